@@ -17,6 +17,8 @@
 #define LOG_NDEBUG 0
 #define LOG_TAG "BootAnimation"
 
+#include <algorithm>
+#include <deque>
 #include <vector>
 
 #include <stdint.h>
@@ -108,6 +110,242 @@ static const int TEXT_MISSING_VALUE = INT_MIN;
 static const char EXIT_PROP_NAME[] = "service.bootanim.exit";
 static const int ANIM_ENTRY_NAME_MAX = ANIM_PATH_MAX + 1;
 static constexpr size_t TEXT_POS_LEN_MAX = 16;
+// Number of decoded frames that may wait for upload. Each one holds a full bitmap.
+static constexpr size_t FRAME_DECODE_AHEAD = 4;
+static const char PKM_EXTENSION[] = ".pkm";
+static const char ASTC_EXTENSION[] = ".astc";
+static constexpr size_t PKM_HEADER_SIZE = 16;
+static constexpr size_t ASTC_HEADER_SIZE = 16;
+static constexpr uint32_t ASTC_MAGIC = 0x5CA1AB13;
+// Compressed texture formats. ETC2 and ASTC are only defined by the GLES 3 headers.
+static constexpr GLenum ETC1_RGB8 = 0x8D64;
+static constexpr GLenum ETC2_RGB8 = 0x9274;
+static constexpr GLenum ETC2_RGB8_PUNCHTHROUGH_ALPHA1 = 0x9276;
+static constexpr GLenum ETC2_RGBA8_EAC = 0x9278;
+static constexpr GLenum ASTC_RGBA_4x4 = 0x93B0;
+
+// ---------------------------------------------------------------------------
+
+static bool isCompressedTexture(const String8& name) {
+    const String8 ext(name.getPathExtension());
+    return strcasecmp(ext.string(), PKM_EXTENSION) == 0 ||
+            strcasecmp(ext.string(), ASTC_EXTENSION) == 0;
+}
+
+struct CompressedTexture {
+    GLenum format;
+    int width;
+    int height;
+    const void* data;
+    GLsizei size;
+};
+
+static uint16_t readBE16(const uint8_t* p) {
+    return (p[0] << 8) | p[1];
+}
+
+static uint32_t readLE24(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16);
+}
+
+// Parses a PKM (ETC1/ETC2) or ASTC file header. The payload is left in place,
+// ready to be handed to glCompressedTexImage2D().
+static bool parseCompressedTexture(const String8& name, FileMap* map,
+        CompressedTexture* texture) {
+    const uint8_t* p = static_cast<const uint8_t*>(map->getDataPtr());
+    const size_t length = map->getDataLength();
+    size_t headerSize = 0;
+    size_t blocks = 0;
+    size_t blockSize = 0;
+
+    if (strcasecmp(name.getPathExtension().string(), PKM_EXTENSION) == 0) {
+        if (length < PKM_HEADER_SIZE || memcmp(p, "PKM ", 4) != 0) {
+            return false;
+        }
+        switch (readBE16(p + 6)) {
+            case 0: texture->format = ETC1_RGB8; blockSize = 8; break;
+            case 1: texture->format = ETC2_RGB8; blockSize = 8; break;
+            case 3: texture->format = ETC2_RGBA8_EAC; blockSize = 16; break;
+            case 4: texture->format = ETC2_RGB8_PUNCHTHROUGH_ALPHA1; blockSize = 8; break;
+            default: return false;
+        }
+        // The header holds the block-aligned size followed by the original size.
+        texture->width = readBE16(p + 12);
+        texture->height = readBE16(p + 14);
+        blocks = ((texture->width + 3) / 4) * ((texture->height + 3) / 4);
+        headerSize = PKM_HEADER_SIZE;
+    } else {
+        if (length < ASTC_HEADER_SIZE || (readLE24(p) | (uint32_t(p[3]) << 24)) != ASTC_MAGIC) {
+            return false;
+        }
+        static const uint8_t kBlockSizes[][2] = {
+            {4, 4}, {5, 4}, {5, 5}, {6, 5}, {6, 6}, {8, 5}, {8, 6},
+            {8, 8}, {10, 5}, {10, 6}, {10, 8}, {10, 10}, {12, 10}, {12, 12},
+        };
+        const int bx = p[4];
+        const int by = p[5];
+        size_t i = 0;
+        while (i < NELEM(kBlockSizes) && (kBlockSizes[i][0] != bx || kBlockSizes[i][1] != by)) {
+            i++;
+        }
+        // Only 2D textures are supported.
+        if (i == NELEM(kBlockSizes) || p[6] != 1) {
+            return false;
+        }
+        texture->format = ASTC_RGBA_4x4 + i;
+        texture->width = readLE24(p + 7);
+        texture->height = readLE24(p + 10);
+        blocks = ((texture->width + bx - 1) / bx) * ((texture->height + by - 1) / by);
+        blockSize = 16;
+        headerSize = ASTC_HEADER_SIZE;
+    }
+
+    if (texture->width == 0 || texture->height == 0 ||
+            length - headerSize < blocks * blockSize) {
+        return false;
+    }
+    texture->data = p + headerSize;
+    texture->size = blocks * blockSize;
+    return true;
+}
+
+
+static void decodeImage(FileMap* map, SkBitmap* bitmap) {
+    sk_sp<SkData> data = SkData::MakeWithoutCopy(map->getDataPtr(),
+            map->getDataLength());
+    sk_sp<SkImage> image = SkImage::MakeFromEncoded(data);
+    if (image == nullptr) {
+        SLOGE("Failed to decode animation image");
+        return;
+    }
+    image->asLegacyBitmap(bitmap, SkImage::kRO_LegacyBitmapMode);
+}
+
+// Decodes the frames of the first play of every part, in playback order, into
+// a bounded queue that the animation thread uploads from. Frames the animation
+// thread skips (e.g. when a part is cut short on exit) are not decoded.
+// Compressed texture frames are not decoded; their pages are only read ahead.
+class BootAnimation::FrameDecoderThread : public Thread {
+public:
+    FrameDecoderThread(std::vector<const Animation::Frame*> frames, size_t depth)
+            : Thread(false), mFrames(std::move(frames)), mDepth(depth) {}
+
+    virtual ~FrameDecoderThread() {
+        for (const Decoded& decoded : mDecoded) {
+            delete decoded.compressed;
+        }
+    }
+
+    // Waits for |frame| to be decoded and hands its pixels over. A compressed
+    // texture frame is handed over as |compressed| instead, which the caller
+    // must delete. Returns false if |frame| is not (or no longer) in the
+    // decode order.
+    bool acquire(const Animation::Frame* frame, SkBitmap* bitmap, FileMap** compressed) {
+        Mutex::Autolock _l(mLock);
+        size_t index = mWanted;
+        while (index < mFrames.size() && mFrames[index] != frame) {
+            index++;
+        }
+        if (index == mFrames.size()) {
+            return false;
+        }
+        mWanted = index;
+        for (;;) {
+            // Anything queued before |frame| was skipped by playback.
+            while (!mDecoded.empty() && mDecoded.front().frame != frame) {
+                delete mDecoded.front().compressed;
+                mDecoded.pop_front();
+            }
+            mCondition.broadcast();
+            if (!mDecoded.empty()) {
+                break;
+            }
+            if (mStopped) {
+                return false;
+            }
+            mCondition.wait(mLock);
+        }
+        *bitmap = mDecoded.front().bitmap;
+        *compressed = mDecoded.front().compressed;
+        mDecoded.pop_front();
+        mWanted = index + 1;
+        mCondition.broadcast();
+        return true;
+    }
+
+    void stop() {
+        {
+            Mutex::Autolock _l(mLock);
+            mStopped = true;
+            mCondition.broadcast();
+        }
+        requestExitAndWait();
+    }
+
+private:
+    struct Decoded {
+        const Animation::Frame* frame;
+        SkBitmap bitmap;
+        FileMap* compressed = nullptr;
+    };
+
+    virtual bool threadLoop() {
+        const Animation::Frame* frame;
+        {
+            Mutex::Autolock _l(mLock);
+            while (!mStopped && mDecoded.size() >= mDepth) {
+                mCondition.wait(mLock);
+            }
+            // FileMap memory is never released until application exit, so
+            // drop the frames playback has already moved past.
+            for (; mNext < mWanted; mNext++) {
+                delete mFrames[mNext]->map;
+            }
+            if (mStopped || mNext == mFrames.size()) {
+                return false;
+            }
+            frame = mFrames[mNext++];
+        }
+
+        Decoded decoded;
+        decoded.frame = frame;
+        if (isCompressedTexture(frame->name)) {
+            frame->map->advise(FileMap::WILLNEED);
+            decoded.compressed = frame->map;
+        } else {
+            decodeImage(frame->map, &decoded.bitmap);
+            delete frame->map;
+        }
+
+        Mutex::Autolock _l(mLock);
+        mDecoded.push_back(std::move(decoded));
+        mCondition.broadcast();
+        return true;
+    }
+
+    const std::vector<const Animation::Frame*> mFrames;
+    const size_t mDepth;
+    Mutex mLock;
+    Condition mCondition;
+    std::deque<Decoded> mDecoded;
+    size_t mNext = 0;    // Index in mFrames of the next frame to decode.
+    size_t mWanted = 0;  // Index in mFrames of the next frame playback needs.
+    bool mStopped = false;
+};
+
+// Collects the frames in the order playAnimation() first shows them.
+static void collectFrames(const BootAnimation::Animation& animation,
+        std::vector<const BootAnimation::Animation::Frame*>* frames) {
+    for (const BootAnimation::Animation::Part& part : animation.parts) {
+        if (part.animation != nullptr) {
+            collectFrames(*part.animation, frames);
+            continue;
+        }
+        for (size_t j = 0; j < part.frames.size(); j++) {
+            frames->push_back(&part.frames[j]);
+        }
+    }
+}
 
 // ---------------------------------------------------------------------------
 
@@ -221,16 +459,50 @@ status_t BootAnimation::initTexture(Texture* texture, AssetManager& assets,
 status_t BootAnimation::initTexture(FileMap* map, int* width, int* height)
 {
     SkBitmap bitmap;
-    sk_sp<SkData> data = SkData::MakeWithoutCopy(map->getDataPtr(),
-            map->getDataLength());
-    sk_sp<SkImage> image = SkImage::MakeFromEncoded(data);
-    image->asLegacyBitmap(&bitmap, SkImage::kRO_LegacyBitmapMode);
+    decodeImage(map, &bitmap);
 
     // FileMap memory is never released until application exit.
     // Release it now as the texture is already loaded and the memory used for
     // the packed resource can be released.
     delete map;
 
+    return initTexture(bitmap, width, height);
+}
+
+status_t BootAnimation::initCompressedTexture(const String8& name, FileMap* map,
+        int* width, int* height)
+{
+    CompressedTexture texture;
+    const bool parsed = parseCompressedTexture(name, map, &texture);
+    if (!parsed) {
+        SLOGE("Invalid compressed texture %s", name.string());
+    } else if (std::find(mCompressedTextureFormats.begin(), mCompressedTextureFormats.end(),
+            static_cast<GLint>(texture.format)) == mCompressedTextureFormats.end()) {
+        SLOGE("Compressed texture format 0x%x of %s is not supported", texture.format,
+                name.string());
+    } else {
+        glCompressedTexImage2D(GL_TEXTURE_2D, 0, texture.format, texture.width, texture.height,
+                0, texture.size, texture.data);
+
+        GLint crop[4] = { 0, texture.height, texture.width, -texture.height };
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_CROP_RECT_OES, crop);
+
+        *width = texture.width;
+        *height = texture.height;
+    }
+
+    // The texture data was read straight out of the mapped zip entry.
+    delete map;
+
+    return parsed ? NO_ERROR : BAD_VALUE;
+}
+
+status_t BootAnimation::initTexture(const SkBitmap& bitmap, int* width, int* height)
+{
+    if (bitmap.empty()) {
+        return NO_INIT;
+    }
+
     const int w = bitmap.width();
     const int h = bitmap.height();
     const void* p = bitmap.getPixels();
@@ -803,6 +1075,9 @@ bool BootAnimation::preloadZip(Animation& animation)
                                 } else if (leaf == "trim.txt") {
                                     part.trimData.setTo((char const*)map->getDataPtr(),
                                                         map->getDataLength());
+                                } else if (leaf == "delta.txt") {
+                                    part.deltaData.setTo((char const*)map->getDataPtr(),
+                                                         map->getDataLength());
                                 } else {
                                     Animation::Frame frame;
                                     frame.name = leaf;
@@ -811,6 +1086,10 @@ bool BootAnimation::preloadZip(Animation& animation)
                                     frame.trimHeight = animation.height;
                                     frame.trimX = 0;
                                     frame.trimY = 0;
+                                    frame.deltaX = 0;
+                                    frame.deltaY = 0;
+                                    frame.tid = 0;
+                                    frame.deltaPixels = nullptr;
                                     part.frames.add(frame);
                                 }
                             }
@@ -849,6 +1128,52 @@ bool BootAnimation::preloadZip(Animation& animation)
         }
     }
 
+    // If there is deltaData present, frames after the first are regions of the full frame.
+    for (Animation::Part& part : animation.parts) {
+        if (part.deltaData.isEmpty()) {
+            continue;
+        }
+        if (!part.trimData.isEmpty()) {
+            SLOGE("Part %s has both trim.txt and delta.txt, ignoring trim.txt",
+                    part.path.string());
+            for (size_t frameIdx = 0; frameIdx < part.frames.size(); frameIdx++) {
+                Animation::Frame& frame(part.frames.editItemAt(frameIdx));
+                frame.trimWidth = animation.width;
+                frame.trimHeight = animation.height;
+                frame.trimX = 0;
+                frame.trimY = 0;
+            }
+        }
+        const char* deltaDataStr = part.deltaData.string();
+        size_t frameIdx = 0;
+        for (; frameIdx < part.frames.size(); frameIdx++) {
+            const char* endl = strstr(deltaDataStr, "\n");
+            if (endl == nullptr) {
+                break;
+            }
+            String8 line(deltaDataStr, endl - deltaDataStr);
+            const char* lineStr = line.string();
+            deltaDataStr = ++endl;
+            int width = 0, height = 0, x = 0, y = 0;
+            if (sscanf(lineStr, "%dx%d+%d+%d", &width, &height, &x, &y) != 4 ||
+                    x < 0 || y < 0 || x + width > animation.width ||
+                    y + height > animation.height ||
+                    (frameIdx == 0 && (width != animation.width ||
+                            height != animation.height))) {
+                SLOGE("Error parsing delta.txt, line: %s", lineStr);
+                break;
+            }
+            Animation::Frame& frame(part.frames.editItemAt(frameIdx));
+            frame.deltaX = x;
+            frame.deltaY = y;
+        }
+        // A frame without a position can't be applied, so play the part as full frames.
+        part.deltaFrames = frameIdx == part.frames.size();
+        if (!part.deltaFrames) {
+            SLOGE("delta.txt of part %s does not cover every frame", part.path.string());
+        }
+    }
+
     zip->endIteration(cookie);
 
     return true;
@@ -897,6 +1222,14 @@ bool BootAnimation::movie()
         }
     }
 
+    // Compressed texture frames can only be uploaded in formats the driver accepts.
+    GLint numCompressedFormats = 0;
+    glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &numCompressedFormats);
+    mCompressedTextureFormats.resize(numCompressedFormats);
+    if (numCompressedFormats > 0) {
+        glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, mCompressedTextureFormats.data());
+    }
+
     // Blend required to draw time on top of animation frames.
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     glShadeModel(GL_FLAT);
@@ -924,7 +1257,18 @@ bool BootAnimation::movie()
         mTimeCheckThread->run("BootAnimation::TimeCheckThread", PRIORITY_NORMAL);
     }
 
+    std::vector<const Animation::Frame*> frames;
+    collectFrames(*mAnimation, &frames);
+    mFrameDecoder = new FrameDecoderThread(std::move(frames), FRAME_DECODE_AHEAD);
+    mFrameDecoder->run("BootAnimation::FrameDecoderThread", PRIORITY_DISPLAY);
+
+    mDroppedFrames = 0;
     playAnimation(*mAnimation);
+    SLOGD("%sAnimation dropped %d frames", mShuttingDown ? "Shutdown" : "Boot",
+            mDroppedFrames);
+
+    mFrameDecoder->stop();
+    mFrameDecoder = nullptr;
 
     if (mTimeCheckThread != nullptr) {
         mTimeCheckThread->requestExit();
@@ -980,7 +1324,9 @@ bool BootAnimation::playAnimation(const Animation& animation)
                 const Animation::Frame& frame(part.frames[j]);
                 nsecs_t lastFrame = systemTime();
 
-                if (r > 0) {
+                if (part.deltaFrames) {
+                    updateDeltaTexture(part, j, r == 0);
+                } else if (r > 0) {
                     glBindTexture(GL_TEXTURE_2D, frame.tid);
                 } else {
                     if (part.count != 1) {
@@ -989,8 +1335,16 @@ bool BootAnimation::playAnimation(const Animation& animation)
                         glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
                         glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
                     }
-                    int w, h;
-                    initTexture(frame.map, &w, &h);
+                    SkBitmap bitmap;
+                    FileMap* compressed = nullptr;
+                    if (mFrameDecoder->acquire(&frame, &bitmap, &compressed)) {
+                        int w, h;
+                        if (compressed != nullptr) {
+                            initCompressedTexture(frame.name, compressed, &w, &h);
+                        } else {
+                            initTexture(bitmap, &w, &h);
+                        }
+                    }
                 }
 
                 const int xc = animationX + frame.trimX;
@@ -1021,6 +1375,10 @@ bool BootAnimation::playAnimation(const Animation& animation)
 
                 nsecs_t now = systemTime();
                 nsecs_t delay = frameDuration - (now - lastFrame);
+                if (delay < 0) {
+                    // Count every frame period this frame overran.
+                    mDroppedFrames += static_cast<int>((now - lastFrame) / frameDuration);
+                }
                 //SLOGD("%lld, %lld", ns2ms(now - lastFrame), ns2ms(delay));
                 lastFrame = now;
 
@@ -1053,6 +1411,8 @@ bool BootAnimation::playAnimation(const Animation& animation)
             for (size_t j = 0; j < fcount; j++) {
                 const Animation::Frame& frame(part.frames[j]);
                 glDeleteTextures(1, &frame.tid);
+                delete frame.deltaPixels;
+                frame.deltaPixels = nullptr;
             }
         }
     }
@@ -1060,6 +1420,61 @@ bool BootAnimation::playAnimation(const Animation& animation)
     return true;
 }
 
+void BootAnimation::updateDeltaTexture(const Animation::Part& part, size_t index,
+        bool firstPlay) {
+    const Animation::Frame& frame(part.frames[index]);
+    // Every frame of the part is drawn from the texture of its first frame. Looping
+    // parts own that texture, other parts update the default texture like full frames.
+    const Animation::Frame& keyFrame(part.frames[0]);
+    if (firstPlay && index == 0 && part.count != 1) {
+        glGenTextures(1, &keyFrame.tid);
+        glBindTexture(GL_TEXTURE_2D, keyFrame.tid);
+        glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    } else {
+        glBindTexture(GL_TEXTURE_2D, keyFrame.tid);
+    }
+
+    SkBitmap bitmap;
+    if (firstPlay) {
+        FileMap* compressed = nullptr;
+        if (!mFrameDecoder->acquire(&frame, &bitmap, &compressed)) {
+            return;
+        }
+        if (compressed != nullptr) {
+            SLOGE("Compressed texture %s can't be a delta frame", frame.name.string());
+            delete compressed;
+            return;
+        }
+        if (part.count != 1) {
+            frame.deltaPixels = new SkBitmap(bitmap);
+        }
+    } else if (frame.deltaPixels != nullptr) {
+        bitmap = *frame.deltaPixels;
+    }
+
+    if (index == 0) {
+        int w, h;
+        initTexture(bitmap, &w, &h);
+        return;
+    }
+
+    switch (bitmap.colorType()) {
+        case kN32_SkColorType:
+            glTexSubImage2D(GL_TEXTURE_2D, 0, frame.deltaX, frame.deltaY,
+                    bitmap.width(), bitmap.height(), GL_RGBA, GL_UNSIGNED_BYTE,
+                    bitmap.getPixels());
+            break;
+        case kRGB_565_SkColorType:
+            glTexSubImage2D(GL_TEXTURE_2D, 0, frame.deltaX, frame.deltaY,
+                    bitmap.width(), bitmap.height(), GL_RGB, GL_UNSIGNED_SHORT_5_6_5,
+                    bitmap.getPixels());
+            break;
+        default:
+            break;
+    }
+}
+
 void BootAnimation::handleViewport(nsecs_t timestep) {
     if (mShuttingDown || !mFlingerSurfaceControl || mTargetInset == 0) {
         return;
@@ -63,7 +63,12 @@ public:
             int trimY;
             int trimWidth;
             int trimHeight;
+            // Position of the frame in the animation if its part uses delta frames.
+            int deltaX;
+            int deltaY;
             mutable GLuint tid;
+            // Pixels kept to replay a delta frame when its part loops.
+            mutable SkBitmap* deltaPixels;
             bool operator < (const Frame& rhs) const {
                 return name < rhs.name;
             }
@@ -79,6 +84,9 @@ public:
                             // the clock is centred on that axis.
             String8 path;
             String8 trimData;
+            String8 deltaData;
+            // Every frame but the first only updates a region of the previous one.
+            bool deltaFrames = false;
             SortedVector<Frame> frames;
             bool playUntilComplete;
             float backgroundColor[3];
@@ -145,8 +153,14 @@ private:
         BootAnimation* mBootAnimation;
     };
 
+    // Decodes animation frames a few steps ahead of playback.
+    class FrameDecoderThread;
+
     status_t initTexture(Texture* texture, AssetManager& asset, const char* name);
     status_t initTexture(FileMap* map, int* width, int* height);
+    status_t initTexture(const SkBitmap& bitmap, int* width, int* height);
+    status_t initCompressedTexture(const String8& name, FileMap* map, int* width, int* height);
+    void updateDeltaTexture(const Animation::Part& part, size_t index, bool firstPlay);
     status_t initFont(Font* font, const char* fallback);
     bool android();
     bool movie();
@@ -174,6 +188,7 @@ private:
     int         mCurrentInset;
     int         mTargetInset;
     bool        mUseNpotTextures = false;
+    std::vector<GLint> mCompressedTextureFormats;
     EGLDisplay  mDisplay;
     EGLDisplay  mContext;
     EGLDisplay  mSurface;
@@ -187,6 +202,8 @@ private:
     String8     mZipFileName;
     SortedVector<String8> mLoadedFiles;
     sp<TimeCheckThread> mTimeCheckThread = nullptr;
+    sp<FrameDecoderThread> mFrameDecoder = nullptr;
+    int         mDroppedFrames = 0;
     sp<Callbacks> mCallbacks;
     Animation* mAnimation = nullptr;
 };
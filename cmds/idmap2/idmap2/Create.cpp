@@ -22,6 +22,7 @@
 #include <ostream>
 #include <sstream>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "idmap2/BinaryStreamVisitor.h"
@@ -99,12 +100,22 @@ Result<Unit> Create(const std::vector<std::string>& args) {
     return Error("failed to load apk %s", overlay_apk_path.c_str());
   }
 
-  const auto idmap = Idmap::FromApkAssets(target_apk_path, *target_apk, overlay_apk_path,
-                                          *overlay_apk, fulfilled_policies, !ignore_overlayable);
+  // Reusing the mapping of the previous idmap only saves time, so it is fine if there is none.
+  std::unique_ptr<const Idmap> previous_idmap;
+  if (auto previous = Idmap::FromFile(idmap_path)) {
+    previous_idmap = std::move(*previous);
+  }
+
+  const auto idmap =
+      Idmap::FromApkAssets(target_apk_path, *target_apk, overlay_apk_path, *overlay_apk,
+                           fulfilled_policies, !ignore_overlayable, previous_idmap.get());
   if (!idmap) {
     return Error(idmap.GetError(), "failed to create idmap");
   }
 
+  // The previous idmap is mapped from the file that is about to be truncated.
+  previous_idmap.reset();
+
   umask(kIdmapFilePermissionMask);
   std::ofstream fout(idmap_path);
   if (fout.fail()) {
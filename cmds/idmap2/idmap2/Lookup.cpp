@@ -16,6 +16,7 @@
 
 #include <algorithm>
 #include <fstream>
+#include <iostream>
 #include <iterator>
 #include <memory>
 #include <ostream>
@@ -53,6 +54,7 @@ using android::StringPiece16;
 using android::base::StringPrintf;
 using android::idmap2::CommandLineOptions;
 using android::idmap2::Error;
+using android::idmap2::Idmap;
 using android::idmap2::IdmapHeader;
 using android::idmap2::ResourceId;
 using android::idmap2::Result;
@@ -85,7 +87,13 @@ Result<ResourceId> WARN_UNUSED ParseResReference(const AssetManager2& am, const
   return Error("failed to obtain resource id for %s", res.c_str());
 }
 
-Result<std::string> WARN_UNUSED GetValue(const AssetManager2& am, ResourceId resid) {
+struct ResolvedValue {
+  ApkAssetsCookie cookie;
+  std::string config;
+  std::string value;
+};
+
+Result<ResolvedValue> WARN_UNUSED GetValue(const AssetManager2& am, ResourceId resid) {
   Res_value value;
   ResTable_config config;
   uint32_t flags;
@@ -94,15 +102,10 @@ Result<std::string> WARN_UNUSED GetValue(const AssetManager2& am, ResourceId res
     return Error("no resource 0x%08x in asset manager", resid);
   }
 
-  std::string out;
-
   // TODO(martenkongstad): use optional parameter GetResource(..., std::string*
   // stacktrace = NULL) instead
-  out.append(StringPrintf("cookie=%d ", cookie));
-
-  out.append("config='");
-  out.append(config.toString().c_str());
-  out.append("' value=");
+  ResolvedValue resolved{cookie, config.toString().c_str(), ""};
+  std::string& out = resolved.value;
 
   switch (value.dataType) {
     case Res_value::TYPE_INT_DEC:
@@ -129,9 +132,76 @@ Result<std::string> WARN_UNUSED GetValue(const AssetManager2& am, ResourceId res
       out.append(StringPrintf("dataType=0x%02x data=0x%08x", value.dataType, value.data));
       break;
   }
+  return resolved;
+}
+
+std::string FormatValue(const ResolvedValue& resolved) {
+  return StringPrintf("cookie=%d config='%s' value=%s", resolved.cookie, resolved.config.c_str(),
+                      resolved.value.c_str());
+}
+
+// Escapes the characters that separate the fields and lines of the machine-readable output.
+std::string EscapeField(const std::string& field) {
+  std::string out;
+  for (char c : field) {
+    switch (c) {
+      case '\\':
+        out.append("\\\\");
+        break;
+      case '\t':
+        out.append("\\t");
+        break;
+      case '\n':
+        out.append("\\n");
+        break;
+      default:
+        out.push_back(c);
+        break;
+    }
+  }
   return out;
 }
 
+Result<ResolvedValue> Resolve(const AssetManager2& am, const std::string& target_package_name,
+                              const std::string& query, ResourceId* out_resid) {
+  const Result<ResourceId> resid = ParseResReference(am, query, target_package_name);
+  if (!resid) {
+    return Error(resid.GetError(), "failed to parse resource ID");
+  }
+  *out_resid = *resid;
+
+  const Result<ResolvedValue> value = GetValue(am, *resid);
+  if (!value) {
+    return Error(value.GetError(), "resource 0x%08x not found", *resid);
+  }
+  return value;
+}
+
+// Looks up `query` and prints one line for it: in the machine-readable format, the tab-separated
+// fields "query ok resid cookie config value" or "query error message".
+Result<Unit> LookupOne(const AssetManager2& am, const std::string& target_package_name,
+                       const std::string& query, bool machine_readable, std::ostream& out) {
+  ResourceId resid = 0;
+  const Result<ResolvedValue> value = Resolve(am, target_package_name, query, &resid);
+
+  if (machine_readable) {
+    out << EscapeField(query) << '\t';
+    if (value) {
+      out << "ok\t" << StringPrintf("0x%08x", resid) << '\t' << value->cookie << '\t'
+          << EscapeField(value->config) << '\t' << EscapeField(value->value) << '\n';
+    } else {
+      out << "error\t" << EscapeField(value.GetErrorMessage()) << '\n';
+    }
+  } else if (value) {
+    out << FormatValue(*value) << '\n';
+  }
+
+  if (!value) {
+    return value.GetError();
+  }
+  return Unit{};
+}
+
 Result<std::string> GetTargetPackageNameFromManifest(const std::string& apk_path) {
   const auto zip = ZipFile::Open(apk_path);
   if (!zip) {
@@ -162,21 +232,35 @@ Result<Unit> Lookup(const std::vector<std::string>& args) {
   std::vector<std::string> idmap_paths;
   std::string config_str;
   std::string resid_str;
+  std::string resid_file;
+  bool machine_readable = false;
 
   const CommandLineOptions opts =
       CommandLineOptions("idmap2 lookup")
           .MandatoryOption("--idmap-path", "input: path to idmap file to load", &idmap_paths)
           .MandatoryOption("--config", "configuration to use", &config_str)
-          .MandatoryOption("--resid",
-                           "Resource ID (in the target package; '0xpptteeee' or "
-                           "'[package:]type/name') to look up",
-                           &resid_str);
+          .OptionalOption("--resid",
+                          "Resource ID (in the target package; '0xpptteeee' or "
+                          "'[package:]type/name') to look up",
+                          &resid_str)
+          .OptionalOption("--resid-file",
+                          "file with one resource ID (like --resid) per line to look up, or '-' "
+                          "for stdin; empty lines and lines starting with '#' are skipped",
+                          &resid_file)
+          .OptionalFlag("--machine-readable",
+                        "print one tab-separated line per resource ID: the ID, then 'ok', the "
+                        "numeric ID, cookie, config and value, or 'error' and the error",
+                        &machine_readable);
 
   const auto opts_ok = opts.Parse(args);
   if (!opts_ok) {
     return opts_ok.GetError();
   }
 
+  if (resid_str.empty() == resid_file.empty()) {
+    return Error("exactly one of --resid and --resid-file must be given");
+  }
+
   ConfigDescription config;
   if (!ConfigDescription::Parse(config_str, &config)) {
     return Error("failed to parse config");
@@ -187,12 +271,11 @@ Result<Unit> Lookup(const std::vector<std::string>& args) {
   std::string target_package_name;
   for (size_t i = 0; i < idmap_paths.size(); i++) {
     const auto& idmap_path = idmap_paths[i];
-    std::fstream fin(idmap_path);
-    auto idmap_header = IdmapHeader::FromBinaryStream(fin);
-    fin.close();
-    if (!idmap_header) {
-      return Error("failed to read idmap from %s", idmap_path.c_str());
+    const auto idmap = Idmap::FromFile(idmap_path);
+    if (!idmap) {
+      return Error(idmap.GetError(), "failed to read idmap from %s", idmap_path.c_str());
     }
+    const std::unique_ptr<const IdmapHeader>& idmap_header = (*idmap)->GetHeader();
 
     if (i == 0) {
       target_path = idmap_header->GetTargetPath().to_string();
@@ -230,16 +313,44 @@ Result<Unit> Lookup(const std::vector<std::string>& args) {
   am.SetApkAssets(raw_pointer_apk_assets);
   am.SetConfiguration(config);
 
-  const Result<ResourceId> resid = ParseResReference(am, resid_str, target_package_name);
-  if (!resid) {
-    return Error(resid.GetError(), "failed to parse resource ID");
+  if (!resid_str.empty()) {
+    const auto lookup_ok =
+        LookupOne(am, target_package_name, resid_str, machine_readable, std::cout);
+    std::cout.flush();
+    return lookup_ok;
   }
 
-  const Result<std::string> value = GetValue(am, *resid);
-  if (!value) {
-    return Error(value.GetError(), "resource 0x%08x not found", *resid);
+  // The asset manager is only set up once for all of the resources of the batch, which are looked
+  // up in order.
+  std::ifstream fin;
+  if (resid_file != "-") {
+    fin.open(resid_file);
+    if (fin.fail()) {
+      return Error("failed to open %s", resid_file.c_str());
+    }
+  }
+  std::istream& in = resid_file == "-" ? std::cin : fin;
+
+  size_t count = 0;
+  size_t failed = 0;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    count++;
+    const auto lookup_ok = LookupOne(am, target_package_name, line, machine_readable, std::cout);
+    if (!lookup_ok) {
+      failed++;
+      if (!machine_readable) {
+        std::cerr << line << ": " << lookup_ok.GetErrorMessage() << std::endl;
+      }
+    }
   }
-  std::cout << *value << std::endl;
+  std::cout.flush();
 
+  if (failed > 0) {
+    return Error("failed to look up %zu of %zu resources", failed, count);
+  }
   return Unit{};
 }
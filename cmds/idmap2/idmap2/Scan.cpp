@@ -15,43 +15,62 @@
  */
 
 #include <dirent.h>
+#include <sys/stat.h>   // umask
+#include <sys/types.h>  // umask
+#include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
 #include <fstream>
+#include <functional>
 #include <memory>
+#include <optional>
 #include <ostream>
 #include <set>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
 #include "Commands.h"
 #include "android-base/properties.h"
+#include "idmap2/BinaryStreamVisitor.h"
 #include "idmap2/CommandLineOptions.h"
 #include "idmap2/FileUtils.h"
+#include "idmap2/FingerprintCache.h"
 #include "idmap2/Idmap.h"
+#include "idmap2/Policies.h"
 #include "idmap2/ResourceUtils.h"
 #include "idmap2/Result.h"
 #include "idmap2/SysTrace.h"
 #include "idmap2/Xml.h"
 #include "idmap2/ZipFile.h"
 
+using android::ApkAssets;
+using android::idmap2::BinaryStreamVisitor;
 using android::idmap2::CommandLineOptions;
 using android::idmap2::Error;
+using android::idmap2::FingerprintCache;
 using android::idmap2::Idmap;
+using android::idmap2::IdmapHeader;
 using android::idmap2::kPolicyOdm;
 using android::idmap2::kPolicyOem;
 using android::idmap2::kPolicyProduct;
 using android::idmap2::kPolicyPublic;
 using android::idmap2::kPolicySystem;
 using android::idmap2::kPolicyVendor;
+using android::idmap2::PoliciesToBitmask;
 using android::idmap2::PolicyBitmask;
 using android::idmap2::PolicyFlags;
 using android::idmap2::Result;
 using android::idmap2::Unit;
 using android::idmap2::utils::ExtractOverlayManifestInfo;
 using android::idmap2::utils::FindFiles;
+using android::idmap2::utils::kIdmapFilePermissionMask;
 using android::idmap2::utils::OverlayManifestInfo;
+using android::idmap2::utils::UidHasWriteAccessToPath;
 
 namespace {
 
@@ -118,6 +137,84 @@ std::vector<std::string> PoliciesForPath(const std::string& apk_path) {
   return fulfilled_policies;
 }
 
+// Calls func(i) for every i in [0, count), spread over as many threads as there are cores.
+void ParallelFor(size_t count, const std::function<void(size_t)>& func) {
+  const size_t thread_count =
+      std::min<size_t>(count, std::max(1U, std::thread::hardware_concurrency()));
+  std::atomic<size_t> next(0);
+  const auto worker = [&]() {
+    for (size_t i = next++; i < count; i = next++) {
+      func(i);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < thread_count; i++) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
+// Same as `idmap2 create`, but against a target that is already loaded, which is shared with the
+// other overlays of the scan. The idmap is written to a temporary file that is then renamed, so
+// that a reader never sees a partial idmap.
+Result<Unit> CreateIdmap(const std::string& target_apk_path, const ApkAssets& target_apk,
+                         const InputOverlay& overlay) {
+  SYSTRACE << "CreateIdmap " << overlay.apk_path;
+  const uid_t uid = getuid();
+  if (!UidHasWriteAccessToPath(uid, overlay.idmap_path)) {
+    return Error("uid %d does not have write access to %s", uid, overlay.idmap_path.c_str());
+  }
+
+  PolicyBitmask fulfilled_policies = 0;
+  auto conv_result = PoliciesToBitmask(overlay.policies);
+  if (conv_result) {
+    fulfilled_policies |= *conv_result;
+  } else {
+    return conv_result.GetError();
+  }
+
+  if (fulfilled_policies == 0) {
+    fulfilled_policies |= PolicyFlags::POLICY_PUBLIC;
+  }
+
+  const std::unique_ptr<const ApkAssets> overlay_apk = ApkAssets::Load(overlay.apk_path);
+  if (!overlay_apk) {
+    return Error("failed to load apk %s", overlay.apk_path.c_str());
+  }
+
+  // Reusing the mapping of the previous idmap only saves time, so it is fine if there is none.
+  std::unique_ptr<const Idmap> previous_idmap;
+  if (auto previous = Idmap::FromFile(overlay.idmap_path)) {
+    previous_idmap = std::move(*previous);
+  }
+
+  const auto idmap =
+      Idmap::FromApkAssets(target_apk_path, target_apk, overlay.apk_path, *overlay_apk,
+                           fulfilled_policies, !overlay.ignore_overlayable, previous_idmap.get());
+  if (!idmap) {
+    return Error(idmap.GetError(), "failed to create idmap");
+  }
+
+  const std::string tmp_path = overlay.idmap_path + "." + std::to_string(getpid()) + ".tmp";
+  std::ofstream fout(tmp_path);
+  if (fout.fail()) {
+    return Error("failed to open idmap path %s", tmp_path.c_str());
+  }
+  BinaryStreamVisitor visitor(fout);
+  (*idmap)->accept(&visitor);
+  fout.close();
+  if (fout.fail() || rename(tmp_path.c_str(), overlay.idmap_path.c_str()) != 0) {
+    unlink(tmp_path.c_str());
+    return Error("failed to write to idmap path %s", overlay.idmap_path.c_str());
+  }
+
+  return Unit{};
+}
+
 }  // namespace
 
 Result<Unit> Scan(const std::vector<std::string>& args) {
@@ -127,6 +224,7 @@ Result<Unit> Scan(const std::vector<std::string>& args) {
   std::string target_apk_path;
   std::string output_directory;
   std::vector<std::string> override_policies;
+  std::string fingerprint_cache_path;
   bool recursive = false;
 
   const CommandLineOptions opts =
@@ -144,7 +242,11 @@ Result<Unit> Scan(const std::vector<std::string>& args) {
               "--override-policy",
               "input: an overlayable policy this overlay fulfills "
               "(if none or supplied, the overlays will not have their policies overriden",
-              &override_policies);
+              &override_policies)
+          .OptionalOption("--fingerprint-cache",
+                          "input/output: path to a database of the apk CRCs, which spares "
+                          "opening the apks that have not changed since they were recorded",
+                          &fingerprint_cache_path);
   const auto opts_ok = opts.Parse(args);
   if (!opts_ok) {
     return opts_ok.GetError();
@@ -155,10 +257,17 @@ Result<Unit> Scan(const std::vector<std::string>& args) {
     return Error(apk_paths.GetError(), "failed to find apk files");
   }
 
+  // Parsing the manifests is mostly spent unzipping and reading each overlay, so do it for all of
+  // them at once.
+  std::vector<std::optional<Result<OverlayManifestInfo>>> overlay_infos((*apk_paths)->size());
+  ParallelFor(overlay_infos.size(), [&](size_t i) {
+    overlay_infos[i] = ExtractOverlayManifestInfo((**apk_paths)[i], /* assert_overlay */ false);
+  });
+
   std::vector<InputOverlay> interesting_apks;
-  for (const std::string& path : **apk_paths) {
-    Result<OverlayManifestInfo> overlay_info =
-        ExtractOverlayManifestInfo(path, /* assert_overlay */ false);
+  for (size_t i = 0; i < overlay_infos.size(); i++) {
+    const std::string& path = (**apk_paths)[i];
+    const Result<OverlayManifestInfo>& overlay_info = *overlay_infos[i];
     if (!overlay_info) {
       return overlay_info.GetError();
     }
@@ -213,30 +322,56 @@ Result<Unit> Scan(const std::vector<std::string>& args) {
         std::lower_bound(interesting_apks.begin(), interesting_apks.end(), input), input);
   }
 
-  std::stringstream stream;
-  for (const auto& overlay : interesting_apks) {
-    if (!Verify(std::vector<std::string>({"--idmap-path", overlay.idmap_path}))) {
-      std::vector<std::string> create_args = {"--target-apk-path",  target_apk_path,
-                                              "--overlay-apk-path", overlay.apk_path,
-                                              "--idmap-path",       overlay.idmap_path};
-      if (overlay.ignore_overlayable) {
-        create_args.emplace_back("--ignore-overlayable");
-      }
+  // All of the overlays have the same target, so it is only loaded once, if any idmap is out of
+  // date, and then shared by the threads that create the idmaps.
+  std::unique_ptr<FingerprintCache> cache;
+  if (!fingerprint_cache_path.empty()) {
+    cache = std::make_unique<FingerprintCache>(fingerprint_cache_path);
+  }
 
-      for (const std::string& policy : overlay.policies) {
-        create_args.emplace_back("--policy");
-        create_args.emplace_back(policy);
-      }
+  std::vector<char> up_to_date(interesting_apks.size());
+  ParallelFor(interesting_apks.size(), [&](size_t i) {
+    std::ifstream fin(interesting_apks[i].idmap_path);
+    const std::unique_ptr<const IdmapHeader> header = IdmapHeader::FromBinaryStream(fin);
+    fin.close();
+    up_to_date[i] = header && header->IsUpToDate(cache.get());
+  });
+
+  if (cache) {
+    const auto save_ok = cache->Save();
+    if (!save_ok) {
+      LOG(WARNING) << save_ok.GetError().GetMessage();
+    }
+  }
 
-      const auto create_ok = Create(create_args);
-      if (!create_ok) {
-        LOG(WARNING) << "failed to create idmap for overlay apk path \"" << overlay.apk_path
-                     << "\": " << create_ok.GetError().GetMessage();
-        continue;
-      }
+  std::vector<char> created(interesting_apks.size());
+  if (std::find(up_to_date.begin(), up_to_date.end(), false) != up_to_date.end()) {
+    const std::unique_ptr<const ApkAssets> target_apk = ApkAssets::Load(target_apk_path);
+    if (!target_apk) {
+      LOG(WARNING) << "failed to create idmaps: failed to load apk " << target_apk_path;
+    } else {
+      umask(kIdmapFilePermissionMask);
+      ParallelFor(interesting_apks.size(), [&](size_t i) {
+        if (up_to_date[i]) {
+          return;
+        }
+        const InputOverlay& overlay = interesting_apks[i];
+        const auto create_ok = CreateIdmap(target_apk_path, *target_apk, overlay);
+        if (!create_ok) {
+          LOG(WARNING) << "failed to create idmap for overlay apk path \"" << overlay.apk_path
+                       << "\": " << create_ok.GetError().GetMessage();
+          return;
+        }
+        created[i] = true;
+      });
     }
+  }
 
-    stream << overlay.idmap_path << std::endl;
+  std::stringstream stream;
+  for (size_t i = 0; i < interesting_apks.size(); i++) {
+    if (up_to_date[i] || created[i]) {
+      stream << interesting_apks[i].idmap_path << std::endl;
+    }
   }
 
   std::cout << stream.str();
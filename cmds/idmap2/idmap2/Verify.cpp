@@ -20,12 +20,14 @@
 #include <vector>
 
 #include "idmap2/CommandLineOptions.h"
+#include "idmap2/FingerprintCache.h"
 #include "idmap2/Idmap.h"
 #include "idmap2/Result.h"
 #include "idmap2/SysTrace.h"
 
 using android::idmap2::CommandLineOptions;
 using android::idmap2::Error;
+using android::idmap2::FingerprintCache;
 using android::idmap2::IdmapHeader;
 using android::idmap2::Result;
 using android::idmap2::Unit;
@@ -33,10 +35,15 @@ using android::idmap2::Unit;
 Result<Unit> Verify(const std::vector<std::string>& args) {
   SYSTRACE << "Verify " << args;
   std::string idmap_path;
+  std::string fingerprint_cache_path;
 
   const CommandLineOptions opts =
       CommandLineOptions("idmap2 verify")
-          .MandatoryOption("--idmap-path", "input: path to idmap file to verify", &idmap_path);
+          .MandatoryOption("--idmap-path", "input: path to idmap file to verify", &idmap_path)
+          .OptionalOption("--fingerprint-cache",
+                          "input/output: path to a database of the apk CRCs, which spares "
+                          "opening the apks that have not changed since they were recorded",
+                          &fingerprint_cache_path);
 
   const auto opts_ok = opts.Parse(args);
   if (!opts_ok) {
@@ -50,7 +57,18 @@ Result<Unit> Verify(const std::vector<std::string>& args) {
     return Error("failed to parse idmap header");
   }
 
-  const auto header_ok = header->IsUpToDate();
+  std::unique_ptr<FingerprintCache> cache;
+  if (!fingerprint_cache_path.empty()) {
+    cache = std::make_unique<FingerprintCache>(fingerprint_cache_path);
+  }
+
+  const auto header_ok = header->IsUpToDate(cache.get());
+  if (cache) {
+    const auto save_ok = cache->Save();
+    if (!save_ok) {
+      LOG(WARNING) << save_ok.GetError().GetMessage();
+    }
+  }
   if (!header_ok) {
     return Error(header_ok.GetError(), "idmap not up to date");
   }
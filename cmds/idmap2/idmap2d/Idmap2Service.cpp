@@ -26,12 +26,14 @@
 #include <memory>
 #include <ostream>
 #include <string>
+#include <utility>
 
 #include "android-base/macros.h"
 #include "android-base/stringprintf.h"
 #include "binder/IPCThreadState.h"
 #include "idmap2/BinaryStreamVisitor.h"
 #include "idmap2/FileUtils.h"
+#include "idmap2/FingerprintCache.h"
 #include "idmap2/Idmap.h"
 #include "idmap2/Policies.h"
 #include "idmap2/SysTrace.h"
@@ -40,11 +42,13 @@
 using android::IPCThreadState;
 using android::binder::Status;
 using android::idmap2::BinaryStreamVisitor;
+using android::idmap2::FingerprintCache;
 using android::idmap2::Idmap;
 using android::idmap2::IdmapHeader;
 using android::idmap2::PolicyBitmask;
 using android::idmap2::utils::kIdmapCacheDir;
 using android::idmap2::utils::kIdmapFilePermissionMask;
+using android::idmap2::utils::kIdmapFingerprintCachePath;
 using android::idmap2::utils::UidHasWriteAccessToPath;
 
 namespace {
@@ -62,6 +66,18 @@ PolicyBitmask ConvertAidlArgToPolicyBitmask(int32_t arg) {
   return static_cast<PolicyBitmask>(arg);
 }
 
+FingerprintCache& GetFingerprintCache() {
+  static FingerprintCache cache(kIdmapFingerprintCachePath);
+  return cache;
+}
+
+void SaveFingerprintCache() {
+  const auto save_ok = GetFingerprintCache().Save();
+  if (!save_ok) {
+    LOG(WARNING) << save_ok.GetErrorMessage();
+  }
+}
+
 }  // namespace
 
 namespace android::os {
@@ -93,19 +109,29 @@ Status Idmap2Service::removeIdmap(const std::string& overlay_apk_path,
   return ok();
 }
 
-Status Idmap2Service::verifyIdmap(const std::string& overlay_apk_path,
-                                  int32_t fulfilled_policies ATTRIBUTE_UNUSED,
-                                  bool enforce_overlayable ATTRIBUTE_UNUSED,
-                                  int32_t user_id ATTRIBUTE_UNUSED, bool* _aidl_return) {
+Status Idmap2Service::verifyIdmap(const std::string& overlay_apk_path, int32_t fulfilled_policies,
+                                  bool enforce_overlayable, int32_t user_id ATTRIBUTE_UNUSED,
+                                  bool* _aidl_return) {
   SYSTRACE << "Idmap2Service::verifyIdmap " << overlay_apk_path;
   assert(_aidl_return);
   const std::string idmap_path = Idmap::CanonicalIdmapPathFor(kIdmapCacheDir, overlay_apk_path);
   std::ifstream fin(idmap_path);
   const std::unique_ptr<const IdmapHeader> header = IdmapHeader::FromBinaryStream(fin);
   fin.close();
-  *_aidl_return = header && header->IsUpToDate();
-
-  // TODO(b/119328308): Check that the set of fulfilled policies of the overlay has not changed
+  FingerprintCache& cache = GetFingerprintCache();
+  bool up_to_date = header && header->IsUpToDate(&cache);
+
+  // The policies are only known for the idmaps created since they were recorded; the older ones
+  // are assumed to still fulfill theirs.
+  // TODO(b/119328308): Record the fulfilled policies in the idmap itself
+  const auto policies = cache.FindPolicies(idmap_path);
+  if (up_to_date && policies &&
+      (policies->fulfilled_policies != ConvertAidlArgToPolicyBitmask(fulfilled_policies) ||
+       policies->enforce_overlayable != enforce_overlayable)) {
+    up_to_date = false;
+  }
+  *_aidl_return = up_to_date;
+  SaveFingerprintCache();
 
   return ok();
 }
@@ -137,12 +163,22 @@ Status Idmap2Service::createIdmap(const std::string& target_apk_path,
     return error("failed to load apk " + overlay_apk_path);
   }
 
-  const auto idmap = Idmap::FromApkAssets(target_apk_path, *target_apk, overlay_apk_path,
-                                          *overlay_apk, policy_bitmask, enforce_overlayable);
+  // Reusing the mapping of the previous idmap only saves time, so it is fine if there is none.
+  std::unique_ptr<const Idmap> previous_idmap;
+  if (auto previous = Idmap::FromFile(idmap_path)) {
+    previous_idmap = std::move(*previous);
+  }
+
+  const auto idmap =
+      Idmap::FromApkAssets(target_apk_path, *target_apk, overlay_apk_path, *overlay_apk,
+                           policy_bitmask, enforce_overlayable, previous_idmap.get());
   if (!idmap) {
     return error(idmap.GetErrorMessage());
   }
 
+  // The previous idmap is mapped from the file that is about to be truncated.
+  previous_idmap.reset();
+
   umask(kIdmapFilePermissionMask);
   std::ofstream fout(idmap_path);
   if (fout.fail()) {
@@ -155,6 +191,9 @@ Status Idmap2Service::createIdmap(const std::string& target_apk_path,
     return error("failed to write to idmap path " + idmap_path);
   }
 
+  GetFingerprintCache().SetPolicies(idmap_path, {policy_bitmask, enforce_overlayable});
+  SaveFingerprintCache();
+
   *_aidl_return = idmap_path;
   return ok();
 }
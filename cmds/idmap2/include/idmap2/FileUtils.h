@@ -27,6 +27,7 @@
 namespace android::idmap2::utils {
 
 constexpr const char* kIdmapCacheDir = "/data/resource-cache";
+constexpr const char* kIdmapFingerprintCachePath = "/data/resource-cache/idmap2d.fingerprints";
 constexpr const mode_t kIdmapFilePermissionMask = 0133;  // u=rw,g=r,o=r
 
 typedef std::function<bool(unsigned char type /* DT_* from dirent.h */, const std::string& path)>
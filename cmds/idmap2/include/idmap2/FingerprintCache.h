@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IDMAP2_INCLUDE_IDMAP2_FINGERPRINTCACHE_H_
+#define IDMAP2_INCLUDE_IDMAP2_FINGERPRINTCACHE_H_
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include "android-base/macros.h"
+#include "idmap2/Policies.h"
+#include "idmap2/Result.h"
+
+namespace android::idmap2 {
+
+// A small database of what verifying an idmap has to know about the files on disk, so that as
+// long as those files do not change, verifying an idmap only needs a stat() of them:
+//
+// - the CRC of each target and overlay apk (see IdmapHeader::IsUpToDate), keyed by its path and
+//   fingerprint, which is the (device, inode, mtime, size) of the file;
+// - the policies each idmap was created with, keyed by the path of the idmap.
+//
+// It is a cache: a missing or corrupt database is the same as an empty one. It is safe to use
+// from several threads.
+class FingerprintCache {
+ public:
+  struct Fingerprint {
+    uint64_t device;
+    uint64_t inode;
+    int64_t mtime_ns;
+    int64_t size;
+
+    bool operator==(const Fingerprint& rhs) const;
+  };
+
+  struct IdmapPolicies {
+    PolicyBitmask fulfilled_policies;
+    bool enforce_overlayable;
+  };
+
+  static Result<Fingerprint> GetFingerprint(const std::string& path);
+
+  // Reads the database at `path`, if there is one.
+  explicit FingerprintCache(const std::string& path);
+
+  // Returns the CRC recorded for the file at `path`, if its fingerprint was `fingerprint`.
+  std::optional<uint32_t> FindCrc(const std::string& path, const Fingerprint& fingerprint) const;
+
+  void SetCrc(const std::string& path, const Fingerprint& fingerprint, uint32_t crc);
+
+  std::optional<IdmapPolicies> FindPolicies(const std::string& idmap_path) const;
+
+  void SetPolicies(const std::string& idmap_path, const IdmapPolicies& policies);
+
+  // Writes the database back, if it changed, after dropping the entries of files that changed or
+  // no longer exist. The file is replaced atomically.
+  Result<Unit> Save();
+
+ private:
+  struct CrcEntry {
+    Fingerprint fingerprint;
+    uint32_t crc;
+  };
+
+  const std::string path_;
+
+  mutable std::mutex lock_;
+  std::map<std::string, CrcEntry> crcs_;
+  std::map<std::string, IdmapPolicies> policies_;
+  bool dirty_ = false;
+
+  DISALLOW_COPY_AND_ASSIGN(FingerprintCache);
+};
+
+}  // namespace android::idmap2
+
+#endif  // IDMAP2_INCLUDE_IDMAP2_FINGERPRINTCACHE_H_
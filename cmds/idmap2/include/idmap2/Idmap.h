@@ -46,6 +46,7 @@
 #ifndef IDMAP2_INCLUDE_IDMAP2_IDMAP_H_
 #define IDMAP2_INCLUDE_IDMAP2_IDMAP_H_
 
+#include <cstring>
 #include <iostream>
 #include <memory>
 #include <string>
@@ -57,8 +58,13 @@
 #include "androidfw/StringPiece.h"
 #include "idmap2/Policies.h"
 
+namespace android::base {
+class MappedFile;
+}  // namespace android::base
+
 namespace android::idmap2 {
 
+class FingerprintCache;
 class Idmap;
 class Visitor;
 
@@ -82,9 +88,19 @@ static constexpr const uint32_t kIdmapCurrentVersion = android::kIdmapCurrentVer
 // terminating null)
 static constexpr const size_t kIdmapStringLength = 256;
 
+// The sizes of the fixed-size parts of an idmap, as encoded in the file.
+static constexpr const size_t kIdmapHeaderSize = 4 * sizeof(uint32_t) + 2 * kIdmapStringLength;
+static constexpr const size_t kIdmapDataHeaderSize = 2 * sizeof(uint16_t);
+static constexpr const size_t kIdmapTypeEntryHeaderSize = 4 * sizeof(uint16_t);
+
+// FromBinaryData() parses an idmap directly out of a buffer, such as an mmapped idmap file, without
+// copying the entries: the objects it returns point into the buffer, which must outlive them.
+// FromBinaryStream() copies what it reads, and its objects do not refer to the stream.
+
 class IdmapHeader {
  public:
   static std::unique_ptr<const IdmapHeader> FromBinaryStream(std::istream& stream);
+  static std::unique_ptr<const IdmapHeader> FromBinaryData(const StringPiece& data);
 
   inline uint32_t GetMagic() const {
     return magic_;
@@ -112,8 +128,10 @@ class IdmapHeader {
 
   // Invariant: anytime the idmap data encoding is changed, the idmap version
   // field *must* be incremented. Because of this, we know that if the idmap
-  // header is up-to-date the entire file is up-to-date.
-  Result<Unit> IsUpToDate() const;
+  // header is up-to-date the entire file is up-to-date. If `cache` is not null, the CRCs of the
+  // target and overlay are looked up in it, and recorded in it, instead of always read from the
+  // zips.
+  Result<Unit> IsUpToDate(FingerprintCache* cache = nullptr) const;
 
   void accept(Visitor* v) const;
 
@@ -137,6 +155,7 @@ class IdmapData {
   class Header {
    public:
     static std::unique_ptr<const Header> FromBinaryStream(std::istream& stream);
+    static std::unique_ptr<const Header> FromBinaryData(const StringPiece& data);
 
     inline PackageId GetTargetPackageId() const {
       return target_package_id_;
@@ -162,6 +181,12 @@ class IdmapData {
   class TypeEntry {
    public:
     static std::unique_ptr<const TypeEntry> FromBinaryStream(std::istream& stream);
+    static std::unique_ptr<const TypeEntry> FromBinaryData(const StringPiece& data);
+
+    // The number of bytes the type entry takes up in the idmap.
+    inline size_t GetEncodedSize() const {
+      return kIdmapTypeEntryHeaderSize + entry_count_ * sizeof(uint32_t);
+    }
 
     inline TypeId GetTargetTypeId() const {
       return target_type_id_;
@@ -172,7 +197,7 @@ class IdmapData {
     }
 
     inline uint16_t GetEntryCount() const {
-      return entries_.size();
+      return entry_count_;
     }
 
     inline uint16_t GetEntryOffset() const {
@@ -180,7 +205,12 @@ class IdmapData {
     }
 
     inline EntryId GetEntry(size_t i) const {
-      return i < entries_.size() ? entries_[i] : 0xffffu;
+      if (i >= entry_count_) {
+        return kNoEntry;
+      }
+      uint32_t value;
+      memcpy(&value, entries_ + i * sizeof(uint32_t), sizeof(uint32_t));
+      return static_cast<EntryId>(dtohl(value));
     }
 
     void accept(Visitor* v) const;
@@ -189,16 +219,25 @@ class IdmapData {
     TypeEntry() {
     }
 
+    // Copies `entries` into owned_entries_, encoded as they are in the idmap.
+    void SetEntries(const std::vector<EntryId>& entries);
+
     TypeId target_type_id_;
     TypeId overlay_type_id_;
     uint16_t entry_offset_;
-    std::vector<EntryId> entries_;
+
+    // The entries, encoded as they are in the idmap: either in the buffer the type entry was
+    // parsed from, or in owned_entries_.
+    const uint8_t* entries_ = nullptr;
+    uint16_t entry_count_ = 0;
+    std::vector<uint8_t> owned_entries_;
 
     friend Idmap;
     DISALLOW_COPY_AND_ASSIGN(TypeEntry);
   };
 
   static std::unique_ptr<const IdmapData> FromBinaryStream(std::istream& stream);
+  static std::unique_ptr<const IdmapData> FromBinaryData(const StringPiece& data);
 
   inline const std::unique_ptr<const Header>& GetHeader() const {
     return header_;
@@ -227,17 +266,30 @@ class Idmap {
                                            const std::string& absolute_apk_path);
 
   static Result<std::unique_ptr<const Idmap>> FromBinaryStream(std::istream& stream);
+  static Result<std::unique_ptr<const Idmap>> FromBinaryData(const StringPiece& data);
+
+  // Maps the idmap file at `path` into memory, and parses it in place. The returned idmap owns the
+  // mapping.
+  static Result<std::unique_ptr<const Idmap>> FromFile(const std::string& path);
+
+  ~Idmap();
 
   // In the current version of idmap, the first package in each resources.arsc
   // file is used; change this in the next version of idmap to use a named
   // package instead; also update FromApkAssets to take additional parameters:
   // the target and overlay package names
+  //
+  // If `previous_idmap` is the idmap that was created for the same target before the overlay
+  // changed, its mapping is reused for the overlay resources that still have the same resource ID
+  // and name, so that only the resources that were added or renamed have to be looked up by name
+  // in the target. `previous_idmap` is ignored if the target has changed since it was created.
   static Result<std::unique_ptr<const Idmap>> FromApkAssets(const std::string& target_apk_path,
                                                             const ApkAssets& target_apk_assets,
                                                             const std::string& overlay_apk_path,
                                                             const ApkAssets& overlay_apk_assets,
                                                             const PolicyBitmask& fulfilled_policies,
-                                                            bool enforce_overlayable);
+                                                            bool enforce_overlayable,
+                                                            const Idmap* previous_idmap = nullptr);
 
   inline const std::unique_ptr<const IdmapHeader>& GetHeader() const {
     return header_;
@@ -253,9 +305,15 @@ class Idmap {
   Idmap() {
   }
 
+  static Result<std::unique_ptr<Idmap>> ParseBinaryData(const StringPiece& data);
+
   std::unique_ptr<const IdmapHeader> header_;
   std::vector<std::unique_ptr<const IdmapData>> data_;
 
+  // What the data blocks point into, if the idmap was not parsed out of a caller's buffer.
+  std::vector<char> buffer_;
+  std::unique_ptr<const base::MappedFile> mapped_file_;
+
   DISALLOW_COPY_AND_ASSIGN(Idmap);
 };
 
@@ -0,0 +1,245 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "idmap2/FingerprintCache.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "idmap2/FileUtils.h"
+
+namespace android::idmap2 {
+
+namespace {
+
+constexpr uint32_t kFingerprintCacheMagic = 0x43504649;  // IFPC
+constexpr uint32_t kFingerprintCacheVersion = 0x00000001;
+
+// The database never leaves the device, so it is in host byte order.
+template <typename T>
+void Append(const T& value, std::string* out) {
+  out->append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void AppendString(const std::string& str, std::string* out) {
+  Append(static_cast<uint32_t>(str.size()), out);
+  out->append(str);
+}
+
+// Reads consecutive values out of the database, failing once it runs out of data.
+class Reader {
+ public:
+  explicit Reader(const std::string& data) : data_(data) {
+  }
+
+  template <typename T>
+  bool Read(T* out_value) {
+    if (data_.size() - position_ < sizeof(T)) {
+      return false;
+    }
+    memcpy(out_value, data_.data() + position_, sizeof(T));
+    position_ += sizeof(T);
+    return true;
+  }
+
+  bool ReadString(std::string* out_str) {
+    uint32_t size;
+    if (!Read(&size) || data_.size() - position_ < size) {
+      return false;
+    }
+    out_str->assign(data_, position_, size);
+    position_ += size;
+    return true;
+  }
+
+  bool AtEnd() const {
+    return position_ == data_.size();
+  }
+
+ private:
+  const std::string& data_;
+  size_t position_ = 0U;
+};
+
+}  // namespace
+
+bool FingerprintCache::Fingerprint::operator==(const Fingerprint& rhs) const {
+  return device == rhs.device && inode == rhs.inode && mtime_ns == rhs.mtime_ns &&
+         size == rhs.size;
+}
+
+Result<FingerprintCache::Fingerprint> FingerprintCache::GetFingerprint(const std::string& path) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) {
+    return Error("failed to stat %s: %s", path.c_str(), strerror(errno));
+  }
+  return Fingerprint{static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino),
+                     st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec,
+                     static_cast<int64_t>(st.st_size)};
+}
+
+FingerprintCache::FingerprintCache(const std::string& path) : path_(path) {
+  const std::unique_ptr<std::string> data = utils::ReadFile(path);
+  if (!data || data->empty()) {
+    return;
+  }
+
+  Reader reader(*data);
+  uint32_t magic;
+  uint32_t version;
+  uint32_t crc_count;
+  uint32_t policies_count;
+  if (!reader.Read(&magic) || magic != kFingerprintCacheMagic || !reader.Read(&version) ||
+      version != kFingerprintCacheVersion || !reader.Read(&crc_count) ||
+      !reader.Read(&policies_count)) {
+    dirty_ = true;
+    return;
+  }
+
+  std::map<std::string, CrcEntry> crcs;
+  for (uint32_t i = 0; i < crc_count; i++) {
+    std::string entry_path;
+    CrcEntry entry;
+    if (!reader.ReadString(&entry_path) || !reader.Read(&entry.fingerprint.device) ||
+        !reader.Read(&entry.fingerprint.inode) || !reader.Read(&entry.fingerprint.mtime_ns) ||
+        !reader.Read(&entry.fingerprint.size) || !reader.Read(&entry.crc)) {
+      dirty_ = true;
+      return;
+    }
+    crcs.emplace(std::move(entry_path), entry);
+  }
+
+  std::map<std::string, IdmapPolicies> policies;
+  for (uint32_t i = 0; i < policies_count; i++) {
+    std::string idmap_path;
+    IdmapPolicies entry;
+    uint8_t enforce_overlayable;
+    if (!reader.ReadString(&idmap_path) || !reader.Read(&entry.fulfilled_policies) ||
+        !reader.Read(&enforce_overlayable)) {
+      dirty_ = true;
+      return;
+    }
+    entry.enforce_overlayable = enforce_overlayable != 0U;
+    policies.emplace(std::move(idmap_path), entry);
+  }
+
+  if (!reader.AtEnd()) {
+    dirty_ = true;
+    return;
+  }
+  crcs_ = std::move(crcs);
+  policies_ = std::move(policies);
+}
+
+std::optional<uint32_t> FingerprintCache::FindCrc(const std::string& path,
+                                                  const Fingerprint& fingerprint) const {
+  std::lock_guard<std::mutex> lock(lock_);
+  const auto iter = crcs_.find(path);
+  if (iter == crcs_.end() || !(iter->second.fingerprint == fingerprint)) {
+    return {};
+  }
+  return iter->second.crc;
+}
+
+void FingerprintCache::SetCrc(const std::string& path, const Fingerprint& fingerprint,
+                              uint32_t crc) {
+  std::lock_guard<std::mutex> lock(lock_);
+  crcs_[path] = CrcEntry{fingerprint, crc};
+  dirty_ = true;
+}
+
+std::optional<FingerprintCache::IdmapPolicies> FingerprintCache::FindPolicies(
+    const std::string& idmap_path) const {
+  std::lock_guard<std::mutex> lock(lock_);
+  const auto iter = policies_.find(idmap_path);
+  if (iter == policies_.end()) {
+    return {};
+  }
+  return iter->second;
+}
+
+void FingerprintCache::SetPolicies(const std::string& idmap_path, const IdmapPolicies& policies) {
+  std::lock_guard<std::mutex> lock(lock_);
+  policies_[idmap_path] = policies;
+  dirty_ = true;
+}
+
+Result<Unit> FingerprintCache::Save() {
+  std::lock_guard<std::mutex> lock(lock_);
+  for (auto iter = crcs_.begin(); iter != crcs_.end();) {
+    const auto fingerprint = GetFingerprint(iter->first);
+    if (!fingerprint || !(*fingerprint == iter->second.fingerprint)) {
+      iter = crcs_.erase(iter);
+      dirty_ = true;
+    } else {
+      ++iter;
+    }
+  }
+  for (auto iter = policies_.begin(); iter != policies_.end();) {
+    if (access(iter->first.c_str(), F_OK) != 0) {
+      iter = policies_.erase(iter);
+      dirty_ = true;
+    } else {
+      ++iter;
+    }
+  }
+  if (!dirty_) {
+    return Unit{};
+  }
+
+  std::string data;
+  Append(kFingerprintCacheMagic, &data);
+  Append(kFingerprintCacheVersion, &data);
+  Append(static_cast<uint32_t>(crcs_.size()), &data);
+  Append(static_cast<uint32_t>(policies_.size()), &data);
+  for (const auto& entry : crcs_) {
+    AppendString(entry.first, &data);
+    Append(entry.second.fingerprint.device, &data);
+    Append(entry.second.fingerprint.inode, &data);
+    Append(entry.second.fingerprint.mtime_ns, &data);
+    Append(entry.second.fingerprint.size, &data);
+    Append(entry.second.crc, &data);
+  }
+  for (const auto& entry : policies_) {
+    AppendString(entry.first, &data);
+    Append(entry.second.fulfilled_policies, &data);
+    Append(static_cast<uint8_t>(entry.second.enforce_overlayable ? 1U : 0U), &data);
+  }
+
+  const std::string tmp_path = path_ + "." + std::to_string(getpid()) + ".tmp";
+  std::ofstream fout(tmp_path, std::ios::binary);
+  if (fout.fail()) {
+    return Error("failed to open fingerprint cache %s", tmp_path.c_str());
+  }
+  fout.write(data.data(), data.size());
+  fout.close();
+  if (fout.fail() || rename(tmp_path.c_str(), path_.c_str()) != 0) {
+    unlink(tmp_path.c_str());
+    return Error("failed to write fingerprint cache %s", path_.c_str());
+  }
+  dirty_ = false;
+  return Unit{};
+}
+
+}  // namespace android::idmap2
@@ -16,20 +16,30 @@
 
 #include "idmap2/Idmap.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #include <algorithm>
+#include <cerrno>
+#include <cstring>
 #include <iostream>
 #include <iterator>
 #include <limits>
 #include <map>
 #include <memory>
+#include <optional>
 #include <set>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "android-base/macros.h"
+#include "android-base/mapped_file.h"
 #include "android-base/stringprintf.h"
+#include "android-base/unique_fd.h"
 #include "androidfw/AssetManager2.h"
+#include "idmap2/FingerprintCache.h"
 #include "idmap2/ResourceUtils.h"
 #include "idmap2/Result.h"
 #include "idmap2/SysTrace.h"
@@ -45,6 +55,8 @@ namespace {
 
 #define EXTRACT_ENTRY(resid) (0x0000ffff & (resid))
 
+#define RESID(pkg, type, entry) (((pkg) << 24) | ((type) << 16) | (entry))
+
 class MatchingResources {
  public:
   void Add(ResourceId target_resid, ResourceId overlay_resid) {
@@ -65,36 +77,68 @@ class MatchingResources {
   std::map<TypeId, std::set<std::pair<ResourceId, ResourceId>>> map_;
 };
 
-bool WARN_UNUSED Read16(std::istream& stream, uint16_t* out) {
-  uint16_t value;
-  if (stream.read(reinterpret_cast<char*>(&value), sizeof(uint16_t))) {
-    *out = dtohl(value);
+// Reads consecutive values out of an encoded idmap, failing once it runs out of data.
+class BinaryReader {
+ public:
+  explicit BinaryReader(const StringPiece& data) : data_(data) {
+  }
+
+  bool WARN_UNUSED Read16(uint16_t* out) {
+    uint16_t value;
+    if (!ReadBytes(&value, sizeof(uint16_t))) {
+      return false;
+    }
+    *out = dtohs(value);
     return true;
   }
-  return false;
-}
 
-bool WARN_UNUSED Read32(std::istream& stream, uint32_t* out) {
-  uint32_t value;
-  if (stream.read(reinterpret_cast<char*>(&value), sizeof(uint32_t))) {
+  bool WARN_UNUSED Read32(uint32_t* out) {
+    uint32_t value;
+    if (!ReadBytes(&value, sizeof(uint32_t))) {
+      return false;
+    }
     *out = dtohl(value);
     return true;
   }
-  return false;
-}
 
-// a string is encoded as a kIdmapStringLength char array; the array is always null-terminated
-bool WARN_UNUSED ReadString(std::istream& stream, char out[kIdmapStringLength]) {
-  char buf[kIdmapStringLength];
-  memset(buf, 0, sizeof(buf));
-  if (!stream.read(buf, sizeof(buf))) {
-    return false;
+  // a string is encoded as a kIdmapStringLength char array; the array is always null-terminated
+  bool WARN_UNUSED ReadString(char out[kIdmapStringLength]) {
+    const uint8_t* buf = Skip(kIdmapStringLength);
+    if (buf == nullptr || buf[kIdmapStringLength - 1] != '\0') {
+      return false;
+    }
+    memcpy(out, buf, kIdmapStringLength);
+    return true;
   }
-  if (buf[sizeof(buf) - 1] != '\0') {
-    return false;
+
+  // Returns the next `size` bytes of the data, without copying them, or nullptr.
+  const uint8_t* WARN_UNUSED Skip(size_t size) {
+    if (data_.size() - position_ < size) {
+      return nullptr;
+    }
+    const uint8_t* result = reinterpret_cast<const uint8_t*>(data_.data()) + position_;
+    position_ += size;
+    return result;
   }
-  memcpy(out, buf, sizeof(buf));
-  return true;
+
+ private:
+  bool ReadBytes(void* out, size_t size) {
+    const uint8_t* buf = Skip(size);
+    if (buf == nullptr) {
+      return false;
+    }
+    memcpy(out, buf, size);
+    return true;
+  }
+
+  StringPiece data_;
+  size_t position_ = 0U;
+};
+
+// Reads exactly `size` bytes out of `stream` into `out`.
+bool WARN_UNUSED ReadFromStream(std::istream& stream, size_t size, std::string* out) {
+  out->resize(size);
+  return static_cast<bool>(stream.read(&(*out)[0], size));
 }
 
 ResourceId NameToResid(const AssetManager2& am, const std::string& name) {
@@ -127,22 +171,95 @@ Result<uint32_t> GetCrc(const ZipFile& zip) {
              : Error("failed to get CRC for \"%s\"", a ? "AndroidManifest.xml" : "resources.arsc");
 }
 
+// Only opens the zip if the cache has no CRC for the current fingerprint of the file.
+Result<uint32_t> GetCrc(const std::string& zip_path, const char* what, FingerprintCache* cache) {
+  std::optional<FingerprintCache::Fingerprint> fingerprint;
+  if (cache != nullptr) {
+    auto result = FingerprintCache::GetFingerprint(zip_path);
+    if (result) {
+      fingerprint = *result;
+      const std::optional<uint32_t> crc = cache->FindCrc(zip_path, *fingerprint);
+      if (crc) {
+        return *crc;
+      }
+    }
+  }
+
+  const std::unique_ptr<const ZipFile> zip = ZipFile::Open(zip_path);
+  if (!zip) {
+    return Error("failed to open %s %s", what, zip_path.c_str());
+  }
+
+  Result<uint32_t> crc = GetCrc(*zip);
+  if (!crc) {
+    return Error("failed to get %s crc", what);
+  }
+
+  if (fingerprint) {
+    cache->SetCrc(zip_path, *fingerprint, *crc);
+  }
+  return crc;
+}
+
+// Returns the overlay resource ID -> target resource ID mapping of `previous_idmap`, or an empty
+// mapping if it was not created against the same target package.
+std::map<ResourceId, ResourceId> GetPreviousMapping(const Idmap& previous_idmap,
+                                                    const std::string& target_apk_path,
+                                                    uint32_t target_crc,
+                                                    PackageId target_package_id,
+                                                    PackageId overlay_package_id) {
+  std::map<ResourceId, ResourceId> mapping;
+  const IdmapHeader& header = *previous_idmap.GetHeader();
+  if (header.GetTargetCrc() != target_crc || header.GetTargetPath() != target_apk_path) {
+    return mapping;
+  }
+
+  for (const auto& data : previous_idmap.GetData()) {
+    if (data->GetHeader()->GetTargetPackageId() != target_package_id) {
+      continue;
+    }
+    for (const auto& type : data->GetTypeEntries()) {
+      for (uint16_t i = 0; i < type->GetEntryCount(); i++) {
+        const EntryId overlay_entry = type->GetEntry(i);
+        if (overlay_entry == kNoEntry) {
+          continue;
+        }
+        const ResourceId target_resid = RESID(target_package_id, type->GetTargetTypeId(),
+                                              type->GetEntryOffset() + i);
+        const ResourceId overlay_resid =
+            RESID(overlay_package_id, type->GetOverlayTypeId(), overlay_entry);
+        mapping.emplace(overlay_resid, target_resid);
+      }
+    }
+  }
+  return mapping;
+}
+
 }  // namespace
 
 std::unique_ptr<const IdmapHeader> IdmapHeader::FromBinaryStream(std::istream& stream) {
+  std::string buf;
+  if (!ReadFromStream(stream, kIdmapHeaderSize, &buf)) {
+    return nullptr;
+  }
+  return FromBinaryData(buf);
+}
+
+std::unique_ptr<const IdmapHeader> IdmapHeader::FromBinaryData(const StringPiece& data) {
   std::unique_ptr<IdmapHeader> idmap_header(new IdmapHeader());
 
-  if (!Read32(stream, &idmap_header->magic_) || !Read32(stream, &idmap_header->version_) ||
-      !Read32(stream, &idmap_header->target_crc_) || !Read32(stream, &idmap_header->overlay_crc_) ||
-      !ReadString(stream, idmap_header->target_path_) ||
-      !ReadString(stream, idmap_header->overlay_path_)) {
+  BinaryReader reader(data);
+  if (!reader.Read32(&idmap_header->magic_) || !reader.Read32(&idmap_header->version_) ||
+      !reader.Read32(&idmap_header->target_crc_) || !reader.Read32(&idmap_header->overlay_crc_) ||
+      !reader.ReadString(idmap_header->target_path_) ||
+      !reader.ReadString(idmap_header->overlay_path_)) {
     return nullptr;
   }
 
   return std::move(idmap_header);
 }
 
-Result<Unit> IdmapHeader::IsUpToDate() const {
+Result<Unit> IdmapHeader::IsUpToDate(FingerprintCache* cache) const {
   if (magic_ != kIdmapMagic) {
     return Error("bad magic: actual 0x%08x, expected 0x%08x", magic_, kIdmapMagic);
   }
@@ -151,14 +268,9 @@ Result<Unit> IdmapHeader::IsUpToDate() const {
     return Error("bad version: actual 0x%08x, expected 0x%08x", version_, kIdmapCurrentVersion);
   }
 
-  const std::unique_ptr<const ZipFile> target_zip = ZipFile::Open(target_path_);
-  if (!target_zip) {
-    return Error("failed to open target %s", GetTargetPath().to_string().c_str());
-  }
-
-  Result<uint32_t> target_crc = GetCrc(*target_zip);
+  Result<uint32_t> target_crc = GetCrc(target_path_, "target", cache);
   if (!target_crc) {
-    return Error("failed to get target crc");
+    return target_crc.GetError();
   }
 
   if (target_crc_ != *target_crc) {
@@ -166,14 +278,9 @@ Result<Unit> IdmapHeader::IsUpToDate() const {
                  *target_crc);
   }
 
-  const std::unique_ptr<const ZipFile> overlay_zip = ZipFile::Open(overlay_path_);
-  if (!overlay_zip) {
-    return Error("failed to open overlay %s", GetOverlayPath().to_string().c_str());
-  }
-
-  Result<uint32_t> overlay_crc = GetCrc(*overlay_zip);
+  Result<uint32_t> overlay_crc = GetCrc(overlay_path_, "overlay", cache);
   if (!overlay_crc) {
-    return Error("failed to get overlay crc");
+    return overlay_crc.GetError();
   }
 
   if (overlay_crc_ != *overlay_crc) {
@@ -185,10 +292,20 @@ Result<Unit> IdmapHeader::IsUpToDate() const {
 }
 
 std::unique_ptr<const IdmapData::Header> IdmapData::Header::FromBinaryStream(std::istream& stream) {
+  std::string buf;
+  if (!ReadFromStream(stream, kIdmapDataHeaderSize, &buf)) {
+    return nullptr;
+  }
+  return FromBinaryData(buf);
+}
+
+std::unique_ptr<const IdmapData::Header> IdmapData::Header::FromBinaryData(
+    const StringPiece& data) {
   std::unique_ptr<IdmapData::Header> idmap_data_header(new IdmapData::Header());
 
+  BinaryReader reader(data);
   uint16_t target_package_id16;
-  if (!Read16(stream, &target_package_id16) || !Read16(stream, &idmap_data_header->type_count_)) {
+  if (!reader.Read16(&target_package_id16) || !reader.Read16(&idmap_data_header->type_count_)) {
     return nullptr;
   }
   idmap_data_header->target_package_id_ = target_package_id16;
@@ -198,25 +315,62 @@ std::unique_ptr<const IdmapData::Header> IdmapData::Header::FromBinaryStream(std
 
 std::unique_ptr<const IdmapData::TypeEntry> IdmapData::TypeEntry::FromBinaryStream(
     std::istream& stream) {
+  std::string buf;
+  if (!ReadFromStream(stream, kIdmapTypeEntryHeaderSize, &buf)) {
+    return nullptr;
+  }
+  uint16_t entry_count;
+  memcpy(&entry_count, &buf[2 * sizeof(uint16_t)], sizeof(uint16_t));
+  std::string entries;
+  if (!ReadFromStream(stream, dtohs(entry_count) * sizeof(uint32_t), &entries)) {
+    return nullptr;
+  }
+  buf.append(entries);
+
+  // Copy the entries, as they won't outlive the stream data.
+  std::unique_ptr<const TypeEntry> view = FromBinaryData(buf);
+  if (!view) {
+    return nullptr;
+  }
   std::unique_ptr<IdmapData::TypeEntry> data(new IdmapData::TypeEntry());
+  data->target_type_id_ = view->target_type_id_;
+  data->overlay_type_id_ = view->overlay_type_id_;
+  data->entry_offset_ = view->entry_offset_;
+  data->owned_entries_.assign(view->entries_, view->entries_ + entries.size());
+  data->entries_ = data->owned_entries_.data();
+  data->entry_count_ = view->entry_count_;
+  return std::move(data);
+}
+
+std::unique_ptr<const IdmapData::TypeEntry> IdmapData::TypeEntry::FromBinaryData(
+    const StringPiece& data) {
+  std::unique_ptr<IdmapData::TypeEntry> type(new IdmapData::TypeEntry());
+
+  BinaryReader reader(data);
   uint16_t target_type16;
   uint16_t overlay_type16;
-  uint16_t entry_count;
-  if (!Read16(stream, &target_type16) || !Read16(stream, &overlay_type16) ||
-      !Read16(stream, &entry_count) || !Read16(stream, &data->entry_offset_)) {
+  if (!reader.Read16(&target_type16) || !reader.Read16(&overlay_type16) ||
+      !reader.Read16(&type->entry_count_) || !reader.Read16(&type->entry_offset_)) {
     return nullptr;
   }
-  data->target_type_id_ = target_type16;
-  data->overlay_type_id_ = overlay_type16;
-  for (uint16_t i = 0; i < entry_count; i++) {
-    ResourceId resid;
-    if (!Read32(stream, &resid)) {
-      return nullptr;
-    }
-    data->entries_.push_back(resid);
+  type->target_type_id_ = target_type16;
+  type->overlay_type_id_ = overlay_type16;
+  type->entries_ = reader.Skip(type->entry_count_ * sizeof(uint32_t));
+  if (type->entries_ == nullptr) {
+    return nullptr;
   }
 
-  return std::move(data);
+  return std::move(type);
+}
+
+void IdmapData::TypeEntry::SetEntries(const std::vector<EntryId>& entries) {
+  owned_entries_.resize(entries.size() * sizeof(uint32_t));
+  for (size_t i = 0; i < entries.size(); i++) {
+    const uint32_t value = htodl(static_cast<uint32_t>(entries[i]));
+    memcpy(&owned_entries_[i * sizeof(uint32_t)], &value, sizeof(uint32_t));
+  }
+  entries_ = owned_entries_.data();
+  entry_count_ = entries.size();
 }
 
 std::unique_ptr<const IdmapData> IdmapData::FromBinaryStream(std::istream& stream) {
@@ -235,6 +389,25 @@ std::unique_ptr<const IdmapData> IdmapData::FromBinaryStream(std::istream& strea
   return std::move(data);
 }
 
+std::unique_ptr<const IdmapData> IdmapData::FromBinaryData(const StringPiece& data) {
+  std::unique_ptr<IdmapData> idmap_data(new IdmapData());
+  idmap_data->header_ = IdmapData::Header::FromBinaryData(data);
+  if (!idmap_data->header_) {
+    return nullptr;
+  }
+  size_t offset = kIdmapDataHeaderSize;
+  for (size_t type_count = 0; type_count < idmap_data->header_->GetTypeCount(); type_count++) {
+    std::unique_ptr<const TypeEntry> type =
+        IdmapData::TypeEntry::FromBinaryData(data.substr(offset, data.size() - offset));
+    if (!type) {
+      return nullptr;
+    }
+    offset += type->GetEncodedSize();
+    idmap_data->type_entries_.push_back(std::move(type));
+  }
+  return std::move(idmap_data);
+}
+
 std::string Idmap::CanonicalIdmapPathFor(const std::string& absolute_dir,
                                          const std::string& absolute_apk_path) {
   assert(absolute_dir.size() > 0 && absolute_dir[0] == "/");
@@ -244,28 +417,81 @@ std::string Idmap::CanonicalIdmapPathFor(const std::string& absolute_dir,
   return absolute_dir + "/" + copy + "@idmap";
 }
 
+Idmap::~Idmap() {
+}
+
 Result<std::unique_ptr<const Idmap>> Idmap::FromBinaryStream(std::istream& stream) {
   SYSTRACE << "Idmap::FromBinaryStream";
+  std::vector<char> buffer{std::istreambuf_iterator<char>(stream),
+                           std::istreambuf_iterator<char>()};
+  auto idmap = ParseBinaryData(StringPiece(buffer.data(), buffer.size()));
+  if (!idmap) {
+    return idmap.GetError();
+  }
+
+  // The data blocks point into the buffer; moving a vector keeps its contents where they are.
+  (*idmap)->buffer_ = std::move(buffer);
+  return {std::move(*idmap)};
+}
+
+Result<std::unique_ptr<const Idmap>> Idmap::FromBinaryData(const StringPiece& data) {
+  SYSTRACE << "Idmap::FromBinaryData";
+  auto idmap = ParseBinaryData(data);
+  if (!idmap) {
+    return idmap.GetError();
+  }
+  return {std::move(*idmap)};
+}
+
+Result<std::unique_ptr<Idmap>> Idmap::ParseBinaryData(const StringPiece& data) {
   std::unique_ptr<Idmap> idmap(new Idmap());
 
-  idmap->header_ = IdmapHeader::FromBinaryStream(stream);
+  idmap->header_ = IdmapHeader::FromBinaryData(data);
   if (!idmap->header_) {
     return Error("failed to parse idmap header");
   }
 
   // idmap version 0x01 does not specify the number of data blocks that follow
   // the idmap header; assume exactly one data block
+  size_t offset = kIdmapHeaderSize;
   for (int i = 0; i < 1; i++) {
-    std::unique_ptr<const IdmapData> data = IdmapData::FromBinaryStream(stream);
-    if (!data) {
+    std::unique_ptr<const IdmapData> idmap_data =
+        IdmapData::FromBinaryData(data.substr(offset, data.size() - offset));
+    if (!idmap_data) {
       return Error("failed to parse data block %d", i);
     }
-    idmap->data_.push_back(std::move(data));
+    idmap->data_.push_back(std::move(idmap_data));
   }
 
   return {std::move(idmap)};
 }
 
+Result<std::unique_ptr<const Idmap>> Idmap::FromFile(const std::string& path) {
+  SYSTRACE << "Idmap::FromFile " << path;
+  base::unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC)));
+  if (fd < 0) {
+    return Error("failed to open %s: %s", path.c_str(), strerror(errno));
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    return Error("failed to stat %s: %s", path.c_str(), strerror(errno));
+  }
+
+  std::unique_ptr<base::MappedFile> mapped_file =
+      base::MappedFile::FromFd(fd, 0, static_cast<size_t>(st.st_size), PROT_READ);
+  if (!mapped_file) {
+    return Error("failed to map %s: %s", path.c_str(), strerror(errno));
+  }
+
+  auto idmap = ParseBinaryData(StringPiece(mapped_file->data(), mapped_file->size()));
+  if (!idmap) {
+    return idmap.GetError();
+  }
+  (*idmap)->mapped_file_ = std::move(mapped_file);
+  return {std::move(*idmap)};
+}
+
 std::string ConcatPolicies(const std::vector<std::string>& policies) {
   std::string message;
   for (const std::string& policy : policies) {
@@ -324,7 +550,8 @@ Result<std::unique_ptr<const Idmap>> Idmap::FromApkAssets(const std::string& tar
                                                           const std::string& overlay_apk_path,
                                                           const ApkAssets& overlay_apk_assets,
                                                           const PolicyBitmask& fulfilled_policies,
-                                                          bool enforce_overlayable) {
+                                                          bool enforce_overlayable,
+                                                          const Idmap* previous_idmap) {
   SYSTRACE << "Idmap::FromApkAssets";
   AssetManager2 target_asset_manager;
   if (!target_asset_manager.SetApkAssets({&target_apk_assets}, true, false)) {
@@ -404,6 +631,16 @@ Result<std::unique_ptr<const Idmap>> Idmap::FromApkAssets(const std::string& tar
   std::unique_ptr<Idmap> idmap(new Idmap());
   idmap->header_ = std::move(header);
 
+  // Looking a name up in the target is what dominates the cost of creating an idmap, as it scans
+  // the key string pool of the type. A mapping of the previous idmap is only a hint: it is used if
+  // the target resource still has the same name as the overlay resource, which is cheap to check.
+  std::map<ResourceId, ResourceId> previous_mapping;
+  if (previous_idmap != nullptr) {
+    previous_mapping =
+        GetPreviousMapping(*previous_idmap, target_apk_path, idmap->header_->GetTargetCrc(),
+                           target_pkg->GetPackageId(), overlay_pkg->GetPackageId());
+  }
+
   // find the resources that exist in both packages
   MatchingResources matching_resources;
   const auto end = overlay_pkg->end();
@@ -416,7 +653,18 @@ Result<std::unique_ptr<const Idmap>> Idmap::FromApkAssets(const std::string& tar
     // prepend "<package>:" to turn name into "<package>:<type>/<name>"
     const std::string full_name =
         base::StringPrintf("%s:%s", target_pkg->GetPackageName().c_str(), name->c_str());
-    const ResourceId target_resid = NameToResid(target_asset_manager, full_name);
+    ResourceId target_resid = 0;
+    const auto previous = previous_mapping.find(overlay_resid);
+    if (previous != previous_mapping.end()) {
+      Result<std::string> target_name =
+          utils::ResToTypeEntryName(target_asset_manager, previous->second);
+      if (target_name && *target_name == *name) {
+        target_resid = previous->second;
+      }
+    }
+    if (target_resid == 0) {
+      target_resid = NameToResid(target_asset_manager, full_name);
+    }
     if (target_resid == 0) {
       continue;
     }
@@ -449,15 +697,17 @@ Result<std::unique_ptr<const Idmap>> Idmap::FromApkAssets(const std::string& tar
     type->target_type_id_ = EXTRACT_TYPE(ei->first);
     type->overlay_type_id_ = EXTRACT_TYPE(ei->second);
     type->entry_offset_ = EXTRACT_ENTRY(ei->first);
+    std::vector<EntryId> entries;
     EntryId last_target_entry = kNoEntry;
     for (; ei != ti->second.cend(); ++ei) {
       if (last_target_entry != kNoEntry) {
         int count = EXTRACT_ENTRY(ei->first) - last_target_entry - 1;
-        type->entries_.insert(type->entries_.end(), count, kNoEntry);
+        entries.insert(entries.end(), count, kNoEntry);
       }
-      type->entries_.push_back(EXTRACT_ENTRY(ei->second));
+      entries.push_back(EXTRACT_ENTRY(ei->second));
       last_target_entry = EXTRACT_ENTRY(ei->first);
     }
+    type->SetEntries(entries);
     data->type_entries_.push_back(std::move(type));
   }
 
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unistd.h>
+
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include "TestHelpers.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "idmap2/BinaryStreamVisitor.h"
+#include "idmap2/FingerprintCache.h"
+#include "idmap2/Idmap.h"
+
+using ::testing::NotNull;
+
+namespace android::idmap2 {
+
+TEST_F(Idmap2Tests, FingerprintCacheSaveAndLoad) {
+  const std::string cache_path = GetTempDirPath() + "/fingerprints";
+  {
+    std::ofstream fout(GetIdmapPath());
+  }
+
+  const auto fingerprint = FingerprintCache::GetFingerprint(GetTargetApkPath());
+  ASSERT_TRUE(fingerprint);
+  {
+    FingerprintCache cache(cache_path);
+    ASSERT_FALSE(cache.FindCrc(GetTargetApkPath(), *fingerprint));
+    cache.SetCrc(GetTargetApkPath(), *fingerprint, 0x12345678U);
+    cache.SetPolicies(GetIdmapPath(), {PolicyFlags::POLICY_PUBLIC, true});
+    ASSERT_TRUE(cache.Save());
+  }
+
+  FingerprintCache cache(cache_path);
+  const auto crc = cache.FindCrc(GetTargetApkPath(), *fingerprint);
+  ASSERT_TRUE(crc);
+  ASSERT_EQ(*crc, 0x12345678U);
+
+  FingerprintCache::Fingerprint changed = *fingerprint;
+  changed.size++;
+  ASSERT_FALSE(cache.FindCrc(GetTargetApkPath(), changed));
+
+  const auto policies = cache.FindPolicies(GetIdmapPath());
+  ASSERT_TRUE(policies);
+  ASSERT_EQ(policies->fulfilled_policies, PolicyFlags::POLICY_PUBLIC);
+  ASSERT_TRUE(policies->enforce_overlayable);
+
+  unlink(cache_path.c_str());
+  unlink(GetIdmapPath().c_str());
+}
+
+TEST_F(Idmap2Tests, FingerprintCacheIgnoresCorruptFile) {
+  const std::string cache_path = GetTempDirPath() + "/fingerprints";
+  {
+    std::ofstream fout(cache_path);
+    fout << "not a fingerprint cache";
+  }
+
+  FingerprintCache cache(cache_path);
+  const auto fingerprint = FingerprintCache::GetFingerprint(GetTargetApkPath());
+  ASSERT_TRUE(fingerprint);
+  ASSERT_FALSE(cache.FindCrc(GetTargetApkPath(), *fingerprint));
+
+  unlink(cache_path.c_str());
+}
+
+TEST_F(Idmap2Tests, FingerprintCacheIsUpToDate) {
+  fclose(stderr);  // silence expected warnings from libandroidfw
+
+  std::unique_ptr<const ApkAssets> target_apk = ApkAssets::Load(GetTargetApkPath());
+  ASSERT_THAT(target_apk, NotNull());
+  std::unique_ptr<const ApkAssets> overlay_apk = ApkAssets::Load(GetOverlayApkPath());
+  ASSERT_THAT(overlay_apk, NotNull());
+
+  auto result = Idmap::FromApkAssets(GetTargetApkPath(), *target_apk, GetOverlayApkPath(),
+                                     *overlay_apk, PolicyFlags::POLICY_PUBLIC,
+                                     /* enforce_overlayable */ true);
+  ASSERT_TRUE(result);
+  std::stringstream stream;
+  BinaryStreamVisitor visitor(stream);
+  (*result)->accept(&visitor);
+  std::unique_ptr<const IdmapHeader> header = IdmapHeader::FromBinaryStream(stream);
+  ASSERT_THAT(header, NotNull());
+
+  // The first check reads the CRCs from the zips and records them.
+  FingerprintCache cache(GetTempDirPath() + "/fingerprints");
+  ASSERT_TRUE(header->IsUpToDate(&cache));
+  const auto fingerprint = FingerprintCache::GetFingerprint(GetTargetApkPath());
+  ASSERT_TRUE(fingerprint);
+  const auto crc = cache.FindCrc(GetTargetApkPath(), *fingerprint);
+  ASSERT_TRUE(crc);
+  ASSERT_EQ(*crc, header->GetTargetCrc());
+
+  // The next ones trust the recorded CRCs as long as the files are unchanged.
+  cache.SetCrc(GetTargetApkPath(), *fingerprint, header->GetTargetCrc() + 1);
+  ASSERT_FALSE(header->IsUpToDate(&cache));
+}
+
+}  // namespace android::idmap2
@@ -331,6 +331,69 @@ TEST_F(Idmap2BinaryTests, Lookup) {
   unlink(GetIdmapPath().c_str());
 }
 
+TEST_F(Idmap2BinaryTests, LookupBatch) {
+  SKIP_TEST_IF_CANT_EXEC_IDMAP2;
+
+  // clang-format off
+  auto result = ExecuteBinary({"idmap2",
+                               "create",
+                               "--target-apk-path", GetTargetApkPath(),
+                               "--overlay-apk-path", GetOverlayApkPath(),
+                               "--idmap-path", GetIdmapPath()});
+  // clang-format on
+  ASSERT_THAT(result, NotNull());
+  ASSERT_EQ(result->status, EXIT_SUCCESS) << result->stderr;
+
+  const std::string resid_path = GetTempDirPath() + "/resids";
+  {
+    std::ofstream fout(resid_path);
+    fout << "# string/str1 twice\n"
+         << "0x7f02000c\n"
+         << "\n"
+         << "test.target:string/str1\n";
+  }
+
+  // clang-format off
+  result = ExecuteBinary({"idmap2",
+                          "lookup",
+                          "--idmap-path", GetIdmapPath(),
+                          "--config", "",
+                          "--resid-file", resid_path,
+                          "--machine-readable"});
+  // clang-format on
+  ASSERT_THAT(result, NotNull());
+  ASSERT_EQ(result->status, EXIT_SUCCESS) << result->stderr;
+  std::istringstream lines(result->stdout);
+  std::string line;
+  ASSERT_TRUE(std::getline(lines, line));
+  ASSERT_EQ(line.find("0x7f02000c\tok\t0x7f02000c\t"), 0U) << line;
+  ASSERT_NE(line.find("\toverlay-1"), std::string::npos) << line;
+  ASSERT_TRUE(std::getline(lines, line));
+  ASSERT_EQ(line.find("test.target:string/str1\tok\t0x7f02000c\t"), 0U) << line;
+  ASSERT_FALSE(std::getline(lines, line));
+
+  {
+    std::ofstream fout(resid_path);
+    fout << "test.target:string/does-not-exist\n";
+  }
+
+  // clang-format off
+  result = ExecuteBinary({"idmap2",
+                          "lookup",
+                          "--idmap-path", GetIdmapPath(),
+                          "--config", "",
+                          "--resid-file", resid_path,
+                          "--machine-readable"});
+  // clang-format on
+  ASSERT_THAT(result, NotNull());
+  ASSERT_NE(result->status, EXIT_SUCCESS);
+  ASSERT_EQ(result->stdout.find("test.target:string/does-not-exist\terror\t"), 0U)
+      << result->stdout;
+
+  unlink(resid_path.c_str());
+  unlink(GetIdmapPath().c_str());
+}
+
 TEST_F(Idmap2BinaryTests, InvalidCommandLineOptions) {
   SKIP_TEST_IF_CANT_EXEC_IDMAP2;
 
@@ -169,6 +169,43 @@ TEST(IdmapTests, GracefullyFailToCreateIdmapFromCorruptBinaryStream) {
   ASSERT_FALSE(result);
 }
 
+TEST(IdmapTests, CreateIdmapFromBinaryData) {
+  const StringPiece raw(reinterpret_cast<const char*>(idmap_raw_data), idmap_raw_data_len);
+
+  auto result = Idmap::FromBinaryData(raw);
+  ASSERT_TRUE(result);
+  const auto idmap = std::move(*result);
+
+  ASSERT_THAT(idmap->GetHeader(), NotNull());
+  ASSERT_EQ(idmap->GetHeader()->GetTargetCrc(), 0x1234U);
+  ASSERT_EQ(idmap->GetHeader()->GetOverlayPath().to_string(), "overlay.apk");
+
+  ASSERT_EQ(idmap->GetData().size(), 1U);
+  const std::vector<std::unique_ptr<const IdmapData::TypeEntry>>& types =
+      idmap->GetData()[0]->GetTypeEntries();
+  ASSERT_EQ(types.size(), 2U);
+
+  ASSERT_EQ(types[0]->GetEntryCount(), 1U);
+  ASSERT_EQ(types[0]->GetEncodedSize(), 12U);
+  ASSERT_EQ(types[0]->GetEntry(0), 0x0000U);
+
+  ASSERT_EQ(types[1]->GetTargetTypeId(), 0x03U);
+  ASSERT_EQ(types[1]->GetEntryCount(), 3U);
+  ASSERT_EQ(types[1]->GetEntryOffset(), 3U);
+  ASSERT_EQ(types[1]->GetEntry(0), 0x0000U);
+  ASSERT_EQ(types[1]->GetEntry(1), kNoEntry);
+  ASSERT_EQ(types[1]->GetEntry(2), 0x0001U);
+  ASSERT_EQ(types[1]->GetEntry(3), kNoEntry);
+}
+
+TEST(IdmapTests, GracefullyFailToCreateIdmapFromTruncatedBinaryData) {
+  // cut off in the header, the data header, and the entries of the last type
+  for (size_t size : {10U, 0x212U, 0x233U}) {
+    const StringPiece raw(reinterpret_cast<const char*>(idmap_raw_data), size);
+    ASSERT_FALSE(Idmap::FromBinaryData(raw)) << size;
+  }
+}
+
 void CreateIdmap(const StringPiece& target_apk_path, const StringPiece& overlay_apk_path,
                  const PolicyBitmask& fulfilled_policies, bool enforce_overlayable,
                  std::unique_ptr<const Idmap>* out_idmap) {
@@ -486,6 +523,59 @@ TEST(IdmapTests, FailToCreateIdmapFromApkAssetsIfPathTooLong) {
   ASSERT_FALSE(result);
 }
 
+std::string SerializeIdmap(const Idmap& idmap) {
+  std::stringstream stream;
+  BinaryStreamVisitor visitor(stream);
+  idmap.accept(&visitor);
+  return stream.str();
+}
+
+// An idmap created from a previous idmap must be the same as one created from scratch, even if the
+// previous idmap maps the resources of a different overlay.
+TEST(IdmapTests, CreateIdmapFromApkAssetsWithPreviousIdmap) {
+  const std::string target_apk_path(GetTestDataPath() + "/target/target.apk");
+  std::unique_ptr<const ApkAssets> target_apk = ApkAssets::Load(target_apk_path);
+  ASSERT_THAT(target_apk, NotNull());
+
+  const std::string overlay_apk_path(GetTestDataPath() + "/overlay/overlay.apk");
+  std::unique_ptr<const ApkAssets> overlay_apk = ApkAssets::Load(overlay_apk_path);
+  ASSERT_THAT(overlay_apk, NotNull());
+
+  const std::string system_overlay_apk_path(GetTestDataPath() +
+                                            "/system-overlay/system-overlay.apk");
+  std::unique_ptr<const ApkAssets> system_overlay_apk = ApkAssets::Load(system_overlay_apk_path);
+  ASSERT_THAT(system_overlay_apk, NotNull());
+
+  const PolicyBitmask policies = PolicyFlags::POLICY_SYSTEM_PARTITION | PolicyFlags::POLICY_PUBLIC;
+  const auto overlay_idmap =
+      Idmap::FromApkAssets(target_apk_path, *target_apk, overlay_apk_path, *overlay_apk, policies,
+                           /* enforce_overlayable */ true);
+  ASSERT_TRUE(overlay_idmap);
+
+  const auto system_overlay_idmap =
+      Idmap::FromApkAssets(target_apk_path, *target_apk, system_overlay_apk_path,
+                           *system_overlay_apk, policies, /* enforce_overlayable */ true);
+  ASSERT_TRUE(system_overlay_idmap);
+
+  auto result = Idmap::FromApkAssets(target_apk_path, *target_apk, overlay_apk_path, *overlay_apk,
+                                     policies, /* enforce_overlayable */ true,
+                                     overlay_idmap->get());
+  ASSERT_TRUE(result);
+  ASSERT_EQ(SerializeIdmap(**result), SerializeIdmap(**overlay_idmap));
+
+  result = Idmap::FromApkAssets(target_apk_path, *target_apk, system_overlay_apk_path,
+                                *system_overlay_apk, policies, /* enforce_overlayable */ true,
+                                overlay_idmap->get());
+  ASSERT_TRUE(result);
+  ASSERT_EQ(SerializeIdmap(**result), SerializeIdmap(**system_overlay_idmap));
+
+  result = Idmap::FromApkAssets(target_apk_path, *target_apk, overlay_apk_path, *overlay_apk,
+                                policies, /* enforce_overlayable */ true,
+                                system_overlay_idmap->get());
+  ASSERT_TRUE(result);
+  ASSERT_EQ(SerializeIdmap(**result), SerializeIdmap(**overlay_idmap));
+}
+
 TEST(IdmapTests, IdmapHeaderIsUpToDate) {
   fclose(stderr);  // silence expected warnings from libandroidfw
 
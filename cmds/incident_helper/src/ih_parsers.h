@@ -0,0 +1,29 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INCIDENT_HELPER_PARSERS_H
+#define INCIDENT_HELPER_PARSERS_H
+
+#include "TextParserBase.h"
+
+/**
+ * Returns a new parser for the section, which the caller owns. Sections without a
+ * specific parser get a NoopParser. Used by incident_helper itself, and by incidentd
+ * to parse sections without running incident_helper.
+ */
+TextParserBase* selectParser(int section);
+
+#endif // INCIDENT_HELPER_PARSERS_H
@@ -19,6 +19,7 @@
 #include "ih_util.h"
 
 #include <algorithm>
+#include <cstring>
 #include <sstream>
 #include <unistd.h>
 
@@ -30,12 +31,23 @@ bool isValidChar(char c) {
         || (v == (uint8_t)'_');
 }
 
-std::string trim(const std::string& s, const std::string& charset) {
-    const auto head = s.find_first_not_of(charset);
-    if (head == std::string::npos) return "";
+// Narrows [*begin, *end) of s to exclude the leading and trailing chars in the charset.
+static inline void trimRange(const char* s, size_t* begin, size_t* end,
+        const std::string& charset) {
+    while (*begin < *end && charset.find(s[*begin]) != std::string::npos) (*begin)++;
+    while (*end > *begin && charset.find(s[*end - 1]) != std::string::npos) (*end)--;
+}
 
-    const auto tail = s.find_last_not_of(charset);
-    return s.substr(head, tail - head + 1);
+// Returns the chars of s in [begin, end), trimmed with the charset, without copying the
+// untrimmed chars first.
+static inline std::string trimmedSubstr(const std::string& s, size_t begin, size_t end,
+        const std::string& charset) {
+    trimRange(s.data(), &begin, &end, charset);
+    return s.substr(begin, end - begin);
+}
+
+std::string trim(const std::string& s, const std::string& charset) {
+    return trimmedSubstr(s, 0, s.size(), charset);
 }
 
 static inline std::string toLowerStr(const std::string& s) {
@@ -44,33 +56,31 @@ static inline std::string toLowerStr(const std::string& s) {
     return res;
 }
 
-static inline std::string trimDefault(const std::string& s) {
-    return trim(s, DEFAULT_WHITESPACE);
-}
-
-static inline std::string trimHeader(const std::string& s) {
-    return toLowerStr(trimDefault(s));
-}
-
 static inline bool isNumber(const std::string& s) {
     std::string::const_iterator it = s.begin();
     while (it != s.end() && std::isdigit(*it)) ++it;
     return !s.empty() && it == s.end();
 }
 
-// This is similiar to Split in android-base/file.h, but it won't add empty string
-static void split(const std::string& line, std::vector<std::string>& words,
-        const trans_func& func, const std::string& delimiters) {
+// This is similiar to Split in android-base/file.h, but it won't add empty string.
+// The words are trimmed of the default whitespace, and lower cased if toLower is set. Each
+// word is only copied once, into the vector.
+static void split(const std::string& line, std::vector<std::string>& words, bool toLower,
+        const std::string& delimiters) {
     words.clear();  // clear the buffer before split
 
     size_t base = 0;
     size_t found;
     while (true) {
         found = line.find_first_of(delimiters, base);
-        if (found != base) {
-            std::string word = (*func) (line.substr(base, found - base));
-            if (!word.empty()) {
-                words.push_back(word);
+        size_t begin = base;
+        size_t end = found == line.npos ? line.size() : found;
+        trimRange(line.data(), &begin, &end, DEFAULT_WHITESPACE);
+        if (begin != end) {
+            words.emplace_back(line, begin, end - begin);
+            if (toLower) {
+                std::string& word = words.back();
+                std::transform(word.begin(), word.end(), word.begin(), ::tolower);
             }
         }
         if (found == line.npos) break;
@@ -80,15 +90,13 @@ static void split(const std::string& line, std::vector<std::string>& words,
 
 header_t parseHeader(const std::string& line, const std::string& delimiters) {
     header_t header;
-    trans_func f = &trimHeader;
-    split(line, header, f, delimiters);
+    split(line, header, true, delimiters);
     return header;
 }
 
 record_t parseRecord(const std::string& line, const std::string& delimiters) {
     record_t record;
-    trans_func f = &trimDefault;
-    split(line, record, f, delimiters);
+    split(line, record, false, delimiters);
     return record;
 }
 
@@ -136,7 +144,7 @@ record_t parseRecordByColumns(const std::string& line, const std::vector<int>& i
             return record;
         }
         while (idx < lineSize && delimiters.find(line[idx++]) == std::string::npos);
-        record.push_back(trimDefault(line.substr(lastIndex, idx - lastIndex)));
+        record.push_back(trimmedSubstr(line, lastIndex, idx, DEFAULT_WHITESPACE));
         lastBeginning = lastIndex;
         lastIndex = idx;
     }
@@ -148,7 +156,7 @@ record_t parseRecordByColumns(const std::string& line, const std::vector<int>& i
             record.pop_back();
             beginning = lastBeginning;
         }
-        record.push_back(trimDefault(line.substr(beginning, lineSize - beginning)));
+        record.push_back(trimmedSubstr(line, beginning, lineSize, DEFAULT_WHITESPACE));
     }
     return record;
 }
@@ -183,7 +191,7 @@ bool stripPrefix(std::string* line, const char* key, bool endAtDelimiter) {
         if (j == len || isValidChar(line->at(j))) return false;
     }
 
-    line->assign(trimDefault(line->substr(j)));
+    line->assign(trimmedSubstr(*line, j, len, DEFAULT_WHITESPACE));
     return true;
 }
 
@@ -204,7 +212,7 @@ bool stripSuffix(std::string* line, const char* key, bool endAtDelimiter) {
         if (j < 0 || isValidChar(line->at(j))) return false;
     }
 
-    line->assign(trimDefault(line->substr(0, j+1)));
+    line->assign(trimmedSubstr(*line, 0, j + 1, DEFAULT_WHITESPACE));
     return true;
 }
 
@@ -236,28 +244,33 @@ double toDouble(const std::string& s) {
 // ==============================================================================
 Reader::Reader(const int fd)
 {
-    mFile = fdopen(fd, "r");
+    // Read through a duplicate, so that closing the file leaves fd to its owner.
+    const int dupFd = dup(fd);
+    mFile = dupFd < 0 ? nullptr : fdopen(dupFd, "r");
+    if (mFile == nullptr && dupFd >= 0) close(dupFd);
     mStatus = mFile == nullptr ? "Invalid fd " + std::to_string(fd) : "";
 }
 
 Reader::~Reader()
 {
     if (mFile != nullptr) fclose(mFile);
+    free(mBuffer);
 }
 
 bool Reader::readLine(std::string* line) {
     if (mFile == nullptr) return false;
 
-    char* buf = nullptr;
-    size_t len = 0;
-    ssize_t read = getline(&buf, &len, mFile);
+    // The buffer is kept across lines, so that it is only reallocated for longer lines.
+    ssize_t read = getline(&mBuffer, &mBufferSize, mFile);
     if (read != -1) {
-        std::string s(buf);
-        line->assign(trim(s, DEFAULT_NEWLINE));
+        // Like a C string, the line ends at the first NUL.
+        size_t begin = 0;
+        size_t end = strnlen(mBuffer, read);
+        trimRange(mBuffer, &begin, &end, DEFAULT_NEWLINE);
+        line->assign(mBuffer + begin, end - begin);
     } else if (errno == EINVAL) {
         mStatus = "Bad Argument";
     }
-    free(buf);
     return read != -1;
 }
 
@@ -118,6 +118,8 @@ public:
 private:
     FILE* mFile;
     std::string mStatus;
+    char* mBuffer = nullptr;
+    size_t mBufferSize = 0;
 };
 
 /**
@@ -168,6 +168,22 @@ TEST(IhUtilTest, Reader) {
     ASSERT_TRUE(r.ok(&line));
 }
 
+TEST(IhUtilTest, ReaderShorterLineAfterLongerLine) {
+    TemporaryFile tf;
+    ASSERT_NE(tf.fd, -1);
+    const string longLine(1000, 'x');
+    ASSERT_TRUE(WriteStringToFile(longLine + "\r\nab\r\n", tf.path));
+
+    Reader r(tf.fd);
+    string line;
+    ASSERT_TRUE(r.readLine(&line));
+    EXPECT_THAT(line, StrEq(longLine));
+    ASSERT_TRUE(r.readLine(&line));
+    EXPECT_THAT(line, StrEq("ab"));
+    ASSERT_FALSE(r.readLine(&line));
+    ASSERT_TRUE(r.ok(&line));
+}
+
 TEST(IhUtilTest, ReaderEmpty) {
     TemporaryFile tf;
     ASSERT_NE(tf.fd, -1);
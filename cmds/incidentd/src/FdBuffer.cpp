@@ -149,7 +149,10 @@ status_t FdBuffer::readProcessedDataInStream(int fd, unique_fd toFd, unique_fd f
     fcntl(toFd.get(), F_SETFL, fcntl(toFd.get(), F_GETFL, 0) | O_NONBLOCK);
     fcntl(fromFd.get(), F_SETFL, fcntl(fromFd.get(), F_GETFL, 0) | O_NONBLOCK);
 
-    // A circular buffer holds data read from fd and writes to parsing process
+    // Data is spliced from fd into the pipe to the parsing process, so it never has to be
+    // copied in and out of user space.  If fd doesn't support splice, e.g. some procfs and
+    // sysfs files, a circular buffer holds data read from fd and writes to parsing process.
+    bool canSplice = true;
     uint8_t cirBuf[BUFFER_SIZE];
     size_t cirSize = 0;
     int rpos = 0, wpos = 0;
@@ -196,8 +199,26 @@ status_t FdBuffer::readProcessedDataInStream(int fd, unique_fd toFd, unique_fd f
             }
         }
 
+        // splice from fd to parsing process
+        if (canSplice && pfds[0].fd != -1 && pfds[1].fd != -1) {
+            ssize_t amt = TEMP_FAILURE_RETRY(splice(fd, NULL, toFd.get(), NULL, BUFFER_SIZE,
+                                                    SPLICE_F_MOVE | SPLICE_F_NONBLOCK));
+            if (amt < 0) {
+                if (errno == EINVAL || errno == ENOSYS) {
+                    VLOG("fd %d doesn't support splice, copying instead", fd);
+                    canSplice = false;
+                } else if (!(errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    VLOG("Fail to splice fd %d to toFd %d: %s", fd, toFd.get(), strerror(errno));
+                    return -errno;
+                }  // otherwise just continue
+            } else if (amt == 0) {
+                VLOG("Reached EOF of input file %d", fd);
+                pfds[0].fd = -1;  // reach EOF so don't have to poll pfds[0].
+            }
+        }
+
         // read from fd
-        if (cirSize != BUFFER_SIZE && pfds[0].fd != -1) {
+        if (!canSplice && cirSize != BUFFER_SIZE && pfds[0].fd != -1) {
             ssize_t amt;
             if (rpos >= wpos) {
                 amt = TEMP_FAILURE_RETRY(::read(fd, cirBuf + rpos, BUFFER_SIZE - rpos));
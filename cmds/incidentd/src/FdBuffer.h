@@ -56,6 +56,7 @@ public:
      * reads original data in 'fd' and writes to parsing process through 'toFd', then it reads
      * and stores the processed data from 'fromFd' in memory for later usage.
      * This function behaves in a streaming fashion in order to save memory usage.
+     * The original data is spliced into 'toFd' when 'fd' supports it, and copied otherwise.
      * Returns NO_ERROR if there were no errors or if we timed out.
      *
      * Poll will return POLLERR if fd is from sysfs, handle this edge case.
@@ -45,6 +45,7 @@ enum {
 
 #define DEFAULT_BYTES_SIZE_LIMIT (96 * 1024 * 1024)        // 96MB
 #define DEFAULT_REFACTORY_PERIOD_MS (24 * 60 * 60 * 1000)  // 1 Day
+#define DEFAULT_BUCKET_SIZE_LIMIT (24 * 1024 * 1024)       // 24MB per uid and privacy policy
 
 // Skip these sections (for dumpstate only)
 // Skip logs (1100 - 1108) and traces (1200 - 1202) because they are already in the bug report.
@@ -148,8 +149,8 @@ void ReportHandler::handleMessage(const Message& message) {
     }
 }
 
-void ReportHandler::schedulePersistedReport(const IncidentReportArgs& args) {
-    mBatch->addPersistedReport(args);
+void ReportHandler::schedulePersistedReport(const IncidentReportArgs& args, uid_t uid) {
+    mBatch->addPersistedReport(args, uid);
     mHandlerLooper->removeMessages(this, WHAT_TAKE_REPORT);
     mHandlerLooper->sendMessage(this, Message(WHAT_TAKE_REPORT));
 }
@@ -199,7 +200,7 @@ void ReportHandler::take_report() {
     // persisted reqeusts, but changing Reporter::runReport() to track that individually
     // will be a big change.
     if (batch->hasPersistedReports()) {
-        mThrottler->addReportSize(reportByteSize);
+        mThrottler->addReportSize(batch, reportByteSize);
     }
 
     // Kick off the next steps, one of which is to send any new or otherwise remaining
@@ -233,7 +234,8 @@ void ReportHandler::send_broadcasts() {
 
 // ================================================================================
 IncidentService::IncidentService(const sp<Looper>& handlerLooper) {
-    mThrottler = new Throttler(DEFAULT_BYTES_SIZE_LIMIT, DEFAULT_REFACTORY_PERIOD_MS);
+    mThrottler = new Throttler(DEFAULT_BYTES_SIZE_LIMIT, DEFAULT_BUCKET_SIZE_LIMIT,
+            DEFAULT_REFACTORY_PERIOD_MS);
     mWorkDirectory = new WorkDirectory();
     mBroadcaster = new Broadcaster(mWorkDirectory);
     mHandler = new ReportHandler(mWorkDirectory, mBroadcaster, handlerLooper,
@@ -272,7 +274,7 @@ Status IncidentService::reportIncident(const IncidentReportArgs& args) {
         argsCopy.setReceiverCls(DROPBOX_SENTINEL.getClassName());
     }
 
-    mHandler->schedulePersistedReport(argsCopy);
+    mHandler->schedulePersistedReport(argsCopy, IPCThreadState::self()->getCallingUid());
 
     return Status::ok();
 }
@@ -492,6 +494,27 @@ status_t IncidentService::onTransact(uint32_t code, const Parcel& data, Parcel*
     }
 }
 
+status_t IncidentService::dump(int fd, const Vector<String16>& /*args*/) {
+    if (!checkCallingPermission(DUMP_PERMISSION)) {
+        dprintf(fd, "Permission Denial: can't dump incidentd from pid=%d, uid=%d\n",
+                IPCThreadState::self()->getCallingPid(), IPCThreadState::self()->getCallingUid());
+        return NO_ERROR;
+    }
+
+    int dupFd = dup(fd);
+    FILE* out = dupFd >= 0 ? fdopen(dupFd, "w") : NULL;
+    if (out == NULL) {
+        if (dupFd >= 0) {
+            close(dupFd);
+        }
+        return NO_MEMORY;
+    }
+    fprintf(out, "Throttler:\n");
+    mThrottler->dump(out);
+    fclose(out);
+    return NO_ERROR;
+}
+
 status_t IncidentService::command(FILE* in, FILE* out, FILE* err, Vector<String8>& args) {
     const int argCount = args.size();
 
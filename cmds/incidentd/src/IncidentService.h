@@ -52,9 +52,9 @@ public:
 
     /**
      * Schedule a report for the "main" report, where it will be delivered to
-     * the uploaders and/or dropbox.
+     * the uploaders and/or dropbox.  uid is the caller that asked for it.
      */
-    void schedulePersistedReport(const IncidentReportArgs& args);
+    void schedulePersistedReport(const IncidentReportArgs& args, uid_t uid);
 
     /**
      * Adds a ReportRequest to the queue for one that has a listener an and fd
@@ -144,6 +144,9 @@ public:
                                 uint32_t flags) override;
     virtual status_t command(FILE* in, FILE* out, FILE* err, Vector<String8>& args);
 
+    // Prints the throttler state for dumpsys.
+    virtual status_t dump(int fd, const Vector<String16>& args) override;
+
 private:
     sp<WorkDirectory> mWorkDirectory;
     sp<Broadcaster> mBroadcaster;
@@ -29,6 +29,9 @@
 #include <android/util/ProtoFileReader.h>
 #include <log/log.h>
 
+#include <algorithm>
+#include <memory>
+
 namespace android {
 namespace os {
 namespace incidentd {
@@ -81,17 +84,62 @@ void write_field_or_skip(ProtoOutputStream* out, const sp<ProtoReader>& in,
 }
 
 /**
- * Strip next field based on its private policy and request spec, then stores data in buf.
- * Return NO_ERROR if succeeds, otherwise BAD_VALUE is returned to indicate bad data in
- * FdBuffer.
+ * Write the field to each of the outputs, iterator will point to next field. The field is
+ * read only once, however many outputs it is written to.
+ */
+static void write_field(const vector<ProtoOutputStream*>& outs, const sp<ProtoReader>& in,
+        uint32_t fieldTag) {
+    uint8_t wireType = read_wire_type(fieldTag);
+    size_t bytesToWrite = 0;
+
+    switch (wireType) {
+        case WIRE_TYPE_VARINT: {
+            uint64_t varint = in->readRawVarint();
+            for (ProtoOutputStream* out : outs) {
+                out->writeRawVarint(fieldTag);
+                out->writeRawVarint(varint);
+            }
+            return;
+        }
+        case WIRE_TYPE_FIXED64:
+            bytesToWrite = 8;
+            for (ProtoOutputStream* out : outs) {
+                out->writeRawVarint(fieldTag);
+            }
+            break;
+        case WIRE_TYPE_LENGTH_DELIMITED:
+            bytesToWrite = in->readRawVarint();
+            for (ProtoOutputStream* out : outs) {
+                out->writeLengthDelimitedHeader(read_field_id(fieldTag), bytesToWrite);
+            }
+            break;
+        case WIRE_TYPE_FIXED32:
+            bytesToWrite = 4;
+            for (ProtoOutputStream* out : outs) {
+                out->writeRawVarint(fieldTag);
+            }
+            break;
+    }
+    for (size_t i = 0; i < bytesToWrite; i++) {
+        uint8_t byte = in->next();
+        for (ProtoOutputStream* out : outs) {
+            out->writeRawByte(byte);
+        }
+    }
+}
+
+/**
+ * Strip next field based on its private policy and request specs, and store the data that
+ * specs[i] allows in outs[i]. The data is walked once for all of the specs. Return NO_ERROR
+ * if succeeds, otherwise BAD_VALUE is returned to indicate bad data in FdBuffer.
  *
  * The iterator must point to the head of a protobuf formatted field for successful operation.
  * After exit with NO_ERROR, iterator points to the next protobuf field's head.
  *
  * depth is the depth of recursion, for debugging.
  */
-status_t strip_field(ProtoOutputStream* out, const sp<ProtoReader>& in,
-        const Privacy* parentPolicy, const PrivacySpec& spec, int depth) {
+static status_t strip_field(const vector<ProtoOutputStream*>& outs, const sp<ProtoReader>& in,
+        const Privacy* parentPolicy, const vector<PrivacySpec>& specs, int depth) {
     if (!in->hasNext() || parentPolicy == NULL) {
         return BAD_VALUE;
     }
@@ -100,18 +148,30 @@ status_t strip_field(ProtoOutputStream* out, const sp<ProtoReader>& in,
     const Privacy* policy = lookup(parentPolicy, fieldId);
 
     if (policy == NULL || policy->children == NULL) {
-        bool skip = !spec.CheckPremission(policy, parentPolicy->policy);
+        vector<ProtoOutputStream*> keptBy;
+        for (size_t i = 0; i < outs.size(); i++) {
+            if (specs[i].CheckPremission(policy, parentPolicy->policy)) {
+                keptBy.push_back(outs[i]);
+            }
+        }
         // iterator will point to head of next field
-        size_t currentAt = in->bytesRead();
-        write_field_or_skip(out, in, fieldTag, skip);
+        if (keptBy.empty()) {
+            write_field_or_skip(NULL, in, fieldTag, true);
+        } else {
+            write_field(keptBy, in, fieldTag);
+        }
         return NO_ERROR;
     }
     // current field is message type and its sub-fields have extra privacy policies
     uint32_t msgSize = in->readRawVarint();
     size_t start = in->bytesRead();
-    uint64_t token = out->start(encode_field_id(policy));
+    vector<uint64_t> tokens;
+    tokens.reserve(outs.size());
+    for (ProtoOutputStream* out : outs) {
+        tokens.push_back(out->start(encode_field_id(policy)));
+    }
     while (in->bytesRead() - start != msgSize) {
-        status_t err = strip_field(out, in, policy, spec, depth + 1);
+        status_t err = strip_field(outs, in, policy, specs, depth + 1);
         if (err != NO_ERROR) {
             ALOGW("Bad value when stripping id %d, wiretype %d, tag %#x, depth %d, size %d, "
                     "relative pos %zu, ", fieldId, read_wire_type(fieldTag), fieldTag, depth,
@@ -119,120 +179,12 @@ status_t strip_field(ProtoOutputStream* out, const sp<ProtoReader>& in,
             return err;
         }
     }
-    out->end(token);
-    return NO_ERROR;
-}
-
-// ================================================================================
-class FieldStripper {
-public:
-    FieldStripper(const Privacy* restrictions, const sp<ProtoReader>& data,
-            uint8_t bufferLevel);
-
-    /**
-     * Take the data that we have, and filter it down so that no fields
-     * are more sensitive than the given privacy policy.
-     */
-    status_t strip(uint8_t privacyPolicy);
-
-    /**
-     * At the current filter level, how many bytes of data there is.
-     */
-    ssize_t dataSize() const { return mSize; }
-
-    /**
-     * Write the data from the current filter level to the file descriptor.
-     */
-    status_t writeData(int fd);
-
-private:
-    /**
-     * The global set of field --> required privacy level mapping.
-     */
-    const Privacy* mRestrictions;
-
-    /**
-     * The current buffer.
-     */
-    sp<ProtoReader> mData;
-
-    /**
-     * The current size of the buffer inside mData.
-     */
-    ssize_t mSize;
-
-    /**
-     * The current privacy policy that the data is filtered to, as an optimization
-     * so we don't always re-filter data that has already been filtered.
-     */
-    uint8_t mCurrentLevel;
-
-};
-
-FieldStripper::FieldStripper(const Privacy* restrictions, const sp<ProtoReader>& data,
-            uint8_t bufferLevel)
-        :mRestrictions(restrictions),
-         mData(data),
-         mSize(data->size()),
-         mCurrentLevel(bufferLevel) {
-    if (mSize < 0) {
-        ALOGW("FieldStripper constructed with a ProtoReader that doesn't support size."
-                " Data will be missing.");
-    }
-}
-
-status_t FieldStripper::strip(const uint8_t privacyPolicy) {
-    // If the current strip level is less (fewer fields retained) than what's already in the
-    // buffer, then we can skip it.
-    if (mCurrentLevel < privacyPolicy) {
-        PrivacySpec spec(privacyPolicy);
-        ProtoOutputStream proto;
-
-        // Optimization when no strip happens.
-        if (mRestrictions == NULL || spec.RequireAll()) {
-            if (spec.CheckPremission(mRestrictions)) {
-                mSize = mData->size();
-            }
-            return NO_ERROR;
-        }
-
-        while (mData->hasNext()) {
-            status_t err = strip_field(&proto, mData, mRestrictions, spec, 0);
-            if (err != NO_ERROR) {
-                return err; // Error logged in strip_field.
-            }
-        }
-
-        if (mData->bytesRead() != mData->size()) {
-            ALOGW("Buffer corrupted: expect %zu bytes, read %zu bytes", mData->size(),
-                    mData->bytesRead());
-            return BAD_VALUE;
-        }
-
-        mData = proto.data();
-        mSize = proto.size();
-        mCurrentLevel = privacyPolicy;
+    for (size_t i = 0; i < outs.size(); i++) {
+        outs[i]->end(tokens[i]);
     }
     return NO_ERROR;
 }
 
-status_t FieldStripper::writeData(int fd) {
-    status_t err = NO_ERROR;
-    sp<ProtoReader> reader = mData;
-    if (mData == nullptr) {
-        // There had been an error processing the data. We won't write anything,
-        // but we also won't return an error, because errors are fatal.
-        return NO_ERROR;
-    }
-    while (reader->readBuffer() != NULL) {
-        err = WriteFully(fd, reader->readBuffer(), reader->currentToRead()) ? NO_ERROR : -errno;
-        reader->move(reader->currentToRead());
-        if (err != NO_ERROR) return err;
-    }
-    return NO_ERROR;
-}
-
-
 // ================================================================================
 FilterFd::FilterFd(uint8_t privacyPolicy, int fd)
         :mPrivacyPolicy(privacyPolicy),
@@ -242,6 +194,14 @@ FilterFd::FilterFd(uint8_t privacyPolicy, int fd)
 FilterFd::~FilterFd() {
 }
 
+status_t FilterFd::writeSection(int sectionId, const sp<ProtoReader>& data) {
+    status_t err = write_section_header(mFd, sectionId, data->size());
+    if (err != NO_ERROR) {
+        return err;
+    }
+    return write_data(mFd, data);
+}
+
 // ================================================================================
 PrivacyFilter::PrivacyFilter(int sectionId, const Privacy* restrictions)
         :mSectionId(sectionId),
@@ -264,37 +224,61 @@ status_t PrivacyFilter::writeData(const FdBuffer& buffer, uint8_t bufferLevel,
         *maxSize = 0;
     }
 
-    // Order the writes by privacy filter, with increasing levels of filtration,k
-    // so we can do the filter once, and then write many times.
-    sort(mOutputs.begin(), mOutputs.end(),
-        [](const sp<FilterFd>& a, const sp<FilterFd>& b) -> bool { 
-            return a->getPrivacyPolicy() < b->getPrivacyPolicy();
-        });
+    // The privacy policies that the data has to be stripped to. Outputs that allow more
+    // than the data was already filtered to get the data as it is.
+    vector<uint8_t> policies;
+    if (mRestrictions != NULL) {
+        for (const sp<FilterFd>& output: mOutputs) {
+            const uint8_t privacyPolicy = output->getPrivacyPolicy();
+            if (privacyPolicy > bufferLevel && privacyPolicy != PRIVACY_POLICY_LOCAL
+                    && find(policies.begin(), policies.end(), privacyPolicy) == policies.end()) {
+                policies.push_back(privacyPolicy);
+            }
+        }
+    }
+
+    // Strip the data to all of the policies in a single pass over it.
+    vector<PrivacySpec> specs;
+    vector<unique_ptr<ProtoOutputStream>> protos;
+    vector<ProtoOutputStream*> outs;
+    bool stripped = true;
+    if (!policies.empty()) {
+        for (uint8_t privacyPolicy: policies) {
+            specs.emplace_back(privacyPolicy);
+            protos.emplace_back(new ProtoOutputStream());
+            outs.push_back(protos.back().get());
+        }
+
+        sp<ProtoReader> data = buffer.data()->read();
+        while (stripped && data->hasNext()) {
+            // Error logged in strip_field.
+            stripped = strip_field(outs, data, mRestrictions, specs, 0) == NO_ERROR;
+        }
+        if (stripped && data->bytesRead() != data->size()) {
+            ALOGW("Buffer corrupted: expect %zu bytes, read %zu bytes", data->size(),
+                    data->bytesRead());
+            stripped = false;
+        }
+    }
 
-    uint8_t privacyPolicy = PRIVACY_POLICY_LOCAL; // a.k.a. no filtering
-    FieldStripper fieldStripper(mRestrictions, buffer.data()->read(), bufferLevel);
     for (const sp<FilterFd>& output: mOutputs) {
-        // Do another level of filtering if necessary
-        if (privacyPolicy != output->getPrivacyPolicy()) {
-            privacyPolicy = output->getPrivacyPolicy();
-            err = fieldStripper.strip(privacyPolicy);
-            if (err != NO_ERROR) {
-                // We can't successfully strip this data.  We will skip
-                // the rest of this section.
-                return NO_ERROR;
-            }
+        sp<ProtoReader> data;
+        vector<uint8_t>::const_iterator policy = find(policies.begin(), policies.end(),
+                output->getPrivacyPolicy());
+        if (policy == policies.end()) {
+            data = buffer.data()->read();
+        } else if (stripped) {
+            data = protos[policy - policies.begin()]->data();
+        } else {
+            // We can't successfully strip this data.  We will skip this
+            // section for the outputs that need it stripped.
+            continue;
         }
 
         // Write the resultant buffer to the fd, along with the header.
-        ssize_t dataSize = fieldStripper.dataSize();
+        ssize_t dataSize = data->size();
         if (dataSize > 0) {
-            err = write_section_header(output->getFd(), mSectionId, dataSize);
-            if (err != NO_ERROR) {
-                output->onWriteError(err);
-                continue;
-            }
-
-            err = fieldStripper.writeData(output->getFd());
+            err = output->writeSection(mSectionId, data);
             if (err != NO_ERROR) {
                 output->onWriteError(err);
                 continue;
@@ -46,6 +46,12 @@ public:
     uint8_t getPrivacyPolicy() const { return mPrivacyPolicy; }
     int getFd() { return mFd;}
 
+    /**
+     * Write a section, already filtered to this fd's privacy policy.  The default
+     * writes the section header and the data to the fd.
+     */
+    virtual status_t writeSection(int sectionId, const sp<ProtoReader>& data);
+
     virtual void onWriteError(status_t err) = 0;
 
 private:
@@ -26,12 +26,18 @@
 #include "section_list.h"
 
 #include <android-base/file.h>
+#include <android-base/properties.h>
 #include <android/os/DropBoxManager.h>
 #include <android/util/protobuf.h>
 #include <android/util/ProtoOutputStream.h>
 #include <private/android_filesystem_config.h>
 #include <utils/SystemClock.h>
 
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -118,6 +124,7 @@ class PersistedFilterFd : public FilterFd {
 public:
     PersistedFilterFd(uint8_t privacyPolicy, int fd, const sp<ReportFile>& reportFile);
 
+    virtual status_t writeSection(int sectionId, const sp<ProtoReader>& data);
     virtual void onWriteError(status_t err);
 
 private:
@@ -130,6 +137,10 @@ PersistedFilterFd::PersistedFilterFd(uint8_t privacyPolicy, int fd,
          mReportFile(reportFile) {
 }
 
+status_t PersistedFilterFd::writeSection(int sectionId, const sp<ProtoReader>& data) {
+    return mReportFile->writeSection(sectionId, data);
+}
+
 void PersistedFilterFd::onWriteError(status_t err) {
     mReportFile->setWriteError(err);
 }
@@ -167,22 +178,29 @@ void ReportRequest::closeFd() {
     }
 }
 
+void ReportRequest::addCaller(uid_t uid, uint8_t privacyPolicy) {
+    mCallers.insert(make_pair(uid, privacyPolicy));
+}
+
 // ================================================================================
 ReportBatch::ReportBatch() {}
 
 ReportBatch::~ReportBatch() {}
 
-void ReportBatch::addPersistedReport(const IncidentReportArgs& args) {
+void ReportBatch::addPersistedReport(const IncidentReportArgs& args, uid_t uid) {
     ComponentName component(args.receiverPkg(), args.receiverCls());
     map<ComponentName, sp<ReportRequest>>::iterator found = mPersistedRequests.find(component);
+    sp<ReportRequest> request;
     if (found == mPersistedRequests.end()) {
         // not found
-        mPersistedRequests[component] = new ReportRequest(args, nullptr, -1);
+        request = new ReportRequest(args, nullptr, -1);
+        mPersistedRequests[component] = request;
     } else {
         // found
-        sp<ReportRequest> request = found->second;
+        request = found->second;
         request->args.merge(args);
     }
+    request->addCaller(uid, args.getPrivacyPolicy());
 }
 
 void ReportBatch::addStreamingReport(const IncidentReportArgs& args,
@@ -302,6 +320,19 @@ void ReportBatch::transferPersistedRequests(const sp<ReportBatch>& that) {
     mPersistedRequests.clear();
 }
 
+void ReportBatch::transferPersistedRequests(const sp<ReportBatch>& that,
+        const function<bool (const sp<ReportRequest>&)>& filter) {
+    map<ComponentName, sp<ReportRequest>>::iterator it = mPersistedRequests.begin();
+    while (it != mPersistedRequests.end()) {
+        if (filter(it->second)) {
+            that->mPersistedRequests[it->first] = it->second;
+            it = mPersistedRequests.erase(it);
+        } else {
+            it++;
+        }
+    }
+}
+
 void ReportBatch::getFailedRequests(vector<sp<ReportRequest>>* requests) {
     for (map<ComponentName, sp<ReportRequest>>::iterator it = mPersistedRequests.begin();
             it != mPersistedRequests.end(); it++) {
@@ -337,8 +368,20 @@ void ReportBatch::removeRequest(const sp<ReportRequest>& request) {
 // ================================================================================
 ReportWriter::ReportWriter(const sp<ReportBatch>& batch)
         :mBatch(batch),
+         mCollecting(false),
+         mPersistedFile(),
+         mMaxPersistedPrivacyPolicy(PRIVACY_POLICY_UNSET),
+         mSectionExecDurationMs(-1),
+         mMaxSectionDataFilteredSize(0) {
+}
+
+ReportWriter::ReportWriter()
+        :mBatch(),
+         mCollecting(true),
          mPersistedFile(),
-         mMaxPersistedPrivacyPolicy(PRIVACY_POLICY_UNSET) {
+         mMaxPersistedPrivacyPolicy(PRIVACY_POLICY_UNSET),
+         mSectionExecDurationMs(-1),
+         mMaxSectionDataFilteredSize(0) {
 }
 
 ReportWriter::~ReportWriter() {
@@ -355,6 +398,8 @@ void ReportWriter::setMaxPersistedPrivacyPolicy(uint8_t privacyPolicy) {
 void ReportWriter::startSection(int sectionId) {
     mCurrentSectionId = sectionId;
     mSectionStartTimeMs = uptimeMillis();
+    mSectionExecDurationMs = -1;
+    mCollectedBuffer.reset();
 
     mSectionStatsCalledForSectionId = -1;
     mDumpSizeBytes = 0;
@@ -364,7 +409,6 @@ void ReportWriter::startSection(int sectionId) {
     mSectionBufferSuccess = false;
     mHadError = false;
     mSectionErrors.clear();
-    
 }
 
 void ReportWriter::setSectionStats(const FdBuffer& buffer) {
@@ -386,7 +430,8 @@ void ReportWriter::endSection(IncidentMetadata::SectionStats* sectionMetadata) {
     sectionMetadata->set_id(mCurrentSectionId);
     sectionMetadata->set_success((!mHadError) && mSectionBufferSuccess);
     sectionMetadata->set_report_size_bytes(mMaxSectionDataFilteredSize);
-    sectionMetadata->set_exec_duration_ms(endTime - mSectionStartTimeMs);
+    sectionMetadata->set_exec_duration_ms(mSectionExecDurationMs >= 0
+            ? mSectionExecDurationMs : endTime - mSectionStartTimeMs);
     sectionMetadata->set_dump_size_bytes(mDumpSizeBytes);
     sectionMetadata->set_dump_duration_ms(mDumpDurationMs);
     sectionMetadata->set_timed_out(mSectionTimedOut);
@@ -447,6 +492,12 @@ void ReportWriter::vflog(const Section* section, status_t err, int level, const
 
 // Reads data from FdBuffer and writes it to the requests file descriptor.
 status_t ReportWriter::writeSection(const FdBuffer& buffer) {
+    if (mCollecting) {
+        // The copy shares the data of the buffer, which the section is done with.
+        mCollectedBuffer.reset(new FdBuffer(buffer));
+        return NO_ERROR;
+    }
+
     PrivacyFilter filter(mCurrentSectionId, get_privacy_of_section(mCurrentSectionId));
 
     // Add the fd for the persisted requests
@@ -468,6 +519,150 @@ status_t ReportWriter::writeSection(const FdBuffer& buffer) {
     return filter.writeData(buffer, PRIVACY_POLICY_LOCAL, &mMaxSectionDataFilteredSize);
 }
 
+status_t ReportWriter::writeCollectedSection(const ReportWriter& collected,
+        int64_t execDurationMs) {
+    mSectionExecDurationMs = execDurationMs;
+    mSectionStatsCalledForSectionId = collected.mSectionStatsCalledForSectionId;
+    mDumpSizeBytes = collected.mDumpSizeBytes;
+    mDumpDurationMs = collected.mDumpDurationMs;
+    mSectionTimedOut = collected.mSectionTimedOut;
+    mSectionTruncated = collected.mSectionTruncated;
+    mSectionBufferSuccess = collected.mSectionBufferSuccess;
+    mHadError = collected.mHadError;
+    mSectionErrors = collected.mSectionErrors;
+
+    if (collected.mCollectedBuffer == nullptr) {
+        return NO_ERROR;
+    }
+    return writeSection(*collected.mCollectedBuffer);
+}
+
+// ================================================================================
+/**
+ * Runs the sections of a report that can run concurrently on a limited number of
+ * worker threads, each into its own collecting ReportWriter. The report thread
+ * waits for them in section order and writes out what they collected.
+ */
+class ConcurrentSections {
+public:
+    struct Run {
+        const Section* section;
+        ReportWriter writer;
+        status_t err;
+        int64_t execDurationMs;
+        bool done;
+
+        explicit Run(const Section* s) : section(s), err(NO_ERROR), execDurationMs(0),
+                done(false) {}
+    };
+
+    ConcurrentSections();
+    ~ConcurrentSections();
+
+    /**
+     * Adds a section to run. Must be called before start().
+     */
+    Run* add(const Section* section);
+
+    /**
+     * Starts running the sections on up to threadCount threads.
+     */
+    void start(size_t threadCount);
+
+    /**
+     * Blocks until the section of run has been executed.
+     */
+    void waitFor(const Run* run);
+
+    /**
+     * Skips the sections that have not started yet, and waits for the others.
+     */
+    void stop();
+
+private:
+    mutex mLock;
+    condition_variable mRunDone;
+    vector<unique_ptr<Run>> mRuns;
+    // The runs in the order they are started in.
+    vector<Run*> mQueue;
+    size_t mNextRun;
+    bool mStopped;
+    vector<thread> mThreads;
+
+    void runSections();
+};
+
+ConcurrentSections::ConcurrentSections()
+        :mNextRun(0),
+         mStopped(false) {
+}
+
+ConcurrentSections::~ConcurrentSections() {
+    stop();
+}
+
+ConcurrentSections::Run* ConcurrentSections::add(const Section* section) {
+    mRuns.emplace_back(new Run(section));
+    return mRuns.back().get();
+}
+
+void ConcurrentSections::start(size_t threadCount) {
+    // Start the sections with the longest timeouts first. They are the ones that can take
+    // the longest, and the short ones can run alongside them.
+    for (const unique_ptr<Run>& run : mRuns) {
+        mQueue.push_back(run.get());
+    }
+    stable_sort(mQueue.begin(), mQueue.end(), [](const Run* a, const Run* b) {
+        return a->section->timeoutMs > b->section->timeoutMs;
+    });
+
+    threadCount = min(threadCount, mQueue.size());
+    for (size_t i = 0; i < threadCount; i++) {
+        mThreads.emplace_back([this]() { runSections(); });
+    }
+}
+
+void ConcurrentSections::waitFor(const Run* run) {
+    unique_lock<mutex> lock(mLock);
+    mRunDone.wait(lock, [run]() { return run->done; });
+}
+
+void ConcurrentSections::stop() {
+    {
+        unique_lock<mutex> lock(mLock);
+        mStopped = true;
+    }
+    for (thread& th : mThreads) {
+        th.join();
+    }
+    mThreads.clear();
+}
+
+void ConcurrentSections::runSections() {
+    while (true) {
+        Run* run;
+        {
+            unique_lock<mutex> lock(mLock);
+            if (mStopped || mNextRun >= mQueue.size()) {
+                return;
+            }
+            run = mQueue[mNextRun++];
+        }
+
+        const int64_t startTime = uptimeMillis();
+        run->writer.startSection(run->section->id);
+        status_t err = run->section->Execute(&run->writer);
+
+        {
+            unique_lock<mutex> lock(mLock);
+            run->err = err;
+            run->execDurationMs = uptimeMillis() - startTime;
+            run->done = true;
+        }
+        mRunDone.notify_all();
+    }
+}
+
 
 // ================================================================================
 Reporter::Reporter(const sp<WorkDirectory>& workDirectory, const sp<ReportBatch>& batch)
@@ -577,6 +772,21 @@ void Reporter::runReport(size_t* reportByteSize) {
     // sections for it.
     cancel_and_remove_failed_requests();
 
+    // Start the sections that can run concurrently on worker threads. The other sections
+    // run in the loop below, when it gets to them.
+    const int maxConcurrentSections = android::base::GetIntProperty(
+            "incidentd.max_concurrent_sections", DEFAULT_MAX_CONCURRENT_SECTIONS, 1, 64);
+    ConcurrentSections concurrentSections;
+    map<const Section*, ConcurrentSections::Run*> concurrentRuns;
+    if (maxConcurrentSections > 1) {
+        for (const Section** section = SECTION_LIST; *section; section++) {
+            if ((*section)->canRunConcurrently() && mBatch->containsSection((*section)->id)) {
+                concurrentRuns[*section] = concurrentSections.add(*section);
+            }
+        }
+        concurrentSections.start(maxConcurrentSections);
+    }
+
     // For each of the report fields, see if we need it, and if so, execute the command
     // and report to those that care that we're doing it.
     for (const Section** section = SECTION_LIST; *section; section++) {
@@ -596,9 +806,21 @@ void Reporter::runReport(size_t* reportByteSize) {
                     sectionId, IIncidentReportStatusListener::STATUS_STARTING);
         });
 
-        // Go get the data and write it into the file descriptors.
+        // Go get the data and write it into the file descriptors. Sections that ran on
+        // a worker thread are still written here, so the report stays in section order.
         mWriter.startSection(sectionId);
-        err = (*section)->Execute(&mWriter);
+        map<const Section*, ConcurrentSections::Run*>::iterator run =
+                concurrentRuns.find(*section);
+        if (run != concurrentRuns.end()) {
+            concurrentSections.waitFor(run->second);
+            err = mWriter.writeCollectedSection(run->second->writer,
+                    run->second->execDurationMs);
+            if (run->second->err != NO_ERROR) {
+                err = run->second->err;
+            }
+        } else {
+            err = (*section)->Execute(&mWriter);
+        }
         mWriter.endSection(sectionMetadata);
 
         // Sections returning errors are fatal. Most errors should not be fatal.
@@ -627,6 +849,9 @@ void Reporter::runReport(size_t* reportByteSize) {
     }
 
 DONE:
+    // Don't leave sections running after a fatal error.
+    concurrentSections.stop();
+
     // Finish up the persisted file.
     if (mPersistedFile != nullptr) {
         mPersistedFile->closeDataFile();
@@ -25,6 +25,8 @@
 #include <android/util/protobuf.h>
 
 #include <map>
+#include <memory>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -67,8 +69,22 @@ public:
 
     void closeFd();
 
+    /**
+     * Record that uid asked for this report at the given privacy policy.
+     * Persisted requests from several callers to the same receiver are merged
+     * into one request, so it can have more than one caller.
+     */
+    void addCaller(uid_t uid, uint8_t privacyPolicy);
+
+    /**
+     * The (uid, privacy policy) pairs that asked for this report.  Empty for
+     * streaming requests.
+     */
+    const set<pair<uid_t, uint8_t>>& getCallers() const { return mCallers; }
+
 private:
     sp<IIncidentReportStatusListener> mListener;
+    set<pair<uid_t, uint8_t>> mCallers;
     int mFd;
     bool mIsStreaming;
     status_t mStatus;
@@ -86,9 +102,9 @@ public:
 
     /**
      * Schedule a report for the "main" report, where it will be delivered to
-     * the uploaders and/or dropbox.
+     * the uploaders and/or dropbox.  uid is the caller that asked for it.
      */
-    void addPersistedReport(const IncidentReportArgs& args);
+    void addPersistedReport(const IncidentReportArgs& args, uid_t uid);
 
     /**
      * Adds a ReportRequest to the queue for one that has a listener an and fd
@@ -165,6 +181,13 @@ public:
      */
     void transferPersistedRequests(const sp<ReportBatch>& that);
 
+    /**
+     * Move the persisted requests in this batch for which filter returns true to
+     * that batch.  The others stay in this batch.
+     */
+    void transferPersistedRequests(const sp<ReportBatch>& that,
+            const function<bool (const sp<ReportRequest>&)>& filter);
+
     /**
      * Get the requests that have encountered errors.
      */
@@ -185,6 +208,14 @@ private:
 class ReportWriter {
 public:
     ReportWriter(const sp<ReportBatch>& batch);
+
+    /**
+     * Creates a writer that collects the data of a section instead of writing it
+     * out, so that the section can run on a worker thread. The collected section
+     * is written later with writeCollectedSection() on the writer of the report.
+     */
+    ReportWriter();
+
     ~ReportWriter();
 
     void setPersistedFile(sp<ReportFile> file);
@@ -200,10 +231,28 @@ public:
 
     status_t writeSection(const FdBuffer& buffer);
 
+    /**
+     * Takes over the stats and errors of the section that ran on the collecting
+     * writer 'collected' and writes the data it collected, if any. Must be called
+     * between startSection() and endSection(). The section is reported to have run
+     * for execDurationMs, rather than for the time since startSection().
+     */
+    status_t writeCollectedSection(const ReportWriter& collected, int64_t execDurationMs);
+
 private:
     // Data about all requests
     sp<ReportBatch> mBatch;
 
+    /**
+     * Whether sections are kept in mCollectedBuffer rather than written out.
+     */
+    bool mCollecting;
+
+    /**
+     * The data of the current section, when collecting.
+     */
+    unique_ptr<FdBuffer> mCollectedBuffer;
+
     /**
      * The file on disk where we will store the persisted file.
      */
@@ -225,6 +274,12 @@ private:
      */
     int64_t mSectionStartTimeMs;
 
+    /**
+     * How long the current section ran for, if it did not run between startSection()
+     * and endSection(), or -1.
+     */
+    int64_t mSectionExecDurationMs;
+
     /**
      * The last section that setSectionStats was called for, so if someone misses
      * it we can log that.
@@ -258,6 +313,10 @@ public:
     // Run the report as described in the batch and args parameters.
     void runReport(size_t* reportByteSize);
 
+    // The number of sections that run at the same time, unless overridden by the
+    // incidentd.max_concurrent_sections system property.
+    static const int DEFAULT_MAX_CONCURRENT_SECTIONS = 4;
+
 private:
     sp<WorkDirectory> mWorkDirectory;
     ReportWriter mWriter;
@@ -23,6 +23,7 @@
 
 #include <mutex>
 #include <set>
+#include <thread>
 
 #include <android-base/file.h>
 #include <android-base/properties.h>
@@ -42,6 +43,7 @@
 #include "frameworks/base/core/proto/android/os/backtrace.proto.h"
 #include "frameworks/base/core/proto/android/os/data.proto.h"
 #include "frameworks/base/core/proto/android/util/log.proto.h"
+#include "ih_parsers.h"
 #include "incidentd_util.h"
 
 namespace android {
@@ -63,6 +65,43 @@ static pid_t fork_execute_incident_helper(const int id, Fpipe* p2cPipe, Fpipe* c
     return fork_execute_cmd(const_cast<char**>(ihArgs), p2cPipe, c2pPipe);
 }
 
+// IDs smaller than or equal to 1 select the test parsers of incident_helper, which are
+// only ever run in the incident_helper process.
+static bool parses_in_process(const int id) { return id > 1; }
+
+void sigpipe_handler(int signum);
+
+// Parses the text read from 'in' with the incident_helper parser of the section on a
+// thread of this process, which saves forking and executing incident_helper. The
+// parser writes the proto into a pipe that the buffer reads, with the section timeout.
+static status_t parse_in_process(const Section* section, unique_fd in, FdBuffer* buffer) {
+    unique_ptr<TextParserBase> parser(selectParser(section->id));
+    Fpipe pipe;
+    if (!pipe.init()) {
+        ALOGW("[%s] failed to setup pipes", section->name.string());
+        return -errno;
+    }
+
+    thread parserThread([parser = std::move(parser), in = std::move(in),
+                         out = std::move(pipe.writeFd())]() mutable {
+        // Don't crash the service if the reader gave up on the data before the end.
+        signal(SIGPIPE, sigpipe_handler);
+        status_t err = parser->Parse(in.get(), out.get());
+        if (err != NO_ERROR) {
+            ALOGW("%s failed: %s", parser->name.string(), strerror(-err));
+        }
+        // Closing the pipe tells the reader that the data is complete.
+        out.reset();
+    });
+    // The parser finishes at the end of its input, or at its next write once the reader
+    // has closed the pipe.
+    parserThread.detach();
+
+    status_t err = buffer->read(pipe.readFd().get(), section->timeoutMs);
+    pipe.readFd().reset();
+    return err;
+}
+
 bool section_requires_specific_mention(int sectionId) {
     switch (sectionId) {
         case 3025: // restricted_images
@@ -106,6 +145,17 @@ status_t FileSection::Execute(ReportWriter* writer) const {
     }
 
     FdBuffer buffer;
+    if (parses_in_process(this->id)) {
+        status_t readStatus = parse_in_process(this, std::move(fd), &buffer);
+        writer->setSectionStats(buffer);
+        if (readStatus != NO_ERROR || buffer.timedOut()) {
+            ALOGW("[%s] failed to parse data: %s, timedout: %s", this->name.string(),
+                  strerror(-readStatus), buffer.timedOut() ? "true" : "false");
+            return readStatus;
+        }
+        return writer->writeSection(buffer);
+    }
+
     Fpipe p2cPipe;
     Fpipe c2pPipe;
     // initiate pipes to pass data to/from incident_helper
@@ -405,27 +455,35 @@ status_t CommandSection::Execute(ReportWriter* writer) const {
         ALOGW("[%s] failed to fork", this->name.string());
         return -errno;
     }
-    pid_t ihPid = fork_execute_incident_helper(this->id, &cmdPipe, &ihPipe);
-    if (ihPid == -1) {
-        ALOGW("[%s] failed to fork", this->name.string());
-        return -errno;
-    }
+    status_t readStatus;
+    pid_t ihPid = -1;
+    if (parses_in_process(this->id)) {
+        readStatus = parse_in_process(this, std::move(cmdPipe.readFd()), &buffer);
+    } else {
+        ihPid = fork_execute_incident_helper(this->id, &cmdPipe, &ihPipe);
+        if (ihPid == -1) {
+            ALOGW("[%s] failed to fork", this->name.string());
+            return -errno;
+        }
 
-    cmdPipe.writeFd().reset();
-    status_t readStatus = buffer.read(ihPipe.readFd().get(), this->timeoutMs);
+        cmdPipe.writeFd().reset();
+        readStatus = buffer.read(ihPipe.readFd().get(), this->timeoutMs);
+    }
     writer->setSectionStats(buffer);
     if (readStatus != NO_ERROR || buffer.timedOut()) {
         ALOGW("[%s] failed to read data from incident helper: %s, timedout: %s",
               this->name.string(), strerror(-readStatus), buffer.timedOut() ? "true" : "false");
         kill_child(cmdPid);
-        kill_child(ihPid);
+        if (ihPid != -1) {
+            kill_child(ihPid);
+        }
         return readStatus;
     }
 
     // Waiting for command here has one trade-off: the failed status of command won't be detected
     // until buffer timeout, but it has advatage on starting the data stream earlier.
     status_t cmdStatus = wait_child(cmdPid);
-    status_t ihStatus = wait_child(ihPid);
+    status_t ihStatus = ihPid != -1 ? wait_child(ihPid) : NO_ERROR;
     if (cmdStatus != NO_ERROR || ihStatus != NO_ERROR) {
         ALOGW("[%s] abnormal child processes, return status: command: %s, incident helper: %s",
               this->name.string(), strerror(-cmdStatus), strerror(-ihStatus));
@@ -46,6 +46,13 @@ public:
     virtual ~Section();
 
     virtual status_t Execute(ReportWriter* writer) const = 0;
+
+    /**
+     * Whether Execute() may run on a worker thread at the same time as other
+     * sections. Sections that share state with other sections return false, and
+     * are executed one after another on the thread taking the report.
+     */
+    virtual bool canRunConcurrently() const { return true; }
 };
 
 /**
@@ -152,6 +159,9 @@ public:
 
     virtual status_t BlockingCall(int pipeWriteFd) const;
 
+    // All of the log sections share gLastLogsRetrieved.
+    virtual bool canRunConcurrently() const { return false; }
+
 private:
     log_id_t mLogID;
     bool mBinary;
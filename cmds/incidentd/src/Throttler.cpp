@@ -19,17 +19,25 @@
 #include "Throttler.h"
 
 #include <inttypes.h>
+#include <private/android_filesystem_config.h>
 #include <utils/SystemClock.h>
 
+#include <set>
+
 namespace android {
 namespace os {
 namespace incidentd {
 
 Throttler::Throttler(size_t limit, int64_t refractoryPeriodMs)
+    : Throttler(limit, limit, refractoryPeriodMs) {}
+
+Throttler::Throttler(size_t limit, size_t bucketLimit, int64_t refractoryPeriodMs)
     : mSizeLimit(limit),
+      mBucketLimit(bucketLimit),
       mRefractoryPeriodMs(refractoryPeriodMs),
       mAccumulatedSize(0),
-      mLastRefractoryMs(android::elapsedRealtime()) {}
+      mLastRefractoryMs(android::elapsedRealtime()),
+      mThrottledCount(0) {}
 
 Throttler::~Throttler() {}
 
@@ -39,34 +47,134 @@ sp<ReportBatch> Throttler::filterBatch(const sp<ReportBatch>& queued) {
     // We will never throttle the streaming ones.
     queued->transferStreamingRequests(result);
 
-    // If the persisted ones aren't to be throttled, then add them to the
-    // batch we're going to do.
-    if (!shouldThrottle()) {
-        queued->transferPersistedRequests(result);
+    // Move the persisted ones that aren't to be throttled to the batch we're
+    // going to do.  The others wait in the queue until there is room for them,
+    // without running the reporter for them in the meantime.
+    unique_lock<mutex> lock(mLock);
+    refill_locked();
+    size_t throttled = 0;
+    queued->transferPersistedRequests(result,
+            [this, &throttled](const sp<ReportRequest>& request) {
+        Priority priority = getPriority(request);
+        if (shouldThrottle_locked(priority)) {
+            throttled++;
+            return false;
+        }
+        const set<BucketKey>& callers = request->getCallers();
+        if (priority == PRIORITY_CRITICAL || callers.empty()) {
+            return true;
+        }
+        for (const BucketKey& caller : callers) {
+            if (hasTokens_locked(caller)) {
+                return true;
+            }
+        }
+        throttled++;
+        return false;
+    });
+    if (throttled > 0) {
+        VLOG("Throttling %zu persisted requests", throttled);
     }
+    mThrottledCount = throttled;
 
     return result;
 }
 
 bool Throttler::shouldThrottle() {
+    unique_lock<mutex> lock(mLock);
+    return shouldThrottle_locked(PRIORITY_CRITICAL);
+}
+
+bool Throttler::shouldThrottle_locked(Priority priority) {
     int64_t now = android::elapsedRealtime();
     if (now > mRefractoryPeriodMs + mLastRefractoryMs) {
         mLastRefractoryMs = now;
         mAccumulatedSize = 0;
     }
-    return mAccumulatedSize > mSizeLimit;
+    if (priority == PRIORITY_CRITICAL) {
+        return mAccumulatedSize > mSizeLimit;
+    }
+    return mAccumulatedSize > mSizeLimit - mSizeLimit / 4;
+}
+
+void Throttler::refill_locked() {
+    int64_t now = android::elapsedRealtime();
+    map<BucketKey, Bucket>::iterator it = mBuckets.begin();
+    while (it != mBuckets.end()) {
+        Bucket& bucket = it->second;
+        int64_t elapsed = min(now - bucket.lastRefillMs, mRefractoryPeriodMs);
+        int64_t added = mRefractoryPeriodMs > 0
+                ? elapsed * (int64_t)mBucketLimit / mRefractoryPeriodMs
+                : (int64_t)mBucketLimit;
+        if (added > 0) {
+            bucket.tokens += added;
+            bucket.lastRefillMs = now;
+        }
+        // A full bucket is the same as one that was never used.
+        if (bucket.tokens >= (int64_t)mBucketLimit) {
+            it = mBuckets.erase(it);
+        } else {
+            it++;
+        }
+    }
+}
+
+bool Throttler::hasTokens_locked(const BucketKey& key) const {
+    map<BucketKey, Bucket>::const_iterator found = mBuckets.find(key);
+    return found == mBuckets.end() || found->second.tokens > 0;
 }
 
 void Throttler::addReportSize(size_t reportByteSize) {
     VLOG("The current request took %zu bytes to dropbox", reportByteSize);
+    unique_lock<mutex> lock(mLock);
     mAccumulatedSize += reportByteSize;
 }
 
+void Throttler::addReportSize(const sp<ReportBatch>& batch, size_t reportByteSize) {
+    VLOG("The current request took %zu bytes to dropbox", reportByteSize);
+
+    // The reporter only knows the size of the whole report, so every caller
+    // is charged all of it, but only once even if it has several requests.
+    set<BucketKey> callers;
+    batch->forEachPersistedRequest([&callers](const sp<ReportRequest>& request) {
+        callers.insert(request->getCallers().begin(), request->getCallers().end());
+    });
+
+    unique_lock<mutex> lock(mLock);
+    mAccumulatedSize += reportByteSize;
+    int64_t now = android::elapsedRealtime();
+    for (const BucketKey& caller : callers) {
+        map<BucketKey, Bucket>::iterator found = mBuckets.find(caller);
+        if (found == mBuckets.end()) {
+            found = mBuckets.insert(make_pair(caller, Bucket{(int64_t)mBucketLimit, now})).first;
+        }
+        found->second.tokens -= (int64_t)reportByteSize;
+    }
+}
+
+Throttler::Priority Throttler::getPriority(const sp<ReportRequest>& request) {
+    for (const BucketKey& caller : request->getCallers()) {
+        if (caller.first == AID_SYSTEM) {
+            return PRIORITY_CRITICAL;
+        }
+    }
+    return PRIORITY_NORMAL;
+}
+
 void Throttler::dump(FILE* out) {
+    unique_lock<mutex> lock(mLock);
     fprintf(out, "mSizeLimit=%zu\n", mSizeLimit);
     fprintf(out, "mAccumulatedSize=%zu\n", mAccumulatedSize);
     fprintf(out, "mRefractoryPeriodMs=%" PRIi64 "\n", mRefractoryPeriodMs);
     fprintf(out, "mLastRefractoryMs=%" PRIi64 "\n", mLastRefractoryMs);
+    fprintf(out, "mBucketLimit=%zu\n", mBucketLimit);
+    fprintf(out, "mThrottledCount=%zu\n", mThrottledCount);
+    // Buckets that aren't listed are full.
+    for (const auto& bucket : mBuckets) {
+        fprintf(out, "bucket uid=%d privacyPolicy=%d tokens=%" PRIi64 " lastRefillMs=%" PRIi64
+                "\n", bucket.first.first, bucket.first.second, bucket.second.tokens,
+                bucket.second.lastRefillMs);
+    }
 }
 
 }  // namespace incidentd
@@ -20,6 +20,9 @@
 
 #include <utils/RefBase.h>
 
+#include <map>
+#include <mutex>
+#include <utility>
 #include <vector>
 #include <unistd.h>
 
@@ -29,15 +32,31 @@ namespace incidentd {
 
 /**
  * This is a size-based throttler which prevents incidentd to take more data.
+ *
+ * On top of the global limit over the refractory period, every (uid, privacy
+ * policy) that asks for persisted reports has a token bucket of bucketLimit
+ * bytes, which refills over the refractory period.  A request is taken while
+ * the bucket of one of its callers still has tokens, and the size of the
+ * report is charged to all of them after it was taken.
+ *
+ * The requests from the system uid, which are the ones for crashes and other
+ * problems the system noticed, are PRIORITY_CRITICAL.  They are not subject to
+ * the buckets, and the last quarter of the global limit is kept for them.
  */
 class Throttler : public virtual android::RefBase {
 public:
+    enum Priority {
+        PRIORITY_NORMAL = 0,
+        PRIORITY_CRITICAL = 1,
+    };
+
     Throttler(size_t limit, int64_t refractoryPeriodMs);
+    Throttler(size_t limit, size_t bucketLimit, int64_t refractoryPeriodMs);
     ~Throttler();
 
     /**
      * Return a batch containing reports, if any that should be executed.
-     * Those will be removed from 'queued'.
+     * Those will be removed from 'queued'.  The throttled ones stay in 'queued'.
      */
     sp<ReportBatch> filterBatch(const sp<ReportBatch>& queued);
 
@@ -45,14 +64,37 @@ public:
 
     void addReportSize(size_t reportByteSize);
 
+    /**
+     * Charge the size of a report taken for batch to the global limit and to
+     * the buckets of the callers of its persisted requests.
+     */
+    void addReportSize(const sp<ReportBatch>& batch, size_t reportByteSize);
+
+    static Priority getPriority(const sp<ReportRequest>& request);
+
     void dump(FILE* out);
 
 private:
+    typedef pair<uid_t, uint8_t> BucketKey;
+
+    struct Bucket {
+        int64_t tokens;
+        int64_t lastRefillMs;
+    };
+
     const size_t mSizeLimit;
+    const size_t mBucketLimit;
     const int64_t mRefractoryPeriodMs;
 
+    mutex mLock;
     size_t mAccumulatedSize;
     int64_t mLastRefractoryMs;
+    map<BucketKey, Bucket> mBuckets;
+    size_t mThrottledCount;
+
+    bool shouldThrottle_locked(Priority priority);
+    void refill_locked();
+    bool hasTokens_locked(const BucketKey& key) const;
 };
 
 }  // namespace incidentd
@@ -21,6 +21,9 @@
 #include "proto_util.h"
 #include "PrivacyFilter.h"
 
+#include <android-base/file.h>
+#include <android-base/properties.h>
+#include <android/util/protobuf.h>
 #include <google/protobuf/io/zero_copy_stream_impl.h>
 #include <private/android_filesystem_config.h>
 
@@ -39,6 +42,8 @@ namespace android {
 namespace os {
 namespace incidentd {
 
+using namespace android::base;
+using namespace android::util;
 using std::thread;
 using google::protobuf::MessageLite;
 using google::protobuf::RepeatedPtrField;
@@ -60,6 +65,23 @@ static const string EXTENSION_ENVELOPE(".envelope");
  */
 static const string EXTENSION_DATA(".data");
 
+/**
+ * File extension for the links of a report to shared section files.
+ */
+static const string EXTENSION_SECTION(".section");
+
+/**
+ * File extension for shared section files.
+ */
+static const string EXTENSION_SHARED(".shared");
+
+/**
+ * Sections smaller than this are always written to the data file.  Periodic reports
+ * repeat big sections like the system properties and the package list; small ones
+ * aren't worth a file of their own.
+ */
+static const size_t MIN_SHARED_SECTION_SIZE = 16 * 1024;
+
 /**
  * Send these reports to dropbox.
  */
@@ -126,6 +148,16 @@ static bool parse_timestamp_ns(const string& id, int64_t* result) {
     return id.length() != 0 && *endptr == '\0';
 }
 
+// 64-bit FNV-1a.  Shared section files are also compared byte for byte before they are
+// reused, so this only has to spread them out.
+static uint64_t hash_contents(const string& contents) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const char c: contents) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
 static bool has_section(const ReportFileProto_Report& report, int section) {
     const size_t sectionCount = report.section_size();
     for (int i = 0; i < sectionCount; i++) {
@@ -211,6 +243,9 @@ void log_envelope(const ReportFileProto& envelope) {
     ALOGD("  privacy_policy=%d", envelope.privacy_policy());
     ALOGD("  data_file_size=%" PRIi64, (int64_t)envelope.data_file_size());
     ALOGD("  completed=%d", envelope.completed());
+    for (int i=0; i<envelope.shared_section_file_size(); i++) {
+        ALOGD("  shared_section_file[%d]=%s", i, envelope.shared_section_file(i).c_str());
+    }
     ALOGD("}");
 }
 
@@ -222,6 +257,7 @@ struct WorkDirectoryEntry {
 
     string envelope;
     string data;
+    vector<string> sections;
     int64_t timestampNs;
     off_t size;
 };
@@ -229,12 +265,14 @@ struct WorkDirectoryEntry {
 WorkDirectoryEntry::WorkDirectoryEntry()
         :envelope(),
          data(),
+         sections(),
          size(0) {
 }
 
 WorkDirectoryEntry::WorkDirectoryEntry(const WorkDirectoryEntry& that)
         :envelope(that.envelope),
          data(that.data),
+         sections(that.sections),
          size(that.size) {
 }
 
@@ -390,6 +428,38 @@ void ReportFile::closeDataFile() {
     }
 }
 
+status_t ReportFile::writeSection(int sectionId, const sp<ProtoReader>& data) {
+    const size_t size = data->size();
+    if (!mWorkDirectory->sharesSections() || size < MIN_SHARED_SECTION_SIZE) {
+        status_t err = write_section_header(mDataFd, sectionId, size);
+        if (err != NO_ERROR) {
+            return err;
+        }
+        return write_data(mDataFd, data);
+    }
+
+    // Read the whole section, with its header, so it can be compared to the shared ones.
+    uint8_t header[20];
+    uint8_t* p = write_length_delimited_tag_header(header, sectionId, size);
+    string contents(reinterpret_cast<const char*>(header), p - header);
+    contents.reserve(contents.size() + size);
+    while (data->readBuffer() != NULL) {
+        contents.append(reinterpret_cast<const char*>(data->readBuffer()),
+                data->currentToRead());
+        data->move(data->currentToRead());
+    }
+
+    string fileName;
+    if (mWorkDirectory->linkSharedSection(mTimestampNs, sectionId, contents, &fileName)
+            == NO_ERROR) {
+        mEnvelope.add_shared_section_file(fileName);
+        return NO_ERROR;
+    }
+
+    // Error logged in linkSharedSection. Keep the section in the data file instead.
+    return WriteFully(mDataFd, contents.data(), contents.size()) ? NO_ERROR : -errno;
+}
+
 status_t ReportFile::startFilteringData(int writeFd, const IncidentReportArgs& args) {
     // Open data file.
     int dataFd = open(mDataFileName.c_str(), O_RDONLY | O_CLOEXEC);
@@ -436,6 +506,21 @@ status_t ReportFile::startFilteringData(int writeFd, const IncidentReportArgs& a
                 strerror(-err));
     }
 
+    for (const string& sectionFileName : mEnvelope.shared_section_file()) {
+        int sectionFd = open(sectionFileName.c_str(), O_RDONLY | O_CLOEXEC);
+        if (sectionFd < 0) {
+            ALOGW("Error opening shared section '%s' %s", sectionFileName.c_str(),
+                    strerror(errno));
+            continue;
+        }
+        err = filter_and_write_report(writeFd, sectionFd, mEnvelope.privacy_policy(), args);
+        if (err != NO_ERROR) {
+            ALOGW("Error writing shared section '%s' to dropbox: %s", sectionFileName.c_str(),
+                    strerror(-err));
+        }
+        close(sectionFd);
+    }
+
     close(writeFd);
     return NO_ERROR;
 }
@@ -498,15 +583,17 @@ status_t ReportFile::load_envelope_impl(bool cleanup) {
 WorkDirectory::WorkDirectory()
         :mDirectory("/data/misc/incidents"),
          mMaxFileCount(100),
-         mMaxDiskUsageBytes(100 * 1024 * 1024) {  // Incident reports can take up to 100MB on disk.
+         mMaxDiskUsageBytes(100 * 1024 * 1024),  // Incident reports can take up to 100MB on disk.
                                                  // TODO: Should be a flag.
+         mShareSections(GetBoolProperty("incidentd.share_sections", false)) {
     create_directory(mDirectory.c_str());
 }
 
 WorkDirectory::WorkDirectory(const string& dir, int maxFileCount, long maxDiskUsageBytes)
         :mDirectory(dir),
          mMaxFileCount(maxFileCount),
-         mMaxDiskUsageBytes(maxDiskUsageBytes) {
+         mMaxDiskUsageBytes(maxDiskUsageBytes),
+         mShareSections(GetBoolProperty("incidentd.share_sections", false)) {
     create_directory(mDirectory.c_str());
 }
 
@@ -642,11 +729,60 @@ void WorkDirectory::remove(const sp<ReportFile>& report) {
     unique_lock<mutex> lock(mLock);
     // Set this to false to leave files around for debugging.
     if (DO_UNLINK) {
-        unlink(report->getDataFileName().c_str());
-        unlink(report->getEnvelopeFileName().c_str());
+        unlink_report_files_locked(report);
     }
 }
 
+bool WorkDirectory::sharesSections() const {
+    return mShareSections;
+}
+
+status_t WorkDirectory::linkSharedSection(int64_t timestampNs, int sectionId,
+        const string& contents, string* fileName) {
+    unique_lock<mutex> lock(mLock);
+
+    const string sharedFileName = make_shared_filename(contents);
+    string existing;
+    if (ReadFileToString(sharedFileName, &existing)) {
+        if (existing != contents) {
+            ALOGW("Shared section file %s has different contents", sharedFileName.c_str());
+            return ALREADY_EXISTS;
+        }
+    } else {
+        // Write to a temporary file first, so a partial file is never shared.
+        const string tmpFileName = sharedFileName + ".tmp";
+        int fd = open(tmpFileName.c_str(), O_CREAT | O_TRUNC | O_RDWR | O_CLOEXEC, 0660);
+        if (fd < 0) {
+            status_t err = -errno;
+            ALOGW("Can't create shared section file %s: %s", tmpFileName.c_str(),
+                    strerror(-err));
+            return err;
+        }
+        const bool written = WriteFully(fd, contents.data(), contents.size());
+        status_t err = written ? NO_ERROR : -errno;
+        close(fd);
+        if (err == NO_ERROR && rename(tmpFileName.c_str(), sharedFileName.c_str()) != 0) {
+            err = -errno;
+        }
+        if (err != NO_ERROR) {
+            ALOGW("Can't write shared section file %s: %s", sharedFileName.c_str(),
+                    strerror(-err));
+            unlink(tmpFileName.c_str());
+            return err;
+        }
+    }
+
+    // The link count of the shared file counts the reports that use it.
+    *fileName = make_filename(timestampNs, "." + to_string(sectionId) + EXTENSION_SECTION);
+    if (link(sharedFileName.c_str(), fileName->c_str()) != 0) {
+        status_t err = -errno;
+        ALOGW("Can't link shared section file %s to %s: %s", sharedFileName.c_str(),
+                fileName->c_str(), strerror(-err));
+        return err;
+    }
+    return NO_ERROR;
+}
+
 int64_t WorkDirectory::make_timestamp_ns_locked() {
     // Guarantee that we don't have duplicate timestamps.
     // This is a little bit lame, but since reports are created on the
@@ -686,6 +822,13 @@ string WorkDirectory::make_filename(int64_t timestampNs, const string& extension
     return result.str();
 }
 
+string WorkDirectory::make_shared_filename(const string& contents) {
+    stringstream result;
+    result << mDirectory << '/' << hex << setfill('0') << setw(16) << hash_contents(contents)
+            << '_' << dec << contents.size() << EXTENSION_SHARED;
+    return result.str();
+}
+
 off_t WorkDirectory::get_directory_contents_locked(map<string,WorkDirectoryEntry>* files,
         int64_t after) {
     DIR* dir;
@@ -711,10 +854,20 @@ off_t WorkDirectory::get_directory_contents_locked(map<string,WorkDirectoryEntry
 
         bool isEnvelope = ends_with(entryname, EXTENSION_ENVELOPE);
         bool isData = ends_with(entryname, EXTENSION_DATA);
+        bool isSection = ends_with(entryname, EXTENSION_SECTION);
+
+        // Shared section files that no report links to any more can go.
+        if (ends_with(entryname, EXTENSION_SHARED)) {
+            struct stat st;
+            if (DO_UNLINK && stat(filename.c_str(), &st) == 0 && st.st_nlink <= 1) {
+                unlink(filename.c_str());
+            }
+            continue;
+        }
 
         // If the file isn't one of our files, just ignore it.  Otherwise,
         // sum up the sizes.
-        if (isEnvelope || isData) {
+        if (isEnvelope || isData || isSection) {
             string timestamp = strip_extension(entryname);
 
             int64_t timestampNs;
@@ -732,15 +885,23 @@ off_t WorkDirectory::get_directory_contents_locked(map<string,WorkDirectoryEntry
                     continue;
                 }
 
+                // The reports that link to a shared section file split its size.
+                off_t size = st.st_size;
+                if (isSection && st.st_nlink > 1) {
+                    size /= st.st_nlink - 1;
+                }
+
                 WorkDirectoryEntry& entry = (*files)[timestamp];
                 if (isEnvelope) {
                     entry.envelope = filename;
                 } else if (isData) {
                     entry.data = filename;
+                } else if (isSection) {
+                    entry.sections.push_back(filename);
                 }
                 entry.timestampNs = timestampNs;
-                entry.size += st.st_size;
-                totalSize += st.st_size;
+                entry.size += size;
+                totalSize += size;
             }
         }
     }
@@ -756,6 +917,9 @@ off_t WorkDirectory::get_directory_contents_locked(map<string,WorkDirectoryEntry
         while (it != files->end()) {
             if (it->second.envelope.length() == 0) {
                 unlink(it->second.data.c_str());
+                for (const string& section : it->second.sections) {
+                    unlink(section.c_str());
+                }
                 it = files->erase(it);
             } else {
                 it++;
@@ -793,6 +957,9 @@ void WorkDirectory::clean_directory_locked() {
                 it++) {
             unlink(it->second.envelope.c_str());
             unlink(it->second.data.c_str());
+            for (const string& section : it->second.sections) {
+                unlink(section.c_str());
+            }
             totalSize -= it->second.size;
             totalCount--;
         }
@@ -803,12 +970,21 @@ void WorkDirectory::delete_files_for_report_if_necessary(const sp<ReportFile>& r
     if (report->getEnvelope().report_size() == 0) {
         ALOGI("Report %s is finished. Deleting from storage.", report->getId().c_str());
         if (DO_UNLINK) {
-            unlink(report->getDataFileName().c_str());
-            unlink(report->getEnvelopeFileName().c_str());
+            unlink_report_files_locked(report);
         }
     }
 }
 
+void WorkDirectory::unlink_report_files_locked(const sp<ReportFile>& report) {
+    unlink(report->getDataFileName().c_str());
+    unlink(report->getEnvelopeFileName().c_str());
+    // The shared section files themselves are removed by the next directory scan, once
+    // no report links to them.
+    for (const string& section : report->getEnvelope().shared_section_file()) {
+        unlink(section.c_str());
+    }
+}
+
 // ================================================================================
 void get_args_from_report(IncidentReportArgs* out, const ReportFileProto_Report& report) {
     out->setPrivacyPolicy(report.privacy_policy());
@@ -18,6 +18,7 @@
 
 #include <android/content/ComponentName.h>
 #include <android/os/IncidentReportArgs.h>
+#include <android/util/ProtoReader.h>
 #include <frameworks/base/core/proto/android/os/metadata.pb.h>
 #include <frameworks/base/cmds/incidentd/src/report_file.pb.h>
 
@@ -32,6 +33,7 @@ namespace incidentd {
 
 using android::content::ComponentName;
 using android::os::IncidentReportArgs;
+using android::util::ProtoReader;
 using namespace std;
 
 extern const ComponentName DROPBOX_SENTINEL;
@@ -134,6 +136,13 @@ public:
      */
     void closeDataFile();
 
+    /**
+     * Write a section to the data file.  If the work directory shares sections,
+     * a large section is instead linked to a file that holds the same contents
+     * for the reports that already have them, and only written if none do.
+     */
+    status_t writeSection(int sectionId, const sp<ProtoReader>& data);
+
     /**
      * Use the privacy and section configuration from the args parameter to filter data, write
      * to [writeFd] and take the ownership of [writeFd].
@@ -250,11 +259,26 @@ public:
      * more pending readers or broadcasts, for example in response to an error.
      */
     void remove(const sp<ReportFile>& report);
-    
+
+    /**
+     * Whether large sections are shared between the reports with the same contents
+     * for them.  Off unless the incidentd.share_sections property is set.
+     */
+    bool sharesSections() const;
+
+    /**
+     * Link the section [contents], with its section header, to a file for the report
+     * with [timestampNs], writing the shared file for those contents if there isn't
+     * one yet.  Sets [fileName] to the path of the report's link.
+     */
+    status_t linkSharedSection(int64_t timestampNs, int sectionId, const string& contents,
+            string* fileName);
+
 private:
     string mDirectory;
     int mMaxFileCount;
     long mMaxDiskUsageBytes;
+    bool mShareSections;
 
     // Held while creating or removing envelope files, which are the file that keeps
     // the directory consistent.
@@ -265,8 +289,10 @@ private:
     off_t get_directory_contents_locked(map<string,WorkDirectoryEntry>* files, int64_t after);
     void clean_directory_locked();
     void delete_files_for_report_if_necessary(const sp<ReportFile>& report);
+    void unlink_report_files_locked(const sp<ReportFile>& report);
 
     string make_filename(int64_t timestampNs, const string& extension);
+    string make_shared_filename(const string& contents);
 };
 
 
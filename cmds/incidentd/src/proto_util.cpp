@@ -75,7 +75,15 @@ status_t write_section(int fd, int sectionId, const MessageLite& message) {
     }
 }
 
-
+status_t write_data(int fd, const sp<ProtoReader>& reader) {
+    while (reader->readBuffer() != NULL) {
+        if (!WriteFully(fd, reader->readBuffer(), reader->currentToRead())) {
+            return -errno;
+        }
+        reader->move(reader->currentToRead());
+    }
+    return NO_ERROR;
+}
 
 }  // namespace incidentd
 }  // namespace os
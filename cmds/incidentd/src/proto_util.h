@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <android/util/ProtoReader.h>
 #include <utils/Errors.h>
 
 #include <google/protobuf/message_lite.h>
@@ -27,6 +28,7 @@ namespace os {
 namespace incidentd {
 
 using std::vector;
+using android::util::ProtoReader;
 using google::protobuf::MessageLite;
 
 /**
@@ -45,6 +47,11 @@ status_t write_section_header(int fd, int sectionId, size_t size);
  */
 status_t write_section(int fd, int sectionId, const MessageLite& message);
 
+/**
+ * Write all of the data left in the reader to the file descriptor.
+ */
+status_t write_data(int fd, const sp<ProtoReader>& reader);
+
 }  // namespace incidentd
 }  // namespace os
 }  // namespace android
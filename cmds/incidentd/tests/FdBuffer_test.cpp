@@ -206,6 +206,40 @@ TEST_F(FdBufferTest, ReadInStreamAndWriteAllAtOnce) {
     }
 }
 
+TEST_F(FdBufferTest, ReadInStreamFromPipe) {
+    std::string testdata = "splice from a pipe to a pipe";
+    std::string expected = HEAD + testdata;
+    Fpipe inputPipe;
+    ASSERT_NE(inputPipe.init(), -1);
+    ASSERT_TRUE(WriteStringToFd(testdata, inputPipe.writeFd()));
+    inputPipe.writeFd().reset();
+
+    int pid = fork();
+    ASSERT_TRUE(pid != -1);
+
+    if (pid == 0) {
+        p2cPipe.writeFd().reset();
+        c2pPipe.readFd().reset();
+        ASSERT_TRUE(WriteStringToFd(HEAD, c2pPipe.writeFd()));
+        ASSERT_TRUE(DoDataStream(p2cPipe.readFd(), c2pPipe.writeFd()));
+        p2cPipe.readFd().reset();
+        c2pPipe.writeFd().reset();
+        // Must exit here otherwise the child process will continue executing the test binary.
+        _exit(EXIT_SUCCESS);
+    } else {
+        p2cPipe.readFd().reset();
+        c2pPipe.writeFd().reset();
+
+        ASSERT_EQ(NO_ERROR,
+                  buffer.readProcessedDataInStream(inputPipe.readFd().get(),
+                                                   std::move(p2cPipe.writeFd()),
+                                                   std::move(c2pPipe.readFd()), READ_TIMEOUT));
+        AssertBufferReadSuccessful(HEAD.size() + testdata.size());
+        AssertBufferContent(expected.c_str());
+        wait(&pid);
+    }
+}
+
 TEST_F(FdBufferTest, ReadInStreamEmpty) {
     ASSERT_TRUE(WriteStringToFile("", tf.path));
 
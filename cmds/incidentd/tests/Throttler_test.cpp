@@ -16,11 +16,25 @@
 
 #include "Throttler.h"
 
+#include <android/os/IncidentReportArgs.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
+#include <private/android_filesystem_config.h>
 
+using namespace android;
+using namespace android::os;
 using namespace android::os::incidentd;
 
+static sp<ReportBatch> makeBatch(uid_t uid, uint8_t privacyPolicy) {
+    IncidentReportArgs args;
+    args.setPrivacyPolicy(privacyPolicy);
+    args.setReceiverPkg(String16("com.android.test"));
+    args.setReceiverCls(String16("com.android.test.Receiver"));
+    sp<ReportBatch> batch = new ReportBatch();
+    batch->addPersistedReport(args, uid);
+    return batch;
+}
+
 TEST(ThrottlerTest, DataSizeExceeded) {
     Throttler t(100, 100000);
     EXPECT_FALSE(t.shouldThrottle());
@@ -36,3 +50,42 @@ TEST(ThrottlerTest, TimeReset) {
     sleep(1);  // sleep for 1 second to make sure throttler resets
     EXPECT_FALSE(t.shouldThrottle());
 }
+
+TEST(ThrottlerTest, BucketPerUid) {
+    Throttler t(1000, 100, 100000);
+    sp<ReportBatch> taken = t.filterBatch(makeBatch(10001, PRIVACY_POLICY_EXPLICIT));
+    EXPECT_TRUE(taken->hasPersistedReports());
+    t.addReportSize(taken, 200);
+
+    // The bucket of 10001 is used up, but not the ones of the others.
+    sp<ReportBatch> queued = makeBatch(10001, PRIVACY_POLICY_EXPLICIT);
+    EXPECT_FALSE(t.filterBatch(queued)->hasPersistedReports());
+    EXPECT_TRUE(queued->hasPersistedReports());
+    EXPECT_TRUE(t.filterBatch(makeBatch(10002, PRIVACY_POLICY_EXPLICIT))->hasPersistedReports());
+    EXPECT_TRUE(t.filterBatch(makeBatch(10001, PRIVACY_POLICY_AUTOMATIC))->hasPersistedReports());
+}
+
+TEST(ThrottlerTest, BucketRefill) {
+    Throttler t(1000, 100, 500);
+    sp<ReportBatch> taken = t.filterBatch(makeBatch(10001, PRIVACY_POLICY_EXPLICIT));
+    t.addReportSize(taken, 150);
+    EXPECT_FALSE(t.filterBatch(makeBatch(10001, PRIVACY_POLICY_EXPLICIT))->hasPersistedReports());
+    sleep(1);  // sleep for 1 second to make sure the bucket refills
+    EXPECT_TRUE(t.filterBatch(makeBatch(10001, PRIVACY_POLICY_EXPLICIT))->hasPersistedReports());
+}
+
+TEST(ThrottlerTest, CriticalPreempts) {
+    Throttler t(100, 100, 100000);
+    sp<ReportBatch> taken = t.filterBatch(makeBatch(AID_SYSTEM, PRIVACY_POLICY_EXPLICIT));
+    t.addReportSize(taken, 80);
+
+    // Normal requests can't use the last quarter of the global limit, and the
+    // system uid isn't held back by its bucket.
+    EXPECT_FALSE(t.filterBatch(makeBatch(10001, PRIVACY_POLICY_EXPLICIT))->hasPersistedReports());
+    taken = t.filterBatch(makeBatch(AID_SYSTEM, PRIVACY_POLICY_EXPLICIT));
+    EXPECT_TRUE(taken->hasPersistedReports());
+    t.addReportSize(taken, 80);
+    EXPECT_TRUE(t.shouldThrottle());
+    taken = t.filterBatch(makeBatch(AID_SYSTEM, PRIVACY_POLICY_EXPLICIT));
+    EXPECT_FALSE(taken->hasPersistedReports());
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <vector>
+#include "anomaly/AlarmMonitor.h"
+#include "benchmark/benchmark.h"
+
+namespace android {
+namespace os {
+namespace statsd {
+
+using std::vector;
+
+// Replays the alarm traffic of a DurationAnomalyTracker with state.range(0) dimensions: each
+// start or stop replaces that dimension's alarm, and the alarms due are popped every second.
+static void alarmChurn(benchmark::State& state, bool useTimerWheel) {
+    const size_t dimensionCount = state.range(0);
+    const uint32_t startSec = 1500000000;
+    AlarmMonitor monitor(60, [](const sp<IStatsCompanionService>&, int64_t) {},
+                         [](const sp<IStatsCompanionService>&) {}, useTimerWheel);
+    vector<sp<const InternalAlarm>> alarms(dimensionCount);
+    uint32_t seed = 1;
+    auto nextRandom = [&seed]() {
+        seed = seed * 1103515245 + 12345;
+        return seed >> 8;
+    };
+    for (size_t i = 0; i < dimensionCount; i++) {
+        alarms[i] = new InternalAlarm{startSec + 1 + nextRandom() % 3600};
+        monitor.add(alarms[i]);
+    }
+
+    uint32_t nowSec = startSec;
+    size_t replaced = 0;
+    for (auto _ : state) {
+        size_t i = nextRandom() % dimensionCount;
+        monitor.remove(alarms[i]);
+        alarms[i] = new InternalAlarm{nowSec + 1 + nextRandom() % 3600};
+        monitor.add(alarms[i]);
+        if (++replaced % dimensionCount == 0) {
+            nowSec++;
+            benchmark::DoNotOptimize(monitor.popSoonerThan(nowSec));
+        }
+    }
+}
+
+static void BM_AlarmMonitorChurn_PriorityQueue(benchmark::State& state) {
+    alarmChurn(state, false /* useTimerWheel */);
+}
+BENCHMARK(BM_AlarmMonitorChurn_PriorityQueue)->Arg(100)->Arg(1000)->Arg(10000);
+
+static void BM_AlarmMonitorChurn_TimerWheel(benchmark::State& state) {
+    alarmChurn(state, true /* useTimerWheel */);
+}
+BENCHMARK(BM_AlarmMonitorChurn_TimerWheel)->Arg(100)->Arg(1000)->Arg(10000);
+
+}  //  namespace statsd
+}  //  namespace os
+}  //  namespace android
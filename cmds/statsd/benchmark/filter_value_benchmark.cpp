@@ -18,6 +18,8 @@
 #include "FieldValue.h"
 #include "HashableDimensionKey.h"
 #include "logd/LogEvent.h"
+#include "matchers/CompiledAtomMatcher.h"
+#include "matchers/matcher_util.h"
 #include "stats_log_util.h"
 
 namespace android {
@@ -61,6 +63,54 @@ static void BM_FilterValue(benchmark::State& state) {
 
 BENCHMARK(BM_FilterValue);
 
+// Uid of the first attribution node in a list of packages, and the string field.
+static void createAtomMatcher(SimpleAtomMatcher* matcher) {
+    matcher->set_atom_id(1);
+    auto attributionMatcher = matcher->add_field_value_matcher();
+    attributionMatcher->set_field(1);
+    attributionMatcher->set_position(FIRST);
+    auto uidMatcher = attributionMatcher->mutable_matches_tuple()->add_field_value_matcher();
+    uidMatcher->set_field(1);
+    for (int i = 0; i < 8; i++) {
+        uidMatcher->mutable_eq_any_string()->add_str_value("com.example.app" + std::to_string(i));
+    }
+    uidMatcher->mutable_eq_any_string()->add_str_value("AID_SYSTEM");
+    auto stringMatcher = matcher->add_field_value_matcher();
+    stringMatcher->set_field(3);
+    stringMatcher->set_eq_string("LOCATION");
+}
+
+static void BM_MatchesSimple(benchmark::State& state) {
+    LogEvent event(1, 100000);
+    FieldMatcher field_matcher;
+    createLogEventAndMatcher(&event, &field_matcher);
+    SimpleAtomMatcher matcher;
+    createAtomMatcher(&matcher);
+    UidMap uidMap;
+
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(matchesSimple(uidMap, matcher, event));
+    }
+}
+
+BENCHMARK(BM_MatchesSimple);
+
+static void BM_CompiledAtomMatcher(benchmark::State& state) {
+    LogEvent event(1, 100000);
+    FieldMatcher field_matcher;
+    createLogEventAndMatcher(&event, &field_matcher);
+    SimpleAtomMatcher matcher;
+    createAtomMatcher(&matcher);
+    const CompiledAtomMatcher compiled(matcher);
+    UidMap uidMap;
+
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(compiled.matches(uidMap, event));
+    }
+}
+
+BENCHMARK(BM_CompiledAtomMatcher);
+
 }  //  namespace statsd
 }  //  namespace os
 }  //  namespace android
@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Replays a recorded event trace against a real config through the same path statsd uses:
+// socket payload -> LogEvent -> LogEventQueue -> StatsLogProcessor.
+//
+// Inputs are taken from the environment since BENCHMARK_MAIN owns the command line:
+//   STATSD_BENCHMARK_CONFIG: a serialized StatsdConfig.
+//   STATSD_BENCHMARK_TRACE:  a sequence of records, each
+//                              uint32 payload size, int32 uid, int32 pid, payload bytes
+//                            where payload is what the statsd socket delivers after the
+//                            android_log_header_t, i.e. the stats_log event list.
+
+#include <android-base/file.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "benchmark/benchmark.h"
+#include "logd/LogEventQueue.h"
+#include "metric_util.h"
+
+namespace android {
+namespace os {
+namespace statsd {
+
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+static const int kLogMsgHeaderSize = 28;
+
+struct TraceRecord {
+    int32_t uid;
+    int32_t pid;
+    string payload;
+};
+
+static bool readTrace(const char* path, vector<TraceRecord>* records) {
+    string content;
+    if (!android::base::ReadFileToString(path, &content)) {
+        return false;
+    }
+    size_t pos = 0;
+    while (pos + 3 * sizeof(int32_t) <= content.size()) {
+        uint32_t size;
+        TraceRecord record;
+        memcpy(&size, content.data() + pos, sizeof(size));
+        memcpy(&record.uid, content.data() + pos + 4, sizeof(record.uid));
+        memcpy(&record.pid, content.data() + pos + 8, sizeof(record.pid));
+        pos += 3 * sizeof(int32_t);
+        if (size > LOGGER_ENTRY_MAX_PAYLOAD || pos + size > content.size()) {
+            return false;
+        }
+        record.payload.assign(content.data() + pos, size);
+        pos += size;
+        records->push_back(std::move(record));
+    }
+    return pos == content.size();
+}
+
+// Mirrors what StatsSocketListener::onDataAvailable does with a received payload.
+static unique_ptr<LogEvent> makeLogEvent(const TraceRecord& record) {
+    log_msg msg;
+    msg.entry.len = record.payload.size();
+    msg.entry.hdr_size = kLogMsgHeaderSize;
+    msg.entry.sec = time(nullptr);
+    msg.entry.pid = record.pid;
+    msg.entry.uid = record.uid;
+    memcpy(msg.buf + kLogMsgHeaderSize, record.payload.data(), record.payload.size());
+    msg.buf[kLogMsgHeaderSize + record.payload.size()] = 0;
+    return std::make_unique<LogEvent>(msg);
+}
+
+static int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+}
+
+static void BM_PipelineReplay(benchmark::State& state) {
+    const char* configPath = getenv("STATSD_BENCHMARK_CONFIG");
+    const char* tracePath = getenv("STATSD_BENCHMARK_TRACE");
+    string configBytes;
+    StatsdConfig config;
+    vector<TraceRecord> trace;
+    if (configPath == nullptr || tracePath == nullptr) {
+        state.SkipWithError("Set STATSD_BENCHMARK_CONFIG and STATSD_BENCHMARK_TRACE");
+        return;
+    }
+    if (!android::base::ReadFileToString(configPath, &configBytes) ||
+        !config.ParseFromString(configBytes)) {
+        state.SkipWithError("Cannot read config");
+        return;
+    }
+    if (!readTrace(tracePath, &trace) || trace.empty()) {
+        state.SkipWithError("Cannot read trace");
+        return;
+    }
+
+    vector<int64_t> pushTimesNs(trace.size());
+    vector<int64_t> latenciesNs;
+    latenciesNs.reserve(trace.size());
+    int64_t totalEvents = 0;
+    int64_t totalReplayNs = 0;
+    int64_t totalDumpNs = 0;
+    int64_t dumpBytes = 0;
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        ConfigKey key(1000, 12345);
+        sp<StatsLogProcessor> processor = CreateStatsLogProcessor(1, config, key);
+        // Large enough for the whole trace so that the latency bookkeeping stays in step.
+        LogEventQueue queue(trace.size());
+        state.ResumeTiming();
+
+        const int64_t startNs = nowNs();
+        std::thread consumer([&] {
+            vector<unique_ptr<LogEvent>> batch;
+            size_t processed = 0;
+            while (processed < trace.size()) {
+                queue.waitPopBatch(64, &batch);
+                for (auto& event : batch) {
+                    processor->OnLogEvent(event.get());
+                    latenciesNs.push_back(nowNs() - pushTimesNs[processed++]);
+                }
+                batch.clear();
+            }
+        });
+        for (size_t i = 0; i < trace.size(); i++) {
+            unique_ptr<LogEvent> event = makeLogEvent(trace[i]);
+            int64_t oldestTimestampNs;
+            pushTimesNs[i] = nowNs();
+            queue.push(std::move(event), &oldestTimestampNs);
+        }
+        consumer.join();
+        totalReplayNs += nowNs() - startNs;
+        totalEvents += trace.size();
+
+        const int64_t dumpStartNs = nowNs();
+        vector<uint8_t> output;
+        processor->onDumpReport(key, getElapsedRealtimeNs(), true /* include_current_bucket */,
+                                true /* erase_data */, ADB_DUMP, NO_TIME_CONSTRAINTS, &output);
+        totalDumpNs += nowNs() - dumpStartNs;
+        dumpBytes = output.size();
+    }
+
+    std::sort(latenciesNs.begin(), latenciesNs.end());
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    state.SetItemsProcessed(totalEvents);
+    state.counters["events_per_sec"] = totalReplayNs == 0 ? 0 : totalEvents * 1e9 / totalReplayNs;
+    state.counters["p50_latency_ns"] = latenciesNs[latenciesNs.size() / 2];
+    state.counters["p99_latency_ns"] = latenciesNs[latenciesNs.size() * 99 / 100];
+    state.counters["peak_rss_kb"] = usage.ru_maxrss;
+    state.counters["dump_time_ns"] = totalDumpNs / std::max<int64_t>(state.iterations(), 1);
+    state.counters["dump_bytes"] = dumpBytes;
+}
+BENCHMARK(BM_PipelineReplay)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+}  //  namespace statsd
+}  //  namespace os
+}  //  namespace android
@@ -149,9 +149,27 @@ bool isAttributionUidField(const Field& field, const Value& value) {
     return false;
 }
 
-Value::Value(const Value& from) {
-    type = from.getType();
-    switch (type) {
+Value::Value(const Value& from) : type(UNKNOWN) {
+    copyFrom(from);
+}
+
+Value::Value(Value&& from) noexcept : type(UNKNOWN) {
+    switch (from.type) {
+        case STRING:
+            new (&str_value) InternedString(std::move(from.str_value));
+            break;
+        case STORAGE:
+            new (&storage_value) InternedString(std::move(from.storage_value));
+            break;
+        default:
+            long_value = from.long_value;
+            break;
+    }
+    type = from.type;
+}
+
+void Value::copyFrom(const Value& from) {
+    switch (from.type) {
         case INT:
             int_value = from.int_value;
             break;
@@ -165,14 +183,15 @@ Value::Value(const Value& from) {
             double_value = from.double_value;
             break;
         case STRING:
-            str_value = from.str_value;
+            new (&str_value) InternedString(from.str_value);
             break;
         case STORAGE:
-            storage_value = from.storage_value;
+            new (&storage_value) InternedString(from.storage_value);
             break;
         default:
             break;
     }
+    type = from.type;
 }
 
 std::string Value::toString() const {
@@ -186,7 +205,7 @@ std::string Value::toString() const {
         case DOUBLE:
             return std::to_string(double_value) + "[D]";
         case STRING:
-            return str_value + "[S]";
+            return str_value.str() + "[S]";
         case STORAGE:
             return "bytes of size " + std::to_string(storage_value.size()) + "[ST]";
         default:
@@ -353,28 +372,17 @@ Value Value::operator-(const Value& that) const {
 }
 
 Value& Value::operator=(const Value& that) {
-    type = that.type;
-    switch (type) {
-        case INT:
-            int_value = that.int_value;
-            break;
-        case LONG:
-            long_value = that.long_value;
-            break;
-        case FLOAT:
-            float_value = that.float_value;
-            break;
-        case DOUBLE:
-            double_value = that.double_value;
-            break;
-        case STRING:
-            str_value = that.str_value;
-            break;
-        case STORAGE:
-            storage_value = that.storage_value;
-            break;
-        default:
-            break;
+    if (this != &that) {
+        releaseString();
+        copyFrom(that);
+    }
+    return *this;
+}
+
+Value& Value::operator=(Value&& that) noexcept {
+    if (this != &that) {
+        releaseString();
+        new (this) Value(std::move(that));
     }
     return *this;
 }
@@ -15,8 +15,11 @@
  */
 #pragma once
 
+#include "InternedString.h"
 #include "frameworks/base/cmds/statsd/src/statsd_config.pb.h"
 
+#include <new>
+
 namespace android {
 namespace os {
 namespace statsd {
@@ -265,8 +268,12 @@ inline Matcher getSimpleMatcher(int32_t tag, size_t field) {
  * A wrapper for a union type to contain multiple types of values.
  *
  */
+/**
+ * A typed value. Strings and bytes are InternedStrings kept in the union, so a Value is 16
+ * bytes and copying one never copies string payloads.
+ */
 struct Value {
-    Value() : type(UNKNOWN) {}
+    Value() : long_value(0), type(UNKNOWN) {}
 
     Value(int32_t v) {
         int_value = v;
@@ -289,31 +296,44 @@ struct Value {
     }
 
     Value(const std::string& v) {
-        str_value = v;
+        new (&str_value) InternedString(v);
+        type = STRING;
+    }
+
+    Value(const InternedString& v) {
+        new (&str_value) InternedString(v);
         type = STRING;
     }
 
     Value(const std::vector<uint8_t>& v) {
-        storage_value = v;
+        new (&storage_value) InternedString(reinterpret_cast<const char*>(v.data()), v.size());
         type = STORAGE;
     }
 
+    ~Value() {
+        releaseString();
+    }
+
     void setInt(int32_t v) {
+        releaseString();
         int_value = v;
         type = INT;
     }
 
     void setLong(int64_t v) {
+        releaseString();
         long_value = v;
         type = LONG;
     }
 
     void setFloat(float v) {
+        releaseString();
         float_value = v;
         type = FLOAT;
     }
 
     void setDouble(double v) {
+        releaseString();
         double_value = v;
         type = DOUBLE;
     }
@@ -323,9 +343,11 @@ struct Value {
         int64_t long_value;
         float float_value;
         double double_value;
+        // Active when type is STRING.
+        InternedString str_value;
+        // Active when type is STORAGE.
+        InternedString storage_value;
     };
-    std::string str_value;
-    std::vector<uint8_t> storage_value;
 
     Type type;
 
@@ -341,6 +363,8 @@ struct Value {
 
     Value(const Value& from);
 
+    Value(Value&& from) noexcept;
+
     bool operator==(const Value& that) const;
     bool operator!=(const Value& that) const;
 
@@ -350,8 +374,25 @@ struct Value {
     Value operator-(const Value& that) const;
     Value& operator+=(const Value& that);
     Value& operator=(const Value& that);
+    Value& operator=(Value&& that) noexcept;
+
+private:
+    // Destroys the active string member, if any. The caller must set type afterwards.
+    void releaseString() {
+        if (type == STRING) {
+            str_value.~InternedString();
+        } else if (type == STORAGE) {
+            storage_value.~InternedString();
+        }
+        type = UNKNOWN;
+    }
+
+    // Copies that into this, which must not hold a string.
+    void copyFrom(const Value& that);
 };
 
+static_assert(sizeof(Value) == 16, "Value should stay compact, every LogEvent field has one");
+
 /**
  * Represents a log item, or a dimension item (They are essentially the same).
  */
@@ -29,8 +29,12 @@ using std::string;
 using std::vector;
 
 android::hash_t hashDimension(const HashableDimensionKey& value) {
+    return value.getHash();
+}
+
+android::hash_t HashableDimensionKey::computeHash() const {
     android::hash_t hash = 0;
-    for (const auto& fieldValue : value.getValues()) {
+    for (const auto& fieldValue : mValues) {
         hash = android::JenkinsHashMix(hash, android::hash_type((int)fieldValue.mField.getField()));
         hash = android::JenkinsHashMix(hash, android::hash_type((int)fieldValue.mField.getTag()));
         hash = android::JenkinsHashMix(hash, android::hash_type((int)fieldValue.mValue.getType()));
@@ -44,8 +48,8 @@ android::hash_t hashDimension(const HashableDimensionKey& value) {
                                                android::hash_type(fieldValue.mValue.long_value));
                 break;
             case STRING:
-                hash = android::JenkinsHashMix(hash, static_cast<uint32_t>(std::hash<std::string>()(
-                                                             fieldValue.mValue.str_value)));
+                hash = android::JenkinsHashMix(
+                        hash, static_cast<uint32_t>(fieldValue.mValue.str_value.hash()));
                 break;
             case FLOAT: {
                 hash = android::JenkinsHashMix(hash,
@@ -126,6 +130,11 @@ bool HashableDimensionKey::operator==(const HashableDimensionKey& that) const {
     if (mValues.size() != that.getValues().size()) {
         return false;
     }
+    // Keys that have been hashed already, e.g. by a map lookup, are rejected without comparing
+    // their values.
+    if (mHashValid && that.mHashValid && mHash != that.mHash) {
+        return false;
+    }
     size_t count = mValues.size();
     for (size_t i = 0; i < count; i++) {
         if (mValues[i] != (that.getValues())[i]) {
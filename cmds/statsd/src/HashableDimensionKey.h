@@ -34,6 +34,13 @@ struct Metric2Condition {
     std::vector<Matcher> conditionFields;
 };
 
+/**
+ * A dimension key. The hash of the key is computed at most once between mutations, so that
+ * repeated map lookups and comparisons of the same key don't rehash all of its values.
+ *
+ * The hash cache is not synchronized. Like the containers they are stored in, keys must not be
+ * used from several threads without external locking.
+ */
 class HashableDimensionKey {
 public:
     explicit HashableDimensionKey(const std::vector<FieldValue>& values) {
@@ -42,27 +49,47 @@ public:
 
     HashableDimensionKey() {};
 
-    HashableDimensionKey(const HashableDimensionKey& that) : mValues(that.getValues()){};
+    HashableDimensionKey(const HashableDimensionKey& that)
+        : mValues(that.getValues()), mHash(that.mHash), mHashValid(that.mHashValid){};
+
+    HashableDimensionKey(HashableDimensionKey&& that) = default;
+
+    HashableDimensionKey& operator=(const HashableDimensionKey& that) = default;
+
+    HashableDimensionKey& operator=(HashableDimensionKey&& that) = default;
 
     inline void addValue(const FieldValue& value) {
         mValues.push_back(value);
+        mHashValid = false;
     }
 
     inline const std::vector<FieldValue>& getValues() const {
         return mValues;
     }
 
+    // The caller may modify the values through the returned pointer, so the cached hash is
+    // dropped.
     inline std::vector<FieldValue>* mutableValues() {
+        mHashValid = false;
         return &mValues;
     }
 
     inline FieldValue* mutableValue(size_t i) {
         if (i >= 0 && i < mValues.size()) {
+            mHashValid = false;
             return &(mValues[i]);
         }
         return nullptr;
     }
 
+    inline android::hash_t getHash() const {
+        if (!mHashValid) {
+            mHash = computeHash();
+            mHashValid = true;
+        }
+        return mHash;
+    }
+
     std::string toString() const;
 
     bool operator==(const HashableDimensionKey& that) const;
@@ -72,7 +99,13 @@ public:
     bool contains(const HashableDimensionKey& that) const;
 
 private:
+    android::hash_t computeHash() const;
+
     std::vector<FieldValue> mValues;
+
+    mutable android::hash_t mHash = 0;
+
+    mutable bool mHashValid = false;
 };
 
 class MetricDimensionKey {
@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "InternedString.h"
+
+#include "hash.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+
+namespace android {
+namespace os {
+namespace statsd {
+
+namespace {
+
+const uint64_t kEmptyHash = Hash64("", 0);
+
+// Guards the table, and every decrement of a reference count from 1 to 0. Lookups also hold the
+// lock, so an entry can't be resurrected after its last reference started releasing it.
+std::mutex& tableMutex() {
+    static std::mutex* sMutex = new std::mutex();
+    return *sMutex;
+}
+
+template <typename Entry>
+std::unordered_multimap<uint64_t, Entry*>& table() {
+    static auto* sTable = new std::unordered_multimap<uint64_t, Entry*>();
+    return *sTable;
+}
+
+}  // namespace
+
+InternedString::InternedString(const char* data, size_t size) : mEntry(nullptr) {
+    if (size == 0) {
+        return;
+    }
+    const uint64_t hash = Hash64(data, size);
+
+    std::lock_guard<std::mutex> lock(tableMutex());
+    auto& entries = table<Entry>();
+    auto range = entries.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        Entry* entry = it->second;
+        if (entry->size == size && memcmp(entry->chars, data, size) == 0) {
+            entry->refCount.fetch_add(1, std::memory_order_relaxed);
+            mEntry = entry;
+            return;
+        }
+    }
+
+    void* memory = malloc(offsetof(Entry, chars) + size + 1);
+    if (memory == nullptr) {
+        return;
+    }
+    Entry* entry = new (memory) Entry;
+    entry->refCount.store(1, std::memory_order_relaxed);
+    entry->size = size;
+    entry->hash = hash;
+    memcpy(entry->chars, data, size);
+    entry->chars[size] = '\0';
+    entries.emplace(hash, entry);
+    mEntry = entry;
+}
+
+InternedString& InternedString::operator=(const InternedString& that) {
+    if (mEntry != that.mEntry) {
+        if (that.mEntry != nullptr) {
+            that.mEntry->refCount.fetch_add(1, std::memory_order_relaxed);
+        }
+        release();
+        mEntry = that.mEntry;
+    }
+    return *this;
+}
+
+InternedString& InternedString::operator=(InternedString&& that) noexcept {
+    if (this != &that) {
+        release();
+        mEntry = that.mEntry;
+        that.mEntry = nullptr;
+    }
+    return *this;
+}
+
+void InternedString::release() {
+    Entry* entry = mEntry;
+    if (entry == nullptr) {
+        return;
+    }
+    mEntry = nullptr;
+
+    // Fast path: this is not the last reference.
+    int32_t count = entry->refCount.load(std::memory_order_relaxed);
+    while (count > 1) {
+        if (entry->refCount.compare_exchange_weak(count, count - 1, std::memory_order_release,
+                                                  std::memory_order_relaxed)) {
+            return;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(tableMutex());
+    if (entry->refCount.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        // Another thread looked it up while we were waiting for the lock.
+        return;
+    }
+    auto& entries = table<Entry>();
+    auto range = entries.equal_range(entry->hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == entry) {
+            entries.erase(it);
+            break;
+        }
+    }
+    entry->~Entry();
+    free(entry);
+}
+
+uint64_t InternedString::hash() const {
+    return mEntry != nullptr ? mEntry->hash : kEmptyHash;
+}
+
+int InternedString::compare(const InternedString& that) const {
+    if (mEntry == that.mEntry) {
+        return 0;
+    }
+    const size_t len = std::min(size(), that.size());
+    const int result = memcmp(data(), that.data(), len);
+    if (result != 0) {
+        return result;
+    }
+    return size() < that.size() ? -1 : (size() > that.size() ? 1 : 0);
+}
+
+bool InternedString::operator==(const char* that) const {
+    const size_t len = strlen(that);
+    return size() == len && memcmp(data(), that, len) == 0;
+}
+
+size_t InternedString::getInternedCount() {
+    std::lock_guard<std::mutex> lock(tableMutex());
+    return table<Entry>().size();
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <string>
+
+namespace android {
+namespace os {
+namespace statsd {
+
+/**
+ * An immutable, reference counted string stored in a process wide intern table.
+ *
+ * All InternedStrings with the same content share one allocation, so string fields that repeat
+ * across events (package names, wakelock tags, ...) are stored once, copying a Value is a
+ * reference count increment, and equality is a pointer comparison. The object itself is one
+ * pointer wide. An empty string does not allocate.
+ */
+class InternedString {
+public:
+    InternedString() : mEntry(nullptr) {
+    }
+
+    InternedString(const char* data, size_t size);
+
+    explicit InternedString(const std::string& str) : InternedString(str.data(), str.size()) {
+    }
+
+    InternedString(const InternedString& that) : mEntry(that.mEntry) {
+        if (mEntry != nullptr) {
+            mEntry->refCount.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    InternedString(InternedString&& that) noexcept : mEntry(that.mEntry) {
+        that.mEntry = nullptr;
+    }
+
+    ~InternedString() {
+        release();
+    }
+
+    InternedString& operator=(const InternedString& that);
+
+    InternedString& operator=(InternedString&& that) noexcept;
+
+    // Always NUL terminated.
+    const char* c_str() const {
+        return mEntry != nullptr ? mEntry->chars : "";
+    }
+
+    const char* data() const {
+        return c_str();
+    }
+
+    size_t size() const {
+        return mEntry != nullptr ? mEntry->size : 0;
+    }
+
+    size_t length() const {
+        return size();
+    }
+
+    bool empty() const {
+        return mEntry == nullptr;
+    }
+
+    // Hash64 of the content, computed once when the string is interned.
+    uint64_t hash() const;
+
+    std::string str() const {
+        return std::string(data(), size());
+    }
+
+    // Same ordering as std::string::compare.
+    int compare(const InternedString& that) const;
+
+    bool operator==(const InternedString& that) const {
+        // Equal content is always interned to the same entry.
+        return mEntry == that.mEntry;
+    }
+
+    bool operator!=(const InternedString& that) const {
+        return mEntry != that.mEntry;
+    }
+
+    bool operator<(const InternedString& that) const {
+        return compare(that) < 0;
+    }
+
+    bool operator>(const InternedString& that) const {
+        return compare(that) > 0;
+    }
+
+    bool operator>=(const InternedString& that) const {
+        return compare(that) >= 0;
+    }
+
+    bool operator==(const std::string& that) const {
+        return size() == that.size() && that.compare(0, that.size(), data(), size()) == 0;
+    }
+
+    bool operator!=(const std::string& that) const {
+        return !(*this == that);
+    }
+
+    bool operator==(const char* that) const;
+
+    bool operator!=(const char* that) const {
+        return !(*this == that);
+    }
+
+    // Number of distinct strings currently interned. For testing and dumpsys.
+    static size_t getInternedCount();
+
+private:
+    struct Entry {
+        std::atomic<int32_t> refCount;
+        uint32_t size;
+        uint64_t hash;
+        // size bytes followed by a NUL terminator.
+        char chars[1];
+    };
+
+    void release();
+
+    Entry* mEntry;
+};
+
+inline bool operator==(const std::string& a, const InternedString& b) {
+    return b == a;
+}
+
+inline bool operator!=(const std::string& a, const InternedString& b) {
+    return b != a;
+}
+
+inline bool operator==(const char* a, const InternedString& b) {
+    return b == a;
+}
+
+inline bool operator!=(const char* a, const InternedString& b) {
+    return b != a;
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
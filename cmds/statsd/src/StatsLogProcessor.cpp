@@ -21,6 +21,7 @@
 #include <android-base/file.h>
 #include <dirent.h>
 #include <frameworks/base/cmds/statsd/src/active_config_list.pb.h>
+#include <frameworks/base/cmds/statsd/src/bucket_snapshot.pb.h>
 #include "StatsLogProcessor.h"
 #include "android-base/stringprintf.h"
 #include "atoms_info.h"
@@ -72,10 +73,24 @@ const int FIELD_ID_STRINGS = 9;
 // for ActiveConfigList
 const int FIELD_ID_ACTIVE_CONFIG_LIST_CONFIG = 1;
 
+// for BucketSnapshotList
+const int FIELD_ID_BUCKET_SNAPSHOT_ELAPSED_NANOS = 1;
+const int FIELD_ID_BUCKET_SNAPSHOT_WALL_CLOCK_NANOS = 2;
+const int FIELD_ID_BUCKET_SNAPSHOT_LIST_CONFIG = 3;
+
 #define NS_PER_HOUR 3600 * NS_PER_SEC
 
 #define STATS_ACTIVE_METRIC_DIR "/data/misc/stats-active-metric"
 
+#define STATS_BUCKET_SNAPSHOT_FILE STATS_ACTIVE_METRIC_DIR "/bucket_snapshot"
+
+// Period of the bucket snapshots. This bounds the data lost when statsd restarts.
+#define BUCKET_SNAPSHOT_PERIOD_SEC 900
+
+// Largest drift between the elapsed and the wall clock time since a snapshot. A larger one means
+// that the device rebooted, and the buckets of the snapshot were reported at shutdown.
+#define BUCKET_SNAPSHOT_MAX_CLOCK_DRIFT_SEC 60
+
 // Cool down period for writing data to disk to avoid overwriting files.
 #define WRITE_DATA_COOL_DOWN_SEC 5
 
@@ -91,11 +106,13 @@ StatsLogProcessor::StatsLogProcessor(const sp<UidMap>& uidMap,
       mPullerManager(pullerManager),
       mAnomalyAlarmMonitor(anomalyAlarmMonitor),
       mPeriodicAlarmMonitor(periodicAlarmMonitor),
+      mSharedMatcherPool(new SharedMatcherPool(uidMap)),
       mSendBroadcast(sendBroadcast),
       mSendActivationBroadcast(activateBroadcast),
       mTimeBaseNs(timeBaseNs),
       mLargestTimestampSeen(0),
-      mLastTimestampSeen(0) {
+      mLastTimestampSeen(0),
+      mLastBucketSnapshotNs(timeBaseNs) {
     mPullerManager->ForceClearPullerCache();
 }
 
@@ -237,6 +254,8 @@ void StatsLogProcessor::OnLogEvent(LogEvent* event) {
 
     std::unordered_set<int> uidsWithActiveConfigsChanged;
     std::unordered_map<int, std::vector<int64_t>> activeConfigsPerUid;
+    // Matchers shared by several configs are evaluated once for this event.
+    mSharedMatcherPool->startEvent(event);
     // pass the event to metrics managers.
     for (auto& pair : mMetricsManagers) {
         int uid = pair.first.GetUid();
@@ -263,6 +282,11 @@ void StatsLogProcessor::OnLogEvent(LogEvent* event) {
         }
         flushIfNecessaryLocked(event->GetElapsedTimestampNs(), pair.first, *(pair.second));
     }
+    mSharedMatcherPool->finishEvent();
+
+    if (currentTimestampNs - mLastBucketSnapshotNs > BUCKET_SNAPSHOT_PERIOD_SEC * NS_PER_SEC) {
+        SaveBucketSnapshotLocked(currentTimestampNs);
+    }
 
     for (int uid : uidsWithActiveConfigsChanged) {
         // Send broadcast so that receivers can pull data.
@@ -305,6 +329,24 @@ void StatsLogProcessor::GetActiveConfigsLocked(const int uid, vector<int64_t>& o
     }
 }
 
+void StatsLogProcessor::setLogEventFilter(const std::shared_ptr<LogEventFilter>& filter) {
+    std::lock_guard<std::mutex> lock(mMetricsMutex);
+    mLogEventFilter = filter;
+    updateLogEventFilterLocked();
+}
+
+void StatsLogProcessor::updateLogEventFilterLocked() const {
+    if (mLogEventFilter == nullptr) {
+        return;
+    }
+    // OnLogEvent handles isolated uid changes even without any config.
+    std::unordered_set<int> atomIds = {android::util::ISOLATED_UID_CHANGED};
+    for (const auto& pair : mMetricsManagers) {
+        atomIds.insert(pair.second->getAtomIds().begin(), pair.second->getAtomIds().end());
+    }
+    mLogEventFilter->setAtomIds(std::move(atomIds));
+}
+
 void StatsLogProcessor::OnConfigUpdated(const int64_t timestampNs, const ConfigKey& key,
                                         const StatsdConfig& config) {
     std::lock_guard<std::mutex> lock(mMetricsMutex);
@@ -319,9 +361,11 @@ void StatsLogProcessor::OnConfigUpdatedLocked(
             new MetricsManager(key, config, mTimeBaseNs, timestampNs, mUidMap, mPullerManager,
                                mAnomalyAlarmMonitor, mPeriodicAlarmMonitor);
     if (newMetricsManager->isConfigValid()) {
+        newMetricsManager->setSharedMatcherPool(mSharedMatcherPool);
         mUidMap->OnConfigUpdated(key);
         newMetricsManager->refreshTtl(timestampNs);
         mMetricsManagers[key] = newMetricsManager;
+        updateLogEventFilterLocked();
         VLOG("StatsdConfig valid");
     } else {
         // If there is any error in the config, don't use it.
@@ -420,6 +464,79 @@ void StatsLogProcessor::onDumpReport(const ConfigKey& key, const int64_t dumpTim
     StatsdStats::getInstance().noteMetricsReportSent(key, proto.size());
 }
 
+/*
+ * onDumpReport streams serialized ConfigMetricsReportList into outFd.
+ */
+bool StatsLogProcessor::onDumpReport(const ConfigKey& key, const int64_t dumpTimeStampNs,
+                                     const bool include_current_partial_bucket,
+                                     const bool erase_data,
+                                     const DumpReportReason dumpReportReason,
+                                     const DumpLatency dumpLatency,
+                                     int outFd, uint32_t enclosingFieldId) {
+    std::lock_guard<std::mutex> lock(mMetricsMutex);
+
+    // Only holds the uid and id, so it doesn't need a whole default chunk.
+    ProtoOutputStream configKeyProto(SMALL_PROTO_CHUNK_SIZE);
+    uint64_t configKeyToken = configKeyProto.start(FIELD_TYPE_MESSAGE | FIELD_ID_CONFIG_KEY);
+    configKeyProto.write(FIELD_TYPE_INT32 | FIELD_ID_UID, key.GetUid());
+    configKeyProto.write(FIELD_TYPE_INT64 | FIELD_ID_ID, (long long)key.GetId());
+    configKeyProto.end(configKeyToken);
+
+    bool keepFile = false;
+    auto it = mMetricsManagers.find(key);
+    if (it != mMetricsManagers.end() && it->second->shouldPersistLocalHistory()) {
+        keepFile = true;
+    }
+    const bool isAdb = dumpReportReason == ADB_DUMP;
+    const bool eraseFiles = erase_data && !keepFile;
+
+    // Every length has to be known before the first byte goes out, so open the files on disk
+    // and serialize the in-memory report first. The output order matches the proto path:
+    // reports from previous shutdowns, then the current one.
+    vector<StorageManager::ReportFile> files =
+            StorageManager::openConfigMetricsReports(key, isAdb);
+
+    vector<uint8_t> buffer;
+    if (it != mMetricsManagers.end()) {
+        // This allows another broadcast to be sent within the rate-limit period if we get close to
+        // filling the buffer again soon.
+        mLastBroadcastTimes.erase(key);
+        onConfigMetricsReportLocked(key, dumpTimeStampNs, include_current_partial_bucket,
+                                    erase_data, dumpReportReason, dumpLatency,
+                                    false /* is this data going to be saved on disk */, &buffer);
+    } else {
+        ALOGW("Config source %s does not exist", key.ToString().c_str());
+    }
+
+    uint64_t totalSize = configKeyProto.size();
+    for (const auto& file : files) {
+        totalSize += lengthDelimitedHeaderSize(FIELD_ID_REPORTS, file.mSizeBytes) +
+                     file.mSizeBytes;
+    }
+    if (it != mMetricsManagers.end()) {
+        totalSize += lengthDelimitedHeaderSize(FIELD_ID_REPORTS, buffer.size()) + buffer.size();
+    }
+
+    bool good = enclosingFieldId == 0 ||
+                writeLengthDelimitedHeader(outFd, enclosingFieldId, totalSize);
+    good = good && configKeyProto.flush(outFd);
+    for (auto& file : files) {
+        good = good && writeLengthDelimitedHeader(outFd, FIELD_ID_REPORTS, file.mSizeBytes) &&
+               StorageManager::spliceConfigMetricsReport(&file, outFd, eraseFiles, isAdb);
+    }
+    if (it != mMetricsManagers.end()) {
+        good = good && writeLengthDelimitedHeader(outFd, FIELD_ID_REPORTS, buffer.size()) &&
+               android::base::WriteFully(outFd, buffer.data(), buffer.size());
+    }
+    if (!good) {
+        ALOGE("Failed to stream metrics report for %s", key.ToString().c_str());
+        return false;
+    }
+
+    StatsdStats::getInstance().noteMetricsReportSent(key, totalSize);
+    return true;
+}
+
 /*
  * onConfigMetricsReportLocked dumps serialized ConfigMetricsReport into outData.
  */
@@ -434,6 +551,11 @@ void StatsLogProcessor::onConfigMetricsReportLocked(
     if (it == mMetricsManagers.end()) {
         return;
     }
+    // The buckets of the snapshot are about to be reported, so it must not bring them back.
+    // The other configs lose theirs until the next snapshot.
+    if (erase_data) {
+        DeleteBucketSnapshotLocked();
+    }
     int64_t lastReportTimeNs = it->second->getLastReportTimeNs();
     int64_t lastReportWallClockNs = it->second->getLastReportWallClockNs();
 
@@ -478,7 +600,7 @@ void StatsLogProcessor::onConfigMetricsReportLocked(
         VLOG("save history to disk");
         string file_name = StorageManager::getDataHistoryFileName((long)getWallClockSec(),
                                                                   key.GetUid(), key.GetId());
-        StorageManager::writeFile(file_name.c_str(), buffer->data(), buffer->size());
+        StorageManager::writeFileAsync(file_name, key, *buffer, false /* replacePending */);
     }
 }
 
@@ -519,6 +641,7 @@ void StatsLogProcessor::OnConfigRemoved(const ConfigKey& key) {
         WriteDataToDiskLocked(key, getElapsedRealtimeNs(), CONFIG_REMOVED,
                               NO_TIME_CONSTRAINTS);
         mMetricsManagers.erase(it);
+        updateLogEventFilterLocked();
         mUidMap->OnConfigRemoved(key);
     }
     StatsdStats::getInstance().noteConfigRemoved(key);
@@ -558,6 +681,7 @@ void StatsLogProcessor::flushIfNecessaryLocked(
     if (totalBytes >
         StatsdStats::kMaxMetricsBytesPerConfig) {  // Too late. We need to start clearing data.
         metricsManager.dropData(timestampNs);
+        DeleteBucketSnapshotLocked();
         StatsdStats::getInstance().noteDataDropped(key, totalBytes);
         VLOG("StatsD had to toss out metrics for %s", key.ToString().c_str());
     } else if ((totalBytes > StatsdStats::kBytesPerConfigTriggerGetData) ||
@@ -600,7 +724,7 @@ void StatsLogProcessor::WriteDataToDiskLocked(const ConfigKey& key,
                                 &buffer);
     string file_name =
             StorageManager::getDataFileName((long)getWallClockSec(), key.GetUid(), key.GetId());
-    StorageManager::writeFile(file_name.c_str(), buffer.data(), buffer.size());
+    StorageManager::writeFileAsync(file_name, key, std::move(buffer), false /* replacePending */);
 
     // We were able to write the ConfigMetricsReport to disk, so we should trigger collection ASAP.
     mOnDiskDataConfigs.insert(key);
@@ -678,6 +802,84 @@ void StatsLogProcessor::LoadActiveConfigsFromDisk() {
     StorageManager::deleteFile(file_name.c_str());
 }
 
+void StatsLogProcessor::SaveBucketSnapshotLocked(int64_t currentTimeNs) {
+    mLastBucketSnapshotNs = currentTimeNs;
+
+    ProtoOutputStream proto;
+    proto.write(FIELD_TYPE_INT64 | FIELD_ID_BUCKET_SNAPSHOT_ELAPSED_NANOS,
+                (long long)currentTimeNs);
+    proto.write(FIELD_TYPE_INT64 | FIELD_ID_BUCKET_SNAPSHOT_WALL_CLOCK_NANOS,
+                (long long)getWallClockNs());
+    for (const auto& pair : mMetricsManagers) {
+        uint64_t configToken = proto.start(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED |
+                                           FIELD_ID_BUCKET_SNAPSHOT_LIST_CONFIG);
+        pair.second->writeBucketSnapshotToProtoOutputStream(currentTimeNs, &proto);
+        proto.end(configToken);
+    }
+
+    // Written aside and renamed, so that a crash while writing does not leave a truncated
+    // snapshot behind.
+    string tmpFileName = StringPrintf("%s.tmp", STATS_BUCKET_SNAPSHOT_FILE);
+    android::base::unique_fd fd(open(tmpFileName.c_str(),
+                                     O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR));
+    if (fd == -1) {
+        ALOGE("Attempt to write %s but failed", tmpFileName.c_str());
+        return;
+    }
+    if (!proto.flush(fd.get()) || rename(tmpFileName.c_str(), STATS_BUCKET_SNAPSHOT_FILE) != 0) {
+        ALOGE("Failed to write the bucket snapshot");
+        StorageManager::deleteFile(tmpFileName.c_str());
+        return;
+    }
+    mBucketSnapshotOnDisk = true;
+}
+
+void StatsLogProcessor::DeleteBucketSnapshotLocked() {
+    if (mBucketSnapshotOnDisk) {
+        StorageManager::deleteFile(STATS_BUCKET_SNAPSHOT_FILE);
+        mBucketSnapshotOnDisk = false;
+    }
+}
+
+void StatsLogProcessor::LoadBucketSnapshotFromDisk() {
+    std::lock_guard<std::mutex> lock(mMetricsMutex);
+    string content;
+    if (!android::base::ReadFileToString(STATS_BUCKET_SNAPSHOT_FILE, &content)) {
+        VLOG("No bucket snapshot to load");
+        return;
+    }
+    StorageManager::deleteFile(STATS_BUCKET_SNAPSHOT_FILE);
+
+    BucketSnapshotList snapshotList;
+    if (!snapshotList.ParseFromString(content)) {
+        ALOGE("Failed to parse the bucket snapshot");
+        return;
+    }
+
+    const int64_t elapsedSinceSnapshotNs = getElapsedRealtimeNs() - snapshotList.elapsed_nanos();
+    const int64_t clockDriftNs = getWallClockNs() - snapshotList.wall_clock_nanos() -
+                                 elapsedSinceSnapshotNs;
+    const int64_t maxClockDriftNs = BUCKET_SNAPSHOT_MAX_CLOCK_DRIFT_SEC * NS_PER_SEC;
+    if (elapsedSinceSnapshotNs < 0 || clockDriftNs > maxClockDriftNs ||
+        clockDriftNs < -maxClockDriftNs) {
+        VLOG("Bucket snapshot is from before the last boot, dropping it");
+        return;
+    }
+
+    for (const auto& config : snapshotList.config()) {
+        ConfigKey key(config.uid(), config.id());
+        auto it = mMetricsManagers.find(key);
+        if (it == mMetricsManagers.end()) {
+            continue;
+        }
+        it->second->loadBucketSnapshot(config);
+    }
+    VLOG("Loaded the bucket snapshot of %d configs", snapshotList.config_size());
+
+    // The restored buckets are only in memory now, so keep them safe from another restart.
+    SaveBucketSnapshotLocked(getElapsedRealtimeNs());
+}
+
 void StatsLogProcessor::SetConfigsActiveState(const ActiveConfigList& activeConfigList,
                                                     int64_t currentTimeNs) {
     std::lock_guard<std::mutex> lock(mMetricsMutex);
@@ -720,8 +922,12 @@ void StatsLogProcessor::WriteDataToDiskLocked(const DumpReportReason dumpReportR
 
 void StatsLogProcessor::WriteDataToDisk(const DumpReportReason dumpReportReason,
                                         const DumpLatency dumpLatency) {
-    std::lock_guard<std::mutex> lock(mMetricsMutex);
-    WriteDataToDiskLocked(dumpReportReason, dumpLatency);
+    {
+        std::lock_guard<std::mutex> lock(mMetricsMutex);
+        WriteDataToDiskLocked(dumpReportReason, dumpLatency);
+    }
+    // Callers may be about to exit, so the reports have to be on disk before returning.
+    StorageManager::flushPendingWrites();
 }
 
 void StatsLogProcessor::informPullAlarmFired(const int64_t timestampNs) {
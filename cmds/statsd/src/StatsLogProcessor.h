@@ -18,6 +18,8 @@
 
 #include <gtest/gtest_prod.h>
 #include "config/ConfigListener.h"
+#include "logd/LogEventFilter.h"
+#include "matchers/SharedMatcherPool.h"
 #include "metrics/MetricsManager.h"
 #include "packages/UidMap.h"
 #include "external/StatsPullerManager.h"
@@ -63,6 +65,15 @@ public:
                       const DumpReportReason dumpReportReason,
                       const DumpLatency dumpLatency,
                       ProtoOutputStream* proto);
+    // Streams the serialized ConfigMetricsReportList straight into outFd. Reports saved on disk
+    // are spliced in without being read into memory. If enclosingFieldId is non-zero, the list
+    // is framed as that length-delimited field of an outer message.
+    // Returns false if writing to outFd failed; the stream is then incomplete.
+    bool onDumpReport(const ConfigKey& key, const int64_t dumpTimeNs,
+                      const bool include_current_partial_bucket, const bool erase_data,
+                      const DumpReportReason dumpReportReason,
+                      const DumpLatency dumpLatency,
+                      int outFd, uint32_t enclosingFieldId = 0);
 
     /* Tells MetricsManager that the alarms in alarmSet have fired. Modifies anomaly alarmSet. */
     void onAnomalyAlarmFired(
@@ -88,6 +99,9 @@ public:
     /* Load configs containing metrics with active activations from disk. */
     void LoadActiveConfigsFromDisk();
 
+    /* Restores the unreported buckets that were saved before statsd restarted. */
+    void LoadBucketSnapshotFromDisk();
+
     /* Sets the active status/ttl for all configs and metrics to the status in ActiveConfigList. */
     void SetConfigsActiveState(const ActiveConfigList& activeConfigList, int64_t currentTimeNs);
 
@@ -124,6 +138,9 @@ public:
     // Add a specific config key to the possible configs to dump ASAP.
     void noteOnDiskData(const ConfigKey& key);
 
+    // Keeps filter up to date with the atoms that the configs use.
+    void setLogEventFilter(const std::shared_ptr<LogEventFilter>& filter);
+
 private:
     // For testing only.
     inline sp<AlarmMonitor> getAnomalyAlarmMonitor() const {
@@ -157,6 +174,14 @@ private:
 
     sp<AlarmMonitor> mPeriodicAlarmMonitor;
 
+    // Deduplicates identical simple atom matchers across all configs.
+    sp<SharedMatcherPool> mSharedMatcherPool;
+
+    // Told which atoms the configs use, may be null.
+    std::shared_ptr<LogEventFilter> mLogEventFilter;
+
+    void updateLogEventFilterLocked() const;
+
     void resetIfConfigTtlExpiredLocked(const int64_t timestampNs);
 
     void OnConfigUpdatedLocked(
@@ -170,6 +195,11 @@ private:
     void SetConfigsActiveStateLocked(const ActiveConfigList& activeConfigList,
                                      int64_t currentTimeNs);
 
+    // Writes the unreported buckets of all configs to disk, to be restored if statsd restarts.
+    void SaveBucketSnapshotLocked(int64_t currentTimeNs);
+
+    void DeleteBucketSnapshotLocked();
+
     void WriteDataToDiskLocked(const DumpReportReason dumpReportReason,
                                const DumpLatency dumpLatency);
     void WriteDataToDiskLocked(const ConfigKey& key, const int64_t timestampNs,
@@ -223,6 +253,11 @@ private:
     // Last time we wrote active metrics to disk.
     int64_t mLastActiveMetricsWriteNs = 0;
 
+    // Last time we wrote the bucket snapshot to disk.
+    int64_t mLastBucketSnapshotNs;
+
+    bool mBucketSnapshotOnDisk = false;
+
 #ifdef VERY_VERBOSE_PRINTING
     bool mPrintAllLogs = false;
 #endif
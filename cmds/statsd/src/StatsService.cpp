@@ -63,6 +63,9 @@ constexpr const char* kPermissionUsage = "android.permission.PACKAGE_USAGE_STATS
 
 constexpr const char* kOpUsage = "android:get_usage_stats";
 
+// Max number of pushed events drained from the LogEventQueue per wakeup of the reader thread.
+constexpr size_t kLogEventBatchSize = 64;
+
 #define STATS_SERVICE_DIR "/data/misc/stats-service"
 
 // for StatsDataDumpProto
@@ -146,7 +149,8 @@ StatsService::StatsService(const sp<Looper>& handlerLooper, shared_ptr<LogEventQ
                       sc->cancelAnomalyAlarm();
                       StatsdStats::getInstance().noteRegisteredAnomalyAlarmChanged();
                   }
-              })),
+              },
+              true /* useTimerWheel */)),
       mPeriodicAlarmMonitor(new AlarmMonitor(
               MIN_DIFF_TO_UPDATE_REGISTERED_ALARM_SECS,
               [](const sp<IStatsCompanionService>& sc, int64_t timeMillis) {
@@ -161,7 +165,8 @@ StatsService::StatsService(const sp<Looper>& handlerLooper, shared_ptr<LogEventQ
                       StatsdStats::getInstance().noteRegisteredPeriodicAlarmChanged();
                   }
               })),
-      mEventQueue(queue) {
+      mEventQueue(queue),
+      mLogEventFilter(std::make_shared<LogEventFilter>()) {
     mUidMap = UidMap::getInstance();
     mPullerManager = new StatsPullerManager();
     StatsPuller::SetUidMap(mUidMap);
@@ -202,6 +207,7 @@ StatsService::StatsService(const sp<Looper>& handlerLooper, shared_ptr<LogEventQ
 
     mUidMap->setListener(mProcessor);
     mConfigManager->AddListener(mProcessor);
+    mProcessor->setLogEventFilter(mLogEventFilter);
 
     init_system_properties();
 
@@ -216,18 +222,23 @@ StatsService::~StatsService() {
 
 /* Runs on a dedicated thread to process pushed events. */
 void StatsService::readLogs() {
+    std::vector<std::unique_ptr<LogEvent>> events;
+    events.reserve(kLogEventBatchSize);
     // Read forever..... long live statsd
     while (1) {
-        // Block until an event is available.
-        auto event = mEventQueue->waitPop();
-        // Pass it to StatsLogProcess to all configs/metrics
-        // At this point, the LogEventQueue is not blocked, so that the socketListener
-        // can read events from the socket and write to buffer to avoid data drop.
-        mProcessor->OnLogEvent(event.get());
-        // The ShellSubscriber is only used by shell for local debugging.
-        if (mShellSubscriber != nullptr) {
-            mShellSubscriber->onLogEvent(*event);
+        // Block until at least one event is available.
+        mEventQueue->waitPopBatch(kLogEventBatchSize, &events);
+        for (const auto& event : events) {
+            // Pass it to StatsLogProcess to all configs/metrics
+            // At this point, the LogEventQueue is not blocked, so that the socketListener
+            // can read events from the socket and write to buffer to avoid data drop.
+            mProcessor->OnLogEvent(event.get());
+            // The ShellSubscriber is only used by shell for local debugging.
+            if (mShellSubscriber != nullptr) {
+                mShellSubscriber->onLogEvent(*event);
+            }
         }
+        events.clear();
     }
 }
 
@@ -335,18 +346,15 @@ void StatsService::dumpStatsdStats(int out, bool verbose, bool proto) {
  * Write stats report data in StatsDataDumpProto incident section format.
  */
 void StatsService::dumpIncidentSection(int out) {
-    ProtoOutputStream proto;
     for (const ConfigKey& configKey : mConfigManager->GetAllConfigKeys()) {
-        uint64_t reportsListToken =
-                proto.start(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | FIELD_ID_REPORTS_LIST);
-        mProcessor->onDumpReport(configKey, getElapsedRealtimeNs(),
-                                 true /* includeCurrentBucket */, false /* erase_data */,
-                                 ADB_DUMP,
-                                 FAST,
-                                 &proto);
-        proto.end(reportsListToken);
-        proto.flush(out);
-        proto.clear();
+        // Each reports list is streamed as one repeated FIELD_ID_REPORTS_LIST entry.
+        if (!mProcessor->onDumpReport(configKey, getElapsedRealtimeNs(),
+                                      true /* includeCurrentBucket */, false /* erase_data */,
+                                      ADB_DUMP,
+                                      FAST,
+                                      out, FIELD_ID_REPORTS_LIST)) {
+            return;
+        }
     }
 }
 
@@ -428,7 +436,10 @@ status_t StatsService::command(int in, int out, int err, Vector<String8>& args,
                 ALOGI("Null resultReceiver given, no subscription will be started");
                 return UNEXPECTED_NULL;
             }
+            // A subscription can match any atom, so nothing is filtered out while it runs.
+            mLogEventFilter->requestAllAtoms();
             mShellSubscriber->startNewSubscription(in, out, resultReceiver, timeoutSec);
+            mLogEventFilter->releaseAllAtoms();
             return NO_ERROR;
         }
     }
@@ -747,15 +758,11 @@ status_t StatsService::cmd_dump_report(int out, const Vector<String8>& args) {
             name.assign(args[2].c_str(), args[2].size());
         }
         if (good) {
-            vector<uint8_t> data;
-            mProcessor->onDumpReport(ConfigKey(uid, StrToInt64(name)), getElapsedRealtimeNs(),
-                                     includeCurrentBucket, eraseData, ADB_DUMP,
-                                     NO_TIME_CONSTRAINTS,
-                                     &data);
             if (proto) {
-                for (size_t i = 0; i < data.size(); i ++) {
-                    dprintf(out, "%c", data[i]);
-                }
+                mProcessor->onDumpReport(ConfigKey(uid, StrToInt64(name)), getElapsedRealtimeNs(),
+                                         includeCurrentBucket, eraseData, ADB_DUMP,
+                                         NO_TIME_CONSTRAINTS,
+                                         out);
             } else {
                 dprintf(out, "Non-proto stats data dump not currently supported.\n");
             }
@@ -1118,6 +1125,7 @@ Status StatsService::statsCompanionReady() {
 void StatsService::Startup() {
     mConfigManager->Startup();
     mProcessor->LoadActiveConfigsFromDisk();
+    mProcessor->LoadBucketSnapshotFromDisk();
 }
 
 void StatsService::Terminate() {
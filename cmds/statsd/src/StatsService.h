@@ -88,6 +88,13 @@ public:
      */
     void Terminate();
 
+    /**
+     * The atoms wanted by the configs and shell subscriptions, for the socket listener.
+     */
+    std::shared_ptr<LogEventFilter> getLogEventFilter() const {
+        return mLogEventFilter;
+    }
+
     /**
      * Test ONLY interface. In real world, StatsService reads from LogEventQueue.
      */
@@ -384,6 +391,8 @@ private:
     mutable mutex mShellSubscriberMutex;
     std::shared_ptr<LogEventQueue> mEventQueue;
 
+    std::shared_ptr<LogEventFilter> mLogEventFilter;
+
     FRIEND_TEST(StatsLogProcessorTest, TestActivationsPersistAcrossSystemServerRestart);
     FRIEND_TEST(StatsServiceTest, TestAddConfig_simple);
     FRIEND_TEST(StatsServiceTest, TestAddConfig_empty);
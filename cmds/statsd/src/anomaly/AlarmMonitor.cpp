@@ -27,8 +27,10 @@ namespace statsd {
 AlarmMonitor::AlarmMonitor(
         uint32_t minDiffToUpdateRegisteredAlarmTimeSec,
         const std::function<void(const sp<IStatsCompanionService>&, int64_t)>& updateAlarm,
-        const std::function<void(const sp<IStatsCompanionService>&)>& cancelAlarm)
-    : mRegisteredAlarmTimeSec(0), mMinUpdateTimeSec(minDiffToUpdateRegisteredAlarmTimeSec),
+        const std::function<void(const sp<IStatsCompanionService>&)>& cancelAlarm,
+        bool useTimerWheel)
+    : mRegisteredAlarmTimeSec(0), mUseTimerWheel(useTimerWheel),
+      mMinUpdateTimeSec(minDiffToUpdateRegisteredAlarmTimeSec),
       mUpdateAlarm(updateAlarm),
       mCancelAlarm(cancelAlarm) {}
 
@@ -43,7 +45,7 @@ void AlarmMonitor::setStatsCompanionService(sp<IStatsCompanionService> statsComp
         return;
     }
     VLOG("Creating link to statsCompanionService");
-    const sp<const InternalAlarm> top = mPq.top();
+    const sp<const InternalAlarm> top = top_l();
     if (top != nullptr) {
         updateRegisteredAlarmTime_l(top->timestampSec);
     }
@@ -62,7 +64,11 @@ void AlarmMonitor::add(sp<const InternalAlarm> alarm) {
     }
     // TODO(b/110563466): Ensure that refractory period is respected.
     VLOG("Adding alarm with time %u", alarm->timestampSec);
-    mPq.push(alarm);
+    if (mUseTimerWheel) {
+        mWheel.push(alarm);
+    } else {
+        mPq.push(alarm);
+    }
     if (mRegisteredAlarmTimeSec < 1 ||
         alarm->timestampSec + mMinUpdateTimeSec < mRegisteredAlarmTimeSec) {
         updateRegisteredAlarmTime_l(alarm->timestampSec);
@@ -76,14 +82,14 @@ void AlarmMonitor::remove(sp<const InternalAlarm> alarm) {
         return;
     }
     VLOG("Removing alarm with time %u", alarm->timestampSec);
-    bool wasPresent = mPq.remove(alarm);
+    bool wasPresent = mUseTimerWheel ? mWheel.remove(alarm) : mPq.remove(alarm);
     if (!wasPresent) return;
-    if (mPq.empty()) {
+    if (empty_l()) {
         VLOG("Queue is empty. Cancel any alarm.");
         cancelRegisteredAlarmTime_l();
         return;
     }
-    uint32_t soonestAlarmTimeSec = mPq.top()->timestampSec;
+    uint32_t soonestAlarmTimeSec = top_l()->timestampSec;
     VLOG("Soonest alarm is %u", soonestAlarmTimeSec);
     if (soonestAlarmTimeSec > mRegisteredAlarmTimeSec + mMinUpdateTimeSec) {
         updateRegisteredAlarmTime_l(soonestAlarmTimeSec);
@@ -98,19 +104,24 @@ unordered_set<sp<const InternalAlarm>, SpHash<InternalAlarm>> AlarmMonitor::popS
     unordered_set<sp<const InternalAlarm>, SpHash<InternalAlarm>> oldAlarms;
     std::lock_guard<std::mutex> lock(mLock);
 
-    for (sp<const InternalAlarm> t = mPq.top(); t != nullptr && t->timestampSec <= timestampSec;
-        t = mPq.top()) {
-        oldAlarms.insert(t);
-        mPq.pop();  // remove t
+    if (mUseTimerWheel) {
+        // All alarms of a second are fired together from their slot.
+        mWheel.popSoonerThan(timestampSec, &oldAlarms);
+    } else {
+        for (sp<const InternalAlarm> t = mPq.top();
+             t != nullptr && t->timestampSec <= timestampSec; t = mPq.top()) {
+            oldAlarms.insert(t);
+            mPq.pop();  // remove t
+        }
     }
     // Always update registered alarm time (if anything has changed).
     if (!oldAlarms.empty()) {
-        if (mPq.empty()) {
+        if (empty_l()) {
             VLOG("Queue is empty. Cancel any alarm.");
             cancelRegisteredAlarmTime_l();
         } else {
             // Always update the registered alarm in this case (unlike remove()).
-            updateRegisteredAlarmTime_l(mPq.top()->timestampSec);
+            updateRegisteredAlarmTime_l(top_l()->timestampSec);
         }
     }
     return oldAlarms;
@@ -17,6 +17,7 @@
 #pragma once
 
 #include "anomaly/indexed_priority_queue.h"
+#include "anomaly/timer_wheel.h"
 
 #include <android/os/IStatsCompanionService.h>
 #include <utils/RefBase.h>
@@ -64,10 +65,14 @@ public:
      * @param minDiffToUpdateRegisteredAlarmTimeSec If the soonest alarm differs
      * from the registered alarm by more than this amount, update the registered
      * alarm.
+     * @param useTimerWheel Keep the alarms in a timer_wheel instead of an
+     * indexed_priority_queue. Cheaper to add to and remove from with many
+     * alarms, e.g. one per duration metric dimension.
      */
     AlarmMonitor(uint32_t minDiffToUpdateRegisteredAlarmTimeSec,
                  const std::function<void(const sp<IStatsCompanionService>&, int64_t)>& updateAlarm,
-                 const std::function<void(const sp<IStatsCompanionService>&)>& cancelAlarm);
+                 const std::function<void(const sp<IStatsCompanionService>&)>& cancelAlarm,
+                 bool useTimerWheel = false);
     ~AlarmMonitor();
 
     /**
@@ -122,6 +127,13 @@ private:
      */
     indexed_priority_queue<InternalAlarm, InternalAlarm::SmallerTimestamp> mPq;
 
+    /**
+     * Timer wheel of alarms, used instead of mPq if mUseTimerWheel.
+     */
+    timer_wheel<InternalAlarm> mWheel;
+
+    const bool mUseTimerWheel;
+
     /**
      * Binder interface for communicating with StatsCompanionService.
      */
@@ -145,6 +157,15 @@ private:
      */
     void cancelRegisteredAlarmTime_l();
 
+    /** Returns the soonest alarm, or nullptr if there is none. */
+    sp<const InternalAlarm> top_l() const {
+        return mUseTimerWheel ? mWheel.top() : mPq.top();
+    }
+
+    bool empty_l() const {
+        return mUseTimerWheel ? mWheel.empty() : mPq.empty();
+    }
+
     /** Converts uint32 timestamp in seconds to a Java long in msec. */
     int64_t secToMs(uint32_t timeSec);
 
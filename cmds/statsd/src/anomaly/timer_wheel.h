@@ -0,0 +1,312 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "anomaly/indexed_priority_queue.h"
+
+#include <utils/RefBase.h>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace android {
+namespace os {
+namespace statsd {
+
+/**
+ * Hierarchical timer wheel for generic type AA, which must have a uint32_t timestampSec.
+ *
+ * Level L has 64 slots of 64^L seconds each, covering the 64^(L+1) second block that the current
+ * time is in. An element is kept in the lowest level whose block it shares with the current time;
+ * elements beyond the top level wait in an overflow list. Moving the current time forward fires
+ * level 0 slots a whole second at a time and cascades higher level slots down as their block is
+ * entered, visiting only occupied slots.
+ *
+ * push() and remove() are O(1). top() scans the soonest occupied slot.
+ * Unlike indexed_priority_queue, elements are indexed by raw pointer, so each element costs one
+ * reference held by its slot.
+ */
+template <class AA>
+class timer_wheel {
+public:
+    /** Adds a into the wheel. If already present or a==nullptr, does nothing. */
+    void push(sp<const AA> a);
+    /*
+     * Removes a from the wheel. If not present or a==nullptr, does nothing.
+     * Returns true if a had been present (and is now removed), else false.
+     */
+    bool remove(const sp<const AA>& a);
+    /** Removes all elements. */
+    void clear();
+    /** Returns whether the wheel contains a (not just a copy of a, but a itself). */
+    bool contains(const sp<const AA>& a) const {
+        return a != nullptr && mLocations.count(a.get()) > 0;
+    }
+    /** Returns an element with the soonest timestamp. Returns nullptr iff empty(). */
+    sp<const AA> top() const;
+    /** Moves all elements whose timestamp <= timestampSec into out. */
+    void popSoonerThan(uint32_t timestampSec,
+                       std::unordered_set<sp<const AA>, SpHash<AA>>* out);
+    /** Returns number of elements in the wheel. */
+    size_t size() const {
+        return mLocations.size();
+    }
+    /** Returns true iff the wheel is empty. */
+    bool empty() const {
+        return mLocations.empty();
+    }
+
+private:
+    static const int kLevelBits = 6;
+    static const int kSlotCount = 1 << kLevelBits;
+    static const int kLevelCount = 4;
+    // Pseudo levels for elements beyond the top level and for elements already due.
+    static const int kOverflow = kLevelCount;
+    static const int kDue = kLevelCount + 1;
+
+    struct Location {
+        int level;
+        int slot;
+        size_t pos;
+    };
+
+    typedef std::vector<sp<const AA>> Bucket;
+
+    Bucket mSlots[kLevelCount][kSlotCount];
+    // Bit i of mOccupied[L] is set iff mSlots[L][i] is not empty.
+    uint64_t mOccupied[kLevelCount] = {};
+    Bucket mOverflow;
+    // Elements whose timestamp is not after mNowSec.
+    Bucket mDue;
+    std::unordered_map<const AA*, Location> mLocations;
+
+    // Every element in mSlots and mOverflow is after this time.
+    uint32_t mNowSec = 0;
+
+    static int shift(int level) {
+        return kLevelBits * level;
+    }
+
+    static bool sameBlock(uint32_t a, uint32_t b, int level) {
+        return ((uint64_t)a >> shift(level)) == ((uint64_t)b >> shift(level));
+    }
+
+    static int slotOf(uint32_t timestampSec, int level) {
+        return (timestampSec >> shift(level)) & (kSlotCount - 1);
+    }
+
+    Bucket& bucket(int level, int slot) {
+        if (level == kOverflow) return mOverflow;
+        if (level == kDue) return mDue;
+        return mSlots[level][slot];
+    }
+
+    // Start time of the given slot in the block of the current time.
+    uint64_t slotStart(int level, int slot) const {
+        return (((uint64_t)mNowSec >> shift(level + 1)) << shift(level + 1)) |
+               ((uint64_t)slot << shift(level));
+    }
+
+    // Returns the first occupied slot after the current time at the level, or -1.
+    int nextSlot(int level) const;
+
+    void place(const sp<const AA>& a);
+    void erase(const Location& location);
+    void advance(uint32_t timestampSec, std::unordered_set<sp<const AA>, SpHash<AA>>* out);
+};
+
+// Implementation must be done in this file due to use of template.
+
+template <class AA>
+void timer_wheel<AA>::push(sp<const AA> a) {
+    if (a == nullptr) return;
+    if (contains(a)) return;
+    if (empty() && a->timestampSec > 0) {
+        // Nothing depends on the current time, so move it next to the alarm to start out in the
+        // lowest level.
+        mNowSec = a->timestampSec - 1;
+    }
+    place(a);
+}
+
+template <class AA>
+bool timer_wheel<AA>::remove(const sp<const AA>& a) {
+    if (a == nullptr) return false;
+    auto it = mLocations.find(a.get());
+    if (it == mLocations.end()) return false;
+    Location location = it->second;
+    mLocations.erase(it);
+    erase(location);
+    return true;
+}
+
+template <class AA>
+void timer_wheel<AA>::clear() {
+    for (int level = 0; level < kLevelCount; level++) {
+        for (auto& slot : mSlots[level]) {
+            slot.clear();
+        }
+        mOccupied[level] = 0;
+    }
+    mOverflow.clear();
+    mDue.clear();
+    mLocations.clear();
+}
+
+template <class AA>
+sp<const AA> timer_wheel<AA>::top() const {
+    const Bucket* soonest = nullptr;
+    if (!mDue.empty()) {
+        soonest = &mDue;
+    }
+    for (int level = 0; level < kLevelCount && soonest == nullptr; level++) {
+        int slot = nextSlot(level);
+        if (slot >= 0) {
+            soonest = &mSlots[level][slot];
+        }
+    }
+    if (soonest == nullptr) {
+        soonest = &mOverflow;
+    }
+    sp<const AA> result = nullptr;
+    for (const auto& a : *soonest) {
+        if (result == nullptr || a->timestampSec < result->timestampSec) {
+            result = a;
+        }
+    }
+    return result;
+}
+
+template <class AA>
+void timer_wheel<AA>::popSoonerThan(uint32_t timestampSec,
+                                     std::unordered_set<sp<const AA>, SpHash<AA>>* out) {
+    if (timestampSec > mNowSec) {
+        advance(timestampSec, out);
+    }
+    // The current time may have been moved past timestampSec by push() or an earlier call, so
+    // the due list has to be checked element by element.
+    for (size_t i = 0; i < mDue.size();) {
+        if (mDue[i]->timestampSec <= timestampSec) {
+            sp<const AA> a = mDue[i];
+            out->insert(a);
+            remove(a);
+        } else {
+            i++;
+        }
+    }
+}
+
+template <class AA>
+int timer_wheel<AA>::nextSlot(int level) const {
+    int current = slotOf(mNowSec, level);
+    if (current == kSlotCount - 1) return -1;
+    uint64_t after = mOccupied[level] & (~0ULL << (current + 1));
+    return after == 0 ? -1 : __builtin_ctzll(after);
+}
+
+template <class AA>
+void timer_wheel<AA>::place(const sp<const AA>& a) {
+    int level = kDue;
+    int slot = 0;
+    if (a->timestampSec > mNowSec) {
+        level = kOverflow;
+        for (int l = 0; l < kLevelCount; l++) {
+            if (sameBlock(a->timestampSec, mNowSec, l + 1)) {
+                level = l;
+                slot = slotOf(a->timestampSec, l);
+                mOccupied[l] |= 1ULL << slot;
+                break;
+            }
+        }
+    }
+    Bucket& b = bucket(level, slot);
+    b.push_back(a);
+    mLocations[a.get()] = Location{level, slot, b.size() - 1};
+}
+
+template <class AA>
+void timer_wheel<AA>::erase(const Location& location) {
+    Bucket& b = bucket(location.level, location.slot);
+    if (location.pos + 1 < b.size()) {
+        b[location.pos] = b.back();
+        mLocations[b[location.pos].get()].pos = location.pos;
+    }
+    b.pop_back();
+    if (b.empty() && location.level < kLevelCount) {
+        mOccupied[location.level] &= ~(1ULL << location.slot);
+    }
+}
+
+template <class AA>
+void timer_wheel<AA>::advance(uint32_t timestampSec,
+                              std::unordered_set<sp<const AA>, SpHash<AA>>* out) {
+    while (true) {
+        // The next time something has to happen: a level 0 slot fires, or a higher level slot or
+        // the overflow list has to be cascaded down.
+        uint64_t next = (uint64_t)timestampSec + 1;
+        for (int level = 0; level < kLevelCount; level++) {
+            int slot = nextSlot(level);
+            if (slot >= 0) {
+                next = std::min(next, slotStart(level, slot));
+            }
+        }
+        for (const auto& a : mOverflow) {
+            next = std::min(next, ((uint64_t)a->timestampSec >> shift(kLevelCount))
+                                          << shift(kLevelCount));
+        }
+        if (next > timestampSec) {
+            mNowSec = timestampSec;
+            return;
+        }
+        mNowSec = (uint32_t)next;
+
+        Bucket cascading;
+        for (size_t i = 0; i < mOverflow.size();) {
+            if (sameBlock(mOverflow[i]->timestampSec, mNowSec, kLevelCount)) {
+                cascading.push_back(mOverflow[i]);
+                remove(mOverflow[i]);
+            } else {
+                i++;
+            }
+        }
+        for (int level = kLevelCount - 1; level > 0; level--) {
+            Bucket& b = mSlots[level][slotOf(mNowSec, level)];
+            for (const auto& a : b) {
+                cascading.push_back(a);
+                mLocations.erase(a.get());
+            }
+            b.clear();
+            mOccupied[level] &= ~(1ULL << slotOf(mNowSec, level));
+        }
+        for (const auto& a : cascading) {
+            place(a);
+        }
+
+        Bucket& firing = mSlots[0][slotOf(mNowSec, 0)];
+        for (const auto& a : firing) {
+            out->insert(a);
+            mLocations.erase(a.get());
+        }
+        firing.clear();
+        mOccupied[0] &= ~(1ULL << slotOf(mNowSec, 0));
+    }
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
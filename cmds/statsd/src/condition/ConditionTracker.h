@@ -108,6 +108,12 @@ public:
             const bool isSubOutputDimensionFields,
             std::unordered_set<HashableDimensionKey>& dimensionsKeySet) const = 0;
 
+    // Get the indices of the child conditions. Only CombinationConditionTrackers have children.
+    virtual const std::vector<int>& getChildren() const {
+        static const std::vector<int> kNoChildren;
+        return kNoChildren;
+    }
+
     // return the list of LogMatchingTracker index that this ConditionTracker uses.
     virtual const std::set<int>& getLogTrackerIndex() const {
         return mTrackerIndex;
@@ -117,6 +123,11 @@ public:
         mSliced = mSliced | sliced;
     }
 
+    // Tells the tracker that a metric links to it on [conditionFields], so that partial link
+    // queries on those fields can be answered without scanning every slice.
+    virtual void addLinkedFields(const std::vector<Matcher>& conditionFields) {
+    }
+
     inline bool isSliced() const {
         return mSliced;
     }
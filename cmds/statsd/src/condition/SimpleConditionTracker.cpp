@@ -20,6 +20,8 @@
 #include "SimpleConditionTracker.h"
 #include "guardrail/StatsdStats.h"
 
+#include <algorithm>
+
 namespace android {
 namespace os {
 namespace statsd {
@@ -144,6 +146,9 @@ void SimpleConditionTracker::handleStopAll(std::vector<ConditionState>& conditio
     // After StopAll, we know everything has stopped. From now on, default condition is false.
     mInitialValue = ConditionState::kFalse;
     mSlicedConditionState.clear();
+    for (auto& index : mLinkIndexes) {
+        index.slices.clear();
+    }
     conditionCache[mIndex] = ConditionState::kFalse;
     if (!mSliced) {
         mUnSlicedPart = ConditionState::kFalse;
@@ -185,13 +190,13 @@ void SimpleConditionTracker::handleConditionEvent(const HashableDimensionKey& ou
         // We get a new output key.
         newCondition = matchStart ? ConditionState::kTrue : ConditionState::kFalse;
         if (matchStart && mInitialValue != ConditionState::kTrue) {
-            mSlicedConditionState[outputKey] = 1;
+            addToLinkIndexes(&*mSlicedConditionState.emplace(outputKey, 1).first);
             changed = true;
             mLastChangedToTrueDimensions.insert(outputKey);
         } else if (mInitialValue != ConditionState::kFalse) {
             // it's a stop and we don't have history about it.
             // If the default condition is not false, it means this stop is valuable to us.
-            mSlicedConditionState[outputKey] = 0;
+            addToLinkIndexes(&*mSlicedConditionState.emplace(outputKey, 0).first);
             mLastChangedToFalseDimensions.insert(outputKey);
             changed = true;
         }
@@ -233,6 +238,7 @@ void SimpleConditionTracker::handleConditionEvent(const HashableDimensionKey& ou
 
             // if default condition is false, it means we don't need to keep the false values.
             if (mInitialValue == ConditionState::kFalse && startedCount == 0) {
+                removeFromLinkIndexes(&*outputIt);
                 mSlicedConditionState.erase(outputIt);
                 VLOG("erase key %s", outputKey.toString().c_str());
             }
@@ -342,6 +348,91 @@ void SimpleConditionTracker::evaluateCondition(
     }
 }
 
+void SimpleConditionTracker::addLinkedFields(const std::vector<Matcher>& conditionFields) {
+    // Same fields as getDimensionForCondition assigns to the query key.
+    std::vector<Field> fields;
+    for (const auto& matcher : conditionFields) {
+        fields.push_back(Field(matcher.mMatcher.getTag(), matcher.mMatcher.getField()));
+    }
+    for (const auto& index : mLinkIndexes) {
+        if (index.fields == fields) {
+            return;
+        }
+    }
+    mLinkIndexes.push_back(LinkIndex());
+    mLinkIndexes.back().fields = fields;
+    for (const auto& slice : mSlicedConditionState) {
+        HashableDimensionKey projection;
+        if (projectSlice(fields, slice.first, &projection)) {
+            mLinkIndexes.back().slices[projection].push_back(&slice);
+        }
+    }
+}
+
+bool SimpleConditionTracker::projectSlice(const std::vector<Field>& fields,
+                                          const HashableDimensionKey& slice,
+                                          HashableDimensionKey* projection) {
+    for (const auto& field : fields) {
+        bool found = false;
+        for (const auto& value : slice.getValues()) {
+            if (value.mField == field) {
+                projection->addValue(value);
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void SimpleConditionTracker::addToLinkIndexes(const Slice* slice) {
+    for (auto& index : mLinkIndexes) {
+        HashableDimensionKey projection;
+        if (projectSlice(index.fields, slice->first, &projection)) {
+            index.slices[projection].push_back(slice);
+        }
+    }
+}
+
+void SimpleConditionTracker::removeFromLinkIndexes(const Slice* slice) {
+    for (auto& index : mLinkIndexes) {
+        HashableDimensionKey projection;
+        if (!projectSlice(index.fields, slice->first, &projection)) {
+            continue;
+        }
+        auto it = index.slices.find(projection);
+        if (it == index.slices.end()) {
+            continue;
+        }
+        auto& slices = it->second;
+        slices.erase(std::remove(slices.begin(), slices.end(), slice), slices.end());
+        if (slices.empty()) {
+            index.slices.erase(it);
+        }
+    }
+}
+
+const SimpleConditionTracker::LinkIndex* SimpleConditionTracker::findLinkIndex(
+        const HashableDimensionKey& key) const {
+    const auto& values = key.getValues();
+    for (const auto& index : mLinkIndexes) {
+        if (index.fields.size() != values.size()) {
+            continue;
+        }
+        bool sameFields = true;
+        for (size_t i = 0; i < values.size() && sameFields; i++) {
+            sameFields = values[i].mField == index.fields[i];
+        }
+        if (sameFields) {
+            return &index;
+        }
+    }
+    return nullptr;
+}
+
 void SimpleConditionTracker::isConditionMet(
         const ConditionKey& conditionParameters, const vector<sp<ConditionTracker>>& allConditions,
         const vector<Matcher>& dimensionFields,
@@ -384,19 +475,32 @@ void SimpleConditionTracker::isConditionMet(
         // For unseen key, check whether the require dimensions are subset of sliced condition
         // output.
         conditionState = conditionState | mInitialValue;
-        for (const auto& slice : mSlicedConditionState) {
+        auto visitSlice = [&](const Slice& slice) {
             ConditionState sliceState =
                 slice.second > 0 ? ConditionState::kTrue : ConditionState::kFalse;
-            if (slice.first.contains(key)) {
-                conditionState = conditionState | sliceState;
-                if (sliceState == ConditionState::kTrue && dimensionFields.size() > 0) {
-                    if (isSubOutputDimensionFields) {
-                        HashableDimensionKey dimensionKey;
-                        filterValues(dimensionFields, slice.first.getValues(), &dimensionKey);
-                        dimensionsKeySet.insert(dimensionKey);
-                    } else {
-                        dimensionsKeySet.insert(slice.first);
-                    }
+            conditionState = conditionState | sliceState;
+            if (sliceState == ConditionState::kTrue && dimensionFields.size() > 0) {
+                if (isSubOutputDimensionFields) {
+                    HashableDimensionKey dimensionKey;
+                    filterValues(dimensionFields, slice.first.getValues(), &dimensionKey);
+                    dimensionsKeySet.insert(dimensionKey);
+                } else {
+                    dimensionsKeySet.insert(slice.first);
+                }
+            }
+        };
+        const LinkIndex* linkIndex = findLinkIndex(key);
+        if (linkIndex != nullptr) {
+            auto it = linkIndex->slices.find(key);
+            if (it != linkIndex->slices.end()) {
+                for (const Slice* slice : it->second) {
+                    visitSlice(*slice);
+                }
+            }
+        } else {
+            for (const auto& slice : mSlicedConditionState) {
+                if (slice.first.contains(key)) {
+                    visitSlice(slice);
                 }
             }
         }
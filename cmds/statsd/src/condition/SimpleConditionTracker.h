@@ -18,6 +18,7 @@
 #define SIMPLE_CONDITION_TRACKER_H
 
 #include <gtest/gtest_prod.h>
+#include <unordered_map>
 #include "ConditionTracker.h"
 #include "config/ConfigKey.h"
 #include "frameworks/base/cmds/statsd/src/statsd_config.pb.h"
@@ -98,6 +99,8 @@ public:
             return equalDimensions(mOutputDimensions, dimensions);
     }
 
+    void addLinkedFields(const std::vector<Matcher>& conditionFields) override;
+
 private:
     const ConfigKey mConfigKey;
     // The index of the LogEventMatcher which defines the start.
@@ -125,6 +128,28 @@ private:
 
     std::map<HashableDimensionKey, int> mSlicedConditionState;
 
+    typedef std::map<HashableDimensionKey, int>::value_type Slice;
+
+    // A secondary index of mSlicedConditionState for one set of linked fields. Each slice is
+    // stored under its values of those fields, keyed the way getDimensionForCondition builds the
+    // query. A slice without all of the fields can't contain such a key and is left out.
+    struct LinkIndex {
+        std::vector<Field> fields;
+        std::unordered_map<HashableDimensionKey, std::vector<const Slice*>> slices;
+    };
+
+    std::vector<LinkIndex> mLinkIndexes;
+
+    // Returns false if [slice] does not have all of [fields].
+    static bool projectSlice(const std::vector<Field>& fields, const HashableDimensionKey& slice,
+                             HashableDimensionKey* projection);
+
+    void addToLinkIndexes(const Slice* slice);
+
+    void removeFromLinkIndexes(const Slice* slice);
+
+    const LinkIndex* findLinkIndex(const HashableDimensionKey& key) const;
+
     void handleStopAll(std::vector<ConditionState>& conditionCache,
                        std::vector<bool>& changedCache);
 
@@ -138,6 +163,7 @@ private:
     FRIEND_TEST(SimpleConditionTrackerTest, TestSlicedCondition);
     FRIEND_TEST(SimpleConditionTrackerTest, TestSlicedWithNoOutputDim);
     FRIEND_TEST(SimpleConditionTrackerTest, TestStopAll);
+    FRIEND_TEST(SimpleConditionTrackerTest, TestPartialLinkUsesLinkIndex);
 };
 
 }  // namespace statsd
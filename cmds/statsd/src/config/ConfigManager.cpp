@@ -314,7 +314,9 @@ void ConfigManager::update_saved_configs_locked(const ConfigKey& key,
     string file_name =
         StringPrintf("%s/%ld_%d_%lld", STATS_SERVICE_DIR, time(nullptr),
                      key.GetUid(), (long long)key.GetId());
-    StorageManager::writeFile(file_name.c_str(), &buffer[0], numBytes);
+    StorageManager::writeFileAsync(file_name, key,
+                                   vector<uint8_t>(buffer.begin(), buffer.begin() + numBytes),
+                                   true /* replacePending */);
 }
 
 }  // namespace statsd
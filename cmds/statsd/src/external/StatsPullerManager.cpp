@@ -277,7 +277,95 @@ std::map<int, PullAtomInfo> StatsPullerManager::kAllPullAtomInfo = {
          {.puller = new StatsCompanionServicePuller(android::util::NOTIFICATION_REMOTE_VIEWS)}},
 };
 
-StatsPullerManager::StatsPullerManager() : mNextPullTimeNs(NO_ALARM_UPDATE) {
+StatsPullerManager::StatsPullerManager()
+    : mNextPullTimeNs(NO_ALARM_UPDATE),
+      mPullCoalescingWindowNs(StatsdStats::kPullCoalescingWindowNs) {
+}
+
+StatsPullerManager::~StatsPullerManager() {
+    {
+        std::lock_guard<std::mutex> lock(mPullTaskLock);
+        mStopPullThreads = true;
+    }
+    mPullTaskCv.notify_all();
+    // Queued pulls are drained before the threads exit, so no task outlives us.
+    for (auto& thread : mPullThreads) {
+        thread.join();
+    }
+}
+
+void StatsPullerManager::startPullThreadsLocked() {
+    if (!mPullThreads.empty()) {
+        return;
+    }
+    for (int i = 0; i < kPullThreadCount; i++) {
+        mPullThreads.emplace_back([this] { pullThreadLoop(); });
+    }
+}
+
+void StatsPullerManager::pullThreadLoop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mPullTaskLock);
+            mPullTaskCv.wait(lock, [this] { return mStopPullThreads || !mPullTasks.empty(); });
+            if (mPullTasks.empty()) {
+                return;
+            }
+            task = std::move(mPullTasks.front());
+            mPullTasks.pop_front();
+        }
+        task();
+    }
+}
+
+void StatsPullerManager::stampPulledData(PendingPull* pendingPull) {
+    // Convention is to mark pull atom timestamp at request time.
+    // If we pull at t0, puller starts at t1, finishes at t2, and send back
+    // at t3, we mark t0 as its timestamp, which should correspond to its
+    // triggering event, such as condition change at t0.
+    // Here the triggering event is alarm fired from AlarmManager.
+    // In ValueMetricProducer and GaugeMetricProducer we do same thing
+    // when pull on condition change, etc.
+    for (auto& event : pendingPull->data) {
+        event->setElapsedTimestampNs(pendingPull->pullTimeNs);
+        event->setLogdWallClockTimestampNs(pendingPull->wallClockNs);
+    }
+}
+
+void StatsPullerManager::runPendingPull(const std::shared_ptr<PendingPull>& pendingPull) {
+    vector<shared_ptr<LogEvent>> data;
+    bool pullSuccess = Pull(pendingPull->tagId, &data);
+    const int64_t pullDelayNs = getElapsedRealtimeNs() - pendingPull->pullTimeNs;
+    if (pullSuccess) {
+        StatsdStats::getInstance().notePullDelay(pendingPull->tagId, pullDelayNs);
+    }
+
+    bool deliverLate;
+    {
+        std::lock_guard<std::mutex> lock(mPullTaskLock);
+        pendingPull->data = std::move(data);
+        pendingPull->pullSuccess = pullSuccess;
+        pendingPull->done = true;
+        deliverLate = pendingPull->abandoned;
+    }
+    mPullDoneCv.notify_all();
+    if (!deliverLate) {
+        return;
+    }
+
+    // The alarm thread has moved on. Hand the result over here, still stamped with the alarm
+    // time, so the receivers can account for it (or count it as late) instead of losing it.
+    ALOGW("Scheduled pull for atom %d delivered %lld ns after the alarm", pendingPull->tagId,
+          (long long)pullDelayNs);
+    stampPulledData(pendingPull.get());
+    for (const auto& receiver : pendingPull->receivers) {
+        sp<PullDataReceiver> receiverPtr = receiver.promote();
+        if (receiverPtr != nullptr) {
+            receiverPtr->onDataPulled(pendingPull->data, pendingPull->pullSuccess,
+                                      pendingPull->pullTimeNs);
+        }
+    }
 }
 
 bool StatsPullerManager::Pull(int tagId, vector<shared_ptr<LogEvent>>* data) {
@@ -329,6 +417,30 @@ void StatsPullerManager::SetStatsCompanionService(
     }
 }
 
+void StatsPullerManager::SetPullCoalescingWindowNs(int64_t windowNs) {
+    AutoMutex _l(mLock);
+    mPullCoalescingWindowNs = std::max<int64_t>(windowNs, 0);
+}
+
+int64_t StatsPullerManager::coalesceNextPullTimeLocked(int64_t minNextPullTimeNs) const {
+    if (minNextPullTimeNs == NO_ALARM_UPDATE || mPullCoalescingWindowNs == 0) {
+        return minNextPullTimeNs;
+    }
+    // Pulling late is already the norm since alarms are inexact, so rather than pulling some
+    // receivers early we push the alarm out to the latest pull time inside the window. Each
+    // atom is then pulled once and every due receiver shares the same immutable events.
+    int64_t coalescedNs = minNextPullTimeNs;
+    for (const auto& pair : mReceivers) {
+        for (const ReceiverInfo& receiverInfo : pair.second) {
+            if (receiverInfo.nextPullTimeNs > coalescedNs &&
+                receiverInfo.nextPullTimeNs <= minNextPullTimeNs + mPullCoalescingWindowNs) {
+                coalescedNs = receiverInfo.nextPullTimeNs;
+            }
+        }
+    }
+    return coalescedNs;
+}
+
 void StatsPullerManager::RegisterReceiver(int tagId, wp<PullDataReceiver> receiver,
                                               int64_t nextPullTimeNs, int64_t intervalNs) {
     AutoMutex _l(mLock);
@@ -358,7 +470,7 @@ void StatsPullerManager::RegisterReceiver(int tagId, wp<PullDataReceiver> receiv
     // There is only one alarm for all pulled events. So only set it to the smallest denom.
     if (nextPullTimeNs < mNextPullTimeNs) {
         VLOG("Updating next pull time %lld", (long long)mNextPullTimeNs);
-        mNextPullTimeNs = nextPullTimeNs;
+        mNextPullTimeNs = coalesceNextPullTimeLocked(nextPullTimeNs);
         updateAlarmLocked();
     }
     VLOG("Puller for tagId %d registered of %d", tagId, (int)receivers.size());
@@ -406,32 +518,65 @@ void StatsPullerManager::OnAlarmFired(int64_t elapsedTimeNs) {
         }
     }
 
-    for (const auto& pullInfo : needToPull) {
-        vector<shared_ptr<LogEvent>> data;
-        bool pullSuccess = Pull(pullInfo.first, &data);
-        if (pullSuccess) {
-            StatsdStats::getInstance().notePullDelay(
-                    pullInfo.first, getElapsedRealtimeNs() - elapsedTimeNs);
-        } else {
-            VLOG("pull failed at %lld, will try again later", (long long)elapsedTimeNs);
+    // Pulls of different atoms are independent, so run them concurrently and let a slow puller
+    // only hold up its own receivers.
+    vector<shared_ptr<PendingPull>> pendingPulls;
+    if (!needToPull.empty()) {
+        std::lock_guard<std::mutex> lock(mPullTaskLock);
+        startPullThreadsLocked();
+        for (const auto& pullInfo : needToPull) {
+            auto pendingPull = make_shared<PendingPull>();
+            pendingPull->tagId = pullInfo.first;
+            pendingPull->pullTimeNs = elapsedTimeNs;
+            pendingPull->wallClockNs = wallClockNs;
+            pendingPulls.push_back(pendingPull);
+            mPullTasks.push_back([this, pendingPull] { runPendingPull(pendingPull); });
         }
+    }
+    mPullTaskCv.notify_all();
 
-        // Convention is to mark pull atom timestamp at request time.
-        // If we pull at t0, puller starts at t1, finishes at t2, and send back
-        // at t3, we mark t0 as its timestamp, which should correspond to its
-        // triggering event, such as condition change at t0.
-        // Here the triggering event is alarm fired from AlarmManager.
-        // In ValueMetricProducer and GaugeMetricProducer we do same thing
-        // when pull on condition change, etc.
-        for (auto& event : data) {
-            event->setElapsedTimestampNs(elapsedTimeNs);
-            event->setLogdWallClockTimestampNs(wallClockNs);
+    for (size_t i = 0; i < needToPull.size(); i++) {
+        const auto& pullInfo = needToPull[i];
+        const shared_ptr<PendingPull>& pendingPull = pendingPulls[i];
+
+        auto atomInfo = kAllPullAtomInfo.find(pullInfo.first);
+        const int64_t pullTimeoutNs = atomInfo != kAllPullAtomInfo.end()
+                                              ? atomInfo->second.pullTimeoutNs
+                                              : StatsdStats::kPullMaxDelayNs;
+        // Every pull started at the same time, so the deadline is relative to the alarm.
+        const int64_t remainingNs =
+                std::max<int64_t>(elapsedTimeNs + pullTimeoutNs - getElapsedRealtimeNs(), 0);
+        bool pullDone;
+        {
+            std::unique_lock<std::mutex> lock(mPullTaskLock);
+            pullDone = mPullDoneCv.wait_for(lock, std::chrono::nanoseconds(remainingNs),
+                                            [&pendingPull] { return pendingPull->done; });
+            if (!pullDone) {
+                for (const auto& receiverInfo : pullInfo.second) {
+                    pendingPull->receivers.push_back(receiverInfo->receiver);
+                }
+                pendingPull->abandoned = true;
+            }
+        }
+
+        if (pullDone) {
+            if (!pendingPull->pullSuccess) {
+                VLOG("pull failed at %lld, will try again later", (long long)elapsedTimeNs);
+            }
+            stampPulledData(pendingPull.get());
+        } else {
+            StatsdStats::getInstance().notePullDeadlineExceeded(pullInfo.first);
+            ALOGW("Scheduled pull for atom %d missed its %lld ns deadline", pullInfo.first,
+                  (long long)pullTimeoutNs);
         }
 
         for (const auto& receiverInfo : pullInfo.second) {
             sp<PullDataReceiver> receiverPtr = receiverInfo->receiver.promote();
             if (receiverPtr != nullptr) {
-                receiverPtr->onDataPulled(data, pullSuccess, elapsedTimeNs);
+                if (pullDone) {
+                    receiverPtr->onDataPulled(pendingPull->data, pendingPull->pullSuccess,
+                                              elapsedTimeNs);
+                }
                 // We may have just come out of a coma, compute next pull time.
                 int numBucketsAhead =
                         (elapsedTimeNs - receiverInfo->nextPullTimeNs) / receiverInfo->intervalNs;
@@ -445,6 +590,7 @@ void StatsPullerManager::OnAlarmFired(int64_t elapsedTimeNs) {
         }
     }
 
+    minNextPullTimeNs = coalesceNextPullTimeLocked(minNextPullTimeNs);
     VLOG("mNextPullTimeNs: %lld updated to %lld", (long long)mNextPullTimeNs,
          (long long)minNextPullTimeNs);
     mNextPullTimeNs = minNextPullTimeNs;
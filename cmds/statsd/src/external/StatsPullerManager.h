@@ -21,8 +21,13 @@
 #include <binder/IServiceManager.h>
 #include <utils/RefBase.h>
 #include <utils/threads.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <list>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 #include "PullDataReceiver.h"
@@ -57,8 +62,7 @@ class StatsPullerManager : public virtual RefBase {
 public:
     StatsPullerManager();
 
-    virtual ~StatsPullerManager() {
-    }
+    virtual ~StatsPullerManager();
 
     // Registers a receiver for tagId. It will be pulled on the nextPullTimeNs
     // and then every intervalNs thereafter.
@@ -97,8 +101,15 @@ public:
 
     void UnregisterPullerCallback(int32_t atomTag);
 
+    // Scheduled pulls that fall due within [windowNs] of the earliest pending one are deferred
+    // and served together by a single puller invocation. 0 disables coalescing.
+    void SetPullCoalescingWindowNs(int64_t windowNs);
+
     static std::map<int, PullAtomInfo> kAllPullAtomInfo;
 
+    // Number of threads used to run scheduled pulls of different atoms concurrently.
+    static const int kPullThreadCount = 4;
+
 private:
     sp<IStatsCompanionService> mStatsCompanionService = nullptr;
 
@@ -116,8 +127,49 @@ private:
 
     void updateAlarmLocked();
 
+    // Returns the alarm time to use so that every receiver due within the coalescing window
+    // after [minNextPullTimeNs] is pulled in the same round.
+    int64_t coalesceNextPullTimeLocked(int64_t minNextPullTimeNs) const;
+
     int64_t mNextPullTimeNs;
 
+    int64_t mPullCoalescingWindowNs;
+
+    // A scheduled pull handed to the pull threads by OnAlarmFired.
+    struct PendingPull {
+        int tagId;
+        int64_t pullTimeNs;
+        int64_t wallClockNs;
+        // Receivers to deliver to if the alarm thread stopped waiting for this pull.
+        std::vector<wp<PullDataReceiver>> receivers;
+        std::vector<std::shared_ptr<LogEvent>> data;
+        bool pullSuccess = false;
+        bool done = false;
+        bool abandoned = false;
+    };
+
+    void startPullThreadsLocked();
+
+    void pullThreadLoop();
+
+    void runPendingPull(const std::shared_ptr<PendingPull>& pendingPull);
+
+    static void stampPulledData(PendingPull* pendingPull);
+
+    // Threads running scheduled pulls. Started on the first alarm.
+    std::vector<std::thread> mPullThreads;
+
+    // Guards mPullTasks, mStopPullThreads and the PendingPull results.
+    std::mutex mPullTaskLock;
+
+    std::condition_variable mPullTaskCv;
+
+    std::condition_variable mPullDoneCv;
+
+    std::deque<std::function<void()>> mPullTasks;
+
+    bool mStopPullThreads = false;
+
     FRIEND_TEST(GaugeMetricE2eTest, TestRandomSamplePulledEvents);
     FRIEND_TEST(GaugeMetricE2eTest, TestRandomSamplePulledEvent_LateAlarm);
     FRIEND_TEST(GaugeMetricE2eTest, TestRandomSamplePulledEventsWithActivation);
@@ -52,6 +52,7 @@ const int FIELD_ID_SYSTEM_SERVER_RESTART = 15;
 const int FIELD_ID_LOGGER_ERROR_STATS = 16;
 const int FIELD_ID_OVERFLOW = 18;
 const int FIELD_ID_ACTIVATION_BROADCAST_GUARDRAIL = 19;
+const int FIELD_ID_SHARED_MATCHER_STATS = 20;
 
 const int FIELD_ID_ATOM_STATS_TAG = 1;
 const int FIELD_ID_ATOM_STATS_COUNT = 2;
@@ -70,6 +71,9 @@ const int FIELD_ID_OVERFLOW_COUNT = 1;
 const int FIELD_ID_OVERFLOW_MAX_HISTORY = 2;
 const int FIELD_ID_OVERFLOW_MIN_HISTORY = 3;
 
+const int FIELD_ID_SHARED_MATCHER_STATS_SUBSCRIBER_COUNT = 1;
+const int FIELD_ID_SHARED_MATCHER_STATS_DISTINCT_COUNT = 2;
+
 const int FIELD_ID_CONFIG_STATS_UID = 1;
 const int FIELD_ID_CONFIG_STATS_ID = 2;
 const int FIELD_ID_CONFIG_STATS_CREATION = 3;
@@ -119,8 +123,7 @@ const std::map<int, std::pair<size_t, size_t>> StatsdStats::kAtomDimensionKeySiz
         {android::util::CPU_TIME_PER_UID_FREQ, {6000, 10000}},
 };
 
-StatsdStats::StatsdStats() {
-    mPushedAtomStats.resize(android::util::kMaxPushedAtomId + 1);
+StatsdStats::StatsdStats() : mPushedAtomStats(android::util::kMaxPushedAtomId + 1) {
     mStartTimeSec = getWallClockSec();
 }
 
@@ -141,7 +144,7 @@ void StatsdStats::noteConfigReceived(
         const ConfigKey& key, int metricsCount, int conditionsCount, int matchersCount,
         int alertsCount, const std::list<std::pair<const int64_t, const int32_t>>& annotations,
         bool isValid) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     int32_t nowTimeSec = getWallClockSec();
 
     // If there is an existing config for the same key, icebox the old config.
@@ -179,7 +182,7 @@ void StatsdStats::noteConfigRemovedInternalLocked(const ConfigKey& key) {
 }
 
 void StatsdStats::noteConfigRemoved(const ConfigKey& key) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     noteConfigRemovedInternalLocked(key);
 }
 
@@ -191,13 +194,13 @@ void StatsdStats::noteConfigResetInternalLocked(const ConfigKey& key) {
 }
 
 void StatsdStats::noteConfigReset(const ConfigKey& key) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     noteConfigResetInternalLocked(key);
 }
 
 void StatsdStats::noteLogLost(int32_t wallClockTimeSec, int32_t count, int32_t lastError,
                               int32_t lastTag, int32_t uid, int32_t pid) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     if (mLogLossStats.size() == kMaxLoggerErrors) {
         mLogLossStats.pop_front();
     }
@@ -209,7 +212,7 @@ void StatsdStats::noteBroadcastSent(const ConfigKey& key) {
 }
 
 void StatsdStats::noteBroadcastSent(const ConfigKey& key, int32_t timeSec) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     auto it = mConfigStats.find(key);
     if (it == mConfigStats.end()) {
         ALOGE("Config key %s not found!", key.ToString().c_str());
@@ -226,7 +229,7 @@ void StatsdStats::noteActiveStatusChanged(const ConfigKey& key, bool activated)
 }
 
 void StatsdStats::noteActiveStatusChanged(const ConfigKey& key, bool activated, int32_t timeSec) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     auto it = mConfigStats.find(key);
     if (it == mConfigStats.end()) {
         ALOGE("Config key %s not found!", key.ToString().c_str());
@@ -240,12 +243,18 @@ void StatsdStats::noteActiveStatusChanged(const ConfigKey& key, bool activated,
     vec.push_back(timeSec);
 }
 
+void StatsdStats::noteSharedMatcherPool(size_t subscriberCount, size_t distinctCount) {
+    lock_guard<std::shared_mutex> lock(mLock);
+    mSharedMatcherSubscriberCount = subscriberCount;
+    mSharedMatcherDistinctCount = distinctCount;
+}
+
 void StatsdStats::noteActivationBroadcastGuardrailHit(const int uid) {
     noteActivationBroadcastGuardrailHit(uid, getWallClockSec());
 }
 
 void StatsdStats::noteActivationBroadcastGuardrailHit(const int uid, const int32_t timeSec) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     auto& guardrailTimes = mActivationBroadcastGuardrailStats[uid];
     if (guardrailTimes.size() == kMaxTimestampCount) {
         guardrailTimes.pop_front();
@@ -258,7 +267,7 @@ void StatsdStats::noteDataDropped(const ConfigKey& key, const size_t totalBytes)
 }
 
 void StatsdStats::noteEventQueueOverflow(int64_t oldestEventTimestampNs) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
 
     mOverflowCount++;
 
@@ -274,7 +283,7 @@ void StatsdStats::noteEventQueueOverflow(int64_t oldestEventTimestampNs) {
 }
 
 void StatsdStats::noteDataDropped(const ConfigKey& key, const size_t totalBytes, int32_t timeSec) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     auto it = mConfigStats.find(key);
     if (it == mConfigStats.end()) {
         ALOGE("Config key %s not found!", key.ToString().c_str());
@@ -294,7 +303,7 @@ void StatsdStats::noteMetricsReportSent(const ConfigKey& key, const size_t num_b
 
 void StatsdStats::noteMetricsReportSent(const ConfigKey& key, const size_t num_bytes,
                                         int32_t timeSec) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     auto it = mConfigStats.find(key);
     if (it == mConfigStats.end()) {
         ALOGE("Config key %s not found!", key.ToString().c_str());
@@ -307,27 +316,27 @@ void StatsdStats::noteMetricsReportSent(const ConfigKey& key, const size_t num_b
 }
 
 void StatsdStats::noteUidMapDropped(int deltas) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     mUidMapStats.dropped_changes += mUidMapStats.dropped_changes + deltas;
 }
 
 void StatsdStats::noteUidMapAppDeletionDropped() {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     mUidMapStats.deleted_apps++;
 }
 
 void StatsdStats::setUidMapChanges(int changes) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     mUidMapStats.changes = changes;
 }
 
 void StatsdStats::setCurrentUidMapMemory(int bytes) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     mUidMapStats.bytes_used = bytes;
 }
 
 void StatsdStats::noteConditionDimensionSize(const ConfigKey& key, const int64_t& id, int size) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     // if name doesn't exist before, it will create the key with count 0.
     auto statsIt = mConfigStats.find(key);
     if (statsIt == mConfigStats.end()) {
@@ -341,7 +350,7 @@ void StatsdStats::noteConditionDimensionSize(const ConfigKey& key, const int64_t
 }
 
 void StatsdStats::noteMetricDimensionSize(const ConfigKey& key, const int64_t& id, int size) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     // if name doesn't exist before, it will create the key with count 0.
     auto statsIt = mConfigStats.find(key);
     if (statsIt == mConfigStats.end()) {
@@ -355,7 +364,7 @@ void StatsdStats::noteMetricDimensionSize(const ConfigKey& key, const int64_t& i
 
 void StatsdStats::noteMetricDimensionInConditionSize(
         const ConfigKey& key, const int64_t& id, int size) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     // if name doesn't exist before, it will create the key with count 0.
     auto statsIt = mConfigStats.find(key);
     if (statsIt == mConfigStats.end()) {
@@ -368,8 +377,21 @@ void StatsdStats::noteMetricDimensionInConditionSize(
 }
 
 void StatsdStats::noteMatcherMatched(const ConfigKey& key, const int64_t& id) {
-    lock_guard<std::mutex> lock(mLock);
+    {
+        std::shared_lock<std::shared_mutex> lock(mLock);
+        auto statsIt = mConfigStats.find(key);
+        if (statsIt == mConfigStats.end()) {
+            return;
+        }
+        auto matcherIt = statsIt->second->matcher_stats.find(id);
+        if (matcherIt != statsIt->second->matcher_stats.end()) {
+            matcherIt->second.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
 
+    // First match of this matcher, the map has to grow.
+    lock_guard<std::shared_mutex> lock(mLock);
     auto statsIt = mConfigStats.find(key);
     if (statsIt == mConfigStats.end()) {
         return;
@@ -378,7 +400,7 @@ void StatsdStats::noteMatcherMatched(const ConfigKey& key, const int64_t& id) {
 }
 
 void StatsdStats::noteAnomalyDeclared(const ConfigKey& key, const int64_t& id) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     auto statsIt = mConfigStats.find(key);
     if (statsIt == mConfigStats.end()) {
         return;
@@ -387,42 +409,49 @@ void StatsdStats::noteAnomalyDeclared(const ConfigKey& key, const int64_t& id) {
 }
 
 void StatsdStats::noteRegisteredAnomalyAlarmChanged() {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     mAnomalyAlarmRegisteredStats++;
 }
 
 void StatsdStats::noteRegisteredPeriodicAlarmChanged() {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     mPeriodicAlarmRegisteredStats++;
 }
 
 void StatsdStats::updateMinPullIntervalSec(int pullAtomId, long intervalSec) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     mPulledAtomStats[pullAtomId].minPullIntervalSec =
             std::min(mPulledAtomStats[pullAtomId].minPullIntervalSec, intervalSec);
 }
 
 void StatsdStats::notePull(int pullAtomId) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     mPulledAtomStats[pullAtomId].totalPull++;
 }
 
 void StatsdStats::notePullFromCache(int pullAtomId) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     mPulledAtomStats[pullAtomId].totalPullFromCache++;
 }
 
 void StatsdStats::notePullTime(int pullAtomId, int64_t pullTimeNs) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     auto& pullStats = mPulledAtomStats[pullAtomId];
     pullStats.maxPullTimeNs = std::max(pullStats.maxPullTimeNs, pullTimeNs);
     pullStats.avgPullTimeNs = (pullStats.avgPullTimeNs * pullStats.numPullTime + pullTimeNs) /
                               (pullStats.numPullTime + 1);
     pullStats.numPullTime += 1;
+
+    int bucket = 0;
+    for (int64_t boundNs = NS_PER_SEC / 1000;
+         bucket < kPullTimeHistogramBucketCount - 1 && pullTimeNs >= boundNs; boundNs *= 4) {
+        bucket++;
+    }
+    pullStats.pullTimeHistogram[bucket]++;
 }
 
 void StatsdStats::notePullDelay(int pullAtomId, int64_t pullDelayNs) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     auto& pullStats = mPulledAtomStats[pullAtomId];
     pullStats.maxPullDelayNs = std::max(pullStats.maxPullDelayNs, pullDelayNs);
     pullStats.avgPullDelayNs =
@@ -432,34 +461,48 @@ void StatsdStats::notePullDelay(int pullAtomId, int64_t pullDelayNs) {
 }
 
 void StatsdStats::notePullDataError(int pullAtomId) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     mPulledAtomStats[pullAtomId].dataError++;
 }
 
 void StatsdStats::notePullTimeout(int pullAtomId) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     mPulledAtomStats[pullAtomId].pullTimeout++;
 }
 
 void StatsdStats::notePullExceedMaxDelay(int pullAtomId) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     mPulledAtomStats[pullAtomId].pullExceedMaxDelay++;
 }
 
-void StatsdStats::noteAtomLogged(int atomId, int32_t timeSec) {
-    lock_guard<std::mutex> lock(mLock);
+void StatsdStats::notePullDeadlineExceeded(int pullAtomId) {
+    lock_guard<std::shared_mutex> lock(mLock);
+    mPulledAtomStats[pullAtomId].pullDeadlineExceeded++;
+}
 
+void StatsdStats::noteAtomLogged(int atomId, int32_t timeSec) {
     if (atomId <= android::util::kMaxPushedAtomId) {
-        mPushedAtomStats[atomId]++;
-    } else {
-        if (mNonPlatformPushedAtomStats.size() < kMaxNonPlatformPushedAtoms) {
-            mNonPlatformPushedAtomStats[atomId]++;
+        mPushedAtomStats[atomId].fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    {
+        std::shared_lock<std::shared_mutex> lock(mLock);
+        auto it = mNonPlatformPushedAtomStats.find(atomId);
+        if (it != mNonPlatformPushedAtomStats.end()) {
+            it->second.fetch_add(1, std::memory_order_relaxed);
+            return;
         }
     }
+
+    lock_guard<std::shared_mutex> lock(mLock);
+    if (mNonPlatformPushedAtomStats.size() < kMaxNonPlatformPushedAtoms) {
+        mNonPlatformPushedAtomStats[atomId]++;
+    }
 }
 
 void StatsdStats::noteSystemServerRestart(int32_t timeSec) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
 
     if (mSystemServerRestartSec.size() == kMaxSystemServerRestarts) {
         mSystemServerRestartSec.pop_front();
@@ -468,27 +511,27 @@ void StatsdStats::noteSystemServerRestart(int32_t timeSec) {
 }
 
 void StatsdStats::notePullFailed(int atomId) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     mPulledAtomStats[atomId].pullFailed++;
 }
 
 void StatsdStats::noteStatsCompanionPullFailed(int atomId) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     mPulledAtomStats[atomId].statsCompanionPullFailed++;
 }
 
 void StatsdStats::noteStatsCompanionPullBinderTransactionFailed(int atomId) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     mPulledAtomStats[atomId].statsCompanionPullBinderTransactionFailed++;
 }
 
 void StatsdStats::noteEmptyData(int atomId) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     mPulledAtomStats[atomId].emptyData++;
 }
 
 void StatsdStats::notePullerCallbackRegistrationChanged(int atomId, bool registered) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     if (registered) {
         mPulledAtomStats[atomId].registeredCount++;
     } else {
@@ -497,52 +540,52 @@ void StatsdStats::notePullerCallbackRegistrationChanged(int atomId, bool registe
 }
 
 void StatsdStats::noteHardDimensionLimitReached(int64_t metricId) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     getAtomMetricStats(metricId).hardDimensionLimitReached++;
 }
 
 void StatsdStats::noteLateLogEventSkipped(int64_t metricId) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     getAtomMetricStats(metricId).lateLogEventSkipped++;
 }
 
 void StatsdStats::noteSkippedForwardBuckets(int64_t metricId) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     getAtomMetricStats(metricId).skippedForwardBuckets++;
 }
 
 void StatsdStats::noteBadValueType(int64_t metricId) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     getAtomMetricStats(metricId).badValueType++;
 }
 
 void StatsdStats::noteBucketDropped(int64_t metricId) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     getAtomMetricStats(metricId).bucketDropped++;
 }
 
 void StatsdStats::noteBucketUnknownCondition(int64_t metricId) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     getAtomMetricStats(metricId).bucketUnknownCondition++;
 }
 
 void StatsdStats::noteConditionChangeInNextBucket(int64_t metricId) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     getAtomMetricStats(metricId).conditionChangeInNextBucket++;
 }
 
 void StatsdStats::noteInvalidatedBucket(int64_t metricId) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     getAtomMetricStats(metricId).invalidatedBucket++;
 }
 
 void StatsdStats::noteBucketCount(int64_t metricId) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     getAtomMetricStats(metricId).bucketCount++;
 }
 
 void StatsdStats::noteBucketBoundaryDelayNs(int64_t metricId, int64_t timeDelayNs) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     AtomMetricStats& pullStats = getAtomMetricStats(metricId);
     pullStats.maxBucketBoundaryDelayNs =
             std::max(pullStats.maxBucketBoundaryDelayNs, timeDelayNs);
@@ -560,7 +603,7 @@ StatsdStats::AtomMetricStats& StatsdStats::getAtomMetricStats(int64_t metricId)
 }
 
 void StatsdStats::reset() {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
     resetInternalLocked();
 }
 
@@ -605,6 +648,10 @@ void StatsdStats::resetInternalLocked() {
         pullStats.second.pullExceedMaxDelay = 0;
         pullStats.second.registeredCount = 0;
         pullStats.second.unregisteredCount = 0;
+        pullStats.second.pullDeadlineExceeded = 0;
+        for (auto& count : pullStats.second.pullTimeHistogram) {
+            count = 0;
+        }
     }
     mAtomMetricStats.clear();
     mActivationBroadcastGuardrailStats.clear();
@@ -619,7 +666,8 @@ string buildTimeString(int64_t timeSec) {
 }
 
 void StatsdStats::dumpStats(int out) const {
-    lock_guard<std::mutex> lock(mLock);
+    // Only reads, so loggers keep bumping the atomic counters while this formats.
+    std::shared_lock<std::shared_mutex> lock(mLock);
     time_t t = mStartTimeSec;
     struct tm* tm = localtime(&t);
     char timeBuffer[80];
@@ -699,7 +747,8 @@ void StatsdStats::dumpStats(int out) const {
         }
 
         for (const auto& stats : pair.second->matcher_stats) {
-            dprintf(out, "matcher %lld matched %d times\n", (long long)stats.first, stats.second);
+            dprintf(out, "matcher %lld matched %d times\n", (long long)stats.first,
+                    stats.second.load(std::memory_order_relaxed));
         }
 
         for (const auto& stats : pair.second->condition_stats) {
@@ -721,12 +770,14 @@ void StatsdStats::dumpStats(int out) const {
     dprintf(out, "********Pushed Atom stats***********\n");
     const size_t atomCounts = mPushedAtomStats.size();
     for (size_t i = 2; i < atomCounts; i++) {
-        if (mPushedAtomStats[i] > 0) {
-            dprintf(out, "Atom %lu->%d\n", (unsigned long)i, mPushedAtomStats[i]);
+        const int count = mPushedAtomStats[i].load(std::memory_order_relaxed);
+        if (count > 0) {
+            dprintf(out, "Atom %lu->%d\n", (unsigned long)i, count);
         }
     }
     for (const auto& pair : mNonPlatformPushedAtomStats) {
-        dprintf(out, "Atom %lu->%d\n", (unsigned long)pair.first, pair.second);
+        dprintf(out, "Atom %lu->%d\n", (unsigned long)pair.first,
+                pair.second.load(std::memory_order_relaxed));
     }
 
     dprintf(out, "********Pulled Atom stats***********\n");
@@ -738,13 +789,20 @@ void StatsdStats::dumpStats(int out) const {
                 "nanos)%lld, "
                 "  (max pull delay nanos)%lld, (data error)%ld\n"
                 "  (pull timeout)%ld, (pull exceed max delay)%ld\n"
-                "  (registered count) %ld, (unregistered count) %ld\n",
+                "  (registered count) %ld, (unregistered count) %ld\n"
+                "  (pull deadline exceeded) %ld\n",
                 (int)pair.first, (long)pair.second.totalPull, (long)pair.second.totalPullFromCache,
                 (long)pair.second.pullFailed, (long)pair.second.minPullIntervalSec,
                 (long long)pair.second.avgPullTimeNs, (long long)pair.second.maxPullTimeNs,
                 (long long)pair.second.avgPullDelayNs, (long long)pair.second.maxPullDelayNs,
                 pair.second.dataError, pair.second.pullTimeout, pair.second.pullExceedMaxDelay,
-                pair.second.registeredCount, pair.second.unregisteredCount);
+                pair.second.registeredCount, pair.second.unregisteredCount,
+                pair.second.pullDeadlineExceeded);
+        dprintf(out, "  (pull time histogram, 4^i ms buckets)");
+        for (int i = 0; i < kPullTimeHistogramBucketCount; i++) {
+            dprintf(out, " %ld", pair.second.pullTimeHistogram[i]);
+        }
+        dprintf(out, "\n");
     }
 
     if (mAnomalyAlarmRegisteredStats > 0) {
@@ -777,6 +835,9 @@ void StatsdStats::dumpStats(int out) const {
     dprintf(out, "Event queue overflow: %d; MaxHistoryNs: %lld; MinHistoryNs: %lld\n",
             mOverflowCount, (long long)mMaxQueueHistoryNs, (long long)mMinQueueHistoryNs);
 
+    dprintf(out, "Shared matchers: %d subscribers, %d distinct\n", mSharedMatcherSubscriberCount,
+            mSharedMatcherDistinctCount);
+
     if (mActivationBroadcastGuardrailStats.size() > 0) {
         dprintf(out, "********mActivationBroadcastGuardrail stats***********\n");
         for (const auto& pair: mActivationBroadcastGuardrailStats) {
@@ -860,7 +921,8 @@ void addConfigStatsToProto(const ConfigStats& configStats, ProtoOutputStream* pr
         uint64_t tmpToken = proto->start(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED |
                                           FIELD_ID_CONFIG_STATS_MATCHER_STATS);
         proto->write(FIELD_TYPE_INT64 | FIELD_ID_MATCHER_STATS_ID, (long long)pair.first);
-        proto->write(FIELD_TYPE_INT32 | FIELD_ID_MATCHER_STATS_COUNT, pair.second);
+        proto->write(FIELD_TYPE_INT32 | FIELD_ID_MATCHER_STATS_COUNT,
+                     pair.second.load(std::memory_order_relaxed));
         proto->end(tmpToken);
     }
 
@@ -899,7 +961,7 @@ void addConfigStatsToProto(const ConfigStats& configStats, ProtoOutputStream* pr
 }
 
 void StatsdStats::dumpStats(std::vector<uint8_t>* output, bool reset) {
-    lock_guard<std::mutex> lock(mLock);
+    lock_guard<std::shared_mutex> lock(mLock);
 
     ProtoOutputStream proto;
     proto.write(FIELD_TYPE_INT32 | FIELD_ID_BEGIN_TIME, mStartTimeSec);
@@ -915,11 +977,12 @@ void StatsdStats::dumpStats(std::vector<uint8_t>* output, bool reset) {
 
     const size_t atomCounts = mPushedAtomStats.size();
     for (size_t i = 2; i < atomCounts; i++) {
-        if (mPushedAtomStats[i] > 0) {
+        const int count = mPushedAtomStats[i].load(std::memory_order_relaxed);
+        if (count > 0) {
             uint64_t token =
                     proto.start(FIELD_TYPE_MESSAGE | FIELD_ID_ATOM_STATS | FIELD_COUNT_REPEATED);
             proto.write(FIELD_TYPE_INT32 | FIELD_ID_ATOM_STATS_TAG, (int32_t)i);
-            proto.write(FIELD_TYPE_INT32 | FIELD_ID_ATOM_STATS_COUNT, mPushedAtomStats[i]);
+            proto.write(FIELD_TYPE_INT32 | FIELD_ID_ATOM_STATS_COUNT, count);
             proto.end(token);
         }
     }
@@ -928,7 +991,8 @@ void StatsdStats::dumpStats(std::vector<uint8_t>* output, bool reset) {
         uint64_t token =
                 proto.start(FIELD_TYPE_MESSAGE | FIELD_ID_ATOM_STATS | FIELD_COUNT_REPEATED);
         proto.write(FIELD_TYPE_INT32 | FIELD_ID_ATOM_STATS_TAG, pair.first);
-        proto.write(FIELD_TYPE_INT32 | FIELD_ID_ATOM_STATS_COUNT, pair.second);
+        proto.write(FIELD_TYPE_INT32 | FIELD_ID_ATOM_STATS_COUNT,
+                    pair.second.load(std::memory_order_relaxed));
         proto.end(token);
     }
 
@@ -983,6 +1047,15 @@ void StatsdStats::dumpStats(std::vector<uint8_t>* output, bool reset) {
         proto.end(token);
     }
 
+    if (mSharedMatcherSubscriberCount > 0) {
+        uint64_t token = proto.start(FIELD_TYPE_MESSAGE | FIELD_ID_SHARED_MATCHER_STATS);
+        proto.write(FIELD_TYPE_INT32 | FIELD_ID_SHARED_MATCHER_STATS_SUBSCRIBER_COUNT,
+                    mSharedMatcherSubscriberCount);
+        proto.write(FIELD_TYPE_INT32 | FIELD_ID_SHARED_MATCHER_STATS_DISTINCT_COUNT,
+                    mSharedMatcherDistinctCount);
+        proto.end(token);
+    }
+
     for (const auto& restart : mSystemServerRestartSec) {
         proto.write(FIELD_TYPE_INT32 | FIELD_ID_SYSTEM_SERVER_RESTART | FIELD_COUNT_REPEATED,
                     restart);
@@ -20,8 +20,10 @@
 
 #include <gtest/gtest_prod.h>
 #include <log/log_time.h>
+#include <atomic>
 #include <list>
 #include <mutex>
+#include <shared_mutex>
 #include <string>
 #include <vector>
 #include <unordered_map>
@@ -56,7 +58,8 @@ struct ConfigStats {
     std::list<std::pair<int32_t, int64_t>> dump_report_stats;
 
     // Stores how many times a matcher have been matched. The map size is capped by kMaxConfigCount.
-    std::map<const int64_t, int> matcher_stats;
+    // Counts of matchers already in the map are bumped under a shared lock, hence atomic.
+    std::map<const int64_t, std::atomic<int>> matcher_stats;
 
     // Stores the number of output tuple of condition trackers when it's bigger than
     // kDimensionKeySizeSoftLimit. When you see the number is kDimensionKeySizeHardLimit +1,
@@ -161,6 +164,13 @@ public:
     // Max time to do a pull.
     static const int64_t kPullMaxDelayNs = 10 * NS_PER_SEC;
 
+    // Scheduled pulls due within this window of the earliest one are served by a single pull.
+    static const int64_t kPullCoalescingWindowNs = 1 * NS_PER_SEC;
+
+    // Number of buckets in the per-atom pull time histogram. Bucket i counts pulls that took
+    // less than 4^i milliseconds (and at least 4^(i-1)); the last bucket is unbounded.
+    static const int kPullTimeHistogramBucketCount = 8;
+
     // Maximum number of pushed atoms statsd stats will track above kMaxPushedAtomId.
     static const int kMaxNonPlatformPushedAtoms = 100;
 
@@ -349,6 +359,12 @@ public:
      */
     void notePullExceedMaxDelay(int pullAtomId);
 
+    /*
+     * Records a scheduled pull that had not finished by its deadline when the alarm thread
+     * stopped waiting for it. The result is delivered to receivers when it arrives.
+     */
+    void notePullDeadlineExceeded(int pullAtomId);
+
     /*
      * Records when system server restarts.
      */
@@ -444,6 +460,13 @@ public:
      * the queue */
     void noteEventQueueOverflow(int64_t oldestEventTimestampNs);
 
+    /**
+     * Reports the current state of the matcher pool shared across configs.
+     * [subscriberCount]: number of simple atom matchers across all configs that use the pool
+     * [distinctCount]: number of distinct matchers actually evaluated per event
+     */
+    void noteSharedMatcherPool(size_t subscriberCount, size_t distinctCount);
+
     /**
      * Reports that the activation broadcast guardrail was hit for this uid. Namely, the broadcast
      * should have been sent, but instead was skipped due to hitting the guardrail.
@@ -488,6 +511,8 @@ public:
         long emptyData = 0;
         long registeredCount = 0;
         long unregisteredCount = 0;
+        long pullDeadlineExceeded = 0;
+        long pullTimeHistogram[kPullTimeHistogramBucketCount] = {};
     } PulledAtomStats;
 
     typedef struct {
@@ -507,7 +532,10 @@ public:
 private:
     StatsdStats();
 
-    mutable std::mutex mLock;
+    // Taken exclusively to change the stats' structure or any non atomic counter. The hot
+    // counters (pushed atoms, matcher matches) are atomics bumped under a shared lock, or with
+    // no lock at all, so concurrent loggers don't serialize on each other.
+    mutable std::shared_mutex mLock;
 
     int32_t mStartTimeSec;
 
@@ -526,11 +554,12 @@ private:
     // The size of the vector is the largest pushed atom id in atoms.proto + 1. Atoms
     // out of that range will be put in mNonPlatformPushedAtomStats.
     // This is a vector, not a map because it will be accessed A LOT -- for each stats log.
-    std::vector<int> mPushedAtomStats;
+    // It is never resized, so counts are bumped without taking mLock.
+    std::vector<std::atomic<int>> mPushedAtomStats;
 
     // Stores the number of times a pushed atom is logged for atom ids above kMaxPushedAtomId.
     // The max size of the map is kMaxNonPlatformPushedAtoms.
-    std::unordered_map<int, int> mNonPlatformPushedAtomStats;
+    std::unordered_map<int, std::atomic<int>> mNonPlatformPushedAtomStats;
 
     // Maps PullAtomId to its stats. The size is capped by the puller atom counts.
     std::map<int, PulledAtomStats> mPulledAtomStats;
@@ -572,6 +601,13 @@ private:
     // Total number of events that are lost due to queue overflow.
     int32_t mOverflowCount = 0;
 
+    // Number of simple atom matchers, across all configs, that use the shared matcher pool.
+    int32_t mSharedMatcherSubscriberCount = 0;
+
+    // Number of distinct matchers in the shared matcher pool. The ratio to
+    // mSharedMatcherSubscriberCount is how much matcher work is deduplicated across configs.
+    int32_t mSharedMatcherDistinctCount = 0;
+
     // Timestamps when we detect log loss, and the number of logs lost.
     std::list<LogLossStats> mLogLossStats;
 
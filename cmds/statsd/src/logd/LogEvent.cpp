@@ -460,7 +460,7 @@ void LogEvent::init(android_log_context context) {
                     pos[depth] = 4;
                 }
                 mValues.push_back(FieldValue(Field(mTagId, pos, depth),
-                                             Value(string(elem.data.string, elem.len))));
+                                             Value(InternedString(elem.data.string, elem.len))));
 
                 pos[depth]++;
 
@@ -649,7 +649,7 @@ void LogEvent::ToProto(ProtoOutputStream& protoOutput) const {
 
 void writeExperimentIdsToProto(const std::vector<int64_t>& experimentIds,
                                std::vector<uint8_t>* protoOut) {
-    ProtoOutputStream proto;
+    ProtoOutputStream proto(SMALL_PROTO_CHUNK_SIZE);
     for (const auto& expId : experimentIds) {
         proto.write(FIELD_TYPE_INT64 | FIELD_COUNT_REPEATED | FIELD_ID_EXPERIMENT_ID,
                     (long long)expId);
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <unordered_set>
+
+namespace android {
+namespace os {
+namespace statsd {
+
+/**
+ * The set of atom ids that something in statsd consumes, so that the socket listener can skip
+ * decoding and queueing the events of every other atom.
+ *
+ * Written by the StatsLogProcessor when its configs change, read by the socket thread for every
+ * datagram. Until the first setAtomIds() call, and while anyone holds a request for all atoms
+ * (e.g. a shell subscription), every atom is wanted.
+ */
+class LogEventFilter {
+public:
+    void setAtomIds(std::unordered_set<int> atomIds) {
+        std::atomic_store(&mAtomIds,
+                          std::shared_ptr<const std::unordered_set<int>>(
+                                  std::make_shared<std::unordered_set<int>>(std::move(atomIds))));
+    }
+
+    void requestAllAtoms() {
+        mAllAtomsRequests.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void releaseAllAtoms() {
+        mAllAtomsRequests.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    bool isAtomIdWanted(int atomId) const {
+        if (mAllAtomsRequests.load(std::memory_order_relaxed) > 0) {
+            return true;
+        }
+        std::shared_ptr<const std::unordered_set<int>> atomIds = std::atomic_load(&mAtomIds);
+        return atomIds == nullptr || atomIds->find(atomId) != atomIds->end();
+    }
+
+private:
+    std::shared_ptr<const std::unordered_set<int>> mAtomIds;
+
+    std::atomic<int> mAllAtomsRequests{0};
+};
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
@@ -19,12 +19,152 @@
 
 #include "LogEventQueue.h"
 
+#ifdef STATSD_LOCK_FREE_EVENT_QUEUE
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 namespace android {
 namespace os {
 namespace statsd {
 
 using std::unique_lock;
 using std::unique_ptr;
+using std::vector;
+
+#ifdef STATSD_LOCK_FREE_EVENT_QUEUE
+
+namespace {
+
+void futexWait(std::atomic<int32_t>* addr, int32_t expected) {
+    syscall(SYS_futex, reinterpret_cast<int32_t*>(addr), FUTEX_WAIT_PRIVATE, expected, nullptr,
+            nullptr, 0);
+}
+
+void futexWakeOne(std::atomic<int32_t>* addr) {
+    syscall(SYS_futex, reinterpret_cast<int32_t*>(addr), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr,
+            0);
+}
+
+}  // namespace
+
+LogEventQueue::LogEventQueue(size_t maxSize)
+    : mQueueLimit(maxSize),
+      mSlots(new Slot[maxSize]),
+      mEnqueuePos(0),
+      mDequeuePos(0),
+      mConsumerParked(0) {
+    for (size_t i = 0; i < mQueueLimit; i++) {
+        mSlots[i].sequence.store(i, std::memory_order_relaxed);
+        mSlots[i].elapsedTimestampNs.store(0, std::memory_order_relaxed);
+        mSlots[i].event = nullptr;
+    }
+}
+
+LogEventQueue::~LogEventQueue() {
+    while (LogEvent* event = tryPop()) {
+        delete event;
+    }
+}
+
+LogEvent* LogEventQueue::tryPop() {
+    const size_t pos = mDequeuePos.load(std::memory_order_relaxed);
+    Slot& slot = mSlots[pos % mQueueLimit];
+    const size_t seq = slot.sequence.load(std::memory_order_acquire);
+    if (seq != pos + 1) {
+        // The producer that claimed this position has not published yet, or the ring is empty.
+        return nullptr;
+    }
+    LogEvent* event = slot.event;
+    slot.event = nullptr;
+    mDequeuePos.store(pos + 1, std::memory_order_relaxed);
+    // Hand the slot back to producers for the next lap around the ring.
+    slot.sequence.store(pos + mQueueLimit, std::memory_order_release);
+    return event;
+}
+
+void LogEventQueue::park() {
+    mConsumerParked.store(1, std::memory_order_relaxed);
+    // Pairs with the fence in push(): either the producer sees mConsumerParked == 1 and wakes us,
+    // or we see its published slot below and skip the wait.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const size_t pos = mDequeuePos.load(std::memory_order_relaxed);
+    if (mSlots[pos % mQueueLimit].sequence.load(std::memory_order_acquire) != pos + 1) {
+        futexWait(&mConsumerParked, 1);
+    }
+    mConsumerParked.store(0, std::memory_order_relaxed);
+}
+
+unique_ptr<LogEvent> LogEventQueue::waitPop() {
+    while (true) {
+        LogEvent* event = tryPop();
+        if (event != nullptr) {
+            return unique_ptr<LogEvent>(event);
+        }
+        park();
+    }
+}
+
+size_t LogEventQueue::waitPopBatch(size_t maxCount, vector<unique_ptr<LogEvent>>* events) {
+    size_t count = 0;
+    while (count < maxCount) {
+        LogEvent* event = tryPop();
+        if (event == nullptr) {
+            if (count > 0) {
+                break;
+            }
+            park();
+            continue;
+        }
+        events->emplace_back(event);
+        count++;
+    }
+    return count;
+}
+
+bool LogEventQueue::push(unique_ptr<LogEvent> item, int64_t* oldestTimestampNs) {
+    size_t pos = mEnqueuePos.load(std::memory_order_relaxed);
+    Slot* slot;
+    while (true) {
+        slot = &mSlots[pos % mQueueLimit];
+        const size_t seq = slot->sequence.load(std::memory_order_acquire);
+        const intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (mEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // The slot still holds the event from the previous lap, so the queue is full.
+            const size_t oldestPos = mDequeuePos.load(std::memory_order_relaxed);
+            *oldestTimestampNs = mSlots[oldestPos % mQueueLimit].elapsedTimestampNs.load(
+                    std::memory_order_relaxed);
+            return false;
+        } else {
+            pos = mEnqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->elapsedTimestampNs.store(item->GetElapsedTimestampNs(), std::memory_order_relaxed);
+    slot->event = item.release();
+    slot->sequence.store(pos + 1, std::memory_order_release);
+
+    // Only pay for the syscall when the consumer is actually waiting.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (mConsumerParked.load(std::memory_order_relaxed) != 0 &&
+        mConsumerParked.exchange(0, std::memory_order_relaxed) != 0) {
+        futexWakeOne(&mConsumerParked);
+    }
+    return true;
+}
+
+#else
+
+LogEventQueue::LogEventQueue(size_t maxSize) : mQueueLimit(maxSize) {
+}
+
+LogEventQueue::~LogEventQueue() {
+}
 
 unique_ptr<LogEvent> LogEventQueue::waitPop() {
     std::unique_lock<std::mutex> lock(mMutex);
@@ -39,6 +179,23 @@ unique_ptr<LogEvent> LogEventQueue::waitPop() {
     return item;
 }
 
+size_t LogEventQueue::waitPopBatch(size_t maxCount, vector<unique_ptr<LogEvent>>* events) {
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    if (mQueue.empty()) {
+        mCondition.wait(lock, [this] { return !this->mQueue.empty(); });
+    }
+
+    size_t count = 0;
+    while (count < maxCount && !mQueue.empty()) {
+        events->push_back(std::move(mQueue.front()));
+        mQueue.pop();
+        count++;
+    }
+
+    return count;
+}
+
 bool LogEventQueue::push(unique_ptr<LogEvent> item, int64_t* oldestTimestampNs) {
     bool success;
     {
@@ -57,6 +214,8 @@ bool LogEventQueue::push(unique_ptr<LogEvent> item, int64_t* oldestTimestampNs)
     return success;
 }
 
+#endif  // STATSD_LOCK_FREE_EVENT_QUEUE
+
 }  // namespace statsd
 }  // namespace os
 }  // namespace android
@@ -18,11 +18,13 @@
 
 #include "LogEvent.h"
 
+#include <atomic>
 #include <condition_variable>
 #include <memory>
 #include <mutex>
 #include <queue>
 #include <thread>
+#include <vector>
 
 namespace android {
 namespace os {
@@ -30,16 +32,32 @@ namespace statsd {
 
 /**
  * A zero copy thread safe queue buffer for producing and consuming LogEvent.
+ *
+ * By default the queue is a std::queue guarded by a mutex. When statsd is built with
+ * STATSD_LOCK_FREE_EVENT_QUEUE defined, the queue is instead a bounded lock-free ring that
+ * supports many producers and a single consumer. Producers never block in that mode, and they
+ * only issue a futex wake when the consumer is parked waiting for events.
  */
 class LogEventQueue {
 public:
-    explicit LogEventQueue(size_t maxSize) : mQueueLimit(maxSize){};
+    explicit LogEventQueue(size_t maxSize);
+
+    ~LogEventQueue();
 
     /**
      * Blocking read one event from the queue.
      */
     std::unique_ptr<LogEvent> waitPop();
 
+    /**
+     * Blocking read of up to maxCount events from the queue. Blocks until at least one event is
+     * available, then appends all events that are ready (up to maxCount) to events, in order.
+     * Returns the number of events appended.
+     *
+     * Must only be called from the single consumer thread.
+     */
+    size_t waitPopBatch(size_t maxCount, std::vector<std::unique_ptr<LogEvent>>* events);
+
     /**
      * Puts a LogEvent ptr to the end of the queue.
      * Returns false on failure when the queue is full, and output the oldest event timestamp
@@ -49,9 +67,37 @@ public:
 
 private:
     const size_t mQueueLimit;
+
+#ifdef STATSD_LOCK_FREE_EVENT_QUEUE
+    struct Slot {
+        // Position in the ring that this slot is ready for. Equal to the enqueue position when
+        // the slot is free, and to the enqueue position + 1 once an event has been published.
+        std::atomic<size_t> sequence;
+        // Copy of the event timestamp, so that a producer that finds the ring full can report
+        // the oldest timestamp without dereferencing an event the consumer may be freeing.
+        std::atomic<int64_t> elapsedTimestampNs;
+        LogEvent* event;
+    };
+
+    // Pops one event if available. Consumer thread only.
+    LogEvent* tryPop();
+
+    // Parks the consumer until a producer publishes an event. Consumer thread only.
+    void park();
+
+    std::unique_ptr<Slot[]> mSlots;
+
+    // Producers and the consumer spin on different cache lines.
+    alignas(64) std::atomic<size_t> mEnqueuePos;
+    alignas(64) std::atomic<size_t> mDequeuePos;
+
+    // 1 while the consumer is parked (or about to park) on the futex, 0 otherwise.
+    alignas(64) std::atomic<int32_t> mConsumerParked;
+#else
     std::condition_variable mCondition;
     std::mutex mMutex;
     std::queue<std::unique_ptr<LogEvent>> mQueue;
+#endif
 };
 
 }  // namespace statsd
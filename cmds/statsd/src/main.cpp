@@ -98,7 +98,12 @@ int main(int /*argc*/, char** /*argv*/) {
 
     gStatsService->Startup();
 
+#ifdef STATSD_BATCHED_SOCKET_READ
+    sp<StatsSocketListener> socketListener =
+            new StatsSocketListener(eventQueue, gStatsService->getLogEventFilter());
+#else
     sp<StatsSocketListener> socketListener = new StatsSocketListener(eventQueue);
+#endif
 
     ALOGI("Statsd starts to listen to socket.");
     // Backlog and /proc/sys/net/unix/max_dgram_qlen set to large value
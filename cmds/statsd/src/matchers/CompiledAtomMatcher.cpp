@@ -0,0 +1,335 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define DEBUG false  // STOPSHIP if true
+#include "Log.h"
+
+#include "CompiledAtomMatcher.h"
+
+#include <algorithm>
+#include <set>
+
+namespace android {
+namespace os {
+namespace statsd {
+
+using std::string;
+using std::vector;
+
+CompiledAtomMatcher::CompiledAtomMatcher(const SimpleAtomMatcher& matcher)
+    : mAtomId(matcher.atom_id()) {
+    for (const auto& fieldValueMatcher : matcher.field_value_matcher()) {
+        compile(fieldValueMatcher);
+    }
+}
+
+int CompiledAtomMatcher::addStringSet(const vector<string>& strings) {
+    StringSet set;
+    for (const auto& str : strings) {
+        set.strings.push_back(str);
+        auto aidIt = UidMap::sAidToUidMapping.find(str);
+        if (aidIt != UidMap::sAidToUidMapping.end()) {
+            set.aids.push_back((int32_t)aidIt->second);
+        } else {
+            set.packageNames.push_back(str);
+        }
+    }
+    std::sort(set.strings.begin(), set.strings.end());
+    mStringSets.push_back(std::move(set));
+    return mStringSets.size() - 1;
+}
+
+int CompiledAtomMatcher::compile(const FieldValueMatcher& matcher) {
+    const int index = mNodes.size();
+    Node node = {};
+    node.field = matcher.field();
+    node.stringSet = -1;
+    if (matcher.has_position()) {
+        switch (matcher.position()) {
+            case Position::FIRST:
+                node.position = kFirst;
+                break;
+            case Position::LAST:
+                node.position = kLast;
+                break;
+            case Position::ANY:
+                node.position = kAny;
+                break;
+            case Position::ALL:
+                ALOGE("Not supported: field matcher with ALL position.");
+                node.position = kNoRange;
+                break;
+            default:
+                node.position = kNoRange;
+                break;
+        }
+    } else {
+        node.position = kNoPosition;
+    }
+
+    switch (matcher.value_matcher_case()) {
+        case FieldValueMatcher::kMatchesTuple:
+            node.op = kTuple;
+            break;
+        case FieldValueMatcher::kEqBool:
+            node.op = kEqBool;
+            node.boolValue = matcher.eq_bool();
+            break;
+        case FieldValueMatcher::kEqString:
+            node.op = kEqAnyString;
+            node.stringSet = addStringSet({matcher.eq_string()});
+            break;
+        case FieldValueMatcher::kEqAnyString: {
+            const auto& strings = matcher.eq_any_string().str_value();
+            node.op = kEqAnyString;
+            node.stringSet = addStringSet(vector<string>(strings.begin(), strings.end()));
+            break;
+        }
+        case FieldValueMatcher::kNeqAnyString: {
+            const auto& strings = matcher.neq_any_string().str_value();
+            node.op = kNeqAnyString;
+            node.stringSet = addStringSet(vector<string>(strings.begin(), strings.end()));
+            break;
+        }
+        case FieldValueMatcher::kEqInt:
+            node.op = kEqInt;
+            node.intValue = matcher.eq_int();
+            break;
+        case FieldValueMatcher::kLtInt:
+            node.op = kLtInt;
+            node.intValue = matcher.lt_int();
+            break;
+        case FieldValueMatcher::kGtInt:
+            node.op = kGtInt;
+            node.intValue = matcher.gt_int();
+            break;
+        case FieldValueMatcher::kLteInt:
+            node.op = kLteInt;
+            node.intValue = matcher.lte_int();
+            break;
+        case FieldValueMatcher::kGteInt:
+            node.op = kGteInt;
+            node.intValue = matcher.gte_int();
+            break;
+        case FieldValueMatcher::kLtFloat:
+            node.op = kLtFloat;
+            node.floatValue = matcher.lt_float();
+            break;
+        case FieldValueMatcher::kGtFloat:
+            node.op = kGtFloat;
+            node.floatValue = matcher.gt_float();
+            break;
+        default:
+            node.op = kNoValue;
+            break;
+    }
+    mNodes.push_back(node);
+
+    if (node.op == kTuple) {
+        for (const auto& subMatcher : matcher.matches_tuple().field_value_matcher()) {
+            compile(subMatcher);
+        }
+    }
+    mNodes[index].subtreeSize = mNodes.size() - index;
+    return index;
+}
+
+bool CompiledAtomMatcher::matches(const UidMap& uidMap, const LogEvent& event) const {
+    if (mNodes.empty()) {
+        return event.GetTagId() == mAtomId;
+    }
+    const vector<FieldValue>& values = event.getValues();
+    for (int i = 0; i < (int)mNodes.size(); i += mNodes[i].subtreeSize) {
+        if (!matchesNode(uidMap, i, values, 0, values.size(), 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CompiledAtomMatcher::matchesChildren(const UidMap& uidMap, int index,
+                                          const vector<FieldValue>& values, int start, int end,
+                                          int depth) const {
+    const int last = index + mNodes[index].subtreeSize;
+    for (int child = index + 1; child < last; child += mNodes[child].subtreeSize) {
+        if (!matchesNode(uidMap, child, values, start, end, depth)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Same walk as matchesSimple() in matcher_util.cpp, see the comments there.
+bool CompiledAtomMatcher::matchesNode(const UidMap& uidMap, int index,
+                                      const vector<FieldValue>& values, int start, int end,
+                                      int depth) const {
+    if (depth > 2) {
+        ALOGE("Depth > 3 not supported");
+        return false;
+    }
+    if (start >= end) {
+        return false;
+    }
+    const Node& node = mNodes[index];
+
+    int newStart = -1;
+    int newEnd = end;
+    for (int i = start; i < end; i++) {
+        int pos = values[i].mField.getPosAtDepth(depth);
+        if (pos == node.field) {
+            if (newStart == -1) {
+                newStart = i;
+            }
+            newEnd = i + 1;
+        } else if (pos > node.field) {
+            break;
+        }
+    }
+    if (newStart == -1) {
+        return false;
+    }
+    start = newStart;
+    end = newEnd;
+
+    if (node.position != kNoPosition) {
+        depth++;
+        if (depth > 2) {
+            return false;
+        }
+        switch (node.position) {
+            case kFirst:
+                for (int i = start; i < end; i++) {
+                    if (values[i].mField.getPosAtDepth(depth) != 1) {
+                        end = i;
+                        break;
+                    }
+                }
+                break;
+            case kLast:
+                for (int i = start; i < end; i++) {
+                    if (values[i].mField.isLastPos(depth)) {
+                        start = i;
+                        break;
+                    }
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (node.op == kTuple) {
+        if (node.position == kNoRange) {
+            return false;
+        }
+        if (node.position != kAny) {
+            return matchesChildren(uidMap, index, values, start, end, depth + 1);
+        }
+        // Try each sub tree of the repeated field in turn.
+        int rangeStart = start;
+        int currentPos = values[start].mField.getPosAtDepth(depth);
+        for (int i = start; i < end; i++) {
+            int newPos = values[i].mField.getPosAtDepth(depth);
+            if (newPos != currentPos) {
+                if (matchesChildren(uidMap, index, values, rangeStart, i, depth + 1)) {
+                    return true;
+                }
+                rangeStart = i;
+                currentPos = newPos;
+            }
+        }
+        return matchesChildren(uidMap, index, values, rangeStart, end, depth + 1);
+    }
+
+    for (int i = start; i < end; i++) {
+        if (matchesValue(uidMap, node, values[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CompiledAtomMatcher::matchesValue(const UidMap& uidMap, const Node& node,
+                                       const FieldValue& fieldValue) const {
+    const Value& value = fieldValue.mValue;
+    switch (node.op) {
+        case kEqAnyString:
+            return matchesAnyString(uidMap, mStringSets[node.stringSet], fieldValue);
+        case kNeqAnyString:
+            return !matchesAnyString(uidMap, mStringSets[node.stringSet], fieldValue);
+        case kLtFloat:
+            return value.getType() == FLOAT && value.float_value < node.floatValue;
+        case kGtFloat:
+            return value.getType() == FLOAT && value.float_value > node.floatValue;
+        default:
+            break;
+    }
+
+    // eq_bool, eq_int and the other integer comparisons cover both int and long.
+    int64_t intValue;
+    if (value.getType() == INT) {
+        intValue = value.int_value;
+    } else if (value.getType() == LONG) {
+        intValue = value.long_value;
+    } else {
+        return false;
+    }
+    switch (node.op) {
+        case kEqBool:
+            return (intValue != 0) == node.boolValue;
+        case kEqInt:
+            return intValue == node.intValue;
+        case kLtInt:
+            return intValue < node.intValue;
+        case kGtInt:
+            return intValue > node.intValue;
+        case kLteInt:
+            return intValue <= node.intValue;
+        case kGteInt:
+            return intValue >= node.intValue;
+        default:
+            return false;
+    }
+}
+
+bool CompiledAtomMatcher::matchesAnyString(const UidMap& uidMap, const StringSet& set,
+                                           const FieldValue& fieldValue) const {
+    if (isAttributionUidField(fieldValue.mField, fieldValue.mValue)) {
+        const int32_t uid = fieldValue.mValue.int_value;
+        if (std::find(set.aids.begin(), set.aids.end(), uid) != set.aids.end()) {
+            return true;
+        }
+        if (set.packageNames.empty()) {
+            return false;
+        }
+        std::set<string> packageNames = uidMap.getAppNamesFromUid(uid, true /* normalize*/);
+        for (const auto& packageName : set.packageNames) {
+            if (packageNames.find(packageName) != packageNames.end()) {
+                return true;
+            }
+        }
+        return false;
+    }
+    if (fieldValue.mValue.getType() == STRING) {
+        return std::binary_search(set.strings.begin(), set.strings.end(),
+                                  fieldValue.mValue.str_value);
+    }
+    return false;
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "frameworks/base/cmds/statsd/src/statsd_config.pb.h"
+#include "logd/LogEvent.h"
+#include "packages/UidMap.h"
+
+namespace android {
+namespace os {
+namespace statsd {
+
+/**
+ * A SimpleAtomMatcher compiled once at config load, with the same results as matchesSimple().
+ *
+ * The FieldValueMatcher tree is flattened in pre-order into one vector of nodes, so matching
+ * reads plain structs instead of proto accessors. String constants are sorted for binary search,
+ * and the ones naming an AID are resolved up front, so an attribution uid is looked up in the
+ * UidMap once per value rather than once per string.
+ */
+class CompiledAtomMatcher {
+public:
+    CompiledAtomMatcher() = default;
+
+    explicit CompiledAtomMatcher(const SimpleAtomMatcher& matcher);
+
+    bool matches(const UidMap& uidMap, const LogEvent& event) const;
+
+private:
+    enum Op : uint8_t {
+        kNoValue,
+        kTuple,
+        kEqBool,
+        kEqAnyString,  // eq_string and eq_any_string
+        kNeqAnyString,
+        kEqInt,
+        kLtInt,
+        kGtInt,
+        kLteInt,
+        kGteInt,
+        kLtFloat,
+        kGtFloat,
+    };
+
+    enum PositionMode : uint8_t {
+        kNoPosition,
+        kFirst,
+        kLast,
+        kAny,
+        // ALL and POSITION_UNKNOWN: moves one level down but selects no sub tree.
+        kNoRange,
+    };
+
+    struct Node {
+        int32_t field;
+        PositionMode position;
+        Op op;
+        // Nodes in the subtree rooted here, this one included. The next sibling is at
+        // index + subtreeSize.
+        int32_t subtreeSize;
+        int64_t intValue;
+        float floatValue;
+        bool boolValue;
+        // Index in mStringSets for the string ops.
+        int32_t stringSet;
+    };
+
+    struct StringSet {
+        // Sorted, matched against STRING values.
+        std::vector<std::string> strings;
+        // Strings naming an AID, resolved to the uid.
+        std::vector<int32_t> aids;
+        // The other strings, matched against package names of attribution uids.
+        std::vector<std::string> packageNames;
+    };
+
+    // Appends matcher and its subtree to mNodes, returns its index.
+    int compile(const FieldValueMatcher& matcher);
+
+    int addStringSet(const std::vector<std::string>& strings);
+
+    bool matchesNode(const UidMap& uidMap, int index, const std::vector<FieldValue>& values,
+                     int start, int end, int depth) const;
+
+    bool matchesChildren(const UidMap& uidMap, int index, const std::vector<FieldValue>& values,
+                         int start, int end, int depth) const;
+
+    bool matchesValue(const UidMap& uidMap, const Node& node, const FieldValue& value) const;
+
+    bool matchesAnyString(const UidMap& uidMap, const StringSet& set,
+                          const FieldValue& value) const;
+
+    int32_t mAtomId = 0;
+
+    std::vector<Node> mNodes;
+
+    std::vector<StringSet> mStringSets;
+};
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
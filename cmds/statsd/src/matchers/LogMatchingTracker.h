@@ -19,6 +19,7 @@
 
 #include "frameworks/base/cmds/statsd/src/statsd_config.pb.h"
 #include "logd/LogEvent.h"
+#include "matchers/SharedMatcherPool.h"
 #include "matchers/matcher_util.h"
 
 #include <utils/RefBase.h>
@@ -62,6 +63,11 @@ public:
                             const std::vector<sp<LogMatchingTracker>>& allTrackers,
                             std::vector<MatchingState>& matcherResults) = 0;
 
+    // Subscribes this matcher to a pool shared with the other configs, so that identical matchers
+    // are evaluated once per event. Only SimpleLogMatchingTrackers can be shared.
+    virtual void setSharedMatcherPool(const sp<SharedMatcherPool>& pool) {
+    }
+
     // Get the tagIds that this matcher cares about. The combined collection is stored
     // in MetricMananger, so that we can pass any LogEvents that are not interest of us. It uses
     // some memory but hopefully it can save us much CPU time when there is flood of events.
@@ -69,6 +75,13 @@ public:
         return mAtomIds;
     }
 
+    // Get the indices of the child matchers that onLogEvent() may evaluate for an event. Only
+    // CombinationLogMatchingTrackers have children.
+    virtual const std::vector<int>& getChildren() const {
+        static const std::vector<int> kNoChildren;
+        return kNoChildren;
+    }
+
     const int64_t& getId() const {
         return mId;
     }
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define DEBUG false  // STOPSHIP if true
+#include "Log.h"
+
+#include "SharedMatcherPool.h"
+
+#include "guardrail/StatsdStats.h"
+#include "hash.h"
+
+namespace android {
+namespace os {
+namespace statsd {
+
+using std::lock_guard;
+using std::string;
+
+SharedMatcherPool::SharedMatcherPool(const sp<UidMap>& uidMap)
+    : mUidMap(uidMap), mCurrentEvent(nullptr) {
+}
+
+int SharedMatcherPool::acquire(const SimpleAtomMatcher& matcher) {
+    const string key = matcher.SerializeAsString();
+    const uint64_t hash = Hash64(key);
+
+    lock_guard<std::mutex> lock(mMutex);
+    auto it = mSlotByHash.find(hash);
+    if (it != mSlotByHash.end()) {
+        Slot& slot = mSlots[it->second];
+        if (slot.key != key) {
+            // Hash collision. Leave this matcher unshared.
+            VLOG("SharedMatcherPool hash collision on atom %d", matcher.atom_id());
+            return -1;
+        }
+        slot.refCount++;
+        mSubscriberCount++;
+        noteStatsLocked();
+        return it->second;
+    }
+
+    int index;
+    if (!mFreeSlots.empty()) {
+        index = mFreeSlots.back();
+        mFreeSlots.pop_back();
+    } else {
+        index = mSlots.size();
+        mSlots.emplace_back();
+    }
+    Slot& slot = mSlots[index];
+    slot.key = key;
+    slot.matcher = matcher;
+    slot.compiled = CompiledAtomMatcher(matcher);
+    slot.refCount = 1;
+    slot.generation = 0;
+    slot.result = MatchingState::kNotComputed;
+    mSlotByHash[hash] = index;
+    mSubscriberCount++;
+    mDistinctCount++;
+    noteStatsLocked();
+    return index;
+}
+
+void SharedMatcherPool::release(int slotIndex) {
+    lock_guard<std::mutex> lock(mMutex);
+    if (slotIndex < 0 || slotIndex >= (int)mSlots.size() || mSlots[slotIndex].refCount == 0) {
+        return;
+    }
+    Slot& slot = mSlots[slotIndex];
+    slot.refCount--;
+    mSubscriberCount--;
+    if (slot.refCount == 0) {
+        mSlotByHash.erase(Hash64(slot.key));
+        slot.key.clear();
+        slot.matcher.Clear();
+        slot.compiled = CompiledAtomMatcher();
+        mFreeSlots.push_back(slotIndex);
+        mDistinctCount--;
+    }
+    noteStatsLocked();
+}
+
+void SharedMatcherPool::startEvent(const LogEvent* event) {
+    lock_guard<std::mutex> lock(mMutex);
+    mGeneration++;
+    mCurrentEvent.store(event, std::memory_order_relaxed);
+}
+
+void SharedMatcherPool::finishEvent() {
+    mCurrentEvent.store(nullptr, std::memory_order_relaxed);
+}
+
+MatchingState SharedMatcherPool::getResult(int slotIndex, const LogEvent& event) {
+    lock_guard<std::mutex> lock(mMutex);
+    Slot& slot = mSlots[slotIndex];
+    if (slot.generation != mGeneration) {
+        slot.result = slot.compiled.matches(*mUidMap, event) ? MatchingState::kMatched
+                                                             : MatchingState::kNotMatched;
+        slot.generation = mGeneration;
+    }
+    return slot.result;
+}
+
+size_t SharedMatcherPool::getSubscriberCount() const {
+    lock_guard<std::mutex> lock(mMutex);
+    return mSubscriberCount;
+}
+
+size_t SharedMatcherPool::getDistinctMatcherCount() const {
+    lock_guard<std::mutex> lock(mMutex);
+    return mDistinctCount;
+}
+
+void SharedMatcherPool::noteStatsLocked() {
+    StatsdStats::getInstance().noteSharedMatcherPool(mSubscriberCount, mDistinctCount);
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "frameworks/base/cmds/statsd/src/statsd_config.pb.h"
+#include "logd/LogEvent.h"
+#include "matchers/CompiledAtomMatcher.h"
+#include "matchers/matcher_util.h"
+#include "packages/UidMap.h"
+
+#include <utils/RefBase.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace android {
+namespace os {
+namespace statsd {
+
+/**
+ * Deduplicates SimpleAtomMatchers across all the configs of a StatsLogProcessor.
+ *
+ * Identical SimpleAtomMatchers (same serialized proto) map to the same slot. For the event that
+ * is currently being processed by the StatsLogProcessor, each slot is evaluated at most once and
+ * the result is shared with every SimpleLogMatchingTracker that subscribed to it.
+ */
+class SharedMatcherPool : public virtual RefBase {
+public:
+    explicit SharedMatcherPool(const sp<UidMap>& uidMap);
+
+    // Subscribes to the slot for this matcher, creating it if needed. Returns the slot id, or -1
+    // if the matcher cannot be shared.
+    int acquire(const SimpleAtomMatcher& matcher);
+
+    // Drops one subscription to the slot.
+    void release(int slot);
+
+    // Marks event as the event being processed. Results cached for the previous event are
+    // invalidated.
+    void startEvent(const LogEvent* event);
+
+    // Clears the current event. Must be called before the event is destroyed.
+    void finishEvent();
+
+    // Returns whether event is the event being processed, i.e. whether getResult() can be
+    // called for it.
+    bool isCurrentEvent(const LogEvent& event) const {
+        return mCurrentEvent.load(std::memory_order_relaxed) == &event;
+    }
+
+    // Returns the result of the matcher in the slot for the current event, evaluating it on the
+    // first call.
+    MatchingState getResult(int slot, const LogEvent& event);
+
+    // Number of subscriptions across all slots.
+    size_t getSubscriberCount() const;
+
+    // Number of distinct matchers with at least one subscription.
+    size_t getDistinctMatcherCount() const;
+
+private:
+    struct Slot {
+        std::string key;
+        SimpleAtomMatcher matcher;
+        CompiledAtomMatcher compiled;
+        int refCount = 0;
+        // Generation of the event that result was computed for.
+        uint64_t generation = 0;
+        MatchingState result = MatchingState::kNotComputed;
+    };
+
+    void noteStatsLocked();
+
+    const sp<UidMap> mUidMap;
+
+    mutable std::mutex mMutex;
+
+    std::vector<Slot> mSlots;
+
+    // Released slots that can be reused.
+    std::vector<int> mFreeSlots;
+
+    // Maps from the hash of the serialized matcher to its slot.
+    std::unordered_map<uint64_t, int> mSlotByHash;
+
+    size_t mSubscriberCount = 0;
+
+    size_t mDistinctCount = 0;
+
+    // Incremented for every event. 0 is never a valid generation.
+    uint64_t mGeneration = 0;
+
+    std::atomic<const LogEvent*> mCurrentEvent;
+};
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
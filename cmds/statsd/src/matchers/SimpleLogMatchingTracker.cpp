@@ -32,7 +32,11 @@ using std::vector;
 SimpleLogMatchingTracker::SimpleLogMatchingTracker(const int64_t& id, const int index,
                                                    const SimpleAtomMatcher& matcher,
                                                    const UidMap& uidMap)
-    : LogMatchingTracker(id, index), mMatcher(matcher), mUidMap(uidMap) {
+    : LogMatchingTracker(id, index),
+      mMatcher(matcher),
+      mCompiledMatcher(matcher),
+      mUidMap(uidMap),
+      mSharedMatcherSlot(-1) {
     if (!matcher.has_atom_id()) {
         mInitialized = false;
     } else {
@@ -42,6 +46,17 @@ SimpleLogMatchingTracker::SimpleLogMatchingTracker(const int64_t& id, const int
 }
 
 SimpleLogMatchingTracker::~SimpleLogMatchingTracker() {
+    if (mSharedMatcherPool != nullptr && mSharedMatcherSlot >= 0) {
+        mSharedMatcherPool->release(mSharedMatcherSlot);
+    }
+}
+
+void SimpleLogMatchingTracker::setSharedMatcherPool(const sp<SharedMatcherPool>& pool) {
+    if (mSharedMatcherPool != nullptr && mSharedMatcherSlot >= 0) {
+        mSharedMatcherPool->release(mSharedMatcherSlot);
+    }
+    mSharedMatcherPool = pool;
+    mSharedMatcherSlot = (pool != nullptr && mInitialized) ? pool->acquire(mMatcher) : -1;
 }
 
 bool SimpleLogMatchingTracker::init(const vector<AtomMatcher>& allLogMatchers,
@@ -65,7 +80,15 @@ void SimpleLogMatchingTracker::onLogEvent(const LogEvent& event,
         return;
     }
 
-    bool matched = matchesSimple(mUidMap, mMatcher, event);
+    // Pulled events and events fed directly in tests are not in the pool's current event.
+    if (mSharedMatcherSlot >= 0 && mSharedMatcherPool->isCurrentEvent(event)) {
+        matcherResults[mIndex] = mSharedMatcherPool->getResult(mSharedMatcherSlot, event);
+        VLOG("Stats SimpleLogMatcher %lld matched? %d (shared)", (long long)mId,
+             matcherResults[mIndex] == MatchingState::kMatched);
+        return;
+    }
+
+    bool matched = mCompiledMatcher.matches(mUidMap, event);
     matcherResults[mIndex] = matched ? MatchingState::kMatched : MatchingState::kNotMatched;
     VLOG("Stats SimpleLogMatcher %lld matched? %d", (long long)mId, matched);
 }
@@ -22,6 +22,7 @@
 #include <set>
 #include <unordered_map>
 #include <vector>
+#include "CompiledAtomMatcher.h"
 #include "LogMatchingTracker.h"
 #include "frameworks/base/cmds/statsd/src/statsd_config.pb.h"
 #include "packages/UidMap.h"
@@ -47,9 +48,16 @@ public:
                     const std::vector<sp<LogMatchingTracker>>& allTrackers,
                     std::vector<MatchingState>& matcherResults) override;
 
+    void setSharedMatcherPool(const sp<SharedMatcherPool>& pool) override;
+
 private:
     const SimpleAtomMatcher mMatcher;
+    const CompiledAtomMatcher mCompiledMatcher;
     const UidMap& mUidMap;
+
+    // Pool that evaluates this matcher once for all configs, and the slot of mMatcher in it.
+    sp<SharedMatcherPool> mSharedMatcherPool;
+    int mSharedMatcherSlot;
 };
 
 }  // namespace statsd
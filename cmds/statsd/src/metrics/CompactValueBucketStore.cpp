@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define DEBUG false  // STOPSHIP if true
+#include "Log.h"
+
+#include "CompactValueBucketStore.h"
+
+#include <string.h>
+
+namespace android {
+namespace os {
+namespace statsd {
+
+namespace {
+
+void putVarint(uint64_t value, std::string* out) {
+    while (value >= 0x80) {
+        out->push_back((char)((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out->push_back((char)value);
+}
+
+void putZigzag(int64_t value, std::string* out) {
+    putVarint(((uint64_t)value << 1) ^ (uint64_t)(value >> 63), out);
+}
+
+uint64_t getVarint(const std::string& in, size_t* pos) {
+    uint64_t value = 0;
+    int shift = 0;
+    while (*pos < in.size()) {
+        uint8_t byte = (uint8_t)in[(*pos)++];
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            break;
+        }
+        shift += 7;
+    }
+    return value;
+}
+
+int64_t getZigzag(const std::string& in, size_t* pos) {
+    uint64_t value = getVarint(in, pos);
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+}  // namespace
+
+void CompactValueBucketStore::append(const MetricDimensionKey& key, const ValueBucket& bucket) {
+    Columns& columns = mColumns[key];
+
+    putZigzag(bucket.mBucketStartNs - columns.lastEndNs, &columns.times);
+    putVarint(bucket.mBucketEndNs - bucket.mBucketStartNs, &columns.times);
+    columns.lastEndNs = bucket.mBucketEndNs;
+
+    putVarint(bucket.mConditionTrueNs, &columns.condition);
+
+    putVarint(bucket.valueIndex.size(), &columns.values);
+    for (size_t i = 0; i < bucket.valueIndex.size(); i++) {
+        const Value& value = bucket.values[i];
+        if (value.getType() == DOUBLE) {
+            putVarint(((uint64_t)bucket.valueIndex[i] << 1) | 1, &columns.values);
+            columns.values.append(reinterpret_cast<const char*>(&value.double_value),
+                                  sizeof(value.double_value));
+        } else {
+            putVarint((uint64_t)bucket.valueIndex[i] << 1, &columns.values);
+            putZigzag(value.long_value, &columns.values);
+        }
+    }
+    mBucketCount++;
+}
+
+void CompactValueBucketStore::forEach(
+        const std::function<void(const MetricDimensionKey& key,
+                                 const std::vector<ValueBucket>& buckets)>& visitor) const {
+    std::vector<ValueBucket> buckets;
+    for (const auto& pair : mColumns) {
+        const Columns& columns = pair.second;
+        buckets.clear();
+        size_t timePos = 0;
+        size_t conditionPos = 0;
+        size_t valuePos = 0;
+        int64_t lastEndNs = 0;
+        while (timePos < columns.times.size()) {
+            ValueBucket bucket;
+            bucket.mBucketStartNs = lastEndNs + getZigzag(columns.times, &timePos);
+            bucket.mBucketEndNs = bucket.mBucketStartNs + getVarint(columns.times, &timePos);
+            lastEndNs = bucket.mBucketEndNs;
+            bucket.mConditionTrueNs = getVarint(columns.condition, &conditionPos);
+
+            size_t valueCount = getVarint(columns.values, &valuePos);
+            bucket.valueIndex.reserve(valueCount);
+            bucket.values.reserve(valueCount);
+            for (size_t i = 0; i < valueCount; i++) {
+                uint64_t tag = getVarint(columns.values, &valuePos);
+                bucket.valueIndex.push_back((int)(tag >> 1));
+                if (tag & 1) {
+                    double doubleValue = 0;
+                    if (valuePos + sizeof(doubleValue) <= columns.values.size()) {
+                        memcpy(&doubleValue, columns.values.data() + valuePos,
+                               sizeof(doubleValue));
+                    }
+                    valuePos += sizeof(doubleValue);
+                    bucket.values.push_back(Value(doubleValue));
+                } else {
+                    bucket.values.push_back(Value(getZigzag(columns.values, &valuePos)));
+                }
+            }
+            buckets.push_back(std::move(bucket));
+        }
+        visitor(pair.first, buckets);
+    }
+}
+
+void CompactValueBucketStore::clear() {
+    mColumns.clear();
+    mBucketCount = 0;
+}
+
+size_t CompactValueBucketStore::byteSize() const {
+    size_t totalSize = 0;
+    for (const auto& pair : mColumns) {
+        totalSize += sizeof(Columns) + pair.second.times.capacity() +
+                     pair.second.condition.capacity() + pair.second.values.capacity();
+    }
+    return totalSize;
+}
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
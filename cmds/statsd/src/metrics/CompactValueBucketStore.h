@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "FieldValue.h"
+#include "HashableDimensionKey.h"
+
+namespace android {
+namespace os {
+namespace statsd {
+
+struct ValueBucket {
+    int64_t mBucketStartNs;
+    int64_t mBucketEndNs;
+    std::vector<int> valueIndex;
+    std::vector<Value> values;
+    // If the metric has no condition, then this field is just wasted.
+    // When we tune statsd memory usage in the future, this is a candidate to optimize.
+    int64_t mConditionTrueNs;
+};
+
+// Stores the past buckets of a ValueMetricProducer in a packed form.
+//
+// Each dimension keeps three byte columns that are only ever appended to:
+//   - times: zigzag varint of (start - previous end) followed by varint of (end - start),
+//   - condition: varint of the condition true duration,
+//   - values: varint value count, then per value a varint of (index << 1 | isDouble) followed
+//     by a zigzag varint (LONG) or the 8 raw bytes (DOUBLE).
+// Buckets of a pulled metric are usually back to back and of the bucket size with small diffs,
+// so most of them fit in a handful of bytes instead of a full ValueBucket.
+class CompactValueBucketStore {
+public:
+    void append(const MetricDimensionKey& key, const ValueBucket& bucket);
+
+    // Calls [visitor] once per dimension with its buckets decoded in order. Only one
+    // dimension is materialized at a time.
+    void forEach(const std::function<void(const MetricDimensionKey& key,
+                                          const std::vector<ValueBucket>& buckets)>& visitor) const;
+
+    void clear();
+
+    bool empty() const {
+        return mColumns.empty();
+    }
+
+    size_t getBucketCount() const {
+        return mBucketCount;
+    }
+
+    // Bytes held by the encoded columns, including their per-dimension bookkeeping.
+    size_t byteSize() const;
+
+    double getBytesPerBucket() const {
+        return mBucketCount == 0 ? 0 : (double)byteSize() / mBucketCount;
+    }
+
+private:
+    struct Columns {
+        std::string times;
+        std::string condition;
+        std::string values;
+        int64_t lastEndNs = 0;
+    };
+
+    std::unordered_map<MetricDimensionKey, Columns> mColumns;
+
+    size_t mBucketCount = 0;
+};
+
+}  // namespace statsd
+}  // namespace os
+}  // namespace android
@@ -65,6 +65,17 @@ const int FIELD_ID_BUCKET_NUM = 4;
 const int FIELD_ID_START_BUCKET_ELAPSED_MILLIS = 5;
 const int FIELD_ID_END_BUCKET_ELAPSED_MILLIS = 6;
 
+// for MetricBucketSnapshot
+const int FIELD_ID_SNAPSHOT_COUNT_DATA = 2;
+// for SnapshotCountData
+const int FIELD_ID_SNAPSHOT_DIMENSION_IN_WHAT = 1;
+const int FIELD_ID_SNAPSHOT_DIMENSION_IN_CONDITION = 2;
+const int FIELD_ID_SNAPSHOT_BUCKET = 3;
+// for SnapshotCountBucket
+const int FIELD_ID_SNAPSHOT_BUCKET_START = 1;
+const int FIELD_ID_SNAPSHOT_BUCKET_END = 2;
+const int FIELD_ID_SNAPSHOT_BUCKET_COUNT = 3;
+
 CountMetricProducer::CountMetricProducer(const ConfigKey& key, const CountMetric& metric,
                                          const int conditionIndex,
                                          const sp<ConditionWizard>& wizard,
@@ -216,8 +227,10 @@ void CountMetricProducer::onDumpReportLocked(const int64_t dumpTimeNs,
         for (const auto& bucket : counter.second) {
             uint64_t bucketInfoToken = protoOutput->start(
                     FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | FIELD_ID_BUCKET_INFO);
-            // Partial bucket.
-            if (bucket.mBucketEndNs - bucket.mBucketStartNs != mBucketSizeNs) {
+            // Partial bucket, or a bucket restored from before statsd restarted, which the
+            // bucket number can't describe.
+            if (bucket.mBucketEndNs - bucket.mBucketStartNs != mBucketSizeNs ||
+                bucket.mBucketStartNs < mTimeBaseNs) {
                 protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_START_BUCKET_ELAPSED_MILLIS,
                                    (long long)NanoToMillis(bucket.mBucketStartNs));
                 protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_END_BUCKET_ELAPSED_MILLIS,
@@ -241,6 +254,68 @@ void CountMetricProducer::onDumpReportLocked(const int64_t dumpTimeNs,
     }
 }
 
+static void writeSnapshotBucket(const int64_t startNs, const int64_t endNs, const int64_t count,
+                                ProtoOutputStream* protoOutput) {
+    uint64_t bucketToken = protoOutput->start(
+            FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | FIELD_ID_SNAPSHOT_BUCKET);
+    protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_SNAPSHOT_BUCKET_START, (long long)startNs);
+    protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_SNAPSHOT_BUCKET_END, (long long)endNs);
+    protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_SNAPSHOT_BUCKET_COUNT, (long long)count);
+    protoOutput->end(bucketToken);
+}
+
+static uint64_t startSnapshotCountData(const MetricDimensionKey& dimensionKey,
+                                       ProtoOutputStream* protoOutput) {
+    uint64_t dataToken = protoOutput->start(
+            FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | FIELD_ID_SNAPSHOT_COUNT_DATA);
+    writeDimensionToSnapshotProto(dimensionKey.getDimensionKeyInWhat(),
+                                  FIELD_ID_SNAPSHOT_DIMENSION_IN_WHAT, protoOutput);
+    writeDimensionToSnapshotProto(dimensionKey.getDimensionKeyInCondition(),
+                                  FIELD_ID_SNAPSHOT_DIMENSION_IN_CONDITION, protoOutput);
+    return dataToken;
+}
+
+void CountMetricProducer::writeBucketSnapshotLocked(int64_t currentTimeNs,
+                                                    ProtoOutputStream* protoOutput) {
+    flushIfNeededLocked(currentTimeNs);
+
+    for (const auto& counter : mPastBuckets) {
+        uint64_t dataToken = startSnapshotCountData(counter.first, protoOutput);
+        for (const auto& bucket : counter.second) {
+            writeSnapshotBucket(bucket.mBucketStartNs, bucket.mBucketEndNs, bucket.mCount,
+                                protoOutput);
+        }
+        protoOutput->end(dataToken);
+    }
+
+    // The current bucket is saved as a partial bucket ending now. The counts after the
+    // snapshot go to the buckets of the restarted metric.
+    if (currentTimeNs <= mCurrentBucketStartTimeNs) {
+        return;
+    }
+    for (const auto& counter : *mCurrentSlicedCounter) {
+        uint64_t dataToken = startSnapshotCountData(counter.first, protoOutput);
+        writeSnapshotBucket(mCurrentBucketStartTimeNs, currentTimeNs, counter.second,
+                            protoOutput);
+        protoOutput->end(dataToken);
+    }
+}
+
+void CountMetricProducer::loadBucketSnapshotLocked(const MetricBucketSnapshot& snapshot) {
+    for (const auto& data : snapshot.count_data()) {
+        MetricDimensionKey dimensionKey(dimensionFromSnapshotProto(data.dimension_in_what()),
+                                        dimensionFromSnapshotProto(data.dimension_in_condition()));
+        auto& buckets = mPastBuckets[dimensionKey];
+        for (const auto& bucket : data.bucket()) {
+            CountBucket info;
+            info.mBucketStartNs = bucket.start_bucket_elapsed_nanos();
+            info.mBucketEndNs = bucket.end_bucket_elapsed_nanos();
+            info.mCount = bucket.count();
+            buckets.push_back(info);
+        }
+    }
+}
+
 void CountMetricProducer::dropDataLocked(const int64_t dropTimeNs) {
     flushIfNeededLocked(dropTimeNs);
     StatsdStats::getInstance().noteBucketDropped(mMetricId);
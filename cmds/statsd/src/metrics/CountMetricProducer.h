@@ -76,6 +76,11 @@ private:
 
     void dropDataLocked(const int64_t dropTimeNs) override;
 
+    void writeBucketSnapshotLocked(int64_t currentTimeNs,
+                                   android::util::ProtoOutputStream* protoOutput) override;
+
+    void loadBucketSnapshotLocked(const MetricBucketSnapshot& snapshot) override;
+
     // Util function to flush the old packet.
     void flushIfNeededLocked(const int64_t& newEventTime) override;
 
@@ -102,6 +107,7 @@ private:
     FRIEND_TEST(CountMetricProducerTest, TestEventWithAppUpgrade);
     FRIEND_TEST(CountMetricProducerTest, TestEventWithAppUpgradeInNextBucket);
     FRIEND_TEST(CountMetricProducerTest, TestFirstBucket);
+    FRIEND_TEST(CountMetricProducerTest, TestBucketSnapshotRoundTrip);
 };
 
 }  // namespace statsd
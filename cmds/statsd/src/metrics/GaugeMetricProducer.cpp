@@ -275,21 +275,21 @@ void GaugeMetricProducer::onDumpReportLocked(const int64_t dumpTimeNs,
                                    (long long)(getBucketNumFromEndTimeNs(bucket.mBucketEndNs)));
             }
 
-            if (!bucket.mGaugeAtoms.empty()) {
-                for (const auto& atom : bucket.mGaugeAtoms) {
-                    uint64_t atomsToken =
-                        protoOutput->start(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED |
-                                           FIELD_ID_ATOM);
-                    writeFieldValueTreeToStream(mAtomId, *(atom.mFields), protoOutput);
-                    protoOutput->end(atomsToken);
-                }
-                for (const auto& atom : bucket.mGaugeAtoms) {
-                    const int64_t elapsedTimestampNs =
-                            truncateTimestampIfNecessary(mAtomId, atom.mElapsedTimestamps);
-                    protoOutput->write(
-                        FIELD_TYPE_INT64 | FIELD_COUNT_REPEATED | FIELD_ID_ELAPSED_ATOM_TIMESTAMP,
-                        (long long)elapsedTimestampNs);
-                }
+            const GaugeAtoms& atoms = bucket.mGaugeAtoms;
+            for (size_t i = 0; i < atoms.size(); i++) {
+                uint64_t atomsToken =
+                    protoOutput->start(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED |
+                                       FIELD_ID_ATOM);
+                writeFieldValueTreeToStream(mAtomId, atoms.fields(i), atoms.fieldCount(i),
+                                            protoOutput);
+                protoOutput->end(atomsToken);
+            }
+            for (const int64_t timestampNs : atoms.mElapsedTimestampsNs) {
+                const int64_t elapsedTimestampNs =
+                        truncateTimestampIfNecessary(mAtomId, timestampNs);
+                protoOutput->write(
+                    FIELD_TYPE_INT64 | FIELD_COUNT_REPEATED | FIELD_ID_ELAPSED_ATOM_TIMESTAMP,
+                    (long long)elapsedTimestampNs);
             }
             protoOutput->end(bucketInfoToken);
             VLOG("Gauge \t bucket [%lld - %lld] includes %d atoms.",
@@ -402,27 +402,35 @@ void GaugeMetricProducer::onSlicedConditionMayChangeLocked(bool overallCondition
     }  // else: Push mode. No need to proactively pull the gauge data.
 }
 
-std::shared_ptr<vector<FieldValue>> GaugeMetricProducer::getGaugeFields(const LogEvent& event) {
-    std::shared_ptr<vector<FieldValue>> gaugeFields;
-    if (mFieldMatchers.size() > 0) {
-        gaugeFields = std::make_shared<vector<FieldValue>>();
-        filterGaugeValues(mFieldMatchers, event.getValues(), gaugeFields.get());
-    } else {
-        gaugeFields = std::make_shared<vector<FieldValue>>(event.getValues());
-    }
+void GaugeMetricProducer::addGaugeAtom(const LogEvent& event, int64_t eventTimeNs,
+                                       GaugeAtoms* atoms) const {
     // Trim all dimension fields from output. Dimensions will appear in output report and will
     // benefit from dictionary encoding. For large pulled atoms, this can give the benefit of
     // optional repeated field.
-    for (const auto& field : mDimensionsInWhat) {
-        for (auto it = gaugeFields->begin(); it != gaugeFields->end();) {
-            if (it->mField.matches(field)) {
-                it = gaugeFields->erase(it);
-            } else {
-                it++;
+    auto addField = [this, atoms](const FieldValue& value) {
+        for (const auto& field : mDimensionsInWhat) {
+            if (value.mField.matches(field)) {
+                return;
+            }
+        }
+        atoms->mFields.push_back(value);
+    };
+    if (mFieldMatchers.size() > 0) {
+        // Same order as filterGaugeValues().
+        for (const auto& matcher : mFieldMatchers) {
+            for (const auto& value : event.getValues()) {
+                if (value.mField.matches(matcher)) {
+                    addField(value);
+                }
             }
         }
+    } else {
+        for (const auto& value : event.getValues()) {
+            addField(value);
+        }
     }
-    return gaugeFields;
+    atoms->mFieldEnds.push_back(atoms->mFields.size());
+    atoms->mElapsedTimestampsNs.push_back(eventTimeNs);
 }
 
 void GaugeMetricProducer::onDataPulled(const std::vector<std::shared_ptr<LogEvent>>& allData,
@@ -487,16 +495,17 @@ void GaugeMetricProducer::onMatchedLogEventInternalLocked(
     if (hitGuardRailLocked(eventKey)) {
         return;
     }
-    if ((*mCurrentSlicedBucket)[eventKey].size() >= mGaugeAtomsPerDimensionLimit) {
+    GaugeAtoms& atoms = (*mCurrentSlicedBucket)[eventKey];
+    if (atoms.size() >= mGaugeAtomsPerDimensionLimit) {
         return;
     }
-    GaugeAtom gaugeAtom(getGaugeFields(event), eventTimeNs);
-    (*mCurrentSlicedBucket)[eventKey].push_back(gaugeAtom);
+    addGaugeAtom(event, eventTimeNs, &atoms);
     // Anomaly detection on gauge metric only works when there is one numeric
     // field specified.
     if (mAnomalyTrackers.size() > 0) {
-        if (gaugeAtom.mFields->size() == 1) {
-            const Value& value = gaugeAtom.mFields->begin()->mValue;
+        const size_t last = atoms.size() - 1;
+        if (atoms.fieldCount(last) == 1) {
+            const Value& value = atoms.fields(last)->mValue;
             long gaugeVal = 0;
             if (value.getType() == INT) {
                 gaugeVal = (long)value.int_value;
@@ -513,10 +522,10 @@ void GaugeMetricProducer::onMatchedLogEventInternalLocked(
 
 void GaugeMetricProducer::updateCurrentSlicedBucketForAnomaly() {
     for (const auto& slice : *mCurrentSlicedBucket) {
-        if (slice.second.empty()) {
+        if (slice.second.empty() || slice.second.fieldCount(0) == 0) {
             continue;
         }
-        const Value& value = slice.second.front().mFields->front().mValue;
+        const Value& value = slice.second.fields(0)->mValue;
         long gaugeVal = 0;
         if (value.getType() == INT) {
             gaugeVal = (long)value.int_value;
@@ -569,19 +578,8 @@ void GaugeMetricProducer::flushCurrentBucketLocked(const int64_t& eventTimeNs,
         info.mBucketEndNs = fullBucketEndTimeNs;
     }
 
-    if (info.mBucketEndNs - mCurrentBucketStartTimeNs >= mMinBucketSizeNs) {
-        for (const auto& slice : *mCurrentSlicedBucket) {
-            info.mGaugeAtoms = slice.second;
-            auto& bucketList = mPastBuckets[slice.first];
-            bucketList.push_back(info);
-            VLOG("Gauge gauge metric %lld, dump key value: %s", (long long)mMetricId,
-                 slice.first.toString().c_str());
-        }
-    } else {
-        mSkippedBuckets.emplace_back(info.mBucketStartNs, info.mBucketEndNs);
-    }
-
-    // If we have anomaly trackers, we need to update the partial bucket values.
+    // If we have anomaly trackers, we need to update the partial bucket values. This reads the
+    // current bucket, so it goes before the atoms are moved out below.
     if (mAnomalyTrackers.size() > 0) {
         updateCurrentSlicedBucketForAnomaly();
 
@@ -594,6 +592,18 @@ void GaugeMetricProducer::flushCurrentBucketLocked(const int64_t& eventTimeNs,
         }
     }
 
+    if (info.mBucketEndNs - mCurrentBucketStartTimeNs >= mMinBucketSizeNs) {
+        for (auto& slice : *mCurrentSlicedBucket) {
+            auto& bucketList = mPastBuckets[slice.first];
+            bucketList.push_back(info);
+            bucketList.back().mGaugeAtoms = std::move(slice.second);
+            VLOG("Gauge gauge metric %lld, dump key value: %s", (long long)mMetricId,
+                 slice.first.toString().c_str());
+        }
+    } else {
+        mSkippedBuckets.emplace_back(info.mBucketStartNs, info.mBucketEndNs);
+    }
+
     StatsdStats::getInstance().noteBucketCount(mMetricId);
     mCurrentSlicedBucket = std::make_shared<DimToGaugeAtomsMap>();
     mCurrentBucketStartTimeNs = nextBucketStartTimeNs;
@@ -603,12 +613,10 @@ size_t GaugeMetricProducer::byteSizeLocked() const {
     size_t totalSize = 0;
     for (const auto& pair : mPastBuckets) {
         for (const auto& bucket : pair.second) {
-            totalSize += bucket.mGaugeAtoms.size() * sizeof(GaugeAtom);
-            for (const auto& atom : bucket.mGaugeAtoms) {
-                if (atom.mFields != nullptr) {
-                    totalSize += atom.mFields->size() * sizeof(FieldValue);
-                }
-            }
+            const GaugeAtoms& atoms = bucket.mGaugeAtoms;
+            totalSize += atoms.mFields.size() * sizeof(FieldValue) +
+                         atoms.mFieldEnds.size() * sizeof(uint32_t) +
+                         atoms.mElapsedTimestampsNs.size() * sizeof(int64_t);
         }
     }
     return totalSize;
@@ -40,6 +40,9 @@ const int FIELD_ID_ACTIVE_EVENT_ACTIVATION_ATOM_MATCHER_INDEX = 1;
 const int FIELD_ID_ACTIVE_EVENT_ACTIVATION_REMAINING_TTL_NANOS = 2;
 const int FIELD_ID_ACTIVE_EVENT_ACTIVATION_STATE = 3;
 
+// for MetricBucketSnapshot
+const int FIELD_ID_BUCKET_SNAPSHOT_METRIC_ID = 1;
+
 void MetricProducer::onMatchedLogEventLocked(const size_t matcherIndex, const LogEvent& event) {
     if (!mIsActive) {
         return;
@@ -232,6 +235,13 @@ void MetricProducer::writeActiveMetricToProtoOutputStream(
     }
 }
 
+void MetricProducer::writeBucketSnapshotToProtoOutputStream(int64_t currentTimeNs,
+                                                            ProtoOutputStream* proto) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    proto->write(FIELD_TYPE_INT64 | FIELD_ID_BUCKET_SNAPSHOT_METRIC_ID, (long long)mMetricId);
+    writeBucketSnapshotLocked(currentTimeNs, proto);
+}
+
 }  // namespace statsd
 }  // namespace os
 }  // namespace android
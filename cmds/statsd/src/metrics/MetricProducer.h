@@ -20,6 +20,7 @@
 #include <shared_mutex>
 
 #include <frameworks/base/cmds/statsd/src/active_config_list.pb.h>
+#include <frameworks/base/cmds/statsd/src/bucket_snapshot.pb.h>
 #include "HashableDimensionKey.h"
 #include "anomaly/AnomalyTracker.h"
 #include "condition/ConditionWizard.h"
@@ -246,6 +247,16 @@ public:
 
     void writeActiveMetricToProtoOutputStream(
             int64_t currentTimeNs, const DumpReportReason reason, ProtoOutputStream* proto);
+
+    // Writes the buckets that were not reported yet as a MetricBucketSnapshot, including the
+    // current bucket up to currentTimeNs.
+    void writeBucketSnapshotToProtoOutputStream(int64_t currentTimeNs, ProtoOutputStream* proto);
+
+    // Adds the buckets of a snapshot written before statsd restarted to the past buckets.
+    void loadBucketSnapshot(const MetricBucketSnapshot& snapshot) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        loadBucketSnapshotLocked(snapshot);
+    }
 protected:
     virtual void onConditionChangedLocked(const bool condition, const int64_t eventTime) = 0;
     virtual void onSlicedConditionMayChangeLocked(bool overallCondition,
@@ -271,6 +282,11 @@ protected:
 
     void loadActiveMetricLocked(const ActiveMetric& activeMetric, int64_t currentTimeNs);
 
+    // Only metrics that keep their buckets in a form that can be merged back after a restart
+    // support snapshots. The others start over as they did before.
+    virtual void writeBucketSnapshotLocked(int64_t currentTimeNs, ProtoOutputStream* proto) {};
+    virtual void loadBucketSnapshotLocked(const MetricBucketSnapshot& snapshot) {};
+
     virtual void prepareFirstBucketLocked() {};
     /**
      * Flushes the current bucket if the eventTime is after the current bucket's end time. This will
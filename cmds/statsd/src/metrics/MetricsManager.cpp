@@ -23,6 +23,7 @@
 #include "condition/CombinationConditionTracker.h"
 #include "condition/SimpleConditionTracker.h"
 #include "guardrail/StatsdStats.h"
+#include "hash.h"
 #include "matchers/CombinationLogMatchingTracker.h"
 #include "matchers/SimpleLogMatchingTracker.h"
 #include "metrics_manager_util.h"
@@ -32,6 +33,9 @@
 #include <log/logprint.h>
 #include <private/android_filesystem_config.h>
 #include <utils/SystemClock.h>
+#include <algorithm>
+#include <functional>
+#include <queue>
 
 using android::util::FIELD_COUNT_REPEATED;
 using android::util::FIELD_TYPE_INT32;
@@ -60,6 +64,12 @@ const int FIELD_ID_ACTIVE_CONFIG_ID = 1;
 const int FIELD_ID_ACTIVE_CONFIG_UID = 2;
 const int FIELD_ID_ACTIVE_CONFIG_METRIC = 3;
 
+// for ConfigBucketSnapshot
+const int FIELD_ID_BUCKET_SNAPSHOT_CONFIG_ID = 1;
+const int FIELD_ID_BUCKET_SNAPSHOT_CONFIG_UID = 2;
+const int FIELD_ID_BUCKET_SNAPSHOT_CONFIG_HASH = 3;
+const int FIELD_ID_BUCKET_SNAPSHOT_CONFIG_METRIC = 4;
+
 MetricsManager::MetricsManager(const ConfigKey& key, const StatsdConfig& config,
                                const int64_t timeBaseNs, const int64_t currentTimeNs,
                                const sp<UidMap>& uidMap,
@@ -72,7 +82,8 @@ MetricsManager::MetricsManager(const ConfigKey& key, const StatsdConfig& config,
       mTtlEndNs(-1),
       mLastReportTimeNs(currentTimeNs),
       mLastReportWallClockNs(getWallClockNs()),
-      mShouldPersistHistory(config.persist_locally()) {
+      mShouldPersistHistory(config.persist_locally()),
+      mConfigHash(Hash64(config.SerializeAsString())) {
     // Init the ttl end timestamp.
     refreshTtl(timeBaseNs);
 
@@ -84,6 +95,13 @@ MetricsManager::MetricsManager(const ConfigKey& key, const StatsdConfig& config,
             mActivationAtomTrackerToMetricMap, mDeactivationAtomTrackerToMetricMap,
             mMetricIndexesWithActivation, mNoReportMetricIds);
 
+    if (mConfigValid) {
+        initAtomMatcherDispatch(mAllAtomMatchers, mTagIdToMatcherIndices);
+        initConditionPropagation(mAllConditionTrackers, mTrackerToConditionMap,
+                                 mTrackerToSimpleConditionMap, mConditionParents, mConditionRanks);
+    }
+    mMatcherCache.assign(mAllAtomMatchers.size(), MatchingState::kNotComputed);
+
     mHashStringsInReport = config.hash_strings_in_metric_report();
     mVersionStringsInReport = config.version_strings_in_metric_report();
     mInstallerInReport = config.installer_in_metric_report();
@@ -380,16 +398,20 @@ void MetricsManager::onLogEvent(const LogEvent& event) {
 
     mIsActive = isActive || !activeMetricsIndices.empty();
 
-    if (mTagIds.find(tagId) == mTagIds.end()) {
+    auto dispatchIt = mTagIdToMatcherIndices.find(tagId);
+    if (dispatchIt == mTagIdToMatcherIndices.end()) {
         // Not interesting...
         return;
     }
+    const vector<int>& matcherIndices = dispatchIt->second;
 
-    vector<MatchingState> matcherCache(mAllAtomMatchers.size(), MatchingState::kNotComputed);
+    // Every entry of the cache is kNotComputed between events. Only the matchers in
+    // matcherIndices can be written while processing this event, and they are reset below.
+    vector<MatchingState>& matcherCache = mMatcherCache;
 
-    // Evaluate all atom matchers.
-    for (auto& matcher : mAllAtomMatchers) {
-        matcher->onLogEvent(event, mAllAtomMatchers, matcherCache);
+    // Evaluate the atom matchers that care about this atom.
+    for (const int matcherIndex : matcherIndices) {
+        mAllAtomMatchers[matcherIndex]->onLogEvent(event, mAllAtomMatchers, matcherCache);
     }
 
     // Set of metrics that received an activation cancellation.
@@ -429,14 +451,24 @@ void MetricsManager::onLogEvent(const LogEvent& event) {
 
     mIsActive = isActive;
 
-    // A bitmap to see which ConditionTracker needs to be re-evaluated.
+    // A bitmap to see which ConditionTracker has been queued for re-evaluation.
     vector<bool> conditionToBeEvaluated(mAllConditionTrackers.size(), false);
+    // Conditions to evaluate, popped by increasing rank so that children go first.
+    std::priority_queue<std::pair<int, int>, vector<std::pair<int, int>>,
+                        std::greater<std::pair<int, int>>>
+            conditionsToEvaluate;
 
-    for (const auto& pair : mTrackerToConditionMap) {
-        if (matcherCache[pair.first] == MatchingState::kMatched) {
-            const auto& conditionList = pair.second;
-            for (const int conditionIndex : conditionList) {
-                conditionToBeEvaluated[conditionIndex] = true;
+    for (const int matcherIndex : matcherIndices) {
+        if (matcherCache[matcherIndex] != MatchingState::kMatched) {
+            continue;
+        }
+        auto pair = mTrackerToSimpleConditionMap.find(matcherIndex);
+        if (pair != mTrackerToSimpleConditionMap.end()) {
+            for (const int conditionIndex : pair->second) {
+                if (!conditionToBeEvaluated[conditionIndex]) {
+                    conditionToBeEvaluated[conditionIndex] = true;
+                    conditionsToEvaluate.emplace(mConditionRanks[conditionIndex], conditionIndex);
+                }
             }
         }
     }
@@ -445,19 +477,29 @@ void MetricsManager::onLogEvent(const LogEvent& event) {
                                           ConditionState::kNotEvaluated);
     // A bitmap to track if a condition has changed value.
     vector<bool> changedCache(mAllConditionTrackers.size(), false);
-    for (size_t i = 0; i < mAllConditionTrackers.size(); i++) {
-        if (conditionToBeEvaluated[i] == false) {
-            continue;
-        }
+    vector<int> changedConditions;
+    while (!conditionsToEvaluate.empty()) {
+        const int i = conditionsToEvaluate.top().second;
+        conditionsToEvaluate.pop();
         sp<ConditionTracker>& condition = mAllConditionTrackers[i];
         condition->evaluateCondition(event, matcherCache, mAllConditionTrackers, conditionCache,
                                      changedCache);
-    }
-
-    for (size_t i = 0; i < mAllConditionTrackers.size(); i++) {
         if (changedCache[i] == false) {
             continue;
         }
+        changedConditions.push_back(i);
+        // Only the combinations above a changed condition can change.
+        for (const int parent : mConditionParents[i]) {
+            if (!conditionToBeEvaluated[parent]) {
+                conditionToBeEvaluated[parent] = true;
+                conditionsToEvaluate.emplace(mConditionRanks[parent], parent);
+            }
+        }
+    }
+    // Notify metrics in condition index order, as before.
+    std::sort(changedConditions.begin(), changedConditions.end());
+
+    for (const int i : changedConditions) {
         auto pair = mConditionToMetricMap.find(i);
         if (pair != mConditionToMetricMap.end()) {
             auto& metricList = pair->second;
@@ -479,7 +521,7 @@ void MetricsManager::onLogEvent(const LogEvent& event) {
     }
 
     // For matched AtomMatchers, tell relevant metrics that a matched event has come.
-    for (size_t i = 0; i < mAllAtomMatchers.size(); i++) {
+    for (const int i : matcherIndices) {
         if (matcherCache[i] == MatchingState::kMatched) {
             StatsdStats::getInstance().noteMatcherMatched(mConfigKey,
                                                           mAllAtomMatchers[i]->getId());
@@ -493,6 +535,11 @@ void MetricsManager::onLogEvent(const LogEvent& event) {
             }
         }
     }
+
+    // Leave the cache clean for the next event.
+    for (const int matcherIndex : matcherIndices) {
+        matcherCache[matcherIndex] = MatchingState::kNotComputed;
+    }
 }
 
 void MetricsManager::onAnomalyAlarmFired(
@@ -511,6 +558,12 @@ void MetricsManager::onPeriodicAlarmFired(
     }
 }
 
+void MetricsManager::setSharedMatcherPool(const sp<SharedMatcherPool>& pool) {
+    for (const auto& matcher : mAllAtomMatchers) {
+        matcher->setSharedMatcherPool(pool);
+    }
+}
+
 // Returns the total byte size of all metrics managed by a single config source.
 size_t MetricsManager::byteSize() {
     size_t totalSize = 0;
@@ -556,6 +609,37 @@ void MetricsManager::writeActiveConfigToProtoOutputStream(
     }
 }
 
+void MetricsManager::loadBucketSnapshot(const ConfigBucketSnapshot& config) {
+    if ((uint64_t)config.config_hash() != mConfigHash) {
+        VLOG("Config %s changed since the bucket snapshot, dropping it",
+             mConfigKey.ToString().c_str());
+        return;
+    }
+
+    for (const auto& snapshot : config.metric()) {
+        for (const auto& metric : mAllMetricProducers) {
+            if (metric->getMetricId() == snapshot.id()) {
+                metric->loadBucketSnapshot(snapshot);
+                break;
+            }
+        }
+    }
+}
+
+void MetricsManager::writeBucketSnapshotToProtoOutputStream(int64_t currentTimeNs,
+                                                            ProtoOutputStream* proto) {
+    proto->write(FIELD_TYPE_INT64 | FIELD_ID_BUCKET_SNAPSHOT_CONFIG_ID,
+                 (long long)mConfigKey.GetId());
+    proto->write(FIELD_TYPE_INT32 | FIELD_ID_BUCKET_SNAPSHOT_CONFIG_UID, mConfigKey.GetUid());
+    proto->write(FIELD_TYPE_INT64 | FIELD_ID_BUCKET_SNAPSHOT_CONFIG_HASH, (long long)mConfigHash);
+    for (const auto& metric : mAllMetricProducers) {
+        const uint64_t metricToken = proto->start(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED |
+                FIELD_ID_BUCKET_SNAPSHOT_CONFIG_METRIC);
+        metric->writeBucketSnapshotToProtoOutputStream(currentTimeNs, proto);
+        proto->end(metricToken);
+    }
+}
+
 
 
 
@@ -124,6 +124,15 @@ public:
                               std::set<string> *str_set,
                               android::util::ProtoOutputStream* protoOutput);
 
+    // Shares the evaluation of identical simple atom matchers with the other configs that use the
+    // same pool.
+    void setSharedMatcherPool(const sp<SharedMatcherPool>& pool);
+
+    // Atom ids that any matcher of this config can match.
+    inline const std::set<int>& getAtomIds() const {
+        return mTagIds;
+    }
+
     // Computes the total byte size of all metrics managed by a single config source.
     // Does not change the state.
     virtual size_t byteSize();
@@ -139,6 +148,12 @@ public:
     void writeActiveConfigToProtoOutputStream(
             int64_t currentTimeNs, const DumpReportReason reason, ProtoOutputStream* proto);
 
+    // Restores the unreported buckets of a snapshot, unless the config changed since it was
+    // written.
+    void loadBucketSnapshot(const ConfigBucketSnapshot& config);
+
+    void writeBucketSnapshotToProtoOutputStream(int64_t currentTimeNs, ProtoOutputStream* proto);
+
 private:
     // For test only.
     inline int64_t getTtlEndNs() const { return mTtlEndNs; }
@@ -174,6 +189,9 @@ private:
 
     const bool mShouldPersistHistory;
 
+    // Hash of the serialized config, to tell whether a bucket snapshot belongs to it.
+    const uint64_t mConfigHash;
+
     // To guard access to mAllowedLogSources
     mutable std::mutex mAllowedLogSourcesMutex;
 
@@ -190,9 +208,27 @@ private:
     // Hold all the atom matchers from the config.
     std::vector<sp<LogMatchingTracker>> mAllAtomMatchers;
 
+    // Maps from atom id to the indices of the LogMatchingTrackers that need to be evaluated for
+    // events of that atom. Atoms that are not in this map are not interesting to this config.
+    std::unordered_map<int, std::vector<int>> mTagIdToMatcherIndices;
+
+    // Matcher results reused across events, so that onLogEvent does not allocate. All entries
+    // are kNotComputed between events.
+    std::vector<MatchingState> mMatcherCache;
+
     // Hold all the conditions from the config.
     std::vector<sp<ConditionTracker>> mAllConditionTrackers;
 
+    // Simple conditions that use each log tracker. Combination conditions are only evaluated
+    // when one of their children changed, following mConditionParents.
+    std::unordered_map<int, std::vector<int>> mTrackerToSimpleConditionMap;
+
+    // The combination conditions that each condition is a child of.
+    std::vector<std::vector<int>> mConditionParents;
+
+    // Evaluation order of the conditions: children have a lower rank than their parents.
+    std::vector<int> mConditionRanks;
+
     // Hold all metrics from the config.
     std::vector<sp<MetricProducer>> mAllMetricProducers;
 
@@ -205,9 +241,9 @@ private:
     // To make the log processing more efficient, we want to do as much filtering as possible
     // before we go into individual trackers and conditions to match.
 
-    // 1st filter: check if the event tag id is in mTagIds.
+    // 1st filter: check if the event tag id is in mTagIdToMatcherIndices.
     // 2nd filter: if it is, we parse the event because there is at least one member is interested.
-    //             then pass to all LogMatchingTrackers (itself also filter events by ids).
+    //             then pass to the LogMatchingTrackers that care about this atom id.
     // 3nd filter: for LogMatchingTrackers that matched this event, we pass this event to the
     //             ConditionTrackers and MetricProducers that use this matcher.
     // 4th filter: for ConditionTrackers that changed value due to this event, we pass
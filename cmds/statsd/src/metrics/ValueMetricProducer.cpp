@@ -109,6 +109,7 @@ ValueMetricProducer::ValueMetricProducer(
       mMaxPullDelayNs(metric.max_pull_delay_sec() > 0 ? metric.max_pull_delay_sec() * NS_PER_SEC
                                                       : StatsdStats::kPullMaxDelayNs),
       mSplitBucketForAppUpgrade(metric.split_bucket_for_app_upgrade()),
+      mUseCompactPastBuckets(metric.compact_past_buckets()),
       // Condition timer will be set in prepareFirstBucketLocked.
       mConditionTimer(false, timeBaseNs) {
     int64_t bucketSizeMills = 0;
@@ -199,6 +200,7 @@ void ValueMetricProducer::dropDataLocked(const int64_t dropTimeNs) {
 
 void ValueMetricProducer::clearPastBucketsLocked(const int64_t dumpTimeNs) {
     mPastBuckets.clear();
+    mCompactPastBuckets.clear();
     mSkippedBuckets.clear();
 }
 
@@ -230,7 +232,7 @@ void ValueMetricProducer::onDumpReportLocked(const int64_t dumpTimeNs,
     protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_ID, (long long)mMetricId);
     protoOutput->write(FIELD_TYPE_BOOL | FIELD_ID_IS_ACTIVE, isActiveLocked());
 
-    if (mPastBuckets.empty() && mSkippedBuckets.empty()) {
+    if (mPastBuckets.empty() && mCompactPastBuckets.empty() && mSkippedBuckets.empty()) {
         return;
     }
     protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_TIME_BASE, (long long)mTimeBaseNs);
@@ -264,88 +266,100 @@ void ValueMetricProducer::onDumpReportLocked(const int64_t dumpTimeNs,
     }
 
     for (const auto& pair : mPastBuckets) {
-        const MetricDimensionKey& dimensionKey = pair.first;
-        VLOG("  dimension key %s", dimensionKey.toString().c_str());
-        uint64_t wrapperToken =
-                protoOutput->start(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | FIELD_ID_DATA);
-
-        // First fill dimension.
-        if (mSliceByPositionALL) {
-            uint64_t dimensionToken =
-                    protoOutput->start(FIELD_TYPE_MESSAGE | FIELD_ID_DIMENSION_IN_WHAT);
-            writeDimensionToProto(dimensionKey.getDimensionKeyInWhat(), str_set, protoOutput);
-            protoOutput->end(dimensionToken);
-            if (dimensionKey.hasDimensionKeyInCondition()) {
-                uint64_t dimensionInConditionToken =
-                        protoOutput->start(FIELD_TYPE_MESSAGE | FIELD_ID_DIMENSION_IN_CONDITION);
-                writeDimensionToProto(dimensionKey.getDimensionKeyInCondition(), str_set,
-                                      protoOutput);
-                protoOutput->end(dimensionInConditionToken);
-            }
-        } else {
-            writeDimensionLeafNodesToProto(dimensionKey.getDimensionKeyInWhat(),
-                                           FIELD_ID_DIMENSION_LEAF_IN_WHAT, str_set, protoOutput);
-            if (dimensionKey.hasDimensionKeyInCondition()) {
-                writeDimensionLeafNodesToProto(dimensionKey.getDimensionKeyInCondition(),
-                                               FIELD_ID_DIMENSION_LEAF_IN_CONDITION, str_set,
-                                               protoOutput);
-            }
-        }
-
-        // Then fill bucket_info (ValueBucketInfo).
-        for (const auto& bucket : pair.second) {
-            uint64_t bucketInfoToken = protoOutput->start(
-                    FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | FIELD_ID_BUCKET_INFO);
-
-            if (bucket.mBucketEndNs - bucket.mBucketStartNs != mBucketSizeNs) {
-                protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_START_BUCKET_ELAPSED_MILLIS,
-                                   (long long)NanoToMillis(bucket.mBucketStartNs));
-                protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_END_BUCKET_ELAPSED_MILLIS,
-                                   (long long)NanoToMillis(bucket.mBucketEndNs));
-            } else {
-                protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_BUCKET_NUM,
-                                   (long long)(getBucketNumFromEndTimeNs(bucket.mBucketEndNs)));
-            }
-            // only write the condition timer value if the metric has a condition.
-            if (mConditionTrackerIndex >= 0) {
-                protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_CONDITION_TRUE_NS,
-                                   (long long)bucket.mConditionTrueNs);
-            }
-            for (int i = 0; i < (int)bucket.valueIndex.size(); i ++) {
-                int index = bucket.valueIndex[i];
-                const Value& value = bucket.values[i];
-                uint64_t valueToken = protoOutput->start(
-                        FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | FIELD_ID_VALUES);
-                protoOutput->write(FIELD_TYPE_INT32 | FIELD_ID_VALUE_INDEX,
-                                   index);
-                if (value.getType() == LONG) {
-                    protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_VALUE_LONG,
-                                       (long long)value.long_value);
-                    VLOG("\t bucket [%lld - %lld] value %d: %lld", (long long)bucket.mBucketStartNs,
-                         (long long)bucket.mBucketEndNs, index, (long long)value.long_value);
-                } else if (value.getType() == DOUBLE) {
-                    protoOutput->write(FIELD_TYPE_DOUBLE | FIELD_ID_VALUE_DOUBLE,
-                                       value.double_value);
-                    VLOG("\t bucket [%lld - %lld] value %d: %.2f", (long long)bucket.mBucketStartNs,
-                         (long long)bucket.mBucketEndNs, index, value.double_value);
-                } else {
-                    VLOG("Wrong value type for ValueMetric output: %d", value.getType());
-                }
-                protoOutput->end(valueToken);
-            }
-            protoOutput->end(bucketInfoToken);
-        }
-        protoOutput->end(wrapperToken);
+        writePastBucketsToProto(pair.first, pair.second, str_set, protoOutput);
     }
+    mCompactPastBuckets.forEach(
+            [this, str_set, protoOutput](const MetricDimensionKey& dimensionKey,
+                                         const std::vector<ValueBucket>& buckets) {
+                writePastBucketsToProto(dimensionKey, buckets, str_set, protoOutput);
+            });
     protoOutput->end(protoToken);
 
     VLOG("metric %lld dump report now...", (long long)mMetricId);
     if (erase_data) {
         mPastBuckets.clear();
+        mCompactPastBuckets.clear();
         mSkippedBuckets.clear();
     }
 }
 
+void ValueMetricProducer::writePastBucketsToProto(const MetricDimensionKey& dimensionKey,
+                                                  const std::vector<ValueBucket>& buckets,
+                                                  std::set<string>* str_set,
+                                                  ProtoOutputStream* protoOutput) {
+    VLOG("  dimension key %s", dimensionKey.toString().c_str());
+    uint64_t wrapperToken =
+            protoOutput->start(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | FIELD_ID_DATA);
+
+    // First fill dimension.
+    if (mSliceByPositionALL) {
+        uint64_t dimensionToken =
+                protoOutput->start(FIELD_TYPE_MESSAGE | FIELD_ID_DIMENSION_IN_WHAT);
+        writeDimensionToProto(dimensionKey.getDimensionKeyInWhat(), str_set, protoOutput);
+        protoOutput->end(dimensionToken);
+        if (dimensionKey.hasDimensionKeyInCondition()) {
+            uint64_t dimensionInConditionToken =
+                    protoOutput->start(FIELD_TYPE_MESSAGE | FIELD_ID_DIMENSION_IN_CONDITION);
+            writeDimensionToProto(dimensionKey.getDimensionKeyInCondition(), str_set,
+                                  protoOutput);
+            protoOutput->end(dimensionInConditionToken);
+        }
+    } else {
+        writeDimensionLeafNodesToProto(dimensionKey.getDimensionKeyInWhat(),
+                                       FIELD_ID_DIMENSION_LEAF_IN_WHAT, str_set, protoOutput);
+        if (dimensionKey.hasDimensionKeyInCondition()) {
+            writeDimensionLeafNodesToProto(dimensionKey.getDimensionKeyInCondition(),
+                                           FIELD_ID_DIMENSION_LEAF_IN_CONDITION, str_set,
+                                           protoOutput);
+        }
+    }
+
+    // Then fill bucket_info (ValueBucketInfo).
+    for (const auto& bucket : buckets) {
+        uint64_t bucketInfoToken = protoOutput->start(
+                FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | FIELD_ID_BUCKET_INFO);
+
+        if (bucket.mBucketEndNs - bucket.mBucketStartNs != mBucketSizeNs) {
+            protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_START_BUCKET_ELAPSED_MILLIS,
+                               (long long)NanoToMillis(bucket.mBucketStartNs));
+            protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_END_BUCKET_ELAPSED_MILLIS,
+                               (long long)NanoToMillis(bucket.mBucketEndNs));
+        } else {
+            protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_BUCKET_NUM,
+                               (long long)(getBucketNumFromEndTimeNs(bucket.mBucketEndNs)));
+        }
+        // only write the condition timer value if the metric has a condition.
+        if (mConditionTrackerIndex >= 0) {
+            protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_CONDITION_TRUE_NS,
+                               (long long)bucket.mConditionTrueNs);
+        }
+        for (int i = 0; i < (int)bucket.valueIndex.size(); i ++) {
+            int index = bucket.valueIndex[i];
+            const Value& value = bucket.values[i];
+            uint64_t valueToken = protoOutput->start(
+                    FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | FIELD_ID_VALUES);
+            protoOutput->write(FIELD_TYPE_INT32 | FIELD_ID_VALUE_INDEX,
+                               index);
+            if (value.getType() == LONG) {
+                protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_VALUE_LONG,
+                                   (long long)value.long_value);
+                VLOG("\t bucket [%lld - %lld] value %d: %lld", (long long)bucket.mBucketStartNs,
+                     (long long)bucket.mBucketEndNs, index, (long long)value.long_value);
+            } else if (value.getType() == DOUBLE) {
+                protoOutput->write(FIELD_TYPE_DOUBLE | FIELD_ID_VALUE_DOUBLE,
+                                   value.double_value);
+                VLOG("\t bucket [%lld - %lld] value %d: %.2f", (long long)bucket.mBucketStartNs,
+                     (long long)bucket.mBucketEndNs, index, value.double_value);
+            } else {
+                VLOG("Wrong value type for ValueMetric output: %d", value.getType());
+            }
+            protoOutput->end(valueToken);
+        }
+        protoOutput->end(bucketInfoToken);
+    }
+    protoOutput->end(wrapperToken);
+}
+
 void ValueMetricProducer::invalidateCurrentBucketWithoutResetBase() {
     if (!mCurrentBucketIsInvalid) {
         // Only report once per invalid bucket.
@@ -584,6 +598,11 @@ void ValueMetricProducer::dumpStatesLocked(FILE* out, bool verbose) const {
 
     fprintf(out, "ValueMetric %lld dimension size %lu\n", (long long)mMetricId,
             (unsigned long)mCurrentSlicedBucket.size());
+    if (mUseCompactPastBuckets) {
+        fprintf(out, "\tcompact past buckets %lu, %.1f bytes per bucket (uncompacted %lu)\n",
+                (unsigned long)mCompactPastBuckets.getBucketCount(),
+                mCompactPastBuckets.getBytesPerBucket(), (unsigned long)kBucketSize);
+    }
     if (verbose) {
         for (const auto& it : mCurrentSlicedBucket) {
           for (const auto& interval : it.second) {
@@ -874,8 +893,12 @@ void ValueMetricProducer::flushCurrentBucketLocked(const int64_t& eventTimeNs,
             bucket.mConditionTrueNs = conditionTrueDuration;
             // it will auto create new vector of ValuebucketInfo if the key is not found.
             if (bucket.valueIndex.size() > 0) {
-                auto& bucketList = mPastBuckets[slice.first];
-                bucketList.push_back(bucket);
+                if (mUseCompactPastBuckets) {
+                    mCompactPastBuckets.append(slice.first, bucket);
+                } else {
+                    auto& bucketList = mPastBuckets[slice.first];
+                    bucketList.push_back(bucket);
+                }
             }
         }
     } else {
@@ -1009,6 +1032,7 @@ size_t ValueMetricProducer::byteSizeLocked() const {
     for (const auto& pair : mPastBuckets) {
         totalSize += pair.second.size() * kBucketSize;
     }
+    totalSize += mCompactPastBuckets.byteSize();
     return totalSize;
 }
 
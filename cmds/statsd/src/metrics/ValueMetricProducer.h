@@ -25,6 +25,7 @@
 #include "external/PullDataReceiver.h"
 #include "external/StatsPullerManager.h"
 #include "matchers/EventMatcherWizard.h"
+#include "metrics/CompactValueBucketStore.h"
 #include "stats_log_util.h"
 #include "MetricProducer.h"
 #include "frameworks/base/cmds/statsd/src/statsd_config.pb.h"
@@ -33,17 +34,6 @@ namespace android {
 namespace os {
 namespace statsd {
 
-struct ValueBucket {
-    int64_t mBucketStartNs;
-    int64_t mBucketEndNs;
-    std::vector<int> valueIndex;
-    std::vector<Value> values;
-    // If the metric has no condition, then this field is just wasted.
-    // When we tune statsd memory usage in the future, this is a candidate to optimize.
-    int64_t mConditionTrueNs;
-};
-
-
 // Aggregates values within buckets.
 //
 // There are different events that might complete a bucket
@@ -174,6 +164,9 @@ private:
     // Save the past buckets and we can clear when the StatsLogReport is dumped.
     std::unordered_map<MetricDimensionKey, std::vector<ValueBucket>> mPastBuckets;
 
+    // Used instead of mPastBuckets when the metric sets compact_past_buckets.
+    CompactValueBucketStore mCompactPastBuckets;
+
     // Pairs of (elapsed start, elapsed end) denoting buckets that were skipped.
     std::list<std::pair<int64_t, int64_t>> mSkippedBuckets;
 
@@ -191,6 +184,11 @@ private:
                           int64_t originalPullTimeNs, int64_t eventElapsedTimeNs,
                           ConditionState condition);
 
+    void writePastBucketsToProto(const MetricDimensionKey& dimensionKey,
+                                 const std::vector<ValueBucket>& buckets,
+                                 std::set<string>* str_set,
+                                 android::util::ProtoOutputStream* protoOutput);
+
     ValueBucket buildPartialBucket(int64_t bucketEndTime,
                                    const std::vector<Interval>& intervals);
     void initCurrentSlicedBucket(int64_t nextBucketStartTimeNs);
@@ -237,6 +235,8 @@ private:
 
     const bool mSplitBucketForAppUpgrade;
 
+    const bool mUseCompactPastBuckets;
+
     ConditionTimer mConditionTimer;
 
     FRIEND_TEST(ValueMetricProducerTest, TestAnomalyDetection);
@@ -36,6 +36,7 @@
 #include "stats_util.h"
 
 #include <inttypes.h>
+#include <functional>
 
 using std::set;
 using std::string;
@@ -128,6 +129,10 @@ bool handleMetricWithConditions(
         }
         allConditionTrackers[condition_it->second]->setSliced(true);
         allConditionTrackers[it->second]->setSliced(true);
+
+        std::vector<Matcher> conditionFields;
+        translateFieldMatcher(link.fields_in_condition(), &conditionFields);
+        allConditionTrackers[it->second]->addLinkedFields(conditionFields);
     }
     conditionIndex = condition_it->second;
 
@@ -183,6 +188,71 @@ bool initLogTrackers(const StatsdConfig& config, const UidMap& uidMap,
     return true;
 }
 
+void initAtomMatcherDispatch(const vector<sp<LogMatchingTracker>>& allAtomMatchers,
+                             unordered_map<int, vector<int>>& tagIdToMatcherIndices) {
+    unordered_map<int, set<int>> reachable;
+    for (size_t i = 0; i < allAtomMatchers.size(); i++) {
+        for (const int tagId : allAtomMatchers[i]->getAtomIds()) {
+            set<int>& indices = reachable[tagId];
+            // Walk down the combination tree, since a parent evaluates all of its children.
+            vector<int> toVisit = {(int)i};
+            while (!toVisit.empty()) {
+                const int index = toVisit.back();
+                toVisit.pop_back();
+                if (!indices.insert(index).second) {
+                    continue;
+                }
+                for (const int child : allAtomMatchers[index]->getChildren()) {
+                    toVisit.push_back(child);
+                }
+            }
+        }
+    }
+
+    tagIdToMatcherIndices.clear();
+    for (const auto& pair : reachable) {
+        tagIdToMatcherIndices[pair.first].assign(pair.second.begin(), pair.second.end());
+    }
+}
+
+void initConditionPropagation(const vector<sp<ConditionTracker>>& allConditionTrackers,
+                              const unordered_map<int, vector<int>>& trackerToConditionMap,
+                              unordered_map<int, vector<int>>& trackerToSimpleConditionMap,
+                              vector<vector<int>>& conditionParents, vector<int>& conditionRanks) {
+    const int conditionCount = allConditionTrackers.size();
+    conditionParents.assign(conditionCount, vector<int>());
+    for (int i = 0; i < conditionCount; i++) {
+        for (const int child : allConditionTrackers[i]->getChildren()) {
+            conditionParents[child].push_back(i);
+        }
+    }
+
+    // The graph is acyclic once the trackers are initialized.
+    conditionRanks.assign(conditionCount, -1);
+    std::function<int(int)> rankOf = [&](int index) {
+        if (conditionRanks[index] < 0) {
+            int rank = 0;
+            for (const int child : allConditionTrackers[index]->getChildren()) {
+                rank = std::max(rank, rankOf(child) + 1);
+            }
+            conditionRanks[index] = rank;
+        }
+        return conditionRanks[index];
+    };
+    for (int i = 0; i < conditionCount; i++) {
+        rankOf(i);
+    }
+
+    trackerToSimpleConditionMap.clear();
+    for (const auto& pair : trackerToConditionMap) {
+        for (const int conditionIndex : pair.second) {
+            if (allConditionTrackers[conditionIndex]->getChildren().empty()) {
+                trackerToSimpleConditionMap[pair.first].push_back(conditionIndex);
+            }
+        }
+    }
+}
+
 /**
  * A StateTracker is built from a SimplePredicate which has only "start", and no "stop"
  * or "stop_all". The start must be an atom matcher that matches a state atom. It must
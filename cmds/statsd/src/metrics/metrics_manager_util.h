@@ -51,6 +51,17 @@ bool initLogTrackers(const StatsdConfig& config,
                      std::vector<sp<LogMatchingTracker>>& allAtomMatchers,
                      std::set<int>& allTagIds);
 
+// Build the atom id to matcher dispatch table from initialized LogMatchingTrackers.
+// input:
+// [allAtomMatchers]: all the LogMatchingTrackers of the config, already initialized
+// output:
+// [tagIdToMatcherIndices]: for each interesting atom id, the sorted indices of every matcher that
+//                          may be evaluated (and write to the matcher cache) for an event with
+//                          that atom id. This includes the matchers that care about the atom and
+//                          all of their descendants.
+void initAtomMatcherDispatch(const std::vector<sp<LogMatchingTracker>>& allAtomMatchers,
+                             std::unordered_map<int, std::vector<int>>& tagIdToMatcherIndices);
+
 // Initialize ConditionTrackers
 // input:
 // [key]: the config key that this config belongs to
@@ -65,8 +76,23 @@ bool initConditions(const ConfigKey& key, const StatsdConfig& config,
                     const std::unordered_map<int64_t, int>& logTrackerMap,
                     std::unordered_map<int64_t, int>& conditionTrackerMap,
                     std::vector<sp<ConditionTracker>>& allConditionTrackers,
-                    std::unordered_map<int, std::vector<int>>& trackerToConditionMap,
-                    std::unordered_map<int, std::vector<MetricConditionLink>>& eventConditionLinks);
+                    std::unordered_map<int, std::vector<int>>& trackerToConditionMap);
+
+// Build the condition propagation graph from initialized ConditionTrackers.
+// input:
+// [allConditionTrackers]: all the ConditionTrackers of the config, already initialized
+// [trackerToConditionMap]: log tracker index to the conditions that use the log tracker
+// output:
+// [trackerToSimpleConditionMap]: the subset of trackerToConditionMap that are simple conditions.
+//                                Combinations are reached through conditionParents instead.
+// [conditionParents]: for each condition, the combination conditions that have it as a child
+// [conditionRanks]: 0 for simple conditions, 1 + the highest child rank for combinations, so
+//                   evaluating by increasing rank visits children before their parents
+void initConditionPropagation(
+        const std::vector<sp<ConditionTracker>>& allConditionTrackers,
+        const std::unordered_map<int, std::vector<int>>& trackerToConditionMap,
+        std::unordered_map<int, std::vector<int>>& trackerToSimpleConditionMap,
+        std::vector<std::vector<int>>& conditionParents, std::vector<int>& conditionRanks);
 
 // Initialize MetricProducers.
 // input:
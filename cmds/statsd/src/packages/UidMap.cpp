@@ -136,8 +136,8 @@ void UidMap::updateMap(const int64_t& timestamp, const vector<int32_t>& uid,
         for (size_t j = 0; j < uid.size(); j++) {
             string package = string(String8(packageName[j]).string());
             mMap[std::make_pair(uid[j], package)] =
-                    AppData(versionCode[j], string(String8(versionString[j]).string()),
-                            string(String8(installer[j]).string()));
+                    AppData(versionCode[j], internLocked(String8(versionString[j]).string()),
+                            internLocked(String8(installer[j]).string()));
         }
 
         for (const auto& kv : deletedApps) {
@@ -148,6 +148,7 @@ void UidMap::updateMap(const int64_t& timestamp, const vector<int32_t>& uid,
             }
         }
 
+        onMapChangedLocked();
         ensureBytesUsedBelowLimit();
         StatsdStats::getInstance().setCurrentUidMapMemory(mBytesUsed);
         broadcast = mSubscriber;
@@ -170,8 +171,9 @@ void UidMap::updateApp(const int64_t& timestamp, const String16& app_16, const i
     {
         lock_guard<mutex> lock(mMutex);
         int32_t prevVersion = 0;
-        string prevVersionString = "";
-        string newVersionString = string(String8(versionString).string());
+        const string* prevVersionString = internLocked("");
+        const string* newVersionString = internLocked(String8(versionString).string());
+        const string* newInstaller = internLocked(String8(installer).string());
         bool found = false;
         auto it = mMap.find(std::make_pair(uid, appName));
         if (it != mMap.end()) {
@@ -180,13 +182,13 @@ void UidMap::updateApp(const int64_t& timestamp, const String16& app_16, const i
             prevVersionString = it->second.versionString;
             it->second.versionCode = versionCode;
             it->second.versionString = newVersionString;
-            it->second.installer = string(String8(installer).string());
+            it->second.installer = newInstaller;
             it->second.deleted = false;
         }
         if (!found) {
             // Otherwise, we need to add an app at this uid.
             mMap[std::make_pair(uid, appName)] =
-                    AppData(versionCode, newVersionString, string(String8(installer).string()));
+                    AppData(versionCode, newVersionString, newInstaller);
         } else {
             // Only notify the listeners if this is an app upgrade. If this app is being installed
             // for the first time, then we don't notify the listeners.
@@ -194,9 +196,9 @@ void UidMap::updateApp(const int64_t& timestamp, const String16& app_16, const i
             // app after deletion.
             broadcast = mSubscriber;
         }
-        mChanges.emplace_back(false, timestamp, appName, uid, versionCode, newVersionString,
-                              prevVersion, prevVersionString);
-        mBytesUsed += kBytesChangeRecord;
+        addChangeLocked(ChangeRecord(false, timestamp, internLocked(appName), uid, versionCode,
+                                     newVersionString, prevVersion, prevVersionString));
+        onMapChangedLocked();
         ensureBytesUsedBelowLimit();
         StatsdStats::getInstance().setCurrentUidMapMemory(mBytesUsed);
         StatsdStats::getInstance().setUidMapChanges(mChanges.size());
@@ -217,14 +219,110 @@ void UidMap::ensureBytesUsedBelowLimit() {
     }
     while (mBytesUsed > limit) {
         ALOGI("Bytes used %zu is above limit %zu, need to delete something", mBytesUsed, limit);
-        if (mChanges.size() > 0) {
-            mBytesUsed -= kBytesChangeRecord;
-            mChanges.pop_front();
+        if (getSnapshotCacheBytesLocked() > 0) {
+            clearSnapshotCachesLocked();
+        } else if (mChanges.size() > 0) {
+            eraseChangeLocked(mChanges.begin());
             StatsdStats::getInstance().noteUidMapDropped(1);
+        } else {
+            break;
+        }
+    }
+}
+
+const string* UidMap::internLocked(const string& str) {
+    return &*mStringPool.insert(str).first;
+}
+
+void UidMap::addChangeLocked(const ChangeRecord& record) {
+    mChanges.push_back(record);
+    for (const string* str : {record.package, record.versionString, record.prevVersionString}) {
+        if (mChangeStringRefs[str]++ == 0) {
+            mChangeStringBytes += str->size();
+        }
+    }
+    updateBytesUsedLocked();
+}
+
+std::list<ChangeRecord>::iterator UidMap::eraseChangeLocked(std::list<ChangeRecord>::iterator it) {
+    for (const string* str : {it->package, it->versionString, it->prevVersionString}) {
+        auto refs = mChangeStringRefs.find(str);
+        if (--refs->second == 0) {
+            mChangeStringBytes -= str->size();
+            mChangeStringRefs.erase(refs);
+        }
+    }
+    auto next = mChanges.erase(it);
+    updateBytesUsedLocked();
+    return next;
+}
+
+void UidMap::onMapChangedLocked() {
+    clearSnapshotCachesLocked();
+
+    std::unordered_set<const string*> used;
+    for (const auto& kv : mMap) {
+        used.insert(kv.second.versionString);
+        used.insert(kv.second.installer);
+    }
+    for (auto it = mStringPool.begin(); it != mStringPool.end();) {
+        if (used.find(&*it) == used.end() &&
+            mChangeStringRefs.find(&*it) == mChangeStringRefs.end()) {
+            it = mStringPool.erase(it);
+        } else {
+            ++it;
         }
     }
 }
 
+void UidMap::updateBytesUsedLocked() {
+    mBytesUsed = mChanges.size() * kBytesChangeRecord + mChangeStringBytes +
+                 getSnapshotCacheBytesLocked();
+}
+
+const UidMap::SnapshotCache& UidMap::getSnapshotCacheLocked(bool includeVersionStrings,
+                                                            bool includeInstaller,
+                                                            bool hashStrings) {
+    SnapshotCache& cache =
+            mSnapshotCaches[snapshotCacheIndex(includeVersionStrings, includeInstaller,
+                                               hashStrings)];
+    if (cache.valid) {
+        return cache;
+    }
+    ProtoOutputStream packageInfo;
+    string bytes;
+    for (const auto& kv : mMap) {
+        packageInfo.clear();
+        writePackageInfoLocked(kv.first, kv.second, includeVersionStrings, includeInstaller,
+                               hashStrings, &cache.strings, &packageInfo);
+        packageInfo.serializeToString(&bytes);
+        cache.bytes.append(bytes);
+        cache.ends.push_back(cache.bytes.size());
+    }
+    cache.valid = true;
+    updateBytesUsedLocked();
+    return cache;
+}
+
+void UidMap::clearSnapshotCachesLocked() {
+    for (auto& cache : mSnapshotCaches) {
+        cache = SnapshotCache();
+    }
+    updateBytesUsedLocked();
+}
+
+size_t UidMap::getSnapshotCacheBytesLocked() const {
+    size_t bytes = 0;
+    for (const auto& cache : mSnapshotCaches) {
+        if (!cache.valid) {
+            continue;
+        }
+        bytes += cache.bytes.capacity() + cache.ends.capacity() * sizeof(size_t) +
+                 cache.strings.capacity() * sizeof(const string*);
+    }
+    return bytes;
+}
+
 void UidMap::removeApp(const int64_t& timestamp, const String16& app_16, const int32_t& uid) {
     wp<PackageInfoListener> broadcast = NULL;
     string app = string(String8(app_16).string());
@@ -232,7 +330,7 @@ void UidMap::removeApp(const int64_t& timestamp, const String16& app_16, const i
         lock_guard<mutex> lock(mMutex);
 
         int64_t prevVersion = 0;
-        string prevVersionString = "";
+        const string* prevVersionString = internLocked("");
         auto key = std::make_pair(uid, app);
         auto it = mMap.find(key);
         if (it != mMap.end() && !it->second.deleted) {
@@ -248,8 +346,9 @@ void UidMap::removeApp(const int64_t& timestamp, const String16& app_16, const i
             mMap.erase(oldest);
             StatsdStats::getInstance().noteUidMapAppDeletionDropped();
         }
-        mChanges.emplace_back(true, timestamp, app, uid, 0, "", prevVersion, prevVersionString);
-        mBytesUsed += kBytesChangeRecord;
+        addChangeLocked(ChangeRecord(true, timestamp, internLocked(app), uid, 0, internLocked(""),
+                                     prevVersion, prevVersionString));
+        onMapChangedLocked();
         ensureBytesUsedBelowLimit();
         StatsdStats::getInstance().setCurrentUidMapMemory(mBytesUsed);
         StatsdStats::getInstance().setUidMapChanges(mChanges.size());
@@ -294,9 +393,11 @@ int UidMap::getHostUidOrSelf(int uid) const {
 
 void UidMap::clearOutput() {
     mChanges.clear();
+    mChangeStringRefs.clear();
+    mChangeStringBytes = 0;
+    clearSnapshotCachesLocked();
     // Also update the guardrail trackers.
     StatsdStats::getInstance().setUidMapChanges(0);
-    mBytesUsed = 0;
     StatsdStats::getInstance().setCurrentUidMapMemory(mBytesUsed);
 }
 
@@ -330,6 +431,7 @@ void UidMap::writeUidMapSnapshotLocked(int64_t timestamp, bool includeVersionStr
                                        const std::set<int32_t>& interestingUids,
                                        std::set<string>* str_set, ProtoOutputStream* proto) {
     proto->write(FIELD_TYPE_INT64 | FIELD_ID_SNAPSHOT_TIMESTAMP, (long long)timestamp);
+    std::vector<const string*> usedStrings;
     for (const auto& kv : mMap) {
         if (!interestingUids.empty() &&
             interestingUids.find(kv.first.first) == interestingUids.end()) {
@@ -337,38 +439,51 @@ void UidMap::writeUidMapSnapshotLocked(int64_t timestamp, bool includeVersionStr
         }
         uint64_t token = proto->start(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED |
                                       FIELD_ID_SNAPSHOT_PACKAGE_INFO);
-        if (str_set != nullptr) {
-            str_set->insert(kv.first.second);
-            proto->write(FIELD_TYPE_UINT64 | FIELD_ID_SNAPSHOT_PACKAGE_NAME_HASH,
-                         (long long)Hash64(kv.first.second));
-            if (includeVersionStrings) {
-                str_set->insert(kv.second.versionString);
-                proto->write(FIELD_TYPE_UINT64 | FIELD_ID_SNAPSHOT_PACKAGE_VERSION_STRING_HASH,
-                             (long long)Hash64(kv.second.versionString));
-            }
-            if (includeInstaller) {
-                str_set->insert(kv.second.installer);
-                proto->write(FIELD_TYPE_UINT64 | FIELD_ID_SNAPSHOT_PACKAGE_INSTALLER_HASH,
-                             (long long)Hash64(kv.second.installer));
-            }
-        } else {
-            proto->write(FIELD_TYPE_STRING | FIELD_ID_SNAPSHOT_PACKAGE_NAME, kv.first.second);
-            if (includeVersionStrings) {
-                proto->write(FIELD_TYPE_STRING | FIELD_ID_SNAPSHOT_PACKAGE_VERSION_STRING,
-                             kv.second.versionString);
-            }
-            if (includeInstaller) {
-                proto->write(FIELD_TYPE_STRING | FIELD_ID_SNAPSHOT_PACKAGE_INSTALLER,
-                             kv.second.installer);
-            }
+        writePackageInfoLocked(kv.first, kv.second, includeVersionStrings, includeInstaller,
+                               str_set != nullptr, &usedStrings, proto);
+        proto->end(token);
+    }
+    if (str_set != nullptr) {
+        for (const string* str : usedStrings) {
+            str_set->insert(*str);
         }
+    }
+}
 
-        proto->write(FIELD_TYPE_INT64 | FIELD_ID_SNAPSHOT_PACKAGE_VERSION,
-                     (long long)kv.second.versionCode);
-        proto->write(FIELD_TYPE_INT32 | FIELD_ID_SNAPSHOT_PACKAGE_UID, kv.first.first);
-        proto->write(FIELD_TYPE_BOOL | FIELD_ID_SNAPSHOT_PACKAGE_DELETED, kv.second.deleted);
-        proto->end(token);
+void UidMap::writePackageInfoLocked(const std::pair<int, string>& app, const AppData& appData,
+                                    bool includeVersionStrings, bool includeInstaller,
+                                    bool hashStrings, std::vector<const string*>* usedStrings,
+                                    ProtoOutputStream* proto) const {
+    if (hashStrings) {
+        usedStrings->push_back(&app.second);
+        proto->write(FIELD_TYPE_UINT64 | FIELD_ID_SNAPSHOT_PACKAGE_NAME_HASH,
+                     (long long)Hash64(app.second));
+        if (includeVersionStrings) {
+            usedStrings->push_back(appData.versionString);
+            proto->write(FIELD_TYPE_UINT64 | FIELD_ID_SNAPSHOT_PACKAGE_VERSION_STRING_HASH,
+                         (long long)Hash64(*appData.versionString));
+        }
+        if (includeInstaller) {
+            usedStrings->push_back(appData.installer);
+            proto->write(FIELD_TYPE_UINT64 | FIELD_ID_SNAPSHOT_PACKAGE_INSTALLER_HASH,
+                         (long long)Hash64(*appData.installer));
+        }
+    } else {
+        proto->write(FIELD_TYPE_STRING | FIELD_ID_SNAPSHOT_PACKAGE_NAME, app.second);
+        if (includeVersionStrings) {
+            proto->write(FIELD_TYPE_STRING | FIELD_ID_SNAPSHOT_PACKAGE_VERSION_STRING,
+                         *appData.versionString);
+        }
+        if (includeInstaller) {
+            proto->write(FIELD_TYPE_STRING | FIELD_ID_SNAPSHOT_PACKAGE_INSTALLER,
+                         *appData.installer);
+        }
     }
+
+    proto->write(FIELD_TYPE_INT64 | FIELD_ID_SNAPSHOT_PACKAGE_VERSION,
+                 (long long)appData.versionCode);
+    proto->write(FIELD_TYPE_INT32 | FIELD_ID_SNAPSHOT_PACKAGE_UID, app.first);
+    proto->write(FIELD_TYPE_BOOL | FIELD_ID_SNAPSHOT_PACKAGE_DELETED, appData.deleted);
 }
 
 void UidMap::appendUidMap(const int64_t& timestamp, const ConfigKey& key, std::set<string>* str_set,
@@ -384,24 +499,24 @@ void UidMap::appendUidMap(const int64_t& timestamp, const ConfigKey& key, std::s
             proto->write(FIELD_TYPE_INT64 | FIELD_ID_CHANGE_TIMESTAMP,
                          (long long)record.timestampNs);
             if (str_set != nullptr) {
-                str_set->insert(record.package);
+                str_set->insert(*record.package);
                 proto->write(FIELD_TYPE_UINT64 | FIELD_ID_CHANGE_PACKAGE_HASH,
-                             (long long)Hash64(record.package));
+                             (long long)Hash64(*record.package));
                 if (includeVersionStrings) {
-                    str_set->insert(record.versionString);
+                    str_set->insert(*record.versionString);
                     proto->write(FIELD_TYPE_UINT64 | FIELD_ID_CHANGE_NEW_VERSION_STRING_HASH,
-                                 (long long)Hash64(record.versionString));
-                    str_set->insert(record.prevVersionString);
+                                 (long long)Hash64(*record.versionString));
+                    str_set->insert(*record.prevVersionString);
                     proto->write(FIELD_TYPE_UINT64 | FIELD_ID_CHANGE_PREV_VERSION_STRING_HASH,
-                                 (long long)Hash64(record.prevVersionString));
+                                 (long long)Hash64(*record.prevVersionString));
                 }
             } else {
-                proto->write(FIELD_TYPE_STRING | FIELD_ID_CHANGE_PACKAGE, record.package);
+                proto->write(FIELD_TYPE_STRING | FIELD_ID_CHANGE_PACKAGE, *record.package);
                 if (includeVersionStrings) {
                     proto->write(FIELD_TYPE_STRING | FIELD_ID_CHANGE_NEW_VERSION_STRING,
-                                 record.versionString);
+                                 *record.versionString);
                     proto->write(FIELD_TYPE_STRING | FIELD_ID_CHANGE_PREV_VERSION_STRING,
-                                 record.prevVersionString);
+                                 *record.prevVersionString);
                 }
             }
 
@@ -413,13 +528,25 @@ void UidMap::appendUidMap(const int64_t& timestamp, const ConfigKey& key, std::s
         }
     }
 
-    // Write snapshot from current uid map state.
+    // Write snapshot from current uid map state. The package infos are shared by every report
+    // until the map changes again.
+    const SnapshotCache& cache =
+            getSnapshotCacheLocked(includeVersionStrings, includeInstaller, str_set != nullptr);
     uint64_t snapshotsToken =
             proto->start(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | FIELD_ID_SNAPSHOTS);
-    writeUidMapSnapshotLocked(timestamp, includeVersionStrings, includeInstaller,
-                              std::set<int32_t>() /*empty uid set means including every uid*/,
-                              str_set, proto);
+    proto->write(FIELD_TYPE_INT64 | FIELD_ID_SNAPSHOT_TIMESTAMP, (long long)timestamp);
+    size_t begin = 0;
+    for (size_t end : cache.ends) {
+        proto->write(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | FIELD_ID_SNAPSHOT_PACKAGE_INFO,
+                     cache.bytes.data() + begin, end - begin);
+        begin = end;
+    }
     proto->end(snapshotsToken);
+    if (str_set != nullptr) {
+        for (const string* str : cache.strings) {
+            str_set->insert(*str);
+        }
+    }
 
     int64_t prevMin = getMinimumTimestampNs();
     mLastUpdatePerConfigKey[key] = timestamp;
@@ -430,13 +557,13 @@ void UidMap::appendUidMap(const int64_t& timestamp, const ConfigKey& key, std::s
         int64_t cutoff_nanos = newMin;
         for (auto it_changes = mChanges.begin(); it_changes != mChanges.end();) {
             if (it_changes->timestampNs < cutoff_nanos) {
-                mBytesUsed -= kBytesChangeRecord;
-                it_changes = mChanges.erase(it_changes);
+                it_changes = eraseChangeLocked(it_changes);
             } else {
                 ++it_changes;
             }
         }
     }
+    ensureBytesUsedBelowLimit();
     StatsdStats::getInstance().setCurrentUidMapMemory(mBytesUsed);
     StatsdStats::getInstance().setUidMapChanges(mChanges.size());
 }
@@ -447,8 +574,8 @@ void UidMap::printUidMap(int out) const {
     for (const auto& kv : mMap) {
         if (!kv.second.deleted) {
             dprintf(out, "%s, v%" PRId64 ", %s, %s (%i)\n", kv.first.second.c_str(),
-                    kv.second.versionCode, kv.second.versionString.c_str(),
-                    kv.second.installer.c_str(), kv.first.first);
+                    kv.second.versionCode, kv.second.versionString->c_str(),
+                    kv.second.installer->c_str(), kv.first.first);
         }
     }
 }
@@ -32,6 +32,7 @@
 #include <set>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 
 using namespace android;
 using namespace std;
@@ -42,17 +43,19 @@ namespace android {
 namespace os {
 namespace statsd {
 
+// The strings below point into UidMap::mStringPool. Version strings and installers are shared by
+// most packages, so each distinct value is only stored once.
 struct AppData {
     int64_t versionCode;
-    string versionString;
-    string installer;
+    const string* versionString;
+    const string* installer;
     bool deleted;
 
     // Empty constructor needed for unordered map.
-    AppData() {
+    AppData() : versionString(nullptr), installer(nullptr) {
     }
 
-    AppData(const int64_t v, const string& versionString, const string& installer)
+    AppData(const int64_t v, const string* versionString, const string* installer)
         : versionCode(v), versionString(versionString), installer(installer), deleted(false){};
 };
 
@@ -61,16 +64,16 @@ struct AppData {
 struct ChangeRecord {
     const bool deletion;
     const int64_t timestampNs;
-    const string package;
+    const string* package;
     const int32_t uid;
     const int64_t version;
     const int64_t prevVersion;
-    const string versionString;
-    const string prevVersionString;
+    const string* versionString;
+    const string* prevVersionString;
 
-    ChangeRecord(const bool isDeletion, const int64_t timestampNs, const string& package,
-                 const int32_t uid, const int64_t version, const string versionString,
-                 const int64_t prevVersion, const string prevVersionString)
+    ChangeRecord(const bool isDeletion, const int64_t timestampNs, const string* package,
+                 const int32_t uid, const int64_t version, const string* versionString,
+                 const int64_t prevVersion, const string* prevVersionString)
         : deletion(isDeletion),
           timestampNs(timestampNs),
           package(package),
@@ -169,6 +172,27 @@ private:
                                    bool includeInstaller, const std::set<int32_t>& interestingUids,
                                    std::set<string>* str_set, ProtoOutputStream* proto);
 
+    // Writes the fields of one PackageInfo. If hashStrings, the strings are written as hashes and
+    // added to usedStrings.
+    void writePackageInfoLocked(const std::pair<int, string>& app, const AppData& appData,
+                                bool includeVersionStrings, bool includeInstaller,
+                                bool hashStrings, std::vector<const string*>* usedStrings,
+                                ProtoOutputStream* proto) const;
+
+    // Returns the pooled copy of str.
+    const string* internLocked(const string& str);
+
+    void addChangeLocked(const ChangeRecord& record);
+
+    // Removes the change at it and returns the next one.
+    std::list<ChangeRecord>::iterator eraseChangeLocked(std::list<ChangeRecord>::iterator it);
+
+    // Must be called after mMap is modified. Drops the snapshot cache and the pooled strings that
+    // are no longer used.
+    void onMapChangedLocked();
+
+    void updateBytesUsedLocked();
+
     mutable mutex mMutex;
     mutable mutex mIsolatedMutex;
 
@@ -188,6 +212,42 @@ private:
     // Record the changes that can be provided with the uploads.
     std::list<ChangeRecord> mChanges;
 
+    // Interned version strings, installers and change record strings. Nodes of an unordered_set
+    // don't move, so the pointers stay valid until the string is swept by onMapChangedLocked.
+    std::unordered_set<string> mStringPool;
+
+    // Number of fields in mChanges pointing to each pooled string.
+    std::unordered_map<const string*, int> mChangeStringRefs;
+
+    // Total size of the strings in mChangeStringRefs.
+    size_t mChangeStringBytes = 0;
+
+    // The package infos of a full snapshot, encoded once per version of mMap and shared by the
+    // reports of every config with the same options.
+    struct SnapshotCache {
+        bool valid = false;
+        // Concatenated PackageInfo messages; ends[i] is the end offset of the i-th.
+        string bytes;
+        std::vector<size_t> ends;
+        // Strings that are hashed in bytes, to be added to the report's str_set.
+        std::vector<const string*> strings;
+    };
+
+    // Indexed by snapshotCacheIndex().
+    SnapshotCache mSnapshotCaches[8];
+
+    static int snapshotCacheIndex(bool includeVersionStrings, bool includeInstaller,
+                                  bool hashStrings) {
+        return (includeVersionStrings ? 4 : 0) | (includeInstaller ? 2 : 0) | (hashStrings ? 1 : 0);
+    }
+
+    const SnapshotCache& getSnapshotCacheLocked(bool includeVersionStrings, bool includeInstaller,
+                                                bool hashStrings);
+
+    void clearSnapshotCachesLocked();
+
+    size_t getSnapshotCacheBytesLocked() const;
+
     // Store which uid and apps represent deleted ones.
     std::list<std::pair<int, string>> mDeletedApps;
 
@@ -202,16 +262,17 @@ private:
     // Returns the minimum value from mConfigKeys.
     int64_t getMinimumTimestampNs();
 
-    // If our current used bytes is above the limit, then we clear out the earliest snapshot. If
-    // there are no more snapshots, then we clear out the earliest delta. We repeat the deletions
-    // until the memory consumed by mOutput is below the specified limit.
+    // If our current used bytes is above the limit, then we drop the snapshot cache, which can be
+    // rebuilt. If that's not enough, then we clear out the earliest delta. We repeat the deletions
+    // until the memory consumed is below the specified limit.
     void ensureBytesUsedBelowLimit();
 
     // Override used for testing the max memory allowed by uid map. 0 means we use the value
     // specified in StatsdStats.h with the rest of the guardrails.
     size_t maxBytesOverride = 0;
 
-    // Cache the size of mOutput;
+    // Cache of the memory used by the change records, the pooled strings they point to and the
+    // snapshot cache.
     size_t mBytesUsed;
 
     // Allows unit-test to access private methods.
@@ -221,6 +282,8 @@ private:
     FRIEND_TEST(UidMapTest, TestOutputIncludesAtLeastOneSnapshot);
     FRIEND_TEST(UidMapTest, TestMemoryComputed);
     FRIEND_TEST(UidMapTest, TestMemoryGuardrail);
+    FRIEND_TEST(UidMapTest, TestStringsInterned);
+    FRIEND_TEST(UidMapTest, TestSnapshotCache);
 };
 
 }  // namespace statsd
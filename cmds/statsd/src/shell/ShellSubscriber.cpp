@@ -19,6 +19,7 @@
 #include "ShellSubscriber.h"
 
 #include <android-base/file.h>
+#include <algorithm>
 #include "matchers/matcher_util.h"
 #include "stats_log_util.h"
 
@@ -29,6 +30,7 @@ namespace os {
 namespace statsd {
 
 const static int FIELD_ID_ATOM = 1;
+const static int FIELD_ID_DROPPED_ATOM_COUNT = 2;
 
 void ShellSubscriber::startNewSubscription(int in, int out, sp<IResultReceiver> resultReceiver,
                                            int timeoutSec) {
@@ -95,11 +97,39 @@ void ShellSubscriber::updateConfig(const ShellSubscription& config) {
         std::thread puller([token, minInterval, this] { startPull(token, minInterval); });
         puller.detach();
     }
+
+    // Atoms still queued for the previous subscription are not written.
+    mDroppedAtoms += mRingCount;
+    mRingHead = 0;
+    mRingCount = 0;
+    mStreaming = config.has_streaming();
+    if (mStreaming) {
+        const ShellStreamingOptions& options = config.streaming();
+        mRing.resize(std::max(options.buffer_atoms(), 1));
+        mMaxBatchAtoms = std::max(options.max_batch_atoms(), 1);
+        mFlushIntervalMillis = std::max(options.flush_interval_millis(), 1);
+        mStreamToken = token;
+        // Same as the puller, this thread terminates after it detects the token is different.
+        std::thread writer([token, this] { startStreaming(token); });
+        writer.detach();
+    } else {
+        mRing.clear();
+        mStreamToken = 0;
+    }
+    mStreamCv.notify_all();
 }
 
 void ShellSubscriber::writeToOutputLocked(const vector<std::shared_ptr<LogEvent>>& data,
                                           const SimpleAtomMatcher& matcher) {
     if (mOutput == 0) return;
+    if (mStreaming) {
+        for (const auto& event : data) {
+            if (matchesSimple(*mUidMap, matcher, *event)) {
+                enqueueLocked(*event);
+            }
+        }
+        return;
+    }
     int count = 0;
     mProto.clear();
     for (const auto& event : data) {
@@ -125,6 +155,74 @@ void ShellSubscriber::writeToOutputLocked(const vector<std::shared_ptr<LogEvent>
     mProto.clear();
 }
 
+void ShellSubscriber::enqueueLocked(const LogEvent& event) {
+    if (mRingCount == mRing.size()) {
+        mDroppedAtoms++;
+        return;
+    }
+    mEncodeProto.clear();
+    event.ToProto(mEncodeProto);
+    mEncodeProto.serializeToString(&mRing[(mRingHead + mRingCount) % mRing.size()]);
+    mEncodeProto.clear();
+    mRingCount++;
+    if (mRingCount >= mMaxBatchAtoms) {
+        mStreamCv.notify_one();
+    }
+}
+
+void ShellSubscriber::startStreaming(int64_t token) {
+    std::vector<std::string> batch;
+    ProtoOutputStream proto;
+    while (1) {
+        int64_t dropped = 0;
+        int out = 0;
+        std::unique_lock<std::mutex> writeLock(mWriteMutex, std::defer_lock);
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mStreamCv.wait_for(lock, std::chrono::milliseconds(mFlushIntervalMillis),
+                               [this, token] {
+                                   return mStreamToken != token || mRingCount >= mMaxBatchAtoms;
+                               });
+            if (mStreamToken != token || mOutput <= 0) {
+                VLOG("Streaming thread %lld done!", (long long)token);
+                return;
+            }
+            if (mRingCount == 0 && mDroppedAtoms == 0) {
+                continue;
+            }
+            // Swap the encoded atoms out so that the ring keeps the emptied strings' buffers.
+            const size_t count = std::min(mRingCount, mMaxBatchAtoms);
+            batch.resize(count);
+            for (size_t i = 0; i < count; i++) {
+                batch[i].swap(mRing[mRingHead]);
+                mRingHead = (mRingHead + 1) % mRing.size();
+            }
+            mRingCount -= count;
+            dropped = mDroppedAtoms;
+            mDroppedAtoms = 0;
+            out = mOutput;
+            writeLock.lock();
+        }
+
+        proto.clear();
+        for (const auto& atom : batch) {
+            proto.write(util::FIELD_TYPE_MESSAGE | util::FIELD_COUNT_REPEATED | FIELD_ID_ATOM,
+                        atom.data(), atom.size());
+        }
+        if (dropped > 0) {
+            proto.write(util::FIELD_TYPE_INT64 | FIELD_ID_DROPPED_ATOM_COUNT, (long long)dropped);
+            VLOG("shell subscriber dropped %lld atoms", (long long)dropped);
+        }
+        // First write the payload size.
+        size_t bufferSize = proto.size();
+        write(out, &bufferSize, sizeof(bufferSize));
+        VLOG("%zu atoms, proto size: %zu", batch.size(), bufferSize);
+        // Then write the payload.
+        proto.flush(out);
+        proto.clear();
+    }
+}
+
 void ShellSubscriber::startPull(int64_t token, int64_t intervalMillis) {
     while (1) {
         int64_t nowMillis = getElapsedRealtimeMillis();
@@ -193,6 +291,13 @@ void ShellSubscriber::cleanUpLocked() {
     mPushedMatchers.clear();
     mPulledInfo.clear();
     mPullToken = 0;
+    mStreaming = false;
+    mRing.clear();
+    mRingHead = 0;
+    mRingCount = 0;
+    mDroppedAtoms = 0;
+    mStreamToken = 0;
+    mStreamCv.notify_all();
     VLOG("done clean up");
 }
 
@@ -205,6 +310,10 @@ void ShellSubscriber::onLogEvent(const LogEvent& event) {
     for (const auto& matcher : mPushedMatchers) {
         if (matchesSimple(*mUidMap, matcher, event)) {
             VLOG("%s", event.ToString().c_str());
+            if (mStreaming) {
+                enqueueLocked(event);
+                break;
+            }
             uint64_t atomToken = mProto.start(util::FIELD_TYPE_MESSAGE |
                                               util::FIELD_COUNT_REPEATED | FIELD_ID_ATOM);
             event.ToProto(mProto);
@@ -227,6 +336,10 @@ void ShellSubscriber::binderDied(const wp<IBinder>& who) {
         std::lock_guard<std::mutex> lock(mMutex);
         cleanUpLocked();
     }
+    // Wait for a streaming write already in progress; no new one starts after the clean up.
+    {
+        std::lock_guard<std::mutex> writeLock(mWriteMutex);
+    }
     mShellDied.notify_all();
 }
 
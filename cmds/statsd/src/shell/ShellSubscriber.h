@@ -56,6 +56,11 @@ namespace statsd {
  *
  * Only one shell subscriber allowed at a time, because each shell subscriber blocks one thread
  * until it exits.
+ *
+ * By default each match is written right away on the thread that found it. A subscription with
+ * streaming options instead encodes matches into a bounded ring buffer that a writer thread
+ * drains in batches, one ShellData per batch. When the buffer is full new matches are dropped
+ * and the next ShellData carries the number dropped.
  */
 class ShellSubscriber : public virtual IBinder::DeathRecipient {
 public:
@@ -92,6 +97,12 @@ private:
     void writeToOutputLocked(const vector<std::shared_ptr<LogEvent>>& data,
                              const SimpleAtomMatcher& matcher);
 
+    // Encodes the event as an Atom and queues it for the streaming writer.
+    void enqueueLocked(const LogEvent& event);
+
+    // Writer thread of the streaming mode, runs until mStreamToken changes.
+    void startStreaming(int64_t token);
+
     sp<UidMap> mUidMap;
 
     sp<StatsPullerManager> mPullerMgr;
@@ -113,6 +124,23 @@ private:
     std::vector<PullInfo> mPulledInfo;
 
     int64_t mPullToken = 0;  // A unique token to identify a puller thread.
+
+    // Streaming mode state, guarded by mMutex.
+    bool mStreaming = false;
+    // Ring buffer of encoded atoms. Slots keep their capacity so steady state doesn't allocate.
+    std::vector<std::string> mRing;
+    size_t mRingHead = 0;
+    size_t mRingCount = 0;
+    size_t mMaxBatchAtoms = 0;
+    int64_t mFlushIntervalMillis = 0;
+    int64_t mDroppedAtoms = 0;
+    int64_t mStreamToken = 0;  // A unique token to identify a writer thread.
+    std::condition_variable mStreamCv;
+    android::util::ProtoOutputStream mEncodeProto;
+
+    // Held by the writer thread while it writes to mOutput, so that binderDied can wait for an
+    // ongoing write before the fd is closed. Acquired after mMutex, never before.
+    std::mutex mWriteMutex;
 };
 
 }  // namespace statsd
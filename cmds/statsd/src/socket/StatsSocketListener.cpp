@@ -17,8 +17,10 @@
 #include "Log.h"
 
 #include <ctype.h>
+#include <errno.h>
 #include <limits.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/cdefs.h>
 #include <sys/prctl.h>
 #include <sys/socket.h>
@@ -41,8 +43,39 @@ namespace statsd {
 
 static const int kLogMsgHeaderSize = 28;
 
-StatsSocketListener::StatsSocketListener(std::shared_ptr<LogEventQueue> queue)
-    : SocketListener(getLogSocket(), false /*start listen*/), mQueue(queue) {
+// Offsets in a stats log payload, which is an event list of [elapsed timestamp, atom id, ...]
+// preceded by the uint32 event tag.
+static const size_t kListTypeOffset = sizeof(uint32_t);
+static const size_t kTimestampTypeOffset = kListTypeOffset + 2;
+static const size_t kTimestampOffset = kTimestampTypeOffset + 1;
+static const size_t kAtomIdTypeOffset = kTimestampOffset + sizeof(int64_t);
+static const size_t kAtomIdOffset = kAtomIdTypeOffset + 1;
+
+// A datagram coalesced by a client's write buffer (see android_util_StatsLog.cpp) has this in
+// place of the event tag, followed by records of a uint16 payload size and the payload of one
+// atom as it would have been sent on its own. No event list payload starts with this tag.
+static const uint32_t kCoalescedDatagramTag = 0xffff5342;
+
+// Reads the atom id and timestamp of a payload without decoding it. Returns false if the payload
+// does not start the way LogEvent expects, in which case it has to be decoded to find out.
+static bool peekAtomId(const char* payload, size_t size, int32_t* atomId,
+                       int64_t* elapsedTimestampNs) {
+    if (size < kAtomIdOffset + sizeof(int32_t) || payload[kListTypeOffset] != EVENT_TYPE_LIST ||
+        payload[kTimestampTypeOffset] != EVENT_TYPE_LONG ||
+        payload[kAtomIdTypeOffset] != EVENT_TYPE_INT) {
+        return false;
+    }
+    memcpy(elapsedTimestampNs, payload + kTimestampOffset, sizeof(int64_t));
+    memcpy(atomId, payload + kAtomIdOffset, sizeof(int32_t));
+    return true;
+}
+
+StatsSocketListener::StatsSocketListener(std::shared_ptr<LogEventQueue> queue,
+                                         std::shared_ptr<LogEventFilter> filter)
+    : SocketListener(getLogSocket(), false /*start listen*/), mQueue(queue), mFilter(filter) {
+    if (mFilter != nullptr) {
+        mBatch.reset(new BatchSlot[kMaxBatchDatagrams]);
+    }
 }
 
 StatsSocketListener::~StatsSocketListener() {
@@ -65,6 +98,9 @@ bool StatsSocketListener::onDataAvailable(SocketClient* cli) {
     };
 
     int socket = cli->getSocket();
+    if (mFilter != nullptr) {
+        return onDataAvailableBatched(socket);
+    }
 
     // To clear the entire buffer is secure/safe, but this contributes to 1.68%
     // overhead under logging load. We are safe because we check counts, but
@@ -98,6 +134,118 @@ bool StatsSocketListener::onDataAvailable(SocketClient* cli) {
     char* ptr = ((char*)buffer) + sizeof(android_log_header_t);
     n -= sizeof(android_log_header_t);
 
+    if (handleLogLoss(ptr, n, cred) || handleBatch(ptr, n, cred)) {
+        return true;
+    }
+
+    log_msg msg;
+    memcpy(msg.buf + kLogMsgHeaderSize, ptr, n + 1);
+    pushEvent(&msg, n, cred);
+    return true;
+}
+
+bool StatsSocketListener::onDataAvailableBatched(int socket) {
+    struct mmsghdr hdrs[kMaxBatchDatagrams];
+    struct iovec iovs[kMaxBatchDatagrams];
+    for (size_t i = 0; i < kMaxBatchDatagrams; i++) {
+        // The android_log_header_t lands just before the payload position of log_msg, over the
+        // tail of msg.entry that pushEvent() fills in afterwards, so the payload is never moved.
+        // Leave room for the null terminator like onDataAvailable.
+        log_msg& msg = mBatch[i].msg;
+        iovs[i] = {msg.buf + kLogMsgHeaderSize - sizeof(android_log_header_t),
+                   sizeof(android_log_header_t) + LOGGER_ENTRY_MAX_PAYLOAD};
+        hdrs[i].msg_hdr = {
+                NULL, 0, &iovs[i], 1, mBatch[i].control, sizeof(mBatch[i].control), 0,
+        };
+        hdrs[i].msg_len = 0;
+    }
+
+    int count = recvmmsg(socket, hdrs, kMaxBatchDatagrams, MSG_DONTWAIT, nullptr);
+    if (count <= 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+
+    for (int i = 0; i < count; i++) {
+        ssize_t n = hdrs[i].msg_len;
+        if (n <= (ssize_t)(sizeof(android_log_header_t))) {
+            continue;
+        }
+        n -= sizeof(android_log_header_t);
+        log_msg& msg = mBatch[i].msg;
+        char* ptr = (char*)msg.buf + kLogMsgHeaderSize;
+        ptr[n] = 0;
+
+        struct ucred* cred = NULL;
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&hdrs[i].msg_hdr);
+        while (cmsg != NULL) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_CREDENTIALS) {
+                cred = (struct ucred*)CMSG_DATA(cmsg);
+                break;
+            }
+            cmsg = CMSG_NXTHDR(&hdrs[i].msg_hdr, cmsg);
+        }
+        struct ucred fake_cred;
+        if (cred == NULL) {
+            cred = &fake_cred;
+            cred->pid = 0;
+            cred->uid = DEFAULT_OVERFLOWUID;
+        }
+
+        if (handleLogLoss(ptr, n, cred) || handleBatch(ptr, n, cred)) {
+            continue;
+        }
+        filterAndPushEvent(&msg, n, cred);
+    }
+    return true;
+}
+
+void StatsSocketListener::filterAndPushEvent(log_msg* msg, ssize_t n, const struct ucred* cred) {
+    // Atoms that no config uses are only counted, like StatsLogProcessor would.
+    int32_t atomId;
+    int64_t elapsedTimestampNs;
+    if (mFilter != nullptr &&
+        peekAtomId((const char*)msg->buf + kLogMsgHeaderSize, n, &atomId, &elapsedTimestampNs) &&
+        !mFilter->isAtomIdWanted(atomId)) {
+        StatsdStats::getInstance().noteAtomLogged(atomId, elapsedTimestampNs / NS_PER_SEC);
+        return;
+    }
+    pushEvent(msg, n, cred);
+}
+
+bool StatsSocketListener::handleBatch(const char* ptr, ssize_t n, const struct ucred* cred) {
+    uint32_t tag;
+    if (n < (ssize_t)sizeof(tag)) {
+        return false;
+    }
+    memcpy(&tag, ptr, sizeof(tag));
+    if (tag != kCoalescedDatagramTag) {
+        return false;
+    }
+
+    if (mUnpackMsg == nullptr) {
+        mUnpackMsg.reset(new log_msg());
+    }
+    char* payload = (char*)mUnpackMsg->buf + kLogMsgHeaderSize;
+
+    const char* pos = ptr + sizeof(tag);
+    const char* end = ptr + n;
+    while (end - pos >= (ssize_t)sizeof(uint16_t)) {
+        uint16_t size;
+        memcpy(&size, pos, sizeof(size));
+        pos += sizeof(size);
+        if (size == 0 || size > end - pos || size > LOGGER_ENTRY_MAX_PAYLOAD) {
+            ALOGE("Malformed coalesced datagram from uid %d", cred->uid);
+            break;
+        }
+        memcpy(payload, pos, size);
+        payload[size] = 0;
+        pos += size;
+        filterAndPushEvent(mUnpackMsg.get(), size, cred);
+    }
+    return true;
+}
+
+bool StatsSocketListener::handleLogLoss(char* ptr, ssize_t n, const struct ucred* cred) {
     // When a log failed to write to statsd socket (e.g., due ot EBUSY), a special message would
     // be sent to statsd when the socket communication becomes available again.
     // The format is android_log_event_int_t with a single integer in the payload indicating the
@@ -123,23 +271,20 @@ bool StatsSocketListener::onDataAvailable(SocketClient* cli) {
             return true;
         }
     }
+    return false;
+}
 
-    log_msg msg;
-
-    msg.entry.len = n;
-    msg.entry.hdr_size = kLogMsgHeaderSize;
-    msg.entry.sec = time(nullptr);
-    msg.entry.pid = cred->pid;
-    msg.entry.uid = cred->uid;
-
-    memcpy(msg.buf + kLogMsgHeaderSize, ptr, n + 1);
+void StatsSocketListener::pushEvent(log_msg* msg, ssize_t n, const struct ucred* cred) {
+    msg->entry.len = n;
+    msg->entry.hdr_size = kLogMsgHeaderSize;
+    msg->entry.sec = time(nullptr);
+    msg->entry.pid = cred->pid;
+    msg->entry.uid = cred->uid;
 
     int64_t oldestTimestamp;
-    if (!mQueue->push(std::make_unique<LogEvent>(msg), &oldestTimestamp)) {
+    if (!mQueue->push(std::make_unique<LogEvent>(*msg), &oldestTimestamp)) {
         StatsdStats::getInstance().noteEventQueueOverflow(oldestTimestamp);
     }
-
-    return true;
 }
 
 int StatsSocketListener::getLogSocket() {
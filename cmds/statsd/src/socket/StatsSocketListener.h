@@ -15,8 +15,10 @@
  */
 #pragma once
 
+#include <sys/socket.h>
 #include <sysutils/SocketListener.h>
 #include <utils/RefBase.h>
+#include "logd/LogEventFilter.h"
 #include "logd/LogEventQueue.h"
 
 // DEFAULT_OVERFLOWUID is defined in linux/highuid.h, which is not part of
@@ -35,7 +37,12 @@ namespace statsd {
 
 class StatsSocketListener : public SocketListener, public virtual android::RefBase {
 public:
-    explicit StatsSocketListener(std::shared_ptr<LogEventQueue> queue);
+    /**
+     * With a filter, datagrams are read in batches with recvmmsg straight into preallocated
+     * log_msg buffers, and the events of atoms the filter doesn't want are only counted.
+     */
+    explicit StatsSocketListener(std::shared_ptr<LogEventQueue> queue,
+                                 std::shared_ptr<LogEventFilter> filter = nullptr);
 
     virtual ~StatsSocketListener();
 
@@ -43,11 +50,44 @@ protected:
     virtual bool onDataAvailable(SocketClient* cli);
 
 private:
+    static const size_t kMaxBatchDatagrams = 16;
+
+    struct BatchSlot {
+        // + 1 in log_msg::buf keeps room for the null terminator.
+        log_msg msg;
+        alignas(4) char control[CMSG_SPACE(sizeof(struct ucred))];
+    };
+
     static int getLogSocket();
+
+    bool onDataAvailableBatched(int socket);
+
+    // Handles the message sent when logs were dropped, returns false for any other payload.
+    bool handleLogLoss(char* ptr, ssize_t n, const struct ucred* cred);
+
+    // Queues each atom of a datagram that a client's write buffer coalesced, returns false if
+    // the payload isn't such a batch.
+    bool handleBatch(const char* ptr, ssize_t n, const struct ucred* cred);
+
+    // Queues the payload at msg->buf + kLogMsgHeaderSize, or only counts it if the filter
+    // doesn't want its atom.
+    void filterAndPushEvent(log_msg* msg, ssize_t n, const struct ucred* cred);
+
+    // Decodes the payload of n bytes at msg->buf + kLogMsgHeaderSize and queues it.
+    void pushEvent(log_msg* msg, ssize_t n, const struct ucred* cred);
+
     /**
      * Who is going to get the events when they're read.
      */
     std::shared_ptr<LogEventQueue> mQueue;
+
+    std::shared_ptr<LogEventFilter> mFilter;
+
+    // kMaxBatchDatagrams buffers reused by every batched read, null without a filter.
+    std::unique_ptr<BatchSlot[]> mBatch;
+
+    // Buffer the atoms of a coalesced datagram are unpacked into, allocated on first use.
+    std::unique_ptr<log_msg> mUnpackMsg;
 };
 }  // namespace statsd
 }  // namespace os
@@ -17,6 +17,7 @@
 #include "hash.h"
 #include "stats_log_util.h"
 
+#include <android-base/file.h>
 #include <logd/LogEvent.h>
 #include <private/android_filesystem_config.h>
 #include <utils/Log.h>
@@ -28,6 +29,8 @@
 using android::util::AtomsInfo;
 using android::util::FIELD_COUNT_REPEATED;
 using android::util::FIELD_TYPE_BOOL;
+using android::util::FIELD_TYPE_BYTES;
+using android::util::FIELD_TYPE_DOUBLE;
 using android::util::FIELD_TYPE_FIXED64;
 using android::util::FIELD_TYPE_FLOAT;
 using android::util::FIELD_TYPE_INT32;
@@ -53,6 +56,16 @@ const int DIMENSIONS_VALUE_VALUE_STR_HASH = 8;
 
 const int DIMENSIONS_VALUE_TUPLE_VALUE = 1;
 
+// for SnapshotDimensionValue proto
+const int FIELD_ID_SNAPSHOT_DIMENSION_TAG = 1;
+const int FIELD_ID_SNAPSHOT_DIMENSION_FIELD = 2;
+const int FIELD_ID_SNAPSHOT_DIMENSION_VALUE_INT = 3;
+const int FIELD_ID_SNAPSHOT_DIMENSION_VALUE_LONG = 4;
+const int FIELD_ID_SNAPSHOT_DIMENSION_VALUE_FLOAT = 5;
+const int FIELD_ID_SNAPSHOT_DIMENSION_VALUE_DOUBLE = 6;
+const int FIELD_ID_SNAPSHOT_DIMENSION_VALUE_STR = 7;
+const int FIELD_ID_SNAPSHOT_DIMENSION_VALUE_STORAGE = 8;
+
 // for PulledAtomStats proto
 const int FIELD_ID_PULLED_ATOM_STATS = 10;
 const int FIELD_ID_PULL_ATOM_ID = 1;
@@ -72,6 +85,8 @@ const int FIELD_ID_STATS_COMPANION_BINDER_TRANSACTION_FAILED = 14;
 const int FIELD_ID_EMPTY_DATA = 15;
 const int FIELD_ID_PULL_REGISTERED_COUNT = 16;
 const int FIELD_ID_PULL_UNREGISTERED_COUNT = 17;
+const int FIELD_ID_PULL_TIME_HISTOGRAM = 18;
+const int FIELD_ID_PULL_DEADLINE_EXCEEDED = 19;
 // for AtomMetricStats proto
 const int FIELD_ID_ATOM_METRIC_STATS = 17;
 const int FIELD_ID_METRIC_ID = 1;
@@ -123,12 +138,13 @@ void writeDimensionToProtoHelper(const std::vector<FieldValue>& dims, size_t* in
                 case STRING:
                     if (str_set == nullptr) {
                         protoOutput->write(FIELD_TYPE_STRING | DIMENSIONS_VALUE_VALUE_STR,
-                                           dim.mValue.str_value);
+                                           dim.mValue.str_value.c_str(),
+                                           dim.mValue.str_value.size());
                     } else {
-                        str_set->insert(dim.mValue.str_value);
+                        str_set->insert(dim.mValue.str_value.str());
                         protoOutput->write(
                                 FIELD_TYPE_UINT64 | DIMENSIONS_VALUE_VALUE_STR_HASH,
-                                (long long)Hash64(dim.mValue.str_value));
+                                (long long)dim.mValue.str_value.hash());
                     }
                     break;
                 default:
@@ -190,12 +206,13 @@ void writeDimensionLeafToProtoHelper(const std::vector<FieldValue>& dims,
                 case STRING:
                     if (str_set == nullptr) {
                         protoOutput->write(FIELD_TYPE_STRING | DIMENSIONS_VALUE_VALUE_STR,
-                                           dim.mValue.str_value);
+                                           dim.mValue.str_value.c_str(),
+                                           dim.mValue.str_value.size());
                     } else {
-                        str_set->insert(dim.mValue.str_value);
+                        str_set->insert(dim.mValue.str_value.str());
                         protoOutput->write(
                                 FIELD_TYPE_UINT64 | DIMENSIONS_VALUE_VALUE_STR_HASH,
-                                (long long)Hash64(dim.mValue.str_value));
+                                (long long)dim.mValue.str_value.hash());
                     }
                     break;
                 default:
@@ -296,6 +313,81 @@ void writeDimensionPathToProto(const std::vector<Matcher>& fieldMatchers,
     protoOutput->end(topToken);
 }
 
+void writeDimensionToSnapshotProto(const HashableDimensionKey& dimension, const int fieldId,
+                                   ProtoOutputStream* protoOutput) {
+    for (const auto& fieldValue : dimension.getValues()) {
+        uint64_t token = protoOutput->start(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | fieldId);
+        protoOutput->write(FIELD_TYPE_INT32 | FIELD_ID_SNAPSHOT_DIMENSION_TAG,
+                           fieldValue.mField.getTag());
+        protoOutput->write(FIELD_TYPE_INT32 | FIELD_ID_SNAPSHOT_DIMENSION_FIELD,
+                           fieldValue.mField.getField());
+        const Value& value = fieldValue.mValue;
+        switch (value.getType()) {
+            case INT:
+                protoOutput->write(FIELD_TYPE_INT32 | FIELD_ID_SNAPSHOT_DIMENSION_VALUE_INT,
+                                   value.int_value);
+                break;
+            case LONG:
+                protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_SNAPSHOT_DIMENSION_VALUE_LONG,
+                                   (long long)value.long_value);
+                break;
+            case FLOAT:
+                protoOutput->write(FIELD_TYPE_FLOAT | FIELD_ID_SNAPSHOT_DIMENSION_VALUE_FLOAT,
+                                   value.float_value);
+                break;
+            case DOUBLE:
+                protoOutput->write(FIELD_TYPE_DOUBLE | FIELD_ID_SNAPSHOT_DIMENSION_VALUE_DOUBLE,
+                                   value.double_value);
+                break;
+            case STRING:
+                protoOutput->write(FIELD_TYPE_STRING | FIELD_ID_SNAPSHOT_DIMENSION_VALUE_STR,
+                                   value.str_value.c_str(), value.str_value.size());
+                break;
+            case STORAGE:
+                protoOutput->write(FIELD_TYPE_BYTES | FIELD_ID_SNAPSHOT_DIMENSION_VALUE_STORAGE,
+                                   value.storage_value.c_str(), value.storage_value.size());
+                break;
+            default:
+                break;
+        }
+        protoOutput->end(token);
+    }
+}
+
+HashableDimensionKey dimensionFromSnapshotProto(
+        const google::protobuf::RepeatedPtrField<SnapshotDimensionValue>& values) {
+    HashableDimensionKey dimension;
+    for (const auto& snapshotValue : values) {
+        Field field(snapshotValue.tag(), snapshotValue.field());
+        switch (snapshotValue.value_case()) {
+            case SnapshotDimensionValue::kValueInt:
+                dimension.addValue(FieldValue(field, Value(snapshotValue.value_int())));
+                break;
+            case SnapshotDimensionValue::kValueLong:
+                dimension.addValue(FieldValue(field, Value((int64_t)snapshotValue.value_long())));
+                break;
+            case SnapshotDimensionValue::kValueFloat:
+                dimension.addValue(FieldValue(field, Value(snapshotValue.value_float())));
+                break;
+            case SnapshotDimensionValue::kValueDouble:
+                dimension.addValue(FieldValue(field, Value(snapshotValue.value_double())));
+                break;
+            case SnapshotDimensionValue::kValueStr:
+                dimension.addValue(FieldValue(field, Value(snapshotValue.value_str())));
+                break;
+            case SnapshotDimensionValue::kValueStorage: {
+                const std::string& bytes = snapshotValue.value_storage();
+                dimension.addValue(FieldValue(
+                        field, Value(std::vector<uint8_t>(bytes.begin(), bytes.end()))));
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    return dimension;
+}
+
 // Supported Atoms format
 // XYZ_Atom {
 //     repeated SubMsg field_1 = 1;
@@ -322,10 +414,9 @@ void writeDimensionPathToProto(const std::vector<Matcher>& fieldMatchers,
 // }
 //
 //
-void writeFieldValueTreeToStreamHelper(int tagId, const std::vector<FieldValue>& dims,
+void writeFieldValueTreeToStreamHelper(int tagId, const FieldValue* dims, size_t count,
                                        size_t* index, int depth, int prefix,
                                        ProtoOutputStream* protoOutput) {
-    size_t count = dims.size();
     while (*index < count) {
         const auto& dim = dims[*index];
         const int valueDepth = dim.mField.getDepth();
@@ -371,7 +462,9 @@ void writeFieldValueTreeToStreamHelper(int tagId, const std::vector<FieldValue>&
                                                dim.mValue.str_value.length());
                         }
                     } else {
-                        protoOutput->write(FIELD_TYPE_STRING | fieldNum, dim.mValue.str_value);
+                        protoOutput->write(FIELD_TYPE_STRING | fieldNum,
+                                           dim.mValue.str_value.c_str(),
+                                           dim.mValue.str_value.size());
                     }
                     break;
                 }
@@ -395,7 +488,7 @@ void writeFieldValueTreeToStreamHelper(int tagId, const std::vector<FieldValue>&
             }
             // Directly jump to the leaf value because the repeated position field is implied
             // by the position of the sub msg in the parent field.
-            writeFieldValueTreeToStreamHelper(tagId, dims, index, valueDepth,
+            writeFieldValueTreeToStreamHelper(tagId, dims, count, index, valueDepth,
                                               dim.mField.getPrefix(valueDepth), protoOutput);
             if (msg_token != 0) {
                 protoOutput->end(msg_token);
@@ -409,10 +502,15 @@ void writeFieldValueTreeToStreamHelper(int tagId, const std::vector<FieldValue>&
 
 void writeFieldValueTreeToStream(int tagId, const std::vector<FieldValue>& values,
                                  util::ProtoOutputStream* protoOutput) {
+    writeFieldValueTreeToStream(tagId, values.data(), values.size(), protoOutput);
+}
+
+void writeFieldValueTreeToStream(int tagId, const FieldValue* values, size_t count,
+                                 util::ProtoOutputStream* protoOutput) {
     uint64_t atomToken = protoOutput->start(FIELD_TYPE_MESSAGE | tagId);
 
     size_t index = 0;
-    writeFieldValueTreeToStreamHelper(tagId, values, &index, 0, 0, protoOutput);
+    writeFieldValueTreeToStreamHelper(tagId, values, count, &index, 0, 0, protoOutput);
     protoOutput->end(atomToken);
 }
 
@@ -488,6 +586,12 @@ void writePullerStatsToStream(const std::pair<int, StatsdStats::PulledAtomStats>
                        (long long) pair.second.registeredCount);
     protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_PULL_UNREGISTERED_COUNT,
                        (long long) pair.second.unregisteredCount);
+    protoOutput->write(FIELD_TYPE_INT64 | FIELD_ID_PULL_DEADLINE_EXCEEDED,
+                       (long long)pair.second.pullDeadlineExceeded);
+    for (int i = 0; i < StatsdStats::kPullTimeHistogramBucketCount; i++) {
+        protoOutput->write(FIELD_TYPE_INT64 | FIELD_COUNT_REPEATED | FIELD_ID_PULL_TIME_HISTOGRAM,
+                           (long long)pair.second.pullTimeHistogram[i]);
+    }
     protoOutput->end(token);
 }
 
@@ -564,6 +668,29 @@ int64_t MillisToNano(const int64_t millis) {
     return millis * 1000000;
 }
 
+static size_t encodeVarint(uint64_t value, uint8_t* out) {
+    size_t pos = 0;
+    while (value >= 0x80) {
+        out[pos++] = (uint8_t)((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    out[pos++] = (uint8_t)value;
+    return pos;
+}
+
+size_t lengthDelimitedHeaderSize(uint32_t fieldId, uint64_t size) {
+    uint8_t header[20];
+    return encodeVarint(((uint64_t)fieldId << 3) | 2 /* length-delimited */, header) +
+           encodeVarint(size, header);
+}
+
+bool writeLengthDelimitedHeader(int fd, uint32_t fieldId, uint64_t size) {
+    uint8_t header[20];
+    size_t headerSize = encodeVarint(((uint64_t)fieldId << 3) | 2 /* length-delimited */, header);
+    headerSize += encodeVarint(size, header + headerSize);
+    return android::base::WriteFully(fd, header, headerSize);
+}
+
 }  // namespace statsd
 }  // namespace os
 }  // namespace android
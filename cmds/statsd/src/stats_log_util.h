@@ -20,6 +20,7 @@
 #include "FieldValue.h"
 #include "HashableDimensionKey.h"
 #include "atoms_info.h"
+#include "frameworks/base/cmds/statsd/src/bucket_snapshot.pb.h"
 #include "frameworks/base/cmds/statsd/src/statsd_config.pb.h"
 #include "guardrail/StatsdStats.h"
 
@@ -27,8 +28,14 @@ namespace android {
 namespace os {
 namespace statsd {
 
+// The chunk size of the ProtoOutputStreams for small protos.  The chunks come from a pool shared
+// in the process, so use it rather than inventing a new size.
+const size_t SMALL_PROTO_CHUNK_SIZE = 256;
+
 void writeFieldValueTreeToStream(int tagId, const std::vector<FieldValue>& values,
                                  util::ProtoOutputStream* protoOutput);
+void writeFieldValueTreeToStream(int tagId, const FieldValue* values, size_t count,
+                                 util::ProtoOutputStream* protoOutput);
 void writeDimensionToProto(const HashableDimensionKey& dimension, std::set<string> *str_set,
                            util::ProtoOutputStream* protoOutput);
 
@@ -40,6 +47,15 @@ void writeDimensionLeafNodesToProto(const HashableDimensionKey& dimension,
 void writeDimensionPathToProto(const std::vector<Matcher>& fieldMatchers,
                                util::ProtoOutputStream* protoOutput);
 
+// Writes the values of [dimension] as repeated SnapshotDimensionValue under [fieldId], keeping
+// the encoded fields so that the key can be rebuilt as is.
+void writeDimensionToSnapshotProto(const HashableDimensionKey& dimension, const int fieldId,
+                                   util::ProtoOutputStream* protoOutput);
+
+// Rebuilds a dimension key written by writeDimensionToSnapshotProto.
+HashableDimensionKey dimensionFromSnapshotProto(
+        const google::protobuf::RepeatedPtrField<SnapshotDimensionValue>& values);
+
 // Convert the TimeUnit enum to the bucket size in millis with a guardrail on
 // bucket size.
 int64_t TimeUnitToBucketSizeInMillisGuardrailed(int uid, TimeUnit unit);
@@ -77,6 +93,14 @@ void writePullerStatsToStream(const std::pair<int, StatsdStats::PulledAtomStats>
 void writeAtomMetricStatsToStream(const std::pair<int64_t, StatsdStats::AtomMetricStats> &pair,
                                   util::ProtoOutputStream *protoOutput);
 
+// Returns the size of the tag and length prefix of a length-delimited field with [fieldId]
+// carrying [size] bytes.
+size_t lengthDelimitedHeaderSize(uint32_t fieldId, uint64_t size);
+
+// Writes the tag and length prefix of a length-delimited field with [fieldId] carrying [size]
+// bytes to [fd]. The caller writes the payload right after. Returns false on a write error.
+bool writeLengthDelimitedHeader(int fd, uint32_t fieldId, uint64_t size);
+
 template<class T>
 bool parseProtoOutputStream(util::ProtoOutputStream& protoOutput, T* message) {
     std::string pbBytes;
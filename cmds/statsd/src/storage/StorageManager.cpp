@@ -25,8 +25,14 @@
 #include <android-base/file.h>
 #include <dirent.h>
 #include <private/android_filesystem_config.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
 #include <iostream>
+#include <set>
+#include <thread>
 
 namespace android {
 namespace os {
@@ -102,6 +108,195 @@ static void parseFileName(char* name, FileName* output) {
     output->mIsHistory = (substr != nullptr && strcmp("history", substr) == 0);
 }
 
+// Sizes and names of the files in a directory, so that trimToFit doesn't have to list and stat
+// the directory again on every write. Filled by the first trimToFit of the directory and then
+// kept up to date by every StorageManager function that adds, renames or removes a file there.
+struct IndexedFile {
+    int64_t mTimestampSec;
+    bool mIsHistory;
+    int64_t mSizeBytes;
+};
+
+struct DirIndex {
+    bool mLoaded = false;
+    // Keyed by full path.
+    std::map<string, IndexedFile> mFiles;
+};
+
+static std::mutex sDirIndexMutex;
+static std::map<string, DirIndex> sDirIndexes;
+
+static void splitPath(const string& path, string* dir, string* name) {
+    size_t slash = path.rfind('/');
+    *dir = slash == string::npos ? "" : path.substr(0, slash);
+    *name = slash == string::npos ? path : path.substr(slash + 1);
+}
+
+static void indexFileAdded(const string& path, int64_t sizeBytes) {
+    string dir, name;
+    splitPath(path, &dir, &name);
+    FileName output;
+    parseFileName(&name[0], &output);
+    if (output.mTimestampSec == -1) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(sDirIndexMutex);
+    auto it = sDirIndexes.find(dir);
+    if (it != sDirIndexes.end() && it->second.mLoaded) {
+        it->second.mFiles[path] = {output.mTimestampSec, output.mIsHistory, sizeBytes};
+    }
+}
+
+static void indexFileRemoved(const string& path) {
+    string dir, name;
+    splitPath(path, &dir, &name);
+    std::lock_guard<std::mutex> lock(sDirIndexMutex);
+    auto it = sDirIndexes.find(dir);
+    if (it != sDirIndexes.end()) {
+        it->second.mFiles.erase(path);
+    }
+}
+
+static void indexFileRenamed(const string& from, const string& to, int64_t sizeBytes) {
+    indexFileRemoved(from);
+    indexFileAdded(to, sizeBytes);
+}
+
+namespace {
+
+struct PendingWrite {
+    string mFile;
+    string mDir;
+    ConfigKey mKey;
+    vector<uint8_t> mContent;
+    bool mReplaceable;
+};
+
+// Writes files on a dedicated thread. Everything queued while a batch is being written goes into
+// the next batch, which is synced with one round of fdatasync and trimmed once per directory.
+class WriteBehindQueue {
+public:
+    static WriteBehindQueue& getInstance() {
+        // Never destroyed, the thread runs for the lifetime of the process.
+        static WriteBehindQueue* sInstance = new WriteBehindQueue();
+        return *sInstance;
+    }
+
+    void push(PendingWrite&& write, size_t maxPending) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mSpaceCv.wait(lock, [&] { return mPending.size() < maxPending; });
+        if (write.mReplaceable) {
+            for (auto it = mPending.begin(); it != mPending.end();) {
+                if (it->mReplaceable && it->mKey == write.mKey && it->mDir == write.mDir) {
+                    it = mPending.erase(it);
+                    mCompleted++;
+                } else {
+                    ++it;
+                }
+            }
+        }
+        mPending.push_back(std::move(write));
+        mQueued++;
+        mWorkCv.notify_one();
+    }
+
+    void flush() {
+        std::unique_lock<std::mutex> lock(mMutex);
+        const uint64_t target = mQueued;
+        mDoneCv.wait(lock, [&] { return mCompleted >= target; });
+    }
+
+    void cancel(const std::function<bool(const string& file)>& matches) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        for (auto it = mPending.begin(); it != mPending.end();) {
+            if (matches(it->mFile)) {
+                it = mPending.erase(it);
+                mCompleted++;
+            } else {
+                ++it;
+            }
+        }
+        mSpaceCv.notify_all();
+        mDoneCv.notify_all();
+        // The writer itself deletes files when trimming; it must not wait for itself.
+        if (std::this_thread::get_id() != mThread.get_id()) {
+            mDoneCv.wait(lock, [&] { return !mWriting; });
+        }
+    }
+
+private:
+    WriteBehindQueue() : mThread([this] { threadLoop(); }) {
+    }
+
+    void threadLoop() {
+        while (true) {
+            std::deque<PendingWrite> batch;
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                mWorkCv.wait(lock, [&] { return !mPending.empty(); });
+                batch.swap(mPending);
+                mWriting = true;
+                mSpaceCv.notify_all();
+            }
+            writeBatch(&batch);
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mCompleted += batch.size();
+                mWriting = false;
+                mDoneCv.notify_all();
+            }
+        }
+    }
+
+    static void writeBatch(std::deque<PendingWrite>* batch) {
+        std::vector<android::base::unique_fd> fds;
+        std::set<string> dirs;
+        for (const PendingWrite& write : *batch) {
+            android::base::unique_fd fd(
+                    open(write.mFile.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR));
+            if (fd == -1) {
+                VLOG("Attempt to access %s but failed", write.mFile.c_str());
+                continue;
+            }
+            if (android::base::WriteFully(fd, write.mContent.data(), write.mContent.size())) {
+                VLOG("Successfully wrote %s", write.mFile.c_str());
+                indexFileAdded(write.mFile, write.mContent.size());
+            } else {
+                ALOGE("Failed to write %s", write.mFile.c_str());
+            }
+            if (fchown(fd, AID_STATSD, AID_STATSD)) {
+                VLOG("Failed to chown %s to statsd", write.mFile.c_str());
+            }
+            fds.push_back(std::move(fd));
+            dirs.insert(write.mDir);
+        }
+        for (const auto& fd : fds) {
+            if (fdatasync(fd)) {
+                ALOGE("Failed to sync a statsd file: %s", strerror(errno));
+            }
+        }
+        fds.clear();
+        for (const string& dir : dirs) {
+            StorageManager::trimToFit(dir.c_str());
+        }
+    }
+
+    std::mutex mMutex;
+    std::condition_variable mWorkCv;
+    std::condition_variable mSpaceCv;
+    std::condition_variable mDoneCv;
+    std::deque<PendingWrite> mPending;
+    // True while a batch taken from mPending is being written.
+    bool mWriting = false;
+    // Number of writes ever queued, and of those written or dropped. flush() waits for the
+    // second to catch up with the first.
+    uint64_t mQueued = 0;
+    uint64_t mCompleted = 0;
+    std::thread mThread;
+};
+
+}  // namespace
+
 void StorageManager::writeFile(const char* file, const void* buffer, int numBytes) {
     int fd = open(file, O_WRONLY | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
     if (fd == -1) {
@@ -123,6 +318,23 @@ void StorageManager::writeFile(const char* file, const void* buffer, int numByte
     }
 
     close(fd);
+    indexFileAdded(file, numBytes);
+}
+
+void StorageManager::writeFileAsync(const string& file, const ConfigKey& key,
+                                    vector<uint8_t> content, bool replacePending) {
+    string dir, name;
+    splitPath(file, &dir, &name);
+    WriteBehindQueue::getInstance().push(
+            PendingWrite{file, dir, key, std::move(content), replacePending}, kMaxPendingWrites);
+}
+
+void StorageManager::flushPendingWrites() {
+    WriteBehindQueue::getInstance().flush();
+}
+
+void StorageManager::cancelPendingWrites(const std::function<bool(const string& file)>& matches) {
+    WriteBehindQueue::getInstance().cancel(matches);
 }
 
 bool StorageManager::writeTrainInfo(int64_t trainVersionCode, const std::string& trainName,
@@ -314,14 +526,21 @@ bool StorageManager::readTrainInfo(InstallTrainInfo& trainInfo) {
 }
 
 void StorageManager::deleteFile(const char* file) {
+    const string fileName(file);
+    cancelPendingWrites([&](const string& pendingFile) { return pendingFile == fileName; });
     if (remove(file) != 0) {
         VLOG("Attempt to delete %s but is not found", file);
     } else {
         VLOG("Successfully deleted %s", file);
     }
+    indexFileRemoved(fileName);
 }
 
 void StorageManager::deleteAllFiles(const char* path) {
+    const string prefix = string(path) + "/";
+    cancelPendingWrites([&](const string& pendingFile) {
+        return pendingFile.compare(0, prefix.size(), prefix) == 0;
+    });
     unique_ptr<DIR, decltype(&closedir)> dir(opendir(path), closedir);
     if (dir == NULL) {
         VLOG("Directory does not exist: %s", path);
@@ -337,6 +556,14 @@ void StorageManager::deleteAllFiles(const char* path) {
 }
 
 void StorageManager::deleteSuffixedFiles(const char* path, const char* suffix) {
+    const string prefix = string(path) + "/";
+    const string suffixString(suffix);
+    cancelPendingWrites([&](const string& pendingFile) {
+        return pendingFile.compare(0, prefix.size(), prefix) == 0 &&
+               pendingFile.size() >= suffixString.size() &&
+               pendingFile.compare(pendingFile.size() - suffixString.size(), suffixString.size(),
+                                   suffixString) == 0;
+    });
     unique_ptr<DIR, decltype(&closedir)> dir(opendir(path), closedir);
     if (dir == NULL) {
         VLOG("Directory does not exist: %s", path);
@@ -359,6 +586,7 @@ void StorageManager::deleteSuffixedFiles(const char* path, const char* suffix) {
 
 void StorageManager::sendBroadcast(const char* path,
                                    const std::function<void(const ConfigKey&)>& sendBroadcast) {
+    flushPendingWrites();
     unique_ptr<DIR, decltype(&closedir)> dir(opendir(path), closedir);
     if (dir == NULL) {
         VLOG("no stats-data directory on disk");
@@ -379,6 +607,7 @@ void StorageManager::sendBroadcast(const char* path,
 }
 
 bool StorageManager::hasConfigMetricsReport(const ConfigKey& key) {
+    flushPendingWrites();
     unique_ptr<DIR, decltype(&closedir)> dir(opendir(STATS_DATA_DIR), closedir);
     if (dir == NULL) {
         VLOG("Path %s does not exist", STATS_DATA_DIR);
@@ -408,6 +637,7 @@ bool StorageManager::hasConfigMetricsReport(const ConfigKey& key) {
 
 void StorageManager::appendConfigMetricsReport(const ConfigKey& key, ProtoOutputStream* proto,
                                                bool erase_data, bool isAdb) {
+    flushPendingWrites();
     unique_ptr<DIR, decltype(&closedir)> dir(opendir(STATS_DATA_DIR), closedir);
     if (dir == NULL) {
         VLOG("Path %s does not exist", STATS_DATA_DIR);
@@ -429,8 +659,8 @@ void StorageManager::appendConfigMetricsReport(const ConfigKey& key, ProtoOutput
 
         auto fullPathName = StringPrintf("%s/%s", STATS_DATA_DIR, fileName.c_str());
         int fd = open(fullPathName.c_str(), O_RDONLY | O_CLOEXEC);
+        string content;
         if (fd != -1) {
-            string content;
             if (android::base::ReadFdToString(fd, &content)) {
                 proto->write(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | FIELD_ID_REPORTS,
                              content.c_str(), content.size());
@@ -442,6 +672,7 @@ void StorageManager::appendConfigMetricsReport(const ConfigKey& key, ProtoOutput
 
         if (erase_data) {
             remove(fullPathName.c_str());
+            indexFileRemoved(fullPathName);
         } else if (!output.mIsHistory && !isAdb) {
             // This means a real data owner has called to get this data. But the config says it
             // wants to keep a local history. So now this file must be renamed as a history file.
@@ -449,9 +680,93 @@ void StorageManager::appendConfigMetricsReport(const ConfigKey& key, ProtoOutput
             // again. rename returns 0 on success
             if (rename(fullPathName.c_str(), (fullPathName + "_history").c_str())) {
                 ALOGE("Failed to rename file %s", fullPathName.c_str());
+            } else {
+                indexFileRenamed(fullPathName, fullPathName + "_history", content.size());
+            }
+        }
+    }
+}
+
+std::vector<StorageManager::ReportFile> StorageManager::openConfigMetricsReports(
+        const ConfigKey& key, bool isAdb) {
+    flushPendingWrites();
+    std::vector<ReportFile> files;
+    unique_ptr<DIR, decltype(&closedir)> dir(opendir(STATS_DATA_DIR), closedir);
+    if (dir == NULL) {
+        VLOG("Path %s does not exist", STATS_DATA_DIR);
+        return files;
+    }
+
+    dirent* de;
+    while ((de = readdir(dir.get()))) {
+        char* name = de->d_name;
+        if (name[0] == '.') continue;
+        FileName output;
+        parseFileName(name, &output);
+
+        if (output.mTimestampSec == -1 || (output.mIsHistory && !isAdb) ||
+            output.mUid != key.GetUid() || output.mConfigId != key.GetId()) {
+            continue;
+        }
+
+        ReportFile file;
+        file.mPath = StringPrintf("%s/%s", STATS_DATA_DIR, name);
+        file.mFd.reset(open(file.mPath.c_str(), O_RDONLY | O_CLOEXEC));
+        struct stat fileStat;
+        if (file.mFd == -1 || fstat(file.mFd, &fileStat) != 0) {
+            ALOGE("file cannot be opened");
+            continue;
+        }
+        file.mSizeBytes = fileStat.st_size;
+        file.mIsHistory = output.mIsHistory;
+        files.push_back(std::move(file));
+    }
+    return files;
+}
+
+bool StorageManager::spliceConfigMetricsReport(ReportFile* file, int outFd, bool erase_data,
+                                               bool isAdb) {
+    off_t offset = 0;
+    bool useSendfile = true;
+    while (offset < file->mSizeBytes) {
+        if (useSendfile) {
+            ssize_t sent = sendfile(outFd, file->mFd, &offset, file->mSizeBytes - offset);
+            if (sent > 0 || (sent < 0 && errno == EINTR)) {
+                continue;
+            }
+            if (sent < 0 && (errno == EINVAL || errno == ENOSYS)) {
+                // The destination does not support sendfile; fall back to a bounded copy.
+                useSendfile = false;
+                continue;
+            }
+        } else {
+            char buffer[4096];
+            ssize_t readBytes = TEMP_FAILURE_RETRY(
+                    pread(file->mFd, buffer,
+                          std::min<int64_t>(sizeof(buffer), file->mSizeBytes - offset), offset));
+            if (readBytes > 0 && android::base::WriteFully(outFd, buffer, readBytes)) {
+                offset += readBytes;
+                continue;
             }
         }
+        ALOGE("Failed to stream %s: %s", file->mPath.c_str(), strerror(errno));
+        return false;
     }
+    file->mFd.reset();
+
+    if (erase_data) {
+        remove(file->mPath.c_str());
+        indexFileRemoved(file->mPath);
+    } else if (!file->mIsHistory && !isAdb) {
+        // Same as appendConfigMetricsReport: the owner has now seen this data, keep it only as
+        // local history.
+        if (rename(file->mPath.c_str(), (file->mPath + "_history").c_str())) {
+            ALOGE("Failed to rename file %s", file->mPath.c_str());
+        } else {
+            indexFileRenamed(file->mPath, file->mPath + "_history", file->mSizeBytes);
+        }
+    }
+    return true;
 }
 
 bool StorageManager::readFileToString(const char* file, string* content) {
@@ -469,6 +784,7 @@ bool StorageManager::readFileToString(const char* file, string* content) {
 }
 
 void StorageManager::readConfigFromDisk(map<ConfigKey, StatsdConfig>& configsMap) {
+    flushPendingWrites();
     unique_ptr<DIR, decltype(&closedir)> dir(opendir(STATS_SERVICE_DIR), closedir);
     if (dir == NULL) {
         VLOG("no default config on disk");
@@ -508,6 +824,7 @@ bool StorageManager::readConfigFromDisk(const ConfigKey& key, StatsdConfig* conf
 }
 
 bool StorageManager::readConfigFromDisk(const ConfigKey& key, string* content) {
+    flushPendingWrites();
     unique_ptr<DIR, decltype(&closedir)> dir(opendir(STATS_SERVICE_DIR),
                                              closedir);
     if (dir == NULL) {
@@ -577,41 +894,57 @@ void StorageManager::sortFiles(vector<FileInfo>* fileNames) {
 }
 
 void StorageManager::trimToFit(const char* path) {
-    unique_ptr<DIR, decltype(&closedir)> dir(opendir(path), closedir);
-    if (dir == NULL) {
-        VLOG("Path %s does not exist", path);
-        return;
-    }
-    dirent* de;
+    const string dirName(path);
     int totalFileSize = 0;
     vector<FileInfo> fileNames;
+    vector<string> expired;
     auto nowSec = getWallClockSec();
-    while ((de = readdir(dir.get()))) {
-        char* name = de->d_name;
-        if (name[0] == '.') continue;
-
-        FileName output;
-        parseFileName(name, &output);
-        if (output.mTimestampSec == -1) continue;
-        string file_name = output.getFullFileName(path);
-
-        // Check for timestamp and delete if it's too old.
-        long fileAge = nowSec - output.mTimestampSec;
-        if (fileAge > StatsdStats::kMaxAgeSecond ||
-            (output.mIsHistory && fileAge > StatsdStats::kMaxLocalHistoryAgeSecond)) {
-            deleteFile(file_name.c_str());
-            continue;
+    {
+        std::lock_guard<std::mutex> lock(sDirIndexMutex);
+        DirIndex& index = sDirIndexes[dirName];
+        if (!index.mLoaded) {
+            unique_ptr<DIR, decltype(&closedir)> dir(opendir(path), closedir);
+            if (dir == NULL) {
+                VLOG("Path %s does not exist", path);
+                return;
+            }
+            dirent* de;
+            while ((de = readdir(dir.get()))) {
+                char* name = de->d_name;
+                if (name[0] == '.') continue;
+
+                FileName output;
+                parseFileName(name, &output);
+                if (output.mTimestampSec == -1) continue;
+                string file_name = output.getFullFileName(path);
+
+                struct stat fileStat;
+                int64_t fileSize = 0;
+                if (stat(file_name.c_str(), &fileStat) == 0) {
+                    fileSize = fileStat.st_size;
+                }
+                index.mFiles[file_name] = {output.mTimestampSec, output.mIsHistory, fileSize};
+            }
+            index.mLoaded = true;
         }
 
-        ifstream file(file_name.c_str(), ifstream::in | ifstream::binary);
-        int fileSize = 0;
-        if (file.is_open()) {
-            file.seekg(0, ios::end);
-            fileSize = file.tellg();
-            file.close();
-            totalFileSize += fileSize;
+        for (const auto& entry : index.mFiles) {
+            const IndexedFile& file = entry.second;
+            // Check for timestamp and delete if it's too old.
+            long fileAge = nowSec - file.mTimestampSec;
+            if (fileAge > StatsdStats::kMaxAgeSecond ||
+                (file.mIsHistory && fileAge > StatsdStats::kMaxLocalHistoryAgeSecond)) {
+                expired.push_back(entry.first);
+                continue;
+            }
+            totalFileSize += file.mSizeBytes;
+            fileNames.emplace_back(entry.first, file.mIsHistory, file.mSizeBytes, fileAge);
         }
-        fileNames.emplace_back(file_name, output.mIsHistory, fileSize, fileAge);
+    }
+
+    // deleteFile updates the index, so it runs after the lock is released.
+    for (const string& file_name : expired) {
+        deleteFile(file_name.c_str());
     }
 
     if (fileNames.size() > StatsdStats::kMaxFileNumber ||
@@ -629,6 +962,7 @@ void StorageManager::trimToFit(const char* path) {
 }
 
 void StorageManager::printStats(int outFd) {
+    flushPendingWrites();
     printDirStats(outFd, STATS_SERVICE_DIR);
     printDirStats(outFd, STATS_DATA_DIR);
 }
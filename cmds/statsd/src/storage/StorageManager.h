@@ -17,7 +17,9 @@
 #ifndef STORAGE_MANAGER_H
 #define STORAGE_MANAGER_H
 
+#include <android-base/unique_fd.h>
 #include <android/util/ProtoOutputStream.h>
+#include <functional>
 #include <utils/Log.h>
 #include <utils/RefBase.h>
 
@@ -44,11 +46,35 @@ public:
         long mFileAgeSec;
     };
 
+    // An on-disk ConfigMetricsReport opened for streaming.
+    struct ReportFile {
+        std::string mPath;
+        android::base::unique_fd mFd;
+        int64_t mSizeBytes;
+        bool mIsHistory;
+    };
+
     /**
      * Writes a given byte array as a file to the specified file path.
      */
     static void writeFile(const char* file, const void* buffer, int numBytes);
 
+    /**
+     * Queues [content] to be written to [file] by the storage thread and returns without waiting
+     * for the disk. Writes queued close together are synced as one batch. If [replacePending],
+     * a write queued earlier for the same [key] to the same directory that has not started yet
+     * is dropped, since only the latest one matters (e.g. saved configs).
+     * Blocks while kMaxPendingWrites writes are already queued.
+     */
+    static void writeFileAsync(const string& file, const ConfigKey& key, vector<uint8_t> content,
+                               bool replacePending);
+
+    /**
+     * Blocks until every write queued by writeFileAsync so far is on disk. Everything that reads
+     * the statsd directories calls this first.
+     */
+    static void flushPendingWrites();
+
     /**
      * Writes train info.
      */
@@ -108,6 +134,20 @@ public:
     static void appendConfigMetricsReport(const ConfigKey& key, ProtoOutputStream* proto,
                                           bool erase_data, bool isAdb);
 
+    /**
+     * Opens the ConfigMetricsReports on disk that appendConfigMetricsReport would append, so
+     * that their sizes are known before any of them is streamed.
+     */
+    static std::vector<ReportFile> openConfigMetricsReports(const ConfigKey& key, bool isAdb);
+
+    /**
+     * Copies [file] to [outFd] without going through user memory, then removes or renames it
+     * following the same rules as appendConfigMetricsReport. Returns false if fewer than
+     * mSizeBytes could be written, in which case the file is left untouched.
+     */
+    static bool spliceConfigMetricsReport(ReportFile* file, int outFd, bool erase_data,
+                                          bool isAdb);
+
     /**
      * Call to load the saved configs from disk.
      */
@@ -149,6 +189,14 @@ private:
      */
     static void printDirStats(int out, const char* path);
 
+    /**
+     * Drops the queued writes to files accepted by [matches], and waits for the batch being
+     * written, so that nothing shows up on disk after the caller deletes files.
+     */
+    static void cancelPendingWrites(const std::function<bool(const string& file)>& matches);
+
+    static const size_t kMaxPendingWrites = 16;
+
     static std::mutex sTrainInfoMutex;
 };
 
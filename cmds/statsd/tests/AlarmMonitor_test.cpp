@@ -62,6 +62,44 @@ TEST(AlarmMonitor, popSoonerThan) {
     EXPECT_EQ(0u, set.size());
 }
 
+TEST(AlarmMonitor, popSoonerThanWithTimerWheel) {
+    unordered_set<sp<const InternalAlarm>, SpHash<InternalAlarm>> set;
+    std::vector<int64_t> registeredMillis;
+    AlarmMonitor am(2, [&](const sp<IStatsCompanionService>&, int64_t timeMillis) {
+                        registeredMillis.push_back(timeMillis);
+                    },
+                    [](const sp<IStatsCompanionService>&){}, true /* useTimerWheel */);
+
+    sp<const InternalAlarm> a = new InternalAlarm{10};
+    sp<const InternalAlarm> b = new InternalAlarm{20};
+    sp<const InternalAlarm> c = new InternalAlarm{20};
+    sp<const InternalAlarm> d = new InternalAlarm{100000};
+
+    am.add(d);
+    am.add(b);
+    am.add(c);
+    am.add(a);
+    EXPECT_EQ(10u, am.getRegisteredAlarmTimeSec());
+
+    am.remove(a);
+    EXPECT_EQ(20u, am.getRegisteredAlarmTimeSec());
+
+    set = am.popSoonerThan(19);
+    EXPECT_TRUE(set.empty());
+
+    set = am.popSoonerThan(20);
+    EXPECT_EQ(2u, set.size());
+    EXPECT_EQ(1u, set.count(b));
+    EXPECT_EQ(1u, set.count(c));
+    EXPECT_EQ(100000u, am.getRegisteredAlarmTimeSec());
+
+    set = am.popSoonerThan(200000);
+    EXPECT_EQ(1u, set.size());
+    EXPECT_EQ(1u, set.count(d));
+    EXPECT_EQ(0u, am.getRegisteredAlarmTimeSec());
+    EXPECT_EQ(5u, registeredMillis.size());
+}
+
 #else
 GTEST_LOG_(INFO) << "This test does nothing.\n";
 #endif
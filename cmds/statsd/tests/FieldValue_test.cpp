@@ -16,6 +16,7 @@
 #include <gtest/gtest.h>
 #include "frameworks/base/cmds/statsd/src/stats_log.pb.h"
 #include "frameworks/base/cmds/statsd/src/statsd_config.pb.h"
+#include "hash.h"
 #include "matchers/matcher_util.h"
 #include "src/logd/LogEvent.h"
 #include "stats_log_util.h"
@@ -480,6 +481,55 @@ TEST(AtomMatcherTest, TestWriteAtomToProto) {
     EXPECT_EQ(999, atom.num_results());
 }
 
+TEST(AtomMatcherTest, TestDimensionKeyHashCache) {
+    HashableDimensionKey key1;
+    key1.addValue(FieldValue(Field(10, getSimpleField(1)), Value((int32_t)1000)));
+    HashableDimensionKey key2 = key1;
+    EXPECT_EQ(key1.getHash(), key2.getHash());
+    EXPECT_TRUE(key1 == key2);
+
+    // Mutating through mutableValue() drops the cached hash.
+    key2.mutableValue(0)->mValue.setInt(1001);
+    EXPECT_NE(key1.getHash(), key2.getHash());
+    EXPECT_FALSE(key1 == key2);
+
+    key2.mutableValue(0)->mValue.setInt(1000);
+    EXPECT_EQ(key1.getHash(), key2.getHash());
+    EXPECT_TRUE(key1 == key2);
+
+    key2.addValue(FieldValue(Field(10, getSimpleField(2)), Value(std::string("tag"))));
+    EXPECT_NE(key1.getHash(), key2.getHash());
+    EXPECT_EQ(hashDimension(key2), key2.getHash());
+}
+
+TEST(AtomMatcherTest, TestStringValueSharing) {
+    Value value1(std::string("com.example.app"));
+    Value value2(std::string("com.example.app"));
+    Value value3(std::string("com.example.other"));
+
+    EXPECT_EQ(STRING, value1.getType());
+    EXPECT_EQ("com.example.app", value1.str_value);
+    // Identical strings share the same interned payload.
+    EXPECT_EQ(value1.str_value.c_str(), value2.str_value.c_str());
+    EXPECT_TRUE(value1 == value2);
+    EXPECT_TRUE(value1 < value3);
+    EXPECT_EQ(value1.str_value.hash(), Hash64(std::string("com.example.app")));
+
+    // Overwriting a string with a number drops the string.
+    Value copy = value3;
+    copy.setInt(5);
+    EXPECT_EQ(INT, copy.getType());
+    EXPECT_EQ(5, copy.int_value);
+    EXPECT_EQ("com.example.other", value3.str_value);
+
+    Value moved(std::move(value3));
+    EXPECT_EQ("com.example.other", moved.str_value);
+
+    Value empty(std::string(""));
+    EXPECT_TRUE(empty.isZero());
+    EXPECT_EQ("", empty.str_value);
+}
+
 
 }  // namespace statsd
 }  // namespace os
@@ -13,6 +13,9 @@
 // limitations under the License.
 
 #include "frameworks/base/cmds/statsd/src/statsd_config.pb.h"
+#include "matchers/CompiledAtomMatcher.h"
+#include "matchers/SharedMatcherPool.h"
+#include "matchers/SimpleLogMatchingTracker.h"
 #include "matchers/matcher_util.h"
 #include "stats_log_util.h"
 #include "stats_util.h"
@@ -25,6 +28,7 @@
 #include <stdio.h>
 
 using namespace android::os::statsd;
+using android::sp;
 using std::unordered_map;
 using std::vector;
 
@@ -760,6 +764,149 @@ TEST(AtomMatcherTest, TestNorMatcher) {
     matcherResults.push_back(MatchingState::kMatched);
     EXPECT_FALSE(combinationMatch(children, operation, matcherResults));
 }
+
+TEST(AtomMatcherTest, TestSharedMatcherPool) {
+    sp<UidMap> uidMap = new UidMap();
+    sp<SharedMatcherPool> pool = new SharedMatcherPool(uidMap);
+
+    SimpleAtomMatcher simpleMatcher;
+    simpleMatcher.set_atom_id(TAG_ID);
+    auto fieldValueMatcher = simpleMatcher.add_field_value_matcher();
+    fieldValueMatcher->set_field(FIELD_ID_1);
+    fieldValueMatcher->set_eq_int(11);
+
+    SimpleAtomMatcher otherMatcher = simpleMatcher;
+    otherMatcher.mutable_field_value_matcher(0)->set_eq_int(12);
+
+    // Two configs with the same matcher, and one with a different matcher.
+    sp<LogMatchingTracker> tracker1 = new SimpleLogMatchingTracker(1, 0, simpleMatcher, *uidMap);
+    sp<LogMatchingTracker> tracker2 = new SimpleLogMatchingTracker(2, 0, simpleMatcher, *uidMap);
+    sp<LogMatchingTracker> tracker3 = new SimpleLogMatchingTracker(3, 0, otherMatcher, *uidMap);
+    tracker1->setSharedMatcherPool(pool);
+    tracker2->setSharedMatcherPool(pool);
+    tracker3->setSharedMatcherPool(pool);
+    EXPECT_EQ(3u, pool->getSubscriberCount());
+    EXPECT_EQ(2u, pool->getDistinctMatcherCount());
+
+    LogEvent event(TAG_ID, 0);
+    EXPECT_TRUE(event.write(11));
+    event.init();
+
+    pool->startEvent(&event);
+    vector<sp<LogMatchingTracker>> trackers = {tracker1};
+    vector<MatchingState> results1(1, MatchingState::kNotComputed);
+    tracker1->onLogEvent(event, trackers, results1);
+    vector<MatchingState> results2(1, MatchingState::kNotComputed);
+    tracker2->onLogEvent(event, trackers, results2);
+    vector<MatchingState> results3(1, MatchingState::kNotComputed);
+    tracker3->onLogEvent(event, trackers, results3);
+    pool->finishEvent();
+
+    EXPECT_EQ(MatchingState::kMatched, results1[0]);
+    EXPECT_EQ(MatchingState::kMatched, results2[0]);
+    EXPECT_EQ(MatchingState::kNotMatched, results3[0]);
+
+    // An event that is not the current event of the pool is evaluated directly.
+    LogEvent event2(TAG_ID, 0);
+    EXPECT_TRUE(event2.write(12));
+    event2.init();
+    results3[0] = MatchingState::kNotComputed;
+    tracker3->onLogEvent(event2, trackers, results3);
+    EXPECT_EQ(MatchingState::kMatched, results3[0]);
+
+    tracker2.clear();
+    EXPECT_EQ(2u, pool->getSubscriberCount());
+    EXPECT_EQ(2u, pool->getDistinctMatcherCount());
+    tracker1.clear();
+    EXPECT_EQ(1u, pool->getDistinctMatcherCount());
+}
+
+TEST(AtomMatcherTest, TestCompiledMatcherAgreesWithMatchesSimple) {
+    UidMap uidMap;
+    uidMap.updateMap(
+            1, {1111, 2222} /* uid list */, {1, 2} /* version list */,
+            {android::String16("v1"), android::String16("v2")},
+            {android::String16("pkg0"), android::String16("pkg1")} /* package name list */,
+            {android::String16(""), android::String16("")});
+
+    AttributionNodeInternal attribution_node1;
+    attribution_node1.set_uid(1111);
+    attribution_node1.set_tag("location1");
+    AttributionNodeInternal attribution_node2;
+    attribution_node2.set_uid(1000);
+    attribution_node2.set_tag("location2");
+    std::vector<AttributionNodeInternal> attribution_nodes = {attribution_node1,
+                                                              attribution_node2};
+
+    LogEvent event(TAG_ID, 0);
+    event.write(attribution_nodes);
+    event.write("some value");
+    event.write((int64_t)-7);
+    event.write(1.5f);
+    event.init();
+
+    auto expectSame = [&](const SimpleAtomMatcher& simpleMatcher) {
+        EXPECT_EQ(matchesSimple(uidMap, simpleMatcher, event),
+                  CompiledAtomMatcher(simpleMatcher).matches(uidMap, event));
+    };
+
+    SimpleAtomMatcher simpleMatcher;
+    simpleMatcher.set_atom_id(TAG_ID);
+    expectSame(simpleMatcher);
+
+    for (Position position : {Position::FIRST, Position::LAST, Position::ANY, Position::ALL}) {
+        for (const char* str : {"pkg0", "pkg1", "AID_SYSTEM", "AID_ROOT", "location2"}) {
+            for (int field : {ATTRIBUTION_UID_FIELD_ID, ATTRIBUTION_TAG_FIELD_ID}) {
+                simpleMatcher.clear_field_value_matcher();
+                auto attributionMatcher = simpleMatcher.add_field_value_matcher();
+                attributionMatcher->set_field(FIELD_ID_1);
+                attributionMatcher->set_position(position);
+                auto child = attributionMatcher->mutable_matches_tuple()->add_field_value_matcher();
+                child->set_field(field);
+                child->set_eq_string(str);
+                expectSame(simpleMatcher);
+
+                child->mutable_eq_any_string()->add_str_value("pkg9");
+                child->mutable_eq_any_string()->add_str_value(str);
+                expectSame(simpleMatcher);
+
+                child->mutable_neq_any_string()->add_str_value(str);
+                expectSame(simpleMatcher);
+            }
+        }
+    }
+
+    simpleMatcher.clear_field_value_matcher();
+    auto fieldMatcher = simpleMatcher.add_field_value_matcher();
+    fieldMatcher->set_field(FIELD_ID_2);
+    for (const char* str : {"some value", "other value"}) {
+        fieldMatcher->set_eq_string(str);
+        expectSame(simpleMatcher);
+    }
+    fieldMatcher->set_field(3);
+    for (int64_t value : {-8, -7, -6}) {
+        fieldMatcher->set_eq_int(value);
+        expectSame(simpleMatcher);
+        fieldMatcher->set_lt_int(value);
+        expectSame(simpleMatcher);
+        fieldMatcher->set_gt_int(value);
+        expectSame(simpleMatcher);
+        fieldMatcher->set_lte_int(value);
+        expectSame(simpleMatcher);
+        fieldMatcher->set_gte_int(value);
+        expectSame(simpleMatcher);
+    }
+    fieldMatcher->set_eq_bool(true);
+    expectSame(simpleMatcher);
+    fieldMatcher->set_field(4);
+    for (float value : {1.0f, 1.5f, 2.0f}) {
+        fieldMatcher->set_lt_float(value);
+        expectSame(simpleMatcher);
+        fieldMatcher->set_gt_float(value);
+        expectSame(simpleMatcher);
+    }
+}
+
 #else
 GTEST_LOG_(INFO) << "This test does nothing.\n";
 #endif
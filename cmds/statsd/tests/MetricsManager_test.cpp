@@ -471,6 +471,92 @@ TEST(MetricsManagerTest, testAlertWithUnknownMetric) {
                                   metricsWithActivation, noReportMetricIds));
 }
 
+TEST(MetricsManagerTest, TestAtomMatcherDispatch) {
+    UidMap uidMap;
+    StatsdConfig config = buildGoodConfig();
+
+    // A combination over two atoms, with a NOT child that doesn't care about atom 2.
+    AtomMatcher* eventMatcher = config.add_atom_matcher();
+    eventMatcher->set_id(StringToId("WAKELOCK"));
+    eventMatcher->mutable_simple_atom_matcher()->set_atom_id(10);
+
+    eventMatcher = config.add_atom_matcher();
+    eventMatcher->set_id(StringToId("NOT_WAKELOCK"));
+    AtomMatcher_Combination* combination = eventMatcher->mutable_combination();
+    combination->set_operation(LogicalOperation::NOT);
+    combination->add_matcher(StringToId("WAKELOCK"));
+
+    eventMatcher = config.add_atom_matcher();
+    eventMatcher->set_id(StringToId("SCREEN_ON_OR_NOT_WAKELOCK"));
+    combination = eventMatcher->mutable_combination();
+    combination->set_operation(LogicalOperation::OR);
+    combination->add_matcher(StringToId("SCREEN_IS_ON"));
+    combination->add_matcher(StringToId("NOT_WAKELOCK"));
+
+    unordered_map<int64_t, int> logTrackerMap;
+    vector<sp<LogMatchingTracker>> allAtomMatchers;
+    set<int> allTagIds;
+    EXPECT_TRUE(initLogTrackers(config, uidMap, logTrackerMap, allAtomMatchers, allTagIds));
+
+    unordered_map<int, vector<int>> tagIdToMatcherIndices;
+    initAtomMatcherDispatch(allAtomMatchers, tagIdToMatcherIndices);
+
+    EXPECT_EQ(2u, tagIdToMatcherIndices.size());
+    // Screen events also evaluate NOT_WAKELOCK and WAKELOCK through the OR matcher.
+    EXPECT_EQ(vector<int>({0, 1, 2, 3, 4, 5}), tagIdToMatcherIndices[2]);
+    EXPECT_EQ(vector<int>({0, 3, 4, 5}), tagIdToMatcherIndices[10]);
+}
+
+TEST(MetricsManagerTest, TestConditionPropagation) {
+    UidMap uidMap;
+    StatsdConfig config = buildGoodConfig();
+
+    // SCREEN_IS_ON_PREDICATE (0) is used by NOT_SCREEN_ON (1), which is used by
+    // NOT_NOT_SCREEN_ON (2) together with SCREEN_IS_ON_PREDICATE again.
+    Predicate* predicate = config.add_predicate();
+    predicate->set_id(StringToId("SCREEN_IS_ON_PREDICATE"));
+    predicate->mutable_simple_predicate()->set_start(StringToId("SCREEN_IS_ON"));
+    predicate->mutable_simple_predicate()->set_stop(StringToId("SCREEN_IS_OFF"));
+
+    predicate = config.add_predicate();
+    predicate->set_id(StringToId("NOT_SCREEN_ON"));
+    predicate->mutable_combination()->set_operation(LogicalOperation::NOT);
+    predicate->mutable_combination()->add_predicate(StringToId("SCREEN_IS_ON_PREDICATE"));
+
+    predicate = config.add_predicate();
+    predicate->set_id(StringToId("SCREEN_ON_OR_NOT_SCREEN_ON"));
+    predicate->mutable_combination()->set_operation(LogicalOperation::OR);
+    predicate->mutable_combination()->add_predicate(StringToId("NOT_SCREEN_ON"));
+    predicate->mutable_combination()->add_predicate(StringToId("SCREEN_IS_ON_PREDICATE"));
+
+    unordered_map<int64_t, int> logTrackerMap;
+    vector<sp<LogMatchingTracker>> allAtomMatchers;
+    set<int> allTagIds;
+    EXPECT_TRUE(initLogTrackers(config, uidMap, logTrackerMap, allAtomMatchers, allTagIds));
+
+    unordered_map<int64_t, int> conditionTrackerMap;
+    vector<sp<ConditionTracker>> allConditionTrackers;
+    unordered_map<int, vector<int>> trackerToConditionMap;
+    EXPECT_TRUE(initConditions(kConfigKey, config, logTrackerMap, conditionTrackerMap,
+                               allConditionTrackers, trackerToConditionMap));
+
+    unordered_map<int, vector<int>> trackerToSimpleConditionMap;
+    vector<vector<int>> conditionParents;
+    vector<int> conditionRanks;
+    initConditionPropagation(allConditionTrackers, trackerToConditionMap,
+                             trackerToSimpleConditionMap, conditionParents, conditionRanks);
+
+    EXPECT_EQ(vector<int>({0, 1, 2}), conditionRanks);
+    EXPECT_EQ(vector<int>({1, 2}), conditionParents[0]);
+    EXPECT_EQ(vector<int>({2}), conditionParents[1]);
+    EXPECT_TRUE(conditionParents[2].empty());
+    // Only the simple predicate is dispatched from the screen matchers.
+    for (const auto& pair : trackerToSimpleConditionMap) {
+        EXPECT_EQ(vector<int>({0}), pair.second);
+    }
+    EXPECT_EQ(2u, trackerToSimpleConditionMap.size());
+}
+
 #else
 GTEST_LOG_(INFO) << "This test does nothing.\n";
 #endif
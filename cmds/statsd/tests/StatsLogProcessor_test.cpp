@@ -28,6 +28,7 @@
 
 #include "tests/statsd_test_util.h"
 
+#include <android-base/file.h>
 #include <stdio.h>
 
 using namespace android;
@@ -215,6 +216,35 @@ TEST(StatsLogProcessorTest, TestEmptyConfigHasNoUidMap) {
     EXPECT_FALSE(output.reports(0).has_uid_map());
 }
 
+TEST(StatsLogProcessorTest, TestLogEventFilterFollowsConfigs) {
+    sp<UidMap> m = new UidMap();
+    sp<StatsPullerManager> pullerManager = new StatsPullerManager();
+    sp<AlarmMonitor> anomalyAlarmMonitor;
+    sp<AlarmMonitor> subscriberAlarmMonitor;
+    StatsLogProcessor p(m, pullerManager, anomalyAlarmMonitor, subscriberAlarmMonitor, 0,
+                        [](const ConfigKey& key) { return true; },
+                        [](const int&, const vector<int64_t>&) {return true;});
+    auto filter = std::make_shared<LogEventFilter>();
+    // Nothing is filtered before the processor sets the atom ids.
+    EXPECT_TRUE(filter->isAtomIdWanted(android::util::PROCESS_LIFE_CYCLE_STATE_CHANGED));
+
+    p.setLogEventFilter(filter);
+    EXPECT_FALSE(filter->isAtomIdWanted(android::util::PROCESS_LIFE_CYCLE_STATE_CHANGED));
+    EXPECT_TRUE(filter->isAtomIdWanted(android::util::ISOLATED_UID_CHANGED));
+
+    ConfigKey key(3, 4);
+    p.OnConfigUpdated(0, key, MakeConfig(true));
+    EXPECT_TRUE(filter->isAtomIdWanted(android::util::PROCESS_LIFE_CYCLE_STATE_CHANGED));
+    EXPECT_FALSE(filter->isAtomIdWanted(android::util::SCREEN_STATE_CHANGED));
+
+    filter->requestAllAtoms();
+    EXPECT_TRUE(filter->isAtomIdWanted(android::util::SCREEN_STATE_CHANGED));
+    filter->releaseAllAtoms();
+
+    p.OnConfigRemoved(key);
+    EXPECT_FALSE(filter->isAtomIdWanted(android::util::PROCESS_LIFE_CYCLE_STATE_CHANGED));
+}
+
 TEST(StatsLogProcessorTest, TestReportIncludesSubConfig) {
     // Setup simple config key corresponding to empty config.
     sp<UidMap> m = new UidMap();
@@ -295,6 +325,39 @@ TEST(StatsLogProcessorTest, TestOnDumpReportEraseData) {
     EXPECT_TRUE(noData);
 }
 
+TEST(StatsLogProcessorTest, TestOnDumpReportToFd) {
+    StatsdConfig config;
+    config.add_allowed_log_source("AID_ROOT"); // LogEvent defaults to UID of root.
+    auto wakelockAcquireMatcher = CreateAcquireWakelockAtomMatcher();
+    *config.add_atom_matcher() = wakelockAcquireMatcher;
+
+    auto countMetric = config.add_count_metric();
+    countMetric->set_id(123456);
+    countMetric->set_what(wakelockAcquireMatcher.id());
+    countMetric->set_bucket(FIVE_MINUTES);
+
+    ConfigKey cfgKey;
+    sp<StatsLogProcessor> processor = CreateStatsLogProcessor(1, 1, config, cfgKey);
+
+    std::vector<AttributionNodeInternal> attributions1 = {CreateAttribution(111, "App1")};
+    auto event = CreateAcquireWakelockEvent(attributions1, "wl1", 2);
+    processor->OnLogEvent(event.get());
+
+    TemporaryFile tmp;
+    EXPECT_TRUE(processor->onDumpReport(cfgKey, 3, true, true /* erase data */, ADB_DUMP, FAST,
+                                        tmp.fd));
+    string content;
+    EXPECT_TRUE(android::base::ReadFileToString(tmp.path, &content));
+
+    ConfigMetricsReportList output;
+    EXPECT_TRUE(output.ParseFromString(content));
+    EXPECT_EQ(cfgKey.GetUid(), output.config_key().uid());
+    EXPECT_EQ(cfgKey.GetId(), output.config_key().id());
+    EXPECT_EQ(output.reports_size(), 1);
+    EXPECT_EQ(output.reports(0).metrics_size(), 1);
+    EXPECT_EQ(output.reports(0).metrics(0).count_metrics().data_size(), 1);
+}
+
 TEST(StatsLogProcessorTest, TestActiveConfigMetricDiskWriteRead) {
     int uid = 1111;
 
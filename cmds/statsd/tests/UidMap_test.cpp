@@ -423,6 +423,104 @@ TEST(UidMapTest, TestMemoryGuardrail) {
     EXPECT_EQ(1U, m.mChanges.size());
 }
 
+TEST(UidMapTest, TestStringsInterned) {
+    UidMap m;
+    vector<int32_t> uids;
+    vector<int64_t> versions;
+    vector<String16> apps;
+    vector<String16> versionStrings;
+    vector<String16> installers;
+    for (int i = 0; i < 100; i++) {
+        uids.push_back(1000 + i);
+        apps.push_back(String16(("app." + to_string(i)).c_str()));
+        versions.push_back(1);
+        versionStrings.push_back(String16("v1"));
+        installers.push_back(String16("com.android.vending"));
+    }
+    m.updateMap(1, uids, versions, versionStrings, apps, installers);
+    // One copy of "v1" and one of the installer.
+    EXPECT_EQ(2U, m.mStringPool.size());
+
+    m.updateApp(2, String16("app.0"), 1000, 2, String16("v2"), String16("com.android.vending"));
+    // "v2" and the package name of the change record.
+    EXPECT_EQ(4U, m.mStringPool.size());
+    EXPECT_EQ(kBytesChangeRecord + strlen("app.0") + strlen("v2") + strlen("v1"), m.mBytesUsed);
+
+    m.updateApp(3, String16("app.0"), 1000, 3, String16("v3"), String16("com.android.vending"));
+    m.clearOutput();
+    m.removeApp(4, String16("app.1"), 1001);
+    // "v2" is no longer used by the map nor by any change record.
+    EXPECT_EQ(0U, m.mStringPool.count("v2"));
+    EXPECT_EQ(1U, m.mStringPool.count("v3"));
+}
+
+TEST(UidMapTest, TestSnapshotCache) {
+    UidMap m;
+    ConfigKey config1(1, StringToId("config1"));
+    ConfigKey config2(1, StringToId("config2"));
+    m.OnConfigUpdated(config1);
+    m.OnConfigUpdated(config2);
+    vector<int32_t> uids;
+    vector<int64_t> versions;
+    vector<String16> apps;
+    vector<String16> versionStrings;
+    vector<String16> installers;
+    uids.push_back(1000);
+    uids.push_back(1001);
+    apps.push_back(String16(kApp1.c_str()));
+    apps.push_back(String16(kApp2.c_str()));
+    versions.push_back(4);
+    versions.push_back(5);
+    versionStrings.push_back(String16("v4"));
+    versionStrings.push_back(String16("v5"));
+    installers.push_back(String16(""));
+    installers.push_back(String16(""));
+    m.updateMap(1, uids, versions, versionStrings, apps, installers);
+
+    ProtoOutputStream proto;
+    UidMapping results;
+    std::set<string> strSet;
+    m.appendUidMap(2, config1, &strSet, true, false, &proto);
+    protoOutputStreamToUidMapping(&proto, &results);
+    ASSERT_EQ(1, results.snapshots_size());
+    EXPECT_EQ(2, results.snapshots(0).elapsed_timestamp_nanos());
+    EXPECT_EQ(2, results.snapshots(0).package_info_size());
+    EXPECT_TRUE(results.snapshots(0).package_info(0).has_name_hash());
+    EXPECT_EQ(1U, strSet.count("v4"));
+    EXPECT_EQ(1U, strSet.count(kApp2));
+    const int cacheIndex = UidMap::snapshotCacheIndex(true, false, true);
+    EXPECT_TRUE(m.mSnapshotCaches[cacheIndex].valid);
+
+    // Another config with the same options gets the same package infos.
+    UidMapping results2;
+    std::set<string> strSet2;
+    proto.clear();
+    m.appendUidMap(3, config2, &strSet2, true, false, &proto);
+    protoOutputStreamToUidMapping(&proto, &results2);
+    ASSERT_EQ(1, results2.snapshots_size());
+    EXPECT_EQ(3, results2.snapshots(0).elapsed_timestamp_nanos());
+    EXPECT_EQ(results.snapshots(0).package_info(1).SerializeAsString(),
+              results2.snapshots(0).package_info(1).SerializeAsString());
+    EXPECT_EQ(strSet, strSet2);
+
+    // A change to the map drops the cache.
+    m.updateApp(4, String16(kApp1.c_str()), 1000, 40, String16("v40"), String16(""));
+    EXPECT_FALSE(m.mSnapshotCaches[cacheIndex].valid);
+    proto.clear();
+    m.appendUidMap(5, config1, nullptr, true, false, &proto);
+    protoOutputStreamToUidMapping(&proto, &results);
+    ASSERT_EQ(1, results.snapshots_size());
+    bool foundUpdate = false;
+    for (const auto& info : results.snapshots(0).package_info()) {
+        if (info.uid() == 1000) {
+            EXPECT_EQ(40, info.version());
+            EXPECT_EQ("v40", info.version_string());
+            foundUpdate = true;
+        }
+    }
+    EXPECT_TRUE(foundUpdate);
+}
+
 #else
 GTEST_LOG_(INFO) << "This test does nothing.\n";
 #endif
@@ -397,6 +397,82 @@ TEST(SimpleConditionTrackerTest, TestSlicedCondition) {
 
 }
 
+TEST(SimpleConditionTrackerTest, TestPartialLinkUsesLinkIndex) {
+    // Sliced by uid and wake lock name, but linked on uid only.
+    SimplePredicate simplePredicate = getWakeLockHeldCondition(
+            true /*nesting*/, true /*default to false*/, true /*output slice by uid*/,
+            Position::FIRST);
+    simplePredicate.mutable_dimensions()->add_child()->set_field(2);
+    string conditionName = "WL_HELD_BY_UID_AND_NAME";
+
+    unordered_map<int64_t, int> trackerNameIndexMap;
+    trackerNameIndexMap[StringToId("WAKE_LOCK_ACQUIRE")] = 0;
+    trackerNameIndexMap[StringToId("WAKE_LOCK_RELEASE")] = 1;
+    trackerNameIndexMap[StringToId("RELEASE_ALL")] = 2;
+
+    SimpleConditionTracker conditionTracker(kConfigKey, StringToId(conditionName),
+                                            0 /*condition tracker index*/, simplePredicate,
+                                            trackerNameIndexMap);
+
+    FieldMatcher linkFields;
+    linkFields.set_field(TAG_ID);
+    linkFields.add_child()->set_field(ATTRIBUTION_NODE_FIELD_ID);
+    linkFields.mutable_child(0)->set_position(Position::FIRST);
+    linkFields.mutable_child(0)->add_child()->set_field(ATTRIBUTION_UID_FIELD_ID);
+    vector<Matcher> conditionFields;
+    translateFieldMatcher(linkFields, &conditionFields);
+    conditionTracker.addLinkedFields(conditionFields);
+    // Adding the same link twice doesn't create another index.
+    conditionTracker.addLinkedFields(conditionFields);
+    EXPECT_EQ(1UL, conditionTracker.mLinkIndexes.size());
+
+    vector<sp<ConditionTracker>> allPredicates;
+    vector<ConditionState> conditionCache(1, ConditionState::kNotEvaluated);
+    vector<bool> changedCache(1, false);
+    vector<MatchingState> acquire = {MatchingState::kMatched, MatchingState::kNotMatched,
+                                     MatchingState::kNotMatched};
+    vector<MatchingState> release = {MatchingState::kNotMatched, MatchingState::kMatched,
+                                     MatchingState::kNotMatched};
+
+    LogEvent event1(1 /*tagId*/, 0 /*timestamp*/);
+    makeWakeLockEvent(&event1, {111}, "wl1", 1);
+    conditionTracker.evaluateCondition(event1, acquire, allPredicates, conditionCache,
+                                       changedCache);
+    LogEvent event2(1 /*tagId*/, 0 /*timestamp*/);
+    makeWakeLockEvent(&event2, {111}, "wl2", 1);
+    conditionTracker.evaluateCondition(event2, acquire, allPredicates, conditionCache,
+                                       changedCache);
+    LogEvent event3(1 /*tagId*/, 0 /*timestamp*/);
+    makeWakeLockEvent(&event3, {222}, "wl1", 1);
+    conditionTracker.evaluateCondition(event3, acquire, allPredicates, conditionCache,
+                                       changedCache);
+    EXPECT_EQ(3UL, conditionTracker.mSlicedConditionState.size());
+    EXPECT_EQ(2UL, conditionTracker.mLinkIndexes[0].slices.size());
+
+    vector<Matcher> dimensionFields;
+    std::unordered_set<HashableDimensionKey> dimensionKeys;
+    auto isMet = [&](int uid) {
+        conditionCache[0] = ConditionState::kNotEvaluated;
+        conditionTracker.isConditionMet(getWakeLockQueryKey(Position::FIRST, {uid}, conditionName),
+                                        allPredicates, dimensionFields,
+                                        false /*isSubOutputDimensionFields*/,
+                                        true /*isPartialLink*/, conditionCache, dimensionKeys);
+        return conditionCache[0];
+    };
+    EXPECT_EQ(ConditionState::kTrue, isMet(111));
+    EXPECT_EQ(ConditionState::kTrue, isMet(222));
+    EXPECT_EQ(ConditionState::kFalse, isMet(333));
+
+    LogEvent event4(1 /*tagId*/, 0 /*timestamp*/);
+    makeWakeLockEvent(&event4, {222}, "wl1", 0);
+    conditionTracker.evaluateCondition(event4, release, allPredicates, conditionCache,
+                                       changedCache);
+    EXPECT_EQ(2UL, conditionTracker.mSlicedConditionState.size());
+    EXPECT_EQ(1UL, conditionTracker.mLinkIndexes[0].slices.size());
+    EXPECT_EQ(ConditionState::kTrue, isMet(111));
+    EXPECT_EQ(ConditionState::kFalse, isMet(222));
+}
+
 TEST(SimpleConditionTrackerTest, TestSlicedWithNoOutputDim) {
     std::vector<sp<ConditionTracker>> allConditions;
     vector<Matcher> dimensionInCondition;
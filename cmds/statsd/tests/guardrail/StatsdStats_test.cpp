@@ -17,6 +17,7 @@
 #include "tests/statsd_test_util.h"
 
 #include <gtest/gtest.h>
+#include <thread>
 #include <vector>
 
 #ifdef __ANDROID__
@@ -284,6 +285,37 @@ TEST(StatsdStatsTest, TestNonPlatformAtomLog) {
     EXPECT_TRUE(newAtom2Good);
 }
 
+TEST(StatsdStatsTest, TestConcurrentAtomLog) {
+    StatsdStats stats;
+    time_t now = time(nullptr);
+    int newAtom = android::util::kMaxPushedAtomId + 1;
+    const int kThreadCount = 4;
+    const int kLogsPerThread = 10000;
+
+    vector<std::thread> threads;
+    for (int i = 0; i < kThreadCount; i++) {
+        threads.emplace_back([&stats, now, newAtom] {
+            for (int j = 0; j < kLogsPerThread; j++) {
+                stats.noteAtomLogged(android::util::SENSOR_STATE_CHANGED, now);
+                stats.noteAtomLogged(newAtom, now);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    vector<uint8_t> output;
+    stats.dumpStats(&output, false);
+    StatsdStatsReport report;
+    EXPECT_TRUE(report.ParseFromArray(&output[0], output.size()));
+
+    EXPECT_EQ(2, report.atom_stats_size());
+    for (const auto& atomStats : report.atom_stats()) {
+        EXPECT_EQ(kThreadCount * kLogsPerThread, atomStats.count());
+    }
+}
+
 TEST(StatsdStatsTest, TestPullAtomStats) {
     StatsdStats stats;
 
@@ -324,6 +356,31 @@ TEST(StatsdStatsTest, TestPullAtomStats) {
     EXPECT_EQ(1L, report.pulled_atom_stats(0).unregistered_count());
 }
 
+TEST(StatsdStatsTest, TestPullTimeHistogram) {
+    StatsdStats stats;
+
+    stats.notePullTime(android::util::DISK_SPACE, 500 * 1000LL);           // 0.5ms
+    stats.notePullTime(android::util::DISK_SPACE, 2 * 1000 * 1000LL);      // 2ms
+    stats.notePullTime(android::util::DISK_SPACE, 3 * 1000 * 1000LL);      // 3ms
+    stats.notePullTime(android::util::DISK_SPACE, 20 * 1000 * 1000LL);     // 20ms
+    stats.notePullTime(android::util::DISK_SPACE, 60 * NS_PER_SEC);        // 60s
+
+    vector<uint8_t> output;
+    stats.dumpStats(&output, false);
+    StatsdStatsReport report;
+    bool good = report.ParseFromArray(&output[0], output.size());
+    EXPECT_TRUE(good);
+
+    EXPECT_EQ(1, report.pulled_atom_stats_size());
+    const auto& histogram = report.pulled_atom_stats(0).pull_time_histogram();
+    EXPECT_EQ(StatsdStats::kPullTimeHistogramBucketCount, histogram.size());
+    EXPECT_EQ(1L, histogram.Get(0));
+    EXPECT_EQ(2L, histogram.Get(1));
+    EXPECT_EQ(0L, histogram.Get(2));
+    EXPECT_EQ(1L, histogram.Get(3));
+    EXPECT_EQ(1L, histogram.Get(StatsdStats::kPullTimeHistogramBucketCount - 1));
+}
+
 TEST(StatsdStatsTest, TestAtomMetricsStats) {
     StatsdStats stats;
     time_t now = time(nullptr);
@@ -91,6 +91,80 @@ TEST(LogEventQueue_test, TestSlowConsumer) {
     writer.join();
 }
 
+TEST(LogEventQueue_test, TestWaitPopBatch) {
+    LogEventQueue queue(50);
+    int64_t timeBaseNs = 100;
+    int64_t oldestEventNs;
+    for (int i = 0; i < 10; i++) {
+        EXPECT_TRUE(queue.push(std::make_unique<LogEvent>(10, timeBaseNs + i * 1000),
+                               &oldestEventNs));
+    }
+
+    std::vector<unique_ptr<LogEvent>> events;
+    EXPECT_EQ(4u, queue.waitPopBatch(4, &events));
+    EXPECT_EQ(6u, queue.waitPopBatch(50, &events));
+    ASSERT_EQ(10u, events.size());
+    for (int i = 0; i < 10; i++) {
+        // All events are in right order.
+        EXPECT_EQ(timeBaseNs + i * 1000, events[i]->GetElapsedTimestampNs());
+    }
+}
+
+TEST(LogEventQueue_test, TestOverflowReportsOldestEvent) {
+    LogEventQueue queue(3);
+    int64_t timeBaseNs = 100;
+    int64_t oldestEventNs = 0;
+    for (int i = 0; i < 3; i++) {
+        EXPECT_TRUE(queue.push(std::make_unique<LogEvent>(10, timeBaseNs + i * 1000),
+                               &oldestEventNs));
+    }
+    EXPECT_FALSE(queue.push(std::make_unique<LogEvent>(10, timeBaseNs + 3 * 1000),
+                            &oldestEventNs));
+    EXPECT_EQ(timeBaseNs, oldestEventNs);
+
+    // Consuming one event frees exactly one slot.
+    EXPECT_EQ(timeBaseNs, queue.waitPop()->GetElapsedTimestampNs());
+    EXPECT_TRUE(queue.push(std::make_unique<LogEvent>(10, timeBaseNs + 4 * 1000),
+                           &oldestEventNs));
+    EXPECT_FALSE(queue.push(std::make_unique<LogEvent>(10, timeBaseNs + 5 * 1000),
+                            &oldestEventNs));
+    EXPECT_EQ(timeBaseNs + 1000, oldestEventNs);
+}
+
+TEST(LogEventQueue_test, TestMultipleProducers) {
+    LogEventQueue queue(2000);
+    const int kProducers = 4;
+    const int kEventsPerProducer = 250;
+    std::vector<std::thread> writers;
+    for (int p = 0; p < kProducers; p++) {
+        writers.emplace_back([&queue, p] {
+            int64_t oldestEventNs;
+            for (int i = 0; i < kEventsPerProducer; i++) {
+                // Per-producer ordering is encoded in the timestamp.
+                EXPECT_TRUE(queue.push(std::make_unique<LogEvent>(10 + p, i), &oldestEventNs));
+            }
+        });
+    }
+
+    std::vector<int64_t> lastSeen(kProducers, -1);
+    int received = 0;
+    std::vector<unique_ptr<LogEvent>> events;
+    while (received < kProducers * kEventsPerProducer) {
+        queue.waitPopBatch(16, &events);
+        for (const auto& event : events) {
+            int p = event->GetTagId() - 10;
+            EXPECT_LT(lastSeen[p], event->GetElapsedTimestampNs());
+            lastSeen[p] = event->GetElapsedTimestampNs();
+            received++;
+        }
+        events.clear();
+    }
+
+    for (auto& writer : writers) {
+        writer.join();
+    }
+}
+
 #else
 GTEST_LOG_(INFO) << "This test does nothing.\n";
 #endif
@@ -396,6 +396,50 @@ TEST(CountMetricProducerTest, TestAnomalyDetectionUnSliced) {
             std::ceil(1.0 * event7.GetElapsedTimestampNs() / NS_PER_SEC + refPeriodSec));
 }
 
+TEST(CountMetricProducerTest, TestBucketSnapshotRoundTrip) {
+    int64_t bucketStartTimeNs = 10000000000;
+    int64_t bucketSizeNs = TimeUnitToBucketSizeInMillis(ONE_MINUTE) * 1000000LL;
+    int64_t bucket2StartTimeNs = bucketStartTimeNs + bucketSizeNs;
+    int64_t snapshotTimeNs = bucket2StartTimeNs + 10 * NS_PER_SEC;
+
+    CountMetric metric;
+    metric.set_id(1);
+    metric.set_bucket(ONE_MINUTE);
+    sp<MockConditionWizard> wizard = new NaggyMock<MockConditionWizard>();
+
+    CountMetricProducer countProducer(kConfigKey, metric, -1 /*-1 meaning no condition*/, wizard,
+                                      bucketStartTimeNs, bucketStartTimeNs);
+    MetricDimensionKey dimensionKey(getMockedDimensionKey(1, 1, "111"),
+                                    getMockedDimensionKey(2, 1, "222"));
+    (*countProducer.mCurrentSlicedCounter)[dimensionKey] = 2;
+    countProducer.flushIfNeededLocked(bucket2StartTimeNs + 1);
+    (*countProducer.mCurrentSlicedCounter)[dimensionKey] = 3;
+
+    ProtoOutputStream output;
+    countProducer.writeBucketSnapshotToProtoOutputStream(snapshotTimeNs, &output);
+    MetricBucketSnapshot snapshot;
+    EXPECT_TRUE(parseProtoOutputStream(output, &snapshot));
+    EXPECT_EQ(1, snapshot.id());
+    // The past bucket and the current partial bucket.
+    EXPECT_EQ(2, snapshot.count_data_size());
+
+    // The producer of the restarted statsd.
+    int64_t restartTimeNs = snapshotTimeNs + NS_PER_SEC;
+    CountMetricProducer restoredProducer(kConfigKey, metric, -1 /*-1 meaning no condition*/,
+                                         wizard, restartTimeNs, restartTimeNs);
+    restoredProducer.loadBucketSnapshot(snapshot);
+
+    EXPECT_EQ(1UL, restoredProducer.mPastBuckets.size());
+    const auto& buckets = restoredProducer.mPastBuckets[dimensionKey];
+    EXPECT_EQ(2UL, buckets.size());
+    EXPECT_EQ(bucketStartTimeNs, buckets[0].mBucketStartNs);
+    EXPECT_EQ(bucket2StartTimeNs, buckets[0].mBucketEndNs);
+    EXPECT_EQ(2LL, buckets[0].mCount);
+    EXPECT_EQ(bucket2StartTimeNs, buckets[1].mBucketStartNs);
+    EXPECT_EQ(snapshotTimeNs, buckets[1].mBucketEndNs);
+    EXPECT_EQ(3LL, buckets[1].mCount);
+}
+
 }  // namespace statsd
 }  // namespace os
 }  // namespace android
@@ -139,14 +139,14 @@ TEST(GaugeMetricProducerTest, TestPulledEventsNoCondition) {
 
     gaugeProducer.onDataPulled(allData, /** succeed */ true, bucket2StartTimeNs);
     EXPECT_EQ(1UL, gaugeProducer.mCurrentSlicedBucket->size());
-    auto it = gaugeProducer.mCurrentSlicedBucket->begin()->second.front().mFields->begin();
+    auto it = gaugeProducer.mCurrentSlicedBucket->begin()->second.fields(0);
     EXPECT_EQ(INT, it->mValue.getType());
     EXPECT_EQ(10, it->mValue.int_value);
     it++;
     EXPECT_EQ(11, it->mValue.int_value);
     EXPECT_EQ(1UL, gaugeProducer.mPastBuckets.size());
     EXPECT_EQ(3, gaugeProducer.mPastBuckets.begin()->second.back().mGaugeAtoms
-        .front().mFields->begin()->mValue.int_value);
+        .fields(0)->mValue.int_value);
 
     allData.clear();
     std::shared_ptr<LogEvent> event2 = std::make_shared<LogEvent>(tagId, bucket3StartTimeNs + 10);
@@ -157,7 +157,7 @@ TEST(GaugeMetricProducerTest, TestPulledEventsNoCondition) {
     allData.push_back(event2);
     gaugeProducer.onDataPulled(allData, /** succeed */ true, bucket3StartTimeNs);
     EXPECT_EQ(1UL, gaugeProducer.mCurrentSlicedBucket->size());
-    it = gaugeProducer.mCurrentSlicedBucket->begin()->second.front().mFields->begin();
+    it = gaugeProducer.mCurrentSlicedBucket->begin()->second.fields(0);
     EXPECT_EQ(INT, it->mValue.getType());
     EXPECT_EQ(24, it->mValue.int_value);
     it++;
@@ -166,7 +166,7 @@ TEST(GaugeMetricProducerTest, TestPulledEventsNoCondition) {
     // One dimension.
     EXPECT_EQ(1UL, gaugeProducer.mPastBuckets.size());
     EXPECT_EQ(2UL, gaugeProducer.mPastBuckets.begin()->second.size());
-    it = gaugeProducer.mPastBuckets.begin()->second.back().mGaugeAtoms.front().mFields->begin();
+    it = gaugeProducer.mPastBuckets.begin()->second.back().mGaugeAtoms.fields(0);
     EXPECT_EQ(INT, it->mValue.getType());
     EXPECT_EQ(10L, it->mValue.int_value);
     it++;
@@ -178,7 +178,7 @@ TEST(GaugeMetricProducerTest, TestPulledEventsNoCondition) {
     // One dimension.
     EXPECT_EQ(1UL, gaugeProducer.mPastBuckets.size());
     EXPECT_EQ(3UL, gaugeProducer.mPastBuckets.begin()->second.size());
-    it = gaugeProducer.mPastBuckets.begin()->second.back().mGaugeAtoms.front().mFields->begin();
+    it = gaugeProducer.mPastBuckets.begin()->second.back().mGaugeAtoms.fields(0);
     EXPECT_EQ(INT, it->mValue.getType());
     EXPECT_EQ(24L, it->mValue.int_value);
     it++;
@@ -314,8 +314,8 @@ TEST(GaugeMetricProducerTest, TestPulledWithUpgrade) {
     gaugeProducer.onDataPulled(allData, /** succeed */ true, bucketStartTimeNs);
     EXPECT_EQ(1UL, gaugeProducer.mCurrentSlicedBucket->size());
     EXPECT_EQ(1, gaugeProducer.mCurrentSlicedBucket->begin()
-                         ->second.front()
-                         .mFields->begin()
+                         ->second
+                         .fields(0)
                          ->mValue.int_value);
 
     gaugeProducer.notifyAppUpgrade(eventUpgradeTimeNs, "ANY.APP", 1, 1);
@@ -324,8 +324,8 @@ TEST(GaugeMetricProducerTest, TestPulledWithUpgrade) {
     EXPECT_EQ((int64_t)eventUpgradeTimeNs, gaugeProducer.mCurrentBucketStartTimeNs);
     EXPECT_EQ(1UL, gaugeProducer.mCurrentSlicedBucket->size());
     EXPECT_EQ(2, gaugeProducer.mCurrentSlicedBucket->begin()
-                         ->second.front()
-                         .mFields->begin()
+                         ->second
+                         .fields(0)
                          ->mValue.int_value);
 
     allData.clear();
@@ -338,8 +338,8 @@ TEST(GaugeMetricProducerTest, TestPulledWithUpgrade) {
     EXPECT_EQ(2UL, gaugeProducer.mPastBuckets[DEFAULT_METRIC_DIMENSION_KEY].size());
     EXPECT_EQ(1UL, gaugeProducer.mCurrentSlicedBucket->size());
     EXPECT_EQ(3, gaugeProducer.mCurrentSlicedBucket->begin()
-                         ->second.front()
-                         .mFields->begin()
+                         ->second
+                         .fields(0)
                          ->mValue.int_value);
 }
 
@@ -381,8 +381,8 @@ TEST(GaugeMetricProducerTest, TestPulledWithAppUpgradeDisabled) {
     gaugeProducer.onDataPulled(allData, /** succeed */ true, bucketStartTimeNs);
     EXPECT_EQ(1UL, gaugeProducer.mCurrentSlicedBucket->size());
     EXPECT_EQ(1, gaugeProducer.mCurrentSlicedBucket->begin()
-                         ->second.front()
-                         .mFields->begin()
+                         ->second
+                         .fields(0)
                          ->mValue.int_value);
 
     gaugeProducer.notifyAppUpgrade(eventUpgradeTimeNs, "ANY.APP", 1, 1);
@@ -391,8 +391,8 @@ TEST(GaugeMetricProducerTest, TestPulledWithAppUpgradeDisabled) {
     EXPECT_EQ(bucketStartTimeNs, gaugeProducer.mCurrentBucketStartTimeNs);
     EXPECT_EQ(1UL, gaugeProducer.mCurrentSlicedBucket->size());
     EXPECT_EQ(1, gaugeProducer.mCurrentSlicedBucket->begin()
-                         ->second.front()
-                         .mFields->begin()
+                         ->second
+                         .fields(0)
                          ->mValue.int_value);
 }
 
@@ -436,8 +436,8 @@ TEST(GaugeMetricProducerTest, TestPulledEventsWithCondition) {
     gaugeProducer.onConditionChanged(true, bucketStartTimeNs + 8);
     EXPECT_EQ(1UL, gaugeProducer.mCurrentSlicedBucket->size());
     EXPECT_EQ(100, gaugeProducer.mCurrentSlicedBucket->begin()
-                           ->second.front()
-                           .mFields->begin()
+                           ->second
+                           .fields(0)
                            ->mValue.int_value);
     EXPECT_EQ(0UL, gaugeProducer.mPastBuckets.size());
 
@@ -452,14 +452,14 @@ TEST(GaugeMetricProducerTest, TestPulledEventsWithCondition) {
 
     EXPECT_EQ(1UL, gaugeProducer.mCurrentSlicedBucket->size());
     EXPECT_EQ(110, gaugeProducer.mCurrentSlicedBucket->begin()
-                           ->second.front()
-                           .mFields->begin()
+                           ->second
+                           .fields(0)
                            ->mValue.int_value);
     EXPECT_EQ(1UL, gaugeProducer.mPastBuckets.size());
     EXPECT_EQ(100, gaugeProducer.mPastBuckets.begin()
                            ->second.back()
-                           .mGaugeAtoms.front()
-                           .mFields->begin()
+                           .mGaugeAtoms
+                           .fields(0)
                            ->mValue.int_value);
 
     gaugeProducer.onConditionChanged(false, bucket2StartTimeNs + 10);
@@ -468,8 +468,8 @@ TEST(GaugeMetricProducerTest, TestPulledEventsWithCondition) {
     EXPECT_EQ(2UL, gaugeProducer.mPastBuckets.begin()->second.size());
     EXPECT_EQ(110L, gaugeProducer.mPastBuckets.begin()
                             ->second.back()
-                            .mGaugeAtoms.front()
-                            .mFields->begin()
+                            .mGaugeAtoms
+                            .fields(0)
                             ->mValue.int_value);
 }
 
@@ -603,8 +603,8 @@ TEST(GaugeMetricProducerTest, TestPulledEventsAnomalyDetection) {
     gaugeProducer.onDataPulled({event1}, /** succeed */ true, bucketStartTimeNs);
     EXPECT_EQ(1UL, gaugeProducer.mCurrentSlicedBucket->size());
     EXPECT_EQ(13L, gaugeProducer.mCurrentSlicedBucket->begin()
-                           ->second.front()
-                           .mFields->begin()
+                           ->second
+                           .fields(0)
                            ->mValue.int_value);
     EXPECT_EQ(anomalyTracker->getRefractoryPeriodEndsSec(DEFAULT_METRIC_DIMENSION_KEY), 0U);
 
@@ -617,8 +617,8 @@ TEST(GaugeMetricProducerTest, TestPulledEventsAnomalyDetection) {
     gaugeProducer.onDataPulled({event2}, /** succeed */ true, bucketStartTimeNs + bucketSizeNs);
     EXPECT_EQ(1UL, gaugeProducer.mCurrentSlicedBucket->size());
     EXPECT_EQ(15L, gaugeProducer.mCurrentSlicedBucket->begin()
-                           ->second.front()
-                           .mFields->begin()
+                           ->second
+                           .fields(0)
                            ->mValue.int_value);
     EXPECT_EQ(anomalyTracker->getRefractoryPeriodEndsSec(DEFAULT_METRIC_DIMENSION_KEY),
               std::ceil(1.0 * event2->GetElapsedTimestampNs() / NS_PER_SEC) + refPeriodSec);
@@ -632,8 +632,8 @@ TEST(GaugeMetricProducerTest, TestPulledEventsAnomalyDetection) {
     gaugeProducer.onDataPulled({event3}, /** succeed */ true, bucket2StartTimeNs + 2 * bucketSizeNs);
     EXPECT_EQ(1UL, gaugeProducer.mCurrentSlicedBucket->size());
     EXPECT_EQ(26L, gaugeProducer.mCurrentSlicedBucket->begin()
-                           ->second.front()
-                           .mFields->begin()
+                           ->second
+                           .fields(0)
                            ->mValue.int_value);
     EXPECT_EQ(anomalyTracker->getRefractoryPeriodEndsSec(DEFAULT_METRIC_DIMENSION_KEY),
               std::ceil(1.0 * event2->GetElapsedTimestampNs() / NS_PER_SEC + refPeriodSec));
@@ -645,7 +645,7 @@ TEST(GaugeMetricProducerTest, TestPulledEventsAnomalyDetection) {
     event4->init();
     gaugeProducer.onDataPulled({event4}, /** succeed */ true, bucketStartTimeNs + 3 * bucketSizeNs);
     EXPECT_EQ(1UL, gaugeProducer.mCurrentSlicedBucket->size());
-    EXPECT_TRUE(gaugeProducer.mCurrentSlicedBucket->begin()->second.front().mFields->empty());
+    EXPECT_EQ(0UL, gaugeProducer.mCurrentSlicedBucket->begin()->second.fieldCount(0));
 }
 
 TEST(GaugeMetricProducerTest, TestPullOnTrigger) {
@@ -711,13 +711,13 @@ TEST(GaugeMetricProducerTest, TestPullOnTrigger) {
     EXPECT_EQ(2UL, gaugeProducer.mPastBuckets.begin()->second.back().mGaugeAtoms.size());
     EXPECT_EQ(4, gaugeProducer.mPastBuckets.begin()
                          ->second.back()
-                         .mGaugeAtoms[0]
-                         .mFields->begin()
+                         .mGaugeAtoms
+                         .fields(0)
                          ->mValue.int_value);
     EXPECT_EQ(5, gaugeProducer.mPastBuckets.begin()
                          ->second.back()
-                         .mGaugeAtoms[1]
-                         .mFields->begin()
+                         .mGaugeAtoms
+                         .fields(1)
                          ->mValue.int_value);
 }
 
@@ -799,12 +799,59 @@ TEST(GaugeMetricProducerTest, TestRemoveDimensionInOutput) {
     auto bucketIt = gaugeProducer.mPastBuckets.begin();
     EXPECT_EQ(1UL, bucketIt->second.back().mGaugeAtoms.size());
     EXPECT_EQ(3, bucketIt->first.getDimensionKeyInWhat().getValues().begin()->mValue.int_value);
-    EXPECT_EQ(4, bucketIt->second.back().mGaugeAtoms[0].mFields->begin()->mValue.int_value);
+    EXPECT_EQ(4, bucketIt->second.back().mGaugeAtoms.fields(0)->mValue.int_value);
     bucketIt++;
     EXPECT_EQ(2UL, bucketIt->second.back().mGaugeAtoms.size());
     EXPECT_EQ(4, bucketIt->first.getDimensionKeyInWhat().getValues().begin()->mValue.int_value);
-    EXPECT_EQ(5, bucketIt->second.back().mGaugeAtoms[0].mFields->begin()->mValue.int_value);
-    EXPECT_EQ(6, bucketIt->second.back().mGaugeAtoms[1].mFields->begin()->mValue.int_value);
+    EXPECT_EQ(5, bucketIt->second.back().mGaugeAtoms.fields(0)->mValue.int_value);
+    EXPECT_EQ(6, bucketIt->second.back().mGaugeAtoms.fields(1)->mValue.int_value);
+}
+
+TEST(GaugeMetricProducerTest, TestFieldsFilterStoresOnlyProjectedFields) {
+    GaugeMetric metric;
+    metric.set_id(metricId);
+    metric.set_bucket(ONE_MINUTE);
+    metric.set_sampling_type(GaugeMetric::FIRST_N_SAMPLES);
+    auto gaugeFieldMatcher = metric.mutable_gauge_fields_filter()->mutable_fields();
+    gaugeFieldMatcher->set_field(tagId);
+    gaugeFieldMatcher->add_child()->set_field(2);
+
+    sp<MockConditionWizard> wizard = new NaggyMock<MockConditionWizard>();
+    sp<MockStatsPullerManager> pullerManager = new StrictMock<MockStatsPullerManager>();
+
+    UidMap uidMap;
+    SimpleAtomMatcher atomMatcher;
+    atomMatcher.set_atom_id(tagId);
+    sp<EventMatcherWizard> eventMatcherWizard = new EventMatcherWizard({
+        new SimpleLogMatchingTracker(atomMatcherId, logEventMatcherIndex, atomMatcher, uidMap)});
+
+    GaugeMetricProducer gaugeProducer(kConfigKey, metric, -1 /*-1 meaning no condition*/, wizard,
+                                      logEventMatcherIndex, eventMatcherWizard,
+                                      -1 /* -1 means no pulling */, -1, tagId, bucketStartTimeNs,
+                                      bucketStartTimeNs, pullerManager);
+    gaugeProducer.prepareFirstBucket();
+
+    for (int i = 0; i < 3; i++) {
+        shared_ptr<LogEvent> event = make_shared<LogEvent>(tagId, bucketStartTimeNs + 10 + i);
+        event->write(1);
+        event->write(10 + i);
+        event->write("unused");
+        event->init();
+        gaugeProducer.onMatchedLogEvent(1 /*log matcher index*/, *event);
+    }
+    gaugeProducer.flushIfNeededLocked(bucket2StartTimeNs + 1);
+
+    EXPECT_EQ(1UL, gaugeProducer.mPastBuckets.size());
+    const GaugeAtoms& atoms =
+            gaugeProducer.mPastBuckets[DEFAULT_METRIC_DIMENSION_KEY].back().mGaugeAtoms;
+    EXPECT_EQ(3UL, atoms.size());
+    // Only field 2 of each atom is kept.
+    EXPECT_EQ(3UL, atoms.mFields.size());
+    for (size_t i = 0; i < atoms.size(); i++) {
+        EXPECT_EQ(1UL, atoms.fieldCount(i));
+        EXPECT_EQ(10 + (int)i, atoms.fields(i)->mValue.int_value);
+        EXPECT_EQ(bucketStartTimeNs + 10 + (int64_t)i, atoms.mElapsedTimestampsNs[i]);
+    }
 }
 
 }  // namespace statsd
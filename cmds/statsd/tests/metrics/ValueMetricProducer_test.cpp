@@ -3124,6 +3124,59 @@ TEST(ValueMetricProducerTest, TestPulledData_noDiff_withFailure) {
     assertPastBucketValuesSingleKey(valueProducer->mPastBuckets, {}, {});
 }
 
+TEST(ValueMetricProducerTest, TestCompactPastBucketsRoundTrip) {
+    CompactValueBucketStore store;
+    MetricDimensionKey key1(getMockedDimensionKey(tagId, 1, "a"), DEFAULT_DIMENSION_KEY);
+    MetricDimensionKey key2(getMockedDimensionKey(tagId, 1, "b"), DEFAULT_DIMENSION_KEY);
+
+    ValueBucket bucket1;
+    bucket1.mBucketStartNs = bucketStartTimeNs;
+    bucket1.mBucketEndNs = bucket2StartTimeNs;
+    bucket1.valueIndex = {0, 2};
+    bucket1.values = {Value((int64_t)-5), Value(2.5)};
+    bucket1.mConditionTrueNs = 20;
+    store.append(key1, bucket1);
+
+    // A partial bucket followed by a gap.
+    ValueBucket bucket2;
+    bucket2.mBucketStartNs = bucket3StartTimeNs;
+    bucket2.mBucketEndNs = bucket3StartTimeNs + 10;
+    bucket2.valueIndex = {1};
+    bucket2.values = {Value((int64_t)INT64_MAX)};
+    bucket2.mConditionTrueNs = 0;
+    store.append(key1, bucket2);
+    store.append(key2, bucket1);
+
+    EXPECT_EQ(3UL, store.getBucketCount());
+    EXPECT_LT(store.getBytesPerBucket(), (double)sizeof(ValueBucket{}) * 2);
+
+    std::unordered_map<MetricDimensionKey, std::vector<ValueBucket>> decoded;
+    store.forEach([&decoded](const MetricDimensionKey& key,
+                             const std::vector<ValueBucket>& buckets) { decoded[key] = buckets; });
+    EXPECT_EQ(2UL, decoded.size());
+    EXPECT_EQ(2UL, decoded[key1].size());
+    EXPECT_EQ(1UL, decoded[key2].size());
+
+    const ValueBucket& first = decoded[key1][0];
+    EXPECT_EQ(bucketStartTimeNs, first.mBucketStartNs);
+    EXPECT_EQ(bucket2StartTimeNs, first.mBucketEndNs);
+    EXPECT_EQ(20, first.mConditionTrueNs);
+    EXPECT_EQ(vector<int>({0, 2}), first.valueIndex);
+    EXPECT_EQ(-5, first.values[0].long_value);
+    EXPECT_EQ(DOUBLE, first.values[1].getType());
+    EXPECT_EQ(2.5, first.values[1].double_value);
+
+    const ValueBucket& second = decoded[key1][1];
+    EXPECT_EQ(bucket3StartTimeNs, second.mBucketStartNs);
+    EXPECT_EQ(bucket3StartTimeNs + 10, second.mBucketEndNs);
+    EXPECT_EQ(vector<int>({1}), second.valueIndex);
+    EXPECT_EQ(INT64_MAX, second.values[0].long_value);
+
+    store.clear();
+    EXPECT_TRUE(store.empty());
+    EXPECT_EQ(0UL, store.byteSize());
+}
+
 }  // namespace statsd
 }  // namespace os
 }  // namespace android
@@ -210,6 +210,36 @@ TEST(ShellSubscriberTest, testPulledSubscription) {
                  getExpectedShellData());
 }
 
+TEST(ShellSubscriberTest, testStreamingSubscriptionDropsOnOverflow) {
+    sp<MockUidMap> uidMap = new NaggyMock<MockUidMap>();
+
+    sp<MockStatsPullerManager> pullerManager = new StrictMock<MockStatsPullerManager>();
+    vector<std::shared_ptr<LogEvent>> pushedList;
+    for (int i = 0; i < 3; i++) {
+        std::shared_ptr<LogEvent> event =
+                std::make_shared<LogEvent>(29 /*screen_state_atom_id*/, 1000 + i /*timestamp*/);
+        event->write(::android::view::DisplayStateEnum::DISPLAY_STATE_ON);
+        event->init();
+        pushedList.push_back(event);
+    }
+
+    // Room for two atoms, all pushed before the writer thread wakes up.
+    ShellSubscription config;
+    config.add_pushed()->set_atom_id(29);
+    config.mutable_streaming()->set_buffer_atoms(2);
+    config.mutable_streaming()->set_flush_interval_millis(150);
+
+    // The first two atoms in one batch, and the third one counted as dropped.
+    ShellData shellData;
+    for (int i = 0; i < 2; i++) {
+        shellData.add_atom()->mutable_screen_state_changed()->set_state(
+                ::android::view::DisplayStateEnum::DISPLAY_STATE_ON);
+    }
+    shellData.set_dropped_atom_count(1);
+
+    runShellTest(config, uidMap, pullerManager, pushedList, shellData);
+}
+
 #else
 GTEST_LOG_(INFO) << "This test does nothing.\n";
 #endif
@@ -224,6 +224,35 @@ TEST(StorageManagerTest, AppendConfigReportTest4) {
     clearLocalHistoryTestFiles();
 }
 
+TEST(StorageManagerTest, WriteFileAsyncTest) {
+    const ConfigKey key(1066, 1);
+    StorageManager::writeFileAsync(file1, key, vector<uint8_t>{'a', 'b'}, false);
+    StorageManager::writeFileAsync(file2, key, vector<uint8_t>{'c'}, false);
+    StorageManager::flushPendingWrites();
+
+    string content;
+    EXPECT_TRUE(StorageManager::readFileToString(file1.c_str(), &content));
+    EXPECT_EQ("ab", content);
+    EXPECT_TRUE(StorageManager::readFileToString(file2.c_str(), &content));
+    EXPECT_EQ("c", content);
+
+    StorageManager::deleteFile(file1.c_str());
+    StorageManager::deleteFile(file2.c_str());
+    EXPECT_FALSE(fileExist(file1));
+    EXPECT_FALSE(fileExist(file2));
+}
+
+TEST(StorageManagerTest, DeleteFileDropsPendingWriteTest) {
+    const ConfigKey key(1066, 1);
+    for (int i = 0; i < 50; i++) {
+        StorageManager::writeFileAsync(file1, key, vector<uint8_t>{'a'}, false);
+        StorageManager::deleteFile(file1.c_str());
+        EXPECT_FALSE(fileExist(file1));
+    }
+    StorageManager::flushPendingWrites();
+    EXPECT_FALSE(fileExist(file1));
+}
+
 }  // namespace statsd
 }  // namespace os
 }  // namespace android
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/anomaly/timer_wheel.h"
+
+#include <gtest/gtest.h>
+
+using namespace android::os::statsd;
+
+/** struct for template in timer_wheel */
+struct TWTest : public RefBase {
+    explicit TWTest(uint32_t timestampSec) : timestampSec(timestampSec) {
+    }
+
+    const uint32_t timestampSec;
+};
+
+#ifdef __ANDROID__
+TEST(timer_wheel, empty_and_size) {
+    timer_wheel<TWTest> wheel;
+    sp<const TWTest> a = new TWTest{4};
+    sp<const TWTest> b = new TWTest{8};
+
+    EXPECT_EQ(0u, wheel.size());
+    EXPECT_TRUE(wheel.empty());
+
+    wheel.push(a);
+    wheel.push(b);
+    wheel.push(b);
+    EXPECT_EQ(2u, wheel.size());
+    EXPECT_TRUE(wheel.contains(a));
+
+    EXPECT_TRUE(wheel.remove(a));
+    EXPECT_FALSE(wheel.remove(a));
+    EXPECT_FALSE(wheel.contains(a));
+    EXPECT_EQ(1u, wheel.size());
+
+    wheel.clear();
+    EXPECT_TRUE(wheel.empty());
+    EXPECT_EQ(wheel.top(), nullptr);
+}
+
+TEST(timer_wheel, top_across_levels) {
+    const uint32_t base = 1500000000;
+    timer_wheel<TWTest> wheel;
+    sp<const TWTest> soon = new TWTest{base + 10};
+    sp<const TWTest> minutes = new TWTest{base + 1000};
+    sp<const TWTest> days = new TWTest{base + 200000};
+    sp<const TWTest> years = new TWTest{base + 100000000};
+
+    wheel.push(years);
+    EXPECT_EQ(years, wheel.top());
+    wheel.push(days);
+    wheel.push(minutes);
+    EXPECT_EQ(minutes, wheel.top());
+    wheel.push(soon);
+    EXPECT_EQ(soon, wheel.top());
+
+    wheel.remove(soon);
+    EXPECT_EQ(minutes, wheel.top());
+    wheel.remove(minutes);
+    EXPECT_EQ(days, wheel.top());
+    wheel.remove(days);
+    EXPECT_EQ(years, wheel.top());
+}
+
+TEST(timer_wheel, popSoonerThan) {
+    const uint32_t base = 1500000000;
+    timer_wheel<TWTest> wheel;
+    sp<const TWTest> a = new TWTest{base + 10};
+    sp<const TWTest> b = new TWTest{base + 70};
+    sp<const TWTest> c = new TWTest{base + 70};
+    sp<const TWTest> d = new TWTest{base + 5000};
+    sp<const TWTest> e = new TWTest{base + 100000000};
+    wheel.push(a);
+    wheel.push(b);
+    wheel.push(c);
+    wheel.push(d);
+    wheel.push(e);
+
+    std::unordered_set<sp<const TWTest>, SpHash<TWTest>> fired;
+    wheel.popSoonerThan(base + 9, &fired);
+    EXPECT_TRUE(fired.empty());
+
+    wheel.popSoonerThan(base + 70, &fired);
+    EXPECT_EQ(3u, fired.size());
+    EXPECT_EQ(1u, fired.count(a));
+    EXPECT_EQ(1u, fired.count(b));
+    EXPECT_EQ(1u, fired.count(c));
+    EXPECT_EQ(d, wheel.top());
+
+    // An alarm already in the past is due right away.
+    sp<const TWTest> late = new TWTest{base + 20};
+    wheel.push(late);
+    EXPECT_EQ(late, wheel.top());
+
+    fired.clear();
+    wheel.popSoonerThan(base + 5000, &fired);
+    EXPECT_EQ(2u, fired.size());
+    EXPECT_EQ(1u, fired.count(late));
+    EXPECT_EQ(1u, fired.count(d));
+    EXPECT_EQ(e, wheel.top());
+
+    fired.clear();
+    wheel.popSoonerThan(base + 100000000, &fired);
+    EXPECT_EQ(1u, fired.size());
+    EXPECT_EQ(1u, fired.count(e));
+    EXPECT_TRUE(wheel.empty());
+}
+
+#else
+GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif
@@ -0,0 +1,329 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "IncrementalVelocityTracker"
+
+#include "IncrementalVelocityTracker.h"
+
+#include <string.h>
+
+namespace android {
+
+static inline double toSeconds(nsecs_t time) {
+    return time * 0.000000001;
+}
+
+IncrementalVelocityTracker::IncrementalVelocityTracker() :
+        mFitsDirty(true), mActivePointerId(-1), mLastEventTime(0) {
+    memset(mHistory, 0, sizeof(mHistory));
+    memset(&mSums, 0, sizeof(mSums));
+    memset(&mFits, 0, sizeof(mFits));
+}
+
+void IncrementalVelocityTracker::clear() {
+    mCurrentPointerIdBits.clear();
+    mActivePointerId = -1;
+    while (!mTrackedIdBits.isEmpty()) {
+        clearPointer(mTrackedIdBits.clearFirstMarkedBit());
+    }
+}
+
+void IncrementalVelocityTracker::clearPointers(BitSet32 idBits) {
+    BitSet32 remainingIdBits(mCurrentPointerIdBits.value & ~idBits.value);
+    mCurrentPointerIdBits = remainingIdBits;
+
+    if (mActivePointerId >= 0 && idBits.hasBit(mActivePointerId)) {
+        mActivePointerId = !remainingIdBits.isEmpty() ? remainingIdBits.firstMarkedBit() : -1;
+    }
+
+    BitSet32 clearedIdBits(mTrackedIdBits.value & idBits.value);
+    mTrackedIdBits.value &= ~idBits.value;
+    while (!clearedIdBits.isEmpty()) {
+        clearPointer(clearedIdBits.clearFirstMarkedBit());
+    }
+}
+
+void IncrementalVelocityTracker::clearPointer(uint32_t id) {
+    mHistory[id].count = 0;
+    mHistory[id].oldest = 0;
+    mSums.n[id] = 0;
+    mSums.t[id] = 0;
+    mSums.t2[id] = 0;
+    mSums.t3[id] = 0;
+    mSums.t4[id] = 0;
+    mSums.x[id] = 0;
+    mSums.tx[id] = 0;
+    mSums.t2x[id] = 0;
+    mSums.y[id] = 0;
+    mSums.ty[id] = 0;
+    mSums.t2y[id] = 0;
+    mFitsDirty = true;
+}
+
+void IncrementalVelocityTracker::accumulate(uint32_t id, const Sample& sample, double sign) {
+    const double t = toSeconds(sample.time - mHistory[id].origin);
+    const double t2 = t * t;
+    mSums.n[id] += sign;
+    mSums.t[id] += sign * t;
+    mSums.t2[id] += sign * t2;
+    mSums.t3[id] += sign * t2 * t;
+    mSums.t4[id] += sign * t2 * t2;
+    mSums.x[id] += sign * sample.x;
+    mSums.tx[id] += sign * t * sample.x;
+    mSums.t2x[id] += sign * t2 * sample.x;
+    mSums.y[id] += sign * sample.y;
+    mSums.ty[id] += sign * t * sample.y;
+    mSums.t2y[id] += sign * t2 * sample.y;
+    mFitsDirty = true;
+}
+
+void IncrementalVelocityTracker::evictOldest(uint32_t id) {
+    History& history = mHistory[id];
+    accumulate(id, history.at(0), -1);
+    history.oldest = (history.oldest + 1) % HISTORY_SIZE;
+    history.count -= 1;
+}
+
+void IncrementalVelocityTracker::rebase(uint32_t id, nsecs_t origin) {
+    History& history = mHistory[id];
+    const size_t count = history.count;
+    const size_t oldest = history.oldest;
+    clearPointer(id);
+    history.count = count;
+    history.oldest = oldest;
+    history.origin = origin;
+    for (size_t i = 0; i < count; i++) {
+        accumulate(id, history.at(i), 1);
+    }
+}
+
+void IncrementalVelocityTracker::addMovement(const MotionEvent* event) {
+    int32_t actionMasked = event->getActionMasked();
+
+    switch (actionMasked) {
+    case AMOTION_EVENT_ACTION_DOWN:
+    case AMOTION_EVENT_ACTION_HOVER_ENTER:
+        // Clear all pointers on down before adding the new movement.
+        clear();
+        break;
+    case AMOTION_EVENT_ACTION_POINTER_DOWN: {
+        // Start a new movement trace for a pointer that just went down.
+        BitSet32 downIdBits;
+        downIdBits.markBit(event->getPointerId(event->getActionIndex()));
+        clearPointers(downIdBits);
+        break;
+    }
+    case AMOTION_EVENT_ACTION_MOVE:
+    case AMOTION_EVENT_ACTION_HOVER_MOVE:
+        break;
+    default:
+        // Ignore all other actions because they do not convey any new information about
+        // pointer movement, as VelocityTracker does.
+        return;
+    }
+
+    size_t pointerCount = event->getPointerCount();
+    if (pointerCount > MAX_POINTERS) {
+        pointerCount = MAX_POINTERS;
+    }
+
+    BitSet32 idBits;
+    for (size_t i = 0; i < pointerCount; i++) {
+        idBits.markBit(event->getPointerId(i));
+    }
+
+    uint32_t pointerIndex[MAX_POINTERS];
+    for (size_t i = 0; i < pointerCount; i++) {
+        pointerIndex[i] = idBits.getIndexOfBit(event->getPointerId(i));
+    }
+
+    VelocityTracker::Position positions[MAX_POINTERS];
+    size_t historySize = event->getHistorySize();
+    for (size_t h = 0; h < historySize; h++) {
+        for (size_t i = 0; i < pointerCount; i++) {
+            uint32_t index = pointerIndex[i];
+            positions[index].x = event->getHistoricalX(i, h);
+            positions[index].y = event->getHistoricalY(i, h);
+        }
+        addMovement(event->getHistoricalEventTime(h), idBits, positions);
+    }
+
+    for (size_t i = 0; i < pointerCount; i++) {
+        uint32_t index = pointerIndex[i];
+        positions[index].x = event->getX(i);
+        positions[index].y = event->getY(i);
+    }
+    addMovement(event->getEventTime(), idBits, positions);
+}
+
+void IncrementalVelocityTracker::addMovement(nsecs_t eventTime, BitSet32 idBits,
+        const VelocityTracker::Position* positions) {
+    while (idBits.count() > MAX_POINTERS) {
+        idBits.clearLastMarkedBit();
+    }
+
+    if ((mCurrentPointerIdBits.value & idBits.value)
+            && eventTime >= mLastEventTime + ASSUME_POINTER_STOPPED_TIME) {
+        // We have not received any movements for too long. Assume that all pointers
+        // have stopped.
+        while (!mTrackedIdBits.isEmpty()) {
+            clearPointer(mTrackedIdBits.clearFirstMarkedBit());
+        }
+    }
+    mLastEventTime = eventTime;
+
+    mCurrentPointerIdBits = idBits;
+    if (mActivePointerId < 0 || !idBits.hasBit(mActivePointerId)) {
+        mActivePointerId = idBits.isEmpty() ? -1 : idBits.firstMarkedBit();
+    }
+
+    // The history of a pointer ends at the first movement it is missing from.
+    BitSet32 missingIdBits(mTrackedIdBits.value & ~idBits.value);
+    while (!missingIdBits.isEmpty()) {
+        clearPointer(missingIdBits.clearFirstMarkedBit());
+    }
+    mTrackedIdBits = idBits;
+
+    for (BitSet32 iterBits(idBits); !iterBits.isEmpty(); ) {
+        uint32_t id = iterBits.clearFirstMarkedBit();
+        const VelocityTracker::Position& position = positions[idBits.getIndexOfBit(id)];
+        const Sample sample = { eventTime, position.x, position.y };
+        History& history = mHistory[id];
+
+        if (history.count > 0 && history.newest().time == eventTime) {
+            // A second movement with the same time, like the ACTION_POINTER_DOWN that follows
+            // an ACTION_MOVE, updates the sample rather than adding one.
+            accumulate(id, history.newest(), -1);
+            history.newest() = sample;
+            accumulate(id, sample, 1);
+            continue;
+        }
+
+        if (history.count == 0) {
+            history.origin = eventTime;
+        } else if (history.count == HISTORY_SIZE) {
+            evictOldest(id);
+        }
+        history.count += 1;
+        history.newest() = sample;
+        accumulate(id, sample, 1);
+
+        while (eventTime - history.at(0).time > HORIZON) {
+            evictOldest(id);
+        }
+        if (eventTime - history.origin > REBASE_INTERVAL) {
+            rebase(id, eventTime);
+        }
+    }
+}
+
+void IncrementalVelocityTracker::computeFits() {
+    // Solves y = a*t^2 + b*t + c for every id at once, like VelocityTracker's
+    // solveUnweightedLeastSquaresDeg2(). Ids without enough samples get degenerate
+    // fits, which getEstimator() doesn't use, so the loop has no data-dependent branches.
+    for (size_t id = 0; id < NUM_IDS; id++) {
+        const double invN = 1.0 / (mSums.n[id] > 0 ? mSums.n[id] : 1.0);
+        const double st = mSums.t[id] * invN;
+        const double st2 = mSums.t2[id] * invN;
+        const double st3 = mSums.t3[id] * invN;
+        const double st4 = mSums.t4[id] * invN;
+
+        const double Stt = st2 - st * st;
+        const double Stt2 = st3 - st * st2;
+        const double St2t2 = st4 - st2 * st2;
+        const double denominator = Stt * St2t2 - Stt2 * Stt2;
+        const double invDenominator = denominator != 0 ? 1.0 / denominator : 0;
+
+        const double sx = mSums.x[id] * invN;
+        const double Stx = mSums.tx[id] * invN - st * sx;
+        const double St2x = mSums.t2x[id] * invN - st2 * sx;
+        mFits.bx[id] = (Stx * St2t2 - St2x * Stt2) * invDenominator;
+        mFits.ax[id] = (St2x * Stt - Stx * Stt2) * invDenominator;
+        mFits.cx[id] = sx - mFits.bx[id] * st - mFits.ax[id] * st2;
+
+        const double sy = mSums.y[id] * invN;
+        const double Sty = mSums.ty[id] * invN - st * sy;
+        const double St2y = mSums.t2y[id] * invN - st2 * sy;
+        mFits.by[id] = (Sty * St2t2 - St2y * Stt2) * invDenominator;
+        mFits.ay[id] = (St2y * Stt - Sty * Stt2) * invDenominator;
+        mFits.cy[id] = sy - mFits.by[id] * st - mFits.ay[id] * st2;
+
+        mFits.solved[id] = denominator != 0;
+    }
+    mFitsDirty = false;
+}
+
+bool IncrementalVelocityTracker::getVelocity(uint32_t id, float* outVx, float* outVy) {
+    VelocityTracker::Estimator estimator;
+    if (getEstimator(id, &estimator) && estimator.degree >= 1) {
+        *outVx = estimator.xCoeff[1];
+        *outVy = estimator.yCoeff[1];
+        return true;
+    }
+    *outVx = 0;
+    *outVy = 0;
+    return false;
+}
+
+bool IncrementalVelocityTracker::getEstimator(uint32_t id,
+        VelocityTracker::Estimator* outEstimator) {
+    outEstimator->clear();
+
+    if (id >= NUM_IDS || !mTrackedIdBits.hasBit(id) || mHistory[id].count == 0) {
+        return false; // no data
+    }
+    if (mFitsDirty) {
+        computeFits();
+    }
+
+    History& history = mHistory[id];
+    const Sample& newest = history.newest();
+    outEstimator->time = newest.time;
+    outEstimator->confidence = 1;
+
+    if (history.count >= 3 && mFits.solved[id]) {
+        // Move the fit's origin to the newest sample.
+        const double tn = toSeconds(newest.time - history.origin);
+        outEstimator->degree = 2;
+        outEstimator->xCoeff[0] = mFits.cx[id] + (mFits.bx[id] + mFits.ax[id] * tn) * tn;
+        outEstimator->xCoeff[1] = mFits.bx[id] + 2 * mFits.ax[id] * tn;
+        outEstimator->xCoeff[2] = mFits.ax[id];
+        outEstimator->yCoeff[0] = mFits.cy[id] + (mFits.by[id] + mFits.ay[id] * tn) * tn;
+        outEstimator->yCoeff[1] = mFits.by[id] + 2 * mFits.ay[id] * tn;
+        outEstimator->yCoeff[2] = mFits.ay[id];
+        return true;
+    }
+
+    if (history.count == 2) {
+        // The least-squares line through two samples passes through both.
+        const Sample& previous = history.at(0);
+        const double dt = toSeconds(newest.time - previous.time);
+        outEstimator->degree = 1;
+        outEstimator->xCoeff[0] = newest.x;
+        outEstimator->xCoeff[1] = (newest.x - previous.x) / dt;
+        outEstimator->yCoeff[0] = newest.y;
+        outEstimator->yCoeff[1] = (newest.y - previous.y) / dt;
+        return true;
+    }
+
+    // No velocity data available for this pointer, but we do have its current position.
+    outEstimator->degree = 0;
+    outEstimator->xCoeff[0] = newest.x;
+    outEstimator->yCoeff[0] = newest.y;
+    return true;
+}
+
+} // namespace android
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FRAMEWORKS_BASE_CORE_JNI_INCREMENTALVELOCITYTRACKER_H_
+#define FRAMEWORKS_BASE_CORE_JNI_INCREMENTALVELOCITYTRACKER_H_
+
+#include <input/Input.h>
+#include <input/VelocityTracker.h>
+#include <utils/BitSet.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+/*
+ * Tracks pointer velocities with the same fit as VelocityTracker's default "lsq2" strategy:
+ * an unweighted quadratic least-squares fit over each pointer's last 20 samples from the last
+ * 100ms. Instead of refitting all samples of a pointer whenever its velocity is requested, it
+ * updates the sums the fit needs as samples are added and evicted, and solves the fits of all
+ * pointers in one branch-free pass over arrays of those sums.
+ *
+ * Selected with the "ilsq2" strategy name.
+ */
+class IncrementalVelocityTracker {
+public:
+    IncrementalVelocityTracker();
+
+    // Resets the tracker, as on ACTION_DOWN.
+    void clear();
+
+    // Forgets the movements of the given pointers, as on ACTION_POINTER_DOWN.
+    void clearPointers(BitSet32 idBits);
+
+    // Adds all samples of a motion event, following VelocityTracker::addMovement().
+    void addMovement(const MotionEvent* event);
+
+    // Adds one sample per pointer. positions[idBits.getIndexOfBit(id)] is the position of id.
+    void addMovement(nsecs_t eventTime, BitSet32 idBits,
+            const VelocityTracker::Position* positions);
+
+    // Solves the fits of all pointers. Called lazily by getVelocity() and getEstimator().
+    void computeFits();
+
+    // Gets the velocity of a pointer in pixels per second, or zero if it is not known.
+    bool getVelocity(uint32_t id, float* outVx, float* outVy);
+
+    // Gets the fit of a pointer, with time relative to its newest sample.
+    bool getEstimator(uint32_t id, VelocityTracker::Estimator* outEstimator);
+
+    inline BitSet32 getCurrentPointerIdBits() const { return mCurrentPointerIdBits; }
+    inline int32_t getActivePointerId() const { return mActivePointerId; }
+
+private:
+    static const size_t HISTORY_SIZE = 20;
+    static const nsecs_t HORIZON = 100 * 1000000; // 100 ms
+    static const nsecs_t ASSUME_POINTER_STOPPED_TIME = 40 * 1000000; // 40 ms
+
+    // The sums are relative to a per-pointer time origin. Once the newest sample is this far
+    // from it, the origin moves to the newest sample and the sums are recomputed, which keeps
+    // them well conditioned and drops the rounding error of earlier evictions.
+    static const nsecs_t REBASE_INTERVAL = 1000 * 1000000; // 1 s
+
+    static const size_t NUM_IDS = MAX_POINTER_ID + 1;
+
+    struct Sample {
+        nsecs_t time;
+        float x;
+        float y;
+    };
+
+    struct History {
+        Sample samples[HISTORY_SIZE];
+        size_t oldest;
+        size_t count;
+        nsecs_t origin;
+
+        inline const Sample& at(size_t i) const {
+            return samples[(oldest + i) % HISTORY_SIZE];
+        }
+        inline Sample& newest() {
+            return samples[(oldest + count - 1) % HISTORY_SIZE];
+        }
+    };
+
+    // Running sums of the samples of each pointer, as a structure of arrays indexed by id.
+    // t is the sample time in seconds relative to the pointer's origin.
+    struct Sums {
+        double n[NUM_IDS];
+        double t[NUM_IDS];
+        double t2[NUM_IDS];
+        double t3[NUM_IDS];
+        double t4[NUM_IDS];
+        double x[NUM_IDS];
+        double tx[NUM_IDS];
+        double t2x[NUM_IDS];
+        double y[NUM_IDS];
+        double ty[NUM_IDS];
+        double t2y[NUM_IDS];
+    };
+
+    // The quadratic fit of each pointer, position = c + b * t + a * t^2, with t relative to
+    // the pointer's origin. solved is false where the fit is degenerate.
+    struct Fits {
+        double ax[NUM_IDS];
+        double bx[NUM_IDS];
+        double cx[NUM_IDS];
+        double ay[NUM_IDS];
+        double by[NUM_IDS];
+        double cy[NUM_IDS];
+        bool solved[NUM_IDS];
+    };
+
+    History mHistory[NUM_IDS];
+    Sums mSums;
+    Fits mFits;
+    bool mFitsDirty;
+
+    BitSet32 mCurrentPointerIdBits;
+    BitSet32 mTrackedIdBits;
+    int32_t mActivePointerId;
+    nsecs_t mLastEventTime;
+
+    void clearPointer(uint32_t id);
+    void accumulate(uint32_t id, const Sample& sample, double sign);
+    void evictOldest(uint32_t id);
+    void rebase(uint32_t id, nsecs_t origin);
+};
+
+} // namespace android
+
+#endif // FRAMEWORKS_BASE_CORE_JNI_INCREMENTALVELOCITYTRACKER_H_
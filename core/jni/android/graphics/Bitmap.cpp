@@ -27,10 +27,17 @@
 
 #include "core_jni_helpers.h"
 
+#include <nativehelper/JNIPlatformHelp.h>
+
 #include <jni.h>
 #include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
 #include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 
 #define DEBUG_PARCEL 0
 #define ASHMEM_BITMAP_MIN_SIZE (128 * (1 << 10))
@@ -515,21 +522,114 @@ enum JavaEncodeFormat {
     kWEBP_JavaEncodeFormat = 2
 };
 
-static jboolean Bitmap_compress(JNIEnv* env, jobject clazz, jlong bitmapHandle,
-                                jint format, jint quality,
-                                jobject jstream, jbyteArray jstorage) {
-    SkEncodedImageFormat fm;
+static bool toSkEncodedImageFormat(jint format, SkEncodedImageFormat* outFormat) {
     switch (format) {
     case kJPEG_JavaEncodeFormat:
-        fm = SkEncodedImageFormat::kJPEG;
-        break;
+        *outFormat = SkEncodedImageFormat::kJPEG;
+        return true;
     case kPNG_JavaEncodeFormat:
-        fm = SkEncodedImageFormat::kPNG;
-        break;
+        *outFormat = SkEncodedImageFormat::kPNG;
+        return true;
     case kWEBP_JavaEncodeFormat:
-        fm = SkEncodedImageFormat::kWEBP;
-        break;
+        *outFormat = SkEncodedImageFormat::kWEBP;
+        return true;
     default:
+        return false;
+    }
+}
+
+// Returns the pixels to hand to the encoder, false if they could not be converted.
+static bool prepareForEncode(SkBitmap* skbitmap) {
+    if (skbitmap->colorType() == kRGBA_F16_SkColorType) {
+        // Convert to P3 before encoding. This matches SkAndroidCodec::computeOutputColorSpace
+        // for wide gamuts.
+        auto cs = SkColorSpace::MakeRGB(SkNamedTransferFn::kSRGB, SkNamedGamut::kDCIP3);
+        auto info = skbitmap->info().makeColorType(kRGBA_8888_SkColorType)
+                                    .makeColorSpace(std::move(cs));
+        SkBitmap p3;
+        if (!p3.tryAllocPixels(info)) {
+            return false;
+        }
+
+        SkPixmap pm;
+        SkAssertResult(p3.peekPixels(&pm));  // should always work if tryAllocPixels() did.
+        if (!skbitmap->readPixels(pm)) {
+            return false;
+        }
+        *skbitmap = p3;
+    }
+    return true;
+}
+
+/**
+ * Buffered SkWStream writing to a file descriptor it does not own, so that encoding to a file
+ * does not go through a Java OutputStream for every chunk.
+ */
+class FdWStream : public SkWStream {
+public:
+    explicit FdWStream(int fd) : mFd(fd) {}
+
+    ~FdWStream() override { flush(); }
+
+    bool write(const void* buffer, size_t size) override {
+        const char* bytes = static_cast<const char*>(buffer);
+        while (size > 0 && !mError) {
+            if (mBufferedSize == kBufferSize) {
+                flush();
+            }
+            size_t copied = std::min(size, kBufferSize - mBufferedSize);
+            memcpy(mBuffer + mBufferedSize, bytes, copied);
+            mBufferedSize += copied;
+            bytes += copied;
+            size -= copied;
+        }
+        return !mError;
+    }
+
+    void flush() override {
+        const char* bytes = mBuffer;
+        while (mBufferedSize > 0 && !mError) {
+            ssize_t written = TEMP_FAILURE_RETRY(::write(mFd, bytes, mBufferedSize));
+            if (written <= 0) {
+                ALOGW("Failed to write encoded bitmap: %s", strerror(errno));
+                mError = true;
+                break;
+            }
+            mBytesWritten += written;
+            bytes += written;
+            mBufferedSize -= written;
+        }
+    }
+
+    size_t bytesWritten() const override { return mBytesWritten + mBufferedSize; }
+
+    bool hasError() const { return mError; }
+
+private:
+    static constexpr size_t kBufferSize = 64 * 1024;
+
+    const int mFd;
+    char mBuffer[kBufferSize];
+    size_t mBufferedSize = 0;
+    size_t mBytesWritten = 0;
+    bool mError = false;
+};
+
+static bool encodeToFd(const SkBitmap& skbitmap, SkEncodedImageFormat format, int quality,
+                       int fd) {
+    std::unique_ptr<FdWStream> stream = std::make_unique<FdWStream>(fd);
+    if (!SkEncodeImage(stream.get(), skbitmap, format, quality)) {
+        return false;
+    }
+    stream->flush();
+    return !stream->hasError();
+}
+
+static jboolean Bitmap_compress(JNIEnv* env, jobject clazz, jlong bitmapHandle,
+                                jint format, jint quality,
+                                jobject jstream, jbyteArray jstorage) {
+    SkEncodedImageFormat fm;
+    if (!toSkEncodedImageFormat(format, &fm)) {
         return JNI_FALSE;
     }
 
@@ -545,25 +645,117 @@ static jboolean Bitmap_compress(JNIEnv* env, jobject clazz, jlong bitmapHandle,
 
     SkBitmap skbitmap;
     bitmap->getSkBitmap(&skbitmap);
-    if (skbitmap.colorType() == kRGBA_F16_SkColorType) {
-        // Convert to P3 before encoding. This matches SkAndroidCodec::computeOutputColorSpace
-        // for wide gamuts.
-        auto cs = SkColorSpace::MakeRGB(SkNamedTransferFn::kSRGB, SkNamedGamut::kDCIP3);
-        auto info = skbitmap.info().makeColorType(kRGBA_8888_SkColorType)
-                                   .makeColorSpace(std::move(cs));
-        SkBitmap p3;
-        if (!p3.tryAllocPixels(info)) {
-            return JNI_FALSE;
-        }
+    if (!prepareForEncode(&skbitmap)) {
+        return JNI_FALSE;
+    }
+    return SkEncodeImage(strm.get(), skbitmap, fm, quality) ? JNI_TRUE : JNI_FALSE;
+}
 
-        SkPixmap pm;
-        SkAssertResult(p3.peekPixels(&pm));  // should always work if tryAllocPixels() did.
-        if (!skbitmap.readPixels(pm)) {
-            return JNI_FALSE;
+static jboolean Bitmap_compressToFd(JNIEnv* env, jobject clazz, jlong bitmapHandle,
+                                    jint format, jint quality, jobject fileDescriptor) {
+    NPE_CHECK_RETURN_ZERO(env, fileDescriptor);
+    SkEncodedImageFormat fm;
+    if (!toSkEncodedImageFormat(format, &fm)) {
+        return JNI_FALSE;
+    }
+
+    LocalScopedBitmap bitmap(bitmapHandle);
+    if (!bitmap.valid()) {
+        return JNI_FALSE;
+    }
+
+    int fd = jniGetFDFromFileDescriptor(env, fileDescriptor);
+    if (fd < 0) {
+        return JNI_FALSE;
+    }
+
+    SkBitmap skbitmap;
+    bitmap->getSkBitmap(&skbitmap);
+    if (!prepareForEncode(&skbitmap)) {
+        return JNI_FALSE;
+    }
+    return encodeToFd(skbitmap, fm, quality, fd) ? JNI_TRUE : JNI_FALSE;
+}
+
+// Upper bound of the threads encoding one batch.
+static const unsigned kMaxEncodeThreads = 4;
+
+// Encodes bitmapHandles[i] into fileDescriptors[i] for every i, spreading the bitmaps over a few
+// threads. Returns whether each one succeeded, or null if an exception was thrown.
+static jbooleanArray Bitmap_compressBatchToFds(JNIEnv* env, jobject clazz,
+                                               jlongArray bitmapHandles, jint format,
+                                               jint quality, jobjectArray fileDescriptors) {
+    NPE_CHECK_RETURN_ZERO(env, bitmapHandles);
+    NPE_CHECK_RETURN_ZERO(env, fileDescriptors);
+    const jsize count = env->GetArrayLength(bitmapHandles);
+    if (env->GetArrayLength(fileDescriptors) != count) {
+        doThrowIAE(env, "bitmaps and file descriptors must have the same length");
+        return nullptr;
+    }
+    jbooleanArray results = env->NewBooleanArray(count);
+    if (results == nullptr) {
+        return nullptr;
+    }
+    SkEncodedImageFormat fm;
+    if (count == 0 || !toSkEncodedImageFormat(format, &fm)) {
+        return results;
+    }
+
+    // Everything that needs JNI is collected up front. The SkBitmaps keep the pixels alive
+    // while the workers encode.
+    struct EncodeJob {
+        SkBitmap skbitmap;
+        int fd = -1;
+        bool prepared = false;
+        std::atomic<bool> succeeded{false};
+    };
+    std::unique_ptr<EncodeJob[]> jobs(new EncodeJob[count]);
+    {
+        std::vector<jlong> handles(count);
+        env->GetLongArrayRegion(bitmapHandles, 0, count, handles.data());
+        for (jsize i = 0; i < count; i++) {
+            LocalScopedBitmap bitmap(handles[i]);
+            jobject fileDescriptor = env->GetObjectArrayElement(fileDescriptors, i);
+            if (fileDescriptor != nullptr) {
+                jobs[i].fd = jniGetFDFromFileDescriptor(env, fileDescriptor);
+                env->DeleteLocalRef(fileDescriptor);
+            }
+            if (bitmap.valid() && jobs[i].fd >= 0) {
+                bitmap->getSkBitmap(&jobs[i].skbitmap);
+                jobs[i].prepared = true;
+            }
         }
-        skbitmap = p3;
     }
-    return SkEncodeImage(strm.get(), skbitmap, fm, quality) ? JNI_TRUE : JNI_FALSE;
+
+    std::atomic<jsize> nextJob{0};
+    auto encodeJobs = [&]() {
+        for (jsize i = nextJob++; i < count; i = nextJob++) {
+            EncodeJob& job = jobs[i];
+            job.succeeded = job.prepared && prepareForEncode(&job.skbitmap) &&
+                            encodeToFd(job.skbitmap, fm, quality, job.fd);
+            // Drop the pixels of the conversion as soon as possible.
+            job.skbitmap.reset();
+        }
+    };
+    const unsigned threadCount = std::min(
+            {static_cast<unsigned>(count), std::max(std::thread::hardware_concurrency(), 1u),
+             kMaxEncodeThreads});
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < threadCount; i++) {
+        workers.emplace_back(encodeJobs);
+    }
+    // The calling thread takes its share too.
+    encodeJobs();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    std::vector<jboolean> succeeded(count);
+    for (jsize i = 0; i < count; i++) {
+        succeeded[i] = jobs[i].succeeded ? JNI_TRUE : JNI_FALSE;
+    }
+    env->SetBooleanArrayRegion(results, 0, count, succeeded.data());
+    return results;
 }
 
 static inline void bitmapErase(SkBitmap bitmap, const SkColor4f& color,
@@ -1167,6 +1359,10 @@ static const JNINativeMethod gBitmapMethods[] = {
     {   "nativeReconfigure",        "(JIIIZ)V", (void*)Bitmap_reconfigure },
     {   "nativeCompress",           "(JIILjava/io/OutputStream;[B)Z",
         (void*)Bitmap_compress },
+    {   "nativeCompressToFd",       "(JIILjava/io/FileDescriptor;)Z",
+        (void*)Bitmap_compressToFd },
+    {   "nativeCompressBatchToFds", "([JII[Ljava/io/FileDescriptor;)[Z",
+        (void*)Bitmap_compressBatchToFds },
     {   "nativeErase",              "(JI)V", (void*)Bitmap_erase },
     {   "nativeErase",              "(JJJ)V", (void*)Bitmap_eraseLong },
     {   "nativeRowBytes",           "(J)I", (void*)Bitmap_rowBytes },
@@ -40,14 +40,102 @@
 #include <jni.h>
 #include <sys/stat.h>
 
+#include <utils/Timers.h>
+
+#include <algorithm>
+#include <atomic>
 #include <memory>
+#include <thread>
+#include <vector>
 
 using namespace android;
 
+/**
+ * The native object of a BitmapRegionDecoder. Forwards to the decoder of the encoded data, and
+ * keeps a duplicate of its stream so that nativeDecodeTiles() can decode with several decoders
+ * of the same data at once. Only used under the lock of the Java object.
+ */
+class TileRegionDecoder : public SkBitmapRegionDecoder {
+public:
+    static TileRegionDecoder* Create(std::unique_ptr<SkStreamRewindable> stream) {
+        // Without a duplicate, tiles are decoded one at a time.
+        std::unique_ptr<SkStreamRewindable> source(stream->duplicate());
+        std::unique_ptr<SkBitmapRegionDecoder> decoder(SkBitmapRegionDecoder::Create(
+                stream.release(), SkBitmapRegionDecoder::kAndroidCodec_Strategy));
+        if (!decoder) {
+            return nullptr;
+        }
+        return new TileRegionDecoder(std::move(decoder), std::move(source));
+    }
+
+    bool decodeRegion(SkBitmap* bitmap, SkBRDAllocator* allocator, const SkIRect& desiredSubset,
+                      int sampleSize, SkColorType colorType, bool requireUnpremul,
+                      sk_sp<SkColorSpace> prefColorSpace) override {
+        return mDecoder->decodeRegion(bitmap, allocator, desiredSubset, sampleSize, colorType,
+                                      requireUnpremul, std::move(prefColorSpace));
+    }
+
+    SkEncodedImageFormat getEncodedFormat() override { return mDecoder->getEncodedFormat(); }
+
+    SkColorType computeOutputColorType(SkColorType requestedColorType) override {
+        return mDecoder->computeOutputColorType(requestedColorType);
+    }
+
+    sk_sp<SkColorSpace> computeOutputColorSpace(SkColorType outputColorType,
+                                                sk_sp<SkColorSpace> prefColorSpace) override {
+        return mDecoder->computeOutputColorSpace(outputColorType, std::move(prefColorSpace));
+    }
+
+    // Whether acquireClone() may return decoders. Limited to the codecs known to decode
+    // independent regions without shared state.
+    bool canDecodeConcurrently() {
+        if (!mSource) {
+            return false;
+        }
+        switch (getEncodedFormat()) {
+            case SkEncodedImageFormat::kJPEG:
+            case SkEncodedImageFormat::kPNG:
+            case SkEncodedImageFormat::kWEBP:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // Returns a decoder of the same data, kept for reuse by releaseClone(). Null on failure.
+    std::unique_ptr<SkBitmapRegionDecoder> acquireClone() {
+        if (!mClones.empty()) {
+            std::unique_ptr<SkBitmapRegionDecoder> clone = std::move(mClones.back());
+            mClones.pop_back();
+            return clone;
+        }
+        std::unique_ptr<SkStreamRewindable> stream(mSource->duplicate());
+        if (!stream) {
+            return nullptr;
+        }
+        return std::unique_ptr<SkBitmapRegionDecoder>(SkBitmapRegionDecoder::Create(
+                stream.release(), SkBitmapRegionDecoder::kAndroidCodec_Strategy));
+    }
+
+    void releaseClone(std::unique_ptr<SkBitmapRegionDecoder> clone) {
+        mClones.push_back(std::move(clone));
+    }
+
+private:
+    TileRegionDecoder(std::unique_ptr<SkBitmapRegionDecoder> decoder,
+                      std::unique_ptr<SkStreamRewindable> source)
+            : SkBitmapRegionDecoder(decoder->width(), decoder->height())
+            , mDecoder(std::move(decoder))
+            , mSource(std::move(source)) {}
+
+    std::unique_ptr<SkBitmapRegionDecoder> mDecoder;
+    std::unique_ptr<SkStreamRewindable> mSource;
+    // Idle decoders of mSource.
+    std::vector<std::unique_ptr<SkBitmapRegionDecoder>> mClones;
+};
+
 static jobject createBitmapRegionDecoder(JNIEnv* env, std::unique_ptr<SkStreamRewindable> stream) {
-  std::unique_ptr<SkBitmapRegionDecoder> brd(
-            SkBitmapRegionDecoder::Create(stream.release(),
-                                          SkBitmapRegionDecoder::kAndroidCodec_Strategy));
+    std::unique_ptr<SkBitmapRegionDecoder> brd(TileRegionDecoder::Create(std::move(stream)));
     if (!brd) {
         doThrowIOE(env, "Image format not supported");
         return nullObjectReturn("CreateBitmapRegionDecoder returned null");
@@ -237,6 +325,127 @@ static jobject nativeDecodeRegion(JNIEnv* env, jobject, jlong brdHandle, jint in
     return android::bitmap::createBitmap(env, heapAlloc.getStorageObjAndReset(), bitmapCreateFlags);
 }
 
+// Upper bound of the decoders working on one nativeDecodeTiles() call.
+static const unsigned kMaxTileDecodeThreads = 4;
+
+/*
+ * Decodes the regions rects[4 * i, 4 * i + 4) (x, y, width, height) into the distinct tiles[i],
+ * reused like BitmapFactory.Options.inBitmap, which keep their color type, color space and alpha
+ * type. For JPEG, PNG and WebP, the tiles are decoded concurrently by clones of the decoder.
+ * decodeTimes[i] receives the time spent decoding tile i in nanoseconds. Returns whether each
+ * tile was decoded.
+ */
+static jbooleanArray nativeDecodeTiles(JNIEnv* env, jobject, jlong brdHandle, jintArray rects,
+        jint sampleSize, jobjectArray tiles, jlongArray decodeTimes) {
+    NPE_CHECK_RETURN_ZERO(env, rects);
+    NPE_CHECK_RETURN_ZERO(env, tiles);
+    const jsize count = env->GetArrayLength(tiles);
+    if (env->GetArrayLength(rects) != count * 4 ||
+            (decodeTimes != nullptr && env->GetArrayLength(decodeTimes) != count)) {
+        doThrowIAE(env, "rects, tiles and decodeTimes do not match");
+        return nullptr;
+    }
+    jbooleanArray results = env->NewBooleanArray(count);
+    if (results == nullptr || count == 0) {
+        return results;
+    }
+
+    struct TileJob {
+        SkIRect subset;
+        android::Bitmap* tile = nullptr;
+        bool requireUnpremul = false;
+        bool succeeded = false;
+        nsecs_t decodeTime = 0;
+    };
+    std::vector<TileJob> jobs(count);
+    {
+        std::vector<jint> coordinates(count * 4);
+        env->GetIntArrayRegion(rects, 0, count * 4, coordinates.data());
+        for (jsize i = 0; i < count; i++) {
+            const jint* rect = &coordinates[i * 4];
+            jobs[i].subset = SkIRect::MakeXYWH(rect[0], rect[1], rect[2], rect[3]);
+            jobject javaTile = env->GetObjectArrayElement(tiles, i);
+            if (javaTile != nullptr) {
+                android::Bitmap* tile = &bitmap::toBitmap(env, javaTile);
+                if (!tile->isHardware()) {
+                    jobs[i].tile = tile;
+                    jobs[i].requireUnpremul = tile->info().alphaType() == kUnpremul_SkAlphaType;
+                }
+                env->DeleteLocalRef(javaTile);
+            }
+        }
+    }
+
+    TileRegionDecoder* brd = reinterpret_cast<TileRegionDecoder*>(brdHandle);
+    auto decodeTile = [sampleSize](SkBitmapRegionDecoder* decoder, TileJob& job) {
+        if (job.tile == nullptr) {
+            return;
+        }
+        const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        RecyclingClippingPixelAllocator allocator(job.tile, job.tile->getAllocationByteCount());
+        SkColorType colorType = job.tile->info().colorType();
+        sk_sp<SkColorSpace> colorSpace =
+                decoder->computeOutputColorSpace(colorType, job.tile->info().refColorSpace());
+        SkBitmap bitmap;
+        job.succeeded = decoder->decodeRegion(&bitmap, &allocator, job.subset, sampleSize,
+                                              colorType, job.requireUnpremul,
+                                              std::move(colorSpace));
+        if (job.succeeded) {
+            allocator.copyIfNecessary();
+        }
+        job.decodeTime = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    };
+
+    std::vector<std::unique_ptr<SkBitmapRegionDecoder>> clones;
+    if (brd->canDecodeConcurrently()) {
+        const unsigned threadCount = std::min({static_cast<unsigned>(count),
+                std::max(std::thread::hardware_concurrency(), 1u), kMaxTileDecodeThreads});
+        while (clones.size() + 1 < threadCount) {
+            std::unique_ptr<SkBitmapRegionDecoder> clone = brd->acquireClone();
+            if (!clone) {
+                break;
+            }
+            clones.push_back(std::move(clone));
+        }
+    }
+    std::atomic<jsize> nextJob{0};
+    auto decodeJobs = [&](SkBitmapRegionDecoder* decoder) {
+        for (jsize i = nextJob++; i < count; i = nextJob++) {
+            decodeTile(decoder, jobs[i]);
+        }
+    };
+    std::vector<std::thread> workers;
+    for (auto& clone : clones) {
+        workers.emplace_back(decodeJobs, clone.get());
+    }
+    // The calling thread decodes with the decoder itself.
+    decodeJobs(brd);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    for (auto& clone : clones) {
+        brd->releaseClone(std::move(clone));
+    }
+
+    std::vector<jboolean> succeeded(count);
+    std::vector<jlong> times(count);
+    for (jsize i = 0; i < count; i++) {
+        succeeded[i] = jobs[i].succeeded ? JNI_TRUE : JNI_FALSE;
+        times[i] = jobs[i].decodeTime;
+        if (jobs[i].succeeded) {
+            // The pixels and possibly the dimensions of the tile changed.
+            jobject javaTile = env->GetObjectArrayElement(tiles, i);
+            bitmap::reinitBitmap(env, javaTile, jobs[i].tile->info(), !jobs[i].requireUnpremul);
+            env->DeleteLocalRef(javaTile);
+        }
+    }
+    env->SetBooleanArrayRegion(results, 0, count, succeeded.data());
+    if (decodeTimes != nullptr) {
+        env->SetLongArrayRegion(decodeTimes, 0, count, times.data());
+    }
+    return results;
+}
+
 static jint nativeGetHeight(JNIEnv* env, jobject, jlong brdHandle) {
     SkBitmapRegionDecoder* brd =
             reinterpret_cast<SkBitmapRegionDecoder*>(brdHandle);
@@ -262,6 +471,10 @@ static const JNINativeMethod gBitmapRegionDecoderMethods[] = {
         "(JIIIILandroid/graphics/BitmapFactory$Options;JJ)Landroid/graphics/Bitmap;",
         (void*)nativeDecodeRegion},
 
+    {   "nativeDecodeTiles",
+        "(J[II[Landroid/graphics/Bitmap;[J)[Z",
+        (void*)nativeDecodeTiles},
+
     {   "nativeGetHeight", "(J)I", (void*)nativeGetHeight},
 
     {   "nativeGetWidth", "(J)I", (void*)nativeGetWidth},
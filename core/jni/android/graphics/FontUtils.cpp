@@ -19,9 +19,84 @@
 #include <nativehelper/JNIHelp.h>
 #include <core_jni_helpers.h>
 
+#include <minikin/FontFamily.h>
+
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
 namespace android {
 namespace {
 
+// Fonts under these directories cannot change while the device is running.
+static const char* const kSystemFontDirs[] = {
+    "/system/fonts/",
+    "/product/fonts/",
+};
+
+// Bounds the memory the cache keeps alive if something keeps building new variations.
+static const size_t kMaxCachedFonts = 1024;
+static const size_t kMaxCachedFamilies = 512;
+
+struct SystemFontCacheData {
+    std::mutex lock;
+    std::unordered_map<std::string, std::shared_ptr<minikin::MinikinFont>> fonts;
+    std::unordered_set<const minikin::MinikinFont*> cachedFonts;
+    std::unordered_map<std::string, std::shared_ptr<minikin::FontFamily>> families;
+};
+
+// Never destroyed, the cached objects live as long as the process.
+static SystemFontCacheData& getCacheData() {
+    static SystemFontCacheData* data = new SystemFontCacheData();
+    return *data;
+}
+
+static bool isSystemFontPath(std::string_view path) {
+    for (const char* dir : kSystemFontDirs) {
+        if (path.compare(0, strlen(dir), dir) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename T>
+static void appendBytes(std::string* key, const T& value) {
+    key->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static std::string fontKey(std::string_view path, int ttcIndex,
+                           const std::vector<minikin::FontVariation>& axes) {
+    std::string key(path);
+    key.push_back('\0');
+    appendBytes(&key, ttcIndex);
+    for (const auto& axis : axes) {
+        appendBytes(&key, axis.axisTag);
+        appendBytes(&key, axis.value);
+    }
+    return key;
+}
+
+// Returns false if one of the fonts does not come from the cache.
+static bool familyKey(const SystemFontCacheData& data, const std::vector<minikin::Font>& fonts,
+                      uint32_t localeId, int variant, bool isCustomFallback, std::string* key) {
+    appendBytes(key, localeId);
+    appendBytes(key, variant);
+    appendBytes(key, isCustomFallback);
+    for (const auto& font : fonts) {
+        const minikin::MinikinFont* typeface = font.typeface().get();
+        if (data.cachedFonts.count(typeface) == 0) {
+            return false;
+        }
+        appendBytes(key, typeface);
+        appendBytes(key, font.style().weight());
+        appendBytes(key, font.style().slant());
+    }
+    return true;
+}
+
 static struct {
     jmethodID mGet;
     jmethodID mSize;
@@ -50,6 +125,59 @@ jfloat AxisHelper::getStyleValue() const {
     return mEnv->GetFloatField(mAxis, gAxisClassInfo.mStyleValue);
 }
 
+std::shared_ptr<minikin::MinikinFont> SystemFontCache::findFont(
+        std::string_view path, int ttcIndex, const std::vector<minikin::FontVariation>& axes) {
+    if (!isSystemFontPath(path)) {
+        return nullptr;
+    }
+    SystemFontCacheData& data = getCacheData();
+    std::lock_guard<std::mutex> lock(data.lock);
+    auto it = data.fonts.find(fontKey(path, ttcIndex, axes));
+    return it == data.fonts.end() ? nullptr : it->second;
+}
+
+void SystemFontCache::addFont(std::string_view path, int ttcIndex,
+                              const std::vector<minikin::FontVariation>& axes,
+                              const std::shared_ptr<minikin::MinikinFont>& font) {
+    if (!isSystemFontPath(path)) {
+        return;
+    }
+    SystemFontCacheData& data = getCacheData();
+    std::lock_guard<std::mutex> lock(data.lock);
+    if (data.fonts.size() >= kMaxCachedFonts) {
+        return;
+    }
+    if (data.fonts.emplace(fontKey(path, ttcIndex, axes), font).second) {
+        data.cachedFonts.insert(font.get());
+    }
+}
+
+std::shared_ptr<minikin::FontFamily> SystemFontCache::findFamily(
+        const std::vector<minikin::Font>& fonts, uint32_t localeId, int variant,
+        bool isCustomFallback) {
+    SystemFontCacheData& data = getCacheData();
+    std::lock_guard<std::mutex> lock(data.lock);
+    std::string key;
+    if (!familyKey(data, fonts, localeId, variant, isCustomFallback, &key)) {
+        return nullptr;
+    }
+    auto it = data.families.find(key);
+    return it == data.families.end() ? nullptr : it->second;
+}
+
+void SystemFontCache::addFamily(const std::vector<minikin::Font>& fonts, uint32_t localeId,
+                                int variant, bool isCustomFallback,
+                                const std::shared_ptr<minikin::FontFamily>& family) {
+    SystemFontCacheData& data = getCacheData();
+    std::lock_guard<std::mutex> lock(data.lock);
+    std::string key;
+    if (data.families.size() >= kMaxCachedFamilies ||
+            !familyKey(data, fonts, localeId, variant, isCustomFallback, &key)) {
+        return;
+    }
+    data.families.emplace(std::move(key), family);
+}
+
 void init_FontUtils(JNIEnv* env) {
     jclass listClass = FindClassOrDie(env, "java/util/List");
     gListClassInfo.mGet = GetMethodIDOrDie(env, listClass, "get", "(I)Ljava/lang/Object;");
@@ -19,8 +19,11 @@
 
 #include <jni.h>
 #include <memory>
+#include <string_view>
+#include <vector>
 
 #include <minikin/Font.h>
+#include <minikin/FontVariation.h>
 
 namespace minikin {
 class FontFamily;
@@ -64,6 +67,31 @@ private:
   jobject mAxis;
 };
 
+// Process wide cache of the fonts and families built from the read-only system font
+// directories. The zygote fills it while preloading the system fonts, so forked processes inherit
+// the parsed typefaces and family coverage, and the mappings of the font files, copy-on-write.
+// Building the same system font or family again returns the shared object instead of parsing the
+// font tables once more.
+class SystemFontCache {
+public:
+  // Returns null if the font is not in the cache.
+  static std::shared_ptr<minikin::MinikinFont> findFont(
+          std::string_view path, int ttcIndex, const std::vector<minikin::FontVariation>& axes);
+
+  // Does nothing if path is not in a system font directory.
+  static void addFont(std::string_view path, int ttcIndex,
+                      const std::vector<minikin::FontVariation>& axes,
+                      const std::shared_ptr<minikin::MinikinFont>& font);
+
+  // Returns null if the family is not in the cache. Only families made of cached fonts are kept.
+  static std::shared_ptr<minikin::FontFamily> findFamily(const std::vector<minikin::Font>& fonts,
+                                                         uint32_t localeId, int variant,
+                                                         bool isCustomFallback);
+
+  static void addFamily(const std::vector<minikin::Font>& fonts, uint32_t localeId, int variant,
+                        bool isCustomFallback, const std::shared_ptr<minikin::FontFamily>& family);
+};
+
 void init_FontUtils(JNIEnv* env);
 
 }; // namespace android
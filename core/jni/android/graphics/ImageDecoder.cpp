@@ -37,6 +37,8 @@
 #include <androidfw/Asset.h>
 #include <jni.h>
 
+#include <algorithm>
+
 using namespace android;
 
 static jclass    gImageDecoder_class;
@@ -48,6 +50,7 @@ static jmethodID gImageDecoder_postProcessMethodID;
 static jmethodID gSize_constructorMethodID;
 static jmethodID gDecodeException_constructorMethodID;
 static jmethodID gCallback_onPartialImageMethodID;
+static jmethodID gCallback_onProgressiveUpdateMethodID;
 static jmethodID gCanvas_constructorMethodID;
 static jmethodID gCanvas_releaseMethodID;
 
@@ -80,12 +83,51 @@ static jobject throw_exception(JNIEnv* env, ImageDecoder::Error error, const cha
     return nullptr;
 }
 
+// Forwards to the source stream, but can be limited to a number of bytes read before it reports
+// the end of the data. A progressive decode uses that to have SkCodec::incrementalDecode() return
+// with the rows decoded so far, and then lifts the limit to continue from where it stopped.
+class ThrottledStream : public SkStream {
+public:
+    explicit ThrottledStream(std::unique_ptr<SkStream> stream) : mStream(std::move(stream)) {}
+
+    void setReadLimit(size_t limit) { mRemaining = limit; }
+    void clearReadLimit() { mRemaining = SIZE_MAX; }
+
+    // Whether the last read stopped at the limit rather than at the end of the source.
+    bool stoppedAtLimit() const { return mRemaining == 0 && !mStream->isAtEnd(); }
+
+    size_t read(void* buffer, size_t size) override {
+        size_t bytesRead = mStream->read(buffer, std::min(size, mRemaining));
+        if (mRemaining != SIZE_MAX) {
+            mRemaining -= bytesRead;
+        }
+        return bytesRead;
+    }
+
+    bool isAtEnd() const override { return mRemaining != 0 && mStream->isAtEnd(); }
+    size_t peek(void* buffer, size_t size) const override { return mStream->peek(buffer, size); }
+    bool rewind() override { return mStream->rewind(); }
+    bool hasPosition() const override { return mStream->hasPosition(); }
+    size_t getPosition() const override { return mStream->getPosition(); }
+    bool seek(size_t position) override { return mStream->seek(position); }
+    bool move(long offset) override { return mStream->move(offset); }
+    bool hasLength() const override { return mStream->hasLength(); }
+    size_t getLength() const override { return mStream->getLength(); }
+    const void* getMemoryBase() override { return mStream->getMemoryBase(); }
+
+private:
+    std::unique_ptr<SkStream> mStream;
+    size_t mRemaining = SIZE_MAX;
+};
+
 static jobject native_create(JNIEnv* env, std::unique_ptr<SkStream> stream, jobject source) {
     if (!stream.get()) {
         return throw_exception(env, ImageDecoder::kSourceMalformedData, "Failed to create a stream",
                                nullptr, source);
     }
     std::unique_ptr<ImageDecoder> decoder(new ImageDecoder);
+    decoder->mStream = new ThrottledStream(std::move(stream));
+    stream.reset(decoder->mStream);
     SkCodec::Result result;
     auto codec = SkCodec::MakeFromStream(std::move(stream), &result, decoder->mPeeker.get());
     if (jthrowable jexception = get_and_clear_exception(env)) {
@@ -200,6 +242,45 @@ jint postProcessAndRelease(JNIEnv* env, jobject jimageDecoder, std::unique_ptr<C
     return env->CallIntMethod(jimageDecoder, gImageDecoder_postProcessMethodID, jcanvas);
 }
 
+// Reports an incomplete or malformed image to jdecoder's onPartialImage. Returns false if the
+// decode failed or an exception is pending.
+static bool handle_decode_result(JNIEnv* env, jobject jdecoder, SkCodec::Result result) {
+    jthrowable jexception = get_and_clear_exception(env);
+    int onPartialImageError = jexception ? ImageDecoder::kSourceException
+                                         : 0; // No error.
+    switch (result) {
+        case SkCodec::kSuccess:
+            // Ignore the exception, since the decode was successful anyway.
+            jexception = nullptr;
+            onPartialImageError = 0;
+            break;
+        case SkCodec::kIncompleteInput:
+            if (!jexception) {
+                onPartialImageError = ImageDecoder::kSourceIncomplete;
+            }
+            break;
+        case SkCodec::kErrorInInput:
+            if (!jexception) {
+                onPartialImageError = ImageDecoder::kSourceMalformedData;
+            }
+            break;
+        default:
+            SkString msg;
+            msg.printf("getPixels failed with error %s", SkCodec::ResultToString(result));
+            doThrowIOE(env, msg.c_str());
+            return false;
+    }
+
+    if (onPartialImageError) {
+        env->CallVoidMethod(jdecoder, gCallback_onPartialImageMethodID, onPartialImageError,
+                jexception);
+        if (env->ExceptionCheck()) {
+            return false;
+        }
+    }
+    return true;
+}
+
 static jobject ImageDecoder_nDecodeBitmap(JNIEnv* env, jobject /*clazz*/, jlong nativePtr,
                                           jobject jdecoder, jboolean jpostProcess,
                                           jint desiredWidth, jint desiredHeight, jobject jsubset,
@@ -306,38 +387,8 @@ static jobject ImageDecoder_nDecodeBitmap(JNIEnv* env, jobject /*clazz*/, jlong
     SkAndroidCodec::AndroidOptions options;
     options.fSampleSize = sampleSize;
     auto result = codec->getAndroidPixels(decodeInfo, bm.getPixels(), bm.rowBytes(), &options);
-    jthrowable jexception = get_and_clear_exception(env);
-    int onPartialImageError = jexception ? ImageDecoder::kSourceException
-                                         : 0; // No error.
-    switch (result) {
-        case SkCodec::kSuccess:
-            // Ignore the exception, since the decode was successful anyway.
-            jexception = nullptr;
-            onPartialImageError = 0;
-            break;
-        case SkCodec::kIncompleteInput:
-            if (!jexception) {
-                onPartialImageError = ImageDecoder::kSourceIncomplete;
-            }
-            break;
-        case SkCodec::kErrorInInput:
-            if (!jexception) {
-                onPartialImageError = ImageDecoder::kSourceMalformedData;
-            }
-            break;
-        default:
-            SkString msg;
-            msg.printf("getPixels failed with error %s", SkCodec::ResultToString(result));
-            doThrowIOE(env, msg.c_str());
-            return nullptr;
-    }
-
-    if (onPartialImageError) {
-        env->CallVoidMethod(jdecoder, gCallback_onPartialImageMethodID, onPartialImageError,
-                jexception);
-        if (env->ExceptionCheck()) {
-            return nullptr;
-        }
+    if (!handle_decode_result(env, jdecoder, result)) {
+        return nullptr;
     }
 
     jbyteArray ninePatchChunk = nullptr;
@@ -486,6 +537,117 @@ static jobject ImageDecoder_nDecodeBitmap(JNIEnv* env, jobject /*clazz*/, jlong
                                 ninePatchInsets);
 }
 
+// Bytes of the source handed to the codec between two progressive updates.
+static constexpr size_t kProgressiveReadBytes = 64 * 1024;
+
+// Decodes at full size into a mutable heap Bitmap, calling jdecoder's onProgressiveUpdate with the
+// Bitmap and the number of rows decoded each time another part of the source has been decoded, so
+// that the partial image can be drawn (and re-uploaded by hwui) while the rest is still loading.
+// onProgressiveUpdate returns false to stop; the Bitmap is then returned as decoded so far.
+//
+// This relies on SkCodec's incremental decode, which Skia implements for PNG (including the passes
+// of interlaced PNG) and GIF. Other formats, and images that need an EXIF rotation, are decoded in
+// one go and reported once.
+static jobject ImageDecoder_nDecodeProgressive(JNIEnv* env, jobject /*clazz*/, jlong nativePtr,
+                                               jobject jdecoder, jboolean requireUnpremul,
+                                               jlong colorSpaceHandle) {
+    auto* decoder = reinterpret_cast<ImageDecoder*>(nativePtr);
+    SkAndroidCodec* codec = decoder->mCodec.get();
+    SkImageInfo decodeInfo = codec->getInfo();
+    switch (decodeInfo.alphaType()) {
+        case kUnpremul_SkAlphaType:
+            if (!requireUnpremul) {
+                decodeInfo = decodeInfo.makeAlphaType(kPremul_SkAlphaType);
+            }
+            break;
+        case kPremul_SkAlphaType:
+            if (requireUnpremul) {
+                decodeInfo = decodeInfo.makeAlphaType(kUnpremul_SkAlphaType);
+            }
+            break;
+        case kOpaque_SkAlphaType:
+            break;
+        case kUnknown_SkAlphaType:
+            doThrowIOE(env, "Unknown alpha type");
+            return nullptr;
+    }
+
+    SkColorType colorType = codec->computeOutputColorType(kN32_SkColorType);
+    sk_sp<SkColorSpace> colorSpace = GraphicsJNI::getNativeColorSpace(colorSpaceHandle);
+    colorSpace = codec->computeOutputColorSpace(colorType, colorSpace);
+    decodeInfo = decodeInfo.makeColorType(colorType).makeColorSpace(colorSpace);
+
+    SkBitmap bm;
+    if (!bm.setInfo(decodeInfo)) {
+        doThrowIOE(env, "Failed to setInfo properly");
+        return nullptr;
+    }
+    // Heap bitmaps are zero initialized, so rows not decoded yet draw as transparent.
+    sk_sp<Bitmap> nativeBitmap = Bitmap::allocateHeapBitmap(&bm);
+    if (!nativeBitmap) {
+        SkString msg;
+        msg.printf("OOM allocating Bitmap with dimensions %i x %i",
+                decodeInfo.width(), decodeInfo.height());
+        doThrowOOME(env, msg.c_str());
+        return nullptr;
+    }
+    Bitmap* pixels = nativeBitmap.get();
+
+    int bitmapCreateFlags = bitmap::kBitmapCreateFlag_Mutable;
+    if (!requireUnpremul) {
+        bitmapCreateFlags |= bitmap::kBitmapCreateFlag_Premultiplied;
+    }
+    jobject jbitmap = bitmap::createBitmap(env, nativeBitmap.release(), bitmapCreateFlags);
+    if (!jbitmap) {
+        return nullptr;
+    }
+
+    SkCodec* rawCodec = codec->codec();
+    SkCodec::Result result = SkCodec::kUnimplemented;
+    if (rawCodec->getOrigin() == kTopLeft_SkEncodedOrigin) {
+        decoder->mStream->setReadLimit(kProgressiveReadBytes);
+        result = rawCodec->startIncrementalDecode(decodeInfo, bm.getPixels(), bm.rowBytes());
+    }
+
+    if (result == SkCodec::kSuccess) {
+        while (true) {
+            decoder->mStream->setReadLimit(kProgressiveReadBytes);
+            int rowsDecoded = 0;
+            result = rawCodec->incrementalDecode(&rowsDecoded);
+            if (result != SkCodec::kIncompleteInput || !decoder->mStream->stoppedAtLimit()
+                    || env->ExceptionCheck()) {
+                break;
+            }
+            pixels->notifyPixelsChanged();
+            jboolean keepGoing = env->CallBooleanMethod(jdecoder,
+                    gCallback_onProgressiveUpdateMethodID, jbitmap, rowsDecoded);
+            if (env->ExceptionCheck()) {
+                decoder->mStream->clearReadLimit();
+                return nullptr;
+            }
+            if (!keepGoing) {
+                decoder->mStream->clearReadLimit();
+                return jbitmap;
+            }
+        }
+        decoder->mStream->clearReadLimit();
+    } else {
+        decoder->mStream->clearReadLimit();
+        result = codec->getAndroidPixels(decodeInfo, bm.getPixels(), bm.rowBytes());
+    }
+
+    if (!handle_decode_result(env, jdecoder, result)) {
+        return nullptr;
+    }
+    pixels->notifyPixelsChanged();
+    env->CallBooleanMethod(jdecoder, gCallback_onProgressiveUpdateMethodID, jbitmap,
+                           decodeInfo.height());
+    if (env->ExceptionCheck()) {
+        return nullptr;
+    }
+    return jbitmap;
+}
+
 static jobject ImageDecoder_nGetSampledSize(JNIEnv* env, jobject /*clazz*/, jlong nativePtr,
                                             jint sampleSize) {
     auto* decoder = reinterpret_cast<ImageDecoder*>(nativePtr);
@@ -523,6 +685,8 @@ static const JNINativeMethod gImageDecoderMethods[] = {
     { "nCreate",        "(Ljava/io/FileDescriptor;Landroid/graphics/ImageDecoder$Source;)Landroid/graphics/ImageDecoder;", (void*) ImageDecoder_nCreateFd },
     { "nDecodeBitmap",  "(JLandroid/graphics/ImageDecoder;ZIILandroid/graphics/Rect;ZIZZZJZ)Landroid/graphics/Bitmap;",
                                                                  (void*) ImageDecoder_nDecodeBitmap },
+    { "nDecodeProgressive", "(JLandroid/graphics/ImageDecoder;ZJ)Landroid/graphics/Bitmap;",
+                                                                 (void*) ImageDecoder_nDecodeProgressive },
     { "nGetSampledSize","(JI)Landroid/util/Size;",               (void*) ImageDecoder_nGetSampledSize },
     { "nGetPadding",    "(JLandroid/graphics/Rect;)V",           (void*) ImageDecoder_nGetPadding },
     { "nClose",         "(J)V",                                  (void*) ImageDecoder_nClose},
@@ -542,6 +706,7 @@ int register_android_graphics_ImageDecoder(JNIEnv* env) {
     gDecodeException_constructorMethodID = GetMethodIDOrDie(env, gDecodeException_class, "<init>", "(ILjava/lang/String;Ljava/lang/Throwable;Landroid/graphics/ImageDecoder$Source;)V");
 
     gCallback_onPartialImageMethodID = GetMethodIDOrDie(env, gImageDecoder_class, "onPartialImage", "(ILjava/lang/Throwable;)V");
+    gCallback_onProgressiveUpdateMethodID = GetMethodIDOrDie(env, gImageDecoder_class, "onProgressiveUpdate", "(Landroid/graphics/Bitmap;I)Z");
 
     gCanvas_class = MakeGlobalRefOrDie(env, FindClassOrDie(env, "android/graphics/Canvas"));
     gCanvas_constructorMethodID = GetMethodIDOrDie(env, gCanvas_class, "<init>", "(J)V");
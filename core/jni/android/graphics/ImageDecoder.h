@@ -21,6 +21,7 @@
 #include <jni.h>
 
 class SkAndroidCodec;
+class ThrottledStream;
 
 using namespace android;
 
@@ -49,6 +50,8 @@ struct ImageDecoder {
 
     std::unique_ptr<SkAndroidCodec> mCodec;
     sk_sp<NinePatchPeeker> mPeeker;
+    // The source stream, owned by mCodec.
+    ThrottledStream* mStream = nullptr;
 
     ImageDecoder()
         :mPeeker(new NinePatchPeeker)
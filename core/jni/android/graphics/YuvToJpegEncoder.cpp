@@ -8,6 +8,20 @@
 
 #include <jni.h>
 
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Images with at least this many pixels are encoded in strips on several threads.
+static const int kParallelPixelCount = 2 * 1024 * 1024;
+static const int kMaxEncodeStrips = 4;
+// The height of an MCU row for both of the supported samplings.
+static const int kMcuHeight = 16;
+
 YuvToJpegEncoder* YuvToJpegEncoder::create(int format, int* strides) {
     // Only ImageFormat.NV21 and ImageFormat.YUY2 are supported
     // for now.
@@ -36,6 +50,21 @@ void error_exit(j_common_ptr cinfo) {
 
 bool YuvToJpegEncoder::encode(SkWStream* stream, void* inYuv, int width,
         int height, int* offsets, int jpegQuality) {
+    const int mcuRows = (height + kMcuHeight - 1) / kMcuHeight;
+    int stripCount = 1;
+    if (width * height >= kParallelPixelCount) {
+        stripCount = std::min({kMaxEncodeStrips, mcuRows / 2,
+                (int) std::thread::hardware_concurrency()});
+    }
+    if (stripCount > 1) {
+        return encodeStrips(stream, (uint8_t*) inYuv, width, height, offsets, jpegQuality,
+                stripCount);
+    }
+    return encodeImage(stream, (uint8_t*) inYuv, width, height, offsets, jpegQuality, 0);
+}
+
+bool YuvToJpegEncoder::encodeImage(SkWStream* stream, uint8_t* yuv, int width,
+        int height, int* offsets, int jpegQuality, int restartRows) {
     jpeg_compress_struct    cinfo;
     ErrorMgr                err;
     skjpeg_destination_mgr  sk_wstream(stream);
@@ -52,10 +81,11 @@ bool YuvToJpegEncoder::encode(SkWStream* stream, void* inYuv, int width,
     cinfo.dest = &sk_wstream;
 
     setJpegCompressStruct(&cinfo, width, height, jpegQuality);
+    cinfo.restart_in_rows = restartRows;
 
     jpeg_start_compress(&cinfo, TRUE);
 
-    compress(&cinfo, (uint8_t*) inYuv, offsets);
+    compress(&cinfo, yuv, offsets);
 
     jpeg_finish_compress(&cinfo);
 
@@ -64,6 +94,113 @@ bool YuvToJpegEncoder::encode(SkWStream* stream, void* inYuv, int width,
     return true;
 }
 
+static uint16_t readBigEndian16(const uint8_t* p) {
+    return (p[0] << 8) | p[1];
+}
+
+/*
+ * Finds the entropy coded data of a JPEG written by encodeImage(), which runs from the end of the
+ * SOS segment to the EOI marker, and the offset of the SOF segment.
+ */
+static bool findScan(const uint8_t* jpeg, size_t size, size_t* outSofOffset,
+        size_t* outScanStart, size_t* outScanEnd) {
+    if (size < 4 || jpeg[size - 2] != 0xFF || jpeg[size - 1] != JPEG_EOI) {
+        return false;
+    }
+    size_t sofOffset = 0;
+    size_t pos = 2;  // after SOI
+    while (pos + 4 <= size && jpeg[pos] == 0xFF) {
+        const uint8_t marker = jpeg[pos + 1];
+        const size_t length = readBigEndian16(jpeg + pos + 2);
+        if (marker == 0xC0 || marker == 0xC1) {
+            sofOffset = pos;
+        } else if (marker == 0xDA) {
+            if (sofOffset == 0 || pos + 2 + length > size - 2) {
+                return false;
+            }
+            *outSofOffset = sofOffset;
+            *outScanStart = pos + 2 + length;
+            *outScanEnd = size - 2;
+            return true;
+        }
+        pos += 2 + length;
+    }
+    return false;
+}
+
+/*
+ * Encodes horizontal strips of the image on separate threads, each with a restart marker after
+ * every MCU row, and stitches them into one JPEG. Restart markers reset the DC predictions, so the
+ * entropy coded data of each strip can follow on from the one above it, as long as the markers
+ * are renumbered to count the MCU rows of the whole image.
+ */
+bool YuvToJpegEncoder::encodeStrips(SkWStream* stream, uint8_t* yuv, int width,
+        int height, int* offsets, int jpegQuality, int stripCount) {
+    const int mcuRows = (height + kMcuHeight - 1) / kMcuHeight;
+    std::vector<int> firstMcuRows(stripCount + 1);
+    for (int i = 0; i <= stripCount; i++) {
+        firstMcuRows[i] = mcuRows * i / stripCount;
+    }
+
+    std::vector<SkDynamicMemoryWStream> strips(stripCount);
+    std::vector<char> encoded(stripCount, false);
+    auto encodeStrip = [&](int i) {
+        const int startRow = firstMcuRows[i] * kMcuHeight;
+        const int endRow = std::min(firstMcuRows[i + 1] * kMcuHeight, height);
+        int stripOffsets[2] = { offsets[0], fNumPlanes > 1 ? offsets[1] : 0 };
+        offsetRows(stripOffsets, startRow);
+        encoded[i] = encodeImage(&strips[i], yuv, width, endRow - startRow, stripOffsets,
+                jpegQuality, 1);
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < stripCount; i++) {
+        threads.emplace_back(encodeStrip, i);
+    }
+    encodeStrip(0);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    if (std::find(encoded.begin(), encoded.end(), false) != encoded.end()) {
+        return false;
+    }
+
+    std::vector<uint8_t> out;
+    for (int i = 0; i < stripCount; i++) {
+        std::vector<uint8_t> jpeg(strips[i].bytesWritten());
+        strips[i].copyTo(jpeg.data());
+        size_t sofOffset, scanStart, scanEnd;
+        if (!findScan(jpeg.data(), jpeg.size(), &sofOffset, &scanStart, &scanEnd)) {
+            return false;
+        }
+
+        if (i == 0) {
+            // The headers of the strips only differ in the image height.
+            out.assign(jpeg.begin(), jpeg.begin() + scanStart);
+            out[sofOffset + 5] = height >> 8;
+            out[sofOffset + 6] = height & 0xFF;
+        }
+
+        // The strip's own markers count its MCU rows from 0.
+        int mcuRow = firstMcuRows[i];
+        for (size_t pos = scanStart; pos < scanEnd; pos++) {
+            out.push_back(jpeg[pos]);
+            if (jpeg[pos] == 0xFF && pos + 1 < scanEnd && jpeg[pos + 1] >= JPEG_RST0
+                    && jpeg[pos + 1] <= JPEG_RST0 + 7) {
+                out.push_back(JPEG_RST0 + (mcuRow++ & 7));
+                pos++;
+            }
+        }
+        if (i + 1 < stripCount) {
+            out.push_back(0xFF);
+            out.push_back(JPEG_RST0 + (mcuRow & 7));
+        }
+    }
+    out.push_back(0xFF);
+    out.push_back(JPEG_EOI);
+    return stream->write(out.data(), out.size());
+}
+
 void YuvToJpegEncoder::setJpegCompressStruct(jpeg_compress_struct* cinfo,
         int width, int height, int quality) {
     cinfo->image_width = width;
@@ -136,7 +273,17 @@ void Yuv420SpToJpegEncoder::deinterleave(uint8_t* vuPlanar, uint8_t* uRows,
     for (int row = 0; row < numRows; ++row) {
         int offset = ((rowIndex >> 1) + row) * fStrides[1];
         uint8_t* vu = vuPlanar + offset;
-        for (int i = 0; i < (width >> 1); ++i) {
+        int i = 0;
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+        for (; i + 16 <= (width >> 1); i += 16) {
+            int index = row * (width >> 1) + i;
+            uint8x16x2_t vuPairs = vld2q_u8(vu);
+            vst1q_u8(vRows + index, vuPairs.val[0]);
+            vst1q_u8(uRows + index, vuPairs.val[1]);
+            vu += 32;
+        }
+#endif
+        for (; i < (width >> 1); ++i) {
             int index = row * (width >> 1) + i;
             uRows[index] = vu[1];
             vRows[index] = vu[0];
@@ -145,6 +292,11 @@ void Yuv420SpToJpegEncoder::deinterleave(uint8_t* vuPlanar, uint8_t* uRows,
     }
 }
 
+void Yuv420SpToJpegEncoder::offsetRows(int* offsets, int rows) {
+    offsets[0] += rows * fStrides[0];
+    offsets[1] += (rows >> 1) * fStrides[1];
+}
+
 void Yuv420SpToJpegEncoder::configSamplingFactors(jpeg_compress_struct* cinfo) {
     // cb and cr are horizontally downsampled and vertically downsampled as well.
     cinfo->comp_info[0].h_samp_factor = 2;
@@ -210,7 +362,18 @@ void Yuv422IToJpegEncoder::deinterleave(uint8_t* yuv, uint8_t* yRows, uint8_t* u
     if (numRows > 16) numRows = 16;
     for (int row = 0; row < numRows; ++row) {
         uint8_t* yuvSeg = yuv + (rowIndex + row) * fStrides[0];
-        for (int i = 0; i < (width >> 1); ++i) {
+        int i = 0;
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+        for (; i + 16 <= (width >> 1); i += 16) {
+            uint8x16x4_t yuyv = vld4q_u8(yuvSeg);
+            uint8x16x2_t yPairs = {{ yuyv.val[0], yuyv.val[2] }};
+            vst2q_u8(yRows + row * width + (i << 1), yPairs);
+            vst1q_u8(uRows + row * (width >> 1) + i, yuyv.val[1]);
+            vst1q_u8(vRows + row * (width >> 1) + i, yuyv.val[3]);
+            yuvSeg += 64;
+        }
+#endif
+        for (; i < (width >> 1); ++i) {
             int indexY = row * width + (i << 1);
             int indexU = row * (width >> 1) + i;
             yRows[indexY] = yuvSeg[0];
@@ -222,6 +385,10 @@ void Yuv422IToJpegEncoder::deinterleave(uint8_t* yuv, uint8_t* yRows, uint8_t* u
     }
 }
 
+void Yuv422IToJpegEncoder::offsetRows(int* offsets, int rows) {
+    offsets[0] += rows * fStrides[0];
+}
+
 void Yuv422IToJpegEncoder::configSamplingFactors(jpeg_compress_struct* cinfo) {
     // cb and cr are horizontally downsampled and vertically downsampled as well.
     cinfo->comp_info[0].h_samp_factor = 2;
@@ -43,6 +43,14 @@ protected:
     virtual void configSamplingFactors(jpeg_compress_struct* cinfo) = 0;
     virtual void compress(jpeg_compress_struct* cinfo,
             uint8_t* yuv, int* offsets) = 0;
+    // Moves the plane offsets down by the given number of rows of the image.
+    virtual void offsetRows(int* offsets, int rows) = 0;
+
+private:
+    bool encodeImage(SkWStream* stream, uint8_t* yuv, int width, int height,
+            int* offsets, int jpegQuality, int restartRows);
+    bool encodeStrips(SkWStream* stream, uint8_t* yuv, int width, int height,
+            int* offsets, int jpegQuality, int stripCount);
 };
 
 class Yuv420SpToJpegEncoder : public YuvToJpegEncoder {
@@ -57,6 +65,7 @@ private:
     void deinterleave(uint8_t* vuPlanar, uint8_t* uRows, uint8_t* vRows,
             int rowIndex, int width, int height);
     void compress(jpeg_compress_struct* cinfo, uint8_t* yuv, int* offsets);
+    void offsetRows(int* offsets, int rows);
 };
 
 class Yuv422IToJpegEncoder : public YuvToJpegEncoder {
@@ -69,6 +78,7 @@ private:
     void compress(jpeg_compress_struct* cinfo, uint8_t* yuv, int* offsets);
     void deinterleave(uint8_t* yuv, uint8_t* yRows, uint8_t* uRows,
             uint8_t* vRows, int rowIndex, int width, int height);
+    void offsetRows(int* offsets, int rows);
 };
 
 #endif  // _ANDROID_GRAPHICS_YUV_TO_JPEG_ENCODER_H_
@@ -149,6 +149,14 @@ static jlong Font_Builder_build(JNIEnv* env, jobject clazz, jlong builderPtr, jo
         return 0;
     }
     ScopedUtfChars fontPath(env, filePath);
+    std::string_view path(fontPath.c_str(), fontPath.size());
+    std::shared_ptr<minikin::MinikinFont> minikinFont =
+            SystemFontCache::findFont(path, ttcIndex, builder->axes);
+    if (minikinFont != nullptr) {
+        minikin::Font font = minikin::Font::Builder(minikinFont).setWeight(weight)
+                        .setSlant(static_cast<minikin::FontStyle::Slant>(italic)).build();
+        return reinterpret_cast<jlong>(new FontWrapper(std::move(font)));
+    }
     jobject fontRef = MakeGlobalRefOrDie(env, buffer);
     sk_sp<SkData> data(SkData::MakeWithProc(fontPtr, fontSize,
             release_global_ref, reinterpret_cast<void*>(fontRef)));
@@ -171,10 +179,9 @@ static jlong Font_Builder_build(JNIEnv* env, jobject clazz, jlong builderPtr, jo
                           "Failed to create internal object. maybe invalid font data.");
         return 0;
     }
-    std::shared_ptr<minikin::MinikinFont> minikinFont =
-            std::make_shared<MinikinFontSkia>(std::move(face), fontPtr, fontSize,
-                                              std::string_view(fontPath.c_str(), fontPath.size()),
-                                              ttcIndex, builder->axes);
+    minikinFont = std::make_shared<MinikinFontSkia>(std::move(face), fontPtr, fontSize, path,
+                                                    ttcIndex, builder->axes);
+    SystemFontCache::addFont(path, ttcIndex, builder->axes, minikinFont);
     minikin::Font font = minikin::Font::Builder(minikinFont).setWeight(weight)
                     .setSlant(static_cast<minikin::FontStyle::Slant>(italic)).build();
     return reinterpret_cast<jlong>(new FontWrapper(std::move(font)));
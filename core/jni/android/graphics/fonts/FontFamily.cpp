@@ -66,7 +66,13 @@ static jlong FontFamily_Builder_build(JNIEnv* env, jobject clazz, jlong builderP
         ScopedUtfChars str(env, langTags);
         localeId = minikin::registerLocaleList(str.c_str());
     }
-    std::shared_ptr<minikin::FontFamily> family = std::make_shared<minikin::FontFamily>(
+    std::shared_ptr<minikin::FontFamily> family =
+            SystemFontCache::findFamily(builder->fonts, localeId, variant, isCustomFallback);
+    if (family != nullptr) {
+        return reinterpret_cast<jlong>(new FontFamilyWrapper(std::move(family)));
+    }
+    std::vector<minikin::Font> fonts = builder->fonts;
+    family = std::make_shared<minikin::FontFamily>(
             localeId, static_cast<minikin::FamilyVariant>(variant), std::move(builder->fonts),
             isCustomFallback);
     if (family->getCoverage().length() == 0) {
@@ -75,6 +81,7 @@ static jlong FontFamily_Builder_build(JNIEnv* env, jobject clazz, jlong builderP
                           "Failed to create internal object. maybe invalid font data");
         return 0;
     }
+    SystemFontCache::addFamily(fonts, localeId, variant, isCustomFallback, family);
     return reinterpret_cast<jlong>(new FontFamilyWrapper(std::move(family)));
 }
 
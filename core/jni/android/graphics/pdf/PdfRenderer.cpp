@@ -24,9 +24,13 @@
 #include "fpdfview.h"
 
 #include "core_jni_helpers.h"
+#include <list>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 #include <utils/Log.h>
 #include <unistd.h>
+#include <string.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -112,12 +116,174 @@ static void nativeRenderPage(JNIEnv* env, jclass thiz, jlong documentPtr, jlong
     skBitmap.notifyPixelsChanged();
 }
 
+// Rendered tiles of pages, so that a viewer scrolling back to a page or returning to a zoom
+// level copies pixels instead of rasterizing the page again. PDFium keeps global state and
+// can't render on more than one thread at a time, even with separate documents, so this
+// rather than concurrent rendering is what makes repeated views cheap.
+class TileCache {
+public:
+    struct Key {
+        FPDF_DOCUMENT document;
+        int pageIndex;
+        int left, top, width, height;
+        float scale;
+        int renderMode;
+
+        bool operator==(const Key& other) const {
+            return document == other.document && pageIndex == other.pageIndex
+                    && left == other.left && top == other.top && width == other.width
+                    && height == other.height && scale == other.scale
+                    && renderMode == other.renderMode;
+        }
+    };
+
+    // Copies the tile into pixels, whose rows are rowBytes apart. Returns false on a miss.
+    bool get(const Key& key, void* pixels, size_t rowBytes) {
+        std::lock_guard<std::mutex> guard(mLock);
+        auto index = mIndex.find(key);
+        if (index == mIndex.end()) {
+            return false;
+        }
+        mEntries.splice(mEntries.begin(), mEntries, index->second);
+        copyRows(index->second->pixels.data(), key.width * 4, pixels, rowBytes, key);
+        return true;
+    }
+
+    void put(const Key& key, const void* pixels, size_t rowBytes) {
+        size_t tileBytes = static_cast<size_t>(key.width) * key.height * 4;
+        if (tileBytes > kMaxCachedBytes / 4) {
+            return;
+        }
+        Entry entry;
+        entry.key = key;
+        entry.pixels.resize(tileBytes);
+        copyRows(pixels, rowBytes, entry.pixels.data(), key.width * 4, key);
+
+        std::lock_guard<std::mutex> guard(mLock);
+        remove_l(key);
+        mCachedBytes += tileBytes;
+        mEntries.push_front(std::move(entry));
+        mIndex[key] = mEntries.begin();
+        while (mCachedBytes > kMaxCachedBytes) {
+            remove_l(mEntries.back().key);
+        }
+    }
+
+    void removeDocument(FPDF_DOCUMENT document) {
+        std::lock_guard<std::mutex> guard(mLock);
+        for (auto it = mEntries.begin(); it != mEntries.end();) {
+            auto next = std::next(it);
+            if (it->key.document == document) {
+                remove_l(it->key);
+            }
+            it = next;
+        }
+    }
+
+private:
+    static const size_t kMaxCachedBytes = 16 * 1024 * 1024;
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            size_t hash = std::hash<const void*>()(key.document);
+            for (int value : {key.pageIndex, key.left, key.top, key.width, key.height,
+                              key.renderMode}) {
+                hash = hash * 31 + value;
+            }
+            return hash * 31 + std::hash<float>()(key.scale);
+        }
+    };
+
+    struct Entry {
+        Key key;
+        std::vector<uint8_t> pixels;
+    };
+
+    typedef std::list<Entry> EntryList;
+
+    std::mutex mLock;
+    EntryList mEntries;     // most recently used first
+    std::unordered_map<Key, EntryList::iterator, KeyHash> mIndex;
+    size_t mCachedBytes = 0;
+
+    static void copyRows(const void* src, size_t srcRowBytes, void* dst, size_t dstRowBytes,
+            const Key& key) {
+        size_t bytes = static_cast<size_t>(key.width) * 4;
+        for (int y = 0; y < key.height; y++) {
+            memcpy(static_cast<uint8_t*>(dst) + y * dstRowBytes,
+                    static_cast<const uint8_t*>(src) + y * srcRowBytes, bytes);
+        }
+    }
+
+    void remove_l(const Key& key) {
+        auto index = mIndex.find(key);
+        if (index == mIndex.end()) {
+            return;
+        }
+        mCachedBytes -= index->second->pixels.size();
+        mEntries.erase(index->second);
+        mIndex.erase(index);
+    }
+};
+
+static TileCache gTileCache;
+
+// Renders the tile of the page at pageIndex whose top left corner is at (left, top) when the
+// page is drawn at scale, filling the whole bitmap. The bitmap's previous contents are
+// replaced, so tiles can be rendered into recycled bitmaps.
+static void nativeRenderTile(JNIEnv* env, jclass thiz, jlong documentPtr, jlong pagePtr,
+        jint pageIndex, jlong bitmapPtr, jint left, jint top, jfloat scale, jint renderMode) {
+    FPDF_DOCUMENT document = reinterpret_cast<FPDF_DOCUMENT>(documentPtr);
+    FPDF_PAGE page = reinterpret_cast<FPDF_PAGE>(pagePtr);
+
+    SkBitmap skBitmap;
+    bitmap::toBitmap(bitmapPtr).getSkBitmap(&skBitmap);
+    if (skBitmap.colorType() != kN32_SkColorType || !(scale > 0)) {
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                "tiles need an ARGB_8888 bitmap and a positive scale");
+        return;
+    }
+
+    TileCache::Key key = {document, pageIndex, left, top, skBitmap.width(), skBitmap.height(),
+                          scale, renderMode};
+    if (gTileCache.get(key, skBitmap.getPixels(), skBitmap.rowBytes())) {
+        skBitmap.notifyPixelsChanged();
+        return;
+    }
+
+    memset(skBitmap.getPixels(), 0, skBitmap.computeByteSize());
+    FPDF_BITMAP bitmap = FPDFBitmap_CreateEx(skBitmap.width(), skBitmap.height(),
+            FPDFBitmap_BGRA, skBitmap.getPixels(), skBitmap.rowBytes());
+
+    int renderFlags = FPDF_REVERSE_BYTE_ORDER;
+    if (renderMode == RENDER_MODE_FOR_DISPLAY) {
+        renderFlags |= FPDF_LCD_TEXT;
+    } else if (renderMode == RENDER_MODE_FOR_PRINT) {
+        renderFlags |= FPDF_PRINTING;
+    }
+
+    FS_MATRIX transform = {scale, 0, 0, scale, (float) -left, (float) -top};
+    FS_RECTF clip = {0, 0, (float) skBitmap.width(), (float) skBitmap.height()};
+
+    FPDF_RenderPageBitmapWithMatrix(bitmap, page, &transform, &clip, renderFlags);
+    FPDFBitmap_Destroy(bitmap);
+
+    gTileCache.put(key, skBitmap.getPixels(), skBitmap.rowBytes());
+    skBitmap.notifyPixelsChanged();
+}
+
+static void nativeCloseRenderer(JNIEnv* env, jclass thiz, jlong documentPtr) {
+    gTileCache.removeDocument(reinterpret_cast<FPDF_DOCUMENT>(documentPtr));
+    nativeClose(env, thiz, documentPtr);
+}
+
 static const JNINativeMethod gPdfRenderer_Methods[] = {
     {"nativeCreate", "(IJ)J", (void*) nativeOpen},
-    {"nativeClose", "(J)V", (void*) nativeClose},
+    {"nativeClose", "(J)V", (void*) nativeCloseRenderer},
     {"nativeGetPageCount", "(J)I", (void*) nativeGetPageCount},
     {"nativeScaleForPrinting", "(J)Z", (void*) nativeScaleForPrinting},
     {"nativeRenderPage", "(JJJIIIIJI)V", (void*) nativeRenderPage},
+    {"nativeRenderTile", "(JJIJIIFI)V", (void*) nativeRenderTile},
     {"nativeOpenPageAndGetSize", "(JILandroid/graphics/Point;)J", (void*) nativeOpenPageAndGetSize},
     {"nativeClosePage", "(J)V", (void*) nativeClosePage}
 };
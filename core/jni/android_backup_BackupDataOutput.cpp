@@ -22,6 +22,8 @@
 
 #include <androidfw/BackupHelpers.h>
 
+#include <string.h>
+
 namespace android
 {
 
@@ -82,6 +84,59 @@ writeEntityData_native(JNIEnv* env, jobject clazz, jlong w, jbyteArray data, jin
     return (jint)err;
 }
 
+// Entities packed by BackupDataOutput.writeEntities, each as a native-order int key length,
+// an int data size (-1 for a deletion), the UTF-8 key and the data, with no padding.
+static jint
+writeEntities_native(JNIEnv* env, jobject clazz, jlong w, jbyteArray packed, jint size)
+{
+    BackupDataWriter* writer = (BackupDataWriter*)w;
+
+    if (size < 0 || env->GetArrayLength(packed) < size) {
+        // size mismatch
+        return -1;
+    }
+
+    jbyte* packedBytes = env->GetByteArrayElements(packed, NULL);
+    if (packedBytes == NULL) {
+        return -1;
+    }
+
+    int err = NO_ERROR;
+    const uint8_t* p = (const uint8_t*)packedBytes;
+    const uint8_t* end = p + size;
+    while (p < end) {
+        int32_t keyLen, dataSize;
+        if (end - p < (ssize_t)(2 * sizeof(int32_t))) {
+            err = -1;
+            break;
+        }
+        memcpy(&keyLen, p, sizeof(keyLen));
+        memcpy(&dataSize, p + sizeof(keyLen), sizeof(dataSize));
+        p += 2 * sizeof(int32_t);
+        ssize_t bodySize = (ssize_t)keyLen + (dataSize > 0 ? dataSize : 0);
+        if (keyLen <= 0 || bodySize > end - p) {
+            err = -1;
+            break;
+        }
+        String8 key((const char*)p, keyLen);
+        err = writer->WriteEntity(key, p + keyLen, dataSize);
+        if (err != NO_ERROR) {
+            break;
+        }
+        p += bodySize;
+    }
+
+    // Whatever was written must be on the fd before the caller gets to close it.
+    status_t flushErr = writer->Flush();
+    if (err == NO_ERROR) {
+        err = flushErr;
+    }
+
+    env->ReleaseByteArrayElements(packed, packedBytes, JNI_ABORT);
+
+    return (jint)err;
+}
+
 static void
 setKeyPrefix_native(JNIEnv* env, jobject clazz, jlong w, jstring keyPrefixObj)
 {
@@ -100,6 +155,7 @@ static const JNINativeMethod g_methods[] = {
     { "dtor", "(J)V", (void*)dtor_native },
     { "writeEntityHeader_native", "(JLjava/lang/String;I)I", (void*)writeEntityHeader_native },
     { "writeEntityData_native", "(J[BI)I", (void*)writeEntityData_native },
+    { "writeEntities_native", "(J[BI)I", (void*)writeEntities_native },
     { "setKeyPrefix_native", "(JLjava/lang/String;)V", (void*)setKeyPrefix_native },
 };
 
@@ -18,12 +18,15 @@
 
 #include <jni.h>
 #include <nativehelper/JNIHelp.h>
+#include <nativehelper/ScopedLocalRef.h>
+#include <nativehelper/ScopedPrimitiveArray.h>
 #include <android_runtime/AndroidRuntime.h>
 #include <android_runtime/Log.h>
 
 #include <utils/Log.h>
 #include <utils/String8.h>
 #include <utils/String16.h>
+#include <utils/Timers.h>
 #include <cutils/ashmem.h>
 #include <sys/mman.h>
 
@@ -85,9 +88,16 @@ struct SQLiteConnection {
     const String8 label;
 
     volatile bool canceled;
+    bool profiling;
+
+    // A statement left on a row that didn't fit into the previous cursor window, and the
+    // position of that row, so that the next window can be filled without re-executing it.
+    sqlite3_stmt* resumeStatement;
+    int resumePos;
 
     SQLiteConnection(sqlite3* db, int openFlags, const String8& path, const String8& label) :
-        db(db), openFlags(openFlags), path(path), label(label), canceled(false) { }
+        db(db), openFlags(openFlags), path(path), label(label), canceled(false),
+        profiling(false), resumeStatement(NULL), resumePos(0) { }
 };
 
 // Called each time a statement begins execution, when tracing is enabled.
@@ -180,6 +190,7 @@ static jlong nativeOpen(JNIEnv* env, jclass clazz, jstring pathStr, jint openFla
     }
     if (enableProfile) {
         sqlite3_profile(db, &sqliteProfileCallback, connection);
+        connection->profiling = true;
     }
 
     ALOGV("Opened connection %p with label '%s'", db, label.string());
@@ -333,6 +344,9 @@ static void nativeFinalizeStatement(JNIEnv* env, jclass clazz, jlong connectionP
     // whether any errors occurred while executing the statement.  The statement itself
     // is always finalized regardless.
     ALOGV("Finalized statement %p on connection %p", statement, connection->db);
+    if (connection->resumeStatement == statement) {
+        connection->resumeStatement = NULL;
+    }
     sqlite3_finalize(statement);
 }
 
@@ -439,6 +453,9 @@ static void nativeResetStatementAndClearBindings(JNIEnv* env, jclass clazz, jlon
     SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
     sqlite3_stmt* statement = reinterpret_cast<sqlite3_stmt*>(statementPtr);
 
+    if (connection->resumeStatement == statement) {
+        connection->resumeStatement = NULL;
+    }
     int err = sqlite3_reset(statement);
     if (err == SQLITE_OK) {
         err = sqlite3_clear_bindings(statement);
@@ -467,6 +484,115 @@ static void nativeExecute(JNIEnv* env, jclass clazz, jlong connectionPtr,
     executeNonQuery(env, connection, statement);
 }
 
+// Binds one value of a row packed for nativeExecuteBatch(). Types are the
+// CursorWindow field types; integers and floats (as raw bits) come from
+// |number|, strings and blobs from objects[slot].
+static int bindBatchValue(JNIEnv* env, sqlite3_stmt* statement, int index, jbyte type,
+        jlong number, jobjectArray objects, jsize slot) {
+    switch (type) {
+        case CursorWindow::FIELD_TYPE_NULL:
+            return sqlite3_bind_null(statement, index);
+        case CursorWindow::FIELD_TYPE_INTEGER:
+            return sqlite3_bind_int64(statement, index, number);
+        case CursorWindow::FIELD_TYPE_FLOAT: {
+            jdouble value;
+            memcpy(&value, &number, sizeof(value));
+            return sqlite3_bind_double(statement, index, value);
+        }
+        case CursorWindow::FIELD_TYPE_STRING: {
+            ScopedLocalRef<jstring> valueString(env,
+                    static_cast<jstring>(env->GetObjectArrayElement(objects, slot)));
+            if (valueString.get() == NULL) {
+                return sqlite3_bind_null(statement, index);
+            }
+            jsize valueLength = env->GetStringLength(valueString.get());
+            const jchar* value = env->GetStringCritical(valueString.get(), NULL);
+            int err = sqlite3_bind_text16(statement, index, value, valueLength * sizeof(jchar),
+                    SQLITE_TRANSIENT);
+            env->ReleaseStringCritical(valueString.get(), value);
+            return err;
+        }
+        case CursorWindow::FIELD_TYPE_BLOB: {
+            ScopedLocalRef<jbyteArray> valueArray(env,
+                    static_cast<jbyteArray>(env->GetObjectArrayElement(objects, slot)));
+            if (valueArray.get() == NULL) {
+                return sqlite3_bind_null(statement, index);
+            }
+            jsize valueLength = env->GetArrayLength(valueArray.get());
+            jbyte* value = static_cast<jbyte*>(
+                    env->GetPrimitiveArrayCritical(valueArray.get(), NULL));
+            int err = sqlite3_bind_blob(statement, index, value, valueLength, SQLITE_TRANSIENT);
+            env->ReleasePrimitiveArrayCritical(valueArray.get(), value, JNI_ABORT);
+            return err;
+        }
+        default:
+            return SQLITE_MISMATCH;
+    }
+}
+
+// Binds, steps and resets |statement| once for each of |rowCount| packed rows,
+// so that bulk inserts cost one JNI transition instead of one per value.
+// Row r, parameter p lives in slot r * paramCount + p of each array.
+// Returns the total number of changed rows, or -1 with an exception pending.
+static jint nativeExecuteBatch(JNIEnv* env, jclass clazz, jlong connectionPtr,
+        jlong statementPtr, jint rowCount, jbyteArray typesArray, jlongArray numbersArray,
+        jobjectArray objects) {
+    SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    sqlite3_stmt* statement = reinterpret_cast<sqlite3_stmt*>(statementPtr);
+
+    ScopedByteArrayRO types(env, typesArray);
+    ScopedLongArrayRO numbers(env, numbersArray);
+    if (types.get() == NULL || numbers.get() == NULL) {
+        return -1;
+    }
+
+    const int paramCount = sqlite3_bind_parameter_count(statement);
+    const size_t slotCount = static_cast<size_t>(rowCount) * paramCount;
+    if (rowCount < 0 || types.size() < slotCount || numbers.size() < slotCount
+            || (objects != NULL && static_cast<size_t>(env->GetArrayLength(objects)) < slotCount)) {
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                "Batch arrays are too short for the number of rows and parameters.");
+        return -1;
+    }
+
+    const nsecs_t startTime = connection->profiling ? systemTime(SYSTEM_TIME_MONOTONIC) : 0;
+    jint changes = 0;
+    for (jint row = 0; row < rowCount; row++) {
+        for (int i = 0; i < paramCount; i++) {
+            const size_t slot = static_cast<size_t>(row) * paramCount + i;
+            if (objects == NULL && (types[slot] == CursorWindow::FIELD_TYPE_STRING
+                    || types[slot] == CursorWindow::FIELD_TYPE_BLOB)) {
+                jniThrowException(env, "java/lang/IllegalArgumentException",
+                        "Batch has string or blob values but no objects array.");
+                return -1;
+            }
+            int err = bindBatchValue(env, statement, i + 1, types[slot], numbers[slot],
+                    objects, slot);
+            if (err != SQLITE_OK) {
+                throw_sqlite3_exception(env, connection->db, NULL);
+                sqlite3_reset(statement);
+                sqlite3_clear_bindings(statement);
+                return -1;
+            }
+        }
+        int err = executeNonQuery(env, connection, statement);
+        sqlite3_reset(statement);
+        sqlite3_clear_bindings(statement);
+        if (err != SQLITE_DONE) {
+            return -1;
+        }
+        changes += sqlite3_changes(connection->db);
+    }
+
+    if (connection->profiling && rowCount > 0) {
+        const nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - startTime;
+        ALOG(LOG_VERBOSE, SQLITE_PROFILE_TAG, "%s: batch of %d \"%s\" took %0.3f ms"
+                " (%0.3f ms per row)\n", connection->label.string(), rowCount,
+                sqlite3_sql(statement), elapsed * 0.000001f, elapsed * 0.000001f / rowCount);
+    }
+    return changes;
+}
+
 static jint nativeExecuteForChangedRowCount(JNIEnv* env, jclass clazz,
         jlong connectionPtr, jlong statementPtr) {
     SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
@@ -673,12 +799,19 @@ static CopyRowResult copyRow(JNIEnv* env, CursorWindow* window,
     return result;
 }
 
-static jlong nativeExecuteForCursorWindow(JNIEnv* env, jclass clazz,
-        jlong connectionPtr, jlong statementPtr, jlong windowPtr,
-        jint startPos, jint requiredPos, jboolean countAllRows) {
-    SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
-    sqlite3_stmt* statement = reinterpret_cast<sqlite3_stmt*>(statementPtr);
-    CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
+static jlong executeForCursorWindow(JNIEnv* env, SQLiteConnection* connection,
+        sqlite3_stmt* statement, CursorWindow* window,
+        jint startPos, jint requiredPos, jboolean countAllRows, bool resumable) {
+    // A statement left on a row by an earlier resumable fill continues from that row if
+    // this fill starts there. Otherwise it has to be executed again from the beginning.
+    bool resumed = false;
+    if (connection->resumeStatement == statement) {
+        resumed = connection->resumePos == startPos;
+        if (!resumed) {
+            sqlite3_reset(statement);
+        }
+        connection->resumeStatement = NULL;
+    }
 
     status_t status = window->clear();
     if (status) {
@@ -699,12 +832,14 @@ static jlong nativeExecuteForCursorWindow(JNIEnv* env, jclass clazz,
     }
 
     int retryCount = 0;
-    int totalRows = 0;
+    int totalRows = resumed ? startPos : 0;
     int addedRows = 0;
     bool windowFull = false;
     bool gotException = false;
     while (!gotException && (!windowFull || countAllRows)) {
-        int err = sqlite3_step(statement);
+        // A resumed statement is still on the row at startPos.
+        int err = resumed ? SQLITE_ROW : sqlite3_step(statement);
+        resumed = false;
         if (err == SQLITE_ROW) {
             LOG_WINDOW("Stepped statement %p to row %d", statement, totalRows);
             retryCount = 0;
@@ -756,10 +891,19 @@ static jlong nativeExecuteForCursorWindow(JNIEnv* env, jclass clazz,
         }
     }
 
-    LOG_WINDOW("Resetting statement %p after fetching %d rows and adding %d rows"
-            "to the window in %d bytes",
-            statement, totalRows, addedRows, window->size() - window->freeSpace());
-    sqlite3_reset(statement);
+    if (resumable && windowFull && !countAllRows && !gotException && addedRows > 0) {
+        // Keep the statement on the row that didn't fit, which is where the next
+        // window starts.
+        LOG_WINDOW("Keeping statement %p on row %d after adding %d rows to the window",
+                statement, totalRows - 1, addedRows);
+        connection->resumeStatement = statement;
+        connection->resumePos = totalRows - 1;
+    } else {
+        LOG_WINDOW("Resetting statement %p after fetching %d rows and adding %d rows"
+                "to the window in %d bytes",
+                statement, totalRows, addedRows, window->size() - window->freeSpace());
+        sqlite3_reset(statement);
+    }
 
     // Report the total number of rows on request.
     if (startPos > totalRows) {
@@ -777,6 +921,33 @@ static jlong nativeExecuteForCursorWindow(JNIEnv* env, jclass clazz,
     return result;
 }
 
+static jlong nativeExecuteForCursorWindow(JNIEnv* env, jclass clazz,
+        jlong connectionPtr, jlong statementPtr, jlong windowPtr,
+        jint startPos, jint requiredPos, jboolean countAllRows) {
+    SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    sqlite3_stmt* statement = reinterpret_cast<sqlite3_stmt*>(statementPtr);
+    CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
+
+    return executeForCursorWindow(env, connection, statement, window,
+            startPos, requiredPos, countAllRows, false /*resumable*/);
+}
+
+// Like nativeExecuteForCursorWindow() without counting all rows, except that when the
+// window fills up the statement is left on the row that didn't fit instead of being reset.
+// Filling the next window from that row then continues the query rather than re-executing
+// it and stepping over every earlier row. Resetting or finalizing the statement drops the
+// saved position.
+static jlong nativeExecuteForCursorWindowResumable(JNIEnv* env, jclass clazz,
+        jlong connectionPtr, jlong statementPtr, jlong windowPtr,
+        jint startPos, jint requiredPos) {
+    SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    sqlite3_stmt* statement = reinterpret_cast<sqlite3_stmt*>(statementPtr);
+    CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
+
+    return executeForCursorWindow(env, connection, statement, window,
+            startPos, requiredPos, false /*countAllRows*/, true /*resumable*/);
+}
+
 static jint nativeGetDbLookaside(JNIEnv* env, jobject clazz, jlong connectionPtr) {
     SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
 
@@ -850,10 +1021,14 @@ static const JNINativeMethod sMethods[] =
             (void*)nativeExecuteForBlobFileDescriptor },
     { "nativeExecuteForChangedRowCount", "(JJ)I",
             (void*)nativeExecuteForChangedRowCount },
+    { "nativeExecuteBatch", "(JJI[B[J[Ljava/lang/Object;)I",
+            (void*)nativeExecuteBatch },
     { "nativeExecuteForLastInsertedRowId", "(JJ)J",
             (void*)nativeExecuteForLastInsertedRowId },
     { "nativeExecuteForCursorWindow", "(JJJIIZ)J",
             (void*)nativeExecuteForCursorWindow },
+    { "nativeExecuteForCursorWindowResumable", "(JJJII)J",
+            (void*)nativeExecuteForCursorWindowResumable },
     { "nativeGetDbLookaside", "(J)I",
             (void*)nativeGetDbLookaside },
     { "nativeCancel", "(J)V",
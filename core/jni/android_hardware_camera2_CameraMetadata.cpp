@@ -23,6 +23,7 @@
 #include <utils/Vector.h>
 #include <utils/SortedVector.h>
 #include <utils/KeyedVector.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
 #include <vector>
@@ -222,6 +223,83 @@ static jlong CameraMetadata_allocateCopy(JNIEnv *env, jobject thiz,
     return reinterpret_cast<jlong>(new CameraMetadata(*otherMetadata));
 }
 
+// Compares entries rather than raw buffers, which differ in capacity and layout.
+static bool CameraMetadata_sameContents(const camera_metadata_t *a, const camera_metadata_t *b) {
+    size_t count = get_camera_metadata_entry_count(a);
+    if (count != get_camera_metadata_entry_count(b) ||
+            get_camera_metadata_data_count(a) != get_camera_metadata_data_count(b) ||
+            get_camera_metadata_vendor_id(a) != get_camera_metadata_vendor_id(b)) {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        camera_metadata_ro_entry_t entryA, entryB;
+        if (get_camera_metadata_ro_entry(a, i, &entryA) != OK ||
+                get_camera_metadata_ro_entry(b, i, &entryB) != OK ||
+                entryA.tag != entryB.tag || entryA.type != entryB.type ||
+                entryA.count != entryB.count ||
+                memcmp(entryA.data.u8, entryB.data.u8,
+                       entryA.count * camera_metadata_type_size[entryA.type])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Makes this metadata a copy of other, for callers that copy a result into the same object
+// every frame. Identical contents are left alone, and the existing buffer is refilled in place
+// when it has the capacity, so that the copy neither allocates nor shrinks it.
+static void CameraMetadata_copyFrom(JNIEnv *env, jobject thiz, jobject other) {
+    ALOGV("%s", __FUNCTION__);
+
+    CameraMetadata* metadata = CameraMetadata_getPointerThrow(env, thiz);
+    if (metadata == NULL) return;
+
+    CameraMetadata* otherMetadata = CameraMetadata_getPointerThrow(env, other, "other");
+    if (otherMetadata == NULL || otherMetadata == metadata) return;
+
+    const camera_metadata_t *src = otherMetadata->getAndLock();
+    const camera_metadata_t *dst = metadata->getAndLock();
+    if (src == NULL || dst == NULL) {
+        metadata->unlock(dst);
+        otherMetadata->unlock(src);
+        *metadata = *otherMetadata;
+        return;
+    }
+
+    if (CameraMetadata_sameContents(dst, src)) {
+        ALOGV("%s: Contents unchanged", __FUNCTION__);
+        metadata->unlock(dst);
+        otherMetadata->unlock(src);
+        return;
+    }
+
+    size_t entryCapacity = get_camera_metadata_entry_capacity(dst);
+    size_t dataCapacity = get_camera_metadata_data_capacity(dst);
+    bool fits = get_camera_metadata_entry_count(src) <= entryCapacity &&
+            get_camera_metadata_data_count(src) <= dataCapacity;
+    metadata->unlock(dst);
+
+    camera_metadata_t *buffer = fits ? metadata->release() : NULL;
+    if (buffer == NULL) {
+        otherMetadata->unlock(src);
+        *metadata = *otherMetadata;
+        return;
+    }
+
+    size_t bufferSize = get_camera_metadata_size(buffer);
+    place_camera_metadata(buffer, bufferSize, entryCapacity, dataCapacity);
+    set_camera_metadata_vendor_id(buffer, get_camera_metadata_vendor_id(src));
+    int res = append_camera_metadata(buffer, src);
+    otherMetadata->unlock(src);
+    if (res != OK) {
+        ALOGE("%s: Failed to copy metadata in place (res = %d)", __FUNCTION__, res);
+        free_camera_metadata(buffer);
+        *metadata = *otherMetadata;
+        return;
+    }
+    metadata->acquire(buffer);
+}
+
 
 static jboolean CameraMetadata_isEmpty(JNIEnv *env, jobject thiz) {
     ALOGV("%s", __FUNCTION__);
@@ -322,6 +400,92 @@ static jbyteArray CameraMetadata_readValues(JNIEnv *env, jobject thiz, jint tag)
     return byteArray;
 }
 
+// Packed data starts on 8-byte boundaries, so that int64 and double values can be read
+// with aligned accesses.
+static const size_t kPackedAlignment = 8;
+
+/**
+ * Reads the values of all of tags into the direct buffer dst with one call, rather than one
+ * byte[] per tag. dst starts with a table of two int32s per tag, holding the offset of the
+ * tag's values in dst and their size in bytes, or -1 and 0 for a tag that has no entry. The
+ * values follow the table in native byte order, as nativeReadValues returns them.
+ *
+ * Returns the number of bytes written, or the negated size needed if dst is too small, in
+ * which case nothing is written.
+ */
+static jint CameraMetadata_readValuesPacked(JNIEnv *env, jobject thiz, jintArray tags,
+        jobject dst) {
+    ALOGV("%s", __FUNCTION__);
+
+    CameraMetadata* metadata = CameraMetadata_getPointerThrow(env, thiz);
+    if (metadata == NULL) return 0;
+
+    if (tags == NULL || dst == NULL) {
+        jniThrowNullPointerException(env, tags == NULL ? "tags" : "dst");
+        return 0;
+    }
+    uint8_t* out = static_cast<uint8_t*>(env->GetDirectBufferAddress(dst));
+    jlong capacity = env->GetDirectBufferCapacity(dst);
+    if (out == NULL || capacity < 0) {
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                          "dst is not a direct buffer");
+        return 0;
+    }
+
+    ScopedIntArrayRO tagArray(env, tags);
+    if (tagArray.get() == NULL) return 0;
+    size_t tagCount = tagArray.size();
+
+    const camera_metadata_t *metaBuffer = metadata->getAndLock();
+    std::vector<camera_metadata_ro_entry_t> entries(tagCount);
+    std::vector<bool> found(tagCount);
+
+    size_t total = tagCount * 2 * sizeof(int32_t);
+    for (size_t i = 0; i < tagCount; i++) {
+        uint32_t tag = static_cast<uint32_t>(tagArray[i]);
+        if (get_local_camera_metadata_tag_type(tag, metaBuffer) == -1) {
+            metadata->unlock(metaBuffer);
+            jniThrowExceptionFmt(env, "java/lang/IllegalArgumentException",
+                                 "Tag (%d) did not have a type", tag);
+            return 0;
+        }
+        camera_metadata_ro_entry_t& entry = entries[i];
+        if (metaBuffer == NULL ||
+                find_camera_metadata_ro_entry(metaBuffer, tag, &entry) != OK) {
+            continue;
+        }
+        found[i] = true;
+        total = (total + kPackedAlignment - 1) & ~(kPackedAlignment - 1);
+        total += entry.count * Helpers::getTypeSize(entry.type);
+    }
+
+    if (total > static_cast<size_t>(capacity) || total > INT32_MAX) {
+        metadata->unlock(metaBuffer);
+        ALOGV("%s: Needs %zu bytes, buffer holds %" PRId64, __FUNCTION__, total, capacity);
+        return total > INT32_MAX ? INT32_MIN : -static_cast<jint>(total);
+    }
+
+    int32_t* table = reinterpret_cast<int32_t*>(out);
+    size_t offset = tagCount * 2 * sizeof(int32_t);
+    for (size_t i = 0; i < tagCount; i++) {
+        const camera_metadata_ro_entry_t& entry = entries[i];
+        if (!found[i]) {
+            table[2 * i] = -1;
+            table[2 * i + 1] = 0;
+            continue;
+        }
+        offset = (offset + kPackedAlignment - 1) & ~(kPackedAlignment - 1);
+        size_t byteCount = entry.count * Helpers::getTypeSize(entry.type);
+        memcpy(out + offset, entry.data.u8, byteCount);
+        table[2 * i] = static_cast<int32_t>(offset);
+        table[2 * i + 1] = static_cast<int32_t>(byteCount);
+        offset += byteCount;
+    }
+    metadata->unlock(metaBuffer);
+
+    return static_cast<jint>(offset);
+}
+
 static void CameraMetadata_writeValues(JNIEnv *env, jobject thiz, jint tag, jbyteArray src) {
     ALOGV("%s (tag = %d)", __FUNCTION__, tag);
 
@@ -555,6 +719,9 @@ static const JNINativeMethod gCameraMetadataMethods[] = {
   { "nativeAllocateCopy",
     "(L" CAMERA_METADATA_CLASS_NAME ";)J",
     (void *)CameraMetadata_allocateCopy },
+  { "nativeCopyFrom",
+    "(L" CAMERA_METADATA_CLASS_NAME ";)V",
+    (void *)CameraMetadata_copyFrom },
   { "nativeIsEmpty",
     "()Z",
     (void*)CameraMetadata_isEmpty },
@@ -576,6 +743,9 @@ static const JNINativeMethod gCameraMetadataMethods[] = {
   { "nativeReadValues",
     "(I)[B",
     (void *)CameraMetadata_readValues },
+  { "nativeReadValuesPacked",
+    "([ILjava/nio/ByteBuffer;)I",
+    (void *)CameraMetadata_readValuesPacked },
   { "nativeWriteValues",
     "(I[B)V",
     (void *)CameraMetadata_writeValues },
@@ -16,8 +16,10 @@
 
 //#define LOG_NDEBUG 0
 #define LOG_TAG "DngCreator_JNI"
+#include <errno.h>
 #include <inttypes.h>
 #include <string.h>
+#include <unistd.h>
 #include <algorithm>
 #include <array>
 #include <memory>
@@ -48,6 +50,7 @@
 
 #include <jni.h>
 #include <nativehelper/JNIHelp.h>
+#include <nativehelper/ScopedLocalRef.h>
 
 using namespace android;
 using namespace img_utils;
@@ -101,6 +104,12 @@ static struct {
     jmethodID mWriteMethod;
 } gOutputStreamClassInfo;
 
+static struct {
+    jclass mFileOutputStreamClass;
+    jclass mAutoCloseOutputStreamClass;
+    jmethodID mGetFDMethod;
+} gFileOutputStreamClassInfo;
+
 static struct {
     jmethodID mReadMethod;
     jmethodID mSkipMethod;
@@ -377,6 +386,86 @@ status_t JniOutputStream::close() {
 // End of JniOutputStream
 // ----------------------------------------------------------------------------
 
+/**
+ * Output that writes straight to a file descriptor, through a buffer that gathers the many small
+ * writes of the TIFF structure.
+ *
+ * This class is not intended to be used across JNI calls.
+ */
+class FdOutput : public Output, public LightRefBase<FdOutput> {
+public:
+    explicit FdOutput(int fd);
+
+    virtual ~FdOutput();
+
+    status_t open();
+
+    status_t write(const uint8_t* buf, size_t offset, size_t count);
+
+    status_t close();
+private:
+    enum {
+        BUFFER_SIZE = 256 * 1024
+    };
+    status_t writeFully(const uint8_t* buf, size_t count);
+    status_t flush();
+
+    int mFd;
+    std::unique_ptr<uint8_t[]> mBuffer;
+    size_t mBuffered;
+};
+
+FdOutput::FdOutput(int fd) : mFd(fd), mBuffer(new uint8_t[BUFFER_SIZE]), mBuffered(0) {}
+
+FdOutput::~FdOutput() {}
+
+status_t FdOutput::open() {
+    // Do nothing
+    return OK;
+}
+
+status_t FdOutput::writeFully(const uint8_t* buf, size_t count) {
+    while (count > 0) {
+        ssize_t written = TEMP_FAILURE_RETRY(::write(mFd, buf, count));
+        if (written < 0) {
+            ALOGE("%s: Failed to write to fd %d: %s", __FUNCTION__, mFd, strerror(errno));
+            return -errno;
+        }
+        buf += written;
+        count -= written;
+    }
+    return OK;
+}
+
+status_t FdOutput::flush() {
+    status_t res = writeFully(mBuffer.get(), mBuffered);
+    mBuffered = 0;
+    return res;
+}
+
+status_t FdOutput::write(const uint8_t* buf, size_t offset, size_t count) {
+    if (mBuffered + count > BUFFER_SIZE) {
+        status_t res = flush();
+        if (res != OK) {
+            return res;
+        }
+    }
+    // Pixel data large enough to fill the buffer by itself goes straight to the file.
+    if (count >= BUFFER_SIZE) {
+        return writeFully(buf + offset, count);
+    }
+    memcpy(mBuffer.get() + mBuffered, buf + offset, count);
+    mBuffered += count;
+    return OK;
+}
+
+status_t FdOutput::close() {
+    return flush();
+}
+
+// End of FdOutput
+// ----------------------------------------------------------------------------
+
 /**
  * Wrapper class for a Java InputStream.
  *
@@ -1173,6 +1262,14 @@ static void DngCreator_nativeClassInit(JNIEnv* env, jclass clazz) {
     gOutputStreamClassInfo.mWriteMethod = GetMethodIDOrDie(env,
             outputStreamClazz, "write", "([BII)V");
 
+    jclass fileOutputStreamClazz = FindClassOrDie(env, "java/io/FileOutputStream");
+    gFileOutputStreamClassInfo.mFileOutputStreamClass = MakeGlobalRefOrDie(env,
+            fileOutputStreamClazz);
+    gFileOutputStreamClassInfo.mAutoCloseOutputStreamClass = MakeGlobalRefOrDie(env,
+            FindClassOrDie(env, "android/os/ParcelFileDescriptor$AutoCloseOutputStream"));
+    gFileOutputStreamClassInfo.mGetFDMethod = GetMethodIDOrDie(env,
+            fileOutputStreamClazz, "getFD", "()Ljava/io/FileDescriptor;");
+
     jclass inputStreamClazz = FindClassOrDie(env, "java/io/InputStream");
     gInputStreamClassInfo.mReadMethod = GetMethodIDOrDie(env, inputStreamClazz, "read", "([BII)I");
     gInputStreamClassInfo.mSkipMethod = GetMethodIDOrDie(env, inputStreamClazz, "skip", "(J)J");
@@ -2406,6 +2503,64 @@ static void DngCreator_nativeSetThumbnail(JNIEnv* env, jobject thiz, jobject buf
     }
 }
 
+/**
+ * Returns the file descriptor behind outStream if it is a plain FileOutputStream, which can then
+ * be written directly rather than through a JNI call for every 4KB. Returns -1 otherwise,
+ * including for subclasses that may do something with the bytes on the way.
+ */
+static int getOutputFd(JNIEnv* env, jobject outStream) {
+    ScopedLocalRef<jclass> clazz(env, env->GetObjectClass(outStream));
+    if (!env->IsSameObject(clazz.get(), gFileOutputStreamClassInfo.mFileOutputStreamClass) &&
+            !env->IsSameObject(clazz.get(),
+                    gFileOutputStreamClassInfo.mAutoCloseOutputStreamClass)) {
+        return -1;
+    }
+    ScopedLocalRef<jobject> fileDescriptor(env,
+            env->CallObjectMethod(outStream, gFileOutputStreamClassInfo.mGetFDMethod));
+    if (env->ExceptionCheck() || fileDescriptor.get() == nullptr) {
+        env->ExceptionClear();
+        return -1;
+    }
+    return jniGetFDFromFileDescriptor(env, fileDescriptor.get());
+}
+
+/**
+ * Opens the Output to write the DNG to outStream with, keeping it alive in one of the given
+ * pointers. Returns nullptr with an exception pending on failure.
+ */
+static Output* openOutput(JNIEnv* env, jobject outStream, sp<JniOutputStream>* jniOut,
+        sp<FdOutput>* fdOut) {
+    int fd = getOutputFd(env, outStream);
+    if (fd >= 0) {
+        ALOGV("%s: Writing straight to fd %d.", __FUNCTION__, fd);
+        *fdOut = new FdOutput(fd);
+        return fdOut->get();
+    }
+
+    *jniOut = new JniOutputStream(env, outStream);
+    if (env->ExceptionCheck()) {
+        ALOGE("%s: Could not allocate buffers for output stream", __FUNCTION__);
+        return nullptr;
+    }
+    return jniOut->get();
+}
+
+/**
+ * Flushes out after the TiffWriter is done with it. Returns false with an exception pending on
+ * failure.
+ */
+static bool closeOutput(JNIEnv* env, Output* out) {
+    status_t ret = out->close();
+    if (ret != OK) {
+        if (!env->ExceptionCheck()) {
+            jniThrowExceptionFmt(env, "java/io/IOException",
+                    "Encountered error %d while writing file.", ret);
+        }
+        return false;
+    }
+    return true;
+}
+
 // TODO: Refactor out common preamble for the two nativeWrite methods.
 static void DngCreator_nativeWriteImage(JNIEnv* env, jobject thiz, jobject outStream, jint width,
         jint height, jobject inBuffer, jint rowStride, jint pixStride, jlong offset,
@@ -2420,9 +2575,10 @@ static void DngCreator_nativeWriteImage(JNIEnv* env, jobject thiz, jobject outSt
     uint32_t uHeight = static_cast<uint32_t>(height);
     uint64_t uOffset = static_cast<uint64_t>(offset);
 
-    sp<JniOutputStream> out = new JniOutputStream(env, outStream);
-    if(env->ExceptionCheck()) {
-        ALOGE("%s: Could not allocate buffers for output stream", __FUNCTION__);
+    sp<JniOutputStream> jniOut;
+    sp<FdOutput> fdOut;
+    Output* out = openOutput(env, outStream, &jniOut, &fdOut);
+    if (out == nullptr) {
         return;
     }
 
@@ -2486,7 +2642,7 @@ static void DngCreator_nativeWriteImage(JNIEnv* env, jobject thiz, jobject outSt
         sources.add(&stripSource);
 
         status_t ret = OK;
-        if ((ret = writer->write(out.get(), sources.editArray(), sources.size())) != OK) {
+        if ((ret = writer->write(out, sources.editArray(), sources.size())) != OK) {
             ALOGE("%s: write failed with error %d.", __FUNCTION__, ret);
             if (!env->ExceptionCheck()) {
                 jniThrowExceptionFmt(env, "java/io/IOException",
@@ -2494,6 +2650,7 @@ static void DngCreator_nativeWriteImage(JNIEnv* env, jobject thiz, jobject outSt
             }
             return;
         }
+        closeOutput(env, out);
     } else {
         inBuf = new JniInputByteBuffer(env, inBuffer);
 
@@ -2503,7 +2660,7 @@ static void DngCreator_nativeWriteImage(JNIEnv* env, jobject thiz, jobject outSt
         sources.add(&stripSource);
 
         status_t ret = OK;
-        if ((ret = writer->write(out.get(), sources.editArray(), sources.size())) != OK) {
+        if ((ret = writer->write(out, sources.editArray(), sources.size())) != OK) {
             ALOGE("%s: write failed with error %d.", __FUNCTION__, ret);
             if (!env->ExceptionCheck()) {
                 jniThrowExceptionFmt(env, "java/io/IOException",
@@ -2511,6 +2668,7 @@ static void DngCreator_nativeWriteImage(JNIEnv* env, jobject thiz, jobject outSt
             }
             return;
         }
+        closeOutput(env, out);
     }
 }
 
@@ -2528,9 +2686,10 @@ static void DngCreator_nativeWriteInputStream(JNIEnv* env, jobject thiz, jobject
           "rowStride=%d, pixStride=%d, offset=%" PRId64, __FUNCTION__, width,
           height, rowStride, pixStride, offset);
 
-    sp<JniOutputStream> out = new JniOutputStream(env, outStream);
-    if (env->ExceptionCheck()) {
-        ALOGE("%s: Could not allocate buffers for output stream", __FUNCTION__);
+    sp<JniOutputStream> jniOut;
+    sp<FdOutput> fdOut;
+    Output* out = openOutput(env, outStream, &jniOut, &fdOut);
+    if (out == nullptr) {
         return;
     }
 
@@ -2577,7 +2736,7 @@ static void DngCreator_nativeWriteInputStream(JNIEnv* env, jobject thiz, jobject
     sources.add(&stripSource);
 
     status_t ret = OK;
-    if ((ret = writer->write(out.get(), sources.editArray(), sources.size())) != OK) {
+    if ((ret = writer->write(out, sources.editArray(), sources.size())) != OK) {
         ALOGE("%s: write failed with error %d.", __FUNCTION__, ret);
         if (!env->ExceptionCheck()) {
             jniThrowExceptionFmt(env, "java/io/IOException",
@@ -2585,6 +2744,7 @@ static void DngCreator_nativeWriteInputStream(JNIEnv* env, jobject thiz, jobject
         }
         return;
     }
+    closeOutput(env, out);
 }
 
 } /*extern "C" */
@@ -28,6 +28,14 @@
 #include <utils/Log.h>
 #include <media/AudioSystem.h>
 #include <media/ToneGenerator.h>
+#include <utils/Timers.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 // ----------------------------------------------------------------------------
 
@@ -38,6 +46,100 @@ struct fields_t {
 };
 static fields_t fields;
 
+// Released ToneGenerators are kept for a while with their AudioTrack, so that apps that
+// create a ToneGenerator per beep do not pay for setting up a new track each time. A pooled
+// generator is only handed out again for the same stream type and volume.
+class ToneGeneratorPool {
+public:
+    ToneGenerator* acquire(audio_stream_type_t streamType, jint volume) {
+        std::lock_guard<std::mutex> guard(mLock);
+        for (auto it = mIdle.begin(); it != mIdle.end(); ++it) {
+            if (it->key == key(streamType, volume)) {
+                ToneGenerator* toneGen = it->toneGen;
+                mIdle.erase(it);
+                mKeys[toneGen] = key(streamType, volume);
+                return toneGen;
+            }
+        }
+        return NULL;
+    }
+
+    // Takes ownership of a ToneGenerator set up by native_setup.
+    void track(ToneGenerator* toneGen, audio_stream_type_t streamType, jint volume) {
+        std::lock_guard<std::mutex> guard(mLock);
+        mKeys[toneGen] = key(streamType, volume);
+    }
+
+    void release(ToneGenerator* toneGen) {
+        toneGen->stopTone();
+
+        std::vector<ToneGenerator*> evicted;
+        {
+            std::lock_guard<std::mutex> guard(mLock);
+            auto it = mKeys.find(toneGen);
+            if (it == mKeys.end()) {
+                evicted.push_back(toneGen);
+            } else {
+                mIdle.push_back({toneGen, it->second, systemTime()});
+                mKeys.erase(it);
+                while (mIdle.size() > kMaxIdle) {
+                    evicted.push_back(mIdle.front().toneGen);
+                    mIdle.pop_front();
+                }
+                if (!mReaping) {
+                    mReaping = true;
+                    std::thread(&ToneGeneratorPool::reap, this).detach();
+                }
+            }
+        }
+        // Tearing down the track can block, so do it outside of the lock.
+        for (ToneGenerator* gen : evicted) {
+            delete gen;
+        }
+    }
+
+private:
+    static const size_t kMaxIdle = 4;
+    static const nsecs_t kIdleTimeoutNs = 10000000000LL;    // 10 s
+
+    struct Idle {
+        ToneGenerator* toneGen;
+        int64_t key;
+        nsecs_t since;
+    };
+
+    static int64_t key(audio_stream_type_t streamType, jint volume) {
+        return ((int64_t)streamType << 32) | (uint32_t)volume;
+    }
+
+    // Deletes the generators that have been idle for too long. Runs until the pool is empty.
+    void reap() {
+        std::unique_lock<std::mutex> lock(mLock);
+        while (!mIdle.empty()) {
+            nsecs_t wait = mIdle.front().since + kIdleTimeoutNs - systemTime();
+            if (wait > 0) {
+                mCondition.wait_for(lock, std::chrono::nanoseconds(wait));
+                continue;
+            }
+            ToneGenerator* toneGen = mIdle.front().toneGen;
+            mIdle.pop_front();
+            lock.unlock();
+            delete toneGen;
+            lock.lock();
+        }
+        mReaping = false;
+    }
+
+    std::mutex mLock;
+    std::condition_variable mCondition;
+    std::deque<Idle> mIdle;     // oldest first
+    std::unordered_map<ToneGenerator*, int64_t> mKeys;  // generators in use
+    bool mReaping = false;
+};
+
+// Never destroyed, as the reaper thread may outlive static destruction.
+static ToneGeneratorPool* const gToneGeneratorPool = new ToneGeneratorPool();
+
 static jboolean android_media_ToneGenerator_startTone(JNIEnv *env, jobject thiz, jint toneType, jint durationMs) {
     ALOGV("android_media_ToneGenerator_startTone: %p", thiz);
 
@@ -82,15 +184,25 @@ static void android_media_ToneGenerator_release(JNIEnv *env, jobject thiz) {
 
     env->SetLongField(thiz, fields.context, 0);
 
-    delete lpToneGen;
+    if (lpToneGen != NULL) {
+        gToneGeneratorPool->release(lpToneGen);
+    }
 }
 
 static void android_media_ToneGenerator_native_setup(JNIEnv *env, jobject thiz,
         jint streamType, jint volume) {
-    ToneGenerator *lpToneGen = new ToneGenerator((audio_stream_type_t) streamType, AudioSystem::linearToLog(volume), true);
-
     env->SetLongField(thiz, fields.context, 0);
 
+    ToneGenerator *lpToneGen = gToneGeneratorPool->acquire(
+            (audio_stream_type_t) streamType, volume);
+    if (lpToneGen != NULL) {
+        ALOGV("ToneGenerator reused lpToneGen: %p", lpToneGen);
+        env->SetLongField(thiz, fields.context, (jlong)lpToneGen);
+        return;
+    }
+
+    lpToneGen = new ToneGenerator((audio_stream_type_t) streamType, AudioSystem::linearToLog(volume), true);
+
     ALOGV("android_media_ToneGenerator_native_setup jobject: %p", thiz);
 
     ALOGV("ToneGenerator lpToneGen: %p", lpToneGen);
@@ -103,6 +215,7 @@ static void android_media_ToneGenerator_native_setup(JNIEnv *env, jobject thiz,
     }
 
     // Stow our new C++ ToneGenerator in an opaque field in the Java object.
+    gToneGeneratorPool->track(lpToneGen, (audio_stream_type_t) streamType, volume);
     env->SetLongField(thiz, fields.context, (jlong)lpToneGen);
 
     ALOGV("ToneGenerator fields.context: %p", (void*) env->GetLongField(thiz, fields.context));
@@ -116,8 +229,8 @@ static void android_media_ToneGenerator_native_finalize(JNIEnv *env,
             fields.context);
 
     if (lpToneGen != NULL) {
-        ALOGV("delete lpToneGen: %p", lpToneGen);
-        delete lpToneGen;
+        ALOGV("release lpToneGen: %p", lpToneGen);
+        gToneGeneratorPool->release(lpToneGen);
     }
 }
 
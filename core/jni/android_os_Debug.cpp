@@ -49,6 +49,8 @@
 #include <memtrack/memtrack.h>
 #include <memunreachable/memunreachable.h>
 #include <android-base/strings.h>
+#include <android-base/unique_fd.h>
+#include <androidfw/AssetManager2.h>
 #include "android_os_Debug.h"
 #include <vintf/VintfObject.h>
 
@@ -489,8 +491,110 @@ static void android_os_Debug_getDirtyPages(JNIEnv *env, jobject clazz, jobject o
     android_os_Debug_getDirtyPagesPid(env, clazz, getpid(), object);
 }
 
-static jlong android_os_Debug_getPssPid(JNIEnv *env, jobject clazz, jint pid,
-        jlongArray outUssSwapPssRss, jlongArray outMemtrack)
+/*
+ * Parses the value of a "Name:   1234 kB" line of smaps_rollup. Returns the character after the
+ * number.
+ */
+static const char* parse_smaps_kb(const char* p, const char* end, uint64_t* out)
+{
+    while (p < end && *p == ' ') {
+        p++;
+    }
+    uint64_t value = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        value = value * 10 + (*p - '0');
+        p++;
+    }
+    *out = value;
+    return p;
+}
+
+/*
+ * Reads the totals of /proc/pid/smaps_rollup with a single read and without sscanf. Returns
+ * false if the kernel has no smaps_rollup, in which case the caller has to sum up smaps.
+ */
+static bool read_smaps_rollup(int pid, meminfo::MemUsage* stats)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/smaps_rollup", pid);
+    base::unique_fd fd(TEMP_FAILURE_RETRY(open(path, O_RDONLY | O_CLOEXEC)));
+    if (fd == -1) {
+        return false;
+    }
+
+    // The rollup is a header line and about twenty counters, well below a page.
+    char buf[4096];
+    size_t len = 0;
+    while (len < sizeof(buf)) {
+        ssize_t n = TEMP_FAILURE_RETRY(read(fd, buf + len, sizeof(buf) - len));
+        if (n < 0) {
+            return false;
+        }
+        if (n == 0) {
+            break;
+        }
+        len += n;
+    }
+
+    *stats = {};
+    const char* end = buf + len;
+    // Skip the header line with the address range.
+    const char* p = static_cast<const char*>(memchr(buf, '\n', len));
+    while (p != nullptr && ++p < end) {
+        uint64_t* field = nullptr;
+        size_t name_len = 0;
+        switch (*p) {
+            case 'R':
+                if (end - p > 4 && !memcmp(p, "Rss:", 4)) {
+                    field = &stats->rss;
+                    name_len = 4;
+                }
+                break;
+            case 'P':
+                if (end - p > 4 && !memcmp(p, "Pss:", 4)) {
+                    field = &stats->pss;
+                    name_len = 4;
+                } else if (end - p > 14 && !memcmp(p, "Private_Clean:", 14)) {
+                    field = &stats->private_clean;
+                    name_len = 14;
+                } else if (end - p > 14 && !memcmp(p, "Private_Dirty:", 14)) {
+                    field = &stats->private_dirty;
+                    name_len = 14;
+                }
+                break;
+            case 'S':
+                if (end - p > 5 && !memcmp(p, "Swap:", 5)) {
+                    field = &stats->swap;
+                    name_len = 5;
+                } else if (end - p > 8 && !memcmp(p, "SwapPss:", 8)) {
+                    field = &stats->swap_pss;
+                    name_len = 8;
+                }
+                break;
+        }
+        if (field != nullptr) {
+            p = parse_smaps_kb(p + name_len, end, field);
+        }
+        p = static_cast<const char*>(memchr(p, '\n', end - p));
+    }
+    stats->uss = stats->private_clean + stats->private_dirty;
+    return true;
+}
+
+// Order of the values that getPss(int[], long[]) returns for each pid.
+enum {
+    PSS_PID_PSS,
+    PSS_PID_USS,
+    PSS_PID_SWAP_PSS,
+    PSS_PID_RSS,
+    PSS_PID_MEMTRACK,
+    PSS_PID_COUNT
+};
+
+/*
+ * Collects the totals of one process into out[PSS_PID_*]. p may be NULL if there is no memtrack.
+ */
+static void read_pss(struct memtrack_proc* p, int pid, jlong* out)
 {
     jlong pss = 0;
     jlong rss = 0;
@@ -499,13 +603,17 @@ static jlong android_os_Debug_getPssPid(JNIEnv *env, jobject clazz, jint pid,
     jlong memtrack = 0;
 
     struct graphics_memory_pss graphics_mem;
-    if (read_memtrack_memory(pid, &graphics_mem) == 0) {
+    if (p != NULL && read_memtrack_memory(p, pid, &graphics_mem) == 0) {
         pss = uss = rss = memtrack = graphics_mem.graphics + graphics_mem.gl + graphics_mem.other;
     }
 
-    ::android::meminfo::ProcMemInfo proc_mem(pid);
     ::android::meminfo::MemUsage stats;
-    if (proc_mem.SmapsOrRollup(&stats)) {
+    bool found = read_smaps_rollup(pid, &stats);
+    if (!found) {
+        ::android::meminfo::ProcMemInfo proc_mem(pid);
+        found = proc_mem.SmapsOrRollup(&stats);
+    }
+    if (found) {
         pss += stats.pss;
         uss += stats.uss;
         rss += stats.rss;
@@ -513,6 +621,32 @@ static jlong android_os_Debug_getPssPid(JNIEnv *env, jobject clazz, jint pid,
         pss += swapPss; // Also in swap, those pages would be accounted as Pss without SWAP
     }
 
+    out[PSS_PID_PSS] = pss;
+    out[PSS_PID_USS] = uss;
+    out[PSS_PID_SWAP_PSS] = swapPss;
+    out[PSS_PID_RSS] = rss;
+    out[PSS_PID_MEMTRACK] = memtrack;
+}
+
+static jlong android_os_Debug_getPssPid(JNIEnv *env, jobject clazz, jint pid,
+        jlongArray outUssSwapPssRss, jlongArray outMemtrack)
+{
+    struct memtrack_proc* p = memtrack_proc_new();
+    if (p == NULL) {
+        ALOGW("failed to create memtrack_proc");
+    }
+    jlong values[PSS_PID_COUNT];
+    read_pss(p, pid, values);
+    if (p != NULL) {
+        memtrack_proc_destroy(p);
+    }
+
+    jlong pss = values[PSS_PID_PSS];
+    jlong uss = values[PSS_PID_USS];
+    jlong swapPss = values[PSS_PID_SWAP_PSS];
+    jlong rss = values[PSS_PID_RSS];
+    jlong memtrack = values[PSS_PID_MEMTRACK];
+
     if (outUssSwapPssRss != NULL) {
         if (env->GetArrayLength(outUssSwapPssRss) >= 1) {
             jlong* outUssSwapPssRssArray = env->GetLongArrayElements(outUssSwapPssRss, 0);
@@ -547,6 +681,42 @@ static jlong android_os_Debug_getPss(JNIEnv *env, jobject clazz)
     return android_os_Debug_getPssPid(env, clazz, getpid(), NULL, NULL);
 }
 
+/*
+ * Collects the totals of many processes in one call, sharing one memtrack_proc. outValues
+ * receives PSS_PID_COUNT values per pid, in the order of the PSS_PID_* enum.
+ */
+static void android_os_Debug_getPssPids(JNIEnv *env, jobject clazz, jintArray pids,
+        jlongArray outValues)
+{
+    if (pids == NULL || outValues == NULL) {
+        jniThrowNullPointerException(env, "pids and outValues must not be null");
+        return;
+    }
+    jsize count = env->GetArrayLength(pids);
+    if (env->GetArrayLength(outValues) < count * PSS_PID_COUNT) {
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                "outValues is too small for the number of pids");
+        return;
+    }
+
+    std::vector<jint> pidValues(count);
+    env->GetIntArrayRegion(pids, 0, count, pidValues.data());
+    std::vector<jlong> values(count * PSS_PID_COUNT);
+
+    struct memtrack_proc* p = memtrack_proc_new();
+    if (p == NULL) {
+        ALOGW("failed to create memtrack_proc");
+    }
+    for (jsize i = 0; i < count; i++) {
+        read_pss(p, pidValues[i], &values[i * PSS_PID_COUNT]);
+    }
+    if (p != NULL) {
+        memtrack_proc_destroy(p);
+    }
+
+    env->SetLongArrayRegion(outValues, 0, values.size(), values.data());
+}
+
 // The 1:1 mapping of MEMINFO_* enums here must match with the constants from
 // Debug.java.
 enum {
@@ -837,6 +1007,11 @@ static jlong android_os_Debug_getIonMappedSizeKb(JNIEnv* env, jobject clazz) {
     return ionPss;
 }
 
+static jlong android_os_Debug_getResourceBagCacheSize(JNIEnv* env, jobject clazz)
+{
+    return (jlong)AssetManager2::GetGlobalBagCacheBytes();
+}
+
 static jboolean android_os_Debug_isVmapStack(JNIEnv *env, jobject clazz)
 {
     static enum {
@@ -873,6 +1048,8 @@ static const JNINativeMethod gMethods[] = {
             (void*) android_os_Debug_getPss },
     { "getPss",                 "(I[J[J)J",
             (void*) android_os_Debug_getPssPid },
+    { "getPss",                 "([I[J)V",
+            (void*) android_os_Debug_getPssPids },
     { "getMemInfo",             "([J)V",
             (void*) android_os_Debug_getMemInfo },
     { "dumpNativeHeap",         "(Ljava/io/FileDescriptor;)V",
@@ -903,6 +1080,8 @@ static const JNINativeMethod gMethods[] = {
             (void*)android_os_Debug_getIonPoolsSizeKb },
     { "getIonMappedSizeKb", "()J",
             (void*)android_os_Debug_getIonMappedSizeKb },
+    { "getResourceBagCacheSize", "()J",
+            (void*)android_os_Debug_getResourceBagCacheSize },
     { "isVmapStack", "()Z",
             (void*)android_os_Debug_isVmapStack },
 };
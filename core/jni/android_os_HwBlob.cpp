@@ -31,6 +31,9 @@
 
 #include "core_jni_helpers.h"
 
+#include <mutex>
+#include <vector>
+
 using android::AndroidRuntime;
 using android::hardware::hidl_handle;
 using android::hardware::hidl_string;
@@ -81,20 +84,74 @@ sp<JHwBlob> JHwBlob::GetNativeContext(JNIEnv *env, jobject thiz) {
     return (JHwBlob *)env->GetLongField(thiz, gFields.contextID);
 }
 
+// Buffers of large blobs are kept for reuse by later transactions, which tend to send
+// blobs of the same sizes over and over, rather than being returned to the heap.
+static const size_t kMinPooledBufferSize = 16 * 1024;
+static const size_t kMaxPooledBuffers = 4;
+
+static std::mutex gBufferPoolLock;
+static std::vector<std::pair<size_t, void *>> gBufferPool;  // capacity, buffer
+
+// Returns a zeroed buffer of at least size bytes and its capacity in *capacity.
+static void *allocBlobBuffer(size_t size, size_t *capacity) {
+    if (size >= kMinPooledBufferSize) {
+        std::lock_guard<std::mutex> guard(gBufferPoolLock);
+        auto best = gBufferPool.end();
+        for (auto it = gBufferPool.begin(); it != gBufferPool.end(); ++it) {
+            // Don't hand out buffers much larger than what was asked for.
+            if (it->first >= size && it->first / 2 <= size
+                    && (best == gBufferPool.end() || it->first < best->first)) {
+                best = it;
+            }
+        }
+        if (best != gBufferPool.end()) {
+            void *buffer = best->second;
+            *capacity = best->first;
+            gBufferPool.erase(best);
+            memset(buffer, 0, size);
+            return buffer;
+        }
+    }
+
+    *capacity = size;
+    return calloc(size, 1);
+}
+
+static void freeBlobBuffer(void *buffer, size_t capacity) {
+    if (buffer != nullptr && capacity >= kMinPooledBufferSize) {
+        std::lock_guard<std::mutex> guard(gBufferPoolLock);
+        if (gBufferPool.size() < kMaxPooledBuffers) {
+            gBufferPool.emplace_back(capacity, buffer);
+            return;
+        }
+    }
+    free(buffer);
+}
+
 JHwBlob::JHwBlob(JNIEnv *env, jobject thiz, size_t size)
     : mBuffer(nullptr),
       mSize(size),
+      mCapacity(0),
       mType(BlobType::GENERIC),
       mOwnsBuffer(true),
-      mHandle(0) {
+      mHandle(0),
+      mBufferObj(nullptr) {
     if (size > 0) {
-        mBuffer = calloc(size, 1);
+        mBuffer = allocBlobBuffer(size, &mCapacity);
     }
 }
 
 JHwBlob::~JHwBlob() {
-    if (mOwnsBuffer) {
-        free(mBuffer);
+    if (mBufferObj != nullptr) {
+        JNIEnv *env = AndroidRuntime::getJNIEnv();
+        if (env != nullptr) {
+            env->DeleteGlobalRef(mBufferObj);
+        } else {
+            LOG(ERROR) << "Leaking the direct buffer of a blob freed off a Java thread";
+        }
+        mBufferObj = nullptr;
+    } else if (mOwnsBuffer) {
+        freeBlobBuffer(mBuffer, mCapacity);
         mBuffer = nullptr;
     }
 }
@@ -109,6 +166,26 @@ void JHwBlob::setTo(const void *ptr, size_t handle) {
     mHandle = handle;
 }
 
+status_t JHwBlob::setToDirectBuffer(JNIEnv *env, jobject bufferObj) {
+    CHECK(mBufferObj == nullptr);
+
+    void *ptr = env->GetDirectBufferAddress(bufferObj);
+    jlong capacity = env->GetDirectBufferCapacity(bufferObj);
+    if (ptr == nullptr || capacity < 0) {
+        return BAD_VALUE;
+    }
+
+    if (mOwnsBuffer) {
+        freeBlobBuffer(mBuffer, mCapacity);
+    }
+    mBuffer = ptr;
+    mSize = capacity;
+    mCapacity = capacity;
+    mBufferObj = env->NewGlobalRef(bufferObj);
+
+    return OK;
+}
+
 status_t JHwBlob::getHandle(size_t *handle) const {
     if (mOwnsBuffer) {
         return INVALID_OPERATION;
@@ -287,6 +364,24 @@ static void JHwBlob_native_setup(
     JHwBlob::SetNativeContext(env, thiz, context);
 }
 
+static void JHwBlob_native_setupFromBuffer(
+        JNIEnv *env, jobject thiz, jobject bufferObj) {
+    if (bufferObj == nullptr) {
+        jniThrowException(env, "java/lang/NullPointerException", nullptr);
+        return;
+    }
+
+    sp<JHwBlob> context = new JHwBlob(env, thiz, 0 /* size */);
+
+    if (context->setToDirectBuffer(env, bufferObj) != OK) {
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                          "Buffer is not a direct buffer");
+        return;
+    }
+
+    JHwBlob::SetNativeContext(env, thiz, context);
+}
+
 #define DEFINE_BLOB_GETTER(Suffix,Type)                                        \
 static Type JHwBlob_native_get ## Suffix(                                      \
         JNIEnv *env, jobject thiz, jlong offset) {                             \
@@ -387,6 +482,24 @@ DEFINE_BLOB_ARRAY_COPIER(Int64,jlong,Long)
 DEFINE_BLOB_ARRAY_COPIER(Float,jfloat,Float)
 DEFINE_BLOB_ARRAY_COPIER(Double,jdouble,Double)
 
+// Returns a direct ByteBuffer over size bytes of the blob at offset, for reading a large
+// embedded vector without copying it into a Java array. The buffer is only valid for as long
+// as the blob and, for blobs read from a parcel, the parcel are.
+static jobject JHwBlob_native_asByteBuffer(
+        JNIEnv *env, jobject thiz, jlong offset, jlong size) {
+    sp<JHwBlob> blob = JHwBlob::GetNativeContext(env, thiz);
+
+    if (offset < 0 || size < 0
+            || static_cast<size_t>(offset) > blob->size()
+            || static_cast<size_t>(size) > blob->size() - offset) {
+        signalExceptionForError(env, -ERANGE);
+        return nullptr;
+    }
+
+    return env->NewDirectByteBuffer(
+            static_cast<uint8_t *>(blob->data()) + offset, size);
+}
+
 static void JHwBlob_native_copyToBoolArray(
         JNIEnv *env,
         jobject thiz,
@@ -592,6 +705,8 @@ static jlong JHwBlob_native_handle(JNIEnv *env, jobject thiz) {
 static JNINativeMethod gMethods[] = {
     { "native_init", "()J", (void *)JHwBlob_native_init },
     { "native_setup", "(I)V", (void *)JHwBlob_native_setup },
+    { "native_setupFromBuffer", "(Ljava/nio/ByteBuffer;)V",
+        (void *)JHwBlob_native_setupFromBuffer },
 
     { "getBool", "(J)Z", (void *)JHwBlob_native_getBool },
     { "getInt8", "(J)B", (void *)JHwBlob_native_getInt8 },
@@ -610,6 +725,7 @@ static JNINativeMethod gMethods[] = {
     { "copyToInt64Array", "(J[JI)V", (void *)JHwBlob_native_copyToInt64Array },
     { "copyToFloatArray", "(J[FI)V", (void *)JHwBlob_native_copyToFloatArray },
     { "copyToDoubleArray", "(J[DI)V", (void *)JHwBlob_native_copyToDoubleArray },
+    { "asByteBuffer", "(JJ)Ljava/nio/ByteBuffer;", (void *)JHwBlob_native_asByteBuffer },
 
     { "putBool", "(JZ)V", (void *)JHwBlob_native_putBool },
     { "putInt8", "(JB)V", (void *)JHwBlob_native_putInt8 },
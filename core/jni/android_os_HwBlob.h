@@ -46,6 +46,10 @@ struct JHwBlob : public RefBase {
 
     void setTo(const void *ptr, size_t handle);
 
+    // Uses the memory of the direct ByteBuffer bufferObj as this blob's buffer, so that data
+    // the caller puts in the buffer goes into the parcel without being copied into the blob.
+    status_t setToDirectBuffer(JNIEnv *env, jobject bufferObj);
+
     status_t getHandle(size_t *handle) const;
 
     status_t read(size_t offset, void *data, size_t size) const;
@@ -82,11 +86,15 @@ private:
 
     void *mBuffer;
     size_t mSize;
+    size_t mCapacity;
     BlobType mType;
     bool mOwnsBuffer;
 
     size_t mHandle;
 
+    // Global reference to the direct ByteBuffer that owns mBuffer, if any.
+    jobject mBufferObj;
+
     Vector<BlobInfo> mSubBlobs;
 
     status_t writeSubBlobsToParcel(hardware::Parcel *parcel, size_t parentHandle) const;
@@ -493,6 +493,51 @@ DEFINE_PARCEL_VECTOR_WRITER(Int64,jlong)
 DEFINE_PARCEL_VECTOR_WRITER(Float,jfloat)
 DEFINE_PARCEL_VECTOR_WRITER(Double,jdouble)
 
+// Writes the first size bytes of a direct ByteBuffer as a vec<int8_t>. The parcel refers to
+// the buffer's memory rather than to a copy of it, so the buffer must not change until the
+// parcel has been sent.
+static void JHwParcel_native_writeInt8VectorFromBuffer(
+        JNIEnv *env, jobject thiz, jobject bufferObj, jint size) {
+    if (bufferObj == NULL) {
+        jniThrowException(env, "java/lang/NullPointerException", NULL);
+        return;
+    }
+
+    if (size < 0) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", NULL);
+        return;
+    }
+
+    sp<JHwParcel> impl = JHwParcel::GetNativeContext(env, thiz);
+
+    const hidl_vec<jbyte> *vec =
+        impl->getStorage()->allocTemporaryDirectBufferVector(env, bufferObj, size);
+
+    if (vec == nullptr) {
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                          "Buffer is not a direct buffer of the given size");
+        return;
+    }
+
+    hardware::Parcel *parcel = impl->getParcel();
+
+    size_t parentHandle;
+    status_t err = parcel->writeBuffer(vec, sizeof(*vec), &parentHandle);
+
+    if (err == OK) {
+        size_t childHandle;
+
+        err = ::android::hardware::writeEmbeddedToParcel(
+                *vec,
+                parcel,
+                parentHandle,
+                0 /* parentOffset */,
+                &childHandle);
+    }
+
+    signalExceptionForError(env, err);
+}
+
 static void JHwParcel_native_writeBoolVector(
         JNIEnv *env, jobject thiz, jbooleanArray valObj) {
     if (valObj == NULL) {
@@ -793,6 +838,39 @@ DEFINE_PARCEL_VECTOR_READER(Int64,jlong,Long)
 DEFINE_PARCEL_VECTOR_READER(Float,jfloat,Float)
 DEFINE_PARCEL_VECTOR_READER(Double,jdouble,Double)
 
+// Reads a vec<int8_t> as a direct ByteBuffer over the parcel's memory rather than a copy in a
+// new byte[]. The buffer is only valid until the parcel is released.
+static jobject JHwParcel_native_readInt8VectorAsBuffer(JNIEnv *env, jobject thiz) {
+    hardware::Parcel *parcel =
+        JHwParcel::GetNativeContext(env, thiz)->getParcel();
+    size_t parentHandle;
+
+    const hidl_vec<jbyte> *vec;
+    status_t err = parcel->readBuffer(sizeof(*vec), &parentHandle,
+            reinterpret_cast<const void**>(&vec));
+
+    if (err != OK) {
+        signalExceptionForError(env, err);
+        return NULL;
+    }
+
+    size_t childHandle;
+
+    err = ::android::hardware::readEmbeddedFromParcel(
+                const_cast<hidl_vec<jbyte> &>(*vec),
+                *parcel,
+                parentHandle,
+                0 /* parentOffset */,
+                &childHandle);
+
+    if (err != OK) {
+        signalExceptionForError(env, err);
+        return NULL;
+    }
+
+    return env->NewDirectByteBuffer(const_cast<jbyte *>(vec->data()), vec->size());
+}
+
 static jbooleanArray JHwParcel_native_readBoolVector(JNIEnv *env, jobject thiz) {
     hardware::Parcel *parcel = JHwParcel::GetNativeContext(env, thiz)->getParcel();
 
@@ -1097,6 +1175,9 @@ static JNINativeMethod gMethods[] = {
     { "writeDoubleVector", "([D)V",
         (void *)JHwParcel_native_writeDoubleVector },
 
+    { "writeInt8VectorFromBuffer", "(Ljava/nio/ByteBuffer;I)V",
+        (void *)JHwParcel_native_writeInt8VectorFromBuffer },
+
     { "writeStringVector", "([Ljava/lang/String;)V",
         (void *)JHwParcel_native_writeStringVector },
 
@@ -1132,6 +1213,9 @@ static JNINativeMethod gMethods[] = {
     { "readInt8VectorAsArray", "()[B",
         (void *)JHwParcel_native_readInt8Vector },
 
+    { "readInt8VectorAsBuffer", "()Ljava/nio/ByteBuffer;",
+        (void *)JHwParcel_native_readInt8VectorAsBuffer },
+
     { "readInt16VectorAsArray", "()[S",
         (void *)JHwParcel_native_readInt16Vector },
 
@@ -21,8 +21,12 @@
 
 #include <utils/Looper.h>
 #include <utils/Log.h>
+#include <utils/Timers.h>
 #include "android_os_MessageQueue.h"
 
+#include <atomic>
+#include <vector>
+
 #include "core_jni_helpers.h"
 
 namespace android {
@@ -30,6 +34,7 @@ namespace android {
 static struct {
     jfieldID mPtr;   // native object attached to the DVM MessageQueue
     jmethodID dispatchEvents;
+    jmethodID dispatchEventsBatch;
 } gMessageQueueClassInfo;
 
 // Must be kept in sync with the constants in Looper.FileDescriptorCallback
@@ -37,6 +42,17 @@ static const int CALLBACK_EVENT_INPUT = 1 << 0;
 static const int CALLBACK_EVENT_OUTPUT = 1 << 1;
 static const int CALLBACK_EVENT_ERROR = 1 << 2;
 
+// Indices of the counters returned by nativeGetStats; must be kept in sync with MessageQueue.
+enum {
+    LOOPER_STATS_POLLS = 0,
+    LOOPER_STATS_WAKEUPS,
+    LOOPER_STATS_FD_EVENTS,
+    LOOPER_STATS_FD_UPCALLS,
+    LOOPER_STATS_BLOCKED_NANOS,
+    LOOPER_STATS_FD_DISPATCH_NANOS,
+    LOOPER_STATS_BUSY_NANOS,
+    LOOPER_STATS_COUNT
+};
 
 class NativeMessageQueue : public MessageQueue, public LooperCallback {
 public:
@@ -51,10 +67,35 @@ public:
 
     virtual int handleEvent(int fd, int events, void* data);
 
+    void getStats(int64_t* outStats) const;
+
 private:
+    struct PendingFdEvent {
+        int fd;
+        int events;
+        int watchedEvents;
+    };
+
     JNIEnv* mPollEnv;
     jobject mPollObj;
     jthrowable mExceptionObj;
+
+    // File descriptor events of the current poll, delivered to Java once the poll returns.
+    std::vector<PendingFdEvent> mPendingFdEvents;
+    std::vector<jint> mFdEventsBuffer;
+    jintArray mFdEventsArray;
+    jsize mFdEventsArrayLength;
+
+    // Written by the looper thread only, but may be read from any thread.
+    std::atomic<int64_t> mStats[LOOPER_STATS_COUNT];
+    nsecs_t mLastPollReturnTime;
+
+    void dispatchPendingFdEvents(JNIEnv* env);
+    void updateWatchedEvents(int fd, int oldWatchedEvents, int newWatchedEvents);
+    void addStat(int index, int64_t delta) {
+        mStats[index].store(mStats[index].load(std::memory_order_relaxed) + delta,
+                std::memory_order_relaxed);
+    }
 };
 
 
@@ -76,7 +117,11 @@ bool MessageQueue::raiseAndClearException(JNIEnv* env, const char* msg) {
 }
 
 NativeMessageQueue::NativeMessageQueue() :
-        mPollEnv(NULL), mPollObj(NULL), mExceptionObj(NULL) {
+        mPollEnv(NULL), mPollObj(NULL), mExceptionObj(NULL),
+        mFdEventsArray(NULL), mFdEventsArrayLength(0), mLastPollReturnTime(0) {
+    for (int i = 0; i < LOOPER_STATS_COUNT; i++) {
+        mStats[i].store(0, std::memory_order_relaxed);
+    }
     mLooper = Looper::getForThread();
     if (mLooper == NULL) {
         mLooper = new Looper(false);
@@ -85,6 +130,12 @@ NativeMessageQueue::NativeMessageQueue() :
 }
 
 NativeMessageQueue::~NativeMessageQueue() {
+    if (mFdEventsArray) {
+        JNIEnv* env = AndroidRuntime::getJNIEnv();
+        if (env) {
+            env->DeleteGlobalRef(mFdEventsArray);
+        }
+    }
 }
 
 void NativeMessageQueue::raiseException(JNIEnv* env, const char* msg, jthrowable exceptionObj) {
@@ -105,9 +156,31 @@ void NativeMessageQueue::raiseException(JNIEnv* env, const char* msg, jthrowable
 }
 
 void NativeMessageQueue::pollOnce(JNIEnv* env, jobject pollObj, int timeoutMillis) {
+    nsecs_t pollStartTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (mLastPollReturnTime) {
+        addStat(LOOPER_STATS_BUSY_NANOS, pollStartTime - mLastPollReturnTime);
+    }
+
     mPollEnv = env;
     mPollObj = pollObj;
-    mLooper->pollOnce(timeoutMillis);
+    int result = mLooper->pollOnce(timeoutMillis);
+
+    // Blocked time includes native callbacks and messages run by the looper itself; only the
+    // Java fd listeners, dispatched below, are accounted separately.
+    nsecs_t pollEndTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    addStat(LOOPER_STATS_POLLS, 1);
+    if (result != Looper::POLL_TIMEOUT) {
+        addStat(LOOPER_STATS_WAKEUPS, 1);
+    }
+    addStat(LOOPER_STATS_BLOCKED_NANOS, pollEndTime - pollStartTime);
+
+    if (!mPendingFdEvents.empty()) {
+        dispatchPendingFdEvents(env);
+        mLastPollReturnTime = systemTime(SYSTEM_TIME_MONOTONIC);
+        addStat(LOOPER_STATS_FD_DISPATCH_NANOS, mLastPollReturnTime - pollEndTime);
+    } else {
+        mLastPollReturnTime = pollEndTime;
+    }
     mPollObj = NULL;
     mPollEnv = NULL;
 
@@ -138,6 +211,78 @@ void NativeMessageQueue::setFileDescriptorEvents(int fd, int events) {
     }
 }
 
+void NativeMessageQueue::updateWatchedEvents(int fd, int oldWatchedEvents,
+        int newWatchedEvents) {
+    if (!newWatchedEvents) {
+        mLooper->removeFd(fd);
+    } else if (newWatchedEvents != oldWatchedEvents) {
+        setFileDescriptorEvents(fd, newWatchedEvents);
+    }
+}
+
+void NativeMessageQueue::dispatchPendingFdEvents(JNIEnv* env) {
+    const jsize count = mPendingFdEvents.size();
+    addStat(LOOPER_STATS_FD_EVENTS, count);
+    addStat(LOOPER_STATS_FD_UPCALLS, 1);
+
+    if (count == 1) {
+        const PendingFdEvent event = mPendingFdEvents[0];
+        mPendingFdEvents.clear();
+        int newWatchedEvents = env->CallIntMethod(mPollObj,
+                gMessageQueueClassInfo.dispatchEvents, event.fd, event.events);
+        updateWatchedEvents(event.fd, event.watchedEvents, newWatchedEvents);
+        return;
+    }
+
+    // Pass all events of the poll as (fd, events) pairs in one upcall. Java replaces the
+    // events of each pair with the events it wants to keep watching for, as returned by
+    // dispatchEvents.
+    if (mFdEventsArrayLength < count * 2) {
+        if (mFdEventsArray) {
+            env->DeleteGlobalRef(mFdEventsArray);
+            mFdEventsArray = NULL;
+            mFdEventsArrayLength = 0;
+        }
+        jsize length = count * 2 < 16 ? 16 : count * 2;
+        jintArray array = env->NewIntArray(length);
+        if (!array) {
+            mPendingFdEvents.clear();
+            return;
+        }
+        mFdEventsArray = jintArray(env->NewGlobalRef(array));
+        mFdEventsArrayLength = length;
+        env->DeleteLocalRef(array);
+    }
+
+    mFdEventsBuffer.resize(count * 2);
+    for (jsize i = 0; i < count; i++) {
+        mFdEventsBuffer[i * 2] = mPendingFdEvents[i].fd;
+        mFdEventsBuffer[i * 2 + 1] = mPendingFdEvents[i].events;
+    }
+    env->SetIntArrayRegion(mFdEventsArray, 0, count * 2, mFdEventsBuffer.data());
+
+    env->CallVoidMethod(mPollObj, gMessageQueueClassInfo.dispatchEventsBatch,
+            mFdEventsArray, count);
+    if (env->ExceptionCheck()) {
+        // Leave the exception pending for the caller of nativePollOnce.
+        mPendingFdEvents.clear();
+        return;
+    }
+
+    env->GetIntArrayRegion(mFdEventsArray, 0, count * 2, mFdEventsBuffer.data());
+    for (jsize i = 0; i < count; i++) {
+        const PendingFdEvent& event = mPendingFdEvents[i];
+        updateWatchedEvents(event.fd, event.watchedEvents, mFdEventsBuffer[i * 2 + 1]);
+    }
+    mPendingFdEvents.clear();
+}
+
+void NativeMessageQueue::getStats(int64_t* outStats) const {
+    for (int i = 0; i < LOOPER_STATS_COUNT; i++) {
+        outStats[i] = mStats[i].load(std::memory_order_relaxed);
+    }
+}
+
 int NativeMessageQueue::handleEvent(int fd, int looperEvents, void* data) {
     int events = 0;
     if (looperEvents & Looper::EVENT_INPUT) {
@@ -149,15 +294,9 @@ int NativeMessageQueue::handleEvent(int fd, int looperEvents, void* data) {
     if (looperEvents & (Looper::EVENT_ERROR | Looper::EVENT_HANGUP | Looper::EVENT_INVALID)) {
         events |= CALLBACK_EVENT_ERROR;
     }
-    int oldWatchedEvents = reinterpret_cast<intptr_t>(data);
-    int newWatchedEvents = mPollEnv->CallIntMethod(mPollObj,
-            gMessageQueueClassInfo.dispatchEvents, fd, events);
-    if (!newWatchedEvents) {
-        return 0; // unregister the fd
-    }
-    if (newWatchedEvents != oldWatchedEvents) {
-        setFileDescriptorEvents(fd, newWatchedEvents);
-    }
+    // Defer the upcall so that all fds that became ready in this poll are dispatched together
+    // once pollOnce() returns. The fd stays registered until Java says otherwise.
+    mPendingFdEvents.push_back({fd, events, static_cast<int>(reinterpret_cast<intptr_t>(data))});
     return 1;
 }
 
@@ -207,6 +346,20 @@ static void android_os_MessageQueue_nativeSetFileDescriptorEvents(JNIEnv* env, j
     nativeMessageQueue->setFileDescriptorEvents(fd, events);
 }
 
+static void android_os_MessageQueue_nativeGetStats(JNIEnv* env, jclass clazz,
+        jlong ptr, jlongArray outStats) {
+    if (outStats == NULL || env->GetArrayLength(outStats) < LOOPER_STATS_COUNT) {
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                "outStats must hold LOOPER_STATS_COUNT values");
+        return;
+    }
+    NativeMessageQueue* nativeMessageQueue = reinterpret_cast<NativeMessageQueue*>(ptr);
+    int64_t stats[LOOPER_STATS_COUNT];
+    nativeMessageQueue->getStats(stats);
+    env->SetLongArrayRegion(outStats, 0, LOOPER_STATS_COUNT,
+            reinterpret_cast<const jlong*>(stats));
+}
+
 // ----------------------------------------------------------------------------
 
 static const JNINativeMethod gMessageQueueMethods[] = {
@@ -218,6 +371,7 @@ static const JNINativeMethod gMessageQueueMethods[] = {
     { "nativeIsPolling", "(J)Z", (void*)android_os_MessageQueue_nativeIsPolling },
     { "nativeSetFileDescriptorEvents", "(JII)V",
             (void*)android_os_MessageQueue_nativeSetFileDescriptorEvents },
+    { "nativeGetStats", "(J[J)V", (void*)android_os_MessageQueue_nativeGetStats },
 };
 
 int register_android_os_MessageQueue(JNIEnv* env) {
@@ -228,6 +382,8 @@ int register_android_os_MessageQueue(JNIEnv* env) {
     gMessageQueueClassInfo.mPtr = GetFieldIDOrDie(env, clazz, "mPtr", "J");
     gMessageQueueClassInfo.dispatchEvents = GetMethodIDOrDie(env, clazz,
             "dispatchEvents", "(II)I");
+    gMessageQueueClassInfo.dispatchEventsBatch = GetMethodIDOrDie(env, clazz,
+            "dispatchEventsBatch", "([II)V");
 
     return res;
 }
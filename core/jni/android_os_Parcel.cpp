@@ -68,6 +68,8 @@ static struct parcel_offsets_t
     jmethodID recycle;
 } gParcelOffsets;
 
+static jclass gStringClass;
+
 Parcel* parcelForJavaObject(JNIEnv* env, jobject obj)
 {
     if (obj) {
@@ -273,25 +275,97 @@ static void android_os_Parcel_writeDouble(JNIEnv* env, jclass clazz, jlong nativ
     }
 }
 
+static status_t writeJavaString(JNIEnv* env, Parcel* parcel, jstring val)
+{
+    if (val == NULL) {
+        return parcel->writeString16(NULL, 0);
+    }
+    status_t err = NO_MEMORY;
+    const jchar* str = env->GetStringCritical(val, 0);
+    if (str) {
+        err = parcel->writeString16(reinterpret_cast<const char16_t*>(str),
+                env->GetStringLength(val));
+        env->ReleaseStringCritical(val, str);
+    }
+    return err;
+}
+
 static void android_os_Parcel_writeString(JNIEnv* env, jclass clazz, jlong nativePtr, jstring val)
 {
     Parcel* parcel = reinterpret_cast<Parcel*>(nativePtr);
     if (parcel != NULL) {
-        status_t err = NO_MEMORY;
-        if (val) {
-            const jchar* str = env->GetStringCritical(val, 0);
-            if (str) {
-                err = parcel->writeString16(
-                    reinterpret_cast<const char16_t*>(str),
-                    env->GetStringLength(val));
-                env->ReleaseStringCritical(val, str);
-            }
-        } else {
-            err = parcel->writeString16(NULL, 0);
+        const status_t err = writeJavaString(env, parcel, val);
+        if (err != NO_ERROR) {
+            signalExceptionForError(env, clazz, err);
         }
+    }
+}
+
+// Writes a whole int[] or long[] in the same layout as Parcel.writeIntArray() and
+// Parcel.writeLongArray(): the length (or -1 for null) followed by the elements.
+template <typename T>
+static void writePrimitiveArray(JNIEnv* env, jclass clazz, jlong nativePtr, jarray data)
+{
+    Parcel* parcel = reinterpret_cast<Parcel*>(nativePtr);
+    if (parcel == NULL) {
+        return;
+    }
+
+    const jsize length = data != NULL ? env->GetArrayLength(data) : -1;
+    status_t err = parcel->writeInt32(length);
+    if (err != NO_ERROR || length <= 0) {
         if (err != NO_ERROR) {
             signalExceptionForError(env, clazz, err);
         }
+        return;
+    }
+    if (static_cast<size_t>(length) > INT32_MAX / sizeof(T)) {
+        signalExceptionForError(env, clazz, BAD_VALUE);
+        return;
+    }
+
+    const size_t size = length * sizeof(T);
+    void* dest = parcel->writeInplace(size);
+    if (dest == NULL) {
+        signalExceptionForError(env, clazz, NO_MEMORY);
+        return;
+    }
+
+    void* ar = env->GetPrimitiveArrayCritical(data, 0);
+    if (ar) {
+        memcpy(dest, ar, size);
+        env->ReleasePrimitiveArrayCritical(data, ar, JNI_ABORT);
+    }
+}
+
+static void android_os_Parcel_writeIntArray(JNIEnv* env, jclass clazz, jlong nativePtr,
+                                            jintArray data)
+{
+    writePrimitiveArray<int32_t>(env, clazz, nativePtr, data);
+}
+
+static void android_os_Parcel_writeLongArray(JNIEnv* env, jclass clazz, jlong nativePtr,
+                                             jlongArray data)
+{
+    writePrimitiveArray<int64_t>(env, clazz, nativePtr, data);
+}
+
+static void android_os_Parcel_writeStringArray(JNIEnv* env, jclass clazz, jlong nativePtr,
+                                               jobjectArray data)
+{
+    Parcel* parcel = reinterpret_cast<Parcel*>(nativePtr);
+    if (parcel == NULL) {
+        return;
+    }
+
+    const jsize length = data != NULL ? env->GetArrayLength(data) : -1;
+    status_t err = parcel->writeInt32(length);
+    for (jsize i = 0; i < length && err == NO_ERROR; i++) {
+        ScopedLocalRef<jstring> str(env, (jstring) env->GetObjectArrayElement(data, i));
+        err = writeJavaString(env, parcel, str.get());
+    }
+    if (err != NO_ERROR) {
+        signalExceptionForError(env, clazz, err);
     }
 }
 
@@ -408,6 +482,81 @@ static jbyteArray android_os_Parcel_readBlob(JNIEnv* env, jclass clazz, jlong na
     return ret;
 }
 
+// Reads an array written by writePrimitiveArray(); returns NULL for a null or malformed array.
+template <typename T, typename JArray, JArray (JNIEnv::*NewArray)(jsize)>
+static JArray createPrimitiveArray(JNIEnv* env, jlong nativePtr)
+{
+    Parcel* parcel = reinterpret_cast<Parcel*>(nativePtr);
+    if (parcel == NULL) {
+        return NULL;
+    }
+
+    const int32_t len = parcel->readInt32();
+
+    // sanity check the stored length against the true data size
+    if (len < 0 || static_cast<size_t>(len) > parcel->dataAvail() / sizeof(T)) {
+        return NULL;
+    }
+
+    JArray ret = (env->*NewArray)(len);
+    if (ret == NULL || len == 0) {
+        return ret;
+    }
+
+    const void* data = parcel->readInplace(len * sizeof(T));
+    if (data == NULL) {
+        return NULL;
+    }
+    void* ar = env->GetPrimitiveArrayCritical(ret, 0);
+    if (ar) {
+        memcpy(ar, data, len * sizeof(T));
+        env->ReleasePrimitiveArrayCritical(ret, ar, 0);
+    }
+    return ret;
+}
+
+static jintArray android_os_Parcel_createIntArray(JNIEnv* env, jclass clazz, jlong nativePtr)
+{
+    return createPrimitiveArray<int32_t, jintArray, &JNIEnv::NewIntArray>(env, nativePtr);
+}
+
+static jlongArray android_os_Parcel_createLongArray(JNIEnv* env, jclass clazz, jlong nativePtr)
+{
+    return createPrimitiveArray<int64_t, jlongArray, &JNIEnv::NewLongArray>(env, nativePtr);
+}
+
+static jobjectArray android_os_Parcel_createStringArray(JNIEnv* env, jclass clazz,
+                                                        jlong nativePtr)
+{
+    Parcel* parcel = reinterpret_cast<Parcel*>(nativePtr);
+    if (parcel == NULL) {
+        return NULL;
+    }
+
+    const int32_t len = parcel->readInt32();
+
+    // Every string takes at least its 4-byte length (-1 for null).
+    if (len < 0 || static_cast<size_t>(len) > parcel->dataAvail() / sizeof(int32_t)) {
+        return NULL;
+    }
+
+    jobjectArray ret = env->NewObjectArray(len, gStringClass, NULL);
+    for (int32_t i = 0; ret != NULL && i < len; i++) {
+        size_t strLen;
+        const char16_t* str = parcel->readString16Inplace(&strLen);
+        if (str == NULL) {
+            continue;
+        }
+        ScopedLocalRef<jstring> jstr(env,
+                env->NewString(reinterpret_cast<const jchar*>(str), strLen));
+        if (jstr.get() == NULL) {
+            return NULL;
+        }
+        env->SetObjectArrayElement(ret, i, jstr.get());
+    }
+    return ret;
+}
+
 static jint android_os_Parcel_readInt(jlong nativePtr)
 {
     Parcel* parcel = reinterpret_cast<Parcel*>(nativePtr);
@@ -467,6 +616,32 @@ static jobject android_os_Parcel_readStrongBinder(JNIEnv* env, jclass clazz, jlo
     return NULL;
 }
 
+// Reads binders.length binders in one JNI call. Binders that already have a BinderProxy are
+// resolved natively; only new ones call up into Java.
+static void android_os_Parcel_readStrongBinderArray(JNIEnv* env, jclass clazz, jlong nativePtr,
+        jobjectArray binders)
+{
+    Parcel* parcel = reinterpret_cast<Parcel*>(nativePtr);
+    if (parcel == NULL) {
+        return;
+    }
+    const jsize count = env->GetArrayLength(binders);
+    for (jsize i = 0; i < count; i++) {
+        // javaObjectForIBinder() may hand back a global ref, so release through a frame.
+        if (env->PushLocalFrame(4) != JNI_OK) {
+            return;
+        }
+        jobject binder = javaObjectForIBinder(env, parcel->readStrongBinder());
+        if (!env->ExceptionCheck()) {
+            env->SetObjectArrayElement(binders, i, binder);
+        }
+        env->PopLocalFrame(NULL);
+        if (env->ExceptionCheck()) {
+            return;
+        }
+    }
+}
+
 static jobject android_os_Parcel_readFileDescriptor(JNIEnv* env, jclass clazz, jlong nativePtr)
 {
     Parcel* parcel = reinterpret_cast<Parcel*>(nativePtr);
@@ -726,12 +901,18 @@ static const JNINativeMethod gParcelMethods[] = {
     // @FastNative
     {"nativeWriteDouble",         "(JD)V", (void*)android_os_Parcel_writeDouble},
     {"nativeWriteString",         "(JLjava/lang/String;)V", (void*)android_os_Parcel_writeString},
+    {"nativeWriteIntArray",       "(J[I)V", (void*)android_os_Parcel_writeIntArray},
+    {"nativeWriteLongArray",      "(J[J)V", (void*)android_os_Parcel_writeLongArray},
+    {"nativeWriteStringArray",    "(J[Ljava/lang/String;)V", (void*)android_os_Parcel_writeStringArray},
     {"nativeWriteStrongBinder",   "(JLandroid/os/IBinder;)V", (void*)android_os_Parcel_writeStrongBinder},
     {"nativeWriteFileDescriptor", "(JLjava/io/FileDescriptor;)J", (void*)android_os_Parcel_writeFileDescriptor},
 
     {"nativeCreateByteArray",     "(J)[B", (void*)android_os_Parcel_createByteArray},
     {"nativeReadByteArray",       "(J[BI)Z", (void*)android_os_Parcel_readByteArray},
     {"nativeReadBlob",            "(J)[B", (void*)android_os_Parcel_readBlob},
+    {"nativeCreateIntArray",      "(J)[I", (void*)android_os_Parcel_createIntArray},
+    {"nativeCreateLongArray",     "(J)[J", (void*)android_os_Parcel_createLongArray},
+    {"nativeCreateStringArray",   "(J)[Ljava/lang/String;", (void*)android_os_Parcel_createStringArray},
     // @CriticalNative
     {"nativeReadInt",             "(J)I", (void*)android_os_Parcel_readInt},
     // @CriticalNative
@@ -742,6 +923,7 @@ static const JNINativeMethod gParcelMethods[] = {
     {"nativeReadDouble",          "(J)D", (void*)android_os_Parcel_readDouble},
     {"nativeReadString",          "(J)Ljava/lang/String;", (void*)android_os_Parcel_readString},
     {"nativeReadStrongBinder",    "(J)Landroid/os/IBinder;", (void*)android_os_Parcel_readStrongBinder},
+    {"nativeReadStrongBinderArray", "(J[Landroid/os/IBinder;)V", (void*)android_os_Parcel_readStrongBinderArray},
     {"nativeReadFileDescriptor",  "(J)Ljava/io/FileDescriptor;", (void*)android_os_Parcel_readFileDescriptor},
 
     {"nativeCreate",              "()J", (void*)android_os_Parcel_create},
@@ -780,6 +962,8 @@ int register_android_os_Parcel(JNIEnv* env)
     gParcelOffsets.obtain = GetStaticMethodIDOrDie(env, clazz, "obtain", "()Landroid/os/Parcel;");
     gParcelOffsets.recycle = GetMethodIDOrDie(env, clazz, "recycle", "()V");
 
+    gStringClass = MakeGlobalRefOrDie(env, FindClassOrDie(env, "java/lang/String"));
+
     return RegisterMethodsOrDie(env, kParcelPathName, gParcelMethods, NELEM(gParcelMethods));
 }
 
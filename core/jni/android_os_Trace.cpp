@@ -19,11 +19,47 @@
 #include <cutils/trace.h>
 #include <log/log.h>
 #include <nativehelper/JNIHelp.h>
+#include <nativehelper/ScopedLocalRef.h>
+#include <nativehelper/ScopedPrimitiveArray.h>
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <unistd.h>
 
 #include <array>
+#include <atomic>
+#include <string>
 
 namespace android {
 
+/*
+ * Tracing state shared with Java through the direct ByteBuffer returned by
+ * nativeGetTraceState(), so that Trace.isTagEnabled() can read it without a JNI call.
+ * generation is bumped each time enabledTags changes, so Java can also cache per-call-site
+ * decisions and revalidate them with one int read. Both are in native byte order at offsets
+ * 0 and 8, which must match android.os.Trace.
+ */
+struct TraceState {
+    std::atomic<int64_t> enabledTags;
+    std::atomic<int32_t> generation;
+    int32_t reserved;
+};
+static_assert(sizeof(std::atomic<int64_t>) == sizeof(int64_t)
+        && sizeof(std::atomic<int32_t>) == sizeof(int32_t),
+        "TraceState must be plain memory for Java");
+
+static TraceState gTraceState;
+
+static uint64_t publishEnabledTags() {
+    uint64_t tags = atrace_get_enabled_tags();
+    int64_t previous = gTraceState.enabledTags.exchange(static_cast<int64_t>(tags),
+            std::memory_order_release);
+    if (previous != static_cast<int64_t>(tags)) {
+        gTraceState.generation.fetch_add(1, std::memory_order_release);
+    }
+    return tags;
+}
+
 inline static void sanitizeString(char* str) {
     while (*str) {
         char c = *str;
@@ -52,6 +88,9 @@ inline static void withString(JNIEnv* env, jstring jstr, F callback) {
 
 static void android_os_Trace_nativeTraceCounter(JNIEnv* env, jclass,
         jlong tag, jstring nameStr, jlong value) {
+    if (!atrace_is_tag_enabled(tag)) {
+        return;
+    }
     withString(env, nameStr, [tag, value](char* str) {
         atrace_int64(tag, str, value);
     });
@@ -59,6 +98,9 @@ static void android_os_Trace_nativeTraceCounter(JNIEnv* env, jclass,
 
 static void android_os_Trace_nativeTraceBegin(JNIEnv* env, jclass,
         jlong tag, jstring nameStr) {
+    if (!atrace_is_tag_enabled(tag)) {
+        return;
+    }
     withString(env, nameStr, [tag](char* str) {
         atrace_begin(tag, str);
     });
@@ -70,6 +112,9 @@ static void android_os_Trace_nativeTraceEnd(JNIEnv*, jclass, jlong tag) {
 
 static void android_os_Trace_nativeAsyncTraceBegin(JNIEnv* env, jclass,
         jlong tag, jstring nameStr, jint cookie) {
+    if (!atrace_is_tag_enabled(tag)) {
+        return;
+    }
     withString(env, nameStr, [tag, cookie](char* str) {
         atrace_async_begin(tag, str, cookie);
     });
@@ -77,17 +122,73 @@ static void android_os_Trace_nativeAsyncTraceBegin(JNIEnv* env, jclass,
 
 static void android_os_Trace_nativeAsyncTraceEnd(JNIEnv* env, jclass,
         jlong tag, jstring nameStr, jint cookie) {
+    if (!atrace_is_tag_enabled(tag)) {
+        return;
+    }
     withString(env, nameStr, [tag, cookie](char* str) {
         atrace_async_end(tag, str, cookie);
     });
 }
 
+// Emits names.length counters with a single write to the trace marker. Each counter is a
+// newline-terminated "C|pid|name|value" record, the format atrace_int64() writes on its own.
+static void android_os_Trace_nativeTraceCounters(JNIEnv* env, jclass,
+        jlong tag, jobjectArray namesArray, jlongArray valuesArray) {
+    if (!atrace_is_tag_enabled(tag)) {
+        return;
+    }
+    ScopedLongArrayRO values(env, valuesArray);
+    if (values.get() == nullptr) {
+        return;
+    }
+    jsize count = env->GetArrayLength(namesArray);
+    if (count != static_cast<jsize>(values.size())) {
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                "names and values must have the same length");
+        return;
+    }
+
+    std::string records;
+    char prefix[32];
+    int prefixLength = snprintf(prefix, sizeof(prefix), "C|%d|", getpid());
+    for (jsize i = 0; i < count; i++) {
+        ScopedLocalRef<jstring> nameStr(env,
+                static_cast<jstring>(env->GetObjectArrayElement(namesArray, i)));
+        if (nameStr.get() == nullptr) {
+            continue;
+        }
+        withString(env, nameStr.get(), [&](char* str) {
+            char value[32];
+            int valueLength = snprintf(value, sizeof(value), "|%" PRId64 "\n",
+                    static_cast<int64_t>(values[i]));
+            records.append(prefix, prefixLength);
+            records.append(str);
+            records.append(value, valueLength);
+        });
+    }
+    if (!records.empty() && atrace_marker_fd >= 0) {
+        TEMP_FAILURE_RETRY(write(atrace_marker_fd, records.data(), records.size()));
+    }
+}
+
+// Returns the TraceState, refreshed, as a direct ByteBuffer.
+static jobject android_os_Trace_nativeGetTraceState(JNIEnv* env, jclass) {
+    publishEnabledTags();
+    return env->NewDirectByteBuffer(&gTraceState, sizeof(gTraceState));
+}
+
+// Also refreshes the TraceState; Trace calls this whenever the trace tag property changes.
+static jlong android_os_Trace_nativeGetEnabledTags() {
+    return static_cast<jlong>(publishEnabledTags());
+}
+
 static void android_os_Trace_nativeSetAppTracingAllowed(JNIEnv*, jclass, jboolean allowed) {
     atrace_set_debuggable(allowed);
 }
 
 static void android_os_Trace_nativeSetTracingEnabled(JNIEnv*, jclass, jboolean enabled) {
     atrace_set_tracing_enabled(enabled);
+    publishEnabledTags();
 }
 
 static const JNINativeMethod gTraceMethods[] = {
@@ -98,6 +199,12 @@ static const JNINativeMethod gTraceMethods[] = {
     { "nativeSetTracingEnabled",
             "(Z)V",
             (void*)android_os_Trace_nativeSetTracingEnabled },
+    { "nativeTraceCounters",
+            "(J[Ljava/lang/String;[J)V",
+            (void*)android_os_Trace_nativeTraceCounters },
+    { "nativeGetTraceState",
+            "()Ljava/nio/ByteBuffer;",
+            (void*)android_os_Trace_nativeGetTraceState },
 
     // ----------- @FastNative  ----------------
 
@@ -120,7 +227,7 @@ static const JNINativeMethod gTraceMethods[] = {
     // ----------- @CriticalNative  ----------------
     { "nativeGetEnabledTags",
             "()J",
-            (void*)atrace_get_enabled_tags },
+            (void*)android_os_Trace_nativeGetEnabledTags },
 };
 
 int register_android_os_Trace(JNIEnv* env) {
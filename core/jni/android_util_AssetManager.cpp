@@ -28,6 +28,7 @@
 
 #include <private/android_filesystem_config.h> // for AID_SYSTEM
 
+#include <algorithm>
 #include <sstream>
 #include <string>
 
@@ -264,7 +265,8 @@ static jobjectArray NativeCreateIdmapsForStaticOverlaysTargetingAndroid(JNIEnv*
     "--recursive",
     "--target-package-name", "android",
     "--target-apk-path", "/system/framework/framework-res.apk",
-    "--output-directory", "/data/resource-cache"};
+    "--output-directory", "/data/resource-cache",
+    "--fingerprint-cache", "/data/resource-cache/idmap2-scan.fingerprints"};
 
   for (const auto& dir : input_dirs) {
     argv.push_back("--input-directory");
@@ -533,6 +535,12 @@ static void NativeSetConfiguration(JNIEnv* env, jclass /*clazz*/, jlong ptr, jin
   assetmanager->SetConfiguration(configuration);
 }
 
+static void NativeSetBagCacheLimit(JNIEnv* /*env*/, jclass /*clazz*/, jlong ptr,
+                                   jlong limit_bytes) {
+  ScopedLock<AssetManager2> assetmanager(AssetManagerFromLong(ptr));
+  assetmanager->SetBagCacheLimit(static_cast<size_t>(std::max<jlong>(limit_bytes, 0)));
+}
+
 static jobject NativeGetAssignedPackageIdentifiers(JNIEnv* env, jclass /*clazz*/, jlong ptr) {
   ScopedLock<AssetManager2> assetmanager(AssetManagerFromLong(ptr));
 
@@ -810,10 +818,15 @@ static jintArray NativeGetStyleAttributes(JNIEnv* env, jclass /*clazz*/, jlong p
     return nullptr;
   }
 
+  jint* buffer = reinterpret_cast<jint*>(env->GetPrimitiveArrayCritical(array, nullptr));
+  if (buffer == nullptr) {
+    return nullptr;
+  }
+
   for (uint32_t i = 0; i < bag->entry_count; i++) {
-    jint attr_resid = bag->entries[i].key;
-    env->SetIntArrayRegion(array, i, 1, &attr_resid);
+    buffer[i] = static_cast<jint>(bag->entries[i].key);
   }
+  env->ReleasePrimitiveArrayCritical(array, buffer, 0);
   return array;
 }
 
@@ -954,6 +967,41 @@ static jintArray NativeGetResourceIntArray(JNIEnv* env, jclass /*clazz*/, jlong
   return array;
 }
 
+// Resolves every entry of the bag into STYLE_NUM_ENTRIES ints at out_data, as
+// TypedArray expects them. Returns false if a reference can't be resolved.
+static bool ResolveBagEntries(AssetManager2* assetmanager, const ResolvedBag* bag,
+                              jint* out_data) {
+  jint* cursor = out_data;
+  for (size_t i = 0; i < bag->entry_count; i++) {
+    const ResolvedBag::Entry& entry = bag->entries[i];
+    Res_value value = entry.value;
+    ResTable_config selected_config;
+    selected_config.density = 0;
+    uint32_t flags = bag->type_spec_flags;
+    uint32_t ref = 0;
+    ApkAssetsCookie cookie =
+        assetmanager->ResolveReference(entry.cookie, &value, &selected_config, &flags, &ref);
+    if (cookie == kInvalidCookie) {
+      return false;
+    }
+
+    // Deal with the special @null value -- it turns back to TYPE_NULL.
+    if (value.dataType == Res_value::TYPE_REFERENCE && value.data == 0) {
+      value.dataType = Res_value::TYPE_NULL;
+      value.data = Res_value::DATA_NULL_UNDEFINED;
+    }
+
+    cursor[STYLE_TYPE] = static_cast<jint>(value.dataType);
+    cursor[STYLE_DATA] = static_cast<jint>(value.data);
+    cursor[STYLE_ASSET_COOKIE] = ApkAssetsCookieToJavaCookie(cookie);
+    cursor[STYLE_RESOURCE_ID] = static_cast<jint>(ref);
+    cursor[STYLE_CHANGING_CONFIGURATIONS] = static_cast<jint>(flags);
+    cursor[STYLE_DENSITY] = static_cast<jint>(selected_config.density);
+    cursor += STYLE_NUM_ENTRIES;
+  }
+  return true;
+}
+
 static jint NativeGetResourceArraySize(JNIEnv* /*env*/, jclass /*clazz*/, jlong ptr, jint resid) {
   ScopedLock<AssetManager2> assetmanager(AssetManagerFromLong(ptr));
   const ResolvedBag* bag = assetmanager->GetBag(static_cast<uint32_t>(resid));
@@ -976,7 +1024,7 @@ static jint NativeGetResourceArray(JNIEnv* env, jclass /*clazz*/, jlong ptr, jin
     return -1;
   }
 
-  if (static_cast<jsize>(bag->entry_count) > out_data_length * STYLE_NUM_ENTRIES) {
+  if (static_cast<jsize>(bag->entry_count * STYLE_NUM_ENTRIES) > out_data_length) {
     jniThrowException(env, "java/lang/IllegalArgumentException", "Input array is not large enough");
     return -1;
   }
@@ -986,37 +1034,62 @@ static jint NativeGetResourceArray(JNIEnv* env, jclass /*clazz*/, jlong ptr, jin
     return -1;
   }
 
-  jint* cursor = buffer;
-  for (size_t i = 0; i < bag->entry_count; i++) {
-    const ResolvedBag::Entry& entry = bag->entries[i];
-    Res_value value = entry.value;
-    ResTable_config selected_config;
-    selected_config.density = 0;
-    uint32_t flags = bag->type_spec_flags;
-    uint32_t ref = 0;
-    ApkAssetsCookie cookie =
-        assetmanager->ResolveReference(entry.cookie, &value, &selected_config, &flags, &ref);
-    if (cookie == kInvalidCookie) {
-      env->ReleasePrimitiveArrayCritical(out_data, buffer, JNI_ABORT);
-      return -1;
-    }
+  if (!ResolveBagEntries(assetmanager.get(), bag, buffer)) {
+    env->ReleasePrimitiveArrayCritical(out_data, buffer, JNI_ABORT);
+    return -1;
+  }
+  env->ReleasePrimitiveArrayCritical(out_data, buffer, 0);
+  return static_cast<jint>(bag->entry_count);
+}
 
-    // Deal with the special @null value -- it turns back to TYPE_NULL.
-    if (value.dataType == Res_value::TYPE_REFERENCE && value.data == 0) {
-      value.dataType = Res_value::TYPE_NULL;
-      value.data = Res_value::DATA_NULL_UNDEFINED;
+// Resolves several arrays at once, such as the drawables and color state lists that the zygote
+// preloads, under a single lock and into a single int[]. For each resource ID, in order, the
+// result holds the number of entries followed by STYLE_NUM_ENTRIES ints for each of them, as
+// nativeGetResourceArray() would write them. The count is -1 for a resource that isn't an array.
+static jintArray NativeGetResourceArrays(JNIEnv* env, jclass /*clazz*/, jlong ptr,
+                                         jintArray resids) {
+  ScopedIntArrayRO ids(env, resids);
+  if (ids.get() == nullptr) {
+    return nullptr;
+  }
+
+  ScopedLock<AssetManager2> assetmanager(AssetManagerFromLong(ptr));
+  // All of the bags are held until the end.
+  AssetManager2::ScopedBagPin bag_pin(assetmanager.get());
+  std::vector<const ResolvedBag*> bags(ids.size());
+  size_t total_length = ids.size();
+  for (size_t i = 0; i < ids.size(); i++) {
+    bags[i] = assetmanager->GetBag(static_cast<uint32_t>(ids[i]));
+    if (bags[i] != nullptr) {
+      total_length += bags[i]->entry_count * STYLE_NUM_ENTRIES;
     }
+  }
 
-    cursor[STYLE_TYPE] = static_cast<jint>(value.dataType);
-    cursor[STYLE_DATA] = static_cast<jint>(value.data);
-    cursor[STYLE_ASSET_COOKIE] = ApkAssetsCookieToJavaCookie(cookie);
-    cursor[STYLE_RESOURCE_ID] = static_cast<jint>(ref);
-    cursor[STYLE_CHANGING_CONFIGURATIONS] = static_cast<jint>(flags);
-    cursor[STYLE_DENSITY] = static_cast<jint>(selected_config.density);
-    cursor += STYLE_NUM_ENTRIES;
+  jintArray array = env->NewIntArray(total_length);
+  if (array == nullptr) {
+    return nullptr;
   }
-  env->ReleasePrimitiveArrayCritical(out_data, buffer, 0);
-  return static_cast<jint>(bag->entry_count);
+
+  jint* buffer = reinterpret_cast<jint*>(env->GetPrimitiveArrayCritical(array, nullptr));
+  if (buffer == nullptr) {
+    return nullptr;
+  }
+
+  jint* cursor = buffer;
+  for (const ResolvedBag* bag : bags) {
+    if (bag == nullptr) {
+      *cursor++ = -1;
+      continue;
+    }
+    *cursor++ = static_cast<jint>(bag->entry_count);
+    if (!ResolveBagEntries(assetmanager.get(), bag, cursor)) {
+      env->ReleasePrimitiveArrayCritical(array, buffer, JNI_ABORT);
+      return nullptr;
+    }
+    cursor += bag->entry_count * STYLE_NUM_ENTRIES;
+  }
+  env->ReleasePrimitiveArrayCritical(array, buffer, 0);
+  return array;
 }
 
 static jint NativeGetResourceIdentifier(JNIEnv* env, jclass /*clazz*/, jlong ptr, jstring name,
@@ -1529,6 +1602,7 @@ static const JNINativeMethod gAssetManagerMethods[] = {
     {"nativeSetApkAssets", "(J[Landroid/content/res/ApkAssets;Z)V", (void*)NativeSetApkAssets},
     {"nativeSetConfiguration", "(JIILjava/lang/String;IIIIIIIIIIIIIII)V",
      (void*)NativeSetConfiguration},
+    {"nativeSetBagCacheLimit", "(JJ)V", (void*)NativeSetBagCacheLimit},
     {"nativeGetAssignedPackageIdentifiers", "(J)Landroid/util/SparseArray;",
      (void*)NativeGetAssignedPackageIdentifiers},
 
@@ -1553,6 +1627,7 @@ static const JNINativeMethod gAssetManagerMethods[] = {
     {"nativeGetResourceIntArray", "(JI)[I", (void*)NativeGetResourceIntArray},
     {"nativeGetResourceArraySize", "(JI)I", (void*)NativeGetResourceArraySize},
     {"nativeGetResourceArray", "(JI[I)I", (void*)NativeGetResourceArray},
+    {"nativeGetResourceArrays", "(J[I)[I", (void*)NativeGetResourceArrays},
 
     // AssetManager resource name/ID methods.
     {"nativeGetResourceIdentifier", "(JLjava/lang/String;Ljava/lang/String;Ljava/lang/String;)I",
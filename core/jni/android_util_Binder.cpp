@@ -28,6 +28,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <unordered_map>
 
 #include <android-base/stringprintf.h>
 #include <binder/BpBinder.h>
@@ -729,6 +730,84 @@ BinderProxyNativeData* getBPNativeData(JNIEnv* env, jobject obj) {
     return (BinderProxyNativeData *) env->GetLongField(obj, gBinderProxyOffsets.mNativeData);
 }
 
+// Maps IBinders to their live BinderProxy, so that unparceling a binder that already has a
+// BinderProxy doesn't need an upcall into BinderProxy.getInstance(). The map in BinderProxy.java
+// remains the source of truth; this only remembers its answers. Entries hold weak global refs,
+// which ART limits per process, so the number of entries is bounded and misses simply go to Java.
+// The map is sharded by IBinder address to keep lock contention between binder threads low.
+class BinderProxyCache {
+public:
+    // Returns a new local ref to the BinderProxy of |binder|, or NULL if none is cached.
+    jobject get(JNIEnv* env, IBinder* binder) {
+        Shard& shard = shardFor(binder);
+        std::lock_guard<std::mutex> _l(shard.lock);
+        auto it = shard.entries.find(binder);
+        if (it == shard.entries.end()) {
+            return NULL;
+        }
+        jobject proxy = env->NewLocalRef(it->second.proxy);
+        if (proxy == NULL) {
+            // The BinderProxy was collected and awaits destruction.
+            env->DeleteWeakGlobalRef(it->second.proxy);
+            shard.entries.erase(it);
+        }
+        return proxy;
+    }
+
+    void put(JNIEnv* env, IBinder* binder, jobject proxy, BinderProxyNativeData* nativeData) {
+        Shard& shard = shardFor(binder);
+        std::lock_guard<std::mutex> _l(shard.lock);
+        auto it = shard.entries.find(binder);
+        if (it != shard.entries.end()) {
+            if (it->second.nativeData == nativeData) {
+                return;
+            }
+            env->DeleteWeakGlobalRef(it->second.proxy);
+            shard.entries.erase(it);
+        } else if (shard.entries.size() >= kMaxEntriesPerShard) {
+            return;
+        }
+        jweak ref = env->NewWeakGlobalRef(proxy);
+        if (ref != NULL) {
+            shard.entries.emplace(binder, Entry{ref, nativeData});
+        }
+    }
+
+    // Called when the BinderProxy owning |nativeData| is destroyed.
+    void remove(JNIEnv* env, BinderProxyNativeData* nativeData) {
+        IBinder* binder = nativeData->mObject.get();
+        Shard& shard = shardFor(binder);
+        std::lock_guard<std::mutex> _l(shard.lock);
+        auto it = shard.entries.find(binder);
+        if (it != shard.entries.end() && it->second.nativeData == nativeData) {
+            env->DeleteWeakGlobalRef(it->second.proxy);
+            shard.entries.erase(it);
+        }
+    }
+
+private:
+    static constexpr size_t kNumShards = 32;
+    static constexpr size_t kMaxEntriesPerShard = 256;
+
+    struct Entry {
+        jweak proxy;
+        BinderProxyNativeData* nativeData;
+    };
+
+    struct Shard {
+        std::mutex lock;
+        std::unordered_map<IBinder*, Entry> entries;
+    };
+
+    Shard& shardFor(IBinder* binder) {
+        return mShards[(reinterpret_cast<uintptr_t>(binder) >> 4) % kNumShards];
+    }
+
+    Shard mShards[kNumShards];
+};
+
+static BinderProxyCache gBinderProxyCache;
+
 // If the argument is a JavaBBinder, return the Java object that was used to create it.
 // Otherwise return a BinderProxy for the IBinder. If a previous call was passed the
 // same IBinder, and the original BinderProxy is still alive, return the same BinderProxy.
@@ -743,6 +822,11 @@ jobject javaObjectForIBinder(JNIEnv* env, const sp<IBinder>& val)
         return object;
     }
 
+    jobject cached = gBinderProxyCache.get(env, val.get());
+    if (cached != NULL) {
+        return cached;
+    }
+
     BinderProxyNativeData* nativeData = new BinderProxyNativeData();
     nativeData->mOrgue = new DeathRecipientList;
     nativeData->mObject = val;
@@ -769,6 +853,7 @@ jobject javaObjectForIBinder(JNIEnv* env, const sp<IBinder>& val)
     } else {
         delete nativeData;
     }
+    gBinderProxyCache.put(env, val.get(), object, actualNativeData);
 
     return object;
 }
@@ -1530,6 +1615,7 @@ static void BinderProxy_destroy(void* rawNativeData)
     BinderProxyNativeData * nativeData = (BinderProxyNativeData *) rawNativeData;
     LOGDEATH("Destroying BinderProxy: binder=%p drl=%p\n",
             nativeData->mObject.get(), nativeData->mOrgue.get());
+    gBinderProxyCache.remove(AndroidRuntime::getJNIEnv(), nativeData);
     delete nativeData;
     IPCThreadState::self()->flushCommands();
     --gNumProxies;
@@ -22,9 +22,15 @@
 #include <assert.h>
 #include <cutils/properties.h>
 #include <log/log.h>               // For LOGGER_ENTRY_MAX_PAYLOAD.
+#include <sys/system_properties.h>
 #include <utils/Log.h>
 #include <utils/String8.h>
 
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <string_view>
+
 #include "jni.h"
 #include <nativehelper/JNIHelp.h>
 #include "utils/misc.h"
@@ -47,12 +53,125 @@ static jboolean isLoggable(const char* tag, jint level) {
     return __android_log_is_loggable(level, tag, ANDROID_LOG_INFO);
 }
 
+// Whether a tag is loggable depends on the log.tag.* properties, which __android_log_is_loggable
+// reads on every call. The answers are cached per tag until any system property changes.
+static const size_t kMaxCachedTagLength = 31;
+static const size_t kTagCacheSize = 128;
+
+struct TagCacheEntry {
+    char tag[kMaxCachedTagLength + 1];
+    uint32_t serial;          // of the system properties the levels were looked up with
+    uint8_t knownLevels;      // one bit per priority
+    uint8_t loggableLevels;
+};
+
+static std::mutex gTagCacheLock;
+static TagCacheEntry gTagCache[kTagCacheSize];
+
+static jboolean isLoggableCached(const char* tag, size_t length, jint level) {
+    if (length > kMaxCachedTagLength || level < 0 || level >= 8) {
+        return isLoggable(tag, level);
+    }
+
+    const uint32_t serial = __system_property_area_serial();
+    const uint8_t bit = 1 << level;
+    TagCacheEntry& entry =
+            gTagCache[std::hash<std::string_view>()(std::string_view(tag, length)) % kTagCacheSize];
+    {
+        std::lock_guard<std::mutex> guard(gTagCacheLock);
+        if (entry.serial == serial && (entry.knownLevels & bit) && !strcmp(entry.tag, tag)) {
+            return (entry.loggableLevels & bit) != 0;
+        }
+    }
+
+    jboolean result = isLoggable(tag, level);
+
+    std::lock_guard<std::mutex> guard(gTagCacheLock);
+    if (entry.serial != serial || strcmp(entry.tag, tag)) {
+        memcpy(entry.tag, tag, length + 1);
+        entry.serial = serial;
+        entry.knownLevels = 0;
+        entry.loggableLevels = 0;
+    }
+    entry.knownLevels |= bit;
+    if (result) {
+        entry.loggableLevels |= bit;
+    }
+    return result;
+}
+
+/*
+ * Encodes str as UTF-8 into buf, without allocating, for as many whole characters as fit in
+ * size - 1 bytes, and NUL terminates it. Returns false if str didn't fit. As with
+ * GetStringUTFChars, U+0000 is encoded in two bytes so that it doesn't end the string.
+ */
+static bool encodeUtf8(JNIEnv* env, jstring str, char* buf, size_t size, size_t* outLength)
+{
+    const jsize length = env->GetStringLength(str);
+    jchar chunk[128];
+    size_t out = 0;
+    jsize pos = 0;
+    while (pos < length) {
+        const jsize count = std::min<jsize>(length - pos, NELEM(chunk));
+        env->GetStringRegion(str, pos, count, chunk);
+
+        jsize i = 0;
+        for (; i < count; i++) {
+            uint32_t c = chunk[i];
+            if (c >= 0xD800 && c < 0xDC00) {
+                if (i + 1 == count && pos + count < length) {
+                    break;  // The low surrogate is in the next chunk.
+                }
+                if (i + 1 < count && chunk[i + 1] >= 0xDC00 && chunk[i + 1] < 0xE000) {
+                    c = 0x10000 + ((c - 0xD800) << 10) + (chunk[i + 1] - 0xDC00);
+                }
+            }
+
+            const size_t n = c == 0 ? 2 : c < 0x80 ? 1 : c < 0x800 ? 2 : c < 0x10000 ? 3 : 4;
+            if (out + n >= size) {
+                buf[out] = '\0';
+                *outLength = out;
+                return false;
+            }
+            if (c == 0) {
+                buf[out++] = '\xC0';
+                buf[out++] = '\x80';
+            } else if (c < 0x80) {
+                buf[out++] = c;
+            } else if (c < 0x800) {
+                buf[out++] = 0xC0 | (c >> 6);
+                buf[out++] = 0x80 | (c & 0x3F);
+            } else if (c < 0x10000) {
+                buf[out++] = 0xE0 | (c >> 12);
+                buf[out++] = 0x80 | ((c >> 6) & 0x3F);
+                buf[out++] = 0x80 | (c & 0x3F);
+            } else {
+                buf[out++] = 0xF0 | (c >> 18);
+                buf[out++] = 0x80 | ((c >> 12) & 0x3F);
+                buf[out++] = 0x80 | ((c >> 6) & 0x3F);
+                buf[out++] = 0x80 | (c & 0x3F);
+                i++;  // Consumed the low surrogate as well.
+            }
+        }
+        pos += i;
+    }
+    buf[out] = '\0';
+    *outLength = out;
+    return true;
+}
+
 static jboolean android_util_Log_isLoggable(JNIEnv* env, jobject clazz, jstring tag, jint level)
 {
     if (tag == NULL) {
         return false;
     }
 
+    char buf[kMaxCachedTagLength + 1];
+    size_t length;
+    if (encodeUtf8(env, tag, buf, sizeof(buf), &length)) {
+        return isLoggableCached(buf, length, level);
+    }
+
     const char* chars = env->GetStringUTFChars(tag, NULL);
     if (!chars) {
         return false;
@@ -65,7 +184,7 @@ static jboolean android_util_Log_isLoggable(JNIEnv* env, jobject clazz, jstring
 }
 
 bool android_util_Log_isVerboseLogEnabled(const char* tag) {
-    return isLoggable(tag, levels.verbose);
+    return isLoggableCached(tag, strlen(tag), levels.verbose);
 }
 
 /*
@@ -76,7 +195,7 @@ static jint android_util_Log_println_native(JNIEnv* env, jobject clazz,
         jint bufID, jint priority, jstring tagObj, jstring msgObj)
 {
     const char* tag = NULL;
-    const char* msg = NULL;
+    const char* longTag = NULL;
 
     if (msgObj == NULL) {
         jniThrowNullPointerException(env, "println needs a message");
@@ -88,15 +207,24 @@ static jint android_util_Log_println_native(JNIEnv* env, jobject clazz,
         return -1;
     }
 
-    if (tagObj != NULL)
-        tag = env->GetStringUTFChars(tagObj, NULL);
-    msg = env->GetStringUTFChars(msgObj, NULL);
+    char tagBuf[128];
+    size_t length;
+    if (tagObj != NULL) {
+        if (encodeUtf8(env, tagObj, tagBuf, sizeof(tagBuf), &length)) {
+            tag = tagBuf;
+        } else {
+            tag = longTag = env->GetStringUTFChars(tagObj, NULL);
+        }
+    }
+
+    // The logger truncates anything past its payload size, so no more than that is encoded.
+    char msg[LOGGER_ENTRY_MAX_PAYLOAD];
+    encodeUtf8(env, msgObj, msg, sizeof(msg), &length);
 
     int res = __android_log_buf_write(bufID, (android_LogPriority)priority, tag, msg);
 
-    if (tag != NULL)
-        env->ReleaseStringUTFChars(tagObj, tag);
-    env->ReleaseStringUTFChars(msgObj, msg);
+    if (longTag != NULL)
+        env->ReleaseStringUTFChars(tagObj, longTag);
 
     return res;
 }
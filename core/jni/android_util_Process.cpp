@@ -28,8 +28,12 @@
 #include <meminfo/sysmeminfo.h>
 #include <processgroup/processgroup.h>
 #include <processgroup/sched_policy.h>
+#include <android-base/unique_fd.h>
 
+#include <algorithm>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "core_jni_helpers.h"
@@ -1052,6 +1056,225 @@ jboolean android_os_Process_readProcFile(JNIEnv* env, jobject clazz,
             format, outStrings, outLongs, outFloats);
 }
 
+// Keeps `proc` files open between reads so that repeated reads of the same file cost a single
+// pread() at offset 0 rather than an open/read/close. Files of processes that have exited fail
+// to read and are dropped from the cache.
+class ProcFileReader {
+public:
+    // Reads all of path into mBuffer, null terminated, and returns the number of bytes read or
+    // -1 on error. Must be called with mLock held.
+    ssize_t readLocked(const std::string& path) {
+        auto it = mFds.find(path);
+        if (it != mFds.end()) {
+            ssize_t len = preadFully(it->second.get());
+            if (len > 0) {
+                return len;
+            }
+            // Files of an exited task read as empty or fail. The pid may have been reused since,
+            // so retry with a fresh fd.
+            mFds.erase(it);
+        }
+
+        android::base::unique_fd fd(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+        if (fd < 0) {
+            if (kDebugProc) {
+                ALOGW("Unable to open process file: %s\n", path.c_str());
+            }
+            return -1;
+        }
+        ssize_t len = preadFully(fd.get());
+        if (len < 0) {
+            return -1;
+        }
+        if (mFds.size() >= kMaxCachedFds) {
+            // Pids come and go, so rather than track recency just start over when full.
+            mFds.clear();
+        }
+        mFds.emplace(path, std::move(fd));
+        return len;
+    }
+
+    char* buffer() { return mBuffer.data(); }
+
+    std::mutex mLock;
+
+private:
+    static const size_t kMaxCachedFds = 512;
+
+    std::unordered_map<std::string, android::base::unique_fd> mFds;
+    std::vector<char> mBuffer = std::vector<char>(kReadSize);
+
+    ssize_t preadFully(int fd) {
+        size_t numBytesRead = 0;
+        while (true) {
+            if (mBuffer.size() - numBytesRead < kReadSize) {
+                mBuffer.resize(mBuffer.size() + kReadSize);
+            }
+            // Leave room for the null terminator.
+            ssize_t len = TEMP_FAILURE_RETRY(pread(fd, mBuffer.data() + numBytesRead,
+                    mBuffer.size() - numBytesRead - 1, numBytesRead));
+            if (len < 0) {
+                return -1;
+            } else if (len == 0) {
+                break;
+            }
+            numBytesRead += len;
+        }
+        mBuffer[numBytesRead] = '\0';
+        return numBytesRead;
+    }
+};
+
+jlong android_os_Process_nativeCreateProcFileReader(JNIEnv* env, jobject clazz)
+{
+    return reinterpret_cast<jlong>(new ProcFileReader());
+}
+
+void android_os_Process_nativeDestroyProcFileReader(JNIEnv* env, jobject clazz, jlong ptr)
+{
+    delete reinterpret_cast<ProcFileReader*>(ptr);
+}
+
+jboolean android_os_Process_nativeReadProcFile(JNIEnv* env, jobject clazz, jlong ptr,
+        jstring file, jintArray format, jobjectArray outStrings,
+        jlongArray outLongs, jfloatArray outFloats)
+{
+    if (file == NULL || format == NULL) {
+        jniThrowNullPointerException(env, NULL);
+        return JNI_FALSE;
+    }
+
+    const char* file8 = env->GetStringUTFChars(file, NULL);
+    if (file8 == NULL) {
+        jniThrowException(env, "java/lang/OutOfMemoryError", NULL);
+        return JNI_FALSE;
+    }
+    std::string path(file8);
+    env->ReleaseStringUTFChars(file, file8);
+
+    ProcFileReader* reader = reinterpret_cast<ProcFileReader*>(ptr);
+    std::lock_guard<std::mutex> lock(reader->mLock);
+    ssize_t len = reader->readLocked(path);
+    if (len < 0) {
+        return JNI_FALSE;
+    }
+    return android_os_Process_parseProcLineArray(env, clazz, reader->buffer(), 0, len,
+            format, outStrings, outLongs, outFloats);
+}
+
+// Fields of /proc/<pid>/stat returned per pid by nativeReadProcStats; must match Process.java.
+enum {
+    PROC_STAT_STATE = 0,
+    PROC_STAT_PPID,
+    PROC_STAT_MINOR_FAULTS,
+    PROC_STAT_MAJOR_FAULTS,
+    PROC_STAT_UTIME,
+    PROC_STAT_STIME,
+    PROC_STAT_NUM_THREADS,
+    PROC_STAT_START_TIME,
+    PROC_STAT_VSIZE,
+    PROC_STAT_RSS,
+    PROC_STAT_COUNT
+};
+
+// 1-based /proc/<pid>/stat field number of each PROC_STAT_* value.
+static const int kProcStatFields[PROC_STAT_COUNT] = {
+    3,  // state
+    4,  // ppid
+    10, // minflt
+    12, // majflt
+    14, // utime
+    15, // stime
+    20, // num_threads
+    22, // starttime
+    23, // vsize
+    24, // rss
+};
+
+// Parses a stat line without a format array. comm may contain spaces and parentheses, so the
+// fields after it are located from the last ')'.
+static bool parseProcStat(const char* buffer, size_t len, jlong* out)
+{
+    const char* end = buffer + len;
+    const char* p = static_cast<const char*>(memrchr(buffer, ')', len));
+    if (p == NULL || end - p < 3) {
+        return false;
+    }
+    p += 2;
+    out[PROC_STAT_STATE] = *p;
+
+    int field = 3;
+    for (int i = PROC_STAT_STATE + 1; i < PROC_STAT_COUNT; i++) {
+        while (field < kProcStatFields[i]) {
+            while (p < end && *p != ' ') {
+                p++;
+            }
+            if (p == end) {
+                return false;
+            }
+            p++;
+            field++;
+        }
+        bool negative = p < end && *p == '-';
+        if (negative) {
+            p++;
+        }
+        jlong value = 0;
+        while (p < end && *p >= '0' && *p <= '9') {
+            value = value * 10 + (*p++ - '0');
+        }
+        out[i] = negative ? -value : value;
+    }
+    return true;
+}
+
+// Reads /proc/<pid>/stat for each of pids, or /proc/<parentPid>/task/<pid>/stat when parentPid
+// is positive, into PROC_STAT_COUNT longs per pid. Rows of pids that could not be read are set
+// to -1. Returns the number of pids read.
+jint android_os_Process_nativeReadProcStats(JNIEnv* env, jobject clazz, jlong ptr,
+        jint parentPid, jintArray pids, jlongArray outStats)
+{
+    if (pids == NULL || outStats == NULL) {
+        jniThrowNullPointerException(env, NULL);
+        return 0;
+    }
+
+    const jsize count = env->GetArrayLength(pids);
+    if (env->GetArrayLength(outStats) < count * PROC_STAT_COUNT) {
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                "outStats is too small for pids");
+        return 0;
+    }
+
+    std::vector<jint> pidData(count);
+    env->GetIntArrayRegion(pids, 0, count, pidData.data());
+    std::vector<jlong> stats(count * PROC_STAT_COUNT, -1);
+
+    jint numRead = 0;
+    ProcFileReader* reader = reinterpret_cast<ProcFileReader*>(ptr);
+    {
+        std::lock_guard<std::mutex> lock(reader->mLock);
+        char path[64];
+        for (jsize i = 0; i < count; i++) {
+            if (parentPid > 0) {
+                snprintf(path, sizeof(path), "/proc/%d/task/%d/stat", parentPid, pidData[i]);
+            } else {
+                snprintf(path, sizeof(path), "/proc/%d/stat", pidData[i]);
+            }
+            ssize_t len = reader->readLocked(path);
+            jlong* row = &stats[i * PROC_STAT_COUNT];
+            if (len > 0 && parseProcStat(reader->buffer(), len, row)) {
+                numRead++;
+            } else {
+                std::fill(row, row + PROC_STAT_COUNT, -1);
+            }
+        }
+    }
+
+    env->SetLongArrayRegion(outStats, 0, stats.size(), stats.data());
+    return numRead;
+}
+
 void android_os_Process_setApplicationObject(JNIEnv* env, jobject clazz,
                                              jobject binderObject)
 {
@@ -1260,6 +1483,10 @@ static const JNINativeMethod methods[] = {
     {"getPids", "(Ljava/lang/String;[I)[I", (void*)android_os_Process_getPids},
     {"readProcFile", "(Ljava/lang/String;[I[Ljava/lang/String;[J[F)Z", (void*)android_os_Process_readProcFile},
     {"parseProcLine", "([BII[I[Ljava/lang/String;[J[F)Z", (void*)android_os_Process_parseProcLine},
+    {"nativeCreateProcFileReader", "()J", (void*)android_os_Process_nativeCreateProcFileReader},
+    {"nativeDestroyProcFileReader", "(J)V", (void*)android_os_Process_nativeDestroyProcFileReader},
+    {"nativeReadProcFile", "(JLjava/lang/String;[I[Ljava/lang/String;[J[F)Z", (void*)android_os_Process_nativeReadProcFile},
+    {"nativeReadProcStats", "(JI[I[J)I", (void*)android_os_Process_nativeReadProcStats},
     {"getElapsedCpuTime", "()J", (void*)android_os_Process_getElapsedCpuTime},
     {"getPss", "(I)J", (void*)android_os_Process_getPss},
     {"getRss", "(I)[J", (void*)android_os_Process_getRss},
@@ -18,8 +18,16 @@
 #define LOG_TAG "StatsLog_println"
 
 #include <assert.h>
+#include <string.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include "jni.h"
+#include <log/log.h>
 #include <nativehelper/JNIHelp.h>
 #include "utils/misc.h"
 #include "core_jni_helpers.h"
@@ -27,6 +35,127 @@
 
 namespace android {
 
+/*
+ * Coalesces the atoms written with writeBuffered() into datagrams of up to
+ * LOGGER_ENTRY_MAX_PAYLOAD bytes, sent when full or FLUSH_DELAY after the first atom.
+ *
+ * A coalesced datagram starts with COALESCED_DATAGRAM_TAG in place of the event tag, followed
+ * by records of a uint16 size and the bytes of one atom. It must stay in sync with
+ * StatsSocketListener::handleBatch() in statsd.
+ *
+ * If statsd's socket is full, the datagram is resent one atom at a time, so that
+ * libstatssocket counts every dropped atom and reports the last atom id as it would have
+ * without buffering.
+ */
+class StatsWriteBuffer {
+public:
+    static StatsWriteBuffer& getInstance() {
+        static StatsWriteBuffer* buffer = new StatsWriteBuffer();
+        return *buffer;
+    }
+
+    void write(const void* atom, size_t size, int32_t atomId) {
+        if (sizeof(COALESCED_DATAGRAM_TAG) + sizeof(uint16_t) + size > MAX_DATAGRAM_SIZE) {
+            // Too large to share a datagram.
+            flush();
+            write_buffer_to_statsd(const_cast<void*>(atom), size, atomId);
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mLock);
+        if (mData.size() + sizeof(uint16_t) + size > MAX_DATAGRAM_SIZE) {
+            flushLocked();
+        }
+        if (mAtoms.empty()) {
+            mDeadline = std::chrono::steady_clock::now() + FLUSH_DELAY;
+            startFlusherLocked();
+            mFlushNeeded.notify_one();
+        }
+
+        uint16_t size16 = static_cast<uint16_t>(size);
+        const uint8_t* sizeBytes = reinterpret_cast<const uint8_t*>(&size16);
+        mData.insert(mData.end(), sizeBytes, sizeBytes + sizeof(size16));
+        mAtoms.push_back({mData.size(), size, atomId});
+        const uint8_t* atomBytes = static_cast<const uint8_t*>(atom);
+        mData.insert(mData.end(), atomBytes, atomBytes + size);
+    }
+
+    void flush() {
+        std::lock_guard<std::mutex> lock(mLock);
+        flushLocked();
+    }
+
+private:
+    static constexpr uint32_t COALESCED_DATAGRAM_TAG = 0xffff5342;
+    static constexpr size_t MAX_DATAGRAM_SIZE = LOGGER_ENTRY_MAX_PAYLOAD;
+    static constexpr std::chrono::milliseconds FLUSH_DELAY{50};
+
+    struct Atom {
+        size_t offset;
+        size_t size;
+        int32_t atomId;
+    };
+
+    StatsWriteBuffer() : mFlusherStarted(false) {
+        mData.reserve(MAX_DATAGRAM_SIZE);
+        resetLocked();
+    }
+
+    void resetLocked() {
+        mData.clear();
+        mAtoms.clear();
+        const uint8_t* tagBytes = reinterpret_cast<const uint8_t*>(&COALESCED_DATAGRAM_TAG);
+        mData.insert(mData.end(), tagBytes, tagBytes + sizeof(COALESCED_DATAGRAM_TAG));
+    }
+
+    void flushLocked() {
+        if (mAtoms.empty()) {
+            return;
+        }
+        if (mAtoms.size() == 1) {
+            const Atom& atom = mAtoms[0];
+            write_buffer_to_statsd(mData.data() + atom.offset, atom.size, atom.atomId);
+        } else if (write_buffer_to_statsd(mData.data(), mData.size(), mAtoms.back().atomId) < 0) {
+            for (const Atom& atom : mAtoms) {
+                write_buffer_to_statsd(mData.data() + atom.offset, atom.size, atom.atomId);
+            }
+        }
+        resetLocked();
+    }
+
+    void startFlusherLocked() {
+        if (mFlusherStarted) {
+            return;
+        }
+        mFlusherStarted = true;
+        std::thread([this] { flusherLoop(); }).detach();
+    }
+
+    void flusherLoop() {
+        std::unique_lock<std::mutex> lock(mLock);
+        while (true) {
+            if (mAtoms.empty()) {
+                mFlushNeeded.wait(lock);
+                continue;
+            }
+            if (mFlushNeeded.wait_until(lock, mDeadline) == std::cv_status::timeout
+                    && !mAtoms.empty() && std::chrono::steady_clock::now() >= mDeadline) {
+                flushLocked();
+            }
+        }
+    }
+
+    std::mutex mLock;
+    std::condition_variable mFlushNeeded;
+    std::vector<uint8_t> mData;
+    std::vector<Atom> mAtoms;
+    std::chrono::steady_clock::time_point mDeadline;
+    bool mFlusherStarted;
+};
+
+constexpr uint32_t StatsWriteBuffer::COALESCED_DATAGRAM_TAG;
+constexpr std::chrono::milliseconds StatsWriteBuffer::FLUSH_DELAY;
+
 static void android_util_StatsLog_write(JNIEnv* env, jobject clazz, jbyteArray buf, jint size,
         jint atomId) {
     if (buf == NULL) {
@@ -47,12 +176,38 @@ static void android_util_StatsLog_write(JNIEnv* env, jobject clazz, jbyteArray b
     env->ReleaseByteArrayElements(buf, bufferArray, 0);
 }
 
+static void android_util_StatsLog_writeBuffered(JNIEnv* env, jobject clazz, jbyteArray buf,
+        jint size, jint atomId) {
+    if (buf == NULL) {
+        return;
+    }
+    jint actualSize = env->GetArrayLength(buf);
+    if (actualSize < size) {
+        return;
+    }
+
+    jbyte* bufferArray = env->GetByteArrayElements(buf, NULL);
+    if (bufferArray == NULL) {
+        return;
+    }
+
+    StatsWriteBuffer::getInstance().write(bufferArray, size, atomId);
+
+    env->ReleaseByteArrayElements(buf, bufferArray, JNI_ABORT);
+}
+
+static void android_util_StatsLog_flushBuffered(JNIEnv* env, jobject clazz) {
+    StatsWriteBuffer::getInstance().flush();
+}
+
 /*
  * JNI registration.
  */
 static const JNINativeMethod gMethods[] = {
     /* name, signature, funcPtr */
     { "writeImpl", "([BII)V", (void*) android_util_StatsLog_write },
+    { "writeBufferedImpl", "([BII)V", (void*) android_util_StatsLog_writeBuffered },
+    { "flushBufferedImpl", "()V", (void*) android_util_StatsLog_flushBuffered },
 };
 
 int register_android_util_StatsLog(JNIEnv* env)
@@ -29,6 +29,18 @@
 
 namespace android {
 
+// The fields nativeGetAttributes() writes for each attribute.
+// Keep in sync with XmlBlock.java !!!
+enum {
+    ATTR_NAMESPACE = 0,
+    ATTR_NAME = 1,
+    ATTR_RESOURCE = 2,
+    ATTR_DATA_TYPE = 3,
+    ATTR_DATA = 4,
+    ATTR_STRING_VALUE = 5,
+    ATTR_NUM_FIELDS = 6,
+};
+
 // ----------------------------------------------------------------------------
 
 static jlong android_content_XmlBlock_nativeCreate(JNIEnv* env, jobject clazz,
@@ -255,6 +267,42 @@ static jint android_content_XmlBlock_nativeGetAttributeStringValue(JNIEnv* env,
     return static_cast<jint>(st->getAttributeValueStringID(idx));
 }
 
+// Reads every attribute of the current element at once, ATTR_NUM_FIELDS ints per attribute,
+// so that inflating an element costs one transition rather than several per attribute.
+// Returns the number of attributes. If outAttrs is too small to hold them, it is left as is
+// and the caller should retry with a larger array.
+static jint android_content_XmlBlock_nativeGetAttributes(JNIEnv* env, jobject clazz,
+                                                         jlong token, jintArray outAttrs)
+{
+    ResXMLParser* st = reinterpret_cast<ResXMLParser*>(token);
+    if (st == NULL || outAttrs == NULL) {
+        jniThrowNullPointerException(env, NULL);
+        return 0;
+    }
+
+    const size_t count = st->getAttributeCount();
+    if (count == 0 || static_cast<size_t>(env->GetArrayLength(outAttrs))
+            < count * ATTR_NUM_FIELDS) {
+        return static_cast<jint>(count);
+    }
+
+    jint* attrs = reinterpret_cast<jint*>(env->GetPrimitiveArrayCritical(outAttrs, NULL));
+    if (attrs == NULL) {
+        return 0;
+    }
+    for (size_t i = 0; i < count; i++) {
+        jint* attr = attrs + i * ATTR_NUM_FIELDS;
+        attr[ATTR_NAMESPACE] = static_cast<jint>(st->getAttributeNamespaceID(i));
+        attr[ATTR_NAME] = static_cast<jint>(st->getAttributeNameID(i));
+        attr[ATTR_RESOURCE] = static_cast<jint>(st->getAttributeNameResID(i));
+        attr[ATTR_DATA_TYPE] = static_cast<jint>(st->getAttributeDataType(i));
+        attr[ATTR_DATA] = static_cast<jint>(st->getAttributeData(i));
+        attr[ATTR_STRING_VALUE] = static_cast<jint>(st->getAttributeValueStringID(i));
+    }
+    env->ReleasePrimitiveArrayCritical(outAttrs, attrs, 0);
+    return static_cast<jint>(count);
+}
+
 static jint android_content_XmlBlock_nativeGetAttributeIndex(JNIEnv* env, jobject clazz,
                                                              jlong token,
                                                              jstring ns, jstring name)
@@ -415,6 +463,8 @@ static const JNINativeMethod gXmlBlockMethods[] = {
             (void*) android_content_XmlBlock_nativeGetAttributeData },
     { "nativeGetAttributeStringValue", "(JI)I",
             (void*) android_content_XmlBlock_nativeGetAttributeStringValue },
+    { "nativeGetAttributes",        "(J[I)I",
+            (void*) android_content_XmlBlock_nativeGetAttributes },
     { "nativeGetAttributeIndex",    "(JLjava/lang/String;Ljava/lang/String;)I",
             (void*) android_content_XmlBlock_nativeGetAttributeIndex },
     { "nativeGetIdAttribute",      "(J)I",
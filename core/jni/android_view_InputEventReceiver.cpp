@@ -47,6 +47,58 @@ static struct {
     jmethodID dispatchBatchedInputEventPending;
 } gInputEventReceiverClassInfo;
 
+// Hands the InputConsumer the native MotionEvent of a Java MotionEvent from MotionEvent's
+// recycler, so that a motion event, including every batched history sample, is consumed
+// directly into the object that gets dispatched instead of being copied into it afterwards.
+// The recycled native events keep their sample storage, so steady-state consumption doesn't
+// allocate either. Key events still use the preallocated event.
+class JavaMotionEventFactory : public InputEventFactoryInterface {
+public:
+    JavaMotionEventFactory(JNIEnv* env, PreallocatedInputEventFactory* fallbackFactory) :
+            mEnv(env), mFallbackFactory(fallbackFactory), mMotionEventObj(NULL) { }
+
+    ~JavaMotionEventFactory() {
+        releaseMotionEventObj();
+    }
+
+    virtual KeyEvent* createKeyEvent() {
+        return mFallbackFactory->createKeyEvent();
+    }
+
+    virtual MotionEvent* createMotionEvent() {
+        releaseMotionEventObj();
+        MotionEvent* event = NULL;
+        mMotionEventObj = android_view_MotionEvent_obtain(mEnv, &event);
+        if (!mMotionEventObj) {
+            // Still consume the event so that it gets finished; it won't be dispatched.
+            return mFallbackFactory->createMotionEvent();
+        }
+        return event;
+    }
+
+    // Returns the Java MotionEvent wrapping the last event consumed through this factory.
+    // The caller owns the returned local reference.
+    jobject takeMotionEventObj() {
+        jobject obj = mMotionEventObj;
+        mMotionEventObj = NULL;
+        return obj;
+    }
+
+    // Recycles an event that was created but not consumed.
+    void releaseMotionEventObj() {
+        if (mMotionEventObj) {
+            android_view_MotionEvent_recycle(mEnv, mMotionEventObj);
+            mEnv->DeleteLocalRef(mMotionEventObj);
+            mMotionEventObj = NULL;
+        }
+    }
+
+private:
+    JNIEnv* const mEnv;
+    PreallocatedInputEventFactory* const mFallbackFactory;
+    jobject mMotionEventObj;
+};
+
 
 class NativeInputEventReceiver : public LooperCallback {
 public:
@@ -231,13 +283,19 @@ status_t NativeInputEventReceiver::consumeEvents(JNIEnv* env,
     }
 
     ScopedLocalRef<jobject> receiverObj(env, NULL);
+    JavaMotionEventFactory javaEventFactory(env, &mInputEventFactory);
     bool skipCallbacks = false;
     for (;;) {
         uint32_t seq;
         InputEvent* inputEvent;
-        status_t status = mInputConsumer.consume(&mInputEventFactory,
+        // Events that won't be dispatched don't need a Java object.
+        InputEventFactoryInterface* factory = skipCallbacks
+                ? static_cast<InputEventFactoryInterface*>(&mInputEventFactory)
+                : &javaEventFactory;
+        status_t status = mInputConsumer.consume(factory,
                 consumeBatches, frameTime, &seq, &inputEvent);
         if (status) {
+            javaEventFactory.releaseMotionEventObj();
             if (status == WOULD_BLOCK) {
                 if (!skipCallbacks && !mBatchedInputEventPending
                         && mInputConsumer.hasPendingBatch()) {
@@ -299,7 +357,8 @@ status_t NativeInputEventReceiver::consumeEvents(JNIEnv* env,
                 if ((motionEvent->getAction() & AMOTION_EVENT_ACTION_MOVE) && outConsumedBatch) {
                     *outConsumedBatch = true;
                 }
-                inputEventObj = android_view_MotionEvent_obtainAsCopy(env, motionEvent);
+                // The event was consumed straight into its Java MotionEvent.
+                inputEventObj = javaEventFactory.takeMotionEventObj();
                 break;
             }
 
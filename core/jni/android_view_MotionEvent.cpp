@@ -79,7 +79,7 @@ static void android_view_MotionEvent_setNativePtr(JNIEnv* env, jobject eventObj,
             reinterpret_cast<jlong>(event));
 }
 
-jobject android_view_MotionEvent_obtainAsCopy(JNIEnv* env, const MotionEvent* event) {
+jobject android_view_MotionEvent_obtain(JNIEnv* env, MotionEvent** outEvent) {
     jobject eventObj = env->CallStaticObjectMethod(gMotionEventClassInfo.clazz,
             gMotionEventClassInfo.obtain);
     if (env->ExceptionCheck() || !eventObj) {
@@ -95,7 +95,16 @@ jobject android_view_MotionEvent_obtainAsCopy(JNIEnv* env, const MotionEvent* ev
         android_view_MotionEvent_setNativePtr(env, eventObj, destEvent);
     }
 
-    destEvent->copyFrom(event, true);
+    *outEvent = destEvent;
+    return eventObj;
+}
+
+jobject android_view_MotionEvent_obtainAsCopy(JNIEnv* env, const MotionEvent* event) {
+    MotionEvent* destEvent;
+    jobject eventObj = android_view_MotionEvent_obtain(env, &destEvent);
+    if (eventObj) {
+        destEvent->copyFrom(event, true);
+    }
     return eventObj;
 }
 
@@ -28,6 +28,10 @@ class MotionEvent;
  * Returns NULL on error. */
 extern jobject android_view_MotionEvent_obtainAsCopy(JNIEnv* env, const MotionEvent* event);
 
+/* Obtains an instance of a DVM MotionEvent object and stores its native MotionEvent, for the
+ * caller to fill in place, in outEvent. Returns NULL on error. */
+extern jobject android_view_MotionEvent_obtain(JNIEnv* env, MotionEvent** outEvent);
+
 /* Gets the underlying native MotionEvent instance within a DVM MotionEvent object.
  * Returns NULL if the event is NULL or if it is uninitialized. */
 extern MotionEvent* android_view_MotionEvent_getNativePtr(JNIEnv* env, jobject eventObj);
@@ -23,6 +23,9 @@
 #include <input/Input.h>
 #include <input/VelocityTracker.h>
 #include "android_view_MotionEvent.h"
+#include "IncrementalVelocityTracker.h"
+
+#include <memory>
 
 #include <nativehelper/ScopedUtfChars.h>
 
@@ -33,6 +36,9 @@ namespace android {
 // Special constant to request the velocity of the active pointer.
 static const int ACTIVE_POINTER_ID = -1;
 
+// Strategy name of IncrementalVelocityTracker, which libinput doesn't know about.
+static const char* const INCREMENTAL_STRATEGY = "ilsq2";
+
 static struct {
     jfieldID xCoeff;
     jfieldID yCoeff;
@@ -59,34 +65,62 @@ private:
     };
 
     VelocityTracker mVelocityTracker;
+    std::unique_ptr<IncrementalVelocityTracker> mIncrementalVelocityTracker;
     int32_t mActivePointerId;
     BitSet32 mCalculatedIdBits;
     Velocity mCalculatedVelocity[MAX_POINTERS];
 };
 
+static bool isIncrementalStrategy(const char* strategy) {
+    return strategy && !strcmp(strategy, INCREMENTAL_STRATEGY);
+}
+
 VelocityTrackerState::VelocityTrackerState(const char* strategy) :
-        mVelocityTracker(strategy), mActivePointerId(-1) {
+        mVelocityTracker(isIncrementalStrategy(strategy) ? NULL : strategy),
+        mActivePointerId(-1) {
+    if (isIncrementalStrategy(strategy)) {
+        mIncrementalVelocityTracker = std::make_unique<IncrementalVelocityTracker>();
+    }
 }
 
 void VelocityTrackerState::clear() {
-    mVelocityTracker.clear();
+    if (mIncrementalVelocityTracker) {
+        mIncrementalVelocityTracker->clear();
+    } else {
+        mVelocityTracker.clear();
+    }
     mActivePointerId = -1;
     mCalculatedIdBits.clear();
 }
 
 void VelocityTrackerState::addMovement(const MotionEvent* event) {
-    mVelocityTracker.addMovement(event);
+    if (mIncrementalVelocityTracker) {
+        mIncrementalVelocityTracker->addMovement(event);
+    } else {
+        mVelocityTracker.addMovement(event);
+    }
 }
 
 void VelocityTrackerState::computeCurrentVelocity(int32_t units, float maxVelocity) {
-    BitSet32 idBits(mVelocityTracker.getCurrentPointerIdBits());
+    BitSet32 idBits(mIncrementalVelocityTracker
+            ? mIncrementalVelocityTracker->getCurrentPointerIdBits()
+            : mVelocityTracker.getCurrentPointerIdBits());
     mCalculatedIdBits = idBits;
 
+    if (mIncrementalVelocityTracker) {
+        // Solve all pointers at once rather than lazily from the first getVelocity().
+        mIncrementalVelocityTracker->computeFits();
+    }
+
     for (uint32_t index = 0; !idBits.isEmpty(); index++) {
         uint32_t id = idBits.clearFirstMarkedBit();
 
         float vx, vy;
-        mVelocityTracker.getVelocity(id, &vx, &vy);
+        if (mIncrementalVelocityTracker) {
+            mIncrementalVelocityTracker->getVelocity(id, &vx, &vy);
+        } else {
+            mVelocityTracker.getVelocity(id, &vx, &vy);
+        }
 
         vx = vx * units / 1000;
         vy = vy * units / 1000;
@@ -110,7 +144,9 @@ void VelocityTrackerState::computeCurrentVelocity(int32_t units, float maxVeloci
 
 void VelocityTrackerState::getVelocity(int32_t id, float* outVx, float* outVy) {
     if (id == ACTIVE_POINTER_ID) {
-        id = mVelocityTracker.getActivePointerId();
+        id = mIncrementalVelocityTracker
+                ? mIncrementalVelocityTracker->getActivePointerId()
+                : mVelocityTracker.getActivePointerId();
     }
 
     float vx, vy;
@@ -133,6 +169,9 @@ void VelocityTrackerState::getVelocity(int32_t id, float* outVx, float* outVy) {
 }
 
 bool VelocityTrackerState::getEstimator(int32_t id, VelocityTracker::Estimator* outEstimator) {
+    if (mIncrementalVelocityTracker) {
+        return mIncrementalVelocityTracker->getEstimator(id, outEstimator);
+    }
     return mVelocityTracker.getEstimator(id, outEstimator);
 }
 
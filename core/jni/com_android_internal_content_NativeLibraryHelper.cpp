@@ -37,7 +37,12 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 
 #define APK_LIB "lib/"
 #define APK_LIB_LEN (sizeof(APK_LIB) - 1)
@@ -169,16 +174,12 @@ sumFiles(JNIEnv*, void* arg, ZipFileRO* zipFile, ZipEntryRO zipEntry, const char
  * Copy the native library if needed.
  *
  * This function assumes the library and path names passed in are considered safe.
+ * It does not use JNI, so it can run on any thread.
  */
 static install_status_t
-copyFileIfChanged(JNIEnv *env, void* arg, ZipFileRO* zipFile, ZipEntryRO zipEntry, const char* fileName)
+copyFileIfChanged(const std::string& nativeLibPath, bool extractNativeLibs, ZipFileRO* zipFile,
+        ZipEntryRO zipEntry, const char* fileName)
 {
-    void** args = reinterpret_cast<void**>(arg);
-    jstring* javaNativeLibPath = (jstring*) args[0];
-    jboolean extractNativeLibs = *(jboolean*) args[1];
-
-    ScopedUtfChars nativeLibPath(env, *javaNativeLibPath);
-
     uint32_t uncompLen;
     uint32_t when;
     uint32_t crc;
@@ -483,14 +484,88 @@ static int findSupportedAbi(JNIEnv *env, jlong apkHandle, jobjectArray supported
     return status;
 }
 
+// The most libraries copyNativeBinaries extracts at once. Extraction is a mix of inflating and
+// writing, which a few threads overlap well.
+static const size_t kMaxCopyThreads = 4;
+
+struct NativeLibraryEntry {
+    // Name of the entry in the APK, and its last path component.
+    std::string entryName;
+    std::string fileName;
+};
+
+static install_status_t
+collectNativeFile(JNIEnv*, void* arg, ZipFileRO* zipFile, ZipEntryRO zipEntry,
+        const char* fileName)
+{
+    std::vector<NativeLibraryEntry>* libraries =
+            reinterpret_cast<std::vector<NativeLibraryEntry>*>(arg);
+    char entryName[PATH_MAX];
+    if (zipFile->getEntryFileName(zipEntry, entryName, sizeof(entryName))) {
+        return INSTALL_FAILED_INVALID_APK;
+    }
+    libraries->push_back({entryName, fileName});
+    return INSTALL_SUCCEEDED;
+}
+
 static jint
 com_android_internal_content_NativeLibraryHelper_copyNativeBinaries(JNIEnv *env, jclass clazz,
         jlong apkHandle, jstring javaNativeLibPath, jstring javaCpuAbi,
         jboolean extractNativeLibs, jboolean debuggable)
 {
-    void* args[] = { &javaNativeLibPath, &extractNativeLibs };
-    return (jint) iterateOverNativeFiles(env, apkHandle, javaCpuAbi, debuggable,
-            copyFileIfChanged, reinterpret_cast<void*>(args));
+    // The iteration reuses its entry, so collect the names first and look the entries up again
+    // for the copy.
+    std::vector<NativeLibraryEntry> libraries;
+    install_status_t status = iterateOverNativeFiles(env, apkHandle, javaCpuAbi, debuggable,
+            collectNativeFile, &libraries);
+    if (status != INSTALL_SUCCEEDED || libraries.empty()) {
+        return (jint) status;
+    }
+
+    const ScopedUtfChars nativeLibPathChars(env, javaNativeLibPath);
+    if (nativeLibPathChars.c_str() == NULL) {
+        return INSTALL_FAILED_INTERNAL_ERROR;
+    }
+    const std::string nativeLibPath(nativeLibPathChars.c_str());
+    ZipFileRO* zipFile = reinterpret_cast<ZipFileRO*>(apkHandle);
+
+    // Reading and inflating entries of the same ZipFileRO from several threads is safe.
+    // Like the serial loop used to, report the failure of the first library in the APK.
+    std::vector<install_status_t> results(libraries.size(), INSTALL_SUCCEEDED);
+    std::atomic<size_t> nextLibrary(0);
+    std::atomic<bool> failed(false);
+    auto copyLibraries = [&]() {
+        for (size_t i = nextLibrary++; i < libraries.size() && !failed; i = nextLibrary++) {
+            ZipEntryRO entry = zipFile->findEntryByName(libraries[i].entryName.c_str());
+            if (entry == NULL) {
+                results[i] = INSTALL_FAILED_INVALID_APK;
+            } else {
+                results[i] = copyFileIfChanged(nativeLibPath, extractNativeLibs, zipFile, entry,
+                        libraries[i].fileName.c_str());
+                zipFile->releaseEntry(entry);
+            }
+            if (results[i] != INSTALL_SUCCEEDED) {
+                ALOGV("Failure for entry %s", libraries[i].fileName.c_str());
+                failed = true;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < std::min(libraries.size(), kMaxCopyThreads); i++) {
+        threads.emplace_back(copyLibraries);
+    }
+    copyLibraries();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    for (install_status_t result : results) {
+        if (result != INSTALL_SUCCEEDED) {
+            return (jint) result;
+        }
+    }
+    return (jint) INSTALL_SUCCEEDED;
 }
 
 static jlong
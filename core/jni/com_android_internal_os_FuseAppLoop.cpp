@@ -17,11 +17,17 @@
 #define LOG_TAG "FuseAppLoopJNI"
 #define LOG_NDEBUG 0
 
+#include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 
+#include <algorithm>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 #include <android_runtime/Log.h>
 #include <android-base/logging.h>
@@ -39,18 +45,132 @@ constexpr const char* CLASS_NAME = "com/android/internal/os/FuseAppLoop";
 
 jclass gFuseAppLoopClass;
 jmethodID gOnCommandMethod;
+jmethodID gOnCommandDirectMethod;
 jmethodID gOnOpenMethod;
 
+constexpr size_t kDirectBufferSize =
+        std::max(static_cast<size_t>(fuse::kFuseMaxRead), static_cast<size_t>(fuse::kFuseMaxWrite));
+
+// Keep a few spare buffers around so that steady streaming doesn't allocate.
+constexpr size_t kMaxFreeDirectBuffers = 4;
+
+// Native buffers that Java sees as direct ByteBuffers, one per outstanding read or write, so
+// that data moves between the FUSE request and Java without going through a byte[] and so
+// that Java can have several requests in flight and reply to them in any order.
+class DirectBufferPool {
+public:
+    // Returns the buffer for the request unique, or nullptr if it can't be allocated.
+    jobject Acquire(JNIEnv* env, uint64_t unique, void** outData) {
+        Buffer buffer;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (!mFree.empty()) {
+                buffer = mFree.back();
+                mFree.pop_back();
+            }
+        }
+        if (buffer.data == nullptr) {
+            buffer.data = malloc(kDirectBufferSize);
+            if (buffer.data == nullptr) {
+                return nullptr;
+            }
+            ScopedLocalRef<jobject> obj(env, env->NewDirectByteBuffer(buffer.data,
+                                                                      kDirectBufferSize));
+            if (obj.get() == nullptr) {
+                env->ExceptionClear();
+                free(buffer.data);
+                return nullptr;
+            }
+            buffer.obj = env->NewGlobalRef(obj.get());
+        }
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        mInUse[unique] = buffer;
+        *outData = buffer.data;
+        return buffer.obj;
+    }
+
+    // Returns the data of the buffer of the request unique, or nullptr if it has none.
+    void* Get(uint64_t unique) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto it = mInUse.find(unique);
+        return it != mInUse.end() ? it->second.data : nullptr;
+    }
+
+    // Takes back the buffer of the request unique once it has been replied to.
+    void Release(JNIEnv* env, uint64_t unique) {
+        Buffer buffer;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            auto it = mInUse.find(unique);
+            if (it == mInUse.end()) {
+                return;
+            }
+            buffer = it->second;
+            mInUse.erase(it);
+            if (mFree.size() < kMaxFreeDirectBuffers) {
+                mFree.push_back(buffer);
+                return;
+            }
+        }
+        env->DeleteGlobalRef(buffer.obj);
+        free(buffer.data);
+    }
+
+    void Clear(JNIEnv* env) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (const Buffer& buffer : mFree) {
+            env->DeleteGlobalRef(buffer.obj);
+            free(buffer.data);
+        }
+        for (const auto& entry : mInUse) {
+            env->DeleteGlobalRef(entry.second.obj);
+            free(entry.second.data);
+        }
+        mFree.clear();
+        mInUse.clear();
+    }
+
+private:
+    struct Buffer {
+        void* data = nullptr;
+        jobject obj = nullptr;
+    };
+
+    std::mutex mMutex;
+    std::vector<Buffer> mFree;
+    std::unordered_map<uint64_t, Buffer> mInUse;
+};
+
+struct AppLoop {
+    explicit AppLoop(base::unique_fd&& fd) : loop(std::move(fd)) {}
+
+    fuse::FuseAppLoop loop;
+    DirectBufferPool buffers;
+};
+
+AppLoop* ToAppLoop(jlong ptr) {
+    return reinterpret_cast<AppLoop*>(ptr);
+}
+
+fuse::FuseAppLoop* ToLoop(jlong ptr) {
+    return &ToAppLoop(ptr)->loop;
+}
+
 class Callback : public fuse::FuseAppLoopCallback {
 private:
     typedef ScopedLocalRef<jbyteArray> LocalBytes;
     JNIEnv* const mEnv;
     jobject const mSelf;
+    fuse::FuseAppLoop* const mLoop;
+    // Set in direct mode, in which reads and writes go through onCommandDirect.
+    DirectBufferPool* const mDirectBuffers;
     std::map<uint64_t, std::unique_ptr<LocalBytes>> mBuffers;
 
 public:
-    Callback(JNIEnv* env, jobject self) :
-        mEnv(env), mSelf(self) {}
+    Callback(JNIEnv* env, jobject self, fuse::FuseAppLoop* loop,
+             DirectBufferPool* directBuffers) :
+        mEnv(env), mSelf(self), mLoop(loop), mDirectBuffers(directBuffers) {}
 
     void OnLookup(uint64_t unique, uint64_t inode) override {
         CallOnCommand(FUSE_LOOKUP, unique, inode, 0, 0, nullptr);
@@ -64,7 +184,10 @@ public:
         const jbyteArray buffer = static_cast<jbyteArray>(mEnv->CallObjectMethod(
                 mSelf, gOnOpenMethod, unique, inode));
         CHECK(!mEnv->ExceptionCheck());
-        if (buffer == nullptr) {
+        if (buffer == nullptr || mDirectBuffers != nullptr) {
+            if (buffer != nullptr) {
+                mEnv->DeleteLocalRef(buffer);
+            }
             return;
         }
 
@@ -84,6 +207,17 @@ public:
     void OnRead(uint64_t unique, uint64_t inode, uint64_t offset, uint32_t size) override {
         CHECK_LE(size, static_cast<uint32_t>(fuse::kFuseMaxRead));
 
+        if (mDirectBuffers != nullptr) {
+            void* data;
+            jobject buffer = mDirectBuffers->Acquire(mEnv, unique, &data);
+            if (buffer == nullptr) {
+                ReplyNoMemory(unique);
+                return;
+            }
+            CallOnCommandDirect(FUSE_READ, unique, inode, offset, size, buffer);
+            return;
+        }
+
         auto it = mBuffers.find(inode);
         CHECK(it != mBuffers.end());
 
@@ -94,6 +228,20 @@ public:
             const void* buffer) override {
         CHECK_LE(size, static_cast<uint32_t>(fuse::kFuseMaxWrite));
 
+        if (mDirectBuffers != nullptr) {
+            // The request buffer is reused for the next request as soon as this returns, so
+            // the data has to be moved out of it for Java to handle the write asynchronously.
+            void* data;
+            jobject javaBuffer = mDirectBuffers->Acquire(mEnv, unique, &data);
+            if (javaBuffer == nullptr) {
+                ReplyNoMemory(unique);
+                return;
+            }
+            memcpy(data, buffer, size);
+            CallOnCommandDirect(FUSE_WRITE, unique, inode, offset, size, javaBuffer);
+            return;
+        }
+
         auto it = mBuffers.find(inode);
         CHECK(it != mBuffers.end());
 
@@ -112,54 +260,77 @@ private:
         mEnv->CallVoidMethod(mSelf, gOnCommandMethod, command, unique, inode, offset, size, bytes);
         CHECK(!mEnv->ExceptionCheck());
     }
+
+    void CallOnCommandDirect(jint command, jlong unique, jlong inode, jlong offset, jint size,
+                             jobject buffer) {
+        mEnv->CallVoidMethod(mSelf, gOnCommandDirectMethod, command, unique, inode, offset, size,
+                             buffer);
+        CHECK(!mEnv->ExceptionCheck());
+    }
+
+    void ReplyNoMemory(uint64_t unique) {
+        if (!mLoop->ReplySimple(unique, -ENOMEM)) {
+            mLoop->Break();
+        }
+    }
 };
 
 jlong com_android_internal_os_FuseAppLoop_new(JNIEnv* env, jobject self, jint jfd) {
-    return reinterpret_cast<jlong>(new fuse::FuseAppLoop(base::unique_fd(jfd)));
+    return reinterpret_cast<jlong>(new AppLoop(base::unique_fd(jfd)));
 }
 
 void com_android_internal_os_FuseAppLoop_delete(JNIEnv* env, jobject self, jlong ptr) {
-    delete reinterpret_cast<fuse::FuseAppLoop*>(ptr);
+    AppLoop* appLoop = ToAppLoop(ptr);
+    appLoop->buffers.Clear(env);
+    delete appLoop;
 }
 
 void com_android_internal_os_FuseAppLoop_start(JNIEnv* env, jobject self, jlong ptr) {
-    Callback callback(env, self);
-    reinterpret_cast<fuse::FuseAppLoop*>(ptr)->Start(&callback);
+    Callback callback(env, self, ToLoop(ptr), nullptr);
+    ToLoop(ptr)->Start(&callback);
+}
+
+void com_android_internal_os_FuseAppLoop_startDirect(JNIEnv* env, jobject self, jlong ptr) {
+    Callback callback(env, self, ToLoop(ptr), &ToAppLoop(ptr)->buffers);
+    ToLoop(ptr)->Start(&callback);
 }
 
 void com_android_internal_os_FuseAppLoop_replySimple(
         JNIEnv* env, jobject self, jlong ptr, jlong unique, jint result) {
-    if (!reinterpret_cast<fuse::FuseAppLoop*>(ptr)->ReplySimple(unique, result)) {
-        reinterpret_cast<fuse::FuseAppLoop*>(ptr)->Break();
+    // Failed reads and writes in direct mode are answered with a simple reply.
+    ToAppLoop(ptr)->buffers.Release(env, unique);
+    if (!ToLoop(ptr)->ReplySimple(unique, result)) {
+        ToLoop(ptr)->Break();
     }
 }
 
 void com_android_internal_os_FuseAppLoop_replyOpen(
         JNIEnv* env, jobject self, jlong ptr, jlong unique, jlong fh) {
-    if (!reinterpret_cast<fuse::FuseAppLoop*>(ptr)->ReplyOpen(unique, fh)) {
-        reinterpret_cast<fuse::FuseAppLoop*>(ptr)->Break();
+    if (!ToLoop(ptr)->ReplyOpen(unique, fh)) {
+        ToLoop(ptr)->Break();
     }
 }
 
 void com_android_internal_os_FuseAppLoop_replyLookup(
         JNIEnv* env, jobject self, jlong ptr, jlong unique, jlong inode, jlong size) {
-    if (!reinterpret_cast<fuse::FuseAppLoop*>(ptr)->ReplyLookup(unique, inode, size)) {
-        reinterpret_cast<fuse::FuseAppLoop*>(ptr)->Break();
+    if (!ToLoop(ptr)->ReplyLookup(unique, inode, size)) {
+        ToLoop(ptr)->Break();
     }
 }
 
 void com_android_internal_os_FuseAppLoop_replyGetAttr(
         JNIEnv* env, jobject self, jlong ptr, jlong unique, jlong inode, jlong size) {
-    if (!reinterpret_cast<fuse::FuseAppLoop*>(ptr)->ReplyGetAttr(
+    if (!ToLoop(ptr)->ReplyGetAttr(
             unique, inode, size, S_IFREG | 0777)) {
-        reinterpret_cast<fuse::FuseAppLoop*>(ptr)->Break();
+        ToLoop(ptr)->Break();
     }
 }
 
 void com_android_internal_os_FuseAppLoop_replyWrite(
         JNIEnv* env, jobject self, jlong ptr, jlong unique, jint size) {
-    if (!reinterpret_cast<fuse::FuseAppLoop*>(ptr)->ReplyWrite(unique, size)) {
-        reinterpret_cast<fuse::FuseAppLoop*>(ptr)->Break();
+    ToAppLoop(ptr)->buffers.Release(env, unique);
+    if (!ToLoop(ptr)->ReplyWrite(unique, size)) {
+        ToLoop(ptr)->Break();
     }
 }
 
@@ -168,8 +339,23 @@ void com_android_internal_os_FuseAppLoop_replyRead(
     ScopedByteArrayRO array(env, data);
     CHECK_GE(size, 0);
     CHECK_LE(static_cast<size_t>(size), array.size());
-    if (!reinterpret_cast<fuse::FuseAppLoop*>(ptr)->ReplyRead(unique, size, array.get())) {
-        reinterpret_cast<fuse::FuseAppLoop*>(ptr)->Break();
+    if (!ToLoop(ptr)->ReplyRead(unique, size, array.get())) {
+        ToLoop(ptr)->Break();
+    }
+}
+
+// Replies to a read in direct mode with the first size bytes of its buffer.
+void com_android_internal_os_FuseAppLoop_replyReadDirect(
+        JNIEnv* env, jobject self, jlong ptr, jlong unique, jint size) {
+    AppLoop* appLoop = ToAppLoop(ptr);
+    const void* data = appLoop->buffers.Get(unique);
+    CHECK(data != nullptr);
+    CHECK_GE(size, 0);
+    CHECK_LE(static_cast<size_t>(size), kDirectBufferSize);
+    bool replied = appLoop->loop.ReplyRead(unique, size, data);
+    appLoop->buffers.Release(env, unique);
+    if (!replied) {
+        appLoop->loop.Break();
     }
 }
 
@@ -189,6 +375,11 @@ const JNINativeMethod methods[] = {
         "(J)V",
         reinterpret_cast<void*>(com_android_internal_os_FuseAppLoop_start)
     },
+    {
+        "native_startDirect",
+        "(J)V",
+        reinterpret_cast<void*>(com_android_internal_os_FuseAppLoop_startDirect)
+    },
     {
         "native_replySimple",
         "(JJI)V",
@@ -214,6 +405,11 @@ const JNINativeMethod methods[] = {
         "(JJI[B)V",
         reinterpret_cast<void*>(com_android_internal_os_FuseAppLoop_replyRead)
     },
+    {
+        "native_replyReadDirect",
+        "(JJI)V",
+        reinterpret_cast<void*>(com_android_internal_os_FuseAppLoop_replyReadDirect)
+    },
     {
         "native_replyWrite",
         "(JJI)V",
@@ -225,6 +421,8 @@ const JNINativeMethod methods[] = {
 int register_com_android_internal_os_FuseAppLoop(JNIEnv* env) {
     gFuseAppLoopClass = MakeGlobalRefOrDie(env, FindClassOrDie(env, CLASS_NAME));
     gOnCommandMethod = GetMethodIDOrDie(env, gFuseAppLoopClass, "onCommand", "(IJJJI[B)V");
+    gOnCommandDirectMethod = GetMethodIDOrDie(env, gFuseAppLoopClass, "onCommandDirect",
+                                              "(IJJJILjava/nio/ByteBuffer;)V");
     gOnOpenMethod = GetMethodIDOrDie(env, gFuseAppLoopClass, "onOpen", "(JJ)[B");
     RegisterMethodsOrDie(env, CLASS_NAME, methods, NELEM(methods));
     return 0;
@@ -33,6 +33,16 @@ static struct {
 
 static jfieldID gmData;
 
+// Time of the last freq time read, shared by the full and the delta read so that each update is
+// handed to the Java side exactly once.
+static uint64_t gFreqTimeLastUpdate = 0;
+
+// A record of the delta read: a uid and the byte offset of its times in the buffer.
+struct UidRecord {
+    int32_t uid;
+    int32_t offset;
+};
+
 static jlongArray getUidArray(JNIEnv *env, jobject sparseAr, uint32_t uid, jsize sz) {
     jlongArray ar = (jlongArray)env->CallObjectMethod(sparseAr, gSparseArrayClassInfo.get, uid);
     if (!ar) {
@@ -62,8 +72,7 @@ static jboolean KernelCpuUidFreqTimeBpfMapReader_removeUidRange(JNIEnv *env, jcl
 }
 
 static jboolean KernelCpuUidFreqTimeBpfMapReader_readBpfData(JNIEnv *env, jobject thiz) {
-    static uint64_t lastUpdate = 0;
-    uint64_t newLastUpdate = lastUpdate;
+    uint64_t newLastUpdate = gFreqTimeLastUpdate;
     auto sparseAr = env->GetObjectField(thiz, gmData);
     if (sparseAr == NULL) return false;
     auto data = android::bpf::getUidsUpdatedCpuFreqTimes(&newLastUpdate);
@@ -78,10 +87,51 @@ static jboolean KernelCpuUidFreqTimeBpfMapReader_readBpfData(JNIEnv *env, jobjec
         if (ar == NULL) return false;
         copy2DVecToArray(env, ar, times);
     }
-    lastUpdate = newLastUpdate;
+    gFreqTimeLastUpdate = newLastUpdate;
     return true;
 }
 
+/*
+ * Writes the times of the uids updated since the last read into a direct ByteBuffer, in native
+ * byte order: one UidRecord per uid, followed by the times of each uid in milliseconds, one long
+ * per frequency. Returns the number of records, or -1 on failure. If the buffer is too small,
+ * nothing is consumed and the negated number of bytes needed is returned.
+ */
+static jint KernelCpuUidFreqTimeBpfMapReader_readBpfDataDelta(JNIEnv *env, jobject,
+                                                              jobject buffer) {
+    auto dst = static_cast<uint8_t *>(env->GetDirectBufferAddress(buffer));
+    jlong capacity = env->GetDirectBufferCapacity(buffer);
+    if (dst == NULL || capacity < 0) return -1;
+
+    uint64_t newLastUpdate = gFreqTimeLastUpdate;
+    auto data = android::bpf::getUidsUpdatedCpuFreqTimes(&newLastUpdate);
+    if (!data.has_value()) return -1;
+    if (data->empty()) {
+        gFreqTimeLastUpdate = newLastUpdate;
+        return 0;
+    }
+
+    size_t timesPerUid = 0;
+    for (const auto &subVec : data->begin()->second) timesPerUid += subVec.size();
+    const size_t recordsSize = data->size() * sizeof(UidRecord);
+    const size_t required = recordsSize + data->size() * timesPerUid * sizeof(jlong);
+    if (required > INT32_MAX) return -1;
+    if (required > static_cast<uint64_t>(capacity)) return -static_cast<jint>(required);
+
+    auto record = reinterpret_cast<UidRecord *>(dst);
+    auto times = reinterpret_cast<jlong *>(dst + recordsSize);
+    for (const auto &[uid, uidTimes] : *data) {
+        record->uid = uid;
+        record->offset = reinterpret_cast<uint8_t *>(times) - dst;
+        ++record;
+        for (const auto &subVec : uidTimes) {
+            for (uint64_t time : subVec) *times++ = time / NSEC_PER_MSEC;
+        }
+    }
+    gFreqTimeLastUpdate = newLastUpdate;
+    return data->size();
+}
+
 static jlongArray KernelCpuUidFreqTimeBpfMapReader_getDataDimensions(JNIEnv *env, jobject) {
     auto freqs = android::bpf::getCpuFreqs();
     if (!freqs) return NULL;
@@ -100,6 +150,8 @@ static jlongArray KernelCpuUidFreqTimeBpfMapReader_getDataDimensions(JNIEnv *env
 static const JNINativeMethod gFreqTimeMethods[] = {
         {"removeUidRange", "(II)Z", (void *)KernelCpuUidFreqTimeBpfMapReader_removeUidRange},
         {"readBpfData", "()Z", (void *)KernelCpuUidFreqTimeBpfMapReader_readBpfData},
+        {"readBpfDataDelta", "(Ljava/nio/ByteBuffer;)I",
+         (void *)KernelCpuUidFreqTimeBpfMapReader_readBpfDataDelta},
         {"getDataDimensions", "()[J", (void *)KernelCpuUidFreqTimeBpfMapReader_getDataDimensions},
 };
 
@@ -32,8 +32,10 @@
 #include <sys/mount.h>
 #include <linux/fs.h>
 
+#include <algorithm>
 #include <array>
 #include <atomic>
+#include <cmath>
 #include <functional>
 #include <list>
 #include <optional>
@@ -79,6 +81,7 @@
 #include <cutils/multiuser.h>
 #include <private/android_filesystem_config.h>
 #include <utils/String8.h>
+#include <utils/Timers.h>
 #include <utils/Trace.h>
 #include <selinux/android.h>
 #include <seccomp_policy.h>
@@ -299,6 +302,98 @@ static std::array<UsapTableEntry, USAP_POOL_SIZE_MAX_LIMIT> gUsapTable;
  */
 static FileDescriptorTable* gOpenFdTable = nullptr;
 
+/**
+ * Time spent creating or restating gOpenFdTable before each fork. Only
+ * touched on the zygote's main thread.
+ */
+static struct {
+  int64_t count;
+  nsecs_t last_ns;
+  nsecs_t max_ns;
+  nsecs_t total_ns;
+} gFdTableStats;
+
+/**
+ * Tracks how quickly apps are being launched so that the USAP pool can be
+ * sized ahead of launch bursts rather than refilled against fixed thresholds.
+ * Only used from the zygote's main thread.
+ */
+class UsapPoolDemand {
+ public:
+  /**
+   * Records an app launch that was either served by a USAP from the pool
+   * (a hit) or had to be forked from the zygote (a miss).
+   */
+  void RecordLaunch(bool hit) {
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    mLaunchRate = DecayedRate(now) + 1.0 / kRateTimeConstantSeconds;
+    mLastLaunchTime = now;
+    if (hit) {
+      ++mHits;
+    } else {
+      ++mMisses;
+    }
+  }
+
+  /**
+   * @return The number of USAPs the pool should hold to absorb the launches
+   * expected before it can be refilled, clamped to [min_size, max_size].
+   * Returns min_size while the system is under memory pressure, so that the
+   * pool shrinks instead of competing with running apps for memory.
+   */
+  int GetTargetSize(int min_size, int max_size) const {
+    if (IsUnderMemoryPressure()) {
+      return min_size;
+    }
+
+    const double expected_launches =
+        DecayedRate(systemTime(SYSTEM_TIME_MONOTONIC)) * kRefillHorizonSeconds;
+    const double target = min_size + std::ceil(expected_launches);
+    return static_cast<int>(std::min(target, static_cast<double>(max_size)));
+  }
+
+  int64_t GetHits() const { return mHits; }
+  int64_t GetMisses() const { return mMisses; }
+
+ private:
+  /** Time constant, in seconds, of the exponentially decayed launch rate. */
+  static constexpr double kRateTimeConstantSeconds = 5.0;
+
+  /** How far ahead, in seconds, the pool should cover the current launch rate. */
+  static constexpr double kRefillHorizonSeconds = 10.0;
+
+  /** Share of time, in percent, some task stalls on memory above which the pool shrinks. */
+  static constexpr double kMemoryPressureThreshold = 10.0;
+
+  /** @return The launch rate, in launches per second, decayed to |now|. */
+  double DecayedRate(nsecs_t now) const {
+    if (mLastLaunchTime == 0) {
+      return 0.0;
+    }
+    const double elapsed_seconds = static_cast<double>(now - mLastLaunchTime) / s2ns(1);
+    return mLaunchRate * std::exp(-elapsed_seconds / kRateTimeConstantSeconds);
+  }
+
+  static bool IsUnderMemoryPressure() {
+    std::string psi;
+    if (!android::base::ReadFileToString("/proc/pressure/memory", &psi)) {
+      return false;
+    }
+    double some_avg10;
+    if (sscanf(psi.c_str(), "some avg10=%lf", &some_avg10) != 1) {
+      return false;
+    }
+    return some_avg10 > kMemoryPressureThreshold;
+  }
+
+  double mLaunchRate = 0.0;
+  nsecs_t mLastLaunchTime = 0;
+  int64_t mHits = 0;
+  int64_t mMisses = 0;
+};
+
+static UsapPoolDemand gUsapPoolDemand;
+
 // Must match values in com.android.internal.os.Zygote.
 enum MountExternalKind {
   MOUNT_EXTERNAL_NONE = 0,
@@ -1011,10 +1106,19 @@ static pid_t ForkCommon(JNIEnv* env, bool is_system_server,
   // If this is the first fork for this zygote, create the open FD table.  If
   // it isn't, we just need to check whether the list of open files has changed
   // (and it shouldn't in the normal case).
-  if (gOpenFdTable == nullptr) {
-    gOpenFdTable = FileDescriptorTable::Create(fds_to_ignore, fail_fn);
-  } else {
-    gOpenFdTable->Restat(fds_to_ignore, fail_fn);
+  {
+    ATRACE_NAME("ZygoteFdTable");
+    const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (gOpenFdTable == nullptr) {
+      gOpenFdTable = FileDescriptorTable::Create(fds_to_ignore, fail_fn);
+    } else {
+      gOpenFdTable->Restat(fds_to_ignore, fail_fn);
+    }
+    const nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    gFdTableStats.count++;
+    gFdTableStats.last_ns = elapsed;
+    gFdTableStats.max_ns = std::max(gFdTableStats.max_ns, elapsed);
+    gFdTableStats.total_ns += elapsed;
   }
 
   android_fdsan_error_level fdsan_error_level = android_fdsan_get_error_level();
@@ -1046,7 +1150,10 @@ static pid_t ForkCommon(JNIEnv* env, bool is_system_server,
 
     // Re-open all remaining open file descriptors so that they aren't shared
     // with the zygote across a fork.
-    gOpenFdTable->ReopenOrDetach(fail_fn);
+    {
+      ATRACE_NAME("ReopenOrDetach");
+      gOpenFdTable->ReopenOrDetach(fail_fn);
+    }
 
     // Turn fdsan back on.
     android_fdsan_set_error_level(fdsan_error_level);
@@ -1529,6 +1636,9 @@ static jint com_android_internal_os_Zygote_nativeForkAndSpecialize(
                        mount_external, se_info, nice_name, false,
                        is_child_zygote == JNI_TRUE, instruction_set, app_data_dir,
                        is_top_app == JNI_TRUE);
+    } else if (pid > 0 && gUsapPoolEventFD != -1 && is_child_zygote == JNI_FALSE) {
+      // The USAP pool is in use but this launch couldn't be served from it.
+      gUsapPoolDemand.RecordLaunch(/* hit= */ false);
     }
     return pid;
 }
@@ -1783,7 +1893,12 @@ static jintArray com_android_internal_os_Zygote_nativeGetUsapPipeFDs(JNIEnv* env
  */
 static jboolean com_android_internal_os_Zygote_nativeRemoveUsapTableEntry(JNIEnv* env, jclass,
                                                                           jint usap_pid) {
-  return RemoveUsapTableEntry(usap_pid);
+  // Managed code only removes USAPs that have reported their specialization.
+  if (RemoveUsapTableEntry(usap_pid)) {
+    gUsapPoolDemand.RecordLaunch(/* hit= */ true);
+    return JNI_TRUE;
+  }
+  return JNI_FALSE;
 }
 
 /**
@@ -1812,6 +1927,48 @@ static jint com_android_internal_os_Zygote_nativeGetUsapPoolCount(JNIEnv* env, j
   return gUsapPoolCount;
 }
 
+/**
+ * @param env  Managed runtime environment
+ * @param min_size  The smallest pool size to return
+ * @param max_size  The largest pool size to return
+ * @return The number of USAPs the pool should be refilled to, predicted from
+ *         the recent launch rate and reduced under memory pressure
+ */
+static jint com_android_internal_os_Zygote_nativeGetUsapPoolTargetSize(JNIEnv* env, jclass,
+                                                                       jint min_size,
+                                                                       jint max_size) {
+  return gUsapPoolDemand.GetTargetSize(min_size, max_size);
+}
+
+/**
+ * @param env  Managed runtime environment
+ * @return {hits, misses}: launches served by a USAP and launches that had to
+ *         fork from the zygote while the USAP pool was enabled
+ */
+static jlongArray com_android_internal_os_Zygote_nativeGetUsapPoolStats(JNIEnv* env, jclass) {
+  const jlong stats[] = {gUsapPoolDemand.GetHits(), gUsapPoolDemand.GetMisses()};
+  jlongArray result = env->NewLongArray(NELEM(stats));
+  if (result != nullptr) {
+    env->SetLongArrayRegion(result, 0, NELEM(stats), stats);
+  }
+  return result;
+}
+
+/**
+ * @param env  Managed runtime environment
+ * @return {count, last, max, total} of the time in nanoseconds spent
+ *         validating the zygote's open file descriptors before a fork
+ */
+static jlongArray com_android_internal_os_Zygote_nativeGetFdTableStats(JNIEnv* env, jclass) {
+  const jlong stats[] = {gFdTableStats.count, gFdTableStats.last_ns, gFdTableStats.max_ns,
+                         gFdTableStats.total_ns};
+  jlongArray result = env->NewLongArray(NELEM(stats));
+  if (result != nullptr) {
+    env->SetLongArrayRegion(result, 0, NELEM(stats), stats);
+  }
+  return result;
+}
+
 /**
  * Kills all processes currently in the USAP pool and closes their read pipe
  * FDs.
@@ -1935,6 +2092,12 @@ static const JNINativeMethod gMethods[] = {
       (void *) com_android_internal_os_Zygote_nativeGetUsapPoolEventFD },
     { "nativeGetUsapPoolCount", "()I",
       (void *) com_android_internal_os_Zygote_nativeGetUsapPoolCount },
+    { "nativeGetUsapPoolTargetSize", "(II)I",
+      (void *) com_android_internal_os_Zygote_nativeGetUsapPoolTargetSize },
+    { "nativeGetUsapPoolStats", "()[J",
+      (void *) com_android_internal_os_Zygote_nativeGetUsapPoolStats },
+    { "nativeGetFdTableStats", "()[J",
+      (void *) com_android_internal_os_Zygote_nativeGetFdTableStats },
     { "nativeEmptyUsapPool", "()V",
       (void *) com_android_internal_os_Zygote_nativeEmptyUsapPool },
     { "nativeBlockSigTerm", "()V",
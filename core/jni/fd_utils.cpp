@@ -30,6 +30,7 @@
 #include <android-base/logging.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
+#include <android-base/unique_fd.h>
 
 // Static whitelist of open paths that the zygote is allowed to keep open.
 static const char* kPathWhitelist[] = {
@@ -180,7 +181,14 @@ class FileDescriptorInfo {
   // refers to the same description.
   bool RefersToSameFile() const;
 
-  void ReopenOrDetach(fail_fn_t fail_fn) const;
+  // Returns a copy of this object carrying the current flags of |fd|, or
+  // nullptr if they haven't changed. The path was validated when this object
+  // was created, so a descriptor that still refers to the same file doesn't
+  // need another readlink() and whitelist check.
+  FileDescriptorInfo* WithCurrentFlags(fail_fn_t fail_fn) const;
+
+  // |dev_null_fd| is opened on first use and shared by all detached sockets.
+  void ReopenOrDetach(fail_fn_t fail_fn, android::base::unique_fd* dev_null_fd) const;
 
   const int fd;
   const struct stat stat;
@@ -192,11 +200,16 @@ class FileDescriptorInfo {
   const bool is_sock;
 
  private:
-  explicit FileDescriptorInfo(int fd);
+  // Creates a FileDescriptorInfo for a socket. The stat is kept so that
+  // RefersToSameFile() holds across restats.
+  FileDescriptorInfo(struct stat stat, int fd);
 
   FileDescriptorInfo(struct stat stat, const std::string& file_path, int fd, int open_flags,
                      int fd_flags, int fs_flags, off_t offset);
 
+  static void GetFlags(int fd, const std::string& file_path, fail_fn_t fail_fn,
+                       int* fd_flags, int* open_flags, int* fs_flags);
+
   // Returns the locally-bound name of the socket |fd|. Returns true
   // iff. all of the following hold :
   //
@@ -206,7 +219,7 @@ class FileDescriptorInfo {
   //   address).
   static bool GetSocketName(const int fd, std::string* result);
 
-  void DetachSocket(fail_fn_t fail_fn) const;
+  void DetachSocket(fail_fn_t fail_fn, android::base::unique_fd* dev_null_fd) const;
 
   DISALLOW_COPY_AND_ASSIGN(FileDescriptorInfo);
 };
@@ -234,7 +247,7 @@ FileDescriptorInfo* FileDescriptorInfo::CreateFromFd(int fd, fail_fn_t fail_fn)
                                           fd));
     }
 
-    return new FileDescriptorInfo(fd);
+    return new FileDescriptorInfo(f_stat, fd);
   }
 
   // We only handle whitelisted regular files and character devices. Whitelisted
@@ -275,11 +288,25 @@ FileDescriptorInfo* FileDescriptorInfo::CreateFromFd(int fd, fail_fn_t fail_fn)
     fail_fn(android::base::StringPrintf("Not whitelisted (%d): %s", fd, file_path.c_str()));
   }
 
+  int fd_flags;
+  int open_flags;
+  int fs_flags;
+  GetFlags(fd, file_path, fail_fn, &fd_flags, &open_flags, &fs_flags);
+
+  // File offset : Ignore the offset for non seekable files.
+  const off_t offset = TEMP_FAILURE_RETRY(lseek64(fd, 0, SEEK_CUR));
+
+  return new FileDescriptorInfo(f_stat, file_path, fd, open_flags, fd_flags, fs_flags, offset);
+}
+
+// static
+void FileDescriptorInfo::GetFlags(int fd, const std::string& file_path, fail_fn_t fail_fn,
+                                  int* fd_flags, int* open_flags, int* fs_flags) {
   // File descriptor flags : currently on FD_CLOEXEC. We can set these
   // using F_SETFD - we're single threaded at this point of execution so
   // there won't be any races.
-  const int fd_flags = TEMP_FAILURE_RETRY(fcntl(fd, F_GETFD));
-  if (fd_flags == -1) {
+  *fd_flags = TEMP_FAILURE_RETRY(fcntl(fd, F_GETFD));
+  if (*fd_flags == -1) {
     fail_fn(android::base::StringPrintf("Failed fcntl(%d, F_GETFD) (%s): %s",
                                         fd,
                                         file_path.c_str(),
@@ -298,24 +325,19 @@ FileDescriptorInfo* FileDescriptorInfo::CreateFromFd(int fd, fail_fn_t fail_fn)
   //   can only set O_APPEND, O_ASYNC, O_DIRECT, O_NOATIME, and O_NONBLOCK.
   //   In particular, it can't set O_SYNC and O_DSYNC. We'll have to test for
   //   their presence and pass them in to open().
-  int fs_flags = TEMP_FAILURE_RETRY(fcntl(fd, F_GETFL));
-  if (fs_flags == -1) {
+  const int status_flags = TEMP_FAILURE_RETRY(fcntl(fd, F_GETFL));
+  if (status_flags == -1) {
     fail_fn(android::base::StringPrintf("Failed fcntl(%d, F_GETFL) (%s): %s",
                                         fd,
                                         file_path.c_str(),
                                         strerror(errno)));
   }
 
-  // File offset : Ignore the offset for non seekable files.
-  const off_t offset = TEMP_FAILURE_RETRY(lseek64(fd, 0, SEEK_CUR));
-
   // We pass the flags that open accepts to open, and use F_SETFL for
   // the rest of them.
   static const int kOpenFlags = (O_RDONLY | O_WRONLY | O_RDWR | O_DSYNC | O_SYNC);
-  int open_flags = fs_flags & (kOpenFlags);
-  fs_flags = fs_flags & (~(kOpenFlags));
-
-  return new FileDescriptorInfo(f_stat, file_path, fd, open_flags, fd_flags, fs_flags, offset);
+  *open_flags = status_flags & (kOpenFlags);
+  *fs_flags = status_flags & (~(kOpenFlags));
 }
 
 bool FileDescriptorInfo::RefersToSameFile() const {
@@ -328,9 +350,28 @@ bool FileDescriptorInfo::RefersToSameFile() const {
   return f_stat.st_ino == stat.st_ino && f_stat.st_dev == stat.st_dev;
 }
 
-void FileDescriptorInfo::ReopenOrDetach(fail_fn_t fail_fn) const {
+FileDescriptorInfo* FileDescriptorInfo::WithCurrentFlags(fail_fn_t fail_fn) const {
+  // Sockets are detached rather than reopened, so their flags don't matter.
   if (is_sock) {
-    return DetachSocket(fail_fn);
+    return nullptr;
+  }
+
+  int new_fd_flags;
+  int new_open_flags;
+  int new_fs_flags;
+  GetFlags(fd, file_path, fail_fn, &new_fd_flags, &new_open_flags, &new_fs_flags);
+  if (new_fd_flags == fd_flags && new_open_flags == open_flags && new_fs_flags == fs_flags) {
+    return nullptr;
+  }
+
+  return new FileDescriptorInfo(stat, file_path, fd, new_open_flags, new_fd_flags, new_fs_flags,
+                                offset);
+}
+
+void FileDescriptorInfo::ReopenOrDetach(fail_fn_t fail_fn,
+                                        android::base::unique_fd* dev_null_fd) const {
+  if (is_sock) {
+    return DetachSocket(fail_fn, dev_null_fd);
   }
 
   // Children can directly use the in-memory file created by ART through memfd_create.
@@ -390,9 +431,9 @@ void FileDescriptorInfo::ReopenOrDetach(fail_fn_t fail_fn) const {
   close(new_fd);
 }
 
-FileDescriptorInfo::FileDescriptorInfo(int fd) :
+FileDescriptorInfo::FileDescriptorInfo(struct stat stat, int fd) :
   fd(fd),
-  stat(),
+  stat(stat),
   open_flags(0),
   fd_flags(0),
   fs_flags(0),
@@ -456,21 +497,20 @@ bool FileDescriptorInfo::GetSocketName(const int fd, std::string* result) {
   return true;
 }
 
-void FileDescriptorInfo::DetachSocket(fail_fn_t fail_fn) const {
-  const int dev_null_fd = open("/dev/null", O_RDWR | O_CLOEXEC);
-  if (dev_null_fd < 0) {
-    fail_fn(std::string("Failed to open /dev/null: ").append(strerror(errno)));
+void FileDescriptorInfo::DetachSocket(fail_fn_t fail_fn,
+                                      android::base::unique_fd* dev_null_fd) const {
+  if (dev_null_fd->get() == -1) {
+    dev_null_fd->reset(open("/dev/null", O_RDWR | O_CLOEXEC));
+    if (dev_null_fd->get() == -1) {
+      fail_fn(std::string("Failed to open /dev/null: ").append(strerror(errno)));
+    }
   }
 
-  if (dup3(dev_null_fd, fd, O_CLOEXEC) == -1) {
+  if (dup3(dev_null_fd->get(), fd, O_CLOEXEC) == -1) {
     fail_fn(android::base::StringPrintf("Failed dup3 on socket descriptor %d: %s",
                                         fd,
                                         strerror(errno)));
   }
-
-  if (close(dev_null_fd) == -1) {
-    fail_fn(android::base::StringPrintf("Failed close(%d): %s", dev_null_fd, strerror(errno)));
-  }
 }
 
 // static
@@ -540,13 +580,14 @@ void FileDescriptorTable::Restat(const std::vector<int>& fds_to_ignore, fail_fn_
 
 // Reopens all file descriptors that are contained in the table.
 void FileDescriptorTable::ReopenOrDetach(fail_fn_t fail_fn) {
+  android::base::unique_fd dev_null_fd;
   std::unordered_map<int, FileDescriptorInfo*>::const_iterator it;
   for (it = open_fd_map_.begin(); it != open_fd_map_.end(); ++it) {
     const FileDescriptorInfo* info = it->second;
     if (info == nullptr) {
       return;
     } else {
-      info->ReopenOrDetach(fail_fn);
+      info->ReopenOrDetach(fail_fn, &dev_null_fd);
     }
   }
 }
@@ -589,8 +630,13 @@ void FileDescriptorTable::RestatInternal(std::set<int>& open_fds, fail_fn_t fail
         delete it->second;
         it->second = FileDescriptorInfo::CreateFromFd(*element, fail_fn);
       } else {
-        // It's the same file. Nothing to do here. Move on to the next open
-        // FD.
+        // It's the same file. Only its flags may have changed since we last
+        // looked, and those are cheap to check.
+        FileDescriptorInfo* updated = it->second->WithCurrentFlags(fail_fn);
+        if (updated != nullptr) {
+          delete it->second;
+          it->second = updated;
+        }
       }
 
       if (IsArtMemfd(it->second->file_path)) {
@@ -82,6 +82,28 @@ native_handle_t *EphemeralStorage::allocTemporaryNativeHandle(
     return static_cast<native_handle_t*>(item.mPtr);
 }
 
+const hidl_vec<jbyte> *EphemeralStorage::allocTemporaryDirectBufferVector(
+        JNIEnv *env, jobject bufferObj, size_t size) {
+    jbyte *val = static_cast<jbyte *>(env->GetDirectBufferAddress(bufferObj));
+    jlong capacity = env->GetDirectBufferCapacity(bufferObj);
+    if (val == nullptr || capacity < 0 || size > static_cast<size_t>(capacity)) {
+        return nullptr;
+    }
+
+    Item item;
+    item.mType = TYPE_DIRECT_BUFFER;
+    item.mObj = env->NewGlobalRef(bufferObj);
+    item.mPtr = val;
+    mItems.push_back(item);
+
+    void *vecPtr = allocTemporaryStorage(sizeof(hidl_vec<jbyte>));
+
+    hidl_vec<jbyte> *vec = new (vecPtr) hidl_vec<jbyte>;
+    vec->setToExternal(val, size);
+
+    return vec;
+}
+
 #define DEFINE_ALLOC_VECTOR_METHODS(Suffix,Type,NewType)                       \
 const hidl_vec<Type> *EphemeralStorage::allocTemporary ## Suffix ## Vector(    \
         JNIEnv *env, Type ## Array arrayObj) {                                 \
@@ -156,6 +178,12 @@ void EphemeralStorage::release(JNIEnv *env) {
             DEFINE_RELEASE_ARRAY_CASE(Float,jfloat,Float)
             DEFINE_RELEASE_ARRAY_CASE(Double,jdouble,Double)
 
+            case TYPE_DIRECT_BUFFER:
+            {
+                env->DeleteGlobalRef(item.mObj);
+                break;
+            }
+
             case TYPE_NATIVE_HANDLE:
             {
                 int err = native_handle_delete(static_cast<native_handle_t *>(item.mPtr));
@@ -45,6 +45,12 @@ struct EphemeralStorage {
 
     native_handle_t *allocTemporaryNativeHandle(int numFds, int numInts);
 
+    // Returns a vector over the first size bytes of the direct ByteBuffer bufferObj, which
+    // is kept alive until release. Returns nullptr if bufferObj isn't a direct buffer or is
+    // smaller than size.
+    const ::android::hardware::hidl_vec<jbyte> *allocTemporaryDirectBufferVector(
+            JNIEnv *env, jobject bufferObj, size_t size);
+
     DECLARE_ALLOC_METHODS(Int8,jbyte)
     DECLARE_ALLOC_METHODS(Int16,jshort)
     DECLARE_ALLOC_METHODS(Int32,jint)
@@ -64,6 +70,7 @@ private:
         TYPE_Float_ARRAY,
         TYPE_Double_ARRAY,
         TYPE_NATIVE_HANDLE,
+        TYPE_DIRECT_BUFFER,
     };
 
     struct Item {
@@ -16,7 +16,16 @@
 
 #include "androidfw/ApkAssets.h"
 
+#include <fcntl.h>
+#include <sys/stat.h>
+
 #include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <tuple>
 
 #include "android-base/errors.h"
 #include "android-base/file.h"
@@ -25,8 +34,10 @@
 #include "android-base/utf8.h"
 #include "utils/Compat.h"
 #include "utils/FileMap.h"
+#include "utils/Trace.h"
 #include "ziparchive/zip_archive.h"
 
+#include "androidfw/ArscIndex.h"
 #include "androidfw/Asset.h"
 #include "androidfw/Idmap.h"
 #include "androidfw/misc.h"
@@ -40,6 +51,32 @@ using base::unique_fd;
 
 static const std::string kResourcesArsc("resources.arsc");
 
+// Where the system keeps generated resource data, such as IDMAPs.
+static const std::string kResourceCacheDir("/data/resource-cache/");
+
+// Maps the file at `index_path`, if it can be read.
+static std::unique_ptr<FileMap> MapArscIndex(const std::string& index_path) {
+  unique_fd fd(base::utf8::open(index_path.c_str(), O_RDONLY | O_BINARY | O_CLOEXEC));
+  if (fd == -1) {
+    // Most APKs have no index.
+    return {};
+  }
+
+  const off64_t file_len = lseek64(fd, 0, SEEK_END);
+  if (file_len <= 0) {
+    return {};
+  }
+
+  std::unique_ptr<FileMap> file_map = util::make_unique<FileMap>();
+  if (!file_map->create(index_path.c_str(), fd, 0, static_cast<size_t>(file_len),
+                        true /*readOnly*/)) {
+    LOG(WARNING) << "Failed to mmap resource table index '" << index_path
+                 << "': " << SystemErrorCodeToString(errno);
+    return {};
+  }
+  return file_map;
+}
+
 ApkAssets::ApkAssets(ZipArchiveHandle unmanaged_handle,
                      const std::string& path,
                      time_t last_mod_time)
@@ -84,6 +121,137 @@ std::unique_ptr<const ApkAssets> ApkAssets::LoadFromFd(unique_fd fd,
                   system, force_shared_lib);
 }
 
+namespace {
+
+// The most loads LoadAll() runs at once. Loading is mostly spent on I/O and page faults, so a
+// few threads are enough to overlap them.
+constexpr size_t kMaxLoadThreads = 4u;
+
+// Identifies the file an ApkAssets was loaded from, and how it was loaded.
+using LoadedFileKey =
+    std::tuple<std::string, ApkAssets::LoadRequest::Kind, bool, dev_t, ino_t, time_t>;
+
+std::mutex gLoadedFilesLock;
+
+// Entries expire once nothing uses their ApkAssets anymore.
+std::map<LoadedFileKey, std::weak_ptr<const ApkAssets>> gLoadedFiles;
+
+std::unique_ptr<const ApkAssets> LoadRequested(const ApkAssets::LoadRequest& request) {
+  switch (request.kind) {
+    case ApkAssets::LoadRequest::Kind::kSharedLibrary:
+      return ApkAssets::LoadAsSharedLibrary(request.path, request.system);
+    case ApkAssets::LoadRequest::Kind::kOverlay:
+      return ApkAssets::LoadOverlay(request.path, request.system);
+    default:
+      return ApkAssets::Load(request.path, request.system);
+  }
+}
+
+std::shared_ptr<const ApkAssets> LoadShared(const ApkAssets::LoadRequest& request) {
+  struct stat sb;
+  if (stat(request.path.c_str(), &sb) != 0) {
+    // Fails below with the same error as the other Load methods.
+    return LoadRequested(request);
+  }
+
+  const LoadedFileKey key(request.path, request.kind, request.system, sb.st_dev, sb.st_ino,
+                          sb.st_mtime);
+  {
+    std::lock_guard<std::mutex> lock(gLoadedFilesLock);
+    auto iter = gLoadedFiles.find(key);
+    if (iter != gLoadedFiles.end()) {
+      std::shared_ptr<const ApkAssets> apk_assets = iter->second.lock();
+      // The APK of an overlay is not the file of the key.
+      if (apk_assets != nullptr && apk_assets->IsUpToDate()) {
+        return apk_assets;
+      }
+      gLoadedFiles.erase(iter);
+    }
+  }
+
+  std::shared_ptr<const ApkAssets> apk_assets = LoadRequested(request);
+  if (apk_assets != nullptr) {
+    std::lock_guard<std::mutex> lock(gLoadedFilesLock);
+    // Drop what expired, so that the map does not grow with every APK ever loaded.
+    for (auto iter = gLoadedFiles.begin(); iter != gLoadedFiles.end();) {
+      iter = iter->second.expired() ? gLoadedFiles.erase(iter) : std::next(iter);
+    }
+    // If another thread loaded the same file meanwhile, both copies stay valid; the map keeps
+    // the last one.
+    gLoadedFiles[key] = apk_assets;
+  }
+  return apk_assets;
+}
+
+}  // namespace
+
+std::vector<std::shared_ptr<const ApkAssets>> ApkAssets::LoadAll(
+    const std::vector<LoadRequest>& requests) {
+  ATRACE_NAME("ApkAssets::LoadAll");
+  std::vector<std::shared_ptr<const ApkAssets>> result(requests.size());
+  std::atomic<size_t> next_request{0u};
+  auto load = [&]() {
+    for (size_t i = next_request++; i < requests.size(); i = next_request++) {
+      result[i] = LoadShared(requests[i]);
+    }
+  };
+
+  // The calling thread loads too.
+  const size_t thread_count = std::min(requests.size(), kMaxLoadThreads);
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < thread_count; i++) {
+    threads.emplace_back(load);
+  }
+  load();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  return result;
+}
+
+bool ApkAssets::CreateArscIndex(const std::string& path, const std::string& index_path) {
+  std::unique_ptr<const ApkAssets> apk_assets = Load(path);
+  if (apk_assets == nullptr || apk_assets->resources_asset_ == nullptr) {
+    return false;
+  }
+
+  ::ZipEntry entry;
+  if (::FindEntry(apk_assets->zip_handle_.get(), kResourcesArsc, &entry) != 0) {
+    return false;
+  }
+
+  const StringPiece data(
+      reinterpret_cast<const char*>(apk_assets->resources_asset_->getBuffer(true /*wordAligned*/)),
+      apk_assets->resources_asset_->getLength());
+  std::string index;
+  if (!LoadedArscIndex::Create(data, entry.crc32, &index)) {
+    return false;
+  }
+
+  // Written aside and then renamed, so that loading the APK meanwhile never reads half an index.
+  const std::string temp_path = index_path + ".tmp";
+  if (!base::WriteStringToFile(index, temp_path)) {
+    LOG(ERROR) << "Failed to write '" << temp_path << "': " << SystemErrorCodeToString(errno);
+    return false;
+  }
+
+  if (rename(temp_path.c_str(), index_path.c_str()) != 0) {
+    LOG(ERROR) << "Failed to rename '" << temp_path << "' to '" << index_path
+               << "': " << SystemErrorCodeToString(errno);
+    std::remove(temp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+std::string ApkAssets::GetArscIndexPath(const std::string& path) {
+  // Same naming as the IDMAPs next to it, e.g. system@framework@framework-res.apk@arscidx.
+  const size_t start = path.find_first_not_of('/');
+  std::string name = start == std::string::npos ? std::string() : path.substr(start);
+  std::replace(name.begin(), name.end(), '/', '@');
+  return kResourceCacheDir + name + "@arscidx";
+}
+
 std::unique_ptr<Asset> ApkAssets::CreateAssetFromFile(const std::string& path) {
   unique_fd fd(base::utf8::open(path.c_str(), O_RDONLY | O_BINARY | O_CLOEXEC));
   if (fd == -1) {
@@ -153,8 +321,21 @@ std::unique_ptr<const ApkAssets> ApkAssets::LoadImpl(
   const StringPiece data(
       reinterpret_cast<const char*>(loaded_apk->resources_asset_->getBuffer(true /*wordAligned*/)),
       loaded_apk->resources_asset_->getLength());
-  loaded_apk->loaded_arsc_ =
-      LoadedArsc::Load(data, loaded_idmap.get(), system, load_as_shared_library);
+
+  // Overlays have their types remapped by the IDMAP, so they always walk the table.
+  std::unique_ptr<const LoadedArscIndex> arsc_index;
+  if (loaded_idmap == nullptr) {
+    std::unique_ptr<FileMap> index_map = MapArscIndex(GetArscIndexPath(path));
+    if (index_map != nullptr) {
+      arsc_index = LoadedArscIndex::Load(
+          StringPiece(reinterpret_cast<const char*>(index_map->getDataPtr()),
+                      index_map->getDataLength()),
+          data, entry.crc32);
+    }
+  }
+
+  loaded_apk->loaded_arsc_ = LoadedArsc::Load(data, loaded_idmap.get(), system,
+                                              load_as_shared_library, arsc_index.get());
   if (loaded_apk->loaded_arsc_ == nullptr) {
     LOG(ERROR) << "Failed to load '" << kResourcesArsc << "' in APK '" << path << "'.";
     return {};
@@ -164,6 +345,26 @@ std::unique_ptr<const ApkAssets> ApkAssets::LoadImpl(
   return std::move(loaded_apk);
 }
 
+// Tells the kernel how the mapped data of an entry opened with `mode` is going to be read, so
+// that readahead neither thrashes on random access nor stops short on sequential reads.
+static void AdviseMap(FileMap* map, Asset::AccessMode mode, bool compressed) {
+  switch (mode) {
+    case Asset::ACCESS_BUFFER:
+      // The whole entry is read right away, start paging it in now.
+      map->advise(FileMap::WILLNEED);
+      break;
+    case Asset::ACCESS_STREAMING:
+      map->advise(FileMap::SEQUENTIAL);
+      break;
+    case Asset::ACCESS_RANDOM:
+      // Compressed data is only ever inflated front to back.
+      map->advise(compressed ? FileMap::SEQUENTIAL : FileMap::RANDOM);
+      break;
+    default:
+      break;
+  }
+}
+
 std::unique_ptr<Asset> ApkAssets::Open(const std::string& path, Asset::AccessMode mode) const {
   CHECK(zip_handle_ != nullptr);
 
@@ -180,6 +381,7 @@ std::unique_ptr<Asset> ApkAssets::Open(const std::string& path, Asset::AccessMod
       LOG(ERROR) << "Failed to mmap file '" << path << "' in APK '" << path_ << "'";
       return {};
     }
+    AdviseMap(map.get(), mode, true /*compressed*/);
 
     std::unique_ptr<Asset> asset =
         Asset::createFromCompressedMap(std::move(map), entry.uncompressed_length, mode);
@@ -195,6 +397,7 @@ std::unique_ptr<Asset> ApkAssets::Open(const std::string& path, Asset::AccessMod
       LOG(ERROR) << "Failed to mmap file '" << path << "' in APK '" << path_ << "'";
       return {};
     }
+    AdviseMap(map.get(), mode, false /*compressed*/);
 
     std::unique_ptr<Asset> asset = Asset::createFromUncompressedMap(std::move(map), mode);
     if (asset == nullptr) {
@@ -205,6 +408,30 @@ std::unique_ptr<Asset> ApkAssets::Open(const std::string& path, Asset::AccessMod
   }
 }
 
+size_t ApkAssets::Prefetch(const std::vector<std::string>& paths) const {
+  CHECK(zip_handle_ != nullptr);
+  ATRACE_NAME("ApkAssets::Prefetch");
+
+  const int fd = ::GetFileDescriptor(zip_handle_.get());
+  size_t found = 0u;
+  for (const std::string& path : paths) {
+    ::ZipEntry entry;
+    if (::FindEntry(zip_handle_.get(), path, &entry) != 0) {
+      continue;
+    }
+    found++;
+#if defined(__linux__)
+    const off64_t length = entry.method == kCompressDeflated ? entry.compressed_length
+                                                             : entry.uncompressed_length;
+    // Only queues the reads, the page cache is filled in the background.
+    ::posix_fadvise64(fd, entry.offset, length, POSIX_FADV_WILLNEED);
+#else
+    (void)fd;
+#endif
+  }
+  return found;
+}
+
 bool ApkAssets::ForEachFile(const std::string& root_path,
                             const std::function<void(const StringPiece&, FileType)>& f) const {
   CHECK(zip_handle_ != nullptr);
@@ -0,0 +1,286 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define ATRACE_TAG ATRACE_TAG_RESOURCES
+
+#include "androidfw/ArscIndex.h"
+
+#include <map>
+
+#include "android-base/logging.h"
+#include "utils/Trace.h"
+
+#ifdef _WIN32
+#ifdef ERROR
+#undef ERROR
+#endif
+#endif
+
+#include "androidfw/Chunk.h"
+#include "androidfw/LoadedArsc.h"
+
+namespace android {
+
+constexpr static uint32_t kArscIndexMagic = 0x58444941u;  // 'AIDX'
+constexpr static uint32_t kArscIndexVersion = 1u;
+
+namespace {
+
+template <typename T>
+void Append(const T& value, std::string* out) {
+  out->append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+uint32_t OffsetOf(const void* chunk, const StringPiece& arsc_data) {
+  return static_cast<uint32_t>(reinterpret_cast<const char*>(chunk) - arsc_data.data());
+}
+
+// Reads consecutive values out of the index data, failing once it runs out of data.
+class IndexReader {
+ public:
+  explicit IndexReader(const StringPiece& data) : data_(data) {}
+
+  template <typename T>
+  const T* Read() {
+    if (data_.size() - position_ < sizeof(T)) {
+      return nullptr;
+    }
+    const T* value = reinterpret_cast<const T*>(data_.data() + position_);
+    position_ += sizeof(T);
+    return value;
+  }
+
+  // Returns true if `count` more values of `size` bytes each could still be read.
+  bool HasRoomFor(size_t count, size_t size) const {
+    return count <= (data_.size() - position_) / size;
+  }
+
+  bool AtEnd() const {
+    return position_ == data_.size();
+  }
+
+ private:
+  StringPiece data_;
+  size_t position_ = 0u;
+};
+
+// Returns the chunk at `offset` of the table, or nullptr if a chunk of at least `min_size` bytes
+// can not start there.
+template <typename T>
+const T* ChunkAt(uint32_t offset, size_t min_size, const StringPiece& arsc_data) {
+  if ((offset & 0x03) != 0 || offset > arsc_data.size() || arsc_data.size() - offset < min_size) {
+    return nullptr;
+  }
+  return reinterpret_cast<const T*>(arsc_data.data() + offset);
+}
+
+}  // namespace
+
+bool LoadedArscIndex::Create(const StringPiece& arsc_data, uint32_t arsc_crc32,
+                             std::string* out_index) {
+  ATRACE_NAME("LoadedArscIndex::Create");
+  // Everything the index points to must have passed the checks of a regular load.
+  if (LoadedArsc::Load(arsc_data) == nullptr) {
+    return false;
+  }
+
+  std::vector<const ResChunk_header*> packages;
+  ChunkIterator iter(arsc_data.data(), arsc_data.size());
+  while (iter.HasNext()) {
+    const Chunk chunk = iter.Next();
+    if (chunk.type() != RES_TABLE_TYPE) {
+      continue;
+    }
+    ChunkIterator table_iter(chunk.data_ptr(), chunk.data_size());
+    while (table_iter.HasNext()) {
+      const Chunk table_chunk = table_iter.Next();
+      if (table_chunk.type() == RES_TABLE_PACKAGE_TYPE) {
+        packages.push_back(table_chunk.header<ResChunk_header>());
+      }
+    }
+  }
+
+  out_index->clear();
+  Append(ArscIndex_header{kArscIndexMagic, kArscIndexVersion,
+                          static_cast<uint32_t>(arsc_data.size()), arsc_crc32,
+                          static_cast<uint32_t>(packages.size())},
+         out_index);
+
+  for (const ResChunk_header* package : packages) {
+    const Chunk package_chunk(package);
+    std::vector<uint32_t> chunks;
+    // Keyed by type ID. Like LoadedPackage::Load(), the first type spec of an ID is the one its
+    // types belong to.
+    std::map<uint8_t, std::pair<uint32_t, std::vector<uint32_t>>> type_specs;
+
+    ChunkIterator package_iter(package_chunk.data_ptr(), package_chunk.data_size());
+    while (package_iter.HasNext()) {
+      const Chunk child_chunk = package_iter.Next();
+      switch (child_chunk.type()) {
+        case RES_TABLE_TYPE_SPEC_TYPE: {
+          const ResTable_typeSpec* type_spec = child_chunk.header<ResTable_typeSpec>();
+          if (type_specs.find(type_spec->id) == type_specs.end()) {
+            type_specs[type_spec->id].first = OffsetOf(type_spec, arsc_data);
+          }
+        } break;
+
+        case RES_TABLE_TYPE_TYPE: {
+          const ResTable_type* type = child_chunk.header<ResTable_type, kResTableTypeMinSize>();
+          type_specs[type->id].second.push_back(OffsetOf(type, arsc_data));
+        } break;
+
+        default:
+          chunks.push_back(OffsetOf(child_chunk.header<ResChunk_header>(), arsc_data));
+          break;
+      }
+    }
+
+    Append(ArscIndex_package{OffsetOf(package, arsc_data), static_cast<uint32_t>(chunks.size()),
+                             static_cast<uint32_t>(type_specs.size())},
+           out_index);
+    for (uint32_t offset : chunks) {
+      Append(offset, out_index);
+    }
+    for (const auto& type_spec : type_specs) {
+      Append(ArscIndex_typeSpec{type_spec.second.first,
+                                static_cast<uint32_t>(type_spec.second.second.size())},
+             out_index);
+      for (uint32_t offset : type_spec.second.second) {
+        Append(offset, out_index);
+      }
+    }
+  }
+  return true;
+}
+
+std::unique_ptr<const LoadedArscIndex> LoadedArscIndex::Load(const StringPiece& index_data,
+                                                             const StringPiece& arsc_data,
+                                                             uint32_t arsc_crc32) {
+  ATRACE_NAME("LoadedArscIndex::Load");
+  if ((reinterpret_cast<uintptr_t>(index_data.data()) & 0x03) != 0) {
+    LOG(ERROR) << "Resource table index is not word aligned.";
+    return {};
+  }
+
+  IndexReader reader(index_data);
+  const ArscIndex_header* header = reader.Read<ArscIndex_header>();
+  if (header == nullptr || header->magic != kArscIndexMagic) {
+    LOG(ERROR) << "Resource table index has an invalid header.";
+    return {};
+  }
+
+  if (header->version != kArscIndexVersion || header->arsc_size != arsc_data.size() ||
+      header->arsc_crc32 != arsc_crc32) {
+    // Stale, it has to be created again.
+    return {};
+  }
+
+  if (!reader.HasRoomFor(header->package_count, sizeof(ArscIndex_package))) {
+    LOG(ERROR) << "Resource table index is truncated.";
+    return {};
+  }
+
+  std::unique_ptr<LoadedArscIndex> index(new LoadedArscIndex());
+  index->packages_.resize(header->package_count);
+  for (PackageChunks& package : index->packages_) {
+    const ArscIndex_package* package_header = reader.Read<ArscIndex_package>();
+    if (package_header == nullptr) {
+      LOG(ERROR) << "Resource table index is truncated.";
+      return {};
+    }
+
+    package.package = ChunkAt<ResTable_package>(package_header->package_offset,
+                                                sizeof(ResChunk_header), arsc_data);
+    if (package.package == nullptr) {
+      LOG(ERROR) << "Resource table index has an invalid package offset.";
+      return {};
+    }
+
+    if (!reader.HasRoomFor(package_header->chunk_count, sizeof(uint32_t))) {
+      LOG(ERROR) << "Resource table index is truncated.";
+      return {};
+    }
+    package.chunks.resize(package_header->chunk_count);
+    for (const ResChunk_header*& chunk : package.chunks) {
+      const uint32_t* offset = reader.Read<uint32_t>();
+      if (offset == nullptr) {
+        LOG(ERROR) << "Resource table index is truncated.";
+        return {};
+      }
+      chunk = ChunkAt<ResChunk_header>(*offset, sizeof(ResChunk_header), arsc_data);
+      if (chunk == nullptr) {
+        LOG(ERROR) << "Resource table index has an invalid chunk offset.";
+        return {};
+      }
+    }
+
+    if (!reader.HasRoomFor(package_header->type_spec_count, sizeof(ArscIndex_typeSpec))) {
+      LOG(ERROR) << "Resource table index is truncated.";
+      return {};
+    }
+    package.type_specs.resize(package_header->type_spec_count);
+    for (TypeSpecChunks& type_spec : package.type_specs) {
+      const ArscIndex_typeSpec* type_spec_header = reader.Read<ArscIndex_typeSpec>();
+      if (type_spec_header == nullptr) {
+        LOG(ERROR) << "Resource table index is truncated.";
+        return {};
+      }
+
+      type_spec.type_spec = ChunkAt<ResTable_typeSpec>(type_spec_header->type_spec_offset,
+                                                       sizeof(ResTable_typeSpec), arsc_data);
+      if (type_spec.type_spec == nullptr) {
+        LOG(ERROR) << "Resource table index has an invalid type spec offset.";
+        return {};
+      }
+
+      if (!reader.HasRoomFor(type_spec_header->type_count, sizeof(uint32_t))) {
+        LOG(ERROR) << "Resource table index is truncated.";
+        return {};
+      }
+      type_spec.types.resize(type_spec_header->type_count);
+      for (const ResTable_type*& type : type_spec.types) {
+        const uint32_t* offset = reader.Read<uint32_t>();
+        if (offset == nullptr) {
+          LOG(ERROR) << "Resource table index is truncated.";
+          return {};
+        }
+        type = ChunkAt<ResTable_type>(*offset, kResTableTypeMinSize, arsc_data);
+        if (type == nullptr) {
+          LOG(ERROR) << "Resource table index has an invalid type offset.";
+          return {};
+        }
+      }
+    }
+  }
+
+  if (!reader.AtEnd()) {
+    LOG(ERROR) << "Resource table index has trailing data.";
+    return {};
+  }
+  return std::move(index);
+}
+
+const LoadedArscIndex::PackageChunks* LoadedArscIndex::GetPackageChunks(
+    const ResTable_package* package) const {
+  for (const PackageChunks& package_chunks : packages_) {
+    if (package_chunks.package == package) {
+      return &package_chunks;
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace android
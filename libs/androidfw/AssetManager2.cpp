@@ -19,6 +19,7 @@
 #include "androidfw/AssetManager2.h"
 
 #include <algorithm>
+#include <atomic>
 #include <iterator>
 #include <map>
 #include <set>
@@ -45,40 +46,33 @@
 
 namespace android {
 
-struct FindEntryResult {
-  // A pointer to the resource table entry for this resource.
-  // If the size of the entry is > sizeof(ResTable_entry), it can be cast to
-  // a ResTable_map_entry and processed as a bag/map.
-  const ResTable_entry* entry;
+// Generations of AssetManagers and theme attributes, see GetGeneration().
+static std::atomic<uint64_t> gNextGeneration{1u};
 
-  // The configuration for which the resulting entry was defined. This is already swapped to host
-  // endianness.
-  ResTable_config config;
-
-  // The bitmask of configuration axis with which the resource value varies.
-  uint32_t type_flags;
-
-  // The dynamic package ID map for the package from which this resource came from.
-  const DynamicRefTable* dynamic_ref_table;
-
-  // The string pool reference to the type's name. This uses a different string pool than
-  // the global string pool, but this is hidden from the caller.
-  StringPoolRef type_string_ref;
+static uint64_t NextGeneration() {
+  return gNextGeneration.fetch_add(1u, std::memory_order_relaxed);
+}
 
-  // The string pool reference to the entry's name. This uses a different string pool than
-  // the global string pool, but this is hidden from the caller.
-  StringPoolRef entry_string_ref;
-};
+// The memory held by the bag caches of all AssetManagers, see GetGlobalBagCacheBytes().
+static std::atomic<size_t> gBagCacheBytes{0u};
 
-AssetManager2::AssetManager2() {
+AssetManager2::AssetManager2() : generation_(NextGeneration()) {
   memset(&configuration_, 0, sizeof(configuration_));
 }
 
+AssetManager2::~AssetManager2() {
+  gBagCacheBytes.fetch_sub(cached_bag_bytes_, std::memory_order_relaxed);
+}
+
 bool AssetManager2::SetApkAssets(const std::vector<const ApkAssets*>& apk_assets,
                                  bool invalidate_caches, bool filter_incompatible_configs) {
   apk_assets_ = apk_assets;
+  generation_ = NextGeneration();
   BuildDynamicRefTable();
   RebuildFilterList(filter_incompatible_configs);
+  // The cached entries point into the previous ApkAssets, so they can never be kept.
+  cached_entries_.clear();
+  cached_themes_.clear();
   if (invalidate_caches) {
     InvalidateCaches(static_cast<uint32_t>(-1));
   }
@@ -158,6 +152,11 @@ void AssetManager2::DumpToLog() const {
   }
   LOG(INFO) << "Package ID map: " << list;
 
+  const uint32_t lookups = cached_entry_hits_ + cached_entry_misses_;
+  LOG(INFO) << base::StringPrintf("Entry cache: %zu entries, %u/%u hits (%.1f%%)",
+                                  cached_entries_.size(), cached_entry_hits_, lookups,
+                                  lookups > 0 ? 100.0f * cached_entry_hits_ / lookups : 0.0f);
+
   for (const auto& package_group: package_groups_) {
     list = "";
     for (const auto& package : package_group.packages_) {
@@ -235,7 +234,12 @@ void AssetManager2::SetConfiguration(const ResTable_config& configuration) {
   configuration_ = configuration;
 
   if (diff) {
-    RebuildFilterList();
+    generation_ = NextGeneration();
+    if (configs_filtered_) {
+      UpdateFilterList(static_cast<uint32_t>(diff));
+    } else {
+      RebuildFilterList();
+    }
     InvalidateCaches(static_cast<uint32_t>(diff));
   }
 }
@@ -390,6 +394,20 @@ ApkAssetsCookie AssetManager2::FindEntry(uint32_t resid, uint16_t density_overri
     return kInvalidCookie;
   }
 
+  // Lookups in the set configuration can be answered by an earlier one, unless the steps taken
+  // to resolve the resource must be recorded.
+  const bool use_entry_cache = !ignore_configuration && desired_config == &configuration_ &&
+                               !resource_resolution_logging_enabled_;
+  if (use_entry_cache) {
+    auto cached_iter = cached_entries_.find(resid);
+    if (cached_iter != cached_entries_.end()) {
+      cached_entry_hits_++;
+      *out_entry = cached_iter->second.entry;
+      return cached_iter->second.cookie;
+    }
+    cached_entry_misses_++;
+  }
+
   const uint32_t package_id = get_package_id(resid);
   const uint8_t type_idx = get_type_id(resid) - 1;
   const uint16_t entry_idx = get_entry_id(resid);
@@ -409,6 +427,7 @@ ApkAssetsCookie AssetManager2::FindEntry(uint32_t resid, uint16_t density_overri
   const ResTable_type* best_type = nullptr;
   const ResTable_config* best_config = nullptr;
   ResTable_config best_config_copy;
+  uint16_t best_locale = 0u;  // Of best_config in filtered_locales_, on the fast path.
   uint32_t best_offset = 0u;
   uint32_t type_flags = 0u;
 
@@ -452,12 +471,14 @@ ApkAssetsCookie AssetManager2::FindEntry(uint32_t resid, uint16_t density_overri
       const size_t type_count = candidate_configs.size();
       for (uint32_t i = 0; i < type_count; i++) {
         const ResTable_config& this_config = candidate_configs[i];
+        const uint16_t this_locale = filtered_group.locales[i];
 
         // We can skip calling ResTable_config::match() because we know that all candidate
         // configurations that do NOT match have been filtered-out.
         if (best_config == nullptr) {
           resolution_type = Resolution::Step::Type::INITIAL;
-        } else if (this_config.isBetterThan(*best_config, desired_config)) {
+        } else if (this_config.isBetterThan(*best_config, desired_config,
+                                            locale_better_[this_locale][best_locale])) {
           resolution_type = Resolution::Step::Type::BETTER_MATCH;
         } else if (package_is_overlay && this_config.compare(*best_config) == 0) {
           resolution_type = Resolution::Step::Type::OVERLAID;
@@ -477,6 +498,7 @@ ApkAssetsCookie AssetManager2::FindEntry(uint32_t resid, uint16_t density_overri
         best_package = loaded_package;
         best_type = type;
         best_config = &this_config;
+        best_locale = this_locale;
         best_offset = offset;
 
         if (resource_resolution_logging_enabled_) {
@@ -569,6 +591,9 @@ ApkAssetsCookie AssetManager2::FindEntry(uint32_t resid, uint16_t density_overri
         StringPoolRef(best_package->GetKeyStringPool(), best_entry->key.index);
   }
 
+  if (use_entry_cache) {
+    cached_entries_.emplace(resid, CachedEntry{best_cookie, *out_entry});
+  }
   return best_cookie;
 }
 
@@ -753,34 +778,94 @@ ApkAssetsCookie AssetManager2::ResolveReference(ApkAssetsCookie cookie, Res_valu
 }
 
 const std::vector<uint32_t> AssetManager2::GetBagResIdStack(uint32_t resid) {
-  auto cached_iter = cached_bag_resid_stacks_.find(resid);
-  if (cached_iter != cached_bag_resid_stacks_.end()) {
-    return cached_iter->second;
-  } else {
-    auto found_resids = std::vector<uint32_t>();
-    GetBag(resid, found_resids);
-    // Cache style stacks if they are not already cached.
-    cached_bag_resid_stacks_[resid] = found_resids;
-    return found_resids;
+  if (GetBag(resid) == nullptr) {
+    return {};
   }
+  const CachedBag& cached_bag = cached_bags_.find(resid)->second;
+  return std::vector<uint32_t>(cached_bag.stack, cached_bag.stack + cached_bag.stack_size);
 }
 
 const ResolvedBag* AssetManager2::GetBag(uint32_t resid) {
+  auto cached_iter = cached_bags_.find(resid);
+  if (cached_iter != cached_bags_.end()) {
+    bag_lru_.splice(bag_lru_.begin(), bag_lru_, cached_iter->second.lru_position);
+    return cached_iter->second.bag.get();
+  }
+
+  // Only bags that are not cached can push the cache over its limit, and no bag is in use by this
+  // AssetManager while none is being resolved, so this is the place to trim it.
+  if (bag_cache_limit_ != 0u && bag_pins_ == 0) {
+    TrimBagCache();
+  }
+
   auto found_resids = std::vector<uint32_t>();
-  auto bag = GetBag(resid, found_resids);
+  return GetBag(resid, found_resids);
+}
+
+void AssetManager2::SetBagCacheLimit(size_t limit_bytes) {
+  bag_cache_limit_ = limit_bytes;
+}
+
+size_t AssetManager2::GetGlobalBagCacheBytes() {
+  return gBagCacheBytes.load(std::memory_order_relaxed);
+}
 
-  // Cache style stacks if they are not already cached.
-  auto cached_iter = cached_bag_resid_stacks_.find(resid);
-  if (cached_iter == cached_bag_resid_stacks_.end()) {
-    cached_bag_resid_stacks_[resid] = found_resids;
+util::unique_cptr<ResolvedBag> AssetManager2::AllocateBag(size_t entry_count, size_t stack_size) {
+  return util::unique_cptr<ResolvedBag>{reinterpret_cast<ResolvedBag*>(
+      malloc(sizeof(ResolvedBag) + (entry_count * sizeof(ResolvedBag::Entry)) +
+             (stack_size * sizeof(uint32_t))))};
+}
+
+const ResolvedBag* AssetManager2::CacheBag(uint32_t resid, util::unique_cptr<ResolvedBag> bag,
+                                           size_t entry_count, uint32_t parent_resid) {
+  const CachedBag* parent =
+      parent_resid != 0u ? &cached_bags_.find(parent_resid)->second : nullptr;
+  const size_t stack_size = 1u + (parent != nullptr ? parent->stack_size : 0u);
+  const size_t entries_size = sizeof(ResolvedBag) + (entry_count * sizeof(ResolvedBag::Entry));
+  const size_t size = entries_size + (stack_size * sizeof(uint32_t));
+
+  // Fit the allocation to the entries that were filled, and the stack.
+  bag.reset(reinterpret_cast<ResolvedBag*>(realloc(bag.release(), size)));
+  bag->entry_count = static_cast<uint32_t>(entry_count);
+
+  uint32_t* stack = reinterpret_cast<uint32_t*>(reinterpret_cast<uint8_t*>(bag.get()) +
+                                                entries_size);
+  stack[0] = resid;
+  if (parent != nullptr) {
+    std::copy(parent->stack, parent->stack + parent->stack_size, stack + 1);
+  }
+
+  bag_lru_.push_front(resid);
+  cached_bag_bytes_ += size;
+  gBagCacheBytes.fetch_add(size, std::memory_order_relaxed);
+
+  CachedBag& cached_bag = cached_bags_[resid];
+  cached_bag.bag = std::move(bag);
+  cached_bag.stack = stack;
+  cached_bag.stack_size = static_cast<uint32_t>(stack_size);
+  cached_bag.size = size;
+  cached_bag.lru_position = bag_lru_.begin();
+  return cached_bag.bag.get();
+}
+
+void AssetManager2::TrimBagCache() {
+  while (cached_bag_bytes_ > bag_cache_limit_ && !bag_lru_.empty()) {
+    EvictBag(cached_bags_.find(bag_lru_.back()));
   }
-  return bag;
+}
+
+std::unordered_map<uint32_t, AssetManager2::CachedBag>::iterator AssetManager2::EvictBag(
+    std::unordered_map<uint32_t, CachedBag>::iterator iter) {
+  bag_lru_.erase(iter->second.lru_position);
+  cached_bag_bytes_ -= iter->second.size;
+  gBagCacheBytes.fetch_sub(iter->second.size, std::memory_order_relaxed);
+  return cached_bags_.erase(iter);
 }
 
 const ResolvedBag* AssetManager2::GetBag(uint32_t resid, std::vector<uint32_t>& child_resids) {
   auto cached_iter = cached_bags_.find(resid);
   if (cached_iter != cached_bags_.end()) {
-    return cached_iter->second.get();
+    return cached_iter->second.bag.get();
   }
 
   FindEntryResult entry;
@@ -816,8 +901,7 @@ const ResolvedBag* AssetManager2::GetBag(uint32_t resid, std::vector<uint32_t>&
     // There is no parent or that a circular dependency exist, meaning there is nothing to
     // inherit and we can do a simple copy of the entries in the map.
     const size_t entry_count = map_entry_end - map_entry;
-    util::unique_cptr<ResolvedBag> new_bag{reinterpret_cast<ResolvedBag*>(
-        malloc(sizeof(ResolvedBag) + (entry_count * sizeof(ResolvedBag::Entry))))};
+    util::unique_cptr<ResolvedBag> new_bag = AllocateBag(entry_count, 1u /* stack_size */);
     ResolvedBag::Entry* new_entry = new_bag->entries;
     for (; map_entry != map_entry_end; ++map_entry) {
       uint32_t new_key = dtohl(map_entry->name.ident);
@@ -846,10 +930,7 @@ const ResolvedBag* AssetManager2::GetBag(uint32_t resid, std::vector<uint32_t>&
       ++new_entry;
     }
     new_bag->type_spec_flags = entry.type_flags;
-    new_bag->entry_count = static_cast<uint32_t>(entry_count);
-    ResolvedBag* result = new_bag.get();
-    cached_bags_[resid] = std::move(new_bag);
-    return result;
+    return CacheBag(resid, std::move(new_bag), entry_count, 0u /* parent_resid */);
   }
 
   // In case the parent is a dynamic reference, resolve it.
@@ -867,8 +948,7 @@ const ResolvedBag* AssetManager2::GetBag(uint32_t resid, std::vector<uint32_t>&
   // Create the max possible entries we can make. Once we construct the bag,
   // we will realloc to fit to size.
   const size_t max_count = parent_bag->entry_count + dtohl(map->count);
-  util::unique_cptr<ResolvedBag> new_bag{reinterpret_cast<ResolvedBag*>(
-      malloc(sizeof(ResolvedBag) + (max_count * sizeof(ResolvedBag::Entry))))};
+  util::unique_cptr<ResolvedBag> new_bag = AllocateBag(max_count, 0u /* stack_size */);
   ResolvedBag::Entry* new_entry = new_bag->entries;
 
   const ResolvedBag::Entry* parent_entry = parent_bag->entries;
@@ -949,19 +1029,12 @@ const ResolvedBag* AssetManager2::GetBag(uint32_t resid, std::vector<uint32_t>&
     new_entry += num_entries_to_copy;
   }
 
-  // Resize the resulting array to fit.
-  const size_t actual_count = new_entry - new_bag->entries;
-  if (actual_count != max_count) {
-    new_bag.reset(reinterpret_cast<ResolvedBag*>(realloc(
-        new_bag.release(), sizeof(ResolvedBag) + (actual_count * sizeof(ResolvedBag::Entry)))));
-  }
-
   // Combine flags from the parent and our own bag.
   new_bag->type_spec_flags = entry.type_flags | parent_bag->type_spec_flags;
-  new_bag->entry_count = static_cast<uint32_t>(actual_count);
-  ResolvedBag* result = new_bag.get();
-  cached_bags_[resid] = std::move(new_bag);
-  return result;
+
+  // CacheBag() resizes the resulting array to fit.
+  const size_t actual_count = new_entry - new_bag->entries;
+  return CacheBag(resid, std::move(new_bag), actual_count, parent_resid);
 }
 
 static bool Utf8ToUtf16(const StringPiece& str, std::u16string* out) {
@@ -1033,7 +1106,39 @@ uint32_t AssetManager2::GetResourceId(const std::string& resource_name,
   return 0u;
 }
 
+static bool HasSameLocale(const ResTable_config& a, const ResTable_config& b) {
+  return a.locale == b.locale &&
+         memcmp(a.localeScript, b.localeScript, sizeof(a.localeScript)) == 0 &&
+         memcmp(a.localeVariant, b.localeVariant, sizeof(a.localeVariant)) == 0 &&
+         memcmp(a.localeNumberingSystem, b.localeNumberingSystem,
+                sizeof(a.localeNumberingSystem)) == 0;
+}
+
+uint16_t AssetManager2::IndexLocale(const ResTable_config& config) {
+  // Only the locales that match configuration_ are left, so there are few of them.
+  for (size_t i = 0; i < filtered_locales_.size(); i++) {
+    if (HasSameLocale(filtered_locales_[i], config)) {
+      return static_cast<uint16_t>(i);
+    }
+  }
+
+  const size_t index = filtered_locales_.size();
+  CHECK(index <= std::numeric_limits<uint16_t>::max()) << "Too many locales";
+  filtered_locales_.push_back(config);
+  locale_better_.emplace_back(index + 1u);
+  for (size_t i = 0; i < index; i++) {
+    locale_better_[i].push_back(
+        filtered_locales_[i].isLocaleBetterThan(filtered_locales_[index], &configuration_));
+    locale_better_[index][i] =
+        filtered_locales_[index].isLocaleBetterThan(filtered_locales_[i], &configuration_);
+  }
+  return static_cast<uint16_t>(index);
+}
+
 void AssetManager2::RebuildFilterList(bool filter_incompatible_configs) {
+  configs_filtered_ = filter_incompatible_configs;
+  filtered_locales_.clear();
+  locale_better_.clear();
   for (PackageGroup& group : package_groups_) {
     for (ConfiguredPackage& impl : group.packages_) {
       // Destroy it.
@@ -1045,13 +1150,17 @@ void AssetManager2::RebuildFilterList(bool filter_incompatible_configs) {
       // Create the filters here.
       impl.loaded_package_->ForEachTypeSpec([&](const TypeSpec* spec, uint8_t type_index) {
         FilteredConfigGroup& group = impl.filtered_configs_.editItemAt(type_index);
+        ResTable_config default_config;
+        memset(&default_config, 0, sizeof(default_config));
         const auto iter_end = spec->types + spec->type_count;
         for (auto iter = spec->types; iter != iter_end; ++iter) {
           ResTable_config this_config;
           this_config.copyFromDtoH((*iter)->config);
+          group.config_dimensions |= static_cast<uint32_t>(default_config.diff(this_config));
           if (!filter_incompatible_configs || this_config.match(configuration_)) {
             group.configurations.push_back(this_config);
             group.types.push_back(*iter);
+            group.locales.push_back(IndexLocale(this_config));
           }
         }
       });
@@ -1059,20 +1168,80 @@ void AssetManager2::RebuildFilterList(bool filter_incompatible_configs) {
   }
 }
 
-void AssetManager2::InvalidateCaches(uint32_t diff) {
-  cached_bag_resid_stacks_.clear();
+void AssetManager2::UpdateFilterList(uint32_t diff) {
+  // The locales compare differently against another requested locale.
+  const bool locale_changed = (diff & ResTable_config::CONFIG_LOCALE) != 0u;
+  if (locale_changed) {
+    filtered_locales_.clear();
+    locale_better_.clear();
+  }
 
+  for (PackageGroup& group : package_groups_) {
+    for (ConfiguredPackage& impl : group.packages_) {
+      impl.loaded_package_->ForEachTypeSpec([&](const TypeSpec* spec, uint8_t type_index) {
+        FilteredConfigGroup& group = impl.filtered_configs_.editItemAt(type_index);
+        // A configuration that leaves all of the changed axes unspecified matches the same way
+        // as it did before.
+        if ((group.config_dimensions & diff) == 0u) {
+          if (locale_changed) {
+            for (size_t i = 0; i < group.configurations.size(); i++) {
+              group.locales[i] = IndexLocale(group.configurations[i]);
+            }
+          }
+          return;
+        }
+
+        group.configurations.clear();
+        group.types.clear();
+        group.locales.clear();
+        const auto iter_end = spec->types + spec->type_count;
+        for (auto iter = spec->types; iter != iter_end; ++iter) {
+          ResTable_config this_config;
+          this_config.copyFromDtoH((*iter)->config);
+          if (this_config.match(configuration_)) {
+            group.configurations.push_back(this_config);
+            group.types.push_back(*iter);
+            group.locales.push_back(IndexLocale(this_config));
+          }
+        }
+      });
+    }
+  }
+}
+
+void AssetManager2::InvalidateCaches(uint32_t diff) {
   if (diff == 0xffffffffu) {
     // Everything must go.
+    gBagCacheBytes.fetch_sub(cached_bag_bytes_, std::memory_order_relaxed);
+    cached_bag_bytes_ = 0u;
     cached_bags_.clear();
+    bag_lru_.clear();
+    cached_entries_.clear();
+    cached_themes_.clear();
     return;
   }
 
+  for (auto iter = cached_themes_.begin(); iter != cached_themes_.end();) {
+    if (diff & iter->second->type_spec_flags) {
+      iter = cached_themes_.erase(iter);
+    } else {
+      ++iter;
+    }
+  }
+
+  for (auto iter = cached_entries_.begin(); iter != cached_entries_.end();) {
+    if (diff & iter->second.entry.type_flags) {
+      iter = cached_entries_.erase(iter);
+    } else {
+      ++iter;
+    }
+  }
+
   // Be more conservative with what gets purged. Only if the bag has other possible
   // variations with respect to what changed (diff) should we remove it.
-  for (auto iter = cached_bags_.cbegin(); iter != cached_bags_.cend();) {
-    if (diff & iter->second->type_spec_flags) {
-      iter = cached_bags_.erase(iter);
+  for (auto iter = cached_bags_.begin(); iter != cached_bags_.end();) {
+    if (diff & iter->second.bag->type_spec_flags) {
+      iter = EvictBag(iter);
     } else {
       ++iter;
     }
@@ -1113,29 +1282,112 @@ struct ThemeType {
 };
 
 constexpr size_t kTypeCount = std::numeric_limits<uint8_t>::max() + 1;
+constexpr size_t kPackageCount = std::numeric_limits<uint8_t>::max() + 1;
+
+// Limits the themes an AssetManager keeps, an app applies a few style chains at most.
+constexpr size_t kMaxCachedThemes = 32u;
 
 }  // namespace
 
-struct Theme::Package {
-  // Each element of Type will be a dynamically sized object
-  // allocated to have the entries stored contiguously with the Type.
-  std::array<util::unique_cptr<ThemeType>, kTypeCount> types;
+struct ThemeData {
+  struct Package {
+    // Each element of Type will be a dynamically sized object
+    // allocated to have the entries stored contiguously with the Type.
+    std::array<util::unique_cptr<ThemeType>, kTypeCount> types;
+  };
+
+  uint32_t type_spec_flags = 0u;
+  std::array<std::unique_ptr<Package>, kPackageCount> packages;
+  uint64_t generation = NextGeneration();
+
+  std::shared_ptr<ThemeData> Clone() const {
+    auto copy = std::make_shared<ThemeData>();
+    copy->type_spec_flags = type_spec_flags;
+    for (size_t p = 0; p < packages.size(); p++) {
+      const Package* package = packages[p].get();
+      if (package == nullptr) {
+        continue;
+      }
+      copy->packages[p].reset(new Package());
+      for (size_t t = 0; t < package->types.size(); t++) {
+        const ThemeType* type = package->types[t].get();
+        if (type == nullptr) {
+          continue;
+        }
+        const size_t type_alloc_size = sizeof(ThemeType) + (type->entry_count * sizeof(ThemeEntry));
+        void* copied_data = malloc(type_alloc_size);
+        memcpy(copied_data, type, type_alloc_size);
+        copy->packages[p]->types[t].reset(reinterpret_cast<ThemeType*>(copied_data));
+      }
+    }
+    return copy;
+  }
 };
 
+std::shared_ptr<ThemeData> AssetManager2::GetCachedTheme(
+    const std::vector<uint64_t>& applied_styles) const {
+  auto cached_iter = cached_themes_.find(applied_styles);
+  return cached_iter != cached_themes_.end() ? cached_iter->second : nullptr;
+}
+
+void AssetManager2::CacheTheme(const std::vector<uint64_t>& applied_styles,
+                               std::shared_ptr<ThemeData> data) {
+  if (cached_themes_.size() >= kMaxCachedThemes) {
+    cached_themes_.clear();
+  }
+  cached_themes_[applied_styles] = std::move(data);
+}
+
+ThemeData* Theme::MutableData() {
+  if (data_ == nullptr) {
+    data_ = std::make_shared<ThemeData>();
+  } else if (data_.use_count() > 1) {
+    data_ = data_->Clone();
+  } else {
+    data_->generation = NextGeneration();
+  }
+  return data_.get();
+}
+
+uint32_t Theme::GetChangingConfigurations() const {
+  return data_ != nullptr ? data_->type_spec_flags : 0u;
+}
+
+uint64_t Theme::GetGeneration() const {
+  return data_ != nullptr ? data_->generation : 0u;
+}
+
 bool Theme::ApplyStyle(uint32_t resid, bool force) {
   ATRACE_NAME("Theme::ApplyStyle");
 
+  // If a theme had the same styles applied before, share its attributes instead of merging the
+  // style into ours.
+  std::vector<uint64_t> applied_styles;
+  if (applied_styles_valid_) {
+    applied_styles.reserve(applied_styles_.size() + 1);
+    applied_styles = applied_styles_;
+    applied_styles.push_back((static_cast<uint64_t>(resid) << 1) | (force ? 1u : 0u));
+    std::shared_ptr<ThemeData> cached = asset_manager_->GetCachedTheme(applied_styles);
+    if (cached != nullptr) {
+      data_ = std::move(cached);
+      applied_styles_ = std::move(applied_styles);
+      return true;
+    }
+  }
+
   const ResolvedBag* bag = asset_manager_->GetBag(resid);
   if (bag == nullptr) {
     return false;
   }
 
+  ThemeData* data = MutableData();
+
   // Merge the flags from this style.
-  type_spec_flags_ |= bag->type_spec_flags;
+  data->type_spec_flags |= bag->type_spec_flags;
 
   int last_type_idx = -1;
   int last_package_idx = -1;
-  Package* last_package = nullptr;
+  ThemeData::Package* last_package = nullptr;
   ThemeType* last_type = nullptr;
 
   // Iterate backwards, because each bag is sorted in ascending key ID order, meaning we will only
@@ -1148,6 +1400,9 @@ bool Theme::ApplyStyle(uint32_t resid, bool force) {
     // If the resource ID passed in is not a style, the key can be some other identifier that is not
     // a resource ID. We should fail fast instead of operating with strange resource IDs.
     if (!is_valid_resid(attr_resid)) {
+      // The entries before this one were applied already.
+      applied_styles_valid_ = false;
+      applied_styles_.clear();
       return false;
     }
 
@@ -1160,9 +1415,9 @@ bool Theme::ApplyStyle(uint32_t resid, bool force) {
     const int entry_idx = get_entry_id(attr_resid);
 
     if (last_package_idx != package_idx) {
-      std::unique_ptr<Package>& package = packages_[package_idx];
+      std::unique_ptr<ThemeData::Package>& package = data->packages[package_idx];
       if (package == nullptr) {
-        package.reset(new Package());
+        package.reset(new ThemeData::Package());
       }
       last_package_idx = package_idx;
       last_package = package.get();
@@ -1201,6 +1456,11 @@ bool Theme::ApplyStyle(uint32_t resid, bool force) {
       entry.value = bag_iter->value;
     }
   }
+
+  if (applied_styles_valid_) {
+    applied_styles_ = std::move(applied_styles);
+    asset_manager_->CacheTheme(applied_styles_, data_);
+  }
   return true;
 }
 
@@ -1210,9 +1470,13 @@ ApkAssetsCookie Theme::GetAttribute(uint32_t resid, Res_value* out_value,
 
   uint32_t type_spec_flags = 0u;
 
+  if (data_ == nullptr) {
+    return kInvalidCookie;
+  }
+
   do {
     const int package_idx = get_package_id(resid);
-    const Package* package = packages_[package_idx].get();
+    const ThemeData::Package* package = data_->packages[package_idx].get();
     if (package != nullptr) {
       // The themes are constructed with a 1-based type ID, so no need to decrement here.
       const int type_idx = get_type_id(resid);
@@ -1269,10 +1533,9 @@ ApkAssetsCookie Theme::ResolveAttributeReference(ApkAssetsCookie cookie, Res_val
 }
 
 void Theme::Clear() {
-  type_spec_flags_ = 0u;
-  for (std::unique_ptr<Package>& package : packages_) {
-    package.reset();
-  }
+  data_.reset();
+  applied_styles_.clear();
+  applied_styles_valid_ = true;
 }
 
 void Theme::SetTo(const Theme& o) {
@@ -1280,38 +1543,11 @@ void Theme::SetTo(const Theme& o) {
     return;
   }
 
-  type_spec_flags_ = o.type_spec_flags_;
-
   if (asset_manager_ == o.asset_manager_) {
-    // The theme comes from the same asset manager so all theme data can be copied exactly
-    for (size_t p = 0; p < packages_.size(); p++) {
-      const Package *package = o.packages_[p].get();
-      if (package == nullptr) {
-        // The other theme doesn't have this package, clear ours.
-        packages_[p].reset();
-        continue;
-      }
-
-      if (packages_[p] == nullptr) {
-        // The other theme has this package, but we don't. Make one.
-        packages_[p].reset(new Package());
-      }
-
-      for (size_t t = 0; t < package->types.size(); t++) {
-        const ThemeType *type = package->types[t].get();
-        if (type == nullptr) {
-          // The other theme doesn't have this type, clear ours.
-          packages_[p]->types[t].reset();
-          continue;
-        }
-
-        // Create a new type and update it to theirs.
-        const size_t type_alloc_size = sizeof(ThemeType) + (type->entry_count * sizeof(ThemeEntry));
-        void *copied_data = malloc(type_alloc_size);
-        memcpy(copied_data, type, type_alloc_size);
-        packages_[p]->types[t].reset(reinterpret_cast<ThemeType *>(copied_data));
-      }
-    }
+    // The theme comes from the same asset manager so all theme data can be shared exactly.
+    data_ = o.data_;
+    applied_styles_ = o.applied_styles_;
+    applied_styles_valid_ = o.applied_styles_valid_;
   } else {
     std::map<ApkAssetsCookie, ApkAssetsCookie> src_to_dest_asset_cookies;
     typedef std::map<int, int> SourceToDestinationRuntimePackageMap;
@@ -1359,14 +1595,17 @@ void Theme::SetTo(const Theme& o) {
     }
 
     // Reset the data in the destination theme.
-    for (size_t p = 0; p < packages_.size(); p++) {
-      if (packages_[p] != nullptr) {
-        packages_[p].reset();
-      }
+    applied_styles_.clear();
+    applied_styles_valid_ = false;
+    data_ = std::make_shared<ThemeData>();
+    ThemeData* data = data_.get();
+    data->type_spec_flags = o.GetChangingConfigurations();
+    if (o.data_ == nullptr) {
+      return;
     }
 
-    for (size_t p = 0; p < packages_.size(); p++) {
-      const Package *package = o.packages_[p].get();
+    for (size_t p = 0; p < o.data_->packages.size(); p++) {
+      const ThemeData::Package *package = o.data_->packages[p].get();
       if (package == nullptr) {
         continue;
       }
@@ -1449,9 +1688,10 @@ void Theme::SetTo(const Theme& o) {
           }
 
           // Lazily instantiate the destination package.
-          std::unique_ptr<Package>& dest_package = packages_[attribute_dest_package_id];
+          std::unique_ptr<ThemeData::Package>& dest_package =
+              data->packages[attribute_dest_package_id];
           if (dest_package == nullptr) {
-            dest_package.reset(new Package());
+            dest_package.reset(new ThemeData::Package());
           }
 
           // Lazily instantiate and resize the destination type.
@@ -1486,8 +1726,12 @@ void Theme::Dump() const {
   base::ScopedLogSeverity _log(base::INFO);
   LOG(INFO) << base::StringPrintf("Theme(this=%p, AssetManager2=%p)", this, asset_manager_);
 
-  for (int p = 0; p < packages_.size(); p++) {
-    auto& package = packages_[p];
+  if (data_ == nullptr) {
+    return;
+  }
+
+  for (int p = 0; p < data_->packages.size(); p++) {
+    auto& package = data_->packages[p];
     if (package == nullptr) {
       continue;
     }
@@ -16,7 +16,10 @@
 
 #include "androidfw/AttributeResolution.h"
 
+#include <algorithm>
 #include <cstdint>
+#include <memory>
+#include <vector>
 
 #include <log/log.h>
 
@@ -202,6 +205,187 @@ bool ResolveAttrs(Theme* theme, uint32_t def_style_attr, uint32_t def_style_res,
   return true;
 }
 
+namespace {
+
+// Finds the value of an attribute for ApplyStyle() and writes it to the STYLE_NUM_ENTRIES
+// out_values of the attribute. `value` holds the value from the XML attributes, if any.
+class StyledAttributeResolver {
+ public:
+  StyledAttributeResolver(Theme* theme, const ResolvedBag* xml_style_bag, uint32_t style_flags,
+                          const ResolvedBag* default_style_bag, uint32_t def_style_flags)
+      : theme_(theme),
+        xml_style_attr_finder_(xml_style_bag),
+        style_flags_(style_flags),
+        def_style_attr_finder_(default_style_bag),
+        def_style_flags_(def_style_flags) {}
+
+  // Must be called in ascending order of cur_ident, for the bag finders.
+  void Resolve(uint32_t cur_ident, Res_value value, uint32_t value_source_resid,
+               uint32_t* out_values) {
+    AssetManager2* assetmanager = theme_->GetAssetManager();
+    ResTable_config config;
+    ApkAssetsCookie cookie = kInvalidCookie;
+    uint32_t type_set_flags = 0u;
+    config.density = 0;
+
+    if (value.dataType == Res_value::TYPE_NULL && value.data != Res_value::DATA_NULL_EMPTY) {
+      // Walk through the style class values looking for the requested attribute.
+      const ResolvedBag::Entry* entry = xml_style_attr_finder_.Find(cur_ident);
+      if (entry != xml_style_attr_finder_.end()) {
+        // We found the attribute we were looking for.
+        cookie = entry->cookie;
+        type_set_flags = style_flags_;
+        value = entry->value;
+        value_source_resid = entry->style;
+        if (kDebugStyles) {
+          ALOGI("-> From style: type=0x%x, data=0x%08x, style=0x%08x", value.dataType, value.data,
+              entry->style);
+        }
+      }
+    }
+
+    if (value.dataType == Res_value::TYPE_NULL && value.data != Res_value::DATA_NULL_EMPTY) {
+      // Walk through the default style values looking for the requested attribute.
+      const ResolvedBag::Entry* entry = def_style_attr_finder_.Find(cur_ident);
+      if (entry != def_style_attr_finder_.end()) {
+        // We found the attribute we were looking for.
+        cookie = entry->cookie;
+        type_set_flags = def_style_flags_;
+        value = entry->value;
+        if (kDebugStyles) {
+          ALOGI("-> From def style: type=0x%x, data=0x%08x, style=0x%08x", value.dataType,
+              value.data, entry->style);
+        }
+        value_source_resid = entry->style;
+      }
+    }
+
+    uint32_t resid = 0u;
+    if (value.dataType != Res_value::TYPE_NULL) {
+      // Take care of resolving the found resource to its final value.
+      ApkAssetsCookie new_cookie =
+          theme_->ResolveAttributeReference(cookie, &value, &config, &type_set_flags, &resid);
+      if (new_cookie != kInvalidCookie) {
+        cookie = new_cookie;
+      }
+
+      if (kDebugStyles) {
+        ALOGI("-> Resolved attr: type=0x%x, data=0x%08x", value.dataType, value.data);
+      }
+    } else if (value.data != Res_value::DATA_NULL_EMPTY) {
+      // If we still don't have a value for this attribute, try to find it in the theme!
+      ApkAssetsCookie new_cookie = theme_->GetAttribute(cur_ident, &value, &type_set_flags);
+      // TODO: set value_source_resid for the style in the theme that was used.
+      if (new_cookie != kInvalidCookie) {
+        if (kDebugStyles) {
+          ALOGI("-> From theme: type=0x%x, data=0x%08x", value.dataType, value.data);
+        }
+        new_cookie =
+            assetmanager->ResolveReference(new_cookie, &value, &config, &type_set_flags, &resid);
+        if (new_cookie != kInvalidCookie) {
+          cookie = new_cookie;
+        }
+
+        if (kDebugStyles) {
+          ALOGI("-> Resolved theme: type=0x%x, data=0x%08x", value.dataType, value.data);
+        }
+      }
+    }
+
+    // Deal with the special @null value -- it turns back to TYPE_NULL.
+    if (value.dataType == Res_value::TYPE_REFERENCE && value.data == 0) {
+      if (kDebugStyles) {
+        ALOGI("-> Setting to @null!");
+      }
+      value.dataType = Res_value::TYPE_NULL;
+      value.data = Res_value::DATA_NULL_UNDEFINED;
+      cookie = kInvalidCookie;
+    }
+
+    if (kDebugStyles) {
+      ALOGI("Attribute 0x%08x: type=0x%x, data=0x%08x", cur_ident, value.dataType, value.data);
+    }
+
+    out_values[STYLE_TYPE] = value.dataType;
+    out_values[STYLE_DATA] = value.data;
+    out_values[STYLE_ASSET_COOKIE] = ApkAssetsCookieToJavaCookie(cookie);
+    out_values[STYLE_RESOURCE_ID] = resid;
+    out_values[STYLE_CHANGING_CONFIGURATIONS] = type_set_flags;
+    out_values[STYLE_DENSITY] = config.density;
+    out_values[STYLE_SOURCE_RESOURCE_ID] = value_source_resid;
+  }
+
+ private:
+  Theme* theme_;
+  BagAttributeFinder xml_style_attr_finder_;
+  uint32_t style_flags_;
+  BagAttributeFinder def_style_attr_finder_;
+  uint32_t def_style_flags_;
+};
+
+// The values ApplyStyle() finds for the attributes the XML does not set, which only depend on
+// the styles, the theme and the AssetManager. Views inflated with the same style mostly differ in
+// a few XML attributes, so the rest is reused from here.
+struct StyledAttributes {
+  uint64_t assetmanager_generation;
+  uint64_t theme_generation;
+  uint32_t style_resid;
+  uint32_t style_flags;
+  uint32_t def_style_resid;
+  uint32_t def_style_flags;
+  std::vector<uint32_t> attrs;
+
+  // STYLE_NUM_ENTRIES for each of attrs.
+  std::vector<uint32_t> values;
+};
+
+// Recently used first. Per thread, as inflation runs on many threads and AssetManagers.
+constexpr size_t kStyledAttributesCacheSize = 16u;
+thread_local std::vector<std::unique_ptr<StyledAttributes>> tStyledAttributesCache;
+
+const StyledAttributes* GetStyledAttributes(Theme* theme, uint32_t style_resid,
+                                            uint32_t style_flags,
+                                            const ResolvedBag* xml_style_bag,
+                                            uint32_t def_style_resid, uint32_t def_style_flags,
+                                            const ResolvedBag* default_style_bag,
+                                            const uint32_t* attrs, size_t attrs_length) {
+  const uint64_t assetmanager_generation = theme->GetAssetManager()->GetGeneration();
+  const uint64_t theme_generation = theme->GetGeneration();
+  auto& cache = tStyledAttributesCache;
+  for (size_t i = 0; i < cache.size(); i++) {
+    const StyledAttributes& entry = *cache[i];
+    if (entry.assetmanager_generation == assetmanager_generation &&
+        entry.theme_generation == theme_generation && entry.style_resid == style_resid &&
+        entry.style_flags == style_flags && entry.def_style_resid == def_style_resid &&
+        entry.def_style_flags == def_style_flags && entry.attrs.size() == attrs_length &&
+        std::equal(entry.attrs.begin(), entry.attrs.end(), attrs)) {
+      std::rotate(cache.begin(), cache.begin() + i, cache.begin() + i + 1);
+      return cache.front().get();
+    }
+  }
+
+  std::unique_ptr<StyledAttributes> entry(new StyledAttributes{
+      assetmanager_generation, theme_generation, style_resid, style_flags, def_style_resid,
+      def_style_flags, std::vector<uint32_t>(attrs, attrs + attrs_length),
+      std::vector<uint32_t>(attrs_length * STYLE_NUM_ENTRIES)});
+  StyledAttributeResolver resolver(theme, xml_style_bag, style_flags, default_style_bag,
+                                   def_style_flags);
+  Res_value no_value;
+  no_value.dataType = Res_value::TYPE_NULL;
+  no_value.data = Res_value::DATA_NULL_UNDEFINED;
+  for (size_t ii = 0; ii < attrs_length; ii++) {
+    resolver.Resolve(attrs[ii], no_value, 0u, &entry->values[ii * STYLE_NUM_ENTRIES]);
+  }
+
+  if (cache.size() >= kStyledAttributesCacheSize) {
+    cache.pop_back();
+  }
+  cache.insert(cache.begin(), std::move(entry));
+  return cache.front().get();
+}
+
+}  // namespace
+
 void ApplyStyle(Theme* theme, ResXMLParser* xml_parser, uint32_t def_style_attr,
                 uint32_t def_style_resid, const uint32_t* attrs, size_t attrs_length,
                 uint32_t* out_values, uint32_t* out_indices) {
@@ -211,7 +395,6 @@ void ApplyStyle(Theme* theme, ResXMLParser* xml_parser, uint32_t def_style_attr,
   }
 
   AssetManager2* assetmanager = theme->GetAssetManager();
-  ResTable_config config;
   Res_value value;
 
   int indices_idx = 0;
@@ -246,6 +429,9 @@ void ApplyStyle(Theme* theme, ResXMLParser* xml_parser, uint32_t def_style_attr,
     }
   }
 
+  // Both bags are used at once, so neither may be evicted to make room for the other.
+  AssetManager2::ScopedBagPin bag_pin(assetmanager);
+
   // Retrieve the default style bag, if requested.
   const ResolvedBag* default_style_bag = nullptr;
   if (def_style_resid != 0) {
@@ -255,8 +441,6 @@ void ApplyStyle(Theme* theme, ResXMLParser* xml_parser, uint32_t def_style_attr,
     }
   }
 
-  BagAttributeFinder def_style_attr_finder(default_style_bag);
-
   // Retrieve the style class bag, if requested.
   const ResolvedBag* xml_style_bag = nullptr;
   if (style_resid != 0) {
@@ -266,7 +450,15 @@ void ApplyStyle(Theme* theme, ResXMLParser* xml_parser, uint32_t def_style_attr,
     }
   }
 
-  BagAttributeFinder xml_style_attr_finder(xml_style_bag);
+  // What the styles and the theme give each attribute, used where the XML has no value.
+  const StyledAttributes* styled = GetStyledAttributes(
+      theme, style_resid, style_flags, xml_style_bag, def_style_resid, def_style_flags,
+      default_style_bag, attrs, attrs_length);
+
+  // Takes over from the XML attributes that are set to TYPE_NULL without a value. The bags are
+  // only searched through for those.
+  StyledAttributeResolver resolver(theme, xml_style_bag, style_flags, default_style_bag,
+                                   def_style_flags);
 
   // Retrieve the XML attributes, if requested.
   XmlAttributeFinder xml_attr_finder(xml_parser);
@@ -280,14 +472,6 @@ void ApplyStyle(Theme* theme, ResXMLParser* xml_parser, uint32_t def_style_attr,
       ALOGI("RETRIEVING ATTR 0x%08x...", cur_ident);
     }
 
-    ApkAssetsCookie cookie = kInvalidCookie;
-    uint32_t type_set_flags = 0u;
-
-    value.dataType = Res_value::TYPE_NULL;
-    value.data = Res_value::DATA_NULL_UNDEFINED;
-    config.density = 0;
-    uint32_t value_source_resid = 0;
-
     // Try to find a value for this attribute...  we prioritize values
     // coming from, first XML attributes, then XML style, then default
     // style, and finally the theme.
@@ -296,101 +480,20 @@ void ApplyStyle(Theme* theme, ResXMLParser* xml_parser, uint32_t def_style_attr,
     const size_t xml_attr_idx = xml_attr_finder.Find(cur_ident);
     if (xml_attr_idx != xml_attr_finder.end()) {
       // We found the attribute we were looking for.
+      value.dataType = Res_value::TYPE_NULL;
+      value.data = Res_value::DATA_NULL_UNDEFINED;
       xml_parser->getAttributeValue(xml_attr_idx, &value);
       if (kDebugStyles) {
         ALOGI("-> From XML: type=0x%x, data=0x%08x", value.dataType, value.data);
       }
-      value_source_resid = xml_parser->getSourceResourceId();
-    }
-
-    if (value.dataType == Res_value::TYPE_NULL && value.data != Res_value::DATA_NULL_EMPTY) {
-      // Walk through the style class values looking for the requested attribute.
-      const ResolvedBag::Entry* entry = xml_style_attr_finder.Find(cur_ident);
-      if (entry != xml_style_attr_finder.end()) {
-        // We found the attribute we were looking for.
-        cookie = entry->cookie;
-        type_set_flags = style_flags;
-        value = entry->value;
-        value_source_resid = entry->style;
-        if (kDebugStyles) {
-          ALOGI("-> From style: type=0x%x, data=0x%08x, style=0x%08x", value.dataType, value.data,
-              entry->style);
-        }
-      }
-    }
-
-    if (value.dataType == Res_value::TYPE_NULL && value.data != Res_value::DATA_NULL_EMPTY) {
-      // Walk through the default style values looking for the requested attribute.
-      const ResolvedBag::Entry* entry = def_style_attr_finder.Find(cur_ident);
-      if (entry != def_style_attr_finder.end()) {
-        // We found the attribute we were looking for.
-        cookie = entry->cookie;
-        type_set_flags = def_style_flags;
-        value = entry->value;
-        if (kDebugStyles) {
-          ALOGI("-> From def style: type=0x%x, data=0x%08x, style=0x%08x", value.dataType, value.data,
-              entry->style);
-        }
-        value_source_resid = entry->style;
-      }
-    }
-
-    uint32_t resid = 0u;
-    if (value.dataType != Res_value::TYPE_NULL) {
-      // Take care of resolving the found resource to its final value.
-      ApkAssetsCookie new_cookie =
-          theme->ResolveAttributeReference(cookie, &value, &config, &type_set_flags, &resid);
-      if (new_cookie != kInvalidCookie) {
-        cookie = new_cookie;
-      }
-
-      if (kDebugStyles) {
-        ALOGI("-> Resolved attr: type=0x%x, data=0x%08x", value.dataType, value.data);
-      }
-    } else if (value.data != Res_value::DATA_NULL_EMPTY) {
-      // If we still don't have a value for this attribute, try to find it in the theme!
-      ApkAssetsCookie new_cookie = theme->GetAttribute(cur_ident, &value, &type_set_flags);
-      // TODO: set value_source_resid for the style in the theme that was used.
-      if (new_cookie != kInvalidCookie) {
-        if (kDebugStyles) {
-          ALOGI("-> From theme: type=0x%x, data=0x%08x", value.dataType, value.data);
-        }
-        new_cookie =
-            assetmanager->ResolveReference(new_cookie, &value, &config, &type_set_flags, &resid);
-        if (new_cookie != kInvalidCookie) {
-          cookie = new_cookie;
-        }
-
-        if (kDebugStyles) {
-          ALOGI("-> Resolved theme: type=0x%x, data=0x%08x", value.dataType, value.data);
-        }
-      }
-    }
-
-    // Deal with the special @null value -- it turns back to TYPE_NULL.
-    if (value.dataType == Res_value::TYPE_REFERENCE && value.data == 0) {
-      if (kDebugStyles) {
-        ALOGI("-> Setting to @null!");
-      }
-      value.dataType = Res_value::TYPE_NULL;
-      value.data = Res_value::DATA_NULL_UNDEFINED;
-      cookie = kInvalidCookie;
-    }
-
-    if (kDebugStyles) {
-      ALOGI("Attribute 0x%08x: type=0x%x, data=0x%08x", cur_ident, value.dataType, value.data);
+      resolver.Resolve(cur_ident, value, xml_parser->getSourceResourceId(), out_values);
+    } else {
+      // Write the final value back to Java.
+      std::copy_n(&styled->values[ii * STYLE_NUM_ENTRIES], STYLE_NUM_ENTRIES, out_values);
     }
 
-    // Write the final value back to Java.
-    out_values[STYLE_TYPE] = value.dataType;
-    out_values[STYLE_DATA] = value.data;
-    out_values[STYLE_ASSET_COOKIE] = ApkAssetsCookieToJavaCookie(cookie);
-    out_values[STYLE_RESOURCE_ID] = resid;
-    out_values[STYLE_CHANGING_CONFIGURATIONS] = type_set_flags;
-    out_values[STYLE_DENSITY] = config.density;
-    out_values[STYLE_SOURCE_RESOURCE_ID] = value_source_resid;
-
-    if (value.dataType != Res_value::TYPE_NULL || value.data == Res_value::DATA_NULL_EMPTY) {
+    if (out_values[STYLE_TYPE] != Res_value::TYPE_NULL ||
+        out_values[STYLE_DATA] == Res_value::DATA_NULL_EMPTY) {
       indices_idx++;
 
       // out_indices must NOT be nullptr.
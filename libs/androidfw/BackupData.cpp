@@ -16,6 +16,7 @@
 
 #define LOG_TAG "backup_data"
 
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
@@ -49,6 +50,13 @@ padding_extra(size_t n)
     return ROUND_UP[n % 4];
 }
 
+// Entity headers and small entities are gathered up to this size before they are written.
+static const size_t kWriteBufferSize = 64 * 1024;
+
+// Reads are done in chunks of this size, so that headers, keys and padding don't each take
+// a read.
+static const size_t kReadBufferSize = 64 * 1024;
+
 BackupDataWriter::BackupDataWriter(int fd)
     :m_fd(fd),
      m_status(NO_ERROR),
@@ -60,41 +68,87 @@ BackupDataWriter::BackupDataWriter(int fd)
 
 BackupDataWriter::~BackupDataWriter()
 {
+    Flush();
+}
+
+status_t
+BackupDataWriter::write_fully(const void* data, size_t size)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    while (size > 0) {
+        ssize_t amt = write(m_fd, p, size);
+        if (amt < 0 && errno == EINTR) {
+            continue;
+        }
+        if (amt <= 0) {
+            m_status = amt < 0 ? errno : EIO;
+            if (kIsDebug) ALOGD("write returned error %d (%s)", m_status, strerror(m_status));
+            return m_status;
+        }
+        p += amt;
+        size -= amt;
+        m_pos += amt;
+    }
+    return NO_ERROR;
+}
+
+status_t
+BackupDataWriter::Flush()
+{
+    if (m_status != NO_ERROR || m_buffer.empty()) {
+        m_buffer.clear();
+        return m_status;
+    }
+    // m_pos already counts the buffered bytes.
+    m_pos -= m_buffer.size();
+    status_t err = write_fully(m_buffer.data(), m_buffer.size());
+    m_buffer.clear();
+    return err;
+}
+
+status_t
+BackupDataWriter::append(const void* data, size_t size)
+{
+    if (m_buffer.size() + size > kWriteBufferSize) {
+        status_t err = Flush();
+        if (err != NO_ERROR) {
+            return err;
+        }
+        if (size >= kWriteBufferSize) {
+            return write_fully(data, size);
+        }
+    }
+    const uint8_t* p = (const uint8_t*)data;
+    m_buffer.insert(m_buffer.end(), p, p + size);
+    m_pos += size;
+    return NO_ERROR;
 }
 
 // Pad out anything they've previously written to the next 4 byte boundary.
 status_t
-BackupDataWriter::write_padding_for(int n)
+BackupDataWriter::append_padding_for(int n)
 {
-    ssize_t amt;
     ssize_t paddingSize;
 
     paddingSize = padding_extra(n);
     if (paddingSize > 0) {
         uint32_t padding = 0xbcbcbcbc;
         if (kIsDebug) ALOGI("writing %zd padding bytes for %d", paddingSize, n);
-        amt = write(m_fd, &padding, paddingSize);
-        if (amt != paddingSize) {
-            m_status = errno;
-            return m_status;
-        }
-        m_pos += amt;
+        return append(&padding, paddingSize);
     }
     return NO_ERROR;
 }
 
 status_t
-BackupDataWriter::WriteEntityHeader(const String8& key, size_t dataSize)
+BackupDataWriter::append_entity_header(const String8& key, int dataSize)
 {
     if (m_status != NO_ERROR) {
         return m_status;
     }
 
-    ssize_t amt;
-
-    amt = write_padding_for(m_pos);
-    if (amt != 0) {
-        return amt;
+    status_t err = append_padding_for(m_pos);
+    if (err != NO_ERROR) {
+        return err;
     }
 
     String8 k;
@@ -106,7 +160,7 @@ BackupDataWriter::WriteEntityHeader(const String8& key, size_t dataSize)
         k = key;
     }
     if (kIsDebug) {
-        ALOGD("Writing header: prefix='%s' key='%s' dataSize=%zu", m_keyPrefix.string(),
+        ALOGD("Writing header: prefix='%s' key='%s' dataSize=%d", m_keyPrefix.string(),
                 key.string(), dataSize);
     }
 
@@ -120,26 +174,36 @@ BackupDataWriter::WriteEntityHeader(const String8& key, size_t dataSize)
     header.dataSize = tolel(dataSize);
 
     if (kIsDebug) ALOGI("writing entity header, %zu bytes", sizeof(entity_header_v1));
-    amt = write(m_fd, &header, sizeof(entity_header_v1));
-    if (amt != sizeof(entity_header_v1)) {
-        m_status = errno;
-        return m_status;
+    err = append(&header, sizeof(entity_header_v1));
+    if (err != NO_ERROR) {
+        return err;
     }
-    m_pos += amt;
 
     if (kIsDebug) ALOGI("writing entity header key, %zd bytes", keyLen+1);
-    amt = write(m_fd, k.string(), keyLen+1);
-    if (amt != keyLen+1) {
-        m_status = errno;
-        return m_status;
+    err = append(k.string(), keyLen+1);
+    if (err != NO_ERROR) {
+        return err;
     }
-    m_pos += amt;
 
-    amt = write_padding_for(keyLen+1);
+    err = append_padding_for(keyLen+1);
 
     m_entityCount++;
 
-    return amt;
+    return err;
+}
+
+status_t
+BackupDataWriter::WriteEntityHeader(const String8& key, size_t dataSize)
+{
+    status_t err = append_entity_header(key, dataSize);
+    if (err != NO_ERROR) {
+        return err;
+    }
+    // A header with data goes out with the first WriteEntityData.  Deletions have none.
+    if ((int)dataSize <= 0) {
+        return Flush();
+    }
+    return NO_ERROR;
 }
 
 status_t
@@ -157,14 +221,24 @@ BackupDataWriter::WriteEntityData(const void* data, size_t size)
     // We don't write padding here, because they're allowed to call this several
     // times with smaller buffers.  We write it at the end of WriteEntityHeader
     // instead.
-    ssize_t amt = write(m_fd, data, size);
-    if (amt != (ssize_t)size) {
-        m_status = errno;
-        if (kIsDebug) ALOGD("write returned error %d (%s)", m_status, strerror(m_status));
-        return m_status;
+    if (m_buffer.empty()) {
+        return write_fully(data, size);
     }
-    m_pos += amt;
-    return NO_ERROR;
+    status_t err = append(data, size);
+    if (err != NO_ERROR) {
+        return err;
+    }
+    return Flush();
+}
+
+status_t
+BackupDataWriter::WriteEntity(const String8& key, const void* data, ssize_t dataSize)
+{
+    status_t err = append_entity_header(key, dataSize < 0 ? -1 : dataSize);
+    if (err != NO_ERROR || dataSize <= 0) {
+        return err;
+    }
+    return append(data, dataSize);
 }
 
 void
@@ -178,7 +252,9 @@ BackupDataReader::BackupDataReader(int fd)
     :m_fd(fd),
      m_done(false),
      m_status(NO_ERROR),
-     m_entityCount(0)
+     m_entityCount(0),
+     m_bufferPos(0),
+     m_bufferEnd(0)
 {
     memset(&m_header, 0, sizeof(m_header));
     m_pos = (ssize_t) lseek(fd, 0, SEEK_CUR);
@@ -237,7 +313,7 @@ BackupDataReader::ReadNextHeader(bool* done, int* type)
     else if (amt != NO_ERROR) {
         return amt;
     }
-    amt = read(m_fd, &m_header, sizeof(m_header));
+    amt = read_buffered(&m_header, sizeof(m_header));
     *done = m_done = (amt == 0);
     if (*done) {
         return NO_ERROR;
@@ -270,7 +346,7 @@ BackupDataReader::ReadNextHeader(bool* done, int* type)
                 m_status = ENOMEM;
                 return m_status;
             }
-            int amt = read(m_fd, buf, size+1);
+            int amt = read_buffered(buf, size+1);
             CHECK_SIZE(amt, (int)size+1);
             m_key.unlockBuffer(size);
             m_pos += size+1;
@@ -317,12 +393,19 @@ BackupDataReader::SkipEntityData()
     if (m_header.type != BACKUP_HEADER_ENTITY_V1) {
         return EINVAL;
     }
-    if (m_header.entity.dataSize > 0) {
-        int pos = lseek(m_fd, m_dataEndPos, SEEK_SET);
-        if (pos == -1) {
-            return errno;
+    if (m_header.entity.dataSize > 0 && m_dataEndPos > m_pos) {
+        size_t skip = m_dataEndPos - m_pos;
+        if (skip <= m_bufferEnd - m_bufferPos) {
+            m_bufferPos += skip;
+            m_pos = m_dataEndPos;
+        } else {
+            int pos = lseek(m_fd, m_dataEndPos, SEEK_SET);
+            if (pos == -1) {
+                return errno;
+            }
+            m_bufferPos = m_bufferEnd = 0;
+            m_pos = pos;
         }
-        m_pos = pos;
     }
     SKIP_PADDING();
     return NO_ERROR;
@@ -348,7 +431,7 @@ BackupDataReader::ReadEntityData(void* data, size_t size)
     if (kIsDebug) {
         ALOGD("   reading %zu bytes", size);
     }
-    int amt = read(m_fd, data, size);
+    int amt = read_buffered(data, size);
     if (amt < 0) {
         m_status = errno;
         return -1;
@@ -370,12 +453,57 @@ BackupDataReader::skip_padding()
     paddingSize = padding_extra(m_pos);
     if (paddingSize > 0) {
         uint32_t padding;
-        amt = read(m_fd, &padding, paddingSize);
+        amt = read_buffered(&padding, paddingSize);
         CHECK_SIZE(amt, paddingSize);
         m_pos += amt;
     }
     return NO_ERROR;
 }
 
+// Reads size bytes, from what was read ahead first.  Returns fewer only at the end of the
+// file, or -1 with errno set if the read failed.  Does not move m_pos.
+ssize_t
+BackupDataReader::read_buffered(void* data, size_t size)
+{
+    uint8_t* p = (uint8_t*)data;
+    size_t done = 0;
+    while (done < size) {
+        if (m_bufferPos < m_bufferEnd) {
+            size_t n = m_bufferEnd - m_bufferPos;
+            if (n > size - done) {
+                n = size - done;
+            }
+            memcpy(p + done, m_buffer.data() + m_bufferPos, n);
+            m_bufferPos += n;
+            done += n;
+            continue;
+        }
+
+        // Large entity data skips the buffer.
+        ssize_t amt;
+        if (size - done >= kReadBufferSize) {
+            amt = read(m_fd, p + done, size - done);
+        } else {
+            m_buffer.resize(kReadBufferSize);
+            amt = read(m_fd, m_buffer.data(), kReadBufferSize);
+            m_bufferPos = 0;
+            m_bufferEnd = amt > 0 ? amt : 0;
+            if (amt > 0) {
+                continue;
+            }
+        }
+        if (amt < 0 && errno == EINTR) {
+            continue;
+        }
+        if (amt < 0) {
+            return -1;
+        }
+        if (amt == 0) {
+            break;
+        }
+        done += amt;
+    }
+    return done;
+}
 
 } // namespace android
@@ -22,6 +22,7 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/time.h>  // for utimes
@@ -30,6 +31,11 @@
 #include <utime.h>
 #include <zlib.h>
 
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
 #include <log/log.h>
 #include <utils/ByteOrder.h>
 #include <utils/KeyedVector.h>
@@ -310,25 +316,95 @@ compute_crc32(const char* file, FileRec* out) {
         return -1;
     }
 
-    const int bufsize = 4*1024;
-    int amt;
-
-    char* buf = (char*)malloc(bufsize);
-    int crc = crc32(0L, Z_NULL, 0);
-
-    lseek(fd, 0, SEEK_SET);
+    uLong crc = crc32(0L, Z_NULL, 0);
 
-    while ((amt = read(fd, buf, bufsize)) != 0) {
-        crc = crc32(crc, (Bytef*)buf, amt);
+    // Map the file rather than copying it through a small buffer. zlib's crc32() computes the
+    // CRC-32 the snapshots have always held, so old snapshots still compare.
+    struct stat st;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    if (data != MAP_FAILED) {
+        madvise(data, st.st_size, MADV_SEQUENTIAL);
+        const Bytef* bytes = reinterpret_cast<const Bytef*>(data);
+        for (off_t offset = 0; offset < st.st_size;) {
+            const uInt amt = static_cast<uInt>(std::min<off_t>(st.st_size - offset, 1 << 30));
+            crc = crc32(crc, bytes + offset, amt);
+            offset += amt;
+        }
+        munmap(data, st.st_size);
+    } else {
+        const int bufsize = 64*1024;
+        char* buf = (char*)malloc(bufsize);
+        int amt;
+        while ((amt = read(fd, buf, bufsize)) > 0) {
+            crc = crc32(crc, (Bytef*)buf, amt);
+        }
+        free(buf);
     }
 
     close(fd);
-    free(buf);
 
     out->s.crc32 = crc;
     return NO_ERROR;
 }
 
+// The most threads scan_files() stats and checksums files on.
+static const size_t kMaxScanThreads = 4;
+
+enum {
+    SCAN_OK,
+    SCAN_NOT_FOUND,
+    SCAN_UNREADABLE,
+};
+
+/*
+ * Stats and checksums every file into its record, on a few threads since it is mostly waiting
+ * for storage. Returns a SCAN_* status for each file.
+ */
+static std::vector<int>
+scan_files(char const* const* files, int fileCount, std::vector<FileRec>* records)
+{
+    std::vector<int> results(fileCount, SCAN_OK);
+    records->resize(fileCount);
+    std::atomic<int> next(0);
+
+    auto scan = [&]() {
+        for (int i = next++; i < fileCount; i = next++) {
+            FileRec& r = (*records)[i];
+            char const* file = files[i];
+            r.file = file;
+            struct stat st;
+
+            if (stat(file, &st) != 0) {
+                results[i] = SCAN_NOT_FOUND;
+                continue;
+            }
+            r.deleted = false;
+            r.s.modTime_sec = st.st_mtime;
+            r.s.modTime_nsec = 0; // workaround sim breakage
+            //r.s.modTime_nsec = st.st_mtime_nsec;
+            r.s.mode = st.st_mode;
+            r.s.size = st.st_size;
+
+            if (compute_crc32(file, &r) != NO_ERROR) {
+                results[i] = SCAN_UNREADABLE;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < std::min(static_cast<size_t>(fileCount), kMaxScanThreads); i++) {
+        threads.emplace_back(scan);
+    }
+    scan();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    return results;
+}
+
 int
 back_up_files(int oldSnapshotFD, BackupDataWriter* dataStream, int newSnapshotFD,
         char const* const* files, char const* const* keys, int fileCount)
@@ -345,37 +421,26 @@ back_up_files(int oldSnapshotFD, BackupDataWriter* dataStream, int newSnapshotFD
         }
     }
 
+    std::vector<FileRec> records;
+    const std::vector<int> results = scan_files(files, fileCount, &records);
+
     for (int i=0; i<fileCount; i++) {
         String8 key(keys[i]);
-        FileRec r;
-        char const* file = files[i];
-        r.file = file;
-        struct stat st;
-
-        err = stat(file, &st);
-        if (err != 0) {
+        if (results[i] == SCAN_NOT_FOUND) {
             // not found => treat as deleted
             continue;
-        } else {
-            r.deleted = false;
-            r.s.modTime_sec = st.st_mtime;
-            r.s.modTime_nsec = 0; // workaround sim breakage
-            //r.s.modTime_nsec = st.st_mtime_nsec;
-            r.s.mode = st.st_mode;
-            r.s.size = st.st_size;
+        }
 
-            if (newSnapshot.indexOfKey(key) >= 0) {
-                LOGP("back_up_files key already in use '%s'", key.string());
-                return -1;
-            }
+        if (newSnapshot.indexOfKey(key) >= 0) {
+            LOGP("back_up_files key already in use '%s'", key.string());
+            return -1;
+        }
 
-            // compute the CRC
-            if (compute_crc32(file, &r) != NO_ERROR) {
-                ALOGW("Unable to open file %s", file);
-                continue;
-            }
+        if (results[i] == SCAN_UNREADABLE) {
+            ALOGW("Unable to open file %s", files[i]);
+            continue;
         }
-        newSnapshot.add(key, r);
+        newSnapshot.add(key, records[i]);
     }
 
     int n = 0;
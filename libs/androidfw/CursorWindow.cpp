@@ -22,30 +22,96 @@
 #include <utils/Log.h>
 
 #include <cutils/ashmem.h>
+#include <linux/memfd.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include <algorithm>
 
 #include <assert.h>
+#include <fcntl.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 namespace android {
 
+// Growable windows start out at most this big.
+static const size_t INITIAL_GROWABLE_WINDOW_SIZE = 128 * 1024;
+
+// Returns the size of the window in fd, or -1 if it is neither an ashmem region nor a memfd
+// that is sealed against shrinking.
+static ssize_t getWindowSize(int fd) {
+    if (ashmem_valid(fd)) {
+        return ashmem_get_size_region(fd);
+    }
+
+    // A growable window. As it can't shrink, a mapping of its current size stays backed.
+    struct stat sb;
+    int seals = ::fcntl(fd, F_GET_SEALS);
+    if (seals < 0 || !(seals & F_SEAL_SHRINK) || ::fstat(fd, &sb) != 0) {
+        return -1;
+    }
+    return sb.st_size;
+}
+
 CursorWindow::CursorWindow(const String8& name, int ashmemFd,
-        void* data, size_t size, bool readOnly) :
-        mName(name), mAshmemFd(ashmemFd), mData(data), mSize(size), mReadOnly(readOnly) {
+        void* data, size_t size, size_t maxSize, bool readOnly) :
+        mName(name), mAshmemFd(ashmemFd), mData(data), mSize(size), mMaxSize(maxSize),
+        mReadOnly(readOnly), mLastAllocRow(UINT32_MAX), mLastAllocFieldDirOffset(0) {
     mHeader = static_cast<Header*>(mData);
 }
 
 CursorWindow::~CursorWindow() {
-    ::munmap(mData, mSize);
+    ::munmap(mData, mMaxSize);
     ::close(mAshmemFd);
 }
 
 status_t CursorWindow::create(const String8& name, size_t size, CursorWindow** outCursorWindow) {
+    return create(name, std::min(size, INITIAL_GROWABLE_WINDOW_SIZE), size, outCursorWindow);
+}
+
+status_t CursorWindow::create(const String8& name, size_t initialSize, size_t maxSize,
+        CursorWindow** outCursorWindow) {
     String8 ashmemName("CursorWindow: ");
     ashmemName.append(name);
 
     status_t result;
+    if (initialSize < maxSize) {
+        int memfd = ::syscall(__NR_memfd_create, ashmemName.string(),
+                MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (memfd < 0) {
+            ALOGW("CursorWindow: memfd_create() failed: errno=%d, using a fixed size window.",
+                    errno);
+        } else if (::ftruncate(memfd, initialSize) != 0
+                || ::fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK) != 0) {
+            ALOGE("CursorWindow: sizing memfd failed: errno=%d.", errno);
+            ::close(memfd);
+        } else {
+            // Only the first initialSize bytes are backed until the window grows.
+            void* data = ::mmap(NULL, maxSize, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+            if (data == MAP_FAILED) {
+                ALOGE("CursorWindow: mmap() failed: errno=%d.", errno);
+                ::close(memfd);
+            } else {
+                CursorWindow* window = new CursorWindow(name, memfd,
+                        data, initialSize, maxSize, false /*readOnly*/);
+                result = window->clear();
+                if (!result) {
+                    LOG_WINDOW("Created new growable CursorWindow: mSize=%zu, mMaxSize=%zu, "
+                            "mData=%p", window->mSize, window->mMaxSize, window->mData);
+                    *outCursorWindow = window;
+                    return OK;
+                }
+                delete window;
+                *outCursorWindow = NULL;
+                return result;
+            }
+        }
+    }
+
+    const size_t size = maxSize;
     int ashmemFd = ashmem_create_region(ashmemName.string(), size);
     if (ashmemFd < 0) {
         result = -errno;
@@ -65,7 +131,7 @@ status_t CursorWindow::create(const String8& name, size_t size, CursorWindow** o
                     ALOGE("CursorWindow: ashmem_set_prot_region() failed: errno=%d.", errno);
                 } else {
                     CursorWindow* window = new CursorWindow(name, ashmemFd,
-                            data, size, false /*readOnly*/);
+                            data, size, size, false /*readOnly*/);
                     result = window->clear();
                     if (!result) {
                         LOG_WINDOW("Created new CursorWindow: freeOffset=%d, "
@@ -98,10 +164,11 @@ status_t CursorWindow::createFromParcel(Parcel* parcel, CursorWindow** outCursor
         result = BAD_TYPE;
         ALOGE("CursorWindow: readFileDescriptor() failed");
     } else {
-        ssize_t size = ashmem_get_size_region(ashmemFd);
+        const bool growable = !ashmem_valid(ashmemFd);
+        ssize_t size = getWindowSize(ashmemFd);
         if (size < 0) {
             result = UNKNOWN_ERROR;
-            ALOGE("CursorWindow: ashmem_get_size_region() failed: errno=%d.", errno);
+            ALOGE("CursorWindow: getting the window size failed: errno=%d.", errno);
         } else {
             int dupAshmemFd = ::fcntl(ashmemFd, F_DUPFD_CLOEXEC, 0);
             if (dupAshmemFd < 0) {
@@ -109,12 +176,14 @@ status_t CursorWindow::createFromParcel(Parcel* parcel, CursorWindow** outCursor
                 ALOGE("CursorWindow: fcntl() failed: errno=%d.", errno);
             } else {
                 // the size of the ashmem descriptor can be modified between ashmem_get_size_region
-                // call and mmap, so we'll check again immediately after memory is mapped
+                // call and mmap, so we'll check again immediately after memory is mapped.
+                // A growable window can only grow, which leaves the mapping valid.
                 void* data = ::mmap(NULL, size, PROT_READ, MAP_SHARED, dupAshmemFd, 0);
                 if (data == MAP_FAILED) {
                     result = -errno;
                     ALOGE("CursorWindow: mmap() failed: errno=%d.", errno);
-                } else if ((actualSize = ashmem_get_size_region(dupAshmemFd)) != size) {
+                } else if (!growable
+                        && (actualSize = ashmem_get_size_region(dupAshmemFd)) != size) {
                     ::munmap(data, size);
                     result = BAD_VALUE;
                     ALOGE("CursorWindow: ashmem_get_size_region() returned %d, expected %d"
@@ -122,7 +191,7 @@ status_t CursorWindow::createFromParcel(Parcel* parcel, CursorWindow** outCursor
                             actualSize, (int) size, errno);
                 } else {
                     CursorWindow* window = new CursorWindow(name, dupAshmemFd,
-                            data, size, true /*readOnly*/);
+                            data, size, size, true /*readOnly*/);
                     LOG_WINDOW("Created CursorWindow from parcel: freeOffset=%d, "
                             "numRows=%d, numColumns=%d, mSize=%d, mData=%p",
                             window->mHeader->freeOffset,
@@ -143,7 +212,20 @@ status_t CursorWindow::createFromParcel(Parcel* parcel, CursorWindow** outCursor
 status_t CursorWindow::writeToParcel(Parcel* parcel) {
     status_t status = parcel->writeString8(mName);
     if (!status) {
-        status = parcel->writeDupFileDescriptor(mAshmemFd);
+        if (ashmem_valid(mAshmemFd)) {
+            // The region was made read-only for everyone else on creation.
+            status = parcel->writeDupFileDescriptor(mAshmemFd);
+        } else {
+            // A memfd has no such protection, so only hand out a read-only descriptor of it.
+            String8 path = String8::format("/proc/self/fd/%d", mAshmemFd);
+            int readOnlyFd = ::open(path.string(), O_RDONLY | O_CLOEXEC);
+            if (readOnlyFd < 0) {
+                ALOGE("CursorWindow: reopening the window read-only failed: errno=%d.", errno);
+                status = -errno;
+            } else {
+                status = parcel->writeFileDescriptor(readOnlyFd, true /*takeOwnership*/);
+            }
+        }
     }
     return status;
 }
@@ -157,6 +239,7 @@ status_t CursorWindow::clear() {
     mHeader->firstChunkOffset = sizeof(Header);
     mHeader->numRows = 0;
     mHeader->numColumns = 0;
+    mLastAllocRow = UINT32_MAX;
 
     RowSlotChunk* firstChunk = static_cast<RowSlotChunk*>(offsetToPtr(mHeader->firstChunkOffset));
     firstChunk->nextChunkOffset = 0;
@@ -203,6 +286,8 @@ status_t CursorWindow::allocRow() {
     LOG_WINDOW("Allocated row %u, rowSlot is at offset %u, fieldDir is %d bytes at offset %u\n",
             mHeader->numRows - 1, offsetFromPtr(rowSlot), fieldDirSize, fieldDirOffset);
     rowSlot->offset = fieldDirOffset;
+    mLastAllocRow = mHeader->numRows - 1;
+    mLastAllocFieldDirOffset = fieldDirOffset;
     return OK;
 }
 
@@ -214,6 +299,9 @@ status_t CursorWindow::freeLastRow() {
     if (mHeader->numRows > 0) {
         mHeader->numRows--;
     }
+    if (mLastAllocRow >= mHeader->numRows) {
+        mLastAllocRow = UINT32_MAX;
+    }
     return OK;
 }
 
@@ -228,7 +316,7 @@ uint32_t CursorWindow::alloc(size_t size, bool aligned) {
 
     uint32_t offset = mHeader->freeOffset + padding;
     uint32_t nextFreeOffset = offset + size;
-    if (nextFreeOffset > mSize) {
+    if (nextFreeOffset > mSize && !grow(nextFreeOffset)) {
         ALOGW("Window is full: requested allocation %zu bytes, "
                 "free space %zu bytes, window size %zu bytes",
                 size, freeSpace(), mSize);
@@ -239,6 +327,22 @@ uint32_t CursorWindow::alloc(size_t size, bool aligned) {
     return offset;
 }
 
+bool CursorWindow::grow(size_t minSize) {
+    if (minSize > mMaxSize) {
+        return false;
+    }
+
+    // Doubling keeps the number of ftruncate() calls per window small.
+    size_t newSize = std::max(minSize, std::min(mSize * 2, mMaxSize));
+    if (::ftruncate(mAshmemFd, newSize) != 0) {
+        ALOGE("CursorWindow: growing to %zu bytes failed: errno=%d.", newSize, errno);
+        return false;
+    }
+    LOG_WINDOW("Grew CursorWindow from %zu to %zu bytes", mSize, newSize);
+    mSize = newSize;
+    return true;
+}
+
 CursorWindow::RowSlot* CursorWindow::getRowSlot(uint32_t row) {
     uint32_t chunkPos = row;
     RowSlotChunk* chunk = static_cast<RowSlotChunk*>(
@@ -280,6 +384,10 @@ CursorWindow::FieldSlot* CursorWindow::getFieldSlot(uint32_t row, uint32_t colum
                 row, column, mHeader->numRows, mHeader->numColumns);
         return NULL;
     }
+    if (row == mLastAllocRow) {
+        FieldSlot* fieldDir = static_cast<FieldSlot*>(offsetToPtr(mLastAllocFieldDirOffset));
+        return &fieldDir[column];
+    }
     RowSlot* rowSlot = getRowSlot(row);
     if (!rowSlot) {
         ALOGE("Failed to find rowSlot for row %d.", row);
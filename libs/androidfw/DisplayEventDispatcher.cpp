@@ -18,6 +18,7 @@
 
 #include <cinttypes>
 #include <cstdint>
+#include <cstdlib>
 
 #include <androidfw/DisplayEventDispatcher.h>
 #include <gui/DisplayEventReceiver.h>
@@ -33,6 +34,57 @@ namespace android {
 // using just a few large reads.
 static const size_t EVENT_BUFFER_SIZE = 100;
 
+// Intervals between vsync events longer than this many periods only move the phase of the
+// predictor, they are too coarse to refine the period.
+static const nsecs_t MAX_PERIODS_PER_SAMPLE = 8;
+
+// The longest plausible vsync period, for the first estimate.
+static const nsecs_t MAX_VSYNC_PERIOD = ms2ns(100);
+
+void VsyncPredictor::addVsync(nsecs_t timestamp) {
+    if (mLastTimestamp == 0 || timestamp <= mLastTimestamp) {
+        mLastTimestamp = timestamp;
+        return;
+    }
+
+    const nsecs_t interval = timestamp - mLastTimestamp;
+    mLastTimestamp = timestamp;
+    if (mPeriod == 0) {
+        if (interval <= MAX_VSYNC_PERIOD) {
+            mPeriod = interval;
+        }
+        return;
+    }
+
+    const nsecs_t periods = (interval + mPeriod / 2) / mPeriod;
+    if (periods < 1 || periods > MAX_PERIODS_PER_SAMPLE) {
+        return;
+    }
+    const nsecs_t sample = interval / periods;
+    if (std::abs(sample - mPeriod) < mPeriod / 4) {
+        // Smooth out the jitter of the timestamps.
+        mPeriod += (sample - mPeriod) / 8;
+    } else if (periods == 1) {
+        // The first estimate spanned several periods, or the refresh rate changed.
+        mPeriod = sample;
+    }
+}
+
+void VsyncPredictor::reset() {
+    mLastTimestamp = 0;
+    mPeriod = 0;
+}
+
+nsecs_t VsyncPredictor::getNextVsync(nsecs_t time) const {
+    if (mPeriod == 0) {
+        return 0;
+    }
+    if (time < mLastTimestamp) {
+        return mLastTimestamp;
+    }
+    return mLastTimestamp + ((time - mLastTimestamp) / mPeriod + 1) * mPeriod;
+}
+
 DisplayEventDispatcher::DisplayEventDispatcher(const sp<Looper>& looper,
         ISurfaceComposer::VsyncSource vsyncSource,
         ISurfaceComposer::ConfigChanged configChanged) :
@@ -129,6 +181,7 @@ bool DisplayEventDispatcher::processPendingEvents(
                 // Later vsync events will just overwrite the info from earlier
                 // ones. That's fine, we only care about the most recent.
                 gotVsync = true;
+                mVsyncPredictor.addVsync(ev.header.timestamp);
                 *outTimestamp = ev.header.timestamp;
                 *outDisplayId = ev.header.displayId;
                 *outCount = ev.vsync.count;
@@ -137,6 +190,8 @@ bool DisplayEventDispatcher::processPendingEvents(
                 dispatchHotplug(ev.header.timestamp, ev.header.displayId, ev.hotplug.connected);
                 break;
             case DisplayEventReceiver::DISPLAY_EVENT_CONFIG_CHANGED:
+                // The refresh rate may have changed.
+                mVsyncPredictor.reset();
                 dispatchConfigChanged(ev.header.timestamp, ev.header.displayId, ev.config.configId);
                 break;
             default:
@@ -155,8 +155,8 @@ std::unique_ptr<const LoadedIdmap> LoadedIdmap::Load(const StringPiece& idmap_da
 
     // Only add a non-empty overlay.
     if (dtohs(entry_header->entry_count != 0)) {
-      loaded_idmap->type_map_[static_cast<uint8_t>(dtohs(entry_header->overlay_type_id))] =
-          entry_header;
+      loaded_idmap->type_map_.set(static_cast<uint8_t>(dtohs(entry_header->overlay_type_id)),
+                                  entry_header);
     }
 
     const size_t entry_size_bytes =
@@ -180,11 +180,7 @@ uint8_t LoadedIdmap::TargetPackageId() const {
 }
 
 const IdmapEntry_header* LoadedIdmap::GetEntryMapForType(uint8_t type_id) const {
-  auto iter = type_map_.find(type_id);
-  if (iter != type_map_.end()) {
-    return iter->second;
-  }
-  return nullptr;
+  return type_map_[type_id];
 }
 
 }  // namespace android
@@ -33,6 +33,7 @@
 #endif
 #endif
 
+#include "androidfw/ArscIndex.h"
 #include "androidfw/ByteBucketArray.h"
 #include "androidfw/Chunk.h"
 #include "androidfw/ResourceUtils.h"
@@ -401,7 +402,8 @@ const LoadedPackage* LoadedArsc::GetPackageById(uint8_t package_id) const {
 
 std::unique_ptr<const LoadedPackage> LoadedPackage::Load(const Chunk& chunk,
                                                          const LoadedIdmap* loaded_idmap,
-                                                         bool system, bool load_as_shared_library) {
+                                                         bool system, bool load_as_shared_library,
+                                                         const LoadedArscIndex* index) {
   ATRACE_NAME("LoadedPackage::Load");
   std::unique_ptr<LoadedPackage> loaded_package(new LoadedPackage());
 
@@ -447,9 +449,18 @@ std::unique_ptr<const LoadedPackage> LoadedPackage::Load(const Chunk& chunk,
   // contiguous block of memory that holds all the Types together with the TypeSpec.
   std::unordered_map<int, std::unique_ptr<TypeSpecPtrBuilder>> type_builder_map;
 
+  // With an index, only the chunks other than type specs and types are visited here. The type
+  // specs and types are taken from the index below, without touching them.
+  const LoadedArscIndex::PackageChunks* indexed_chunks =
+      index != nullptr && loaded_idmap == nullptr ? index->GetPackageChunks(header) : nullptr;
+  size_t next_indexed_chunk = 0u;
+
   ChunkIterator iter(chunk.data_ptr(), chunk.data_size());
-  while (iter.HasNext()) {
-    const Chunk child_chunk = iter.Next();
+  while (indexed_chunks != nullptr ? next_indexed_chunk < indexed_chunks->chunks.size()
+                                   : iter.HasNext()) {
+    const Chunk child_chunk = indexed_chunks != nullptr
+                                  ? Chunk(indexed_chunks->chunks[next_indexed_chunk++])
+                                  : iter.Next();
     switch (child_chunk.type()) {
       case RES_STRING_POOL_TYPE: {
         const uintptr_t pool_address =
@@ -672,6 +683,18 @@ std::unique_ptr<const LoadedPackage> LoadedPackage::Load(const Chunk& chunk,
     }
   }
 
+  if (indexed_chunks != nullptr) {
+    for (const LoadedArscIndex::TypeSpecChunks& type_spec_chunks : indexed_chunks->type_specs) {
+      const ResTable_typeSpec* type_spec = type_spec_chunks.type_spec;
+      std::unique_ptr<TypeSpecPtrBuilder>& builder_ptr = type_builder_map[type_spec->id - 1];
+      builder_ptr = util::make_unique<TypeSpecPtrBuilder>(type_spec, nullptr /*idmap_header*/);
+      loaded_package->resource_ids_.set(type_spec->id, dtohl(type_spec->entryCount));
+      for (const ResTable_type* type : type_spec_chunks.types) {
+        builder_ptr->AddType(type);
+      }
+    }
+  }
+
   // Flatten and construct the TypeSpecs.
   for (auto& entry : type_builder_map) {
     uint8_t type_idx = static_cast<uint8_t>(entry.first);
@@ -696,7 +719,7 @@ std::unique_ptr<const LoadedPackage> LoadedPackage::Load(const Chunk& chunk,
 }
 
 bool LoadedArsc::LoadTable(const Chunk& chunk, const LoadedIdmap* loaded_idmap,
-                           bool load_as_shared_library) {
+                           bool load_as_shared_library, const LoadedArscIndex* index) {
   const ResTable_header* header = chunk.header<ResTable_header>();
   if (header == nullptr) {
     LOG(ERROR) << "RES_TABLE_TYPE too small.";
@@ -735,7 +758,7 @@ bool LoadedArsc::LoadTable(const Chunk& chunk, const LoadedIdmap* loaded_idmap,
         packages_seen++;
 
         std::unique_ptr<const LoadedPackage> loaded_package =
-            LoadedPackage::Load(child_chunk, loaded_idmap, system_, load_as_shared_library);
+            LoadedPackage::Load(child_chunk, loaded_idmap, system_, load_as_shared_library, index);
         if (!loaded_package) {
           return false;
         }
@@ -759,8 +782,9 @@ bool LoadedArsc::LoadTable(const Chunk& chunk, const LoadedIdmap* loaded_idmap,
 
 std::unique_ptr<const LoadedArsc> LoadedArsc::Load(const StringPiece& data,
                                                    const LoadedIdmap* loaded_idmap, bool system,
-                                                   bool load_as_shared_library) {
-  ATRACE_NAME("LoadedArsc::LoadTable");
+                                                   bool load_as_shared_library,
+                                                   const LoadedArscIndex* index) {
+  ATRACE_NAME(index != nullptr ? "LoadedArsc::LoadTable indexed" : "LoadedArsc::LoadTable");
 
   // Not using make_unique because the constructor is private.
   std::unique_ptr<LoadedArsc> loaded_arsc(new LoadedArsc());
@@ -771,7 +795,7 @@ std::unique_ptr<const LoadedArsc> LoadedArsc::Load(const StringPiece& data,
     const Chunk chunk = iter.Next();
     switch (chunk.type()) {
       case RES_TABLE_TYPE:
-        if (!loaded_arsc->LoadTable(chunk, loaded_idmap, load_as_shared_library)) {
+        if (!loaded_arsc->LoadTable(chunk, loaded_idmap, load_as_shared_library, index)) {
           return {};
         }
         break;
@@ -30,6 +30,7 @@
 #include <memory>
 #include <set>
 #include <type_traits>
+#include <unordered_map>
 
 #include <android-base/macros.h>
 #include <androidfw/ByteBucketArray.h>
@@ -654,15 +655,12 @@ status_t ResStringPool::getError() const
 void ResStringPool::uninit()
 {
     mError = NO_INIT;
-    if (mHeader != NULL && mCache != NULL) {
+    std::atomic<char16_t*>* cache = mCache.exchange(NULL);
+    if (mHeader != NULL && cache != NULL) {
         for (size_t x = 0; x < mHeader->stringCount; x++) {
-            if (mCache[x] != NULL) {
-                free(mCache[x]);
-                mCache[x] = NULL;
-            }
+            free(cache[x].load(std::memory_order_relaxed));
         }
-        free(mCache);
-        mCache = NULL;
+        free(cache);
     }
     if (mOwnedData) {
         free(mOwnedData);
@@ -746,10 +744,12 @@ const char16_t* ResStringPool::stringAt(size_t idx, size_t* u16len) const
 
                 // encLen must be less than 0x7FFF due to encoding.
                 if ((uint32_t)(u8str+u8len-strings) < mStringPoolSize) {
-                    AutoMutex lock(mDecodeLock);
-
-                    if (mCache != NULL && mCache[idx] != NULL) {
-                        return mCache[idx];
+                    std::atomic<char16_t*>* cache = mCache.load(std::memory_order_acquire);
+                    if (cache != NULL) {
+                        char16_t* cached = cache[idx].load(std::memory_order_acquire);
+                        if (cached != NULL) {
+                            return cached;
+                        }
                     }
 
                     // Retrieve the actual length of the utf8 string if the
@@ -779,7 +779,7 @@ const char16_t* ResStringPool::stringAt(size_t idx, size_t* u16len) const
 
                     utf8_to_utf16(u8str, u8len, u16str, *u16len + 1);
 
-                    if (mCache == NULL) {
+                    if (cache == NULL) {
 #ifndef __ANDROID__
                         if (kDebugStringPoolNoisy) {
                             ALOGI("CREATING STRING CACHE OF %zu bytes",
@@ -790,19 +790,37 @@ const char16_t* ResStringPool::stringAt(size_t idx, size_t* u16len) const
                         ALOGW("CREATING STRING CACHE OF %zu bytes",
                                 static_cast<size_t>(mHeader->stringCount*sizeof(char16_t**)));
 #endif
-                        mCache = (char16_t**)calloc(mHeader->stringCount, sizeof(char16_t*));
-                        if (mCache == NULL) {
+                        // Zeroed memory is a table of null atomic pointers.
+                        static_assert(sizeof(std::atomic<char16_t*>) == sizeof(char16_t*),
+                                      "std::atomic<char16_t*> is not lock-free");
+                        std::atomic<char16_t*>* newCache = (std::atomic<char16_t*>*)calloc(
+                                mHeader->stringCount, sizeof(std::atomic<char16_t*>));
+                        if (newCache == NULL) {
                             ALOGW("No memory trying to allocate decode cache table of %d bytes\n",
                                   (int)(mHeader->stringCount*sizeof(char16_t**)));
+                            free(u16str);
                             return NULL;
                         }
+                        // Another thread may have created the table meanwhile.
+                        if (mCache.compare_exchange_strong(cache, newCache,
+                                                           std::memory_order_acq_rel)) {
+                            cache = newCache;
+                        } else {
+                            free(newCache);
+                        }
                     }
 
                     if (kDebugStringPoolNoisy) {
                       ALOGI("Caching UTF8 string: %s", u8str);
                     }
 
-                    mCache[idx] = u16str;
+                    // If another thread decoded the same string meanwhile, use its copy.
+                    char16_t* expected = NULL;
+                    if (!cache[idx].compare_exchange_strong(expected, u16str,
+                                                            std::memory_order_acq_rel)) {
+                        free(u16str);
+                        return expected;
+                    }
                     return u16str;
                 } else {
                     ALOGW("Bad string block: string #%lld extends to %lld, past end at %lld\n",
@@ -2412,6 +2430,11 @@ bool ResTable_config::isLocaleBetterThan(const ResTable_config& o,
 
 bool ResTable_config::isBetterThan(const ResTable_config& o,
         const ResTable_config* requested) const {
+    return isBetterThan(o, requested, requested != NULL && isLocaleBetterThan(o, requested));
+}
+
+bool ResTable_config::isBetterThan(const ResTable_config& o,
+        const ResTable_config* requested, bool localeIsBetter) const {
     if (requested) {
         if (imsi || o.imsi) {
             if ((mcc != o.mcc) && requested->mcc) {
@@ -2423,7 +2446,7 @@ bool ResTable_config::isBetterThan(const ResTable_config& o,
             }
         }
 
-        if (isLocaleBetterThan(o, requested)) {
+        if (localeIsBetter) {
             return true;
         }
 
@@ -3589,6 +3612,7 @@ struct ResTable::PackageGroup
                 }
             }
         }
+        cachedEntries.clear();
     }
 
     ssize_t findType16(const char16_t* type, size_t len) const {
@@ -3621,6 +3645,11 @@ struct ResTable::PackageGroup
     // be shared by other ResTable's (framework resources are shared this way).
     ByteBucketArray<TypeCacheEntry> typeCacheEntries;
 
+    // The entries that getEntry() found for the parameters of the ResTable, keyed by
+    // (type index << 16) | entry index. Cleared along with typeCacheEntries, and when packages
+    // are added to the group. Guarded by ResTable::mFilteredConfigLock.
+    mutable std::unordered_map<uint32_t, Entry> cachedEntries;
+
     // The table mapping dynamic references to resolved references for
     // this package group.
     // TODO: We may be able to support dynamic references in overlays
@@ -6377,6 +6406,22 @@ status_t ResTable::getEntry(
         return BAD_TYPE;
     }
 
+    // Lookups for the parameters of this ResTable are memoized, since tools look up every
+    // resource, often more than once.
+    const bool isForParams = config && memcmp(&mParams, config, sizeof(mParams)) == 0;
+    const uint32_t cacheKey = (static_cast<uint32_t>(typeIndex) << 16)
+            | static_cast<uint32_t>(entryIndex);
+    if (isForParams) {
+        AutoMutex _lock(mFilteredConfigLock);
+        auto cachedIter = packageGroup->cachedEntries.find(cacheKey);
+        if (cachedIter != packageGroup->cachedEntries.end()) {
+            if (outEntry != NULL) {
+                *outEntry = cachedIter->second;
+            }
+            return NO_ERROR;
+        }
+    }
+
     const ResTable_type* bestType = NULL;
     uint32_t bestOffset = ResTable_type::NO_ENTRY;
     const Package* bestPackage = NULL;
@@ -6547,14 +6592,25 @@ status_t ResTable::getEntry(
         return BAD_TYPE;
     }
 
+    Entry result;
+    result.entry = entry;
+    result.config = bestConfig;
+    result.type = bestType;
+    result.specFlags = specFlags;
+    result.package = bestPackage;
+    result.typeStr = StringPoolRef(&bestPackage->typeStrings, actualTypeIndex - bestPackage->typeIdOffset);
+    result.keyStr = StringPoolRef(&bestPackage->keyStrings, dtohl(entry->key.index));
+
+    if (isForParams) {
+        AutoMutex _lock(mFilteredConfigLock);
+        // The parameters may have changed since, along with the filtered configurations used.
+        if (memcmp(&mParams, config, sizeof(mParams)) == 0) {
+            packageGroup->cachedEntries[cacheKey] = result;
+        }
+    }
+
     if (outEntry != NULL) {
-        outEntry->entry = entry;
-        outEntry->config = bestConfig;
-        outEntry->type = bestType;
-        outEntry->specFlags = specFlags;
-        outEntry->package = bestPackage;
-        outEntry->typeStr = StringPoolRef(&bestPackage->typeStrings, actualTypeIndex - bestPackage->typeIdOffset);
-        outEntry->keyStr = StringPoolRef(&bestPackage->keyStrings, dtohl(entry->key.index));
+        *outEntry = result;
     }
     return NO_ERROR;
 }
@@ -6673,6 +6729,12 @@ status_t ResTable::parsePackage(const ResTable_package* const pkg,
         return (mError=err);
     }
 
+    // The types of the package can change what the group resolves to.
+    {
+        AutoMutex _lock(mFilteredConfigLock);
+        group->cachedEntries.clear();
+    }
+
     // Iterate through all chunks.
     const ResChunk_header* chunk =
         (const ResChunk_header*)(((const uint8_t*)pkg)
@@ -34,6 +34,10 @@
 #include <assert.h>
 #include <unistd.h>
 
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#endif
+
 using namespace android;
 
 class _ZipEntryRO {
@@ -53,6 +57,46 @@ private:
     _ZipEntryRO& operator=(const _ZipEntryRO& other);
 };
 
+/*
+ * Copy a stored entry to an open file descriptor in the kernel, without going through a user
+ * space buffer. Returns "false", with the file position back where it was, if that isn't
+ * possible, e.g. for archives that aren't backed by a file.
+ *
+ * Like ExtractEntryToFile, it writes at the current file position. The data is not checked
+ * against the entry's CRC; the whole APK is covered by its signature.
+ */
+static bool copyStoredEntry(ZipArchiveHandle handle, const ZipEntry& entry, int fd)
+{
+#if defined(__linux__)
+    const int zipFd = GetFileDescriptor(handle);
+    const off64_t start = lseek64(fd, 0, SEEK_CUR);
+    if (zipFd < 0 || start < 0) {
+        return false;
+    }
+
+    off64_t offset = entry.offset;
+    uint64_t remaining = entry.uncompressed_length;
+    while (remaining > 0) {
+        const ssize_t copied = TEMP_FAILURE_RETRY(sendfile64(fd, zipFd, &offset, remaining));
+        if (copied <= 0) {
+            ALOGV("sendfile failed (%s), extracting the regular way",
+                    copied < 0 ? strerror(errno) : "short copy");
+            if (lseek64(fd, start, SEEK_SET) != start || ftruncate64(fd, start) != 0) {
+                ALOGW("Couldn't rewind the output file: %s", strerror(errno));
+            }
+            return false;
+        }
+        remaining -= copied;
+    }
+    return true;
+#else
+    (void) handle;
+    (void) entry;
+    (void) fd;
+    return false;
+#endif
+}
+
 ZipFileRO::~ZipFileRO() {
     CloseArchive(mHandle);
     if (mFileName != NULL) {
@@ -259,6 +303,11 @@ bool ZipFileRO::uncompressEntry(ZipEntryRO entry, void* buffer, size_t size) con
 bool ZipFileRO::uncompressEntry(ZipEntryRO entry, int fd) const
 {
     _ZipEntryRO *zipEntry = reinterpret_cast<_ZipEntryRO*>(entry);
+    if (zipEntry->entry.method == kCompressStored &&
+            copyStoredEntry(mHandle, zipEntry->entry, fd)) {
+        return true;
+    }
+
     const int32_t error = ExtractEntryToFile(mHandle, &(zipEntry->entry), fd);
     if (error) {
         ALOGW("ExtractToMemory failed with %s", ErrorCodeString(error));
@@ -19,6 +19,7 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "android-base/macros.h"
 #include "android-base/unique_fd.h"
@@ -65,9 +66,48 @@ class ApkAssets {
                                                      const std::string& friendly_name, bool system,
                                                      bool force_shared_lib);
 
+  // What LoadAll() loads, the same way as the Load methods above.
+  struct LoadRequest {
+    enum class Kind {
+      kApk,
+      kSharedLibrary,
+      // `path` is the path of the IDMAP.
+      kOverlay,
+    };
+
+    std::string path;
+    Kind kind = Kind::kApk;
+    bool system = false;
+  };
+
+  // Loads the ApkAssets of all `requests` concurrently, returning them in the same order, with
+  // nullptr for the ones that failed to load. The result can be passed to
+  // AssetManager2::SetApkAssets() in one step.
+  // ApkAssets are immutable, so any one that is still alive from an earlier LoadAll() in this
+  // process for the same file (by path, inode and modification time) is reused instead of being
+  // loaded again.
+  static std::vector<std::shared_ptr<const ApkAssets>> LoadAll(
+      const std::vector<LoadRequest>& requests);
+
+  // Creates the index of the resources.arsc of the APK at `path` into `index_path`, so that
+  // loading the APK can skip walking its resource table. Returns false if the APK or its resource
+  // table fails to load.
+  // The APKs loaded by Load() and LoadAsSharedLibrary() use the index at GetArscIndexPath(), for
+  // as long as it was created from the same resources.arsc.
+  static bool CreateArscIndex(const std::string& path, const std::string& index_path);
+
+  // Returns where the resources.arsc index of the APK at `path` is looked up.
+  static std::string GetArscIndexPath(const std::string& path);
+
+  // Opens the entry at `path`. `mode` also tells the kernel how the mapped entry will be read.
   std::unique_ptr<Asset> Open(const std::string& path,
                               Asset::AccessMode mode = Asset::AccessMode::ACCESS_RANDOM) const;
 
+  // Starts reading the entries at `paths` into the page cache without waiting for the reads, so
+  // that the files a process needs at start up are resident by the time they are opened. Paths
+  // that are not in the APK are skipped. Returns the number of entries found.
+  size_t Prefetch(const std::vector<std::string>& paths) const;
+
   bool ForEachFile(const std::string& path,
                    const std::function<void(const StringPiece&, FileType)>& f) const;
 
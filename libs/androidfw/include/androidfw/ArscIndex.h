@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ARSCINDEX_H_
+#define ARSCINDEX_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "android-base/macros.h"
+
+#include "androidfw/ResourceTypes.h"
+#include "androidfw/StringPiece.h"
+
+namespace android {
+
+// The on-disk layout of an index, in host byte order since it never leaves the device it was
+// created on. All offsets are from the start of the resources.arsc data.
+//
+//   ArscIndex_header
+//   package_count times:
+//     ArscIndex_package
+//     chunk_count uint32_t offsets of the package's child chunks, other than type specs and types
+//     type_spec_count times:
+//       ArscIndex_typeSpec
+//       type_count uint32_t offsets of the types of the type spec
+struct ArscIndex_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t arsc_size;
+  uint32_t arsc_crc32;
+  uint32_t package_count;
+};
+
+struct ArscIndex_package {
+  uint32_t package_offset;
+  uint32_t chunk_count;
+  uint32_t type_spec_count;
+};
+
+struct ArscIndex_typeSpec {
+  uint32_t type_spec_offset;
+  uint32_t type_count;
+};
+
+// A prebuilt index of the chunks of a resources.arsc, so that LoadedArsc::Load() does not have to
+// walk every type chunk of the table, and page in the memory around each one, in every process
+// that loads it.
+//
+// An index is created from a table that loads successfully, and is only ever used with the table
+// of the same size and CRC-32 it was created from. The chunks it points to were verified when it
+// was created, so apart from checking that the offsets lie within the table, loading with an
+// index trusts it. Indexes must therefore only be read from locations that only the system can
+// write to.
+class LoadedArscIndex {
+ public:
+  struct TypeSpecChunks {
+    const ResTable_typeSpec* type_spec;
+    std::vector<const ResTable_type*> types;
+  };
+
+  struct PackageChunks {
+    const ResTable_package* package;
+    std::vector<const ResChunk_header*> chunks;
+    std::vector<TypeSpecChunks> type_specs;
+  };
+
+  // Creates the index of `arsc_data` into `out_index`. Returns false if the table does not load.
+  static bool Create(const StringPiece& arsc_data, uint32_t arsc_crc32, std::string* out_index);
+
+  // Loads an index for `arsc_data`, which must outlive the LoadedArscIndex. Returns nullptr if the
+  // index is malformed or was created from a different table.
+  static std::unique_ptr<const LoadedArscIndex> Load(const StringPiece& index_data,
+                                                     const StringPiece& arsc_data,
+                                                     uint32_t arsc_crc32);
+
+  // Returns the chunks of the package chunk `package`, or nullptr if they are not indexed.
+  const PackageChunks* GetPackageChunks(const ResTable_package* package) const;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(LoadedArscIndex);
+
+  LoadedArscIndex() = default;
+
+  std::vector<PackageChunks> packages_;
+};
+
+}  // namespace android
+
+#endif  // ARSCINDEX_H_
@@ -21,6 +21,9 @@
 
 #include <array>
 #include <limits>
+#include <list>
+#include <map>
+#include <memory>
 #include <set>
 #include <unordered_map>
 
@@ -33,6 +36,7 @@
 namespace android {
 
 class Theme;
+struct ThemeData;
 
 using ApkAssetsCookie = int32_t;
 
@@ -72,7 +76,30 @@ struct ResolvedBag {
   Entry entries[0];
 };
 
-struct FindEntryResult;
+struct FindEntryResult {
+  // A pointer to the resource table entry for this resource.
+  // If the size of the entry is > sizeof(ResTable_entry), it can be cast to
+  // a ResTable_map_entry and processed as a bag/map.
+  const ResTable_entry* entry;
+
+  // The configuration for which the resulting entry was defined. This is already swapped to host
+  // endianness.
+  ResTable_config config;
+
+  // The bitmask of configuration axis with which the resource value varies.
+  uint32_t type_flags;
+
+  // The dynamic package ID map for the package from which this resource came from.
+  const DynamicRefTable* dynamic_ref_table;
+
+  // The string pool reference to the type's name. This uses a different string pool than
+  // the global string pool, but this is hidden from the caller.
+  StringPoolRef type_string_ref;
+
+  // The string pool reference to the entry's name. This uses a different string pool than
+  // the global string pool, but this is hidden from the caller.
+  StringPoolRef entry_string_ref;
+};
 
 // AssetManager2 is the main entry point for accessing assets and resources.
 // AssetManager2 provides caching of resources retrieved via the underlying ApkAssets.
@@ -93,8 +120,28 @@ class AssetManager2 {
     size_t entry_len = 0u;
   };
 
+  // Keeps GetBag() from evicting bags to stay within the bag cache limit while in scope, so that
+  // the bags it returned stay valid. Needed by callers that hold more than one bag at a time.
+  class ScopedBagPin {
+   public:
+    explicit ScopedBagPin(AssetManager2* asset_manager) : asset_manager_(asset_manager) {
+      asset_manager_->bag_pins_++;
+    }
+
+    ~ScopedBagPin() {
+      asset_manager_->bag_pins_--;
+    }
+
+   private:
+    DISALLOW_COPY_AND_ASSIGN(ScopedBagPin);
+
+    AssetManager2* asset_manager_;
+  };
+
   AssetManager2();
 
+  ~AssetManager2();
+
   // Sets/resets the underlying ApkAssets for this AssetManager. The ApkAssets
   // are not owned by the AssetManager, and must have a longer lifetime.
   //
@@ -131,6 +178,12 @@ class AssetManager2 {
   // caches that are related to the configuration change to be invalidated.
   void SetConfiguration(const ResTable_config& configuration);
 
+  // Changes whenever the ApkAssets or the configuration change, and is never the same for two
+  // AssetManagers. Lets the callers cache what they derive from resources.
+  inline uint64_t GetGeneration() const {
+    return generation_;
+  }
+
   inline const ResTable_config& GetConfiguration() const {
     return configuration_;
   }
@@ -240,6 +293,7 @@ class AssetManager2 {
   // resource has been resolved yet.
   std::string GetLastResourceResolution() const;
 
+  // Returns the resource IDs of the bag with ID `resid` and of its parents, child first.
   const std::vector<uint32_t> GetBagResIdStack(uint32_t resid);
 
   // Retrieves the best matching bag/map resource with ID `resid`.
@@ -252,8 +306,24 @@ class AssetManager2 {
   //      ...
   //    }
   //  }
+  //
+  // The bag stays valid until the bag cache is invalidated or, with a bag cache limit, until the
+  // next call to GetBag() outside of a ScopedBagPin.
   const ResolvedBag* GetBag(uint32_t resid);
 
+  // Limits the memory held by resolved bags to about `limit_bytes`. Before resolving a bag that is
+  // not cached, GetBag() evicts the least recently used bags over the limit. 0 means no limit,
+  // which is the default.
+  void SetBagCacheLimit(size_t limit_bytes);
+
+  // Returns the memory held by the resolved bags of this AssetManager.
+  size_t GetBagCacheBytes() const {
+    return cached_bag_bytes_;
+  }
+
+  // Returns the memory held by the resolved bags of all AssetManagers of the process.
+  static size_t GetGlobalBagCacheBytes();
+
   // Creates a new Theme from this AssetManager.
   std::unique_ptr<Theme> NewTheme();
 
@@ -303,13 +373,59 @@ class AssetManager2 {
   // This should always be called when mutating the AssetManager's configuration or ApkAssets set.
   void RebuildFilterList(bool filter_incompatible_configs = true);
 
+  // Re-constructs only the lists of the types with configurations that specify any of the
+  // configuration axes denoted by the bitmask `diff`, after the configuration changed along them.
+  void UpdateFilterList(uint32_t diff);
+
+  // Returns the index of the locale of `config` in filtered_locales_, adding it if it is not there
+  // yet.
+  uint16_t IndexLocale(const ResTable_config& config);
+
   // AssetManager2::GetBag(resid) wraps this function to track which resource ids have already
   // been seen while traversing bag parents.
   const ResolvedBag* GetBag(uint32_t resid, std::vector<uint32_t>& child_resids);
 
+  // A resolved bag, in a single allocation with its style stack: the resource ID of the bag
+  // followed by those of its parents. The stacks are kept because they might be requested a number
+  // of times for each view during View inspection.
+  struct CachedBag {
+    util::unique_cptr<ResolvedBag> bag;
+
+    // The style stack, stored right after the entries of `bag`.
+    const uint32_t* stack;
+    uint32_t stack_size;
+
+    // The size of the allocation of `bag`.
+    size_t size;
+
+    // The position of the bag in bag_lru_.
+    std::list<uint32_t>::iterator lru_position;
+  };
+
+  // Allocates a bag of `entry_count` entries, followed by room for a style stack of `stack_size`
+  // resource IDs.
+  static util::unique_cptr<ResolvedBag> AllocateBag(size_t entry_count, size_t stack_size);
+
+  // Caches `bag`, of `entry_count` entries, for `resid`. Its style stack is `resid` followed by
+  // the stack of the cached bag `parent_resid`, if not 0. Returns the cached bag.
+  const ResolvedBag* CacheBag(uint32_t resid, util::unique_cptr<ResolvedBag> bag,
+                              size_t entry_count, uint32_t parent_resid);
+
+  // Evicts the least recently used bags until the bag cache is within bag_cache_limit_.
+  void TrimBagCache();
+
+  // Evicts the bag cached at `iter` of cached_bags_, returns the iterator following it.
+  std::unordered_map<uint32_t, CachedBag>::iterator EvictBag(
+      std::unordered_map<uint32_t, CachedBag>::iterator iter);
+
   // Retrieve the assigned package id of the package if loaded into this AssetManager
   uint8_t GetAssignedPackageId(const LoadedPackage* package);
 
+  // Returns the attributes of a theme that had `applied_styles` applied after it was cleared, if
+  // such a theme was seen since the affected caches were last purged. See Theme::ApplyStyle.
+  std::shared_ptr<ThemeData> GetCachedTheme(const std::vector<uint64_t>& applied_styles) const;
+  void CacheTheme(const std::vector<uint64_t>& applied_styles, std::shared_ptr<ThemeData> data);
+
   // The ordered list of ApkAssets to search. These are not owned by the AssetManager, and must
   // have a longer lifetime.
   std::vector<const ApkAssets*> apk_assets_;
@@ -319,6 +435,13 @@ class AssetManager2 {
   struct FilteredConfigGroup {
     std::vector<ResTable_config> configurations;
     std::vector<const ResTable_type*> types;
+
+    // For each configuration, the index of its locale in AssetManager2::filtered_locales_.
+    std::vector<uint16_t> locales;
+
+    // The CONFIG_* dimensions that any configuration of the type specifies, filtered out or not.
+    // The filter only has to be rebuilt when one of these changes.
+    uint32_t config_dimensions = 0u;
   };
 
   // Represents an single package.
@@ -360,13 +483,51 @@ class AssetManager2 {
   // may need to be purged.
   ResTable_config configuration_;
 
+  // The distinct locales of the configurations in the filtered_configs_ of the packages, and how
+  // they compare for configuration_: locale_better_[i][j] is
+  // filtered_locales_[i].isLocaleBetterThan(filtered_locales_[j], &configuration_). This way
+  // FindEntry() does not compare the regions of the locales again for every resource.
+  std::vector<ResTable_config> filtered_locales_;
+  std::vector<std::vector<bool>> locale_better_;
+
+  // Whether the filtered_configs_ of the packages only hold configurations that match
+  // configuration_, as opposed to all of them.
+  bool configs_filtered_ = false;
+
+  uint64_t generation_;
+
   // Cached set of bags. These are cached because they can inherit keys from parent bags,
   // which involves some calculation.
-  std::unordered_map<uint32_t, util::unique_cptr<ResolvedBag>> cached_bags_;
+  std::unordered_map<uint32_t, CachedBag> cached_bags_;
+
+  // The resource IDs of cached_bags_, most recently used first.
+  std::list<uint32_t> bag_lru_;
+
+  // The memory held by cached_bags_, and how much it may hold, with 0 for no limit.
+  size_t cached_bag_bytes_ = 0u;
+  size_t bag_cache_limit_ = 0u;
+
+  // The number of ScopedBagPins alive. No bags are evicted for the limit while there are any.
+  int bag_pins_ = 0;
+
+  // The result of FindEntry() for a resource in the current configuration.
+  struct CachedEntry {
+    ApkAssetsCookie cookie;
+    FindEntryResult entry;
+  };
+
+  // Cached FindEntry() results for the current configuration, so that a resource looked up again
+  // does not go through every package and configuration. An entry is purged when the
+  // configuration changes along one of the axes in its type_flags.
+  mutable std::unordered_map<uint32_t, CachedEntry> cached_entries_;
+
+  // How often FindEntry() could use cached_entries_, reported by DumpToLog().
+  mutable uint32_t cached_entry_hits_ = 0u;
+  mutable uint32_t cached_entry_misses_ = 0u;
 
-  // Cached set of bag resid stacks for each bag. These are cached because they might be requested
-  // a number of times for each view during View inspection.
-  std::unordered_map<uint32_t, std::vector<uint32_t>> cached_bag_resid_stacks_;
+  // Attributes of themes keyed by the styles applied to them, shared by the Themes with the same
+  // styles applied. Purged like cached_bags_, as they are made of bags.
+  std::map<std::vector<uint64_t>, std::shared_ptr<ThemeData>> cached_themes_;
 
   // Whether or not to save resource resolution steps
   bool resource_resolution_logging_enabled_ = false;
@@ -444,9 +605,11 @@ class Theme {
 
   // Returns a bit mask of configuration changes that will impact this
   // theme (and thus require completely reloading it).
-  inline uint32_t GetChangingConfigurations() const {
-    return type_spec_flags_;
-  }
+  uint32_t GetChangingConfigurations() const;
+
+  // Changes whenever the attributes of this theme may have changed. Themes with the same
+  // attributes may share a generation, other themes never do.
+  uint64_t GetGeneration() const;
 
   // Retrieve a value in the theme. If the theme defines this value, returns an asset cookie
   // indicating which ApkAssets it came from and populates `out_value` with the value.
@@ -473,14 +636,21 @@ class Theme {
   // Called by AssetManager2.
   explicit Theme(AssetManager2* asset_manager);
 
+  // Returns data_ to be modified, after making it a copy of its own if it is shared.
+  ThemeData* MutableData();
+
   AssetManager2* asset_manager_;
-  uint32_t type_spec_flags_ = 0u;
 
-  // Defined in the cpp.
-  struct Package;
+  // The attributes set by the applied styles, null if there are none. Copy-on-write: shared with
+  // the themes that were set to this one or had the same styles applied, and with the
+  // AssetManager's cache of themes.
+  std::shared_ptr<ThemeData> data_;
 
-  constexpr static size_t kPackageCount = std::numeric_limits<uint8_t>::max() + 1;
-  std::array<std::unique_ptr<Package>, kPackageCount> packages_;
+  // The styles applied since the theme was last cleared, each as (resid << 1 | force), which
+  // identify data_ in the AssetManager's cache. Not valid once the theme was set to a theme of
+  // another AssetManager, or a style failed to apply half way.
+  std::vector<uint64_t> applied_styles_;
+  bool applied_styles_valid_ = true;
 };
 
 inline const ResolvedBag::Entry* begin(const ResolvedBag* bag) {
@@ -19,6 +19,8 @@
 
 #include <sys/stat.h>
 
+#include <vector>
+
 #include <utils/Errors.h>
 #include <utils/String8.h>
 #include <utils/KeyedVector.h>
@@ -61,6 +63,9 @@ struct FileRec {
 /**
  * Writes the data.
  *
+ * Entity headers are held back until their data is written, so that each entity takes a single
+ * write.  Everything else is on the fd by the time a call returns.
+ *
  * If an error occurs, it poisons this object and all write calls will fail
  * with the error that occurred.
  */
@@ -82,17 +87,28 @@ public:
      */
     status_t WriteEntityData(const void* data, size_t size);
 
+    /* Writes a whole entity, or a deletion if dataSize is negative.  Entities written this
+     * way are gathered into large writes, and may stay in memory until Flush() is called.
+     */
+    status_t WriteEntity(const String8& key, const void* data, ssize_t dataSize);
+
+    status_t Flush();
+
     void SetKeyPrefix(const String8& keyPrefix);
 
 private:
     explicit BackupDataWriter();
-    status_t write_padding_for(int n);
-    
+    status_t append_padding_for(int n);
+    status_t append_entity_header(const String8& key, int dataSize);
+    status_t append(const void* data, size_t size);
+    status_t write_fully(const void* data, size_t size);
+
     int m_fd;
     status_t m_status;
     ssize_t m_pos;
     int m_entityCount;
     String8 m_keyPrefix;
+    std::vector<uint8_t> m_buffer;
 };
 
 /**
@@ -119,7 +135,8 @@ public:
 private:
     explicit BackupDataReader();
     status_t skip_padding();
-    
+    ssize_t read_buffered(void* data, size_t size);
+
     int m_fd;
     bool m_done;
     status_t m_status;
@@ -131,6 +148,10 @@ private:
         entity_header_v1 entity;
     } m_header;
     String8 m_key;
+    // Bytes read ahead of m_pos, from m_bufferPos to m_bufferEnd.
+    std::vector<uint8_t> m_buffer;
+    size_t m_bufferPos;
+    size_t m_bufferEnd;
 };
 
 int back_up_files(int oldSnapshotFD, BackupDataWriter* dataStream, int newSnapshotFD,
@@ -51,7 +51,7 @@ namespace android {
  */
 class CursorWindow {
     CursorWindow(const String8& name, int ashmemFd,
-            void* data, size_t size, bool readOnly);
+            void* data, size_t size, size_t maxSize, bool readOnly);
 
 public:
     /* Field types. */
@@ -81,7 +81,21 @@ public:
 
     ~CursorWindow();
 
+    /**
+     * Creates a window that holds up to size bytes. It starts out smaller and grows as rows are
+     * added, see the overload below.
+     */
     static status_t create(const String8& name, size_t size, CursorWindow** outCursorWindow);
+
+    /**
+     * Creates a window of initialSize bytes, which grows in place up to maxSize bytes when it
+     * runs out of space. The whole maxSize is reserved in the address space up front, so
+     * pointers into the window stay valid as it grows.
+     * Growing needs a memfd; if one can't be created, the window is a fixed size ashmem region
+     * of maxSize bytes.
+     */
+    static status_t create(const String8& name, size_t initialSize, size_t maxSize,
+            CursorWindow** outCursorWindow);
     static status_t createFromParcel(Parcel* parcel, CursorWindow** outCursorWindow);
 
     status_t writeToParcel(Parcel* parcel);
@@ -164,10 +178,18 @@ private:
     String8 mName;
     int mAshmemFd;
     void* mData;
+    // The usable size of the window, and the size of the mapping it can grow to.
     size_t mSize;
+    size_t mMaxSize;
     bool mReadOnly;
     Header* mHeader;
 
+    // The row last added by allocRow() and the offset of its field directory. A row is
+    // filled right after it is allocated, so this spares getFieldSlot() walking the row
+    // slot chunks for every field put into it.
+    uint32_t mLastAllocRow;
+    uint32_t mLastAllocFieldDirOffset;
+
     inline void* offsetToPtr(uint32_t offset, uint32_t bufferSize = 0) {
         if (offset >= mSize) {
             ALOGE("Offset %" PRIu32 " out of bounds, max value %zu", offset, mSize);
@@ -192,6 +214,11 @@ private:
      */
     uint32_t alloc(size_t size, bool aligned = false);
 
+    /**
+     * Grows the window so that it is at least minSize bytes. Returns false if it can't.
+     */
+    bool grow(size_t minSize);
+
     RowSlot* getRowSlot(uint32_t row);
     RowSlot* allocRowSlot();
 
@@ -17,9 +17,32 @@
 #include <gui/DisplayEventReceiver.h>
 #include <utils/Log.h>
 #include <utils/Looper.h>
+#include <utils/Timers.h>
 
 namespace android {
 
+// Estimates the vsync period and phase from the timestamps of the vsync events seen, to predict
+// the upcoming vsyncs. Vsync events are only sent when requested, so the interval between two of
+// them may span several periods.
+class VsyncPredictor {
+public:
+    void addVsync(nsecs_t timestamp);
+
+    // Forgets the period, e.g. when the display configuration changed.
+    void reset();
+
+    // Returns the estimated vsync period, or 0 while it is unknown.
+    nsecs_t getPeriod() const { return mPeriod; }
+
+    // Returns the predicted time of the first vsync after 'time', or 0 while the period is
+    // unknown.
+    nsecs_t getNextVsync(nsecs_t time) const;
+
+private:
+    nsecs_t mLastTimestamp = 0;
+    nsecs_t mPeriod = 0;
+};
+
 class DisplayEventDispatcher : public LooperCallback {
 public:
     explicit DisplayEventDispatcher(const sp<Looper>& looper,
@@ -30,6 +53,15 @@ public:
     void dispose();
     status_t scheduleVsync();
 
+    // The vsync period estimated from the vsyncs received so far, or 0 while it is unknown.
+    nsecs_t getVsyncPeriod() const { return mVsyncPredictor.getPeriod(); }
+
+    // The predicted time of the first vsync after 'time', e.g. the deadline of the frame that
+    // started at the vsync at 'time', or 0 while the period is unknown.
+    nsecs_t getPredictedNextVsync(nsecs_t time) const {
+        return mVsyncPredictor.getNextVsync(time);
+    }
+
 protected:
     virtual ~DisplayEventDispatcher() = default;
 
@@ -37,6 +69,7 @@ private:
     sp<Looper> mLooper;
     DisplayEventReceiver mReceiver;
     bool mWaitingForVsync;
+    VsyncPredictor mVsyncPredictor;
 
     virtual void dispatchVsync(nsecs_t timestamp, PhysicalDisplayId displayId, uint32_t count) = 0;
     virtual void dispatchHotplug(nsecs_t timestamp, PhysicalDisplayId displayId,
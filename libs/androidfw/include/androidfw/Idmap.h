@@ -19,10 +19,10 @@
 
 #include <memory>
 #include <string>
-#include <unordered_map>
 
 #include "android-base/macros.h"
 
+#include "androidfw/ByteBucketArray.h"
 #include "androidfw/StringPiece.h"
 
 namespace android {
@@ -63,7 +63,8 @@ class LoadedIdmap {
 
   const Idmap_header* header_ = nullptr;
   std::string overlay_apk_path_;
-  std::unordered_map<uint8_t, const IdmapEntry_header*> type_map_;
+  // Indexed by overlay type ID.
+  ByteBucketArray<const IdmapEntry_header*> type_map_;
 
  private:
   DISALLOW_COPY_AND_ASSIGN(LoadedIdmap);
@@ -34,6 +34,7 @@
 
 #include <android/configuration.h>
 
+#include <atomic>
 #include <memory>
 
 namespace android {
@@ -532,11 +533,12 @@ private:
     void*                       mOwnedData;
     const ResStringPool_header* mHeader;
     size_t                      mSize;
-    mutable Mutex               mDecodeLock;
     const uint32_t*             mEntries;
     const uint32_t*             mEntryStyles;
     const void*                 mStrings;
-    char16_t mutable**          mCache;
+    // UTF-16 copies of the UTF-8 strings decoded so far. Filled without a lock: each slot, and
+    // the table itself, is set at most once with a compare-and-swap.
+    mutable std::atomic<std::atomic<char16_t*>*> mCache;
     uint32_t                    mStringPoolSize;    // number of uint16_t
     const uint32_t*             mStyles;
     uint32_t                    mStylePoolSize;    // number of uint32_t
@@ -1254,6 +1256,12 @@ struct ResTable_config
     // it wins.  If this IS generic, o wins (return false).
     bool isBetterThan(const ResTable_config& o, const ResTable_config* requested) const;
 
+    // Same as isBetterThan(o, requested) for a non-NULL 'requested', given the result of
+    // isLocaleBetterThan(o, requested) in 'localeIsBetter', e.g. from a table computed ahead of
+    // time for the requested locale.
+    bool isBetterThan(const ResTable_config& o, const ResTable_config* requested,
+            bool localeIsBetter) const;
+
     // Return true if 'this' can be considered a match for the parameters in 
     // 'settings'.
     // Note this is asymetric.  A default piece of data will match every request
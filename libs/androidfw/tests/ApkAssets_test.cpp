@@ -28,6 +28,8 @@ using ::android::base::unique_fd;
 using ::com::android::basic::R;
 using ::testing::Eq;
 using ::testing::Ge;
+using ::testing::IsNull;
+using ::testing::Ne;
 using ::testing::NotNull;
 using ::testing::SizeIs;
 using ::testing::StrEq;
@@ -112,6 +114,37 @@ TEST(ApkAssetsTest, LoadApkWithIdmap) {
   ASSERT_THAT(ApkAssets::LoadOverlay(tf.path), NotNull());
 }
 
+TEST(ApkAssetsTest, LoadAll) {
+  using Kind = ApkAssets::LoadRequest::Kind;
+  const std::vector<ApkAssets::LoadRequest> requests = {
+      {GetTestDataPath() + "/basic/basic.apk", Kind::kApk, false /*system*/},
+      {GetTestDataPath() + "/appaslib/appaslib.apk", Kind::kSharedLibrary, false /*system*/},
+      {GetTestDataPath() + "/does/not/exist.apk", Kind::kApk, false /*system*/},
+  };
+
+  std::vector<std::shared_ptr<const ApkAssets>> loaded_apks = ApkAssets::LoadAll(requests);
+  ASSERT_THAT(loaded_apks, SizeIs(3u));
+  ASSERT_THAT(loaded_apks[0], NotNull());
+  EXPECT_THAT(loaded_apks[0]->GetPath(), StrEq(requests[0].path));
+  ASSERT_THAT(loaded_apks[1], NotNull());
+  ASSERT_THAT(loaded_apks[1]->GetLoadedArsc()->GetPackages(), SizeIs(1u));
+  EXPECT_TRUE(loaded_apks[1]->GetLoadedArsc()->GetPackages()[0]->IsDynamic());
+  EXPECT_THAT(loaded_apks[2], IsNull());
+
+  // ApkAssets still in use are shared.
+  std::vector<std::shared_ptr<const ApkAssets>> reloaded_apks = ApkAssets::LoadAll(requests);
+  ASSERT_THAT(reloaded_apks, SizeIs(3u));
+  EXPECT_THAT(reloaded_apks[0], Eq(loaded_apks[0]));
+  EXPECT_THAT(reloaded_apks[1], Eq(loaded_apks[1]));
+
+  // The same file loaded another way is not.
+  std::vector<std::shared_ptr<const ApkAssets>> library_apks =
+      ApkAssets::LoadAll({{requests[0].path, Kind::kSharedLibrary, false /*system*/}});
+  ASSERT_THAT(library_apks, SizeIs(1u));
+  ASSERT_THAT(library_apks[0], NotNull());
+  EXPECT_THAT(library_apks[0], Ne(loaded_apks[0]));
+}
+
 TEST(ApkAssetsTest, CreateAndDestroyAssetKeepsApkAssetsOpen) {
   std::unique_ptr<const ApkAssets> loaded_apk =
       ApkAssets::Load(GetTestDataPath() + "/basic/basic.apk");
@@ -122,6 +155,23 @@ TEST(ApkAssetsTest, CreateAndDestroyAssetKeepsApkAssetsOpen) {
   { ASSERT_THAT(loaded_apk->Open("res/layout/main.xml", Asset::ACCESS_BUFFER), NotNull()); }
 }
 
+TEST(ApkAssetsTest, PrefetchSkipsMissingEntries) {
+  std::unique_ptr<const ApkAssets> loaded_apk =
+      ApkAssets::Load(GetTestDataPath() + "/basic/basic.apk");
+  ASSERT_THAT(loaded_apk, NotNull());
+
+  EXPECT_EQ(2u, loaded_apk->Prefetch({"res/layout/main.xml", "assets/uncompressed.txt",
+                                      "assets/does_not_exist.txt"}));
+
+  // Prefetching does not get in the way of opening the entries.
+  for (Asset::AccessMode mode : {Asset::ACCESS_UNKNOWN, Asset::ACCESS_RANDOM,
+                                 Asset::ACCESS_STREAMING, Asset::ACCESS_BUFFER}) {
+    std::unique_ptr<Asset> asset = loaded_apk->Open("assets/uncompressed.txt", mode);
+    ASSERT_THAT(asset, NotNull());
+    EXPECT_THAT(asset->getBuffer(false /*wordAligned*/), NotNull());
+  }
+}
+
 TEST(ApkAssetsTest, OpenUncompressedAssetFd) {
   std::unique_ptr<const ApkAssets> loaded_apk =
       ApkAssets::Load(GetTestDataPath() + "/basic/basic.apk");
@@ -36,6 +36,7 @@ namespace lib_one = com::android::lib_one;
 namespace lib_two = com::android::lib_two;
 namespace libclient = com::android::libclient;
 
+using ::testing::ElementsAre;
 using ::testing::Eq;
 using ::testing::NotNull;
 using ::testing::StrEq;
@@ -149,6 +150,86 @@ TEST_F(AssetManager2Test, FindsResourceFromMultipleApkAssets) {
   EXPECT_EQ(Res_value::TYPE_STRING, value.dataType);
 }
 
+TEST_F(AssetManager2Test, CachedResourceFollowsConfigurationChange) {
+  ResTable_config desired_config;
+  memset(&desired_config, 0, sizeof(desired_config));
+  desired_config.language[0] = 'd';
+  desired_config.language[1] = 'e';
+
+  AssetManager2 assetmanager;
+  assetmanager.SetConfiguration(desired_config);
+  assetmanager.SetApkAssets({basic_assets_.get(), basic_de_fr_assets_.get()});
+
+  Res_value value;
+  ResTable_config selected_config;
+  uint32_t flags;
+
+  ApkAssetsCookie cookie =
+      assetmanager.GetResource(basic::R::string::test1, false /*may_be_bag*/,
+                               0 /*density_override*/, &value, &selected_config, &flags);
+  ASSERT_EQ(1, cookie);
+  EXPECT_EQ('d', selected_config.language[0]);
+
+  // The second lookup is served from the cache, with the same result.
+  cookie = assetmanager.GetResource(basic::R::string::test1, false /*may_be_bag*/,
+                                    0 /*density_override*/, &value, &selected_config, &flags);
+  ASSERT_EQ(1, cookie);
+  EXPECT_EQ('d', selected_config.language[0]);
+  EXPECT_EQ('e', selected_config.language[1]);
+
+  desired_config.language[0] = 'f';
+  desired_config.language[1] = 'r';
+  assetmanager.SetConfiguration(desired_config);
+  cookie = assetmanager.GetResource(basic::R::string::test1, false /*may_be_bag*/,
+                                    0 /*density_override*/, &value, &selected_config, &flags);
+  ASSERT_EQ(1, cookie);
+  EXPECT_EQ('f', selected_config.language[0]);
+  EXPECT_EQ('r', selected_config.language[1]);
+
+  // A language the APKs have no resources for falls back to the default configuration.
+  desired_config.language[0] = 'e';
+  desired_config.language[1] = 's';
+  assetmanager.SetConfiguration(desired_config);
+  cookie = assetmanager.GetResource(basic::R::string::test1, false /*may_be_bag*/,
+                                    0 /*density_override*/, &value, &selected_config, &flags);
+  ASSERT_NE(kInvalidCookie, cookie);
+  EXPECT_EQ(0, selected_config.language[0]);
+}
+
+TEST_F(AssetManager2Test, ConfigurationChangeKeepsUnaffectedFilters) {
+  ResTable_config desired_config;
+  memset(&desired_config, 0, sizeof(desired_config));
+  desired_config.language[0] = 'd';
+  desired_config.language[1] = 'e';
+
+  AssetManager2 assetmanager;
+  assetmanager.SetConfiguration(desired_config);
+  assetmanager.SetApkAssets({basic_assets_.get(), basic_de_fr_assets_.get()});
+
+  Res_value value;
+  ResTable_config selected_config;
+  uint32_t flags;
+
+  // No resource varies by orientation, so the German strings stay selected.
+  desired_config.orientation = ResTable_config::ORIENTATION_LAND;
+  assetmanager.SetConfiguration(desired_config);
+  ApkAssetsCookie cookie =
+      assetmanager.GetResource(basic::R::string::test1, false /*may_be_bag*/,
+                               0 /*density_override*/, &value, &selected_config, &flags);
+  ASSERT_EQ(1, cookie);
+  EXPECT_EQ('d', selected_config.language[0]);
+  EXPECT_EQ('e', selected_config.language[1]);
+
+  desired_config.language[0] = 'f';
+  desired_config.language[1] = 'r';
+  assetmanager.SetConfiguration(desired_config);
+  cookie = assetmanager.GetResource(basic::R::string::test1, false /*may_be_bag*/,
+                                    0 /*density_override*/, &value, &selected_config, &flags);
+  ASSERT_EQ(1, cookie);
+  EXPECT_EQ('f', selected_config.language[0]);
+  EXPECT_EQ('r', selected_config.language[1]);
+}
+
 TEST_F(AssetManager2Test, FindsResourceFromSharedLibrary) {
   AssetManager2 assetmanager;
 
@@ -360,6 +441,46 @@ TEST_F(AssetManager2Test, MergeStylesCircularDependency) {
   ASSERT_EQ(3u, bag_one->entry_count);
 }
 
+TEST_F(AssetManager2Test, BagCacheStaysWithinLimit) {
+  size_t style_four_bytes;
+  {
+    AssetManager2 assetmanager;
+    assetmanager.SetApkAssets({style_assets_.get()});
+    ASSERT_NE(nullptr, assetmanager.GetBag(app::R::style::StyleFour));
+    style_four_bytes = assetmanager.GetBagCacheBytes();
+  }
+
+  AssetManager2 assetmanager;
+  assetmanager.SetApkAssets({style_assets_.get()});
+  const size_t global_bytes = AssetManager2::GetGlobalBagCacheBytes();
+
+  // Resolves StyleOne, its parent, along the way.
+  ASSERT_NE(nullptr, assetmanager.GetBag(app::R::style::StyleTwo));
+  const size_t style_two_bytes = assetmanager.GetBagCacheBytes();
+  EXPECT_GT(style_two_bytes, 0u);
+  EXPECT_EQ(global_bytes + style_two_bytes, AssetManager2::GetGlobalBagCacheBytes());
+  EXPECT_THAT(assetmanager.GetBagResIdStack(app::R::style::StyleTwo),
+              ElementsAre(app::R::style::StyleTwo, app::R::style::StyleOne));
+
+  assetmanager.SetBagCacheLimit(1u);
+
+  // Cached bags are returned without evicting anything.
+  ASSERT_NE(nullptr, assetmanager.GetBag(app::R::style::StyleOne));
+  EXPECT_EQ(style_two_bytes, assetmanager.GetBagCacheBytes());
+
+  // While pinned, nothing is evicted for a bag that is not cached.
+  {
+    AssetManager2::ScopedBagPin bag_pin(&assetmanager);
+    ASSERT_NE(nullptr, assetmanager.GetBag(app::R::style::StyleFour));
+    EXPECT_EQ(style_two_bytes + style_four_bytes, assetmanager.GetBagCacheBytes());
+  }
+
+  // Otherwise the bags over the limit are evicted before it is resolved.
+  ASSERT_NE(nullptr, assetmanager.GetBag(app::R::style::StyleTwo));
+  EXPECT_EQ(style_two_bytes, assetmanager.GetBagCacheBytes());
+  EXPECT_EQ(global_bytes + style_two_bytes, AssetManager2::GetGlobalBagCacheBytes());
+}
+
 TEST_F(AssetManager2Test, ResolveReferenceToResource) {
   AssetManager2 assetmanager;
   assetmanager.SetApkAssets({basic_assets_.get()});
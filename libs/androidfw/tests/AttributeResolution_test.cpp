@@ -156,6 +156,38 @@ TEST_F(AttributeResolutionTest, Theme) {
   EXPECT_EQ(public_flag, values_cursor[STYLE_CHANGING_CONFIGURATIONS]);
 }
 
+TEST_F(AttributeResolutionTest, ApplyStyleFollowsThemeChanges) {
+  std::unique_ptr<Theme> theme = assetmanager_.NewTheme();
+  ASSERT_TRUE(theme->ApplyStyle(R::style::StyleTwo));
+
+  std::array<uint32_t, 2> attrs{{R::attr::attr_one, R::attr::attr_five}};
+  std::array<uint32_t, attrs.size() * STYLE_NUM_ENTRIES> values;
+  std::array<uint32_t, attrs.size() * STYLE_NUM_ENTRIES> cached_values;
+  std::array<uint32_t, attrs.size() + 1> indices;
+  std::array<uint32_t, attrs.size() + 1> cached_indices;
+
+  ApplyStyle(theme.get(), nullptr /*xml_parser*/, 0u /*def_style_attr*/, 0u /*def_style_res*/,
+             attrs.data(), attrs.size(), values.data(), indices.data());
+  ApplyStyle(theme.get(), nullptr /*xml_parser*/, 0u /*def_style_attr*/, 0u /*def_style_res*/,
+             attrs.data(), attrs.size(), cached_values.data(), cached_indices.data());
+  EXPECT_EQ(values, cached_values);
+  EXPECT_EQ(indices, cached_indices);
+
+  const uint32_t* values_cursor = values.data() + STYLE_NUM_ENTRIES;
+  EXPECT_EQ(Res_value::TYPE_STRING, values_cursor[STYLE_TYPE]);
+  EXPECT_EQ(R::string::string_one, values_cursor[STYLE_RESOURCE_ID]);
+
+  // Changing the theme in place must not return the values resolved against the old one.
+  ASSERT_TRUE(theme->ApplyStyle(R::style::StyleThree, true /* force */));
+  ApplyStyle(theme.get(), nullptr /*xml_parser*/, 0u /*def_style_attr*/, 0u /*def_style_res*/,
+             attrs.data(), attrs.size(), values.data(), indices.data());
+
+  values_cursor = values.data() + STYLE_NUM_ENTRIES;
+  EXPECT_EQ(Res_value::TYPE_INT_DEC, values_cursor[STYLE_TYPE]);
+  EXPECT_EQ(5u, values_cursor[STYLE_DATA]);
+  EXPECT_EQ(0u, values_cursor[STYLE_RESOURCE_ID]);
+}
+
 TEST_F(AttributeResolutionXmlTest, XmlParser) {
   std::array<uint32_t, 5> attrs{{R::attr::attr_one, R::attr::attr_two, R::attr::attr_three,
                                  R::attr::attr_four, R::attr::attr_empty}};
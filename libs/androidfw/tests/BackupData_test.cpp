@@ -434,4 +434,105 @@ TEST_F(BackupDataTest, ReadDeletedEntityData) {
   delete reader;
 }
 
+TEST_F(BackupDataTest, WriteEntitiesAndRead) {
+  int fd = ::open(mFilename.string(), O_WRONLY);
+  BackupDataWriter* writer = new BackupDataWriter(fd);
+  EXPECT_EQ(NO_ERROR, writer->WriteEntity(mKey1, DATA1, sizeof(DATA1)))
+          << "WriteEntity returned an error";
+  EXPECT_EQ(NO_ERROR, writer->WriteEntity(mKey4, NULL, -1))
+          << "WriteEntity returned an error on deletion";
+  EXPECT_EQ(NO_ERROR, writer->WriteEntity(mKey2, DATA2, sizeof(DATA2)))
+          << "WriteEntity returned an error";
+  EXPECT_EQ(NO_ERROR, writer->Flush())
+          << "Flush returned an error";
+
+  ::close(fd);
+  fd = ::open(mFilename.string(), O_RDONLY);
+  BackupDataReader* reader = new BackupDataReader(fd);
+
+  bool done;
+  int type;
+  String8 key;
+  size_t dataSize;
+  char dataBytes[sizeof(DATA2)];
+  reader->ReadNextHeader(&done, &type);
+  EXPECT_EQ(NO_ERROR, reader->ReadEntityHeader(&key, &dataSize));
+  EXPECT_EQ(mKey1, key);
+  EXPECT_EQ(sizeof(DATA1), dataSize);
+  EXPECT_EQ((int) dataSize, reader->ReadEntityData(dataBytes, dataSize));
+  EXPECT_EQ(0, memcmp(DATA1, dataBytes, sizeof(DATA1)));
+
+  reader->ReadNextHeader(&done, &type);
+  EXPECT_EQ(NO_ERROR, reader->ReadEntityHeader(&key, &dataSize));
+  EXPECT_EQ(mKey4, key);
+  EXPECT_EQ(-1, (int) dataSize)
+          << "not recognizing deletion";
+
+  reader->ReadNextHeader(&done, &type);
+  EXPECT_EQ(NO_ERROR, reader->ReadEntityHeader(&key, &dataSize));
+  EXPECT_EQ(mKey2, key);
+  EXPECT_EQ(sizeof(DATA2), dataSize);
+  EXPECT_EQ((int) dataSize, reader->ReadEntityData(dataBytes, dataSize));
+  EXPECT_EQ(0, memcmp(DATA2, dataBytes, sizeof(DATA2)));
+
+  reader->ReadNextHeader(&done, &type);
+  EXPECT_TRUE(done) << "expected the end after three entities";
+
+  delete writer;
+  delete reader;
+}
+
+TEST_F(BackupDataTest, ReadManyEntities) {
+  // Enough entities to take several read buffers, and one larger than a buffer.  The last
+  // one is read rather than skipped, as there's no padding after it to skip.
+  const int count = 10001;
+  const size_t largeSize = 200 * 1024;
+  char* large = new char[largeSize];
+  memset(large, 'L', largeSize);
+
+  int fd = ::open(mFilename.string(), O_WRONLY);
+  BackupDataWriter* writer = new BackupDataWriter(fd);
+  for (int i = 0; i < count; i++) {
+    String8 key = String8::format("key%d", i);
+    if (i == 5000) {
+      writer->WriteEntity(key, large, largeSize);
+    } else {
+      writer->WriteEntity(key, DATA3, (i % sizeof(DATA3)) + 1);
+    }
+  }
+  EXPECT_EQ(NO_ERROR, writer->Flush());
+
+  ::close(fd);
+  fd = ::open(mFilename.string(), O_RDONLY);
+  BackupDataReader* reader = new BackupDataReader(fd);
+
+  bool done;
+  int type;
+  String8 key;
+  size_t dataSize;
+  char* dataBytes = new char[largeSize];
+  for (int i = 0; i < count; i++) {
+    EXPECT_EQ(NO_ERROR, reader->ReadNextHeader(&done, &type));
+    EXPECT_EQ(NO_ERROR, reader->ReadEntityHeader(&key, &dataSize));
+    EXPECT_EQ(String8::format("key%d", i), key);
+    if (i % 2) {
+      EXPECT_EQ(NO_ERROR, reader->SkipEntityData());
+      continue;
+    }
+    EXPECT_EQ((int) dataSize, reader->ReadEntityData(dataBytes, dataSize));
+    if (i == 5000) {
+      EXPECT_EQ(0, memcmp(large, dataBytes, largeSize));
+    } else {
+      EXPECT_EQ(0, memcmp(DATA3, dataBytes, dataSize));
+    }
+  }
+  reader->ReadNextHeader(&done, &type);
+  EXPECT_TRUE(done);
+
+  delete[] dataBytes;
+  delete[] large;
+  delete writer;
+  delete reader;
+}
+
 }
@@ -182,6 +182,32 @@ TEST(ConfigTest, RoundIsMoreSpecific) {
   EXPECT_TRUE(targetConfigC.isBetterThan(targetConfigB, &deviceConfig));
 }
 
+TEST(ConfigTest, PrecomputedLocaleComparison) {
+  ResTable_config deviceConfig;
+  memset(&deviceConfig, 0, sizeof(deviceConfig));
+  memcpy(deviceConfig.language, "en", 2);
+  memcpy(deviceConfig.country, "US", 2);
+  deviceConfig.orientation = ResTable_config::ORIENTATION_LAND;
+
+  ResTable_config localeConfig;
+  memset(&localeConfig, 0, sizeof(localeConfig));
+  memcpy(localeConfig.language, "en", 2);
+
+  ResTable_config landConfig;
+  memset(&landConfig, 0, sizeof(landConfig));
+  landConfig.orientation = ResTable_config::ORIENTATION_LAND;
+
+  const bool localeIsBetter = localeConfig.isLocaleBetterThan(landConfig, &deviceConfig);
+  EXPECT_TRUE(localeIsBetter);
+  EXPECT_TRUE(localeConfig.isBetterThan(landConfig, &deviceConfig, localeIsBetter));
+  EXPECT_EQ(landConfig.isBetterThan(localeConfig, &deviceConfig),
+            landConfig.isBetterThan(localeConfig, &deviceConfig,
+                                    landConfig.isLocaleBetterThan(localeConfig, &deviceConfig)));
+
+  // Without the locale deciding, the other axes are compared.
+  EXPECT_FALSE(localeConfig.isBetterThan(landConfig, &deviceConfig, false));
+}
+
 TEST(ConfigTest, ScreenIsWideGamut) {
   ResTable_config defaultConfig;
   memset(&defaultConfig, 0, sizeof(defaultConfig));
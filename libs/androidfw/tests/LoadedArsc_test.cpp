@@ -17,6 +17,7 @@
 #include "androidfw/LoadedArsc.h"
 
 #include "android-base/file.h"
+#include "androidfw/ArscIndex.h"
 #include "androidfw/ResourceUtils.h"
 
 #include "TestHelpers.h"
@@ -237,7 +238,7 @@ class MockLoadedIdmap : public LoadedIdmap {
     entry_header->entry_id_offset = 1;
     entry_header->entry_count = 1;
     entry_header->entries[0] = 0x00000000u;
-    type_map_[entry_header->overlay_type_id] = entry_header.get();
+    type_map_.set(entry_header->overlay_type_id, entry_header.get());
   }
 
  private:
@@ -387,6 +388,60 @@ TEST(LoadedArscTest, GetOverlayableMap) {
   ASSERT_EQ(map.at("OverlayableResources2"), "overlay://com.android.overlayable");
 }
 
+TEST(LoadedArscTest, LoadWithIndex) {
+  std::string contents;
+  ASSERT_TRUE(ReadFileFromZipToString(GetTestDataPath() + "/basic/basic.apk", "resources.arsc",
+                                      &contents));
+  const uint32_t crc32 = 0x12345678u;
+
+  std::string index_data;
+  ASSERT_TRUE(LoadedArscIndex::Create(StringPiece(contents), crc32, &index_data));
+
+  // An index is only used for the table it was created from.
+  ASSERT_THAT(LoadedArscIndex::Load(StringPiece(index_data), StringPiece(contents), crc32 + 1),
+              IsNull());
+  std::unique_ptr<const LoadedArscIndex> index =
+      LoadedArscIndex::Load(StringPiece(index_data), StringPiece(contents), crc32);
+  ASSERT_THAT(index, NotNull());
+
+  std::unique_ptr<const LoadedArsc> loaded_arsc = LoadedArsc::Load(StringPiece(contents));
+  ASSERT_THAT(loaded_arsc, NotNull());
+  std::unique_ptr<const LoadedArsc> indexed_arsc =
+      LoadedArsc::Load(StringPiece(contents), nullptr /*loaded_idmap*/, false /*system*/,
+                       false /*load_as_shared_library*/, index.get());
+  ASSERT_THAT(indexed_arsc, NotNull());
+
+  const LoadedPackage* package = loaded_arsc->GetPackageById(0x7f);
+  const LoadedPackage* indexed_package = indexed_arsc->GetPackageById(0x7f);
+  ASSERT_THAT(package, NotNull());
+  ASSERT_THAT(indexed_package, NotNull());
+  EXPECT_THAT(indexed_package->GetPackageName(), StrEq(package->GetPackageName()));
+  EXPECT_THAT(indexed_package->GetTypeStringPool()->size(),
+              Eq(package->GetTypeStringPool()->size()));
+  EXPECT_THAT(indexed_package->GetKeyStringPool()->size(),
+              Eq(package->GetKeyStringPool()->size()));
+
+  size_t type_spec_count = 0u;
+  package->ForEachTypeSpec([&](const TypeSpec* type_spec, uint8_t type_index) {
+    type_spec_count++;
+    const TypeSpec* indexed_type_spec = indexed_package->GetTypeSpecByTypeIndex(type_index);
+    ASSERT_THAT(indexed_type_spec, NotNull());
+    EXPECT_THAT(indexed_type_spec->type_spec, Eq(type_spec->type_spec));
+    ASSERT_THAT(indexed_type_spec->type_count, Eq(type_spec->type_count));
+    for (size_t i = 0; i < type_spec->type_count; i++) {
+      EXPECT_THAT(indexed_type_spec->types[i], Eq(type_spec->types[i]));
+    }
+  });
+  EXPECT_THAT(type_spec_count, Ge(1u));
+
+  auto indexed_iter = indexed_package->begin();
+  for (auto iter = package->begin(); iter != package->end(); ++iter, ++indexed_iter) {
+    ASSERT_NE(indexed_package->end(), indexed_iter);
+    EXPECT_EQ(*iter, *indexed_iter);
+  }
+  EXPECT_EQ(indexed_package->end(), indexed_iter);
+}
+
 // structs with size fields (like Res_value, ResTable_entry) should be
 // backwards and forwards compatible (aka checking the size field against
 // sizeof(Res_value) might not be backwards compatible.
@@ -19,6 +19,8 @@
 #include <codecvt>
 #include <locale>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "utils/String16.h"
 #include "utils/String8.h"
@@ -41,6 +43,46 @@ TEST(ResTableTest, ShouldLoadSuccessfully) {
   ASSERT_EQ(NO_ERROR, table.add(contents.data(), contents.size()));
 }
 
+TEST(ResTableTest, DecodesUtf8StringsConcurrently) {
+  std::string contents;
+  ASSERT_TRUE(ReadFileFromZipToString(GetTestDataPath() + "/basic/basic.apk",
+                                      "resources.arsc", &contents));
+
+  ResTable table;
+  ASSERT_EQ(NO_ERROR, table.add(contents.data(), contents.size()));
+  const ResStringPool* pool = table.getTableStringBlock(0);
+  ASSERT_NE(nullptr, pool);
+  ASSERT_TRUE(pool->isUTF8());
+  ASSERT_GT(pool->size(), 0u);
+
+  // Every thread must get the same decoded copy of each string.
+  constexpr size_t kThreadCount = 4;
+  std::vector<std::vector<const char16_t*>> decoded(kThreadCount);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < kThreadCount; t++) {
+    threads.emplace_back([pool, &strings = decoded[t]]() {
+      for (size_t i = 0; i < pool->size(); i++) {
+        size_t len;
+        strings.push_back(pool->stringAt(i, &len));
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  for (size_t i = 0; i < pool->size(); i++) {
+    size_t len8;
+    const char* str8 = pool->string8At(i, &len8);
+    ASSERT_NE(nullptr, str8);
+    ASSERT_NE(nullptr, decoded[0][i]);
+    EXPECT_EQ(String16(str8, len8), String16(decoded[0][i]));
+    for (size_t t = 1; t < kThreadCount; t++) {
+      EXPECT_EQ(decoded[0][i], decoded[t][i]);
+    }
+  }
+}
+
 TEST(ResTableTest, ShouldLoadSparseEntriesSuccessfully) {
   std::string contents;
   ASSERT_TRUE(ReadFileFromZipToString(GetTestDataPath() + "/sparse/sparse.apk", "resources.arsc",
@@ -252,6 +294,40 @@ TEST(ResTableTest, ResourceIsOverridenWithBetterConfig) {
   ASSERT_EQ(uint32_t(400), val.data);
 }
 
+TEST(ResTableTest, CachedEntryFollowsParameterChange) {
+  std::string contents;
+  ASSERT_TRUE(ReadFileFromZipToString(GetTestDataPath() + "/basic/basic.apk",
+                                      "resources.arsc", &contents));
+
+  ResTable table;
+  ASSERT_EQ(NO_ERROR, table.add(contents.data(), contents.size()));
+
+  ResTable_config param;
+  memset(&param, 0, sizeof(param));
+  param.language[0] = 's';
+  param.language[1] = 'v';
+  param.country[0] = 'S';
+  param.country[1] = 'E';
+  table.setParameters(&param);
+
+  // The second lookup is served from the cache, with the same result.
+  Res_value val;
+  for (int i = 0; i < 2; i++) {
+    ssize_t block = table.getResource(basic::R::integer::number1, &val, MAY_NOT_BE_BAG);
+    ASSERT_GE(block, 0);
+    ASSERT_EQ(Res_value::TYPE_INT_DEC, val.dataType);
+    ASSERT_EQ(uint32_t(400), val.data);
+  }
+
+  memset(&param, 0, sizeof(param));
+  table.setParameters(&param);
+
+  ssize_t block = table.getResource(basic::R::integer::number1, &val, MAY_NOT_BE_BAG);
+  ASSERT_GE(block, 0);
+  ASSERT_EQ(Res_value::TYPE_INT_DEC, val.dataType);
+  ASSERT_EQ(uint32_t(200), val.data);
+}
+
 TEST(ResTableTest, emptyTableHasSensibleDefaults) {
   const int32_t assetCookie = 1;
 
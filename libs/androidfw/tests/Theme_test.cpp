@@ -210,6 +210,48 @@ TEST_F(ThemeTest, MultipleThemesOverlaidForced) {
   EXPECT_EQ(static_cast<uint32_t>(ResTable_typeSpec::SPEC_PUBLIC), flags);
 }
 
+TEST_F(ThemeTest, ThemesWithSameStylesDoNotAffectEachOther) {
+  AssetManager2 assetmanager;
+  assetmanager.SetApkAssets({style_assets_.get()});
+
+  std::unique_ptr<Theme> theme_one = assetmanager.NewTheme();
+  ASSERT_TRUE(theme_one->ApplyStyle(app::R::style::StyleTwo));
+  ASSERT_TRUE(theme_one->ApplyStyle(app::R::style::StyleThree));
+
+  // Starts from the attributes theme_one had after StyleTwo, then forces StyleThree on them.
+  std::unique_ptr<Theme> theme_two = assetmanager.NewTheme();
+  ASSERT_TRUE(theme_two->ApplyStyle(app::R::style::StyleTwo));
+  ASSERT_TRUE(theme_two->ApplyStyle(app::R::style::StyleThree, true /* force */));
+
+  // Same styles as theme_one.
+  std::unique_ptr<Theme> theme_three = assetmanager.NewTheme();
+  ASSERT_TRUE(theme_three->ApplyStyle(app::R::style::StyleTwo));
+  ASSERT_TRUE(theme_three->ApplyStyle(app::R::style::StyleThree));
+
+  Res_value value;
+  uint32_t flags;
+
+  ASSERT_NE(kInvalidCookie, theme_one->GetAttribute(app::R::attr::attr_five, &value, &flags));
+  EXPECT_EQ(Res_value::TYPE_REFERENCE, value.dataType);
+  EXPECT_EQ(app::R::string::string_one, value.data);
+
+  ASSERT_NE(kInvalidCookie, theme_two->GetAttribute(app::R::attr::attr_five, &value, &flags));
+  EXPECT_EQ(Res_value::TYPE_INT_DEC, value.dataType);
+  EXPECT_EQ(5u, value.data);
+
+  ASSERT_NE(kInvalidCookie, theme_three->GetAttribute(app::R::attr::attr_five, &value, &flags));
+  EXPECT_EQ(Res_value::TYPE_REFERENCE, value.dataType);
+  EXPECT_EQ(app::R::string::string_one, value.data);
+
+  // Changing a copy leaves the original alone.
+  theme_three->SetTo(*theme_two);
+  theme_three->Clear();
+  ASSERT_NE(kInvalidCookie, theme_two->GetAttribute(app::R::attr::attr_five, &value, &flags));
+  EXPECT_EQ(5u, value.data);
+  EXPECT_EQ(kInvalidCookie, theme_three->GetAttribute(app::R::attr::attr_five, &value, &flags));
+  EXPECT_EQ(0u, theme_three->GetChangingConfigurations());
+}
+
 TEST_F(ThemeTest, ResolveDynamicAttributesAndReferencesToSharedLibrary) {
   AssetManager2 assetmanager;
   assetmanager.SetApkAssets(
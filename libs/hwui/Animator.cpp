@@ -262,6 +262,35 @@ bool BaseRenderNodeAnimator::animate(AnimationContext& context) {
     return finished;
 }
 
+bool BaseRenderNodeAnimator::beginAnimate(AnimationContext& context, float* outFraction) {
+    if (mPlayState != PlayState::Running && mPlayState != PlayState::Reversing) {
+        return false;
+    }
+    nsecs_t currentPlayTime = context.frameTimeMs() - mStartTime;
+    if (currentPlayTime < 0) {
+        return false;
+    }
+    // Same as updatePlayTime(), up to the interpolation.
+    mPlayTime = mPlayState == PlayState::Reversing ? mDuration - currentPlayTime : currentPlayTime;
+    onPlayTimeChanged(mPlayTime);
+    float fraction = 1.0f;
+    if (mDuration > 0) {
+        fraction = mPlayTime / (float)mDuration;
+    }
+    *outFraction = MathUtils::clamp(fraction, 0.0f, 1.0f);
+    return true;
+}
+
+bool BaseRenderNodeAnimator::finishAnimate(AnimationContext& context, float interpolatedFraction) {
+    setValue(mTarget, mFromValue + (mDeltaValue * interpolatedFraction));
+    bool finished = context.frameTimeMs() - mStartTime >= mDuration;
+    if (finished && mPlayState != PlayState::Finished) {
+        mPlayState = PlayState::Finished;
+        callOnFinishedListener(context);
+    }
+    return finished;
+}
+
 bool BaseRenderNodeAnimator::updatePlayTime(nsecs_t playTime) {
     mPlayTime = mPlayState == PlayState::Reversing ? mDuration - playTime : playTime;
     onPlayTimeChanged(mPlayTime);
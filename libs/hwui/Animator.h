@@ -80,6 +80,18 @@ public:
     ANDROID_API void pushStaging(AnimationContext& context);
     ANDROID_API bool animate(AnimationContext& context);
 
+    // animate() in two steps, so that AnimatorManager can interpolate the fractions of many
+    // animators in one batch. beginAnimate() returns false without changing anything if this
+    // frame is more than an interpolation step, then animate() has to be used instead.
+    // Only valid if canAnimateBatched().
+    bool beginAnimate(AnimationContext& context, float* outFraction);
+    // Sets the value for the interpolated fraction. Returns true if finished, like animate().
+    bool finishAnimate(AnimationContext& context, float interpolatedFraction);
+    // True if setValue() and onPlayTimeChanged() have no effect on other animators, so the
+    // fractions of the frame may be computed before any value is set.
+    virtual bool canAnimateBatched() const { return false; }
+    Interpolator* interpolator() { return mInterpolator.get(); }
+
     // Returns the remaining time in ms for the animation. Note this should only be called during
     // an animation on RenderThread.
     ANDROID_API nsecs_t getRemainingPlayTime();
@@ -200,6 +212,8 @@ public:
 
     ANDROID_API virtual uint32_t dirtyMask();
 
+    virtual bool canAnimateBatched() const override { return true; }
+
 protected:
     virtual float getValue(RenderNode* target) const override;
     virtual void setValue(RenderNode* target, float value) override;
@@ -17,6 +17,8 @@
 
 #include <algorithm>
 
+#include <utils/Timers.h>
+
 #include "AnimationContext.h"
 #include "Animator.h"
 #include "DamageAccumulator.h"
@@ -92,32 +94,8 @@ void AnimatorManager::onAnimatorTargetChanged(BaseRenderNodeAnimator* animator)
     mAnimators.erase(std::remove(mAnimators.begin(), mAnimators.end(), animator), mAnimators.end());
 }
 
-class AnimateFunctor {
-public:
-    AnimateFunctor(TreeInfo& info, AnimationContext& context, uint32_t* outDirtyMask)
-            : mInfo(info), mContext(context), mDirtyMask(outDirtyMask) {}
-
-    bool operator()(sp<BaseRenderNodeAnimator>& animator) {
-        *mDirtyMask |= animator->dirtyMask();
-        bool remove = animator->animate(mContext);
-        if (remove) {
-            animator->detach();
-        } else {
-            if (animator->isRunning()) {
-                mInfo.out.hasAnimations = true;
-            }
-            if (CC_UNLIKELY(!animator->mayRunAsync())) {
-                mInfo.out.requiresUiRedraw = true;
-            }
-        }
-        return remove;
-    }
-
-private:
-    TreeInfo& mInfo;
-    AnimationContext& mContext;
-    uint32_t* mDirtyMask;
-};
+// Below this many animators, batching costs more than it saves.
+static constexpr size_t kMinBatchedAnimators = 4;
 
 uint32_t AnimatorManager::animate(TreeInfo& info) {
     if (!mAnimators.size()) return 0;
@@ -140,13 +118,75 @@ void AnimatorManager::animateNoDamage(TreeInfo& info) {
     animateCommon(info);
 }
 
+void AnimatorManager::interpolateBatched(AnimationContext& context) {
+    const size_t count = mAnimators.size();
+    mIsBatched.assign(count, false);
+    mBatchedFractions.resize(count);
+    for (auto& batch : mBatches) {
+        batch.animators.clear();
+        batch.interpolators.clear();
+        batch.fractions.clear();
+    }
+    for (size_t i = 0; i < count; i++) {
+        BaseRenderNodeAnimator* animator = mAnimators[i].get();
+        float fraction;
+        if (animator->canAnimateBatched() && animator->beginAnimate(context, &fraction)) {
+            Interpolator* interpolator = animator->interpolator();
+            InterpolatorBatch& batch = mBatches[static_cast<int>(interpolator->kind())];
+            batch.animators.push_back(i);
+            batch.interpolators.push_back(interpolator);
+            batch.fractions.push_back(fraction);
+            mIsBatched[i] = true;
+        }
+    }
+    for (int kind = 0; kind < static_cast<int>(Interpolator::Kind::Count); kind++) {
+        InterpolatorBatch& batch = mBatches[kind];
+        Interpolator::interpolateBatch(static_cast<Interpolator::Kind>(kind),
+                                       batch.interpolators.data(), batch.fractions.data(),
+                                       batch.fractions.size());
+        for (size_t i = 0; i < batch.animators.size(); i++) {
+            mBatchedFractions[batch.animators[i]] = batch.fractions[i];
+        }
+    }
+}
+
 uint32_t AnimatorManager::animateCommon(TreeInfo& info) {
+    const nsecs_t startTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    AnimationContext& context = mAnimationHandle->context();
+    const bool batched = mAnimators.size() >= kMinBatchedAnimators;
+    if (batched) {
+        interpolateBatched(context);
+    }
+
+    // The values are set in the order of mAnimators, so the last animator of a property wins as
+    // before.
     uint32_t dirtyMask = 0;
-    AnimateFunctor functor(info, mAnimationHandle->context(), &dirtyMask);
-    auto newEnd = std::remove_if(mAnimators.begin(), mAnimators.end(), functor);
-    mAnimators.erase(newEnd, mAnimators.end());
+    size_t kept = 0;
+    for (size_t i = 0; i < mAnimators.size(); i++) {
+        sp<BaseRenderNodeAnimator>& animator = mAnimators[i];
+        dirtyMask |= animator->dirtyMask();
+        bool remove = batched && mIsBatched[i]
+                              ? animator->finishAnimate(context, mBatchedFractions[i])
+                              : animator->animate(context);
+        if (remove) {
+            animator->detach();
+            continue;
+        }
+        if (animator->isRunning()) {
+            info.out.hasAnimations = true;
+        }
+        if (CC_UNLIKELY(!animator->mayRunAsync())) {
+            info.out.requiresUiRedraw = true;
+        }
+        if (kept != i) {
+            mAnimators[kept] = std::move(animator);
+        }
+        kept++;
+    }
+    mAnimators.resize(kept);
     mAnimationHandle->notifyAnimationsRan();
     mParent.mProperties.updateMatrix();
+    info.out.animationTime += systemTime(SYSTEM_TIME_MONOTONIC) - startTime;
     return dirtyMask;
 }
 
@@ -21,11 +21,13 @@
 #include <cutils/compiler.h>
 #include <utils/StrongPointer.h>
 
+#include "Interpolator.h"
 #include "utils/Macros.h"
 
 namespace android {
 namespace uirenderer {
 
+class AnimationContext;
 class AnimationHandle;
 class BaseRenderNodeAnimator;
 class RenderNode;
@@ -62,8 +64,14 @@ public:
 
     bool hasAnimators() { return mAnimators.size(); }
 
+    // Also counts the animators not pushed yet.
+    bool hasAnyAnimators() const { return mAnimators.size() || mNewAnimators.size(); }
+
 private:
     uint32_t animateCommon(TreeInfo& info);
+    // Computes the interpolated fractions of the animators that can animate batched, see
+    // mBatchedFractions.
+    void interpolateBatched(AnimationContext& context);
 
     RenderNode& mParent;
     AnimationHandle* mAnimationHandle;
@@ -71,6 +79,18 @@ private:
     // To improve the efficiency of resizing & removing from the vector
     std::vector<sp<BaseRenderNodeAnimator> > mNewAnimators;
     std::vector<sp<BaseRenderNodeAnimator> > mAnimators;
+
+    // Scratch space of animateCommon(). mIsBatched[i] tells whether mAnimators[i] began its frame
+    // in interpolateBatched(), its interpolated fraction is mBatchedFractions[i] then.
+    std::vector<bool> mIsBatched;
+    std::vector<float> mBatchedFractions;
+    // The batched animators of each Interpolator::Kind, held in arrays for interpolateBatch().
+    struct InterpolatorBatch {
+        std::vector<size_t> animators;
+        std::vector<Interpolator*> interpolators;
+        std::vector<float> fractions;
+    };
+    InterpolatorBatch mBatches[static_cast<int>(Interpolator::Kind::Count)];
 };
 
 } /* namespace uirenderer */
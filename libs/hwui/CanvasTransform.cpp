@@ -25,9 +25,12 @@
 #include <ui/ColorSpace.h>
 
 #include <algorithm>
+#include <atomic>
+#include <cinttypes>
 #include <cmath>
 
 #include <log/log.h>
+#include <stdio.h>
 #include <SkHighContrastFilter.h>
 
 namespace android::uirenderer {
@@ -54,15 +57,59 @@ static SkColor makeDark(SkColor color) {
     }
 }
 
+static std::atomic<uint64_t> sColorCacheHits{0};
+static std::atomic<uint64_t> sColorCacheMisses{0};
+
+// Re-recording a UI under force dark transforms the same few colors every time, so the results
+// of the round trip through Lab are cached on every thread that transforms paints.
+struct ColorCacheEntry {
+    SkColor color;
+    SkColor transformed;
+    ColorTransform transform = ColorTransform::None;  // None if the entry is empty
+};
+
+static constexpr size_t kColorCacheSize = 256;
+static thread_local ColorCacheEntry sColorCache[kColorCacheSize];
+
 static SkColor transformColor(ColorTransform transform, SkColor color) {
-    switch (transform) {
-        case ColorTransform::Light:
-            return makeLight(color);
-        case ColorTransform::Dark:
-            return makeDark(color);
-        default:
-            return color;
+    if (transform != ColorTransform::Light && transform != ColorTransform::Dark) {
+        return color;
+    }
+
+    const uint32_t hash = (color ^ static_cast<uint32_t>(transform)) * 0x9E3779B1u;
+    ColorCacheEntry& entry = sColorCache[hash >> 24];
+    if (entry.transform == transform && entry.color == color) {
+        sColorCacheHits.fetch_add(1, std::memory_order_relaxed);
+        return entry.transformed;
     }
+    sColorCacheMisses.fetch_add(1, std::memory_order_relaxed);
+
+    entry.color = color;
+    entry.transformed = transform == ColorTransform::Light ? makeLight(color) : makeDark(color);
+    entry.transform = transform;
+    return entry.transformed;
+}
+
+// The mode filters made for transformed colors, so that re-recording doesn't create a new one
+// for every paint.
+struct ModeFilterCacheEntry {
+    SkColor color;
+    SkBlendMode mode;
+    sk_sp<SkColorFilter> filter;
+};
+
+static constexpr size_t kModeFilterCacheSize = 16;
+static thread_local ModeFilterCacheEntry sModeFilterCache[kModeFilterCacheSize];
+
+static sk_sp<SkColorFilter> makeModeFilter(SkColor color, SkBlendMode mode) {
+    const uint32_t hash = (color ^ static_cast<uint32_t>(mode)) * 0x9E3779B1u;
+    ModeFilterCacheEntry& entry = sModeFilterCache[hash >> 28];
+    if (!entry.filter || entry.color != color || entry.mode != mode) {
+        entry.color = color;
+        entry.mode = mode;
+        entry.filter = SkColorFilter::MakeModeFilter(color, mode);
+    }
+    return entry.filter;
 }
 
 static void applyColorTransform(ColorTransform transform, SkPaint& paint) {
@@ -99,10 +146,9 @@ static void applyColorTransform(ColorTransform transform, SkPaint& paint) {
     if (paint.getColorFilter()) {
         SkBlendMode mode;
         SkColor color;
-        // TODO: LRU this or something to avoid spamming new color mode filters
         if (paint.getColorFilter()->asColorMode(&color, &mode)) {
             color = transformColor(transform, color);
-            paint.setColorFilter(SkColorFilter::MakeModeFilter(color, mode));
+            paint.setColorFilter(makeModeFilter(color, mode));
         }
     }
 }
@@ -146,4 +192,12 @@ bool transformPaint(ColorTransform transform, SkPaint* paint, BitmapPalette pale
     return shouldInvert;
 }
 
+void dumpColorTransformCache(int fd) {
+    const uint64_t hits = sColorCacheHits.load(std::memory_order_relaxed);
+    const uint64_t misses = sColorCacheMisses.load(std::memory_order_relaxed);
+    const uint64_t lookups = hits + misses;
+    dprintf(fd, "\nForce dark color cache: %" PRIu64 " hits, %" PRIu64 " misses (%.1f%% hits)\n",
+            hits, misses, lookups ? 100.0 * hits / lookups : 0.0);
+}
+
 }  // namespace android::uirenderer
@@ -42,4 +42,7 @@ bool transformPaint(ColorTransform transform, SkPaint* paint);
 
 bool transformPaint(ColorTransform transform, SkPaint* paint, BitmapPalette palette);
 
+// Prints how often transformed colors came from the cache, for dumpsys gfxinfo.
+void dumpColorTransformCache(int fd);
+
 }  // namespace android::uirenderer;
\ No newline at end of file
@@ -37,13 +37,91 @@ struct DirtyStack {
         const RenderNode* renderNode;
         const Matrix4* matrix4;
     };
-    // When this frame is pop'd, this rect is mapped through the above transform
+    // When this frame is pop'd, these rects are mapped through the above transform
     // and applied to the previous (aka parent) frame
-    SkRect pendingDirty;
+    DamageRects pendingDirty;
     DirtyStack* prev;
     DirtyStack* next;
 };
 
+static float area(const SkRect& rect) {
+    return rect.width() * rect.height();
+}
+
+SkRect DamageRects::bounds() const {
+    SkRect bounds = SkRect::MakeEmpty();
+    for (const SkRect& rect : *this) {
+        bounds.join(rect);
+    }
+    return bounds;
+}
+
+void DamageRects::join(const SkRect& rect) {
+    if (rect.isEmpty()) return;
+    // Absorb everything rect overlaps, and whatever the result then overlaps in turn
+    SkRect joined = rect;
+    for (int i = 0; i < mCount;) {
+        if (mRects[i].contains(joined)) {
+            return;
+        }
+        if (SkRect::Intersects(mRects[i], joined)) {
+            joined.join(mRects[i]);
+            mRects[i] = mRects[--mCount];
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+    if (mCount < kMaxRects) {
+        mRects[mCount++] = joined;
+        return;
+    }
+    int best = 0;
+    float bestGrowth = 0;
+    for (int i = 0; i < mCount; i++) {
+        SkRect candidate = mRects[i];
+        candidate.join(joined);
+        float growth = area(candidate) - area(mRects[i]) - area(joined);
+        if (i == 0 || growth < bestGrowth) {
+            best = i;
+            bestGrowth = growth;
+        }
+    }
+    joined.join(mRects[best]);
+    mRects[best] = mRects[--mCount];
+    // There is room now, but the joined rect may overlap others
+    join(joined);
+}
+
+void DamageRects::join(const DamageRects& other) {
+    for (const SkRect& rect : other) {
+        join(rect);
+    }
+}
+
+bool DamageRects::intersect(const SkRect& clip) {
+    int count = 0;
+    for (int i = 0; i < mCount; i++) {
+        SkRect rect = mRects[i];
+        if (rect.intersect(clip)) {
+            mRects[count++] = rect;
+        }
+    }
+    mCount = count;
+    return mCount > 0;
+}
+
+void DamageRects::roundOut() {
+    // Rounding can make neighbours overlap, so join them again
+    DamageRects rounded;
+    for (const SkRect& rect : *this) {
+        SkRect temp;
+        rect.roundOut(&temp);
+        rounded.join(temp);
+    }
+    *this = rounded;
+}
+
 DamageAccumulator::DamageAccumulator() {
     mHead = mAllocator.create_trivial<DirtyStack>();
     memset(mHead, 0, sizeof(DirtyStack));
@@ -119,40 +197,54 @@ void DamageAccumulator::popTransform() {
     }
 }
 
-static inline void mapRect(const Matrix4* matrix, const SkRect& in, SkRect* out) {
+static inline void mapRect(const Matrix4* matrix, const DamageRects& in, DamageRects* out) {
     if (in.isEmpty()) return;
-    Rect temp(in);
-    if (CC_LIKELY(!matrix->isPerspective())) {
-        matrix->mapRect(temp);
-    } else {
+    if (CC_UNLIKELY(matrix->isPerspective())) {
         // Don't attempt to calculate damage for a perspective transform
         // as the numbers this works with can break the perspective
         // calculations. Just give up and expand to DIRTY_MIN/DIRTY_MAX
-        temp.set(DIRTY_MIN, DIRTY_MIN, DIRTY_MAX, DIRTY_MAX);
+        out->join(SkRect::MakeLTRB(DIRTY_MIN, DIRTY_MIN, DIRTY_MAX, DIRTY_MAX));
+        return;
+    }
+    // out may be in
+    DamageRects copy(in);
+    for (const SkRect& rect : copy) {
+        Rect temp(rect);
+        matrix->mapRect(temp);
+        out->join(SkRect::MakeLTRB(RECT_ARGS(temp)));
     }
-    out->join(RECT_ARGS(temp));
 }
 
 void DamageAccumulator::applyMatrix4Transform(DirtyStack* frame) {
     mapRect(frame->matrix4, frame->pendingDirty, &mHead->pendingDirty);
 }
 
-static inline void mapRect(const RenderProperties& props, const SkRect& in, SkRect* out) {
+static inline void mapRect(const RenderProperties& props, const DamageRects& in,
+                           DamageRects* out) {
     if (in.isEmpty()) return;
     const SkMatrix* transform = props.getTransformMatrix();
-    SkRect temp(in);
-    if (transform && !transform->isIdentity()) {
-        if (CC_LIKELY(!transform->hasPerspective())) {
+    if (transform && transform->isIdentity()) {
+        transform = nullptr;
+    }
+    if (CC_UNLIKELY(transform && transform->hasPerspective())) {
+        // Don't attempt to calculate damage for a perspective transform
+        // as the numbers this works with can break the perspective
+        // calculations. Just give up and expand to DIRTY_MIN/DIRTY_MAX
+        SkRect temp = SkRect::MakeLTRB(DIRTY_MIN, DIRTY_MIN, DIRTY_MAX, DIRTY_MAX);
+        temp.offset(props.getLeft(), props.getTop());
+        out->join(temp);
+        return;
+    }
+    // out may be in
+    DamageRects copy(in);
+    for (const SkRect& rect : copy) {
+        SkRect temp(rect);
+        if (transform) {
             transform->mapRect(&temp);
-        } else {
-            // Don't attempt to calculate damage for a perspective transform
-            // as the numbers this works with can break the perspective
-            // calculations. Just give up and expand to DIRTY_MIN/DIRTY_MAX
-            temp.set(DIRTY_MIN, DIRTY_MIN, DIRTY_MAX, DIRTY_MAX);
         }
+        temp.offset(props.getLeft(), props.getTop());
+        out->join(temp);
     }
-    temp.offset(props.getLeft(), props.getTop());
-    out->join(temp);
 }
 
 static DirtyStack* findParentRenderNode(DirtyStack* frame) {
@@ -178,12 +270,12 @@ static DirtyStack* findProjectionReceiver(DirtyStack* frame) {
 }
 
 static void applyTransforms(DirtyStack* frame, DirtyStack* end) {
-    SkRect* rect = &frame->pendingDirty;
+    DamageRects* rects = &frame->pendingDirty;
     while (frame != end) {
         if (frame->type == TransformRenderNode) {
-            mapRect(frame->renderNode->properties(), *rect, rect);
+            mapRect(frame->renderNode->properties(), *rects, rects);
         } else {
-            mapRect(frame->matrix4, *rect, rect);
+            mapRect(frame->matrix4, *rects, rects);
         }
         frame = frame->prev;
     }
@@ -201,9 +293,7 @@ void DamageAccumulator::applyRenderNodeTransform(DirtyStack* frame) {
 
     // Perform clipping
     if (props.getClipDamageToBounds() && !frame->pendingDirty.isEmpty()) {
-        if (!frame->pendingDirty.intersect(0, 0, props.getWidth(), props.getHeight())) {
-            frame->pendingDirty.setEmpty();
-        }
+        frame->pendingDirty.intersect(SkRect::MakeWH(props.getWidth(), props.getHeight()));
     }
 
     // apply all transforms
@@ -225,19 +315,25 @@ void DamageAccumulator::applyRenderNodeTransform(DirtyStack* frame) {
 }
 
 void DamageAccumulator::dirty(float left, float top, float right, float bottom) {
-    mHead->pendingDirty.join(left, top, right, bottom);
+    mHead->pendingDirty.join(SkRect::MakeLTRB(left, top, right, bottom));
 }
 
 void DamageAccumulator::peekAtDirty(SkRect* dest) const {
-    *dest = mHead->pendingDirty;
+    *dest = mHead->pendingDirty.bounds();
 }
 
 void DamageAccumulator::finish(SkRect* totalDirty) {
+    DamageRects rects;
+    finish(&rects);
+    *totalDirty = rects.bounds();
+}
+
+void DamageAccumulator::finish(DamageRects* totalDirty) {
     LOG_ALWAYS_FATAL_IF(mHead->prev != mHead, "Cannot finish, mismatched push/pop calls! %p vs. %p",
                         mHead->prev, mHead);
-    // Root node never has a transform, so this is the fully mapped dirty rect
+    // Root node never has a transform, so these are the fully mapped dirty rects
     *totalDirty = mHead->pendingDirty;
-    totalDirty->roundOut(totalDirty);
+    totalDirty->roundOut();
     mHead->pendingDirty.setEmpty();
 }
 
@@ -36,6 +36,35 @@ struct DirtyStack;
 class RenderNode;
 class Matrix4;
 
+// A dirty area kept as up to kMaxRects disjoint rects, so that small updates far apart from
+// each other don't turn into their combined bounds. Once full, a new rect is joined into the one
+// whose bounds grow the least.
+class DamageRects {
+public:
+    static constexpr int kMaxRects = 4;
+
+    DamageRects() = default;
+    DamageRects(const SkRect& rect) { join(rect); }  // NOLINT(google-explicit-constructor)
+
+    bool isEmpty() const { return mCount == 0; }
+    int count() const { return mCount; }
+    const SkRect& operator[](int index) const { return mRects[index]; }
+    const SkRect* begin() const { return mRects; }
+    const SkRect* end() const { return mRects + mCount; }
+    SkRect bounds() const;
+
+    void setEmpty() { mCount = 0; }
+    void join(const SkRect& rect);
+    void join(const DamageRects& other);
+    // Returns false if nothing is left
+    bool intersect(const SkRect& clip);
+    void roundOut();
+
+private:
+    SkRect mRects[kMaxRects];
+    int mCount = 0;
+};
+
 class DamageAccumulator {
     PREVENT_COPY_AND_ASSIGN(DamageAccumulator);
 
@@ -61,6 +90,7 @@ public:
     ANDROID_API void computeCurrentTransform(Matrix4* outMatrix) const;
 
     void finish(SkRect* totalDirty);
+    void finish(DamageRects* totalDirty);
 
 private:
     void pushCommon();
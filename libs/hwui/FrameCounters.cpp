@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "FrameCounters.h"
+
+#include "utils/RingBuffer.h"
+
+#include <cutils/compiler.h>
+#include <inttypes.h>
+#include <utils/Trace.h>
+#include <atomic>
+#include <cstdio>
+
+namespace android {
+namespace uirenderer {
+
+static constexpr int kCounterCount = static_cast<int>(FrameCounter::Count);
+
+static const char* kCounterNames[] = {
+        "DisplayListOps", "ImagesPinned",          "ImageBytesPinned",
+        "LayerUpdates",   "HardwareBitmapUploads", "HardwareBitmapBytes",
+};
+
+static_assert(sizeof(kCounterNames) / sizeof(kCounterNames[0]) == kCounterCount,
+              "Missing a FrameCounter name");
+
+struct FrameCounterValues {
+    nsecs_t vsync = 0;
+    int64_t values[kCounterCount] = {};
+};
+
+// 2 seconds at 60fps.
+static constexpr size_t kHistorySize = 120;
+
+static std::atomic<int64_t> sPending[kCounterCount];
+static RingBuffer<FrameCounterValues, kHistorySize> sHistory;
+
+void FrameCounters::add(FrameCounter counter, int64_t value) {
+    sPending[static_cast<int>(counter)].fetch_add(value, std::memory_order_relaxed);
+}
+
+void FrameCounters::finishFrame(nsecs_t vsync) {
+    FrameCounterValues& frame = sHistory.next();
+    frame.vsync = vsync;
+    for (int i = 0; i < kCounterCount; i++) {
+        frame.values[i] = sPending[i].exchange(0, std::memory_order_relaxed);
+    }
+    if (CC_UNLIKELY(ATRACE_ENABLED())) {
+        for (int i = 0; i < kCounterCount; i++) {
+            ATRACE_INT64(kCounterNames[i], frame.values[i]);
+        }
+    }
+}
+
+void FrameCounters::dump(int fd) {
+    dprintf(fd, "\n---FRAMECOUNTERS---\n");
+    dprintf(fd, "Vsync");
+    for (int i = 0; i < kCounterCount; i++) {
+        dprintf(fd, ",%s", kCounterNames[i]);
+    }
+    dprintf(fd, ",\n");
+    for (size_t frame = 0; frame < sHistory.size(); frame++) {
+        const FrameCounterValues& values = sHistory[frame];
+        dprintf(fd, "%" PRId64, values.vsync);
+        for (int i = 0; i < kCounterCount; i++) {
+            dprintf(fd, ",%" PRId64, values.values[i]);
+        }
+        dprintf(fd, ",\n");
+    }
+    dprintf(fd, "---FRAMECOUNTERS---\n");
+}
+
+void FrameCounters::reset() {
+    sHistory.clear();
+    for (int i = 0; i < kCounterCount; i++) {
+        sPending[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+int64_t FrameCounters::lastFrameValue(FrameCounter counter) {
+    if (sHistory.size() == 0) {
+        return 0;
+    }
+    return sHistory.back().values[static_cast<int>(counter)];
+}
+
+const char* FrameCounters::name(FrameCounter counter) {
+    return kCounterNames[static_cast<int>(counter)];
+}
+
+}  // namespace uirenderer
+}  // namespace android
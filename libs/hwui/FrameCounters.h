@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+#pragma once
+
+#include <utils/Timers.h>
+
+#include <stdint.h>
+
+namespace android {
+namespace uirenderer {
+
+enum class FrameCounter {
+    // Ops in the display lists of the synced tree.
+    DisplayListOps = 0,
+    // Raster images pinned as textures to draw the frame, and their bytes.
+    ImagesPinned,
+    ImageBytesPinned,
+    // Layers rendered before the frame.
+    LayerUpdates,
+    // Hardware bitmaps uploaded on any thread since the last frame, and their bytes.
+    HardwareBitmapUploads,
+    HardwareBitmapBytes,
+
+    Count,
+};
+
+/**
+ * Process wide counts of the content of each frame.
+ *
+ * add() can be called from any thread, it only does a relaxed atomic add. The counts are gathered
+ * into a history of the last frames by finishFrame(), which is also when they are emitted as
+ * atrace counters if tracing is enabled. finishFrame() and dump() are only called on the
+ * RenderThread.
+ */
+class FrameCounters {
+public:
+    static void add(FrameCounter counter, int64_t value);
+    static void finishFrame(nsecs_t vsync);
+    static void dump(int fd);
+    static void reset();
+
+    // The counts of the last finished frame, for tests.
+    static int64_t lastFrameValue(FrameCounter counter);
+
+    static const char* name(FrameCounter counter);
+};
+
+}  // namespace uirenderer
+}  // namespace android
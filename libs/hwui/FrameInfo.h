@@ -64,6 +64,8 @@ enum {
     RTAnimation = 1 << 1,
     SurfaceCanvas = 1 << 2,
     SkippedFrame = 1 << 3,
+    // The frame was given a present time past the next vsync.
+    RenderAhead = 1 << 4,
 };
 };
 
@@ -114,6 +116,12 @@ public:
         set(FrameInfoIndex::Flags) |= static_cast<uint64_t>(frameInfoFlag);
     }
 
+    // How often the UI thread blocked on the RenderThread since the previous frame. Not part of
+    // data(), which has the layout of FrameMetrics.java.
+    void setUiThreadSyncWaits(int syncWaits) { mUiThreadSyncWaits = syncWaits; }
+
+    int uiThreadSyncWaits() const { return mUiThreadSyncWaits; }
+
     const int64_t* data() const { return mFrameInfo; }
 
     inline int64_t operator[](FrameInfoIndex index) const { return get(index); }
@@ -152,6 +160,7 @@ public:
 
 private:
     int64_t mFrameInfo[static_cast<int>(FrameInfoIndex::NumIndexes)];
+    int mUiThreadSyncWaits = 0;
 };
 
 } /* namespace uirenderer */
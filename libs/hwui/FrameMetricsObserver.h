@@ -16,14 +16,35 @@
 
 #pragma once
 
+#include "RecordingCost.h"
+
 #include <utils/RefBase.h>
+#include <utils/Timers.h>
+
+#include <string>
 
 namespace android {
 namespace uirenderer {
 
+/**
+ * Estimated cost of the display lists drawn in a frame, see RecordingCost.
+ */
+struct FrameCost {
+    RecordingCost total;
+    // The node whose own display list touches the most pixels, and that list's cost.
+    std::string costliestNodeName;
+    RecordingCost costliestNode;
+    // CPU time the RenderThread spent running animators for the frame.
+    nsecs_t animationTime = 0;
+};
+
 class FrameMetricsObserver : public VirtualLightRefBase {
 public:
     virtual void notify(const int64_t* buffer) = 0;
+
+    // Called after notify() with the cost of the same frame. The FrameInfo buffer is shared
+    // with FrameMetrics.java, so the estimate is reported separately.
+    virtual void notifyCost(const FrameCost& cost) {}
 };
 
 }  // namespace uirenderer
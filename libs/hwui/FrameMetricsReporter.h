@@ -52,6 +52,12 @@ public:
         }
     }
 
+    void reportFrameCost(const FrameCost& cost) {
+        for (size_t i = 0; i < mObservers.size(); i++) {
+            mObservers[i]->notifyCost(cost);
+        }
+    }
+
 private:
     std::vector<sp<FrameMetricsObserver> > mObservers;
 };
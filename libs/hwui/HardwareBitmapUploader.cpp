@@ -16,9 +16,11 @@
 
 #include "HardwareBitmapUploader.h"
 
+#include "FrameCounters.h"
 #include "hwui/Bitmap.h"
 #include "renderthread/EglManager.h"
 #include "renderthread/VulkanManager.h"
+#include "thread/CommonPool.h"
 #include "thread/ThreadBase.h"
 #include "utils/TimeUtils.h"
 
@@ -32,6 +34,8 @@
 #include <utils/GLUtils.h>
 #include <utils/Trace.h>
 #include <utils/TraceUtils.h>
+#include <algorithm>
+#include <memory>
 #include <thread>
 
 namespace android::uirenderer {
@@ -49,6 +53,14 @@ struct FormatInfo {
     bool valid = true;
 };
 
+struct UploadRequest {
+    // The source bitmap, converted to a color type the buffer can take.
+    SkBitmap bitmap;
+    FormatInfo format;
+    // nullptr if the request failed.
+    sp<GraphicBuffer> buffer;
+};
+
 class AHBUploader : public RefBase {
 public:
     virtual ~AHBUploader() {}
@@ -70,13 +82,19 @@ public:
         onDestroy();
     }
 
-    bool uploadHardwareBitmap(const SkBitmap& bitmap, const FormatInfo& format,
-                              sp<GraphicBuffer> graphicBuffer) {
+    // Uploads every request that has a buffer, and clears the buffer of those that fail.
+    void uploadHardwareBitmaps(std::vector<UploadRequest>& requests) {
         ATRACE_CALL();
         beginUpload();
-        bool result = onUploadHardwareBitmap(bitmap, format, graphicBuffer);
+        onUploadHardwareBitmaps(requests);
         endUpload();
-        return result;
+        for (const UploadRequest& request : requests) {
+            if (request.buffer) {
+                FrameCounters::add(FrameCounter::HardwareBitmapUploads, 1);
+                FrameCounters::add(FrameCounter::HardwareBitmapBytes,
+                                   request.bitmap.computeByteSize());
+            }
+        }
     }
 
     void postIdleTimeoutCheck() {
@@ -92,8 +110,7 @@ private:
     virtual void onIdle() = 0;
     virtual void onDestroy() = 0;
 
-    virtual bool onUploadHardwareBitmap(const SkBitmap& bitmap, const FormatInfo& format,
-                                        sp<GraphicBuffer> graphicBuffer) = 0;
+    virtual void onUploadHardwareBitmaps(std::vector<UploadRequest>& requests) = 0;
     virtual void onBeginUpload() = 0;
 
     bool shouldTimeOutLocked() {
@@ -164,39 +181,53 @@ private:
         return mEglManager.eglDisplay();
     }
 
-    bool onUploadHardwareBitmap(const SkBitmap& bitmap, const FormatInfo& format,
-                                sp<GraphicBuffer> graphicBuffer) override {
+    void onUploadHardwareBitmaps(std::vector<UploadRequest>& requests) override {
         ATRACE_CALL();
 
         EGLDisplay display = getUploadEglDisplay();
 
         LOG_ALWAYS_FATAL_IF(display == EGL_NO_DISPLAY, "Failed to get EGL_DEFAULT_DISPLAY! err=%s",
                             uirenderer::renderthread::EglManager::eglErrorString());
-        // We use an EGLImage to access the content of the GraphicBuffer
+        // We use an EGLImage to access the content of each GraphicBuffer
         // The EGL image is later bound to a 2D texture
-        EGLClientBuffer clientBuffer = (EGLClientBuffer)graphicBuffer->getNativeBuffer();
-        AutoEglImage autoImage(display, clientBuffer);
-        if (autoImage.image == EGL_NO_IMAGE_KHR) {
-            ALOGW("Could not create EGL image, err =%s",
-                  uirenderer::renderthread::EglManager::eglErrorString());
-            return false;
+        std::vector<std::unique_ptr<AutoEglImage>> autoImages(requests.size());
+        for (size_t i = 0; i < requests.size(); i++) {
+            if (!requests[i].buffer) {
+                continue;
+            }
+            EGLClientBuffer clientBuffer = (EGLClientBuffer)requests[i].buffer->getNativeBuffer();
+            autoImages[i] = std::make_unique<AutoEglImage>(display, clientBuffer);
+            if (autoImages[i]->image == EGL_NO_IMAGE_KHR) {
+                ALOGW("Could not create EGL image, err =%s",
+                      uirenderer::renderthread::EglManager::eglErrorString());
+                autoImages[i] = nullptr;
+                requests[i].buffer = nullptr;
+            }
         }
 
         {
-            ATRACE_FORMAT("CPU -> gralloc transfer (%dx%d)", bitmap.width(), bitmap.height());
+            ATRACE_FORMAT("CPU -> gralloc transfer (%zu bitmaps)", requests.size());
             EGLSyncKHR fence = mUploadThread->queue().runSync([&]() -> EGLSyncKHR {
-                AutoSkiaGlTexture glTexture;
-                glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, autoImage.image);
-                GL_CHECKPOINT(MODERATE);
-
-                // glTexSubImage2D is synchronous in sense that it memcpy() from pointer that we
-                // provide.
-                // But asynchronous in sense that driver may upload texture onto hardware buffer
-                // when we first use it in drawing
-                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, bitmap.width(), bitmap.height(),
-                                format.format, format.type, bitmap.getPixels());
-                GL_CHECKPOINT(MODERATE);
-
+                for (size_t i = 0; i < requests.size(); i++) {
+                    if (!autoImages[i]) {
+                        continue;
+                    }
+                    const SkBitmap& bitmap = requests[i].bitmap;
+                    const FormatInfo& format = requests[i].format;
+                    AutoSkiaGlTexture glTexture;
+                    glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, autoImages[i]->image);
+                    GL_CHECKPOINT(MODERATE);
+
+                    // glTexSubImage2D is synchronous in sense that it memcpy() from pointer that
+                    // we provide.
+                    // But asynchronous in sense that driver may upload texture onto hardware
+                    // buffer when we first use it in drawing
+                    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, bitmap.width(), bitmap.height(),
+                                    format.format, format.type, bitmap.getPixels());
+                    GL_CHECKPOINT(MODERATE);
+                }
+
+                // The uploads complete in order, so one fence covers all of them.
                 EGLSyncKHR uploadFence =
                         eglCreateSyncKHR(eglGetCurrentDisplay(), EGL_SYNC_FENCE_KHR, NULL);
                 LOG_ALWAYS_FATAL_IF(uploadFence == EGL_NO_SYNC_KHR,
@@ -211,7 +242,6 @@ private:
 
             eglDestroySyncKHR(display, fence);
         }
-        return true;
     }
 
     renderthread::EglManager mEglManager;
@@ -262,15 +292,21 @@ private:
         }
     }
 
-    bool onUploadHardwareBitmap(const SkBitmap& bitmap, const FormatInfo& format,
-                                sp<GraphicBuffer> graphicBuffer) override {
+    void onUploadHardwareBitmaps(std::vector<UploadRequest>& requests) override {
         ATRACE_CALL();
 
         std::lock_guard _lock{mLock};
 
-        sk_sp<SkImage> image = SkImage::MakeFromAHardwareBufferWithData(mGrContext.get(),
-            bitmap.pixmap(), reinterpret_cast<AHardwareBuffer*>(graphicBuffer.get()));
-        return (image.get() != nullptr);
+        for (auto& request : requests) {
+            if (!request.buffer) {
+                continue;
+            }
+            sk_sp<SkImage> image = SkImage::MakeFromAHardwareBufferWithData(mGrContext.get(),
+                request.bitmap.pixmap(), reinterpret_cast<AHardwareBuffer*>(request.buffer.get()));
+            if (!image) {
+                request.buffer = nullptr;
+            }
+        }
     }
 
     sk_sp<GrContext> mGrContext;
@@ -373,18 +409,17 @@ static void createUploader(bool usingGL) {
     }
 }
 
-sk_sp<Bitmap> HardwareBitmapUploader::allocateHardwareBitmap(const SkBitmap& sourceBitmap) {
-    ATRACE_CALL();
-
-    bool usingGL = uirenderer::Properties::getRenderPipelineType() ==
-            uirenderer::RenderPipelineType::SkiaGL;
-
-    FormatInfo format = determineFormat(sourceBitmap, usingGL);
-    if (!format.valid) {
-        return nullptr;
+// Converts the bitmap and allocates the buffer for it, leaving the buffer unset on failure.
+static UploadRequest prepareUpload(const SkBitmap& sourceBitmap, bool usingGL) {
+    UploadRequest request;
+    request.format = determineFormat(sourceBitmap, usingGL);
+    if (!request.format.valid) {
+        return request;
     }
 
-    SkBitmap bitmap = makeHwCompatible(format, sourceBitmap);
+    const FormatInfo& format = request.format;
+    SkBitmap& bitmap = request.bitmap;
+    bitmap = makeHwCompatible(format, sourceBitmap);
     sp<GraphicBuffer> buffer = new GraphicBuffer(
             static_cast<uint32_t>(bitmap.width()), static_cast<uint32_t>(bitmap.height()),
             format.pixelFormat,
@@ -396,16 +431,81 @@ sk_sp<Bitmap> HardwareBitmapUploader::allocateHardwareBitmap(const SkBitmap& sou
     status_t error = buffer->initCheck();
     if (error < 0) {
         ALOGW("createGraphicBuffer() failed in GraphicBuffer.create()");
+        return request;
+    }
+    request.buffer = buffer;
+    return request;
+}
+
+static sk_sp<Bitmap> finishUpload(const UploadRequest& request) {
+    if (!request.buffer) {
         return nullptr;
     }
+    const SkBitmap& bitmap = request.bitmap;
+    return Bitmap::createFrom(request.buffer, bitmap.colorType(), bitmap.refColorSpace(),
+                              bitmap.alphaType(), Bitmap::computePalette(bitmap));
+}
 
-    createUploader(usingGL);
+sk_sp<Bitmap> HardwareBitmapUploader::allocateHardwareBitmap(const SkBitmap& sourceBitmap) {
+    ATRACE_CALL();
 
-    if (!sUploader->uploadHardwareBitmap(bitmap, format, buffer)) {
+    bool usingGL = uirenderer::Properties::getRenderPipelineType() ==
+            uirenderer::RenderPipelineType::SkiaGL;
+
+    std::vector<UploadRequest> requests;
+    requests.push_back(prepareUpload(sourceBitmap, usingGL));
+    if (!requests[0].buffer) {
         return nullptr;
     }
-    return Bitmap::createFrom(buffer, bitmap.colorType(), bitmap.refColorSpace(),
-                              bitmap.alphaType(), Bitmap::computePalette(bitmap));
+
+    createUploader(usingGL);
+
+    sUploader->uploadHardwareBitmaps(requests);
+    return finishUpload(requests[0]);
+}
+
+std::vector<sk_sp<Bitmap>> HardwareBitmapUploader::allocateHardwareBitmaps(
+        const std::vector<SkBitmap>& sourceBitmaps) {
+    ATRACE_FORMAT("allocateHardwareBitmaps %zu", sourceBitmaps.size());
+
+    bool usingGL = uirenderer::Properties::getRenderPipelineType() ==
+            uirenderer::RenderPipelineType::SkiaGL;
+
+    // Every CommonPool thread takes a share of the bitmaps, and so does this thread.
+    std::vector<UploadRequest> requests(sourceBitmaps.size());
+    constexpr size_t shareCount = CommonPool::THREAD_COUNT + 1;
+    auto prepareShare = [&](size_t share) {
+        for (size_t i = share; i < sourceBitmaps.size(); i += shareCount) {
+            requests[i] = prepareUpload(sourceBitmaps[i], usingGL);
+        }
+    };
+    {
+        CommonPool::Group group;
+        for (size_t share = 1; share < shareCount && share < sourceBitmaps.size(); share++) {
+            group.post([&prepareShare, share] { prepareShare(share); });
+        }
+        prepareShare(0);
+        group.wait();
+    }
+
+    std::vector<sk_sp<Bitmap>> result(sourceBitmaps.size());
+    if (std::none_of(requests.begin(), requests.end(),
+                     [](const UploadRequest& request) { return request.buffer != nullptr; })) {
+        return result;
+    }
+
+    createUploader(usingGL);
+
+    sUploader->uploadHardwareBitmaps(requests);
+    for (size_t i = 0; i < requests.size(); i++) {
+        result[i] = finishUpload(requests[i]);
+    }
+    return result;
+}
+
+std::future<sk_sp<Bitmap>> HardwareBitmapUploader::allocateHardwareBitmapAsync(
+        const SkBitmap& sourceBitmap) {
+    return CommonPool::async([sourceBitmap] { return allocateHardwareBitmap(sourceBitmap); });
 }
 
 void HardwareBitmapUploader::initialize() {
@@ -18,6 +18,9 @@
 
 #include <hwui/Bitmap.h>
 
+#include <future>
+#include <vector>
+
 namespace android::uirenderer {
 
 class ANDROID_API HardwareBitmapUploader {
@@ -27,6 +30,21 @@ public:
 
     static sk_sp<Bitmap> allocateHardwareBitmap(const SkBitmap& sourceBitmap);
 
+    /**
+     * Same as allocateHardwareBitmap for each of sourceBitmaps, but the color type conversions
+     * and buffer allocations run in parallel on CommonPool, and all the uploads share a single
+     * trip to the upload thread. Entries that could not be uploaded are nullptr.
+     * Must not be called from a CommonPool thread.
+     */
+    static std::vector<sk_sp<Bitmap>> allocateHardwareBitmaps(
+            const std::vector<SkBitmap>& sourceBitmaps);
+
+    /**
+     * Runs allocateHardwareBitmap on CommonPool. The pixels of sourceBitmap must not change
+     * until the returned future is ready.
+     */
+    static std::future<sk_sp<Bitmap>> allocateHardwareBitmapAsync(const SkBitmap& sourceBitmap);
+
     static bool hasFP16Support();
 };
 
@@ -29,10 +29,32 @@ Interpolator* Interpolator::createDefaultInterpolator() {
     return new AccelerateDecelerateInterpolator();
 }
 
-float AccelerateDecelerateInterpolator::interpolate(float input) {
+static inline float accelerateDecelerate(float input) {
     return (float)(cosf((input + 1) * M_PI) / 2.0f) + 0.5f;
 }
 
+void Interpolator::interpolateBatch(Kind kind, Interpolator* const* interpolators,
+                                    float* fractions, size_t count) {
+    switch (kind) {
+        case Kind::Linear:
+            break;
+        case Kind::AccelerateDecelerate:
+            for (size_t i = 0; i < count; i++) {
+                fractions[i] = accelerateDecelerate(fractions[i]);
+            }
+            break;
+        default:
+            for (size_t i = 0; i < count; i++) {
+                fractions[i] = interpolators[i]->interpolate(fractions[i]);
+            }
+            break;
+    }
+}
+
+float AccelerateDecelerateInterpolator::interpolate(float input) {
+    return accelerateDecelerate(input);
+}
+
 float AccelerateInterpolator::interpolate(float input) {
     if (mFactor == 1.0f) {
         return input * input;
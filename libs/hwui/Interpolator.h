@@ -27,18 +27,37 @@ namespace uirenderer {
 
 class Interpolator {
 public:
+    // The interpolators that interpolateBatch() evaluates without a virtual call per value.
+    enum class Kind {
+        Other = 0,
+        Linear,
+        AccelerateDecelerate,
+        Count,
+    };
+
     virtual ~Interpolator() {}
 
     virtual float interpolate(float input) = 0;
 
+    Kind kind() const { return mKind; }
+
+    // Replaces each of the count fractions by interpolators[i]->interpolate(fractions[i]). All
+    // the interpolators must be of the given kind.
+    static void interpolateBatch(Kind kind, Interpolator* const* interpolators, float* fractions,
+                                 size_t count);
+
     static Interpolator* createDefaultInterpolator();
 
 protected:
-    Interpolator() {}
+    explicit Interpolator(Kind kind = Kind::Other) : mKind(kind) {}
+
+private:
+    const Kind mKind;
 };
 
 class ANDROID_API AccelerateDecelerateInterpolator : public Interpolator {
 public:
+    AccelerateDecelerateInterpolator() : Interpolator(Kind::AccelerateDecelerate) {}
     virtual float interpolate(float input) override;
 };
 
@@ -95,6 +114,7 @@ private:
 
 class ANDROID_API LinearInterpolator : public Interpolator {
 public:
+    LinearInterpolator() : Interpolator(Kind::Linear) {}
     virtual float interpolate(float input) override { return input; }
 };
 
@@ -74,6 +74,9 @@ static const int64_t IGNORE_EXCEEDING = seconds_to_nanoseconds(10);
  */
 static const int64_t EXEMPT_FRAMES_FLAGS = FrameInfoFlags::SurfaceCanvas;
 
+// A fence that hasn't signaled after this many more frames is dropped rather than waited on
+static const size_t MAX_PENDING_GPU_FRAMES = 8;
+
 // For testing purposes to try and eliminate test infra overhead we will
 // consider any unknown delay of frame start as part of the test infrastructure
 // and filter it out of the frame profile data
@@ -129,6 +132,15 @@ void JankTracker::finishFrame(const FrameInfo& frame) {
     mData->reportFrame(totalDuration);
     (*mGlobalData)->reportFrame(totalDuration);
 
+    reportStage(kStageSync,
+                frame.duration(FrameInfoIndex::SyncStart, FrameInfoIndex::IssueDrawCommandsStart));
+    reportStage(kStageDraw, frame.duration(FrameInfoIndex::IssueDrawCommandsStart,
+                                           FrameInfoIndex::SwapBuffers));
+    reportStage(kStageFlush,
+                frame.duration(FrameInfoIndex::SwapBuffers, FrameInfoIndex::FrameCompleted));
+    reportStage(kStageDequeue, frame[FrameInfoIndex::DequeueBufferDuration]);
+    reportSignaledGpuFrames();
+
     // Only things like Surface.lockHardwareCanvas() are exempt from tracking
     if (CC_UNLIKELY(frame[FrameInfoIndex::Flags] & EXEMPT_FRAMES_FLAGS)) {
         return;
@@ -184,6 +196,36 @@ void JankTracker::finishFrame(const FrameInfo& frame) {
     }
 }
 
+void JankTracker::finishGpuDraw(const FrameInfo& frame, sp<Fence>&& fence) {
+    if (fence == nullptr || !fence->isValid()) {
+        return;
+    }
+    if (mPendingGpuFrames.size() >= MAX_PENDING_GPU_FRAMES) {
+        mPendingGpuFrames.pop_front();
+    }
+    mPendingGpuFrames.push_back(
+            PendingGpuFrame{std::move(fence), frame[FrameInfoIndex::SwapBuffers]});
+}
+
+void JankTracker::reportStage(FrameStage stage, int64_t duration) {
+    mData->reportStage(stage, duration);
+    (*mGlobalData)->reportStage(stage, duration);
+}
+
+void JankTracker::reportSignaledGpuFrames() {
+    while (!mPendingGpuFrames.empty()) {
+        const PendingGpuFrame& pending = mPendingGpuFrames.front();
+        nsecs_t signalTime = pending.fence->getSignalTime();
+        if (signalTime == Fence::SIGNAL_TIME_PENDING) {
+            return;
+        }
+        if (signalTime != Fence::SIGNAL_TIME_INVALID) {
+            reportStage(kStageGpu, signalTime - pending.swapBuffers);
+        }
+        mPendingGpuFrames.pop_front();
+    }
+}
+
 void JankTracker::dumpData(int fd, const ProfileDataDescription* description,
                            const ProfileData* data) {
     if (description) {
@@ -211,6 +253,7 @@ void JankTracker::dumpFrames(int fd) {
         dprintf(fd, "%s", FrameInfoNames[i].c_str());
         dprintf(fd, ",");
     }
+    dprintf(fd, "UiThreadSyncWaits,");
     for (size_t i = 0; i < mFrames.size(); i++) {
         FrameInfo& frame = mFrames[i];
         if (frame[FrameInfoIndex::SyncStart] == 0) {
@@ -220,12 +263,14 @@ void JankTracker::dumpFrames(int fd) {
         for (int i = 0; i < static_cast<int>(FrameInfoIndex::NumIndexes); i++) {
             dprintf(fd, "%" PRId64 ",", frame[i]);
         }
+        dprintf(fd, "%d,", frame.uiThreadSyncWaits());
     }
     dprintf(fd, "\n---PROFILEDATA---\n\n");
 }
 
 void JankTracker::reset() {
     mFrames.clear();
+    mPendingGpuFrames.clear();
     mData->reset();
     (*mGlobalData)->reset();
     sFrameStart = Properties::filterOutTestOverhead ? FrameInfoIndex::HandleInputStart
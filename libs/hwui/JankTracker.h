@@ -24,8 +24,10 @@
 
 #include <cutils/compiler.h>
 #include <ui/DisplayInfo.h>
+#include <ui/Fence.h>
 
 #include <array>
+#include <deque>
 #include <memory>
 
 namespace android {
@@ -58,6 +60,9 @@ public:
 
     FrameInfo* startFrame() { return &mFrames.next(); }
     void finishFrame(const FrameInfo& frame);
+    // Takes the fence the GPU signals once it is done with the frame. Its GPU time is reported
+    // by a later finishFrame(), after the fence has signaled.
+    void finishGpuDraw(const FrameInfo& frame, sp<Fence>&& fence);
 
     void dumpStats(int fd) { dumpData(fd, &mDescription, mData.get()); }
     void dumpFrames(int fd);
@@ -68,7 +73,14 @@ public:
     RingBuffer<FrameInfo, 120>& frames() { return mFrames; }
 
 private:
+    struct PendingGpuFrame {
+        sp<Fence> fence;
+        nsecs_t swapBuffers;
+    };
+
     void setFrameInterval(nsecs_t frameIntervalNanos);
+    void reportStage(FrameStage stage, int64_t duration);
+    void reportSignaledGpuFrames();
 
     static void dumpData(int fd, const ProfileDataDescription* description,
                          const ProfileData* data);
@@ -87,6 +99,8 @@ private:
     ProfileDataContainer mData;
     ProfileDataContainer* mGlobalData;
     ProfileDataDescription mDescription;
+    // Oldest first, the GPU finishes frames in order
+    std::deque<PendingGpuFrame> mPendingGpuFrames;
 
     // Ring buffer large enough for 2 seconds worth of frames
     RingBuffer<FrameInfo, 120> mFrames;
@@ -26,18 +26,18 @@
 namespace android {
 namespace uirenderer {
 
+static inline bool isCommandStart(char c) {
+    // Folding to lower case leaves a single range check. Note that 'e' or 'E'
+    // are not valid path commands, but could be used for floating point
+    // numbers' scientific notation. Therefore, when searching for next command,
+    // we should ignore 'e' and 'E'.
+    const char lower = c | 0x20;
+    return lower >= 'a' && lower <= 'z' && lower != 'e';
+}
+
 static size_t nextStart(const char* s, size_t length, size_t startIndex) {
     size_t index = startIndex;
-    while (index < length) {
-        char c = s[index];
-        // Note that 'e' or 'E' are not valid path commands, but could be
-        // used for floating point numbers' scientific notation.
-        // Therefore, when searching for next command, we should ignore 'e'
-        // and 'E'.
-        if ((((c - 'A') * (c - 'Z') <= 0) || ((c - 'a') * (c - 'z') <= 0)) && c != 'e' &&
-            c != 'E') {
-            return index;
-        }
+    while (index < length && !isCommandStart(s[index])) {
         index++;
     }
     return index;
@@ -116,7 +116,7 @@ static float parseFloat(PathParser::ParseResult* result, const char* startPtr,
 }
 
 /**
- * Parse the floats in the string.
+ * Parse the floats in the string, appending them to outPoints.
  *
  * @param s the string containing a command and list of floats
  * @return true on success
@@ -234,18 +234,21 @@ void PathParser::getPathDataFromAsciiString(PathData* data, ParseResult* result,
 
     while (end < strLen) {
         end = nextStart(pathStr, strLen, end);
-        std::vector<float> points;
-        getFloats(&points, result, pathStr, start, end);
-        validateVerbAndPoints(pathStr[start], points.size(), result);
+        // The floats go straight into data->points, and are dropped again if the verb turns
+        // out to be invalid.
+        const size_t pointsStart = data->points.size();
+        getFloats(&data->points, result, pathStr, start, end);
+        const size_t pointCount = data->points.size() - pointsStart;
+        validateVerbAndPoints(pathStr[start], pointCount, result);
         if (result->failureOccurred) {
+            data->points.resize(pointsStart);
             // If either verb or points is not valid, return immediately.
             result->failureMessage += "Failure occurred at position " + std::to_string(start) +
                                       " of path: " + pathStr;
             return;
         }
         data->verbs.push_back(pathStr[start]);
-        data->verbSizes.push_back(points.size());
-        data->points.insert(data->points.end(), points.begin(), points.end());
+        data->verbSizes.push_back(pointCount);
         start = end;
         end++;
     }
@@ -286,7 +289,13 @@ void PathParser::dump(const PathData& data) {
 
 void PathParser::parseAsciiStringForSkPath(SkPath* skPath, ParseResult* result, const char* pathStr,
                                            size_t strLen) {
-    PathData pathData;
+    // Inflating a layout parses many path strings in a row, reuse the buffers of the previous
+    // one instead of allocating new ones.
+    static thread_local PathData sPathData;
+    PathData& pathData = sPathData;
+    pathData.verbs.clear();
+    pathData.verbSizes.clear();
+    pathData.points.clear();
     getPathDataFromAsciiString(&pathData, result, pathStr, strLen);
     if (result->failureOccurred) {
         return;
@@ -25,6 +25,10 @@ static const char* JANK_TYPE_NAMES[] = {
         "Missed Vsync",        "High input latency",       "Slow UI thread",
         "Slow bitmap uploads", "Slow issue draw commands", "Frame deadline missed"};
 
+static const char* STAGE_NAMES[] = {"SYNC", "DRAW", "FLUSH", "GPU", "DEQUEUE"};
+static_assert((sizeof(STAGE_NAMES) / sizeof(STAGE_NAMES[0])) == NUM_STAGES,
+              "size mismatch: STAGE_NAMES doesn't match FrameStage!");
+
 // The bucketing algorithm controls so to speak
 // If a frame is <= to this it goes in bucket 0
 static const uint32_t kBucketMinThreshold = 5;
@@ -77,6 +81,14 @@ uint32_t ProfileData::frameTimeForSlowFrameCountIndex(uint32_t index) {
     return (index * kSlowFrameBucketIntervalMs) + kSlowFrameBucketStartMs;
 }
 
+uint32_t ProfileData::frameTimeForStageFrameCountIndex(uint32_t index) {
+    return index + 1;
+}
+
+const char* ProfileData::stageName(FrameStage stage) {
+    return STAGE_NAMES[static_cast<int>(stage)];
+}
+
 void ProfileData::mergeWith(const ProfileData& other) {
     // Make sure we don't overflow Just In Case
     uint32_t divider = 0;
@@ -91,6 +103,12 @@ void ProfileData::mergeWith(const ProfileData& other) {
         mFrameCounts[i] >>= divider;
         mFrameCounts[i] += other.mFrameCounts[i];
     }
+    for (size_t stage = 0; stage < other.mStageFrameCounts.size(); stage++) {
+        for (size_t i = 0; i < other.mStageFrameCounts[stage].size(); i++) {
+            mStageFrameCounts[stage][i] >>= divider;
+            mStageFrameCounts[stage][i] += other.mStageFrameCounts[stage][i];
+        }
+    }
     mJankFrameCount >>= divider;
     mJankFrameCount += other.mJankFrameCount;
     mTotalFrameCount >>= divider;
@@ -117,6 +135,12 @@ void ProfileData::dump(int fd) const {
     histogramForEach([fd](HistogramEntry entry) {
         dprintf(fd, " %ums=%u", entry.renderTimeMs, entry.frameCount);
     });
+    for (int stage = 0; stage < NUM_STAGES; stage++) {
+        dprintf(fd, "\n%s HISTOGRAM:", STAGE_NAMES[stage]);
+        stageHistogramForEach(static_cast<FrameStage>(stage), [fd](HistogramEntry entry) {
+            dprintf(fd, " %ums=%u", entry.renderTimeMs, entry.frameCount);
+        });
+    }
 }
 
 uint32_t ProfileData::findPercentile(int percentile) const {
@@ -141,6 +165,9 @@ void ProfileData::reset() {
     mJankTypeCounts.fill(0);
     mFrameCounts.fill(0);
     mSlowFrameCounts.fill(0);
+    for (auto& counts : mStageFrameCounts) {
+        counts.fill(0);
+    }
     mTotalFrameCount = 0;
     mJankFrameCount = 0;
     mStatStartTime = systemTime(CLOCK_MONOTONIC);
@@ -158,6 +185,12 @@ void ProfileData::reportFrame(int64_t duration) {
     }
 }
 
+void ProfileData::reportStage(FrameStage stage, int64_t duration) {
+    auto& counts = mStageFrameCounts[static_cast<int>(stage)];
+    uint32_t index = static_cast<uint32_t>(ns2ms(std::max(duration, int64_t(0))));
+    counts[std::min(index, static_cast<uint32_t>(counts.size() - 1))]++;
+}
+
 void ProfileData::histogramForEach(const std::function<void(HistogramEntry)>& callback) const {
     for (size_t i = 0; i < mFrameCounts.size(); i++) {
         callback(HistogramEntry{frameTimeForFrameCountIndex(i), mFrameCounts[i]});
@@ -167,5 +200,13 @@ void ProfileData::histogramForEach(const std::function<void(HistogramEntry)>& ca
     }
 }
 
+void ProfileData::stageHistogramForEach(FrameStage stage,
+                                        const std::function<void(HistogramEntry)>& callback) const {
+    const auto& counts = mStageFrameCounts[static_cast<int>(stage)];
+    for (size_t i = 0; i < counts.size(); i++) {
+        callback(HistogramEntry{frameTimeForStageFrameCountIndex(i), counts[i]});
+    }
+}
+
 } /* namespace uirenderer */
 } /* namespace android */
\ No newline at end of file
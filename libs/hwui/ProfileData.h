@@ -39,6 +39,23 @@ enum JankType {
     NUM_BUCKETS,
 };
 
+// The parts of a frame that get their own duration histogram
+enum FrameStage {
+    // SyncStart to IssueDrawCommandsStart
+    kStageSync = 0,
+    // IssueDrawCommandsStart to SwapBuffers
+    kStageDraw,
+    // SwapBuffers to FrameCompleted, the swap flushing the frame to the GPU
+    kStageFlush,
+    // SwapBuffers to the GPU signaling the frame's fence
+    kStageGpu,
+    // DequeueBufferDuration
+    kStageDequeue,
+
+    // must be last
+    NUM_STAGES,
+};
+
 // For testing
 class MockProfileData;
 
@@ -58,6 +75,7 @@ public:
     void reportFrame(int64_t duration);
     void reportJank() { mJankFrameCount++; }
     void reportJankType(JankType type) { mJankTypeCounts[static_cast<int>(type)]++; }
+    void reportStage(FrameStage stage, int64_t duration);
 
     uint32_t totalFrameCount() const { return mTotalFrameCount; }
     uint32_t jankFrameCount() const { return mJankFrameCount; }
@@ -69,15 +87,24 @@ public:
         uint32_t frameCount;
     };
     void histogramForEach(const std::function<void(HistogramEntry)>& callback) const;
+    void stageHistogramForEach(FrameStage stage,
+                               const std::function<void(HistogramEntry)>& callback) const;
 
     constexpr static int HistogramSize() {
         return std::tuple_size<decltype(ProfileData::mFrameCounts)>::value +
                std::tuple_size<decltype(ProfileData::mSlowFrameCounts)>::value;
     }
 
+    constexpr static int StageHistogramSize() {
+        return std::tuple_size<decltype(ProfileData::mStageFrameCounts)::value_type>::value;
+    }
+
+    static const char* stageName(FrameStage stage);
+
     // Visible for testing
     static uint32_t frameTimeForFrameCountIndex(uint32_t index);
     static uint32_t frameTimeForSlowFrameCountIndex(uint32_t index);
+    static uint32_t frameTimeForStageFrameCountIndex(uint32_t index);
 
 private:
     // Open our guts up to unit tests
@@ -88,6 +115,9 @@ private:
     std::array<uint32_t, 57> mFrameCounts;
     // Holds a histogram of frame times in 50ms increments from 150ms to 5s
     std::array<uint16_t, 97> mSlowFrameCounts;
+    // Per FrameStage, a histogram of durations in 1ms increments up to 24ms. The last bucket,
+    // 25ms, holds everything slower
+    std::array<std::array<uint32_t, 25>, NUM_STAGES> mStageFrameCounts;
 
     uint32_t mTotalFrameCount;
     uint32_t mJankFrameCount;
@@ -100,6 +130,9 @@ public:
     std::array<uint32_t, NUM_BUCKETS>& editJankTypeCounts() { return mJankTypeCounts; }
     std::array<uint32_t, 57>& editFrameCounts() { return mFrameCounts; }
     std::array<uint16_t, 97>& editSlowFrameCounts() { return mSlowFrameCounts; }
+    std::array<uint32_t, 25>& editStageFrameCounts(FrameStage stage) {
+        return mStageFrameCounts[static_cast<int>(stage)];
+    }
     uint32_t& editTotalFrameCount() { return mTotalFrameCount; }
     uint32_t& editJankFrameCount() { return mJankFrameCount; }
     nsecs_t& editStatStartTime() { return mStatStartTime; }
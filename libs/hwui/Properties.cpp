@@ -66,6 +66,16 @@ bool Properties::isolatedProcess = false;
 
 int Properties::contextPriority = 0;
 int Properties::defaultRenderAhead = -1;
+bool Properties::adaptiveRenderAhead = false;
+bool Properties::parallelPrepareTree = false;
+bool Properties::publishPropertyOnlyFrames = false;
+bool Properties::shaderCacheWarmup = false;
+bool Properties::parallelVectorDrawables = false;
+bool Properties::adaptiveCacheBudget = false;
+bool Properties::textBlobCache = false;
+bool Properties::layerPool = false;
+int Properties::animatedImagePrefetchFrames = 0;
+bool Properties::offThreadLayers = false;
 
 static int property_get_int(const char* key, int defaultValue) {
     char buf[PROPERTY_VALUE_MAX] = {
@@ -126,6 +136,18 @@ bool Properties::load() {
 
     defaultRenderAhead = std::max(-1, std::min(2, property_get_int(PROPERTY_RENDERAHEAD,
             render_ahead().value_or(0))));
+    adaptiveRenderAhead = property_get_bool(PROPERTY_ADAPTIVE_RENDER_AHEAD, false);
+
+    parallelPrepareTree = property_get_bool(PROPERTY_PARALLEL_PREPARE_TREE, false);
+    publishPropertyOnlyFrames = property_get_bool(PROPERTY_PUBLISH_PROPERTY_ONLY_FRAMES, false);
+    shaderCacheWarmup = property_get_bool(PROPERTY_SHADER_CACHE_WARMUP, false);
+    parallelVectorDrawables = property_get_bool(PROPERTY_PARALLEL_VECTOR_DRAWABLES, false);
+    adaptiveCacheBudget = property_get_bool(PROPERTY_ADAPTIVE_CACHE_BUDGET, false);
+    textBlobCache = property_get_bool(PROPERTY_TEXT_BLOB_CACHE, false);
+    layerPool = property_get_bool(PROPERTY_LAYER_POOL, false);
+    animatedImagePrefetchFrames =
+            std::max(0, std::min(3, property_get_int(PROPERTY_ANIMATED_IMAGE_PREFETCH, 0)));
+    offThreadLayers = property_get_bool(PROPERTY_OFF_THREAD_LAYERS, false);
 
     return (prevDebugLayersUpdates != debugLayersUpdates) || (prevDebugOverdraw != debugOverdraw);
 }
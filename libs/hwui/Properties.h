@@ -165,6 +165,65 @@ enum DebugLevel {
 
 #define PROPERTY_RENDERAHEAD "debug.hwui.render_ahead"
 
+/**
+ * Setting this to true lets a context without a fixed render ahead depth render one frame ahead
+ * for a while after a slow frame, as long as the buffer queue is not already full.
+ */
+#define PROPERTY_ADAPTIVE_RENDER_AHEAD "debug.hwui.adaptive_render_ahead"
+
+/**
+ * Setting this to true lets prepareTree hand independent RenderNode subtrees to CommonPool.
+ */
+#define PROPERTY_PARALLEL_PREPARE_TREE "debug.hwui.parallel_prepare_tree"
+
+/**
+ * Setting this to true unblocks the UI thread before prepareTree for frames in which it only
+ * changed RenderNode properties.
+ */
+#define PROPERTY_PUBLISH_PROPERTY_ONLY_FRAMES "debug.hwui.publish_property_only_frames"
+
+/**
+ * Setting this to true makes the shader cache rank its entries by use and load the most used
+ * ones into memory off the RenderThread when the GrContext is created.
+ */
+#define PROPERTY_SHADER_CACHE_WARMUP "debug.hwui.shader_cache_warmup"
+
+/**
+ * Setting this to true redraws the caches of dirty VectorDrawables on CommonPool threads before
+ * they are uploaded into the atlas.
+ */
+#define PROPERTY_PARALLEL_VECTOR_DRAWABLES "debug.hwui.parallel_vector_drawables"
+
+/**
+ * Setting this to true lets CacheManager raise the GPU resource cache limit while frames fill it,
+ * and purge the cache back down in small steps once frames stop.
+ */
+#define PROPERTY_ADAPTIVE_CACHE_BUDGET "debug.hwui.adaptive_cache_budget"
+
+/**
+ * Setting this to true makes SkiaCanvas reuse the text blobs of glyph runs it recorded before, so
+ * unchanged labels keep hitting Skia's GPU text blob cache across re-recordings.
+ */
+#define PROPERTY_TEXT_BLOB_CACHE "debug.hwui.text_blob_cache"
+
+/**
+ * Setting this to true keeps the surfaces of destroyed hardware layers in a pool for a few seconds,
+ * for the next layer of the same size to reuse.
+ */
+#define PROPERTY_LAYER_POOL "debug.hwui.layer_pool"
+
+/**
+ * Number of frames, 0 to 3, that the AnimatedImageThread decodes ahead of the one an
+ * AnimatedImageDrawable asks for. 0 only decodes frames on demand.
+ */
+#define PROPERTY_ANIMATED_IMAGE_PREFETCH "debug.hwui.animated_image_prefetch"
+
+/**
+ * Experimental, Vulkan only: records the layers whose subtrees may be drawn from another thread
+ * into deferred display lists on CommonPool, and draws those into the layers in order.
+ */
+#define PROPERTY_OFF_THREAD_LAYERS "debug.hwui.vk_off_thread_layers"
+
 ///////////////////////////////////////////////////////////////////////////////
 // Misc
 ///////////////////////////////////////////////////////////////////////////////
@@ -249,6 +308,18 @@ public:
     ANDROID_API static int contextPriority;
 
     static int defaultRenderAhead;
+    static bool adaptiveRenderAhead;
+
+    static bool parallelPrepareTree;
+
+    static bool publishPropertyOnlyFrames;
+    static bool shaderCacheWarmup;
+    static bool parallelVectorDrawables;
+    static bool adaptiveCacheBudget;
+    static bool textBlobCache;
+    static bool layerPool;
+    static int animatedImagePrefetchFrames;
+    static bool offThreadLayers;
 
 private:
     static ProfileType sProfileType;
@@ -35,27 +35,36 @@ using namespace android::uirenderer::renderthread;
 namespace android {
 namespace uirenderer {
 
-CopyResult Readback::copySurfaceInto(Surface& surface, const Rect& srcRect, SkBitmap* bitmap) {
-    ATRACE_CALL();
-    // Setup the source
-    sp<GraphicBuffer> sourceBuffer;
-    sp<Fence> sourceFence;
-    Matrix4 texTransform;
-    status_t err = surface.getLastQueuedBuffer(&sourceBuffer, &sourceFence, texTransform.data);
-    texTransform.invalidateType();
+static CopyResult getLastQueuedBuffer(Surface& surface, sp<GraphicBuffer>* outBuffer,
+                                      sp<Fence>* outFence, Matrix4* outTransform) {
+    status_t err = surface.getLastQueuedBuffer(outBuffer, outFence, outTransform->data);
+    outTransform->invalidateType();
     if (err != NO_ERROR) {
         ALOGW("Failed to get last queued buffer, error = %d", err);
         return CopyResult::UnknownError;
     }
-    if (!sourceBuffer.get()) {
+    if (!outBuffer->get()) {
         ALOGW("Surface doesn't have any previously queued frames, nothing to readback from");
         return CopyResult::SourceEmpty;
     }
-    if (sourceBuffer->getUsage() & GRALLOC_USAGE_PROTECTED) {
+    if ((*outBuffer)->getUsage() & GRALLOC_USAGE_PROTECTED) {
         ALOGW("Surface is protected, unable to copy from it");
         return CopyResult::SourceInvalid;
     }
-    err = sourceFence->wait(500 /* ms */);
+    return CopyResult::Success;
+}
+
+CopyResult Readback::copySurfaceInto(Surface& surface, const Rect& srcRect, SkBitmap* bitmap) {
+    ATRACE_CALL();
+    // Setup the source
+    sp<GraphicBuffer> sourceBuffer;
+    sp<Fence> sourceFence;
+    Matrix4 texTransform;
+    CopyResult result = getLastQueuedBuffer(surface, &sourceBuffer, &sourceFence, &texTransform);
+    if (result != CopyResult::Success) {
+        return result;
+    }
+    status_t err = sourceFence->wait(500 /* ms */);
     if (err != NO_ERROR) {
         ALOGE("Timeout (500ms) exceeded waiting for buffer fence, abandoning readback attempt");
         return CopyResult::Timeout;
@@ -72,6 +81,81 @@ CopyResult Readback::copySurfaceInto(Surface& surface, const Rect& srcRect, SkBi
     return copyImageInto(image, texTransform, srcRect, bitmap);
 }
 
+CopyResult Readback::copySurfaceIntoBuffer(Surface& surface, const Rect& srcRect,
+                                           const sp<GraphicBuffer>& dstBuffer,
+                                           sp<Fence>* outFence) {
+    ATRACE_CALL();
+    sp<GraphicBuffer> sourceBuffer;
+    sp<Fence> sourceFence;
+    Matrix4 texTransform;
+    CopyResult result = getLastQueuedBuffer(surface, &sourceBuffer, &sourceFence, &texTransform);
+    if (result != CopyResult::Success) {
+        return result;
+    }
+    if (!dstBuffer.get()) {
+        return CopyResult::DestinationInvalid;
+    }
+
+    requireContext();
+    GrContext* grContext = mRenderThread.getGrContext();
+    const bool isGl = Properties::getRenderPipelineType() == RenderPipelineType::SkiaGL;
+    // Have the GPU wait for the producer instead of blocking the RenderThread on it.
+    status_t err = isGl ? mRenderThread.eglManager().fenceWait(sourceFence)
+                        : mRenderThread.vulkanManager().fenceWait(sourceFence, grContext);
+    if (err != NO_ERROR) {
+        ALOGW("Failed to wait on buffer fence, error = %d", err);
+        return CopyResult::UnknownError;
+    }
+
+    sk_sp<SkColorSpace> colorSpace =
+            DataSpaceToColorSpace(static_cast<android_dataspace>(surface.getBuffersDataSpace()));
+    sk_sp<SkImage> image = SkImage::MakeFromAHardwareBuffer(
+            reinterpret_cast<AHardwareBuffer*>(sourceBuffer.get()), kPremul_SkAlphaType,
+            colorSpace);
+    sk_sp<SkSurface> dstSurface = SkSurface::MakeFromAHardwareBuffer(
+            grContext, reinterpret_cast<AHardwareBuffer*>(dstBuffer.get()),
+            kTopLeft_GrSurfaceOrigin, colorSpace, nullptr);
+    if (!image.get()) {
+        return CopyResult::UnknownError;
+    }
+    if (!dstSurface.get()) {
+        ALOGW("Unable to render into the provided buffer");
+        return CopyResult::DestinationInvalid;
+    }
+
+    Layer layer(mRenderThread.renderState(), nullptr, 255, SkBlendMode::kSrc);
+    const SkRect dstRect = SkRect::MakeIWH(dstSurface->width(), dstSurface->height());
+    SkRect layerSrcRect;
+    if (!prepareImageLayer(image, texTransform, srcRect, dstRect, &layer, &layerSrcRect)) {
+        return CopyResult::UnknownError;
+    }
+    if (!skiapipeline::LayerDrawable::DrawLayer(grContext, dstSurface->getCanvas(), &layer,
+                                                &layerSrcRect, &dstRect, false)) {
+        ALOGW("Unable to draw content from GPU into the provided buffer");
+        return CopyResult::UnknownError;
+    }
+    dstSurface->flush();
+
+    sp<Fence> fence;
+    if (isGl) {
+        EGLSyncKHR eglFence = EGL_NO_SYNC_KHR;
+        err = mRenderThread.eglManager().createReleaseFence(false, &eglFence, fence);
+        if (err == NO_ERROR && !fence.get()) {
+            // Without native fences the copy has to finish before the buffer is handed out.
+            mRenderThread.eglManager().fence();
+            fence = Fence::NO_FENCE;
+        }
+    } else {
+        err = mRenderThread.vulkanManager().createReleaseFence(fence, grContext);
+    }
+    if (err != NO_ERROR) {
+        ALOGW("Failed to create a fence for the copy, error = %d", err);
+        return CopyResult::UnknownError;
+    }
+    *outFence = fence.get() ? fence : Fence::NO_FENCE;
+    return CopyResult::Success;
+}
+
 CopyResult Readback::copyHWBitmapInto(Bitmap* hwBitmap, SkBitmap* bitmap) {
     LOG_ALWAYS_FATAL_IF(!hwBitmap->isHardware());
 
@@ -103,19 +187,21 @@ CopyResult Readback::copyLayerInto(DeferredLayerUpdater* deferredLayer, SkBitmap
     return copyResult;
 }
 
-CopyResult Readback::copyImageInto(const sk_sp<SkImage>& image, Matrix4& texTransform,
-                                   const Rect& srcRect, SkBitmap* bitmap) {
-    ATRACE_CALL();
+void Readback::requireContext() {
     if (Properties::getRenderPipelineType() == RenderPipelineType::SkiaGL) {
         mRenderThread.requireGlContext();
     } else {
         mRenderThread.requireVkContext();
     }
+}
+
+CopyResult Readback::copyImageInto(const sk_sp<SkImage>& image, Matrix4& texTransform,
+                                   const Rect& srcRect, SkBitmap* bitmap) {
+    ATRACE_CALL();
+    requireContext();
     if (!image.get()) {
         return CopyResult::UnknownError;
     }
-    int imgWidth = image->width();
-    int imgHeight = image->height();
     sk_sp<GrContext> grContext = sk_ref_sp(mRenderThread.getGrContext());
 
     if (bitmap->colorType() == kRGBA_F16_SkColorType &&
@@ -126,34 +212,45 @@ CopyResult Readback::copyImageInto(const sk_sp<SkImage>& image, Matrix4& texTran
 
     CopyResult copyResult = CopyResult::UnknownError;
 
-    int displayedWidth = imgWidth, displayedHeight = imgHeight;
+    SkRect skiaDestRect = SkRect::MakeWH(bitmap->width(), bitmap->height());
+    SkRect skiaSrcRect;
+    Layer layer(mRenderThread.renderState(), nullptr, 255, SkBlendMode::kSrc);
+    if (!prepareImageLayer(image, texTransform, srcRect, skiaDestRect, &layer, &skiaSrcRect)) {
+        return copyResult;
+    }
+    if (copyLayerInto(&layer, &skiaSrcRect, &skiaDestRect, bitmap)) {
+        copyResult = CopyResult::Success;
+    }
+
+    return copyResult;
+}
+
+bool Readback::prepareImageLayer(const sk_sp<SkImage>& image, Matrix4& texTransform,
+                                 const Rect& srcRect, const SkRect& dstRect, Layer* layer,
+                                 SkRect* outSrcRect) {
+    int displayedWidth = image->width(), displayedHeight = image->height();
     // If this is a 90 or 270 degree rotation we need to swap width/height to get the device
     // size.
     if (texTransform[Matrix4::kSkewX] >= 0.5f || texTransform[Matrix4::kSkewX] <= -0.5f) {
         std::swap(displayedWidth, displayedHeight);
     }
-    SkRect skiaDestRect = SkRect::MakeWH(bitmap->width(), bitmap->height());
     SkRect skiaSrcRect = srcRect.toSkRect();
     if (skiaSrcRect.isEmpty()) {
         skiaSrcRect = SkRect::MakeIWH(displayedWidth, displayedHeight);
     }
     bool srcNotEmpty = skiaSrcRect.intersect(SkRect::MakeIWH(displayedWidth, displayedHeight));
     if (!srcNotEmpty) {
-        return copyResult;
-    }
-
-    Layer layer(mRenderThread.renderState(), nullptr, 255, SkBlendMode::kSrc);
-    bool disableFilter = MathUtils::areEqual(skiaSrcRect.width(), skiaDestRect.width()) &&
-                         MathUtils::areEqual(skiaSrcRect.height(), skiaDestRect.height());
-    layer.setForceFilter(!disableFilter);
-    layer.setSize(displayedWidth, displayedHeight);
-    texTransform.copyTo(layer.getTexTransform());
-    layer.setImage(image);
-    if (copyLayerInto(&layer, &skiaSrcRect, &skiaDestRect, bitmap)) {
-        copyResult = CopyResult::Success;
+        return false;
     }
 
-    return copyResult;
+    bool disableFilter = MathUtils::areEqual(skiaSrcRect.width(), dstRect.width()) &&
+                         MathUtils::areEqual(skiaSrcRect.height(), dstRect.height());
+    layer->setForceFilter(!disableFilter);
+    layer->setSize(displayedWidth, displayedHeight);
+    texTransform.copyTo(layer->getTexTransform());
+    layer->setImage(image);
+    *outSrcRect = skiaSrcRect;
+    return true;
 }
 
 bool Readback::copyLayerInto(Layer* layer, const SkRect* srcRect, const SkRect* dstRect,
@@ -24,6 +24,7 @@
 
 namespace android {
 class Bitmap;
+class Fence;
 class GraphicBuffer;
 class Surface;
 namespace uirenderer {
@@ -49,6 +50,14 @@ public:
      */
     CopyResult copySurfaceInto(Surface& surface, const Rect& srcRect, SkBitmap* bitmap);
 
+    /**
+     * Copies the surface's most recently queued buffer into dstBuffer on the GPU, without reading
+     * the pixels back. Neither the producer's fence nor the copy is waited on by the CPU. On
+     * success outFence is set to a fence that signals once dstBuffer holds the copy.
+     */
+    CopyResult copySurfaceIntoBuffer(Surface& surface, const Rect& srcRect,
+                                     const sp<GraphicBuffer>& dstBuffer, sp<Fence>* outFence);
+
     CopyResult copyHWBitmapInto(Bitmap* hwBitmap, SkBitmap* bitmap);
 
     CopyResult copyLayerInto(DeferredLayerUpdater* layer, SkBitmap* bitmap);
@@ -57,6 +66,13 @@ private:
     CopyResult copyImageInto(const sk_sp<SkImage>& image, Matrix4& texTransform,
                              const Rect& srcRect, SkBitmap* bitmap);
 
+    // Sets up layer to draw image, and computes the part of it to copy into dstRect. Returns
+    // false if that part is empty.
+    bool prepareImageLayer(const sk_sp<SkImage>& image, Matrix4& texTransform, const Rect& srcRect,
+                           const SkRect& dstRect, Layer* layer, SkRect* outSrcRect);
+
+    void requireContext();
+
     bool copyLayerInto(Layer* layer, const SkRect* srcRect, const SkRect* dstRect,
                        SkBitmap* bitmap);
 
@@ -33,6 +33,7 @@
 #include "SkTextBlob.h"
 #include "SkVertices.h"
 
+#include <cstring>
 #include <experimental/type_traits>
 
 namespace android {
@@ -506,9 +507,12 @@ void* DisplayListData::push(size_t pod, Args&&... args) {
     SkASSERT(fUsed + skip <= fReserved);
     auto op = (T*)(fBytes.get() + fUsed);
     fUsed += skip;
+    // Clear the padding too, isSameRecording() compares ops byte for byte.
+    sk_bzero(op, skip);
     new (op) T{std::forward<Args>(args)...};
     op->type = (uint32_t)T::kType;
     op->skip = skip;
+    mCost.ops++;
     return op + 1;
 }
 
@@ -714,6 +718,7 @@ void DisplayListData::reset() {
 
     // Leave fBytes and fReserved alone.
     fUsed = 0;
+    mCost = RecordingCost();
 }
 
 template <class T>
@@ -764,6 +769,82 @@ void DisplayListData::applyColorTransform(ColorTransform transform) {
     this->map(color_transform_fns, transform);
 }
 
+typedef bool (*equal_fn)(const void*, const void*, size_t,
+                         const DisplayListData::DrawableMatcher&);
+
+// Compares the bytes of two ops of the same type but those of one of their members.
+static bool equalExcept(const void* a, const void* b, size_t skip, const void* memberOfA,
+                        size_t memberSize) {
+    const size_t offset = (const uint8_t*)memberOfA - (const uint8_t*)a;
+    const size_t end = offset + memberSize;
+    return !memcmp(a, b, offset) &&
+           !memcmp((const uint8_t*)a + end, (const uint8_t*)b + end, skip - end);
+}
+
+template <class T>
+using has_image_helper = decltype(std::declval<T>().image);
+
+template <class T>
+constexpr bool has_image = std::experimental::is_detected_v<has_image_helper, T>;
+
+template <class T>
+constexpr equal_fn equalForOp() {
+    if
+        constexpr(std::is_same_v<T, DrawDrawable>) {
+            return [](const void* a, const void* b, size_t skip,
+                      const DisplayListData::DrawableMatcher& drawablesMatch) {
+                const T* opA = reinterpret_cast<const T*>(a);
+                const T* opB = reinterpret_cast<const T*>(b);
+                return drawablesMatch(opA->drawable.get(), opB->drawable.get()) &&
+                       equalExcept(a, b, skip, &opA->drawable, sizeof(opA->drawable));
+            };
+        }
+    else if
+        constexpr(has_image<T>) {
+            // Each recording of a bitmap makes a new SkImage, with the same ID while the pixels
+            // are unchanged.
+            return [](const void* a, const void* b, size_t skip,
+                      const DisplayListData::DrawableMatcher&) {
+                const T* opA = reinterpret_cast<const T*>(a);
+                const T* opB = reinterpret_cast<const T*>(b);
+                return opA->image && opB->image &&
+                       opA->image->uniqueID() == opB->image->uniqueID() &&
+                       equalExcept(a, b, skip, &opA->image, sizeof(opA->image));
+            };
+        }
+    else {
+        // Equal bytes mean the same values and the same ref counted objects, which the ops
+        // keep alive and never modify.
+        return [](const void* a, const void* b, size_t skip,
+                  const DisplayListData::DrawableMatcher&) { return !memcmp(a, b, skip); };
+    }
+}
+
+#define X(T) equalForOp<T>(),
+static const equal_fn equal_fns[] = {
+#include "DisplayListOps.in"
+};
+#undef X
+
+bool DisplayListData::isSameRecording(const DisplayListData& other,
+                                      const DrawableMatcher& drawablesMatch) const {
+    if (fUsed != other.fUsed) {
+        return false;
+    }
+    const uint8_t* end = fBytes.get() + fUsed;
+    for (const uint8_t *ptr = fBytes.get(), *otherPtr = other.fBytes.get(); ptr < end;) {
+        auto op = (const Op*)ptr;
+        auto otherOp = (const Op*)otherPtr;
+        if (op->type != otherOp->type || op->skip != otherOp->skip ||
+            !equal_fns[op->type](op, otherOp, op->skip, drawablesMatch)) {
+            return false;
+        }
+        ptr += op->skip;
+        otherPtr += otherOp->skip;
+    }
+    return true;
+}
+
 RecordingCanvas::RecordingCanvas() : INHERITED(1, 1), fDL(nullptr) {}
 
 void RecordingCanvas::reset(DisplayListData* dl, const SkIRect& bounds) {
@@ -773,6 +854,39 @@ void RecordingCanvas::reset(DisplayListData* dl, const SkIRect& bounds) {
     mSaveCount = mComplexSaveCount = 0;
 }
 
+void RecordingCanvas::addDrawCost(const SkRect& bounds, const SkPaint* paint) {
+    SkRect storage;
+    const SkRect* drawBounds = &bounds;
+    if (paint && paint->canComputeFastBounds()) {
+        drawBounds = &paint->computeFastBounds(bounds, &storage);
+    }
+    SkRect deviceBounds;
+    getTotalMatrix().mapRect(&deviceBounds, *drawBounds);
+    if (deviceBounds.intersect(SkRect::Make(getDeviceClipBounds()))) {
+        fDL->mCost.pixels += static_cast<int64_t>(deviceBounds.width() * deviceBounds.height());
+    }
+    if (mClipMayBeComplex) {
+        fDL->mCost.complexClipDraws++;
+    }
+}
+
+void RecordingCanvas::addClipDrawCost() {
+    addDrawCost(getLocalClipBounds());
+}
+
+void RecordingCanvas::addImageCost(const SkImage* image, const SkRect& dst, const SkPaint* paint) {
+    if (!image) {
+        return;
+    }
+    addDrawCost(dst, paint);
+    // Texture backed images are already on the GPU, and the lazily generated ones wrap hardware
+    // buffers in practice.
+    if (!image->isTextureBacked() && !image->isLazyGenerated()) {
+        fDL->mCost.bitmapBytes += static_cast<int64_t>(image->width()) * image->height() *
+                                  SkColorTypeBytesPerPixel(image->colorType());
+    }
+}
+
 sk_sp<SkSurface> RecordingCanvas::onNewSurface(const SkImageInfo&, const SkSurfaceProps&) {
     return nullptr;
 }
@@ -786,6 +900,7 @@ void RecordingCanvas::willSave() {
     fDL->save();
 }
 SkCanvas::SaveLayerStrategy RecordingCanvas::getSaveLayerStrategy(const SaveLayerRec& rec) {
+    fDL->mCost.saveLayers++;
     fDL->saveLayer(rec.fBounds, rec.fPaint, rec.fBackdrop, rec.fClipMask, rec.fClipMatrix,
                    rec.fSaveLayerFlags);
     return SkCanvas::kNoLayer_SaveLayerStrategy;
@@ -842,31 +957,44 @@ void RecordingCanvas::onClipRegion(const SkRegion& region, SkClipOp op) {
 }
 
 void RecordingCanvas::onDrawPaint(const SkPaint& paint) {
+    addClipDrawCost();
     fDL->drawPaint(paint);
 }
 void RecordingCanvas::onDrawBehind(const SkPaint& paint) {
+    addClipDrawCost();
     fDL->drawBehind(paint);
 }
 void RecordingCanvas::onDrawPath(const SkPath& path, const SkPaint& paint) {
+    if (path.isInverseFillType()) {
+        addClipDrawCost();
+    } else {
+        addDrawCost(path.getBounds(), &paint);
+    }
     fDL->drawPath(path, paint);
 }
 void RecordingCanvas::onDrawRect(const SkRect& rect, const SkPaint& paint) {
+    addDrawCost(rect, &paint);
     fDL->drawRect(rect, paint);
 }
 void RecordingCanvas::onDrawRegion(const SkRegion& region, const SkPaint& paint) {
+    addDrawCost(SkRect::Make(region.getBounds()), &paint);
     fDL->drawRegion(region, paint);
 }
 void RecordingCanvas::onDrawOval(const SkRect& oval, const SkPaint& paint) {
+    addDrawCost(oval, &paint);
     fDL->drawOval(oval, paint);
 }
 void RecordingCanvas::onDrawArc(const SkRect& oval, SkScalar startAngle, SkScalar sweepAngle,
                                 bool useCenter, const SkPaint& paint) {
+    addDrawCost(oval, &paint);
     fDL->drawArc(oval, startAngle, sweepAngle, useCenter, paint);
 }
 void RecordingCanvas::onDrawRRect(const SkRRect& rrect, const SkPaint& paint) {
+    addDrawCost(rrect.rect(), &paint);
     fDL->drawRRect(rrect, paint);
 }
 void RecordingCanvas::onDrawDRRect(const SkRRect& out, const SkRRect& in, const SkPaint& paint) {
+    addDrawCost(out.rect(), &paint);
     fDL->drawDRRect(out, in, paint);
 }
 
@@ -883,35 +1011,47 @@ void RecordingCanvas::onDrawAnnotation(const SkRect& rect, const char key[], SkD
 
 void RecordingCanvas::onDrawTextBlob(const SkTextBlob* blob, SkScalar x, SkScalar y,
                                      const SkPaint& paint) {
+    addDrawCost(blob->bounds().makeOffset(x, y), &paint);
     fDL->drawTextBlob(blob, x, y, paint);
 }
 
 void RecordingCanvas::onDrawBitmap(const SkBitmap& bm, SkScalar x, SkScalar y,
                                    const SkPaint* paint) {
-    fDL->drawImage(SkImage::MakeFromBitmap(bm), x, y, paint, BitmapPalette::Unknown);
+    sk_sp<SkImage> image = SkImage::MakeFromBitmap(bm);
+    addImageCost(image.get(), SkRect::MakeXYWH(x, y, bm.width(), bm.height()), paint);
+    fDL->drawImage(std::move(image), x, y, paint, BitmapPalette::Unknown);
 }
 void RecordingCanvas::onDrawBitmapNine(const SkBitmap& bm, const SkIRect& center, const SkRect& dst,
                                        const SkPaint* paint) {
-    fDL->drawImageNine(SkImage::MakeFromBitmap(bm), center, dst, paint);
+    sk_sp<SkImage> image = SkImage::MakeFromBitmap(bm);
+    addImageCost(image.get(), dst, paint);
+    fDL->drawImageNine(std::move(image), center, dst, paint);
 }
 void RecordingCanvas::onDrawBitmapRect(const SkBitmap& bm, const SkRect* src, const SkRect& dst,
                                        const SkPaint* paint, SrcRectConstraint constraint) {
-    fDL->drawImageRect(SkImage::MakeFromBitmap(bm), src, dst, paint, constraint,
-                       BitmapPalette::Unknown);
+    sk_sp<SkImage> image = SkImage::MakeFromBitmap(bm);
+    addImageCost(image.get(), dst, paint);
+    fDL->drawImageRect(std::move(image), src, dst, paint, constraint, BitmapPalette::Unknown);
 }
 void RecordingCanvas::onDrawBitmapLattice(const SkBitmap& bm, const SkCanvas::Lattice& lattice,
                                           const SkRect& dst, const SkPaint* paint) {
-    fDL->drawImageLattice(SkImage::MakeFromBitmap(bm), lattice, dst, paint, BitmapPalette::Unknown);
+    sk_sp<SkImage> image = SkImage::MakeFromBitmap(bm);
+    addImageCost(image.get(), dst, paint);
+    fDL->drawImageLattice(std::move(image), lattice, dst, paint, BitmapPalette::Unknown);
 }
 
 void RecordingCanvas::drawImage(const sk_sp<SkImage>& image, SkScalar x, SkScalar y,
                                 const SkPaint* paint, BitmapPalette palette) {
+    if (image) {
+        addImageCost(image.get(), SkRect::MakeXYWH(x, y, image->width(), image->height()), paint);
+    }
     fDL->drawImage(image, x, y, paint, palette);
 }
 
 void RecordingCanvas::drawImageRect(const sk_sp<SkImage>& image, const SkRect& src,
                                     const SkRect& dst, const SkPaint* paint,
                                     SrcRectConstraint constraint, BitmapPalette palette) {
+    addImageCost(image.get(), dst, paint);
     fDL->drawImageRect(image, &src, dst, paint, constraint, palette);
 }
 
@@ -929,6 +1069,7 @@ void RecordingCanvas::drawImageLattice(const sk_sp<SkImage>& image, const Lattic
         latticePlusBounds.fBounds = &bounds;
     }
 
+    addImageCost(image.get(), dst, paint);
     if (SkLatticeIter::Valid(image->width(), image->height(), latticePlusBounds)) {
         fDL->drawImageLattice(image, latticePlusBounds, dst, paint, palette);
     } else {
@@ -939,18 +1080,24 @@ void RecordingCanvas::drawImageLattice(const sk_sp<SkImage>& image, const Lattic
 
 void RecordingCanvas::onDrawImage(const SkImage* img, SkScalar x, SkScalar y,
                                   const SkPaint* paint) {
+    if (img) {
+        addImageCost(img, SkRect::MakeXYWH(x, y, img->width(), img->height()), paint);
+    }
     fDL->drawImage(sk_ref_sp(img), x, y, paint, BitmapPalette::Unknown);
 }
 void RecordingCanvas::onDrawImageNine(const SkImage* img, const SkIRect& center, const SkRect& dst,
                                       const SkPaint* paint) {
+    addImageCost(img, dst, paint);
     fDL->drawImageNine(sk_ref_sp(img), center, dst, paint);
 }
 void RecordingCanvas::onDrawImageRect(const SkImage* img, const SkRect* src, const SkRect& dst,
                                       const SkPaint* paint, SrcRectConstraint constraint) {
+    addImageCost(img, dst, paint);
     fDL->drawImageRect(sk_ref_sp(img), src, dst, paint, constraint, BitmapPalette::Unknown);
 }
 void RecordingCanvas::onDrawImageLattice(const SkImage* img, const SkCanvas::Lattice& lattice,
                                          const SkRect& dst, const SkPaint* paint) {
+    addImageCost(img, dst, paint);
     fDL->drawImageLattice(sk_ref_sp(img), lattice, dst, paint, BitmapPalette::Unknown);
 }
 
@@ -966,6 +1113,7 @@ void RecordingCanvas::onDrawPoints(SkCanvas::PointMode mode, size_t count, const
 void RecordingCanvas::onDrawVerticesObject(const SkVertices* vertices,
                                            const SkVertices::Bone bones[], int boneCount,
                                            SkBlendMode mode, const SkPaint& paint) {
+    addDrawCost(vertices->bounds(), &paint);
     fDL->drawVertices(vertices, bones, boneCount, mode, paint);
 }
 void RecordingCanvas::onDrawAtlas(const SkImage* atlas, const SkRSXform xforms[],
@@ -17,6 +17,7 @@
 #pragma once
 
 #include "CanvasTransform.h"
+#include "RecordingCost.h"
 #include "hwui/Bitmap.h"
 #include "hwui/Canvas.h"
 #include "utils/Macros.h"
@@ -32,6 +33,7 @@
 #include "SkTDArray.h"
 #include "SkTemplates.h"
 
+#include <functional>
 #include <vector>
 
 namespace android {
@@ -66,6 +68,19 @@ public:
 
     bool hasText() const { return mHasText; }
     size_t usedSize() const { return fUsed; }
+    const RecordingCost& cost() const { return mCost; }
+
+    // Asked about each pair of drawables the two lists draw at the same point, as the ones
+    // owned by a list (e.g. child RenderNodes) are never the same objects.
+    using DrawableMatcher = std::function<bool(SkDrawable*, SkDrawable*)>;
+
+    /**
+     * Returns true if other records the same ops with the same arguments. Shared immutable
+     * objects (paths, text blobs, pictures...) must be the same objects, images must have the
+     * same unique ID. May return false for lists that would draw the same.
+     */
+    bool isSameRecording(const DisplayListData& other,
+                         const DrawableMatcher& drawablesMatch) const;
 
 private:
     friend class RecordingCanvas;
@@ -131,6 +146,8 @@ private:
     size_t fUsed = 0;
     size_t fReserved = 0;
 
+    RecordingCost mCost;
+
     bool mHasText : 1;
 };
 
@@ -221,6 +238,13 @@ private:
         }
     }
 
+    // Adds a draw covering bounds, in local coordinates, to the cost of the list.
+    void addDrawCost(const SkRect& bounds, const SkPaint* paint = nullptr);
+    // Adds a draw covering the whole clip.
+    void addClipDrawCost();
+    // Adds a draw of image into dst, and the bytes of image if it has to be uploaded.
+    void addImageCost(const SkImage* image, const SkRect& dst, const SkPaint* paint);
+
     DisplayListData* fDL;
 
     /**
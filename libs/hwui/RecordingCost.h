@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+namespace android {
+namespace uirenderer {
+
+/**
+ * Rough cost of drawing a display list, estimated by RecordingCanvas while it is recorded. Only
+ * the list's own ops are counted: the child RenderNodes and other drawables it draws are not.
+ */
+struct RecordingCost {
+    // Device pixels touched, each draw counted separately once clipped to the clip bounds.
+    int64_t pixels = 0;
+    uint32_t saveLayers = 0;
+    // Draws made while the clip may not be a rectangle, see RecordingCanvas::isClipMayBeComplex.
+    uint32_t complexClipDraws = 0;
+    // Bytes of the raster images drawn, the most that may have to be uploaded to draw the list.
+    int64_t bitmapBytes = 0;
+    uint32_t ops = 0;
+
+    RecordingCost& operator+=(const RecordingCost& other) {
+        pixels += other.pixels;
+        saveLayers += other.saveLayers;
+        complexClipDraws += other.complexClipDraws;
+        bitmapBytes += other.bitmapBytes;
+        ops += other.ops;
+        return *this;
+    }
+};
+
+}  // namespace uirenderer
+}  // namespace android
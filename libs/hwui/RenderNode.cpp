@@ -22,6 +22,7 @@
 #include "VectorDrawable.h"
 #include "renderstate/RenderState.h"
 #include "renderthread/CanvasContext.h"
+#include "thread/CommonPool.h"
 #include "utils/FatVector.h"
 #include "utils/MathUtils.h"
 #include "utils/StringUtils.h"
@@ -30,6 +31,7 @@
 #include <SkPathOps.h>
 #include <algorithm>
 #include <atomic>
+#include <future>
 #include <sstream>
 #include <string>
 
@@ -48,6 +50,37 @@ private:
     TreeInfo* mTreeInfo;
 };
 
+// Holds on to the nodes reported while a subtree is prepared on CommonPool, until the RenderThread
+// passes them on to its own observer in tree order.
+class DeferredRemoved : public TreeObserver {
+public:
+    void onMaybeRemovedFromTree(RenderNode* node) override { mMarked.emplace_back(node); }
+
+    void replay(TreeObserver& observer) {
+        for (auto& node : mMarked) {
+            observer.onMaybeRemovedFromTree(node.get());
+        }
+        mMarked.clear();
+    }
+
+private:
+    std::vector<sp<RenderNode>> mMarked;
+};
+
+// A node needs this many children before its subtrees are considered for CommonPool.
+static constexpr size_t kMinOffThreadChildren = 3;
+// Smaller subtrees aren't worth the round trip to a worker.
+static constexpr int kMinOffThreadSubtreeSize = 16;
+// Leaves room in the CommonPool queue for everything else.
+static constexpr size_t kMaxOffThreadJobs = CommonPool::QUEUE_SIZE / 2;
+
+static void updateCostliestNode(TreeInfo::Out& out, RenderNode* node, const RecordingCost& cost) {
+    if (!out.costliestNode || cost.pixels > out.costliestNodeCost.pixels) {
+        out.costliestNode = node;
+        out.costliestNodeCost = cost;
+    }
+}
+
 static int64_t generateId() {
     static std::atomic<int64_t> sNextId{1};
     return sNextId++;
@@ -124,6 +157,44 @@ void RenderNode::prepareTree(TreeInfo& info) {
     LOG_ALWAYS_FATAL_IF(before != info.disableForceDark, "Mis-matched force dark");
 }
 
+uint64_t RenderNode::publishPropertyOnlyChanges(RenderNode* root) {
+    ATRACE_CALL();
+    std::vector<RenderNode*> changedNodes;
+    if (!root->collectPropertyOnlyChanges(&changedNodes)) {
+        return 0;
+    }
+    static std::atomic<uint64_t> sNextEpoch{1};
+    const uint64_t epoch = sNextEpoch++;
+    for (RenderNode* node : changedNodes) {
+        if (!node->mPublishedProperties) {
+            node->mPublishedProperties = std::make_unique<RenderProperties>();
+        }
+        *node->mPublishedProperties = node->mStagingProperties;
+        node->mPublishedEpoch = epoch;
+        node->mDirtyPropertyFields = 0;
+    }
+    return epoch;
+}
+
+bool RenderNode::collectPropertyOnlyChanges(std::vector<RenderNode*>* changedNodes) {
+    // Display list syncs change the tree and run TreeObserver callbacks, animators and position
+    // listeners are pushed from staging state. None of that can happen with the UI thread running.
+    if (mNeedsDisplayListSync || mPositionListenerDirty || mAnimatorManager.hasAnyAnimators()) {
+        return false;
+    }
+    if (mDirtyPropertyFields) {
+        changedNodes->push_back(this);
+    }
+    if (mDisplayList) {
+        for (auto& child : mDisplayList->mChildNodes) {
+            if (!child.getRenderNode()->collectPropertyOnlyChanges(changedNodes)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
 void RenderNode::addAnimator(const sp<BaseRenderNodeAnimator>& animator) {
     mAnimatorManager.addAnimator(animator);
 }
@@ -168,7 +239,7 @@ void RenderNode::pushLayerUpdate(TreeInfo& info) {
         CC_UNLIKELY(properties().getWidth() == 0) || CC_UNLIKELY(properties().getHeight() == 0) ||
         CC_UNLIKELY(!properties().fitsOnLayer())) {
         if (CC_UNLIKELY(hasLayer())) {
-            this->setLayerSurface(nullptr);
+            info.canvasContext.recycleLayer(this);
         }
         return;
     }
@@ -222,7 +293,7 @@ void RenderNode::prepareTreeImpl(TreeObserver& observer, TreeInfo& info, bool fu
     }
 
     bool willHaveFunctor = false;
-    if (info.mode == TreeInfo::MODE_FULL && mStagingDisplayList) {
+    if (info.mode == TreeInfo::MODE_FULL && !info.publishedEpoch && mStagingDisplayList) {
         willHaveFunctor = mStagingDisplayList->hasFunctor();
     } else if (mDisplayList) {
         willHaveFunctor = mDisplayList->hasFunctor();
@@ -235,17 +306,28 @@ void RenderNode::prepareTreeImpl(TreeObserver& observer, TreeInfo& info, bool fu
     }
 
     prepareLayer(info, animatorDirtyMask);
-    if (info.mode == TreeInfo::MODE_FULL) {
+    if (info.mode == TreeInfo::MODE_FULL && !info.publishedEpoch) {
         pushStagingDisplayListChanges(observer, info);
     }
 
     if (mDisplayList) {
         info.out.hasFunctors |= mDisplayList->hasFunctor();
+        const RecordingCost& cost = mDisplayList->getRecordingCost();
+        info.out.recordingCost += cost;
+        updateCostliestNode(info.out, this, cost);
+        std::unique_ptr<OffThreadPrepare> offThread;
+        if (CC_UNLIKELY(Properties::parallelPrepareTree) && !info.offThreadPrepareAttempted &&
+            mDisplayList->mChildNodes.size() >= kMinOffThreadChildren) {
+            info.offThreadPrepareAttempted = true;
+            offThread = startOffThreadPrepare(info, childFunctorsNeedLayer);
+        }
         bool isDirty = mDisplayList->prepareListAndChildren(
                 observer, info, childFunctorsNeedLayer,
-                [](RenderNode* child, TreeObserver& observer, TreeInfo& info,
-                   bool functorsNeedLayer) {
-                    child->prepareTreeImpl(observer, info, functorsNeedLayer);
+                [&offThread](RenderNode* child, TreeObserver& observer, TreeInfo& info,
+                             bool functorsNeedLayer) {
+                    if (!offThread || !offThread->finish(child, observer, info)) {
+                        child->prepareTreeImpl(observer, info, functorsNeedLayer);
+                    }
                 });
         if (isDirty) {
             damageSelf(info);
@@ -259,11 +341,218 @@ void RenderNode::prepareTreeImpl(TreeObserver& observer, TreeInfo& info, bool fu
     info.damageAccumulator->popTransform();
 }
 
+/**
+ * The subtrees of one node's children that are prepared on CommonPool while the RenderThread
+ * prepares the other children. Each gets its own TreeInfo, DamageAccumulator and TreeObserver;
+ * when prepareListAndChildren() reaches the child, finish() waits for it and applies the results
+ * to the RenderThread's TreeInfo, so everything ordered (damage into the parent's frame, observer
+ * callbacks) still happens in tree order.
+ */
+struct RenderNode::OffThreadPrepare {
+    struct Job {
+        Job(RenderNode* node, TreeInfo& parentInfo)
+                : node(node), info(parentInfo.mode, parentInfo.canvasContext) {}
+
+        sp<RenderNode> node;
+        DamageAccumulator damageAccumulator;
+        TreeInfo info;
+        DeferredRemoved observer;
+        std::future<void> done;
+        bool finished = false;
+    };
+
+    ~OffThreadPrepare() {
+        for (auto& job : jobs) {
+            if (!job->finished) {
+                job->done.wait();
+            }
+        }
+    }
+
+    void start(RenderNode* node, TreeInfo& info, bool functorsNeedLayer) {
+        auto job = std::make_unique<Job>(node, info);
+        TreeInfo& jobInfo = job->info;
+        jobInfo.prepareTextures = info.prepareTextures;
+        jobInfo.runAnimations = info.runAnimations;
+        jobInfo.damageAccumulator = &job->damageAccumulator;
+        jobInfo.damageGenerationId = info.damageGenerationId;
+        // Layers keep a subtree on the RenderThread, so there is nothing to queue.
+        jobInfo.layerUpdateQueue = nullptr;
+        jobInfo.errorHandler = info.errorHandler;
+        jobInfo.updateWindowPositions = info.updateWindowPositions;
+        jobInfo.disableForceDark = info.disableForceDark;
+        jobInfo.offThreadPrepareAttempted = true;
+        jobInfo.publishedEpoch = info.publishedEpoch;
+
+        Job* rawJob = job.get();
+        job->done = CommonPool::async([rawJob, functorsNeedLayer]() {
+            ATRACE_NAME("prepareTree subtree");
+            rawJob->node->prepareTreeImpl(rawJob->observer, rawJob->info, functorsNeedLayer);
+        });
+        jobs.push_back(std::move(job));
+    }
+
+    // Returns false if child isn't prepared here.
+    bool finish(RenderNode* child, TreeObserver& observer, TreeInfo& info) {
+        for (auto& job : jobs) {
+            if (job->node.get() != child || job->finished) {
+                continue;
+            }
+            job->done.wait();
+            job->finished = true;
+
+            // The subtree's damage ends up in the root frame of its accumulator, in the same
+            // space as the frame prepareListAndChildren() pushed for the child.
+            SkRect dirty;
+            job->damageAccumulator.peekAtDirty(&dirty);
+            if (!dirty.isEmpty()) {
+                info.damageAccumulator->dirty(dirty.fLeft, dirty.fTop, dirty.fRight,
+                                              dirty.fBottom);
+            }
+            job->observer.replay(observer);
+
+            const TreeInfo::Out& out = job->info.out;
+            info.out.hasFunctors |= out.hasFunctors;
+            info.out.hasAnimations |= out.hasAnimations;
+            info.out.requiresUiRedraw |= out.requiresUiRedraw;
+            info.out.recordingCost += out.recordingCost;
+            if (out.costliestNode) {
+                updateCostliestNode(info.out, out.costliestNode, out.costliestNodeCost);
+            }
+            if (out.animatedImageDelay != TreeInfo::Out::kNoAnimatedImageDelay &&
+                (info.out.animatedImageDelay == TreeInfo::Out::kNoAnimatedImageDelay ||
+                 out.animatedImageDelay < info.out.animatedImageDelay)) {
+                info.out.animatedImageDelay = out.animatedImageDelay;
+            }
+            info.hasBackwardProjectedNodes = job->info.hasBackwardProjectedNodes;
+            return true;
+        }
+        return false;
+    }
+
+    std::vector<std::unique_ptr<Job>> jobs;
+};
+
+/**
+ * Walks every child subtree once to find the ones that can be prepared on CommonPool: no node in
+ * them talks to the CanvasContext, the UI thread or the JNI layer while being prepared, and no
+ * node is reachable from another child, which could be prepared concurrently. The RenderThread
+ * prepares the first of them itself; the others are started here.
+ */
+std::unique_ptr<RenderNode::OffThreadPrepare> RenderNode::startOffThreadPrepare(
+        TreeInfo& info, bool functorsNeedLayer) {
+    ATRACE_CALL();
+    static std::atomic<int64_t> sNextVisitId{1};
+    const int64_t visitId = sNextVisitId++;
+    const auto& children = mDisplayList->mChildNodes;
+    std::vector<bool> eligible(children.size(), true);
+    std::vector<int> nodeCounts(children.size(), 0);
+    for (size_t i = 0; i < children.size(); i++) {
+        children[i].getRenderNode()->checkOffThreadSubtree(visitId, i, info.publishedEpoch,
+                                                           &eligible, &nodeCounts[i]);
+    }
+
+    auto prepare = std::make_unique<OffThreadPrepare>();
+    bool keptOne = false;
+    for (size_t i = 0; i < children.size() && prepare->jobs.size() < kMaxOffThreadJobs; i++) {
+        if (!eligible[i] || nodeCounts[i] < kMinOffThreadSubtreeSize) {
+            continue;
+        }
+        if (!keptOne) {
+            keptOne = true;
+            continue;
+        }
+        prepare->start(children[i].getRenderNode(), info, functorsNeedLayer);
+    }
+    if (prepare->jobs.empty()) {
+        return nullptr;
+    }
+    return prepare;
+}
+
+void RenderNode::checkOffThreadSubtree(int64_t visitId, int childIndex, uint64_t publishedEpoch,
+                                       std::vector<bool>* eligible, int* nodeCount) {
+    if (mOffThreadVisitId == visitId) {
+        if (mOffThreadVisitChild != childIndex) {
+            (*eligible)[mOffThreadVisitChild] = false;
+            (*eligible)[childIndex] = false;
+        }
+        return;
+    }
+    mOffThreadVisitId = visitId;
+    mOffThreadVisitChild = childIndex;
+    (*nodeCount)++;
+    if (!canPrepareOffThread(publishedEpoch)) {
+        (*eligible)[childIndex] = false;
+    }
+
+    // Both the current and the staging children, as prepareTreeImpl() touches both on a sync.
+    if (mDisplayList) {
+        for (auto& child : mDisplayList->mChildNodes) {
+            child.getRenderNode()->checkOffThreadSubtree(visitId, childIndex, publishedEpoch,
+                                                         eligible, nodeCount);
+        }
+    }
+    if (!publishedEpoch && mNeedsDisplayListSync && mStagingDisplayList) {
+        for (auto& child : mStagingDisplayList->mChildNodes) {
+            child.getRenderNode()->checkOffThreadSubtree(visitId, childIndex, publishedEpoch,
+                                                         eligible, nodeCount);
+        }
+    }
+}
+
+bool RenderNode::canPrepareOffThread(uint64_t publishedEpoch) const {
+    // More than one parent means the node may be prepared twice in the same traversal.
+    if (mParentCount > 1) {
+        return false;
+    }
+    if (publishedEpoch) {
+        // The staging state belongs to the UI thread again, and publishPropertyOnlyChanges()
+        // made sure there are no animators, position listener changes or display list syncs.
+        const RenderProperties& next =
+                mPublishedEpoch == publishedEpoch ? *mPublishedProperties : mProperties;
+        if (mPositionListener || hasLayer() ||
+            mProperties.effectiveLayerType() == LayerType::RenderLayer ||
+            next.effectiveLayerType() == LayerType::RenderLayer ||
+            mProperties.getProjectBackwards() || next.getProjectBackwards()) {
+            return false;
+        }
+        return !mDisplayList || mDisplayList->canPrepareOffThread();
+    }
+    // Position listeners call into Java, animators into the AnimationContext, and layers into
+    // the CanvasContext and LayerUpdateQueue.
+    if (mPositionListener || mStagingPositionListener || mPositionListenerDirty ||
+        mAnimatorManager.hasAnyAnimators()) {
+        return false;
+    }
+    if (hasLayer() || mProperties.effectiveLayerType() == LayerType::RenderLayer ||
+        mStagingProperties.effectiveLayerType() == LayerType::RenderLayer) {
+        return false;
+    }
+    // Projected damage goes to a receiver above the subtree.
+    if (mProperties.getProjectBackwards() || mStagingProperties.getProjectBackwards()) {
+        return false;
+    }
+    if (mDisplayList && !mDisplayList->canPrepareOffThread()) {
+        return false;
+    }
+    return !mNeedsDisplayListSync || !mStagingDisplayList ||
+           mStagingDisplayList->canPrepareOffThread();
+}
+
 void RenderNode::syncProperties() {
     mProperties = mStagingProperties;
 }
 
 void RenderNode::pushStagingPropertiesChanges(TreeInfo& info) {
+    if (CC_UNLIKELY(info.publishedEpoch)) {
+        // Only the properties can have changed, see publishPropertyOnlyChanges().
+        if (mPublishedEpoch == info.publishedEpoch) {
+            syncPropertiesWithDamage(info, *mPublishedProperties);
+        }
+        return;
+    }
+
     if (mPositionListenerDirty) {
         mPositionListener = std::move(mStagingPositionListener);
         mStagingPositionListener = nullptr;
@@ -278,19 +567,23 @@ void RenderNode::pushStagingPropertiesChanges(TreeInfo& info) {
     }
     if (mDirtyPropertyFields) {
         mDirtyPropertyFields = 0;
-        damageSelf(info);
-        info.damageAccumulator->popTransform();
-        syncProperties();
-        // We could try to be clever and only re-damage if the matrix changed.
-        // However, we don't need to worry about that. The cost of over-damaging
-        // here is only going to be a single additional map rect of this node
-        // plus a rect join(). The parent's transform (and up) will only be
-        // performed once.
-        info.damageAccumulator->pushTransform(this);
-        damageSelf(info);
+        syncPropertiesWithDamage(info, mStagingProperties);
     }
 }
 
+void RenderNode::syncPropertiesWithDamage(TreeInfo& info, const RenderProperties& properties) {
+    damageSelf(info);
+    info.damageAccumulator->popTransform();
+    mProperties = properties;
+    // We could try to be clever and only re-damage if the matrix changed.
+    // However, we don't need to worry about that. The cost of over-damaging
+    // here is only going to be a single additional map rect of this node
+    // plus a rect join(). The parent's transform (and up) will only be
+    // performed once.
+    info.damageAccumulator->pushTransform(this);
+    damageSelf(info);
+}
+
 void RenderNode::syncDisplayList(TreeObserver& observer, TreeInfo* info) {
     // Make sure we inc first so that we don't fluctuate between 0 and 1,
     // which would thrash the layer cache
@@ -349,6 +642,16 @@ void RenderNode::handleForceDark(android::uirenderer::TreeInfo *info) {
 void RenderNode::pushStagingDisplayListChanges(TreeObserver& observer, TreeInfo& info) {
     if (mNeedsDisplayListSync) {
         mNeedsDisplayListSync = false;
+        if (mDisplayList && mStagingDisplayList &&
+            mStagingDisplayList->isSameRecording(*mDisplayList)) {
+            // Re-recorded without changes: keep the synced list, which needs no damage or
+            // prepare work, and recycle the new one.
+            if (!mStagingDisplayList->reuseDisplayList(this, &info.canvasContext)) {
+                delete mStagingDisplayList;
+            }
+            mStagingDisplayList = nullptr;
+            return;
+        }
         // Damage with the old display list first then the new one to catch any
         // changes in isRenderable or, in the future, bounds
         damageSelf(info);
@@ -467,6 +770,44 @@ const SkPath* RenderNode::getClippedOutline(const SkRect& clipRect) const {
     return &mClippedOutlineCache.clippedOutline;
 }
 
+bool RenderNode::canDrawContentOffThread() const {
+    if (!mDisplayList) {
+        return true;
+    }
+    if (!mDisplayList->canDrawOffThread()) {
+        return false;
+    }
+    for (const auto& child : mDisplayList->mChildNodes) {
+        const RenderNode* node = child.getRenderNode();
+        const RenderProperties& properties = node->properties();
+        // Shadows read SkiaPipeline's light center, which the RenderThread moves into the space
+        // of each layer it draws.
+        if (node->mParentCount > 1 || node->hasLayer() ||
+            properties.effectiveLayerType() == LayerType::RenderLayer ||
+            properties.getProjectBackwards() || properties.getZ() != 0 ||
+            !node->canDrawContentOffThread()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const SkPath* RenderNode::getRevealedOutline(const SkPath& casterPath,
+                                             const SkPath& revealClipPath) const {
+    const uint32_t casterID = casterPath.getGenerationID();
+    const uint32_t revealID = revealClipPath.getGenerationID();
+
+    if (casterID != mRevealedOutlineCache.casterID ||
+        revealID != mRevealedOutlineCache.revealID) {
+        mRevealedOutlineCache.casterID = casterID;
+        mRevealedOutlineCache.revealID = revealID;
+
+        Op(casterPath, revealClipPath, kIntersect_SkPathOp,
+           &mRevealedOutlineCache.revealedOutline);
+    }
+    return &mRevealedOutlineCache.revealedOutline;
+}
+
 using StringBuffer = FatVector<char, 128>;
 
 template <typename... T>
@@ -37,6 +37,7 @@
 #include "pipeline/skia/SkiaLayer.h"
 #include "utils/FatVector.h"
 
+#include <memory>
 #include <vector>
 
 class SkBitmap;
@@ -148,6 +149,13 @@ public:
     int getHeight() const { return properties().getHeight(); }
 
     ANDROID_API virtual void prepareTree(TreeInfo& info);
+
+    // Called on the RenderThread while the UI thread is blocked on a sync. If the UI thread
+    // changed nothing in the tree under root but staging properties, copies the changed ones
+    // aside and returns the epoch they were published under. A MODE_FULL prepareTree() with
+    // that epoch in TreeInfo::publishedEpoch syncs from the copies and leaves all staging state
+    // alone, so it may run after the UI thread is unblocked. Otherwise returns 0.
+    static uint64_t publishPropertyOnlyChanges(RenderNode* root);
     void destroyHardwareResources(TreeInfo* info = nullptr);
     void destroyLayers();
 
@@ -226,7 +234,20 @@ private:
     void handleForceDark(TreeInfo* info);
 
     void prepareTreeImpl(TreeObserver& observer, TreeInfo& info, bool functorsNeedLayer);
+
+    // Child subtrees of mDisplayList being prepared on CommonPool, see prepareTreeImpl.
+    struct OffThreadPrepare;
+    std::unique_ptr<OffThreadPrepare> startOffThreadPrepare(TreeInfo& info,
+                                                            bool functorsNeedLayer);
+    // Marks this subtree as reached from the given child of the node starting the off thread
+    // prepare, clearing eligible for that child if the subtree needs the RenderThread and for
+    // both children if it is reached from another child too.
+    void checkOffThreadSubtree(int64_t visitId, int childIndex, uint64_t publishedEpoch,
+                               std::vector<bool>* eligible, int* nodeCount);
+    bool canPrepareOffThread(uint64_t publishedEpoch) const;
+    bool collectPropertyOnlyChanges(std::vector<RenderNode*>* changedNodes);
     void pushStagingPropertiesChanges(TreeInfo& info);
+    void syncPropertiesWithDamage(TreeInfo& info, const RenderProperties& properties);
     void pushStagingDisplayListChanges(TreeObserver& observer, TreeInfo& info);
     void prepareLayer(TreeInfo& info, uint32_t dirtyMask);
     void pushLayerUpdate(TreeInfo& info);
@@ -243,6 +264,10 @@ private:
     uint32_t mDirtyPropertyFields;
     RenderProperties mProperties;
     RenderProperties mStagingProperties;
+    // The staging properties as published for the sync of mPublishedEpoch, only allocated for
+    // nodes that were changed in a property-only frame.
+    std::unique_ptr<RenderProperties> mPublishedProperties;
+    uint64_t mPublishedEpoch = 0;
 
     // Owned by UI. Set when DL is set, cleared when DL cleared or when node detached
     // (likely by parent re-record/removal)
@@ -279,6 +304,10 @@ private:
 
     UsageHint mUsageHint = UsageHint::Unknown;
 
+    // Last checkOffThreadSubtree() walk that reached this node, and from which child.
+    int64_t mOffThreadVisitId = 0;
+    int mOffThreadVisitChild = -1;
+
     // METHODS & FIELDS ONLY USED BY THE SKIA RENDERER
 public:
     /**
@@ -345,6 +374,22 @@ public:
      */
     const SkPath* getClippedOutline(const SkRect& clipRect) const;
 
+    /**
+     * Returns true if drawing the content of this node only reads its subtree, so that it may be
+     * recorded off the RenderThread while nothing else touches the subtree: the descendants have
+     * one parent, no layer, no Z and are not projected, and no display list needs the
+     * RenderThread, see SkiaDisplayList::canDrawOffThread().
+     */
+    bool canDrawContentOffThread() const;
+
+    /**
+     * Returns casterPath, the outline of this RenderNode or its clipped outline, intersected
+     * with revealClipPath. Cached like getClippedOutline(), keyed on the generation IDs of both
+     * paths, so the shadow of an unchanged caster reuses the same path across frames.
+     */
+    const SkPath* getRevealedOutline(const SkPath& casterPath,
+                                     const SkPath& revealClipPath) const;
+
 private:
     /**
      * If this RenderNode has been used in a previous frame then the SkiaDisplayList
@@ -370,6 +415,16 @@ private:
         SkPath clippedOutline;
     };
     mutable ClippedOutlineCache mClippedOutlineCache;
+
+    struct RevealedOutlineCache {
+        // keys
+        uint32_t casterID = 0;
+        uint32_t revealID = 0;
+
+        // value
+        SkPath revealedOutline;
+    };
+    mutable RevealedOutlineCache mRevealedOutlineCache;
 };  // class RenderNode
 
 class MarkAndSweepRemoved : public TreeObserver {
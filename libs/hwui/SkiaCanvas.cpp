@@ -18,11 +18,14 @@
 
 #include "CanvasProperty.h"
 #include "NinePatchUtils.h"
+#include "Properties.h"
 #include "VectorDrawable.h"
 #include "hwui/Bitmap.h"
 #include "hwui/MinikinUtils.h"
 #include "hwui/PaintFilter.h"
+#include "hwui/TextBlobCache.h"
 #include "pipeline/skia/AnimatedDrawables.h"
+#include "utils/FatVector.h"
 
 #include <SkAndroidFrameworkUtils.h>
 #include <SkAnimatedImage.h>
@@ -707,11 +710,18 @@ void SkiaCanvas::drawGlyphs(ReadGlyphFunc glyphFunc, int count, const Paint& pai
         paintCopy.setStyle(SkPaint::kFill_Style);
     }
 
-    SkTextBlobBuilder builder;
-    const SkTextBlobBuilder::RunBuffer& buffer = builder.allocRunPos(font, count);
-    glyphFunc(buffer.glyphs, buffer.pos);
-
-    sk_sp<SkTextBlob> textBlob(builder.make());
+    sk_sp<SkTextBlob> textBlob;
+    if (Properties::textBlobCache && count <= TextBlobCache::kMaxGlyphs) {
+        uirenderer::FatVector<uint16_t, 64> glyphs(count);
+        uirenderer::FatVector<float, 128> positions(count * 2);
+        glyphFunc(glyphs.data(), positions.data());
+        textBlob = TextBlobCache::get().getOrCreate(font, glyphs.data(), positions.data(), count);
+    } else {
+        SkTextBlobBuilder builder;
+        const SkTextBlobBuilder::RunBuffer& buffer = builder.allocRunPos(font, count);
+        glyphFunc(buffer.glyphs, buffer.pos);
+        textBlob = builder.make();
+    }
     mCanvas->drawTextBlob(textBlob, 0, 0, paintCopy);
     drawTextDecorations(x, y, totalAdvance, paintCopy);
 }
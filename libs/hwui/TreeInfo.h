@@ -17,6 +17,7 @@
 #pragma once
 
 #include "Properties.h"
+#include "RecordingCost.h"
 #include "utils/Macros.h"
 
 #include <utils/Timers.h>
@@ -64,7 +65,7 @@ public:
     enum TraversalMode {
         // The full monty - sync, push, run animators, etc... Used by DrawFrameTask
         // May only be used if both the UI thread and RT thread are blocked on the
-        // prepare
+        // prepare, unless publishedEpoch is set
         MODE_FULL,
         // Run only what can be done safely on RT thread. Currently this only means
         // animators, but potentially things like SurfaceTexture updates
@@ -120,11 +121,27 @@ public:
         // This is used to post a message to redraw when it is time to draw the
         // next frame of an AnimatedImageDrawable.
         nsecs_t animatedImageDelay = kNoAnimatedImageDelay;
+        // Summed over the display lists of the nodes traversed.
+        RecordingCost recordingCost;
+        // The node whose own display list touches the most pixels, and that list's cost.
+        RenderNode* costliestNode = nullptr;
+        RecordingCost costliestNodeCost;
+        // Time spent running the animators of the traversed nodes.
+        nsecs_t animationTime = 0;
     } out;
 
     // This flag helps to disable projection for receiver nodes that do not have any backward
     // projected children.
     bool hasBackwardProjectedNodes = false;
+
+    // Set once the traversal has tried to prepare subtrees on CommonPool, which is done at most
+    // once per traversal. Always set for the subtrees prepared there.
+    bool offThreadPrepareAttempted = false;
+
+    // Set by DrawFrameTask when the UI thread only changed properties and was unblocked before
+    // the traversal, see RenderNode::publishPropertyOnlyChanges(). A MODE_FULL traversal then
+    // syncs the properties published under this epoch and reads no other staging state.
+    uint64_t publishedEpoch = 0;
     // TODO: Damage calculations
 };
 
@@ -505,7 +505,7 @@ void Tree::updateCache(sp<skiapipeline::VectorDrawableAtlas>& atlas, GrContext*
             surface.reset();
         }
     }
-    if (!canReuseSurface || mCache.dirty) {
+    if (!canReuseSurface || mCache.dirty || mCache.uploadPending) {
         if (surface) {
             Bitmap& bitmap = getBitmapUpdateIfDirty();
             SkBitmap skiaBitmap;
@@ -513,6 +513,14 @@ void Tree::updateCache(sp<skiapipeline::VectorDrawableAtlas>& atlas, GrContext*
             surface->writePixels(skiaBitmap, dst.fLeft, dst.fTop);
         }
         mCache.dirty = false;
+        mCache.uploadPending = false;
+    }
+}
+
+void Tree::rasterizeCacheIfDirty() {
+    if (mCache.dirty) {
+        getBitmapUpdateIfDirty();
+        mCache.uploadPending = true;
     }
 }
 
@@ -657,6 +657,13 @@ public:
      */
     void updateCache(sp<skiapipeline::VectorDrawableAtlas>& atlas, GrContext* context);
 
+    /**
+     * Redraws the bitmap cache if it is dirty, leaving the upload to the next updateCache call.
+     * This only touches the tree's own render thread state, so it may run on another thread
+     * while the render thread waits for it.
+     */
+    void rasterizeCacheIfDirty();
+
     void setAntiAlias(bool aa) { mRootNode->setAntiAlias(aa); }
 
 private:
@@ -665,6 +672,8 @@ private:
         sk_sp<Bitmap> bitmap;  // used by HWUI pipeline and software
         // TODO: use surface instead of bitmap when drawing in software canvas
         bool dirty = true;
+        // bitmap was redrawn by rasterizeCacheIfDirty and has to be uploaded by updateCache
+        bool uploadPending = false;
 
         // the rest of the code in Cache is used by Skia pipelines only
 
@@ -22,6 +22,7 @@
 #include <SkPicture.h>
 #include <SkRefCnt.h>
 
+#include <algorithm>
 #include <optional>
 
 namespace android {
@@ -31,6 +32,14 @@ AnimatedImageDrawable::AnimatedImageDrawable(sk_sp<SkAnimatedImage> animatedImag
     mTimeToShowNextSnapshot = ms2ns(mSkAnimatedImage->currentFrameDuration());
 }
 
+AnimatedImageDrawable::~AnimatedImageDrawable() {
+    // mEverPrefetched is only written by the AnimatedImageThread while it holds a reference, so
+    // it can be read without its lock here.
+    if (mEverPrefetched) {
+        uirenderer::AnimatedImageThread::getInstance().onDrawableDestroyed(this);
+    }
+}
+
 void AnimatedImageDrawable::syncProperties() {
     mProperties = mStagingProperties;
 }
@@ -187,8 +196,13 @@ void AnimatedImageDrawable::onDraw(SkCanvas* canvas) {
     }
 
     if (mRunning && !mNextSnapshot.valid()) {
+        nsecs_t deadline = systemTime(CLOCK_MONOTONIC);
+        {
+            std::unique_lock lock{mSwapLock};
+            deadline += std::max<nsecs_t>(0, mTimeToShowNextSnapshot - mCurrentTime);
+        }
         auto& thread = uirenderer::AnimatedImageThread::getInstance();
-        mNextSnapshot = thread.decodeNextFrame(sk_ref_sp(this));
+        mNextSnapshot = thread.decodeNextFrame(sk_ref_sp(this), deadline);
     }
 
     if (!drawDirectly) {
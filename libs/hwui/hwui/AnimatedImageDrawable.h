@@ -27,11 +27,16 @@
 #include <SkDrawable.h>
 #include <SkPicture.h>
 
+#include <deque>
 #include <future>
 #include <mutex>
 
 namespace android {
 
+namespace uirenderer {
+class AnimatedImageThread;
+}
+
 class OnAnimationEndListener {
 public:
     virtual ~OnAnimationEndListener() {}
@@ -49,6 +54,7 @@ public:
     // bytesUsed includes the approximate sizes of the SkAnimatedImage and the SkPictures in the
     // Snapshots.
     AnimatedImageDrawable(sk_sp<SkAnimatedImage> animatedImage, size_t bytesUsed);
+    ~AnimatedImageDrawable() override;
 
     /**
      * This updates the internal time and returns true if the image needs
@@ -155,6 +161,14 @@ private:
     Properties mProperties;
 
     std::unique_ptr<OnAnimationEndListener> mEndListener;
+
+    // The frames that the AnimatedImageThread decoded ahead, in order. These are guarded by the
+    // AnimatedImageThread's lock.
+    friend class uirenderer::AnimatedImageThread;
+    std::deque<Snapshot> mPrefetchedSnapshots;
+    bool mPrefetchQueued = false;
+    bool mDecodedFinalFrame = false;
+    bool mEverPrefetched = false;
 };
 
 }  // namespace android
@@ -16,29 +16,212 @@
 
 #include "AnimatedImageThread.h"
 
+#include "Properties.h"
+#include "utils/TimeUtils.h"
+#include "utils/TraceUtils.h"
+
 #include <sys/resource.h>
+#include <utils/ThreadDefs.h>
+
+#include <algorithm>
+#include <array>
+#include <thread>
 
 namespace android {
 namespace uirenderer {
 
+// How long prefetching stays off after trimMemory().
+#define PREFETCH_SUSPEND_TIME 5_s
+
 AnimatedImageThread& AnimatedImageThread::getInstance() {
     static AnimatedImageThread* sInstance = new AnimatedImageThread();
     return *sInstance;
 }
 
 AnimatedImageThread::AnimatedImageThread() {
-    setpriority(PRIO_PROCESS, 0, PRIORITY_NORMAL + PRIORITY_MORE_FAVORABLE);
-    start("AnimatedImageThread");
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        std::thread worker([this, i] {
+            std::array<char, 16> name{"AnimatedImage"};
+            snprintf(name.data(), name.size(), "AnimatedImage%d", i);
+            pthread_setname_np(pthread_self(), name.data());
+            setpriority(PRIO_PROCESS, 0, PRIORITY_NORMAL + PRIORITY_MORE_FAVORABLE);
+            workerLoop();
+        });
+        worker.detach();
+    }
 }
 
 std::future<AnimatedImageDrawable::Snapshot> AnimatedImageThread::decodeNextFrame(
-        const sk_sp<AnimatedImageDrawable>& drawable) {
-    return queue().async([drawable]() { return drawable->decodeNextFrame(); });
+        const sk_sp<AnimatedImageDrawable>& drawable, nsecs_t deadline) {
+    std::promise<AnimatedImageDrawable::Snapshot> promise;
+    std::future<AnimatedImageDrawable::Snapshot> future = promise.get_future();
+    std::lock_guard lock(mLock);
+    AnimatedImageDrawable::Snapshot snapshot;
+    if (popPrefetchedLocked(drawable.get(), &snapshot)) {
+        promise.set_value(std::move(snapshot));
+        schedulePrefetchLocked(drawable, deadline);
+    } else {
+        enqueueLocked({drawable, JobType::Decode, deadline, std::move(promise)});
+    }
+    return future;
 }
 
 std::future<AnimatedImageDrawable::Snapshot> AnimatedImageThread::reset(
         const sk_sp<AnimatedImageDrawable>& drawable) {
-    return queue().async([drawable]() { return drawable->reset(); });
+    std::promise<AnimatedImageDrawable::Snapshot> promise;
+    std::future<AnimatedImageDrawable::Snapshot> future = promise.get_future();
+    std::lock_guard lock(mLock);
+    // The drawable dropped the future of a frame it asked for before, and that frame must not
+    // be decoded after the reset.
+    mJobs.erase(std::remove_if(mJobs.begin(), mJobs.end(),
+                               [&drawable](const Job& job) {
+                                   return job.drawable == drawable && job.type == JobType::Decode;
+                               }),
+                mJobs.end());
+    // The first frame is shown as soon as it is ready.
+    enqueueLocked({drawable, JobType::Reset, 0, std::move(promise)});
+    return future;
+}
+
+void AnimatedImageThread::trimMemory() {
+    std::lock_guard lock(mLock);
+    mPrefetchSuspendedUntil = systemTime(SYSTEM_TIME_MONOTONIC) + PREFETCH_SUSPEND_TIME;
+    for (AnimatedImageDrawable* drawable : mPrefetchedDrawables) {
+        drawable->mPrefetchedSnapshots.clear();
+    }
+    mPrefetchedDrawables.clear();
+}
+
+void AnimatedImageThread::onDrawableDestroyed(AnimatedImageDrawable* drawable) {
+    std::lock_guard lock(mLock);
+    mPrefetchedDrawables.erase(drawable);
+}
+
+void AnimatedImageThread::workerLoop() {
+    Job job;
+    while (true) {
+        {
+            std::unique_lock lock(mLock);
+            while (!takeJobLocked(&job)) {
+                mCondition.wait(lock);
+            }
+        }
+        runJob(job);
+        job = Job();
+    }
+}
+
+void AnimatedImageThread::runJob(Job& job) {
+    AnimatedImageDrawable* drawable = job.drawable.get();
+    AnimatedImageDrawable::Snapshot snapshot;
+    if (job.type == JobType::Decode) {
+        // A prefetch may have finished the frame while this job was queued.
+        std::lock_guard lock(mLock);
+        if (popPrefetchedLocked(drawable, &snapshot)) {
+            mBusyDrawables.erase(drawable);
+            job.promise.set_value(std::move(snapshot));
+            schedulePrefetchLocked(job.drawable, job.deadline);
+            return;
+        }
+    }
+
+    {
+        ATRACE_NAME(job.type == JobType::Prefetch ? "AnimatedImage prefetch"
+                                                  : "AnimatedImage decode");
+        snapshot = job.type == JobType::Reset ? drawable->reset() : drawable->decodeNextFrame();
+    }
+
+    std::lock_guard lock(mLock);
+    mBusyDrawables.erase(drawable);
+    drawable->mDecodedFinalFrame = snapshot.mDurationMS == SkAnimatedImage::kFinished;
+    switch (job.type) {
+        case JobType::Reset:
+            dropPrefetchedLocked(drawable);
+            job.promise.set_value(std::move(snapshot));
+            break;
+        case JobType::Decode:
+            job.promise.set_value(std::move(snapshot));
+            break;
+        case JobType::Prefetch:
+            drawable->mPrefetchQueued = false;
+            if (systemTime(SYSTEM_TIME_MONOTONIC) >= mPrefetchSuspendedUntil) {
+                pushPrefetchedLocked(drawable, std::move(snapshot));
+            }
+            break;
+    }
+    schedulePrefetchLocked(job.drawable, job.deadline);
+    if (!mJobs.empty()) {
+        // Jobs of this drawable may have been skipped while it was busy.
+        mCondition.notify_one();
+    }
+}
+
+void AnimatedImageThread::enqueueLocked(Job&& job) {
+    mJobs.push_back(std::move(job));
+    mCondition.notify_one();
+}
+
+bool AnimatedImageThread::takeJobLocked(Job* outJob) {
+    auto best = mJobs.end();
+    for (auto it = mJobs.begin(); it != mJobs.end(); it++) {
+        if (mBusyDrawables.count(it->drawable.get())) {
+            continue;
+        }
+        if (best == mJobs.end()) {
+            best = it;
+            continue;
+        }
+        const bool prefetch = it->type == JobType::Prefetch;
+        const bool bestPrefetch = best->type == JobType::Prefetch;
+        if (prefetch != bestPrefetch ? !prefetch : it->deadline < best->deadline) {
+            best = it;
+        }
+    }
+    if (best == mJobs.end()) {
+        return false;
+    }
+    *outJob = std::move(*best);
+    // Keep the queue order, so that jobs with the same deadline run first come first served.
+    mJobs.erase(best);
+    mBusyDrawables.insert(outJob->drawable.get());
+    return true;
+}
+
+void AnimatedImageThread::schedulePrefetchLocked(const sk_sp<AnimatedImageDrawable>& drawable,
+                                                 nsecs_t deadline) {
+    const int prefetchFrames = Properties::animatedImagePrefetchFrames;
+    if (prefetchFrames <= 0 || drawable->mPrefetchQueued || drawable->mDecodedFinalFrame ||
+        drawable->mPrefetchedSnapshots.size() >= static_cast<size_t>(prefetchFrames) ||
+        systemTime(SYSTEM_TIME_MONOTONIC) < mPrefetchSuspendedUntil) {
+        return;
+    }
+    drawable->mPrefetchQueued = true;
+    enqueueLocked({drawable, JobType::Prefetch, deadline, {}});
+}
+
+void AnimatedImageThread::pushPrefetchedLocked(AnimatedImageDrawable* drawable,
+                                               AnimatedImageDrawable::Snapshot&& snapshot) {
+    drawable->mPrefetchedSnapshots.push_back(std::move(snapshot));
+    drawable->mEverPrefetched = true;
+    mPrefetchedDrawables.insert(drawable);
+}
+
+bool AnimatedImageThread::popPrefetchedLocked(AnimatedImageDrawable* drawable,
+                                              AnimatedImageDrawable::Snapshot* outSnapshot) {
+    if (drawable->mPrefetchedSnapshots.empty()) {
+        return false;
+    }
+    *outSnapshot = std::move(drawable->mPrefetchedSnapshots.front());
+    drawable->mPrefetchedSnapshots.pop_front();
+    if (drawable->mPrefetchedSnapshots.empty()) {
+        mPrefetchedDrawables.erase(drawable);
+    }
+    return true;
+}
+
+void AnimatedImageThread::dropPrefetchedLocked(AnimatedImageDrawable* drawable) {
+    drawable->mPrefetchedSnapshots.clear();
+    mPrefetchedDrawables.erase(drawable);
 }
 
 }  // namespace uirenderer
@@ -18,26 +18,88 @@
 #define ANIMATEDIMAGETHREAD_H_
 
 #include "AnimatedImageDrawable.h"
-#include "thread/ThreadBase.h"
 
 #include <SkRefCnt.h>
+#include <utils/Macros.h>
+#include <utils/Timers.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
 
 namespace android {
 
 namespace uirenderer {
 
-class AnimatedImageThread : private ThreadBase {
+/**
+ * Decodes the frames of AnimatedImageDrawables on a small pool of threads.
+ *
+ * The frames of one drawable are decoded one at a time and in order, but different drawables
+ * decode in parallel. Frames that are already late or due soonest are decoded first. With
+ * Properties::animatedImagePrefetchFrames, idle workers decode that many frames ahead of the one
+ * each drawable last asked for, so that the next request can be answered right away.
+ */
+class AnimatedImageThread {
     PREVENT_COPY_AND_ASSIGN(AnimatedImageThread);
 
 public:
     static AnimatedImageThread& getInstance();
 
+    /**
+     * Returns the frame that follows the last one returned for the drawable. deadline is when
+     * the frame is due to be shown, in SYSTEM_TIME_MONOTONIC.
+     */
     std::future<AnimatedImageDrawable::Snapshot> decodeNextFrame(
-            const sk_sp<AnimatedImageDrawable>&);
+            const sk_sp<AnimatedImageDrawable>&, nsecs_t deadline);
     std::future<AnimatedImageDrawable::Snapshot> reset(const sk_sp<AnimatedImageDrawable>&);
 
+    /**
+     * Drops all prefetched frames, and stops prefetching for a while.
+     */
+    void trimMemory();
+
+    /**
+     * Called by the drawable's destructor to forget its prefetched frames.
+     */
+    void onDrawableDestroyed(AnimatedImageDrawable* drawable);
+
+    static constexpr int THREAD_COUNT = 2;
+
 private:
+    enum class JobType { Reset, Decode, Prefetch };
+
+    struct Job {
+        sk_sp<AnimatedImageDrawable> drawable;
+        JobType type;
+        nsecs_t deadline;
+        std::promise<AnimatedImageDrawable::Snapshot> promise;
+    };
+
     AnimatedImageThread();
+
+    void workerLoop();
+    void runJob(Job& job);
+
+    void enqueueLocked(Job&& job);
+    // Picks the job to run next: requested frames before prefetches, then by deadline. Skips the
+    // drawables that another worker is decoding.
+    bool takeJobLocked(Job* outJob);
+    void schedulePrefetchLocked(const sk_sp<AnimatedImageDrawable>& drawable, nsecs_t deadline);
+    void pushPrefetchedLocked(AnimatedImageDrawable* drawable,
+                              AnimatedImageDrawable::Snapshot&& snapshot);
+    bool popPrefetchedLocked(AnimatedImageDrawable* drawable,
+                             AnimatedImageDrawable::Snapshot* outSnapshot);
+    void dropPrefetchedLocked(AnimatedImageDrawable* drawable);
+
+    std::mutex mLock;
+    std::condition_variable mCondition;
+    std::vector<Job> mJobs;
+    // Drawables that a worker is decoding.
+    std::unordered_set<const AnimatedImageDrawable*> mBusyDrawables;
+    // Drawables that hold prefetched frames.
+    std::unordered_set<AnimatedImageDrawable*> mPrefetchedDrawables;
+    nsecs_t mPrefetchSuspendedUntil = 0;
 };
 
 }  // namespace uirenderer
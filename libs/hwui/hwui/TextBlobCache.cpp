@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TextBlobCache.h"
+
+#include <SkTypeface.h>
+#include <utils/JenkinsHash.h>
+
+#include <cstring>
+
+namespace android {
+
+TextBlobCache& TextBlobCache::get() {
+    static TextBlobCache* sInstance = new TextBlobCache();
+    return *sInstance;
+}
+
+static sk_sp<SkTextBlob> makeBlob(const SkFont& font, const uint16_t* glyphs,
+                                  const float* positions, int count) {
+    SkTextBlobBuilder builder;
+    const SkTextBlobBuilder::RunBuffer& buffer = builder.allocRunPos(font, count);
+    memcpy(buffer.glyphs, glyphs, count * sizeof(uint16_t));
+    memcpy(buffer.pos, positions, count * 2 * sizeof(float));
+    return builder.make();
+}
+
+sk_sp<SkTextBlob> TextBlobCache::getOrCreate(const SkFont& font, const uint16_t* glyphs,
+                                             const float* positions, int count) {
+    if (count > kMaxGlyphs) {
+        return makeBlob(font, glyphs, positions, count);
+    }
+
+    Key key{font, std::vector<uint16_t>(glyphs, glyphs + count),
+            std::vector<float>(positions, positions + count * 2), 0};
+    uint32_t hash = JenkinsHashMix(0, font.getTypeface() ? font.getTypeface()->uniqueID() : 0);
+    hash = JenkinsHashMixBytes(hash, reinterpret_cast<const uint8_t*>(glyphs),
+                               count * sizeof(uint16_t));
+    hash = JenkinsHashMixBytes(hash, reinterpret_cast<const uint8_t*>(positions),
+                               count * 2 * sizeof(float));
+    key.hash = JenkinsHashWhiten(hash);
+
+    std::lock_guard<std::mutex> lock(mLock);
+    auto found = mIndex.find(&key);
+    if (found != mIndex.end()) {
+        mHits++;
+        mEntries.splice(mEntries.begin(), mEntries, found->second);
+        return found->second->blob;
+    }
+
+    mMisses++;
+    sk_sp<SkTextBlob> blob = makeBlob(font, glyphs, positions, count);
+    if (mEntries.size() >= kMaxEntries) {
+        mIndex.erase(&mEntries.back().key);
+        mEntries.pop_back();
+    }
+    mEntries.push_front(Entry{std::move(key), blob});
+    mIndex.emplace(&mEntries.front().key, mEntries.begin());
+    return blob;
+}
+
+void TextBlobCache::clear() {
+    std::lock_guard<std::mutex> lock(mLock);
+    mIndex.clear();
+    mEntries.clear();
+}
+
+void TextBlobCache::dump(String8& log) {
+    std::lock_guard<std::mutex> lock(mLock);
+    uint32_t lookups = mHits + mMisses;
+    log.appendFormat("Text Blob Cache:\n");
+    log.appendFormat("  Entries: %zu / %zu, Hits: %u, Misses: %u (%.1f%% hit rate)\n",
+                     mEntries.size(), kMaxEntries, mHits, mMisses,
+                     lookups ? 100.0f * mHits / lookups : 0.0f);
+}
+
+size_t TextBlobCache::size() {
+    std::lock_guard<std::mutex> lock(mLock);
+    return mEntries.size();
+}
+
+}  // namespace android
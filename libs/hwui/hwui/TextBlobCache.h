@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <SkFont.h>
+#include <SkRefCnt.h>
+#include <SkTextBlob.h>
+#include <cutils/compiler.h>
+#include <utils/String8.h>
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace android {
+
+/**
+ * Process wide LRU cache of the SkTextBlobs built by SkiaCanvas::drawGlyphs, keyed by the
+ * glyphs, their positions and the font. A label that is re-recorded unchanged gets back the
+ * blob of its previous recording, which also lets Skia's GPU text blob cache, keyed by blob ID,
+ * reuse the vertices it built for it.
+ *
+ * Shaping is already cached per word by minikin's LayoutCache, so only the blobs are kept here.
+ */
+class ANDROID_API TextBlobCache {
+public:
+    static TextBlobCache& get();
+
+    /**
+     * Returns the blob of a single positioned run, from the cache or newly built. positions holds
+     * count (x, y) pairs.
+     */
+    sk_sp<SkTextBlob> getOrCreate(const SkFont& font, const uint16_t* glyphs,
+                                  const float* positions, int count);
+
+    void clear();
+    void dump(String8& log);
+
+    size_t size();
+
+    // Runs with more glyphs than this are not cached.
+    static constexpr int kMaxGlyphs = 256;
+    static constexpr size_t kMaxEntries = 512;
+
+private:
+    struct Key {
+        SkFont font;
+        std::vector<uint16_t> glyphs;
+        std::vector<float> positions;
+        uint32_t hash;
+
+        bool operator==(const Key& other) const {
+            return hash == other.hash && font == other.font && glyphs == other.glyphs &&
+                   positions == other.positions;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key* key) const { return key->hash; }
+    };
+
+    struct KeyEqual {
+        bool operator()(const Key* a, const Key* b) const { return *a == *b; }
+    };
+
+    struct Entry {
+        Key key;
+        sk_sp<SkTextBlob> blob;
+    };
+
+    std::mutex mLock;
+    // Most recently used first.
+    std::list<Entry> mEntries;
+    std::unordered_map<const Key*, std::list<Entry>::iterator, KeyHash, KeyEqual> mIndex;
+    uint32_t mHits = 0;
+    uint32_t mMisses = 0;
+};
+
+}  // namespace android
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "LayerPool.h"
+
+#include <SkColorSpace.h>
+
+#include "utils/TraceUtils.h"
+
+namespace android {
+namespace uirenderer {
+namespace skiapipeline {
+
+sk_sp<SkSurface> LayerPool::acquire(GrContext* context, const SkImageInfo& info,
+                                    GrSurfaceOrigin origin, const SkSurfaceProps& props) {
+    // Prefer the most recently released surface, its memory is the most likely to still be warm.
+    for (size_t i = mEntries.size(); i-- > 0;) {
+        const Entry& entry = mEntries[i];
+        const SkImageInfo& pooledInfo = entry.surface->imageInfo();
+        if (entry.origin == origin && pooledInfo.width() == info.width() &&
+            pooledInfo.height() == info.height() && pooledInfo.colorType() == info.colorType() &&
+            pooledInfo.alphaType() == info.alphaType() &&
+            SkColorSpace::Equals(pooledInfo.colorSpace(), info.colorSpace()) &&
+            entry.surface->props().flags() == props.flags() &&
+            entry.surface->props().pixelGeometry() == props.pixelGeometry()) {
+            sk_sp<SkSurface> surface = entry.surface;
+            erase(i);
+            mReuses++;
+            return surface;
+        }
+    }
+
+    mAllocations++;
+    ATRACE_FORMAT("LayerPool allocate %dx%d", info.width(), info.height());
+    return SkSurface::MakeRenderTarget(context, SkBudgeted::kYes, info, 0, origin, &props);
+}
+
+void LayerPool::release(sk_sp<SkSurface> surface, GrSurfaceOrigin origin, nsecs_t now) {
+    if (!surface || !surface->unique()) {
+        return;
+    }
+    const size_t bytes = surfaceBytes(surface.get());
+    if (bytes > mMaxBytes) {
+        return;
+    }
+    while (mBytes + bytes > mMaxBytes) {
+        erase(0);
+    }
+    mBytes += bytes;
+    mEntries.push_back({std::move(surface), origin, now});
+}
+
+nsecs_t LayerPool::trim(nsecs_t now, nsecs_t timeout) {
+    while (!mEntries.empty() && now - mEntries.front().releaseTime >= timeout) {
+        erase(0);
+        mExpired++;
+    }
+    return mEntries.empty() ? 0 : mEntries.front().releaseTime + timeout;
+}
+
+void LayerPool::clear() {
+    mEntries.clear();
+    mBytes = 0;
+}
+
+void LayerPool::dump(String8& log) const {
+    log.appendFormat("  LayerPool            %6.2f kB / %6.2f KB (entries = %zu)\n",
+                     mBytes / 1024.0f, mMaxBytes / 1024.0f, mEntries.size());
+    log.appendFormat("    Allocations: %u, reuses: %u, expired: %u\n", mAllocations, mReuses,
+                     mExpired);
+}
+
+void LayerPool::erase(size_t index) {
+    mBytes -= surfaceBytes(mEntries[index].surface.get());
+    mEntries.erase(mEntries.begin() + index);
+}
+
+} /* namespace skiapipeline */
+} /* namespace uirenderer */
+} /* namespace android */
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <GrContext.h>
+#include <SkSurface.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+#include <vector>
+
+namespace android {
+namespace uirenderer {
+namespace skiapipeline {
+
+/**
+ * Keeps the surfaces of recently destroyed layers around for a while, so that a layer created for
+ * a short animation (e.g. a fade in) can take over the surface of the previous one instead of
+ * allocating a new render target. Layer sizes are already rounded up to LAYER_SIZE, which makes
+ * matches between nodes of similar size likely.
+ *
+ * Must only be used on the RenderThread.
+ */
+class LayerPool {
+public:
+    explicit LayerPool(size_t maxBytes) : mMaxBytes(maxBytes) {}
+
+    /**
+     * Returns a pooled surface with the same size, color type, color space and origin, or a newly
+     * allocated one.
+     */
+    sk_sp<SkSurface> acquire(GrContext* context, const SkImageInfo& info, GrSurfaceOrigin origin,
+                             const SkSurfaceProps& props);
+
+    /**
+     * Takes back a surface that is no longer attached to a layer. Surfaces that are still
+     * referenced elsewhere, or that would push the pool over its limit, are released instead.
+     */
+    void release(sk_sp<SkSurface> surface, GrSurfaceOrigin origin, nsecs_t now);
+
+    /**
+     * Releases the surfaces that have been pooled for longer than timeout. Returns when the next
+     * one expires, or 0 if the pool is empty.
+     */
+    nsecs_t trim(nsecs_t now, nsecs_t timeout);
+
+    void clear();
+    void dump(String8& log) const;
+
+    size_t size() const { return mEntries.size(); }
+    size_t bytes() const { return mBytes; }
+
+private:
+    struct Entry {
+        sk_sp<SkSurface> surface;
+        GrSurfaceOrigin origin;
+        nsecs_t releaseTime;
+    };
+
+    static size_t surfaceBytes(const SkSurface* surface) {
+        return surface->width() * surface->height() * surface->imageInfo().bytesPerPixel();
+    }
+
+    void erase(size_t index);
+
+    const size_t mMaxBytes;
+    size_t mBytes = 0;
+    // Oldest first.
+    std::vector<Entry> mEntries;
+
+    uint32_t mAllocations = 0;
+    uint32_t mReuses = 0;
+    uint32_t mExpired = 0;
+};
+
+} /* namespace skiapipeline */
+} /* namespace uirenderer */
+} /* namespace android */
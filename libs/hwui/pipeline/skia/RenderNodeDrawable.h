@@ -76,6 +76,15 @@ public:
      */
     const SkMatrix& getRecordedMatrix() const { return mRecordedTransform; }
 
+    /**
+     * Returns true if other was recorded for the same node in the same way.
+     */
+    bool isSameRecording(const RenderNodeDrawable& other) const {
+        return mRenderNode == other.mRenderNode && mRecordedTransform == other.mRecordedTransform &&
+               mComposeLayer == other.mComposeLayer &&
+               mInReorderingSection == other.mInReorderingSection;
+    }
+
     /**
      * Sets a pointer to a display list of the parent render node. The display list is used when
      * drawing backward projected nodes, when this node is a projection receiver.
@@ -19,7 +19,6 @@
 #include "SkiaDisplayList.h"
 #include "SkiaPipeline.h"
 
-#include <SkPathOps.h>
 #include <SkShadowUtils.h>
 
 namespace android {
@@ -39,12 +38,24 @@ void StartReorderBarrierDrawable::onDraw(SkCanvas* canvas) {
             mChildren.push_back(const_cast<RenderNodeDrawable*>(&mDisplayList->mChildNodes[i]));
         }
     }
-    std::stable_sort(mChildren.begin(), mChildren.end(),
-                     [](RenderNodeDrawable* a, RenderNodeDrawable* b) {
-                         const float aZValue = a->getNodeProperties().getZ();
-                         const float bZValue = b->getNodeProperties().getZ();
-                         return aZValue < bZValue;
-                     });
+    // mChildren keeps the order of the previous draw, which is still sorted if no child's Z
+    // changed since. Sorting it again would then be a no-op, so only the Z values are compared.
+    bool sorted = mSortedZ.size() == mChildren.size();
+    for (size_t i = 0; sorted && i < mChildren.size(); i++) {
+        sorted = mChildren[i]->getNodeProperties().getZ() == mSortedZ[i];
+    }
+    if (!sorted) {
+        std::stable_sort(mChildren.begin(), mChildren.end(),
+                         [](RenderNodeDrawable* a, RenderNodeDrawable* b) {
+                             const float aZValue = a->getNodeProperties().getZ();
+                             const float bZValue = b->getNodeProperties().getZ();
+                             return aZValue < bZValue;
+                         });
+        mSortedZ.resize(mChildren.size());
+        for (size_t i = 0; i < mChildren.size(); i++) {
+            mSortedZ[i] = mChildren[i]->getNodeProperties().getZ();
+        }
+    }
 
     size_t drawIndex = 0;
     const size_t endIndex = mChildren.size();
@@ -185,11 +196,8 @@ void EndReorderBarrierDrawable::drawShadow(SkCanvas* canvas, RenderNodeDrawable*
     }
 
     // intersect the shadow-casting path with the reveal, if present
-    SkPath tmpPath;  // holds temporary SkPath to store the result of intersections
     if (revealClipPath) {
-        Op(*casterPath, *revealClipPath, kIntersect_SkPathOp, &tmpPath);
-        tmpPath.setIsVolatile(true);
-        casterPath = &tmpPath;
+        casterPath = caster->getRenderNode()->getRevealedOutline(*casterPath, *revealClipPath);
     }
 
     const Vector3 lightPos = SkiaPipeline::getLightCenter();
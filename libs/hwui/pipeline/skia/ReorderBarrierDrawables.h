@@ -49,6 +49,8 @@ private:
     int mEndChildIndex;
     int mBeginChildIndex;
     FatVector<RenderNodeDrawable*, 16> mChildren;
+    // Z of each of mChildren when last sorted.
+    FatVector<float, 16> mSortedZ;
     SkiaDisplayList* mDisplayList;
 
     friend class EndReorderBarrierDrawable;
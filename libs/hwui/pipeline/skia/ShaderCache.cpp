@@ -18,11 +18,14 @@
 #include <GrContext.h>
 #include <log/log.h>
 #include <openssl/sha.h>
+#include <utils/String8.h>
 #include <algorithm>
 #include <array>
+#include <cstring>
 #include <thread>
 #include "FileBlobCache.h"
 #include "Properties.h"
+#include "thread/CommonPool.h"
 #include "utils/TraceUtils.h"
 
 namespace android {
@@ -34,6 +37,10 @@ static const size_t maxKeySize = 1024;
 static const size_t maxValueSize = 512 * 1024;
 static const size_t maxTotalSize = 1024 * 1024;
 
+// Keys whose hit counts are stored on disk, and keys read ahead by warmUp().
+static const size_t maxRankedKeys = 64;
+static const size_t maxWarmUpKeys = 32;
+
 ShaderCache::ShaderCache() {
     // There is an "incomplete FileBlobCache type" compilation error, if ctor is moved to header.
 }
@@ -85,6 +92,8 @@ void ShaderCache::initShaderDiskCache(const void* identity, ssize_t size) {
     if (!Properties::runningInEmulator && mFilename.length() > 0) {
         mBlobCache.reset(new FileBlobCache(maxKeySize, maxValueSize, maxTotalSize, mFilename));
         validateCache(identity, size);
+        loadHitCountsLocked();
+        mWarmEntries.clear();
         mInitialized = true;
     }
 }
@@ -107,6 +116,16 @@ sk_sp<SkData> ShaderCache::load(const SkData& key) {
         return nullptr;
     }
 
+    std::string keyString(static_cast<const char*>(key.data()), keySize);
+    auto warmEntry = mWarmEntries.find(keyString);
+    if (warmEntry != mWarmEntries.end()) {
+        sk_sp<SkData> data = std::move(warmEntry->second);
+        mWarmEntries.erase(warmEntry);
+        mWarmHitCount++;
+        countHitLocked(keyString);
+        return data;
+    }
+
     // mObservedBlobValueSize is reasonably big to avoid memory reallocation
     // Allocate a buffer with malloc. SkData takes ownership of that allocation and will call free.
     void* valueBuffer = malloc(mObservedBlobValueSize);
@@ -129,6 +148,7 @@ sk_sp<SkData> ShaderCache::load(const SkData& key) {
     }
     if (!valueSize) {
         free(valueBuffer);
+        mMissCount++;
         return nullptr;
     }
     if (valueSize > mObservedBlobValueSize) {
@@ -136,9 +156,123 @@ sk_sp<SkData> ShaderCache::load(const SkData& key) {
         free(valueBuffer);
         return nullptr;
     }
+    countHitLocked(keyString);
     return SkData::MakeFromMalloc(valueBuffer, valueSize);
 }
 
+void ShaderCache::countHitLocked(const std::string& key) {
+    mHitCount++;
+    mHitCounts[key]++;
+    if (Properties::shaderCacheWarmup) {
+        // Get the new ranking on disk even if no new shader is compiled in this run.
+        mCacheDirty = true;
+        scheduleDeferredSaveLocked();
+    }
+}
+
+std::vector<const std::string*> ShaderCache::rankedKeysLocked(size_t maxCount) const {
+    std::vector<std::pair<uint32_t, const std::string*>> counts;
+    counts.reserve(mHitCounts.size());
+    for (const auto& entry : mHitCounts) {
+        counts.emplace_back(entry.second, &entry.first);
+    }
+    size_t count = std::min(maxCount, counts.size());
+    std::partial_sort(counts.begin(), counts.begin() + count, counts.end(),
+                      [](const auto& a, const auto& b) { return a.first > b.first; });
+    std::vector<const std::string*> keys;
+    keys.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        keys.push_back(counts[i].second);
+    }
+    return keys;
+}
+
+// The hit counts are stored as a sequence of (uint32_t count, uint32_t key size, key) records.
+void ShaderCache::loadHitCountsLocked() {
+    mHitCounts.clear();
+    auto key = sHitCountsKey;
+    size_t size = mBlobCache->get(&key, sizeof(key), nullptr, 0);
+    if (size == 0) {
+        return;
+    }
+    std::vector<uint8_t> buffer(size);
+    if (mBlobCache->get(&key, sizeof(key), buffer.data(), size) != size) {
+        return;
+    }
+    const size_t headerSize = 2 * sizeof(uint32_t);
+    size_t offset = 0;
+    while (size - offset >= headerSize) {
+        uint32_t count;
+        uint32_t keySize;
+        memcpy(&count, buffer.data() + offset, sizeof(count));
+        memcpy(&keySize, buffer.data() + offset + sizeof(count), sizeof(keySize));
+        offset += headerSize;
+        if (keySize > size - offset) {
+            ALOGW("ShaderCache::loadHitCountsLocked truncated hit counts");
+            break;
+        }
+        mHitCounts.emplace(
+                std::string(reinterpret_cast<const char*>(buffer.data() + offset), keySize),
+                count);
+        offset += keySize;
+    }
+}
+
+void ShaderCache::storeHitCountsLocked() {
+    std::vector<uint8_t> buffer;
+    for (const std::string* rankedKey : rankedKeysLocked(maxRankedKeys)) {
+        uint32_t header[2] = {mHitCounts[*rankedKey], (uint32_t)rankedKey->size()};
+        const uint8_t* headerBytes = reinterpret_cast<const uint8_t*>(header);
+        buffer.insert(buffer.end(), headerBytes, headerBytes + sizeof(header));
+        buffer.insert(buffer.end(), rankedKey->begin(), rankedKey->end());
+    }
+    if (buffer.size() && buffer.size() < maxValueSize) {
+        auto key = sHitCountsKey;
+        mBlobCache->set(&key, sizeof(key), buffer.data(), buffer.size());
+    }
+}
+
+void ShaderCache::warmUp() {
+    if (!Properties::shaderCacheWarmup) {
+        return;
+    }
+    CommonPool::post([this] {
+        ATRACE_NAME("ShaderCache::warmUp");
+        std::lock_guard<std::mutex> lock(mMutex);
+        warmUpLocked();
+    });
+}
+
+void ShaderCache::warmUpLocked() {
+    if (!mInitialized) {
+        return;
+    }
+    BlobCache* bc = getBlobCacheLocked();
+    for (const std::string* key : rankedKeysLocked(maxWarmUpKeys)) {
+        if (mWarmEntries.count(*key)) {
+            continue;
+        }
+        size_t valueSize = bc->get(key->data(), key->size(), nullptr, 0);
+        if (valueSize == 0) {
+            // The entry was evicted since its hit was counted.
+            continue;
+        }
+        sk_sp<SkData> data = SkData::MakeUninitialized(valueSize);
+        if (bc->get(key->data(), key->size(), data->writable_data(), valueSize) != valueSize) {
+            continue;
+        }
+        mWarmEntries.emplace(*key, std::move(data));
+        mWarmLoadedCount++;
+    }
+}
+
+void ShaderCache::dump(String8& log) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    log.appendFormat("Shader Cache:\n");
+    log.appendFormat("  Hits: %u, Misses: %u\n", mHitCount, mMissCount);
+    log.appendFormat("  Warmed up: %u, used: %u\n", mWarmLoadedCount, mWarmHitCount);
+}
+
 void ShaderCache::saveToDiskLocked() {
     ATRACE_NAME("ShaderCache::saveToDiskLocked");
     if (mInitialized && mBlobCache && mSavePending) {
@@ -146,6 +280,7 @@ void ShaderCache::saveToDiskLocked() {
             auto key = sIDKey;
             mBlobCache->set(&key, sizeof(key), mIDHash.data(), mIDHash.size());
         }
+        storeHitCountsLocked();
         mBlobCache->writeToFile();
     }
     mSavePending = false;
@@ -188,7 +323,10 @@ void ShaderCache::store(const SkData& key, const SkData& data) {
         mTryToStorePipelineCache = true;
     }
     bc->set(key.data(), keySize, value, valueSize);
+    scheduleDeferredSaveLocked();
+}
 
+void ShaderCache::scheduleDeferredSaveLocked() {
     if (!mSavePending && mDeferredSaveDelay > 0) {
         mSavePending = true;
         std::thread deferredSaveThread([this]() {
@@ -21,12 +21,14 @@
 #include <memory>
 #include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace android {
 
 class BlobCache;
 class FileBlobCache;
+class String8;
 
 namespace uirenderer {
 namespace skiapipeline {
@@ -82,6 +84,19 @@ public:
      */
     void onVkFrameFlushed(GrContext* context);
 
+    /**
+     * "warmUp" reads the value blobs of the most used entries, as ranked by their hit counts of
+     * previous runs, into memory on a CommonPool thread. The next "load" of such a key is served
+     * from memory instead of the blob cache. Does nothing unless debug.hwui.shader_cache_warmup
+     * is set. This should be called after "initShaderDiskCache".
+     */
+    void warmUp();
+
+    /**
+     * "dump" prints the hit and miss counts of "load" and how many warmed up entries were used.
+     */
+    void dump(String8& log);
+
 private:
     // Creation and (the lack of) destruction is handled internally.
     ShaderCache();
@@ -111,6 +126,37 @@ private:
      */
     void saveToDiskLocked();
 
+    /**
+     * "scheduleDeferredSaveLocked" starts a thread that calls "saveToDiskLocked" after
+     * "mDeferredSaveDelay" seconds, if one is not already pending.
+     */
+    void scheduleDeferredSaveLocked();
+
+    /**
+     * "countHitLocked" bumps the hit count of a key that was found by "load".
+     */
+    void countHitLocked(const std::string& key);
+
+    /**
+     * "rankedKeysLocked" returns up to maxCount keys of "mHitCounts", most used first.
+     */
+    std::vector<const std::string*> rankedKeysLocked(size_t maxCount) const;
+
+    /**
+     * "loadHitCountsLocked" replaces "mHitCounts" with the counts stored in the blob cache.
+     */
+    void loadHitCountsLocked();
+
+    /**
+     * "storeHitCountsLocked" stores the counts of the most used keys in the blob cache.
+     */
+    void storeHitCountsLocked();
+
+    /**
+     * "warmUpLocked" reads the value blobs of the most used keys into "mWarmEntries".
+     */
+    void warmUpLocked();
+
     /**
      * "mInitialized" indicates whether the ShaderCache is in the initialized
      * state.  It is initialized to false at construction time, and gets set to
@@ -200,6 +246,26 @@ private:
      */
     bool mCacheDirty = false;
 
+    /**
+     * "mHitCounts" has the number of times each key was found by "load", in this and previous
+     * runs. Only the most used keys are stored on disk.
+     */
+    std::unordered_map<std::string, uint32_t> mHitCounts;
+
+    /**
+     * "mWarmEntries" has the value blobs read ahead by "warmUp" that "load" has not asked for
+     * yet. An entry is dropped once it is loaded.
+     */
+    std::unordered_map<std::string, sk_sp<SkData>> mWarmEntries;
+
+    /**
+     * Statistics printed by "dump".
+     */
+    uint32_t mHitCount = 0;
+    uint32_t mMissCount = 0;
+    uint32_t mWarmLoadedCount = 0;
+    uint32_t mWarmHitCount = 0;
+
     /**
      * "sCache" is the singleton ShaderCache object.
      */
@@ -210,6 +276,12 @@ private:
      */
     static constexpr uint8_t sIDKey = 0;
 
+    /**
+     * "sHitCountsKey" is the cache key of the serialized hit counts. Like "sIDKey" it is a single
+     * byte, which no program key is.
+     */
+    static constexpr uint8_t sHitCountsKey = 1;
+
     friend class ShaderCacheTestUtils;  // used for unit testing
 };
 
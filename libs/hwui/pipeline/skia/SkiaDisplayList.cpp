@@ -40,6 +40,31 @@ void SkiaDisplayList::syncContents(const WebViewSyncData& data) {
     }
 }
 
+bool SkiaDisplayList::isSameRecording(const SkiaDisplayList& other) const {
+    if (!canPrepareOffThread() || !other.canPrepareOffThread() ||
+        mChildNodes.size() != other.mChildNodes.size()) {
+        return false;
+    }
+    // Child nodes are drawn in the order they were added to mChildNodes.
+    size_t nextChild = 0;
+    return mDisplayList.isSameRecording(
+            other.mDisplayList, [&](SkDrawable* drawable, SkDrawable* otherDrawable) {
+                if (drawable == otherDrawable) {
+                    return true;
+                }
+                if (nextChild >= mChildNodes.size() || drawable != &mChildNodes[nextChild] ||
+                    otherDrawable != &other.mChildNodes[nextChild]) {
+                    return false;
+                }
+                const RenderNodeDrawable& child = mChildNodes[nextChild];
+                const RenderNodeDrawable& otherChild = other.mChildNodes[nextChild];
+                nextChild++;
+                const bool isReceiver = &child == mProjectionReceiver;
+                const bool otherIsReceiver = &otherChild == other.mProjectionReceiver;
+                return child.isSameRecording(otherChild) && isReceiver == otherIsReceiver;
+            });
+}
+
 bool SkiaDisplayList::reuseDisplayList(RenderNode* node, renderthread::CanvasContext* context) {
     reset();
     node->attachAvailableList(this);
@@ -162,6 +187,7 @@ void SkiaDisplayList::reset() {
     mAnimatedImages.clear();
     mChildFunctors.clear();
     mChildNodes.clear();
+    mHasTextureLayers = false;
 
     allocator.~LinearAllocator();
     new (&allocator) LinearAllocator();
@@ -90,6 +90,34 @@ public:
 
     bool hasText() const { return mDisplayList.hasText(); }
 
+    /**
+     * Returns the cost of drawing this list's own ops, estimated while it was recorded.
+     */
+    const RecordingCost& getRecordingCost() const { return mDisplayList.cost(); }
+
+    /**
+     * Returns true if prepareListAndChildren() and syncContents() only touch this list and its
+     * children, and so may run off the RenderThread: no functors, vector drawables, animated
+     * images or mutable images to pin.
+     */
+    bool canPrepareOffThread() const {
+        return mChildFunctors.empty() && mVectorDrawables.empty() && mAnimatedImages.empty() &&
+               mMutableImages.empty();
+    }
+
+    /**
+     * Returns true if drawing this list only reads it, so that it may be drawn off the
+     * RenderThread: on top of canPrepareOffThread(), no texture layers to update.
+     */
+    bool canDrawOffThread() const { return canPrepareOffThread() && !mHasTextureLayers; }
+
+    /**
+     * Returns true if other is a recording of the same content, so that syncing it in place of
+     * this list would change nothing. Lists with content that is synced from the UI thread
+     * (functors, vector drawables, animated and mutable images) never compare equal.
+     */
+    bool isSameRecording(const SkiaDisplayList& other) const;
+
     /**
      * Attempts to reset and reuse this DisplayList.
      *
@@ -163,6 +191,8 @@ public:
     }
 
     std::vector<AnimatedImageDrawable*> mAnimatedImages;
+    // Set if the list draws a DeferredLayerUpdater, whose LayerDrawable uses the GrContext.
+    bool mHasTextureLayers = false;
     DisplayListData mDisplayList;
 
     // mProjectionReceiver points to a child node (stored in mChildNodes) that is as a projection
@@ -16,6 +16,7 @@
 
 #include "SkiaPipeline.h"
 
+#include <SkDeferredDisplayListRecorder.h>
 #include <SkImageEncoder.h>
 #include <SkImageInfo.h>
 #include <SkImagePriv.h>
@@ -23,12 +24,17 @@
 #include <SkOverdrawColorFilter.h>
 #include <SkPicture.h>
 #include <SkPictureRecorder.h>
+#include <SkRegion.h>
+#include <SkSurfaceCharacterization.h>
+#include "FrameCounters.h"
 #include "TreeInfo.h"
 #include "VectorDrawable.h"
 #include "thread/CommonPool.h"
 #include "utils/TraceUtils.h"
 
 #include <unistd.h>
+#include <algorithm>
+#include <future>
 
 using namespace android::uirenderer::renderthread;
 
@@ -59,6 +65,10 @@ bool SkiaPipeline::pinImages(std::vector<SkImage*>& mutableImages) {
     for (SkImage* image : mutableImages) {
         if (SkImage_pinAsTexture(image, mRenderThread.getGrContext())) {
             mPinnedImages.emplace_back(sk_ref_sp(image));
+            FrameCounters::add(FrameCounter::ImagesPinned, 1);
+            FrameCounters::add(FrameCounter::ImageBytesPinned,
+                               static_cast<int64_t>(image->width()) * image->height() *
+                                       SkColorTypeBytesPerPixel(image->colorType()));
         } else {
             return false;
         }
@@ -84,13 +94,82 @@ void SkiaPipeline::renderLayers(const LightGeometry& lightGeometry,
                                 const LightInfo& lightInfo) {
     updateLighting(lightGeometry, lightInfo);
     ATRACE_NAME("draw layers");
+    FrameCounters::add(FrameCounter::LayerUpdates, layerUpdateQueue->entries().size());
     renderVectorDrawableCache();
     renderLayersImpl(*layerUpdateQueue, opaque);
     layerUpdateQueue->clear();
 }
 
+// A layer recorded into a deferred display list on a CommonPool thread.
+struct OffThreadLayer {
+    struct Recording {
+        // Null if the layer's damage was clipped out.
+        std::unique_ptr<SkDeferredDisplayList> displayList;
+        nsecs_t recordTime = 0;
+    };
+
+    sk_sp<SkSurface> surface;
+    std::future<Recording> recording;
+};
+
+// Same as the drawing of a layer in renderLayersImpl(), into a recorder for the layer's surface.
+static OffThreadLayer::Recording recordLayer(RenderNode* layerNode, const Rect& layerDamage,
+                                             const SkSurfaceCharacterization& characterization) {
+    const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    OffThreadLayer::Recording recording;
+    SkDeferredDisplayListRecorder recorder(characterization);
+    SkCanvas* layerCanvas = recorder.getCanvas();
+    layerCanvas->androidFramework_setDeviceClipRestriction(layerDamage.toSkIRect());
+
+    const RenderProperties& properties = layerNode->properties();
+    const SkRect bounds = SkRect::MakeWH(properties.getWidth(), properties.getHeight());
+    if (!properties.getClipToBounds() || !layerCanvas->quickReject(bounds)) {
+        ATRACE_FORMAT("recordLayer [%s] %.1f x %.1f", layerNode->getName(), bounds.width(),
+                      bounds.height());
+
+        layerNode->getSkiaLayer()->hasRenderedSinceRepaint = false;
+        layerCanvas->clear(SK_ColorTRANSPARENT);
+
+        RenderNodeDrawable root(layerNode, layerCanvas, false);
+        root.forceDraw(layerCanvas);
+        recording.displayList = recorder.detach();
+    }
+    recording.recordTime = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    return recording;
+}
+
 void SkiaPipeline::renderLayersImpl(const LayerUpdateQueue& layers, bool opaque) {
     sk_sp<GrContext> cachedContext;
+    // cache the current context so that we can defer flushing it until
+    // either all the layers have been rendered or the context changes
+    auto deferFlush = [&cachedContext](SkSurface* layerSurface) {
+        GrContext* currentContext = layerSurface->getCanvas()->getGrContext();
+        if (cachedContext.get() != currentContext) {
+            if (cachedContext.get()) {
+                ATRACE_NAME("flush layers (context changed)");
+                cachedContext->flush();
+            }
+            cachedContext.reset(SkSafeRef(currentContext));
+        }
+    };
+
+    std::vector<OffThreadLayer> offThreadLayers;
+    nsecs_t offThreadRecordTime = 0;
+    nsecs_t offThreadWaitTime = 0;
+    auto drawOffThreadLayers = [&]() {
+        for (auto& layer : offThreadLayers) {
+            const nsecs_t waitStart = systemTime(SYSTEM_TIME_MONOTONIC);
+            OffThreadLayer::Recording recording = layer.recording.get();
+            offThreadWaitTime += systemTime(SYSTEM_TIME_MONOTONIC) - waitStart;
+            offThreadRecordTime += recording.recordTime;
+            if (recording.displayList) {
+                ATRACE_NAME("drawLayer (recorded off thread)");
+                layer.surface->draw(recording.displayList.get());
+                deferFlush(layer.surface.get());
+            }
+        }
+        offThreadLayers.clear();
+    };
 
     // Render all layers that need to be updated, in order.
     for (size_t i = 0; i < layers.entries().size(); i++) {
@@ -101,13 +180,31 @@ void SkiaPipeline::renderLayersImpl(const LayerUpdateQueue& layers, bool opaque)
         if (CC_LIKELY(layerNode->getLayerSurface() != nullptr)) {
             SkASSERT(layerNode->getLayerSurface());
             SkiaDisplayList* displayList = (SkiaDisplayList*)layerNode->getDisplayList();
+
+            const Rect& layerDamage = layers.entries()[i].damage;
+
+            if (CC_UNLIKELY(canRecordLayersOffThread()) && displayList &&
+                !displayList->isEmpty() && layerNode->canDrawContentOffThread()) {
+                SkSurfaceCharacterization characterization;
+                if (layerNode->getLayerSurface()->characterize(&characterization)) {
+                    OffThreadLayer layer;
+                    layer.surface = sk_ref_sp(layerNode->getLayerSurface());
+                    layer.recording = CommonPool::async([layerNode, layerDamage,
+                                                         characterization]() {
+                        return recordLayer(layerNode, layerDamage, characterization);
+                    });
+                    offThreadLayers.push_back(std::move(layer));
+                    continue;
+                }
+            }
+            // The layer may draw the ones before it in the queue, which have to be up to date.
+            drawOffThreadLayers();
+
             if (!displayList || displayList->isEmpty()) {
                 SkDEBUGF(("%p drawLayers(%s) : missing drawable", layerNode, layerNode->getName()));
                 return;
             }
 
-            const Rect& layerDamage = layers.entries()[i].damage;
-
             SkCanvas* layerCanvas = layerNode->getLayerSurface()->getCanvas();
 
             int saveCount = layerCanvas->save();
@@ -136,18 +233,15 @@ void SkiaPipeline::renderLayersImpl(const LayerUpdateQueue& layers, bool opaque)
             layerCanvas->restoreToCount(saveCount);
             mLightCenter = savedLightCenter;
 
-            // cache the current context so that we can defer flushing it until
-            // either all the layers have been rendered or the context changes
-            GrContext* currentContext = layerNode->getLayerSurface()->getCanvas()->getGrContext();
-            if (cachedContext.get() != currentContext) {
-                if (cachedContext.get()) {
-                    ATRACE_NAME("flush layers (context changed)");
-                    cachedContext->flush();
-                }
-                cachedContext.reset(SkSafeRef(currentContext));
-            }
+            deferFlush(layerNode->getLayerSurface());
         }
     }
+    drawOffThreadLayers();
+    if (offThreadRecordTime) {
+        // The RenderThread time saved by recording layers off thread, this frame
+        ATRACE_INT("OffThreadLayersSavedUs",
+                   static_cast<int32_t>(ns2us(offThreadRecordTime - offThreadWaitTime)));
+    }
 
     if (cachedContext.get()) {
         ATRACE_NAME("flush layers");
@@ -168,9 +262,11 @@ bool SkiaPipeline::createOrUpdateLayer(RenderNode* node, const DamageAccumulator
                                  kPremul_SkAlphaType, getSurfaceColorSpace());
         SkSurfaceProps props(0, kUnknown_SkPixelGeometry);
         SkASSERT(mRenderThread.getGrContext() != nullptr);
-        node->setLayerSurface(SkSurface::MakeRenderTarget(mRenderThread.getGrContext(),
-                                                          SkBudgeted::kYes, info, 0,
-                                                          this->getSurfaceOrigin(), &props));
+        sk_sp<SkSurface> previousLayer = sk_ref_sp(layer);
+        node->setLayerSurface(mRenderThread.cacheManager().acquireLayerSurface(
+                info, this->getSurfaceOrigin(), props));
+        mRenderThread.cacheManager().recycleLayerSurface(std::move(previousLayer),
+                                                         this->getSurfaceOrigin());
         if (node->getLayerSurface()) {
             // update the transform in window of the layer to reset its origin wrt light source
             // position
@@ -215,6 +311,9 @@ void SkiaPipeline::renderVectorDrawableCache() {
         auto grContext = mRenderThread.getGrContext();
         atlas->prepareForDraw(grContext);
         ATRACE_NAME("Update VectorDrawables");
+        if (Properties::parallelVectorDrawables) {
+            rasterizeVectorDrawables();
+        }
         for (auto vd : mVectorDrawables) {
             vd->updateCache(atlas, grContext);
         }
@@ -222,6 +321,35 @@ void SkiaPipeline::renderVectorDrawableCache() {
     }
 }
 
+void SkiaPipeline::rasterizeVectorDrawables() {
+    // A tree drawn more than once in the frame must only be handed to one thread.
+    std::vector<VectorDrawableRoot*> dirtyTrees;
+    for (auto vd : mVectorDrawables) {
+        if (vd->isDirty()) {
+            dirtyTrees.push_back(vd);
+        }
+    }
+    std::sort(dirtyTrees.begin(), dirtyTrees.end());
+    dirtyTrees.erase(std::unique(dirtyTrees.begin(), dirtyTrees.end()), dirtyTrees.end());
+    if (dirtyTrees.size() < 2) {
+        return;
+    }
+    ATRACE_FORMAT("Rasterize %zu VectorDrawables", dirtyTrees.size());
+    // Every CommonPool thread takes a share of the trees, and so does this thread.
+    constexpr size_t shareCount = CommonPool::THREAD_COUNT + 1;
+    auto rasterizeShare = [&dirtyTrees](size_t share) {
+        for (size_t i = share; i < dirtyTrees.size(); i += shareCount) {
+            dirtyTrees[i]->rasterizeCacheIfDirty();
+        }
+    };
+    CommonPool::Group group;
+    for (size_t share = 1; share < shareCount && share < dirtyTrees.size(); share++) {
+        group.post([&rasterizeShare, share] { rasterizeShare(share); });
+    }
+    rasterizeShare(0);
+    group.wait();
+}
+
 static void savePictureAsync(const sk_sp<SkData>& data, const std::string& filename) {
     CommonPool::post([data, filename] {
         if (0 == access(filename.c_str(), F_OK)) {
@@ -289,7 +417,7 @@ void SkiaPipeline::endCapture(SkSurface* surface) {
     }
 }
 
-void SkiaPipeline::renderFrame(const LayerUpdateQueue& layers, const SkRect& clip,
+void SkiaPipeline::renderFrame(const LayerUpdateQueue& layers, const DamageRects& clip,
                                const std::vector<sp<RenderNode>>& nodes, bool opaque,
                                const Rect& contentDrawBounds, sk_sp<SkSurface> surface,
                                const SkMatrix& preTransform) {
@@ -329,12 +457,22 @@ static Rect nodeBounds(RenderNode& node) {
 }
 }  // namespace
 
-void SkiaPipeline::renderFrameImpl(const LayerUpdateQueue& layers, const SkRect& clip,
+void SkiaPipeline::renderFrameImpl(const LayerUpdateQueue& layers, const DamageRects& clip,
                                    const std::vector<sp<RenderNode>>& nodes, bool opaque,
                                    const Rect& contentDrawBounds, SkCanvas* canvas,
                                    const SkMatrix& preTransform) {
     SkAutoCanvasRestore saver(canvas, true);
-    canvas->androidFramework_setDeviceClipRestriction(preTransform.mapRect(clip).roundOut());
+    canvas->androidFramework_setDeviceClipRestriction(
+            preTransform.mapRect(clip.bounds()).roundOut());
+    if (clip.count() > 1) {
+        // Clip to the damage itself rather than its bounds, so that updates far apart don't
+        // repaint everything in between
+        SkRegion region;
+        for (const SkRect& rect : clip) {
+            region.op(preTransform.mapRect(rect).roundOut(), SkRegion::kUnion_Op);
+        }
+        canvas->clipRegion(region);
+    }
     canvas->concat(preTransform);
 
     // STOPSHIP: Revert, temporary workaround to clear always F16 frame buffer for b/74976293
@@ -481,7 +619,7 @@ static const uint32_t kOverdrawColors[2][6] = {
         },
 };
 
-void SkiaPipeline::renderOverdraw(const LayerUpdateQueue& layers, const SkRect& clip,
+void SkiaPipeline::renderOverdraw(const LayerUpdateQueue& layers, const DamageRects& clip,
                                   const std::vector<sp<RenderNode>>& nodes,
                                   const Rect& contentDrawBounds, sk_sp<SkSurface> surface,
                                   const SkMatrix& preTransform) {
@@ -49,7 +49,7 @@ public:
     SkColorType getSurfaceColorType() const override { return mSurfaceColorType; }
     sk_sp<SkColorSpace> getSurfaceColorSpace() override { return mSurfaceColorSpace; }
 
-    void renderFrame(const LayerUpdateQueue& layers, const SkRect& clip,
+    void renderFrame(const LayerUpdateQueue& layers, const DamageRects& clip,
                      const std::vector<sp<RenderNode>>& nodes, bool opaque,
                      const Rect& contentDrawBounds, sk_sp<SkSurface> surface,
                      const SkMatrix& preTransform);
@@ -109,6 +109,12 @@ public:
     }
 
 protected:
+    /**
+     * Whether renderLayersImpl() may record the layers that allow it on CommonPool threads, see
+     * RenderNode::canDrawContentOffThread(). Requires deferred display list support.
+     */
+    virtual bool canRecordLayersOffThread() const { return false; }
+
     void dumpResourceCacheUsage() const;
     void setSurfaceColorProperties(renderthread::ColorMode colorMode);
 
@@ -117,7 +123,7 @@ protected:
     sk_sp<SkColorSpace> mSurfaceColorSpace;
 
 private:
-    void renderFrameImpl(const LayerUpdateQueue& layers, const SkRect& clip,
+    void renderFrameImpl(const LayerUpdateQueue& layers, const DamageRects& clip,
                          const std::vector<sp<RenderNode>>& nodes, bool opaque,
                          const Rect& contentDrawBounds, SkCanvas* canvas,
                          const SkMatrix& preTransform);
@@ -126,7 +132,7 @@ private:
      *  Debugging feature.  Draws a semi-transparent overlay on each pixel, indicating
      *  how many times it has been drawn.
      */
-    void renderOverdraw(const LayerUpdateQueue& layers, const SkRect& clip,
+    void renderOverdraw(const LayerUpdateQueue& layers, const DamageRects& clip,
                         const std::vector<sp<RenderNode>>& nodes, const Rect& contentDrawBounds,
                         sk_sp<SkSurface> surface, const SkMatrix& preTransform);
 
@@ -135,6 +141,12 @@ private:
      */
     void renderVectorDrawableCache();
 
+    /**
+     *  Redraw the bitmap caches of the dirty mVectorDrawables on CommonPool threads, leaving the
+     *  uploads to renderVectorDrawableCache.
+     */
+    void rasterizeVectorDrawables();
+
     SkCanvas* tryCapture(SkSurface* surface);
     void endCapture(SkSurface* surface);
 
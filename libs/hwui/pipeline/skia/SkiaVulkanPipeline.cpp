@@ -59,8 +59,8 @@ Frame SkiaVulkanPipeline::getFrame() {
     return mVkManager.dequeueNextBuffer(mVkSurface);
 }
 
-bool SkiaVulkanPipeline::draw(const Frame& frame, const SkRect& screenDirty, const SkRect& dirty,
-                              const LightGeometry& lightGeometry,
+bool SkiaVulkanPipeline::draw(const Frame& frame, const SkRect& screenDirty,
+                              const DamageRects& dirty, const LightGeometry& lightGeometry,
                               LayerUpdateQueue* layerUpdateQueue, const Rect& contentDrawBounds,
                               bool opaque, const LightInfo& lightInfo,
                               const std::vector<sp<RenderNode>>& renderNodes,
@@ -93,7 +93,8 @@ bool SkiaVulkanPipeline::draw(const Frame& frame, const SkRect& screenDirty, con
 }
 
 bool SkiaVulkanPipeline::swapBuffers(const Frame& frame, bool drew, const SkRect& screenDirty,
-                                     FrameInfo* currentFrameInfo, bool* requireSwap) {
+                                     FrameInfo* currentFrameInfo, bool* requireSwap,
+                                     sp<Fence>* frameFence) {
     *requireSwap = drew;
 
     // Even if we decided to cancel the frame, from the perspective of jank
@@ -101,7 +102,7 @@ bool SkiaVulkanPipeline::swapBuffers(const Frame& frame, bool drew, const SkRect
     currentFrameInfo->markSwapBuffers();
 
     if (*requireSwap) {
-        mVkManager.swapBuffers(mVkSurface, screenDirty);
+        mVkManager.swapBuffers(mVkSurface, screenDirty, frameFence);
     }
 
     return *requireSwap;
@@ -33,14 +33,15 @@ public:
 
     renderthread::MakeCurrentResult makeCurrent() override;
     renderthread::Frame getFrame() override;
-    bool draw(const renderthread::Frame& frame, const SkRect& screenDirty, const SkRect& dirty,
-              const LightGeometry& lightGeometry, LayerUpdateQueue* layerUpdateQueue,
-              const Rect& contentDrawBounds, bool opaque, const LightInfo& lightInfo,
-              const std::vector<sp<RenderNode> >& renderNodes,
+    bool draw(const renderthread::Frame& frame, const SkRect& screenDirty,
+              const DamageRects& dirty, const LightGeometry& lightGeometry,
+              LayerUpdateQueue* layerUpdateQueue, const Rect& contentDrawBounds, bool opaque,
+              const LightInfo& lightInfo, const std::vector<sp<RenderNode> >& renderNodes,
               FrameInfoVisualizer* profiler) override;
     GrSurfaceOrigin getSurfaceOrigin() override { return kTopLeft_GrSurfaceOrigin; }
     bool swapBuffers(const renderthread::Frame& frame, bool drew, const SkRect& screenDirty,
-                     FrameInfo* currentFrameInfo, bool* requireSwap) override;
+                     FrameInfo* currentFrameInfo, bool* requireSwap,
+                     sp<Fence>* frameFence) override;
     DeferredLayerUpdater* createTextureLayer() override;
     bool setSurface(ANativeWindow* surface, renderthread::SwapBehavior swapBehavior,
                     renderthread::ColorMode colorMode, uint32_t extraBuffers) override;
@@ -54,6 +55,7 @@ public:
 
 protected:
     void onContextDestroyed() override;
+    bool canRecordLayersOffThread() const override { return Properties::offThreadLayers; }
 
 private:
     renderthread::VulkanManager& mVkManager;
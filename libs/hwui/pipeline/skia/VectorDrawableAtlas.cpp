@@ -52,16 +52,22 @@ void VectorDrawableAtlas::prepareForDraw(GrContext* context) {
 
 #define MAX_CONSECUTIVE_FAILURES 5
 #define MAX_UNUSED_RATIO 2.0f
+#define MIN_ALLOCATED_RATIO 0.75f
 
 bool VectorDrawableAtlas::isFragmented() {
-    return mConsecutiveFailures > MAX_CONSECUTIVE_FAILURES &&
-           mPixelUsedByVDs * MAX_UNUSED_RATIO < mPixelAllocated;
+    if (mPixelUsedByVDs * MAX_UNUSED_RATIO >= mPixelAllocated) {
+        return false;
+    }
+    return mConsecutiveFailures > MAX_CONSECUTIVE_FAILURES ||
+           mPixelAllocated > mWidth * mHeight * MIN_ALLOCATED_RATIO;
 }
 
 void VectorDrawableAtlas::repackIfNeeded(GrContext* context) {
-    // We repackage when atlas failed to allocate space MAX_CONSECUTIVE_FAILURES consecutive
-    // times and the atlas allocated pixels are at least MAX_UNUSED_RATIO times higher than pixels
-    // used by atlas VDs.
+    // We repackage when the atlas allocated pixels are at least MAX_UNUSED_RATIO times higher
+    // than pixels used by atlas VDs, and either the atlas failed to allocate space
+    // MAX_CONSECUTIVE_FAILURES consecutive times or MIN_ALLOCATED_RATIO of the atlas has been
+    // allocated. The latter repacks a fragmented atlas before new VDs have to fall back to
+    // standalone surfaces.
     if (isFragmented() && mSurface) {
         repack(context);
     }
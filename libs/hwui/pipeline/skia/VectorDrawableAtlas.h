@@ -78,7 +78,9 @@ public:
     void repackIfNeeded(GrContext* context);
 
     /**
-     * Returns true if atlas is fragmented and repack is needed.
+     * Returns true if atlas is fragmented and repack is needed. That is the case once most of the
+     * allocated area has been released, and the atlas either is almost fully allocated or has
+     * been failing to allocate new rectangles.
      */
     bool isFragmented();
 
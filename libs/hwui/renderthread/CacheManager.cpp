@@ -19,15 +19,21 @@
 #include "Layer.h"
 #include "Properties.h"
 #include "RenderThread.h"
+#include "hwui/AnimatedImageThread.h"
+#include "hwui/TextBlobCache.h"
 #include "pipeline/skia/ShaderCache.h"
 #include "pipeline/skia/SkiaMemoryTracer.h"
 #include "renderstate/RenderState.h"
 #include "thread/CommonPool.h"
+#include "utils/LinearAllocator.h"
+#include "utils/TimeUtils.h"
+#include "utils/TraceUtils.h"
 
 #include <GrContextOptions.h>
 #include <SkExecutor.h>
 #include <SkGraphics.h>
 #include <SkMathPriv.h>
+#include <cutils/properties.h>
 #include <gui/Surface.h>
 #include <math.h>
 #include <set>
@@ -43,10 +49,29 @@ namespace renderthread {
 #define SURFACE_SIZE_MULTIPLIER (12.0f * 4.0f)
 #define BACKGROUND_RETENTION_PERCENTAGE (0.5f)
 
-CacheManager::CacheManager(const DisplayInfo& display)
+// Limits of the adaptive resource budget. Low RAM devices never go above the default budget.
+#define ADAPTIVE_BUDGET_MAX_MULTIPLIER (2.0f)
+#define ADAPTIVE_BUDGET_STEP_PERCENTAGE (0.25f)
+// The budget grows when a frame ends with the cache at least this full.
+#define ADAPTIVE_BUDGET_FULL_PERCENTAGE (0.9f)
+// Frames have to stop for this long before the cache is trimmed, which then happens in steps of
+// IDLE_TRIM_STEP_PERCENTAGE of the default budget, about one per vsync.
+#define IDLE_TRIM_DELAY 1_s
+#define IDLE_TRIM_INTERVAL 16_ms
+#define IDLE_TRIM_STEP_PERCENTAGE (0.1f)
+// How long the surface of a destroyed layer stays in the pool, and how much can be kept there.
+#define LAYER_POOL_TIMEOUT 3_s
+#define LAYER_POOL_SURFACE_PERCENTAGE (1.0f)
+
+CacheManager::CacheManager(const DisplayInfo& display, WorkQueue& queue)
         : mMaxSurfaceArea(display.w * display.h)
         , mMaxResourceBytes(mMaxSurfaceArea * SURFACE_SIZE_MULTIPLIER)
         , mBackgroundResourceBytes(mMaxResourceBytes * BACKGROUND_RETENTION_PERCENTAGE)
+        , mMaxAdaptiveResourceBytes(property_get_bool("ro.config.low_ram", false)
+                                            ? mMaxResourceBytes
+                                            : mMaxResourceBytes * ADAPTIVE_BUDGET_MAX_MULTIPLIER)
+        , mResourceBudgetBytes(mMaxResourceBytes)
+        , mQueue(queue)
         // This sets the maximum size for a single texture atlas in the GPU font cache. If
         // necessary, the cache can allocate additional textures that are counted against the
         // total cache limits provided to Skia.
@@ -54,7 +79,8 @@ CacheManager::CacheManager(const DisplayInfo& display)
         // This sets the maximum size of the CPU font cache to be at least the same size as the
         // total number of GPU font caches (i.e. 4 separate GPU atlases).
         , mMaxCpuFontCacheBytes(std::max(mMaxGpuFontAtlasBytes*4, SkGraphics::GetFontCacheLimit()))
-        , mBackgroundCpuFontCacheBytes(mMaxCpuFontCacheBytes * BACKGROUND_RETENTION_PERCENTAGE) {
+        , mBackgroundCpuFontCacheBytes(mMaxCpuFontCacheBytes * BACKGROUND_RETENTION_PERCENTAGE)
+        , mLayerPool(mMaxSurfaceArea * 4 * LAYER_POOL_SURFACE_PERCENTAGE) {
 
     SkGraphics::SetFontCacheLimit(mMaxCpuFontCacheBytes);
 
@@ -71,12 +97,14 @@ void CacheManager::reset(sk_sp<GrContext> context) {
     if (context) {
         mGrContext = std::move(context);
         mGrContext->getResourceCacheLimits(&mMaxResources, nullptr);
+        mResourceBudgetBytes = mMaxResourceBytes;
         mGrContext->setResourceCacheLimits(mMaxResources, mMaxResourceBytes);
     }
 }
 
 void CacheManager::destroy() {
     // cleanup any caches here as the GrContext is about to go away...
+    mLayerPool.clear();
     mGrContext.reset(nullptr);
     mVectorDrawableAtlas = new skiapipeline::VectorDrawableAtlas(
             mMaxSurfaceArea / 2,
@@ -98,16 +126,24 @@ void CacheManager::configureContext(GrContextOptions* contextOptions, const void
 
     auto& cache = skiapipeline::ShaderCache::get();
     cache.initShaderDiskCache(identity, size);
+    cache.warmUp();
     contextOptions->fPersistentCache = &cache;
     contextOptions->fGpuPathRenderers &= ~GpuPathRenderers::kCoverageCounting;
 }
 
 void CacheManager::trimMemory(TrimMemoryMode mode) {
+    LinearAllocator::trimPagePool();
+    TextBlobCache::get().clear();
+    if (Properties::animatedImagePrefetchFrames > 0) {
+        AnimatedImageThread::getInstance().trimMemory();
+    }
+
     if (!mGrContext) {
         return;
     }
 
     mGrContext->flush();
+    mLayerPool.clear();
 
     switch (mode) {
         case TrimMemoryMode::Complete:
@@ -120,6 +156,7 @@ void CacheManager::trimMemory(TrimMemoryMode mode) {
             // limits between the background and max amounts. This causes the unlocked resources
             // that have persistent data to be purged in LRU order.
             mGrContext->purgeUnlockedResources(true);
+            mResourceBudgetBytes = mMaxResourceBytes;
             mGrContext->setResourceCacheLimits(mMaxResources, mBackgroundResourceBytes);
             mGrContext->setResourceCacheLimits(mMaxResources, mMaxResourceBytes);
             SkGraphics::SetFontCacheLimit(mBackgroundCpuFontCacheBytes);
@@ -140,6 +177,70 @@ void CacheManager::trimStaleResources() {
     mGrContext->purgeResourcesNotUsedInMs(std::chrono::seconds(30));
 }
 
+void CacheManager::onFrameCompleted() {
+    if (!mGrContext || !Properties::adaptiveCacheBudget) {
+        return;
+    }
+    size_t usage;
+    mGrContext->getResourceCacheUsage(nullptr, &usage);
+    mHighWaterResourceBytes = std::max(mHighWaterResourceBytes, usage);
+    if (usage >= mResourceBudgetBytes * ADAPTIVE_BUDGET_FULL_PERCENTAGE &&
+        mResourceBudgetBytes < mMaxAdaptiveResourceBytes) {
+        // The scene is likely evicting resources it still uses, give it more room.
+        setResourceBudget(std::min(mMaxAdaptiveResourceBytes,
+                                   mResourceBudgetBytes + static_cast<size_t>(
+                                           mMaxResourceBytes * ADAPTIVE_BUDGET_STEP_PERCENTAGE)));
+    }
+    mLastFrameCompleted = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (!mIdleTrimPending) {
+        scheduleIdleTrim(IDLE_TRIM_DELAY);
+    }
+}
+
+void CacheManager::setResourceBudget(size_t bytes) {
+    ATRACE_INT("ResourceBudgetKB", bytes / 1024);
+    mResourceBudgetBytes = bytes;
+    mGrContext->setResourceCacheLimits(mMaxResources, bytes);
+}
+
+void CacheManager::scheduleIdleTrim(nsecs_t delay) {
+    mIdleTrimPending = true;
+    mQueue.postDelayed(delay, [this]() { idleTrim(); });
+}
+
+void CacheManager::idleTrim() {
+    mIdleTrimPending = false;
+    if (!mGrContext) {
+        return;
+    }
+    nsecs_t idleTime = systemTime(SYSTEM_TIME_MONOTONIC) - mLastFrameCompleted;
+    if (idleTime < IDLE_TRIM_DELAY) {
+        scheduleIdleTrim(IDLE_TRIM_DELAY - idleTime);
+        return;
+    }
+
+    // Every step releases a bounded amount of memory, so no single one stalls the thread the
+    // way purging down to the background budget at once would.
+    ATRACE_NAME("CacheManager::idleTrim");
+    const size_t stepBytes = mMaxResourceBytes * IDLE_TRIM_STEP_PERCENTAGE;
+    if (mResourceBudgetBytes > mMaxResourceBytes) {
+        setResourceBudget(std::max(mMaxResourceBytes, mResourceBudgetBytes - stepBytes));
+        scheduleIdleTrim(IDLE_TRIM_INTERVAL);
+        return;
+    }
+    size_t usage;
+    mGrContext->getResourceCacheUsage(nullptr, &usage);
+    if (usage > mBackgroundResourceBytes) {
+        mGrContext->purgeUnlockedResources(std::min(stepBytes, usage - mBackgroundResourceBytes),
+                                           true /* preferScratchResources */);
+        size_t newUsage;
+        mGrContext->getResourceCacheUsage(nullptr, &newUsage);
+        if (newUsage < usage) {
+            scheduleIdleTrim(IDLE_TRIM_INTERVAL);
+        }
+    }
+}
+
 sp<skiapipeline::VectorDrawableAtlas> CacheManager::acquireVectorDrawableAtlas() {
     LOG_ALWAYS_FATAL_IF(mVectorDrawableAtlas.get() == nullptr);
     LOG_ALWAYS_FATAL_IF(mGrContext == nullptr);
@@ -150,6 +251,37 @@ sp<skiapipeline::VectorDrawableAtlas> CacheManager::acquireVectorDrawableAtlas()
     return mVectorDrawableAtlas;
 }
 
+sk_sp<SkSurface> CacheManager::acquireLayerSurface(const SkImageInfo& info, GrSurfaceOrigin origin,
+                                                   const SkSurfaceProps& props) {
+    LOG_ALWAYS_FATAL_IF(mGrContext == nullptr);
+    if (!Properties::layerPool) {
+        return SkSurface::MakeRenderTarget(mGrContext.get(), SkBudgeted::kYes, info, 0, origin,
+                                           &props);
+    }
+    return mLayerPool.acquire(mGrContext.get(), info, origin, props);
+}
+
+void CacheManager::recycleLayerSurface(sk_sp<SkSurface> surface, GrSurfaceOrigin origin) {
+    if (!Properties::layerPool || !mGrContext) {
+        return;
+    }
+    mLayerPool.release(std::move(surface), origin, systemTime(SYSTEM_TIME_MONOTONIC));
+    if (mLayerPool.size() && !mLayerPoolTrimPending) {
+        mLayerPoolTrimPending = true;
+        mQueue.postDelayed(LAYER_POOL_TIMEOUT, [this]() { trimLayerPool(); });
+    }
+}
+
+void CacheManager::trimLayerPool() {
+    mLayerPoolTrimPending = false;
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    nsecs_t nextExpiry = mLayerPool.trim(now, LAYER_POOL_TIMEOUT);
+    if (nextExpiry) {
+        mLayerPoolTrimPending = true;
+        mQueue.postDelayed(nextExpiry - now, [this]() { trimLayerPool(); });
+    }
+}
+
 void CacheManager::dumpMemoryUsage(String8& log, const RenderState* renderState) {
     if (!mGrContext) {
         log.appendFormat("No valid cache instance.\n");
@@ -176,10 +308,20 @@ void CacheManager::dumpMemoryUsage(String8& log, const RenderState* renderState)
     mGrContext->dumpMemoryStatistics(&gpuTracer);
     gpuTracer.logOutput(log);
 
+    if (Properties::adaptiveCacheBudget) {
+        log.appendFormat("  Budget: %.2f KB (default %.2f KB), high water mark %.2f KB\n",
+                         mResourceBudgetBytes / 1024.0f, mMaxResourceBytes / 1024.0f,
+                         mHighWaterResourceBytes / 1024.0f);
+        mHighWaterResourceBytes = 0;
+    }
+
     log.appendFormat("Other Caches:\n");
     log.appendFormat("                         Current / Maximum\n");
     log.appendFormat("  VectorDrawableAtlas  %6.2f kB / %6.2f KB (entries = %zu)\n", 0.0f, 0.0f,
                      (size_t)0);
+    if (Properties::layerPool) {
+        mLayerPool.dump(log);
+    }
 
     if (renderState) {
         if (renderState->mActiveLayers.size() > 0) {
@@ -203,6 +345,10 @@ void CacheManager::dumpMemoryUsage(String8& log, const RenderState* renderState)
 
     log.appendFormat("Total GPU memory usage:\n");
     gpuTracer.logTotals(log);
+
+    skiapipeline::ShaderCache::get().dump(log);
+    TextBlobCache::get().dump(log);
+    LinearAllocator::dumpPageStats(log);
 }
 
 } /* namespace renderthread */
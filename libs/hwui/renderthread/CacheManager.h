@@ -23,7 +23,9 @@
 #include <utils/String8.h>
 #include <vector>
 
+#include "pipeline/skia/LayerPool.h"
 #include "pipeline/skia/VectorDrawableAtlas.h"
+#include "thread/WorkQueue.h"
 
 namespace android {
 
@@ -45,21 +47,35 @@ public:
     void configureContext(GrContextOptions* context, const void* identity, ssize_t size);
     void trimMemory(TrimMemoryMode mode);
     void trimStaleResources();
+    void onFrameCompleted();
     void dumpMemoryUsage(String8& log, const RenderState* renderState = nullptr);
 
     sp<skiapipeline::VectorDrawableAtlas> acquireVectorDrawableAtlas();
 
+    /**
+     * Allocates the surface of a hardware layer. With Properties::layerPool, surfaces given back
+     * by recycleLayerSurface() are reused.
+     */
+    sk_sp<SkSurface> acquireLayerSurface(const SkImageInfo& info, GrSurfaceOrigin origin,
+                                         const SkSurfaceProps& props);
+    void recycleLayerSurface(sk_sp<SkSurface> surface, GrSurfaceOrigin origin);
+
     size_t getCacheSize() const { return mMaxResourceBytes; }
     size_t getBackgroundCacheSize() const { return mBackgroundResourceBytes; }
 
 private:
     friend class RenderThread;
 
-    explicit CacheManager(const DisplayInfo& display);
+    CacheManager(const DisplayInfo& display, WorkQueue& queue);
 
     void reset(sk_sp<GrContext> grContext);
     void destroy();
 
+    void setResourceBudget(size_t bytes);
+    void scheduleIdleTrim(nsecs_t delay);
+    void idleTrim();
+    void trimLayerPool();
+
     const size_t mMaxSurfaceArea;
     sk_sp<GrContext> mGrContext;
 
@@ -67,6 +83,16 @@ private:
     const size_t mMaxResourceBytes;
     const size_t mBackgroundResourceBytes;
 
+    // With Properties::adaptiveCacheBudget, the resource cache limit moves between
+    // mMaxResourceBytes and mMaxAdaptiveResourceBytes, following the usage of recent frames.
+    const size_t mMaxAdaptiveResourceBytes;
+    size_t mResourceBudgetBytes;
+    // Highest resource cache usage seen at the end of a frame since the last dump.
+    size_t mHighWaterResourceBytes = 0;
+    nsecs_t mLastFrameCompleted = 0;
+    bool mIdleTrimPending = false;
+    WorkQueue& mQueue;
+
     const size_t mMaxGpuFontAtlasBytes;
     const size_t mMaxCpuFontCacheBytes;
     const size_t mBackgroundCpuFontCacheBytes;
@@ -77,6 +103,9 @@ private:
     };
 
     sp<skiapipeline::VectorDrawableAtlas> mVectorDrawableAtlas;
+
+    skiapipeline::LayerPool mLayerPool;
+    bool mLayerPoolTrimPending = false;
 };
 
 } /* namespace renderthread */
@@ -21,6 +21,7 @@
 #include "AnimationContext.h"
 #include "EglManager.h"
 #include "Frame.h"
+#include "FrameCounters.h"
 #include "LayerUpdateQueue.h"
 #include "Properties.h"
 #include "RenderThread.h"
@@ -50,6 +51,9 @@
 
 #define LOG_FRAMETIME_MMA 0
 
+// How many frames are rendered ahead after a slow frame with Properties::adaptiveRenderAhead.
+#define ADAPTIVE_RENDER_AHEAD_FRAMES 60
+
 #if LOG_FRAMETIME_MMA
 static float sBenchMma = 0;
 static int sFrameCount = 0;
@@ -156,7 +160,8 @@ void CanvasContext::setSurface(sp<Surface>&& surface, bool enableTimeout) {
         mNativeSurface = nullptr;
     }
 
-    if (mRenderAheadDepth == 0 && DeviceInfo::get()->getMaxRefreshRate() > 66.6f) {
+    if (mRenderAheadDepth == 0 &&
+        (DeviceInfo::get()->getMaxRefreshRate() > 66.6f || Properties::adaptiveRenderAhead)) {
         mFixedRenderAhead = false;
         mRenderAheadCapacity = 1;
     } else {
@@ -169,6 +174,7 @@ void CanvasContext::setSurface(sp<Surface>&& surface, bool enableTimeout) {
                                                   mRenderAheadCapacity);
 
     mFrameNumber = -1;
+    mPacedFramesLeft = 0;
 
     if (hasSurface) {
         mHaveNewSurface = true;
@@ -320,6 +326,19 @@ void CanvasContext::prepareTree(TreeInfo& info, int64_t* uiFrameInfo, int64_t sy
     }
     mAnimationContext->runRemainingAnimations(info);
     GL_CHECKPOINT(MODERATE);
+    if (info.out.animationTime > 0) {
+        ATRACE_INT("AnimationTimeUs", static_cast<int32_t>(ns2us(info.out.animationTime)));
+    }
+
+    FrameCounters::add(FrameCounter::DisplayListOps, info.out.recordingCost.ops);
+
+    if (CC_UNLIKELY(mFrameMetricsReporter.get() != nullptr)) {
+        mCurrentFrameCost.animationTime = info.out.animationTime;
+        mCurrentFrameCost.total = info.out.recordingCost;
+        mCurrentFrameCost.costliestNode = info.out.costliestNodeCost;
+        mCurrentFrameCost.costliestNodeName =
+                info.out.costliestNode ? info.out.costliestNode->getName() : "";
+    }
 
     freePrefetchedLayers();
     GL_CHECKPOINT(MODERATE);
@@ -419,19 +438,38 @@ void CanvasContext::setPresentTime() {
     const auto frameIntervalNanos = mRenderThread.timeLord().frameIntervalNanos();
     if (mFixedRenderAhead) {
         renderAhead = std::min(mRenderAheadDepth, mRenderAheadCapacity);
-    } else if (frameIntervalNanos < 15_ms) {
+    } else if (frameIntervalNanos < 15_ms || mPacedFramesLeft > 0) {
         renderAhead = std::min(1, static_cast<int>(mRenderAheadCapacity));
     }
 
     if (renderAhead) {
         presentTime = mCurrentFrameInfo->get(FrameInfoIndex::Vsync) +
                 (frameIntervalNanos * (renderAhead + 1));
+        mCurrentFrameInfo->addFlag(FrameInfoFlags::RenderAhead);
     }
     native_window_set_buffers_timestamp(mNativeSurface.get(), presentTime);
 }
 
+void CanvasContext::updateFramePacing() {
+    if (mFixedRenderAhead || !Properties::adaptiveRenderAhead) {
+        return;
+    }
+    const nsecs_t frameIntervalNanos = mRenderThread.timeLord().frameIntervalNanos();
+    if (mCurrentFrameInfo->get(FrameInfoIndex::DequeueBufferDuration) > frameIntervalNanos / 2) {
+        // The queue is full, so frames are ahead of the display already. Rendering further
+        // ahead would only add latency.
+        mPacedFramesLeft = 0;
+    } else if (mCurrentFrameInfo->totalDuration() > frameIntervalNanos) {
+        // Give the next frames a buffer of one vsync to absorb another slow one.
+        mPacedFramesLeft = ADAPTIVE_RENDER_AHEAD_FRAMES;
+    } else if (mPacedFramesLeft > 0) {
+        mPacedFramesLeft--;
+    }
+    ATRACE_INT("PacedFramesLeft", mPacedFramesLeft);
+}
+
 void CanvasContext::draw() {
-    SkRect dirty;
+    DamageRects dirty;
     mDamageAccumulator.finish(&dirty);
 
     if (dirty.isEmpty() && Properties::skipEmptyFrames && !surfaceRequiresRedraw()) {
@@ -444,7 +482,8 @@ void CanvasContext::draw() {
     Frame frame = mRenderPipeline->getFrame();
     setPresentTime();
 
-    SkRect windowDirty = computeDirtyRect(frame, &dirty);
+    DamageRects windowDamage = computeDirtyRect(frame, &dirty);
+    SkRect windowDirty = windowDamage.bounds();
 
     bool drew = mRenderPipeline->draw(frame, windowDirty, dirty, mLightGeometry, &mLayerUpdateQueue,
                                       mContentDrawBounds, mOpaque, mLightInfo, mRenderNodes,
@@ -455,8 +494,9 @@ void CanvasContext::draw() {
     waitOnFences();
 
     bool requireSwap = false;
-    bool didSwap =
-            mRenderPipeline->swapBuffers(frame, drew, windowDirty, mCurrentFrameInfo, &requireSwap);
+    sp<Fence> frameFence;
+    bool didSwap = mRenderPipeline->swapBuffers(frame, drew, windowDirty, mCurrentFrameInfo,
+                                                &requireSwap, &frameFence);
 
     mIsDirty = false;
 
@@ -465,7 +505,7 @@ void CanvasContext::draw() {
             setSurface(nullptr);
         }
         SwapHistory& swap = mSwapHistory.next();
-        swap.damage = windowDirty;
+        swap.damage = windowDamage;
         swap.swapCompletedTime = systemTime(CLOCK_MONOTONIC);
         swap.vsyncTime = mRenderThread.timeLord().latestVsync();
         if (mNativeSurface.get()) {
@@ -496,6 +536,10 @@ void CanvasContext::draw() {
 
     // TODO: Use a fence for real completion?
     mCurrentFrameInfo->markFrameCompleted();
+    if (requireSwap) {
+        updateFramePacing();
+    }
+    mRenderThread.cacheManager().onFrameCompleted();
 
 #if LOG_FRAMETIME_MMA
     float thisFrame = mCurrentFrameInfo->duration(FrameInfoIndex::IssueDrawCommandsStart,
@@ -520,11 +564,16 @@ void CanvasContext::draw() {
     }
 
     mJankTracker.finishFrame(*mCurrentFrameInfo);
+    if (didSwap) {
+        mJankTracker.finishGpuDraw(*mCurrentFrameInfo, std::move(frameFence));
+    }
     if (CC_UNLIKELY(mFrameMetricsReporter.get() != nullptr)) {
         mFrameMetricsReporter->reportFrameMetrics(mCurrentFrameInfo->data());
+        mFrameMetricsReporter->reportFrameCost(mCurrentFrameCost);
     }
 
     GpuMemoryTracker::onFrameCompleted();
+    FrameCounters::finishFrame(mCurrentFrameInfo->get(FrameInfoIndex::Vsync));
 }
 
 // Called by choreographer to do an RT-driven animation
@@ -603,6 +652,13 @@ void CanvasContext::buildLayer(RenderNode* node) {
     mPrefetchedLayers.insert(node);
 }
 
+void CanvasContext::recycleLayer(RenderNode* node) {
+    sk_sp<SkSurface> surface = sk_ref_sp(node->getLayerSurface());
+    node->setLayerSurface(nullptr);
+    mRenderThread.cacheManager().recycleLayerSurface(std::move(surface),
+                                                     mRenderPipeline->getSurfaceOrigin());
+}
+
 void CanvasContext::destroyHardwareResources() {
     stopDrawing();
     if (mRenderPipeline->isContextReady()) {
@@ -686,7 +742,7 @@ void CanvasContext::setRenderAheadDepth(int renderAhead) {
     mRenderAheadDepth = static_cast<uint32_t>(renderAhead);
 }
 
-SkRect CanvasContext::computeDirtyRect(const Frame& frame, SkRect* dirty) {
+DamageRects CanvasContext::computeDirtyRect(const Frame& frame, DamageRects* dirty) {
     if (frame.width() != mLastFrameWidth || frame.height() != mLastFrameHeight) {
         // can't rely on prior content of window if viewport size changes
         dirty->setEmpty();
@@ -696,22 +752,26 @@ SkRect CanvasContext::computeDirtyRect(const Frame& frame, SkRect* dirty) {
         // New surface needs a full draw
         dirty->setEmpty();
     } else {
-        if (!dirty->isEmpty() && !dirty->intersect(0, 0, frame.width(), frame.height())) {
-            ALOGW("Dirty " RECT_STRING " doesn't intersect with 0 0 %d %d ?", SK_RECT_ARGS(*dirty),
+        SkRect bounds = dirty->bounds();
+        if (!dirty->isEmpty() && !dirty->intersect(SkRect::MakeWH(frame.width(), frame.height()))) {
+            ALOGW("Dirty " RECT_STRING " doesn't intersect with 0 0 %d %d ?", SK_RECT_ARGS(bounds),
                   frame.width(), frame.height());
+        }
+        bounds = dirty->bounds();
+        profiler().unionDirty(&bounds);
+        if (bounds.isEmpty()) {
             dirty->setEmpty();
         }
-        profiler().unionDirty(dirty);
     }
 
     if (dirty->isEmpty()) {
-        dirty->set(0, 0, frame.width(), frame.height());
+        *dirty = SkRect::MakeWH(frame.width(), frame.height());
     }
 
     // At this point dirty is the area of the window to update. However,
     // the area of the frame we need to repaint is potentially different, so
     // stash the screen area for later
-    SkRect windowDirty(*dirty);
+    DamageRects windowDirty(*dirty);
 
     // If the buffer age is 0 we do a full-screen repaint (handled above)
     // If the buffer age is 1 the buffer contents are the same as they were
@@ -721,7 +781,7 @@ SkRect CanvasContext::computeDirtyRect(const Frame& frame, SkRect* dirty) {
         if (frame.bufferAge() > (int)mSwapHistory.size()) {
             // We don't have enough history to handle this old of a buffer
             // Just do a full-draw
-            dirty->set(0, 0, frame.width(), frame.height());
+            *dirty = SkRect::MakeWH(frame.width(), frame.height());
         } else {
             // At this point we haven't yet added the latest frame
             // to the damage history (happens below)
@@ -79,6 +79,12 @@ public:
         return mRenderPipeline->createOrUpdateLayer(node, dmgAccumulator, errorHandler);
     }
 
+    /**
+     * Detaches the layer of the provided RenderNode, handing its surface back to the
+     * CacheManager for a later layer to reuse.
+     */
+    void recycleLayer(RenderNode* node);
+
     /**
      * Pin any mutable images to the GPU cache. A pinned images is guaranteed to
      * remain in the cache until it has been unpinned. We leverage this feature
@@ -122,6 +128,8 @@ public:
     void setWideGamut(bool wideGamut);
     bool makeCurrent();
     void prepareTree(TreeInfo& info, int64_t* uiFrameInfo, int64_t syncQueued, RenderNode* target);
+    // Recorded in the FrameInfo of the frame prepared last.
+    void setUiThreadSyncWaits(int syncWaits) { mCurrentFrameInfo->setUiThreadSyncWaits(syncWaits); }
     void draw();
     void destroy();
 
@@ -213,8 +221,9 @@ private:
     bool isSwapChainStuffed();
     bool surfaceRequiresRedraw();
     void setPresentTime();
+    void updateFramePacing();
 
-    SkRect computeDirtyRect(const Frame& frame, SkRect* dirty);
+    DamageRects computeDirtyRect(const Frame& frame, DamageRects* dirty);
 
     EGLint mLastFrameWidth = 0;
     EGLint mLastFrameHeight = 0;
@@ -234,8 +243,10 @@ private:
     bool mFixedRenderAhead = false;
     uint32_t mRenderAheadDepth = 0;
     uint32_t mRenderAheadCapacity = 0;
+    // Frames left to render ahead with Properties::adaptiveRenderAhead, see updateFramePacing().
+    uint32_t mPacedFramesLeft = 0;
     struct SwapHistory {
-        SkRect damage;
+        DamageRects damage;
         nsecs_t vsyncTime;
         nsecs_t swapCompletedTime;
         nsecs_t dequeueDuration;
@@ -266,6 +277,8 @@ private:
     JankTracker mJankTracker;
     FrameInfoVisualizer mProfiler;
     std::unique_ptr<FrameMetricsReporter> mFrameMetricsReporter;
+    // Only kept up to date while mFrameMetricsReporter is set.
+    FrameCost mCurrentFrameCost;
 
     std::set<RenderNode*> mPrefetchedLayers;
 
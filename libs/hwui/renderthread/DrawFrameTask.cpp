@@ -19,8 +19,11 @@
 #include <utils/Log.h>
 #include <utils/Trace.h>
 
+#include <iterator>
+
 #include "../DeferredLayerUpdater.h"
 #include "../DisplayList.h"
+#include "../Properties.h"
 #include "../RenderNode.h"
 #include "CanvasContext.h"
 #include "RenderThread.h"
@@ -33,7 +36,8 @@ DrawFrameTask::DrawFrameTask()
         : mRenderThread(nullptr)
         , mContext(nullptr)
         , mContentDrawBounds(0, 0, 0, 0)
-        , mSyncResult(SyncResult::OK) {}
+        , mSyncResult(SyncResult::OK)
+        , mDeferredSyncResult(SyncResult::OK) {}
 
 DrawFrameTask::~DrawFrameTask() {}
 
@@ -81,9 +85,63 @@ void DrawFrameTask::postAndWait() {
     mSignal.wait(mLock);
 }
 
+// Results of a prepareTree(), and of the makeCurrent() before it.
+static int syncResultOf(CanvasContext* context, bool canDraw, TreeInfo& info) {
+    int result = SyncResult::OK;
+    // This is after the prepareTree so that any pending operations
+    // (RenderNode tree state, prefetched layers, etc...) will be flushed.
+    if (CC_UNLIKELY(!context->hasSurface() || !canDraw)) {
+        if (!context->hasSurface()) {
+            result |= SyncResult::LostSurfaceRewardIfFound;
+        } else {
+            // If we have a surface but can't draw we must be stopped
+            result |= SyncResult::ContextIsStopped;
+        }
+        info.out.canDrawThisFrame = false;
+    }
+
+    if (info.out.hasAnimations) {
+        if (info.out.requiresUiRedraw) {
+            result |= SyncResult::UIRedrawRequired;
+        }
+    }
+    if (!info.out.canDrawThisFrame) {
+        result |= SyncResult::FrameDropped;
+    }
+    return result;
+}
+
+static void finishFrame(CanvasContext* context, const std::function<void(int64_t)>& callback,
+                        bool canDrawThisFrame) {
+    // Even if we aren't drawing this vsync pulse the next frame number will still be accurate
+    if (CC_UNLIKELY(callback)) {
+        context->enqueueFrameWork(
+                [callback, frameNr = context->getFrameNumber()]() { callback(frameNr); });
+    }
+
+    if (CC_LIKELY(canDrawThisFrame)) {
+        context->draw();
+    } else {
+        // wait on fences so tasks don't overlap next frame
+        context->waitOnFences();
+    }
+}
+
 void DrawFrameTask::run() {
     ATRACE_NAME("DrawFrame");
 
+    // Reported late by the last frame that unblocked the UI thread before they were known.
+    mSyncResult |= mDeferredSyncResult;
+    mDeferredSyncResult = SyncResult::OK;
+
+    if (CC_UNLIKELY(Properties::publishPropertyOnlyFrames) && mTargetNode) {
+        const uint64_t publishedEpoch = RenderNode::publishPropertyOnlyChanges(mTargetNode);
+        if (publishedEpoch) {
+            runPublishedFrame(publishedEpoch);
+            return;
+        }
+    }
+
     bool canUnblockUiThread;
     bool canDrawThisFrame;
     {
@@ -107,26 +165,52 @@ void DrawFrameTask::run() {
         unblockUiThread();
     }
 
-    // Even if we aren't drawing this vsync pulse the next frame number will still be accurate
-    if (CC_UNLIKELY(callback)) {
-        context->enqueueFrameWork(
-                [callback, frameNr = context->getFrameNumber()]() { callback(frameNr); });
-    }
-
-    if (CC_LIKELY(canDrawThisFrame)) {
-        context->draw();
-    } else {
-        // wait on fences so tasks don't overlap next frame
-        context->waitOnFences();
-    }
+    finishFrame(context, callback, canDrawThisFrame);
 
     if (!canUnblockUiThread) {
         unblockUiThread();
     }
 }
 
-bool DrawFrameTask::syncFrameState(TreeInfo& info) {
+void DrawFrameTask::runPublishedFrame(uint64_t publishedEpoch) {
     ATRACE_CALL();
+    const bool canDraw = syncUiThreadState();
+    // Whatever is already known is reported now, the rest with the next frame.
+    if (!mContext->hasSurface()) {
+        mSyncResult |= SyncResult::LostSurfaceRewardIfFound | SyncResult::FrameDropped;
+    } else if (!canDraw) {
+        mSyncResult |= SyncResult::ContextIsStopped | SyncResult::FrameDropped;
+    }
+    const int reportedSyncResult = mSyncResult;
+
+    // Grab a copy of everything we need, the UI thread is going to record the next frame
+    CanvasContext* context = mContext;
+    sp<RenderNode> targetNode = mTargetNode;
+    int64_t frameInfo[UI_THREAD_FRAME_INFO_SIZE];
+    std::copy(std::begin(mFrameInfo), std::end(mFrameInfo), frameInfo);
+    const int64_t syncQueued = mSyncQueued;
+    const int syncWaits = mUiThreadSyncWaits;
+    std::function<void(int64_t)> callback = std::move(mFrameCallback);
+    mFrameCallback = nullptr;
+    if (mFrameCompleteCallback) {
+        context->addFrameCompleteListener(std::move(mFrameCompleteCallback));
+        mFrameCompleteCallback = nullptr;
+    }
+    int* deferredSyncResult = &mDeferredSyncResult;
+
+    // From this point on anything else in "this" is *UNSAFE TO ACCESS*
+    unblockUiThread();
+
+    TreeInfo info(TreeInfo::MODE_FULL, *context);
+    info.publishedEpoch = publishedEpoch;
+    context->prepareTree(info, frameInfo, syncQueued, targetNode.get());
+    context->setUiThreadSyncWaits(syncWaits);
+    *deferredSyncResult = syncResultOf(context, canDraw, info) & ~reportedSyncResult;
+
+    finishFrame(context, callback, info.out.canDrawThisFrame);
+}
+
+bool DrawFrameTask::syncUiThreadState() {
     int64_t vsync = mFrameInfo[static_cast<int>(FrameInfoIndex::Vsync)];
     mRenderThread->timeLord().vsyncReceived(vsync);
     bool canDraw = mContext->makeCurrent();
@@ -137,28 +221,15 @@ bool DrawFrameTask::syncFrameState(TreeInfo& info) {
     }
     mLayers.clear();
     mContext->setContentDrawBounds(mContentDrawBounds);
-    mContext->prepareTree(info, mFrameInfo, mSyncQueued, mTargetNode);
-
-    // This is after the prepareTree so that any pending operations
-    // (RenderNode tree state, prefetched layers, etc...) will be flushed.
-    if (CC_UNLIKELY(!mContext->hasSurface() || !canDraw)) {
-        if (!mContext->hasSurface()) {
-            mSyncResult |= SyncResult::LostSurfaceRewardIfFound;
-        } else {
-            // If we have a surface but can't draw we must be stopped
-            mSyncResult |= SyncResult::ContextIsStopped;
-        }
-        info.out.canDrawThisFrame = false;
-    }
+    return canDraw;
+}
 
-    if (info.out.hasAnimations) {
-        if (info.out.requiresUiRedraw) {
-            mSyncResult |= SyncResult::UIRedrawRequired;
-        }
-    }
-    if (!info.out.canDrawThisFrame) {
-        mSyncResult |= SyncResult::FrameDropped;
-    }
+bool DrawFrameTask::syncFrameState(TreeInfo& info) {
+    ATRACE_CALL();
+    bool canDraw = syncUiThreadState();
+    mContext->prepareTree(info, mFrameInfo, mSyncQueued, mTargetNode);
+    mContext->setUiThreadSyncWaits(mUiThreadSyncWaits);
+    mSyncResult |= syncResultOf(mContext, canDraw, info);
     // If prepareTextures is false, we ran out of texture cache space
     return info.prepareTextures;
 }
@@ -72,6 +72,9 @@ public:
 
     int64_t* frameInfo() { return mFrameInfo; }
 
+    // Times the UI thread blocked on the RenderThread since the last frame, see FrameInfo.
+    void setUiThreadSyncWaits(int syncWaits) { mUiThreadSyncWaits = syncWaits; }
+
     void run();
 
     void setFrameCallback(std::function<void(int64_t)>&& callback) {
@@ -84,6 +87,10 @@ public:
 
 private:
     void postAndWait();
+    // A frame in which the UI thread only changed RenderNode properties, which were published
+    // under publishedEpoch. Unblocks the UI thread before preparing the tree.
+    void runPublishedFrame(uint64_t publishedEpoch);
+    bool syncUiThreadState();
     bool syncFrameState(TreeInfo& info);
     void unblockUiThread();
 
@@ -101,7 +108,11 @@ private:
     std::vector<sp<DeferredLayerUpdater> > mLayers;
 
     int mSyncResult;
+    // Results of the last published frame that were not known yet when the UI thread was
+    // unblocked. Only touched on the RenderThread.
+    int mDeferredSyncResult;
     int64_t mSyncQueued;
+    int mUiThreadSyncWaits = 0;
 
     int64_t mFrameInfo[UI_THREAD_FRAME_INFO_SIZE];
 
@@ -434,12 +434,14 @@ Frame EglManager::beginFrame(EGLSurface surface) {
     return frame;
 }
 
-void EglManager::damageFrame(const Frame& frame, const SkRect& dirty) {
+void EglManager::damageFrame(const Frame& frame, const DamageRects& dirty) {
 #ifdef EGL_KHR_partial_update
     if (EglExtensions.setDamage && mSwapBehavior == SwapBehavior::BufferAge) {
-        EGLint rects[4];
-        frame.map(dirty, rects);
-        if (!eglSetDamageRegionKHR(mEglDisplay, frame.mSurface, rects, 1)) {
+        EGLint rects[4 * DamageRects::kMaxRects];
+        for (int i = 0; i < dirty.count(); i++) {
+            frame.map(dirty[i], rects + 4 * i);
+        }
+        if (!eglSetDamageRegionKHR(mEglDisplay, frame.mSurface, rects, dirty.count())) {
             LOG_ALWAYS_FATAL("Failed to set damage region on surface %p, error=%s",
                              (void*)frame.mSurface, eglErrorString());
         }
@@ -451,17 +453,32 @@ bool EglManager::damageRequiresSwap() {
     return EglExtensions.setDamage && mSwapBehavior == SwapBehavior::BufferAge;
 }
 
-bool EglManager::swapBuffers(const Frame& frame, const SkRect& screenDirty) {
+bool EglManager::swapBuffers(const Frame& frame, const SkRect& screenDirty,
+                             sp<Fence>* frameFence) {
     if (CC_UNLIKELY(Properties::waitForGpuCompletion)) {
         ATRACE_NAME("Finishing GPU work");
         fence();
     }
 
+    // The sync has to be created before the swap to cover the frame, but its fd only exists
+    // once the swap has flushed it.
+    EGLSyncKHR sync = EGL_NO_SYNC_KHR;
+    if (frameFence && SyncFeatures::getInstance().useNativeFenceSync()) {
+        sync = eglCreateSyncKHR(mEglDisplay, EGL_SYNC_NATIVE_FENCE_ANDROID, nullptr);
+    }
+
     EGLint rects[4];
     frame.map(screenDirty, rects);
     eglSwapBuffersWithDamageKHR(mEglDisplay, frame.mSurface, rects, screenDirty.isEmpty() ? 0 : 1);
 
     EGLint err = eglGetError();
+    if (sync != EGL_NO_SYNC_KHR) {
+        int fenceFd = eglDupNativeFenceFDANDROID(mEglDisplay, sync);
+        eglDestroySyncKHR(mEglDisplay, sync);
+        if (fenceFd != EGL_NO_NATIVE_FENCE_FD_ANDROID) {
+            *frameFence = new Fence(fenceFd);
+        }
+    }
     if (CC_LIKELY(err == EGL_SUCCESS)) {
         return true;
     }
@@ -58,12 +58,15 @@ public:
     // Returns true if the current surface changed, false if it was already current
     bool makeCurrent(EGLSurface surface, EGLint* errOut = nullptr, bool force = false);
     Frame beginFrame(EGLSurface surface);
-    void damageFrame(const Frame& frame, const SkRect& dirty);
+    void damageFrame(const Frame& frame, const DamageRects& dirty);
     // If this returns true it is mandatory that swapBuffers is called
     // if damageFrame is called without subsequent calls to damageFrame().
     // See EGL_KHR_partial_update for more information
     bool damageRequiresSwap();
-    bool swapBuffers(const Frame& frame, const SkRect& screenDirty);
+    // If frameFence is non-null it is set to a native fence covering the frame's rendering,
+    // when native fences are supported.
+    bool swapBuffers(const Frame& frame, const SkRect& screenDirty,
+                     sp<Fence>* frameFence = nullptr);
 
     // Returns true iff the surface is now preserving buffers.
     bool setPreserveBuffer(EGLSurface surface, bool preserve);
@@ -32,6 +32,8 @@ struct ANativeWindow;
 
 namespace android {
 
+class Fence;
+
 namespace uirenderer {
 
 class DeferredLayerUpdater;
@@ -58,13 +60,16 @@ class IRenderPipeline {
 public:
     virtual MakeCurrentResult makeCurrent() = 0;
     virtual Frame getFrame() = 0;
-    virtual bool draw(const Frame& frame, const SkRect& screenDirty, const SkRect& dirty,
+    virtual bool draw(const Frame& frame, const SkRect& screenDirty, const DamageRects& dirty,
                       const LightGeometry& lightGeometry, LayerUpdateQueue* layerUpdateQueue,
                       const Rect& contentDrawBounds, bool opaque, const LightInfo& lightInfo,
                       const std::vector<sp<RenderNode>>& renderNodes,
                       FrameInfoVisualizer* profiler) = 0;
+    // frameFence is set to a fence that signals when the GPU has finished the frame, if the
+    // backend could create one.
     virtual bool swapBuffers(const Frame& frame, bool drew, const SkRect& screenDirty,
-                             FrameInfo* currentFrameInfo, bool* requireSwap) = 0;
+                             FrameInfo* currentFrameInfo, bool* requireSwap,
+                             sp<Fence>* frameFence) = 0;
     virtual DeferredLayerUpdater* createTextureLayer() = 0;
     virtual bool setSurface(ANativeWindow* window, SwapBehavior swapBehavior, ColorMode colorMode,
                             uint32_t extraBuffers) = 0;
@@ -18,6 +18,7 @@
 
 #include "DeferredLayerUpdater.h"
 #include "DisplayList.h"
+#include "FrameCounters.h"
 #include "Properties.h"
 #include "Readback.h"
 #include "Rect.h"
@@ -29,16 +30,36 @@
 #include "renderthread/EglManager.h"
 #include "renderthread/RenderTask.h"
 #include "renderthread/RenderThread.h"
+#include "thread/CommonPool.h"
 #include "utils/Macros.h"
 #include "utils/TimeUtils.h"
 #include "utils/TraceUtils.h"
 
+#include <ui/Fence.h>
 #include <ui/GraphicBuffer.h>
 
 namespace android {
 namespace uirenderer {
 namespace renderthread {
 
+template <class F>
+void RenderProxy::postBatched(F&& func) {
+    mPendingCommands.emplace_back(std::forward<F>(func));
+}
+
+template <class F>
+void RenderProxy::post(F&& func) {
+    flushCommands();
+    mRenderThread.queue().post(std::forward<F>(func));
+}
+
+template <class F>
+auto RenderProxy::runSync(F&& func) -> decltype(func()) {
+    flushCommands();
+    mSyncWaits++;
+    return mRenderThread.queue().runSync(std::forward<F>(func));
+}
+
 RenderProxy::RenderProxy(bool translucent, RenderNode* rootRenderNode,
                          IContextFactory* contextFactory)
         : mRenderThread(RenderThread::getInstance()), mContext(nullptr) {
@@ -57,17 +78,17 @@ void RenderProxy::destroyContext() {
         mDrawFrameTask.setContext(nullptr, nullptr, nullptr);
         // This is also a fence as we need to be certain that there are no
         // outstanding mDrawFrame tasks posted before it is destroyed
-        mRenderThread.queue().runSync([this]() { delete mContext; });
+        runSync([this]() { delete mContext; });
         mContext = nullptr;
     }
 }
 
 void RenderProxy::setSwapBehavior(SwapBehavior swapBehavior) {
-    mRenderThread.queue().post([this, swapBehavior]() { mContext->setSwapBehavior(swapBehavior); });
+    postBatched([context = mContext, swapBehavior]() { context->setSwapBehavior(swapBehavior); });
 }
 
 bool RenderProxy::loadSystemProperties() {
-    return mRenderThread.queue().runSync([this]() -> bool {
+    return runSync([this]() -> bool {
         bool needsRedraw = Properties::load();
         if (mContext->profiler().consumeProperties()) {
             needsRedraw = true;
@@ -77,44 +98,48 @@ bool RenderProxy::loadSystemProperties() {
 }
 
 void RenderProxy::setName(const char* name) {
-    // block since name/value pointers owned by caller
-    // TODO: Support move arguments
-    mRenderThread.queue().runSync([this, name]() { mContext->setName(std::string(name)); });
+    // name is owned by the caller, so copy it instead of blocking
+    postBatched([context = mContext, name = std::string(name)]() mutable {
+        context->setName(std::move(name));
+    });
 }
 
 void RenderProxy::setSurface(const sp<Surface>& surface, bool enableTimeout) {
-    mRenderThread.queue().post([this, surf = surface, enableTimeout]() mutable {
+    post([this, surf = surface, enableTimeout]() mutable {
         mContext->setSurface(std::move(surf), enableTimeout);
     });
 }
 
 void RenderProxy::allocateBuffers() {
-    mRenderThread.queue().post([=]() { mContext->allocateBuffers(); });
+    post([=]() { mContext->allocateBuffers(); });
 }
 
 bool RenderProxy::pause() {
-    return mRenderThread.queue().runSync([this]() -> bool { return mContext->pauseSurface(); });
+    return runSync([this]() -> bool { return mContext->pauseSurface(); });
 }
 
 void RenderProxy::setStopped(bool stopped) {
-    mRenderThread.queue().runSync([this, stopped]() { mContext->setStopped(stopped); });
+    runSync([this, stopped]() { mContext->setStopped(stopped); });
 }
 
 void RenderProxy::setLightAlpha(uint8_t ambientShadowAlpha, uint8_t spotShadowAlpha) {
-    mRenderThread.queue().post(
-            [=]() { mContext->setLightAlpha(ambientShadowAlpha, spotShadowAlpha); });
+    postBatched([context = mContext, ambientShadowAlpha, spotShadowAlpha]() {
+        context->setLightAlpha(ambientShadowAlpha, spotShadowAlpha);
+    });
 }
 
 void RenderProxy::setLightGeometry(const Vector3& lightCenter, float lightRadius) {
-    mRenderThread.queue().post([=]() { mContext->setLightGeometry(lightCenter, lightRadius); });
+    postBatched([context = mContext, lightCenter, lightRadius]() {
+        context->setLightGeometry(lightCenter, lightRadius);
+    });
 }
 
 void RenderProxy::setOpaque(bool opaque) {
-    mRenderThread.queue().post([=]() { mContext->setOpaque(opaque); });
+    postBatched([context = mContext, opaque]() { context->setOpaque(opaque); });
 }
 
 void RenderProxy::setWideGamut(bool wideGamut) {
-    mRenderThread.queue().post([=]() { mContext->setWideGamut(wideGamut); });
+    postBatched([context = mContext, wideGamut]() { context->setWideGamut(wideGamut); });
 }
 
 int64_t* RenderProxy::frameInfo() {
@@ -122,6 +147,9 @@ int64_t* RenderProxy::frameInfo() {
 }
 
 int RenderProxy::syncAndDrawFrame() {
+    flushCommands();
+    mDrawFrameTask.setUiThreadSyncWaits(mSyncWaits);
+    mSyncWaits = 0;
     return mDrawFrameTask.drawFrame();
 }
 
@@ -129,7 +157,7 @@ void RenderProxy::destroy() {
     // destroyCanvasAndSurface() needs a fence as when it returns the
     // underlying BufferQueue is going to be released from under
     // the render thread.
-    mRenderThread.queue().runSync([=]() { mContext->destroy(); });
+    runSync([=]() { mContext->destroy(); });
 }
 
 void RenderProxy::invokeFunctor(Functor* functor, bool waitForCompletion) {
@@ -153,19 +181,19 @@ void RenderProxy::destroyFunctor(int functor) {
 }
 
 DeferredLayerUpdater* RenderProxy::createTextureLayer() {
-    return mRenderThread.queue().runSync([this]() -> auto {
+    return runSync([this]() -> auto {
         return mContext->createTextureLayer();
     });
 }
 
 void RenderProxy::buildLayer(RenderNode* node) {
-    mRenderThread.queue().runSync([&]() { mContext->buildLayer(node); });
+    runSync([&]() { mContext->buildLayer(node); });
 }
 
 bool RenderProxy::copyLayerInto(DeferredLayerUpdater* layer, SkBitmap& bitmap) {
     ATRACE_NAME("TextureView#getBitmap");
     auto& thread = RenderThread::getInstance();
-    return thread.queue().runSync([&]() -> bool {
+    return runSync([&]() -> bool {
         return thread.readback().copyLayerInto(layer, &bitmap) == CopyResult::Success;
     });
 }
@@ -179,11 +207,11 @@ void RenderProxy::cancelLayerUpdate(DeferredLayerUpdater* layer) {
 }
 
 void RenderProxy::detachSurfaceTexture(DeferredLayerUpdater* layer) {
-    return mRenderThread.queue().runSync([&]() { layer->detachSurfaceTexture(); });
+    return runSync([&]() { layer->detachSurfaceTexture(); });
 }
 
 void RenderProxy::destroyHardwareResources() {
-    return mRenderThread.queue().runSync([&]() { mContext->destroyHardwareResources(); });
+    return runSync([&]() { mContext->destroyHardwareResources(); });
 }
 
 void RenderProxy::trimMemory(int level) {
@@ -200,8 +228,20 @@ void RenderProxy::overrideProperty(const char* name, const char* value) {
             [&]() { Properties::overrideProperty(name, value); });
 }
 
+void RenderProxy::flushCommands() {
+    if (mPendingCommands.empty()) {
+        return;
+    }
+    mRenderThread.queue().post([commands = std::move(mPendingCommands)]() {
+        for (const auto& command : commands) {
+            command();
+        }
+    });
+    mPendingCommands.clear();
+}
+
 void RenderProxy::fence() {
-    mRenderThread.queue().runSync([]() {});
+    runSync([]() {});
 }
 
 int RenderProxy::maxTextureSize() {
@@ -211,15 +251,15 @@ int RenderProxy::maxTextureSize() {
 }
 
 void RenderProxy::stopDrawing() {
-    mRenderThread.queue().runSync([this]() { mContext->stopDrawing(); });
+    runSync([this]() { mContext->stopDrawing(); });
 }
 
 void RenderProxy::notifyFramePending() {
-    mRenderThread.queue().post([this]() { mContext->notifyFramePending(); });
+    post([this]() { mContext->notifyFramePending(); });
 }
 
 void RenderProxy::dumpProfileInfo(int fd, int dumpFlags) {
-    mRenderThread.queue().runSync([&]() {
+    runSync([&]() {
         mContext->profiler().dumpData(fd);
         if (dumpFlags & DumpFlags::FrameStats) {
             mContext->dumpFrames(fd);
@@ -227,6 +267,9 @@ void RenderProxy::dumpProfileInfo(int fd, int dumpFlags) {
         if (dumpFlags & DumpFlags::JankStats) {
             mRenderThread.globalProfileData()->dump(fd);
         }
+        if (dumpFlags & DumpFlags::Counters) {
+            FrameCounters::dump(fd);
+        }
         if (dumpFlags & DumpFlags::Reset) {
             mContext->resetFrameStats();
         }
@@ -234,11 +277,11 @@ void RenderProxy::dumpProfileInfo(int fd, int dumpFlags) {
 }
 
 void RenderProxy::resetProfileInfo() {
-    mRenderThread.queue().runSync([=]() { mContext->resetFrameStats(); });
+    postBatched([context = mContext]() { context->resetFrameStats(); });
 }
 
 uint32_t RenderProxy::frameTimePercentile(int percentile) {
-    return mRenderThread.queue().runSync([&]() -> auto {
+    return runSync([&]() -> auto {
         return mRenderThread.globalProfileData()->findPercentile(percentile);
     });
 }
@@ -268,15 +311,17 @@ int RenderProxy::getRenderThreadTid() {
 }
 
 void RenderProxy::addRenderNode(RenderNode* node, bool placeFront) {
-    mRenderThread.queue().post([=]() { mContext->addRenderNode(node, placeFront); });
+    postBatched([context = mContext, node = sp<RenderNode>(node), placeFront]() {
+        context->addRenderNode(node, placeFront);
+    });
 }
 
 void RenderProxy::removeRenderNode(RenderNode* node) {
-    mRenderThread.queue().post([=]() { mContext->removeRenderNode(node); });
+    postBatched([context = mContext, node]() { context->removeRenderNode(node); });
 }
 
 void RenderProxy::drawRenderNode(RenderNode* node) {
-    mRenderThread.queue().runSync([=]() { mContext->prepareAndDraw(node); });
+    runSync([=]() { mContext->prepareAndDraw(node); });
 }
 
 void RenderProxy::setContentDrawBounds(int left, int top, int right, int bottom) {
@@ -285,7 +330,7 @@ void RenderProxy::setContentDrawBounds(int left, int top, int right, int bottom)
 
 void RenderProxy::setPictureCapturedCallback(
         const std::function<void(sk_sp<SkPicture>&&)>& callback) {
-    mRenderThread.queue().post(
+    post(
             [this, cb = callback]() { mContext->setPictureCapturedCallback(cb); });
 }
 
@@ -298,23 +343,23 @@ void RenderProxy::setFrameCompleteCallback(std::function<void(int64_t)>&& callba
 }
 
 void RenderProxy::addFrameMetricsObserver(FrameMetricsObserver* observerPtr) {
-    mRenderThread.queue().post([this, observer = sp{observerPtr}]() {
+    post([this, observer = sp{observerPtr}]() {
         mContext->addFrameMetricsObserver(observer.get());
     });
 }
 
 void RenderProxy::removeFrameMetricsObserver(FrameMetricsObserver* observerPtr) {
-    mRenderThread.queue().post([this, observer = sp{observerPtr}]() {
+    post([this, observer = sp{observerPtr}]() {
         mContext->removeFrameMetricsObserver(observer.get());
     });
 }
 
 void RenderProxy::setForceDark(bool enable) {
-    mRenderThread.queue().post([this, enable]() { mContext->setForceDark(enable); });
+    postBatched([context = mContext, enable]() { context->setForceDark(enable); });
 }
 
 void RenderProxy::setRenderAheadDepth(int renderAhead) {
-    mRenderThread.queue().post(
+    postBatched(
             [context = mContext, renderAhead] { context->setRenderAheadDepth(renderAhead); });
 }
 
@@ -326,6 +371,21 @@ int RenderProxy::copySurfaceInto(sp<Surface>& surface, int left, int top, int ri
     }));
 }
 
+void RenderProxy::copySurfaceIntoAsync(
+        const sp<Surface>& surface, int left, int top, int right, int bottom,
+        const sp<GraphicBuffer>& buffer,
+        std::function<void(int result, const sp<Fence>& fence)> callback) {
+    auto& thread = RenderThread::getInstance();
+    thread.queue().post([&thread, surface, rect = Rect(left, top, right, bottom), buffer,
+                         callback = std::move(callback)]() mutable {
+        sp<Fence> fence;
+        CopyResult result = thread.readback().copySurfaceIntoBuffer(*surface, rect, buffer, &fence);
+        CommonPool::post([result, fence = std::move(fence), callback = std::move(callback)]() {
+            callback(static_cast<int>(result), fence);
+        });
+    });
+}
+
 void RenderProxy::prepareToDraw(Bitmap& bitmap) {
     // If we haven't spun up a hardware accelerated window yet, there's no
     // point in precaching these bitmaps as it can't impact jank.
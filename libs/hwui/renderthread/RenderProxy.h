@@ -22,6 +22,9 @@
 #include <gui/Surface.h>
 #include <utils/Functor.h>
 
+#include <functional>
+#include <vector>
+
 #include "../FrameMetricsObserver.h"
 #include "../IContextFactory.h"
 #include "DrawFrameTask.h"
@@ -29,6 +32,7 @@
 #include "hwui/Bitmap.h"
 
 namespace android {
+class Fence;
 class GraphicBuffer;
 
 namespace uirenderer {
@@ -48,6 +52,7 @@ enum {
     FrameStats = 1 << 0,
     Reset = 1 << 1,
     JankStats = 1 << 2,
+    Counters = 1 << 3,
 };
 }
 
@@ -142,6 +147,16 @@ public:
 
     ANDROID_API static int copySurfaceInto(sp<Surface>& surface, int left, int top, int right,
                                            int bottom, SkBitmap* bitmap);
+
+    /**
+     * Like copySurfaceInto(), but copies into buffer on the GPU and returns right away. callback
+     * is invoked on a CommonPool thread with the CopyResult and, on success, a fence that signals
+     * once buffer holds the copy. The pixels are never read back to the CPU.
+     */
+    ANDROID_API static void copySurfaceIntoAsync(
+            const sp<Surface>& surface, int left, int top, int right, int bottom,
+            const sp<GraphicBuffer>& buffer,
+            std::function<void(int result, const sp<Fence>& fence)> callback);
     ANDROID_API static void prepareToDraw(Bitmap& bitmap);
 
     static int copyHWBitmapInto(Bitmap* hwBitmap, SkBitmap* bitmap);
@@ -155,11 +170,29 @@ public:
     static void releaseVDAtlasEntries();
 
 private:
+    // Queues a call that returns nothing. It is posted together with the other pending calls by
+    // the next post(), runSync() or frame, so a burst of state changes costs one work item.
+    template <class F>
+    void postBatched(F&& func);
+
+    template <class F>
+    void post(F&& func);
+
+    // Blocks until func ran on the RenderThread. Counted in the FrameInfo of the next frame.
+    template <class F>
+    auto runSync(F&& func) -> decltype(func());
+
+    void flushCommands();
+
     RenderThread& mRenderThread;
     CanvasContext* mContext;
 
     DrawFrameTask mDrawFrameTask;
 
+    std::vector<std::function<void()>> mPendingCommands;
+    // runSync() calls since the last frame.
+    int mSyncWaits = 0;
+
     void destroyContext();
 
     // Friend class to help with bridging
@@ -16,6 +16,7 @@
 
 #include "RenderThread.h"
 
+#include "../CanvasTransform.h"
 #include "../HardwareBitmapUploader.h"
 #include "CanvasContext.h"
 #include "DeviceInfo.h"
@@ -27,6 +28,7 @@
 #include "pipeline/skia/SkiaOpenGLPipeline.h"
 #include "pipeline/skia/SkiaVulkanPipeline.h"
 #include "renderstate/RenderState.h"
+#include "thread/CommonPool.h"
 #include "utils/FatVector.h"
 #include "utils/TimeUtils.h"
 #include "utils/TraceUtils.h"
@@ -183,7 +185,7 @@ void RenderThread::initThreadLocals() {
     mEglManager = new EglManager();
     mRenderState = new RenderState(*this);
     mVkManager = new VulkanManager();
-    mCacheManager = new CacheManager(DeviceInfo::get()->displayInfo());
+    mCacheManager = new CacheManager(DeviceInfo::get()->displayInfo(), queue());
 }
 
 void RenderThread::setupFrameInterval() {
@@ -275,6 +277,8 @@ void RenderThread::dumpGraphicsMemory(int fd) {
 
     dprintf(fd, "\n%s\n", cachesOutput.string());
     dprintf(fd, "\nPipeline=%s\n", pipeline.string());
+    CommonPool::dump(fd);
+    dumpColorTransformCache(fd);
 }
 
 Readback& RenderThread::readback() {
@@ -492,7 +492,8 @@ static void destroy_semaphore(void* context) {
     delete info;
 }
 
-void VulkanManager::swapBuffers(VulkanSurface* surface, const SkRect& dirtyRect) {
+void VulkanManager::swapBuffers(VulkanSurface* surface, const SkRect& dirtyRect,
+                                sp<Fence>* frameFence) {
     if (CC_UNLIKELY(Properties::waitForGpuCompletion)) {
         ATRACE_NAME("Finishing GPU work");
         mDeviceWaitIdle(mDevice);
@@ -536,6 +537,13 @@ void VulkanManager::swapBuffers(VulkanSurface* surface, const SkRect& dirtyRect)
 
         err = mGetSemaphoreFdKHR(mDevice, &getFdInfo, &fenceFd);
         ALOGE_IF(VK_SUCCESS != err, "VulkanManager::swapBuffers(): Failed to get semaphore Fd");
+        if (frameFence && fenceFd != -1) {
+            // The queue takes ownership of fenceFd
+            int dupedFd = dup(fenceFd);
+            if (dupedFd != -1) {
+                *frameFence = new Fence(dupedFd);
+            }
+        }
     } else {
         ALOGE("VulkanManager::swapBuffers(): Semaphore submission failed");
         mQueueWaitIdle(mGraphicsQueue);
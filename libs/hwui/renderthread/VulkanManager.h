@@ -64,7 +64,9 @@ public:
     void destroySurface(VulkanSurface* surface);
 
     Frame dequeueNextBuffer(VulkanSurface* surface);
-    void swapBuffers(VulkanSurface* surface, const SkRect& dirtyRect);
+    // If frameFence is non-null it is set to a fence covering the frame's rendering.
+    void swapBuffers(VulkanSurface* surface, const SkRect& dirtyRect,
+                     sp<Fence>* frameFence = nullptr);
 
     // Cleans up all the global state in the VulkanManger.
     void destroy();
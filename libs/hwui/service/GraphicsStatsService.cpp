@@ -25,26 +25,66 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <stddef.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <array>
+#include <vector>
+
 namespace android {
 namespace uirenderer {
 
 using namespace google::protobuf;
 
-constexpr int32_t sCurrentFileVersion = 1;
+constexpr int32_t sCurrentFileVersion = 2;
+// Files of this version hold a serialized GraphicsStatsProto after the header. They are still
+// read, and converted to the current layout on their next save.
+constexpr int32_t sProtoFileVersion = 1;
 constexpr int32_t sHeaderSize = 4;
 static_assert(sizeof(sCurrentFileVersion) == sHeaderSize, "Header size is wrong");
 
 constexpr int sHistogramSize = ProfileData::HistogramSize();
+constexpr int sStageHistogramSize = ProfileData::StageHistogramSize();
+
+/**
+ * Layout of the stats files, followed by the package name. saveBuffer() adds to the counters of
+ * the mapped file in place, so saving dirties a few pages instead of parsing and serializing the
+ * whole proto. The proto is only built when dumping.
+ *
+ * The bucket counts are part of the header, so changing ProfileData's histograms makes older
+ * files fail validation instead of being misread. saveBuffer() calls for a file are serialized by
+ * GraphicsStatsService.java, the counters are accessed atomically so that a concurrent dump reads
+ * whole values.
+ */
+struct MappedStats {
+    int32_t fileVersion;
+    uint32_t histogramSize;
+    uint32_t stageHistogramSize;
+    uint32_t stageCount;
+    uint32_t jankTypeCount;
+    uint32_t packageNameSize;
+    int64_t versionCode;
+    int64_t statsStart;
+    int64_t statsEnd;
+    uint32_t totalFrames;
+    uint32_t jankyFrames;
+    uint32_t jankTypeCounts[NUM_BUCKETS];
+    uint32_t histogram[sHistogramSize];
+    uint32_t stageHistograms[NUM_STAGES][sStageHistogramSize];
+};
+static_assert(offsetof(MappedStats, fileVersion) == 0, "The version must come first");
+
+typedef std::function<void(ProfileData::HistogramEntry)> HistogramCallback;
 
 static bool mergeProfileDataIntoProto(protos::GraphicsStatsProto* proto,
                                       const std::string& package, int64_t versionCode,
                                       int64_t startTime, int64_t endTime, const ProfileData* data);
 static void dumpAsTextToFd(protos::GraphicsStatsProto* proto, int outFd);
+static void mappedStatsToProto(const MappedStats* stats, protos::GraphicsStatsProto* proto);
 
 class FileDescriptor {
 public:
@@ -62,6 +102,50 @@ private:
     int mFd;
 };
 
+template <typename T>
+static T loadCounter(const T& counter) {
+    return __atomic_load_n(&counter, __ATOMIC_RELAXED);
+}
+
+template <typename T>
+static void storeCounter(T& counter, T value) {
+    __atomic_store_n(&counter, value, __ATOMIC_RELAXED);
+}
+
+static void addToCounter(uint32_t& counter, uint32_t value) {
+    __atomic_fetch_add(&counter, value, __ATOMIC_RELAXED);
+}
+
+static size_t mappedStatsSize(size_t packageNameSize) {
+    return sizeof(MappedStats) + packageNameSize;
+}
+
+static const char* mappedPackageName(const MappedStats* stats) {
+    return reinterpret_cast<const char*>(stats + 1);
+}
+
+static bool isValidMappedStats(const MappedStats* stats, size_t size) {
+    return size >= sizeof(MappedStats) && stats->fileVersion == sCurrentFileVersion &&
+           stats->histogramSize == sHistogramSize &&
+           stats->stageHistogramSize == sStageHistogramSize && stats->stageCount == NUM_STAGES &&
+           stats->jankTypeCount == NUM_BUCKETS &&
+           size == mappedStatsSize(stats->packageNameSize);
+}
+
+// The render time of each bucket of MappedStats::histogram, as reported by ProfileData.
+static const std::array<uint32_t, sHistogramSize>& histogramRenderMillis() {
+    static const std::array<uint32_t, sHistogramSize> sRenderMillis = [] {
+        std::array<uint32_t, sHistogramSize> renderMillis;
+        ProfileData data;
+        size_t index = 0;
+        data.histogramForEach([&](ProfileData::HistogramEntry entry) {
+            renderMillis[index++] = entry.renderTimeMs;
+        });
+        return renderMillis;
+    }();
+    return sRenderMillis;
+}
+
 class FileOutputStreamLite : public io::ZeroCopyOutputStream {
 public:
     explicit FileOutputStreamLite(int fd) : mCopyAdapter(fd), mImpl(&mCopyAdapter) {}
@@ -137,22 +221,197 @@ bool GraphicsStatsService::parseFromFile(const std::string& path,
         return false;
     }
     uint32_t file_version = *reinterpret_cast<uint32_t*>(addr);
-    if (file_version != sCurrentFileVersion) {
+    bool success = false;
+    if (file_version == sCurrentFileVersion) {
+        const MappedStats* stats = reinterpret_cast<const MappedStats*>(addr);
+        success = isValidMappedStats(stats, sb.st_size);
+        if (success) {
+            mappedStatsToProto(stats, output);
+        } else {
+            ALOGW("Invalid stats layout in '%s' (size %d)", path.c_str(), (int)sb.st_size);
+        }
+    } else if (file_version == sProtoFileVersion) {
+        void* data = reinterpret_cast<uint8_t*>(addr) + sHeaderSize;
+        int dataSize = sb.st_size - sHeaderSize;
+        io::ArrayInputStream input{data, dataSize};
+        success = output->ParseFromZeroCopyStream(&input);
+        if (!success) {
+            ALOGW("Parse failed on '%s' error='%s'", path.c_str(),
+                  output->InitializationErrorString().c_str());
+        }
+    } else {
         ALOGW("file_version mismatch! expected %d got %d", sCurrentFileVersion, file_version);
-        munmap(addr, sb.st_size);
+    }
+    munmap(addr, sb.st_size);
+    return success;
+}
+
+void mappedStatsToProto(const MappedStats* stats, protos::GraphicsStatsProto* proto) {
+    proto->set_package_name(std::string(mappedPackageName(stats), stats->packageNameSize));
+    proto->set_version_code(loadCounter(stats->versionCode));
+    proto->set_stats_start(loadCounter(stats->statsStart));
+    proto->set_stats_end(loadCounter(stats->statsEnd));
+    auto summary = proto->mutable_summary();
+    summary->set_total_frames(loadCounter(stats->totalFrames));
+    summary->set_janky_frames(loadCounter(stats->jankyFrames));
+    summary->set_missed_vsync_count(loadCounter(stats->jankTypeCounts[kMissedVsync]));
+    summary->set_high_input_latency_count(loadCounter(stats->jankTypeCounts[kHighInputLatency]));
+    summary->set_slow_ui_thread_count(loadCounter(stats->jankTypeCounts[kSlowUI]));
+    summary->set_slow_bitmap_upload_count(loadCounter(stats->jankTypeCounts[kSlowSync]));
+    summary->set_slow_draw_count(loadCounter(stats->jankTypeCounts[kSlowRT]));
+    summary->set_missed_deadline_count(loadCounter(stats->jankTypeCounts[kMissedDeadline]));
+
+    const auto& renderMillis = histogramRenderMillis();
+    auto histogram = proto->mutable_histogram();
+    histogram->Reserve(sHistogramSize);
+    for (int i = 0; i < sHistogramSize; i++) {
+        auto bucket = histogram->Add();
+        bucket->set_render_millis(renderMillis[i]);
+        bucket->set_frame_count(loadCounter(stats->histogram[i]));
+    }
+    for (int stage = 0; stage < NUM_STAGES; stage++) {
+        protos::GraphicsStatsStageHistogramProto* stageProto = proto->add_stage_histogram();
+        // The proto's Stage values match FrameStage
+        stageProto->set_stage(static_cast<protos::GraphicsStatsStageHistogramProto::Stage>(stage));
+        auto stageHistogram = stageProto->mutable_histogram();
+        stageHistogram->Reserve(sStageHistogramSize);
+        for (int i = 0; i < sStageHistogramSize; i++) {
+            auto bucket = stageHistogram->Add();
+            bucket->set_render_millis(ProfileData::frameTimeForStageFrameCountIndex(i));
+            bucket->set_frame_count(loadCounter(stats->stageHistograms[stage][i]));
+        }
+    }
+}
+
+// Carries the counters of a file saved in an earlier format over to the current layout. Only
+// called on a private copy, so no atomics are needed.
+static void copyProtoIntoStats(const protos::GraphicsStatsProto& proto, MappedStats* stats) {
+    stats->versionCode = proto.version_code();
+    stats->statsStart = proto.stats_start();
+    stats->statsEnd = proto.stats_end();
+    const auto& summary = proto.summary();
+    stats->totalFrames = summary.total_frames();
+    stats->jankyFrames = summary.janky_frames();
+    stats->jankTypeCounts[kMissedVsync] = summary.missed_vsync_count();
+    stats->jankTypeCounts[kHighInputLatency] = summary.high_input_latency_count();
+    stats->jankTypeCounts[kSlowUI] = summary.slow_ui_thread_count();
+    stats->jankTypeCounts[kSlowSync] = summary.slow_bitmap_upload_count();
+    stats->jankTypeCounts[kSlowRT] = summary.slow_draw_count();
+    stats->jankTypeCounts[kMissedDeadline] = summary.missed_deadline_count();
+    if (proto.histogram_size() == sHistogramSize) {
+        for (int i = 0; i < sHistogramSize; i++) {
+            stats->histogram[i] = proto.histogram(i).frame_count();
+        }
+    }
+    for (const auto& stage : proto.stage_histogram()) {
+        if (stage.stage() < 0 || stage.stage() >= NUM_STAGES ||
+            stage.histogram_size() != sStageHistogramSize) {
+            continue;
+        }
+        for (int i = 0; i < sStageHistogramSize; i++) {
+            stats->stageHistograms[stage.stage()][i] = stage.histogram(i).frame_count();
+        }
+    }
+}
+
+static void mergeProfileDataIntoStats(MappedStats* stats, int64_t versionCode, int64_t startTime,
+                                      int64_t endTime, const ProfileData* data) {
+    const int64_t statsStart = loadCounter(stats->statsStart);
+    if (statsStart == 0 || statsStart > startTime) {
+        storeCounter(stats->statsStart, startTime);
+    }
+    const int64_t statsEnd = loadCounter(stats->statsEnd);
+    if (statsEnd == 0 || statsEnd < endTime) {
+        storeCounter(stats->statsEnd, endTime);
+    }
+    storeCounter(stats->versionCode, versionCode);
+    addToCounter(stats->totalFrames, data->totalFrameCount());
+    addToCounter(stats->jankyFrames, data->jankFrameCount());
+    for (int type = 0; type < NUM_BUCKETS; type++) {
+        addToCounter(stats->jankTypeCounts[type], data->jankTypeCount(static_cast<JankType>(type)));
+    }
+    int index = 0;
+    data->histogramForEach([&](ProfileData::HistogramEntry entry) {
+        addToCounter(stats->histogram[index++], entry.frameCount);
+    });
+    for (int stage = 0; stage < NUM_STAGES; stage++) {
+        index = 0;
+        data->stageHistogramForEach(static_cast<FrameStage>(stage),
+                                    [&](ProfileData::HistogramEntry entry) {
+                                        addToCounter(stats->stageHistograms[stage][index++],
+                                                     entry.frameCount);
+                                    });
+    }
+}
+
+// Rewrites the file at fd in the current layout, keeping the stats it held if it can be read.
+static bool initializeStatsFile(int fd, const std::string& path, const std::string& package,
+                                size_t fileSize) {
+    std::vector<uint8_t> buffer(mappedStatsSize(package.size()));
+    MappedStats* stats = reinterpret_cast<MappedStats*>(buffer.data());
+    protos::GraphicsStatsProto oldProto;
+    if (fileSize > 0 && GraphicsStatsService::parseFromFile(path, &oldProto)) {
+        copyProtoIntoStats(oldProto, stats);
+    }
+    stats->fileVersion = sCurrentFileVersion;
+    stats->histogramSize = sHistogramSize;
+    stats->stageHistogramSize = sStageHistogramSize;
+    stats->stageCount = NUM_STAGES;
+    stats->jankTypeCount = NUM_BUCKETS;
+    stats->packageNameSize = package.size();
+    memcpy(stats + 1, package.data(), package.size());
+
+    if (ftruncate(fd, 0)) {
+        int err = errno;
+        ALOGW("Failed to truncate '%s', errno=%d (%s)", path.c_str(), err, strerror(err));
         return false;
     }
+    ssize_t wrote = TEMP_FAILURE_RETRY(pwrite(fd, buffer.data(), buffer.size(), 0));
+    if (wrote != static_cast<ssize_t>(buffer.size())) {
+        int err = errno;
+        ALOGW("Failed to write '%s', returned=%zd errno=%d (%s)", path.c_str(), wrote, err,
+              strerror(err));
+        return false;
+    }
+    return true;
+}
 
-    void* data = reinterpret_cast<uint8_t*>(addr) + sHeaderSize;
-    int dataSize = sb.st_size - sHeaderSize;
-    io::ArrayInputStream input{data, dataSize};
-    bool success = output->ParseFromZeroCopyStream(&input);
-    if (!success) {
-        ALOGW("Parse failed on '%s' error='%s'", path.c_str(),
-              output->InitializationErrorString().c_str());
+// Adds the entries of a ProfileData histogram into the proto's, which must be either empty or
+// have the same buckets
+static bool mergeHistogram(
+        const char* name, int size,
+        RepeatedPtrField<protos::GraphicsStatsHistogramBucketProto>* histogram,
+        const std::function<void(const HistogramCallback&)>& forEach) {
+    bool creatingHistogram = false;
+    if (histogram->size() == 0) {
+        histogram->Reserve(size);
+        creatingHistogram = true;
+    } else if (histogram->size() != size) {
+        ALOGE("%s size mismatch, proto is %d expected %d", name, histogram->size(), size);
+        return false;
     }
-    munmap(addr, sb.st_size);
-    return success;
+    int index = 0;
+    bool hitMergeError = false;
+    forEach([&](ProfileData::HistogramEntry entry) {
+        if (hitMergeError) return;
+
+        protos::GraphicsStatsHistogramBucketProto* bucket;
+        if (creatingHistogram) {
+            bucket = histogram->Add();
+            bucket->set_render_millis(entry.renderTimeMs);
+        } else {
+            bucket = histogram->Mutable(index);
+            if (bucket->render_millis() != static_cast<int32_t>(entry.renderTimeMs)) {
+                ALOGW("Frame time mistmatch %d vs. %u", bucket->render_millis(),
+                      entry.renderTimeMs);
+                hitMergeError = true;
+                return;
+            }
+        }
+        bucket->set_frame_count(bucket->frame_count() + entry.frameCount);
+        index++;
+    });
+    return !hitMergeError;
 }
 
 bool mergeProfileDataIntoProto(protos::GraphicsStatsProto* proto, const std::string& package,
@@ -181,37 +440,36 @@ bool mergeProfileDataIntoProto(protos::GraphicsStatsProto* proto, const std::str
     summary->set_missed_deadline_count(summary->missed_deadline_count()
             + data->jankTypeCount(kMissedDeadline));
 
-    bool creatingHistogram = false;
-    if (proto->histogram_size() == 0) {
-        proto->mutable_histogram()->Reserve(sHistogramSize);
-        creatingHistogram = true;
-    } else if (proto->histogram_size() != sHistogramSize) {
-        ALOGE("Histogram size mismatch, proto is %d expected %d", proto->histogram_size(),
-              sHistogramSize);
+    if (!mergeHistogram("Histogram", sHistogramSize, proto->mutable_histogram(),
+                        [data](const HistogramCallback& callback) {
+                            data->histogramForEach(callback);
+                        })) {
         return false;
     }
-    int index = 0;
-    bool hitMergeError = false;
-    data->histogramForEach([&](ProfileData::HistogramEntry entry) {
-        if (hitMergeError) return;
-
-        protos::GraphicsStatsHistogramBucketProto* bucket;
-        if (creatingHistogram) {
-            bucket = proto->add_histogram();
-            bucket->set_render_millis(entry.renderTimeMs);
-        } else {
-            bucket = proto->mutable_histogram(index);
-            if (bucket->render_millis() != static_cast<int32_t>(entry.renderTimeMs)) {
-                ALOGW("Frame time mistmatch %d vs. %u", bucket->render_millis(),
-                      entry.renderTimeMs);
-                hitMergeError = true;
-                return;
+    for (int stage = 0; stage < NUM_STAGES; stage++) {
+        protos::GraphicsStatsStageHistogramProto* stageProto = nullptr;
+        for (auto& it : *proto->mutable_stage_histogram()) {
+            if (it.stage() == stage) {
+                stageProto = &it;
+                break;
             }
         }
-        bucket->set_frame_count(bucket->frame_count() + entry.frameCount);
-        index++;
-    });
-    return !hitMergeError;
+        if (!stageProto) {
+            stageProto = proto->add_stage_histogram();
+            // The proto's Stage values match FrameStage
+            stageProto->set_stage(
+                    static_cast<protos::GraphicsStatsStageHistogramProto::Stage>(stage));
+        }
+        if (!mergeHistogram(ProfileData::stageName(static_cast<FrameStage>(stage)),
+                            sStageHistogramSize, stageProto->mutable_histogram(),
+                            [data, stage](const HistogramCallback& callback) {
+                                data->stageHistogramForEach(static_cast<FrameStage>(stage),
+                                                            callback);
+                            })) {
+            return false;
+        }
+    }
+    return true;
 }
 
 static int32_t findPercentile(protos::GraphicsStatsProto* proto, int percentile) {
@@ -255,56 +513,65 @@ void dumpAsTextToFd(protos::GraphicsStatsProto* proto, int fd) {
     for (const auto& it : proto->histogram()) {
         dprintf(fd, " %dms=%d", it.render_millis(), it.frame_count());
     }
+    for (const auto& stage : proto->stage_histogram()) {
+        if (stage.stage() < 0 || stage.stage() >= NUM_STAGES) continue;
+        dprintf(fd, "\n%s HISTOGRAM:",
+                ProfileData::stageName(static_cast<FrameStage>(stage.stage())));
+        for (const auto& it : stage.histogram()) {
+            dprintf(fd, " %dms=%d", it.render_millis(), it.frame_count());
+        }
+    }
     dprintf(fd, "\n");
 }
 
 void GraphicsStatsService::saveBuffer(const std::string& path, const std::string& package,
                                       int64_t versionCode, int64_t startTime, int64_t endTime,
                                       const ProfileData* data) {
-    protos::GraphicsStatsProto statsProto;
-    if (!parseFromFile(path, &statsProto)) {
-        statsProto.Clear();
-    }
-    if (!mergeProfileDataIntoProto(&statsProto, package, versionCode, startTime, endTime, data)) {
-        return;
-    }
-    // Although we might not have read any data from the file, merging the existing data
-    // should always fully-initialize the proto
-    if (!statsProto.IsInitialized()) {
-        ALOGE("proto initialization error %s", statsProto.InitializationErrorString().c_str());
+    if (package.empty()) {
+        ALOGE("missing package_name() for '%s'", path.c_str());
         return;
     }
-    if (statsProto.package_name().empty() || !statsProto.has_summary()) {
-        ALOGE("missing package_name() '%s' summary %d", statsProto.package_name().c_str(),
-              statsProto.has_summary());
-        return;
-    }
-    int outFd = open(path.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0660);
-    if (outFd <= 0) {
+    FileDescriptor fd{open(path.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0660)};
+    if (!fd.valid()) {
         int err = errno;
         ALOGW("Failed to open '%s', error=%d (%s)", path.c_str(), err, strerror(err));
         return;
     }
-    int wrote = write(outFd, &sCurrentFileVersion, sHeaderSize);
-    if (wrote != sHeaderSize) {
+    struct stat sb;
+    if (fstat(fd, &sb)) {
         int err = errno;
-        ALOGW("Failed to write header to '%s', returned=%d errno=%d (%s)", path.c_str(), wrote, err,
-              strerror(err));
-        close(outFd);
+        ALOGW("Failed to fstat '%s', errno=%d (%s)", path.c_str(), err, strerror(err));
         return;
     }
-    {
-        FileOutputStreamLite output(outFd);
-        bool success = statsProto.SerializeToZeroCopyStream(&output) && output.Flush();
-        if (output.GetErrno() != 0) {
-            ALOGW("Error writing to fd=%d, path='%s' err=%d (%s)", outFd, path.c_str(),
-                  output.GetErrno(), strerror(output.GetErrno()));
-            success = false;
-        } else if (!success) {
-            ALOGW("Serialize failed on '%s' unknown error", path.c_str());
+
+    const size_t size = mappedStatsSize(package.size());
+    MappedStats* stats = nullptr;
+    if (static_cast<size_t>(sb.st_size) == size) {
+        void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (addr != MAP_FAILED) {
+            stats = reinterpret_cast<MappedStats*>(addr);
+            if (!isValidMappedStats(stats, size) ||
+                memcmp(mappedPackageName(stats), package.data(), package.size())) {
+                munmap(addr, size);
+                stats = nullptr;
+            }
+        }
+    }
+    if (!stats) {
+        // A new file, one saved in an earlier format, or one of another package
+        if (!initializeStatsFile(fd, path, package, sb.st_size)) {
+            return;
+        }
+        void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) {
+            int err = errno;
+            ALOGW("Failed to mmap '%s', errno=%d (%s)", path.c_str(), err, strerror(err));
+            return;
         }
+        stats = reinterpret_cast<MappedStats*>(addr);
     }
-    close(outFd);
+    mergeProfileDataIntoStats(stats, versionCode, startTime, endTime, data);
+    munmap(stats, size);
 }
 
 class GraphicsStatsService::Dump {
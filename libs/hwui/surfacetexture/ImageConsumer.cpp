@@ -50,6 +50,10 @@ void ImageConsumer::onReleaseBufferLocked(int buf) {
     mImageSlots[buf].eglFence() = EGL_NO_SYNC_KHR;
 }
 
+void ImageConsumer::onAbandonLocked() {
+    mImportCache.clear();
+}
+
 /**
  * AutoBackendTextureRelease manages EglImage/VkImage lifetime. It is a ref-counted object
  * that keeps GPU resources alive until the last SKImage object using them is destroyed.
@@ -164,9 +168,58 @@ void AutoBackendTextureRelease::newBufferContent(GrContext* context) {
     }
 }
 
+AutoBackendTextureRelease* ImageConsumer::ImportCache::acquire(GraphicBuffer* graphicBuffer,
+                                                               GrContext* context) {
+    const uint64_t bufferId = graphicBuffer->getId();
+    for (auto& entry : mEntries) {
+        if (entry.bufferId == bufferId) {
+            entry.lastUsedFrame = mFrame;
+            entry.textureRelease->ref();
+            entry.textureRelease->newBufferContent(context);
+            return entry.textureRelease;
+        }
+    }
+    AutoBackendTextureRelease* textureRelease =
+            new AutoBackendTextureRelease(context, graphicBuffer);
+    mEntries.push_back(Entry{bufferId, mFrame, textureRelease});
+    // The initial ref is the cache's, this one is the caller's.
+    textureRelease->ref();
+    return textureRelease;
+}
+
+void ImageConsumer::ImportCache::markUsed(uint64_t bufferId) {
+    for (auto& entry : mEntries) {
+        if (entry.bufferId == bufferId) {
+            entry.lastUsedFrame = mFrame;
+            return;
+        }
+    }
+}
+
+void ImageConsumer::ImportCache::onFrameAcquired() {
+    mFrame++;
+    for (size_t i = 0; i < mEntries.size();) {
+        if (mFrame - mEntries[i].lastUsedFrame > kMaxUnusedFrames) {
+            // A slot may still use the image, so only the cache's ref is dropped.
+            mEntries[i].textureRelease->unref(false);
+            mEntries[i] = mEntries.back();
+            mEntries.pop_back();
+        } else {
+            i++;
+        }
+    }
+}
+
+void ImageConsumer::ImportCache::clear() {
+    for (auto& entry : mEntries) {
+        entry.textureRelease->unref(false);
+    }
+    mEntries.clear();
+}
+
 void ImageConsumer::ImageSlot::createIfNeeded(sp<GraphicBuffer> graphicBuffer,
                                               android_dataspace dataspace, bool forceCreate,
-                                              GrContext* context) {
+                                              GrContext* context, ImportCache& importCache) {
     if (!mTextureRelease || !mTextureRelease->getImage().get() || dataspace != mDataspace
             || forceCreate) {
         if (!graphicBuffer.get()) {
@@ -175,8 +228,9 @@ void ImageConsumer::ImageSlot::createIfNeeded(sp<GraphicBuffer> graphicBuffer,
         }
 
         if (!mTextureRelease) {
-            mTextureRelease = new AutoBackendTextureRelease(context, graphicBuffer.get());
+            mTextureRelease = importCache.acquire(graphicBuffer.get(), context);
         } else {
+            importCache.markUsed(graphicBuffer->getId());
             mTextureRelease->newBufferContent(context);
         }
 
@@ -210,7 +264,8 @@ sk_sp<SkImage> ImageConsumer::dequeueImage(bool* queueEmpty, SurfaceTexture& st,
             if (slot != BufferItem::INVALID_BUFFER_SLOT) {
                 *queueEmpty = true;
                 mImageSlots[slot].createIfNeeded(st.mSlots[slot].mGraphicBuffer,
-                        st.mCurrentDataSpace, false, renderState.getRenderThread().getGrContext());
+                        st.mCurrentDataSpace, false, renderState.getRenderThread().getGrContext(),
+                        mImportCache);
                 return mImageSlots[slot].getImage();
             }
         }
@@ -291,8 +346,9 @@ sk_sp<SkImage> ImageConsumer::dequeueImage(bool* queueEmpty, SurfaceTexture& st,
     st.computeCurrentTransformMatrixLocked();
 
     *queueEmpty = false;
+    mImportCache.onFrameAcquired();
     mImageSlots[slot].createIfNeeded(st.mSlots[slot].mGraphicBuffer, item.mDataSpace, true,
-        renderState.getRenderThread().getGrContext());
+        renderState.getRenderThread().getGrContext(), mImportCache);
     return mImageSlots[slot].getImage();
 }
 
@@ -26,6 +26,8 @@
 #include <gui/BufferItem.h>
 #include <system/graphics.h>
 
+#include <vector>
+
 namespace android {
 
 namespace uirenderer {
@@ -63,7 +65,52 @@ public:
      */
     void onFreeBufferLocked(int slotIndex);
 
+    /**
+     * onAbandonLocked releases the imported buffers that are only kept alive by the import
+     * cache. It must be called before the GrContext they were imported into goes away.
+     */
+    void onAbandonLocked();
+
 private:
+    /**
+     * ImportCache keeps the EGLImage or VkImage of each buffer that went through a slot, so
+     * that a buffer coming back, in the same or in another slot, is not imported again. This
+     * happens every frame with producers that attach their buffers, like video decoders.
+     * An import is dropped once its buffer was not acquired for kMaxUnusedFrames frames.
+     * Guarded by the SurfaceTexture mutex, like the slots.
+     */
+    class ImportCache {
+    public:
+        ~ImportCache() { clear(); }
+
+        /**
+         * Returns the import of graphicBuffer with a ref held by the caller, importing it if
+         * needed. A cached import is updated with the new buffer content.
+         */
+        AutoBackendTextureRelease* acquire(GraphicBuffer* graphicBuffer, GrContext* context);
+
+        // Marks the import of the buffer as used by the current frame.
+        void markUsed(uint64_t bufferId);
+
+        // Starts a new frame and drops the imports that went unused for too long.
+        void onFrameAcquired();
+
+        void clear();
+
+    private:
+        static constexpr uint64_t kMaxUnusedFrames = BufferQueueDefs::NUM_BUFFER_SLOTS;
+
+        struct Entry {
+            uint64_t bufferId;
+            uint64_t lastUsedFrame;
+            // The cache holds one ref.
+            AutoBackendTextureRelease* textureRelease;
+        };
+
+        std::vector<Entry> mEntries;
+        uint64_t mFrame = 0;
+    };
+
     /**
      * ImageSlot contains the information and object references that
      * ImageConsumer maintains about a BufferQueue buffer slot.
@@ -75,7 +122,7 @@ private:
         ~ImageSlot() { clear(); }
 
         void createIfNeeded(sp<GraphicBuffer> graphicBuffer, android_dataspace dataspace,
-                            bool forceCreate, GrContext* context);
+                            bool forceCreate, GrContext* context, ImportCache& importCache);
 
         void clear();
 
@@ -110,6 +157,8 @@ private:
      * of the buffer allocated to a slot.
      */
     ImageSlot mImageSlots[BufferQueueDefs::NUM_BUFFER_SLOTS];
+
+    ImportCache mImportCache;
 };
 
 } /* namespace android */
@@ -240,6 +240,7 @@ void SurfaceTexture::detachFromView() {
         for (int i=0; i < BufferQueueDefs::NUM_BUFFER_SLOTS; i++) {
             mImageConsumer.onFreeBufferLocked(i);
         }
+        mImageConsumer.onAbandonLocked();
     } else {
         SFT_LOGE("detachFromView: not attached to View");
     }
@@ -458,6 +459,7 @@ void SurfaceTexture::freeBufferLocked(int slotIndex) {
 void SurfaceTexture::abandonLocked() {
     SFT_LOGV("abandonLocked");
     mEGLConsumer.onAbandonLocked();
+    mImageConsumer.onAbandonLocked();
     ConsumerBase::abandonLocked();
 }
 
@@ -39,6 +39,8 @@ public:
         int reportFrametimeWeight = 0;
         bool renderOffscreen = true;
         int renderAhead = 0;
+        // SKP capture replayed by the skpreplay scene.
+        std::string replayFile;
     };
 
     template <class T>
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TestSceneBase.h"
+
+#include <SkPicture.h>
+#include <SkStream.h>
+
+#include <unistd.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class SkpReplay;
+
+static TestScene::Registrar _SkpReplay(TestScene::Info{
+        "skpreplay",
+        "Replays the frames of a debug.hwui.capture_skp_frames capture, looping through them. "
+        "The capture is given with --replay.",
+        [](const TestScene::Options& opts) -> test::TestScene* {
+            return new SkpReplay(opts.replayFile);
+        }});
+
+/**
+ * A capture of N frames is saved as <file>_N, <file>_N-1, ... <file>_2 and then <file> for the
+ * last frame, see SkiaPipeline::endCapture. Each frame is recorded into the same RenderNode, so
+ * they go through prepareTree and the pipeline like the app's own frames did.
+ */
+class SkpReplay : public TestScene {
+public:
+    explicit SkpReplay(const std::string& file) {
+        int lastSequence = 1;
+        while (exists(file + "_" + std::to_string(lastSequence + 1))) {
+            lastSequence++;
+        }
+        for (int sequence = lastSequence; sequence > 1; sequence--) {
+            load(file + "_" + std::to_string(sequence));
+        }
+        load(file);
+        if (frames.empty()) {
+            fprintf(stderr, "No frames to replay in '%s'\n", file.c_str());
+        }
+    }
+
+    sp<RenderNode> card;
+    void createContent(int width, int height, Canvas& canvas) override {
+        card = TestUtils::createNode(0, 0, width, height, nullptr);
+        recordFrame(0);
+        canvas.drawRenderNode(card.get());
+    }
+
+    void doFrame(int frameNr) override { recordFrame(frameNr); }
+
+private:
+    std::vector<sk_sp<SkPicture>> frames;
+
+    static bool exists(const std::string& file) { return access(file.c_str(), R_OK) == 0; }
+
+    void load(const std::string& file) {
+        if (!exists(file)) {
+            return;
+        }
+        SkFILEStream stream(file.c_str());
+        sk_sp<SkPicture> picture = SkPicture::MakeFromStream(&stream);
+        if (!picture) {
+            fprintf(stderr, "Failed to read '%s'\n", file.c_str());
+            return;
+        }
+        frames.push_back(std::move(picture));
+    }
+
+    void recordFrame(int frameNr) {
+        if (frames.empty()) {
+            return;
+        }
+        const sk_sp<SkPicture>& picture = frames[frameNr % frames.size()];
+        TestUtils::recordNode(*card, [&picture](Canvas& canvas) {
+            canvas.asSkCanvas()->drawPicture(picture);
+        });
+    }
+};
@@ -70,6 +70,9 @@ OPTIONS:
   --benchmark_format   Set output format. Possible values are tabular, json, csv
   --renderer=TYPE      Sets the render pipeline to use. May be skiagl or skiavk
   --render-ahead=NUM   Sets how far to render-ahead. Must be 0 (default), 1, or 2.
+  --replay=FILE        Replays the frames captured to FILE with debug.hwui.skp_filename
+                       and debug.hwui.capture_skp_frames. Runs the skpreplay test unless
+                       tests are given. Use with --onscreen for frame time percentiles
 )");
 }
 
@@ -172,6 +175,7 @@ enum {
     Offscreen,
     Renderer,
     RenderAhead,
+    Replay,
 };
 }
 
@@ -188,6 +192,7 @@ static const struct option LONG_OPTIONS[] = {
         {"offscreen", no_argument, nullptr, LongOpts::Offscreen},
         {"renderer", required_argument, nullptr, LongOpts::Renderer},
         {"render-ahead", required_argument, nullptr, LongOpts::RenderAhead},
+        {"replay", required_argument, nullptr, LongOpts::Replay},
         {0, 0, 0, 0}};
 
 static const char* SHORT_OPTIONS = "c:r:h";
@@ -296,6 +301,14 @@ void parseOptions(int argc, char* argv[]) {
                 }
                 break;
 
+            case LongOpts::Replay:
+                if (!optarg) {
+                    error = true;
+                    break;
+                }
+                gOpts.replayFile = optarg;
+                break;
+
             case 'h':
                 printHelp();
                 exit(EXIT_SUCCESS);
@@ -327,9 +340,14 @@ void parseOptions(int argc, char* argv[]) {
                 gRunTests.push_back(pos->second);
             }
         } while (optind < argc);
+    } else if (!gOpts.replayFile.empty()) {
+        gRunTests.push_back(TestScene::testMap()["skpreplay"]);
     } else {
         for (auto& iter : TestScene::testMap()) {
-            gRunTests.push_back(iter.second);
+            // Nothing to replay without a capture.
+            if (iter.first != "skpreplay") {
+                gRunTests.push_back(iter.second);
+            }
         }
     }
 }
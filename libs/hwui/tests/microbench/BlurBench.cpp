@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "utils/Blur.h"
+
+#include <stdlib.h>
+#include <vector>
+
+using namespace android;
+using namespace android::uirenderer;
+
+typedef void (*BlurPass)(float* weights, int32_t radius, const uint8_t* source, uint8_t* dest,
+                         int32_t width, int32_t height);
+
+static std::vector<uint8_t> makeMask(int32_t size) {
+    std::vector<uint8_t> mask(size * size);
+    srand(size);
+    for (uint8_t& alpha : mask) {
+        alpha = rand();
+    }
+    return mask;
+}
+
+// Blurs a size x size mask with the given radius, after checking the pass against the scalar
+// reference.
+static void runBlurPass(benchmark::State& state, BlurPass pass, BlurPass reference) {
+    const int32_t size = state.range(0);
+    const int32_t radius = state.range(1);
+    std::vector<float> weights(2 * radius + 1);
+    Blur::generateGaussianWeights(weights.data(), radius);
+    std::vector<uint8_t> source = makeMask(size);
+    std::vector<uint8_t> dest(source.size());
+    std::vector<uint8_t> expected(source.size());
+
+    pass(weights.data(), radius, source.data(), dest.data(), size, size);
+    reference(weights.data(), radius, source.data(), expected.data(), size, size);
+    for (size_t i = 0; i < dest.size(); i++) {
+        // Allow for the compiler contracting the scalar multiply-adds.
+        if (abs(dest[i] - expected[i]) > 1) {
+            state.SkipWithError("Blur doesn't match the scalar reference");
+            return;
+        }
+    }
+
+    while (state.KeepRunning()) {
+        pass(weights.data(), radius, source.data(), dest.data(), size, size);
+        benchmark::DoNotOptimize(dest.data());
+    }
+    state.SetItemsProcessed(state.iterations() * size * size);
+}
+
+void BM_Blur_horizontal(benchmark::State& state) {
+    runBlurPass(state, Blur::horizontal, Blur::horizontalScalar);
+}
+BENCHMARK(BM_Blur_horizontal)->Args({64, 4})->Args({256, 8})->Args({1024, 25});
+
+void BM_Blur_horizontalScalar(benchmark::State& state) {
+    runBlurPass(state, Blur::horizontalScalar, Blur::horizontalScalar);
+}
+BENCHMARK(BM_Blur_horizontalScalar)->Args({64, 4})->Args({256, 8})->Args({1024, 25});
+
+void BM_Blur_vertical(benchmark::State& state) {
+    runBlurPass(state, Blur::vertical, Blur::verticalScalar);
+}
+BENCHMARK(BM_Blur_vertical)->Args({64, 4})->Args({256, 8})->Args({1024, 25});
+
+void BM_Blur_verticalScalar(benchmark::State& state) {
+    runBlurPass(state, Blur::verticalScalar, Blur::verticalScalar);
+}
+BENCHMARK(BM_Blur_verticalScalar)->Args({64, 4})->Args({256, 8})->Args({1024, 25});
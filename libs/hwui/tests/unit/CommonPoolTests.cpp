@@ -184,3 +184,56 @@ TEST(CommonPool, syncLifecycleCheck) {
     CommonPool::waitForIdle();
     ASSERT_EQ(0, ObjectTracker::count());
 }
+
+TEST(CommonPool, groupWait) {
+    std::atomic_int count{0};
+    {
+        CommonPool::Group group;
+        for (int i = 0; i < 100; i++) {
+            group.post([&count] { count++; });
+        }
+        group.wait();
+        EXPECT_EQ(100, count.load());
+
+        std::vector<CommonPool::Task> tasks;
+        for (int i = 0; i < 50; i++) {
+            tasks.push_back([&count] { count++; });
+        }
+        group.post(std::move(tasks));
+        // The destructor waits for the batch
+    }
+    EXPECT_EQ(150, count.load());
+}
+
+TEST(CommonPool, postBatch) {
+    std::mutex mutex;
+    std::condition_variable fence;
+    int ran = 0;
+    std::vector<CommonPool::Task> tasks;
+    for (int i = 0; i < CommonPool::QUEUE_SIZE; i++) {
+        tasks.push_back([&] {
+            std::unique_lock lock{mutex};
+            ran++;
+            fence.notify_all();
+        });
+    }
+    CommonPool::postBatch(std::move(tasks));
+    std::unique_lock lock{mutex};
+    EXPECT_TRUE(fence.wait_for(lock, std::chrono::seconds(1),
+                               [&] { return ran == CommonPool::QUEUE_SIZE; }));
+    lock.unlock();
+    CommonPool::waitForIdle();
+}
+
+TEST(CommonPool, postFromWorker) {
+    std::atomic_int count{0};
+    CommonPool::Group group;
+    group.post([&count] {
+        CommonPool::Group inner;
+        inner.post([&count] { count++; });
+        // Waiting from a worker relies on the other worker stealing the task.
+        inner.wait();
+    });
+    group.wait();
+    EXPECT_EQ(1, count.load());
+}
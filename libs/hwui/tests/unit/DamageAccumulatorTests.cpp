@@ -127,3 +127,47 @@ TEST(DamageAccumulator, perspectiveTransform) {
     da.finish(&dirty);
     ASSERT_EQ(SkRect::MakeLTRB(50, 50, 500, 500), dirty);
 }
+
+TEST(DamageAccumulator, separateRects) {
+    DamageAccumulator da;
+    da.pushTransform(&Matrix4::identity());
+    {
+        da.pushTransform(&Matrix4::identity());
+        da.dirty(0, 0, 10, 10);
+        da.popTransform();
+        da.pushTransform(&Matrix4::identity());
+        da.dirty(990.5f, 990.5f, 1000, 1000);
+        da.popTransform();
+    }
+    da.popTransform();
+    DamageRects dirty;
+    da.finish(&dirty);
+    ASSERT_EQ(2, dirty.count());
+    EXPECT_EQ(SkRect::MakeLTRB(0, 0, 10, 10), dirty[0]);
+    EXPECT_EQ(SkRect::MakeLTRB(990, 990, 1000, 1000), dirty[1]);
+    EXPECT_EQ(SkRect::MakeLTRB(0, 0, 1000, 1000), dirty.bounds());
+}
+
+TEST(DamageRects, join) {
+    DamageRects rects;
+    rects.join(SkRect::MakeLTRB(0, 0, 10, 10));
+    rects.join(SkRect::MakeLTRB(100, 0, 110, 10));
+    // Overlapping both, everything ends up in one rect
+    rects.join(SkRect::MakeLTRB(5, 0, 105, 5));
+    ASSERT_EQ(1, rects.count());
+    EXPECT_EQ(SkRect::MakeLTRB(0, 0, 110, 10), rects[0]);
+
+    rects.setEmpty();
+    for (int i = 0; i < DamageRects::kMaxRects; i++) {
+        rects.join(SkRect::MakeXYWH(i * 100, 0, 10, 10));
+    }
+    ASSERT_EQ(DamageRects::kMaxRects, rects.count());
+    // Once full, joins into the closest rect
+    rects.join(SkRect::MakeXYWH(15, 0, 10, 10));
+    ASSERT_EQ(DamageRects::kMaxRects, rects.count());
+    bool found = false;
+    for (const SkRect& rect : rects) {
+        found |= rect == SkRect::MakeLTRB(0, 0, 25, 10);
+    }
+    EXPECT_TRUE(found);
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "FrameCounters.h"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <string>
+
+using namespace android::uirenderer;
+
+TEST(FrameCounters, finishFrame) {
+    FrameCounters::reset();
+    FrameCounters::add(FrameCounter::LayerUpdates, 2);
+    FrameCounters::add(FrameCounter::LayerUpdates, 1);
+    FrameCounters::add(FrameCounter::ImageBytesPinned, 400);
+    FrameCounters::finishFrame(1000);
+    EXPECT_EQ(3, FrameCounters::lastFrameValue(FrameCounter::LayerUpdates));
+    EXPECT_EQ(400, FrameCounters::lastFrameValue(FrameCounter::ImageBytesPinned));
+    EXPECT_EQ(0, FrameCounters::lastFrameValue(FrameCounter::DisplayListOps));
+
+    // The counts start over for the next frame.
+    FrameCounters::finishFrame(2000);
+    EXPECT_EQ(0, FrameCounters::lastFrameValue(FrameCounter::LayerUpdates));
+    FrameCounters::reset();
+}
+
+TEST(FrameCounters, dump) {
+    FrameCounters::reset();
+    FrameCounters::add(FrameCounter::HardwareBitmapUploads, 5);
+    FrameCounters::finishFrame(1234);
+
+    FILE* file = tmpfile();
+    ASSERT_NE(nullptr, file);
+    FrameCounters::dump(fileno(file));
+    rewind(file);
+    std::string output;
+    char buffer[256];
+    while (fgets(buffer, sizeof(buffer), file)) {
+        output += buffer;
+    }
+    fclose(file);
+
+    EXPECT_NE(std::string::npos, output.find(FrameCounters::name(FrameCounter::LayerUpdates)));
+    EXPECT_NE(std::string::npos, output.find("1234,0,0,0,0,5,0,"));
+    FrameCounters::reset();
+}
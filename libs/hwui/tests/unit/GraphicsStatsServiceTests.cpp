@@ -18,6 +18,7 @@
 
 #include "protos/graphicsstats.pb.h"
 #include "service/GraphicsStatsService.h"
+#include "utils/TimeUtils.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -160,3 +161,82 @@ TEST(GraphicsStats, merge) {
         EXPECT_EQ(expectedBucket, loadedProto.histogram().Get(i).render_millis());
     }
 }
+
+TEST(GraphicsStats, stageHistograms) {
+    std::string path = findRootPath() + "/test_stageHistograms";
+    std::string packageName = "com.test.stageHistograms";
+    MockProfileData mockData;
+    mockData.editTotalFrameCount() = 10;
+    mockData.reportStage(kStageGpu, 500_us);
+    mockData.reportStage(kStageGpu, 3_ms);
+    mockData.reportStage(kStageGpu, 100_ms);
+    mockData.reportStage(kStageDequeue, 7_ms);
+    EXPECT_EQ(1u, mockData.editStageFrameCounts(kStageGpu)[0]);
+    EXPECT_EQ(1u, mockData.editStageFrameCounts(kStageGpu)[3]);
+    EXPECT_EQ(1u, mockData.editStageFrameCounts(kStageGpu).back());
+    EXPECT_EQ(1u, mockData.editStageFrameCounts(kStageDequeue)[7]);
+
+    GraphicsStatsService::saveBuffer(path, packageName, 5, 3000, 7000, &mockData);
+    GraphicsStatsService::saveBuffer(path, packageName, 5, 7050, 10000, &mockData);
+    protos::GraphicsStatsProto loadedProto;
+    EXPECT_TRUE(GraphicsStatsService::parseFromFile(path, &loadedProto));
+    // Clean up the file
+    unlink(path.c_str());
+
+    ASSERT_EQ(NUM_STAGES, loadedProto.stage_histogram_size());
+    for (const auto& stage : loadedProto.stage_histogram()) {
+        ASSERT_EQ(ProfileData::StageHistogramSize(), stage.histogram_size());
+        for (int i = 0; i < stage.histogram_size(); i++) {
+            EXPECT_EQ(ProfileData::frameTimeForStageFrameCountIndex(i),
+                      (uint32_t)stage.histogram(i).render_millis());
+            uint32_t expectedCount =
+                    mockData.editStageFrameCounts(static_cast<FrameStage>(stage.stage()))[i] * 2;
+            EXPECT_EQ(expectedCount, (uint32_t)stage.histogram(i).frame_count());
+        }
+    }
+}
+
+TEST(GraphicsStats, upgradeProtoFile) {
+    std::string path = findRootPath() + "/test_upgradeProtoFile";
+    std::string packageName = "com.test.upgradeProtoFile";
+    MockProfileData mockData;
+    mockData.editJankFrameCount() = 20;
+    mockData.editTotalFrameCount() = 100;
+    for (size_t i = 0; i < mockData.editFrameCounts().size(); i++) {
+        mockData.editFrameCounts()[i] = (i % 5) + 1;
+    }
+
+    // Build a file in the format that serialized the whole proto after a version 1 header
+    GraphicsStatsService::saveBuffer(path, packageName, 5, 3000, 7000, &mockData);
+    protos::GraphicsStatsProto oldProto;
+    ASSERT_TRUE(GraphicsStatsService::parseFromFile(path, &oldProto));
+    std::string oldFile(4, '\0');
+    oldFile[0] = 1;
+    oldFile += oldProto.SerializeAsString();
+    FILE* file = fopen(path.c_str(), "w");
+    ASSERT_NE(nullptr, file);
+    ASSERT_EQ(oldFile.size(), fwrite(oldFile.data(), 1, oldFile.size(), file));
+    fclose(file);
+
+    protos::GraphicsStatsProto loadedProto;
+    EXPECT_TRUE(GraphicsStatsService::parseFromFile(path, &loadedProto));
+    EXPECT_EQ(100, loadedProto.summary().total_frames());
+
+    // Saving again carries the old counters over to the current format
+    GraphicsStatsService::saveBuffer(path, packageName, 6, 7050, 10000, &mockData);
+    loadedProto.Clear();
+    EXPECT_TRUE(GraphicsStatsService::parseFromFile(path, &loadedProto));
+    // Clean up the file
+    unlink(path.c_str());
+
+    EXPECT_EQ(packageName, loadedProto.package_name());
+    EXPECT_EQ(6, loadedProto.version_code());
+    EXPECT_EQ(3000, loadedProto.stats_start());
+    EXPECT_EQ(10000, loadedProto.stats_end());
+    EXPECT_EQ(20 * 2, loadedProto.summary().janky_frames());
+    EXPECT_EQ(100 * 2, loadedProto.summary().total_frames());
+    ASSERT_EQ(ProfileData::HistogramSize(), loadedProto.histogram_size());
+    for (size_t i = 0; i < mockData.editFrameCounts().size(); i++) {
+        EXPECT_EQ(((int)(i % 5) + 1) * 2, loadedProto.histogram().Get(i).frame_count());
+    }
+}
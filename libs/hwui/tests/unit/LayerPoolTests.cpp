@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "pipeline/skia/LayerPool.h"
+#include "tests/common/TestUtils.h"
+#include "utils/TimeUtils.h"
+
+using namespace android;
+using namespace android::uirenderer;
+using namespace android::uirenderer::skiapipeline;
+
+RENDERTHREAD_SKIA_PIPELINE_TEST(LayerPool, reuse) {
+    GrContext* grContext = renderThread.getGrContext();
+    ASSERT_TRUE(grContext != nullptr);
+    LayerPool pool(1024 * 1024);
+    SkSurfaceProps props(0, kUnknown_SkPixelGeometry);
+    SkImageInfo info = SkImageInfo::MakeN32Premul(128, 64);
+
+    sk_sp<SkSurface> surface = pool.acquire(grContext, info, kTopLeft_GrSurfaceOrigin, props);
+    ASSERT_TRUE(surface != nullptr);
+    SkSurface* pooled = surface.get();
+    pool.release(std::move(surface), kTopLeft_GrSurfaceOrigin, 0);
+    EXPECT_EQ(1u, pool.size());
+    EXPECT_EQ(128u * 64 * 4, pool.bytes());
+
+    // A different size or origin does not match.
+    sk_sp<SkSurface> other = pool.acquire(grContext, SkImageInfo::MakeN32Premul(64, 64),
+                                          kTopLeft_GrSurfaceOrigin, props);
+    EXPECT_NE(pooled, other.get());
+    other = pool.acquire(grContext, info, kBottomLeft_GrSurfaceOrigin, props);
+    EXPECT_NE(pooled, other.get());
+    EXPECT_EQ(1u, pool.size());
+
+    surface = pool.acquire(grContext, info, kTopLeft_GrSurfaceOrigin, props);
+    EXPECT_EQ(pooled, surface.get());
+    EXPECT_EQ(0u, pool.size());
+    EXPECT_EQ(0u, pool.bytes());
+
+    // Surfaces that are still referenced elsewhere are not pooled.
+    sk_sp<SkSurface> extraRef = surface;
+    pool.release(std::move(surface), kTopLeft_GrSurfaceOrigin, 0);
+    EXPECT_EQ(0u, pool.size());
+}
+
+RENDERTHREAD_SKIA_PIPELINE_TEST(LayerPool, limits) {
+    GrContext* grContext = renderThread.getGrContext();
+    ASSERT_TRUE(grContext != nullptr);
+    SkImageInfo info = SkImageInfo::MakeN32Premul(64, 64);
+    LayerPool pool(2 * 64 * 64 * 4);
+    SkSurfaceProps props(0, kUnknown_SkPixelGeometry);
+
+    for (int i = 0; i < 3; i++) {
+        pool.release(pool.acquire(grContext, info, kTopLeft_GrSurfaceOrigin, props),
+                     kTopLeft_GrSurfaceOrigin, i * 1_s);
+        pool.release(SkSurface::MakeRenderTarget(grContext, SkBudgeted::kYes, info),
+                     kTopLeft_GrSurfaceOrigin, i * 1_s);
+    }
+    // The oldest surfaces make room for newer ones.
+    EXPECT_EQ(2u, pool.size());
+
+    EXPECT_EQ(2_s + 2_s, pool.trim(3_s, 2_s));
+    EXPECT_EQ(2u, pool.size());
+    EXPECT_EQ(0, pool.trim(4_s, 2_s));
+    EXPECT_EQ(0u, pool.size());
+    EXPECT_EQ(0u, pool.bytes());
+}
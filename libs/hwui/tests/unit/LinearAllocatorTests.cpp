@@ -86,6 +86,21 @@ TEST(LinearAllocator, rewind) {
     EXPECT_EQ(1, destroyed);
 }
 
+TEST(LinearAllocator, recyclePages) {
+    LinearAllocator::trimPagePool();
+    void* first;
+    {
+        LinearAllocator la;
+        first = la.alloc<char>(64);
+    }
+    {
+        LinearAllocator la;
+        // The page of the first allocator is reused
+        EXPECT_EQ(first, la.alloc<char>(64));
+    }
+    LinearAllocator::trimPagePool();
+}
+
 TEST(LinearStdAllocator, simpleAllocate) {
     LinearAllocator la;
     LinearStdAllocator<void*> stdAllocator(la);
@@ -86,5 +86,23 @@ TEST(Interpolator, pathInterpolation) {
         }
     }
 }
+
+TEST(Interpolator, interpolateBatch) {
+    AccelerateDecelerateInterpolator accelerateDecelerate;
+    LinearInterpolator linear;
+    PathInterpolator path({0.0f, 0.5f, 1.0f}, {0.0f, 0.8f, 1.0f});
+    const float inFractions[] = {0.0f, 0.1f, 0.25f, 0.5f, 0.9f, 1.0f};
+    const size_t count = sizeof(inFractions) / sizeof(inFractions[0]);
+    Interpolator* const interpolators[] = {&accelerateDecelerate, &linear, &path};
+    for (Interpolator* interpolator : interpolators) {
+        std::vector<Interpolator*> batch(count, interpolator);
+        std::vector<float> fractions(std::begin(inFractions), std::end(inFractions));
+        Interpolator::interpolateBatch(interpolator->kind(), batch.data(), fractions.data(),
+                                       count);
+        for (size_t i = 0; i < count; i++) {
+            EXPECT_FLOAT_EQ(interpolator->interpolate(inFractions[i]), fractions[i]);
+        }
+    }
+}
 }
 }
@@ -266,6 +266,45 @@ TEST(RenderNode, releasedCallback) {
     EXPECT_EQ(0, refcnt);
 }
 
+TEST(RenderNode, canDrawContentOffThread) {
+    auto child = TestUtils::createNode(0, 0, 50, 50, [](RenderProperties& props, Canvas& canvas) {
+        canvas.drawColor(Color::Red_500, SkBlendMode::kSrcOver);
+    });
+    auto parent = TestUtils::createNode(0, 0, 100, 100,
+                                        [&child](RenderProperties& props, Canvas& canvas) {
+                                            canvas.drawRenderNode(child.get());
+                                        });
+    TestUtils::syncHierarchyPropertiesAndDisplayList(parent);
+    EXPECT_TRUE(parent->canDrawContentOffThread());
+
+    // A child with Z casts a shadow, lit from the light center of the RenderThread
+    child->mutateStagingProperties().setTranslationZ(5);
+    TestUtils::syncHierarchyPropertiesAndDisplayList(parent);
+    EXPECT_FALSE(parent->canDrawContentOffThread());
+    EXPECT_TRUE(child->canDrawContentOffThread());
+}
+
+TEST(RenderNode, getRevealedOutline) {
+    sp<RenderNode> node = new RenderNode();
+    SkPath outline;
+    outline.addRect(0, 0, 100, 100);
+    SkPath reveal;
+    reveal.addCircle(0, 0, 50);
+
+    const SkPath* revealed = node->getRevealedOutline(outline, reveal);
+    const uint32_t revealedID = revealed->getGenerationID();
+    EXPECT_EQ(SkRect::MakeWH(50, 50), revealed->getBounds());
+
+    // Unchanged paths reuse the same result, so it stays cached on the GPU.
+    EXPECT_EQ(revealedID, node->getRevealedOutline(outline, reveal)->getGenerationID());
+
+    reveal.reset();
+    reveal.addCircle(0, 0, 20);
+    revealed = node->getRevealedOutline(outline, reveal);
+    EXPECT_NE(revealedID, revealed->getGenerationID());
+    EXPECT_EQ(SkRect::MakeWH(20, 20), revealed->getBounds());
+}
+
 RENDERTHREAD_TEST(RenderNode, prepareTree_nullableDisplayList) {
     auto rootNode = TestUtils::createNode(0, 0, 200, 400, nullptr);
     ContextFactory contextFactory;
@@ -295,6 +334,103 @@ RENDERTHREAD_TEST(RenderNode, prepareTree_nullableDisplayList) {
     canvasContext->destroy();
 }
 
+// A chain of depth nodes at left, top, each drawing the next one.
+static sp<RenderNode> createNodeChain(int left, int top, int depth, sp<RenderNode>* deepest) {
+    sp<RenderNode> node =
+            TestUtils::createNode(1, 1, 21, 21, [](RenderProperties& props, Canvas& canvas) {
+                canvas.drawColor(Color::Red_500, SkBlendMode::kSrcOver);
+            });
+    *deepest = node;
+    for (int i = 1; i < depth; i++) {
+        sp<RenderNode> child = node;
+        const int x = i == depth - 1 ? left : 1;
+        const int y = i == depth - 1 ? top : 1;
+        node = TestUtils::createNode(x, y, x + 40, y + 40,
+                                     [child](RenderProperties& props, Canvas& canvas) {
+                                         canvas.drawRenderNode(child.get());
+                                     });
+    }
+    return node;
+}
+
+RENDERTHREAD_TEST(RenderNode, prepareTree_parallelMatchesSerial) {
+    ContextFactory contextFactory;
+    SkRect serialDirty;
+    SkRect parallelDirty;
+    for (bool parallel : {false, true}) {
+        ScopedProperty<bool> prop(Properties::parallelPrepareTree, parallel);
+        std::vector<sp<RenderNode>> children;
+        std::vector<sp<RenderNode>> deepest(4);
+        for (int i = 0; i < 4; i++) {
+            children.push_back(createNodeChain(i * 90, i * 10, 20, &deepest[i]));
+        }
+        auto rootNode = TestUtils::createNode(
+                0, 0, 400, 400, [children](RenderProperties& props, Canvas& canvas) {
+                    for (auto& child : children) {
+                        canvas.drawRenderNode(child.get());
+                    }
+                });
+        std::unique_ptr<CanvasContext> canvasContext(
+                CanvasContext::create(renderThread, false, rootNode.get(), &contextFactory));
+        TreeInfo info(TreeInfo::MODE_FULL, *canvasContext.get());
+        DamageAccumulator damageAccumulator;
+        info.damageAccumulator = &damageAccumulator;
+
+        rootNode->prepareTree(info);
+        EXPECT_TRUE(info.offThreadPrepareAttempted || !parallel);
+        for (auto& node : deepest) {
+            EXPECT_TRUE(node->hasParents());
+            EXPECT_TRUE(node->getDisplayList());
+        }
+        damageAccumulator.finish(parallel ? &parallelDirty : &serialDirty);
+        canvasContext->destroy();
+    }
+    EXPECT_FALSE(serialDirty.isEmpty());
+    EXPECT_EQ(serialDirty, parallelDirty);
+}
+
+RENDERTHREAD_TEST(RenderNode, prepareTree_publishedProperties) {
+    ContextFactory contextFactory;
+    auto child = TestUtils::createNode(10, 10, 20, 20, [](RenderProperties& props, Canvas& canvas) {
+        canvas.drawColor(Color::Red_500, SkBlendMode::kSrcOver);
+    });
+    auto rootNode = TestUtils::createNode(0, 0, 200, 200,
+                                          [&child](RenderProperties& props, Canvas& canvas) {
+                                              canvas.drawRenderNode(child.get());
+                                          });
+    std::unique_ptr<CanvasContext> canvasContext(
+            CanvasContext::create(renderThread, false, rootNode.get(), &contextFactory));
+    DamageAccumulator damageAccumulator;
+
+    // The display lists haven't been synced yet.
+    EXPECT_EQ(0u, RenderNode::publishPropertyOnlyChanges(rootNode.get()));
+    {
+        TreeInfo info(TreeInfo::MODE_FULL, *canvasContext.get());
+        info.damageAccumulator = &damageAccumulator;
+        rootNode->prepareTree(info);
+    }
+
+    child->mutateStagingProperties().setTranslationX(50);
+    child->setPropertyFieldsDirty(RenderNode::TRANSLATION_X);
+    const uint64_t epoch = RenderNode::publishPropertyOnlyChanges(rootNode.get());
+    EXPECT_NE(0u, epoch);
+    EXPECT_FALSE(child->isPropertyFieldDirty(RenderNode::TRANSLATION_X));
+
+    // The UI thread goes on with the next frame before the tree is prepared.
+    child->mutateStagingProperties().setTranslationX(100);
+    child->setPropertyFieldsDirty(RenderNode::TRANSLATION_X);
+    {
+        TreeInfo info(TreeInfo::MODE_FULL, *canvasContext.get());
+        info.damageAccumulator = &damageAccumulator;
+        info.publishedEpoch = epoch;
+        rootNode->prepareTree(info);
+    }
+    EXPECT_EQ(50, child->properties().getTranslationX());
+    EXPECT_TRUE(child->isPropertyFieldDirty(RenderNode::TRANSLATION_X));
+
+    canvasContext->destroy();
+}
+
 // TODO: Is this supposed to work in SkiaGL/SkiaVK?
 RENDERTHREAD_TEST(DISABLED_RenderNode, prepareTree_HwLayer_AVD_enqueueDamage) {
     VectorDrawable::Group* group = new VectorDrawable::Group();
@@ -60,6 +60,25 @@ public:
     static bool validateCache(ShaderCache& cache, std::vector<T> hash) {
         return cache.validateCache(hash.data(), hash.size() * sizeof(T));
     }
+
+    /**
+     * "warmUp" reads the most used entries into memory on the calling thread.
+     */
+    static void warmUp(ShaderCache& cache) {
+        std::lock_guard<std::mutex> lock(cache.mMutex);
+        cache.warmUpLocked();
+    }
+
+    static size_t warmEntryCount(ShaderCache& cache) {
+        std::lock_guard<std::mutex> lock(cache.mMutex);
+        return cache.mWarmEntries.size();
+    }
+
+    static uint32_t hitCount(ShaderCache& cache, const SkData& key) {
+        std::lock_guard<std::mutex> lock(cache.mMutex);
+        auto it = cache.mHitCounts.find(std::string((const char*)key.data(), key.size()));
+        return it == cache.mHitCounts.end() ? 0 : it->second;
+    }
 };
 
 } /* namespace skiapipeline */
@@ -187,6 +206,49 @@ TEST(ShaderCacheTest, testWriteAndRead) {
     remove(cacheFile1.c_str());
 }
 
+TEST(ShaderCacheTest, testWarmUp) {
+    if (!folderExist(getExternalStorageFolder())) {
+        // don't run the test if external storage folder is not available
+        return;
+    }
+    std::string cacheFile = getExternalStorageFolder() + "/shaderCacheTestWarmUp";
+    remove(cacheFile.c_str());
+
+    ShaderCache::get().setFilename(cacheFile.c_str());
+    ShaderCacheTestUtils::setSaveDelay(ShaderCache::get(), 0);  // disable deferred save
+    ShaderCache::get().initShaderDiskCache();
+
+    sk_sp<SkData> inVS;
+    setShader(inVS, "warmVS");
+    ShaderCache::get().store(GrProgramDescTest(1), *inVS.get());
+    setShader(inVS, "coldVS");
+    ShaderCache::get().store(GrProgramDescTest(2), *inVS.get());
+    for (int i = 0; i < 3; i++) {
+        ASSERT_NE(ShaderCache::get().load(GrProgramDescTest(1)), sk_sp<SkData>());
+    }
+    ASSERT_EQ(ShaderCacheTestUtils::hitCount(ShaderCache::get(), GrProgramDescTest(1)), 3u);
+    ASSERT_EQ(ShaderCacheTestUtils::hitCount(ShaderCache::get(), GrProgramDescTest(2)), 0u);
+
+    // the hit counts survive a restart, and only entries that were hit are warmed up
+    ShaderCacheTestUtils::terminate(ShaderCache::get(), true);
+    ShaderCache::get().initShaderDiskCache();
+    ASSERT_EQ(ShaderCacheTestUtils::hitCount(ShaderCache::get(), GrProgramDescTest(1)), 3u);
+    ShaderCacheTestUtils::warmUp(ShaderCache::get());
+    ASSERT_EQ(ShaderCacheTestUtils::warmEntryCount(ShaderCache::get()), 1u);
+
+    // a warmed up entry is handed out once, later loads go to the blob cache
+    sk_sp<SkData> outVS;
+    ASSERT_NE((outVS = ShaderCache::get().load(GrProgramDescTest(1))), sk_sp<SkData>());
+    ASSERT_TRUE(checkShader(outVS, "warmVS"));
+    ASSERT_EQ(ShaderCacheTestUtils::warmEntryCount(ShaderCache::get()), 0u);
+    ASSERT_NE((outVS = ShaderCache::get().load(GrProgramDescTest(1))), sk_sp<SkData>());
+    ASSERT_TRUE(checkShader(outVS, "warmVS"));
+    ASSERT_EQ(ShaderCacheTestUtils::hitCount(ShaderCache::get(), GrProgramDescTest(1)), 5u);
+
+    ShaderCacheTestUtils::terminate(ShaderCache::get(), false);
+    remove(cacheFile.c_str());
+}
+
 TEST(ShaderCacheTest, testCacheValidation) {
     if (!folderExist(getExternalStorageFolder())) {
         // don't run the test if external storage folder is not available
@@ -22,6 +22,7 @@
 #include "IContextFactory.h"
 #include "pipeline/skia/GLFunctorDrawable.h"
 #include "pipeline/skia/SkiaDisplayList.h"
+#include "pipeline/skia/SkiaRecordingCanvas.h"
 #include "renderthread/CanvasContext.h"
 #include "tests/common/TestContext.h"
 #include "tests/common/TestUtils.h"
@@ -93,6 +94,60 @@ TEST(SkiaDisplayList, reuseDisplayList) {
     ASSERT_EQ(availableList.get(), nullptr);
 }
 
+static std::unique_ptr<SkiaDisplayList> recordList(SkColor color, RenderNode* child) {
+    SkiaRecordingCanvas canvas(nullptr, 100, 100);
+    SkPaint paint;
+    paint.setColor(color);
+    canvas.drawRect(0, 0, 50, 50, paint);
+    canvas.drawRenderNode(child);
+    return std::unique_ptr<SkiaDisplayList>(
+            static_cast<SkiaDisplayList*>(canvas.finishRecording()));
+}
+
+TEST(SkiaDisplayList, isSameRecording) {
+    sp<RenderNode> child = new RenderNode();
+    sp<RenderNode> otherChild = new RenderNode();
+    auto list = recordList(SK_ColorRED, child.get());
+
+    EXPECT_TRUE(list->isSameRecording(*recordList(SK_ColorRED, child.get())));
+    EXPECT_FALSE(list->isSameRecording(*recordList(SK_ColorBLUE, child.get())));
+    EXPECT_FALSE(list->isSameRecording(*recordList(SK_ColorRED, otherChild.get())));
+}
+
+TEST(SkiaDisplayList, recordingCost) {
+    SkiaRecordingCanvas canvas(nullptr, 100, 100);
+    SkPaint paint;
+    canvas.drawColor(SK_ColorWHITE, SkBlendMode::kSrcOver);
+    // Clipped to the 50x50 quadrant inside the canvas.
+    canvas.drawRect(-50, -50, 50, 50, paint);
+    canvas.saveLayerAlpha(0, 0, 100, 100, 128, SaveFlags::ClipToLayer);
+    canvas.restore();
+    sk_sp<Bitmap> bitmap = TestUtils::createBitmap(10, 10);
+    canvas.drawBitmap(*bitmap, 0, 0, nullptr);
+    const int64_t rectClipPixels = 100 * 100 + 50 * 50 + 10 * 10;
+
+    SkPath circle;
+    circle.addCircle(50, 50, 10);
+    canvas.save(SaveFlags::MatrixClip);
+    canvas.clipPath(&circle, SkClipOp::kIntersect);
+    canvas.drawRect(0, 0, 100, 100, paint);
+    canvas.restore();
+
+    std::unique_ptr<SkiaDisplayList> skiaDL(
+            static_cast<SkiaDisplayList*>(canvas.finishRecording()));
+    const RecordingCost& cost = skiaDL->getRecordingCost();
+    // The draw in the circle counts the bounds of the clip, whose rounding is up to Skia.
+    EXPECT_GE(cost.pixels, rectClipPixels + 20 * 20);
+    EXPECT_LE(cost.pixels, rectClipPixels + 22 * 22);
+    EXPECT_EQ(1u, cost.saveLayers);
+    EXPECT_EQ(1u, cost.complexClipDraws);
+    EXPECT_EQ(10 * 10 * 4, cost.bitmapBytes);
+
+    skiaDL->reset();
+    EXPECT_EQ(0, skiaDL->getRecordingCost().pixels);
+    EXPECT_EQ(0u, skiaDL->getRecordingCost().saveLayers);
+}
+
 TEST(SkiaDisplayList, syncContexts) {
     SkiaDisplayList skiaDL;
 
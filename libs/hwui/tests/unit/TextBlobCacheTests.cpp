@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "hwui/TextBlobCache.h"
+
+#include <SkFont.h>
+
+using namespace android;
+
+namespace {
+
+sk_sp<SkTextBlob> getBlob(const SkFont& font, uint16_t firstGlyph, float x) {
+    uint16_t glyphs[] = {firstGlyph, 2, 3};
+    float positions[] = {x, 10, x + 10, 10, x + 20, 10};
+    return TextBlobCache::get().getOrCreate(font, glyphs, positions, 3);
+}
+
+}  // namespace
+
+TEST(TextBlobCache, reuse) {
+    TextBlobCache::get().clear();
+    SkFont font;
+    font.setSize(20);
+
+    sk_sp<SkTextBlob> blob = getBlob(font, 1, 0);
+    ASSERT_NE(nullptr, blob);
+    EXPECT_EQ(blob, getBlob(font, 1, 0));
+    EXPECT_EQ(1u, TextBlobCache::get().size());
+
+    // Any difference in the glyphs, positions or font builds a new blob.
+    EXPECT_NE(blob, getBlob(font, 4, 0));
+    EXPECT_NE(blob, getBlob(font, 1, 5));
+    SkFont biggerFont(font);
+    biggerFont.setSize(30);
+    EXPECT_NE(blob, getBlob(biggerFont, 1, 0));
+    EXPECT_EQ(4u, TextBlobCache::get().size());
+
+    TextBlobCache::get().clear();
+    EXPECT_EQ(0u, TextBlobCache::get().size());
+    EXPECT_NE(blob, getBlob(font, 1, 0));
+}
+
+TEST(TextBlobCache, evictLeastRecentlyUsed) {
+    TextBlobCache::get().clear();
+    SkFont font;
+
+    sk_sp<SkTextBlob> first = getBlob(font, 1, 0);
+    sk_sp<SkTextBlob> second = getBlob(font, 1, 1);
+    for (size_t i = 2; i < TextBlobCache::kMaxEntries; i++) {
+        getBlob(font, 1, i);
+    }
+    // Touch the first entry so the second one is evicted instead.
+    EXPECT_EQ(first, getBlob(font, 1, 0));
+    getBlob(font, 1, TextBlobCache::kMaxEntries);
+    EXPECT_EQ(TextBlobCache::kMaxEntries, TextBlobCache::get().size());
+
+    EXPECT_EQ(first, getBlob(font, 1, 0));
+    EXPECT_NE(second, getBlob(font, 1, 1));
+    TextBlobCache::get().clear();
+}
@@ -160,4 +160,35 @@ RENDERTHREAD_SKIA_PIPELINE_TEST(VectorDrawableAtlas, repack) {
     atlas.repackIfNeeded(renderThread.getGrContext());
 
     ASSERT_FALSE(atlas.isFragmented());
+}
+
+RENDERTHREAD_SKIA_PIPELINE_TEST(VectorDrawableAtlas, repackBeforeFallback) {
+    VectorDrawableAtlas atlas(100 * 100);
+    atlas.prepareForDraw(renderThread.getGrContext());
+    // 16x16 rects take no padding in the rectanizer, 36 of them allocate most of the atlas
+    const int MAX_RECTS = 36;
+    const int KEPT_RECTS = 6;
+    AtlasEntry VDRects[MAX_RECTS];
+    for (uint32_t i = 0; i < MAX_RECTS; i++) {
+        VDRects[i] = atlas.requestNewEntry(16, 16, renderThread.getGrContext());
+        ASSERT_TRUE(VDRects[i].key != INVALID_ATLAS_KEY);
+    }
+    ASSERT_FALSE(atlas.isFragmented());
+
+    // release most entries, which fragments the atlas before any allocation has failed
+    for (uint32_t i = 0; i < MAX_RECTS - KEPT_RECTS; i++) {
+        atlas.releaseEntry(VDRects[i].key);
+    }
+    ASSERT_TRUE(atlas.isFragmented());
+
+    atlas.repackIfNeeded(renderThread.getGrContext());
+    ASSERT_FALSE(atlas.isFragmented());
+
+    // the kept entries are still valid after being moved
+    for (uint32_t i = MAX_RECTS - KEPT_RECTS; i < MAX_RECTS; i++) {
+        auto VDRect = atlas.getEntry(VDRects[i].key);
+        ASSERT_TRUE(VDRect.key != INVALID_ATLAS_KEY);
+        ASSERT_TRUE(VDRect.surface.get() != nullptr);
+        ASSERT_EQ(16, VDRect.rect.width());
+    }
 }
\ No newline at end of file
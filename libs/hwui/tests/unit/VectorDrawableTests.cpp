@@ -306,6 +306,37 @@ TEST(PathParser, parseAsciiStringForSkPath) {
     }
 }
 
+TEST(PathParser, parseAsciiStringForSkPathAfterFailure) {
+    // Parsing reuses its buffers, a failed or longer parse must not leak into the next one.
+    for (const TestData& testData : sTestDataSet) {
+        for (StringPath stringPath : sStringPaths) {
+            PathParser::ParseResult failedResult;
+            SkPath skPath;
+            PathParser::parseAsciiStringForSkPath(&skPath, &failedResult, stringPath.stringPath,
+                                                  strlen(stringPath.stringPath));
+
+            PathParser::ParseResult result;
+            SkPath actualPath;
+            PathParser::parseAsciiStringForSkPath(&actualPath, &result, testData.pathString,
+                                                  strlen(testData.pathString));
+            SkPath expectedPath;
+            testData.skPathLamda(&expectedPath);
+            EXPECT_EQ(expectedPath, actualPath);
+        }
+    }
+}
+
+TEST(PathParser, getPathDataDropsInvalidVerb) {
+    // Points of a verb that fails validation are not left behind in the data.
+    PathParser::ParseResult result;
+    PathData pathData;
+    const char* pathString = "L1,0 L1,1 L0,1 z M1000";
+    PathParser::getPathDataFromAsciiString(&pathData, &result, pathString, strlen(pathString));
+    EXPECT_TRUE(result.failureOccurred);
+    EXPECT_EQ(4u, pathData.verbs.size());
+    EXPECT_EQ(6u, pathData.points.size());
+}
+
 TEST(VectorDrawableUtils, morphPathData) {
     for (const TestData& fromData : sTestDataSet) {
         for (const TestData& toData : sTestDataSet) {
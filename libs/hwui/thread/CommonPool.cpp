@@ -16,15 +16,20 @@
 
 #include "CommonPool.h"
 
+#include <stdio.h>
 #include <sys/resource.h>
 #include <utils/Trace.h>
 #include "renderthread/RenderThread.h"
 
 #include <array>
+#include <cinttypes>
 
 namespace android {
 namespace uirenderer {
 
+// Index of the worker running on this thread, -1 on other threads.
+static thread_local int sWorkerIndex = -1;
+
 CommonPool::CommonPool() {
     ATRACE_CALL();
 
@@ -43,7 +48,7 @@ CommonPool::CommonPool() {
                     startHook(name.data());
                 }
             }
-            pool->workerLoop();
+            pool->workerLoop(i);
         });
         worker.detach();
     }
@@ -55,38 +60,82 @@ CommonPool& CommonPool::instance() {
 }
 
 void CommonPool::post(Task&& task) {
-    instance().enqueue(std::move(task));
+    CommonPool& pool = instance();
+    pool.enqueue(std::move(task));
+    pool.notifyWorkers(1);
+}
+
+void CommonPool::postBatch(std::vector<Task>&& tasks) {
+    CommonPool& pool = instance();
+    for (auto& task : tasks) {
+        pool.enqueue(std::move(task));
+    }
+    pool.notifyWorkers(tasks.size());
 }
 
 void CommonPool::enqueue(Task&& task) {
-    std::unique_lock lock(mLock);
-    while (!mWorkQueue.hasSpace()) {
-        lock.unlock();
+    // Counted first so that workers never see a negative count.
+    mQueuedTasks++;
+    const int start = sWorkerIndex >= 0 ? sWorkerIndex : mNextWorker++ % THREAD_COUNT;
+    while (true) {
+        for (int i = 0; i < THREAD_COUNT; i++) {
+            if (mWorkers[(start + i) % THREAD_COUNT].queue.tryPush(std::move(task))) {
+                return;
+            }
+        }
         usleep(100);
-        lock.lock();
     }
-    mWorkQueue.push(std::move(task));
-    if (mWaitingThreads == THREAD_COUNT || (mWaitingThreads > 0 && mWorkQueue.size() > 1)) {
-        mCondition.notify_one();
+}
+
+void CommonPool::notifyWorkers(int taskCount) {
+    // Pairs with the park in workerLoop(): either the worker sees the new task when it checks
+    // the queues after counting itself as waiting, or it is counted here.
+    const int waiting = mWaitingThreads.load();
+    if (waiting == 0) {
+        return;
+    }
+    // A single task is left to a busy worker rather than waking another thread for it, unless
+    // it was posted by a worker, which may be about to block on it.
+    if (waiting == THREAD_COUNT || sWorkerIndex >= 0 || mQueuedTasks.load() > 1) {
+        std::lock_guard lock(mLock);
+        if (taskCount > 1) {
+            mCondition.notify_all();
+        } else {
+            mCondition.notify_one();
+        }
     }
 }
 
-void CommonPool::workerLoop() {
-    std::unique_lock lock(mLock);
+bool CommonPool::tryDequeue(int workerIndex, Task* task) {
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        Worker& worker = mWorkers[(workerIndex + i) % THREAD_COUNT];
+        if (worker.queue.tryPop(task)) {
+            mQueuedTasks--;
+            mWorkers[workerIndex].ranCount++;
+            if (i != 0) {
+                mWorkers[workerIndex].stolenCount++;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+void CommonPool::workerLoop(int workerIndex) {
+    sWorkerIndex = workerIndex;
+    Task task;
     while (true) {
-        if (!mWorkQueue.hasWork()) {
+        if (!tryDequeue(workerIndex, &task)) {
+            std::unique_lock lock(mLock);
             mWaitingThreads++;
-            mCondition.wait(lock);
+            // Need to double-check that no work arrived before we were counted as waiting
+            while (!tryDequeue(workerIndex, &task)) {
+                mCondition.wait(lock);
+            }
             mWaitingThreads--;
         }
-        // Need to double-check that work is still available now that we have the lock
-        // It may have already been grabbed by a different thread
-        while (mWorkQueue.hasWork()) {
-            auto work = mWorkQueue.pop();
-            lock.unlock();
-            work();
-            lock.lock();
-        }
+        task();
+        task = nullptr;
     }
 }
 
@@ -96,12 +145,58 @@ void CommonPool::waitForIdle() {
 
 void CommonPool::doWaitForIdle() {
     std::unique_lock lock(mLock);
-    while (mWaitingThreads != THREAD_COUNT) {
+    while (mWaitingThreads != THREAD_COUNT || mQueuedTasks != 0) {
         lock.unlock();
         usleep(100);
         lock.lock();
     }
 }
 
+void CommonPool::dump(int fd) {
+    instance().doDump(fd);
+}
+
+void CommonPool::doDump(int fd) {
+    dprintf(fd, "\nCommonPool: %d tasks queued, %d of %d workers idle\n", mQueuedTasks.load(),
+            mWaitingThreads.load(), THREAD_COUNT);
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        const Worker& worker = mWorkers[i];
+        dprintf(fd, "  hwuiTask%d: %d queued, %" PRIu64 " ran, %" PRIu64 " stolen\n", i,
+                worker.queue.size(), worker.ranCount.load(), worker.stolenCount.load());
+    }
+}
+
+CommonPool::Task CommonPool::Group::wrap(Task&& task) {
+    {
+        std::lock_guard lock(mLock);
+        mPending++;
+    }
+    return [this, task = std::move(task)]() {
+        task();
+        std::lock_guard lock(mLock);
+        if (--mPending == 0) {
+            mCondition.notify_all();
+        }
+    };
+}
+
+void CommonPool::Group::post(Task&& task) {
+    CommonPool::post(wrap(std::move(task)));
+}
+
+void CommonPool::Group::post(std::vector<Task>&& tasks) {
+    for (auto& task : tasks) {
+        task = wrap(std::move(task));
+    }
+    CommonPool::postBatch(std::move(tasks));
+}
+
+void CommonPool::Group::wait() {
+    std::unique_lock lock(mLock);
+    while (mPending > 0) {
+        mCondition.wait(lock);
+    }
+}
+
 }  // namespace uirenderer
 }  // namespace android
\ No newline at end of file
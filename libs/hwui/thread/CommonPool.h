@@ -21,55 +21,99 @@
 
 #include <log/log.h>
 
+#include <array>
+#include <atomic>
 #include <condition_variable>
 #include <functional>
 #include <future>
 #include <mutex>
+#include <vector>
 
 namespace android {
 namespace uirenderer {
 
+/**
+ * Bounded multi-producer multi-consumer queue that doesn't take a lock. Each slot has a sequence
+ * number telling whether it is free for the push at, or holds the element for the pop at, a
+ * given position, so pushers and poppers only race on claiming a position.
+ */
 template <class T, int SIZE>
-class ArrayQueue {
-    PREVENT_COPY_AND_ASSIGN(ArrayQueue);
-    static_assert(SIZE > 0, "Size must be positive");
+class WorkQueue {
+    PREVENT_COPY_AND_ASSIGN(WorkQueue);
+    static_assert(SIZE > 0 && (SIZE & (SIZE - 1)) == 0, "Size must be a power of two");
 
 public:
-    ArrayQueue() = default;
-    ~ArrayQueue() = default;
-
-    constexpr size_t capacity() const { return SIZE; }
-    constexpr bool hasWork() const { return mHead != mTail; }
-    constexpr bool hasSpace() const { return ((mHead + 1) % SIZE) != mTail; }
-    constexpr int size() const {
-        if (mHead > mTail) {
-            return mHead - mTail;
-        } else {
-            return mTail - mHead + SIZE;
+    WorkQueue() {
+        for (int i = 0; i < SIZE; i++) {
+            mSlots[i].sequence.store(i, std::memory_order_relaxed);
         }
     }
+    ~WorkQueue() = default;
 
-    constexpr void push(T&& t) {
-        int newHead = (mHead + 1) % SIZE;
-        LOG_ALWAYS_FATAL_IF(newHead == mTail, "no space");
+    constexpr size_t capacity() const { return SIZE; }
 
-        mBuffer[mHead] = std::move(t);
-        mHead = newHead;
+    // Approximate while other threads push or pop.
+    int size() const {
+        const size_t head = mPushPos.load(std::memory_order_relaxed);
+        const size_t tail = mPopPos.load(std::memory_order_relaxed);
+        return head > tail ? head - tail : 0;
     }
 
-    constexpr T pop() {
-        LOG_ALWAYS_FATAL_IF(mTail == mHead, "empty");
-        int index = mTail;
-        mTail = (mTail + 1) % SIZE;
-        T ret = std::move(mBuffer[index]);
-        mBuffer[index] = nullptr;
-        return ret;
+    // Moves from t only if there was space.
+    bool tryPush(T&& t) {
+        size_t pos = mPushPos.load(std::memory_order_relaxed);
+        Slot* slot;
+        while (true) {
+            slot = &mSlots[pos & (SIZE - 1)];
+            size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+            if (diff == 0) {
+                if (mPushPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = mPushPos.load(std::memory_order_relaxed);
+            }
+        }
+        slot->value = std::move(t);
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPop(T* out) {
+        size_t pos = mPopPos.load(std::memory_order_relaxed);
+        Slot* slot;
+        while (true) {
+            slot = &mSlots[pos & (SIZE - 1)];
+            size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (mPopPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = mPopPos.load(std::memory_order_relaxed);
+            }
+        }
+        *out = std::move(slot->value);
+        slot->value = nullptr;
+        slot->sequence.store(pos + SIZE, std::memory_order_release);
+        return true;
     }
 
 private:
-    T mBuffer[SIZE];
-    int mHead = 0;
-    int mTail = 0;
+    struct Slot {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    Slot mSlots[SIZE];
+    alignas(64) std::atomic<size_t> mPushPos{0};
+    alignas(64) std::atomic<size_t> mPopPos{0};
 };
 
 class CommonPool {
@@ -80,8 +124,38 @@ public:
     static constexpr auto THREAD_COUNT = 2;
     static constexpr auto QUEUE_SIZE = 128;
 
+    /**
+     * A set of tasks that can be waited on together. The destructor waits too, so tasks may
+     * reference the stack of whoever owns the group.
+     */
+    class Group {
+        PREVENT_COPY_AND_ASSIGN(Group);
+
+    public:
+        Group() = default;
+        ~Group() { wait(); }
+
+        void post(Task&& task);
+
+        // Posts all the tasks before waking the workers for them.
+        void post(std::vector<Task>&& tasks);
+
+        // Blocks until every task posted so far has run.
+        void wait();
+
+    private:
+        Task wrap(Task&& task);
+
+        std::mutex mLock;
+        std::condition_variable mCondition;
+        int mPending = 0;
+    };
+
     static void post(Task&& func);
 
+    // Like post() for each task, but wakes the workers once for all of them.
+    static void postBatch(std::vector<Task>&& tasks);
+
     template <class F>
     static auto async(F&& func) -> std::future<decltype(func())> {
         typedef std::packaged_task<decltype(func())()> task_t;
@@ -100,6 +174,9 @@ public:
     // For testing purposes only, blocks until all worker threads are parked.
     static void waitForIdle();
 
+    // Prints the queue depths and steal counts, for dumpsys gfxinfo.
+    static void dump(int fd);
+
 private:
     static CommonPool& instance();
 
@@ -107,14 +184,29 @@ private:
     ~CommonPool() {}
 
     void enqueue(Task&&);
+    void notifyWorkers(int taskCount);
+    bool tryDequeue(int workerIndex, Task* task);
     void doWaitForIdle();
+    void doDump(int fd);
 
-    void workerLoop();
+    void workerLoop(int workerIndex);
+
+    // Each worker runs the tasks of its own queue first and steals from the others when it
+    // runs out. Tasks posted from a worker go to its own queue, other posts are spread across
+    // the queues.
+    struct Worker {
+        WorkQueue<Task, QUEUE_SIZE / THREAD_COUNT> queue;
+        std::atomic<uint64_t> ranCount{0};
+        std::atomic<uint64_t> stolenCount{0};
+    };
+    std::array<Worker, THREAD_COUNT> mWorkers;
+    std::atomic<uint32_t> mNextWorker{0};
+    std::atomic<int> mQueuedTasks{0};
 
+    // Only taken to park and wake workers.
     std::mutex mLock;
     std::condition_variable mCondition;
-    int mWaitingThreads = 0;
-    ArrayQueue<Task, QUEUE_SIZE> mWorkQueue;
+    std::atomic<int> mWaitingThreads{0};
 };
 
 }  // namespace uirenderer
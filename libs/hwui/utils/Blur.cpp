@@ -15,9 +15,17 @@
  */
 
 #include <math.h>
+#include <string.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "Blur.h"
 #include "MathUtils.h"
+#include "thread/CommonPool.h"
 
 namespace android {
 namespace uirenderer {
@@ -91,8 +99,170 @@ void Blur::generateGaussianWeights(float* weights, float radius) {
     }
 }
 
+namespace {
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define BLUR_SIMD 1
+
+using Float4 = float32x4_t;
+
+inline Float4 load4(const uint8_t* p) {
+    uint32_t bytes;
+    memcpy(&bytes, p, sizeof(bytes));
+    uint16x8_t shorts = vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(bytes)));
+    return vcvtq_f32_u32(vmovl_u16(vget_low_u16(shorts)));
+}
+
+inline Float4 splat(float f) {
+    return vdupq_n_f32(f);
+}
+
+// Multiplies and adds separately, as the scalar loops do, so that the results match them.
+inline Float4 mulAdd(Float4 acc, Float4 v, Float4 w) {
+    return vaddq_f32(acc, vmulq_f32(v, w));
+}
+
+inline void store4(uint8_t* p, Float4 v) {
+    uint16x4_t shorts = vqmovn_u32(vcvtq_u32_f32(v));
+    uint8x8_t bytes = vqmovn_u16(vcombine_u16(shorts, shorts));
+    uint32_t out = vget_lane_u32(vreinterpret_u32_u8(bytes), 0);
+    memcpy(p, &out, sizeof(out));
+}
+
+#elif defined(__SSE2__)
+#define BLUR_SIMD 1
+
+using Float4 = __m128;
+
+inline Float4 load4(const uint8_t* p) {
+    int32_t bytes;
+    memcpy(&bytes, p, sizeof(bytes));
+    const __m128i zero = _mm_setzero_si128();
+    __m128i shorts = _mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero);
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(shorts, zero));
+}
+
+inline Float4 splat(float f) {
+    return _mm_set1_ps(f);
+}
+
+inline Float4 mulAdd(Float4 acc, Float4 v, Float4 w) {
+    return _mm_add_ps(acc, _mm_mul_ps(v, w));
+}
+
+inline void store4(uint8_t* p, Float4 v) {
+    __m128i ints = _mm_cvttps_epi32(v);
+    __m128i shorts = _mm_packs_epi32(ints, ints);
+    int32_t out = _mm_cvtsi128_si32(_mm_packus_epi16(shorts, shorts));
+    memcpy(p, &out, sizeof(out));
+}
+
+#endif
+
+// Masks with at least this many pixels are blurred on the CommonPool threads as well.
+constexpr int32_t kParallelPixelCount = 256 * 256;
+
+inline int32_t clamp(int32_t value, int32_t max) {
+    return value < 0 ? 0 : (value > max ? max : value);
+}
+
+// Splits the rows of the mask into a band for every CommonPool thread and one for this thread.
+template <typename RowFunc>
+void forEachRow(int32_t width, int32_t height, const RowFunc& blurRow) {
+    if (width * height < kParallelPixelCount) {
+        for (int32_t y = 0; y < height; y++) {
+            blurRow(y);
+        }
+        return;
+    }
+
+    constexpr int32_t shareCount = CommonPool::THREAD_COUNT + 1;
+    auto blurShare = [&blurRow, height](int32_t share) {
+        const int32_t end = height * (share + 1) / shareCount;
+        for (int32_t y = height * share / shareCount; y < end; y++) {
+            blurRow(y);
+        }
+    };
+    CommonPool::Group group;
+    for (int32_t share = 1; share < shareCount; share++) {
+        group.post([&blurShare, share] { blurShare(share); });
+    }
+    blurShare(0);
+    group.wait();
+}
+
+void horizontalRow(const float* weights, int32_t radius, const uint8_t* input, uint8_t* output,
+                   int32_t width) {
+    int32_t x = 0;
+#ifdef BLUR_SIMD
+    for (; x < radius && x < width; x++) {
+        float blurredPixel = 0.0f;
+        for (int32_t r = -radius; r <= radius; r++) {
+            blurredPixel += (float)input[clamp(x + r, width - 1)] * weights[r + radius];
+        }
+        output[x] = (uint8_t)blurredPixel;
+    }
+    // Four pixels at a time while their windows are inside the row.
+    for (; x + 3 < width - radius; x += 4) {
+        const uint8_t* i = input + (x - radius);
+        Float4 blurredPixels = splat(0.0f);
+        for (int32_t r = 0; r <= 2 * radius; r++) {
+            blurredPixels = mulAdd(blurredPixels, load4(i + r), splat(weights[r]));
+        }
+        store4(output + x, blurredPixels);
+    }
+#endif
+    for (; x < width; x++) {
+        float blurredPixel = 0.0f;
+        for (int32_t r = -radius; r <= radius; r++) {
+            blurredPixel += (float)input[clamp(x + r, width - 1)] * weights[r + radius];
+        }
+        output[x] = (uint8_t)blurredPixel;
+    }
+}
+
+void verticalRow(const float* weights, int32_t radius, const uint8_t* source, uint8_t* output,
+                 int32_t y, int32_t width, int32_t height) {
+    int32_t x = 0;
+#ifdef BLUR_SIMD
+    // Four columns at a time, with the window's rows clamped to the mask.
+    for (; x + 3 < width; x += 4) {
+        Float4 blurredPixels = splat(0.0f);
+        for (int32_t r = -radius; r <= radius; r++) {
+            const uint8_t* i = source + clamp(y + r, height - 1) * width + x;
+            blurredPixels = mulAdd(blurredPixels, load4(i), splat(weights[r + radius]));
+        }
+        store4(output + x, blurredPixels);
+    }
+#endif
+    for (; x < width; x++) {
+        float blurredPixel = 0.0f;
+        for (int32_t r = -radius; r <= radius; r++) {
+            const uint8_t* i = source + clamp(y + r, height - 1) * width + x;
+            blurredPixel += (float)(*i) * weights[r + radius];
+        }
+        output[x] = (uint8_t)blurredPixel;
+    }
+}
+
+}  // namespace
+
 void Blur::horizontal(float* weights, int32_t radius, const uint8_t* source, uint8_t* dest,
                       int32_t width, int32_t height) {
+    forEachRow(width, height, [=](int32_t y) {
+        horizontalRow(weights, radius, source + y * width, dest + y * width, width);
+    });
+}
+
+void Blur::vertical(float* weights, int32_t radius, const uint8_t* source, uint8_t* dest,
+                    int32_t width, int32_t height) {
+    forEachRow(width, height, [=](int32_t y) {
+        verticalRow(weights, radius, source, dest + y * width, y, width, height);
+    });
+}
+
+void Blur::horizontalScalar(float* weights, int32_t radius, const uint8_t* source, uint8_t* dest,
+                            int32_t width, int32_t height) {
     float blurredPixel = 0.0f;
     float currentPixel = 0.0f;
 
@@ -134,8 +304,8 @@ void Blur::horizontal(float* weights, int32_t radius, const uint8_t* source, uin
     }
 }
 
-void Blur::vertical(float* weights, int32_t radius, const uint8_t* source, uint8_t* dest,
-                    int32_t width, int32_t height) {
+void Blur::verticalScalar(float* weights, int32_t radius, const uint8_t* source, uint8_t* dest,
+                          int32_t width, int32_t height) {
     float blurredPixel = 0.0f;
     float currentPixel = 0.0f;
 
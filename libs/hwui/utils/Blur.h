@@ -35,10 +35,17 @@ public:
     static uint32_t convertRadiusToInt(float radius);
 
     static void generateGaussianWeights(float* weights, float radius);
+    // Blur several pixels at a time with NEON or SSE2 where available, and large masks on the
+    // CommonPool threads as well.
     static void horizontal(float* weights, int32_t radius, const uint8_t* source, uint8_t* dest,
                            int32_t width, int32_t height);
     static void vertical(float* weights, int32_t radius, const uint8_t* source, uint8_t* dest,
                          int32_t width, int32_t height);
+    // One pixel at a time, as a reference for horizontal() and vertical().
+    static void horizontalScalar(float* weights, int32_t radius, const uint8_t* source,
+                                 uint8_t* dest, int32_t width, int32_t height);
+    static void verticalScalar(float* weights, int32_t radius, const uint8_t* source,
+                               uint8_t* dest, int32_t width, int32_t height);
 };
 
 }  // namespace uirenderer
@@ -30,11 +30,20 @@
 #include <stdlib.h>
 #include <utils/Log.h>
 #include <utils/Macros.h>
+#include <utils/String8.h>
+
+#include <atomic>
+#include <mutex>
 
 // The ideal size of a page allocation (these need to be multiples of 8)
 #define INITIAL_PAGE_SIZE ((size_t)512)  // 512b
 #define MAX_PAGE_SIZE ((size_t)131072)   // 128kb
 
+// Pages of the sizes between INITIAL_PAGE_SIZE and MAX_PAGE_SIZE are kept for reuse when their
+// allocator is destroyed, up to this many bytes across the process
+#define PAGE_SIZE_CLASSES 9
+#define MAX_POOLED_BYTES ((size_t)1048576)  // 1mb
+
 // The maximum amount of wasted space we can have per page
 // Allocations exceeding this will have their own dedicated page
 // If this is too low, we will malloc too much
@@ -80,7 +89,10 @@ public:
     Page* next() { return mNextPage; }
     void setNext(Page* next) { mNextPage = next; }
 
-    Page() : mNextPage(0) {}
+    // -1 for dedicated pages, which aren't recycled
+    int sizeClass() { return mSizeClass; }
+
+    explicit Page(int sizeClass) : mNextPage(0), mSizeClass(sizeClass) {}
 
     void* operator new(size_t /*size*/, void* buf) { return buf; }
 
@@ -91,8 +103,98 @@ public:
 private:
     Page(const Page& /*other*/) {}
     Page* mNextPage;
+    int mSizeClass;
 };
 
+static int sizeClassFor(size_t pageSize) {
+    for (int sizeClass = 0; sizeClass < PAGE_SIZE_CLASSES; sizeClass++) {
+        if (pageSize == INITIAL_PAGE_SIZE << sizeClass) {
+            return sizeClass;
+        }
+    }
+    return -1;
+}
+
+/**
+ * The buffers of recycled pages, one free list per size class. Display lists are recorded on the
+ * UI thread and destroyed on the RenderThread, so this is shared by the whole process.
+ */
+class LinearAllocator::PagePool {
+public:
+    // Returns nullptr if there is no free buffer of that size class.
+    void* acquire(int sizeClass) {
+        std::lock_guard lock(mLock);
+        Buffer* buffer = mFree[sizeClass];
+        if (!buffer) {
+            mMisses++;
+            return nullptr;
+        }
+        mFree[sizeClass] = buffer->next;
+        mPooledBytes -= bufferSize(sizeClass);
+        mHits++;
+        return buffer;
+    }
+
+    // Returns false if the pool is full, in which case the caller frees the buffer.
+    bool release(void* buf, int sizeClass) {
+        const size_t size = bufferSize(sizeClass);
+        std::lock_guard lock(mLock);
+        if (mPooledBytes + size > MAX_POOLED_BYTES) {
+            return false;
+        }
+        Buffer* buffer = reinterpret_cast<Buffer*>(buf);
+        buffer->next = mFree[sizeClass];
+        mFree[sizeClass] = buffer;
+        mPooledBytes += size;
+        return true;
+    }
+
+    void trim() {
+        std::lock_guard lock(mLock);
+        for (auto& buffer : mFree) {
+            while (buffer) {
+                Buffer* next = buffer->next;
+                free(buffer);
+                buffer = next;
+            }
+        }
+        mPooledBytes = 0;
+    }
+
+    void dump(String8& log) {
+        std::lock_guard lock(mLock);
+        log.appendFormat("  Pooled %6.2f kB / %6.2f kB (hits = %zu, misses = %zu)\n",
+                         mPooledBytes / 1024.0f, MAX_POOLED_BYTES / 1024.0f, mHits, mMisses);
+    }
+
+private:
+    struct Buffer {
+        Buffer* next;
+    };
+
+    static size_t bufferSize(int sizeClass) {
+        return ALIGN((INITIAL_PAGE_SIZE << sizeClass) + sizeof(Page));
+    }
+
+    std::mutex mLock;
+    Buffer* mFree[PAGE_SIZE_CLASSES] = {};
+    size_t mPooledBytes = 0;
+    size_t mHits = 0;
+    size_t mMisses = 0;
+};
+
+LinearAllocator::PagePool& LinearAllocator::pagePool() {
+    static PagePool* sPool = new PagePool();
+    return *sPool;
+}
+
+// Usage of the allocators destroyed so far, to tune the page sizes with.
+static std::atomic<size_t> sRetiredAllocators{0};
+static std::atomic<size_t> sRetiredPages{0};
+static std::atomic<size_t> sRetiredDedicatedPages{0};
+static std::atomic<size_t> sRetiredAllocatedBytes{0};
+static std::atomic<size_t> sRetiredWastedBytes{0};
+
 LinearAllocator::LinearAllocator()
         : mPageSize(INITIAL_PAGE_SIZE)
         , mMaxAllocSize(INITIAL_PAGE_SIZE * MAX_WASTE_RATIO)
@@ -113,11 +215,22 @@ LinearAllocator::~LinearAllocator(void) {
     Page* p = mPages;
     while (p) {
         Page* next = p->next();
+        const int sizeClass = p->sizeClass();
         p->~Page();
-        free(p);
+        if (sizeClass < 0 || !pagePool().release(p, sizeClass)) {
+            free(p);
+        }
         RM_ALLOCATION();
         p = next;
     }
+
+    if (mPageCount) {
+        sRetiredAllocators++;
+        sRetiredPages += mPageCount;
+        sRetiredDedicatedPages += mDedicatedPageCount;
+        sRetiredAllocatedBytes += mTotalAllocated;
+        sRetiredWastedBytes += mWastedSpace;
+    }
 }
 
 void* LinearAllocator::start(Page* p) {
@@ -141,7 +254,7 @@ void LinearAllocator::ensureNext(size_t size) {
         mPageSize = ALIGN(mPageSize);
     }
     mWastedSpace += mPageSize;
-    Page* p = newPage(mPageSize);
+    Page* p = newPage(mPageSize, false);
     if (mCurrentPage) {
         mCurrentPage->setNext(p);
     }
@@ -157,7 +270,7 @@ void* LinearAllocator::allocImpl(size_t size) {
     if (size > mMaxAllocSize && !fitsInCurrentPage(size)) {
         ALOGV("Exceeded max size %zu > %zu", size, mMaxAllocSize);
         // Allocation is too large, create a dedicated page for the allocation
-        Page* page = newPage(size);
+        Page* page = newPage(size, true);
         mDedicatedPageCount++;
         page->setNext(mPages);
         mPages = page;
@@ -216,13 +329,36 @@ void LinearAllocator::rewindIfLastAlloc(void* ptr, size_t allocSize) {
     }
 }
 
-LinearAllocator::Page* LinearAllocator::newPage(size_t pageSize) {
+LinearAllocator::Page* LinearAllocator::newPage(size_t pageSize, bool dedicated) {
+    const int sizeClass = dedicated ? -1 : sizeClassFor(pageSize);
     pageSize = ALIGN(pageSize + sizeof(LinearAllocator::Page));
     ADD_ALLOCATION();
     mTotalAllocated += pageSize;
     mPageCount++;
-    void* buf = malloc(pageSize);
-    return new (buf) Page();
+    void* buf = sizeClass >= 0 ? pagePool().acquire(sizeClass) : nullptr;
+    if (!buf) {
+        buf = malloc(pageSize);
+    }
+    return new (buf) Page(sizeClass);
+}
+
+void LinearAllocator::trimPagePool() {
+    pagePool().trim();
+}
+
+void LinearAllocator::dumpPageStats(String8& log) {
+    log.appendFormat("LinearAllocator pages:\n");
+    pagePool().dump(log);
+    const size_t allocators = sRetiredAllocators;
+    if (!allocators) {
+        return;
+    }
+    const size_t allocated = sRetiredAllocatedBytes;
+    log.appendFormat("  Per allocator: %6.2f kB, %.1f pages (%.1f dedicated), %.1f%% wasted "
+                     "(allocators = %zu)\n",
+                     allocated / 1024.0f / allocators, (float)sRetiredPages / allocators,
+                     (float)sRetiredDedicatedPages / allocators,
+                     allocated ? sRetiredWastedBytes * 100.0f / allocated : 0.0f, allocators);
 }
 
 static const char* toSize(size_t value, float& result) {
@@ -32,6 +32,9 @@
 #include <vector>
 
 namespace android {
+
+class String8;
+
 namespace uirenderer {
 
 /**
@@ -116,10 +119,23 @@ public:
      */
     size_t usedSize() const { return mTotalAllocated - mWastedSpace; }
 
+    /**
+     * Frees the pages that destroyed allocators left for reuse.
+     */
+    static void trimPagePool();
+
+    /**
+     * Appends the state of the page pool and the average usage of the allocators destroyed so
+     * far (pages, dedicated pages, wasted space) to log.
+     */
+    static void dumpPageStats(String8& log);
+
 private:
     LinearAllocator(const LinearAllocator& other);
 
     class Page;
+    class PagePool;
+    static PagePool& pagePool();
     typedef void (*Destructor)(void* addr);
     struct DestructorNode {
         Destructor dtor;
@@ -131,7 +147,7 @@ private:
 
     void addToDestructionList(Destructor, void* addr);
     void runDestructorFor(void* addr);
-    Page* newPage(size_t pageSize);
+    Page* newPage(size_t pageSize, bool dedicated);
     bool fitsInCurrentPage(size_t size);
     void ensureNext(size_t size);
     void* start(Page* p);
@@ -15,14 +15,19 @@
  */
 
 #define LOG_TAG "PointerController"
+#define ATRACE_TAG ATRACE_TAG_INPUT
 //#define LOG_NDEBUG 0
 
 // Log debug messages about pointer updates
 #define DEBUG_POINTER_UPDATES 0
 
+// Log the rate at which vsync wakes up the pointer controller
+#define DEBUG_VSYNC_WAKEUPS 0
+
 #include "PointerController.h"
 
 #include <log/log.h>
+#include <utils/Trace.h>
 
 #include <memory>
 
@@ -43,6 +48,9 @@ static const nsecs_t POINTER_FADE_DURATION = 500 * 1000000LL; // 500 ms
 // The number of events to be read at once for DisplayEventReceiver.
 static const int EVENT_BUFFER_SIZE = 100;
 
+// Interval over which the vsync wakeup rate is reported.
+static const nsecs_t VSYNC_WAKEUPS_REPORT_INTERVAL = 1000 * 1000000LL; // 1 second
+
 std::shared_ptr<PointerController> PointerController::create(
         const sp<PointerControllerPolicyInterface>& policy, const sp<Looper>& looper,
         const sp<SpriteController>& spriteController) {
@@ -65,6 +73,7 @@ std::shared_ptr<PointerController> PointerController::create(
     if (controller->mDisplayEventReceiver.initCheck() == NO_ERROR) {
         controller->mLooper->addFd(controller->mDisplayEventReceiver.getFd(), Looper::POLL_CALLBACK,
                                    Looper::EVENT_INPUT, controller->mCallback, nullptr);
+        controller->mVsyncAvailable = true;
     } else {
         ALOGE("Failed to initialize DisplayEventReceiver.");
     }
@@ -83,6 +92,10 @@ PointerController::PointerController(const sp<PointerControllerPolicyInterface>&
 
     mLocked.animationPending = false;
 
+    mLocked.frameUpdatePending = false;
+    mLocked.vsyncWakeupsWindowStart = 0;
+    mLocked.vsyncWakeups = 0;
+
     mLocked.presentation = Presentation::POINTER;
     mLocked.presentationChanged = false;
 
@@ -107,6 +120,11 @@ PointerController::~PointerController() {
 
     AutoMutex _l(mLock);
 
+    if (mLocked.frameUpdatePending) {
+        mLocked.frameUpdatePending = false;
+        mSpriteController->closeTransaction();
+    }
+
     mLocked.pointerSprite.clear();
 
     for (auto& it : mLocked.spotsByDisplay) {
@@ -301,6 +319,7 @@ void PointerController::setSpots(const PointerCoords* spotCoords,
         newSpots = iter->second;
     }
 
+    requestFrameLocked();
     mSpriteController->openTransaction();
 
     // Add or move spots for fingers that are down.
@@ -533,13 +552,29 @@ int PointerController::LooperCallback::handleEvent(int /* fd */, int events, voi
 void PointerController::doAnimate(nsecs_t timestamp) {
     AutoMutex _l(mLock);
 
-    mLocked.animationPending = false;
+    reportVsyncWakeupLocked(timestamp);
 
-    bool keepFading = doFadingAnimationLocked(timestamp);
-    bool keepBitmapFlipping = doBitmapAnimationLocked(timestamp);
-    if (keepFading || keepBitmapFlipping) {
-        startAnimationLocked();
+    // Send everything that changed for this frame to the sprite controller as one update.
+    // Changes made while animating belong to this frame, so they don't request another one.
+    mSpriteController->openTransaction();
+    bool wasFrameUpdatePending = mLocked.frameUpdatePending;
+    mLocked.frameUpdatePending = true;
+
+    if (mLocked.animationPending) {
+        mLocked.animationPending = false;
+
+        bool keepFading = doFadingAnimationLocked(timestamp);
+        bool keepBitmapFlipping = doBitmapAnimationLocked(timestamp);
+        if (keepFading || keepBitmapFlipping) {
+            startAnimationLocked();
+        }
     }
+
+    mLocked.frameUpdatePending = false;
+    if (wasFrameUpdatePending) {
+        mSpriteController->closeTransaction();
+    }
+    mSpriteController->closeTransaction();
 }
 
 bool PointerController::doFadingAnimationLocked(nsecs_t timestamp) {
@@ -605,6 +640,12 @@ bool PointerController::doBitmapAnimationLocked(nsecs_t timestamp) {
         return false;
     }
 
+    // Don't wake up for a pointer nobody can see. updatePointerLocked() restarts the
+    // animation when the pointer is shown again.
+    if (mLocked.pointerAlpha <= 0.0f) {
+        return false;
+    }
+
     if (timestamp - mLocked.lastFrameUpdatedTime > iter->second.durationPerFrame) {
         mSpriteController->openTransaction();
 
@@ -635,6 +676,35 @@ void PointerController::startAnimationLocked() {
     }
 }
 
+/* Holds back sprite updates until the next vsync, so that pointer moves and spot changes
+ * arriving faster than the display refreshes are applied once per frame. */
+void PointerController::requestFrameLocked() {
+    if (!mVsyncAvailable || mLocked.frameUpdatePending) {
+        return;
+    }
+    mLocked.frameUpdatePending = true;
+    mSpriteController->openTransaction();
+    mDisplayEventReceiver.requestNextVsync();
+}
+
+void PointerController::reportVsyncWakeupLocked(nsecs_t timestamp) {
+    mLocked.vsyncWakeups += 1;
+
+    nsecs_t elapsed = timestamp - mLocked.vsyncWakeupsWindowStart;
+    if (elapsed < VSYNC_WAKEUPS_REPORT_INTERVAL) {
+        return;
+    }
+    if (mLocked.vsyncWakeupsWindowStart != 0) {
+        int32_t wakeupsPerSecond = int32_t(mLocked.vsyncWakeups * 1000000000LL / elapsed);
+        ATRACE_INT("PointerController vsync wakeups/s", wakeupsPerSecond);
+#if DEBUG_VSYNC_WAKEUPS
+        ALOGD("Vsync wakeups: %d/s", wakeupsPerSecond);
+#endif
+    }
+    mLocked.vsyncWakeupsWindowStart = timestamp;
+    mLocked.vsyncWakeups = 0;
+}
+
 void PointerController::resetInactivityTimeoutLocked() {
     mLooper->removeMessages(mHandler, MSG_INACTIVITY_TIMEOUT);
 
@@ -653,6 +723,7 @@ void PointerController::updatePointerLocked() REQUIRES(mLock) {
         return;
     }
 
+    requestFrameLocked();
     mSpriteController->openTransaction();
 
     mLocked.pointerSprite->setLayer(Sprite::BASE_LAYER_POINTER);
@@ -662,6 +733,11 @@ void PointerController::updatePointerLocked() REQUIRES(mLock) {
     if (mLocked.pointerAlpha > 0) {
         mLocked.pointerSprite->setAlpha(mLocked.pointerAlpha);
         mLocked.pointerSprite->setVisible(true);
+        // Resume an animated pointer icon that was paused while the pointer was hidden.
+        if (mLocked.presentation == Presentation::POINTER
+                && mLocked.animationResources.count(mLocked.requestedPointerType)) {
+            startAnimationLocked();
+        }
     } else {
         mLocked.pointerSprite->setVisible(false);
     }
@@ -163,6 +163,7 @@ private:
     sp<LooperCallback> mCallback;
 
     DisplayEventReceiver mDisplayEventReceiver;
+    bool mVsyncAvailable = false;
 
     PointerResources mResources;
 
@@ -170,6 +171,12 @@ private:
         bool animationPending;
         nsecs_t animationTime;
 
+        // Whether sprite updates are being held back until the next vsync.
+        bool frameUpdatePending;
+
+        nsecs_t vsyncWakeupsWindowStart;
+        uint32_t vsyncWakeups;
+
         size_t animationFrameIndex;
         nsecs_t lastFrameUpdatedTime;
 
@@ -211,6 +218,8 @@ private:
     void doInactivityTimeout();
 
     void startAnimationLocked();
+    void requestFrameLocked();
+    void reportVsyncWakeupLocked(nsecs_t timestamp);
 
     void resetInactivityTimeoutLocked();
     void removeInactivityTimeoutLocked();
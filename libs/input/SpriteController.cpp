@@ -23,6 +23,8 @@
 #include <utils/String8.h>
 #include <gui/Surface.h>
 
+#include <algorithm>
+
 namespace android {
 
 // --- SpriteController ---
@@ -79,9 +81,15 @@ void SpriteController::invalidateSpriteLocked(const sp<SpriteImpl>& sprite) {
     }
 }
 
-void SpriteController::disposeSurfaceLocked(const sp<SurfaceControl>& surfaceControl) {
-    bool wasEmpty = mLocked.disposedSurfaces.isEmpty();
-    mLocked.disposedSurfaces.push(surfaceControl);
+void SpriteController::disposeSurfaceLocked(const SpriteState& state) {
+    bool wasEmpty = mLocked.disposedSurfaces.isEmpty() && mLocked.recycledSurfaces.empty();
+    // Keep a few surfaces, along with what they show, for sprites created later.
+    if (mLocked.recycledSurfaces.size() + mLocked.surfacePool.size() < MAX_POOLED_SURFACES) {
+        mLocked.recycledSurfaces.push_back({state.surfaceControl, state.surfaceWidth,
+                state.surfaceHeight, state.surfaceDrawn ? state.surfaceIconKey : 0});
+    } else {
+        mLocked.disposedSurfaces.push(state.surfaceControl);
+    }
     if (wasEmpty) {
         mLooper->sendMessage(mHandler, Message(MSG_DISPOSE_SURFACES));
     }
@@ -125,21 +133,18 @@ void SpriteController::doUpdateSprites() {
         SpriteUpdate& update = updates.editItemAt(i);
 
         if (update.state.surfaceControl == NULL && update.state.wantSurfaceVisible()) {
-            update.state.surfaceWidth = update.state.icon.width();
-            update.state.surfaceHeight = update.state.icon.height();
-            update.state.surfaceDrawn = false;
-            update.state.surfaceVisible = false;
-            update.state.surfaceControl = obtainSurface(
-                    update.state.surfaceWidth, update.state.surfaceHeight);
-            if (update.state.surfaceControl != NULL) {
+            if (obtainSurface(update.state) != NULL) {
                 update.surfaceChanged = surfaceChanged = true;
             }
         }
     }
 
     // Resize and/or reparent sprites if needed.
+    // Only resizes have to reach SurfaceFlinger before the sprites are redrawn. Everything
+    // else is sent along with the property updates below, in one transaction per update.
     SurfaceComposerClient::Transaction t;
     bool needApplyTransaction = false;
+    bool surfaceResized = false;
     for (size_t i = 0; i < numSprites; i++) {
         SpriteUpdate& update = updates.editItemAt(i);
         if (update.state.surfaceControl == nullptr) {
@@ -151,13 +156,14 @@ void SpriteController::doUpdateSprites() {
             int32_t desiredHeight = update.state.icon.height();
             if (update.state.surfaceWidth < desiredWidth
                     || update.state.surfaceHeight < desiredHeight) {
-                needApplyTransaction = true;
+                surfaceResized = true;
 
                 t.setSize(update.state.surfaceControl,
                         desiredWidth, desiredHeight);
                 update.state.surfaceWidth = desiredWidth;
                 update.state.surfaceHeight = desiredHeight;
                 update.state.surfaceDrawn = false;
+                update.state.surfaceIconKey = 0;
                 update.surfaceChanged = surfaceChanged = true;
 
                 if (update.state.surfaceVisible) {
@@ -173,16 +179,22 @@ void SpriteController::doUpdateSprites() {
             needApplyTransaction = true;
         }
     }
-    if (needApplyTransaction) {
+    if (surfaceResized) {
         t.apply();
+        needApplyTransaction = false;
     }
 
     // Redraw sprites if needed.
+    // A surface that already shows the new icon, e.g. the spot icon of a recycled sprite,
+    // is not redrawn. A cleared icon keeps the surface contents while it is hidden.
     for (size_t i = 0; i < numSprites; i++) {
         SpriteUpdate& update = updates.editItemAt(i);
 
-        if ((update.state.dirty & DIRTY_BITMAP) && update.state.surfaceDrawn) {
+        if ((update.state.dirty & DIRTY_BITMAP) && update.state.surfaceDrawn
+                && update.state.icon.isValid()
+                && update.state.surfaceIconKey != update.state.iconKey) {
             update.state.surfaceDrawn = false;
+            update.state.surfaceIconKey = 0;
             update.surfaceChanged = surfaceChanged = true;
         }
 
@@ -191,12 +203,12 @@ void SpriteController::doUpdateSprites() {
             sp<Surface> surface = update.state.surfaceControl->getSurface();
             if (update.state.icon.draw(surface)) {
                 update.state.surfaceDrawn = true;
+                update.state.surfaceIconKey = update.state.iconKey;
                 update.surfaceChanged = surfaceChanged = true;
             }
         }
     }
 
-    needApplyTransaction = false;
     for (size_t i = 0; i < numSprites; i++) {
         SpriteUpdate& update = updates.editItemAt(i);
 
@@ -289,7 +301,8 @@ void SpriteController::doUpdateSprites() {
             if (update.surfaceChanged) {
                 update.sprite->setSurfaceLocked(update.state.surfaceControl,
                         update.state.surfaceWidth, update.state.surfaceHeight,
-                        update.state.surfaceDrawn, update.state.surfaceVisible);
+                        update.state.surfaceDrawn, update.state.surfaceVisible,
+                        update.state.surfaceIconKey);
             }
         }
     } // release lock
@@ -303,15 +316,30 @@ void SpriteController::doUpdateSprites() {
 }
 
 void SpriteController::doDisposeSurfaces() {
-    // Collect disposed surfaces.
+    // Collect disposed and recycled surfaces.
     Vector<sp<SurfaceControl> > disposedSurfaces;
+    std::vector<PooledSurface> recycledSurfaces;
     { // acquire lock
         AutoMutex _l(mLock);
 
         disposedSurfaces = mLocked.disposedSurfaces;
         mLocked.disposedSurfaces.clear();
+        recycledSurfaces.swap(mLocked.recycledSurfaces);
     } // release lock
 
+    // Hide recycled surfaces before they can be handed out again, in a single transaction.
+    if (!recycledSurfaces.empty()) {
+        SurfaceComposerClient::Transaction t;
+        for (const PooledSurface& pooled : recycledSurfaces) {
+            t.hide(pooled.surfaceControl);
+        }
+        t.apply();
+
+        AutoMutex _l(mLock);
+        mLocked.surfacePool.insert(mLocked.surfacePool.end(),
+                recycledSurfaces.begin(), recycledSurfaces.end());
+    }
+
     // Release the last reference to each surface outside of the lock.
     // We don't want the surfaces to be deleted while we are holding our lock.
     disposedSurfaces.clear();
@@ -323,17 +351,46 @@ void SpriteController::ensureSurfaceComposerClient() {
     }
 }
 
-sp<SurfaceControl> SpriteController::obtainSurface(int32_t width, int32_t height) {
+sp<SurfaceControl> SpriteController::obtainSurface(SpriteState& state) {
+    state.surfaceVisible = false;
+
+    { // acquire lock
+        AutoMutex _l(mLock);
+
+        // Prefer a pooled surface that already shows the sprite's icon.
+        std::vector<PooledSurface>& pool = mLocked.surfacePool;
+        if (!pool.empty()) {
+            auto it = std::find_if(pool.begin(), pool.end(), [&state](const PooledSurface& s) {
+                return s.iconKey != 0 && s.iconKey == state.iconKey;
+            });
+            if (it == pool.end()) {
+                it = pool.begin();
+            }
+            state.surfaceControl = it->surfaceControl;
+            state.surfaceWidth = it->width;
+            state.surfaceHeight = it->height;
+            state.surfaceIconKey = it->iconKey == state.iconKey ? it->iconKey : 0;
+            state.surfaceDrawn = state.surfaceIconKey != 0;
+            pool.erase(it);
+            return state.surfaceControl;
+        }
+    } // release lock
+
     ensureSurfaceComposerClient();
 
+    state.surfaceWidth = state.icon.width();
+    state.surfaceHeight = state.icon.height();
+    state.surfaceDrawn = false;
+    state.surfaceIconKey = 0;
     sp<SurfaceControl> surfaceControl = mSurfaceComposerClient->createSurface(
-            String8("Sprite"), width, height, PIXEL_FORMAT_RGBA_8888,
+            String8("Sprite"), state.surfaceWidth, state.surfaceHeight, PIXEL_FORMAT_RGBA_8888,
             ISurfaceComposerClient::eHidden |
             ISurfaceComposerClient::eCursorWindow);
     if (surfaceControl == NULL || !surfaceControl->isValid()) {
         ALOGE("Error creating sprite surface.");
         return NULL;
     }
+    state.surfaceControl = surfaceControl;
     return surfaceControl;
 }
 
@@ -350,7 +407,7 @@ SpriteController::SpriteImpl::~SpriteImpl() {
     // Let the controller take care of deleting the last reference to sprite
     // surfaces so that we do not block the caller on an IPC here.
     if (mLocked.state.surfaceControl != NULL) {
-        mController->disposeSurfaceLocked(mLocked.state.surfaceControl);
+        mController->disposeSurfaceLocked(mLocked.state);
         mLocked.state.surfaceControl.clear();
     }
 }
@@ -360,10 +417,18 @@ void SpriteController::SpriteImpl::setIcon(const SpriteIcon& icon) {
 
     uint32_t dirty;
     if (icon.isValid()) {
-        SkBitmap* bitmapCopy = &mLocked.state.icon.bitmap;
-        if (bitmapCopy->tryAllocPixels(icon.bitmap.info().makeColorType(kN32_SkColorType))) {
-            icon.bitmap.readPixels(bitmapCopy->info(), bitmapCopy->getPixels(),
-                    bitmapCopy->rowBytes(), 0, 0);
+        // Icons share immutable bitmaps, so the generation id identifies the pixels.
+        uint32_t iconKey = icon.bitmap.getGenerationID();
+        if (!mLocked.state.icon.isValid() || mLocked.state.iconKey != iconKey) {
+            SkBitmap* bitmapCopy = &mLocked.state.icon.bitmap;
+            if (bitmapCopy->tryAllocPixels(icon.bitmap.info().makeColorType(kN32_SkColorType))) {
+                icon.bitmap.readPixels(bitmapCopy->info(), bitmapCopy->getPixels(),
+                        bitmapCopy->rowBytes(), 0, 0);
+            }
+            mLocked.state.iconKey = iconKey;
+            dirty = DIRTY_BITMAP;
+        } else {
+            dirty = 0;
         }
 
         if (!mLocked.state.icon.isValid()
@@ -371,17 +436,20 @@ void SpriteController::SpriteImpl::setIcon(const SpriteIcon& icon) {
                 || mLocked.state.icon.hotSpotY != icon.hotSpotY) {
             mLocked.state.icon.hotSpotX = icon.hotSpotX;
             mLocked.state.icon.hotSpotY = icon.hotSpotY;
-            dirty = DIRTY_BITMAP | DIRTY_HOTSPOT;
-        } else {
-            dirty = DIRTY_BITMAP;
+            dirty |= DIRTY_HOTSPOT;
         }
 
         if (mLocked.state.icon.style != icon.style) {
             mLocked.state.icon.style = icon.style;
             dirty |= DIRTY_ICON_STYLE;
         }
+
+        if (!dirty) {
+            return; // same icon as before so nothing to do
+        }
     } else if (mLocked.state.icon.isValid()) {
         mLocked.state.icon.bitmap.reset();
+        mLocked.state.iconKey = 0;
         dirty = DIRTY_BITMAP | DIRTY_HOTSPOT | DIRTY_ICON_STYLE;
     } else {
         return; // setting to invalid icon and already invalid so nothing to do
@@ -20,6 +20,8 @@
 #include <utils/RefBase.h>
 #include <utils/Looper.h>
 
+#include <vector>
+
 #include <gui/SurfaceComposerClient.h>
 
 #include "SpriteIcon.h"
@@ -128,6 +130,8 @@ public:
     virtual void closeTransaction();
 
 private:
+    static constexpr size_t MAX_POOLED_SURFACES = 4;
+
     enum {
         MSG_UPDATE_SPRITES,
         MSG_DISPOSE_SURFACES,
@@ -152,14 +156,17 @@ private:
      * Note that the SpriteIcon holds a reference to a shared (and immutable) bitmap. */
     struct SpriteState {
         inline SpriteState() :
-                dirty(0), visible(false),
+                dirty(0), iconKey(0), visible(false),
                 positionX(0), positionY(0), layer(0), alpha(1.0f), displayId(ADISPLAY_ID_DEFAULT),
-                surfaceWidth(0), surfaceHeight(0), surfaceDrawn(false), surfaceVisible(false) {
+                surfaceWidth(0), surfaceHeight(0), surfaceDrawn(false), surfaceVisible(false),
+                surfaceIconKey(0) {
         }
 
         uint32_t dirty;
 
         SpriteIcon icon;
+        // Generation id of the bitmap the icon was copied from, or 0 if there is no icon.
+        uint32_t iconKey;
         bool visible;
         float positionX;
         float positionY;
@@ -173,6 +180,8 @@ private:
         int32_t surfaceHeight;
         bool surfaceDrawn;
         bool surfaceVisible;
+        // The iconKey of the icon last drawn into the surface, or 0 if its contents are unknown.
+        uint32_t surfaceIconKey;
 
         inline bool wantSurfaceVisible() const {
             return visible && alpha > 0.0f && icon.isValid();
@@ -210,12 +219,13 @@ private:
         }
 
         inline void setSurfaceLocked(const sp<SurfaceControl>& surfaceControl,
-                int32_t width, int32_t height, bool drawn, bool visible) {
+                int32_t width, int32_t height, bool drawn, bool visible, uint32_t iconKey) {
             mLocked.state.surfaceControl = surfaceControl;
             mLocked.state.surfaceWidth = width;
             mLocked.state.surfaceHeight = height;
             mLocked.state.surfaceDrawn = drawn;
             mLocked.state.surfaceVisible = visible;
+            mLocked.state.surfaceIconKey = iconKey;
         }
 
     private:
@@ -240,6 +250,14 @@ private:
         bool surfaceChanged;
     };
 
+    /* A hidden surface of a deleted sprite, kept to be handed to a new sprite. */
+    struct PooledSurface {
+        sp<SurfaceControl> surfaceControl;
+        int32_t width;
+        int32_t height;
+        uint32_t iconKey;
+    };
+
     mutable Mutex mLock;
 
     sp<Looper> mLooper;
@@ -251,19 +269,21 @@ private:
     struct Locked {
         Vector<sp<SpriteImpl> > invalidatedSprites;
         Vector<sp<SurfaceControl> > disposedSurfaces;
+        std::vector<PooledSurface> recycledSurfaces; // not hidden yet
+        std::vector<PooledSurface> surfacePool;
         uint32_t transactionNestingCount;
         bool deferredSpriteUpdate;
     } mLocked; // guarded by mLock
 
     void invalidateSpriteLocked(const sp<SpriteImpl>& sprite);
-    void disposeSurfaceLocked(const sp<SurfaceControl>& surfaceControl);
+    void disposeSurfaceLocked(const SpriteState& state);
 
     void handleMessage(const Message& message);
     void doUpdateSprites();
     void doDisposeSurfaces();
 
     void ensureSurfaceComposerClient();
-    sp<SurfaceControl> obtainSurface(int32_t width, int32_t height);
+    sp<SurfaceControl> obtainSurface(SpriteState& state);
 };
 
 } // namespace android
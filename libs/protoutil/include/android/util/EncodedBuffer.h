@@ -46,6 +46,22 @@ public:
     explicit EncodedBuffer(size_t chunkSize);
     virtual ~EncodedBuffer();
 
+    /**
+     * The chunks of destroyed EncodedBuffers are kept in a pool shared by the whole
+     * process, up to a limit, so the next EncodedBuffers with the same chunk size
+     * don't have to allocate them again.
+     */
+    struct ChunkPoolStats {
+        size_t hits;        // Chunks taken from the pool.
+        size_t misses;      // Chunks allocated because the pool had none of the size.
+        size_t pooledBytes; // Bytes of the chunks in the pool now.
+    };
+
+    /**
+     * Returns the counts of the chunk pool since the process started.
+     */
+    static ChunkPoolStats getChunkPoolStats();
+
     class Pointer {
     public:
         Pointer();
@@ -90,6 +90,11 @@ class ProtoOutputStream
 {
 public:
     ProtoOutputStream();
+    /**
+     * Buffers the data in chunks of chunkSize bytes, e.g. a small size for protos that
+     * are known to be small.  Zero uses the default of EncodedBuffer.
+     */
+    explicit ProtoOutputStream(size_t chunkSize);
     ~ProtoOutputStream();
 
     /**
@@ -146,6 +151,15 @@ private:
     uint32_t mObjectId;
     uint64_t mExpectedObjectToken;
 
+    // Positions of the 64-bit size fields of the length delimited fields, in order, so
+    // compact() can shrink them without parsing the buffer.
+    std::vector<size_t> mSizePositions;
+    // How many bytes compact() saves by shrinking the size fields of the finished
+    // objects, and of the length delimited fields, written so far.
+    size_t mCompactSavings;
+    // mCompactSavings when each of the unfinished objects started.
+    std::vector<size_t> mStartSavings;
+
     inline void writeDoubleImpl(uint32_t id, double val);
     inline void writeFloatImpl(uint32_t id, float val);
     inline void writeInt64Impl(uint32_t id, int64_t val);
@@ -164,8 +178,6 @@ private:
     inline void writeMessageBytesImpl(uint32_t id, const char* val, size_t size);
 
     bool compact();
-    size_t editEncodedSize(size_t rawSize);
-    bool compactSize(size_t rawSize);
 
     template<typename T>
     bool internalWrite(uint64_t fieldId, T val, const char* typeName);
@@ -17,6 +17,7 @@
 #ifndef ANDROID_UTIL_PROTOBUF_H
 #define ANDROID_UTIL_PROTOBUF_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 namespace android {
@@ -45,6 +46,13 @@ uint32_t read_field_id(uint32_t varint);
  */
 size_t get_varint_size(uint64_t varint);
 
+/**
+ * Read the varint at the start of the buffer, which has size bytes. Return the
+ * number of bytes it takes, or 0 if it doesn't end within size or 10 bytes.
+ * Meant for reading straight out of a contiguous chunk of data.
+ */
+size_t read_raw_varint(const uint8_t* buf, size_t size, uint64_t* val);
+
 /**
  * Write a varint into the buffer. Return the next position to write at.
  * There must be 10 bytes in the buffer.
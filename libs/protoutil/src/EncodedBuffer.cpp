@@ -16,6 +16,11 @@
 #define LOG_TAG "libprotoutil"
 
 #include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
 
 #include <android/util/EncodedBuffer.h>
 #include <android/util/protobuf.h>
@@ -25,6 +30,71 @@ namespace android {
 namespace util {
 
 const size_t BUFFER_SIZE = 8 * 1024; // 8 KB
+const size_t MAX_POOLED_BYTES = 512 * 1024; // 512 KB
+
+namespace {
+
+/**
+ * The process-wide pool of chunks freed by EncodedBuffers.  statsd creates many short-lived
+ * ProtoOutputStreams for every dump, and each one used to malloc and free its chunks.
+ */
+class ChunkPool {
+public:
+    uint8_t* obtain(size_t chunkSize)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            std::vector<uint8_t*>& chunks = mChunks[chunkSize];
+            if (!chunks.empty()) {
+                uint8_t* buf = chunks.back();
+                chunks.pop_back();
+                mPooledBytes -= chunkSize;
+                mHits++;
+                return buf;
+            }
+            mMisses++;
+        }
+        return (uint8_t*)malloc(chunkSize);
+    }
+
+    void release(size_t chunkSize, const std::vector<uint8_t*>& bufs)
+    {
+        size_t i = 0;
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            std::vector<uint8_t*>& chunks = mChunks[chunkSize];
+            for (; i < bufs.size() && mPooledBytes + chunkSize <= MAX_POOLED_BYTES; i++) {
+                chunks.push_back(bufs[i]);
+                mPooledBytes += chunkSize;
+            }
+        }
+        for (; i < bufs.size(); i++) {
+            free(bufs[i]);
+        }
+    }
+
+    EncodedBuffer::ChunkPoolStats getStats()
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        return EncodedBuffer::ChunkPoolStats{mHits, mMisses, mPooledBytes};
+    }
+
+private:
+    std::mutex mLock;
+    std::map<size_t, std::vector<uint8_t*>> mChunks;
+    size_t mPooledBytes = 0;
+    size_t mHits = 0;
+    size_t mMisses = 0;
+};
+
+}  // namespace
+
+// Never destroyed, so EncodedBuffers can still release their chunks during static destruction.
+static ChunkPool& chunk_pool()
+{
+    static ChunkPool* pool = new ChunkPool();
+    return *pool;
+}
 
 EncodedBuffer::Pointer::Pointer() : Pointer(BUFFER_SIZE)
 {
@@ -96,10 +166,13 @@ EncodedBuffer::EncodedBuffer(size_t chunkSize)
 
 EncodedBuffer::~EncodedBuffer()
 {
-    for (size_t i=0; i<mBuffers.size(); i++) {
-        uint8_t* buf = mBuffers[i];
-        free(buf);
-    }
+    chunk_pool().release(mChunkSize, mBuffers);
+}
+
+EncodedBuffer::ChunkPoolStats
+EncodedBuffer::getChunkPoolStats()
+{
+    return chunk_pool().getStats();
 }
 
 inline uint8_t*
@@ -135,7 +208,7 @@ EncodedBuffer::writeBuffer()
     if (mWp.index() > mBuffers.size()) return NULL;
     uint8_t* buf = NULL;
     if (mWp.index() == mBuffers.size()) {
-        buf = (uint8_t*)malloc(mChunkSize);
+        buf = chunk_pool().obtain(mChunkSize);
 
         if (buf == NULL) return NULL; // This indicates NO_MEMORY
 
@@ -329,13 +402,18 @@ EncodedBuffer::editRawFixed32(size_t pos, uint32_t val)
 void
 EncodedBuffer::copy(size_t srcPos, size_t size)
 {
-    if (size == 0) return;
     Pointer cp(mChunkSize);
     cp.move(srcPos);
 
-    while (cp.pos() < srcPos + size) {
-        writeRawByte(*at(cp));
-        cp.move();
+    // Move the longest runs that stay within one chunk on both sides.  The source is
+    // never behind wp, but both can be in the same chunk, so the runs may overlap.
+    while (size > 0) {
+        uint8_t* dst = writeBuffer();
+        size_t amt = std::min(size, std::min(mChunkSize - cp.offset(), currentToWrite()));
+        memmove(dst, at(cp), amt);
+        mWp.move(amt);
+        cp.move(amt);
+        size -= amt;
     }
 }
 
@@ -399,6 +477,14 @@ uint64_t
 EncodedBuffer::Reader::readRawVarint()
 {
     uint64_t val = 0, shift = 0;
+    // Decode straight out of the chunk, unless the varint runs into the next one.
+    if (hasNext()) {
+        size_t len = read_raw_varint(mData->at(mRp), currentToRead(), &val);
+        if (len > 0) {
+            mRp.move(len);
+            return val;
+        }
+    }
     while (true) {
         uint8_t byte = next();
         val |= (INT64_C(0x7F) & byte) << shift;
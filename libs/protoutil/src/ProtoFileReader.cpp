@@ -16,6 +16,7 @@
 #define LOG_TAG "libprotoutil"
 
 #include <android/util/ProtoFileReader.h>
+#include <android/util/protobuf.h>
 #include <cutils/log.h>
 
 #include <cinttypes>
@@ -106,6 +107,14 @@ uint64_t
 ProtoFileReader::readRawVarint()
 {
     uint64_t val = 0, shift = 0;
+    // Decode straight out of the buffer, unless the varint runs past what was read.
+    if (ensure_data()) {
+        size_t len = read_raw_varint(mBuffer + mOffset, mMaxOffset - mOffset, &val);
+        if (len > 0) {
+            mOffset += len;
+            return val;
+        }
+    }
     while (true) {
         if (!hasNext()) {
             ALOGW("readRawVarint() called without hasNext() called first.");
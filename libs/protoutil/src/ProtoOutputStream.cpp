@@ -27,12 +27,20 @@ namespace android {
 namespace util {
 
 ProtoOutputStream::ProtoOutputStream()
-        :mBuffer(new EncodedBuffer()),
+        :ProtoOutputStream(0)
+{
+}
+
+ProtoOutputStream::ProtoOutputStream(size_t chunkSize)
+        :mBuffer(new EncodedBuffer(chunkSize)),
          mCopyBegin(0),
          mCompact(false),
          mDepth(0),
          mObjectId(0),
-         mExpectedObjectToken(UINT64_C(-1))
+         mExpectedObjectToken(UINT64_C(-1)),
+         mSizePositions(),
+         mCompactSavings(0),
+         mStartSavings()
 {
 }
 
@@ -50,6 +58,9 @@ ProtoOutputStream::clear()
     mDepth = 0;
     mObjectId = 0;
     mExpectedObjectToken = UINT64_C(-1);
+    mSizePositions.clear();
+    mCompactSavings = 0;
+    mStartSavings.clear();
 }
 
 template<typename T>
@@ -261,6 +272,8 @@ ProtoOutputStream::start(uint64_t fieldId)
     mDepth++;
     mObjectId++;
     mBuffer->writeRawFixed64(mExpectedObjectToken); // push previous token into stack.
+    mSizePositions.push_back(sizePos);
+    mStartSavings.push_back(mCompactSavings);
 
     mExpectedObjectToken = makeToken(sizePos - prevPos,
         (bool)(fieldId & FIELD_COUNT_REPEATED), mDepth, mObjectId, sizePos);
@@ -292,13 +305,22 @@ ProtoOutputStream::end(uint64_t token)
     mBuffer->ep()->rewind()->move(sizePos);
     mExpectedObjectToken = mBuffer->readRawFixed64();
 
+    // The encoded size is the raw size less what compacting the size fields of the nested
+    // objects saves.
+    size_t childSavings = mCompactSavings - mStartSavings.back();
+    mStartSavings.pop_back();
+
     // If raw size is larger than 0, write the negative value here to indicate a compact is needed.
     if (childRawSize > 0) {
+        int childEncodedSize = childRawSize - childSavings;
         mBuffer->editRawFixed32(sizePos, -childRawSize);
-        mBuffer->editRawFixed32(sizePos+4, -1);
+        mBuffer->editRawFixed32(sizePos+4, childEncodedSize);
+        mCompactSavings += 8 - get_varint_size(childEncodedSize);
     } else {
         // reset wp which erase the header tag of the message when its size is 0.
+        // Nothing nested in it was kept, so its own size field is the last one.
         mBuffer->wp()->rewind()->move(sizePos - getTagSizeFromToken(token));
+        mSizePositions.pop_back();
     }
 }
 
@@ -319,19 +341,25 @@ ProtoOutputStream::compact() {
     size_t rawBufferSize = mBuffer->size();
     if (rawBufferSize == 0) return true; // nothing to do if the buffer is empty;
 
-    // reset edit pointer and recursively compute encoded size of messages.
-    mBuffer->ep()->rewind();
-    if (editEncodedSize(rawBufferSize) == 0) {
-        ALOGE("Failed to editEncodedSize.");
-        return false;
-    }
-
-    // reset both edit pointer and write pointer, and compact recursively.
-    mBuffer->ep()->rewind();
+    // Every size field already holds its encoded size, so this is a single pass that
+    // copies the data forward in the buffer, converting the pairs of uint32s into a
+    // single unsigned varint of the size.
     mBuffer->wp()->rewind();
-    if (!compactSize(rawBufferSize)) {
-        ALOGE("Failed to compactSize.");
-        return false;
+    for (size_t sizePos : mSizePositions) {
+        mBuffer->copy(mCopyBegin, sizePos - mCopyBegin);
+
+        mBuffer->ep()->rewind()->move(sizePos);
+        int childRawSize = (int)mBuffer->readRawFixed32();
+        int childEncodedSize = (int)mBuffer->readRawFixed32();
+        mCopyBegin = sizePos + 8;
+        if (childEncodedSize < 0 || (childRawSize >= 0 && childRawSize != childEncodedSize)) {
+            ALOGE("Bad raw or encoded values: raw=%d, encoded=%d at %zu",
+                    childRawSize, childEncodedSize, sizePos);
+            return false;
+        }
+
+        // write encoded size to buffer.
+        mBuffer->writeRawVarint32(childEncodedSize);
     }
     // copy the reset to the buffer.
     if (mCopyBegin < rawBufferSize) {
@@ -343,113 +371,6 @@ ProtoOutputStream::compact() {
     return true;
 }
 
-/**
- * First compaction pass.  Iterate through the data, and fill in the
- * nested object sizes so the next pass can compact them.
- */
-size_t
-ProtoOutputStream::editEncodedSize(size_t rawSize)
-{
-    size_t objectStart = mBuffer->ep()->pos();
-    size_t objectEnd = objectStart + rawSize;
-    size_t encodedSize = 0;
-    int childRawSize, childEncodedSize;
-    size_t childEncodedSizePos;
-
-    while (mBuffer->ep()->pos() < objectEnd) {
-        uint32_t tag = (uint32_t)mBuffer->readRawVarint();
-        encodedSize += get_varint_size(tag);
-        switch (read_wire_type(tag)) {
-            case WIRE_TYPE_VARINT:
-                do {
-                    encodedSize++;
-                } while ((mBuffer->readRawByte() & 0x80) != 0);
-                break;
-            case WIRE_TYPE_FIXED64:
-                encodedSize += 8;
-                mBuffer->ep()->move(8);
-                break;
-            case WIRE_TYPE_LENGTH_DELIMITED:
-                childRawSize = (int)mBuffer->readRawFixed32();
-                childEncodedSizePos = mBuffer->ep()->pos();
-                childEncodedSize = (int)mBuffer->readRawFixed32();
-                if (childRawSize >= 0 && childRawSize == childEncodedSize) {
-                    mBuffer->ep()->move(childRawSize);
-                } else if (childRawSize < 0 && childEncodedSize == -1){
-                    childEncodedSize = editEncodedSize(-childRawSize);
-                    mBuffer->editRawFixed32(childEncodedSizePos, childEncodedSize);
-                } else {
-                    ALOGE("Bad raw or encoded values: raw=%d, encoded=%d at %zu",
-                            childRawSize, childEncodedSize, childEncodedSizePos);
-                    return 0;
-                }
-                encodedSize += get_varint_size(childEncodedSize) + childEncodedSize;
-                break;
-            case WIRE_TYPE_FIXED32:
-                encodedSize += 4;
-                mBuffer->ep()->move(4);
-                break;
-            default:
-                ALOGE("Unexpected wire type %d in editEncodedSize at [%zu, %zu]",
-                        read_wire_type(tag), objectStart, objectEnd);
-                return 0;
-        }
-    }
-    return encodedSize;
-}
-
-/**
- * Second compaction pass.  Iterate through the data, and copy the data
- * forward in the buffer, converting the pairs of uint32s into a single
- * unsigned varint of the size.
- */
-bool
-ProtoOutputStream::compactSize(size_t rawSize)
-{
-    size_t objectStart = mBuffer->ep()->pos();
-    size_t objectEnd = objectStart + rawSize;
-    int childRawSize, childEncodedSize;
-
-    while (mBuffer->ep()->pos() < objectEnd) {
-        uint32_t tag = (uint32_t)mBuffer->readRawVarint();
-        switch (read_wire_type(tag)) {
-            case WIRE_TYPE_VARINT:
-                while ((mBuffer->readRawByte() & 0x80) != 0) {}
-                break;
-            case WIRE_TYPE_FIXED64:
-                mBuffer->ep()->move(8);
-                break;
-            case WIRE_TYPE_LENGTH_DELIMITED:
-                mBuffer->copy(mCopyBegin, mBuffer->ep()->pos() - mCopyBegin);
-
-                childRawSize = (int)mBuffer->readRawFixed32();
-                childEncodedSize = (int)mBuffer->readRawFixed32();
-                mCopyBegin = mBuffer->ep()->pos();
-
-                // write encoded size to buffer.
-                mBuffer->writeRawVarint32(childEncodedSize);
-                if (childRawSize >= 0 && childRawSize == childEncodedSize) {
-                    mBuffer->ep()->move(childEncodedSize);
-                } else if (childRawSize < 0){
-                    if (!compactSize(-childRawSize)) return false;
-                } else {
-                    ALOGE("Bad raw or encoded values: raw=%d, encoded=%d",
-                            childRawSize, childEncodedSize);
-                    return false;
-                }
-                break;
-            case WIRE_TYPE_FIXED32:
-                mBuffer->ep()->move(4);
-                break;
-            default:
-                ALOGE("Unexpected wire type %d in compactSize at [%zu, %zu]",
-                        read_wire_type(tag), objectStart, objectEnd);
-                return false;
-        }
-    }
-    return true;
-}
-
 size_t
 ProtoOutputStream::size()
 {
@@ -530,6 +451,8 @@ ProtoOutputStream::writeLengthDelimitedHeader(uint32_t id, size_t size)
 {
     mBuffer->writeHeader(id, WIRE_TYPE_LENGTH_DELIMITED);
     // reserves 64 bits for length delimited fields, if first field is negative, compact it.
+    mSizePositions.push_back(mBuffer->wp()->pos());
+    mCompactSavings += 8 - get_varint_size(size);
     mBuffer->writeRawFixed32(size);
     mBuffer->writeRawFixed32(size);
 }
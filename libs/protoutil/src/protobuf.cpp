@@ -16,6 +16,8 @@
 
 #include <android/util/protobuf.h>
 
+#include <string.h>
+
 namespace android {
 namespace util {
 
@@ -42,6 +44,46 @@ get_varint_size(uint64_t varint)
     return size;
 }
 
+size_t
+read_raw_varint(const uint8_t* buf, size_t size, uint64_t* val)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (size >= 8) {
+        // Look at 8 bytes at once. The varint ends at the first byte without the
+        // continuation bit.
+        uint64_t word;
+        memcpy(&word, buf, sizeof(word));
+        const uint64_t ends = ~word & UINT64_C(0x8080808080808080);
+        if (ends != 0) {
+            const size_t len = (__builtin_ctzll(ends) + 1) / 8;
+            if (len < 8) {
+                word &= (UINT64_C(1) << (len * 8)) - 1;
+            }
+            // Squeeze out the continuation bits.  The groups past the end are zero.
+            *val = (word & UINT64_C(0x7f))
+                    | ((word >> 1) & (UINT64_C(0x7f) << 7))
+                    | ((word >> 2) & (UINT64_C(0x7f) << 14))
+                    | ((word >> 3) & (UINT64_C(0x7f) << 21))
+                    | ((word >> 4) & (UINT64_C(0x7f) << 28))
+                    | ((word >> 5) & (UINT64_C(0x7f) << 35))
+                    | ((word >> 6) & (UINT64_C(0x7f) << 42))
+                    | ((word >> 7) & (UINT64_C(0x7f) << 49));
+            return len;
+        }
+    }
+#endif
+
+    uint64_t result = 0;
+    for (size_t i = 0; i < size && i < 10; i++) {
+        result |= (UINT64_C(0x7F) & buf[i]) << (7 * i);
+        if ((buf[i] & 0x80) == 0) {
+            *val = result;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
 uint8_t*
 write_raw_varint(uint8_t* buf, uint64_t val)
 {
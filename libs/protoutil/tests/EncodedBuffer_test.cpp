@@ -150,3 +150,23 @@ TEST(EncodedBufferTest, ReadVarint) {
     EXPECT_EQ(reader->size(), len);
     EXPECT_EQ(reader->readRawVarint(), val);
 }
+
+TEST(EncodedBufferTest, ChunkPool) {
+    // An unusual chunk size, so other buffers in the process neither add nor take its chunks.
+    constexpr size_t chunkSize = 1000;
+    EncodedBuffer::ChunkPoolStats before = EncodedBuffer::getChunkPoolStats();
+    {
+        sp<EncodedBuffer> buffer = new EncodedBuffer(chunkSize);
+        ASSERT_NE(buffer->writeBuffer(), nullptr);
+    }
+    EncodedBuffer::ChunkPoolStats afterFirst = EncodedBuffer::getChunkPoolStats();
+    EXPECT_EQ(afterFirst.misses, before.misses + 1);
+    EXPECT_EQ(afterFirst.pooledBytes, before.pooledBytes + chunkSize);
+
+    sp<EncodedBuffer> buffer = new EncodedBuffer(chunkSize);
+    ASSERT_NE(buffer->writeBuffer(), nullptr);
+    EncodedBuffer::ChunkPoolStats afterSecond = EncodedBuffer::getChunkPoolStats();
+    EXPECT_EQ(afterSecond.hits, afterFirst.hits + 1);
+    EXPECT_EQ(afterSecond.misses, afterFirst.misses);
+    EXPECT_EQ(afterSecond.pooledBytes, before.pooledBytes);
+}
@@ -316,6 +316,39 @@ TEST(ProtoOutputStreamTest, AdvancedEncoding) {
     EXPECT_FALSE(log2.has_data());
 }
 
+TEST(ProtoOutputStreamTest, MultiByteSizes) {
+    // Sizes that take more than one varint byte, across several buffer chunks.
+    std::string name(200, 'n');
+    std::string data(40000, 'd');
+
+    ProtoOutputStream proto;
+    uint64_t token1 = proto.start(FIELD_TYPE_MESSAGE | ComplexProto::kLogsFieldNumber);
+    EXPECT_TRUE(proto.write(FIELD_TYPE_INT32 | ComplexProto::Log::kIdFieldNumber, 1));
+    EXPECT_TRUE(proto.write(FIELD_TYPE_STRING | ComplexProto::Log::kNameFieldNumber, name));
+    EXPECT_TRUE(proto.write(FIELD_TYPE_BYTES | ComplexProto::Log::kDataFieldNumber,
+                            data.c_str(), data.size()));
+    proto.end(token1);
+    // An empty message is dropped, and must not throw off the sizes after it.
+    uint64_t token2 = proto.start(FIELD_TYPE_MESSAGE | ComplexProto::kLogsFieldNumber);
+    proto.end(token2);
+    uint64_t token3 = proto.start(FIELD_TYPE_MESSAGE | ComplexProto::kLogsFieldNumber);
+    EXPECT_TRUE(proto.write(FIELD_TYPE_STRING | ComplexProto::Log::kNameFieldNumber, name));
+    proto.end(token3);
+    EXPECT_TRUE(proto.write(FIELD_TYPE_INT32 | ComplexProto::kIntsFieldNumber, 7));
+
+    ComplexProto complex;
+    ASSERT_TRUE(complex.ParseFromString(iterateToString(&proto)));
+    EXPECT_EQ(complex.ByteSize(), (int)proto.size());
+    EXPECT_EQ(complex.ints_size(), 1);
+    EXPECT_EQ(complex.ints(0), 7);
+    EXPECT_EQ(complex.logs_size(), 2);
+    EXPECT_EQ(complex.logs(0).id(), 1);
+    EXPECT_EQ(complex.logs(0).name(), name);
+    EXPECT_EQ(complex.logs(0).data(), data);
+    EXPECT_FALSE(complex.logs(1).has_id());
+    EXPECT_EQ(complex.logs(1).name(), name);
+}
+
 TEST(ProtoOutputStreamTest, InvalidTypes) {
     ProtoOutputStream proto;
     EXPECT_FALSE(proto.write(FIELD_TYPE_UNKNOWN | PrimitiveProto::kValInt32FieldNumber, 790));
@@ -48,4 +48,26 @@ TEST(ProtobufTest, All) {
     EXPECT_EQ(header[1], 0x96);
     EXPECT_EQ(header[2], 0x01);
     EXPECT_EQ(header[3], UNSET_BYTE);
-}
\ No newline at end of file
+}
+TEST(ProtobufTest, ReadRawVarint) {
+    const uint64_t values[] = {
+        0, 1, 127, 128, 150, 16383, 16384, UINT64_C(1) << 35, (UINT64_C(1) << 56) - 1,
+        UINT64_C(1) << 56, UINT64_C(-2), UINT64_C(-1),
+    };
+    for (uint64_t value : values) {
+        uint8_t buf[20];
+        memset(buf, 0xff, sizeof(buf));
+        const size_t size = write_raw_varint(buf, value) - buf;
+
+        // With room for a whole word past the varint, and with exactly the varint.
+        for (size_t avail : {sizeof(buf), size}) {
+            uint64_t val = 0;
+            EXPECT_EQ(read_raw_varint(buf, avail, &val), size) << value;
+            EXPECT_EQ(val, value);
+        }
+
+        // Cut short, as at the end of a chunk.
+        uint64_t val = 0;
+        EXPECT_EQ(read_raw_varint(buf, size - 1, &val), 0u) << value;
+    }
+}
@@ -26,6 +26,7 @@
 #include <cstdio>
 
 #include <gui/BufferItemConsumer.h>
+#include <gui/BufferQueueDefs.h>
 #include <gui/Surface.h>
 
 #include <android_runtime/AndroidRuntime.h>
@@ -76,6 +77,7 @@ static struct {
 static struct {
     jclass clazz;
     jmethodID ctor;
+    jmethodID reset;
 } gSurfacePlaneClassInfo;
 
 // Get an ID that's unique within this process.
@@ -117,6 +119,22 @@ public:
     void setBufferHeight(int height) { mHeight = height; }
     int getBufferHeight() { return mHeight; }
 
+    // Planes of the last image acquired from each buffer slot. They are handed out again when
+    // the slot is next acquired with the same buffer, so steady-state acquires allocate nothing.
+    static const int kMaxPlanes = 3;
+    struct SlotPlanes {
+        uint64_t bufferId;
+        int numPlanes;
+        jobjectArray planes;
+        jobject byteBuffers[kMaxPlanes];
+        uint8_t* data[kMaxPlanes];
+        uint32_t dataSize[kMaxPlanes];
+    };
+    SlotPlanes* getSlotPlanes(int slot) {
+        return (slot >= 0 && slot < BufferQueueDefs::NUM_BUFFER_SLOTS) ? &mSlotPlanes[slot] : NULL;
+    }
+    static void clearSlotPlanes(JNIEnv* env, SlotPlanes* slotPlanes);
+
 private:
     static JNIEnv* getJNIEnv(bool* needsDetach);
     static void detachJNI();
@@ -130,6 +148,7 @@ private:
     android_dataspace mDataSpace;
     int mWidth;
     int mHeight;
+    SlotPlanes mSlotPlanes[BufferQueueDefs::NUM_BUFFER_SLOTS];
 };
 
 JNIImageReaderContext::JNIImageReaderContext(JNIEnv* env,
@@ -140,6 +159,7 @@ JNIImageReaderContext::JNIImageReaderContext(JNIEnv* env,
     mDataSpace(HAL_DATASPACE_UNKNOWN),
     mWidth(-1),
     mHeight(-1) {
+    memset(mSlotPlanes, 0, sizeof(mSlotPlanes));
     for (int i = 0; i < maxImages; i++) {
         BufferItem* buffer = new BufferItem;
         mBuffers.push_back(buffer);
@@ -187,12 +207,27 @@ void JNIImageReaderContext::returnBufferItem(BufferItem* buffer) {
     mBuffers.push_back(buffer);
 }
 
+void JNIImageReaderContext::clearSlotPlanes(JNIEnv* env, SlotPlanes* slotPlanes) {
+    if (slotPlanes->planes != NULL) {
+        env->DeleteGlobalRef(slotPlanes->planes);
+    }
+    for (int i = 0; i < kMaxPlanes; i++) {
+        if (slotPlanes->byteBuffers[i] != NULL) {
+            env->DeleteGlobalRef(slotPlanes->byteBuffers[i]);
+        }
+    }
+    memset(slotPlanes, 0, sizeof(*slotPlanes));
+}
+
 JNIImageReaderContext::~JNIImageReaderContext() {
     bool needsDetach = false;
     JNIEnv* env = getJNIEnv(&needsDetach);
     if (env != NULL) {
         env->DeleteGlobalRef(mWeakThiz);
         env->DeleteGlobalRef(mClazz);
+        for (int i = 0; i < BufferQueueDefs::NUM_BUFFER_SLOTS; i++) {
+            clearSlotPlanes(env, &mSlotPlanes[i]);
+        }
     } else {
         ALOGW("leaking JNI object references");
     }
@@ -347,6 +382,10 @@ static void ImageReader_classInit(JNIEnv* env, jclass clazz)
             "(Landroid/media/ImageReader$SurfaceImage;IILjava/nio/ByteBuffer;)V");
     LOG_ALWAYS_FATAL_IF(gSurfacePlaneClassInfo.ctor == NULL,
             "Can not find SurfacePlane constructor");
+    gSurfacePlaneClassInfo.reset = env->GetMethodID(gSurfacePlaneClassInfo.clazz, "reset",
+            "(Landroid/media/ImageReader$SurfaceImage;IILjava/nio/ByteBuffer;)V");
+    LOG_ALWAYS_FATAL_IF(gSurfacePlaneClassInfo.reset == NULL,
+            "Can not find SurfacePlane.reset");
 }
 
 static void ImageReader_init(JNIEnv* env, jobject thiz, jobject weakThiz, jint width, jint height,
@@ -641,6 +680,11 @@ static jint ImageReader_detachImage(JNIEnv* env, jobject thiz, jobject image) {
                 "nativeDetachImage failed for image!!!");
         return res;
     }
+    // The planes leave with the detached image.
+    JNIImageReaderContext::SlotPlanes* slotPlanes = ctx->getSlotPlanes(buffer->mSlot);
+    if (slotPlanes != NULL) {
+        JNIImageReaderContext::clearSlotPlanes(env, slotPlanes);
+    }
     return OK;
 }
 
@@ -777,6 +821,103 @@ static jobjectArray Image_createSurfacePlanes(JNIEnv* env, jobject thiz,
     return surfacePlanes;
 }
 
+// Like Image_createSurfacePlanes, but reuses the SurfacePlane objects and ByteBuffers of the
+// image last acquired from the same buffer slot. The buffer is still locked for each image; only
+// planes whose locked address or size changed get a new ByteBuffer.
+static jobjectArray ImageReader_createImagePlanes(JNIEnv* env, jobject thiz, jobject image,
+        int numPlanes, int readerFormat)
+{
+    ALOGV("%s: numPlanes %d", __FUNCTION__, numPlanes);
+    JNIImageReaderContext* ctx = ImageReader_getContext(env, thiz);
+    BufferItem* buffer = Image_getBufferItem(env, image);
+    int halReaderFormat = android_view_Surface_mapPublicFormatToHalFormat(
+            static_cast<PublicFormat>(readerFormat));
+    JNIImageReaderContext::SlotPlanes* slotPlanes =
+            (ctx != NULL && buffer != NULL) ? ctx->getSlotPlanes(buffer->mSlot) : NULL;
+    if (slotPlanes == NULL || isFormatOpaque(halReaderFormat) || numPlanes <= 0
+            || numPlanes > JNIImageReaderContext::kMaxPlanes) {
+        return Image_createSurfacePlanes(env, image, numPlanes, readerFormat);
+    }
+
+    uint64_t bufferId = buffer->mGraphicBuffer->getId();
+    if (slotPlanes->bufferId != bufferId || slotPlanes->numPlanes != numPlanes) {
+        JNIImageReaderContext::clearSlotPlanes(env, slotPlanes);
+        slotPlanes->bufferId = bufferId;
+        slotPlanes->numPlanes = numPlanes;
+    }
+
+    LockedImage lockedImg = LockedImage();
+    Image_getLockedImage(env, image, &lockedImg);
+    if (env->ExceptionCheck()) {
+        return NULL;
+    }
+
+    int rowStride[JNIImageReaderContext::kMaxPlanes];
+    int pixelStride[JNIImageReaderContext::kMaxPlanes];
+    for (int i = 0; i < numPlanes; i++) {
+        uint8_t *pData = NULL;
+        uint32_t dataSize = 0;
+        Image_getLockedImageInfo(env, &lockedImg, i, halReaderFormat,
+                &pData, &dataSize, &pixelStride[i], &rowStride[i]);
+        if (env->ExceptionCheck()) {
+            return NULL;
+        }
+        if (slotPlanes->byteBuffers[i] != NULL && slotPlanes->data[i] == pData
+                && slotPlanes->dataSize[i] == dataSize) {
+            continue;
+        }
+        jobject byteBuffer = env->NewDirectByteBuffer(pData, dataSize);
+        if (byteBuffer == NULL) {
+            if (!env->ExceptionCheck()) {
+                jniThrowException(env, "java/lang/IllegalStateException",
+                        "Failed to allocate ByteBuffer");
+            }
+            return NULL;
+        }
+        if (slotPlanes->byteBuffers[i] != NULL) {
+            env->DeleteGlobalRef(slotPlanes->byteBuffers[i]);
+        }
+        slotPlanes->byteBuffers[i] = env->NewGlobalRef(byteBuffer);
+        slotPlanes->data[i] = pData;
+        slotPlanes->dataSize[i] = dataSize;
+        env->DeleteLocalRef(byteBuffer);
+    }
+
+    if (slotPlanes->planes == NULL) {
+        jobjectArray surfacePlanes = env->NewObjectArray(numPlanes,
+                gSurfacePlaneClassInfo.clazz, /*initial_element*/NULL);
+        if (surfacePlanes == NULL) {
+            jniThrowRuntimeException(env, "Failed to create SurfacePlane arrays,"
+                    " probably out of memory");
+            return NULL;
+        }
+        for (int i = 0; i < numPlanes; i++) {
+            jobject surfacePlane = env->NewObject(gSurfacePlaneClassInfo.clazz,
+                    gSurfacePlaneClassInfo.ctor, image, rowStride[i], pixelStride[i],
+                    slotPlanes->byteBuffers[i]);
+            if (surfacePlane == NULL) {
+                return NULL;
+            }
+            env->SetObjectArrayElement(surfacePlanes, i, surfacePlane);
+            env->DeleteLocalRef(surfacePlane);
+        }
+        slotPlanes->planes = (jobjectArray) env->NewGlobalRef(surfacePlanes);
+        return surfacePlanes;
+    }
+
+    // SurfacePlane.reset() points the plane at the new image and rewinds the buffer.
+    for (int i = 0; i < numPlanes; i++) {
+        jobject surfacePlane = env->GetObjectArrayElement(slotPlanes->planes, i);
+        env->CallVoidMethod(surfacePlane, gSurfacePlaneClassInfo.reset, image, rowStride[i],
+                pixelStride[i], slotPlanes->byteBuffers[i]);
+        env->DeleteLocalRef(surfacePlane);
+        if (env->ExceptionCheck()) {
+            return NULL;
+        }
+    }
+    return (jobjectArray) env->NewLocalRef(slotPlanes->planes);
+}
+
 static jint Image_getWidth(JNIEnv* env, jobject thiz)
 {
     BufferItem* buffer = Image_getBufferItem(env, thiz);
@@ -834,7 +975,9 @@ static const JNINativeMethod gImageReaderMethods[] = {
     {"nativeImageSetup",       "(Landroid/media/Image;)I",   (void*)ImageReader_imageSetup },
     {"nativeGetSurface",       "()Landroid/view/Surface;",   (void*)ImageReader_getSurface },
     {"nativeDetachImage",      "(Landroid/media/Image;)I",   (void*)ImageReader_detachImage },
-    {"nativeDiscardFreeBuffers", "()V",                      (void*)ImageReader_discardFreeBuffers }
+    {"nativeDiscardFreeBuffers", "()V",                      (void*)ImageReader_discardFreeBuffers },
+    {"nativeCreateImagePlanes", "(Landroid/media/Image;II)[Landroid/media/ImageReader$SurfaceImage$SurfacePlane;",
+                                                             (void*)ImageReader_createImagePlanes },
 };
 
 static const JNINativeMethod gImageMethods[] = {
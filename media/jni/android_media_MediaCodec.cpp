@@ -51,6 +51,8 @@
 
 #include <system/window.h>
 
+#include <algorithm>
+
 namespace android {
 
 // Keep these in sync with their equivalents in MediaCodec.java !!!
@@ -64,6 +66,17 @@ enum {
     EVENT_CALLBACK = 1,
     EVENT_SET_CALLBACK = 2,
     EVENT_FRAME_RENDERED = 3,
+    EVENT_OUTPUT_BATCH = 4,
+};
+
+// An EVENT_OUTPUT_BATCH carries this many longs per output buffer, in this order.
+enum {
+    OUTPUT_BATCH_INDEX = 0,
+    OUTPUT_BATCH_OFFSET,
+    OUTPUT_BATCH_SIZE,
+    OUTPUT_BATCH_TIME_US,
+    OUTPUT_BATCH_FLAGS,
+    OUTPUT_BATCH_FIELDS,
 };
 
 static struct CryptoErrorCodes {
@@ -110,6 +123,12 @@ static struct {
     jfieldID levelField;
 } gCodecInfo;
 
+static struct {
+    jclass clazz;
+    jmethodID ctorId;
+    jmethodID setId;
+} gBufferInfo;
+
 struct fields_t {
     jmethodID postEventFromNativeID;
     jmethodID lockAndGetContextID;
@@ -134,7 +153,10 @@ JMediaCodec::JMediaCodec(
         JNIEnv *env, jobject thiz,
         const char *name, bool nameIsType, bool encoder)
     : mClass(NULL),
-      mObject(NULL) {
+      mObject(NULL),
+      mPoolBufferInfos(false),
+      mMaxOutputBatchSize(1),
+      mOutputGeneration(0) {
     jclass clazz = env->GetObjectClass(thiz);
     CHECK(clazz != NULL);
 
@@ -260,6 +282,17 @@ void JMediaCodec::deleteJavaObjects(JNIEnv *env) {
     mByteBufferAsReadOnlyBufferMethodID = NULL;
     mByteBufferPositionMethodID = NULL;
     mByteBufferLimitMethodID = NULL;
+
+    deleteBufferInfos(env);
+}
+
+void JMediaCodec::deleteBufferInfos(JNIEnv *env) {
+    for (jobject info : mBufferInfos) {
+        if (info != NULL) {
+            env->DeleteGlobalRef(info);
+        }
+    }
+    mBufferInfos.clear();
 }
 
 status_t JMediaCodec::enableOnFrameRenderedListener(jboolean enable) {
@@ -333,15 +366,18 @@ status_t JMediaCodec::start() {
 
 status_t JMediaCodec::stop() {
     mSurfaceTextureClient.clear();
+    ++mOutputGeneration;
 
     return mCodec->stop();
 }
 
 status_t JMediaCodec::flush() {
+    ++mOutputGeneration;
     return mCodec->flush();
 }
 
 status_t JMediaCodec::reset() {
+    ++mOutputGeneration;
     return mCodec->reset();
 }
 
@@ -386,11 +422,8 @@ status_t JMediaCodec::dequeueOutputBuffer(
         return err;
     }
 
-    ScopedLocalRef<jclass> clazz(
-            env, env->FindClass("android/media/MediaCodec$BufferInfo"));
-
-    jmethodID method = env->GetMethodID(clazz.get(), "set", "(IIJI)V");
-    env->CallVoidMethod(bufferInfo, method, (jint)offset, (jint)size, timeUs, flags);
+    env->CallVoidMethod(
+            bufferInfo, gBufferInfo.setId, (jint)offset, (jint)size, timeUs, flags);
 
     return OK;
 }
@@ -818,6 +851,11 @@ void JMediaCodec::handleCallback(const sp<AMessage> &msg) {
     CHECK(msg->findInt32("callbackID", &arg1));
     JNIEnv *env = AndroidRuntime::getJNIEnv();
 
+    if (arg1 != MediaCodec::CB_INPUT_AVAILABLE && arg1 != MediaCodec::CB_OUTPUT_AVAILABLE) {
+        // Report batched output buffers ahead of the format change or error that followed.
+        flushOutputBatch(env);
+    }
+
     switch (arg1) {
         case MediaCodec::CB_INPUT_AVAILABLE:
         {
@@ -827,34 +865,28 @@ void JMediaCodec::handleCallback(const sp<AMessage> &msg) {
 
         case MediaCodec::CB_OUTPUT_AVAILABLE:
         {
-            CHECK(msg->findInt32("index", &arg2));
-
-            size_t size, offset;
-            int64_t timeUs;
-            uint32_t flags;
-            CHECK(msg->findSize("size", &size));
-            CHECK(msg->findSize("offset", &offset));
-            CHECK(msg->findInt64("timeUs", &timeUs));
-            CHECK(msg->findInt32("flags", (int32_t *)&flags));
-
-            ScopedLocalRef<jclass> clazz(
-                    env, env->FindClass("android/media/MediaCodec$BufferInfo"));
-            jmethodID ctor = env->GetMethodID(clazz.get(), "<init>", "()V");
-            jmethodID method = env->GetMethodID(clazz.get(), "set", "(IIJI)V");
-
-            obj = env->NewObject(clazz.get(), ctor);
-
-            if (obj == NULL) {
-                if (env->ExceptionCheck()) {
-                    ALOGE("Could not create MediaCodec.BufferInfo.");
-                    env->ExceptionClear();
-                }
-                jniThrowException(env, "java/lang/IllegalStateException", NULL);
+            PendingOutput output;
+            CHECK(msg->findInt32("index", &output.index));
+            CHECK(msg->findSize("size", &output.size));
+            CHECK(msg->findSize("offset", &output.offset));
+            CHECK(msg->findInt64("timeUs", &output.timeUs));
+            CHECK(msg->findInt32("flags", (int32_t *)&output.flags));
+            output.generation = mOutputGeneration;
+
+            if (mMaxOutputBatchSize <= 1) {
+                postOutputAvailable(env, output);
                 return;
             }
 
-            env->CallVoidMethod(obj, method, (jint)offset, (jint)size, timeUs, flags);
-            break;
+            mPendingOutputs.push_back(output);
+            if (mPendingOutputs.size() >= (size_t)mMaxOutputBatchSize) {
+                flushOutputBatch(env);
+            } else if (mPendingOutputs.size() == 1) {
+                // Anything that becomes ready before this message comes back around joins
+                // the batch.
+                (new AMessage(kWhatFlushOutputBatch, this))->post();
+            }
+            return;
         }
 
         case MediaCodec::CB_ERROR:
@@ -906,6 +938,116 @@ void JMediaCodec::handleCallback(const sp<AMessage> &msg) {
     env->DeleteLocalRef(obj);
 }
 
+jobject JMediaCodec::newBufferInfo(JNIEnv *env, const PendingOutput &output) {
+    jobject obj = NULL;
+    if (mPoolBufferInfos) {
+        // The codec does not report an index again until the app has released it, by which
+        // point the app is done with the BufferInfo it got for it.
+        if ((size_t)output.index >= mBufferInfos.size()) {
+            mBufferInfos.resize(output.index + 1, NULL);
+        }
+        jobject &pooled = mBufferInfos[output.index];
+        if (pooled == NULL) {
+            ScopedLocalRef<jobject> info(
+                    env, env->NewObject(gBufferInfo.clazz, gBufferInfo.ctorId));
+            if (info.get() != NULL) {
+                pooled = env->NewGlobalRef(info.get());
+            }
+        }
+        if (pooled != NULL) {
+            obj = env->NewLocalRef(pooled);
+        }
+    } else {
+        obj = env->NewObject(gBufferInfo.clazz, gBufferInfo.ctorId);
+    }
+
+    if (obj != NULL) {
+        env->CallVoidMethod(
+                obj, gBufferInfo.setId,
+                (jint)output.offset, (jint)output.size, output.timeUs, output.flags);
+    }
+    return obj;
+}
+
+void JMediaCodec::postOutputAvailable(JNIEnv *env, const PendingOutput &output) {
+    jobject obj = newBufferInfo(env, output);
+
+    if (obj == NULL) {
+        if (env->ExceptionCheck()) {
+            ALOGE("Could not create MediaCodec.BufferInfo.");
+            env->ExceptionClear();
+        }
+        jniThrowException(env, "java/lang/IllegalStateException", NULL);
+        return;
+    }
+
+    env->CallVoidMethod(
+            mObject,
+            gFields.postEventFromNativeID,
+            EVENT_CALLBACK,
+            MediaCodec::CB_OUTPUT_AVAILABLE,
+            output.index,
+            obj);
+
+    env->DeleteLocalRef(obj);
+}
+
+void JMediaCodec::flushOutputBatch(JNIEnv *env) {
+    if (mPendingOutputs.empty()) {
+        return;
+    }
+
+    // Buffers reported before a flush, stop or reset are no longer the app's to release.
+    std::vector<PendingOutput> outputs;
+    outputs.swap(mPendingOutputs);
+    int32_t generation = mOutputGeneration;
+    outputs.erase(
+            std::remove_if(outputs.begin(), outputs.end(),
+                    [generation](const PendingOutput &output) {
+                        return output.generation != generation;
+                    }),
+            outputs.end());
+
+    if (outputs.size() == 1) {
+        postOutputAvailable(env, outputs[0]);
+        return;
+    } else if (outputs.empty()) {
+        return;
+    }
+
+    std::vector<jlong> values(outputs.size() * OUTPUT_BATCH_FIELDS);
+    for (size_t i = 0; i < outputs.size(); ++i) {
+        jlong *fields = &values[i * OUTPUT_BATCH_FIELDS];
+        fields[OUTPUT_BATCH_INDEX] = outputs[i].index;
+        fields[OUTPUT_BATCH_OFFSET] = outputs[i].offset;
+        fields[OUTPUT_BATCH_SIZE] = outputs[i].size;
+        fields[OUTPUT_BATCH_TIME_US] = outputs[i].timeUs;
+        fields[OUTPUT_BATCH_FLAGS] = outputs[i].flags;
+    }
+
+    ScopedLocalRef<jlongArray> batch(env, env->NewLongArray(values.size()));
+    if (batch.get() == NULL) {
+        ALOGE("Could not allocate an output batch of %zu buffers.", outputs.size());
+        env->ExceptionClear();
+        for (const PendingOutput &output : outputs) {
+            postOutputAvailable(env, output);
+        }
+        return;
+    }
+    env->SetLongArrayRegion(batch.get(), 0, values.size(), values.data());
+
+    env->CallVoidMethod(
+            mObject, gFields.postEventFromNativeID,
+            EVENT_OUTPUT_BATCH, (jint)outputs.size(), 0, batch.get());
+}
+
+void JMediaCodec::setOutputCallbackMode(bool poolBufferInfos, int32_t maxBatchSize) {
+    sp<AMessage> msg = new AMessage(kWhatSetOutputCallbackMode, this);
+    msg->setInt32("pool", poolBufferInfos);
+    msg->setInt32("max-batch-size", maxBatchSize);
+    msg->post();
+}
+
 void JMediaCodec::handleFrameRenderedNotification(const sp<AMessage> &msg) {
     int32_t arg1 = 0, arg2 = 0;
     jobject obj = NULL;
@@ -939,6 +1081,26 @@ void JMediaCodec::onMessageReceived(const sp<AMessage> &msg) {
             handleFrameRenderedNotification(msg);
             break;
         }
+        case kWhatSetOutputCallbackMode:
+        {
+            int32_t pool, maxBatchSize;
+            CHECK(msg->findInt32("pool", &pool));
+            CHECK(msg->findInt32("max-batch-size", &maxBatchSize));
+
+            JNIEnv *env = AndroidRuntime::getJNIEnv();
+            flushOutputBatch(env);
+            mPoolBufferInfos = pool != 0;
+            mMaxOutputBatchSize = maxBatchSize;
+            if (!mPoolBufferInfos) {
+                deleteBufferInfos(env);
+            }
+            break;
+        }
+        case kWhatFlushOutputBatch:
+        {
+            flushOutputBatch(AndroidRuntime::getJNIEnv());
+            break;
+        }
         default:
             TRESPASS();
     }
@@ -1112,6 +1274,26 @@ static void android_media_MediaCodec_native_setCallback(
     throwExceptionAsNecessary(env, err);
 }
 
+static void android_media_MediaCodec_native_setOutputCallbackMode(
+        JNIEnv *env,
+        jobject thiz,
+        jboolean poolBufferInfos,
+        jint maxBatchSize) {
+    sp<JMediaCodec> codec = getMediaCodec(env, thiz);
+
+    if (codec == NULL) {
+        throwExceptionAsNecessary(env, INVALID_OPERATION);
+        return;
+    }
+
+    if (maxBatchSize < 0) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", NULL);
+        return;
+    }
+
+    codec->setOutputCallbackMode(poolBufferInfos, maxBatchSize);
+}
+
 static void android_media_MediaCodec_native_configure(
         JNIEnv *env,
         jobject thiz,
@@ -2105,6 +2287,18 @@ static void android_media_MediaCodec_native_init(JNIEnv *env) {
     field = env->GetFieldID(clazz.get(), "level", "I");
     CHECK(field != NULL);
     gCodecInfo.levelField = field;
+
+    clazz.reset(env->FindClass("android/media/MediaCodec$BufferInfo"));
+    CHECK(clazz.get() != NULL);
+    gBufferInfo.clazz = (jclass)env->NewGlobalRef(clazz.get());
+
+    method = env->GetMethodID(clazz.get(), "<init>", "()V");
+    CHECK(method != NULL);
+    gBufferInfo.ctorId = method;
+
+    method = env->GetMethodID(clazz.get(), "set", "(IIJI)V");
+    CHECK(method != NULL);
+    gBufferInfo.setId = method;
 }
 
 static void android_media_MediaCodec_native_setup(
@@ -2178,6 +2372,9 @@ static const JNINativeMethod gMethods[] = {
       "(Landroid/media/MediaCodec$Callback;)V",
       (void *)android_media_MediaCodec_native_setCallback },
 
+    { "native_setOutputCallbackMode", "(ZI)V",
+      (void *)android_media_MediaCodec_native_setOutputCallbackMode },
+
     { "native_configure",
       "([Ljava/lang/String;[Ljava/lang/Object;Landroid/view/Surface;"
       "Landroid/media/MediaCrypto;Landroid/os/IHwBinder;I)V",
@@ -17,7 +17,9 @@
 #ifndef _ANDROID_MEDIA_MEDIACODEC_H_
 #define _ANDROID_MEDIA_MEDIACODEC_H_
 
+#include <atomic>
 #include <mutex>
+#include <vector>
 
 #include "jni.h"
 
@@ -132,6 +134,10 @@ struct JMediaCodec : public AHandler {
 
     void selectAudioPresentation(const int32_t presentationId, const int32_t programId);
 
+    // Whether output callbacks reuse one BufferInfo per buffer index, and how many ready
+    // output buffers may be reported in one callback (<= 1 reports each on its own).
+    void setOutputCallbackMode(bool poolBufferInfos, int32_t maxBatchSize);
+
 protected:
     virtual ~JMediaCodec();
 
@@ -141,6 +147,17 @@ private:
     enum {
         kWhatCallbackNotify,
         kWhatFrameRendered,
+        kWhatSetOutputCallbackMode,
+        kWhatFlushOutputBatch,
+    };
+
+    struct PendingOutput {
+        int32_t index;
+        size_t offset;
+        size_t size;
+        int64_t timeUs;
+        uint32_t flags;
+        int32_t generation;
     };
 
     jclass mClass;
@@ -165,6 +182,15 @@ private:
 
     status_t mInitStatus;
 
+    // Output callback mode, only touched on the looper thread.
+    bool mPoolBufferInfos;
+    int32_t mMaxOutputBatchSize;
+    std::vector<jobject> mBufferInfos;  // global refs, by buffer index
+    std::vector<PendingOutput> mPendingOutputs;
+
+    // Bumped by flush/stop/reset so that batched buffers from before are dropped.
+    std::atomic<int32_t> mOutputGeneration;
+
     template <typename T>
     status_t createByteBufferFromABuffer(
             JNIEnv *env, bool readOnly, bool clearBuffer, const sp<T> &buffer,
@@ -174,6 +200,10 @@ private:
     void deleteJavaObjects(JNIEnv *env);
     void handleCallback(const sp<AMessage> &msg);
     void handleFrameRenderedNotification(const sp<AMessage> &msg);
+    jobject newBufferInfo(JNIEnv *env, const PendingOutput &output);
+    void postOutputAvailable(JNIEnv *env, const PendingOutput &output);
+    void flushOutputBatch(JNIEnv *env);
+    void deleteBufferInfos(JNIEnv *env);
 
     DISALLOW_EVIL_CONSTRUCTORS(JMediaCodec);
 };
@@ -32,7 +32,16 @@
 namespace android {
 
 JMediaDataSource::JMediaDataSource(JNIEnv* env, jobject source)
-    : mJavaObjStatus(OK), mSizeIsCached(false), mCachedSize(0), mMemory(NULL) {
+    : mJavaObjStatus(OK), mSizeIsCached(false), mCachedSize(0), mMemory(NULL),
+      mPrefetchActive(false), mPrefetchQuit(false), mPrefetchEos(false), mPrefetchFailed(false),
+      mPrefetchOffset(0), mPrefetchGeneration(0), mPrefetchUpcalls(0),
+      mLastReadEnd(-1), mSequentialReads(0), mReads(0), mPrefetchHits(0), mUpcalls(0) {
+    for (int i = 0; i < kPrefetchChunks; i++) {
+        mChunks[i].state = PrefetchChunk::EMPTY;
+        mChunks[i].offset = 0;
+        mChunks[i].length = 0;
+    }
+
     mMediaDataSourceObj = env->NewGlobalRef(source);
     CHECK(mMediaDataSourceObj != NULL);
 
@@ -58,6 +67,7 @@ JMediaDataSource::JMediaDataSource(JNIEnv* env, jobject source)
 }
 
 JMediaDataSource::~JMediaDataSource() {
+    stopPrefetchThread();
     JNIEnv* env = AndroidRuntime::getJNIEnv();
     env->DeleteGlobalRef(mMediaDataSourceObj);
     env->DeleteGlobalRef(mByteArrayObj);
@@ -68,30 +78,25 @@ sp<IMemory> JMediaDataSource::getIMemory() {
     return mMemory;
 }
 
-ssize_t JMediaDataSource::readAt(off64_t offset, size_t size) {
-    Mutex::Autolock lock(mLock);
-
-    if (mJavaObjStatus != OK || mMemory == NULL) {
-        return -1;
-    }
-    if (size > kBufferSize) {
-        size = kBufferSize;
-    }
+// Reads from the java DataSource into out. Sets *failed if it is now in a broken state.
+ssize_t JMediaDataSource::readFromJava(JNIEnv* env, jbyteArray array, off64_t offset,
+        size_t size, uint8_t* out, bool* failed) {
+    Mutex::Autolock lock(mJavaLock);
 
-    JNIEnv* env = AndroidRuntime::getJNIEnv();
+    *failed = false;
     jint numread = env->CallIntMethod(mMediaDataSourceObj, mReadMethod,
-            (jlong)offset, mByteArrayObj, (jint)0, (jint)size);
+            (jlong)offset, array, (jint)0, (jint)size);
     if (env->ExceptionCheck()) {
         ALOGW("An exception occurred in readAt()");
         LOGW_EX(env);
         env->ExceptionClear();
-        mJavaObjStatus = UNKNOWN_ERROR;
+        *failed = true;
         return -1;
     }
     if (numread < 0) {
         if (numread != -1) {
             ALOGW("An error occurred in readAt()");
-            mJavaObjStatus = UNKNOWN_ERROR;
+            *failed = true;
             return -1;
         } else {
             // numread == -1 indicates EOF
@@ -100,15 +105,214 @@ ssize_t JMediaDataSource::readAt(off64_t offset, size_t size) {
     }
     if ((size_t)numread > size) {
         ALOGE("readAt read too many bytes.");
-        mJavaObjStatus = UNKNOWN_ERROR;
+        *failed = true;
         return -1;
     }
 
     ALOGV("readAt %lld / %zu => %d.", (long long)offset, size, numread);
-    env->GetByteArrayRegion(mByteArrayObj, 0, numread, (jbyte*)mMemory->pointer());
+    env->GetByteArrayRegion(array, 0, numread, (jbyte*)out);
+    return numread;
+}
+
+ssize_t JMediaDataSource::readAt(off64_t offset, size_t size) {
+    Mutex::Autolock lock(mLock);
+
+    if (mJavaObjStatus != OK || mMemory == NULL) {
+        return -1;
+    }
+    if (size > kBufferSize) {
+        size = kBufferSize;
+    }
+
+    mReads++;
+    const bool sequential = offset == mLastReadEnd;
+    mSequentialReads = sequential ? mSequentialReads + 1 : 0;
+
+    ssize_t numread = readFromPrefetch_l(offset, size);
+    if (numread >= 0) {
+        mPrefetchHits++;
+    } else {
+        if (!sequential) {
+            flushPrefetch_l();
+        }
+        bool failed;
+        {
+            Mutex::Autolock prefetchLock(mPrefetchLock);
+            failed = mPrefetchFailed;
+        }
+        if (!failed) {
+            JNIEnv* env = AndroidRuntime::getJNIEnv();
+            numread = readFromJava(env, mByteArrayObj, offset, size,
+                    static_cast<uint8_t*>(mMemory->pointer()), &failed);
+            mUpcalls++;
+        }
+        if (failed) {
+            flushPrefetch_l();
+            mJavaObjStatus = UNKNOWN_ERROR;
+            return -1;
+        }
+        if (numread > 0 && mSequentialReads >= kSequentialReadsToPrefetch) {
+            startPrefetch_l(offset + numread);
+        }
+    }
+
+    mLastReadEnd = offset + numread;
     return numread;
 }
 
+// Copies from the read-ahead ring into mMemory, waiting if the chunk holding offset is being
+// fetched. Returns -1 if offset is not in the ring.
+ssize_t JMediaDataSource::readFromPrefetch_l(off64_t offset, size_t size) {
+    Mutex::Autolock lock(mPrefetchLock);
+
+    while (mPrefetchActive) {
+        PrefetchChunk* chunk = NULL;
+        for (int i = 0; i < kPrefetchChunks; i++) {
+            PrefetchChunk& c = mChunks[i];
+            size_t length = c.state == PrefetchChunk::FETCHING ? kPrefetchChunkSize : c.length;
+            if (c.state != PrefetchChunk::EMPTY && offset >= c.offset
+                    && offset < c.offset + (off64_t)length) {
+                chunk = &c;
+                break;
+            }
+        }
+        if (chunk == NULL) {
+            return -1;
+        }
+        if (chunk->state == PrefetchChunk::FETCHING) {
+            mPrefetchCondition.wait(mPrefetchLock);
+            continue;
+        }
+
+        size_t available = chunk->offset + chunk->length - offset;
+        size_t numread = size < available ? size : available;
+        memcpy(mMemory->pointer(), chunk->data.data() + (offset - chunk->offset), numread);
+
+        // Chunks wholly behind the reader are done with; let the prefetch thread refill them.
+        for (int i = 0; i < kPrefetchChunks; i++) {
+            PrefetchChunk& c = mChunks[i];
+            if (c.state == PrefetchChunk::READY && c.offset + (off64_t)c.length <= offset) {
+                c.state = PrefetchChunk::EMPTY;
+            }
+        }
+        mPrefetchCondition.broadcast();
+        return numread;
+    }
+    return -1;
+}
+
+void JMediaDataSource::startPrefetch_l(off64_t offset) {
+    Mutex::Autolock lock(mPrefetchLock);
+
+    mPrefetchGeneration++;
+    for (int i = 0; i < kPrefetchChunks; i++) {
+        if (mChunks[i].state == PrefetchChunk::READY) {
+            mChunks[i].state = PrefetchChunk::EMPTY;
+        }
+        if (mChunks[i].data.empty()) {
+            mChunks[i].data.resize(kPrefetchChunkSize);
+        }
+    }
+    mPrefetchOffset = offset;
+    mPrefetchEos = false;
+    mPrefetchActive = true;
+    if (!mPrefetchThread.joinable()) {
+        mPrefetchThread = std::thread(&JMediaDataSource::prefetchLoop, this);
+    }
+    mPrefetchCondition.broadcast();
+}
+
+void JMediaDataSource::flushPrefetch_l() {
+    Mutex::Autolock lock(mPrefetchLock);
+
+    if (!mPrefetchActive) {
+        return;
+    }
+    mPrefetchGeneration++;
+    for (int i = 0; i < kPrefetchChunks; i++) {
+        if (mChunks[i].state == PrefetchChunk::READY) {
+            mChunks[i].state = PrefetchChunk::EMPTY;
+        }
+    }
+    mPrefetchActive = false;
+    mPrefetchCondition.broadcast();
+}
+
+void JMediaDataSource::stopPrefetchThread() {
+    {
+        Mutex::Autolock lock(mPrefetchLock);
+        mPrefetchQuit = true;
+        mPrefetchActive = false;
+        mPrefetchCondition.broadcast();
+    }
+    if (mPrefetchThread.joinable()) {
+        mPrefetchThread.join();
+    }
+}
+
+void JMediaDataSource::prefetchLoop() {
+    JavaVM* vm = AndroidRuntime::getJavaVM();
+    JNIEnv* env = NULL;
+    JavaVMAttachArgs args = {JNI_VERSION_1_4, "JMediaDataSource", NULL};
+    if (vm->AttachCurrentThread(&env, &args) != JNI_OK) {
+        ALOGE("Failed to attach the prefetch thread");
+        Mutex::Autolock lock(mPrefetchLock);
+        mPrefetchActive = false;
+        mPrefetchCondition.broadcast();
+        return;
+    }
+    ScopedLocalRef<jbyteArray> array(env, env->NewByteArray(kPrefetchChunkSize));
+
+    mPrefetchLock.lock();
+    while (!mPrefetchQuit && array.get() != NULL) {
+        PrefetchChunk* chunk = NULL;
+        if (mPrefetchActive && !mPrefetchEos) {
+            for (int i = 0; i < kPrefetchChunks; i++) {
+                if (mChunks[i].state == PrefetchChunk::EMPTY) {
+                    chunk = &mChunks[i];
+                    break;
+                }
+            }
+        }
+        if (chunk == NULL) {
+            mPrefetchCondition.wait(mPrefetchLock);
+            continue;
+        }
+
+        const off64_t offset = mPrefetchOffset;
+        const uint32_t generation = mPrefetchGeneration;
+        chunk->state = PrefetchChunk::FETCHING;
+        chunk->offset = offset;
+        chunk->length = 0;
+        mPrefetchLock.unlock();
+
+        bool failed;
+        ssize_t numread = readFromJava(env, array.get(), offset, kPrefetchChunkSize,
+                chunk->data.data(), &failed);
+
+        mPrefetchLock.lock();
+        mPrefetchUpcalls++;
+        chunk->state = PrefetchChunk::EMPTY;
+        if (generation != mPrefetchGeneration) {
+            // The reader moved on while this chunk was fetched.
+        } else if (failed) {
+            mPrefetchFailed = true;
+            mPrefetchActive = false;
+        } else if (numread == 0) {
+            mPrefetchEos = true;
+        } else {
+            chunk->state = PrefetchChunk::READY;
+            chunk->length = numread;
+            mPrefetchOffset = offset + numread;
+        }
+        mPrefetchCondition.broadcast();
+    }
+    mPrefetchLock.unlock();
+
+    array.reset();
+    vm->DetachCurrentThread();
+}
+
 status_t JMediaDataSource::getSize(off64_t* size) {
     Mutex::Autolock lock(mLock);
 
@@ -145,7 +349,11 @@ status_t JMediaDataSource::getSize(off64_t* size) {
 void JMediaDataSource::close() {
     Mutex::Autolock lock(mLock);
 
+    stopPrefetchThread();
+    ALOGV("%s", toString_l().string());
+
     JNIEnv* env = AndroidRuntime::getJNIEnv();
+    Mutex::Autolock javaLock(mJavaLock);
     env->CallVoidMethod(mMediaDataSourceObj, mCloseMethod);
     // The closed state is effectively the same as an error state.
     mJavaObjStatus = UNKNOWN_ERROR;
@@ -156,7 +364,19 @@ uint32_t JMediaDataSource::getFlags() {
 }
 
 String8 JMediaDataSource::toString() {
-    return String8::format("JMediaDataSource(pid %d, uid %d)", getpid(), getuid());
+    Mutex::Autolock lock(mLock);
+    return toString_l();
+}
+
+String8 JMediaDataSource::toString_l() {
+    int64_t prefetchUpcalls;
+    {
+        Mutex::Autolock lock(mPrefetchLock);
+        prefetchUpcalls = mPrefetchUpcalls;
+    }
+    return String8::format("JMediaDataSource(pid %d, uid %d, reads %lld, prefetch hits %lld,"
+            " upcalls %lld, prefetch upcalls %lld)", getpid(), getuid(), (long long)mReads,
+            (long long)mPrefetchHits, (long long)mUpcalls, (long long)prefetchUpcalls);
 }
 
 }  // namespace android
@@ -21,9 +21,13 @@
 
 #include <media/IDataSource.h>
 #include <media/stagefright/foundation/ABase.h>
+#include <utils/Condition.h>
 #include <utils/Errors.h>
 #include <utils/Mutex.h>
 
+#include <thread>
+#include <vector>
+
 namespace android {
 
 // The native counterpart to a Java android.media.MediaDataSource. It inherits from
@@ -32,10 +36,18 @@ namespace android {
 // If the java DataSource returns an error or throws an exception it
 // will be considered to be in a broken state, and the only further call this
 // will make is to close().
+//
+// Once reads turn sequential, a helper thread reads ahead of them from the java DataSource
+// in kPrefetchChunkSize chunks into a ring of kPrefetchChunks buffers, and readAt() is served
+// from the ring where possible.
 class JMediaDataSource : public BnDataSource {
 public:
     enum {
         kBufferSize = 64 * 1024,
+        kPrefetchChunkSize = 256 * 1024,
+        kPrefetchChunks = 4,
+        // Reads that must follow each other before read-ahead starts.
+        kSequentialReadsToPrefetch = 2,
     };
 
     JMediaDataSource(JNIEnv *env, jobject source);
@@ -67,6 +79,48 @@ private:
     jmethodID mCloseMethod;
     jbyteArray mByteArrayObj;
 
+    // Serializes calls into the java DataSource between binder threads and the prefetch thread.
+    // Taken after mLock and never while holding mPrefetchLock.
+    Mutex mJavaLock;
+
+    struct PrefetchChunk {
+        enum State { EMPTY, FETCHING, READY };
+        State state;
+        off64_t offset;
+        size_t length;
+        std::vector<uint8_t> data;
+    };
+
+    // Read-ahead state, guarded by mPrefetchLock.
+    Mutex mPrefetchLock;
+    Condition mPrefetchCondition;
+    PrefetchChunk mChunks[kPrefetchChunks];
+    std::thread mPrefetchThread;
+    bool mPrefetchActive;
+    bool mPrefetchQuit;
+    bool mPrefetchEos;
+    bool mPrefetchFailed;
+    off64_t mPrefetchOffset;
+    // Bumped when the ring is flushed so that a chunk fetched for the old position is dropped.
+    uint32_t mPrefetchGeneration;
+    int64_t mPrefetchUpcalls;
+
+    // Access pattern and stats, guarded by mLock.
+    off64_t mLastReadEnd;
+    int mSequentialReads;
+    int64_t mReads;
+    int64_t mPrefetchHits;
+    int64_t mUpcalls;
+
+    ssize_t readFromJava(JNIEnv* env, jbyteArray array, off64_t offset, size_t size,
+            uint8_t* out, bool* failed);
+    ssize_t readFromPrefetch_l(off64_t offset, size_t size);
+    void startPrefetch_l(off64_t offset);
+    void flushPrefetch_l();
+    void stopPrefetchThread();
+    void prefetchLoop();
+    String8 toString_l();
+
     DISALLOW_EVIL_CONSTRUCTORS(JMediaDataSource);
 };
 
@@ -22,10 +22,13 @@
 #include "android_runtime/AndroidRuntime.h"
 #include "jni.h"
 #include <nativehelper/JNIPlatformHelp.h>
+#include <nativehelper/ScopedLocalRef.h>
 
 #include <unistd.h>
 #include <fcntl.h>
 
+#include <vector>
+
 #include <media/stagefright/foundation/ABuffer.h>
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/foundation/AMessage.h>
@@ -39,6 +42,18 @@ struct fields_t {
 
 static fields_t gFields;
 
+// Layout of the per-sample info of nativeWriteSampleDataBatch, one run of
+// SAMPLE_INFO_FIELDS longs per sample.
+// Keep in sync with MediaMuxer.java !!!
+enum {
+    SAMPLE_INFO_TRACK_INDEX = 0,
+    SAMPLE_INFO_OFFSET,
+    SAMPLE_INFO_SIZE,
+    SAMPLE_INFO_TIME_US,
+    SAMPLE_INFO_FLAGS,
+    SAMPLE_INFO_FIELDS,
+};
+
 }
 
 using namespace android;
@@ -73,65 +88,115 @@ static jint android_media_MediaMuxer_addTrack(
     return trackIndex;
 }
 
-static void android_media_MediaMuxer_writeSampleData(
-        JNIEnv *env, jclass /* clazz */, jlong nativeObject, jint trackIndex,
+// Hands one sample to the muxer. Samples in direct buffers are wrapped in place, and of a
+// heap buffer only the sample's range of the backing array is copied. Returns false with an
+// exception pending on failure.
+static bool writeSample(
+        JNIEnv *env, const sp<MediaMuxer> &muxer, jint trackIndex,
         jobject byteBuf, jint offset, jint size, jlong timeUs, jint flags) {
-    sp<MediaMuxer> muxer(reinterpret_cast<MediaMuxer *>(nativeObject));
-    if (muxer == NULL) {
-        jniThrowException(env, "java/lang/IllegalStateException",
-                          "Muxer was not set up correctly");
-        return;
-    }
-
-    // Try to convert the incoming byteBuffer into ABuffer
+    sp<ABuffer> buffer;
     void *dst = env->GetDirectBufferAddress(byteBuf);
 
-    jlong dstSize;
-    jbyteArray byteArray = NULL;
-
     if (dst == NULL) {
+        ScopedLocalRef<jbyteArray> byteArray(env,
+            (jbyteArray)env->CallObjectMethod(byteBuf, gFields.arrayID));
 
-        byteArray =
-            (jbyteArray)env->CallObjectMethod(byteBuf, gFields.arrayID);
-
-        if (byteArray == NULL) {
+        if (byteArray.get() == NULL) {
             jniThrowException(env, "java/lang/IllegalArgumentException",
                               "byteArray is null");
-            return;
+            return false;
         }
 
-        jboolean isCopy;
-        dst = env->GetByteArrayElements(byteArray, &isCopy);
+        jlong dstSize = env->GetArrayLength(byteArray.get());
+        if (dstSize < (offset + size)) {
+            ALOGE("writeSampleData saw wrong dstSize %lld, size  %d, offset %d",
+                  (long long)dstSize, size, offset);
+            jniThrowException(env, "java/lang/IllegalArgumentException",
+                              "sample has a wrong size");
+            return false;
+        }
 
-        dstSize = env->GetArrayLength(byteArray);
+        buffer = new ABuffer(size);
+        env->GetByteArrayRegion(byteArray.get(), offset, size, (jbyte *)buffer->data());
     } else {
-        dstSize = env->GetDirectBufferCapacity(byteBuf);
+        jlong dstSize = env->GetDirectBufferCapacity(byteBuf);
+        if (dstSize < (offset + size)) {
+            ALOGE("writeSampleData saw wrong dstSize %lld, size  %d, offset %d",
+                  (long long)dstSize, size, offset);
+            jniThrowException(env, "java/lang/IllegalArgumentException",
+                              "sample has a wrong size");
+            return false;
+        }
+
+        buffer = new ABuffer((char *)dst + offset, size);
     }
 
-    if (dstSize < (offset + size)) {
-        ALOGE("writeSampleData saw wrong dstSize %lld, size  %d, offset %d",
-              (long long)dstSize, size, offset);
-        if (byteArray != NULL) {
-            env->ReleaseByteArrayElements(byteArray, (jbyte *)dst, 0);
-        }
-        jniThrowException(env, "java/lang/IllegalArgumentException",
-                          "sample has a wrong size");
+    status_t err = muxer->writeSampleData(buffer, trackIndex, timeUs, flags);
+
+    if (err != OK) {
+        jniThrowException(env, "java/lang/IllegalStateException",
+                          "writeSampleData returned an error");
+        return false;
+    }
+    return true;
+}
+
+static void android_media_MediaMuxer_writeSampleData(
+        JNIEnv *env, jclass /* clazz */, jlong nativeObject, jint trackIndex,
+        jobject byteBuf, jint offset, jint size, jlong timeUs, jint flags) {
+    sp<MediaMuxer> muxer(reinterpret_cast<MediaMuxer *>(nativeObject));
+    if (muxer == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException",
+                          "Muxer was not set up correctly");
         return;
     }
 
-    sp<ABuffer> buffer = new ABuffer((char *)dst + offset, size);
+    writeSample(env, muxer, trackIndex, byteBuf, offset, size, timeUs, flags);
+}
 
-    status_t err = muxer->writeSampleData(buffer, trackIndex, timeUs, flags);
+// Writes several samples in one call, byteBufs[i] holding the sample described by the
+// i-th run of SAMPLE_INFO_FIELDS in infos. Stops at the first sample that fails.
+static void android_media_MediaMuxer_writeSampleDataBatch(
+        JNIEnv *env, jclass /* clazz */, jlong nativeObject,
+        jobjectArray byteBufs, jlongArray infos) {
+    sp<MediaMuxer> muxer(reinterpret_cast<MediaMuxer *>(nativeObject));
+    if (muxer == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException",
+                          "Muxer was not set up correctly");
+        return;
+    }
+
+    if (byteBufs == NULL || infos == NULL) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", NULL);
+        return;
+    }
 
-    if (byteArray != NULL) {
-        env->ReleaseByteArrayElements(byteArray, (jbyte *)dst, 0);
+    jsize count = env->GetArrayLength(byteBufs);
+    if (env->GetArrayLength(infos) != count * SAMPLE_INFO_FIELDS) {
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                          "sample infos do not match the buffers");
+        return;
     }
 
-    if (err != OK) {
-        jniThrowException(env, "java/lang/IllegalStateException",
-                          "writeSampleData returned an error");
+    std::vector<jlong> values(count * SAMPLE_INFO_FIELDS);
+    env->GetLongArrayRegion(infos, 0, values.size(), values.data());
+
+    for (jsize i = 0; i < count; ++i) {
+        const jlong *info = &values[i * SAMPLE_INFO_FIELDS];
+        ScopedLocalRef<jobject> byteBuf(env, env->GetObjectArrayElement(byteBufs, i));
+        if (byteBuf.get() == NULL) {
+            jniThrowException(env, "java/lang/IllegalArgumentException",
+                              "byteBuffer is null");
+            return;
+        }
+
+        if (!writeSample(env, muxer,
+                (jint)info[SAMPLE_INFO_TRACK_INDEX], byteBuf.get(),
+                (jint)info[SAMPLE_INFO_OFFSET], (jint)info[SAMPLE_INFO_SIZE],
+                info[SAMPLE_INFO_TIME_US], (jint)info[SAMPLE_INFO_FLAGS])) {
+            return;
+        }
     }
-    return;
 }
 
 // Constructor counterpart.
@@ -260,6 +325,9 @@ static const JNINativeMethod gMethods[] = {
     { "nativeWriteSampleData", "(JILjava/nio/ByteBuffer;IIJI)V",
         (void *)android_media_MediaMuxer_writeSampleData },
 
+    { "nativeWriteSampleDataBatch", "(J[Ljava/nio/ByteBuffer;[J)V",
+        (void *)android_media_MediaMuxer_writeSampleDataBatch },
+
     { "nativeStop", "(J)V", (void *)android_media_MediaMuxer_stop},
 
     { "nativeSetup", "(Ljava/io/FileDescriptor;I)J",
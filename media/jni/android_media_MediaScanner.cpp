@@ -29,6 +29,14 @@
 #include "android_runtime/Log.h"
 #include <android-base/macros.h>                // for FALLTHROUGH_INTENDED
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
 using namespace android;
 
 
@@ -44,6 +52,9 @@ static const char* const kRunTimeException =
 static const char* const kIllegalArgumentException =
         "java/lang/IllegalArgumentException";
 
+// Upper bound on the worker threads of one processFiles() call.
+static const size_t kMaxScanThreads = 4;
+
 struct fields_t {
     jfieldID    context;
 };
@@ -107,6 +118,77 @@ static bool isValidUtf8(const char* bytes) {
     return true;
 }
 
+// Replaces the non-ASCII bytes of a value that is not valid modified UTF-8, as
+// handleStringTag() does before handing it to Java.
+static std::string sanitizedTagValue(const char* value) {
+    std::string cleaned(value);
+    if (!isValidUtf8(value)) {
+        for (char& ch : cleaned) {
+            if (ch & 0x80) {
+                ch = '?';
+            }
+        }
+    }
+    return cleaned;
+}
+
+// What a scan reported about one file of a processFiles() batch.
+struct ScannedFile {
+    ScannedFile() : done(false), result(MEDIA_SCAN_RESULT_ERROR) {}
+
+    bool done;
+    MediaScanResult result;
+    std::string mimeType;
+    // Alternating tag names and values, in the order they were reported.
+    std::vector<std::string> namesAndValues;
+};
+
+// Collects the callbacks of a scan on a worker thread, without calling into Java.
+class RecordingScannerClient : public MediaScannerClient
+{
+public:
+    explicit RecordingScannerClient(ScannedFile* file) : mFile(file) {}
+
+    virtual status_t scanFile(const char* /* path */, long long /* lastModified */,
+            long long /* fileSize */, bool /* isDirectory */, bool /* noMedia */)
+    {
+        // Only used when walking directories.
+        return OK;
+    }
+
+    virtual status_t handleStringTag(const char* name, const char* value)
+    {
+        mFile->namesAndValues.push_back(name);
+        mFile->namesAndValues.push_back(sanitizedTagValue(value));
+        return OK;
+    }
+
+    virtual status_t setMimeType(const char* mimeType)
+    {
+        mFile->mimeType = mimeType;
+        return OK;
+    }
+
+private:
+    ScannedFile* mFile;
+};
+
+// Remembers the locale, so that the worker scanners of processFiles() can use it too.
+class JMediaScanner : public StagefrightMediaScanner
+{
+public:
+    void setLocale(const char* locale)
+    {
+        MediaScanner::setLocale(locale);
+        mLocale = locale;
+    }
+
+    const std::string& getLocale() const { return mLocale; }
+
+private:
+    std::string mLocale;
+};
+
 class MyMediaScannerClient : public MediaScannerClient
 {
 public:
@@ -115,7 +197,8 @@ public:
             mClient(env->NewGlobalRef(client)),
             mScanFileMethodID(0),
             mHandleStringTagMethodID(0),
-            mSetMimeTypeMethodID(0)
+            mSetMimeTypeMethodID(0),
+            mHandleFileMetadataMethodID(0)
     {
         ALOGV("MyMediaScannerClient constructor");
         jclass mediaScannerClientInterface =
@@ -138,6 +221,11 @@ public:
                                     mediaScannerClientInterface,
                                     "setMimeType",
                                     "(Ljava/lang/String;)V");
+
+            mHandleFileMetadataMethodID = env->GetMethodID(
+                                    mediaScannerClientInterface,
+                                    "handleFileMetadata",
+                                    "(Ljava/lang/String;Ljava/lang/String;[Ljava/lang/String;)V");
         }
     }
 
@@ -218,21 +306,60 @@ public:
         return checkAndClearExceptionFromCallback(mEnv, "setMimeType");
     }
 
+    // Hands everything a batch scan found out about a file to Java in one call.
+    status_t handleFileMetadata(jstring path, jclass stringClass, const ScannedFile& file)
+    {
+        ALOGV("handleFileMetadata: %zu tags", file.namesAndValues.size() / 2);
+        jstring mimeTypeStr = NULL;
+        if (!file.mimeType.empty() &&
+                (mimeTypeStr = mEnv->NewStringUTF(file.mimeType.c_str())) == NULL) {
+            mEnv->ExceptionClear();
+            return NO_MEMORY;
+        }
+
+        jobjectArray namesAndValues = mEnv->NewObjectArray(
+                file.namesAndValues.size(), stringClass, NULL);
+        if (namesAndValues == NULL) {
+            mEnv->DeleteLocalRef(mimeTypeStr);
+            mEnv->ExceptionClear();
+            return NO_MEMORY;
+        }
+        for (size_t i = 0; i < file.namesAndValues.size(); ++i) {
+            jstring str = mEnv->NewStringUTF(file.namesAndValues[i].c_str());
+            if (str == NULL) {
+                mEnv->DeleteLocalRef(namesAndValues);
+                mEnv->DeleteLocalRef(mimeTypeStr);
+                mEnv->ExceptionClear();
+                return NO_MEMORY;
+            }
+            mEnv->SetObjectArrayElement(namesAndValues, i, str);
+            mEnv->DeleteLocalRef(str);
+        }
+
+        mEnv->CallVoidMethod(
+            mClient, mHandleFileMetadataMethodID, path, mimeTypeStr, namesAndValues);
+
+        mEnv->DeleteLocalRef(namesAndValues);
+        mEnv->DeleteLocalRef(mimeTypeStr);
+        return checkAndClearExceptionFromCallback(mEnv, "handleFileMetadata");
+    }
+
 private:
     JNIEnv *mEnv;
     jobject mClient;
     jmethodID mScanFileMethodID;
     jmethodID mHandleStringTagMethodID;
     jmethodID mSetMimeTypeMethodID;
+    jmethodID mHandleFileMetadataMethodID;
 };
 
 
-static MediaScanner *getNativeScanner_l(JNIEnv* env, jobject thiz)
+static JMediaScanner *getNativeScanner_l(JNIEnv* env, jobject thiz)
 {
-    return (MediaScanner *) env->GetLongField(thiz, fields.context);
+    return (JMediaScanner *) env->GetLongField(thiz, fields.context);
 }
 
-static void setNativeScanner_l(JNIEnv* env, jobject thiz, MediaScanner *s)
+static void setNativeScanner_l(JNIEnv* env, jobject thiz, JMediaScanner *s)
 {
     env->SetLongField(thiz, fields.context, (jlong)s);
 }
@@ -242,7 +369,7 @@ android_media_MediaScanner_processDirectory(
         JNIEnv *env, jobject thiz, jstring path, jobject client)
 {
     ALOGV("processDirectory");
-    MediaScanner *mp = getNativeScanner_l(env, thiz);
+    JMediaScanner *mp = getNativeScanner_l(env, thiz);
     if (mp == NULL) {
         jniThrowException(env, kRunTimeException, "No scanner available");
         return;
@@ -274,7 +401,7 @@ android_media_MediaScanner_processFile(
     ALOGV("processFile");
 
     // Lock already hold by processDirectory
-    MediaScanner *mp = getNativeScanner_l(env, thiz);
+    JMediaScanner *mp = getNativeScanner_l(env, thiz);
     if (mp == NULL) {
         jniThrowException(env, kRunTimeException, "No scanner available");
         return false;
@@ -310,12 +437,139 @@ android_media_MediaScanner_processFile(
     return result != MEDIA_SCAN_RESULT_ERROR;
 }
 
+// Scans a list of files on up to kMaxScanThreads worker threads, each with a scanner of its
+// own. The results are handed to the client's handleFileMetadata() on the calling thread, one
+// call per successfully scanned file and in the order of the list, as soon as they are ready.
+static jbooleanArray
+android_media_MediaScanner_processFiles(
+        JNIEnv *env, jobject thiz, jobjectArray paths,
+        jobjectArray mimeTypes, jobject client)
+{
+    ALOGV("processFiles");
+
+    JMediaScanner *mp = getNativeScanner_l(env, thiz);
+    if (mp == NULL) {
+        jniThrowException(env, kRunTimeException, "No scanner available");
+        return NULL;
+    }
+
+    if (paths == NULL || client == NULL) {
+        jniThrowException(env, kIllegalArgumentException, NULL);
+        return NULL;
+    }
+
+    const size_t count = env->GetArrayLength(paths);
+    if (mimeTypes != NULL && (size_t)env->GetArrayLength(mimeTypes) != count) {
+        jniThrowException(env, kIllegalArgumentException, "mimeTypes length mismatch");
+        return NULL;
+    }
+
+    std::vector<std::string> pathStrs(count);
+    std::vector<std::string> mimeTypeStrs(count);
+    for (size_t i = 0; i < count; ++i) {
+        jstring path = (jstring) env->GetObjectArrayElement(paths, i);
+        if (path == NULL) {
+            jniThrowException(env, kIllegalArgumentException, NULL);
+            return NULL;
+        }
+        const char *pathStr = env->GetStringUTFChars(path, NULL);
+        if (pathStr == NULL) {  // Out of memory
+            return NULL;
+        }
+        pathStrs[i] = pathStr;
+        env->ReleaseStringUTFChars(path, pathStr);
+        env->DeleteLocalRef(path);
+
+        jstring mimeType = mimeTypes != NULL
+                ? (jstring) env->GetObjectArrayElement(mimeTypes, i) : NULL;
+        if (mimeType != NULL) {
+            const char *mimeTypeStr = env->GetStringUTFChars(mimeType, NULL);
+            if (mimeTypeStr == NULL) {  // Out of memory
+                return NULL;
+            }
+            mimeTypeStrs[i] = mimeTypeStr;
+            env->ReleaseStringUTFChars(mimeType, mimeTypeStr);
+            env->DeleteLocalRef(mimeType);
+        }
+    }
+
+    jbooleanArray results = env->NewBooleanArray(count);
+    if (results == NULL) {  // Out of memory
+        return NULL;
+    }
+    jclass stringClass = env->FindClass("java/lang/String");
+    if (stringClass == NULL) {
+        return NULL;
+    }
+
+    std::vector<ScannedFile> files(count);
+    std::mutex lock;
+    std::condition_variable scanned;
+    std::atomic<size_t> next(0);
+    const std::string locale = mp->getLocale();
+
+    std::vector<std::thread> workers;
+    const size_t numWorkers = std::min(count, kMaxScanThreads);
+    for (size_t w = 0; w < numWorkers; ++w) {
+        workers.emplace_back([&] {
+            StagefrightMediaScanner scanner;
+            if (!locale.empty()) {
+                scanner.setLocale(locale.c_str());
+            }
+            size_t i;
+            while ((i = next++) < count) {
+                ScannedFile file;
+                RecordingScannerClient recorder(&file);
+                file.result = scanner.processFile(
+                        pathStrs[i].c_str(),
+                        mimeTypeStrs[i].empty() ? NULL : mimeTypeStrs[i].c_str(),
+                        recorder);
+
+                std::lock_guard<std::mutex> guard(lock);
+                files[i] = std::move(file);
+                files[i].done = true;
+                scanned.notify_all();
+            }
+        });
+    }
+
+    MyMediaScannerClient myClient(env, client);
+    for (size_t i = 0; i < count; ++i) {
+        ScannedFile file;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            scanned.wait(guard, [&] { return files[i].done; });
+            file = std::move(files[i]);
+        }
+
+        jboolean ok = JNI_FALSE;
+        if (file.result == MEDIA_SCAN_RESULT_ERROR) {
+            ALOGE("An error occurred while scanning file '%s'.", pathStrs[i].c_str());
+        } else {
+            jstring path = env->NewStringUTF(pathStrs[i].c_str());
+            if (path == NULL) {
+                env->ExceptionClear();
+            } else {
+                ok = myClient.handleFileMetadata(path, stringClass, file) == OK;
+                env->DeleteLocalRef(path);
+            }
+        }
+        env->SetBooleanArrayRegion(results, i, 1, &ok);
+    }
+
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    env->DeleteLocalRef(stringClass);
+    return results;
+}
+
 static void
 android_media_MediaScanner_setLocale(
         JNIEnv *env, jobject thiz, jstring locale)
 {
     ALOGV("setLocale");
-    MediaScanner *mp = getNativeScanner_l(env, thiz);
+    JMediaScanner *mp = getNativeScanner_l(env, thiz);
     if (mp == NULL) {
         jniThrowException(env, kRunTimeException, "No scanner available");
         return;
@@ -339,7 +593,7 @@ android_media_MediaScanner_extractAlbumArt(
         JNIEnv *env, jobject thiz, jobject fileDescriptor)
 {
     ALOGV("extractAlbumArt");
-    MediaScanner *mp = getNativeScanner_l(env, thiz);
+    JMediaScanner *mp = getNativeScanner_l(env, thiz);
     if (mp == NULL) {
         jniThrowException(env, kRunTimeException, "No scanner available");
         return NULL;
@@ -393,7 +647,7 @@ static void
 android_media_MediaScanner_native_setup(JNIEnv *env, jobject thiz)
 {
     ALOGV("native_setup");
-    MediaScanner *mp = new StagefrightMediaScanner;
+    JMediaScanner *mp = new JMediaScanner;
 
     if (mp == NULL) {
         jniThrowException(env, kRunTimeException, "Out of memory");
@@ -407,7 +661,7 @@ static void
 android_media_MediaScanner_native_finalize(JNIEnv *env, jobject thiz)
 {
     ALOGV("native_finalize");
-    MediaScanner *mp = getNativeScanner_l(env, thiz);
+    JMediaScanner *mp = getNativeScanner_l(env, thiz);
     if (mp == 0) {
         return;
     }
@@ -428,6 +682,12 @@ static const JNINativeMethod gMethods[] = {
         (void *)android_media_MediaScanner_processFile
     },
 
+    {
+        "processFiles",
+        "([Ljava/lang/String;[Ljava/lang/String;Landroid/media/MediaScannerClient;)[Z",
+        (void *)android_media_MediaScanner_processFiles
+    },
+
     {
         "setLocale",
         "(Ljava/lang/String;)V",
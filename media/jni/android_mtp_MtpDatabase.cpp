@@ -17,8 +17,10 @@
 #define LOG_TAG "MtpDatabaseJNI"
 #include "utils/Log.h"
 #include "utils/String8.h"
+#include "utils/Timers.h"
 
 #include "android_media_Streams.h"
+#include "android_mtp_ThumbnailCache.h"
 #include "mtp.h"
 #include "IMtpDatabase.h"
 #include "MtpDataPacket.h"
@@ -44,6 +46,11 @@
 #include <stdio.h>
 #include <unistd.h>
 
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
 using namespace android;
 
 // ----------------------------------------------------------------------------
@@ -92,6 +99,37 @@ IMtpDatabase* getMtpDatabase(JNIEnv *env, jobject database) {
 
 // ----------------------------------------------------------------------------
 
+// How long cached object infos and property values are trusted. Files can change behind
+// the host's back, so this only has to cover a host walking through a folder.
+static const nsecs_t kCacheLifetimeNs = seconds_to_nanoseconds(5);
+static const size_t kMaxCachedObjectInfos = 1024;
+static const size_t kMaxCachedPropertyValues = 16384;
+static const size_t kMaxKnownParents = 65536;
+
+// One entry of an MtpPropertyList.
+struct PropertyValue {
+    int         type;
+    jlong       longValue;
+    bool        hasString;
+    std::string stringValue;
+};
+
+// The parts of an MtpObjectInfo that getObjectInfo() fills in.
+struct CachedObjectInfo {
+    nsecs_t         time;
+    MtpStorageID    storageID;
+    MtpObjectFormat format;
+    MtpObjectHandle parent;
+    uint32_t        compressedSize;
+    MtpObjectFormat thumbFormat;
+    uint32_t        thumbCompressedSize;
+    uint32_t        imagePixWidth;
+    uint32_t        imagePixHeight;
+    time_t          dateCreated;
+    time_t          dateModified;
+    std::string     name;
+};
+
 class MtpDatabase : public IMtpDatabase {
 private:
     jobject         mDatabase;
@@ -99,6 +137,27 @@ private:
     jlongArray      mLongBuffer;
     jcharArray      mStringBuffer;
 
+    // Caches, so that hosts enumerating large folders with repeated queries do not cost an
+    // upcall for each. Like the buffers above, they are only used from the MTP server thread.
+    typedef std::list<std::pair<MtpObjectHandle, CachedObjectInfo>> ObjectInfoList;
+    ObjectInfoList  mObjectInfos;   // most recently used first
+    std::unordered_map<MtpObjectHandle, ObjectInfoList::iterator> mObjectInfoIndex;
+
+    // Values of single properties, fetched for all children of a parent at once.
+    nsecs_t         mPropertyValuesTime;
+    std::unordered_map<uint64_t, PropertyValue> mPropertyValues;    // by handle and property
+    std::unordered_set<uint64_t> mFetchedBatches;                   // by parent and property
+    std::unordered_map<MtpObjectHandle, MtpObjectHandle> mParents;  // as seen in object lists
+
+    ThumbnailCache  mThumbnails;
+
+    bool            findObjectInfo(MtpObjectHandle handle, MtpObjectInfo& info);
+    void            cacheObjectInfo(MtpObjectHandle handle, const MtpObjectInfo& info);
+    bool            findPropertyValue(MtpObjectHandle handle, MtpObjectProperty property,
+                                            PropertyValue& value);
+    void            fetchPropertyBatch(MtpObjectHandle parent, MtpObjectProperty property);
+    void            invalidateObject(MtpObjectHandle handle);
+
 public:
                                     MtpDatabase(JNIEnv *env, jobject client);
     virtual                         ~MtpDatabase();
@@ -199,13 +258,109 @@ static void checkAndClearExceptionFromCallback(JNIEnv* env, const char* methodNa
     }
 }
 
+static inline uint64_t propertyKey(MtpObjectHandle handle, MtpObjectProperty property) {
+    return ((uint64_t)handle << 16) | (property & 0xFFFF);
+}
+
+// Hands the first count entries of an MtpPropertyList to add(handle, property, value).
+template <typename Add>
+static void readPropertyList(JNIEnv* env, jobject list, jint count, Add add) {
+    jintArray objectHandlesArray = (jintArray)env->CallObjectMethod(list, method_getObjectHandles);
+    jintArray propertyCodesArray = (jintArray)env->CallObjectMethod(list, method_getPropertyCodes);
+    jintArray dataTypesArray = (jintArray)env->CallObjectMethod(list, method_getDataTypes);
+    jlongArray longValuesArray = (jlongArray)env->CallObjectMethod(list, method_getLongValues);
+    jobjectArray stringValuesArray = (jobjectArray)env->CallObjectMethod(list, method_getStringValues);
+
+    jint* objectHandles = env->GetIntArrayElements(objectHandlesArray, 0);
+    jint* propertyCodes = env->GetIntArrayElements(propertyCodesArray, 0);
+    jint* dataTypes = env->GetIntArrayElements(dataTypesArray, 0);
+    jlong* longValues = (longValuesArray ? env->GetLongArrayElements(longValuesArray, 0) : NULL);
+
+    for (int i = 0; i < count; i++) {
+        PropertyValue value;
+        value.type = dataTypes[i];
+        value.longValue = (longValues ? longValues[i] : 0);
+        value.hasString = false;
+        if (value.type == MTP_TYPE_STR && stringValuesArray) {
+            jstring stringValue = (jstring)env->GetObjectArrayElement(stringValuesArray, i);
+            const char* str = (stringValue ? env->GetStringUTFChars(stringValue, NULL) : NULL);
+            if (str) {
+                value.hasString = true;
+                value.stringValue = str;
+                env->ReleaseStringUTFChars(stringValue, str);
+            }
+            env->DeleteLocalRef(stringValue);
+        }
+        add(objectHandles[i], propertyCodes[i], value);
+    }
+
+    env->ReleaseIntArrayElements(objectHandlesArray, objectHandles, 0);
+    env->ReleaseIntArrayElements(propertyCodesArray, propertyCodes, 0);
+    env->ReleaseIntArrayElements(dataTypesArray, dataTypes, 0);
+    if (longValues)
+        env->ReleaseLongArrayElements(longValuesArray, longValues, 0);
+
+    env->DeleteLocalRef(objectHandlesArray);
+    env->DeleteLocalRef(propertyCodesArray);
+    env->DeleteLocalRef(dataTypesArray);
+    env->DeleteLocalRef(longValuesArray);
+    env->DeleteLocalRef(stringValuesArray);
+}
+
+static MtpResponseCode putPropertyValue(const PropertyValue& value, MtpDataPacket& packet) {
+    switch (value.type) {
+        case MTP_TYPE_INT8:
+            packet.putInt8(value.longValue);
+            break;
+        case MTP_TYPE_UINT8:
+            packet.putUInt8(value.longValue);
+            break;
+        case MTP_TYPE_INT16:
+            packet.putInt16(value.longValue);
+            break;
+        case MTP_TYPE_UINT16:
+            packet.putUInt16(value.longValue);
+            break;
+        case MTP_TYPE_INT32:
+            packet.putInt32(value.longValue);
+            break;
+        case MTP_TYPE_UINT32:
+            packet.putUInt32(value.longValue);
+            break;
+        case MTP_TYPE_INT64:
+            packet.putInt64(value.longValue);
+            break;
+        case MTP_TYPE_UINT64:
+            packet.putUInt64(value.longValue);
+            break;
+        case MTP_TYPE_INT128:
+            packet.putInt128(value.longValue);
+            break;
+        case MTP_TYPE_UINT128:
+            packet.putUInt128(value.longValue);
+            break;
+        case MTP_TYPE_STR:
+            if (value.hasString) {
+                packet.putString(value.stringValue.c_str());
+            } else {
+                packet.putEmptyString();
+            }
+            break;
+        default:
+            ALOGE("unsupported type in getObjectPropertyValue\n");
+            return MTP_RESPONSE_INVALID_OBJECT_PROP_FORMAT;
+    }
+    return MTP_RESPONSE_OK;
+}
+
 // ----------------------------------------------------------------------------
 
 MtpDatabase::MtpDatabase(JNIEnv *env, jobject client)
     :   mDatabase(env->NewGlobalRef(client)),
         mIntBuffer(NULL),
         mLongBuffer(NULL),
-        mStringBuffer(NULL)
+        mStringBuffer(NULL),
+        mPropertyValuesTime(0)
 {
     // create buffers for out arguments
     // we don't need to be thread-safe so this is OK
@@ -255,6 +410,7 @@ MtpObjectHandle MtpDatabase::beginSendObject(const char* path,
 void MtpDatabase::endSendObject(MtpObjectHandle handle, bool succeeded) {
     JNIEnv* env = AndroidRuntime::getJNIEnv();
     env->CallVoidMethod(mDatabase, method_endSendObject, (jint)handle, (jboolean)succeeded);
+    invalidateObject(handle);
 
     checkAndClearExceptionFromCallback(env, __FUNCTION__);
 }
@@ -265,6 +421,7 @@ void MtpDatabase::rescanFile(const char* path, MtpObjectHandle handle,
     jstring pathStr = env->NewStringUTF(path);
     env->CallVoidMethod(mDatabase, method_rescanFile, pathStr,
                         (jint)handle, (jint)format);
+    invalidateObject(handle);
 
     if (pathStr)
         env->DeleteLocalRef(pathStr);
@@ -282,8 +439,15 @@ MtpObjectHandleList* MtpDatabase::getObjectList(MtpStorageID storageID,
     MtpObjectHandleList* list = new MtpObjectHandleList();
     jint* handles = env->GetIntArrayElements(array, 0);
     jsize length = env->GetArrayLength(array);
-    for (int i = 0; i < length; i++)
+    // A parent of 0 lists the objects of all folders, 0xFFFFFFFF those at the root.
+    MtpObjectHandle listedParent = (parent == 0xFFFFFFFF ? 0 : parent);
+    if (parent != 0 && mParents.size() + length > kMaxKnownParents)
+        mParents.clear();
+    for (int i = 0; i < length; i++) {
         list->push_back(handles[i]);
+        if (parent != 0)
+            mParents[handles[i]] = listedParent;
+    }
     env->ReleaseIntArrayElements(array, handles, 0);
     env->DeleteLocalRef(array);
 
@@ -381,6 +545,11 @@ MtpResponseCode MtpDatabase::getObjectPropertyValue(MtpObjectHandle handle,
                   "Casting MtpObjectHandle to jint loses a value");
     static_assert(sizeof(jint) >= sizeof(MtpObjectProperty),
                   "Casting MtpObjectProperty to jint loses a value");
+    PropertyValue value;
+    if (findPropertyValue(handle, property, value)) {
+        return putPropertyValue(value, packet);
+    }
+
     JNIEnv* env = AndroidRuntime::getJNIEnv();
     jobject list = env->CallObjectMethod(
             mDatabase,
@@ -396,83 +565,150 @@ MtpResponseCode MtpDatabase::getObjectPropertyValue(MtpObjectHandle handle,
         result = MTP_RESPONSE_GENERAL_ERROR;
 
     if (result == MTP_RESPONSE_OK) {
-        jintArray objectHandlesArray = (jintArray)env->CallObjectMethod(list, method_getObjectHandles);
-        jintArray propertyCodesArray = (jintArray)env->CallObjectMethod(list, method_getPropertyCodes);
-        jintArray dataTypesArray = (jintArray)env->CallObjectMethod(list, method_getDataTypes);
-        jlongArray longValuesArray = (jlongArray)env->CallObjectMethod(list, method_getLongValues);
-        jobjectArray stringValuesArray = (jobjectArray)env->CallObjectMethod(list, method_getStringValues);
+        readPropertyList(env, list, 1,
+                [&value](MtpObjectHandle, MtpObjectProperty, const PropertyValue& v) {
+                    value = v;
+                });
+        result = putPropertyValue(value, packet);
+    }
 
-        jint* objectHandles = env->GetIntArrayElements(objectHandlesArray, 0);
-        jint* propertyCodes = env->GetIntArrayElements(propertyCodesArray, 0);
-        jint* dataTypes = env->GetIntArrayElements(dataTypesArray, 0);
-        jlong* longValues = env->GetLongArrayElements(longValuesArray, 0);
+    env->DeleteLocalRef(list);
+    checkAndClearExceptionFromCallback(env, __FUNCTION__);
+    return result;
+}
 
-        int type = dataTypes[0];
-        jlong longValue = (longValues ? longValues[0] : 0);
+bool MtpDatabase::findPropertyValue(MtpObjectHandle handle, MtpObjectProperty property,
+                                    PropertyValue& value) {
+    if (systemTime() - mPropertyValuesTime > kCacheLifetimeNs) {
+        mPropertyValues.clear();
+        mFetchedBatches.clear();
+    }
 
-        switch (type) {
-            case MTP_TYPE_INT8:
-                packet.putInt8(longValue);
-                break;
-            case MTP_TYPE_UINT8:
-                packet.putUInt8(longValue);
-                break;
-            case MTP_TYPE_INT16:
-                packet.putInt16(longValue);
-                break;
-            case MTP_TYPE_UINT16:
-                packet.putUInt16(longValue);
-                break;
-            case MTP_TYPE_INT32:
-                packet.putInt32(longValue);
-                break;
-            case MTP_TYPE_UINT32:
-                packet.putUInt32(longValue);
-                break;
-            case MTP_TYPE_INT64:
-                packet.putInt64(longValue);
-                break;
-            case MTP_TYPE_UINT64:
-                packet.putUInt64(longValue);
-                break;
-            case MTP_TYPE_INT128:
-                packet.putInt128(longValue);
-                break;
-            case MTP_TYPE_UINT128:
-                packet.putUInt128(longValue);
-                break;
-            case MTP_TYPE_STR:
-            {
-                jstring stringValue = (jstring)env->GetObjectArrayElement(stringValuesArray, 0);
-                const char* str = (stringValue ? env->GetStringUTFChars(stringValue, NULL) : NULL);
-                if (stringValue) {
-                    packet.putString(str);
-                    env->ReleaseStringUTFChars(stringValue, str);
-                } else {
-                    packet.putEmptyString();
-                }
-                env->DeleteLocalRef(stringValue);
-                break;
-             }
-            default:
-                ALOGE("unsupported type in getObjectPropertyValue\n");
-                result = MTP_RESPONSE_INVALID_OBJECT_PROP_FORMAT;
+    auto it = mPropertyValues.find(propertyKey(handle, property));
+    if (it == mPropertyValues.end()) {
+        // Hosts tend to ask for the same property of every object in a folder, so fetch it
+        // for all of the object's siblings with one upcall.
+        auto parent = mParents.find(handle);
+        if (parent == mParents.end() ||
+                !mFetchedBatches.insert(propertyKey(parent->second, property)).second) {
+            return false;
         }
-        env->ReleaseIntArrayElements(objectHandlesArray, objectHandles, 0);
-        env->ReleaseIntArrayElements(propertyCodesArray, propertyCodes, 0);
-        env->ReleaseIntArrayElements(dataTypesArray, dataTypes, 0);
-        env->ReleaseLongArrayElements(longValuesArray, longValues, 0);
+        fetchPropertyBatch(parent->second, property);
+        it = mPropertyValues.find(propertyKey(handle, property));
+        if (it == mPropertyValues.end()) {
+            return false;
+        }
+    }
+    value = it->second;
+    return true;
+}
 
-        env->DeleteLocalRef(objectHandlesArray);
-        env->DeleteLocalRef(propertyCodesArray);
-        env->DeleteLocalRef(dataTypesArray);
-        env->DeleteLocalRef(longValuesArray);
-        env->DeleteLocalRef(stringValuesArray);
+void MtpDatabase::fetchPropertyBatch(MtpObjectHandle parent, MtpObjectProperty property) {
+    JNIEnv* env = AndroidRuntime::getJNIEnv();
+    // Depth 1 asks for the children of the parent, or those of the root for a parent of 0.
+    jobject list = env->CallObjectMethod(
+            mDatabase,
+            method_getObjectPropertyList,
+            static_cast<jint>(parent),
+            0,
+            static_cast<jint>(property),
+            0,
+            1);
+    checkAndClearExceptionFromCallback(env, __FUNCTION__);
+    if (!list)
+        return;
+
+    MtpResponseCode result = env->CallIntMethod(list, method_getCode);
+    jint count = env->CallIntMethod(list, method_getCount);
+    if (result == MTP_RESPONSE_OK && count > 0) {
+        if (mPropertyValues.size() + count > kMaxCachedPropertyValues) {
+            mPropertyValues.clear();
+        }
+        if (mPropertyValues.empty()) {
+            mPropertyValuesTime = systemTime();
+        }
+        readPropertyList(env, list, count,
+                [this](MtpObjectHandle handle, MtpObjectProperty property,
+                        const PropertyValue& value) {
+                    mPropertyValues[propertyKey(handle, property)] = value;
+                });
     }
 
     env->DeleteLocalRef(list);
     checkAndClearExceptionFromCallback(env, __FUNCTION__);
-    return result;
+}
+
+bool MtpDatabase::findObjectInfo(MtpObjectHandle handle, MtpObjectInfo& info) {
+    auto index = mObjectInfoIndex.find(handle);
+    if (index == mObjectInfoIndex.end()) {
+        return false;
+    }
+    const CachedObjectInfo& cached = index->second->second;
+    if (systemTime() - cached.time > kCacheLifetimeNs) {
+        mObjectInfos.erase(index->second);
+        mObjectInfoIndex.erase(index);
+        return false;
+    }
+
+    info.mStorageID = cached.storageID;
+    info.mFormat = cached.format;
+    info.mParent = cached.parent;
+    info.mCompressedSize = cached.compressedSize;
+    info.mThumbFormat = cached.thumbFormat;
+    info.mThumbCompressedSize = cached.thumbCompressedSize;
+    info.mImagePixWidth = cached.imagePixWidth;
+    info.mImagePixHeight = cached.imagePixHeight;
+    info.mDateCreated = cached.dateCreated;
+    info.mDateModified = cached.dateModified;
+    info.mAssociationType = MTP_ASSOCIATION_TYPE_UNDEFINED;
+    info.mName = strdup(cached.name.c_str());
+
+    mObjectInfos.splice(mObjectInfos.begin(), mObjectInfos, index->second);
+    return true;
+}
+
+void MtpDatabase::cacheObjectInfo(MtpObjectHandle handle, const MtpObjectInfo& info) {
+    CachedObjectInfo cached;
+    cached.time = systemTime();
+    cached.storageID = info.mStorageID;
+    cached.format = info.mFormat;
+    cached.parent = info.mParent;
+    cached.compressedSize = info.mCompressedSize;
+    cached.thumbFormat = info.mThumbFormat;
+    cached.thumbCompressedSize = info.mThumbCompressedSize;
+    cached.imagePixWidth = info.mImagePixWidth;
+    cached.imagePixHeight = info.mImagePixHeight;
+    cached.dateCreated = info.mDateCreated;
+    cached.dateModified = info.mDateModified;
+    cached.name = (info.mName ? info.mName : "");
+
+    auto index = mObjectInfoIndex.find(handle);
+    if (index != mObjectInfoIndex.end()) {
+        mObjectInfos.erase(index->second);
+    }
+    mObjectInfos.emplace_front(handle, std::move(cached));
+    mObjectInfoIndex[handle] = mObjectInfos.begin();
+    if (mObjectInfos.size() > kMaxCachedObjectInfos) {
+        mObjectInfoIndex.erase(mObjectInfos.back().first);
+        mObjectInfos.pop_back();
+    }
+
+    if (mParents.size() < kMaxKnownParents) {
+        mParents[handle] = info.mParent;
+    }
+}
+
+void MtpDatabase::invalidateObject(MtpObjectHandle handle) {
+    auto index = mObjectInfoIndex.find(handle);
+    if (index != mObjectInfoIndex.end()) {
+        mObjectInfos.erase(index->second);
+        mObjectInfoIndex.erase(index);
+    }
+    mThumbnails.invalidate(handle);
+    // The object may have moved, and other values of its batches may be stale as well.
+    mParents.erase(handle);
+    mPropertyValues.clear();
+    mFetchedBatches.clear();
 }
 
 static bool readLongValue(int type, MtpDataPacket& packet, jlong& longValue) {
@@ -555,6 +791,7 @@ MtpResponseCode MtpDatabase::setObjectPropertyValue(MtpObjectHandle handle,
 
     result = env->CallIntMethod(mDatabase, method_setObjectProperty,
                 (jint)handle, (jint)property, longValue, stringValue);
+    invalidateObject(handle);
     if (stringValue)
         env->DeleteLocalRef(stringValue);
 
@@ -781,6 +1018,10 @@ MtpResponseCode MtpDatabase::getObjectInfo(MtpObjectHandle handle,
     int64_t         length;
     MtpObjectFormat format;
 
+    if (findObjectInfo(handle, info)) {
+        return MTP_RESPONSE_OK;
+    }
+
     MtpResponseCode result = getObjectFilePath(handle, path, length, format);
     if (result != MTP_RESPONSE_OK) {
         return result;
@@ -838,6 +1079,11 @@ MtpResponseCode MtpDatabase::getObjectInfo(MtpObjectHandle handle,
                     info.mImagePixHeight = h;
                 }
                 env->ReleaseLongArrayElements(mLongBuffer, longValues, 0);
+
+                // The host is likely to ask for it next.
+                if (info.mThumbCompressedSize > 0 && info.mFormat != MTP_FORMAT_HEIF) {
+                    mThumbnails.prefetch(handle, path);
+                }
             }
             break;
         }
@@ -867,6 +1113,7 @@ MtpResponseCode MtpDatabase::getObjectInfo(MtpObjectHandle handle,
     }
 
     checkAndClearExceptionFromCallback(env, __FUNCTION__);
+    cacheObjectInfo(handle, info);
     return MTP_RESPONSE_OK;
 }
 
@@ -882,6 +1129,13 @@ void* MtpDatabase::getThumbnail(MtpObjectHandle handle, size_t& outThumbSize) {
             case MTP_FORMAT_EXIF_JPEG:
             case MTP_FORMAT_HEIF:
             case MTP_FORMAT_JFIF: {
+                if (format != MTP_FORMAT_HEIF) {
+                    result = mThumbnails.getThumbnail(handle, path, outThumbSize);
+                    if (result) {
+                        break;
+                    }
+                }
+
                 JNIEnv* env = AndroidRuntime::getJNIEnv();
                 jbyteArray thumbData = (jbyteArray) env->CallObjectMethod(
                         mDatabase, method_getThumbnailData, (jint)handle);
@@ -965,6 +1219,7 @@ MtpResponseCode MtpDatabase::getObjectFilePath(MtpObjectHandle handle,
 
 MtpResponseCode MtpDatabase::beginDeleteObject(MtpObjectHandle handle) {
     JNIEnv* env = AndroidRuntime::getJNIEnv();
+    invalidateObject(handle);
     MtpResponseCode result = env->CallIntMethod(mDatabase, method_beginDeleteObject, (jint)handle);
 
     checkAndClearExceptionFromCallback(env, __FUNCTION__);
@@ -995,6 +1250,7 @@ void MtpDatabase::endMoveObject(MtpObjectHandle oldParent, MtpObjectHandle newPa
     env->CallVoidMethod(mDatabase, method_endMoveObject,
                 (jint)oldParent, (jint) newParent, (jint) oldStorage, (jint) newStorage,
                 (jint) handle, (jboolean) succeeded);
+    invalidateObject(handle);
 
     checkAndClearExceptionFromCallback(env, __FUNCTION__);
 }
@@ -0,0 +1,317 @@
+/*
+ * Copyright 2019, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// #define LOG_NDEBUG 0
+#define LOG_TAG "MtpThumbnailCache"
+
+#include <utils/Log.h>
+#include "android_mtp_ThumbnailCache.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace android {
+
+static const size_t kMaxCachedBytes = 8 * 1024 * 1024;
+static const size_t kMaxCachedEntries = 4096;
+static const size_t kMaxPrefetchQueue = 512;
+static const size_t kNumPrefetchThreads = 2;
+
+// The EXIF data is expected among the first few segments, well ahead of the image data.
+static const int kMaxJpegSegments = 16;
+
+static const uint8_t kJpegMarkerSOI = 0xD8;
+static const uint8_t kJpegMarkerEOI = 0xD9;
+static const uint8_t kJpegMarkerSOS = 0xDA;
+static const uint8_t kJpegMarkerAPP1 = 0xE1;
+
+static const uint16_t kTiffTagJpegInterchangeFormat = 0x0201;
+static const uint16_t kTiffTagJpegInterchangeFormatLength = 0x0202;
+static const uint16_t kTiffTypeShort = 3;
+static const size_t kTiffEntrySize = 12;
+
+static inline uint16_t readUInt16(const uint8_t* p, bool bigEndian) {
+    return bigEndian ? (p[0] << 8) | p[1] : (p[1] << 8) | p[0];
+}
+
+static inline uint32_t readUInt32(const uint8_t* p, bool bigEndian) {
+    return bigEndian
+            ? ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]
+            : ((uint32_t)p[3] << 24) | (p[2] << 16) | (p[1] << 8) | p[0];
+}
+
+// Finds the thumbnail that IFD1 of the TIFF structure of EXIF data points to.
+static bool findTiffThumbnail(const uint8_t* tiff, size_t size,
+        size_t* outOffset, size_t* outLength) {
+    if (size < 8) {
+        return false;
+    }
+    bool bigEndian;
+    if (tiff[0] == 'M' && tiff[1] == 'M') {
+        bigEndian = true;
+    } else if (tiff[0] == 'I' && tiff[1] == 'I') {
+        bigEndian = false;
+    } else {
+        return false;
+    }
+    if (readUInt16(tiff + 2, bigEndian) != 42) {
+        return false;
+    }
+
+    // IFD1 is linked from the end of IFD0.
+    size_t ifd0 = readUInt32(tiff + 4, bigEndian);
+    if (ifd0 > size - 2) {
+        return false;
+    }
+    size_t next = ifd0 + 2 + readUInt16(tiff + ifd0, bigEndian) * kTiffEntrySize;
+    if (next > size - 4) {
+        return false;
+    }
+    size_t ifd1 = readUInt32(tiff + next, bigEndian);
+    if (ifd1 == 0 || ifd1 > size - 2) {
+        return false;
+    }
+    size_t count = readUInt16(tiff + ifd1, bigEndian);
+    if (count * kTiffEntrySize > size - ifd1 - 2) {
+        return false;
+    }
+
+    size_t offset = 0, length = 0;
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t* entry = tiff + ifd1 + 2 + i * kTiffEntrySize;
+        uint16_t tag = readUInt16(entry, bigEndian);
+        uint32_t value = readUInt16(entry + 2, bigEndian) == kTiffTypeShort
+                ? readUInt16(entry + 8, bigEndian) : readUInt32(entry + 8, bigEndian);
+        if (tag == kTiffTagJpegInterchangeFormat) {
+            offset = value;
+        } else if (tag == kTiffTagJpegInterchangeFormatLength) {
+            length = value;
+        }
+    }
+
+    if (offset == 0 || length < 2 || offset > size || length > size - offset) {
+        return false;
+    }
+    // Only hand out JPEG thumbnails, as ExifInterface does.
+    if (tiff[offset] != 0xFF || tiff[offset + 1] != kJpegMarkerSOI) {
+        return false;
+    }
+    *outOffset = offset;
+    *outLength = length;
+    return true;
+}
+
+bool ThumbnailCache::readExifThumbnail(int fd, std::vector<uint8_t>* outData) {
+    uint8_t header[4];
+    if (pread64(fd, header, 2, 0) != 2 || header[0] != 0xFF || header[1] != kJpegMarkerSOI) {
+        return false;
+    }
+
+    off64_t position = 2;
+    for (int i = 0; i < kMaxJpegSegments; i++) {
+        if (pread64(fd, header, sizeof(header), position) != sizeof(header)
+                || header[0] != 0xFF) {
+            return false;
+        }
+        uint8_t marker = header[1];
+        // The length counts itself but not the marker.
+        size_t length = (header[2] << 8) | header[3];
+        if (marker == kJpegMarkerSOS || marker == kJpegMarkerEOI || length < 2) {
+            return false;
+        }
+
+        if (marker == kJpegMarkerAPP1 && length - 2 > 6) {
+            std::vector<uint8_t> segment(length - 2);
+            if (pread64(fd, segment.data(), segment.size(), position + 4)
+                    != (ssize_t)segment.size()) {
+                return false;
+            }
+            if (!memcmp(segment.data(), "Exif\0\0", 6)) {
+                size_t offset, thumbLength;
+                if (!findTiffThumbnail(segment.data() + 6, segment.size() - 6,
+                        &offset, &thumbLength)) {
+                    return false;
+                }
+                const uint8_t* thumb = segment.data() + 6 + offset;
+                outData->assign(thumb, thumb + thumbLength);
+                return true;
+            }
+        }
+        position += 2 + length;
+    }
+    return false;
+}
+
+static void* copyThumbnail(const std::vector<uint8_t>& data, size_t& outThumbSize) {
+    if (data.empty()) {
+        return NULL;
+    }
+    void* result = malloc(data.size());
+    if (result) {
+        memcpy(result, data.data(), data.size());
+        outThumbSize = data.size();
+    }
+    return result;
+}
+
+ThumbnailCache::ThumbnailCache()
+    : mCachedBytes(0),
+      mQuit(false) {
+}
+
+ThumbnailCache::~ThumbnailCache() {
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+        mQuit = true;
+    }
+    mPrefetchCondition.notify_all();
+    for (std::thread& worker : mWorkers) {
+        worker.join();
+    }
+}
+
+void* ThumbnailCache::getThumbnail(MtpObjectHandle handle, const char* path,
+        size_t& outThumbSize) {
+    outThumbSize = 0;
+    struct stat64 st;
+    if (stat64(path, &st) != 0) {
+        return NULL;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+        auto it = find_l(handle, st.st_mtime, st.st_size);
+        if (it != mEntries.end()) {
+            return copyThumbnail(it->data, outThumbSize);
+        }
+    }
+
+    Entry entry;
+    entry.handle = handle;
+    if (!readEntry(path, &entry)) {
+        return NULL;
+    }
+    void* result = copyThumbnail(entry.data, outThumbSize);
+
+    std::lock_guard<std::mutex> guard(mLock);
+    insert_l(std::move(entry));
+    return result;
+}
+
+void ThumbnailCache::prefetch(MtpObjectHandle handle, const char* path) {
+    std::lock_guard<std::mutex> guard(mLock);
+    if (mIndex.count(handle) || mPrefetchQueue.size() >= kMaxPrefetchQueue) {
+        return;
+    }
+    mPrefetchQueue.emplace_back(handle, path);
+    if (mWorkers.empty()) {
+        for (size_t i = 0; i < kNumPrefetchThreads; i++) {
+            mWorkers.emplace_back(&ThumbnailCache::threadLoop, this);
+        }
+    }
+    mPrefetchCondition.notify_one();
+}
+
+void ThumbnailCache::invalidate(MtpObjectHandle handle) {
+    std::lock_guard<std::mutex> guard(mLock);
+    remove_l(handle);
+}
+
+bool ThumbnailCache::readEntry(const char* path, Entry* entry) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat64 st;
+    if (fstat64(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    entry->modified = st.st_mtime;
+    entry->fileSize = st.st_size;
+    if (!readExifThumbnail(fd, &entry->data)) {
+        ALOGV("no EXIF thumbnail in %s", path);
+        entry->data.clear();
+    }
+    close(fd);
+    return true;
+}
+
+ThumbnailCache::EntryList::iterator ThumbnailCache::find_l(MtpObjectHandle handle,
+        time_t modified, off64_t fileSize) {
+    auto index = mIndex.find(handle);
+    if (index == mIndex.end()) {
+        return mEntries.end();
+    }
+    EntryList::iterator it = index->second;
+    if (it->modified != modified || it->fileSize != fileSize) {
+        remove_l(handle);
+        return mEntries.end();
+    }
+    mEntries.splice(mEntries.begin(), mEntries, it);
+    return it;
+}
+
+void ThumbnailCache::insert_l(Entry&& entry) {
+    remove_l(entry.handle);
+    mCachedBytes += entry.data.size();
+    mEntries.push_front(std::move(entry));
+    mIndex[mEntries.front().handle] = mEntries.begin();
+
+    while (mCachedBytes > kMaxCachedBytes || mEntries.size() > kMaxCachedEntries) {
+        remove_l(mEntries.back().handle);
+    }
+}
+
+void ThumbnailCache::remove_l(MtpObjectHandle handle) {
+    auto index = mIndex.find(handle);
+    if (index == mIndex.end()) {
+        return;
+    }
+    mCachedBytes -= index->second->data.size();
+    mEntries.erase(index->second);
+    mIndex.erase(index);
+}
+
+void ThumbnailCache::threadLoop() {
+    std::unique_lock<std::mutex> lock(mLock);
+    while (true) {
+        mPrefetchCondition.wait(lock, [this] { return mQuit || !mPrefetchQueue.empty(); });
+        if (mQuit) {
+            return;
+        }
+        std::pair<MtpObjectHandle, std::string> request = std::move(mPrefetchQueue.front());
+        mPrefetchQueue.pop_front();
+        if (mIndex.count(request.first)) {
+            continue;
+        }
+
+        lock.unlock();
+        Entry entry;
+        entry.handle = request.first;
+        bool read = readEntry(request.second.c_str(), &entry);
+        lock.lock();
+
+        if (read) {
+            insert_l(std::move(entry));
+        }
+    }
+}
+
+};  // namespace android
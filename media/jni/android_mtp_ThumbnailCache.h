@@ -0,0 +1,88 @@
+/*
+ * Copyright 2019, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _ANDROID_MTP_THUMBNAILCACHE_H_
+#define _ANDROID_MTP_THUMBNAILCACHE_H_
+
+#include "MtpTypes.h"
+
+#include <sys/types.h>
+
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace android {
+
+// The EXIF thumbnails of JPEG files, read straight from the byte range that holds them
+// rather than through ExifInterface, and kept in a cache bounded by size. Hosts tend to ask
+// for the object infos of a whole folder before its thumbnails, so the thumbnails of listed
+// objects can be read ahead on worker threads.
+class ThumbnailCache {
+public:
+    ThumbnailCache();
+    ~ThumbnailCache();
+
+    // Returns a malloc'd copy of the EXIF thumbnail of the JPEG file at path, or NULL if it
+    // has none.
+    void* getThumbnail(MtpObjectHandle handle, const char* path, size_t& outThumbSize);
+
+    // Reads the thumbnail of the JPEG file at path into the cache on a worker thread.
+    void prefetch(MtpObjectHandle handle, const char* path);
+
+    void invalidate(MtpObjectHandle handle);
+
+    // Reads the EXIF thumbnail of the JPEG file open as fd from the APP1 segment that holds
+    // it, without decoding anything. Returns false if there is none.
+    static bool readExifThumbnail(int fd, std::vector<uint8_t>* outData);
+
+private:
+    struct Entry {
+        MtpObjectHandle handle;
+        time_t modified;
+        off64_t fileSize;
+        std::vector<uint8_t> data;  // empty if the file has no EXIF thumbnail
+    };
+
+    typedef std::list<Entry> EntryList;
+
+    std::mutex mLock;
+    EntryList mEntries;     // most recently used first
+    std::unordered_map<MtpObjectHandle, EntryList::iterator> mIndex;
+    size_t mCachedBytes;
+
+    std::condition_variable mPrefetchCondition;
+    std::deque<std::pair<MtpObjectHandle, std::string>> mPrefetchQueue;
+    std::vector<std::thread> mWorkers;
+    bool mQuit;
+
+    // Reads the file's EXIF thumbnail into entry. Returns false if the file can't be read.
+    static bool readEntry(const char* path, Entry* entry);
+
+    EntryList::iterator find_l(MtpObjectHandle handle, time_t modified, off64_t fileSize);
+    void insert_l(Entry&& entry);
+    void remove_l(MtpObjectHandle handle);
+    void threadLoop();
+};
+
+};  // namespace android
+
+#endif  // _ANDROID_MTP_THUMBNAILCACHE_H_
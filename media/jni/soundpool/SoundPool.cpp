@@ -67,6 +67,11 @@ SoundPool::SoundPool(int maxChannels, const audio_attributes_t* pAttributes)
     mCallback = 0;
     mUserData = 0;
 
+    memset(&mStats, 0, sizeof(mStats));
+    mPendingLoads = 0;
+    mLoadSetSize = 0;
+    mLoadSetStartTime = 0;
+
     mChannelPool = new SoundChannel[mMaxChannels];
     for (int i = 0; i < mMaxChannels; ++i) {
         mChannelPool[i].init(this);
@@ -88,6 +93,7 @@ SoundPool::~SoundPool()
     mChannels.clear();
     if (mChannelPool)
         delete [] mChannelPool;
+    mTrackPool.clear();
     // clean up samples
     ALOGV("clear samples");
     mSamples.clear();
@@ -151,8 +157,7 @@ int SoundPool::run()
             mRestart.erase(iter);
             mRestartLock.unlock();
             if (channel != 0) {
-                Mutex::Autolock lock(&mLock);
-                channel->nextEvent();
+                restart(channel);
             }
             mRestartLock.lock();
             if (mQuit) break;
@@ -167,6 +172,20 @@ int SoundPool::run()
     return 0;
 }
 
+// start the event queued on a stolen channel; the new AudioTrack is created outside mLock
+// unless the channel was taken again in the meantime
+void SoundPool::restart(SoundChannel* channel)
+{
+    {
+        Mutex::Autolock lock(&mLock);
+        if (!channel->reserve()) {
+            channel->nextEvent();
+            return;
+        }
+    }
+    channel->nextEvent();
+}
+
 void SoundPool::quit()
 {
     mRestartLock.lock();
@@ -228,20 +247,59 @@ int SoundPool::load(int fd, int64_t offset, int64_t length, int priority __unuse
         mSamples.add(sampleID, sample);
         sample->startLoad();
     }
+    {
+        Mutex::Autolock lock(&mStatsLock);
+        if (mPendingLoads++ == 0) {
+            mLoadSetSize = 0;
+            mLoadSetStartTime = systemTime();
+        }
+        mLoadSetSize++;
+    }
     // mDecodeThread->loadSample() must be called outside of mLock.
     // mDecodeThread->loadSample() may block on mDecodeThread message queue space;
     // the message queue emptying may block on SoundPool::findSample().
     //
-    // It theoretically possible that sample loads might decode out-of-order.
+    // Samples decode in parallel on the decode threads, so they may complete out-of-order.
     mDecodeThread->loadSample(sampleID);
     return sampleID;
 }
 
+void SoundPool::sampleLoaded(int sampleID, status_t status)
+{
+    {
+        Mutex::Autolock lock(&mStatsLock);
+        if (status == NO_ERROR) {
+            mStats.samplesLoaded++;
+        } else {
+            mStats.samplesFailed++;
+        }
+        if (mPendingLoads > 0 && --mPendingLoads == 0) {
+            mStats.lastLoadSetSize = mLoadSetSize;
+            mStats.lastLoadSetTimeNs = systemTime() - mLoadSetStartTime;
+            ALOGV("loaded %d samples in %" PRId64 " ns", mLoadSetSize,
+                    mStats.lastLoadSetTimeNs);
+        }
+    }
+    notify(SoundPoolEvent(SoundPoolEvent::SAMPLE_LOADED, sampleID, status));
+}
+
+void SoundPool::getStats(SoundPoolStats* stats)
+{
+    Mutex::Autolock lock(&mStatsLock);
+    *stats = mStats;
+}
+
 bool SoundPool::unload(int sampleID)
 {
     ALOGV("unload: sampleID=%d", sampleID);
-    Mutex::Autolock lock(&mLock);
-    return mSamples.removeItem(sampleID) >= 0; // removeItem() returns index or BAD_VALUE
+    bool removed;
+    {
+        Mutex::Autolock lock(&mLock);
+        removed = mSamples.removeItem(sampleID) >= 0; // removeItem() returns index or BAD_VALUE
+    }
+    // pooled tracks of the sample hold on to its memory
+    purgeTracks(sampleID);
+    return removed;
 }
 
 int SoundPool::play(int sampleID, float leftVolume, float rightVolume,
@@ -251,34 +309,56 @@ int SoundPool::play(int sampleID, float leftVolume, float rightVolume,
             sampleID, leftVolume, rightVolume, priority, loop, rate);
     SoundChannel* channel;
     int channelID;
+    sp<Sample> sample;
+    const nsecs_t startTime = systemTime();
 
-    Mutex::Autolock lock(&mLock);
+    { // scope for the lock
+        Mutex::Autolock lock(&mLock);
 
-    if (mQuit) {
-        return 0;
-    }
-    // is sample ready?
-    sp<Sample> sample(findSample_l(sampleID));
-    if ((sample == 0) || (sample->state() != Sample::READY)) {
-        ALOGW("  sample %d not READY", sampleID);
-        return 0;
-    }
+        if (mQuit) {
+            return 0;
+        }
+        // is sample ready?
+        sample = findSample_l(sampleID);
+        if ((sample == 0) || (sample->state() != Sample::READY)) {
+            ALOGW("  sample %d not READY", sampleID);
+            return 0;
+        }
 
-    dump();
+        dump();
 
-    // allocate a channel
-    channel = allocateChannel_l(priority, sampleID);
+        // allocate a channel
+        channel = allocateChannel_l(priority, sampleID);
 
-    // no channel allocated - return 0
-    if (!channel) {
-        ALOGV("No channel allocated");
-        return 0;
+        // no channel allocated - return 0
+        if (!channel) {
+            ALOGV("No channel allocated");
+            return 0;
+        }
+
+        channelID = ++mNextChannelID;
+
+        ALOGV("play channel %p state = %d", channel, channel->state());
+        // A busy channel is stolen: the event is queued and the channel stopped, which needs
+        // mLock. An idle one is reserved, and its AudioTrack is started without mLock so that
+        // other calls aren't blocked behind AudioTrack creation.
+        if (!channel->reserve()) {
+            channel->play(sample, channelID, leftVolume, rightVolume, priority, loop, rate);
+            channel = NULL;
+        }
     }
 
-    channelID = ++mNextChannelID;
+    if (channel) {
+        channel->play(sample, channelID, leftVolume, rightVolume, priority, loop, rate);
+    }
 
-    ALOGV("play channel %p state = %d", channel, channel->state());
-    channel->play(sample, channelID, leftVolume, rightVolume, priority, loop, rate);
+    const nsecs_t playTime = systemTime() - startTime;
+    Mutex::Autolock lock(&mStatsLock);
+    mStats.playCount++;
+    mStats.playTotalTimeNs += playTime;
+    if (playTime > mStats.playMaxTimeNs) {
+        mStats.playMaxTimeNs = playTime;
+    }
     return channelID;
 }
 
@@ -299,13 +379,18 @@ SoundChannel* SoundPool::allocateChannel_l(int priority, int sampleID)
         }
     }
 
-    // allocate any channel
-    if (!channel && !mChannels.empty()) {
-        iter = mChannels.begin();
-        if (priority >= (*iter)->priority()) {
-            channel = *iter;
-            mChannels.erase(iter);
-            ALOGV("Allocated active channel");
+    // allocate the lowest priority channel, skipping channels still being started
+    if (!channel) {
+        for (iter = mChannels.begin(); iter != mChannels.end(); ++iter) {
+            if ((*iter)->state() == SoundChannel::STARTING) {
+                continue;
+            }
+            if (priority >= (*iter)->priority()) {
+                channel = *iter;
+                mChannels.erase(iter);
+                ALOGV("Allocated active channel");
+            }
+            break;
         }
     }
 
@@ -457,6 +542,62 @@ void SoundPool::done_l(SoundChannel* channel)
     }
 }
 
+sp<PooledTrack> SoundPool::acquireTrack(const TrackKey& key)
+{
+    sp<PooledTrack> track;
+    {
+        Mutex::Autolock lock(&mTrackPoolLock);
+        for (size_t i = mTrackPool.size(); i > 0; --i) {
+            if (mTrackPool[i - 1]->key() == key) {
+                track = mTrackPool[i - 1];
+                mTrackPool.removeAt(i - 1);
+                break;
+            }
+        }
+    }
+    if (track != 0) {
+        Mutex::Autolock lock(&mStatsLock);
+        mStats.trackPoolHits++;
+    }
+    return track;
+}
+
+// track must be stopped
+void SoundPool::releaseTrack(const sp<PooledTrack>& track)
+{
+    track->setChannel(NULL, 0);
+    sp<PooledTrack> evicted;
+    {
+        Mutex::Autolock lock(&mTrackPoolLock);
+        mTrackPool.push(track);
+        if (mTrackPool.size() > kMaxPooledTracks) {
+            evicted = mTrackPool[0];
+            mTrackPool.removeAt(0);
+        }
+    }
+    // evicted is destroyed outside mTrackPoolLock, as its AudioTrack waits for its callbacks
+}
+
+void SoundPool::trackCreated()
+{
+    Mutex::Autolock lock(&mStatsLock);
+    mStats.trackCreations++;
+}
+
+void SoundPool::purgeTracks(int sampleID)
+{
+    Vector< sp<PooledTrack> > purged;
+    {
+        Mutex::Autolock lock(&mTrackPoolLock);
+        for (size_t i = mTrackPool.size(); i > 0; --i) {
+            if (mTrackPool[i - 1]->key().sampleID == sampleID) {
+                purged.push(mTrackPool[i - 1]);
+                mTrackPool.removeAt(i - 1);
+            }
+        }
+    }
+}
+
 void SoundPool::setCallback(SoundPoolCallback* callback, void* user)
 {
     Mutex::Autolock lock(&mCallbackLock);
@@ -723,7 +864,9 @@ void SoundChannel::init(SoundPool* soundPool)
 void SoundChannel::play(const sp<Sample>& sample, int nextChannelID, float leftVolume,
         float rightVolume, int priority, int loop, float rate)
 {
-    sp<AudioTrack> oldTrack;
+    // declared first so that the AudioTracks below are released before their PooledTracks
+    sp<PooledTrack> oldPooledTrack;
+    sp<PooledTrack> pooledTrack;
     sp<AudioTrack> newTrack;
     status_t status = NO_ERROR;
 
@@ -735,8 +878,8 @@ void SoundChannel::play(const sp<Sample>& sample, int nextChannelID, float leftV
                 this, sample->sampleID(), nextChannelID, leftVolume, rightVolume,
                 priority, loop, rate);
 
-        // if not idle, this voice is being stolen
-        if (mState != IDLE) {
+        // if not idle or reserved for this call, this voice is being stolen
+        if (mState != IDLE && mState != STARTING) {
             ALOGV("channel %d stolen - event queued for channel %d", channelID(), nextChannelID);
             mNextEvent.set(sample, nextChannelID, leftVolume, rightVolume, priority, loop, rate);
             stop_l();
@@ -783,41 +926,65 @@ void SoundChannel::play(const sp<Sample>& sample, int nextChannelID, float leftV
         }
         if (newTrack == 0) {
             // mToggle toggles each time a track is started on a given channel.
-            // The toggle is concatenated with the SoundChannel address and passed to AudioTrack
-            // as callback user data. This enables the detection of callbacks received from the old
+            // The toggle is passed to the PooledTrack routing the AudioTrack callbacks to this
+            // channel. This enables the detection of callbacks received from the old
             // audio track while the new one is being started and avoids processing them with
             // wrong audio audio buffer size  (mAudioBufferSize)
             unsigned long toggle = mToggle ^ 1;
-            void *userData = (void *)((unsigned long)this | toggle);
             audio_channel_mask_t sampleChannelMask = sample->channelMask();
             // When sample contains a not none channel mask, use it as is.
             // Otherwise, use channel count to calculate channel mask.
             audio_channel_mask_t channelMask = sampleChannelMask != AUDIO_CHANNEL_NONE
                     ? sampleChannelMask : audio_channel_out_mask_from_count(numChannels);
 
-            // do not create a new audio track if current track is compatible with sample parameters
+            TrackKey key;
+    #ifdef USE_SHARED_MEM_BUFFER
+            key.sampleID = sample->sampleID();
+    #else
+            key.sampleID = 0;
+    #endif
+            key.format = sample->format();
+            key.channelMask = channelMask;
+
+            // borrow a stopped track another channel played the sample on, if there is one
+            pooledTrack = mSoundPool->acquireTrack(key);
+            if (pooledTrack != 0
+                    && pooledTrack->audioTrack()->setSampleRate(sampleRate) == NO_ERROR) {
+                newTrack = pooledTrack->audioTrack();
+                ALOGV("borrowed track %p for sample %d", newTrack.get(), sample->sampleID());
+            } else {
+                pooledTrack = new PooledTrack(key);
     #ifdef USE_SHARED_MEM_BUFFER
-            newTrack = new AudioTrack(streamType, sampleRate, sample->format(),
-                    channelMask, sample->getIMemory(), AUDIO_OUTPUT_FLAG_FAST, callback, userData,
-                    0 /*default notification frames*/, AUDIO_SESSION_ALLOCATE,
-                    AudioTrack::TRANSFER_DEFAULT,
-                    NULL /*offloadInfo*/, -1 /*uid*/, -1 /*pid*/, mSoundPool->attributes());
+                newTrack = new AudioTrack(streamType, sampleRate, sample->format(),
+                        channelMask, sample->getIMemory(), AUDIO_OUTPUT_FLAG_FAST,
+                        PooledTrack::callback, pooledTrack.get(),
+                        0 /*default notification frames*/, AUDIO_SESSION_ALLOCATE,
+                        AudioTrack::TRANSFER_DEFAULT,
+                        NULL /*offloadInfo*/, -1 /*uid*/, -1 /*pid*/, mSoundPool->attributes());
     #else
-            uint32_t bufferFrames = (totalFrames + (kDefaultBufferCount - 1)) / kDefaultBufferCount;
-            newTrack = new AudioTrack(streamType, sampleRate, sample->format(),
-                    channelMask, frameCount, AUDIO_OUTPUT_FLAG_FAST, callback, userData,
-                    bufferFrames, AUDIO_SESSION_ALLOCATE, AudioTrack::TRANSFER_DEFAULT,
-                    NULL /*offloadInfo*/, -1 /*uid*/, -1 /*pid*/, mSoundPool->attributes());
+                uint32_t bufferFrames =
+                        (totalFrames + (kDefaultBufferCount - 1)) / kDefaultBufferCount;
+                newTrack = new AudioTrack(streamType, sampleRate, sample->format(),
+                        channelMask, frameCount, AUDIO_OUTPUT_FLAG_FAST,
+                        PooledTrack::callback, pooledTrack.get(),
+                        bufferFrames, AUDIO_SESSION_ALLOCATE, AudioTrack::TRANSFER_DEFAULT,
+                        NULL /*offloadInfo*/, -1 /*uid*/, -1 /*pid*/, mSoundPool->attributes());
     #endif
-            oldTrack = mAudioTrack;
-            status = newTrack->initCheck();
-            if (status != NO_ERROR) {
-                ALOGE("Error creating AudioTrack");
-                // newTrack goes out of scope, so reference count drops to zero
-                goto exit;
+                pooledTrack->setAudioTrack(newTrack);
+                mSoundPool->trackCreated();
+                status = newTrack->initCheck();
+                if (status != NO_ERROR) {
+                    ALOGE("Error creating AudioTrack");
+                    // pooledTrack goes out of scope, so reference count drops to zero
+                    newTrack.clear();
+                    goto exit;
+                }
             }
             // From now on, AudioTrack callbacks received with previous toggle value will be ignored.
             mToggle = toggle;
+            pooledTrack->setChannel(this, toggle);
+            oldPooledTrack = mTrack;
+            mTrack = pooledTrack;
             mAudioTrack = newTrack;
             ALOGV("using new track %p for sample %d", newTrack.get(), sample->sampleID());
         }
@@ -843,10 +1010,33 @@ void SoundChannel::play(const sp<Sample>& sample, int nextChannelID, float leftV
     }
 
 exit:
-    ALOGV("delete oldTrack %p", oldTrack.get());
     if (status != NO_ERROR) {
+        {
+            Mutex::Autolock lock(&mLock);
+            if (mState == STARTING) {
+                mState = IDLE;
+            }
+        }
         mAudioTrack.clear();
+        oldPooledTrack = mTrack;
+        mTrack.clear();
+    }
+    // the previous track is stopped; keep it warm for the next play of its sample
+    if (oldPooledTrack != 0) {
+        ALOGV("release oldTrack %p", oldPooledTrack->audioTrack().get());
+        mSoundPool->releaseTrack(oldPooledTrack);
+    }
+}
+
+// call with sound pool lock held
+bool SoundChannel::reserve()
+{
+    Mutex::Autolock lock(&mLock);
+    if (mState != IDLE) {
+        return false;
     }
+    mState = STARTING;
+    return true;
 }
 
 void SoundChannel::nextEvent()
@@ -865,6 +1055,9 @@ void SoundChannel::nextEvent()
         nextChannelID = mNextEvent.channelID();
         if (nextChannelID  == 0) {
             ALOGV("stolen channel has no event");
+            if (mState == STARTING) {
+                mState = IDLE;
+            }
             return;
         }
 
@@ -880,11 +1073,38 @@ void SoundChannel::nextEvent()
     play(sample, nextChannelID, leftVolume, rightVolume, priority, loop, rate);
 }
 
-void SoundChannel::callback(int event, void* user, void *info)
+PooledTrack::~PooledTrack()
 {
-    SoundChannel* channel = static_cast<SoundChannel*>((void *)((unsigned long)user & ~1));
+    // destroying the AudioTrack waits for its callback thread, which may be in callback()
+    mAudioTrack.clear();
+}
 
-    channel->process(event, info, (unsigned long)user & 1);
+void PooledTrack::setChannel(SoundChannel* channel, unsigned long toggle)
+{
+    Mutex::Autolock lock(&mLock);
+    mChannel = channel;
+    mToggle = toggle;
+}
+
+void PooledTrack::callback(int event, void* user, void *info)
+{
+    PooledTrack* track = static_cast<PooledTrack*>(user);
+    SoundChannel* channel;
+    unsigned long toggle;
+    {
+        Mutex::Autolock lock(&track->mLock);
+        channel = track->mChannel;
+        toggle = track->mToggle;
+    }
+
+    if (channel == NULL) {
+        // the track is pooled
+        if (event == AudioTrack::EVENT_MORE_DATA) {
+            static_cast<AudioTrack::Buffer *>(info)->size = 0;
+        }
+        return;
+    }
+    channel->process(event, info, toggle);
 }
 
 void SoundChannel::process(int event, void *info, unsigned long toggle)
@@ -967,7 +1187,7 @@ void SoundChannel::process(int event, void *info, unsigned long toggle)
 // call with lock held
 bool SoundChannel::doStop_l()
 {
-    if (mState != IDLE) {
+    if (mState != IDLE && mState != STARTING) {
         ALOGV("stop");
         if (mLeftVolume != 0.f || mRightVolume != 0.f) {
             setVolume_l(0.f, 0.f);
@@ -1116,6 +1336,7 @@ SoundChannel::~SoundChannel()
     // do not call AudioTrack destructor with mLock held as it will wait for the AudioTrack
     // callback thread to exit which may need to execute process() and acquire the mLock.
     mAudioTrack.clear();
+    mTrack.clear();
 }
 
 void SoundChannel::dump()
@@ -18,6 +18,7 @@
 #define SOUNDPOOL_H_
 
 #include <utils/threads.h>
+#include <utils/Timers.h>
 #include <utils/List.h>
 #include <utils/Vector.h>
 #include <utils/KeyedVector.h>
@@ -31,6 +32,7 @@ static const int IDLE_PRIORITY = -1;
 
 // forward declarations
 class SoundEvent;
+class SoundChannel;
 class SoundPoolThread;
 class SoundPool;
 
@@ -45,6 +47,19 @@ public:
     enum MessageType { INVALID, SAMPLE_LOADED };
 };
 
+// load and play timings, as returned by SoundPool::getStats()
+struct SoundPoolStats {
+    int64_t     samplesLoaded;      // samples decoded successfully
+    int64_t     samplesFailed;      // samples that failed to decode
+    int64_t     lastLoadSetSize;    // samples in the last set of loads to complete
+    int64_t     lastLoadSetTimeNs;  // from the first load() of that set until all were done
+    int64_t     playCount;
+    int64_t     playTotalTimeNs;
+    int64_t     playMaxTimeNs;
+    int64_t     trackPoolHits;      // tracks reused from the track pool
+    int64_t     trackCreations;     // tracks created because the pool had none to lend
+};
+
 // callback function prototype
 typedef void SoundPoolCallback(SoundPoolEvent event, SoundPool* soundPool, void* user);
 
@@ -84,6 +99,39 @@ private:
     sp<MemoryHeapBase>   mHeap;
 };
 
+// what a track can play without being recreated
+struct TrackKey {
+    int                  sampleID;  // static tracks play from the sample's memory
+    audio_format_t       format;
+    audio_channel_mask_t channelMask;
+
+    bool operator==(const TrackKey& other) const {
+        return sampleID == other.sampleID && format == other.format
+                && channelMask == other.channelMask;
+    }
+};
+
+// An AudioTrack lent to channels by the SoundPool track pool. The AudioTrack callback goes
+// through here, as the channel playing the track changes while the track lives on.
+class PooledTrack : public RefBase {
+public:
+    explicit PooledTrack(const TrackKey& key) : mKey(key), mChannel(NULL), mToggle(0) {}
+    ~PooledTrack();
+    const TrackKey& key() const { return mKey; }
+    sp<AudioTrack> audioTrack() const { return mAudioTrack; }
+    void setAudioTrack(const sp<AudioTrack>& audioTrack) { mAudioTrack = audioTrack; }
+    // routes callbacks to channel, or drops them if channel is NULL
+    void setChannel(SoundChannel* channel, unsigned long toggle);
+    static void callback(int event, void* user, void *info);
+
+private:
+    const TrackKey      mKey;
+    sp<AudioTrack>      mAudioTrack;
+    Mutex               mLock;
+    SoundChannel*       mChannel;
+    unsigned long       mToggle;
+};
+
 // stores pending events for stolen channels
 class SoundEvent
 {
@@ -113,8 +161,10 @@ protected:
 
 // for channels aka AudioTracks
 class SoundChannel : public SoundEvent {
+    friend class PooledTrack;
 public:
-    enum state { IDLE, RESUMING, STOPPING, PAUSED, PLAYING };
+    // STARTING: allocated to a play() that is creating its AudioTrack outside the pool lock
+    enum state { IDLE, RESUMING, STOPPING, PAUSED, PLAYING, STARTING };
     SoundChannel() : mState(IDLE), mNumChannels(1),
             mPos(0), mToggle(0), mAutoPaused(false), mMuted(false) {}
     ~SoundChannel();
@@ -133,6 +183,7 @@ public:
     void setRate(float rate);
     int state() { return mState; }
     void setPriority(int priority) { mPriority = priority; }
+    bool reserve();
     void setLoop(int loop);
     int numChannels() { return mNumChannels; }
     void clearNextEvent() { mNextEvent.clear(); }
@@ -142,12 +193,12 @@ public:
     int getPrevSampleID(void) { return mPrevSampleID; }
 
 private:
-    static void callback(int event, void* user, void *info);
     void process(int event, void *info, unsigned long toggle);
     bool doStop_l();
 
     SoundPool*          mSoundPool;
-    sp<AudioTrack>      mAudioTrack;
+    sp<PooledTrack>     mTrack;
+    sp<AudioTrack>      mAudioTrack;        // mTrack's AudioTrack; cleared before mTrack
     SoundEvent          mNextEvent;
     Mutex               mLock;
     int                 mState;
@@ -183,13 +234,20 @@ public:
     void setRate(int channelID, float rate);
     const audio_attributes_t* attributes() { return &mAttributes; }
 
+    void getStats(SoundPoolStats* stats);
+
     // called from SoundPoolThread
-    void sampleLoaded(int sampleID);
+    void sampleLoaded(int sampleID, status_t status);
     sp<Sample> findSample(int sampleID);
 
     // called from AudioTrack thread
     void done_l(SoundChannel* channel);
 
+    // called from SoundChannel
+    sp<PooledTrack> acquireTrack(const TrackKey& key);
+    void releaseTrack(const sp<PooledTrack>& track);
+    void trackCreated();
+
     // callback function
     void setCallback(SoundPoolCallback* callback, void* user);
     void* getUserData() { return mUserData; }
@@ -208,6 +266,8 @@ private:
     // restart thread
     void addToRestartList(SoundChannel* channel);
     void addToStopList(SoundChannel* channel);
+    void restart(SoundChannel* channel);
+    void purgeTracks(int sampleID);
     static int beginThread(void* arg);
     int run();
     void quit();
@@ -229,6 +289,18 @@ private:
     bool                    mQuit;
     bool                    mMuted;
 
+    // stopped tracks for channels to reuse, most recently released last
+    static const size_t     kMaxPooledTracks = 4;
+    Mutex                   mTrackPoolLock;
+    Vector< sp<PooledTrack> > mTrackPool;
+
+    // stats, guarded by mStatsLock
+    Mutex                   mStatsLock;
+    SoundPoolStats          mStats;
+    int                     mPendingLoads;
+    int                     mLoadSetSize;
+    nsecs_t                 mLoadSetStartTime;
+
     // callback
     Mutex                   mCallbackLock;
     SoundPoolCallback*      mCallback;
@@ -20,6 +20,8 @@
 
 #include "SoundPoolThread.h"
 
+#include <thread>
+
 namespace android {
 
 void SoundPoolThread::write(SoundPoolMsg msg) {
@@ -31,7 +33,7 @@ void SoundPoolThread::write(SoundPoolMsg msg) {
     // if thread is quitting, don't add to queue
     if (mRunning) {
         mMsgQueue.push(msg);
-        mCondition.signal();
+        mCondition.broadcast();
     }
 }
 
@@ -41,8 +43,11 @@ const SoundPoolMsg SoundPoolThread::read() {
         mCondition.wait(mLock);
     }
     SoundPoolMsg msg = mMsgQueue[0];
-    mMsgQueue.removeAt(0);
-    mCondition.signal();
+    // Leave KILL in the queue so that every thread sees it.
+    if (msg.mMessageType != SoundPoolMsg::KILL) {
+        mMsgQueue.removeAt(0);
+    }
+    mCondition.broadcast();
     return msg;
 }
 
@@ -52,19 +57,34 @@ void SoundPoolThread::quit() {
         mRunning = false;
         mMsgQueue.clear();
         mMsgQueue.push(SoundPoolMsg(SoundPoolMsg::KILL, 0));
-        mCondition.signal();
-        mCondition.wait(mLock);
+        mCondition.broadcast();
+        while (mNumThreads > 0) {
+            mCondition.wait(mLock);
+        }
     }
     ALOGV("return from quit");
 }
 
 SoundPoolThread::SoundPoolThread(SoundPool* soundPool) :
-    mSoundPool(soundPool)
+    mSoundPool(soundPool), mRunning(false), mNumThreads(0)
 {
     mMsgQueue.setCapacity(maxMessages);
-    if (createThreadEtc(beginThread, this, "SoundPoolThread")) {
-        mRunning = true;
+
+    size_t numThreads = std::thread::hardware_concurrency();
+    if (numThreads < 1) {
+        numThreads = 1;
+    } else if (numThreads > maxThreads) {
+        numThreads = maxThreads;
     }
+
+    Mutex::Autolock lock(&mLock);
+    for (size_t i = 0; i < numThreads; ++i) {
+        if (createThreadEtc(beginThread, this, "SoundPoolThread")) {
+            mNumThreads++;
+        }
+    }
+    mRunning = mNumThreads > 0;
+    ALOGV("started %zu decode threads", mNumThreads);
 }
 
 SoundPoolThread::~SoundPoolThread()
@@ -84,9 +104,13 @@ int SoundPoolThread::run() {
         SoundPoolMsg msg = read();
         ALOGV("Got message m=%d, mData=%d", msg.mMessageType, msg.mData);
         switch (msg.mMessageType) {
-        case SoundPoolMsg::KILL:
+        case SoundPoolMsg::KILL: {
             ALOGV("goodbye");
+            Mutex::Autolock lock(&mLock);
+            mNumThreads--;
+            mCondition.broadcast();
             return NO_ERROR;
+        }
         case SoundPoolMsg::LOAD_SAMPLE:
             doLoadSample(msg.mData);
             break;
@@ -108,7 +132,7 @@ void SoundPoolThread::doLoadSample(int sampleID) {
     if (sample != 0) {
         status = sample->doLoad();
     }
-    mSoundPool->notify(SoundPoolEvent(SoundPoolEvent::SAMPLE_LOADED, sampleID, status));
+    mSoundPool->sampleLoaded(sampleID, status);
 }
 
 } // end namespace android
@@ -38,6 +38,8 @@ public:
 /*
  * This class handles background requests from the SoundPool
  */
+// Pool of threads decoding samples for SoundPool::load(). Samples decode independently, so
+// loading a set of samples is spread across up to maxThreads threads.
 class SoundPoolThread {
 public:
     explicit SoundPoolThread(SoundPool* SoundPool);
@@ -48,6 +50,7 @@ public:
 
 private:
     static const size_t maxMessages = 128;
+    static const size_t maxThreads = 4;
 
     static int beginThread(void* arg);
     int run();
@@ -59,6 +62,7 @@ private:
     Vector<SoundPoolMsg>    mMsgQueue;
     SoundPool*              mSoundPool;
     bool                    mRunning;
+    size_t                  mNumThreads;
 };
 
 } // end namespace android
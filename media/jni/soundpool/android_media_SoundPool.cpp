@@ -170,6 +170,46 @@ android_media_SoundPool_setRate(JNIEnv *env, jobject thiz, jint channelID,
     ap->setRate(channelID, (float) rate);
 }
 
+// Indices into the array filled by native_getStats; must be kept in sync with SoundPool.java.
+enum {
+    STATS_SAMPLES_LOADED = 0,
+    STATS_SAMPLES_FAILED,
+    STATS_LAST_LOAD_SET_SIZE,
+    STATS_LAST_LOAD_SET_TIME_NS,
+    STATS_PLAY_COUNT,
+    STATS_PLAY_TOTAL_TIME_NS,
+    STATS_PLAY_MAX_TIME_NS,
+    STATS_TRACK_POOL_HITS,
+    STATS_TRACK_CREATIONS,
+    STATS_COUNT
+};
+
+static void
+android_media_SoundPool_getStats(JNIEnv *env, jobject thiz, jlongArray outStats)
+{
+    ALOGV("android_media_SoundPool_getStats");
+    SoundPool *ap = MusterSoundPool(env, thiz);
+    if (ap == NULL) return;
+    if (outStats == NULL || env->GetArrayLength(outStats) < STATS_COUNT) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", "stats array too small");
+        return;
+    }
+
+    SoundPoolStats stats;
+    ap->getStats(&stats);
+    jlong values[STATS_COUNT];
+    values[STATS_SAMPLES_LOADED] = stats.samplesLoaded;
+    values[STATS_SAMPLES_FAILED] = stats.samplesFailed;
+    values[STATS_LAST_LOAD_SET_SIZE] = stats.lastLoadSetSize;
+    values[STATS_LAST_LOAD_SET_TIME_NS] = stats.lastLoadSetTimeNs;
+    values[STATS_PLAY_COUNT] = stats.playCount;
+    values[STATS_PLAY_TOTAL_TIME_NS] = stats.playTotalTimeNs;
+    values[STATS_PLAY_MAX_TIME_NS] = stats.playMaxTimeNs;
+    values[STATS_TRACK_POOL_HITS] = stats.trackPoolHits;
+    values[STATS_TRACK_CREATIONS] = stats.trackCreations;
+    env->SetLongArrayRegion(outStats, 0, STATS_COUNT, values);
+}
+
 static void android_media_callback(SoundPoolEvent event, SoundPool* soundPool, void* user)
 {
     ALOGV("callback: (%d, %d, %d, %p, %p)", event.mMsg, event.mArg1, event.mArg2, soundPool, user);
@@ -295,6 +335,10 @@ static JNINativeMethod gMethods[] = {
         "(IF)V",
         (void *)android_media_SoundPool_setRate
     },
+    {   "native_getStats",
+        "([J)V",
+        (void *)android_media_SoundPool_getStats
+    },
     {   "native_setup",
         "(Ljava/lang/Object;ILjava/lang/Object;)I",
         (void*)android_media_SoundPool_native_setup
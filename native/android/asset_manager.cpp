@@ -25,6 +25,11 @@
 #include <androidfw/AssetManager2.h>
 #include <utils/threads.h>
 
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+
 #include "jni.h"
 #include <nativehelper/JNIHelp.h>
 
@@ -63,23 +68,44 @@ AAssetManager* AAssetManager_fromJava(JNIEnv* env, jobject assetManager)
     return (AAssetManager*) env->GetLongField(assetManager, gAssetManagerOffsets.mObject);
 }
 
-AAsset* AAssetManager_open(AAssetManager* amgr, const char* filename, int mode)
+static bool toAccessMode(int mode, Asset::AccessMode* outMode)
 {
-    Asset::AccessMode amMode;
     switch (mode) {
     case AASSET_MODE_UNKNOWN:
-        amMode = Asset::ACCESS_UNKNOWN;
-        break;
+        *outMode = Asset::ACCESS_UNKNOWN;
+        return true;
     case AASSET_MODE_RANDOM:
-        amMode = Asset::ACCESS_RANDOM;
-        break;
+        *outMode = Asset::ACCESS_RANDOM;
+        return true;
     case AASSET_MODE_STREAMING:
-        amMode = Asset::ACCESS_STREAMING;
-        break;
+        *outMode = Asset::ACCESS_STREAMING;
+        return true;
     case AASSET_MODE_BUFFER:
-        amMode = Asset::ACCESS_BUFFER;
-        break;
+        *outMode = Asset::ACCESS_BUFFER;
+        return true;
     default:
+        return false;
+    }
+}
+
+// Asks the kernel to read the asset's bytes into the page cache in the background, so that
+// reading or mapping it later doesn't block on I/O. Only uncompressed assets have a range of
+// the file to read ahead; compressed ones are inflated into memory when read anyway.
+static void readAhead(const Asset& asset)
+{
+    off64_t start, length;
+    int fd = asset.openFileDescriptor(&start, &length);
+    if (fd < 0) {
+        return;
+    }
+    posix_fadvise64(fd, start, length, POSIX_FADV_WILLNEED);
+    close(fd);
+}
+
+AAsset* AAssetManager_open(AAssetManager* amgr, const char* filename, int mode)
+{
+    Asset::AccessMode amMode;
+    if (!toAccessMode(mode, &amMode)) {
         return NULL;
     }
 
@@ -91,6 +117,41 @@ AAsset* AAssetManager_open(AAssetManager* amgr, const char* filename, int mode)
     return new AAsset(std::move(asset));
 }
 
+/**
+ * Opens many assets at once, such as everything a level of a game needs, under a single lock.
+ * outAssets[i] is set to the asset named by filenames[i], or NULL if it couldn't be opened.
+ * The contents of uncompressed assets are read ahead in the background, so that reading them
+ * or mapping them with AAsset_getBuffer() later doesn't wait for the storage.
+ *
+ * Returns the number of assets opened, each of which must be closed with AAsset_close().
+ */
+size_t AAssetManager_openAssets(AAssetManager* amgr, const char* const* filenames, size_t count,
+        int mode, AAsset** outAssets)
+{
+    Asset::AccessMode amMode;
+    if (!toAccessMode(mode, &amMode)) {
+        std::fill(outAssets, outAssets + count, nullptr);
+        return 0;
+    }
+
+    size_t opened = 0;
+    {
+        ScopedLock<AssetManager2> locked_mgr(*AssetManagerForNdkAssetManager(amgr));
+        for (size_t i = 0; i < count; i++) {
+            std::unique_ptr<Asset> asset = locked_mgr->Open(filenames[i], amMode);
+            outAssets[i] = asset != nullptr ? new AAsset(std::move(asset)) : nullptr;
+        }
+    }
+    // Other threads can use the AssetManager again while the readahead is requested.
+    for (size_t i = 0; i < count; i++) {
+        if (outAssets[i] != nullptr) {
+            readAhead(*outAssets[i]->mAsset);
+            opened++;
+        }
+    }
+    return opened;
+}
+
 AAssetDir* AAssetManager_openDir(AAssetManager* amgr, const char* dirName)
 {
     ScopedLock<AssetManager2> locked_mgr(*AssetManagerForNdkAssetManager(amgr));
@@ -62,6 +62,10 @@ public:
 
     static Choreographer* getForThread();
 
+    // The deadline of the frame being dispatched by the current frame callbacks, or of the next
+    // frame outside of them. 0 while the vsync period is unknown.
+    nsecs_t getFrameDeadline() const;
+
 protected:
     virtual ~Choreographer() = default;
 
@@ -83,6 +87,9 @@ private:
 
     const sp<Looper> mLooper;
     const std::thread::id mThreadId;
+
+    // The deadline of the frame being dispatched, only set while the frame callbacks run.
+    nsecs_t mFrameDeadline = 0;
 };
 
 
@@ -152,6 +159,8 @@ void Choreographer::dispatchVsync(nsecs_t timestamp, PhysicalDisplayId, uint32_t
             mCallbacks.pop();
         }
     }
+    // The frame has to be ready by the vsync after the one that started it.
+    mFrameDeadline = getPredictedNextVsync(timestamp);
     for (const auto& cb : callbacks) {
         if (cb.callback64 != nullptr) {
             cb.callback64(timestamp, cb.data);
@@ -159,6 +168,16 @@ void Choreographer::dispatchVsync(nsecs_t timestamp, PhysicalDisplayId, uint32_t
             cb.callback(timestamp, cb.data);
         }
     }
+    mFrameDeadline = 0;
+}
+
+nsecs_t Choreographer::getFrameDeadline() const {
+    if (mFrameDeadline != 0) {
+        return mFrameDeadline;
+    }
+    // The next frame starts at the next vsync, and is due at the one after it.
+    const nsecs_t nextVsync = getPredictedNextVsync(systemTime(SYSTEM_TIME_MONOTONIC));
+    return nextVsync != 0 ? getPredictedNextVsync(nextVsync) : 0;
 }
 
 void Choreographer::dispatchHotplug(nsecs_t, PhysicalDisplayId displayId, bool connected) {
@@ -223,3 +242,9 @@ void AChoreographer_postFrameCallbackDelayed64(AChoreographer* choreographer,
     AChoreographer_to_Choreographer(choreographer)->postFrameCallbackDelayed(
             nullptr, callback, data, ms2ns(delayMillis));
 }
+int64_t AChoreographer_getVsyncPeriodNanos(AChoreographer* choreographer) {
+    return AChoreographer_to_Choreographer(choreographer)->getVsyncPeriod();
+}
+int64_t AChoreographer_getFrameDeadlineNanos(AChoreographer* choreographer) {
+    return AChoreographer_to_Choreographer(choreographer)->getFrameDeadline();
+}
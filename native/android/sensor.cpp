@@ -30,6 +30,11 @@
 #include <vndk/hardware_buffer.h>
 
 #include <poll.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
 
 using android::sp;
 using android::Sensor;
@@ -206,6 +211,173 @@ int ASensorManager_configureDirectReport(
 
 /*****************************************************************************/
 
+// A shared memory direct channel, and a reader for the ring of events that the sensor HAL
+// writes into it. The HAL writes each event's payload before its counter, held in reserved0,
+// which starts at 1 and counts up by one per event, skipping 0 when it wraps. So the reader
+// needs no file descriptor to wait on and no copies through the sensor service.
+struct ASensorDirectReader {
+    ASensorManager* manager;
+    int channelId;
+    int fd;
+    const ASensorEvent* ring;
+    size_t ringSize;            // in events
+    size_t readIndex;
+    uint32_t expectedCounter;
+    int64_t lastTimestamp;      // of the last event read
+    int64_t eventPeriodNs;      // smoothed interval between events, 0 until known
+    uint64_t droppedEvents;     // overwritten by the HAL before they were read
+};
+
+// The smallest and largest sleep between reads while waiting for a batch of events.
+static constexpr nsecs_t kMinDirectReaderSleepNs = us2ns(100);
+static constexpr nsecs_t kMaxDirectReaderSleepNs = ms2ns(1);
+
+static inline uint32_t nextDirectCounter(uint32_t counter) {
+    return counter == UINT32_MAX ? 1 : counter + 1;
+}
+
+// Copies up to count new events out of the ring, oldest first.
+static size_t readDirectRing(ASensorDirectReader* reader, ASensorEvent* events, size_t count) {
+    size_t read = 0;
+    while (read < count) {
+        const ASensorEvent* slot = &reader->ring[reader->readIndex];
+        uint32_t counter = __atomic_load_n(
+                reinterpret_cast<const uint32_t*>(&slot->reserved0), __ATOMIC_ACQUIRE);
+        if (counter == 0) {
+            break;  // not written yet
+        }
+        const int32_t ahead = static_cast<int32_t>(counter - reader->expectedCounter);
+        if (ahead < 0) {
+            break;  // still the event that was read a lap ago
+        }
+        if (ahead > 0) {
+            // The HAL lapped the reader. The events from here on are still in order, so carry
+            // on from the oldest one that is left.
+            reader->droppedEvents += ahead;
+            reader->expectedCounter = counter;
+        }
+
+        events[read] = *slot;
+        // Make sure the HAL didn't overwrite the slot while it was being copied.
+        if (__atomic_load_n(reinterpret_cast<const uint32_t*>(&slot->reserved0),
+                __ATOMIC_ACQUIRE) != counter) {
+            continue;
+        }
+
+        const int64_t timestamp = events[read].timestamp;
+        if (reader->lastTimestamp != 0 && timestamp > reader->lastTimestamp) {
+            const int64_t interval = timestamp - reader->lastTimestamp;
+            reader->eventPeriodNs = reader->eventPeriodNs == 0
+                    ? interval : reader->eventPeriodNs + (interval - reader->eventPeriodNs) / 8;
+        }
+        reader->lastTimestamp = timestamp;
+
+        reader->readIndex = (reader->readIndex + 1) % reader->ringSize;
+        reader->expectedCounter = nextDirectCounter(reader->expectedCounter);
+        read++;
+    }
+    return read;
+}
+
+#define RETURN_IF_READER_IS_NULL(retval) do {\
+        if (reader == nullptr) { \
+            ERROR_INVALID_PARAMETER("reader cannot be NULL"); \
+            return retval; \
+        } \
+    } while (false)
+
+ASensorDirectReader* ASensorDirectReader_create(ASensorManager* manager, size_t eventCount) {
+    RETURN_IF_MANAGER_IS_NULL(nullptr);
+
+    if (eventCount < 2) {
+        ERROR_INVALID_PARAMETER("eventCount has to be at least 2.");
+        return nullptr;
+    }
+
+    const size_t size = eventCount * sizeof(ASensorEvent);
+    int fd = ASharedMemory_create("ASensorDirectReader", size);
+    if (fd < 0) {
+        return nullptr;
+    }
+    void* ring = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (ring == MAP_FAILED) {
+        close(fd);
+        return nullptr;
+    }
+    int channelId = ASensorManager_createSharedMemoryDirectChannel(manager, fd, size);
+    if (channelId <= 0) {
+        munmap(ring, size);
+        close(fd);
+        return nullptr;
+    }
+
+    return new ASensorDirectReader{manager, channelId, fd, static_cast<const ASensorEvent*>(ring),
+            eventCount, 0 /* readIndex */, 1 /* expectedCounter */, 0 /* lastTimestamp */,
+            0 /* eventPeriodNs */, 0 /* droppedEvents */};
+}
+
+void ASensorDirectReader_destroy(ASensorDirectReader* reader) {
+    RETURN_IF_READER_IS_NULL(void());
+
+    ASensorManager_configureDirectReport(reader->manager, nullptr, reader->channelId,
+            ASENSOR_DIRECT_RATE_STOP);
+    ASensorManager_destroyDirectChannel(reader->manager, reader->channelId);
+    munmap(const_cast<ASensorEvent*>(reader->ring), reader->ringSize * sizeof(ASensorEvent));
+    close(reader->fd);
+    delete reader;
+}
+
+int ASensorDirectReader_configure(ASensorDirectReader* reader, ASensor const* sensor, int rate) {
+    RETURN_IF_READER_IS_NULL(android::BAD_VALUE);
+    return ASensorManager_configureDirectReport(reader->manager, sensor, reader->channelId, rate);
+}
+
+ssize_t ASensorDirectReader_getEvents(ASensorDirectReader* reader, ASensorEvent* events,
+        size_t count) {
+    RETURN_IF_READER_IS_NULL(android::BAD_VALUE);
+    if (events == nullptr) {
+        ERROR_INVALID_PARAMETER("events cannot be NULL");
+        return android::BAD_VALUE;
+    }
+    return readDirectRing(reader, events, count);
+}
+
+ssize_t ASensorDirectReader_waitForEvents(ASensorDirectReader* reader, ASensorEvent* events,
+        size_t count, size_t minEvents, int64_t timeoutNs) {
+    RETURN_IF_READER_IS_NULL(android::BAD_VALUE);
+    if (events == nullptr) {
+        ERROR_INVALID_PARAMETER("events cannot be NULL");
+        return android::BAD_VALUE;
+    }
+    minEvents = std::min(std::max(minEvents, size_t(1)), count);
+
+    // Rather than waking for every event, sleep for as long as the rest of the batch is expected
+    // to take at the rate the events have been arriving.
+    const nsecs_t deadline = systemTime(SYSTEM_TIME_MONOTONIC) + timeoutNs;
+    size_t read = readDirectRing(reader, events, count);
+    while (read < minEvents) {
+        const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        if (now >= deadline) {
+            break;
+        }
+        nsecs_t sleepNs = reader->eventPeriodNs != 0
+                ? (minEvents - read) * reader->eventPeriodNs : kMaxDirectReaderSleepNs;
+        sleepNs = std::min(std::max(sleepNs, kMinDirectReaderSleepNs), deadline - now);
+        const struct timespec sleep = {
+            static_cast<time_t>(sleepNs / 1000000000), static_cast<long>(sleepNs % 1000000000)};
+        nanosleep(&sleep, nullptr);
+        read += readDirectRing(reader, events + read, count - read);
+    }
+    return read;
+}
+
+uint64_t ASensorDirectReader_getDroppedEventCount(ASensorDirectReader* reader) {
+    RETURN_IF_READER_IS_NULL(0);
+    return reader->droppedEvents;
+}
+
+/*****************************************************************************/
+
 int ASensorEventQueue_registerSensor(ASensorEventQueue* queue, ASensor const* sensor,
         int32_t samplingPeriodUs, int64_t maxBatchReportLatencyUs) {
     RETURN_IF_QUEUE_IS_NULL(android::BAD_VALUE);
@@ -14,7 +14,9 @@
  * limitations under the License.
  */
 
+#include <android/choreographer.h>
 #include <android/hardware/configstore/1.0/ISurfaceFlingerConfigs.h>
+#include <android/hardware_buffer.h>
 #include <android/native_window.h>
 #include <android/surface_control.h>
 
@@ -26,10 +28,17 @@
 #include <gui/SurfaceComposerClient.h>
 #include <gui/SurfaceControl.h>
 
+#include <ui/Fence.h>
 #include <ui/HdrCapabilities.h>
 
+#include <utils/RefBase.h>
 #include <utils/Timers.h>
 
+#include <cinttypes>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
 using namespace android::hardware::configstore;
 using namespace android::hardware::configstore::V1_0;
 using namespace android;
@@ -537,3 +546,282 @@ void ASurfaceTransaction_setColor(ASurfaceTransaction* aSurfaceTransaction,
 
     transaction->setBackgroundColor(surfaceControl, color, alpha, static_cast<ui::Dataspace>(dataspace));
 }
+
+struct ASurfaceBufferPool : public LightRefBase<ASurfaceBufferPool> {
+    ASurfaceBufferPool(const AHardwareBuffer_Desc& desc, size_t maxBuffers)
+          : desc(desc), maxBuffers(maxBuffers) {}
+
+    ~ASurfaceBufferPool() {
+        for (auto& [buffer, releaseFence] : freeBuffers) {
+            AHardwareBuffer_release(buffer);
+        }
+    }
+
+    // Takes back a buffer that was handed out by ASurfaceBufferPool_acquire.
+    void recycle(AHardwareBuffer* buffer, const sp<Fence>& releaseFence) {
+        std::lock_guard<std::mutex> guard(lock);
+        freeBuffers.emplace_back(buffer, releaseFence);
+    }
+
+    // Lets go of a buffer that the pool will not see again.
+    void forget(AHardwareBuffer* buffer) {
+        std::lock_guard<std::mutex> guard(lock);
+        AHardwareBuffer_release(buffer);
+        allocated--;
+    }
+
+    const AHardwareBuffer_Desc desc;
+    const size_t maxBuffers;
+
+    std::mutex lock;
+    std::deque<std::pair<AHardwareBuffer*, sp<Fence>>> freeBuffers;  // least recently used first
+    size_t allocated = 0;
+    uint64_t allocations = 0;
+    uint64_t reuses = 0;
+    uint64_t unsignaledReuses = 0;
+};
+
+ASurfaceBufferPool* ASurfaceBufferPool_create(uint32_t width, uint32_t height, uint32_t format,
+                                              uint64_t usage, size_t maxBuffers) {
+    LOG_ALWAYS_FATAL_IF(maxBuffers == 0, "invalid maxBuffers");
+
+    AHardwareBuffer_Desc desc = {};
+    desc.width = width;
+    desc.height = height;
+    desc.layers = 1;
+    desc.format = format;
+    // The buffers always end up being composited.
+    desc.usage = usage | AHARDWAREBUFFER_USAGE_COMPOSER_OVERLAY;
+    if (!AHardwareBuffer_isSupported(&desc)) {
+        ALOGE("unsupported buffer pool description %ux%u format %u usage %" PRIx64,
+              width, height, format, usage);
+        return nullptr;
+    }
+
+    ASurfaceBufferPool* pool = new ASurfaceBufferPool(desc, maxBuffers);
+    pool->incStrong(nullptr);
+    return pool;
+}
+
+void ASurfaceBufferPool_release(ASurfaceBufferPool* pool) {
+    CHECK_NOT_NULL(pool);
+
+    // Buffers that are still on screen keep the pool alive until they come back.
+    pool->decStrong(nullptr);
+}
+
+AHardwareBuffer* ASurfaceBufferPool_acquire(ASurfaceBufferPool* pool, int* outFenceFd) {
+    CHECK_NOT_NULL(pool);
+    CHECK_NOT_NULL(outFenceFd);
+
+    std::lock_guard<std::mutex> guard(pool->lock);
+    *outFenceFd = -1;
+
+    auto& freeBuffers = pool->freeBuffers;
+    if (!freeBuffers.empty()) {
+        // Prefer a buffer the display is already done with, so the caller doesn't wait. Failing
+        // that, the least recently released one is the closest to being done.
+        auto it = freeBuffers.begin();
+        for (auto candidate = freeBuffers.begin(); candidate != freeBuffers.end(); ++candidate) {
+            const sp<Fence>& fence = candidate->second;
+            if (!fence || fence->getStatus() == Fence::Status::Signaled) {
+                it = candidate;
+                break;
+            }
+        }
+
+        AHardwareBuffer* buffer = it->first;
+        sp<Fence> releaseFence = it->second;
+        freeBuffers.erase(it);
+
+        pool->reuses++;
+        if (releaseFence && releaseFence->getStatus() != Fence::Status::Signaled) {
+            pool->unsignaledReuses++;
+            *outFenceFd = releaseFence->dup();
+        }
+        return buffer;
+    }
+
+    if (pool->allocated >= pool->maxBuffers) {
+        return nullptr;
+    }
+
+    AHardwareBuffer* buffer = nullptr;
+    if (AHardwareBuffer_allocate(&pool->desc, &buffer) != 0) {
+        ALOGE("unable to allocate a buffer for the pool");
+        return nullptr;
+    }
+    pool->allocated++;
+    pool->allocations++;
+    return buffer;
+}
+
+void ASurfaceBufferPool_discard(ASurfaceBufferPool* pool, AHardwareBuffer* buffer,
+                                int release_fence_fd) {
+    CHECK_NOT_NULL(pool);
+    CHECK_NOT_NULL(buffer);
+
+    pool->recycle(buffer, release_fence_fd != -1 ? new Fence(release_fence_fd) : nullptr);
+}
+
+void ASurfaceBufferPool_getStats(ASurfaceBufferPool* pool, uint64_t* outAllocations,
+                                 uint64_t* outReuses, uint64_t* outUnsignaledReuses) {
+    CHECK_NOT_NULL(pool);
+
+    std::lock_guard<std::mutex> guard(pool->lock);
+    if (outAllocations) {
+        *outAllocations = pool->allocations;
+    }
+    if (outReuses) {
+        *outReuses = pool->reuses;
+    }
+    if (outUnsignaledReuses) {
+        *outUnsignaledReuses = pool->unsignaledReuses;
+    }
+}
+
+// A buffer handed out by an ASurfaceBufferPool, along with the pool to hand it back to.
+struct PooledBuffer {
+    sp<ASurfaceBufferPool> pool;
+    AHardwareBuffer* buffer;
+};
+
+// Gathers the updates to any number of surface controls into a single transaction, which is
+// applied at most once per frame, and hands the buffers of the pools set on them back once the
+// display has released them.
+struct ASurfaceBatch : public LightRefBase<ASurfaceBatch> {
+    ~ASurfaceBatch() {
+        // Nothing will say when these leave the screen any more.
+        for (auto& [aSurfaceControl, pooled] : pendingBuffers) {
+            pooled.pool->recycle(pooled.buffer, nullptr);
+        }
+        for (auto& [aSurfaceControl, pooled] : displayedBuffers) {
+            pooled.pool->forget(pooled.buffer);
+        }
+    }
+
+    // Called once the transaction that carried frameBuffers has been latched.
+    void onComplete(const std::unordered_map<ASurfaceControl*, PooledBuffer>& frameBuffers,
+                    const std::vector<SurfaceControlStats>& surfaceControlStats) {
+        std::lock_guard<std::mutex> guard(lock);
+        for (const auto& [surfaceControl, acquireTime, previousReleaseFence] :
+                surfaceControlStats) {
+            ASurfaceControl* aSurfaceControl =
+                    reinterpret_cast<ASurfaceControl*>(surfaceControl.get());
+            auto frameBuffer = frameBuffers.find(aSurfaceControl);
+            if (frameBuffer == frameBuffers.end()) {
+                continue;
+            }
+
+            // The buffer the new one replaced is free once its release fence signals.
+            auto displayed = displayedBuffers.find(aSurfaceControl);
+            if (displayed != displayedBuffers.end()) {
+                displayed->second.pool->recycle(displayed->second.buffer, previousReleaseFence);
+                displayed->second = frameBuffer->second;
+            } else {
+                displayedBuffers.emplace(aSurfaceControl, frameBuffer->second);
+            }
+        }
+    }
+
+    Transaction transaction;
+    bool hasUpdates = false;
+    bool applyScheduled = false;
+
+    // The pooled buffers set on the pending transaction.
+    std::unordered_map<ASurfaceControl*, PooledBuffer> pendingBuffers;
+
+    // Guards displayedBuffers, which completion callbacks update from a binder thread.
+    std::mutex lock;
+    std::unordered_map<ASurfaceControl*, PooledBuffer> displayedBuffers;
+};
+
+ASurfaceBatch* ASurfaceBatch_create() {
+    ASurfaceBatch* batch = new ASurfaceBatch;
+    batch->incStrong(nullptr);
+    return batch;
+}
+
+void ASurfaceBatch_release(ASurfaceBatch* batch) {
+    CHECK_NOT_NULL(batch);
+
+    // Pending completion callbacks and frame callbacks hold their own references.
+    batch->decStrong(nullptr);
+}
+
+ASurfaceTransaction* ASurfaceBatch_getTransaction(ASurfaceBatch* batch) {
+    CHECK_NOT_NULL(batch);
+
+    batch->hasUpdates = true;
+    return reinterpret_cast<ASurfaceTransaction*>(&batch->transaction);
+}
+
+void ASurfaceBatch_setBuffer(ASurfaceBatch* batch, ASurfaceControl* aSurfaceControl,
+                             ASurfaceBufferPool* pool, AHardwareBuffer* buffer,
+                             int acquire_fence_fd) {
+    CHECK_NOT_NULL(batch);
+    CHECK_NOT_NULL(aSurfaceControl);
+    CHECK_NOT_NULL(pool);
+    CHECK_NOT_NULL(buffer);
+
+    // A buffer that is replaced before the batch is applied never reaches the display.
+    auto pending = batch->pendingBuffers.find(aSurfaceControl);
+    if (pending != batch->pendingBuffers.end()) {
+        pending->second.pool->recycle(pending->second.buffer, nullptr);
+    }
+    batch->pendingBuffers[aSurfaceControl] = PooledBuffer{pool, buffer};
+
+    ASurfaceTransaction_setBuffer(ASurfaceBatch_getTransaction(batch), aSurfaceControl, buffer,
+                                  acquire_fence_fd);
+}
+
+void ASurfaceBatch_apply(ASurfaceBatch* batch) {
+    CHECK_NOT_NULL(batch);
+
+    if (!batch->hasUpdates) {
+        return;
+    }
+
+    if (!batch->pendingBuffers.empty()) {
+        sp<ASurfaceBatch> self = batch;
+        TransactionCompletedCallbackTakesContext callback =
+                [self, frameBuffers = std::move(batch->pendingBuffers)](
+                        void* /*context*/, nsecs_t /*latchTime*/,
+                        const sp<Fence>& /*presentFence*/,
+                        const std::vector<SurfaceControlStats>& surfaceControlStats) {
+                    self->onComplete(frameBuffers, surfaceControlStats);
+                };
+        batch->pendingBuffers.clear();
+        batch->transaction.addTransactionCompletedCallback(callback, nullptr);
+    }
+
+    // apply() leaves the transaction empty for the next frame.
+    batch->transaction.apply();
+    batch->hasUpdates = false;
+}
+
+static void onBatchFrame(int64_t /*frameTimeNanos*/, void* data) {
+    ASurfaceBatch* batch = reinterpret_cast<ASurfaceBatch*>(data);
+    batch->applyScheduled = false;
+    ASurfaceBatch_apply(batch);
+    batch->decStrong(nullptr);
+}
+
+void ASurfaceBatch_scheduleApply(ASurfaceBatch* batch) {
+    CHECK_NOT_NULL(batch);
+
+    if (batch->applyScheduled) {
+        return;
+    }
+
+    AChoreographer* choreographer = AChoreographer_getInstance();
+    if (choreographer == nullptr) {
+        // No looper on this thread to wait for the next frame with.
+        ASurfaceBatch_apply(batch);
+        return;
+    }
+
+    batch->applyScheduled = true;
+    batch->incStrong(nullptr);
+    AChoreographer_postFrameCallback64(choreographer, onBatchFrame, batch);
+}
@@ -47,14 +47,6 @@ struct XmlDocDeleter {
 using XmlCharUniquePtr = std::unique_ptr<xmlChar, XmlCharDeleter>;
 using XmlDocUniquePtr = std::unique_ptr<xmlDoc, XmlDocDeleter>;
 
-struct ASystemFontIterator {
-    XmlDocUniquePtr mXmlDoc;
-    xmlNode* mFontNode;
-
-    // The OEM customization XML.
-    XmlDocUniquePtr mCustomizationXmlDoc;
-};
-
 struct AFont {
     std::string mFilePath;
     std::unique_ptr<std::string> mLocale;
@@ -64,6 +56,12 @@ struct AFont {
     std::vector<std::pair<uint32_t, float>> mAxes;
 };
 
+struct ASystemFontIterator {
+    // The fonts of the system and OEM customization XML, shared by all iterators.
+    const std::vector<std::unique_ptr<AFont>>* mFonts;
+    size_t mIndex;
+};
+
 struct AFontMatcher {
     minikin::FontStyle mFontStyle;
     uint32_t mLocaleListId = 0;  // 0 is reserved for empty locale ID.
@@ -199,12 +197,75 @@ xmlNode* findFirstFontNode(const XmlDocUniquePtr& doc) {
     return font;
 }
 
+xmlNode* findNextFontNode(const XmlDocUniquePtr& xmlDoc, xmlNode* fontNode) {
+    if (fontNode == nullptr) {
+        if (!xmlDoc) {
+            return nullptr;  // Already at the end.
+        } else {
+            // First time to query font.
+            return findFirstFontNode(xmlDoc);
+        }
+    } else {
+        xmlNode* nextNode = nextSibling(fontNode, FONT_TAG);
+        while (nextNode == nullptr) {
+            xmlNode* family = nextSibling(fontNode->parent, FAMILY_TAG);
+            if (family == nullptr) {
+                break;
+            }
+            nextNode = firstElement(family, FONT_TAG);
+        }
+        return nextNode;
+    }
+}
+
+void appendFonts(const char* xmlPath, const std::string& pathPrefix,
+                 std::vector<std::unique_ptr<AFont>>* out) {
+    XmlDocUniquePtr xmlDoc(xmlReadFile(xmlPath, nullptr, 0));
+    if (!xmlDoc) {
+        return;
+    }
+    for (xmlNode* fontNode = findNextFontNode(xmlDoc, nullptr); fontNode != nullptr;
+            fontNode = findNextFontNode(xmlDoc, fontNode)) {
+        std::unique_ptr<AFont> font = std::make_unique<AFont>();
+        copyFont(xmlDoc, fontNode, font.get(), pathPrefix);
+        if (isFontFileAvailable(font->mFilePath)) {
+            out->push_back(std::move(font));
+        }
+    }
+}
+
+// The font XML lives on read-only partitions, so it is parsed, and the font files are looked
+// up, once per process rather than on every ASystemFontIterator_open().
+const std::vector<std::unique_ptr<AFont>>& getSystemFonts() {
+    static const std::vector<std::unique_ptr<AFont>>* fonts = [] {
+        auto* fonts = new std::vector<std::unique_ptr<AFont>>();
+        appendFonts("/system/etc/fonts.xml", "/system/fonts/", fonts);
+        // TODO: Filter only customizationType="new-named-family"
+        appendFonts("/product/etc/fonts_customization.xml", "/product/fonts/", fonts);
+        return fonts;
+    }();
+    return *fonts;
+}
+
+AFont* cloneFont(const AFont& font) {
+    AFont* result = new AFont();
+    result->mFilePath = font.mFilePath;
+    if (font.mLocale) {
+        result->mLocale = std::make_unique<std::string>(*font.mLocale);
+    }
+    result->mWeight = font.mWeight;
+    result->mItalic = font.mItalic;
+    result->mCollectionIndex = font.mCollectionIndex;
+    result->mAxes = font.mAxes;
+    return result;
+}
+
 }  // namespace
 
 ASystemFontIterator* ASystemFontIterator_open() {
     std::unique_ptr<ASystemFontIterator> ite(new ASystemFontIterator());
-    ite->mXmlDoc.reset(xmlReadFile("/system/etc/fonts.xml", nullptr, 0));
-    ite->mCustomizationXmlDoc.reset(xmlReadFile("/product/etc/fonts_customization.xml", nullptr, 0));
+    ite->mFonts = &getSystemFonts();
+    ite->mIndex = 0;
     return ite.release();
 }
 
@@ -272,62 +333,12 @@ AFont* _Nonnull AFontMatcher_match(
     return result.release();
 }
 
-xmlNode* findNextFontNode(const XmlDocUniquePtr& xmlDoc, xmlNode* fontNode) {
-    if (fontNode == nullptr) {
-        if (!xmlDoc) {
-            return nullptr;  // Already at the end.
-        } else {
-            // First time to query font.
-            return findFirstFontNode(xmlDoc);
-        }
-    } else {
-        xmlNode* nextNode = nextSibling(fontNode, FONT_TAG);
-        while (nextNode == nullptr) {
-            xmlNode* family = nextSibling(fontNode->parent, FAMILY_TAG);
-            if (family == nullptr) {
-                break;
-            }
-            nextNode = firstElement(family, FONT_TAG);
-        }
-        return nextNode;
-    }
-}
-
 AFont* ASystemFontIterator_next(ASystemFontIterator* ite) {
     LOG_ALWAYS_FATAL_IF(ite == nullptr, "nullptr has passed as iterator argument");
-    if (ite->mXmlDoc) {
-        ite->mFontNode = findNextFontNode(ite->mXmlDoc, ite->mFontNode);
-        if (ite->mFontNode == nullptr) {
-            // Reached end of the XML file. Continue OEM customization.
-            ite->mXmlDoc.reset();
-            ite->mFontNode = nullptr;
-        } else {
-            std::unique_ptr<AFont> font = std::make_unique<AFont>();
-            copyFont(ite->mXmlDoc, ite->mFontNode, font.get(), "/system/fonts/");
-            if (!isFontFileAvailable(font->mFilePath)) {
-                return ASystemFontIterator_next(ite);
-            }
-            return font.release();
-        }
-    }
-    if (ite->mCustomizationXmlDoc) {
-        // TODO: Filter only customizationType="new-named-family"
-        ite->mFontNode = findNextFontNode(ite->mCustomizationXmlDoc, ite->mFontNode);
-        if (ite->mFontNode == nullptr) {
-            // Reached end of the XML file. Finishing
-            ite->mCustomizationXmlDoc.reset();
-            ite->mFontNode = nullptr;
-            return nullptr;
-        } else {
-            std::unique_ptr<AFont> font = std::make_unique<AFont>();
-            copyFont(ite->mCustomizationXmlDoc, ite->mFontNode, font.get(), "/product/fonts/");
-            if (!isFontFileAvailable(font->mFilePath)) {
-                return ASystemFontIterator_next(ite);
-            }
-            return font.release();
-        }
+    if (ite->mIndex >= ite->mFonts->size()) {
+        return nullptr;
     }
-    return nullptr;
+    return cloneFont(*(*ite->mFonts)[ite->mIndex++]);
 }
 
 void AFont_close(AFont* font) {
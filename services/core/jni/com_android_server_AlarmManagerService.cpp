@@ -43,6 +43,7 @@
 #include <array>
 #include <limits>
 #include <memory>
+#include <mutex>
 
 namespace android {
 
@@ -73,22 +74,41 @@ static const clockid_t android_alarm_to_clockid[N_ANDROID_TIMERFDS] = {
 
 typedef std::array<int, N_ANDROID_TIMERFDS> TimerFds;
 
+/**
+ * Layout of the array returned by getAlarmStats(): the number of wakeups per alarm type,
+ * the number of RTC change notifications, then the number of set() calls that armed a
+ * timer and the number that were skipped because the timer was already armed for the
+ * same deadline. Must match AlarmManagerService.java.
+ */
+static const size_t ALARM_STATS_TIME_CHANGES = ANDROID_ALARM_TYPE_COUNT;
+static const size_t ALARM_STATS_TIMER_SETS = ALARM_STATS_TIME_CHANGES + 1;
+static const size_t ALARM_STATS_TIMER_SETS_SKIPPED = ALARM_STATS_TIMER_SETS + 1;
+static const size_t ALARM_STATS_COUNT = ALARM_STATS_TIMER_SETS_SKIPPED + 1;
+
 class AlarmImpl
 {
 public:
     AlarmImpl(const TimerFds &fds, int epollfd, const std::string& rtc_dev) :
-        fds{fds}, epollfd{epollfd}, rtc_dev{rtc_dev} { }
+        fds{fds}, epollfd{epollfd}, rtc_dev{rtc_dev}, armed{}, stats{} { }
     ~AlarmImpl();
 
     int set(int type, struct timespec *ts);
     int setTime(struct timeval *tv);
     int waitForAlarm();
     int getTime(int type, struct itimerspec *spec);
+    void getStats(std::array<uint64_t, ALARM_STATS_COUNT> *out);
 
 private:
     const TimerFds fds;
     const int epollfd;
     std::string rtc_dev;
+
+    /* Guards armed and stats. set() and waitForAlarm() run on different threads. */
+    std::mutex lock;
+    /* The deadline each timerfd is armed for, or {0, 0} if it isn't armed or has fired
+       since. set() never arms {0, 0}, which timerfd takes to mean disarm. */
+    std::array<struct timespec, N_ANDROID_TIMERFDS> armed;
+    std::array<uint64_t, ALARM_STATS_COUNT> stats;
 };
 
 AlarmImpl::~AlarmImpl()
@@ -114,11 +134,32 @@ int AlarmImpl::set(int type, struct timespec *ts)
     /* timerfd interprets 0 = disarm, so replace with a practically
        equivalent deadline of 1 ns */
 
+    std::lock_guard<std::mutex> guard(lock);
+    /* AlarmManagerService reprograms the kernel timer after every change to its alarm
+       list, most of which leave the next deadline where it was. */
+    if (armed[type].tv_sec == ts->tv_sec && armed[type].tv_nsec == ts->tv_nsec) {
+        stats[ALARM_STATS_TIMER_SETS_SKIPPED]++;
+        return 0;
+    }
+
     struct itimerspec spec;
     memset(&spec, 0, sizeof(spec));
     memcpy(&spec.it_value, ts, sizeof(spec.it_value));
 
-    return timerfd_settime(fds[type], TFD_TIMER_ABSTIME, &spec, NULL);
+    int result = timerfd_settime(fds[type], TFD_TIMER_ABSTIME, &spec, NULL);
+    if (result == 0) {
+        armed[type] = *ts;
+        stats[ALARM_STATS_TIMER_SETS]++;
+    } else {
+        armed[type] = {};
+    }
+    return result;
+}
+
+void AlarmImpl::getStats(std::array<uint64_t, ALARM_STATS_COUNT> *out)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    *out = stats;
 }
 
 int AlarmImpl::getTime(int type, struct itimerspec *spec)
@@ -178,6 +219,7 @@ int AlarmImpl::waitForAlarm()
     }
 
     int result = 0;
+    std::lock_guard<std::mutex> guard(lock);
     for (int i = 0; i < nevents; i++) {
         uint32_t alarm_idx = events[i].data.u32;
         uint64_t unused;
@@ -187,11 +229,18 @@ int AlarmImpl::waitForAlarm()
         if (err < 0 && errno != EAGAIN) {
             if (alarm_idx == ANDROID_ALARM_TYPE_COUNT && errno == ECANCELED) {
                 result |= ANDROID_ALARM_TIME_CHANGE_MASK;
+                stats[ALARM_STATS_TIME_CHANGES]++;
             } else {
                 return err;
             }
         } else {
             result |= (1 << alarm_idx);
+            // A fired one-shot timer is disarmed, so the next set() must rearm it even for
+            // the same deadline.
+            armed[alarm_idx] = {};
+            if (alarm_idx < ANDROID_ALARM_TYPE_COUNT) {
+                stats[alarm_idx]++;
+            }
         }
     }
 
@@ -367,6 +416,59 @@ static jint android_server_AlarmManagerService_set(JNIEnv*, jobject, jlong nativ
     return result >= 0 ? 0 : errno;
 }
 
+static jint android_server_AlarmManagerService_setAll(JNIEnv* env, jobject, jlong nativeData,
+        jlongArray deadlinesArray)
+{
+    AlarmImpl *impl = reinterpret_cast<AlarmImpl *>(nativeData);
+    /* Pairs of seconds and nanoseconds per alarm type; a negative seconds value leaves
+       that type unchanged. */
+    jlong deadlines[ANDROID_ALARM_TYPE_COUNT * 2];
+    if (deadlinesArray == nullptr
+            || env->GetArrayLength(deadlinesArray) != ANDROID_ALARM_TYPE_COUNT * 2) {
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                "deadlines must hold a seconds, nanoseconds pair per alarm type");
+        return EINVAL;
+    }
+    env->GetLongArrayRegion(deadlinesArray, 0, ANDROID_ALARM_TYPE_COUNT * 2, deadlines);
+
+    int firstError = 0;
+    for (size_t type = 0; type < ANDROID_ALARM_TYPE_COUNT; type++) {
+        if (deadlines[type * 2] < 0) {
+            continue;
+        }
+        struct timespec ts;
+        ts.tv_sec = deadlines[type * 2];
+        ts.tv_nsec = deadlines[type * 2 + 1];
+        if (impl->set(type, &ts) < 0) {
+            ALOGE("Unable to set alarm %zu to %lld.%09lld: %s\n", type,
+                  static_cast<long long>(ts.tv_sec),
+                  static_cast<long long>(ts.tv_nsec), strerror(errno));
+            if (firstError == 0) {
+                firstError = errno;
+            }
+        }
+    }
+    return firstError;
+}
+
+static jlongArray android_server_AlarmManagerService_getAlarmStats(JNIEnv* env, jobject,
+        jlong nativeData)
+{
+    AlarmImpl *impl = reinterpret_cast<AlarmImpl *>(nativeData);
+    std::array<uint64_t, ALARM_STATS_COUNT> stats;
+    impl->getStats(&stats);
+
+    jlong values[ALARM_STATS_COUNT];
+    for (size_t i = 0; i < ALARM_STATS_COUNT; i++) {
+        values[i] = static_cast<jlong>(stats[i]);
+    }
+    jlongArray array = env->NewLongArray(ALARM_STATS_COUNT);
+    if (array != nullptr) {
+        env->SetLongArrayRegion(array, 0, ALARM_STATS_COUNT, values);
+    }
+    return array;
+}
+
 static jint android_server_AlarmManagerService_waitForAlarm(JNIEnv*, jobject, jlong nativeData)
 {
     AlarmImpl *impl = reinterpret_cast<AlarmImpl *>(nativeData);
@@ -391,6 +493,8 @@ static const JNINativeMethod sMethods[] = {
     {"init", "()J", (void*)android_server_AlarmManagerService_init},
     {"close", "(J)V", (void*)android_server_AlarmManagerService_close},
     {"set", "(JIJJ)I", (void*)android_server_AlarmManagerService_set},
+    {"setAll", "(J[J)I", (void*)android_server_AlarmManagerService_setAll},
+    {"getAlarmStats", "(J)[J", (void*)android_server_AlarmManagerService_getAlarmStats},
     {"waitForAlarm", "(J)I", (void*)android_server_AlarmManagerService_waitForAlarm},
     {"setKernelTime", "(JJ)I", (void*)android_server_AlarmManagerService_setKernelTime},
     {"setKernelTimezone", "(JI)I", (void*)android_server_AlarmManagerService_setKernelTimezone},
@@ -18,31 +18,297 @@
 //#define LOG_NDEBUG 0
 
 #include <dirent.h>
+#include <inttypes.h>
+#include <pthread.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
 #include <android-base/stringprintf.h>
 #include <android-base/file.h>
 
 #include <nativehelper/JNIHelp.h>
+#include <nativehelper/ScopedPrimitiveArray.h>
 #include <android_runtime/AndroidRuntime.h>
 #include <jni.h>
+#include <log/log.h>
+#include <utils/ThreadDefs.h>
+#include <utils/Timers.h>
 
+using android::base::ReadFileToString;
 using android::base::StringPrintf;
 using android::base::WriteStringToFile;
 
 namespace android {
 
+// The 1:1 mapping of COMPACT_* enums here must match with the constants from
+// AppCompactor.java.
+enum CompactMode {
+    COMPACT_FILE,
+    COMPACT_ANON,
+    COMPACT_ALL,
+};
+
+// The 1:1 mapping of COMPACT_RESULT_* enums here must match with the constants from
+// AppCompactor.java. They are the layout of each result returned by
+// nativeDrainCompactionResults().
+enum {
+    COMPACT_RESULT_PID,
+    COMPACT_RESULT_MODE,
+    COMPACT_RESULT_STATUS,
+    COMPACT_RESULT_RECLAIMED_BYTES,
+    COMPACT_RESULT_DURATION_US,
+    COMPACT_RESULT_COUNT,
+};
+
+enum CompactStatus {
+    // All of the requested memory was reclaimed.
+    COMPACT_STATUS_DONE,
+    // Only file pages were reclaimed from a COMPACT_ALL request because the budget ran out.
+    COMPACT_STATUS_PARTIAL,
+    // The request was cancelled, or its budget ran out while it was queued.
+    COMPACT_STATUS_SKIPPED,
+    // The process went away or its reclaim file could not be written.
+    COMPACT_STATUS_FAILED,
+};
+
+// Returns the resident set size of a process in bytes, or -1 if it went away.
+static int64_t getRssBytes(int pid) {
+    std::string statm;
+    if (!ReadFileToString(StringPrintf("/proc/%d/statm", pid), &statm)) {
+        return -1;
+    }
+    long long sizePages, residentPages;
+    if (sscanf(statm.c_str(), "%lld %lld", &sizePages, &residentPages) != 2) {
+        return -1;
+    }
+    return residentPages * getpagesize();
+}
+
+static bool reclaim(int pid, const char* type) {
+    return WriteStringToFile(std::string(type), StringPrintf("/proc/%d/reclaim", pid));
+}
+
+// Compacts processes on a small pool of background threads, highest priority first.
+//
+// Each request has a time budget that starts when it is queued. A request whose budget has
+// run out by the time a thread picks it up is skipped, and a COMPACT_ALL request reclaims
+// file pages first and only goes on to anon pages if its budget and the batch allow, since
+// a single write to /proc/pid/reclaim can't be interrupted.
+class CompactionEngine {
+public:
+    static CompactionEngine& getInstance() {
+        static CompactionEngine* engine = new CompactionEngine();
+        return *engine;
+    }
+
+    // Tracks the requests of one submit() call so that the caller can wait for them.
+    struct Batch {
+        std::mutex lock;
+        std::condition_variable done;
+        size_t remaining = 0;
+    };
+
+    std::shared_ptr<Batch> submit(const std::vector<int>& pids, const std::vector<int>& modes,
+            const std::vector<int>& priorities, nsecs_t budget) {
+        std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+        batch->remaining = pids.size();
+        nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+
+        std::lock_guard<std::mutex> lock(mLock);
+        startThreadsLocked();
+        for (size_t i = 0; i < pids.size(); i++) {
+            Request request;
+            request.pid = pids[i];
+            request.mode = modes[i];
+            request.priority = priorities[i];
+            request.sequence = mNextSequence++;
+            request.generation = mGeneration;
+            request.deadline = budget > 0 ? now + budget : 0;
+            request.batch = batch;
+            mQueue.push(request);
+        }
+        mWork.notify_all();
+        return batch;
+    }
+
+    void waitFor(const std::shared_ptr<Batch>& batch) {
+        std::unique_lock<std::mutex> lock(batch->lock);
+        batch->done.wait(lock, [&batch] { return batch->remaining == 0; });
+    }
+
+    // Skips all queued requests and stops COMPACT_ALL requests in progress after their file
+    // pages.
+    void cancelAll() {
+        std::lock_guard<std::mutex> lock(mLock);
+        mGeneration++;
+    }
+
+    std::vector<jlong> drainResults() {
+        std::lock_guard<std::mutex> lock(mLock);
+        std::vector<jlong> results;
+        results.swap(mResults);
+        return results;
+    }
+
+private:
+    // Bounds both the threads and the results kept for AppCompactor if it stops draining them.
+    static const size_t MAX_THREADS = 2;
+    static const size_t MAX_RESULTS = 256 * COMPACT_RESULT_COUNT;
+
+    struct Request {
+        int pid;
+        int mode;
+        int priority;
+        uint64_t sequence;
+        uint64_t generation;
+        nsecs_t deadline;
+        std::shared_ptr<Batch> batch;
+
+        // Orders the queue by descending priority, then by submission.
+        bool operator<(const Request& other) const {
+            if (priority != other.priority) {
+                return priority < other.priority;
+            }
+            return sequence > other.sequence;
+        }
+    };
+
+    CompactionEngine() : mNextSequence(0), mGeneration(0) {}
+
+    void startThreadsLocked() {
+        if (!mThreads.empty()) {
+            return;
+        }
+        size_t count = std::max(1u, std::min(std::thread::hardware_concurrency() / 2,
+                static_cast<unsigned>(MAX_THREADS)));
+        for (size_t i = 0; i < count; i++) {
+            mThreads.emplace_back([this] { threadLoop(); });
+            mThreads.back().detach();
+        }
+    }
+
+    bool isCancelled(const Request& request) {
+        std::lock_guard<std::mutex> lock(mLock);
+        return request.generation != mGeneration;
+    }
+
+    static bool isExpired(const Request& request) {
+        return request.deadline != 0 && systemTime(SYSTEM_TIME_MONOTONIC) >= request.deadline;
+    }
+
+    void threadLoop() {
+        pthread_setname_np(pthread_self(), "AppCompactor");
+        setpriority(PRIO_PROCESS, 0, ANDROID_PRIORITY_BACKGROUND);
+
+        while (true) {
+            Request request;
+            {
+                std::unique_lock<std::mutex> lock(mLock);
+                mWork.wait(lock, [this] { return !mQueue.empty(); });
+                request = mQueue.top();
+                mQueue.pop();
+            }
+            compact(request);
+        }
+    }
+
+    void compact(const Request& request) {
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        int64_t rssBefore = -1;
+        int64_t rssAfter = -1;
+        CompactStatus status;
+
+        if (isCancelled(request) || isExpired(request)) {
+            status = COMPACT_STATUS_SKIPPED;
+        } else if ((rssBefore = getRssBytes(request.pid)) < 0) {
+            status = COMPACT_STATUS_FAILED;
+        } else {
+            bool ok;
+            status = COMPACT_STATUS_DONE;
+            switch (request.mode) {
+                case COMPACT_FILE:
+                    ok = reclaim(request.pid, "file");
+                    break;
+                case COMPACT_ANON:
+                    ok = reclaim(request.pid, "anon");
+                    break;
+                default:
+                    ok = reclaim(request.pid, "file");
+                    if (ok) {
+                        if (isCancelled(request) || isExpired(request)) {
+                            status = COMPACT_STATUS_PARTIAL;
+                        } else {
+                            ok = reclaim(request.pid, "anon");
+                        }
+                    }
+                    break;
+            }
+            if (!ok) {
+                status = COMPACT_STATUS_FAILED;
+            }
+            rssAfter = getRssBytes(request.pid);
+        }
+
+        nsecs_t duration = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+        ALOGV("compacted pid %d mode %d: status %d, %" PRId64 " -> %" PRId64 " bytes in %" PRId64
+                "us", request.pid, request.mode, status, rssBefore, rssAfter,
+                ns2us(duration));
+
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            if (mResults.size() + COMPACT_RESULT_COUNT > MAX_RESULTS) {
+                // Drop the oldest result.
+                mResults.erase(mResults.begin(), mResults.begin() + COMPACT_RESULT_COUNT);
+            }
+            jlong result[COMPACT_RESULT_COUNT];
+            result[COMPACT_RESULT_PID] = request.pid;
+            result[COMPACT_RESULT_MODE] = request.mode;
+            result[COMPACT_RESULT_STATUS] = status;
+            result[COMPACT_RESULT_RECLAIMED_BYTES] =
+                    rssBefore >= 0 && rssAfter >= 0 ? std::max<int64_t>(rssBefore - rssAfter, 0)
+                                                    : 0;
+            result[COMPACT_RESULT_DURATION_US] = ns2us(duration);
+            mResults.insert(mResults.end(), result, result + COMPACT_RESULT_COUNT);
+        }
+
+        std::lock_guard<std::mutex> lock(request.batch->lock);
+        if (--request.batch->remaining == 0) {
+            request.batch->done.notify_all();
+        }
+    }
+
+    std::mutex mLock;
+    std::condition_variable mWork;
+    std::priority_queue<Request> mQueue;
+    std::vector<std::thread> mThreads;
+    std::vector<jlong> mResults;
+    uint64_t mNextSequence;
+    uint64_t mGeneration;
+};
+
 // This performs per-process reclaim on all processes belonging to non-app UIDs.
 // For the most part, these are non-zygote processes like Treble HALs, but it
 // also includes zygote-derived processes that run in system UIDs, like bluetooth
 // or potentially some mainline modules. The only process that should definitely
 // not be compacted is system_server, since compacting system_server around the
 // time of BOOT_COMPLETE could result in perceptible issues.
+//
+// The processes are compacted in parallel on the CompactionEngine threads; this returns once
+// all of them are done.
 static void com_android_server_am_AppCompactor_compactSystem(JNIEnv *, jobject) {
+    std::vector<int> pids;
     std::unique_ptr<DIR, decltype(&closedir)> proc(opendir("/proc"), closedir);
     struct dirent* current;
     while ((current = readdir(proc.get()))) {
@@ -50,9 +316,16 @@ static void com_android_server_am_AppCompactor_compactSystem(JNIEnv *, jobject)
             continue;
         }
 
+        // skip directories that aren't pids before stat()ing them
+        char* end;
+        int pid = strtol(current->d_name, &end, 10);
+        if (end == current->d_name || *end != '\0') {
+            continue;
+        }
+
         // don't compact system_server, rely on persistent compaction during screen off
         // in order to avoid mmap_sem-related stalls
-        if (atoi(current->d_name) == getpid()) {
+        if (pid == getpid()) {
             continue;
         }
 
@@ -69,14 +342,65 @@ static void com_android_server_am_AppCompactor_compactSystem(JNIEnv *, jobject)
             continue;
         }
 
-        std::string reclaim_path = StringPrintf("/proc/%s/reclaim", current->d_name);
-        WriteStringToFile(std::string("all"), reclaim_path);
+        pids.push_back(pid);
+    }
+
+    if (pids.empty()) {
+        return;
+    }
+    CompactionEngine& engine = CompactionEngine::getInstance();
+    engine.waitFor(engine.submit(pids, std::vector<int>(pids.size(), COMPACT_ALL),
+            std::vector<int>(pids.size(), 0), 0));
+}
+
+// Queues the given processes for compaction. Higher priorities are compacted first; budgetMs
+// bounds how long after this call a process may still be compacted, or 0 for no bound.
+static void com_android_server_am_AppCompactor_nativeCompactProcesses(JNIEnv* env, jobject,
+        jintArray pidsArray, jintArray modesArray, jintArray prioritiesArray, jlong budgetMs) {
+    ScopedIntArrayRO pids(env, pidsArray);
+    ScopedIntArrayRO modes(env, modesArray);
+    ScopedIntArrayRO priorities(env, prioritiesArray);
+    if (pids.get() == NULL || modes.get() == NULL || priorities.get() == NULL) {
+        return;
+    }
+    if (modes.size() != pids.size() || priorities.size() != pids.size()) {
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                "pids, modes and priorities must have the same length");
+        return;
+    }
+
+    std::vector<int> pidValues(pids.get(), pids.get() + pids.size());
+    std::vector<int> modeValues(modes.get(), modes.get() + modes.size());
+    std::vector<int> priorityValues(priorities.get(), priorities.get() + priorities.size());
+    CompactionEngine::getInstance().submit(pidValues, modeValues, priorityValues,
+            ms2ns(budgetMs));
+}
+
+static void com_android_server_am_AppCompactor_nativeCancelCompactions(JNIEnv*, jobject) {
+    CompactionEngine::getInstance().cancelAll();
+}
+
+// Returns the results of the compactions finished since the last call, COMPACT_RESULT_COUNT
+// values each.
+static jlongArray com_android_server_am_AppCompactor_nativeDrainCompactionResults(JNIEnv* env,
+        jobject) {
+    std::vector<jlong> results = CompactionEngine::getInstance().drainResults();
+    jlongArray array = env->NewLongArray(results.size());
+    if (array != NULL) {
+        env->SetLongArrayRegion(array, 0, results.size(), results.data());
     }
+    return array;
 }
 
 static const JNINativeMethod sMethods[] = {
     /* name, signature, funcPtr */
     {"compactSystem", "()V", (void*)com_android_server_am_AppCompactor_compactSystem},
+    {"nativeCompactProcesses", "([I[I[IJ)V",
+            (void*)com_android_server_am_AppCompactor_nativeCompactProcesses},
+    {"nativeCancelCompactions", "()V",
+            (void*)com_android_server_am_AppCompactor_nativeCancelCompactions},
+    {"nativeDrainCompactionResults", "()[J",
+            (void*)com_android_server_am_AppCompactor_nativeDrainCompactionResults},
 };
 
 int register_android_server_am_AppCompactor(JNIEnv* env)
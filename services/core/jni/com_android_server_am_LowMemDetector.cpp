@@ -17,13 +17,20 @@
 #define LOG_TAG "LowMemDetector"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <psi/psi.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/epoll.h>
+#include <unistd.h>
 
+#include <atomic>
+
+#include <android-base/unique_fd.h>
 #include <jni.h>
 #include <nativehelper/JNIHelp.h>
 #include <utils/Log.h>
+#include <utils/SystemClock.h>
 
 namespace android {
 
@@ -35,56 +42,154 @@ enum pressure_levels {
     PRESSURE_LEVEL_COUNT = PRESSURE_HIGH
 };
 
-// amount of stall in us for each level
-static constexpr int PSI_LOW_STALL_US = 15000;
-static constexpr int PSI_MEDIUM_STALL_US = 30000;
-static constexpr int PSI_HIGH_STALL_US = 50000;
+// A PSI trigger and the pressure level it reports. Short windows catch sudden stalls; the
+// longer ones catch sustained pressure that never crosses the short thresholds.
+struct psi_trigger {
+    enum psi_stall_type stall_type;
+    int threshold_us;
+    int window_us;
+    uint32_t level;
+};
 
-// stall tracking window size in us
-static constexpr int PSI_WINDOW_SIZE_US = 1000000;
+static constexpr psi_trigger PSI_TRIGGERS[] = {
+    { PSI_SOME, 15000, 1000000, PRESSURE_LOW },
+    { PSI_SOME, 300000, 10000000, PRESSURE_LOW },
+    { PSI_FULL, 30000, 1000000, PRESSURE_MEDIUM },
+    { PSI_FULL, 200000, 10000000, PRESSURE_MEDIUM },
+    { PSI_FULL, 50000, 1000000, PRESSURE_HIGH },
+};
+static constexpr int PSI_TRIGGER_COUNT = sizeof(PSI_TRIGGERS) / sizeof(PSI_TRIGGERS[0]);
 
 static int psi_epollfd = -1;
 
+// The 1:1 mapping of SNAPSHOT_* enums here must match with the constants from
+// LowMemDetector.java.
+enum snapshot_fields {
+    // Current pressure level, as last returned by waitForPressure.
+    SNAPSHOT_LEVEL,
+    // Uptime in ms when the current level was entered.
+    SNAPSHOT_LEVEL_SINCE_MS,
+    // Uptime in ms of the last update.
+    SNAPSHOT_UPDATE_TIME_MS,
+    // Memory stall time in us per second of wall time since the previous update.
+    SNAPSHOT_SOME_STALL_RATE,
+    SNAPSHOT_FULL_STALL_RATE,
+    // Cumulative memory stall time in us.
+    SNAPSHOT_SOME_TOTAL_US,
+    SNAPSHOT_FULL_TOTAL_US,
+    // Number of PSI events received.
+    SNAPSHOT_EVENT_COUNT,
+    SNAPSHOT_FIELD_COUNT
+};
+
+// Pressure state written by the thread in waitForPressure and read by any thread without
+// locking. The sequence number is odd while an update is in progress; readers retry until
+// they see the same even number before and after copying the fields.
+static struct {
+    std::atomic<uint32_t> seq;
+    std::atomic<int64_t> fields[SNAPSHOT_FIELD_COUNT];
+} psi_snapshot;
+
+// Reads the cumulative "some" and "full" stall times from /proc/pressure/memory.
+static bool read_psi_totals(int64_t* some_total_us, int64_t* full_total_us) {
+    android::base::unique_fd fd(
+            TEMP_FAILURE_RETRY(open("/proc/pressure/memory", O_RDONLY | O_CLOEXEC)));
+    if (fd < 0) {
+        return false;
+    }
+    char buf[256];
+    ssize_t len = TEMP_FAILURE_RETRY(read(fd, buf, sizeof(buf) - 1));
+    if (len <= 0) {
+        return false;
+    }
+    buf[len] = '\0';
+
+    const char* some = strstr(buf, "some ");
+    const char* full = strstr(buf, "full ");
+    if (some == nullptr || full == nullptr) {
+        return false;
+    }
+    const char* some_total = strstr(some, "total=");
+    const char* full_total = strstr(full, "total=");
+    if (some_total == nullptr || full_total == nullptr) {
+        return false;
+    }
+    *some_total_us = strtoll(some_total + strlen("total="), nullptr, 10);
+    *full_total_us = strtoll(full_total + strlen("total="), nullptr, 10);
+    return true;
+}
+
+static void update_snapshot(uint32_t level) {
+    // Only waitForPressure writes, so the fields can be read without the sequence here.
+    int64_t now_ms = uptimeMillis();
+    int64_t prev_level = psi_snapshot.fields[SNAPSHOT_LEVEL].load(std::memory_order_relaxed);
+    int64_t prev_time_ms = psi_snapshot.fields[SNAPSHOT_UPDATE_TIME_MS].load(
+            std::memory_order_relaxed);
+    int64_t prev_some_us = psi_snapshot.fields[SNAPSHOT_SOME_TOTAL_US].load(
+            std::memory_order_relaxed);
+    int64_t prev_full_us = psi_snapshot.fields[SNAPSHOT_FULL_TOTAL_US].load(
+            std::memory_order_relaxed);
+
+    int64_t some_us = prev_some_us;
+    int64_t full_us = prev_full_us;
+    bool have_totals = read_psi_totals(&some_us, &full_us);
+    int64_t elapsed_ms = now_ms - prev_time_ms;
+
+    uint32_t seq = psi_snapshot.seq.load(std::memory_order_relaxed);
+    psi_snapshot.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    auto set = [](int field, int64_t value) {
+        psi_snapshot.fields[field].store(value, std::memory_order_relaxed);
+    };
+    set(SNAPSHOT_LEVEL, level);
+    if (level != prev_level || prev_time_ms == 0) {
+        set(SNAPSHOT_LEVEL_SINCE_MS, now_ms);
+    }
+    set(SNAPSHOT_UPDATE_TIME_MS, now_ms);
+    if (have_totals && prev_time_ms != 0 && elapsed_ms > 0) {
+        set(SNAPSHOT_SOME_STALL_RATE, (some_us - prev_some_us) * 1000 / elapsed_ms);
+        set(SNAPSHOT_FULL_STALL_RATE, (full_us - prev_full_us) * 1000 / elapsed_ms);
+    }
+    set(SNAPSHOT_SOME_TOTAL_US, some_us);
+    set(SNAPSHOT_FULL_TOTAL_US, full_us);
+
+    psi_snapshot.seq.store(seq + 2, std::memory_order_release);
+}
+
 static jint android_server_am_LowMemDetector_init(JNIEnv*, jobject) {
     int epollfd;
-    int low_psi_fd;
-    int medium_psi_fd;
-    int high_psi_fd;
+    int psi_fds[PSI_TRIGGER_COUNT];
+    int registered = 0;
 
-    epollfd = epoll_create(PRESSURE_LEVEL_COUNT);
+    epollfd = epoll_create(PSI_TRIGGER_COUNT);
     if (epollfd == -1) {
         ALOGE("epoll_create failed: %s", strerror(errno));
         return -1;
     }
 
-    low_psi_fd = init_psi_monitor(PSI_SOME, PSI_LOW_STALL_US, PSI_WINDOW_SIZE_US);
-    if (low_psi_fd < 0 ||
-        register_psi_monitor(epollfd, low_psi_fd, (void*)PRESSURE_LOW) != 0) {
-        goto low_fail;
-    }
-
-    medium_psi_fd =
-        init_psi_monitor(PSI_FULL, PSI_MEDIUM_STALL_US, PSI_WINDOW_SIZE_US);
-    if (medium_psi_fd < 0 || register_psi_monitor(epollfd, medium_psi_fd,
-                                                  (void*)PRESSURE_MEDIUM) != 0) {
-        goto medium_fail;
-    }
-
-    high_psi_fd =
-        init_psi_monitor(PSI_FULL, PSI_HIGH_STALL_US, PSI_WINDOW_SIZE_US);
-    if (high_psi_fd < 0 ||
-        register_psi_monitor(epollfd, high_psi_fd, (void*)PRESSURE_HIGH) != 0) {
-        goto high_fail;
+    for (; registered < PSI_TRIGGER_COUNT; registered++) {
+        const psi_trigger& trigger = PSI_TRIGGERS[registered];
+        int fd = init_psi_monitor(trigger.stall_type, trigger.threshold_us, trigger.window_us);
+        if (fd < 0) {
+            goto fail;
+        }
+        if (register_psi_monitor(epollfd, fd, (void*)(uintptr_t)trigger.level) != 0) {
+            destroy_psi_monitor(fd);
+            goto fail;
+        }
+        psi_fds[registered] = fd;
     }
 
     psi_epollfd = epollfd;
+    update_snapshot(PRESSURE_NONE);
     return 0;
 
-high_fail:
-    unregister_psi_monitor(epollfd, medium_psi_fd);
-medium_fail:
-    unregister_psi_monitor(epollfd, low_psi_fd);
-low_fail:
+fail:
+    while (registered > 0) {
+        unregister_psi_monitor(epollfd, psi_fds[--registered]);
+        destroy_psi_monitor(psi_fds[registered]);
+    }
     ALOGE("Failed to register psi trigger");
     close(epollfd);
     return -1;
@@ -92,7 +197,7 @@ low_fail:
 
 static jint android_server_am_LowMemDetector_waitForPressure(JNIEnv*, jobject) {
     static uint32_t pressure_level = PRESSURE_NONE;
-    struct epoll_event events[PRESSURE_LEVEL_COUNT];
+    struct epoll_event events[PSI_TRIGGER_COUNT];
     int nevents = 0;
 
     if (psi_epollfd < 0) {
@@ -103,16 +208,17 @@ static jint android_server_am_LowMemDetector_waitForPressure(JNIEnv*, jobject) {
     do {
         if (pressure_level == PRESSURE_NONE) {
             /* Wait for events with no timeout */
-            nevents = epoll_wait(psi_epollfd, events, PRESSURE_LEVEL_COUNT, -1);
+            nevents = epoll_wait(psi_epollfd, events, PSI_TRIGGER_COUNT, -1);
         } else {
             // This is simpler than lmkd. Assume that the memory pressure
             // state will stay high for at least 1s. Within that 1s window,
             // the memory pressure state can go up due to a different FD
             // becoming available or it can go down when that window expires.
             // Accordingly, there's no polling: just epoll_wait with a 1s timeout.
-            nevents = epoll_wait(psi_epollfd, events, PRESSURE_LEVEL_COUNT, 1000);
+            nevents = epoll_wait(psi_epollfd, events, PSI_TRIGGER_COUNT, 1000);
             if (nevents == 0) {
                 pressure_level = PRESSURE_NONE;
+                update_snapshot(pressure_level);
                 return pressure_level;
             }
         }
@@ -138,14 +244,41 @@ static jint android_server_am_LowMemDetector_waitForPressure(JNIEnv*, jobject) {
         }
     }
 
+    psi_snapshot.fields[SNAPSHOT_EVENT_COUNT].fetch_add(nevents, std::memory_order_relaxed);
+    update_snapshot(pressure_level);
     return pressure_level;
 }
 
+// Copies the latest pressure state into out, SNAPSHOT_FIELD_COUNT values indexed by the
+// SNAPSHOT_* constants. Never blocks, so it can be polled from any thread.
+static void android_server_am_LowMemDetector_getPressureSnapshot(JNIEnv* env, jobject,
+        jlongArray out) {
+    if (out == nullptr || env->GetArrayLength(out) < SNAPSHOT_FIELD_COUNT) {
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                "out must hold SNAPSHOT_FIELD_COUNT values");
+        return;
+    }
+
+    jlong values[SNAPSHOT_FIELD_COUNT];
+    uint32_t seq;
+    do {
+        seq = psi_snapshot.seq.load(std::memory_order_acquire);
+        for (int i = 0; i < SNAPSHOT_FIELD_COUNT; i++) {
+            values[i] = psi_snapshot.fields[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((seq & 1) != 0 || seq != psi_snapshot.seq.load(std::memory_order_relaxed));
+
+    env->SetLongArrayRegion(out, 0, SNAPSHOT_FIELD_COUNT, values);
+}
+
 static const JNINativeMethod sMethods[] = {
     /* name, signature, funcPtr */
     {"init", "()I", (void*)android_server_am_LowMemDetector_init},
     {"waitForPressure", "()I",
      (void*)android_server_am_LowMemDetector_waitForPressure},
+    {"getPressureSnapshot", "([J)V",
+     (void*)android_server_am_LowMemDetector_getPressureSnapshot},
 };
 
 int register_android_server_am_LowMemDetector(JNIEnv* env) {
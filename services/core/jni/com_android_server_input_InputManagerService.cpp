@@ -73,6 +73,7 @@
 #include <vector>
 
 #define INDENT "  "
+#define INDENT2 "    "
 
 using android::base::ParseUint;
 using android::base::StringPrintf;
@@ -189,6 +190,70 @@ static std::string getStringElementFromJavaArray(JNIEnv* env, jobjectArray array
     return result;
 }
 
+// --- NativeInputManager ---
+
+// --- LatencyHistogram ---
+
+// Counts latencies in power-of-two buckets from 64us up. Recording is lock-free so that it can
+// be done from any injecting thread.
+class LatencyHistogram {
+public:
+    LatencyHistogram() : mCount(0), mTotalUs(0), mMaxUs(0) {
+        for (std::atomic<uint64_t>& bucket : mBuckets) {
+            bucket = 0;
+        }
+    }
+
+    void record(nsecs_t latency) {
+        uint64_t us = latency > 0 ? ns2us(latency) : 0;
+        size_t bucket = 0;
+        while (bucket < BUCKET_COUNT - 1 && us >= (FIRST_BUCKET_US << bucket)) {
+            bucket++;
+        }
+        mBuckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        mCount.fetch_add(1, std::memory_order_relaxed);
+        mTotalUs.fetch_add(us, std::memory_order_relaxed);
+        uint64_t max = mMaxUs.load(std::memory_order_relaxed);
+        while (us > max && !mMaxUs.compare_exchange_weak(max, us, std::memory_order_relaxed)) {
+        }
+    }
+
+    void dump(std::string& dump, const char* name) const {
+        uint64_t count = mCount.load(std::memory_order_relaxed);
+        if (count == 0) {
+            dump += StringPrintf(INDENT "%s: no events\n", name);
+            return;
+        }
+        dump += StringPrintf(INDENT "%s: count=%" PRIu64 ", mean=%" PRIu64 "us, max=%" PRIu64
+                "us\n", name, count, mTotalUs.load(std::memory_order_relaxed) / count,
+                mMaxUs.load(std::memory_order_relaxed));
+        dump += INDENT2;
+        for (size_t i = 0; i < BUCKET_COUNT; i++) {
+            uint64_t value = mBuckets[i].load(std::memory_order_relaxed);
+            if (value == 0) {
+                continue;
+            }
+            if (i < BUCKET_COUNT - 1) {
+                dump += StringPrintf("<%" PRIu64 "us: %" PRIu64 " ", FIRST_BUCKET_US << i, value);
+            } else {
+                dump += StringPrintf(">=%" PRIu64 "us: %" PRIu64 " ",
+                        FIRST_BUCKET_US << (i - 1), value);
+            }
+        }
+        dump += "\n";
+    }
+
+private:
+    static constexpr uint64_t FIRST_BUCKET_US = 64;
+    static constexpr size_t BUCKET_COUNT = 16; // the last bucket starts at ~1s
+
+    std::atomic<uint64_t> mBuckets[BUCKET_COUNT];
+    std::atomic<uint64_t> mCount;
+    std::atomic<uint64_t> mTotalUs;
+    std::atomic<uint64_t> mMaxUs;
+};
+
+
 // --- NativeInputManager ---
 
 class NativeInputManager : public virtual RefBase,
@@ -230,6 +295,10 @@ public:
     void setPointerCapture(bool enabled);
     void setMotionClassifierEnabled(bool enabled);
 
+    // Injects an event through the dispatcher and records how long the injector waited.
+    int32_t injectInputEvent(const InputEvent* event, int32_t injectorPid, int32_t injectorUid,
+            int32_t syncMode, int32_t timeoutMillis, uint32_t policyFlags);
+
     /* --- InputReaderPolicyInterface implementation --- */
 
     virtual void getReaderConfiguration(InputReaderConfiguration* outConfig);
@@ -317,6 +386,13 @@ private:
 
     std::atomic<bool> mInteractive;
 
+    // Injection latencies, indexed by INPUT_EVENT_INJECTION_SYNC_* mode. Asynchronous
+    // injections measure queueing; the others include dispatch up to the result or the
+    // finished signal of the target.
+    static constexpr size_t INJECTION_SYNC_MODE_COUNT =
+            INPUT_EVENT_INJECTION_SYNC_WAIT_FOR_FINISHED + 1;
+    LatencyHistogram mInjectionLatency[INJECTION_SYNC_MODE_COUNT];
+
     void updateInactivityTimeoutLocked();
     void handleInterceptActions(jint wmActions, nsecs_t when, uint32_t& policyFlags);
     void ensureSpriteControllerLocked();
@@ -385,6 +461,26 @@ void NativeInputManager::dump(std::string& dump) {
 
     mInputManager->getDispatcher()->dump(dump);
     dump += "\n";
+
+    dump += "Input Injection Latency:\n";
+    mInjectionLatency[INPUT_EVENT_INJECTION_SYNC_NONE].dump(dump, "Async (queueing)");
+    mInjectionLatency[INPUT_EVENT_INJECTION_SYNC_WAIT_FOR_RESULT].dump(dump,
+            "Wait for result");
+    mInjectionLatency[INPUT_EVENT_INJECTION_SYNC_WAIT_FOR_FINISHED].dump(dump,
+            "Wait for finished");
+    dump += "\n";
+}
+
+int32_t NativeInputManager::injectInputEvent(const InputEvent* event, int32_t injectorPid,
+        int32_t injectorUid, int32_t syncMode, int32_t timeoutMillis, uint32_t policyFlags) {
+    nsecs_t startTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    int32_t result = mInputManager->getDispatcher()->injectInputEvent(event, injectorPid,
+            injectorUid, syncMode, timeoutMillis, policyFlags);
+    if (result == INPUT_EVENT_INJECTION_SUCCEEDED && syncMode >= 0
+            && size_t(syncMode) < INJECTION_SYNC_MODE_COUNT) {
+        mInjectionLatency[syncMode].record(systemTime(SYSTEM_TIME_MONOTONIC) - startTime);
+    }
+    return result;
 }
 
 bool NativeInputManager::checkAndClearExceptionFromCallback(JNIEnv* env, const char* methodName) {
@@ -1471,11 +1567,8 @@ static void nativeSetInputFilterEnabled(JNIEnv* /* env */, jclass /* clazz */,
     im->getInputManager()->getDispatcher()->setInputFilterEnabled(enabled);
 }
 
-static jint nativeInjectInputEvent(JNIEnv* env, jclass /* clazz */,
-        jlong ptr, jobject inputEventObj, jint injectorPid, jint injectorUid,
-        jint syncMode, jint timeoutMillis, jint policyFlags) {
-    NativeInputManager* im = reinterpret_cast<NativeInputManager*>(ptr);
-
+static jint injectJavaInputEvent(JNIEnv* env, NativeInputManager* im, jobject inputEventObj,
+        jint injectorPid, jint injectorUid, jint syncMode, jint timeoutMillis, jint policyFlags) {
     if (env->IsInstanceOf(inputEventObj, gKeyEventClassInfo.clazz)) {
         KeyEvent keyEvent;
         status_t status = android_view_KeyEvent_toNative(env, inputEventObj, & keyEvent);
@@ -1484,7 +1577,7 @@ static jint nativeInjectInputEvent(JNIEnv* env, jclass /* clazz */,
             return INPUT_EVENT_INJECTION_FAILED;
         }
 
-        return (jint) im->getInputManager()->getDispatcher()->injectInputEvent(
+        return (jint) im->injectInputEvent(
                 & keyEvent, injectorPid, injectorUid, syncMode, timeoutMillis,
                 uint32_t(policyFlags));
     } else if (env->IsInstanceOf(inputEventObj, gMotionEventClassInfo.clazz)) {
@@ -1494,7 +1587,7 @@ static jint nativeInjectInputEvent(JNIEnv* env, jclass /* clazz */,
             return INPUT_EVENT_INJECTION_FAILED;
         }
 
-        return (jint) im->getInputManager()->getDispatcher()->injectInputEvent(
+        return (jint) im->injectInputEvent(
                 motionEvent, injectorPid, injectorUid, syncMode, timeoutMillis,
                 uint32_t(policyFlags));
     } else {
@@ -1503,6 +1596,44 @@ static jint nativeInjectInputEvent(JNIEnv* env, jclass /* clazz */,
     }
 }
 
+static jint nativeInjectInputEvent(JNIEnv* env, jclass /* clazz */,
+        jlong ptr, jobject inputEventObj, jint injectorPid, jint injectorUid,
+        jint syncMode, jint timeoutMillis, jint policyFlags) {
+    NativeInputManager* im = reinterpret_cast<NativeInputManager*>(ptr);
+
+    return injectJavaInputEvent(env, im, inputEventObj, injectorPid, injectorUid, syncMode,
+            timeoutMillis, policyFlags);
+}
+
+// Injects a stream of events, such as a gesture, in one call. All events but the last are
+// queued without waiting; only the last one is injected with syncMode, and since the
+// dispatcher handles injected events in order, waiting for it covers the whole stream.
+// Stops at the first event that fails and returns its result.
+static jint nativeInjectInputEvents(JNIEnv* env, jclass /* clazz */,
+        jlong ptr, jobjectArray inputEventObjArray, jint injectorPid, jint injectorUid,
+        jint syncMode, jint timeoutMillis, jint policyFlags) {
+    NativeInputManager* im = reinterpret_cast<NativeInputManager*>(ptr);
+
+    jsize length = env->GetArrayLength(inputEventObjArray);
+    jint result = INPUT_EVENT_INJECTION_SUCCEEDED;
+    for (jsize i = 0; i < length; i++) {
+        ScopedLocalRef<jobject> inputEventObj(env,
+                env->GetObjectArrayElement(inputEventObjArray, i));
+        if (!inputEventObj.get()) {
+            jniThrowNullPointerException(env, "inputEvents must not contain null");
+            return INPUT_EVENT_INJECTION_FAILED;
+        }
+
+        jint eventSyncMode = i == length - 1 ? syncMode : INPUT_EVENT_INJECTION_SYNC_NONE;
+        result = injectJavaInputEvent(env, im, inputEventObj.get(), injectorPid, injectorUid,
+                eventSyncMode, timeoutMillis, policyFlags);
+        if (result != INPUT_EVENT_INJECTION_SUCCEEDED) {
+            break;
+        }
+    }
+    return result;
+}
+
 static void nativeToggleCapsLock(JNIEnv* env, jclass /* clazz */,
          jlong ptr, jint deviceId) {
     NativeInputManager* im = reinterpret_cast<NativeInputManager*>(ptr);
@@ -1767,6 +1898,8 @@ static const JNINativeMethod gInputManagerMethods[] = {
             (void*) nativeSetInputFilterEnabled },
     { "nativeInjectInputEvent", "(JLandroid/view/InputEvent;IIIII)I",
             (void*) nativeInjectInputEvent },
+    { "nativeInjectInputEvents", "(J[Landroid/view/InputEvent;IIIII)I",
+            (void*) nativeInjectInputEvents },
     { "nativeToggleCapsLock", "(JI)V",
             (void*) nativeToggleCapsLock },
     { "nativeSetInputWindows", "(J[Landroid/view/InputWindowHandle;I)V",
@@ -36,6 +36,7 @@
 #include "android_runtime/Log.h"
 
 #include <arpa/inet.h>
+#include <atomic>
 #include <cinttypes>
 #include <iomanip>
 #include <limits>
@@ -51,9 +52,14 @@ static jclass class_location;
 static jclass class_gnssNavigationMessage;
 static jclass class_gnssClock;
 static jclass class_gnssConfiguration_halInterfaceVersion;
+static jclass class_byteBuffer;
 
 static jobject mCallbacksObj = nullptr;
 
+// Whether measurement and SV status reports are delivered packed into one direct ByteBuffer
+// rather than translated into Java objects. See PackedGnssData.
+static std::atomic<bool> sPackedReportingEnabled(false);
+
 static jmethodID method_reportLocation;
 static jmethodID method_reportStatus;
 static jmethodID method_reportSvStatus;
@@ -75,6 +81,9 @@ static jmethodID method_reportGeofenceRemoveStatus;
 static jmethodID method_reportGeofencePauseStatus;
 static jmethodID method_reportGeofenceResumeStatus;
 static jmethodID method_reportMeasurementData;
+static jmethodID method_reportPackedMeasurementData;
+static jmethodID method_reportPackedSvStatus;
+static jmethodID method_byteBufferAllocateDirect;
 static jmethodID method_reportNavigationMessages;
 static jmethodID method_reportLocationBatch;
 static jmethodID method_reportGnssServiceDied;
@@ -556,6 +565,100 @@ static GnssLocation_V2_0 createGnssLocation_V2_0(
     return location;
 }
 
+/*
+ * Packed measurement and SV status reports.
+ *
+ * When packed reporting is enabled, each HAL report is written into a single direct
+ * ByteBuffer, in native byte order, instead of being translated into one Java object per
+ * satellite. The Java side decodes the buffer lazily, so its layout must match
+ * GnssPackedReports.java. Bump PACKED_GNSS_VERSION whenever it changes.
+ *
+ * Measurement report: PackedGnssDataHeader, PackedGnssClock, then measurementCount
+ * PackedGnssMeasurement.
+ * SV status report: PackedSvStatusHeader, then svCount PackedSvInfo.
+ */
+static constexpr int32_t PACKED_GNSS_VERSION = 1;
+
+enum PackedSvShiftWidth: uint8_t {
+    PACKED_SVID_SHIFT_WIDTH = 8,
+    PACKED_CONSTELLATION_TYPE_SHIFT_WIDTH = 4
+};
+
+struct PackedGnssDataHeader {
+    int32_t version;
+    int32_t measurementCount;
+    int32_t clockSize;
+    int32_t measurementSize;
+};
+
+// flags holds the GnssClockFlags in the low 16 bits and the ElapsedRealtimeFlags in the high
+// 16 bits. Fields whose flag is not set are undefined.
+struct PackedGnssClock {
+    int64_t timeNs;
+    int64_t fullBiasNs;
+    double biasNs;
+    double biasUncertaintyNs;
+    double driftNsps;
+    double driftUncertaintyNsps;
+    double timeUncertaintyNs;
+    int64_t elapsedRealtimeNs;
+    double elapsedRealtimeUncertaintyNs;
+    int32_t flags;
+    int32_t leapSecond;
+    int32_t hwClockDiscontinuityCount;
+    int32_t reserved;
+};
+static_assert(sizeof(PackedGnssClock) == 88, "PackedGnssClock layout changed");
+
+// Holds the same values the GnssMeasurement setters receive in
+// translateSingleGnssMeasurement(). flags are the GnssMeasurementFlags; fields whose flag is
+// not set are undefined. codeType is NUL terminated.
+struct PackedGnssMeasurement {
+    double timeOffsetNs;
+    int64_t receivedSvTimeNs;
+    int64_t receivedSvTimeUncertaintyNs;
+    double cn0DbHz;
+    double pseudorangeRateMps;
+    double pseudorangeRateUncertaintyMps;
+    double accumulatedDeltaRangeM;
+    double accumulatedDeltaRangeUncertaintyM;
+    double snrDb;
+    double agcLevelDb;
+    float carrierFrequencyHz;
+    int32_t flags;
+    int32_t svid;
+    int32_t constellationType;
+    int32_t state;
+    int32_t accumulatedDeltaRangeState;
+    int32_t multipathIndicator;
+    char codeType[8];
+    int32_t reserved;
+};
+static_assert(sizeof(PackedGnssMeasurement) == 120, "PackedGnssMeasurement layout changed");
+
+struct PackedSvStatusHeader {
+    int32_t version;
+    int32_t svCount;
+    int32_t svInfoSize;
+    int32_t reserved;
+};
+
+struct PackedSvInfo {
+    int32_t svidWithFlags;
+    float cn0DbHz;
+    float elevationDegrees;
+    float azimuthDegrees;
+    float carrierFrequencyHz;
+};
+static_assert(sizeof(PackedSvInfo) == 20, "PackedSvInfo layout changed");
+
+// Allocates a Java-owned direct buffer, so that it stays valid for lazy decoding after the
+// callback returns.
+static jobject allocatePackedBuffer(JNIEnv* env, size_t size) {
+    return env->CallStaticObjectMethod(class_byteBuffer, method_byteBufferAllocateDirect,
+            static_cast<jint>(size));
+}
+
 /*
  * GnssCallback class implements the callback methods for IGnss interface.
  */
@@ -598,6 +701,9 @@ private:
     template<class T>
     Return<void> gnssSvStatusCbImpl(const T& svStatus);
 
+    template<class T>
+    Return<void> packedSvStatusCbImpl(JNIEnv* env, const T& svStatus, uint32_t listSize);
+
     uint32_t getGnssSvInfoListSize(const IGnssCallback_V1_0::GnssSvStatus& svStatus) {
         return svStatus.numSvs;
     }
@@ -685,6 +791,10 @@ Return<void> GnssCallback::gnssSvStatusCbImpl(const T& svStatus) {
         listSize = static_cast<uint32_t>(android::hardware::gnss::V1_0::GnssMax::SVS_COUNT);
     }
 
+    if (sPackedReportingEnabled.load(std::memory_order_relaxed)) {
+        return packedSvStatusCbImpl(env, svStatus, listSize);
+    }
+
     jintArray svidWithFlagArray = env->NewIntArray(listSize);
     jfloatArray cn0Array = env->NewFloatArray(listSize);
     jfloatArray elevArray = env->NewFloatArray(listSize);
@@ -736,6 +846,41 @@ Return<void> GnssCallback::gnssSvStatusCbImpl(const T& svStatus) {
     return Void();
 }
 
+template<class T>
+Return<void> GnssCallback::packedSvStatusCbImpl(JNIEnv* env, const T& svStatus,
+        uint32_t listSize) {
+    jobject buffer = allocatePackedBuffer(env,
+            sizeof(PackedSvStatusHeader) + listSize * sizeof(PackedSvInfo));
+    if (buffer == nullptr) {
+        checkAndClearExceptionFromCallback(env, __FUNCTION__);
+        return Void();
+    }
+    uint8_t* data = static_cast<uint8_t*>(env->GetDirectBufferAddress(buffer));
+
+    PackedSvStatusHeader* header = reinterpret_cast<PackedSvStatusHeader*>(data);
+    header->version = PACKED_GNSS_VERSION;
+    header->svCount = listSize;
+    header->svInfoSize = sizeof(PackedSvInfo);
+    header->reserved = 0;
+
+    PackedSvInfo* infos = reinterpret_cast<PackedSvInfo*>(data + sizeof(PackedSvStatusHeader));
+    for (size_t i = 0; i < listSize; ++i) {
+        const IGnssCallback_V1_0::GnssSvInfo& info = getGnssSvInfoOfIndex(svStatus, i);
+        infos[i].svidWithFlags = (info.svid << PACKED_SVID_SHIFT_WIDTH) |
+            (getConstellationType(svStatus, i) << PACKED_CONSTELLATION_TYPE_SHIFT_WIDTH) |
+            static_cast<uint32_t>(info.svFlag);
+        infos[i].cn0DbHz = info.cN0Dbhz;
+        infos[i].elevationDegrees = info.elevationDegrees;
+        infos[i].azimuthDegrees = info.azimuthDegrees;
+        infos[i].carrierFrequencyHz = info.carrierFrequencyHz;
+    }
+
+    env->CallVoidMethod(mCallbacksObj, method_reportPackedSvStatus, buffer);
+    env->DeleteLocalRef(buffer);
+    checkAndClearExceptionFromCallback(env, __FUNCTION__);
+    return Void();
+}
+
 Return<void> GnssCallback::gnssNmeaCb(
     int64_t timestamp, const ::android::hardware::hidl_string& nmea) {
     JNIEnv* env = getJniEnv();
@@ -1006,6 +1151,15 @@ struct GnssMeasurementCallback : public IGnssMeasurementCallback_V2_0 {
     void translateGnssClock(JavaObject& object, const T& data);
 
     void setMeasurementData(JNIEnv* env, jobject clock, jobjectArray measurementArray);
+
+    template<class T>
+    void packAndSetGnssData(JNIEnv* env, const T& data);
+
+    template<class T>
+    void packSingleGnssMeasurement(const T* measurement, PackedGnssMeasurement* packed);
+
+    template<class T>
+    void packGnssClock(const T& data, PackedGnssClock* packed);
 };
 
 Return<void> GnssMeasurementCallback::gnssMeasurementCb_2_0(
@@ -1030,6 +1184,11 @@ template<class T>
 void GnssMeasurementCallback::translateAndSetGnssData(const T& data) {
     JNIEnv* env = getJniEnv();
 
+    if (sPackedReportingEnabled.load(std::memory_order_relaxed)) {
+        packAndSetGnssData(env, data);
+        return;
+    }
+
     JavaObject gnssClockJavaObject(env, class_gnssClock, method_gnssClockCtor);
     translateGnssClock(gnssClockJavaObject, data);
     jobject clock = gnssClockJavaObject.get();
@@ -1226,6 +1385,127 @@ void GnssMeasurementCallback::setMeasurementData(JNIEnv* env, jobject clock,
     env->DeleteLocalRef(gnssMeasurementsEvent);
 }
 
+template<class T>
+void GnssMeasurementCallback::packAndSetGnssData(JNIEnv* env, const T& data) {
+    size_t count = getMeasurementCount(data);
+    jobject buffer = allocatePackedBuffer(env, sizeof(PackedGnssDataHeader)
+            + sizeof(PackedGnssClock) + count * sizeof(PackedGnssMeasurement));
+    if (buffer == nullptr) {
+        checkAndClearExceptionFromCallback(env, __FUNCTION__);
+        return;
+    }
+    uint8_t* bytes = static_cast<uint8_t*>(env->GetDirectBufferAddress(buffer));
+
+    PackedGnssDataHeader* header = reinterpret_cast<PackedGnssDataHeader*>(bytes);
+    header->version = PACKED_GNSS_VERSION;
+    header->measurementCount = count;
+    header->clockSize = sizeof(PackedGnssClock);
+    header->measurementSize = sizeof(PackedGnssMeasurement);
+
+    PackedGnssClock* clock = reinterpret_cast<PackedGnssClock*>(
+            bytes + sizeof(PackedGnssDataHeader));
+    *clock = {};
+    packGnssClock(data, clock);
+
+    PackedGnssMeasurement* measurements = reinterpret_cast<PackedGnssMeasurement*>(
+            bytes + sizeof(PackedGnssDataHeader) + sizeof(PackedGnssClock));
+    for (size_t i = 0; i < count; ++i) {
+        measurements[i] = {};
+        packSingleGnssMeasurement(&(data.measurements[i]), &measurements[i]);
+    }
+
+    env->CallVoidMethod(mCallbacksObj, method_reportPackedMeasurementData, buffer);
+    checkAndClearExceptionFromCallback(env, __FUNCTION__);
+    env->DeleteLocalRef(buffer);
+}
+
+template<>
+void GnssMeasurementCallback::packSingleGnssMeasurement
+        <IGnssMeasurementCallback_V1_0::GnssMeasurement>(
+        const IGnssMeasurementCallback_V1_0::GnssMeasurement* measurement,
+        PackedGnssMeasurement* packed) {
+    packed->flags = static_cast<int32_t>(measurement->flags);
+    packed->svid = static_cast<int32_t>(measurement->svid);
+    packed->constellationType = static_cast<int32_t>(measurement->constellation);
+    packed->timeOffsetNs = measurement->timeOffsetNs;
+    packed->state = static_cast<int32_t>(measurement->state);
+    packed->receivedSvTimeNs = measurement->receivedSvTimeInNs;
+    packed->receivedSvTimeUncertaintyNs = measurement->receivedSvTimeUncertaintyInNs;
+    packed->cn0DbHz = measurement->cN0DbHz;
+    packed->pseudorangeRateMps = measurement->pseudorangeRateMps;
+    packed->pseudorangeRateUncertaintyMps = measurement->pseudorangeRateUncertaintyMps;
+    // Half Cycle state not reported from Hardware in V1_0
+    packed->accumulatedDeltaRangeState =
+            static_cast<int32_t>(measurement->accumulatedDeltaRangeState) &
+            ~ADR_STATE_HALF_CYCLE_REPORTED;
+    packed->accumulatedDeltaRangeM = measurement->accumulatedDeltaRangeM;
+    packed->accumulatedDeltaRangeUncertaintyM = measurement->accumulatedDeltaRangeUncertaintyM;
+    packed->carrierFrequencyHz = measurement->carrierFrequencyHz;
+    packed->multipathIndicator = static_cast<int32_t>(measurement->multipathIndicator);
+    packed->snrDb = measurement->snrDb;
+    packed->agcLevelDb = measurement->agcLevelDb;
+}
+
+template<>
+void GnssMeasurementCallback::packSingleGnssMeasurement
+        <IGnssMeasurementCallback_V1_1::GnssMeasurement>(
+        const IGnssMeasurementCallback_V1_1::GnssMeasurement* measurement_V1_1,
+        PackedGnssMeasurement* packed) {
+    packSingleGnssMeasurement(&(measurement_V1_1->v1_0), packed);
+
+    // Set the V1_1 flag, and mark that new field has valid information for Java Layer
+    packed->accumulatedDeltaRangeState =
+            static_cast<int32_t>(measurement_V1_1->accumulatedDeltaRangeState) |
+            ADR_STATE_HALF_CYCLE_REPORTED;
+}
+
+template<>
+void GnssMeasurementCallback::packSingleGnssMeasurement
+        <IGnssMeasurementCallback_V2_0::GnssMeasurement>(
+        const IGnssMeasurementCallback_V2_0::GnssMeasurement* measurement_V2_0,
+        PackedGnssMeasurement* packed) {
+    packSingleGnssMeasurement(&(measurement_V2_0->v1_1), packed);
+
+    strlcpy(packed->codeType, measurement_V2_0->codeType.c_str(), sizeof(packed->codeType));
+
+    // Overwrite with v2_0.state since v2_0->v1_1->v1_0.state is deprecated.
+    packed->state = static_cast<int32_t>(measurement_V2_0->state);
+
+    // Overwrite with v2_0.constellation since v2_0->v1_1->v1_0.constellation is deprecated.
+    packed->constellationType = static_cast<int32_t>(measurement_V2_0->constellation);
+}
+
+template<class T>
+void GnssMeasurementCallback::packGnssClock(const T& data, PackedGnssClock* packed) {
+    packGnssClock(data.clock, packed);
+}
+
+template<>
+void GnssMeasurementCallback::packGnssClock(
+        const IGnssMeasurementCallback_V1_0::GnssClock& clock, PackedGnssClock* packed) {
+    packed->flags |= static_cast<uint16_t>(clock.gnssClockFlags);
+    packed->leapSecond = static_cast<int32_t>(clock.leapSecond);
+    packed->timeUncertaintyNs = clock.timeUncertaintyNs;
+    packed->fullBiasNs = clock.fullBiasNs;
+    packed->biasNs = clock.biasNs;
+    packed->biasUncertaintyNs = clock.biasUncertaintyNs;
+    packed->driftNsps = clock.driftNsps;
+    packed->driftUncertaintyNsps = clock.driftUncertaintyNsps;
+    packed->timeNs = clock.timeNs;
+    packed->hwClockDiscontinuityCount = clock.hwClockDiscontinuityCount;
+}
+
+template<>
+void GnssMeasurementCallback::packGnssClock(
+        const IGnssMeasurementCallback_V2_0::GnssData& data, PackedGnssClock* packed) {
+    auto elapsedRealtime = data.elapsedRealtime;
+    packed->flags |= static_cast<int32_t>(static_cast<uint16_t>(elapsedRealtime.flags)) << 16;
+    packed->elapsedRealtimeNs = static_cast<int64_t>(elapsedRealtime.timestampNs);
+    packed->elapsedRealtimeUncertaintyNs =
+            static_cast<double>(elapsedRealtime.timeUncertaintyNs);
+    packGnssClock(data.clock, packed);
+}
+
 /*
  * MeasurementCorrectionsCallback implements callback methods of interface
  * IMeasurementCorrectionsCallback.hal.
@@ -1545,6 +1825,8 @@ static void android_location_GnssLocationProvider_class_init_native(JNIEnv* env,
             "(ZLandroid/location/Location;)V");
     method_reportStatus = env->GetMethodID(clazz, "reportStatus", "(I)V");
     method_reportSvStatus = env->GetMethodID(clazz, "reportSvStatus", "(I[I[F[F[F[F)V");
+    method_reportPackedSvStatus = env->GetMethodID(clazz, "reportPackedSvStatus",
+            "(Ljava/nio/ByteBuffer;)V");
     method_reportAGpsStatus = env->GetMethodID(clazz, "reportAGpsStatus", "(II[B)V");
     method_reportNmea = env->GetMethodID(clazz, "reportNmea", "(J)V");
     method_setTopHalCapabilities = env->GetMethodID(clazz, "setTopHalCapabilities", "(I)V");
@@ -1574,6 +1856,10 @@ static void android_location_GnssLocationProvider_class_init_native(JNIEnv* env,
             clazz,
             "reportMeasurementData",
             "(Landroid/location/GnssMeasurementsEvent;)V");
+    method_reportPackedMeasurementData = env->GetMethodID(
+            clazz,
+            "reportPackedMeasurementData",
+            "(Ljava/nio/ByteBuffer;)V");
     method_reportNavigationMessages = env->GetMethodID(
             clazz,
             "reportNavigationMessage",
@@ -1664,6 +1950,11 @@ static void android_location_GnssLocationProvider_class_init_native(JNIEnv* env,
             (jclass) env->NewGlobalRef(gnssConfiguration_halInterfaceVersionClass);
     method_halInterfaceVersionCtor =
             env->GetMethodID(class_gnssConfiguration_halInterfaceVersion, "<init>", "(II)V");
+
+    jclass byteBufferClass = env->FindClass("java/nio/ByteBuffer");
+    class_byteBuffer = (jclass) env->NewGlobalRef(byteBufferClass);
+    method_byteBufferAllocateDirect = env->GetStaticMethodID(class_byteBuffer, "allocateDirect",
+            "(I)Ljava/nio/ByteBuffer;");
 }
 
 /* Initialization needed at system boot and whenever GNSS service dies. */
@@ -2614,6 +2905,11 @@ static jboolean android_location_GnssMeasurementsProvider_start_measurement_coll
     return JNI_TRUE;
 }
 
+static void android_location_GnssLocationProvider_set_packed_reporting_enabled(JNIEnv* /* env */,
+        jobject /* obj */, jboolean enabled) {
+    sPackedReportingEnabled.store(enabled == JNI_TRUE, std::memory_order_relaxed);
+}
+
 static jboolean android_location_GnssMeasurementsProvider_stop_measurement_collection(
         JNIEnv* env,
         jobject obj) {
@@ -3098,6 +3394,8 @@ static const JNINativeMethod sMethods[] = {
             android_location_GnssLocationProvider_get_internal_state)},
     {"native_is_gnss_visibility_control_supported", "()Z", reinterpret_cast<void *>(
             android_location_GnssLocationProvider_is_gnss_visibility_control_supported)},
+    {"native_set_packed_reporting_enabled", "(Z)V", reinterpret_cast<void *>(
+            android_location_GnssLocationProvider_set_packed_reporting_enabled)},
 };
 
 static const JNINativeMethod sMethodsBatching[] = {
@@ -20,6 +20,7 @@
 #include <inttypes.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <algorithm>
 #include <vector>
 
 #include <jni.h>
@@ -32,6 +33,7 @@
 #include <utils/Log.h>
 #include <utils/misc.h>
 
+#include "android-base/file.h"
 #include "android-base/unique_fd.h"
 #include "bpf/BpfUtils.h"
 #include "netdbpf/BpfNetworkStats.h"
@@ -93,118 +95,181 @@ static jlongArray get_long_array(JNIEnv* env, jobject obj, jfieldID field, int s
     return env->NewLongArray(size);
 }
 
+// Parses an unsigned decimal number. Returns NULL if there is none.
+static const char* parseDecimal(const char* pos, const char* end, uint64_t* out) {
+    const char* start = pos;
+    uint64_t value = 0;
+    while (pos < end && *pos >= '0' && *pos <= '9') {
+        value = value * 10 + (*pos - '0');
+        pos++;
+    }
+    *out = value;
+    return pos == start ? NULL : pos;
+}
+
+// Parses a hexadecimal number with an optional 0x prefix. Returns NULL if there is none.
+static const char* parseHex(const char* pos, const char* end, uint64_t* out) {
+    if (end - pos >= 2 && pos[0] == '0' && (pos[1] == 'x' || pos[1] == 'X')) {
+        pos += 2;
+    }
+    const char* start = pos;
+    uint64_t value = 0;
+    while (pos < end) {
+        char c = *pos;
+        int digit;
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            digit = c - 'A' + 10;
+        } else {
+            break;
+        }
+        value = (value << 4) | digit;
+        pos++;
+    }
+    *out = value;
+    return pos == start ? NULL : pos;
+}
+
+static const char* skipSpaces(const char* pos, const char* end) {
+    while (pos < end && *pos == ' ') pos++;
+    return pos;
+}
+
 static int legacyReadNetworkStatsDetail(std::vector<stats_line>* lines,
                                         const std::vector<std::string>& limitIfaces,
                                         int limitTag, int limitUid, const char* path) {
-    FILE* fp = fopen(path, "re");
-    if (fp == NULL) {
+    // Read the whole file at once and parse it in place; xt_qtaguid generates its contents on
+    // every read, so there is nothing to gain from reading it in pieces.
+    std::string contents;
+    if (!base::ReadFileToString(path, &contents)) {
         return -1;
     }
+    lines->reserve(std::count(contents.begin(), contents.end(), '\n'));
 
     int lastIdx = 1;
-    int idx;
-    char buffer[384];
-    while (fgets(buffer, sizeof(buffer), fp) != NULL) {
+    const char* pos = contents.data();
+    const char* const fileEnd = pos + contents.size();
+    while (pos < fileEnd) {
+        const char* lineEnd = static_cast<const char*>(memchr(pos, '\n', fileEnd - pos));
+        if (lineEnd == NULL) {
+            lineEnd = fileEnd;
+        }
+        const char* line = pos;
+        pos = lineEnd + 1;
+
         stats_line s;
-        int64_t rawTag;
-        char* pos = buffer;
-        char* endPos;
+        uint64_t value;
         // First field is the index.
-        idx = (int)strtol(pos, &endPos, 10);
-        //ALOGI("Index #%d: %s", idx, buffer);
-        if (pos == endPos) {
+        const char* p = parseDecimal(line, lineEnd, &value);
+        if (p == NULL) {
             // Skip lines that don't start with in index.  In particular,
             // this will skip the initial header line.
             continue;
         }
+        int idx = (int)value;
         if (idx != lastIdx + 1) {
-            ALOGE("inconsistent idx=%d after lastIdx=%d: %s", idx, lastIdx, buffer);
-            fclose(fp);
+            ALOGE("inconsistent idx=%d after lastIdx=%d: %.*s", idx, lastIdx,
+                    (int)(lineEnd - line), line);
             return -1;
         }
         lastIdx = idx;
-        pos = endPos;
-        // Skip whitespace.
-        while (*pos == ' ') {
-            pos++;
-        }
+        p = skipSpaces(p, lineEnd);
+
         // Next field is iface.
-        int ifaceIdx = 0;
-        while (*pos != ' ' && *pos != 0 && ifaceIdx < (int)(sizeof(s.iface)-1)) {
-            s.iface[ifaceIdx] = *pos;
-            ifaceIdx++;
-            pos++;
+        size_t ifaceLen = 0;
+        while (p < lineEnd && *p != ' ' && ifaceLen < sizeof(s.iface) - 1) {
+            s.iface[ifaceLen++] = *p++;
         }
-        if (*pos != ' ') {
-            ALOGE("bad iface: %s", buffer);
-            fclose(fp);
+        if (p == lineEnd || *p != ' ') {
+            ALOGE("bad iface: %.*s", (int)(lineEnd - line), line);
             return -1;
         }
-        s.iface[ifaceIdx] = 0;
-        if (limitIfaces.size() > 0) {
-            // Is this an iface the caller is interested in?
-            int i = 0;
-            while (i < (int)limitIfaces.size()) {
-                if (limitIfaces[i] == s.iface) {
-                    break;
-                }
-                i++;
-            }
-            if (i >= (int)limitIfaces.size()) {
-                // Nothing matched; skip this line.
-                //ALOGI("skipping due to iface: %s", buffer);
-                continue;
-            }
+        s.iface[ifaceLen] = 0;
+        if (limitIfaces.size() > 0 &&
+                std::find(limitIfaces.begin(), limitIfaces.end(), s.iface) == limitIfaces.end()) {
+            // Nothing matched; skip this line.
+            continue;
         }
+        p = skipSpaces(p, lineEnd);
 
-        // Ignore whitespace
-        while (*pos == ' ') pos++;
-
-        // Find end of tag field
-        endPos = pos;
-        while (*endPos != ' ') endPos++;
-
-        // Three digit field is always 0x0, otherwise parse
-        if (endPos - pos == 3) {
-            rawTag = 0;
-        } else {
-            if (sscanf(pos, "%" PRIx64, &rawTag) != 1) {
-                ALOGE("bad tag: %s", pos);
-                fclose(fp);
-                return -1;
-            }
+        // Tag field; the upper 32 bits are the tag.
+        p = parseHex(p, lineEnd, &value);
+        if (p == NULL) {
+            ALOGE("bad tag: %.*s", (int)(lineEnd - line), line);
+            return -1;
         }
-        s.tag = rawTag >> 32;
+        s.tag = value >> 32;
         if (limitTag != -1 && s.tag != static_cast<uint32_t>(limitTag)) {
-            //ALOGI("skipping due to tag: %s", buffer);
             continue;
         }
-        pos = endPos;
-
-        // Ignore whitespace
-        while (*pos == ' ') pos++;
-
-        // Parse remaining fields.
-        if (sscanf(pos, "%u %u %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64,
-                &s.uid, &s.set, &s.rxBytes, &s.rxPackets,
-                &s.txBytes, &s.txPackets) == 6) {
-            if (limitUid != -1 && static_cast<uint32_t>(limitUid) != s.uid) {
-                //ALOGI("skipping due to uid: %s", buffer);
-                continue;
-            }
-            lines->push_back(s);
-        } else {
-            //ALOGI("skipping due to bad remaining fields: %s", pos);
-        }
-    }
 
-    if (fclose(fp) != 0) {
-        ALOGE("Failed to close netstats file");
-        return -1;
+        // Parse remaining fields: uid, set, rxBytes, rxPackets, txBytes, txPackets.
+        uint64_t fields[6];
+        size_t parsed = 0;
+        while (parsed < 6 && p != NULL) {
+            p = parseDecimal(skipSpaces(p, lineEnd), lineEnd, &fields[parsed]);
+            if (p != NULL) parsed++;
+        }
+        if (parsed != 6) {
+            // Skip lines with bad remaining fields.
+            continue;
+        }
+        s.uid = fields[0];
+        s.set = fields[1];
+        s.rxBytes = fields[2];
+        s.rxPackets = fields[3];
+        s.txBytes = fields[4];
+        s.txPackets = fields[5];
+        if (limitUid != -1 && static_cast<uint32_t>(limitUid) != s.uid) {
+            continue;
+        }
+        lines->push_back(s);
     }
     return 0;
 }
 
+// Creates each distinct interface name as a Java string once per read. Stats have a handful of
+// interfaces and thousands of lines, which mostly come grouped by interface.
+class IfaceStringCache {
+public:
+    explicit IfaceStringCache(JNIEnv* env) : mEnv(env), mLast(-1) {}
+
+    ~IfaceStringCache() {
+        for (jstring string : mStrings) {
+            mEnv->DeleteLocalRef(string);
+        }
+    }
+
+    jstring get(const char* iface) {
+        if (mLast >= 0 && mNames[mLast] == iface) {
+            return mStrings[mLast];
+        }
+        for (size_t i = 0; i < mNames.size(); i++) {
+            if (mNames[i] == iface) {
+                mLast = i;
+                return mStrings[i];
+            }
+        }
+        jstring string = mEnv->NewStringUTF(iface);
+        if (string == NULL) {
+            return NULL;
+        }
+        mNames.push_back(iface);
+        mStrings.push_back(string);
+        mLast = mNames.size() - 1;
+        return string;
+    }
+
+private:
+    JNIEnv* mEnv;
+    std::vector<std::string> mNames;
+    std::vector<jstring> mStrings;
+    ssize_t mLast;
+};
+
 static int statsLinesToNetworkStats(JNIEnv* env, jclass clazz, jobject stats,
                             std::vector<stats_line>& lines) {
     int size = lines.size();
@@ -214,70 +279,79 @@ static int statsLinesToNetworkStats(JNIEnv* env, jclass clazz, jobject stats,
     ScopedLocalRef<jobjectArray> iface(env, get_string_array(env, stats,
             gNetworkStatsClassInfo.iface, size, grow));
     if (iface.get() == NULL) return -1;
-    ScopedIntArrayRW uid(env, get_int_array(env, stats,
+    ScopedLocalRef<jintArray> uid(env, get_int_array(env, stats,
             gNetworkStatsClassInfo.uid, size, grow));
     if (uid.get() == NULL) return -1;
-    ScopedIntArrayRW set(env, get_int_array(env, stats,
+    ScopedLocalRef<jintArray> set(env, get_int_array(env, stats,
             gNetworkStatsClassInfo.set, size, grow));
     if (set.get() == NULL) return -1;
-    ScopedIntArrayRW tag(env, get_int_array(env, stats,
+    ScopedLocalRef<jintArray> tag(env, get_int_array(env, stats,
             gNetworkStatsClassInfo.tag, size, grow));
     if (tag.get() == NULL) return -1;
-    ScopedIntArrayRW metered(env, get_int_array(env, stats,
-            gNetworkStatsClassInfo.metered, size, grow));
-    if (metered.get() == NULL) return -1;
-    ScopedIntArrayRW roaming(env, get_int_array(env, stats,
-            gNetworkStatsClassInfo.roaming, size, grow));
-    if (roaming.get() == NULL) return -1;
-    ScopedIntArrayRW defaultNetwork(env, get_int_array(env, stats,
-            gNetworkStatsClassInfo.defaultNetwork, size, grow));
-    if (defaultNetwork.get() == NULL) return -1;
-    ScopedLongArrayRW rxBytes(env, get_long_array(env, stats,
+    ScopedLocalRef<jlongArray> rxBytes(env, get_long_array(env, stats,
             gNetworkStatsClassInfo.rxBytes, size, grow));
     if (rxBytes.get() == NULL) return -1;
-    ScopedLongArrayRW rxPackets(env, get_long_array(env, stats,
+    ScopedLocalRef<jlongArray> rxPackets(env, get_long_array(env, stats,
             gNetworkStatsClassInfo.rxPackets, size, grow));
     if (rxPackets.get() == NULL) return -1;
-    ScopedLongArrayRW txBytes(env, get_long_array(env, stats,
+    ScopedLocalRef<jlongArray> txBytes(env, get_long_array(env, stats,
             gNetworkStatsClassInfo.txBytes, size, grow));
     if (txBytes.get() == NULL) return -1;
-    ScopedLongArrayRW txPackets(env, get_long_array(env, stats,
+    ScopedLocalRef<jlongArray> txPackets(env, get_long_array(env, stats,
             gNetworkStatsClassInfo.txPackets, size, grow));
     if (txPackets.get() == NULL) return -1;
-    ScopedLongArrayRW operations(env, get_long_array(env, stats,
-            gNetworkStatsClassInfo.operations, size, grow));
-    if (operations.get() == NULL) return -1;
 
+    // Fill the first size elements of each column from one native buffer rather than pinning
+    // and copying back whole arrays, which may have a larger capacity.
+    std::vector<jint> ints(size);
+    std::vector<jlong> longs(size);
+#define FILL_COLUMN(buffer, array, setRegion, field) \
+    do { \
+        for (int i = 0; i < size; i++) buffer[i] = lines[i].field; \
+        env->setRegion(array.get(), 0, size, buffer.data()); \
+    } while (0)
+    FILL_COLUMN(ints, uid, SetIntArrayRegion, uid);
+    FILL_COLUMN(ints, set, SetIntArrayRegion, set);
+    FILL_COLUMN(ints, tag, SetIntArrayRegion, tag);
+    FILL_COLUMN(longs, rxBytes, SetLongArrayRegion, rxBytes);
+    FILL_COLUMN(longs, rxPackets, SetLongArrayRegion, rxPackets);
+    FILL_COLUMN(longs, txBytes, SetLongArrayRegion, txBytes);
+    FILL_COLUMN(longs, txPackets, SetLongArrayRegion, txPackets);
+#undef FILL_COLUMN
+
+    IfaceStringCache ifaceStrings(env);
     for (int i = 0; i < size; i++) {
-        ScopedLocalRef<jstring> ifaceString(env, env->NewStringUTF(lines[i].iface));
-        env->SetObjectArrayElement(iface.get(), i, ifaceString.get());
-
-        uid[i] = lines[i].uid;
-        set[i] = lines[i].set;
-        tag[i] = lines[i].tag;
-        // Metered, roaming and defaultNetwork are populated in Java-land.
-        rxBytes[i] = lines[i].rxBytes;
-        rxPackets[i] = lines[i].rxPackets;
-        txBytes[i] = lines[i].txBytes;
-        txPackets[i] = lines[i].txPackets;
+        jstring ifaceString = ifaceStrings.get(lines[i].iface);
+        if (ifaceString == NULL) return -1;
+        env->SetObjectArrayElement(iface.get(), i, ifaceString);
     }
 
     env->SetIntField(stats, gNetworkStatsClassInfo.size, size);
     if (grow) {
+        // Metered, roaming, defaultNetwork and operations are populated in Java-land; they
+        // only need allocating when the stats grow.
+        ScopedLocalRef<jintArray> metered(env, env->NewIntArray(size));
+        if (metered.get() == NULL) return -1;
+        ScopedLocalRef<jintArray> roaming(env, env->NewIntArray(size));
+        if (roaming.get() == NULL) return -1;
+        ScopedLocalRef<jintArray> defaultNetwork(env, env->NewIntArray(size));
+        if (defaultNetwork.get() == NULL) return -1;
+        ScopedLocalRef<jlongArray> operations(env, env->NewLongArray(size));
+        if (operations.get() == NULL) return -1;
+
         env->SetIntField(stats, gNetworkStatsClassInfo.capacity, size);
         env->SetObjectField(stats, gNetworkStatsClassInfo.iface, iface.get());
-        env->SetObjectField(stats, gNetworkStatsClassInfo.uid, uid.getJavaArray());
-        env->SetObjectField(stats, gNetworkStatsClassInfo.set, set.getJavaArray());
-        env->SetObjectField(stats, gNetworkStatsClassInfo.tag, tag.getJavaArray());
-        env->SetObjectField(stats, gNetworkStatsClassInfo.metered, metered.getJavaArray());
-        env->SetObjectField(stats, gNetworkStatsClassInfo.roaming, roaming.getJavaArray());
-        env->SetObjectField(stats, gNetworkStatsClassInfo.defaultNetwork,
-                defaultNetwork.getJavaArray());
-        env->SetObjectField(stats, gNetworkStatsClassInfo.rxBytes, rxBytes.getJavaArray());
-        env->SetObjectField(stats, gNetworkStatsClassInfo.rxPackets, rxPackets.getJavaArray());
-        env->SetObjectField(stats, gNetworkStatsClassInfo.txBytes, txBytes.getJavaArray());
-        env->SetObjectField(stats, gNetworkStatsClassInfo.txPackets, txPackets.getJavaArray());
-        env->SetObjectField(stats, gNetworkStatsClassInfo.operations, operations.getJavaArray());
+        env->SetObjectField(stats, gNetworkStatsClassInfo.uid, uid.get());
+        env->SetObjectField(stats, gNetworkStatsClassInfo.set, set.get());
+        env->SetObjectField(stats, gNetworkStatsClassInfo.tag, tag.get());
+        env->SetObjectField(stats, gNetworkStatsClassInfo.metered, metered.get());
+        env->SetObjectField(stats, gNetworkStatsClassInfo.roaming, roaming.get());
+        env->SetObjectField(stats, gNetworkStatsClassInfo.defaultNetwork, defaultNetwork.get());
+        env->SetObjectField(stats, gNetworkStatsClassInfo.rxBytes, rxBytes.get());
+        env->SetObjectField(stats, gNetworkStatsClassInfo.rxPackets, rxPackets.get());
+        env->SetObjectField(stats, gNetworkStatsClassInfo.txBytes, txBytes.get());
+        env->SetObjectField(stats, gNetworkStatsClassInfo.txPackets, txPackets.get());
+        env->SetObjectField(stats, gNetworkStatsClassInfo.operations, operations.get());
     }
     return 0;
 }
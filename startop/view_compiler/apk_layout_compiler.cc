@@ -24,16 +24,35 @@
 #include "androidfw/AssetManager2.h"
 #include "androidfw/ResourceTypes.h"
 
+#include <algorithm>
+#include <atomic>
+#include <codecvt>
+#include <cstring>
 #include <iostream>
 #include <locale>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
 
 #include "android-base/stringprintf.h"
 
 namespace startop {
 
 using android::ResXMLParser;
+using android::Res_value;
 using android::base::StringPrintf;
 
+namespace {
+constexpr char16_t kAndroidNamespace[] = u"http://schemas.android.com/apk/res/android";
+constexpr char16_t kToolsNamespace[] = u"http://schemas.android.com/tools";
+
+std::string ToUtf8(const char16_t* s, size_t length) {
+  return std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t>{}.to_bytes(
+      s, s + length);
+}
+}  // namespace
+
 class ResXmlVisitorAdapter {
  public:
   ResXmlVisitorAdapter(ResXMLParser* parser) : parser_{parser} {}
@@ -56,6 +75,9 @@ class ResXmlVisitorAdapter {
           size_t name_length = 0;
           const char16_t* name = parser_->getElementName(&name_length);
           visitor->VisitStartTag(std::u16string{name, name_length});
+          for (size_t i = 0; i < parser_->getAttributeCount(); i++) {
+            visitor->VisitAttribute(GetAttributeName(i), GetAttributeValue(i));
+          }
           break;
         }
         case ResXMLParser::END_TAG:
@@ -68,20 +90,102 @@ class ResXmlVisitorAdapter {
   }
 
  private:
+  // Returns the attribute's name with a prefix for its namespace, as written in the layout source.
+  std::string GetAttributeName(size_t index) const {
+    size_t length = 0;
+    const char16_t* name = parser_->getAttributeName(index, &length);
+    std::string result = ToUtf8(name, length);
+    const char16_t* ns = parser_->getAttributeNamespace(index, &length);
+    if (ns == nullptr) {
+      return result;
+    }
+    const std::u16string ns_string{ns, length};
+    if (ns_string == kAndroidNamespace) {
+      return "android:" + result;
+    }
+    if (ns_string == kToolsNamespace) {
+      return "tools:" + result;
+    }
+    return ToUtf8(ns, length) + ":" + result;
+  }
+
+  // Returns the attribute's value in the form described for LayoutAttribute.
+  std::string GetAttributeValue(size_t index) const {
+    Res_value value;
+    if (parser_->getAttributeValue(index, &value) < 0) {
+      return "?";
+    }
+    switch (value.dataType) {
+      case Res_value::TYPE_STRING: {
+        size_t length = 0;
+        const char16_t* s = parser_->getAttributeStringValue(index, &length);
+        return s != nullptr ? ToUtf8(s, length) : "?";
+      }
+      case Res_value::TYPE_INT_DEC:
+      case Res_value::TYPE_INT_HEX:
+        return std::to_string(static_cast<int32_t>(value.data));
+      case Res_value::TYPE_INT_BOOLEAN:
+        return value.data != 0 ? "true" : "false";
+      case Res_value::TYPE_FLOAT: {
+        float f;
+        memcpy(&f, &value.data, sizeof(f));
+        return StringPrintf("%.9g", f);
+      }
+      case Res_value::TYPE_REFERENCE:
+        return StringPrintf("@0x%08x", value.data);
+      default:
+        // Theme attributes, and values such as dimensions and colors that have no setter here,
+        // are all written as theme attributes so that they are never taken as literal values.
+        return StringPrintf("?0x%08x", value.data);
+    }
+  }
+
   ResXMLParser* parser_;
 };
 
-bool CanCompileLayout(ResXMLParser* parser) {
+bool CanCompileLayout(ResXMLParser* parser, std::string* message = nullptr) {
   ResXmlVisitorAdapter adapter{parser};
   LayoutValidationVisitor visitor;
   adapter.Accept(&visitor);
 
+  if (message) {
+    *message = visitor.message();
+  }
   return visitor.can_compile();
 }
 
 namespace {
+
+struct ApkLayout {
+  std::string name;
+  std::unique_ptr<android::ResXMLTree> xml_tree;
+  bool can_compile{false};
+  std::string message;
+  std::string java_source;  // only used for CompilationTarget::kJavaLanguage
+};
+
+// Calls fn(i) for each i in [0, count) across the available cores.
+template <typename Fn>
+void ParallelFor(size_t count, Fn fn) {
+  const size_t num_threads =
+      std::min<size_t>(count, std::max(1u, std::thread::hardware_concurrency()));
+  std::atomic<size_t> next{0};
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < num_threads; i++) {
+    threads.emplace_back([&]() {
+      for (size_t j = next++; j < count; j = next++) {
+        fn(j);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
 void CompileApkAssetsLayouts(const std::unique_ptr<const android::ApkAssets>& assets,
-                             CompilationTarget target, std::ostream& target_out) {
+                             CompilationTarget target, std::ostream& target_out,
+                             LayoutCompilationReport* report, const LayoutProfile* profile) {
   android::AssetManager2 resources;
   resources.SetApkAssets({assets.get()});
 
@@ -100,6 +204,9 @@ void CompileApkAssetsLayouts(const std::unique_ptr<const android::ApkAssets>& as
       dex_file.MakeClass(StringPrintf("%s.CompiledView", package_name.c_str()))};
   std::vector<dex::MethodBuilder> methods;
 
+  // AssetManager2 is not thread safe, so the layouts are read up front. Each parser walks its
+  // own tree, so validating them and generating Java for them can then happen in parallel.
+  std::vector<ApkLayout> layouts;
   assets->ForEachFile("res/", [&](const android::StringPiece& s, android::FileType) {
     if (s == "layout") {
       auto path = StringPrintf("res/%s/", s.to_string().c_str());
@@ -111,45 +218,71 @@ void CompileApkAssetsLayouts(const std::unique_ptr<const android::ApkAssets>& as
         CHECK(android::kInvalidCookie != cookie);
         const auto dynamic_ref_table = resources.GetDynamicRefTableForCookie(cookie);
         CHECK(nullptr != dynamic_ref_table);
-        android::ResXMLTree xml_tree{dynamic_ref_table};
-        xml_tree.setTo(asset->getBuffer(/*wordAligned=*/true),
-                       asset->getLength(),
-                       /*copy_data=*/true);
-        android::ResXMLParser parser{xml_tree};
-        parser.restart();
-        if (CanCompileLayout(&parser)) {
-          parser.restart();
-          const std::string layout_name = startop::util::FindLayoutNameFromFilename(layout_path);
-          ResXmlVisitorAdapter adapter{&parser};
-          switch (target) {
-            case CompilationTarget::kDex: {
-              methods.push_back(compiled_view.CreateMethod(
-                  layout_name,
-                  dex::Prototype{dex::TypeDescriptor::FromClassname("android.view.View"),
-                                 dex::TypeDescriptor::FromClassname("android.content.Context"),
-                                 dex::TypeDescriptor::Int()}));
-              DexViewBuilder builder(&methods.back());
-              builder.Start();
-              LayoutCompilerVisitor visitor{&builder};
-              adapter.Accept(&visitor);
-              builder.Finish();
-              methods.back().Encode();
-              break;
-            }
-            case CompilationTarget::kJavaLanguage: {
-              JavaLangViewBuilder builder{package_name, layout_name, target_out};
-              builder.Start();
-              LayoutCompilerVisitor visitor{&builder};
-              adapter.Accept(&visitor);
-              builder.Finish();
-              break;
-            }
-          }
-        }
+        ApkLayout layout;
+        layout.name = startop::util::FindLayoutNameFromFilename(layout_path);
+        layout.xml_tree = std::make_unique<android::ResXMLTree>(dynamic_ref_table);
+        layout.xml_tree->setTo(asset->getBuffer(/*wordAligned=*/true),
+                               asset->getLength(),
+                               /*copy_data=*/true);
+        layouts.push_back(std::move(layout));
       });
     }
   });
 
+  ParallelFor(layouts.size(), [&](size_t i) {
+    ApkLayout& layout = layouts[i];
+    if (profile != nullptr && !profile->IsHot(layout.name)) {
+      layout.message = "Not hot in the profile";
+      return;
+    }
+    android::ResXMLParser parser{*layout.xml_tree};
+    parser.restart();
+    layout.can_compile = CanCompileLayout(&parser, &layout.message);
+    if (layout.can_compile && target == CompilationTarget::kJavaLanguage) {
+      parser.restart();
+      ResXmlVisitorAdapter adapter{&parser};
+      std::ostringstream java_out;
+      JavaLangViewBuilder builder{package_name, layout.name, java_out};
+      builder.Start();
+      LayoutCompilerVisitor visitor{&builder};
+      adapter.Accept(&visitor);
+      builder.Finish();
+      layout.java_source = java_out.str();
+    }
+  });
+
+  // The DEX file is shared by every layout's method, so those are emitted one at a time.
+  for (const auto& layout : layouts) {
+    if (report) {
+      report->Add(layout.name, layout.can_compile, layout.message);
+    }
+    if (!layout.can_compile) {
+      continue;
+    }
+    switch (target) {
+      case CompilationTarget::kDex: {
+        android::ResXMLParser parser{*layout.xml_tree};
+        parser.restart();
+        ResXmlVisitorAdapter adapter{&parser};
+        methods.push_back(compiled_view.CreateMethod(
+            layout.name,
+            dex::Prototype{dex::TypeDescriptor::FromClassname("android.view.View"),
+                           dex::TypeDescriptor::FromClassname("android.content.Context"),
+                           dex::TypeDescriptor::Int()}));
+        DexViewBuilder builder(&methods.back());
+        builder.Start();
+        LayoutCompilerVisitor visitor{&builder};
+        adapter.Accept(&visitor);
+        builder.Finish();
+        methods.back().Encode();
+        break;
+      }
+      case CompilationTarget::kJavaLanguage:
+        target_out << layout.java_source;
+        break;
+    }
+  }
+
   if (target == CompilationTarget::kDex) {
     slicer::MemView image{dex_file.CreateImage()};
     target_out.write(image.ptr<const char>(), image.size());
@@ -158,17 +291,19 @@ void CompileApkAssetsLayouts(const std::unique_ptr<const android::ApkAssets>& as
 }  // namespace
 
 void CompileApkLayouts(const std::string& filename, CompilationTarget target,
-                       std::ostream& target_out) {
+                       std::ostream& target_out, LayoutCompilationReport* report,
+                       const LayoutProfile* profile) {
   auto assets = android::ApkAssets::Load(filename);
-  CompileApkAssetsLayouts(assets, target, target_out);
+  CompileApkAssetsLayouts(assets, target, target_out, report, profile);
 }
 
 void CompileApkLayoutsFd(android::base::unique_fd fd, CompilationTarget target,
-                         std::ostream& target_out) {
+                         std::ostream& target_out, LayoutCompilationReport* report,
+                         const LayoutProfile* profile) {
   constexpr const char* friendly_name{"viewcompiler assets"};
   auto assets = android::ApkAssets::LoadFromFd(
       std::move(fd), friendly_name, /*system=*/false, /*force_shared_lib=*/false);
-  CompileApkAssetsLayouts(assets, target, target_out);
+  CompileApkAssetsLayouts(assets, target, target_out, report, profile);
 }
 
 }  // namespace startop
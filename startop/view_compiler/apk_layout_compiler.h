@@ -20,15 +20,22 @@
 #include <string>
 
 #include "android-base/unique_fd.h"
+#include "layout_profile.h"
+#include "layout_validation.h"
 
 namespace startop {
 
 enum class CompilationTarget { kJavaLanguage, kDex };
 
+// Compiles every supported layout in the APK into one class. If report is non-null, it is told
+// which layouts were compiled and why the rest were skipped. If profile is non-null, only the
+// layouts it considers hot are compiled.
 void CompileApkLayouts(const std::string& filename, CompilationTarget target,
-                       std::ostream& target_out);
+                       std::ostream& target_out, LayoutCompilationReport* report = nullptr,
+                       const LayoutProfile* profile = nullptr);
 void CompileApkLayoutsFd(android::base::unique_fd fd, CompilationTarget target,
-                         std::ostream& target_out);
+                         std::ostream& target_out, LayoutCompilationReport* report = nullptr,
+                         const LayoutProfile* profile = nullptr);
 
 }  // namespace startop
 
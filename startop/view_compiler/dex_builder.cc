@@ -30,6 +30,8 @@ using Op = Instruction::Op;
 
 const TypeDescriptor TypeDescriptor::Int() { return TypeDescriptor{"I"}; };
 const TypeDescriptor TypeDescriptor::Void() { return TypeDescriptor{"V"}; };
+const TypeDescriptor TypeDescriptor::Boolean() { return TypeDescriptor{"Z"}; };
+const TypeDescriptor TypeDescriptor::Float() { return TypeDescriptor{"F"}; };
 
 namespace {
 // From https://source.android.com/devices/tech/dalvik/dex-format#dex-file-magic
@@ -368,6 +370,11 @@ void MethodBuilder::BuildConst4(Value target, int value) {
   AddInstruction(Instruction::OpWithArgs(Op::kMove, target, Value::Immediate(value)));
 }
 
+void MethodBuilder::BuildConst(Value target, int32_t value) {
+  AddInstruction(Instruction::OpWithArgs(
+      Op::kMove, target, Value::Immediate(static_cast<uint32_t>(value))));
+}
+
 void MethodBuilder::BuildConstString(Value target, const std::string& value) {
   const ir::String* const dex_string = dex_->GetOrAddString(value);
   AddInstruction(Instruction::OpWithArgs(Op::kMove, target, Value::String(dex_string->orig_index)));
@@ -436,9 +443,14 @@ void MethodBuilder::EncodeMove(const Instruction& instruction) {
   const Value& source = instruction.args()[0];
 
   if (source.is_immediate()) {
-    // TODO: support more registers
-    CHECK_LT(RegisterValue(*instruction.dest()), 16);
-    Encode11n(::dex::Opcode::OP_CONST_4, RegisterValue(*instruction.dest()), source.value());
+    const size_t dest = RegisterValue(*instruction.dest());
+    const int32_t value = static_cast<int32_t>(source.value());
+    if (dest < 16 && -8 <= value && value < 8) {
+      Encode11n(::dex::Opcode::OP_CONST_4, dest, value);
+    } else {
+      CHECK_LT(dest, 256);
+      Encode31i(::dex::Opcode::OP_CONST, dest, static_cast<uint32_t>(value));
+    }
   } else if (source.is_string()) {
     constexpr size_t kMaxRegisters = 256;
     CHECK_LT(RegisterValue(*instruction.dest()), kMaxRegisters);
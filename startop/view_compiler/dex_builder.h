@@ -63,6 +63,8 @@ class TypeDescriptor {
   // Named constructors for base type descriptors.
   static const TypeDescriptor Int();
   static const TypeDescriptor Void();
+  static const TypeDescriptor Boolean();
+  static const TypeDescriptor Float();
 
   // Creates a type descriptor from a fully-qualified class name. For example, it turns the class
   // name java.lang.Object into the descriptor Ljava/lang/Object.
@@ -351,6 +353,8 @@ class MethodBuilder {
   void BuildReturn(Value src, bool is_object = false);
   // const/4
   void BuildConst4(Value target, int value);
+  // Loads any 32-bit constant, such as the bits of a float, using the shortest encoding that fits.
+  void BuildConst(Value target, int32_t value);
   void BuildConstString(Value target, const std::string& value);
   template <typename... T>
   void BuildNew(Value target, TypeDescriptor type, Prototype constructor, const T&... args);
@@ -406,6 +410,13 @@ class MethodBuilder {
     buffer_.push_back(((b & 0xf) << 12) | (a << 8) | ToBits(opcode));
   }
 
+  inline void Encode31i(::dex::Opcode opcode, uint8_t a, uint32_t b) {
+    // aa|op|bbbb(lo)|bbbb(hi)
+    buffer_.push_back((a << 8) | ToBits(opcode));
+    buffer_.push_back(b & 0xffff);
+    buffer_.push_back(b >> 16);
+  }
+
   inline void Encode21c(::dex::Opcode opcode, uint8_t a, uint16_t b) {
     // aa|op|bbbb
     buffer_.push_back((a << 8) | ToBits(opcode));
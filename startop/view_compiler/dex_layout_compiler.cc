@@ -19,6 +19,8 @@
 
 #include "android-base/stringprintf.h"
 
+#include <cstring>
+
 namespace startop {
 
 using android::base::StringPrintf;
@@ -32,6 +34,7 @@ namespace {
 // TODO: these are a bunch of static initializers, which we should avoid. See if
 // we can make them constexpr.
 const TypeDescriptor kAttributeSet = TypeDescriptor::FromClassname("android.util.AttributeSet");
+const TypeDescriptor kCharSequence = TypeDescriptor::FromClassname("java.lang.CharSequence");
 const TypeDescriptor kContext = TypeDescriptor::FromClassname("android.content.Context");
 const TypeDescriptor kLayoutInflater = TypeDescriptor::FromClassname("android.view.LayoutInflater");
 const TypeDescriptor kResources = TypeDescriptor::FromClassname("android.content.res.Resources");
@@ -131,7 +134,44 @@ void DexViewBuilder::BuildTryCreateView(Value dest, Value parent, Value classnam
       try_create_view_.id, dest, inflater_, parent, classname, context_, attrs_));
 }
 
-void DexViewBuilder::StartView(const std::string& name, bool is_viewgroup) {
+void DexViewBuilder::BuildStaticAttributes(Value view,
+                                           const std::vector<StaticAttribute>& attributes) {
+  LiveRegister value = AcquireRegister();
+  for (const auto& attribute : attributes) {
+    TypeDescriptor value_type = TypeDescriptor::Int();
+    switch (attribute.type) {
+      case AttributeValueType::kInt:
+        method_->BuildConst(value, attribute.int_value);
+        break;
+      case AttributeValueType::kBoolean:
+        value_type = TypeDescriptor::Boolean();
+        method_->BuildConst(value, attribute.int_value);
+        break;
+      case AttributeValueType::kFloat: {
+        value_type = TypeDescriptor::Float();
+        int32_t bits;
+        static_assert(sizeof(bits) == sizeof(attribute.float_value));
+        memcpy(&bits, &attribute.float_value, sizeof(bits));
+        method_->BuildConst(value, bits);
+        break;
+      }
+      case AttributeValueType::kString:
+        value_type = kCharSequence;
+        method_->BuildConstString(value, attribute.string_value);
+        break;
+    }
+    // view.setter(value);
+    auto setter = method_->dex_file()->GetOrDeclareMethod(
+        TypeDescriptor::FromClassname(attribute.declaring_class),
+        attribute.setter,
+        Prototype{TypeDescriptor::Void(), value_type});
+    method_->AddInstruction(Instruction::InvokeVirtual(setter.id, /*dest=*/{}, view, value));
+  }
+}
+
+void DexViewBuilder::StartView(
+    const std::string& name, bool is_viewgroup,
+    const std::optional<std::vector<StaticAttribute>>& static_attributes) {
   bool const is_root_view = view_stack_.empty();
 
   // Advance to start tag
@@ -154,11 +194,21 @@ void DexViewBuilder::StartView(const std::string& name, bool is_viewgroup) {
       Instruction::OpWithArgs(Instruction::Op::kBranchNEqz, /*dest=*/{}, view, label));
 
   // If null, create the class directly.
-  method_->BuildNew(view,
-                    TypeDescriptor::FromClassname(ResolveName(name)),
-                    Prototype{TypeDescriptor::Void(), kContext, kAttributeSet},
-                    context_,
-                    attrs_);
+  if (static_attributes.has_value()) {
+    // All of the attributes are applied by setters, so the constructor doesn't need to look them
+    // up in the AttributeSet.
+    method_->BuildNew(view,
+                      TypeDescriptor::FromClassname(ResolveName(name)),
+                      Prototype{TypeDescriptor::Void(), kContext},
+                      context_);
+    BuildStaticAttributes(view, *static_attributes);
+  } else {
+    method_->BuildNew(view,
+                      TypeDescriptor::FromClassname(ResolveName(name)),
+                      Prototype{TypeDescriptor::Void(), kContext, kAttributeSet},
+                      context_,
+                      attrs_);
+  }
 
   method_->AddInstruction(Instruction::OpWithArgs(Instruction::Op::kBindLabel, /*dest=*/{}, label));
 
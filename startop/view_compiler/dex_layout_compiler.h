@@ -18,6 +18,7 @@
 #define DEX_LAYOUT_COMPILER_H_
 
 #include "dex_builder.h"
+#include "static_attributes.h"
 
 #include <codecvt>
 #include <locale>
@@ -36,7 +37,13 @@ class LayoutCompilerVisitor {
   void VisitEndDocument() { builder_->Finish(); }
   void VisitStartTag(const std::u16string& name) {
     parent_stack_.push_back(ViewEntry{
-        std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t>{}.to_bytes(name), {}});
+        std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t>{}.to_bytes(name),
+        {},
+        {}});
+  }
+  // Called for each attribute of the tag most recently started.
+  void VisitAttribute(const std::string& name, const std::string& value) {
+    parent_stack_.back().attributes.push_back({name, value});
   }
   void VisitEndTag() {
     auto entry = parent_stack_.back();
@@ -52,11 +59,13 @@ class LayoutCompilerVisitor {
  private:
   struct ViewEntry {
     std::string name;
+    std::vector<LayoutAttribute> attributes;
     std::vector<ViewEntry> children;
   };
 
   void GenerateCode(const ViewEntry& view) {
-    builder_->StartView(view.name, !view.children.empty());
+    builder_->StartView(
+        view.name, !view.children.empty(), ResolveStaticAttributes(view.name, view.attributes));
     for (const auto& child : view.children) {
       GenerateCode(child);
     }
@@ -74,7 +83,10 @@ class DexViewBuilder {
 
   void Start();
   void Finish();
-  void StartView(const std::string& name, bool is_viewgroup);
+  // If static_attributes is set, the view is created without an AttributeSet and its attributes
+  // are applied with those setters instead.
+  void StartView(const std::string& name, bool is_viewgroup,
+                 const std::optional<std::vector<StaticAttribute>>& static_attributes);
   void FinishView();
 
  private:
@@ -92,6 +104,7 @@ class DexViewBuilder {
   void BuildLayoutResourceToAttributeSet(dex::Value dest, dex::Value layout_resource);
   void BuildXmlNext();
   void BuildTryCreateView(dex::Value dest, dex::Value parent, dex::Value classname);
+  void BuildStaticAttributes(dex::Value view, const std::vector<StaticAttribute>& attributes);
 
   dex::MethodBuilder* method_;
 
@@ -19,8 +19,42 @@
 #include "android-base/stringprintf.h"
 
 using android::base::StringPrintf;
+using startop::AttributeValueType;
+using startop::StaticAttribute;
 using std::string;
 
+namespace {
+string ToJavaLiteral(const StaticAttribute& attribute) {
+  switch (attribute.type) {
+    case AttributeValueType::kInt:
+      return std::to_string(attribute.int_value);
+    case AttributeValueType::kBoolean:
+      return attribute.int_value ? "true" : "false";
+    case AttributeValueType::kFloat:
+      return StringPrintf("%.9gf", attribute.float_value);
+    case AttributeValueType::kString: {
+      string literal = "\"";
+      for (char c : attribute.string_value) {
+        switch (c) {
+          case '"':
+          case '\\':
+            literal += '\\';
+            literal += c;
+            break;
+          case '\n':
+            literal += "\\n";
+            break;
+          default:
+            literal += c;
+        }
+      }
+      return literal + "\"";
+    }
+  }
+  return {};
+}
+}  // namespace
+
 void JavaLangViewBuilder::Start() const {
   out_ << StringPrintf("package %s;\n", package_.c_str())
        << "import android.content.Context;\n"
@@ -67,7 +101,9 @@ void JavaLangViewBuilder::Finish() const {
           "}\n";     // end CompiledView
 }
 
-void JavaLangViewBuilder::StartView(const string& class_name, bool /*is_viewgroup*/) {
+void JavaLangViewBuilder::StartView(
+    const string& class_name, bool /*is_viewgroup*/,
+    const std::optional<std::vector<StaticAttribute>>& static_attributes) {
   const string view_var = MakeVar("view");
   const string layout_var = MakeVar("layout");
   std::string parent = "null";
@@ -80,11 +116,23 @@ void JavaLangViewBuilder::StartView(const string& class_name, bool /*is_viewgrou
                        class_name.c_str(),
                        view_var.c_str(),
                        parent.c_str(),
-                       class_name.c_str())
-       << StringPrintf("      if (%s == null) %s = new %s(context, attrs);\n",
-                       view_var.c_str(),
-                       view_var.c_str(),
                        class_name.c_str());
+  if (static_attributes.has_value()) {
+    out_ << StringPrintf("      if (%s == null) {\n", view_var.c_str())
+         << StringPrintf("        %s = new %s(context);\n", view_var.c_str(), class_name.c_str());
+    for (const auto& attribute : *static_attributes) {
+      out_ << StringPrintf("        %s.%s(%s);\n",
+                           view_var.c_str(),
+                           attribute.setter.c_str(),
+                           ToJavaLiteral(attribute).c_str());
+    }
+    out_ << "      }\n";
+  } else {
+    out_ << StringPrintf("      if (%s == null) %s = new %s(context, attrs);\n",
+                         view_var.c_str(),
+                         view_var.c_str(),
+                         class_name.c_str());
+  }
   if (!view_stack_.empty()) {
     out_ << StringPrintf("      ViewGroup.LayoutParams %s = %s.generateLayoutParams(attrs);\n",
                          layout_var.c_str(),
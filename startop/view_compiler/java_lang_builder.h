@@ -16,7 +16,10 @@
 #ifndef JAVA_LANG_BUILDER_H_
 #define JAVA_LANG_BUILDER_H_
 
+#include "static_attributes.h"
+
 #include <iostream>
+#include <optional>
 #include <sstream>
 #include <vector>
 
@@ -34,8 +37,10 @@ class JavaLangViewBuilder {
   // Finish generating a class, closing off any open curly braces, etc.
   void Finish() const;
 
-  // Begin creating a view (i.e. process the opening tag)
-  void StartView(const std::string& class_name, bool is_viewgroup);
+  // Begin creating a view (i.e. process the opening tag). If static_attributes is set, the view is
+  // created without an AttributeSet and its attributes are applied with those setters instead.
+  void StartView(const std::string& class_name, bool is_viewgroup,
+                 const std::optional<std::vector<startop::StaticAttribute>>& static_attributes);
   // Finish a view, after all of its child nodes have been processed.
   void FinishView();
 
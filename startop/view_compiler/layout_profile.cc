@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "layout_profile.h"
+#include "util.h"
+
+#include <cstdlib>
+#include <limits>
+#include <sstream>
+
+#include "android-base/stringprintf.h"
+
+using android::base::StringPrintf;
+using std::string;
+
+namespace startop {
+
+namespace {
+string NormalizeLayoutName(const string& name) {
+  constexpr char kLayoutClass[] = "R.layout.";
+  const size_t start = name.rfind(kLayoutClass);
+  if (start != string::npos) {
+    return name.substr(start + sizeof(kLayoutClass) - 1);
+  }
+  return util::FindLayoutNameFromFilename(name);
+}
+}  // namespace
+
+bool LayoutProfile::Parse(std::istream& in, string* error) {
+  string line;
+  for (size_t line_number = 1; std::getline(in, line); line_number++) {
+    std::istringstream fields{line};
+    string name;
+    if (!(fields >> name) || name[0] == '#') {
+      continue;
+    }
+
+    uint64_t count = std::numeric_limits<uint64_t>::max();
+    string count_field;
+    if (fields >> count_field) {
+      char* end;
+      count = strtoull(count_field.c_str(), &end, 10);
+      string rest;
+      if (*end != '\0' || count_field[0] == '-' || (fields >> rest && rest[0] != '#')) {
+        if (error) {
+          *error = StringPrintf("line %zu: expected a layout and an optional count", line_number);
+        }
+        return false;
+      }
+    }
+
+    // A layout may be listed more than once, such as in a trace of several app starts.
+    uint64_t& total = layouts_[NormalizeLayoutName(name)];
+    total = count > std::numeric_limits<uint64_t>::max() - total
+                ? std::numeric_limits<uint64_t>::max()
+                : total + count;
+  }
+  return true;
+}
+
+bool LayoutProfile::IsHot(const string& layout_name) const {
+  auto it = layouts_.find(layout_name);
+  if (it == layouts_.end()) {
+    return false;
+  }
+  return it->second >= min_inflations_;
+}
+
+}  // namespace startop
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef VIEW_COMPILER_LAYOUT_PROFILE_H_
+#define VIEW_COMPILER_LAYOUT_PROFILE_H_
+
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <unordered_map>
+
+namespace startop {
+
+// The layouts that are worth compiling, as gathered from a startup profile or an inflation trace.
+//
+// The profile is a text file with one layout per line, optionally followed by the number of times
+// it was inflated:
+//
+//   # comment
+//   activity_main 1
+//   res/layout/list_item.xml 240
+//   R.layout.header
+//
+// Layouts may be named as above. Layouts without a count are always considered hot.
+class LayoutProfile {
+ public:
+  // Adds the layouts listed in the stream. Returns false, and describes the line in error, if the
+  // stream is malformed.
+  bool Parse(std::istream& in, std::string* error = nullptr);
+
+  // Layouts inflated fewer times than this are not considered hot.
+  void set_min_inflations(uint64_t min_inflations) { min_inflations_ = min_inflations; }
+
+  bool IsHot(const std::string& layout_name) const;
+
+  size_t size() const { return layouts_.size(); }
+
+ private:
+  uint64_t min_inflations_{1};
+  // Inflation counts by layout name, saturating at UINT64_MAX for layouts listed without one.
+  std::unordered_map<std::string, uint64_t> layouts_;
+};
+
+}  // namespace startop
+
+#endif  // VIEW_COMPILER_LAYOUT_PROFILE_H_
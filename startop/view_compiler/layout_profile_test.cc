@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "layout_profile.h"
+
+#include "gtest/gtest.h"
+
+#include <sstream>
+
+using startop::LayoutProfile;
+
+TEST(LayoutProfileTest, ParsesLayoutNames) {
+  std::istringstream in{
+      "# layouts inflated during startup\n"
+      "activity_main\n"
+      "\n"
+      "res/layout/list_item.xml 240\n"
+      "com.example.R.layout.header 3  # from a trace\n"};
+  LayoutProfile profile;
+  ASSERT_TRUE(profile.Parse(in));
+  EXPECT_EQ(profile.size(), 3u);
+  EXPECT_TRUE(profile.IsHot("activity_main"));
+  EXPECT_TRUE(profile.IsHot("list_item"));
+  EXPECT_TRUE(profile.IsHot("header"));
+  EXPECT_FALSE(profile.IsHot("settings"));
+}
+
+TEST(LayoutProfileTest, MinInflations) {
+  std::istringstream in{
+      "activity_main\n"
+      "list_item 40\n"
+      "list_item 60\n"
+      "header 3\n"};
+  LayoutProfile profile;
+  ASSERT_TRUE(profile.Parse(in));
+  profile.set_min_inflations(100);
+  EXPECT_TRUE(profile.IsHot("activity_main"));
+  EXPECT_TRUE(profile.IsHot("list_item"));
+  EXPECT_FALSE(profile.IsHot("header"));
+}
+
+TEST(LayoutProfileTest, RejectsMalformedLines) {
+  std::istringstream in{"activity_main\nlist_item many\n"};
+  LayoutProfile profile;
+  std::string error;
+  EXPECT_FALSE(profile.Parse(in, &error));
+  EXPECT_EQ(error, "line 2: expected a layout and an optional count");
+}
@@ -20,6 +20,8 @@
 
 namespace startop {
 
+using android::base::StringPrintf;
+
 void LayoutValidationVisitor::VisitStartTag(const std::u16string& name) {
   if (0 == name.compare(u"merge")) {
     message_ = "Merge tags are not supported";
@@ -39,4 +41,29 @@ void LayoutValidationVisitor::VisitStartTag(const std::u16string& name) {
   }
 }
 
-}  // namespace startop
\ No newline at end of file
+void LayoutCompilationReport::Add(const std::string& layout_name, bool compiled,
+                                  const std::string& message) {
+  total_++;
+  if (compiled) {
+    compiled_++;
+  } else {
+    skipped_[message].push_back(layout_name);
+  }
+}
+
+double LayoutCompilationReport::compiled_percent() const {
+  return total_ == 0 ? 0 : 100.0 * compiled_ / total_;
+}
+
+void LayoutCompilationReport::Print(std::ostream& out) const {
+  out << StringPrintf("Compiled %zu of %zu layouts (%.1f%%)\n", compiled_, total_,
+                      compiled_percent());
+  for (const auto& [reason, layouts] : skipped_) {
+    out << StringPrintf("  %s: %zu\n", reason.c_str(), layouts.size());
+    for (const auto& layout : layouts) {
+      out << "    " << layout << "\n";
+    }
+  }
+}
+
+}  // namespace startop
@@ -19,7 +19,10 @@
 
 #include "dex_builder.h"
 
+#include <map>
+#include <ostream>
 #include <string>
+#include <vector>
 
 namespace startop {
 
@@ -31,6 +34,7 @@ class LayoutValidationVisitor {
   void VisitStartDocument() const {}
   void VisitEndDocument() const {}
   void VisitStartTag(const std::u16string& name);
+  void VisitAttribute(const std::string& /*name*/, const std::string& /*value*/) const {}
   void VisitEndTag() const {}
 
   const std::string& message() const { return message_; }
@@ -41,6 +45,25 @@ class LayoutValidationVisitor {
   bool can_compile_{true};
 };
 
+// Tallies which layouts of an APK were compiled, and why the others were not.
+class LayoutCompilationReport {
+ public:
+  void Add(const std::string& layout_name, bool compiled, const std::string& message);
+
+  size_t total() const { return total_; }
+  size_t compiled() const { return compiled_; }
+  // The percentage of layouts that were compiled, or 0 if there were none.
+  double compiled_percent() const;
+
+  // Writes the totals, followed by the skipped layouts grouped by reason.
+  void Print(std::ostream& out) const;
+
+ private:
+  size_t total_{0};
+  size_t compiled_{0};
+  std::map<std::string, std::vector<std::string>> skipped_;  // layout names by reason
+};
+
 }  // namespace startop
 
 #endif  // LAYOUT_VALIDATION_H_
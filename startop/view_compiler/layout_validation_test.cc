@@ -15,9 +15,14 @@
  */
 #include "tinyxml_layout_parser.h"
 
+#include "layout_validation.h"
+
 #include "gtest/gtest.h"
 
+#include <sstream>
+
 using startop::CanCompileLayout;
+using startop::LayoutCompilationReport;
 using std::string;
 
 namespace {
@@ -161,3 +166,29 @@ TEST(LayoutValidationTest, FragmentNode) {
 </LinearLayout>)";
   ValidateXmlText(xml, /*expected=*/false);
 }
+
+TEST(LayoutCompilationReportTest, Empty) {
+  LayoutCompilationReport report;
+  EXPECT_EQ(report.total(), 0u);
+  EXPECT_EQ(report.compiled(), 0u);
+  EXPECT_EQ(report.compiled_percent(), 0);
+}
+
+TEST(LayoutCompilationReportTest, GroupsSkippedLayoutsByReason) {
+  LayoutCompilationReport report;
+  report.Add("main", /*compiled=*/true, "Okay");
+  report.Add("list_item", /*compiled=*/false, "Merge tags are not supported");
+  report.Add("header", /*compiled=*/false, "Merge tags are not supported");
+  report.Add("details", /*compiled=*/true, "Okay");
+  EXPECT_EQ(report.total(), 4u);
+  EXPECT_EQ(report.compiled(), 2u);
+  EXPECT_EQ(report.compiled_percent(), 50);
+
+  std::ostringstream out;
+  report.Print(out);
+  EXPECT_EQ(out.str(),
+            "Compiled 2 of 4 layouts (50.0%)\n"
+            "  Merge tags are not supported: 2\n"
+            "    list_item\n"
+            "    header\n");
+}
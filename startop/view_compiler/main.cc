@@ -52,6 +52,10 @@ DEFINE_bool(dex, false, "Generate a DEX file instead of Java");
 DEFINE_int32(infd, -1, "Read input from the given file descriptor");
 DEFINE_string(out, kStdoutFilename, "Where to write the generated class");
 DEFINE_string(package, "", "The package name for the generated class (required)");
+DEFINE_bool(report, false, "With --apk, print which layouts were compiled to stderr");
+DEFINE_string(profile, "", "With --apk, only compile the layouts listed in this profile");
+DEFINE_uint64(profile_min_inflations, 1,
+              "Skip layouts that the profile lists as inflated fewer times than this");
 
 template <typename Visitor>
 class XmlVisitorAdapter : public XMLVisitor {
@@ -68,10 +72,14 @@ class XmlVisitorAdapter : public XMLVisitor {
     return true;
   }
 
-  bool VisitEnter(const XMLElement& element, const XMLAttribute* /*firstAttribute*/) override {
+  bool VisitEnter(const XMLElement& element, const XMLAttribute* firstAttribute) override {
     visitor_->VisitStartTag(
         std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t>{}.from_bytes(
             element.Name()));
+    for (const XMLAttribute* attribute = firstAttribute; attribute != nullptr;
+         attribute = attribute->Next()) {
+      visitor_->VisitAttribute(attribute->Name(), attribute->Value());
+    }
     return true;
   }
 
@@ -120,16 +128,36 @@ int main(int argc, char** argv) {
   if (FLAGS_apk) {
     const startop::CompilationTarget target =
         FLAGS_dex ? startop::CompilationTarget::kDex : startop::CompilationTarget::kJavaLanguage;
+    startop::LayoutCompilationReport report;
+    startop::LayoutCompilationReport* const report_out = FLAGS_report ? &report : nullptr;
+    startop::LayoutProfile profile;
+    if (!FLAGS_profile.empty()) {
+      std::ifstream profile_file{FLAGS_profile};
+      string error;
+      if (!profile_file || !profile.Parse(profile_file, &error)) {
+        LOG(ERROR) << "Could not read profile " << FLAGS_profile << ": " << error;
+        return 1;
+      }
+      profile.set_min_inflations(FLAGS_profile_min_inflations);
+    }
+    const startop::LayoutProfile* const profile_in = FLAGS_profile.empty() ? nullptr : &profile;
     if (FLAGS_infd >= 0) {
-      startop::CompileApkLayoutsFd(
-          android::base::unique_fd{FLAGS_infd}, target, is_stdout ? std::cout : outfile);
+      startop::CompileApkLayoutsFd(android::base::unique_fd{FLAGS_infd},
+                                   target,
+                                   is_stdout ? std::cout : outfile,
+                                   report_out,
+                                   profile_in);
     } else {
       if (argc < 2) {
         gflags::ShowUsageWithFlags(argv[kProgramName]);
         return 1;
       }
       const char* const filename = argv[kFileNameParam];
-      startop::CompileApkLayouts(filename, target, is_stdout ? std::cout : outfile);
+      startop::CompileApkLayouts(
+          filename, target, is_stdout ? std::cout : outfile, report_out, profile_in);
+    }
+    if (FLAGS_report) {
+      report.Print(std::cerr);
     }
     return 0;
   }
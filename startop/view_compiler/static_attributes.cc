@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "static_attributes.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+namespace startop {
+
+namespace {
+
+constexpr char kView[] = "android.view.View";
+constexpr char kTextView[] = "android.widget.TextView";
+constexpr char kLinearLayout[] = "android.widget.LinearLayout";
+
+enum class ValueFormat { kResourceId, kEnum, kBoolean, kFloat, kString };
+
+struct EnumValue {
+  const char* name;
+  int32_t value;         // the value a compiled layout stores for the name
+  int32_t setter_value;  // the argument the setter takes for it
+};
+
+// Terminated by an entry with a null name.
+constexpr EnumValue kVisibilityValues[] = {
+    {"visible", 0, 0}, {"invisible", 1, 4}, {"gone", 2, 8}, {nullptr, 0, 0}};
+constexpr EnumValue kOrientationValues[] = {
+    {"horizontal", 0, 0}, {"vertical", 1, 1}, {nullptr, 0, 0}};
+
+// The framework views that an attribute of a subclass of View applies to, terminated by a null
+// entry. Custom views might not extend the class that declares the setter.
+constexpr const char* kTextViews[] = {"TextView",
+                                      "Button",
+                                      "EditText",
+                                      "CheckBox",
+                                      "CheckedTextView",
+                                      "RadioButton",
+                                      "Switch",
+                                      "ToggleButton",
+                                      nullptr};
+constexpr const char* kLinearLayouts[] = {"LinearLayout", "RadioGroup", nullptr};
+
+struct AttributeSetter {
+  const char* attribute;
+  const char* declaring_class;
+  const char* setter;
+  ValueFormat format;
+  const char* const* view_classes;  // nullptr if it applies to every view
+  const EnumValue* enum_values;
+};
+
+constexpr AttributeSetter kSetters[] = {
+    {"android:id", kView, "setId", ValueFormat::kResourceId, nullptr, nullptr},
+    {"android:visibility", kView, "setVisibility", ValueFormat::kEnum, nullptr, kVisibilityValues},
+    {"android:enabled", kView, "setEnabled", ValueFormat::kBoolean, nullptr, nullptr},
+    {"android:clickable", kView, "setClickable", ValueFormat::kBoolean, nullptr, nullptr},
+    {"android:longClickable", kView, "setLongClickable", ValueFormat::kBoolean, nullptr, nullptr},
+    {"android:alpha", kView, "setAlpha", ValueFormat::kFloat, nullptr, nullptr},
+    {"android:rotation", kView, "setRotation", ValueFormat::kFloat, nullptr, nullptr},
+    {"android:text", kTextView, "setText", ValueFormat::kString, kTextViews, nullptr},
+    {"android:orientation",
+     kLinearLayout,
+     "setOrientation",
+     ValueFormat::kEnum,
+     kLinearLayouts,
+     kOrientationValues},
+};
+
+bool StartsWith(const std::string& s, const char* prefix) {
+  return s.compare(0, strlen(prefix), prefix) == 0;
+}
+
+// Attributes that have no effect on the view itself.
+bool IsIgnoredAttribute(const std::string& name) {
+  return StartsWith(name, "xmlns:") || StartsWith(name, "tools:") ||
+         StartsWith(name, "android:layout_");
+}
+
+// Whether the value depends on resources or the theme, rather than being written out in full.
+bool IsReference(const std::string& value) {
+  return !value.empty() && (value[0] == '@' || value[0] == '?');
+}
+
+bool ListContains(const char* const* list, const std::string& name) {
+  for (; *list != nullptr; list++) {
+    if (name == *list) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ParseInt(const std::string& value, int base, int32_t* out) {
+  if (value.empty()) {
+    return false;
+  }
+  char* end;
+  const long long result = strtoll(value.c_str(), &end, base);
+  if (*end != '\0' || result < INT32_MIN || result > UINT32_MAX) {
+    return false;
+  }
+  *out = static_cast<int32_t>(result);
+  return true;
+}
+
+bool ResolveValue(const AttributeSetter& setter, const std::string& value,
+                  StaticAttribute* attribute) {
+  switch (setter.format) {
+    case ValueFormat::kResourceId:
+      // Only a compiled layout knows the actual id.
+      attribute->type = AttributeValueType::kInt;
+      return StartsWith(value, "@0x") && ParseInt(value.substr(3), 16, &attribute->int_value);
+    case ValueFormat::kEnum: {
+      attribute->type = AttributeValueType::kInt;
+      int32_t compiled_value;
+      const bool is_compiled = ParseInt(value, 10, &compiled_value);
+      for (const EnumValue* e = setter.enum_values; e->name != nullptr; e++) {
+        if (is_compiled ? compiled_value == e->value : value == e->name) {
+          attribute->int_value = e->setter_value;
+          return true;
+        }
+      }
+      return false;
+    }
+    case ValueFormat::kBoolean:
+      attribute->type = AttributeValueType::kBoolean;
+      attribute->int_value = value == "true";
+      return value == "true" || value == "false";
+    case ValueFormat::kFloat: {
+      attribute->type = AttributeValueType::kFloat;
+      if (value.empty() || IsReference(value)) {
+        return false;
+      }
+      char* end;
+      attribute->float_value = strtof(value.c_str(), &end);
+      return *end == '\0' && std::isfinite(attribute->float_value);
+    }
+    case ValueFormat::kString:
+      attribute->type = AttributeValueType::kString;
+      attribute->string_value = value;
+      return !IsReference(value);
+  }
+  return false;
+}
+
+}  // namespace
+
+std::optional<std::vector<StaticAttribute>> ResolveStaticAttributes(
+    const std::string& view_class, const std::vector<LayoutAttribute>& attributes) {
+  // Only framework views are known to have a constructor that takes just a Context.
+  if (view_class.find('.') != std::string::npos) {
+    return std::nullopt;
+  }
+
+  std::vector<StaticAttribute> result;
+  for (const auto& attribute : attributes) {
+    if (IsIgnoredAttribute(attribute.name)) {
+      continue;
+    }
+    const AttributeSetter* setter = nullptr;
+    for (const auto& candidate : kSetters) {
+      if (attribute.name == candidate.attribute) {
+        setter = &candidate;
+        break;
+      }
+    }
+    if (setter == nullptr ||
+        (setter->view_classes != nullptr && !ListContains(setter->view_classes, view_class))) {
+      return std::nullopt;
+    }
+
+    StaticAttribute resolved;
+    resolved.declaring_class = setter->declaring_class;
+    resolved.setter = setter->setter;
+    if (!ResolveValue(*setter, attribute.value, &resolved)) {
+      return std::nullopt;
+    }
+    result.push_back(std::move(resolved));
+  }
+  return result;
+}
+
+}  // namespace startop
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef VIEW_COMPILER_STATIC_ATTRIBUTES_H_
+#define VIEW_COMPILER_STATIC_ATTRIBUTES_H_
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace startop {
+
+// An attribute of a view in a layout. The name carries a namespace prefix, such as
+// "android:visibility", and the value is written the way it would appear in the layout source,
+// such as "gone". Compiled layouts only keep resolved values, so there references are written as
+// "@0x7f0a0001" and theme attributes as "?0x01010036".
+struct LayoutAttribute {
+  std::string name;
+  std::string value;
+};
+
+enum class AttributeValueType { kInt, kBoolean, kFloat, kString };
+
+// A setter call with the same effect as a layout attribute, e.g. setVisibility(View.GONE) for
+// android:visibility="gone".
+struct StaticAttribute {
+  std::string declaring_class;  // e.g. "android.view.View"
+  std::string setter;
+  AttributeValueType type{AttributeValueType::kInt};
+  int32_t int_value{0};  // kInt, or 0 and 1 for kBoolean
+  float float_value{0};
+  std::string string_value;
+};
+
+// Resolves the attributes of a view into setter calls at compile time, so the view can be
+// constructed without an AttributeSet and skip resolving them against its style at run time.
+//
+// This only succeeds if every attribute of the view is a literal value with a known setter. Layout
+// parameters are skipped, since the parent reads those from the AttributeSet. Otherwise, for
+// example for references, theme attributes, styles, or views that aren't part of the framework,
+// it returns std::nullopt and the view must be inflated from its attributes as before.
+std::optional<std::vector<StaticAttribute>> ResolveStaticAttributes(
+    const std::string& view_class, const std::vector<LayoutAttribute>& attributes);
+
+}  // namespace startop
+
+#endif  // VIEW_COMPILER_STATIC_ATTRIBUTES_H_
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "static_attributes.h"
+
+#include "gtest/gtest.h"
+
+using startop::AttributeValueType;
+using startop::LayoutAttribute;
+using startop::ResolveStaticAttributes;
+
+TEST(StaticAttributesTest, ResolvesLiteralValues) {
+  auto resolved = ResolveStaticAttributes("Button",
+                                          {{"android:id", "@0x7f0a0001"},
+                                           {"android:layout_width", "match_parent"},
+                                           {"android:text", "Hello, World!"},
+                                           {"android:visibility", "gone"},
+                                           {"android:enabled", "false"},
+                                           {"android:alpha", "0.5"}});
+  ASSERT_TRUE(resolved.has_value());
+  ASSERT_EQ(resolved->size(), 5u);
+
+  EXPECT_EQ((*resolved)[0].setter, "setId");
+  EXPECT_EQ((*resolved)[0].int_value, 0x7f0a0001);
+  EXPECT_EQ((*resolved)[1].declaring_class, "android.widget.TextView");
+  EXPECT_EQ((*resolved)[1].type, AttributeValueType::kString);
+  EXPECT_EQ((*resolved)[1].string_value, "Hello, World!");
+  EXPECT_EQ((*resolved)[2].int_value, 8);  // View.GONE
+  EXPECT_EQ((*resolved)[3].type, AttributeValueType::kBoolean);
+  EXPECT_EQ((*resolved)[3].int_value, 0);
+  EXPECT_EQ((*resolved)[4].type, AttributeValueType::kFloat);
+  EXPECT_EQ((*resolved)[4].float_value, 0.5f);
+}
+
+TEST(StaticAttributesTest, ResolvesCompiledEnumValues) {
+  auto resolved = ResolveStaticAttributes(
+      "LinearLayout", {{"android:orientation", "1"}, {"android:visibility", "1"}});
+  ASSERT_TRUE(resolved.has_value());
+  ASSERT_EQ(resolved->size(), 2u);
+  EXPECT_EQ((*resolved)[0].int_value, 1);  // LinearLayout.VERTICAL
+  EXPECT_EQ((*resolved)[1].int_value, 4);  // View.INVISIBLE
+}
+
+TEST(StaticAttributesTest, IgnoresNamespacesAndTools) {
+  auto resolved = ResolveStaticAttributes(
+      "TextView",
+      {{"xmlns:android", "http://schemas.android.com/apk/res/android"},
+       {"tools:text", "Preview"}});
+  ASSERT_TRUE(resolved.has_value());
+  EXPECT_TRUE(resolved->empty());
+}
+
+TEST(StaticAttributesTest, RejectsThemeDependentValues) {
+  EXPECT_FALSE(ResolveStaticAttributes("TextView", {{"android:text", "@string/hello"}}));
+  EXPECT_FALSE(ResolveStaticAttributes("TextView", {{"android:alpha", "?0x01010033"}}));
+  EXPECT_FALSE(ResolveStaticAttributes("TextView", {{"android:id", "@+id/title"}}));
+  EXPECT_FALSE(ResolveStaticAttributes("TextView", {{"style", "@0x7f100001"}}));
+}
+
+TEST(StaticAttributesTest, RejectsUnknownAttributesAndViews) {
+  EXPECT_FALSE(ResolveStaticAttributes("View", {{"android:background", "#ff0000"}}));
+  EXPECT_FALSE(ResolveStaticAttributes("View", {{"app:layout_constraintTop_toTopOf", "parent"}}));
+  EXPECT_FALSE(ResolveStaticAttributes("FrameLayout", {{"android:text", "Hello"}}));
+  EXPECT_FALSE(ResolveStaticAttributes("View", {{"android:visibility", "sometimes"}}));
+  EXPECT_FALSE(ResolveStaticAttributes("com.example.CustomView", {}));
+}
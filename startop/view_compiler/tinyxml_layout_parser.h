@@ -40,10 +40,14 @@ class TinyXmlVisitorAdapter : public tinyxml2::XMLVisitor {
   }
 
   bool VisitEnter(const tinyxml2::XMLElement& element,
-                  const tinyxml2::XMLAttribute* /*firstAttribute*/) override {
+                  const tinyxml2::XMLAttribute* firstAttribute) override {
     visitor_->VisitStartTag(
         std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t>{}.from_bytes(
             element.Name()));
+    for (const tinyxml2::XMLAttribute* attribute = firstAttribute; attribute != nullptr;
+         attribute = attribute->Next()) {
+      visitor_->VisitAttribute(attribute->Name(), attribute->Value());
+    }
     return true;
   }
 
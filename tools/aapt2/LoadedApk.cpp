@@ -72,7 +72,26 @@ static ApkFormat DetermineApkFormat(io::IFileCollection* apk) {
   }
 }
 
-std::unique_ptr<LoadedApk> LoadedApk::LoadApkFromPath(const StringPiece& path, IDiagnostics* diag) {
+// Parses the binary table of `table_file`, or returns nullptr after logging to `diag`.
+static std::unique_ptr<ResourceTable> ParseBinaryTable(const Source& source, io::IFile* table_file,
+                                                       io::IFileCollection* collection,
+                                                       IDiagnostics* diag) {
+  std::unique_ptr<ResourceTable> table =
+      util::make_unique<ResourceTable>(/** validate_resources **/ false);
+  std::unique_ptr<io::IData> data = table_file->OpenAsData();
+  if (data == nullptr) {
+    diag->Error(DiagMessage(source) << "failed to open " << kApkResourceTablePath);
+    return {};
+  }
+  BinaryResourceParser parser(diag, table.get(), source, data->data(), data->size(), collection);
+  if (!parser.Parse()) {
+    return {};
+  }
+  return table;
+}
+
+std::unique_ptr<LoadedApk> LoadedApk::LoadApkFromPath(const StringPiece& path, IDiagnostics* diag,
+                                                      bool lazy_table) {
   Source source(path);
   std::string error;
   std::unique_ptr<io::ZipFileCollection> apk = io::ZipFileCollection::Create(path, &error);
@@ -84,7 +103,7 @@ std::unique_ptr<LoadedApk> LoadedApk::LoadApkFromPath(const StringPiece& path, I
   ApkFormat apkFormat = DetermineApkFormat(apk.get());
   switch (apkFormat) {
     case ApkFormat::kBinary:
-      return LoadBinaryApkFromFileCollection(source, std::move(apk), diag);
+      return LoadBinaryApkFromFileCollection(source, std::move(apk), diag, lazy_table);
     case ApkFormat::kProto:
       return LoadProtoApkFromFileCollection(source, std::move(apk), diag);
     default:
@@ -152,20 +171,14 @@ std::unique_ptr<LoadedApk> LoadedApk::LoadProtoApkFromFileCollection(
 }
 
 std::unique_ptr<LoadedApk> LoadedApk::LoadBinaryApkFromFileCollection(
-    const Source& source, unique_ptr<io::IFileCollection> collection, IDiagnostics* diag) {
+    const Source& source, unique_ptr<io::IFileCollection> collection, IDiagnostics* diag,
+    bool lazy_table) {
   std::unique_ptr<ResourceTable> table;
 
   io::IFile* table_file = collection->FindFile(kApkResourceTablePath);
-  if (table_file != nullptr) {
-    table = util::make_unique<ResourceTable>(/** validate_resources **/ false);
-    std::unique_ptr<io::IData> data = table_file->OpenAsData();
-    if (data == nullptr) {
-      diag->Error(DiagMessage(source) << "failed to open " << kApkResourceTablePath);
-      return {};
-    }
-    BinaryResourceParser parser(diag, table.get(), source, data->data(), data->size(),
-                                collection.get());
-    if (!parser.Parse()) {
+  if (table_file != nullptr && !lazy_table) {
+    table = ParseBinaryTable(source, table_file, collection.get(), diag);
+    if (table == nullptr) {
       return {};
     }
   }
@@ -190,14 +203,27 @@ std::unique_ptr<LoadedApk> LoadedApk::LoadBinaryApkFromFileCollection(
                 << "failed to parse binary " << kAndroidManifestPath << ": " << error);
     return {};
   }
-  return util::make_unique<LoadedApk>(source, std::move(collection), std::move(table),
-                                      std::move(manifest), ApkFormat::kBinary);
+  std::unique_ptr<LoadedApk> apk = util::make_unique<LoadedApk>(
+      source, std::move(collection), std::move(table), std::move(manifest), ApkFormat::kBinary);
+  if (lazy_table) {
+    apk->lazy_table_file_ = table_file;
+    apk->lazy_table_diag_ = diag;
+  }
+  return apk;
+}
+
+void LoadedApk::LoadLazyTable() const {
+  if (lazy_table_file_ != nullptr) {
+    io::IFile* table_file = lazy_table_file_;
+    lazy_table_file_ = nullptr;
+    table_ = ParseBinaryTable(source_, table_file, apk_.get(), lazy_table_diag_);
+  }
 }
 
 bool LoadedApk::WriteToArchive(IAaptContext* context, const TableFlattenerOptions& options,
                                IArchiveWriter* writer) {
   FilterChain empty;
-  return WriteToArchive(context, table_.get(), options, &empty, writer);
+  return WriteToArchive(context, GetResourceTable(), options, &empty, writer);
 }
 
 bool LoadedApk::WriteToArchive(IAaptContext* context, ResourceTable* split_table,
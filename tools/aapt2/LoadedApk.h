@@ -44,9 +44,11 @@ class LoadedApk {
  public:
   virtual ~LoadedApk() = default;
 
-  // Loads both binary and proto APKs from disk.
+  // Loads both binary and proto APKs from disk. With `lazy_table`, the resources.arsc of a binary
+  // APK is only parsed by the first call to GetResourceTable(), for callers that may not need it.
+  // GetResourceTable() then logs to `diag` and returns nullptr if the table does not parse.
   static std::unique_ptr<LoadedApk> LoadApkFromPath(const ::android::StringPiece& path,
-                                                    IDiagnostics* diag);
+                                                    IDiagnostics* diag, bool lazy_table = false);
 
   // Loads a proto APK from the given file collection.
   static std::unique_ptr<LoadedApk> LoadProtoApkFromFileCollection(
@@ -54,7 +56,8 @@ class LoadedApk {
 
   // Loads a binary APK from the given file collection.
   static std::unique_ptr<LoadedApk> LoadBinaryApkFromFileCollection(
-      const Source& source, std::unique_ptr<io::IFileCollection> collection, IDiagnostics* diag);
+      const Source& source, std::unique_ptr<io::IFileCollection> collection, IDiagnostics* diag,
+      bool lazy_table = false);
 
   LoadedApk(const Source& source, std::unique_ptr<io::IFileCollection> apk,
             std::unique_ptr<ResourceTable> table, std::unique_ptr<xml::XmlResource> manifest,
@@ -75,10 +78,12 @@ class LoadedApk {
   }
 
   const ResourceTable* GetResourceTable() const {
+    LoadLazyTable();
     return table_.get();
   }
 
   ResourceTable* GetResourceTable() {
+    LoadLazyTable();
     return table_.get();
   }
 
@@ -116,9 +121,17 @@ class LoadedApk {
  private:
   DISALLOW_COPY_AND_ASSIGN(LoadedApk);
 
+  // Parses the table of `lazy_table_file_`, if it has not been parsed yet.
+  void LoadLazyTable() const;
+
   Source source_;
   std::unique_ptr<io::IFileCollection> apk_;
-  std::unique_ptr<ResourceTable> table_;
+  mutable std::unique_ptr<ResourceTable> table_;
+
+  // The resources.arsc whose parsing is deferred until the table is first used, or nullptr.
+  mutable io::IFile* lazy_table_file_ = nullptr;
+  IDiagnostics* lazy_table_diag_ = nullptr;
+
   std::unique_ptr<xml::XmlResource> manifest_;
   ApkFormat format_;
 };
@@ -37,6 +37,7 @@
 #include "cmd/Link.h"
 #include "cmd/Optimize.h"
 #include "io/FileStream.h"
+#include "process/SymbolTable.h"
 #include "trace/TraceBuffer.h"
 #include "util/Files.h"
 #include "util/Util.h"
@@ -63,10 +64,12 @@ class VersionCommand : public Command {
 /** The main entry point of AAPT. */
 class MainCommand : public Command {
  public:
-  explicit MainCommand(text::Printer* printer, IDiagnostics* diagnostics)
+  // `apk_assets_cache` keeps included APKs loaded between commands, when set.
+  explicit MainCommand(text::Printer* printer, IDiagnostics* diagnostics,
+                       ApkAssetsCache* apk_assets_cache = nullptr)
       : Command("aapt2"), diagnostics_(diagnostics) {
     AddOptionalSubcommand(util::make_unique<CompileCommand>(diagnostics));
-    AddOptionalSubcommand(util::make_unique<LinkCommand>(diagnostics));
+    AddOptionalSubcommand(util::make_unique<LinkCommand>(diagnostics, apk_assets_cache));
     AddOptionalSubcommand(util::make_unique<DumpCommand>(printer, diagnostics));
     AddOptionalSubcommand(util::make_unique<DiffCommand>());
     AddOptionalSubcommand(util::make_unique<OptimizeCommand>());
@@ -132,7 +135,8 @@ class DaemonCommand : public Command {
 
       std::vector<StringPiece> args;
       args.insert(args.end(), raw_args.begin(), raw_args.end());
-      int result = MainCommand(&printer, diagnostics_).Execute(args, &std::cerr);
+      int result = MainCommand(&printer, diagnostics_, &apk_assets_cache_).Execute(args,
+                                                                                  &std::cerr);
       out_->Flush();
       if (result != 0) {
         std::cerr << "Error" << std::endl;
@@ -148,6 +152,9 @@ class DaemonCommand : public Command {
   io::FileOutputStream* out_;
   IDiagnostics* diagnostics_;
   Maybe<std::string> trace_folder_;
+
+  // The framework and other included APKs, parsed once for all the links run by the daemon.
+  ApkAssetsCache apk_assets_cache_;
 };
 
 }  // namespace aapt
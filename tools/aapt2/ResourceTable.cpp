@@ -146,7 +146,28 @@ ResourceTableType* ResourceTablePackage::FindOrCreateType(ResourceType type,
   return types.emplace(iter, std::move(new_type))->get();
 }
 
+ResourceEntry* ResourceTableType::FindFirstEntry(const StringPiece& name) {
+  if (indexed_size_ != entries.size() || indexed_data_ != entries.data()) {
+    entry_index_.clear();
+    entry_index_.reserve(entries.size());
+    for (const auto& entry : entries) {
+      // Does not replace an earlier entry of the same name.
+      entry_index_.emplace(entry->name, entry.get());
+    }
+    indexed_size_ = entries.size();
+    indexed_data_ = entries.data();
+  }
+
+  auto iter = entry_index_.find(name);
+  return iter != entry_index_.end() ? iter->second : nullptr;
+}
+
 ResourceEntry* ResourceTableType::FindEntry(const StringPiece& name, const Maybe<uint16_t> id) {
+  ResourceEntry* first_entry = FindFirstEntry(name);
+  if (first_entry == nullptr || !id || id == first_entry->id) {
+    return first_entry;
+  }
+
   const auto last = entries.end();
   auto iter = std::lower_bound(entries.begin(), last, std::make_pair(name, id),
       less_than_struct_with_name_and_id<ResourceEntry>);
@@ -158,6 +179,11 @@ ResourceEntry* ResourceTableType::FindEntry(const StringPiece& name, const Maybe
 
 ResourceEntry* ResourceTableType::FindOrCreateEntry(const StringPiece& name,
                                                     const Maybe<uint16_t > id) {
+  ResourceEntry* first_entry = FindFirstEntry(name);
+  if (first_entry != nullptr && (!id || id == first_entry->id)) {
+    return first_entry;
+  }
+
   auto last = entries.end();
   auto iter = std::lower_bound(entries.begin(), last, std::make_pair(name, id),
                                less_than_struct_with_name_and_id<ResourceEntry>);
@@ -167,7 +193,14 @@ ResourceEntry* ResourceTableType::FindOrCreateEntry(const StringPiece& name,
 
   auto new_entry = new ResourceEntry(name);
   new_entry->id = id;
-  return entries.emplace(iter, std::move(new_entry))->get();
+  iter = entries.emplace(iter, std::move(new_entry));
+  if (iter == entries.begin() || (*(iter - 1))->name != name) {
+    entry_index_.erase(name);
+    entry_index_.emplace(new_entry->name, new_entry);
+  }
+  indexed_size_ = entries.size();
+  indexed_data_ = entries.data();
+  return new_entry;
 }
 
 ResourceConfigValue* ResourceEntry::FindValue(const ConfigDescription& config) {
@@ -188,7 +188,10 @@ class ResourceTableType {
   // Whether this type is public (and must maintain the same type ID across builds).
   Visibility::Level visibility_level = Visibility::Level::kUndefined;
 
-  // List of resources for this type.
+  // List of resources for this type, sorted by name and ID.
+  // Entries are looked up through an index, which is rebuilt whenever the size or storage of this
+  // vector changed since the last lookup. Code removing or replacing entries other than through
+  // FindOrCreateEntry() must therefore not keep the size the same.
   std::vector<std::unique_ptr<ResourceEntry>> entries;
 
   explicit ResourceTableType(const ResourceType type) : type(type) {}
@@ -200,6 +203,14 @@ class ResourceTableType {
 
  private:
   DISALLOW_COPY_AND_ASSIGN(ResourceTableType);
+
+  // Returns the first entry named `name`, or nullptr if there is none.
+  ResourceEntry* FindFirstEntry(const android::StringPiece& name);
+
+  // The first entry of each name in `entries`, keyed by the name of the entry.
+  std::unordered_map<android::StringPiece, ResourceEntry*> entry_index_;
+  size_t indexed_size_ = 0u;
+  const void* indexed_data_ = nullptr;
 };
 
 class ResourceTablePackage {
@@ -370,4 +370,25 @@ TEST(ResourceTableTest, AllowDuplictaeResourcesNames) {
   ASSERT_THAT(entry2->visibility.level, Visibility::Level::kPrivate);
 }
 
+TEST(ResourceTableTest, FindEntryAfterEntriesChangeOutsideOfTable) {
+  ResourceTableType type(ResourceType::kString);
+  for (const char* name : {"c", "a", "d", "b"}) {
+    ASSERT_THAT(type.FindOrCreateEntry(name), NotNull());
+  }
+  ASSERT_THAT(type.entries.size(), Eq(4u));
+  EXPECT_THAT(type.entries[0]->name, StrEq("a"));
+  EXPECT_THAT(type.entries[3]->name, StrEq("d"));
+  EXPECT_THAT(type.FindOrCreateEntry("b"), Eq(type.entries[1].get()));
+
+  // Removing entries the way the resource removal passes do.
+  type.entries.erase(type.entries.begin() + 1);
+  EXPECT_THAT(type.FindEntry("b"), Eq(nullptr));
+  EXPECT_THAT(type.FindEntry("c"), Eq(type.entries[1].get()));
+
+  ResourceEntry* b = type.FindOrCreateEntry("b");
+  ASSERT_THAT(b, NotNull());
+  EXPECT_THAT(type.entries[1].get(), Eq(b));
+  EXPECT_THAT(type.FindEntry("b"), Eq(b));
+}
+
 }  // namespace aapt
@@ -36,6 +36,27 @@ using ::android::base::StringPrintf;
 
 namespace aapt {
 
+namespace {
+
+template <typename T>
+uint64_t HashBytes(const T& value, uint64_t hash) {
+  return util::Fnv1aHash(StringPiece(reinterpret_cast<const char*>(&value), sizeof(T)), hash);
+}
+
+uint64_t HashString(const std::string& str, uint64_t hash) {
+  return util::Fnv1aHash(str, HashBytes(str.size(), hash));
+}
+
+uint64_t HashItem(const Item* item, uint64_t hash) {
+  return HashBytes(item != nullptr ? item->Hash() : 0u, hash);
+}
+
+}  // namespace
+
+uint64_t Value::Hash() const {
+  return 0u;
+}
+
 void Value::PrettyPrint(Printer* printer) const {
   std::ostringstream str_stream;
   Print(&str_stream);
@@ -77,6 +98,10 @@ bool RawString::Equals(const Value* value) const {
   return *this->value == *other->value;
 }
 
+uint64_t RawString::Hash() const {
+  return HashString(*value, 0u);
+}
+
 RawString* RawString::Clone(StringPool* new_pool) const {
   RawString* rs = new RawString(new_pool->MakeRef(value));
   rs->comment_ = comment_;
@@ -115,6 +140,19 @@ bool Reference::Equals(const Value* value) const {
          name == other->name;
 }
 
+uint64_t Reference::Hash() const {
+  uint64_t hash = HashBytes(reference_type, 0u);
+  hash = HashBytes(private_reference, hash);
+  hash = HashBytes(id ? id.value().id : 0u, HashBytes(static_cast<bool>(id), hash));
+  hash = HashBytes(static_cast<bool>(name), hash);
+  if (name) {
+    hash = HashString(name.value().package, hash);
+    hash = HashBytes(name.value().type, hash);
+    hash = HashString(name.value().entry, hash);
+  }
+  return hash;
+}
+
 bool Reference::Flatten(android::Res_value* out_value) const {
   const ResourceId resid = id.value_or_default(ResourceId(0));
   const bool dynamic = resid.is_valid_dynamic() && is_dynamic;
@@ -231,6 +269,10 @@ void Id::Print(std::ostream* out) const {
 String::String(const StringPool::Ref& ref) : value(ref) {
 }
 
+uint64_t String::Hash() const {
+  return HashString(*value, 0u);
+}
+
 bool String::Equals(const Value* value) const {
   const String* other = ValueCast<String>(value);
   if (!other) {
@@ -321,6 +363,10 @@ bool StyledString::Flatten(android::Res_value* out_value) const {
   return true;
 }
 
+uint64_t StyledString::Hash() const {
+  return HashString(value->value, 0u);
+}
+
 StyledString* StyledString::Clone(StringPool* new_pool) const {
   StyledString* str = new StyledString(new_pool->MakeRef(value));
   str->comment_ = comment_;
@@ -347,6 +393,10 @@ bool FileReference::Equals(const Value* value) const {
   return path == other->path;
 }
 
+uint64_t FileReference::Hash() const {
+  return HashString(*path, 0u);
+}
+
 bool FileReference::Flatten(android::Res_value* out_value) const {
   if (path.index() > std::numeric_limits<uint32_t>::max()) {
     return false;
@@ -400,6 +450,10 @@ bool BinaryPrimitive::Equals(const Value* value) const {
          this->value.data == other->value.data;
 }
 
+uint64_t BinaryPrimitive::Hash() const {
+  return HashBytes(value.data, HashBytes(value.dataType, 0u));
+}
+
 bool BinaryPrimitive::Flatten(::android::Res_value* out_value) const {
   out_value->dataType = value.dataType;
   out_value->data = util::HostToDevice32(value.data);
@@ -897,6 +951,20 @@ bool Style::Equals(const Value* value) const {
                     });
 }
 
+uint64_t Style::Hash() const {
+  uint64_t hash = HashBytes(static_cast<bool>(parent), 0u);
+  if (parent) {
+    hash = HashBytes(parent.value().Hash(), hash);
+  }
+
+  // Equals() does not depend on the order of the entries, so neither does their hash.
+  uint64_t entries_hash = 0u;
+  for (const Entry& entry : entries) {
+    entries_hash += HashItem(entry.value.get(), HashBytes(entry.key.Hash(), 0u));
+  }
+  return HashBytes(entries_hash, HashBytes(entries.size(), hash));
+}
+
 Style* Style::Clone(StringPool* new_pool) const {
   Style* style = new Style();
   style->parent = parent;
@@ -997,6 +1065,14 @@ bool Array::Equals(const Value* value) const {
                     });
 }
 
+uint64_t Array::Hash() const {
+  uint64_t hash = HashBytes(elements.size(), 0u);
+  for (const std::unique_ptr<Item>& element : elements) {
+    hash = HashItem(element.get(), hash);
+  }
+  return hash;
+}
+
 Array* Array::Clone(StringPool* new_pool) const {
   Array* array = new Array();
   array->comment_ = comment_;
@@ -1034,6 +1110,14 @@ bool Plural::Equals(const Value* value) const {
   return true;
 }
 
+uint64_t Plural::Hash() const {
+  uint64_t hash = 0u;
+  for (const std::unique_ptr<Item>& value : values) {
+    hash = HashItem(value.get(), hash);
+  }
+  return hash;
+}
+
 Plural* Plural::Clone(StringPool* new_pool) const {
   Plural* p = new Plural();
   p->comment_ = comment_;
@@ -1090,6 +1174,14 @@ bool Styleable::Equals(const Value* value) const {
                     });
 }
 
+uint64_t Styleable::Hash() const {
+  uint64_t hash = HashBytes(entries.size(), 0u);
+  for (const Reference& entry : entries) {
+    hash = HashBytes(entry.Hash(), hash);
+  }
+  return hash;
+}
+
 Styleable* Styleable::Clone(StringPool* /*new_pool*/) const {
   return new Styleable(*this);
 }
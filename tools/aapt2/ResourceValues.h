@@ -94,6 +94,11 @@ class Value {
 
   virtual bool Equals(const Value* value) const = 0;
 
+  // Returns a hash of the parts of this value that Equals() compares, so that values with
+  // different hashes are never equal. Values with the same hash still have to be compared. The
+  // default implementation returns the same hash for every value.
+  virtual uint64_t Hash() const;
+
   // Calls the appropriate overload of ValueVisitor.
   virtual void Accept(ValueVisitor* visitor) = 0;
 
@@ -165,6 +170,7 @@ struct Reference : public BaseItem<Reference> {
   Reference(const ResourceNameRef& n, const ResourceId& i);
 
   bool Equals(const Value* value) const override;
+  uint64_t Hash() const override;
   bool Flatten(android::Res_value* out_value) const override;
   Reference* Clone(StringPool* new_pool) const override;
   void Print(std::ostream* out) const override;
@@ -197,6 +203,7 @@ struct RawString : public BaseItem<RawString> {
   explicit RawString(const StringPool::Ref& ref);
 
   bool Equals(const Value* value) const override;
+  uint64_t Hash() const override;
   bool Flatten(android::Res_value* out_value) const override;
   RawString* Clone(StringPool* new_pool) const override;
   void Print(std::ostream* out) const override;
@@ -231,6 +238,7 @@ struct String : public BaseItem<String> {
   explicit String(const StringPool::Ref& ref);
 
   bool Equals(const Value* value) const override;
+  uint64_t Hash() const override;
   bool Flatten(android::Res_value* out_value) const override;
   String* Clone(StringPool* new_pool) const override;
   void Print(std::ostream* out) const override;
@@ -248,6 +256,7 @@ struct StyledString : public BaseItem<StyledString> {
   explicit StyledString(const StringPool::StyleRef& ref);
 
   bool Equals(const Value* value) const override;
+  uint64_t Hash() const override;
   bool Flatten(android::Res_value* out_value) const override;
   StyledString* Clone(StringPool* new_pool) const override;
   void Print(std::ostream* out) const override;
@@ -268,6 +277,7 @@ struct FileReference : public BaseItem<FileReference> {
   explicit FileReference(const StringPool::Ref& path);
 
   bool Equals(const Value* value) const override;
+  uint64_t Hash() const override;
   bool Flatten(android::Res_value* out_value) const override;
   FileReference* Clone(StringPool* new_pool) const override;
   void Print(std::ostream* out) const override;
@@ -282,6 +292,7 @@ struct BinaryPrimitive : public BaseItem<BinaryPrimitive> {
   BinaryPrimitive(uint8_t dataType, uint32_t data);
 
   bool Equals(const Value* value) const override;
+  uint64_t Hash() const override;
   bool Flatten(android::Res_value* out_value) const override;
   BinaryPrimitive* Clone(StringPool* new_pool) const override;
   void Print(std::ostream* out) const override;
@@ -332,6 +343,7 @@ struct Style : public BaseValue<Style> {
   std::vector<Entry> entries;
 
   bool Equals(const Value* value) const override;
+  uint64_t Hash() const override;
   Style* Clone(StringPool* new_pool) const override;
   void Print(std::ostream* out) const override;
 
@@ -344,6 +356,7 @@ struct Array : public BaseValue<Array> {
   std::vector<std::unique_ptr<Item>> elements;
 
   bool Equals(const Value* value) const override;
+  uint64_t Hash() const override;
   Array* Clone(StringPool* new_pool) const override;
   void Print(std::ostream* out) const override;
 };
@@ -354,6 +367,7 @@ struct Plural : public BaseValue<Plural> {
   std::array<std::unique_ptr<Item>, Count> values;
 
   bool Equals(const Value* value) const override;
+  uint64_t Hash() const override;
   Plural* Clone(StringPool* new_pool) const override;
   void Print(std::ostream* out) const override;
 };
@@ -362,6 +376,7 @@ struct Styleable : public BaseValue<Styleable> {
   std::vector<Reference> entries;
 
   bool Equals(const Value* value) const override;
+  uint64_t Hash() const override;
   Styleable* Clone(StringPool* newPool) const override;
   void Print(std::ostream* out) const override;
   void MergeWith(Styleable* styleable);
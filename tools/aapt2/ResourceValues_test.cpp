@@ -153,6 +153,43 @@ TEST(ResourceValuesTest, StyleEquals) {
   EXPECT_TRUE(a->Equals(g.get()));
 }
 
+TEST(ResourceValuesTest, StyleHash) {
+  std::unique_ptr<Style> a = test::StyleBuilder()
+      .SetParent("android:style/Parent")
+      .AddItem("android:attr/foo", ResourceUtils::TryParseInt("1"))
+      .AddItem("android:attr/bar", ResourceUtils::TryParseInt("2"))
+      .Build();
+
+  std::unique_ptr<Style> b = test::StyleBuilder()
+      .SetParent("android:style/Parent")
+      .AddItem("android:attr/bar", ResourceUtils::TryParseInt("2"))
+      .AddItem("android:attr/foo", ResourceUtils::TryParseInt("1"))
+      .Build();
+
+  std::unique_ptr<Style> c = test::StyleBuilder()
+      .SetParent("android:style/Parent")
+      .AddItem("android:attr/foo", ResourceUtils::TryParseInt("1"))
+      .AddItem("android:attr/bar", ResourceUtils::TryParseInt("3"))
+      .Build();
+
+  // Equal values hash the same, whatever the order of their entries.
+  ASSERT_TRUE(a->Equals(b.get()));
+  EXPECT_EQ(a->Hash(), b->Hash());
+  EXPECT_NE(a->Hash(), c->Hash());
+}
+
+TEST(ResourceValuesTest, StringHashIgnoresPool) {
+  StringPool pool_a;
+  StringPool pool_b;
+  String a(pool_a.MakeRef("hello"));
+  String b(pool_b.MakeRef("hello"));
+  String c(pool_b.MakeRef("world"));
+
+  ASSERT_TRUE(a.Equals(&b));
+  EXPECT_EQ(a.Hash(), b.Hash());
+  EXPECT_NE(a.Hash(), c.Hash());
+}
+
 TEST(ResourceValuesTest, StyleClone) {
   std::unique_ptr<Style> a = test::StyleBuilder()
       .SetParent("android:style/Parent")
@@ -19,11 +19,13 @@
 #include <algorithm>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "android-base/logging.h"
 #include "androidfw/ResourceTypes.h"
 #include "androidfw/StringPiece.h"
 
+#include "trace/TraceBuffer.h"
 #include "util/BigBuffer.h"
 #include "util/Util.h"
 
@@ -259,6 +261,7 @@ void StringPool::Merge(StringPool&& pool) {
   pool.styles_.clear();
   std::move(pool.strings_.begin(), pool.strings_.end(), std::back_inserter(strings_));
   pool.strings_.clear();
+  indexed_strings_.reserve(indexed_strings_.size() + pool.indexed_strings_.size());
   indexed_strings_.insert(pool.indexed_strings_.begin(), pool.indexed_strings_.end());
   pool.indexed_strings_.clear();
 
@@ -268,6 +271,7 @@ void StringPool::Merge(StringPool&& pool) {
 void StringPool::HintWillAdd(size_t string_count, size_t style_count) {
   strings_.reserve(strings_.size() + string_count);
   styles_.reserve(styles_.size() + style_count);
+  indexed_strings_.reserve(indexed_strings_.size() + string_count);
 }
 
 void StringPool::Prune() {
@@ -364,10 +368,38 @@ static size_t EncodedLengthUnits(size_t length) {
 
 const std::string kStringTooLarge = "STRING_TOO_LARGE";
 
-static bool EncodeString(const std::string& str, const bool utf8, BigBuffer* out,
-                         IDiagnostics* diag) {
+namespace {
+
+// A string of the pool, measured before the strings are all encoded next to each other.
+struct StringEncoding {
+  // The string to encode. Points at `modified` when the string had to change to be encoded.
+  const std::string* str;
+
+  // The Modified UTF-8 form of a UTF-8 string with 4 byte codepoints.
+  std::string modified;
+
+  size_t utf16_length;
+  size_t utf8_length;
+
+  // The size in bytes of the encoded string, including its lengths and null terminator.
+  size_t size;
+};
+
+}  // namespace
+
+// Measures `str` as it will be encoded. A string too large to encode is measured, and later
+// written, as kStringTooLarge instead.
+static bool MeasureString(const std::string& str, const bool utf8, StringEncoding* out,
+                          IDiagnostics* diag) {
+  out->str = &str;
   if (utf8) {
-    const std::string& encoded = util::Utf8ToModifiedUtf8(str);
+    // Only strings with 4 byte codepoints need to change for Modified UTF-8.
+    if (std::any_of(str.begin(), str.end(),
+                    [](char c) -> bool { return ((uint8_t) c >> 4) == 0xF; })) {
+      out->modified = util::Utf8ToModifiedUtf8(str);
+      out->str = &out->modified;
+    }
+    const std::string& encoded = *out->str;
     const ssize_t utf16_length = utf8_to_utf16_length(
         reinterpret_cast<const uint8_t*>(encoded.data()), encoded.size());
     CHECK(utf16_length >= 0);
@@ -380,25 +412,19 @@ static bool EncodeString(const std::string& str, const bool utf8, BigBuffer* out
       diag->Error(DiagMessage() << "string too large to encode using UTF-8 "
           << "written instead as '" << kStringTooLarge << "'");
 
-      EncodeString(kStringTooLarge, utf8, out, diag);
+      MeasureString(kStringTooLarge, utf8, out, diag);
       return false;
     }
 
-    const size_t total_size = EncodedLengthUnits<char>(utf16_length)
+    out->utf16_length = utf16_length;
+    out->utf8_length = encoded.size();
+    out->size = EncodedLengthUnits<char>(utf16_length)
         + EncodedLengthUnits<char>(encoded.size()) + encoded.size() + 1;
 
-    char* data = out->NextBlock<char>(total_size);
-
-    // First encode the UTF16 string length.
-    data = EncodeLength(data, utf16_length);
-
-    // Now encode the size of the real UTF8 string.
-    data = EncodeLength(data, encoded.size());
-    strncpy(data, encoded.data(), encoded.size());
-
   } else {
-    const std::u16string encoded = util::Utf8ToUtf16(str);
-    const ssize_t utf16_length = encoded.size();
+    // Like util::Utf8ToUtf16(), invalid UTF-8 is encoded as an empty string.
+    const ssize_t utf16_length = std::max<ssize_t>(
+        utf8_to_utf16_length(reinterpret_cast<const uint8_t*>(str.data()), str.size()), 0);
 
     // Make sure the length to be encoded does not exceed the maximum possible
     // length that can be encoded
@@ -406,29 +432,43 @@ static bool EncodeString(const std::string& str, const bool utf8, BigBuffer* out
       diag->Error(DiagMessage() << "string too large to encode using UTF-16 "
           << "written instead as '" << kStringTooLarge << "'");
 
-      EncodeString(kStringTooLarge, utf8, out, diag);
+      MeasureString(kStringTooLarge, utf8, out, diag);
       return false;
     }
 
+    out->utf16_length = utf16_length;
+    out->utf8_length = str.size();
+
     // Total number of 16-bit words to write.
-    const size_t total_size = EncodedLengthUnits<char16_t>(utf16_length)
-        + encoded.size() + 1;
+    out->size = (EncodedLengthUnits<char16_t>(utf16_length) + utf16_length + 1)
+        * sizeof(char16_t);
+  }
+  return true;
+}
 
-    char16_t* data = out->NextBlock<char16_t>(total_size);
+// Encodes a measured string into `data`, which holds `encoding.size` zeroed bytes.
+static void EncodeString(const StringEncoding& encoding, const bool utf8, uint8_t* data) {
+  if (utf8) {
+    char* out = reinterpret_cast<char*>(data);
 
-    // Encode the actual UTF16 string length.
-    data = EncodeLength(data, utf16_length);
-    const size_t byte_length = encoded.size() * sizeof(char16_t);
+    // First encode the UTF16 string length.
+    out = EncodeLength(out, encoding.utf16_length);
 
-    // NOTE: For some reason, strncpy16(data, entry->value.data(),
-    // entry->value.size()) truncates the string.
-    memcpy(data, encoded.data(), byte_length);
+    // Now encode the size of the real UTF8 string.
+    out = EncodeLength(out, encoding.utf8_length);
+    strncpy(out, encoding.str->data(), encoding.utf8_length);
 
-    // The null-terminating character is already here due to the block of data
-    // being set to 0s on allocation.
-  }
+  } else {
+    char16_t* out = reinterpret_cast<char16_t*>(data);
 
-  return true;
+    // Encode the actual UTF16 string length.
+    out = EncodeLength(out, encoding.utf16_length);
+    if (encoding.utf16_length > 0) {
+      // This also writes the null-terminating character.
+      utf8_to_utf16(reinterpret_cast<const uint8_t*>(encoding.str->data()),
+                    encoding.utf8_length, out, encoding.utf16_length + 1);
+    }
+  }
 }
 
 bool StringPool::Flatten(BigBuffer* out, const StringPool& pool, bool utf8,
@@ -451,15 +491,31 @@ bool StringPool::Flatten(BigBuffer* out, const StringPool& pool, bool utf8,
   const size_t before_strings_index = out->size();
   header->stringsStart = before_strings_index - start_index;
 
-  // Styles always come first.
+  // Every string is measured first, so that they can all be encoded into one block of the exact
+  // size instead of growing the buffer string by string. Styles always come first.
+  std::vector<StringEncoding> encodings(pool.styles_.size() + pool.strings_.size());
+  size_t strings_size = 0u;
+  auto encoding_iter = encodings.begin();
   for (const std::unique_ptr<StyleEntry>& entry : pool.styles_) {
-    *indices++ = out->size() - before_strings_index;
-    no_error = EncodeString(entry->value, utf8, out, diag) && no_error;
+    no_error = MeasureString(entry->value, utf8, &*encoding_iter, diag) && no_error;
+    strings_size += (encoding_iter++)->size;
   }
 
   for (const std::unique_ptr<Entry>& entry : pool.strings_) {
-    *indices++ = out->size() - before_strings_index;
-    no_error = EncodeString(entry->value, utf8, out, diag) && no_error;
+    no_error = MeasureString(entry->value, utf8, &*encoding_iter, diag) && no_error;
+    strings_size += (encoding_iter++)->size;
+  }
+
+  TRACE_COUNTER("string pool strings", encodings.size());
+  TRACE_COUNTER("string pool bytes", strings_size);
+  if (strings_size != 0u) {
+    uint8_t* data = out->NextBlock<uint8_t>(strings_size);
+    size_t offset = 0u;
+    for (const StringEncoding& encoding : encodings) {
+      *indices++ = offset;
+      EncodeString(encoding, utf8, data + offset);
+      offset += encoding.size;
+    }
   }
 
   out->Align4();
@@ -335,6 +335,31 @@ TEST(StringPoolTest, ModifiedUTF8) {
   EXPECT_THAT(util::GetString(test, 2), Eq("\xF0\x90\x90\x80\xF0\x90\x90\xB7"));
 }
 
+TEST(StringPoolTest, FlattenStringsLargerThanOneBlock) {
+  using namespace android;  // For NO_ERROR on Windows.
+  StdErrDiagnostics diag;
+  StringPool pool;
+  std::vector<std::string> strings;
+  for (size_t i = 0; i < 500; i++) {
+    strings.push_back("string " + std::to_string(i) + " \xF0\x90\x90\x80 " + std::string(i, 'x'));
+    pool.MakeRef(strings.back());
+  }
+
+  for (bool utf8 : {true, false}) {
+    BigBuffer buffer(1024);
+    ASSERT_TRUE(utf8 ? StringPool::FlattenUtf8(&buffer, pool, &diag)
+                     : StringPool::FlattenUtf16(&buffer, pool, &diag));
+    std::unique_ptr<uint8_t[]> data = util::Copy(buffer);
+
+    ResStringPool test;
+    ASSERT_EQ(test.setTo(data.get(), buffer.size()), NO_ERROR);
+    ASSERT_EQ(test.size(), strings.size());
+    for (size_t i = 0; i < strings.size(); i++) {
+      EXPECT_THAT(util::GetString(test, i), Eq(strings[i]));
+    }
+  }
+}
+
 TEST(StringPoolTest, MaxEncodingLength) {
   StdErrDiagnostics diag;
   using namespace android;  // For NO_ERROR on Windows.
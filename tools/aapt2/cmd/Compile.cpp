@@ -17,10 +17,17 @@
 #include "Compile.h"
 
 #include <dirent.h>
+#include <unistd.h>
+#include <atomic>
+#include <cinttypes>
+#include <chrono>
+#include <mutex>
 #include <string>
+#include <thread>
 
 #include "android-base/errors.h"
 #include "android-base/file.h"
+#include "android-base/stringprintf.h"
 #include "android-base/utf8.h"
 #include "androidfw/ConfigDescription.h"
 #include "androidfw/StringPiece.h"
@@ -30,6 +37,7 @@
 #include "Diagnostics.h"
 #include "ResourceParser.h"
 #include "ResourceTable.h"
+#include "ResourceUtils.h"
 #include "cmd/Util.h"
 #include "compile/IdAssigner.h"
 #include "compile/InlineXmlFormatParser.h"
@@ -56,6 +64,7 @@ using ::aapt::io::FileInputStream;
 using ::aapt::text::Printer;
 using ::android::ConfigDescription;
 using ::android::StringPiece;
+using ::android::base::StringPrintf;
 using ::android::base::SystemErrorCodeToString;
 using ::google::protobuf::io::CopyingOutputStreamAdaptor;
 
@@ -453,6 +462,34 @@ static bool CompileXml(IAaptContext* context, const CompileOptions& options,
   return true;
 }
 
+// Returns where the PNG `content` is kept once crunched in the --crunch-cache directory. Crunching
+// only depends on the file, on whether it is a 9-patch and on the tool.
+static std::string GetCrunchCachePath(const CompileOptions& options,
+                                      const ResourcePathData& path_data,
+                                      const StringPiece& content) {
+  uint64_t key = util::Fnv1aHash(util::GetToolFingerprint());
+  key = util::Fnv1aHash(path_data.extension, key);
+  key = util::Fnv1aHash(content, key);
+  return file::BuildPath({options.crunch_cache_dir.value(),
+                          StringPrintf("%016" PRIx64 ".png", key)});
+}
+
+// Keeps a crunched PNG in the --crunch-cache directory. It is written to a temporary file first,
+// so that a compile that is interrupted, or that runs at the same time, never reads a partial one.
+static void StoreCrunchedPng(IAaptContext* context, const std::string& cache_path,
+                             const BigBuffer& buffer) {
+  const std::string tmp_path =
+      StringPrintf("%s.%d.%zu.tmp", cache_path.c_str(), static_cast<int>(getpid()),
+                   std::hash<std::thread::id>()(std::this_thread::get_id()));
+  if (!android::base::WriteStringToFile(buffer.to_string(), tmp_path) ||
+      rename(tmp_path.c_str(), cache_path.c_str()) != 0) {
+    // Failing to cache the PNG only costs crunching it again next time.
+    context->GetDiagnostics()->Warn(DiagMessage(cache_path)
+                                    << "failed to write to the crunch cache");
+    unlink(tmp_path.c_str());
+  }
+}
+
 static bool CompilePng(IAaptContext* context, const CompileOptions& options,
                        const ResourcePathData& path_data, io::IFile* file, IArchiveWriter* writer,
                        const std::string& output_path) {
@@ -478,9 +515,26 @@ static bool CompilePng(IAaptContext* context, const CompileOptions& options,
     BigBuffer crunched_png_buffer(4096);
     io::BigBufferOutputStream crunched_png_buffer_out(&crunched_png_buffer);
 
+    const StringPiece content(reinterpret_cast<const char*>(data->data()), data->size());
+    TRACE_COUNTER("png bytes in", content.size());
+    std::string cache_path;
+    if (options.crunch_cache_dir) {
+      cache_path = GetCrunchCachePath(options, path_data, content);
+      std::string cached_png;
+      if (android::base::ReadFileToString(cache_path, &cached_png)) {
+        if (context->IsVerbose()) {
+          context->GetDiagnostics()->Note(DiagMessage(path_data.source)
+                                          << "using crunched PNG from the cache");
+        }
+        TRACE_COUNTER("png bytes out", cached_png.size());
+        io::StringInputStream cached_png_in(cached_png);
+        return WriteHeaderAndDataToWriter(output_path, res_file, &cached_png_in, writer,
+                                          context->GetDiagnostics());
+      }
+    }
+
     // Ensure that we only keep the chunks we care about if we end up
     // using the original PNG instead of the crunched one.
-    const StringPiece content(reinterpret_cast<const char*>(data->data()), data->size());
     PngChunkFilter png_chunk_filter(content);
     std::unique_ptr<Image> image = ReadPng(context, path_data.source, &png_chunk_filter);
     if (!image) {
@@ -540,6 +594,11 @@ static bool CompilePng(IAaptContext* context, const CompileOptions& options,
       buffer.AppendBuffer(std::move(filtered_png_buffer));
     }
 
+    TRACE_COUNTER("png bytes out", buffer.size());
+    if (!cache_path.empty()) {
+      StoreCrunchedPng(context, cache_path, buffer);
+    }
+
     if (context->IsVerbose()) {
       // For debugging only, use the legacy PNG cruncher and compare the resulting file sizes.
       // This will help catch exotic cases where the new code may generate larger PNGs.
@@ -637,80 +696,207 @@ class CompileContext : public IAaptContext {
   bool verbose_ = false;
 };
 
-int Compile(IAaptContext* context, io::IFileCollection* inputs, IArchiveWriter* output_writer,
-             CompileOptions& options) {
-  TRACE_CALL();
-  bool error = false;
+// Time spent on each kind of input file, summed over all the threads compiling them.
+class CompileTimings {
+ public:
+  enum Stage { kTable, kXml, kPng, kFile, kWrite, kStageCount };
 
-  // Iterate over the input files in a stable, platform-independent manner
-  auto file_iterator  = inputs->Iterator();
-  while (file_iterator->HasNext()) {
-    auto file = file_iterator->Next();
-    std::string path = file->GetSource().path;
+  CompileTimings() {
+    for (size_t i = 0; i < kStageCount; i++) {
+      micros_[i] = 0;
+      counts_[i] = 0;
+    }
+  }
+
+  void Add(Stage stage, std::chrono::steady_clock::time_point start) {
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    micros_[stage] += std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    counts_[stage]++;
+  }
 
-    // Skip hidden input files
-    if (file::IsHidden(path)) {
-      continue;
+  void Print(IDiagnostics* diag) const {
+    static const char* kStageNames[kStageCount] = {"values", "xml", "png", "file", "write"};
+    for (size_t i = 0; i < kStageCount; i++) {
+      if (counts_[i] != 0) {
+        diag->Note(DiagMessage() << kStageNames[i] << ": " << counts_[i].load() << " files in "
+                                 << (micros_[i].load() / 1000) << "ms");
+      }
     }
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(CompileTimings);
+
+  std::atomic<int64_t> micros_[kStageCount];
+  std::atomic<size_t> counts_[kStageCount];
+};
+
+// Compiles one input file to `output_writer`. Returns false if the file is not a valid resource
+// file or fails to compile.
+static bool CompileInputFile(IAaptContext* context, const CompileOptions& options,
+                             io::IFile* file, const char dir_sep, IArchiveWriter* output_writer,
+                             CompileTimings* timings) {
+  std::string path = file->GetSource().path;
 
-    if (!options.res_zip && !IsValidFile(context, path)) {
-      error = true;
-      continue;
+  // Skip hidden input files
+  if (file::IsHidden(path)) {
+    return true;
+  }
+
+  if (!options.res_zip && !IsValidFile(context, path)) {
+    return false;
+  }
+
+  // Extract resource type information from the full path
+  std::string err_str;
+  ResourcePathData path_data;
+  if (auto maybe_path_data = ExtractResourcePathData(path, dir_sep, &err_str)) {
+    path_data = maybe_path_data.value();
+  } else {
+    context->GetDiagnostics()->Error(DiagMessage(file->GetSource()) << err_str);
+    return false;
+  }
+
+  // Determine how to compile the file based on its type.
+  auto compile_func = &CompileFile;
+  CompileTimings::Stage stage = CompileTimings::kFile;
+  if (path_data.resource_dir == "values" && path_data.extension == "xml") {
+    compile_func = &CompileTable;
+    stage = CompileTimings::kTable;
+    // We use a different extension (not necessary anymore, but avoids altering the existing
+    // build system logic).
+    path_data.extension = "arsc";
+
+  } else if (const ResourceType* type = ParseResourceType(path_data.resource_dir)) {
+    if (*type != ResourceType::kRaw) {
+      if (*type == ResourceType::kXml || path_data.extension == "xml") {
+        compile_func = &CompileXml;
+        stage = CompileTimings::kXml;
+      } else if ((!options.no_png_crunch && path_data.extension == "png")
+                 || path_data.extension == "9.png") {
+        compile_func = &CompilePng;
+        stage = CompileTimings::kPng;
+      }
     }
+  } else {
+    context->GetDiagnostics()->Error(DiagMessage()
+        << "invalid file path '" << path_data.source << "'");
+    return false;
+  }
 
-    // Extract resource type information from the full path
-    std::string err_str;
-    ResourcePathData path_data;
-    if (auto maybe_path_data = ExtractResourcePathData(path, inputs->GetDirSeparator(), &err_str)) {
-      path_data = maybe_path_data.value();
-    } else {
-      context->GetDiagnostics()->Error(DiagMessage(file->GetSource()) << err_str);
-      error = true;
-      continue;
-    }
-
-    // Determine how to compile the file based on its type.
-    auto compile_func = &CompileFile;
-    if (path_data.resource_dir == "values" && path_data.extension == "xml") {
-      compile_func = &CompileTable;
-      // We use a different extension (not necessary anymore, but avoids altering the existing
-      // build system logic).
-      path_data.extension = "arsc";
-
-    } else if (const ResourceType* type = ParseResourceType(path_data.resource_dir)) {
-      if (*type != ResourceType::kRaw) {
-        if (*type == ResourceType::kXml || path_data.extension == "xml") {
-          compile_func = &CompileXml;
-        } else if ((!options.no_png_crunch && path_data.extension == "png")
-                   || path_data.extension == "9.png") {
-          compile_func = &CompilePng;
+  // Treat periods as a reserved character that should not be present in a file name
+  // Legacy support for AAPT which did not reserve periods
+  if (compile_func != &CompileFile && !options.legacy_mode
+      && std::count(path_data.name.begin(), path_data.name.end(), '.') != 0) {
+    context->GetDiagnostics()->Error(DiagMessage(file->GetSource())
+                                                  << "file name cannot contain '.' other than for"
+                                                  << " specifying the extension");
+    return false;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  const std::string out_path = BuildIntermediateContainerFilename(path_data);
+  if (!compile_func(context, options, path_data, file, output_writer, out_path)) {
+    context->GetDiagnostics()->Error(DiagMessage(file->GetSource()) << "file failed to compile");
+    return false;
+  }
+  timings->Add(stage, start);
+  TRACE_COUNTER("compiled files", 1);
+  return true;
+}
+
+// Compiles `files` on `thread_count` threads. Threads take the next file off a shared counter
+// when done with the last one, so a few slow files do not hold up the rest. Whichever thread
+// finishes the oldest outstanding file writes out its diagnostics and entries, then those of
+// every later file that is already done.
+static bool CompileInParallel(IAaptContext* context, const CompileOptions& options,
+                              const std::vector<io::IFile*>& files, const char dir_sep,
+                              IArchiveWriter* output_writer, size_t thread_count,
+                              CompileTimings* timings) {
+  struct Job {
+    BufferedDiagnostics diagnostics;
+    BufferedArchiveWriter writer;
+    bool compiled = false;
+    bool done = false;
+  };
+  std::vector<Job> jobs(files.size());
+
+  std::atomic<size_t> next_job(0u);
+  std::mutex write_lock;
+  size_t next_write = 0u;  // Guarded by write_lock.
+  bool error = false;      // Guarded by write_lock.
+
+  auto worker = [&]() {
+    size_t i;
+    while ((i = next_job.fetch_add(1u)) < files.size()) {
+      Job& job = jobs[i];
+      ContextWithDiagnostics file_context(context, &job.diagnostics);
+      job.compiled = CompileInputFile(&file_context, options, files[i], dir_sep, &job.writer,
+                                      timings);
+
+      std::lock_guard<std::mutex> lock(write_lock);
+      job.done = true;
+      while (next_write < files.size() && jobs[next_write].done) {
+        const auto start = std::chrono::steady_clock::now();
+        Job& ready = jobs[next_write];
+        ready.diagnostics.Flush(context->GetDiagnostics());
+        if (!ready.writer.Flush(output_writer)) {
+          context->GetDiagnostics()->Error(DiagMessage(files[next_write]->GetSource())
+                                           << "failed to write: " << output_writer->GetError());
+          error = true;
+        }
+        if (!ready.compiled) {
+          error = true;
         }
+        timings->Add(CompileTimings::kWrite, start);
+        next_write++;
       }
-    } else {
-      context->GetDiagnostics()->Error(DiagMessage()
-          << "invalid file path '" << path_data.source << "'");
-      error = true;
-      continue;
     }
+  };
 
-    // Treat periods as a reserved character that should not be present in a file name
-    // Legacy support for AAPT which did not reserve periods
-    if (compile_func != &CompileFile && !options.legacy_mode
-        && std::count(path_data.name.begin(), path_data.name.end(), '.') != 0) {
-      error = true;
-      context->GetDiagnostics()->Error(DiagMessage(file->GetSource())
-                                                    << "file name cannot contain '.' other than for"
-                                                    << " specifying the extension");
-      continue;
-    }
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < thread_count; i++) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  return !error;
+}
+
+int Compile(IAaptContext* context, io::IFileCollection* inputs, IArchiveWriter* output_writer,
+             CompileOptions& options) {
+  TRACE_CALL();
+  bool error = false;
 
-    const std::string out_path = BuildIntermediateContainerFilename(path_data);
-    if (!compile_func(context, options, path_data, file, output_writer, out_path)) {
-      context->GetDiagnostics()->Error(DiagMessage(file->GetSource()) << "file failed to compile");
-      error = true;
+  // Iterate over the input files in a stable, platform-independent manner
+  std::vector<io::IFile*> files;
+  auto file_iterator  = inputs->Iterator();
+  while (file_iterator->HasNext()) {
+    files.push_back(file_iterator->Next());
+  }
+
+  // Every file with symbols writes them to the same text symbols file, leave their order alone.
+  size_t thread_count = options.generate_text_symbols_path ? 1u : options.jobs;
+  thread_count = std::min(thread_count, files.size());
+
+  CompileTimings timings;
+  if (thread_count > 1) {
+    error = !CompileInParallel(context, options, files, inputs->GetDirSeparator(), output_writer,
+                               thread_count, &timings);
+  } else {
+    for (io::IFile* file : files) {
+      if (!CompileInputFile(context, options, file, inputs->GetDirSeparator(), output_writer,
+                            &timings)) {
+        error = true;
+      }
     }
   }
 
+  if (context->IsVerbose()) {
+    timings.Print(context->GetDiagnostics());
+  }
   return error ? 1 : 0;
 }
 
@@ -734,6 +920,25 @@ int CompileCommand::Action(const std::vector<std::string>& args) {
     }
   }
 
+  if (jobs_) {
+    const Maybe<uint32_t> maybe_jobs = ResourceUtils::ParseInt(jobs_.value());
+    if (!maybe_jobs) {
+      context.GetDiagnostics()->Error(DiagMessage() << "-j '" << jobs_.value()
+                                                    << "' is not a valid integer");
+      return 1;
+    }
+    options_.jobs = maybe_jobs.value();
+    if (options_.jobs == 0) {
+      options_.jobs = std::max(1u, std::thread::hardware_concurrency());
+    }
+  }
+
+  if (options_.crunch_cache_dir && !file::mkdirs(options_.crunch_cache_dir.value())) {
+    context.GetDiagnostics()->Error(DiagMessage(options_.crunch_cache_dir.value())
+                                    << "failed to create directory");
+    return 1;
+  }
+
   std::unique_ptr<io::IFileCollection> file_collection;
   std::unique_ptr<IArchiveWriter> archive_writer;
 
@@ -38,6 +38,10 @@ struct CompileOptions {
   // See comments on aapt::ResourceParserOptions.
   bool preserve_visibility_of_styleables = false;
   bool verbose = false;
+  // The number of files compiled at the same time.
+  size_t jobs = 1;
+  // Where crunched PNGs are kept, keyed by the PNG they were crunched from.
+  Maybe<std::string> crunch_cache_dir;
 };
 
 /** Parses flags and compiles resources to be used in linking.  */
@@ -66,6 +70,12 @@ class CompileCommand : public Command {
     AddOptionalFlag("--visibility",
         "Sets the visibility of the compiled resources to the specified\n"
             "level. Accepted levels: public, private, default", &visibility_);
+    AddOptionalFlag("-j",
+        "Number of files to compile at the same time, 0 for one per CPU.\n"
+            "The output is the same as when compiling one file at a time.", &jobs_);
+    AddOptionalFlag("--crunch-cache",
+        "Directory in which crunched PNGs are kept, so that compiling the same PNG\n"
+            "again does not crunch it again.", &options_.crunch_cache_dir, Command::kPath);
     AddOptionalSwitch("-v", "Enables verbose logging", &options_.verbose);
     AddOptionalFlag("--trace-folder", "Generate systrace json trace fragment to specified folder.",
                     &trace_folder_);
@@ -77,6 +87,7 @@ class CompileCommand : public Command {
   IDiagnostics* diagnostic_;
   CompileOptions options_;
   Maybe<std::string> visibility_;
+  Maybe<std::string> jobs_;
   Maybe<std::string> trace_folder_;
 };
 
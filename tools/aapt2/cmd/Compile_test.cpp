@@ -20,6 +20,8 @@
 #include "android-base/stringprintf.h"
 #include "android-base/utf8.h"
 
+#include "compile/Image.h"
+#include "compile/Png.h"
 #include "io/StringStream.h"
 #include "io/ZipArchive.h"
 #include "java/AnnotationProcessor.h"
@@ -140,6 +142,54 @@ TEST_F(CompilerTest, DirInput) {
   ASSERT_EQ(::android::base::utf8::unlink(kOutputFlata.c_str()), 0);
 }
 
+TEST_F(CompilerTest, ParallelDirInputMatchesSerial) {
+  StdErrDiagnostics diag;
+  const std::string kResDir = BuildPath({android::base::Dirname(android::base::GetExecutablePath()),
+                                         "integration-tests", "CompileTest", "DirInput", "res"});
+  const std::string kSerialFlata =
+      BuildPath({android::base::Dirname(android::base::GetExecutablePath()), "integration-tests",
+                 "CompileTest", "DirInput", "serial.flata"});
+  const std::string kParallelFlata =
+      BuildPath({android::base::Dirname(android::base::GetExecutablePath()), "integration-tests",
+                 "CompileTest", "DirInput", "parallel.flata"});
+  ::android::base::utf8::unlink(kSerialFlata.c_str());
+  ::android::base::utf8::unlink(kParallelFlata.c_str());
+
+  ASSERT_EQ(CompileCommand(&diag).Execute({"--dir", kResDir, "-o", kSerialFlata}, &std::cerr), 0);
+  ASSERT_EQ(CompileCommand(&diag).Execute({"--dir", kResDir, "-o", kParallelFlata, "-j", "4"},
+                                          &std::cerr), 0);
+
+  {
+    std::string err;
+    std::unique_ptr<io::ZipFileCollection> serial =
+        io::ZipFileCollection::Create(kSerialFlata, &err);
+    ASSERT_NE(serial, nullptr) << err;
+    std::unique_ptr<io::ZipFileCollection> parallel =
+        io::ZipFileCollection::Create(kParallelFlata, &err);
+    ASSERT_NE(parallel, nullptr) << err;
+
+    // The entries come out in the same order with the same contents.
+    auto serial_iter = serial->Iterator();
+    auto parallel_iter = parallel->Iterator();
+    while (serial_iter->HasNext()) {
+      ASSERT_TRUE(parallel_iter->HasNext());
+      io::IFile* serial_file = serial_iter->Next();
+      io::IFile* parallel_file = parallel_iter->Next();
+      EXPECT_EQ(serial_file->GetSource().path, parallel_file->GetSource().path);
+
+      std::unique_ptr<io::IData> serial_data = serial_file->OpenAsData();
+      std::unique_ptr<io::IData> parallel_data = parallel_file->OpenAsData();
+      ASSERT_NE(serial_data, nullptr);
+      ASSERT_NE(parallel_data, nullptr);
+      ASSERT_EQ(serial_data->size(), parallel_data->size());
+      EXPECT_EQ(0, memcmp(serial_data->data(), parallel_data->data(), serial_data->size()));
+    }
+    EXPECT_FALSE(parallel_iter->HasNext());
+  }
+  ASSERT_EQ(::android::base::utf8::unlink(kSerialFlata.c_str()), 0);
+  ASSERT_EQ(::android::base::utf8::unlink(kParallelFlata.c_str()), 0);
+}
+
 TEST_F(CompilerTest, ZipInput) {
   StdErrDiagnostics diag;
   std::unique_ptr<IAaptContext> context = test::ContextBuilder().Build();
@@ -234,6 +284,83 @@ static void AssertTranslations(CommandTestFixture *ctf, std::string file_name,
   }
 }
 
+TEST_F(CompilerTest, CrunchCacheReusesCrunchedPng) {
+  StdErrDiagnostics diag;
+  std::unique_ptr<IAaptContext> context = test::ContextBuilder().Build();
+
+  // More colors than fit in a palette, with translucent and transparent pixels.
+  const int32_t kSize = 20;
+  Image image;
+  image.width = kSize;
+  image.height = kSize;
+  image.data = std::unique_ptr<uint8_t[]>(new uint8_t[kSize * kSize * 4]);
+  image.rows = std::unique_ptr<uint8_t*[]>(new uint8_t*[kSize]);
+  for (int32_t y = 0; y < kSize; y++) {
+    image.rows[y] = image.data.get() + y * kSize * 4;
+    for (int32_t x = 0; x < kSize; x++) {
+      uint8_t* pixel = image.rows[y] + x * 4;
+      pixel[0] = static_cast<uint8_t>(x * 12);
+      pixel[1] = static_cast<uint8_t>(y * 12);
+      pixel[2] = static_cast<uint8_t>((x + y) * 6);
+      pixel[3] = x == y ? 0u : ((x * y) % 3 == 0 ? 0xffu : 0x80u);
+    }
+  }
+
+  std::string png;
+  {
+    io::StringOutputStream png_out(&png);
+    ASSERT_TRUE(WritePng(context.get(), &image, nullptr, &png_out, {}));
+  }
+
+  const std::string png_path = GetTestPath("res/drawable/test.png");
+  const std::string cache_dir = GetTestPath("crunch-cache");
+  ASSERT_TRUE(WriteFile(png_path, png));
+
+  auto compile = [&](const std::string& out_dir) -> std::string {
+    CHECK(file::mkdirs(out_dir));
+    if (CompileCommand(&diag).Execute({png_path, "-o", out_dir, "--crunch-cache", cache_dir},
+                                      &std::cerr) != 0) {
+      return {};
+    }
+    std::string flat;
+    android::base::ReadFileToString(BuildPath({out_dir, "drawable_test.png.flat"}), &flat);
+    return flat;
+  };
+
+  const std::string flat = compile(GetTestPath("out"));
+  ASSERT_FALSE(flat.empty());
+  Maybe<std::vector<std::string>> entries = file::FindFiles(cache_dir, &diag);
+  ASSERT_TRUE(entries);
+  ASSERT_EQ(entries.value().size(), 1u);
+
+  // Compiling the same PNG again reuses the crunched one.
+  EXPECT_EQ(compile(GetTestPath("out2")), flat);
+  entries = file::FindFiles(cache_dir, &diag);
+  ASSERT_TRUE(entries);
+  EXPECT_EQ(entries.value().size(), 1u);
+
+  // The cached PNG has the pixels it was crunched from, with transparent pixels zeroed.
+  std::string cached_png;
+  ASSERT_TRUE(android::base::ReadFileToString(BuildPath({cache_dir, entries.value()[0]}),
+                                              &cached_png));
+  io::StringInputStream cached_png_in(cached_png);
+  std::unique_ptr<Image> crunched = ReadPng(context.get(), Source("test.png"), &cached_png_in);
+  ASSERT_NE(crunched, nullptr);
+  ASSERT_EQ(crunched->width, kSize);
+  ASSERT_EQ(crunched->height, kSize);
+  for (int32_t y = 0; y < kSize; y++) {
+    for (int32_t x = 0; x < kSize; x++) {
+      const uint8_t* expected = image.rows[y] + x * 4;
+      const uint8_t* actual = crunched->rows[y] + x * 4;
+      const bool transparent = expected[3] == 0u;
+      EXPECT_EQ(actual[0], transparent ? 0u : expected[0]);
+      EXPECT_EQ(actual[1], transparent ? 0u : expected[1]);
+      EXPECT_EQ(actual[2], transparent ? 0u : expected[2]);
+      EXPECT_EQ(actual[3], expected[3]);
+    }
+  }
+}
+
 TEST_F(CompilerTest, DoNotTranslateTest) {
   // The first string (000) is translatable, the second is not
   // ar-XB uses "\u200F\u202E...\u202C\u200F"
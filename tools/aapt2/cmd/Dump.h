@@ -69,7 +69,8 @@ class DumpApkCommand : public Command {
 
     bool error = false;
     for (auto apk : args) {
-      auto loaded_apk = LoadedApk::LoadApkFromPath(apk, diag_);
+      // Most dumps only read the manifest or a few files, so the table is parsed on first use.
+      auto loaded_apk = LoadedApk::LoadApkFromPath(apk, diag_, true /* lazy_table */);
       if (!loaded_apk) {
         error = true;
         continue;
@@ -20,7 +20,9 @@
 #include <cinttypes>
 
 #include <algorithm>
+#include <mutex>
 #include <queue>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
@@ -50,6 +52,7 @@
 #include "io/BigBufferStream.h"
 #include "io/FileStream.h"
 #include "io/FileSystem.h"
+#include "io/StringStream.h"
 #include "io/Util.h"
 #include "io/ZipArchive.h"
 #include "java/JavaClassGenerator.h"
@@ -62,6 +65,7 @@
 #include "link/ResourceExcluder.h"
 #include "link/TableMerger.h"
 #include "link/XmlCompatVersioner.h"
+#include "link/XmlFileCache.h"
 #include "optimize/ResourceDeduper.h"
 #include "optimize/VersionCollapser.h"
 #include "process/IResourceTableConsumer.h"
@@ -211,6 +215,16 @@ class FeatureSplitSymbolTableDelegate : public DefaultSymbolTableDelegate {
   IAaptContext* context_;
 };
 
+// Flattens an XML file to binary XML.
+static bool FlattenXmlToBuffer(IAaptContext* context, const xml::XmlResource& xml_res,
+                               bool keep_raw_values, bool utf16, BigBuffer* out_buffer) {
+  XmlFlattenerOptions options = {};
+  options.keep_raw_values = keep_raw_values;
+  options.use_utf16 = utf16;
+  XmlFlattener flattener(out_buffer, options);
+  return flattener.Consume(context, &xml_res);
+}
+
 static bool FlattenXml(IAaptContext* context, const xml::XmlResource& xml_res,
                        const StringPiece& path, bool keep_raw_values, bool utf16,
                        OutputFormat format, IArchiveWriter* writer) {
@@ -224,11 +238,7 @@ static bool FlattenXml(IAaptContext* context, const xml::XmlResource& xml_res,
   switch (format) {
     case OutputFormat::kApk: {
       BigBuffer buffer(1024);
-      XmlFlattenerOptions options = {};
-      options.keep_raw_values = keep_raw_values;
-      options.use_utf16 = utf16;
-      XmlFlattener flattener(&buffer, options);
-      if (!flattener.Consume(context, &xml_res)) {
+      if (!FlattenXmlToBuffer(context, xml_res, keep_raw_values, utf16, &buffer)) {
         return false;
       }
 
@@ -272,6 +282,12 @@ struct ResourceFileFlattenerOptions {
   OutputFormat output_format = OutputFormat::kApk;
   std::unordered_set<std::string> extensions_to_not_compress;
   Maybe<std::regex> regex_to_not_compress;
+  // The number of XML files linked and flattened at the same time.
+  size_t jobs = 1;
+  // When set, XML files that were linked before in the same environment are read from here
+  // instead of being linked again. Only used for APKs without proguard rules, since flattened
+  // files do not record the rules collected from them.
+  XmlFileCache* xml_file_cache = nullptr;
 };
 
 // A sampling of public framework resource IDs.
@@ -319,16 +335,44 @@ class ResourceFileFlattener {
 
     // The destination to write this file to.
     std::string dst_path;
+
+    // The key of the XML file in the XmlFileCache, if it is used.
+    Maybe<uint64_t> cache_key;
+  };
+
+  // An XML file linked and flattened, possibly on a worker thread. Its diagnostics and entries are
+  // held until everything before it is written out.
+  struct FlattenedXml {
+    BufferedDiagnostics diagnostics;
+    BufferedArchiveWriter writer;
+
+    // The auto-versioned copies of the file, to add to the table.
+    std::vector<std::pair<ResourceFile, std::string>> versioned_files;
+
+    bool flattened = false;
   };
 
   uint32_t GetCompressionFlags(const StringPiece& str);
 
-  std::vector<std::unique_ptr<xml::XmlResource>> LinkAndVersionXmlFile(ResourceTable* table,
+  std::vector<std::unique_ptr<xml::XmlResource>> LinkAndVersionXmlFile(IAaptContext* context,
+                                                                       ResourceTable* table,
                                                                        FileOperation* file_op);
 
+  // Links, versions and flattens the XML file of `file_op`. Does not touch the table, so it may
+  // run for several files at once.
+  bool LinkAndFlattenXmlFile(IAaptContext* context, ResourceTable* table, FileOperation* file_op,
+                             FlattenedXml* out_xml);
+
+  // Writes the documents flattened from an XML file, cached or not, to `out_xml`.
+  bool WriteFlattenedDocuments(IAaptContext* context,
+                               const std::vector<XmlFileCache::Document>& docs,
+                               FlattenedXml* out_xml);
+
   ResourceFileFlattenerOptions options_;
   IAaptContext* context_;
   proguard::KeepSet* keep_set_;
+  // Guards keep_set_ while XML files are linked in parallel.
+  std::mutex keep_set_lock_;
   XmlCompatVersioner::Rules rules_;
 };
 
@@ -423,14 +467,14 @@ std::vector<T> make_singleton_vec(T&& val) {
 }
 
 std::vector<std::unique_ptr<xml::XmlResource>> ResourceFileFlattener::LinkAndVersionXmlFile(
-    ResourceTable* table, FileOperation* file_op) {
+    IAaptContext* context, ResourceTable* table, FileOperation* file_op) {
   TRACE_CALL();
   xml::XmlResource* doc = file_op->xml_to_flatten.get();
   const Source& src = doc->file.source;
 
-  if (context_->IsVerbose()) {
-    context_->GetDiagnostics()->Note(DiagMessage()
-                                     << "linking " << src.path << " (" << doc->file.name << ")");
+  if (context->IsVerbose()) {
+    context->GetDiagnostics()->Note(DiagMessage()
+                                    << "linking " << src.path << " (" << doc->file.name << ")");
   }
 
   // First, strip out any tools namespace attributes. AAPT stripped them out early, which means
@@ -438,17 +482,20 @@ std::vector<std::unique_ptr<xml::XmlResource>> ResourceFileFlattener::LinkAndVer
   xml::StripAndroidStudioAttributes(doc->root.get());
 
   XmlReferenceLinker xml_linker;
-  if (!xml_linker.Consume(context_, doc)) {
+  if (!xml_linker.Consume(context, doc)) {
     return {};
   }
 
-  if (options_.update_proguard_spec && !proguard::CollectProguardRules(context_, doc, keep_set_)) {
-    return {};
+  if (options_.update_proguard_spec) {
+    std::lock_guard<std::mutex> lock(keep_set_lock_);
+    if (!proguard::CollectProguardRules(context, doc, keep_set_)) {
+      return {};
+    }
   }
 
   if (options_.no_xml_namespaces) {
     XmlNamespaceRemover namespace_remover;
-    if (!namespace_remover.Consume(context_, doc)) {
+    if (!namespace_remover.Consume(context, doc)) {
       return {};
     }
   }
@@ -474,7 +521,7 @@ std::vector<std::unique_ptr<xml::XmlResource>> ResourceFileFlattener::LinkAndVer
   XmlCompatVersioner xml_compat_versioner(&rules_);
   const util::Range<ApiVersion> api_range{config.sdkVersion,
                                           FindNextApiVersionForConfig(entry, config)};
-  return xml_compat_versioner.Process(context_, doc, api_range);
+  return xml_compat_versioner.Process(context, doc, api_range);
 }
 
 ResourceFile::Type XmlFileTypeForOutputFormat(OutputFormat format) {
@@ -499,6 +546,20 @@ bool ResourceFileFlattener::Flatten(ResourceTable* table, IArchiveWriter* archiv
 
   proguard::CollectResourceReferences(context_, table, keep_set_);
 
+  // Everything besides the file itself that a linked XML file depends on. The versioned files
+  // added to the table below follow from the rest of it, so it is hashed only once.
+  Maybe<uint64_t> cache_environment;
+  if (options_.xml_file_cache != nullptr) {
+    uint64_t environment = XmlFileCache::HashTable(*table, options_.xml_file_cache->seed());
+    const bool flags[] = {options_.no_auto_version, options_.no_version_vectors,
+                          options_.no_version_transitions, options_.no_xml_namespaces,
+                          options_.keep_raw_values};
+    for (bool flag : flags) {
+      environment = util::Fnv1aHash(flag ? "1" : "0", environment);
+    }
+    cache_environment = environment;
+  }
+
   for (auto& pkg : table->packages) {
     CHECK(!pkg->name.empty()) << "Packages must have names when being linked";
 
@@ -572,6 +633,12 @@ bool ResourceFileFlattener::Flatten(ResourceTable* table, IArchiveWriter* archiv
             file_op.xml_to_flatten->file.config = config_value->config;
             file_op.xml_to_flatten->file.source = file_ref->GetSource();
             file_op.xml_to_flatten->file.name = ResourceName(pkg->name, type->type, entry->name);
+
+            if (cache_environment) {
+              file_op.cache_key = XmlFileCache::GetKey(
+                  cache_environment.value(), file_op.xml_to_flatten->file, file_op.dst_path,
+                  StringPiece(reinterpret_cast<const char*>(data->data()), data->size()));
+            }
           }
 
           // NOTE(adamlesinski): Explicitly construct a StringPiece here, or
@@ -584,63 +651,58 @@ bool ResourceFileFlattener::Flatten(ResourceTable* table, IArchiveWriter* archiv
         }
       }
 
-      // Now flatten the sorted values.
+      // Now flatten the sorted values. The XML files are linked and flattened in parallel, then
+      // everything is added to the table and written to the archive in order.
+      std::vector<FileOperation*> file_ops;
       for (auto& map_entry : config_sorted_files) {
-        const ConfigDescription& config = map_entry.first.first;
-        FileOperation& file_op = map_entry.second;
-
-        if (file_op.xml_to_flatten) {
-          // Check minimum sdk versions supported for drawables
-          auto drawable_entry = kDrawableVersions.find(file_op.xml_to_flatten->root->name);
-          if (drawable_entry != kDrawableVersions.end()) {
-            if (drawable_entry->second > context_->GetMinSdkVersion()
-                && drawable_entry->second > config.sdkVersion) {
-              context_->GetDiagnostics()->Error(DiagMessage(file_op.xml_to_flatten->file.source)
-                                                    << "<" << drawable_entry->first << "> elements "
-                                                    << "require a sdk version of at least "
-                                                    << (int16_t) drawable_entry->second);
-              error = true;
-              continue;
-            }
-          }
+        file_ops.push_back(&map_entry.second);
+      }
 
-          std::vector<std::unique_ptr<xml::XmlResource>> versioned_docs =
-              LinkAndVersionXmlFile(table, &file_op);
-          if (versioned_docs.empty()) {
-            error = true;
-            continue;
+      std::vector<FlattenedXml> flattened_xmls(file_ops.size());
+      {
+        SymbolTable::ConcurrentLookups concurrent_lookups(context_->GetExternalSymbols());
+        util::ParallelFor(file_ops.size(), options_.jobs, [&](size_t i) {
+          if (file_ops[i]->xml_to_flatten) {
+            ContextWithDiagnostics context(context_, &flattened_xmls[i].diagnostics);
+            flattened_xmls[i].flattened =
+                LinkAndFlattenXmlFile(&context, table, file_ops[i], &flattened_xmls[i]);
           }
+        });
+      }
 
-          for (std::unique_ptr<xml::XmlResource>& doc : versioned_docs) {
-            std::string dst_path = file_op.dst_path;
-            if (doc->file.config != file_op.config) {
-              // Only add the new versioned configurations.
-              if (context_->IsVerbose()) {
-                context_->GetDiagnostics()->Note(DiagMessage(doc->file.source)
-                                                 << "auto-versioning resource from config '"
-                                                 << config << "' -> '" << doc->file.config << "'");
-              }
-
-              const ResourceFile& file = doc->file;
-              dst_path = ResourceUtils::BuildResourceFileName(file, context_->GetNameMangler());
+      for (size_t i = 0; i < file_ops.size(); i++) {
+        FileOperation& file_op = *file_ops[i];
+        if (!file_op.xml_to_flatten) {
+          error |= !io::CopyFileToArchive(context_, file_op.file_to_copy, file_op.dst_path,
+                                          GetCompressionFlags(file_op.dst_path), archive_writer);
+          continue;
+        }
 
-              std::unique_ptr<FileReference> file_ref =
-                  util::make_unique<FileReference>(table->string_pool.MakeRef(dst_path));
-              file_ref->SetSource(doc->file.source);
-              // Update the output format of this XML file.
-              file_ref->type = XmlFileTypeForOutputFormat(options_.output_format);
-              if (!table->AddResourceMangled(file.name, file.config, {}, std::move(file_ref),
-                                             context_->GetDiagnostics())) {
-                return false;
-              }
-            }
+        FlattenedXml& flattened_xml = flattened_xmls[i];
+        flattened_xml.diagnostics.Flush(context_->GetDiagnostics());
+        if (!flattened_xml.flattened) {
+          error = true;
+        }
 
-            error |= !FlattenXml(context_, *doc, dst_path, options_.keep_raw_values,
-                                 false /*utf16*/, options_.output_format, archive_writer);
+        // Only add the new versioned configurations.
+        for (const auto& versioned_file : flattened_xml.versioned_files) {
+          const ResourceFile& file = versioned_file.first;
+          std::unique_ptr<FileReference> file_ref =
+              util::make_unique<FileReference>(table->string_pool.MakeRef(versioned_file.second));
+          file_ref->SetSource(file.source);
+          // Update the output format of this XML file.
+          file_ref->type = XmlFileTypeForOutputFormat(options_.output_format);
+          if (!table->AddResourceMangled(file.name, file.config, {}, std::move(file_ref),
+                                         context_->GetDiagnostics())) {
+            return false;
           }
-        } else {
-          error |= !io::CopyFileToArchive(context_, file_op.file_to_copy, file_op.dst_path,
-                                          GetCompressionFlags(file_op.dst_path), archive_writer);
+        }
+
+        if (!flattened_xml.writer.Flush(archive_writer)) {
+          context_->GetDiagnostics()->Error(DiagMessage(file_op.dst_path)
+                                            << "failed to write to archive: "
+                                            << archive_writer->GetError());
+          error = true;
         }
       }
     }
@@ -648,6 +710,111 @@ bool ResourceFileFlattener::Flatten(ResourceTable* table, IArchiveWriter* archiv
   return !error;
 }
 
+bool ResourceFileFlattener::LinkAndFlattenXmlFile(IAaptContext* context, ResourceTable* table,
+                                                  FileOperation* file_op,
+                                                  FlattenedXml* out_xml) {
+  // Check minimum sdk versions supported for drawables
+  auto drawable_entry = kDrawableVersions.find(file_op->xml_to_flatten->root->name);
+  if (drawable_entry != kDrawableVersions.end()) {
+    if (drawable_entry->second > context->GetMinSdkVersion()
+        && drawable_entry->second > file_op->config.sdkVersion) {
+      context->GetDiagnostics()->Error(DiagMessage(file_op->xml_to_flatten->file.source)
+                                           << "<" << drawable_entry->first << "> elements "
+                                           << "require a sdk version of at least "
+                                           << (int16_t) drawable_entry->second);
+      return false;
+    }
+  }
+
+  std::vector<XmlFileCache::Document> cached_docs;
+  if (file_op->cache_key &&
+      options_.xml_file_cache->Load(file_op->cache_key.value(), &cached_docs)) {
+    if (context->IsVerbose()) {
+      context->GetDiagnostics()->Note(DiagMessage(file_op->xml_to_flatten->file.source)
+                                      << "reusing linked file from the incremental cache");
+    }
+    return WriteFlattenedDocuments(context, cached_docs, out_xml);
+  }
+
+  std::vector<std::unique_ptr<xml::XmlResource>> versioned_docs =
+      LinkAndVersionXmlFile(context, table, file_op);
+  if (versioned_docs.empty()) {
+    return false;
+  }
+
+  bool error = false;
+  for (std::unique_ptr<xml::XmlResource>& doc : versioned_docs) {
+    std::string dst_path = file_op->dst_path;
+    const bool versioned = doc->file.config != file_op->config;
+    if (versioned) {
+      if (context->IsVerbose()) {
+        context->GetDiagnostics()->Note(DiagMessage(doc->file.source)
+                                        << "auto-versioning resource from config '"
+                                        << file_op->config << "' -> '" << doc->file.config
+                                        << "'");
+      }
+
+      dst_path = ResourceUtils::BuildResourceFileName(doc->file, context->GetNameMangler());
+      if (!file_op->cache_key) {
+        out_xml->versioned_files.emplace_back(doc->file, dst_path);
+      }
+    }
+
+    if (!file_op->cache_key) {
+      error |= !FlattenXml(context, *doc, dst_path, options_.keep_raw_values, false /*utf16*/,
+                           options_.output_format, &out_xml->writer);
+      continue;
+    }
+
+    BigBuffer buffer(1024);
+    if (!FlattenXmlToBuffer(context, *doc, options_.keep_raw_values, false /*utf16*/, &buffer)) {
+      error = true;
+      continue;
+    }
+
+    XmlFileCache::Document cached_doc;
+    if (versioned) {
+      cached_doc.versioned_file = doc->file;
+    }
+    cached_doc.dst_path = std::move(dst_path);
+    cached_doc.data = buffer.to_string();
+    cached_docs.push_back(std::move(cached_doc));
+  }
+
+  if (error) {
+    return false;
+  }
+
+  if (file_op->cache_key) {
+    // Failing to cache the file only costs linking it again next time.
+    options_.xml_file_cache->Store(file_op->cache_key.value(), cached_docs,
+                                   context->GetDiagnostics());
+    return WriteFlattenedDocuments(context, cached_docs, out_xml);
+  }
+  return true;
+}
+
+bool ResourceFileFlattener::WriteFlattenedDocuments(
+    IAaptContext* context, const std::vector<XmlFileCache::Document>& docs,
+    FlattenedXml* out_xml) {
+  for (const XmlFileCache::Document& doc : docs) {
+    if (doc.versioned_file) {
+      out_xml->versioned_files.emplace_back(doc.versioned_file.value(), doc.dst_path);
+    }
+
+    if (context->IsVerbose()) {
+      context->GetDiagnostics()->Note(DiagMessage(doc.dst_path) << "writing to archive");
+    }
+
+    io::StringInputStream input_stream(doc.data);
+    if (!io::CopyInputStreamToArchive(context, &input_stream, doc.dst_path,
+                                      ArchiveEntry::kCompress, &out_xml->writer)) {
+      return false;
+    }
+  }
+  return true;
+}
+
 static bool WriteStableIdMapToPath(IDiagnostics* diag,
                                    const std::unordered_map<ResourceName, ResourceId>& id_map,
                                    const std::string& id_map_path) {
@@ -812,7 +979,7 @@ class Linker {
   // Pre-condition: context_->GetCompilationPackage() needs to be set.
   bool LoadSymbolsFromIncludePaths() {
     TRACE_NAME("LoadSymbolsFromIncludePaths: #" + std::to_string(options_.include_paths.size()));
-    auto asset_source = util::make_unique<AssetManagerSymbolSource>();
+    auto asset_source = util::make_unique<AssetManagerSymbolSource>(options_.apk_assets_cache);
     for (const std::string& path : options_.include_paths) {
       if (context_->IsVerbose()) {
         context_->GetDiagnostics()->Note(DiagMessage() << "including " << path);
@@ -1566,6 +1733,41 @@ class Linker {
     return true;
   }
 
+  // Sets up the cache of linked XML files in the --incremental-cache directory. Everything an XML
+  // file is linked against, other than the final table, goes into the seed of its keys.
+  bool CreateXmlFileCache() {
+    const std::string& dir = options_.incremental_cache_dir.value();
+    if (options_.output_format != OutputFormat::kApk || options_.generate_proguard_rules_path) {
+      if (context_->IsVerbose()) {
+        context_->GetDiagnostics()->Note(DiagMessage(dir) << "not using the incremental cache "
+                                                          << "for proto or proguard outputs");
+      }
+      return true;
+    }
+
+    if (!file::mkdirs(dir)) {
+      context_->GetDiagnostics()->Error(DiagMessage(dir) << "failed to create directory");
+      return false;
+    }
+
+    uint64_t seed = util::Fnv1aHash(util::GetToolFingerprint());
+    seed = util::Fnv1aHash(context_->GetCompilationPackage(), seed);
+    seed = util::Fnv1aHash(StringPrintf("/%d/%d/%d", context_->GetPackageId(),
+                                        context_->GetMinSdkVersion(),
+                                        static_cast<int>(context_->GetPackageType())),
+                           seed);
+    for (const std::string& path : options_.include_paths) {
+      std::string contents;
+      if (!android::base::ReadFileToString(path, &contents, true /*follow_symlinks*/)) {
+        context_->GetDiagnostics()->Error(DiagMessage(path) << "failed to read included APK");
+        return false;
+      }
+      seed = util::Fnv1aHash(contents, util::Fnv1aHash(path, seed));
+    }
+    xml_file_cache_ = util::make_unique<XmlFileCache>(dir, seed);
+    return true;
+  }
+
   // Writes the AndroidManifest, ResourceTable, and all XML files referenced by the ResourceTable
   // to the IArchiveWriter.
   bool WriteApk(IArchiveWriter* writer, proguard::KeepSet* keep_set, xml::XmlResource* manifest,
@@ -1591,6 +1793,8 @@ class Linker {
     file_flattener_options.update_proguard_spec =
         static_cast<bool>(options_.generate_proguard_rules_path);
     file_flattener_options.output_format = options_.output_format;
+    file_flattener_options.jobs = options_.jobs;
+    file_flattener_options.xml_file_cache = xml_file_cache_.get();
 
     ResourceFileFlattener file_flattener(file_flattener_options, context_, keep_set);
 
@@ -1827,7 +2031,7 @@ class Linker {
       }
     }
 
-    ReferenceLinker linker;
+    ReferenceLinker linker(options_.jobs);
     if (!linker.Consume(context_, &final_table_)) {
       context_->GetDiagnostics()->Error(DiagMessage() << "failed linking references");
       return 1;
@@ -1899,6 +2103,10 @@ class Linker {
       }
     }
 
+    if (options_.incremental_cache_dir && !CreateXmlFileCache()) {
+      return 1;
+    }
+
     proguard::KeepSet proguard_keep_set =
         proguard::KeepSet(options_.generate_conditional_proguard_rules);
     proguard::KeepSet proguard_main_dex_keep_set;
@@ -2038,6 +2246,10 @@ class Linker {
                            proguard_main_dex_keep_set)) {
       return 1;
     }
+
+    if (xml_file_cache_ != nullptr) {
+      xml_file_cache_->RemoveUnusedEntries(context_->GetDiagnostics());
+    }
     return 0;
   }
 
@@ -2050,6 +2262,9 @@ class Linker {
 
   std::unique_ptr<TableMerger> table_merger_;
 
+  // The XML files linked by earlier runs, when --incremental-cache is set.
+  std::unique_ptr<XmlFileCache> xml_file_cache_;
+
   // A pointer to the FileCollection representing the filesystem (not archives).
   std::unique_ptr<io::FileCollection> file_collection_;
 
@@ -2128,6 +2343,19 @@ int LinkCommand::Action(const std::vector<std::string>& args) {
     options_.output_format = OutputFormat::kProto;
   }
 
+  if (jobs_) {
+    const Maybe<uint32_t> maybe_jobs = ResourceUtils::ParseInt(jobs_.value());
+    if (!maybe_jobs) {
+      context.GetDiagnostics()->Error(DiagMessage() << "-j '" << jobs_.value()
+                                                    << "' is not a valid integer");
+      return 1;
+    }
+    options_.jobs = maybe_jobs.value();
+    if (options_.jobs == 0) {
+      options_.jobs = std::max(1u, std::thread::hardware_concurrency());
+    }
+  }
+
   if (package_id_) {
     if (context.GetPackageType() != PackageType::kApp) {
       context.GetDiagnostics()->Error(
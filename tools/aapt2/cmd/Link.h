@@ -29,6 +29,8 @@
 
 namespace aapt {
 
+class ApkAssetsCache;
+
 enum class OutputFormat {
   kApk,
   kProto,
@@ -102,12 +104,22 @@ struct LinkOptions {
 
   // Whether we should fail on definitions of a resource with conflicting visibility.
   bool strict_visibility = false;
+
+  // The number of threads that link references and XML files.
+  size_t jobs = 1;
+
+  // Where XML files linked by this run are kept for later runs.
+  Maybe<std::string> incremental_cache_dir;
+
+  // Keeps the APKs of -I loaded for later links, when set.
+  ApkAssetsCache* apk_assets_cache = nullptr;
 };
 
 class LinkCommand : public Command {
  public:
-  explicit LinkCommand(IDiagnostics* diag) : Command("link", "l"),
-                                             diag_(diag) {
+  explicit LinkCommand(IDiagnostics* diag, ApkAssetsCache* apk_assets_cache = nullptr)
+      : Command("link", "l"), diag_(diag) {
+    options_.apk_assets_cache = apk_assets_cache;
     SetDescription("Links resources into an apk.");
     AddRequiredFlag("-o", "Output path.", &options_.output_path, Command::kPath);
     AddRequiredFlag("--manifest", "Path to the Android manifest to build.",
@@ -284,6 +296,13 @@ class LinkCommand : public Command {
     AddOptionalSwitch("--strict-visibility",
         "Do not allow overlays with different visibility levels.",
         &options_.strict_visibility);
+    AddOptionalFlag("-j",
+        "Number of threads linking references and XML files, 0 for one per CPU.\n"
+            "The output is the same as when linking on one thread.", &jobs_);
+    AddOptionalFlag("--incremental-cache",
+        "Directory in which linked XML files are kept, so that later links with the same\n"
+            "inputs, options and resource IDs do not link them again. Not used with\n"
+            "--proto-format or --proguard.", &options_.incremental_cache_dir, Command::kPath);
     AddOptionalSwitch("-v", "Enables verbose logging.", &verbose_);
     AddOptionalFlag("--trace-folder", "Generate systrace json trace fragment to specified folder.",
                     &trace_folder_);
@@ -298,6 +317,7 @@ class LinkCommand : public Command {
   std::vector<std::string> overlay_arg_list_;
   std::vector<std::string> extra_java_packages_;
   Maybe<std::string> package_id_;
+  Maybe<std::string> jobs_;
   std::vector<std::string> configs_;
   Maybe<std::string> preferred_density_;
   Maybe<std::string> product_list_;
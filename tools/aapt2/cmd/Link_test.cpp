@@ -18,6 +18,7 @@
 
 #include "LoadedApk.h"
 #include "test/Test.h"
+#include "util/Files.h"
 
 using testing::Eq;
 using testing::Ne;
@@ -83,4 +84,76 @@ TEST_F(LinkTest, KeepRawXmlStrings) {
   EXPECT_THAT(util::GetString(tree.getStrings(), static_cast<size_t>(raw_index)), Eq("007"));
 }
 
+TEST_F(LinkTest, IncrementalCacheReusesLinkedXml) {
+  StdErrDiagnostics diag;
+  const std::string compiled_files_dir = GetTestPath("compiled");
+  const std::string cache_dir = GetTestPath("cache");
+  ASSERT_TRUE(CompileFile(GetTestPath("res/xml/test.xml"), R"(<Item AgentCode="007"/>)",
+                          compiled_files_dir, &diag));
+
+  auto link = [&](const std::string& out_apk) -> std::string {
+    std::vector<std::string> link_args = {
+        "--manifest", GetDefaultManifest(),
+        "-o", out_apk,
+        "--incremental-cache", cache_dir,
+    };
+    if (!Link(link_args, compiled_files_dir, &diag)) {
+      return {};
+    }
+
+    std::unique_ptr<LoadedApk> apk = LoadedApk::LoadApkFromPath(out_apk, &diag);
+    std::unique_ptr<io::IData> data = OpenFileAsData(apk.get(), "res/xml/test.xml");
+    if (data == nullptr) {
+      return {};
+    }
+    return std::string(reinterpret_cast<const char*>(data->data()), data->size());
+  };
+
+  const std::string linked_xml = link(GetTestPath("out.apk"));
+  ASSERT_FALSE(linked_xml.empty());
+  Maybe<std::vector<std::string>> entries = file::FindFiles(cache_dir, &diag);
+  ASSERT_TRUE(entries);
+  ASSERT_THAT(entries.value().size(), Eq(1u));
+  const std::string cached_entry = entries.value()[0];
+
+  // An unchanged file comes out of the cache as it was linked.
+  EXPECT_THAT(link(GetTestPath("out2.apk")), Eq(linked_xml));
+  entries = file::FindFiles(cache_dir, &diag);
+  ASSERT_TRUE(entries);
+  EXPECT_THAT(entries.value(), testing::ElementsAre(cached_entry));
+
+  // A changed file is linked again, and replaces the stale entry.
+  ASSERT_TRUE(CompileFile(GetTestPath("res/xml/test.xml"), R"(<Item AgentCode="008"/>)",
+                          compiled_files_dir, &diag));
+  EXPECT_THAT(link(GetTestPath("out3.apk")), Ne(linked_xml));
+  entries = file::FindFiles(cache_dir, &diag);
+  ASSERT_TRUE(entries);
+  ASSERT_THAT(entries.value().size(), Eq(1u));
+  EXPECT_THAT(entries.value()[0], Ne(cached_entry));
+}
+
+TEST_F(LinkTest, LazyTableIsParsedOnFirstUse) {
+  StdErrDiagnostics diag;
+  const std::string compiled_files_dir = GetTestPath("compiled");
+  ASSERT_TRUE(CompileFile(GetTestPath("res/values/values.xml"),
+                          R"(<resources><string name="foo">bar</string></resources>)",
+                          compiled_files_dir, &diag));
+
+  const std::string out_apk = GetTestPath("out.apk");
+  std::vector<std::string> link_args = {
+      "--manifest", GetDefaultManifest(),
+      "-o", out_apk,
+  };
+  ASSERT_TRUE(Link(link_args, compiled_files_dir, &diag));
+
+  std::unique_ptr<LoadedApk> apk = LoadedApk::LoadApkFromPath(out_apk, &diag, true);
+  ASSERT_THAT(apk, Ne(nullptr));
+  ASSERT_THAT(apk->GetManifest(), Ne(nullptr));
+
+  ResourceTable* table = apk->GetResourceTable();
+  ASSERT_THAT(table, Ne(nullptr));
+  EXPECT_TRUE(table->FindResource(test::ParseNameOrDie("com.aapt.command.test:string/foo")));
+  EXPECT_THAT(apk->GetResourceTable(), Eq(table));
+}
+
 }  // namespace aapt
\ No newline at end of file
@@ -16,7 +16,9 @@
 
 #include "Optimize.h"
 
+#include <algorithm>
 #include <memory>
+#include <thread>
 #include <vector>
 
 #include "android-base/file.h"
@@ -203,7 +205,7 @@ class Optimizer {
       MultiApkGenerator generator{apk.get(), context_};
       MultiApkGeneratorOptions generator_options = {
           options_.output_dir.value(), options_.apk_artifacts.value(),
-          options_.table_flattener_options, options_.kept_artifacts};
+          options_.table_flattener_options, options_.kept_artifacts, options_.jobs};
       if (!generator.FromBaseApk(generator_options)) {
         return 1;
       }
@@ -426,6 +428,18 @@ int OptimizeCommand::Action(const std::vector<std::string>& args) {
     return 1;
   }
 
+  if (jobs_) {
+    const Maybe<uint32_t> maybe_jobs = ResourceUtils::ParseInt(jobs_.value());
+    if (!maybe_jobs) {
+      diag->Error(DiagMessage() << "-j '" << jobs_.value() << "' is not a valid integer");
+      return 1;
+    }
+    options_.jobs = maybe_jobs.value();
+    if (options_.jobs == 0) {
+      options_.jobs = std::max(1u, std::thread::hardware_concurrency());
+    }
+  }
+
   std::unique_ptr<LoadedApk> apk = LoadedApk::LoadApkFromPath(apk_path, context.GetDiagnostics());
   if (!apk) {
     return 1;
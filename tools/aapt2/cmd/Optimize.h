@@ -61,6 +61,9 @@ struct OptimizeOptions {
 
   // Path to the output map of original resource paths to shortened paths.
   Maybe<std::string> shortened_paths_map_path;
+
+  // The number of multi-APK artifacts written at the same time.
+  size_t jobs = 1;
 };
 
 class OptimizeCommand : public Command {
@@ -113,6 +116,9 @@ class OptimizeCommand : public Command {
     AddOptionalFlag("--resource-path-shortening-map",
         "Path to output the map of old resource paths to shortened paths.",
         &options_.shortened_paths_map_path);
+    AddOptionalFlag("-j",
+        "Number of multi APK artifacts to generate at the same time, 0 for one per CPU.",
+        &jobs_);
     AddOptionalSwitch("-v", "Enables verbose logging", &verbose_);
   }
 
@@ -128,6 +134,7 @@ class OptimizeCommand : public Command {
   Maybe<std::string> whitelist_path_;
   Maybe<std::string> resources_config_path_;
   Maybe<std::string> target_densities_;
+  Maybe<std::string> jobs_;
   std::vector<std::string> configs_;
   std::vector<std::string> split_args_;
   std::unordered_set<std::string> kept_artifacts_;
@@ -525,32 +525,61 @@ bool WritePng(IAaptContext* context, const Image* image,
   // 1. Every pixel has R == G == B (grayscale)
   // 2. Every pixel has A == 255 (opaque)
   // 3. There are no more than 256 distinct RGBA colors (palette).
+  //
+  // The first two are decided by a branch-free pass over each row, which the compiler can
+  // vectorize. Colors are only collected until there are too many for a palette, and runs of the
+  // same color are only looked up once.
   std::unordered_map<uint32_t, int> color_palette;
   std::unordered_set<uint32_t> alpha_palette;
   bool needs_to_zero_rgb_channels_of_transparent_pixels = false;
-  bool grayscale = true;
+  bool has_translucent_pixels = false;
+  bool palette_overflow = false;
   int max_gray_deviation = 0;
 
   for (int32_t y = 0; y < image->height; y++) {
     const uint8_t* row = image->rows[y];
+    int row_gray_deviation = 0;
+    int row_transparent_colors = 0;
+    int row_translucent_pixels = 0;
     for (int32_t x = 0; x < image->width; x++) {
-      int red = *row++;
-      int green = *row++;
-      int blue = *row++;
-      int alpha = *row++;
-
-      if (alpha == 0) {
-        // The color is completely transparent.
-        // For purposes of palettes and grayscale optimization,
-        // treat all channels as 0x00.
-        needs_to_zero_rgb_channels_of_transparent_pixels =
-            needs_to_zero_rgb_channels_of_transparent_pixels ||
-            (red != 0 || green != 0 || blue != 0);
-        red = green = blue = 0;
+      const int alpha = row[x * 4 + 3];
+      // The color is completely transparent when alpha is 0. For purposes of palettes and
+      // grayscale optimization, treat all channels as 0x00.
+      const int mask = alpha == 0 ? 0 : 0xff;
+      const int red = row[x * 4] & mask;
+      const int green = row[x * 4 + 1] & mask;
+      const int blue = row[x * 4 + 2] & mask;
+
+      row_transparent_colors |= (row[x * 4] | row[x * 4 + 1] | row[x * 4 + 2]) & ~mask;
+      row_translucent_pixels |= alpha ^ 0xff;
+
+      // Calculate the gray scale deviation so that it can be compared
+      // with the threshold.
+      row_gray_deviation = std::max(std::abs(red - green), row_gray_deviation);
+      row_gray_deviation = std::max(std::abs(green - blue), row_gray_deviation);
+      row_gray_deviation = std::max(std::abs(blue - red), row_gray_deviation);
+    }
+    max_gray_deviation = std::max(row_gray_deviation, max_gray_deviation);
+    needs_to_zero_rgb_channels_of_transparent_pixels |= row_transparent_colors != 0;
+    has_translucent_pixels |= row_translucent_pixels != 0;
+
+    if (palette_overflow) {
+      continue;
+    }
+
+    uint32_t last_color = 0u;
+    for (int32_t x = 0; x < image->width; x++) {
+      const uint32_t alpha = row[x * 4 + 3];
+      const uint32_t color = alpha == 0 ? 0u
+                                        : static_cast<uint32_t>(row[x * 4]) << 24 |
+                                              static_cast<uint32_t>(row[x * 4 + 1]) << 16 |
+                                              static_cast<uint32_t>(row[x * 4 + 2]) << 8 | alpha;
+      if (x > 0 && color == last_color) {
+        continue;
       }
+      last_color = color;
 
       // Insert the color into the color palette.
-      const uint32_t color = red << 24 | green << 16 | blue << 8 | alpha;
       color_palette[color] = -1;
 
       // If the pixel has non-opaque alpha, insert it into the
@@ -559,26 +588,31 @@ bool WritePng(IAaptContext* context, const Image* image,
         alpha_palette.insert(color);
       }
 
-      // Check if the image is indeed grayscale.
-      if (grayscale) {
-        if (red != green || red != blue) {
-          grayscale = false;
-        }
+      // Past 256 colors an image can't use a palette, the exact count no longer matters.
+      if (color_palette.size() > 256) {
+        palette_overflow = true;
+        break;
       }
-
-      // Calculate the gray scale deviation so that it can be compared
-      // with the threshold.
-      max_gray_deviation = std::max(std::abs(red - green), max_gray_deviation);
-      max_gray_deviation = std::max(std::abs(green - blue), max_gray_deviation);
-      max_gray_deviation = std::max(std::abs(blue - red), max_gray_deviation);
     }
   }
 
+  // The image is grayscale when every pixel has R == G == B.
+  const bool grayscale = max_gray_deviation == 0;
+
+  // Once colors are no longer collected, the alpha palette may not have seen the translucent
+  // pixels. Only whether it is empty is used then.
+  const size_t alpha_palette_size =
+      has_translucent_pixels ? std::max<size_t>(alpha_palette.size(), 1u) : 0u;
+
   if (context->IsVerbose()) {
     DiagMessage msg;
-    msg << " paletteSize=" << color_palette.size()
-        << " alphaPaletteSize=" << alpha_palette.size()
-        << " maxGrayDeviation=" << max_gray_deviation
+    if (palette_overflow) {
+      msg << " paletteSize>256";
+    } else {
+      msg << " paletteSize=" << color_palette.size()
+          << " alphaPaletteSize=" << alpha_palette.size();
+    }
+    msg << " maxGrayDeviation=" << max_gray_deviation
         << " grayScale=" << (grayscale ? "true" : "false");
     context->GetDiagnostics()->Note(msg);
   }
@@ -587,7 +621,7 @@ bool WritePng(IAaptContext* context, const Image* image,
 
   const int new_color_type = PickColorType(
       image->width, image->height, grayscale, convertible_to_grayscale,
-      nine_patch != nullptr, color_palette.size(), alpha_palette.size());
+      nine_patch != nullptr, color_palette.size(), alpha_palette_size);
 
   if (context->IsVerbose()) {
     DiagMessage msg;
@@ -645,6 +679,8 @@ bool WritePng(IAaptContext* context, const Image* image,
 
     for (int32_t y = 0; y < image->height; y++) {
       png_const_bytep in_row = image->rows[y];
+      uint32_t last_color = 0u;
+      int idx = -1;
       for (int32_t x = 0; x < image->width; x++) {
         int rr = *in_row++;
         int gg = *in_row++;
@@ -656,8 +692,11 @@ bool WritePng(IAaptContext* context, const Image* image,
         }
 
         const uint32_t color = rr << 24 | gg << 16 | bb << 8 | aa;
-        const int idx = color_palette[color];
-        CHECK(idx != -1);
+        if (x == 0 || color != last_color) {
+          idx = color_palette[color];
+          CHECK(idx != -1);
+          last_color = color;
+        }
         out_row[x] = static_cast<png_byte>(idx);
       }
       png_write_row(write_ptr, out_row.get());
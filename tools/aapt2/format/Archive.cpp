@@ -16,6 +16,7 @@
 
 #include "format/Archive.h"
 
+#include <algorithm>
 #include <cstdio>
 #include <memory>
 #include <string>
@@ -27,6 +28,7 @@
 #include "androidfw/StringPiece.h"
 #include "ziparchive/zip_writer.h"
 
+#include "trace/TraceBuffer.h"
 #include "util/Files.h"
 
 using ::android::StringPiece;
@@ -173,6 +175,11 @@ class ZipFileWriter : public IArchiveWriter {
       error_ = ZipWriter::ErrorCodeString(result);
       return false;
     }
+
+    ZipWriter::FileEntry last_entry;
+    if (writer_->GetLastEntry(&last_entry) == 0) {
+      TRACE_COUNTER("zip bytes written", last_entry.compressed_size);
+    }
     return true;
   }
 
@@ -247,6 +254,56 @@ class ZipFileWriter : public IArchiveWriter {
   std::string error_;
 };
 
+// Replays the data of a buffered entry. It can only rewind if the stream the entry was written
+// from could, so that the archive writer makes the same choices it would have made then.
+class BufferedEntryInputStream : public io::InputStream {
+ public:
+  BufferedEntryInputStream(const std::string& data, bool can_rewind)
+      : data_(data), can_rewind_(can_rewind) {
+  }
+
+  bool Next(const void** data, size_t* size) override {
+    if (offset_ == data_.size()) {
+      return false;
+    }
+    *data = data_.data() + offset_;
+    *size = data_.size() - offset_;
+    offset_ = data_.size();
+    return true;
+  }
+
+  void BackUp(size_t count) override {
+    offset_ -= std::min(count, offset_);
+  }
+
+  bool CanRewind() const override {
+    return can_rewind_;
+  }
+
+  bool Rewind() override {
+    if (!can_rewind_) {
+      return false;
+    }
+    offset_ = 0u;
+    return true;
+  }
+
+  size_t ByteCount() const override {
+    return offset_;
+  }
+
+  bool HadError() const override {
+    return false;
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(BufferedEntryInputStream);
+
+  const std::string& data_;
+  bool can_rewind_;
+  size_t offset_ = 0u;
+};
+
 }  // namespace
 
 std::unique_ptr<IArchiveWriter> CreateDirectoryArchiveWriter(IDiagnostics* diag,
@@ -269,4 +326,71 @@ std::unique_ptr<IArchiveWriter> CreateZipFileArchiveWriter(IDiagnostics* diag,
   return std::move(writer);
 }
 
+bool BufferedArchiveWriter::WriteFile(const StringPiece& path, uint32_t flags,
+                                      io::InputStream* in) {
+  if (!StartEntry(path, flags)) {
+    return false;
+  }
+  entries_.back().write_file = true;
+  entries_.back().can_rewind = in->CanRewind();
+
+  const void* data = nullptr;
+  size_t len = 0;
+  while (in->Next(&data, &len)) {
+    if (!Write(data, static_cast<int>(len))) {
+      return false;
+    }
+  }
+  if (in->HadError()) {
+    return false;
+  }
+  return FinishEntry();
+}
+
+bool BufferedArchiveWriter::StartEntry(const StringPiece& path, uint32_t flags) {
+  entries_.push_back(Entry{path.to_string(), flags, {}, false, false, false});
+  return true;
+}
+
+bool BufferedArchiveWriter::Write(const void* data, int len) {
+  if (entries_.empty() || entries_.back().finished) {
+    return false;
+  }
+  entries_.back().data.append(reinterpret_cast<const char*>(data), len);
+  return true;
+}
+
+bool BufferedArchiveWriter::FinishEntry() {
+  if (entries_.empty() || entries_.back().finished) {
+    return false;
+  }
+  entries_.back().finished = true;
+  return true;
+}
+
+bool BufferedArchiveWriter::Flush(IArchiveWriter* writer) {
+  bool result = true;
+  for (const Entry& entry : entries_) {
+    if (!entry.finished) {
+      continue;
+    }
+    if (entry.write_file) {
+      BufferedEntryInputStream in(entry.data, entry.can_rewind);
+      if (!writer->WriteFile(entry.path, entry.flags, &in)) {
+        result = false;
+        break;
+      }
+      continue;
+    }
+    if (!writer->StartEntry(entry.path, entry.flags) ||
+        !writer->Write(entry.data.data(), static_cast<int>(entry.data.size())) ||
+        !writer->FinishEntry()) {
+      result = false;
+      break;
+    }
+  }
+  entries_.clear();
+  return result;
+}
+
 }  // namespace aapt
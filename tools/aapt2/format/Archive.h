@@ -22,6 +22,7 @@
 #include <string>
 #include <vector>
 
+#include "android-base/macros.h"
 #include "androidfw/StringPiece.h"
 #include "google/protobuf/io/zero_copy_stream_impl_lite.h"
 
@@ -70,6 +71,47 @@ class IArchiveWriter : public ::google::protobuf::io::CopyingOutputStream {
   virtual std::string GetError() const = 0;
 };
 
+// Holds on to the entries written on a worker thread until they can be written to the real
+// archive, in the same order as when the work is done serially.
+class BufferedArchiveWriter : public IArchiveWriter {
+ public:
+  BufferedArchiveWriter() = default;
+
+  bool WriteFile(const android::StringPiece& path, uint32_t flags, io::InputStream* in) override;
+
+  bool StartEntry(const android::StringPiece& path, uint32_t flags) override;
+
+  bool FinishEntry() override;
+
+  bool Write(const void* buffer, int size) override;
+
+  bool HadError() const override {
+    return false;
+  }
+
+  std::string GetError() const override {
+    return {};
+  }
+
+  // Writes the finished entries to `writer` and drops them. Returns false if `writer` fails.
+  bool Flush(IArchiveWriter* writer);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(BufferedArchiveWriter);
+
+  struct Entry {
+    std::string path;
+    uint32_t flags;
+    std::string data;
+    bool finished;
+    // Whether the entry was written with WriteFile(), from a stream that could rewind.
+    bool write_file;
+    bool can_rewind;
+  };
+
+  std::vector<Entry> entries_;
+};
+
 std::unique_ptr<IArchiveWriter> CreateDirectoryArchiveWriter(IDiagnostics* diag,
                                                              const android::StringPiece& path);
 
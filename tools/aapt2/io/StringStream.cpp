@@ -47,6 +47,15 @@ size_t StringInputStream::ByteCount() const {
   return offset_;
 }
 
+bool StringInputStream::CanRewind() const {
+  return true;
+}
+
+bool StringInputStream::Rewind() {
+  offset_ = 0u;
+  return true;
+}
+
 size_t StringInputStream::TotalSize() const {
   return str_.size();
 }
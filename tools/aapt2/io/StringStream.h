@@ -45,6 +45,10 @@ class StringInputStream : public KnownSizeInputStream {
     return {};
   }
 
+  bool CanRewind() const override;
+
+  bool Rewind() override;
+
   size_t TotalSize() const override;
 
  private:
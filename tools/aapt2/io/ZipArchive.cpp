@@ -16,6 +16,8 @@
 
 #include "io/ZipArchive.h"
 
+#include <mutex>
+
 #include "utils/FileMap.h"
 #include "ziparchive/zip_archive.h"
 
@@ -53,6 +55,9 @@ std::unique_ptr<IData> ZipFile::OpenAsData() {
   } else {
     std::unique_ptr<uint8_t[]> data =
         std::unique_ptr<uint8_t[]>(new uint8_t[zip_entry_.uncompressed_length]);
+    // The handle is shared by every file of the collection, which may be compiled in parallel.
+    static std::mutex extract_lock;
+    std::lock_guard<std::mutex> lock(extract_lock);
     int32_t result =
         ExtractToMemory(zip_handle_, &zip_entry_, data.get(),
                         static_cast<uint32_t>(zip_entry_.uncompressed_length));
@@ -16,6 +16,8 @@
 
 #include "link/ReferenceLinker.h"
 
+#include <mutex>
+
 #include "android-base/logging.h"
 #include "androidfw/ResourceTypes.h"
 
@@ -48,15 +50,20 @@ class ReferenceLinkerVisitor : public DescendingValueVisitor {
  public:
   using DescendingValueVisitor::Visit;
 
+  // `string_pool_lock` guards `string_pool` when other threads link at the same time, or is
+  // nullptr.
   ReferenceLinkerVisitor(const CallSite& callsite, IAaptContext* context, SymbolTable* symbols,
-                         StringPool* string_pool, xml::IPackageDeclStack* decl)
+                         StringPool* string_pool, std::mutex* string_pool_lock,
+                         xml::IPackageDeclStack* decl)
       : callsite_(callsite),
         context_(context),
         symbols_(symbols),
         package_decls_(decl),
-        string_pool_(string_pool) {}
+        string_pool_(string_pool),
+        string_pool_lock_(string_pool_lock) {}
 
   void Visit(Reference* ref) override {
+    linked_references_++;
     if (!ReferenceLinker::LinkReference(callsite_, ref, context_, symbols_, package_decls_)) {
       error_ = true;
     }
@@ -88,7 +95,14 @@ class ReferenceLinkerVisitor : public DescendingValueVisitor {
 
         // Try to convert the value to a more specific, typed value based on the attribute it is
         // set to.
-        entry.value = ParseValueWithAttribute(std::move(entry.value), symbol->attribute.get());
+        {
+          // Dropping the old value releases its references into the string pool.
+          std::unique_lock<std::mutex> lock;
+          if (string_pool_lock_ != nullptr) {
+            lock = std::unique_lock<std::mutex>(*string_pool_lock_);
+          }
+          entry.value = ParseValueWithAttribute(std::move(entry.value), symbol->attribute.get());
+        }
 
         // Link/resolve the final value (mostly if it's a reference).
         entry.value->Accept(this);
@@ -122,6 +136,10 @@ class ReferenceLinkerVisitor : public DescendingValueVisitor {
     return error_;
   }
 
+  int64_t GetLinkedReferenceCount() const {
+    return linked_references_;
+  }
+
  private:
   DISALLOW_COPY_AND_ASSIGN(ReferenceLinkerVisitor);
 
@@ -155,7 +173,9 @@ class ReferenceLinkerVisitor : public DescendingValueVisitor {
   SymbolTable* symbols_;
   xml::IPackageDeclStack* package_decls_;
   StringPool* string_pool_;
+  std::mutex* string_pool_lock_;
   bool error_ = false;
+  int64_t linked_references_ = 0;
 };
 
 class EmptyDeclStack : public xml::IPackageDeclStack {
@@ -353,49 +373,98 @@ bool ReferenceLinker::LinkReference(const CallSite& callsite, Reference* referen
   return false;
 }
 
+// Links the entries of one type of `package`.
+static bool LinkType(IAaptContext* context, ResourceTablePackage* package,
+                     ResourceTableType* type, StringPool* string_pool,
+                     std::mutex* string_pool_lock) {
+  EmptyDeclStack decl_stack;
+  bool error = false;
+  int64_t linked_references = 0;
+  for (auto& entry : type->entries) {
+    // First, unmangle the name if necessary.
+    ResourceName name(package->name, type->type, entry->name);
+    NameMangler::Unmangle(&name.entry, &name.package);
+
+    // Symbol state information may be lost if there is no value for the resource.
+    if (entry->visibility.level != Visibility::Level::kUndefined && entry->values.empty()) {
+      context->GetDiagnostics()->Error(DiagMessage(entry->visibility.source)
+                                           << "no definition for declared symbol '" << name
+                                           << "'");
+      error = true;
+    }
+
+    // Ensure that definitions for values declared as overlayable exist
+    if (entry->overlayable_item && entry->values.empty()) {
+      context->GetDiagnostics()->Error(DiagMessage(entry->overlayable_item.value().source)
+                                       << "no definition for overlayable symbol '"
+                                       << name << "'");
+      error = true;
+    }
+
+    // The context of this resource is the package in which it is defined.
+    const CallSite callsite{name.package};
+    ReferenceLinkerVisitor visitor(callsite, context, context->GetExternalSymbols(),
+                                   string_pool, string_pool_lock, &decl_stack);
+
+    for (auto& config_value : entry->values) {
+      config_value->value->Accept(&visitor);
+    }
+
+    if (visitor.HasError()) {
+      error = true;
+    }
+    linked_references += visitor.GetLinkedReferenceCount();
+  }
+  TRACE_COUNTER("linked references", linked_references);
+  return !error;
+}
+
 bool ReferenceLinker::Consume(IAaptContext* context, ResourceTable* table) {
   TRACE_NAME("ReferenceLinker::Consume");
-  EmptyDeclStack decl_stack;
   bool error = false;
+  std::vector<std::pair<ResourceTablePackage*, ResourceTableType*>> types;
   for (auto& package : table->packages) {
     // Since we're linking, each package must have a name.
     CHECK(!package->name.empty()) << "all packages being linked must have a name";
 
     for (auto& type : package->types) {
-      for (auto& entry : type->entries) {
-        // First, unmangle the name if necessary.
-        ResourceName name(package->name, type->type, entry->name);
-        NameMangler::Unmangle(&name.entry, &name.package);
-
-        // Symbol state information may be lost if there is no value for the resource.
-        if (entry->visibility.level != Visibility::Level::kUndefined && entry->values.empty()) {
-          context->GetDiagnostics()->Error(DiagMessage(entry->visibility.source)
-                                               << "no definition for declared symbol '" << name
-                                               << "'");
+      if (thread_count_ <= 1u) {
+        if (!LinkType(context, package.get(), type.get(), &table->string_pool, nullptr)) {
           error = true;
         }
-
-        // Ensure that definitions for values declared as overlayable exist
-        if (entry->overlayable_item && entry->values.empty()) {
-          context->GetDiagnostics()->Error(DiagMessage(entry->overlayable_item.value().source)
-                                           << "no definition for overlayable symbol '"
-                                           << name << "'");
+      } else if (type->type == ResourceType::kAttr || type->type == ResourceType::kAttrPrivate) {
+        // Linking the other types reads the attributes through the symbol table, so they are
+        // linked first and do not change while the other types link in parallel.
+        if (!LinkType(context, package.get(), type.get(), &table->string_pool, nullptr)) {
           error = true;
         }
+      } else {
+        types.emplace_back(package.get(), type.get());
+      }
+    }
+  }
 
-        // The context of this resource is the package in which it is defined.
-        const CallSite callsite{name.package};
-        ReferenceLinkerVisitor visitor(callsite, context, context->GetExternalSymbols(),
-                                       &table->string_pool, &decl_stack);
+  if (types.empty()) {
+    return !error;
+  }
 
-        for (auto& config_value : entry->values) {
-          config_value->value->Accept(&visitor);
-        }
+  // Diagnostics are held per type and logged in type order.
+  std::vector<BufferedDiagnostics> diagnostics(types.size());
+  std::unique_ptr<bool[]> linked(new bool[types.size()]);
+  std::mutex string_pool_lock;
+  {
+    SymbolTable::ConcurrentLookups concurrent_lookups(context->GetExternalSymbols());
+    util::ParallelFor(types.size(), thread_count_, [&](size_t i) {
+      ContextWithDiagnostics type_context(context, &diagnostics[i]);
+      linked[i] = LinkType(&type_context, types[i].first, types[i].second, &table->string_pool,
+                           &string_pool_lock);
+    });
+  }
 
-        if (visitor.HasError()) {
-          error = true;
-        }
-      }
+  for (size_t i = 0; i < types.size(); i++) {
+    diagnostics[i].Flush(context->GetDiagnostics());
+    if (!linked[i]) {
+      error = true;
     }
   }
   return !error;
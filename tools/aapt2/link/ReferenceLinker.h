@@ -33,7 +33,9 @@ namespace aapt {
 // Once the ResourceTable is processed by this linker, it is ready to be flattened.
 class ReferenceLinker : public IResourceTableConsumer {
  public:
-  ReferenceLinker() = default;
+  // Links the types of the table on up to `thread_count` threads.
+  explicit ReferenceLinker(size_t thread_count = 1u) : thread_count_(thread_count) {
+  }
 
   // Performs name mangling and looks up the resource in the symbol table. Uses the callsite's
   // package if the reference has no package name defined (implicit).
@@ -84,6 +86,8 @@ class ReferenceLinker : public IResourceTableConsumer {
 
  private:
   DISALLOW_COPY_AND_ASSIGN(ReferenceLinker);
+
+  size_t thread_count_;
 };
 
 }  // namespace aapt
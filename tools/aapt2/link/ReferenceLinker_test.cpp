@@ -72,6 +72,55 @@ TEST(ReferenceLinkerTest, LinkSimpleReferences) {
   EXPECT_EQ(ResourceId(0x01040034), ref->id.value());
 }
 
+TEST(ReferenceLinkerTest, LinkTypesInParallel) {
+  test::ResourceTableBuilder builder;
+  builder.SetPackageId("com.app.test", 0x7f);
+  for (int i = 0; i < 100; i++) {
+    const std::string index = std::to_string(i);
+    builder.AddReference("com.app.test:string/foo" + index, ResourceId(0x7f020000 + i),
+                         "android:string/ok");
+    builder.AddReference("com.app.test:color/foo" + index, ResourceId(0x7f030000 + i),
+                         "string/foo" + index);
+    builder.AddReference("com.app.test:dimen/foo" + index, ResourceId(0x7f040000 + i),
+                         "color/foo" + index);
+  }
+  builder.AddReference("com.app.test:integer/bad", ResourceId(0x7f050000), "string/missing");
+  std::unique_ptr<ResourceTable> table = builder.Build();
+
+  std::unique_ptr<IAaptContext> context =
+      test::ContextBuilder()
+          .SetCompilationPackage("com.app.test")
+          .SetPackageId(0x7f)
+          .SetNameManglerPolicy(NameManglerPolicy{"com.app.test"})
+          .AddSymbolSource(util::make_unique<ResourceTableSymbolSource>(table.get()))
+          .AddSymbolSource(test::StaticSymbolSourceBuilder()
+                               .AddPublicSymbol("android:string/ok", ResourceId(0x01040034))
+                               .Build())
+          .Build();
+
+  // The one missing reference still fails the whole table.
+  ReferenceLinker linker(4u);
+  ASSERT_FALSE(linker.Consume(context.get(), table.get()));
+
+  for (int i = 0; i < 100; i++) {
+    const std::string index = std::to_string(i);
+    Reference* ref = test::GetValue<Reference>(table.get(), "com.app.test:string/foo" + index);
+    ASSERT_THAT(ref, NotNull());
+    ASSERT_TRUE(ref->id);
+    EXPECT_EQ(ResourceId(0x01040034), ref->id.value());
+
+    ref = test::GetValue<Reference>(table.get(), "com.app.test:color/foo" + index);
+    ASSERT_THAT(ref, NotNull());
+    ASSERT_TRUE(ref->id);
+    EXPECT_EQ(ResourceId(0x7f020000 + i), ref->id.value());
+
+    ref = test::GetValue<Reference>(table.get(), "com.app.test:dimen/foo" + index);
+    ASSERT_THAT(ref, NotNull());
+    ASSERT_TRUE(ref->id);
+    EXPECT_EQ(ResourceId(0x7f030000 + i), ref->id.value());
+  }
+}
+
 TEST(ReferenceLinkerTest, LinkStyleAttributes) {
   std::unique_ptr<ResourceTable> table =
       test::ResourceTableBuilder()
@@ -224,6 +224,7 @@ static ResourceTable::CollisionResult MergeConfigValue(IAaptContext* context,
 bool TableMerger::DoMerge(const Source& src, ResourceTablePackage* src_package, bool mangle_package,
                           bool overlay, bool allow_new_resources) {
   bool error = false;
+  int64_t merged_values = 0;
 
   for (auto& src_type : src_package->types) {
     ResourceTableType* dst_type = master_package_->FindOrCreateType(src_type->type);
@@ -283,6 +284,7 @@ bool TableMerger::DoMerge(const Source& src, ResourceTablePackage* src_package,
         }
 
         // Continue if we're taking the new resource.
+        merged_values++;
 
         if (FileReference* f = ValueCast<FileReference>(src_config_value->value.get())) {
           std::unique_ptr<FileReference> new_file_ref;
@@ -309,6 +311,7 @@ bool TableMerger::DoMerge(const Source& src, ResourceTablePackage* src_package,
       }
     }
   }
+  TRACE_COUNTER("merged values", merged_values);
   return !error;
 }
 
@@ -0,0 +1,263 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "link/XmlFileCache.h"
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+
+#include "android-base/file.h"
+#include "android-base/stringprintf.h"
+
+#include "ResourceValues.h"
+#include "util/Files.h"
+#include "util/Util.h"
+
+using ::android::ConfigDescription;
+using ::android::StringPiece;
+using ::android::base::StringPrintf;
+
+namespace aapt {
+
+constexpr static uint32_t kCacheEntryMagic = 0x43584141u;  // 'AAXC'
+constexpr static const char* kCacheEntryExtension = ".xmlc";
+
+namespace {
+
+template <typename T>
+uint64_t HashValue(const T& value, uint64_t hash) {
+  return util::Fnv1aHash(StringPiece(reinterpret_cast<const char*>(&value), sizeof(T)), hash);
+}
+
+template <typename T>
+uint64_t HashMaybe(const Maybe<T>& value, uint64_t hash) {
+  hash = HashValue(static_cast<bool>(value), hash);
+  return value ? HashValue(value.value(), hash) : hash;
+}
+
+// Strings are hashed with their size, so that consecutive strings can not run into each other.
+uint64_t HashString(const StringPiece& str, uint64_t hash) {
+  return util::Fnv1aHash(str, HashValue(str.size(), hash));
+}
+
+template <typename T>
+void Append(const T& value, std::string* out) {
+  out->append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void AppendString(const StringPiece& str, std::string* out) {
+  Append(static_cast<uint32_t>(str.size()), out);
+  out->append(str.data(), str.size());
+}
+
+// Reads consecutive values out of a cache entry, failing once it runs out of data.
+class EntryReader {
+ public:
+  explicit EntryReader(const StringPiece& data) : data_(data) {}
+
+  template <typename T>
+  bool Read(T* out_value) {
+    if (data_.size() - position_ < sizeof(T)) {
+      return false;
+    }
+    memcpy(out_value, data_.data() + position_, sizeof(T));
+    position_ += sizeof(T);
+    return true;
+  }
+
+  bool ReadString(std::string* out_str) {
+    uint32_t size;
+    if (!Read(&size) || data_.size() - position_ < size) {
+      return false;
+    }
+    out_str->assign(data_.data() + position_, size);
+    position_ += size;
+    return true;
+  }
+
+  bool AtEnd() const {
+    return position_ == data_.size();
+  }
+
+ private:
+  StringPiece data_;
+  size_t position_ = 0u;
+};
+
+}  // namespace
+
+uint64_t XmlFileCache::HashTable(const ResourceTable& table, uint64_t hash) {
+  for (const auto& package : table.packages) {
+    hash = HashString(package->name, hash);
+    hash = HashMaybe(package->id, hash);
+    for (const auto& type : package->types) {
+      hash = HashString(to_string(type->type), hash);
+      hash = HashMaybe(type->id, hash);
+      hash = HashValue(type->visibility_level, hash);
+      for (const auto& entry : type->entries) {
+        hash = HashString(entry->name, hash);
+        hash = HashMaybe(entry->id, hash);
+        hash = HashValue(entry->visibility.level, hash);
+        for (const auto& config_value : entry->values) {
+          // The configurations of an entry decide how its XML files are auto-versioned.
+          hash = HashString(config_value->config.to_string(), hash);
+          hash = HashString(config_value->product, hash);
+
+          // The formats of attributes decide how the XML attributes using them are compiled.
+          const Attribute* attr = ValueCast<Attribute>(config_value->value.get());
+          if (attr == nullptr) {
+            continue;
+          }
+          hash = HashValue(attr->type_mask, hash);
+          hash = HashValue(attr->min_int, hash);
+          hash = HashValue(attr->max_int, hash);
+          for (const Attribute::Symbol& symbol : attr->symbols) {
+            hash = HashString(symbol.symbol.name ? symbol.symbol.name.value().to_string() : "",
+                              hash);
+            hash = HashMaybe(symbol.symbol.id, hash);
+            hash = HashValue(symbol.value, hash);
+          }
+        }
+      }
+    }
+  }
+  return hash;
+}
+
+XmlFileCache::XmlFileCache(const std::string& dir, uint64_t seed) : dir_(dir), seed_(seed) {
+}
+
+uint64_t XmlFileCache::GetKey(uint64_t environment, const ResourceFile& file,
+                              const StringPiece& dst_path, const StringPiece& data) {
+  uint64_t hash = HashString(file.name.to_string(), environment);
+  hash = HashString(file.config.to_string(), hash);
+  hash = HashString(file.source.path, hash);
+  hash = HashString(dst_path, hash);
+  return HashString(data, hash);
+}
+
+std::string XmlFileCache::GetEntryName(uint64_t key) {
+  return StringPrintf("%016llx%s", static_cast<unsigned long long>(key), kCacheEntryExtension);
+}
+
+bool XmlFileCache::Load(uint64_t key, std::vector<Document>* out_docs) {
+  const std::string name = GetEntryName(key);
+  std::string contents;
+  if (!android::base::ReadFileToString(file::BuildPath({dir_, name}), &contents)) {
+    return false;
+  }
+
+  EntryReader reader(contents);
+  uint32_t magic;
+  uint32_t doc_count;
+  if (!reader.Read(&magic) || magic != kCacheEntryMagic || !reader.Read(&doc_count)) {
+    return false;
+  }
+
+  out_docs->clear();
+  for (uint32_t i = 0; i < doc_count; i++) {
+    Document doc;
+    uint8_t versioned;
+    if (!reader.Read(&versioned)) {
+      return false;
+    }
+
+    if (versioned != 0u) {
+      ResourceFile file;
+      std::string type;
+      std::string config;
+      if (!reader.ReadString(&file.name.package) || !reader.ReadString(&type) ||
+          !reader.ReadString(&file.name.entry) || !reader.ReadString(&config) ||
+          !reader.ReadString(&file.source.path)) {
+        return false;
+      }
+
+      const ResourceType* parsed_type = ParseResourceType(type);
+      if (parsed_type == nullptr || !ConfigDescription::Parse(config, &file.config)) {
+        return false;
+      }
+      file.name.type = *parsed_type;
+      doc.versioned_file = std::move(file);
+    }
+
+    if (!reader.ReadString(&doc.dst_path) || !reader.ReadString(&doc.data)) {
+      return false;
+    }
+    out_docs->push_back(std::move(doc));
+  }
+
+  if (!reader.AtEnd()) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(lock_);
+  used_entries_.insert(name);
+  return true;
+}
+
+bool XmlFileCache::Store(uint64_t key, const std::vector<Document>& docs, IDiagnostics* diag) {
+  std::string contents;
+  Append(kCacheEntryMagic, &contents);
+  Append(static_cast<uint32_t>(docs.size()), &contents);
+  for (const Document& doc : docs) {
+    Append(static_cast<uint8_t>(doc.versioned_file ? 1u : 0u), &contents);
+    if (doc.versioned_file) {
+      const ResourceFile& file = doc.versioned_file.value();
+      AppendString(file.name.package, &contents);
+      AppendString(to_string(file.name.type), &contents);
+      AppendString(file.name.entry, &contents);
+      AppendString(file.config.to_string(), &contents);
+      AppendString(file.source.path, &contents);
+    }
+    AppendString(doc.dst_path, &contents);
+    AppendString(doc.data, &contents);
+  }
+
+  // Write to a temporary file first, so that a link that is interrupted, or that runs at the
+  // same time, never sees a partial entry.
+  const std::string name = GetEntryName(key);
+  const std::string path = file::BuildPath({dir_, name});
+  const std::string tmp_path = path + ".tmp";
+  if (!android::base::WriteStringToFile(contents, tmp_path) ||
+      rename(tmp_path.c_str(), path.c_str()) != 0) {
+    diag->Warn(DiagMessage(path) << "failed to write to the incremental cache");
+    unlink(tmp_path.c_str());
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(lock_);
+  used_entries_.insert(name);
+  return true;
+}
+
+void XmlFileCache::RemoveUnusedEntries(IDiagnostics* diag) {
+  Maybe<std::vector<std::string>> entries = file::FindFiles(dir_, diag);
+  if (!entries) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(lock_);
+  for (const std::string& entry : entries.value()) {
+    if (util::EndsWith(entry, kCacheEntryExtension) &&
+        used_entries_.find(entry) == used_entries_.end()) {
+      unlink(file::BuildPath({dir_, entry}).c_str());
+    }
+  }
+}
+
+}  // namespace aapt
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AAPT_LINK_XMLFILECACHE_H
+#define AAPT_LINK_XMLFILECACHE_H
+
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "android-base/macros.h"
+#include "androidfw/StringPiece.h"
+
+#include "Diagnostics.h"
+#include "Maybe.h"
+#include "Resource.h"
+#include "ResourceTable.h"
+
+namespace aapt {
+
+// A directory of the XML files that earlier runs of `aapt2 link` linked, versioned and flattened,
+// so that a later run only has to link the files that changed.
+//
+// An entry is keyed by a hash of the compiled file and of its link environment: the tool, the
+// options, the included APKs and the names, IDs, visibility, configurations and attribute formats
+// of the resources in the table. Anything else an XML file is linked against can not change its
+// flattened form. Cached entries only reproduce the output of a successful link, and not the
+// warnings it printed.
+class XmlFileCache {
+ public:
+  // An XML document flattened from a file.
+  struct Document {
+    // The resource file of a document auto-versioned from the file, to add to the table. Empty
+    // for the document of the file itself.
+    Maybe<ResourceFile> versioned_file;
+
+    std::string dst_path;
+
+    // The flattened binary XML.
+    std::string data;
+  };
+
+  // Returns `hash` continued with everything in `table` that linking an XML file against it
+  // depends on.
+  static uint64_t HashTable(const ResourceTable& table, uint64_t hash);
+
+  // `dir` must exist. `seed` hashes the tool, the options and the included APKs.
+  XmlFileCache(const std::string& dir, uint64_t seed);
+
+  uint64_t seed() const {
+    return seed_;
+  }
+
+  // Returns the key of the compiled XML file `data`, from the resource file `file`, linked in the
+  // environment `environment`.
+  static uint64_t GetKey(uint64_t environment, const ResourceFile& file,
+                         const android::StringPiece& dst_path, const android::StringPiece& data);
+
+  // Reads the documents flattened from the file of `key`. Returns false if the file is not
+  // cached.
+  bool Load(uint64_t key, std::vector<Document>* out_docs);
+
+  // Caches the documents flattened from the file of `key`.
+  bool Store(uint64_t key, const std::vector<Document>& docs, IDiagnostics* diag);
+
+  // Deletes the cached files that were neither loaded nor stored by this cache, as they belong to
+  // inputs that no longer exist or have changed.
+  void RemoveUnusedEntries(IDiagnostics* diag);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(XmlFileCache);
+
+  static std::string GetEntryName(uint64_t key);
+
+  std::string dir_;
+  uint64_t seed_;
+
+  // Guards used_entries_, as XML files are linked in parallel.
+  std::mutex lock_;
+  std::unordered_set<std::string> used_entries_;
+};
+
+}  // namespace aapt
+
+#endif  // AAPT_LINK_XMLFILECACHE_H
@@ -35,6 +35,8 @@ struct MultiApkGeneratorOptions {
   std::vector<configuration::OutputArtifact> apk_artifacts;
   TableFlattenerOptions table_flattener_options;
   std::unordered_set<std::string> kept_artifacts;
+  // The number of artifacts generated at the same time.
+  size_t jobs = 1;
 };
 
 /**
@@ -65,6 +67,13 @@ class MultiApkGenerator {
   bool UpdateManifest(const configuration::OutputArtifact& artifact,
                       std::unique_ptr<xml::XmlResource>* updated_manifest, IDiagnostics* diag);
 
+  /**
+   * Writes the APK of a single artifact. Only reads the base APK, so that artifacts can be written
+   * in parallel.
+   */
+  bool WriteArtifact(IAaptContext* context, const configuration::OutputArtifact& artifact,
+                     const MultiApkGeneratorOptions& options);
+
   /**
    * Adds the <screen> elements to the parent node for the provided density configuration.
    */
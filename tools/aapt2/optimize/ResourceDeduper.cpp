@@ -17,6 +17,7 @@
 #include "optimize/ResourceDeduper.h"
 
 #include <algorithm>
+#include <unordered_map>
 
 #include "DominatorTree.h"
 #include "ResourceTable.h"
@@ -44,7 +45,13 @@ class DominatedKeyValueRemover : public DominatorTree::BottomUpVisitor {
   using Node = DominatorTree::Node;
 
   explicit DominatedKeyValueRemover(IAaptContext* context, ResourceEntry* entry)
-      : context_(context), entry_(entry) {}
+      : context_(context), entry_(entry) {
+    // Every value is compared against its parent and all of its siblings, so hash each one once
+    // to skip the deep comparison of values that can not be equal.
+    for (const auto& config_value : entry_->values) {
+      hashes_[config_value->value.get()] = config_value->value->Hash();
+    }
+  }
 
   void VisitConfig(Node* node) {
     Node* parent = node->parent();
@@ -56,7 +63,7 @@ class DominatedKeyValueRemover : public DominatorTree::BottomUpVisitor {
     if (!node_value || !parent_value) {
       return;
     }
-    if (!node_value->value->Equals(parent_value->value.get())) {
+    if (!ValuesEqual(node_value->value.get(), parent_value->value.get())) {
       return;
     }
 
@@ -69,7 +76,7 @@ class DominatedKeyValueRemover : public DominatorTree::BottomUpVisitor {
         continue;
       }
       if (node_configuration.IsCompatibleWith(sibling->config) &&
-          !node_value->value->Equals(sibling->value.get())) {
+          !ValuesEqual(node_value->value.get(), sibling->value.get())) {
         // The configurations are compatible, but the value is
         // different, so we can't remove this value.
         return;
@@ -89,8 +96,13 @@ class DominatedKeyValueRemover : public DominatorTree::BottomUpVisitor {
  private:
   DISALLOW_COPY_AND_ASSIGN(DominatedKeyValueRemover);
 
+  bool ValuesEqual(const Value* a, const Value* b) {
+    return hashes_[a] == hashes_[b] && a->Equals(b);
+  }
+
   IAaptContext* context_;
   ResourceEntry* entry_;
+  std::unordered_map<const Value*, uint64_t> hashes_;
 };
 
 static void DedupeEntry(IAaptContext* context, ResourceEntry* entry) {
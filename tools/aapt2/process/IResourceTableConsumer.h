@@ -52,6 +52,53 @@ struct IAaptContext {
   virtual int GetMinSdkVersion() = 0;
 };
 
+// A context that logs to `diagnostics`, and forwards everything else to `context`. Used to give
+// each worker thread its own diagnostics.
+class ContextWithDiagnostics : public IAaptContext {
+ public:
+  ContextWithDiagnostics(IAaptContext* context, IDiagnostics* diagnostics)
+      : context_(context), diagnostics_(diagnostics) {
+  }
+
+  PackageType GetPackageType() override {
+    return context_->GetPackageType();
+  }
+
+  SymbolTable* GetExternalSymbols() override {
+    return context_->GetExternalSymbols();
+  }
+
+  IDiagnostics* GetDiagnostics() override {
+    return diagnostics_;
+  }
+
+  const std::string& GetCompilationPackage() override {
+    return context_->GetCompilationPackage();
+  }
+
+  uint8_t GetPackageId() override {
+    return context_->GetPackageId();
+  }
+
+  NameMangler* GetNameMangler() override {
+    return context_->GetNameMangler();
+  }
+
+  bool IsVerbose() override {
+    return context_->IsVerbose();
+  }
+
+  int GetMinSdkVersion() override {
+    return context_->GetMinSdkVersion();
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ContextWithDiagnostics);
+
+  IAaptContext* context_;
+  IDiagnostics* diagnostics_;
+};
+
 struct IResourceTableConsumer {
   virtual ~IResourceTableConsumer() = default;
 
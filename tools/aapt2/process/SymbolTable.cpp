@@ -16,6 +16,8 @@
 
 #include "process/SymbolTable.h"
 
+#include <sys/stat.h>
+
 #include <iostream>
 
 #include "android-base/logging.h"
@@ -47,6 +49,25 @@ SymbolTable::SymbolTable(NameMangler* mangler)
       id_cache_(200) {
 }
 
+SymbolTable::ConcurrentLookups::ConcurrentLookups(SymbolTable* table) : table_(table) {
+  std::lock_guard<std::mutex> lock(table_->lock_);
+  table_->concurrent_lookups_++;
+}
+
+SymbolTable::ConcurrentLookups::~ConcurrentLookups() {
+  std::lock_guard<std::mutex> lock(table_->lock_);
+  if (--table_->concurrent_lookups_ == 0) {
+    table_->retained_.clear();
+  }
+}
+
+const SymbolTable::Symbol* SymbolTable::Retain(const std::shared_ptr<Symbol>& symbol) {
+  if (concurrent_lookups_ > 0) {
+    retained_.insert(symbol);
+  }
+  return symbol.get();
+}
+
 void SymbolTable::SetDelegate(std::unique_ptr<ISymbolTableDelegate> delegate) {
   CHECK(delegate != nullptr) << "can't set a nullptr delegate";
   delegate_ = std::move(delegate);
@@ -71,6 +92,7 @@ void SymbolTable::PrependSource(std::unique_ptr<ISymbolSource> source) {
 }
 
 const SymbolTable::Symbol* SymbolTable::FindByName(const ResourceName& name) {
+  std::lock_guard<std::mutex> lock(lock_);
   const ResourceName* name_with_package = &name;
 
   // Fill in the package name if necessary.
@@ -84,7 +106,7 @@ const SymbolTable::Symbol* SymbolTable::FindByName(const ResourceName& name) {
 
   // We store the name unmangled in the cache, so look it up as-is.
   if (const std::shared_ptr<Symbol>& s = cache_.get(*name_with_package)) {
-    return s.get();
+    return Retain(s);
   }
 
   // The name was not found in the cache. Mangle it (if necessary) and find it in our sources.
@@ -116,12 +138,13 @@ const SymbolTable::Symbol* SymbolTable::FindByName(const ResourceName& name) {
 
   // Returns the raw pointer. Callers are not expected to hold on to this
   // between calls to Find*.
-  return shared_symbol.get();
+  return Retain(shared_symbol);
 }
 
 const SymbolTable::Symbol* SymbolTable::FindById(const ResourceId& id) {
+  std::lock_guard<std::mutex> lock(lock_);
   if (const std::shared_ptr<Symbol>& s = id_cache_.get(id)) {
-    return s.get();
+    return Retain(s);
   }
 
   // We did not find it in the cache, so look through the sources.
@@ -137,7 +160,7 @@ const SymbolTable::Symbol* SymbolTable::FindById(const ResourceId& id) {
 
   // Returns the raw pointer. Callers are not expected to hold on to this
   // between calls to Find*.
-  return shared_symbol.get();
+  return Retain(shared_symbol);
 }
 
 const SymbolTable::Symbol* SymbolTable::FindByReference(const Reference& ref) {
@@ -217,13 +240,40 @@ std::unique_ptr<SymbolTable::Symbol> ResourceTableSymbolSource::FindByName(
   return symbol;
 }
 
+std::shared_ptr<const ApkAssets> ApkAssetsCache::Load(const std::string& path) {
+  TRACE_CALL();
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) {
+    return {};
+  }
+
+  std::lock_guard<std::mutex> lock(lock_);
+  auto iter = entries_.find(path);
+  if (iter != entries_.end() && iter->second.size == st.st_size &&
+      iter->second.mtime == st.st_mtime) {
+    return iter->second.apk_assets;
+  }
+
+  std::shared_ptr<const ApkAssets> apk_assets = ApkAssets::Load(path);
+  if (apk_assets == nullptr) {
+    entries_.erase(path);
+    return {};
+  }
+  entries_[path] = Entry{st.st_size, st.st_mtime, apk_assets};
+  return apk_assets;
+}
+
 bool AssetManagerSymbolSource::AddAssetPath(const StringPiece& path) {
   TRACE_CALL();
-  if (std::unique_ptr<const ApkAssets> apk = ApkAssets::Load(path.data())) {
+  std::shared_ptr<const ApkAssets> apk = apk_assets_cache_ != nullptr
+                                             ? apk_assets_cache_->Load(path.to_string())
+                                             : std::shared_ptr<const ApkAssets>(
+                                                   ApkAssets::Load(path.data()));
+  if (apk != nullptr) {
     apk_assets_.push_back(std::move(apk));
 
     std::vector<const ApkAssets*> apk_assets;
-    for (const std::unique_ptr<const ApkAssets>& apk_asset : apk_assets_) {
+    for (const std::shared_ptr<const ApkAssets>& apk_asset : apk_assets_) {
       apk_assets.push_back(apk_asset.get());
     }
 
@@ -250,7 +300,7 @@ bool AssetManagerSymbolSource::IsPackageDynamic(uint32_t packageId) const {
     return true;
   }
 
-  for (const std::unique_ptr<const ApkAssets>& assets : apk_assets_) {
+  for (const std::shared_ptr<const ApkAssets>& assets : apk_assets_) {
     for (const std::unique_ptr<const android::LoadedPackage>& loaded_package
          : assets->GetLoadedArsc()->GetPackages()) {
       if (packageId == loaded_package->GetPackageId() && loaded_package->IsDynamic()) {
@@ -18,7 +18,11 @@
 #define AAPT_PROCESS_SYMBOLTABLE_H
 
 #include <algorithm>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
 #include <vector>
 
 #include "android-base/macros.h"
@@ -72,6 +76,20 @@ class SymbolTable {
     bool is_dynamic = false;
   };
 
+  // While an instance exists, the FindByXXX methods of `table` may be called from several threads
+  // at once, and the symbols they return stay valid until it is destroyed. Sources and the
+  // delegate must not be changed in the meantime.
+  class ConcurrentLookups {
+   public:
+    explicit ConcurrentLookups(SymbolTable* table);
+    ~ConcurrentLookups();
+
+   private:
+    DISALLOW_COPY_AND_ASSIGN(ConcurrentLookups);
+
+    SymbolTable* table_;
+  };
+
   explicit SymbolTable(NameMangler* mangler);
 
   // Overrides the default ISymbolTableDelegate, which allows a custom defined strategy for
@@ -110,6 +128,16 @@ class SymbolTable {
   android::LruCache<ResourceName, std::shared_ptr<Symbol>> cache_;
   android::LruCache<ResourceId, std::shared_ptr<Symbol>> id_cache_;
 
+  // Returns the raw pointer of `symbol`, keeping the symbol alive if there are concurrent lookups.
+  const Symbol* Retain(const std::shared_ptr<Symbol>& symbol);
+
+  // Guards the caches and the sources, and everything below.
+  std::mutex lock_;
+  int concurrent_lookups_ = 0;
+  // The symbols returned during concurrent lookups. Another thread may evict them from the
+  // caches while they are still in use.
+  std::unordered_set<std::shared_ptr<Symbol>> retained_;
+
   DISALLOW_COPY_AND_ASSIGN(SymbolTable);
 };
 
@@ -188,9 +216,34 @@ class ResourceTableSymbolSource : public ISymbolSource {
   DISALLOW_COPY_AND_ASSIGN(ResourceTableSymbolSource);
 };
 
+// Keeps included APKs loaded across the commands run by an aapt2 daemon, so that each link does
+// not parse android.jar again. An APK is loaded again once its size or modification time changes.
+class ApkAssetsCache {
+ public:
+  ApkAssetsCache() = default;
+
+  // Returns the APK at `path`, or nullptr if it can not be loaded.
+  std::shared_ptr<const android::ApkAssets> Load(const std::string& path);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ApkAssetsCache);
+
+  struct Entry {
+    int64_t size;
+    int64_t mtime;
+    std::shared_ptr<const android::ApkAssets> apk_assets;
+  };
+
+  std::mutex lock_;
+  std::map<std::string, Entry> entries_;
+};
+
 class AssetManagerSymbolSource : public ISymbolSource {
  public:
-  AssetManagerSymbolSource() = default;
+  // APKs are loaded through `apk_assets_cache` when it is set.
+  explicit AssetManagerSymbolSource(ApkAssetsCache* apk_assets_cache = nullptr)
+      : apk_assets_cache_(apk_assets_cache) {
+  }
 
   bool AddAssetPath(const android::StringPiece& path);
   std::map<size_t, std::string> GetAssignedPackageIds() const;
@@ -207,8 +260,9 @@ class AssetManagerSymbolSource : public ISymbolSource {
   }
 
  private:
+  ApkAssetsCache* apk_assets_cache_;
   android::AssetManager2 asset_manager_;
-  std::vector<std::unique_ptr<const android::ApkAssets>> apk_assets_;
+  std::vector<std::shared_ptr<const android::ApkAssets>> apk_assets_;
 
   DISALLOW_COPY_AND_ASSIGN(AssetManagerSymbolSource);
 };
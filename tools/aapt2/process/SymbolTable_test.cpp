@@ -134,4 +134,47 @@ TEST_F(SymbolTableTestFixture, FindByNameWhenSymbolIsMangledInResTable) {
   EXPECT_THAT(symbol_table.FindByName(test::ParseNameOrDie("com.android.other:id/foo")), IsNull());
 }
 
+TEST_F(SymbolTableTestFixture, ApkAssetsCacheReloadsChangedApk) {
+  StdErrDiagnostics diag;
+  const std::string compiled_files_dir = GetTestPath("compiled");
+  ASSERT_TRUE(CompileFile(GetTestPath("res/values/values.xml"),
+      R"(<?xml version="1.0" encoding="utf-8"?>
+         <resources>
+             <item type="id" name="foo"/>
+        </resources>)",
+        compiled_files_dir, &diag));
+
+  const std::string apk_path = GetTestPath("lib.apk");
+  const std::vector<std::string> link_args = {
+      "--manifest", GetDefaultManifest("com.android.lib"),
+      "-o", apk_path,
+  };
+  ASSERT_TRUE(Link(link_args, compiled_files_dir, &diag));
+
+  ApkAssetsCache cache;
+  std::shared_ptr<const android::ApkAssets> apk_assets = cache.Load(apk_path);
+  ASSERT_THAT(apk_assets, NotNull());
+  EXPECT_THAT(cache.Load(apk_path), Eq(apk_assets));
+
+  ASSERT_TRUE(CompileFile(GetTestPath("res/values/values.xml"),
+      R"(<?xml version="1.0" encoding="utf-8"?>
+         <resources>
+             <item type="id" name="foo"/>
+             <item type="id" name="bar"/>
+        </resources>)",
+        compiled_files_dir, &diag));
+  ASSERT_TRUE(Link(link_args, compiled_files_dir, &diag));
+
+  std::shared_ptr<const android::ApkAssets> reloaded_apk_assets = cache.Load(apk_path);
+  ASSERT_THAT(reloaded_apk_assets, NotNull());
+  EXPECT_THAT(reloaded_apk_assets, Ne(apk_assets));
+
+  auto asset_manager_source = util::make_unique<AssetManagerSymbolSource>(&cache);
+  ASSERT_TRUE(asset_manager_source->AddAssetPath(apk_path));
+  EXPECT_THAT(asset_manager_source->FindByName(test::ParseNameOrDie("com.android.lib:id/bar")),
+              NotNull());
+
+  EXPECT_THAT(cache.Load(GetTestPath("missing.apk")), IsNull());
+}
+
 }  // namespace aapt
@@ -16,9 +16,14 @@
 
 #include "TraceBuffer.h"
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <map>
+#include <mutex>
 #include <sstream>
 #include <unistd.h>
+#include <utility>
 #include <vector>
 
 #include <inttypes.h>
@@ -34,15 +39,30 @@ namespace {
 
 constexpr char kBegin = 'B';
 constexpr char kEnd = 'E';
+constexpr char kCounter = 'C';
 
 struct TracePoint {
-  pid_t tid;
+  int tid;
   int64_t time;
   std::string tag;
   char type;
+  // The running total of a counter.
+  int64_t value;
 };
 
-std::vector<TracePoint> traces;
+// The number of FlushTraces writing to a folder.
+std::atomic<int> recording(0);
+
+std::mutex traces_lock;
+std::vector<TracePoint> traces;  // Guarded by traces_lock.
+std::map<std::string, int64_t> counters;  // Guarded by traces_lock.
+
+// A small id per thread, so that the begin and end events of each thread pair up.
+int GetThreadId() noexcept {
+  static std::atomic<int> next_id(0);
+  thread_local int id = next_id++;
+  return id;
+}
 
 int64_t GetTime() noexcept {
   auto now = std::chrono::steady_clock::now();
@@ -51,8 +71,13 @@ int64_t GetTime() noexcept {
 
 } // namespace anonymous
 
+bool IsRecording() noexcept {
+  return recording.load(std::memory_order_relaxed) > 0;
+}
+
 void AddWithTime(const std::string& tag, char type, int64_t time) noexcept {
-  TracePoint t = {getpid(), time, tag, type};
+  TracePoint t = {GetThreadId(), time, tag, type, 0};
+  std::lock_guard<std::mutex> lock(traces_lock);
   traces.emplace_back(t);
 }
 
@@ -60,8 +85,57 @@ void Add(const std::string& tag, char type) noexcept {
   AddWithTime(tag, type, GetTime());
 }
 
+void AddToCounter(const char* name, int64_t value) noexcept {
+  const int64_t time = GetTime();
+  std::lock_guard<std::mutex> lock(traces_lock);
+  int64_t& total = counters[name];
+  total += value;
+  traces.push_back(TracePoint{GetThreadId(), time, name, kCounter, total});
+}
+
+// Writes the total time spent in the events of each tag, longest first, and the total of each
+// counter. Nested events of the same tag are counted once each.
+void WriteSummary(FILE* f) {
+  struct Totals {
+    int64_t time = 0;
+    int64_t count = 0;
+  };
+  std::map<std::string, Totals> totals;
+  std::map<int, std::vector<const TracePoint*>> open_events;
+  for (const TracePoint& trace : traces) {
+    if (trace.type == kBegin) {
+      open_events[trace.tid].push_back(&trace);
+    } else if (trace.type == kEnd) {
+      std::vector<const TracePoint*>& stack = open_events[trace.tid];
+      if (!stack.empty()) {
+        Totals& tag_totals = totals[stack.back()->tag];
+        tag_totals.time += trace.time - stack.back()->time;
+        tag_totals.count++;
+        stack.pop_back();
+      }
+    }
+  }
 
+  std::vector<std::pair<std::string, Totals>> sorted_totals(totals.begin(), totals.end());
+  std::stable_sort(sorted_totals.begin(), sorted_totals.end(),
+                   [](const std::pair<std::string, Totals>& a,
+                      const std::pair<std::string, Totals>& b) {
+                     return a.second.time > b.second.time;
+                   });
+
+  fprintf(f, "%12s %10s  %s\n", "total ms", "count", "event");
+  for (const auto& tag_totals : sorted_totals) {
+    fprintf(f, "%12.3f %10" PRId64 "  %s\n", tag_totals.second.time / 1000.0,
+            tag_totals.second.count, tag_totals.first.c_str());
+  }
 
+  if (!counters.empty()) {
+    fprintf(f, "\n%23s  %s\n", "total", "counter");
+    for (const auto& counter : counters) {
+      fprintf(f, "%23" PRId64 "  %s\n", counter.second, counter.first.c_str());
+    }
+  }
+}
 
 void Flush(const std::string& basePath) {
   TRACE_CALL();
@@ -70,35 +144,66 @@ void Flush(const std::string& basePath) {
   }
 
   std::stringstream s;
-  s << basePath << aapt::file::sDirSep << "report_aapt2_" << getpid() << ".json";
-  FILE* f = android::base::utf8::fopen(s.str().c_str(), "a");
+  s << basePath << aapt::file::sDirSep << "report_aapt2_" << getpid();
+  FILE* f = android::base::utf8::fopen((s.str() + ".json").c_str(), "a");
   if (f == nullptr) {
     return;
   }
 
+  std::lock_guard<std::mutex> lock(traces_lock);
   for(const TracePoint& trace : traces) {
+    if (trace.type == kCounter) {
+      fprintf(f, "{\"ts\" : \"%" PRIu64 "\", \"ph\" : \"%c\", \"tid\" : \"%d\" , \"pid\" : \"%d\", "
+              "\"name\" : \"%s\", \"args\" : { \"value\" : %" PRId64 " } },\n", trace.time,
+              trace.type, trace.tid, getpid(), trace.tag.c_str(), trace.value);
+      continue;
+    }
     fprintf(f, "{\"ts\" : \"%" PRIu64 "\", \"ph\" : \"%c\", \"tid\" : \"%d\" , \"pid\" : \"%d\", "
-            "\"name\" : \"%s\" },\n", trace.time, trace.type, 0, trace.tid, trace.tag.c_str());
+            "\"name\" : \"%s\" },\n", trace.time, trace.type, trace.tid, getpid(),
+            trace.tag.c_str());
   }
   fclose(f);
+
+  f = android::base::utf8::fopen((s.str() + "_summary.txt").c_str(), "a");
+  if (f != nullptr) {
+    WriteSummary(f);
+    fclose(f);
+  }
   traces.clear();
+  counters.clear();
 }
 
 } // namespace tracebuffer
 
 void BeginTrace(const std::string& tag) {
-  tracebuffer::Add(tag, tracebuffer::kBegin);
+  if (tracebuffer::IsRecording()) {
+    tracebuffer::Add(tag, tracebuffer::kBegin);
+  }
 }
 
 void EndTrace() {
-  tracebuffer::Add("", tracebuffer::kEnd);
+  if (tracebuffer::IsRecording()) {
+    tracebuffer::Add("", tracebuffer::kEnd);
+  }
+}
+
+void TraceCounter(const char* name, int64_t value) {
+  if (tracebuffer::IsRecording()) {
+    tracebuffer::AddToCounter(name, value);
+  }
 }
 
-Trace::Trace(const std::string& tag) {
-  tracebuffer::Add(tag, tracebuffer::kBegin);
+Trace::Trace(const std::string& tag) : recorded_(tracebuffer::IsRecording()) {
+  if (recorded_) {
+    tracebuffer::Add(tag, tracebuffer::kBegin);
+  }
 }
 
-Trace::Trace(const std::string& tag, const std::vector<android::StringPiece>& args) {
+Trace::Trace(const std::string& tag, const std::vector<android::StringPiece>& args)
+    : recorded_(tracebuffer::IsRecording()) {
+  if (!recorded_) {
+    return;
+  }
   std::stringstream s;
   s << tag;
   s << " ";
@@ -110,16 +215,29 @@ Trace::Trace(const std::string& tag, const std::vector<android::StringPiece>& ar
 }
 
 Trace::~Trace() {
-  tracebuffer::Add("", tracebuffer::kEnd);
+  if (recorded_) {
+    tracebuffer::Add("", tracebuffer::kEnd);
+  }
 }
 
 FlushTrace::FlushTrace(const std::string& basepath, const std::string& tag)
     : basepath_(basepath)  {
-  tracebuffer::Add(tag, tracebuffer::kBegin);
+  if (!basepath_.empty()) {
+    tracebuffer::recording++;
+  }
+  if (tracebuffer::IsRecording()) {
+    tracebuffer::Add(tag, tracebuffer::kBegin);
+  }
 }
 
 FlushTrace::FlushTrace(const std::string& basepath, const std::string& tag,
     const std::vector<android::StringPiece>& args) : basepath_(basepath) {
+  if (!basepath_.empty()) {
+    tracebuffer::recording++;
+  }
+  if (!tracebuffer::IsRecording()) {
+    return;
+  }
   std::stringstream s;
   s << tag;
   s << " ";
@@ -132,6 +250,12 @@ FlushTrace::FlushTrace(const std::string& basepath, const std::string& tag,
 
 FlushTrace::FlushTrace(const std::string& basepath, const std::string& tag,
     const std::vector<std::string>& args) : basepath_(basepath){
+  if (!basepath_.empty()) {
+    tracebuffer::recording++;
+  }
+  if (!tracebuffer::IsRecording()) {
+    return;
+  }
   std::stringstream s;
   s << tag;
   s << " ";
@@ -143,8 +267,13 @@ FlushTrace::FlushTrace(const std::string& basepath, const std::string& tag,
 }
 
 FlushTrace::~FlushTrace() {
-  tracebuffer::Add("", tracebuffer::kEnd);
+  if (tracebuffer::IsRecording()) {
+    tracebuffer::Add("", tracebuffer::kEnd);
+  }
   tracebuffer::Flush(basepath_);
+  if (!basepath_.empty()) {
+    tracebuffer::recording--;
+  }
 }
 
 } // namespace aapt
@@ -17,6 +17,7 @@
 #ifndef AAPT_TRACEBUFFER_H
 #define AAPT_TRACEBUFFER_H
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -26,7 +27,8 @@ namespace aapt {
 
 // Record timestamps for beginning and end of a task and generate systrace json fragments.
 // This is an in-process ftrace which has the advantage of being platform independent.
-// These methods are NOT thread-safe since aapt2 is not multi-threaded.
+// Events are recorded per thread, so these methods may be called from any thread.
+// Nothing is recorded unless a FlushTrace with a folder to write to is alive.
 
 // Convenience RIAA object to automatically finish an event when object goes out of scope.
 class Trace {
@@ -34,14 +36,22 @@ public:
   Trace(const std::string& tag);
   Trace(const std::string& tag, const std::vector<android::StringPiece>& args);
   ~Trace();
+private:
+  // Whether the beginning of the event was recorded, so that its end is recorded too.
+  bool recorded_;
 };
 
 // Manual markers.
 void BeginTrace(const std::string& tag);
 void EndTrace();
 
+// Adds `value` to the counter `name`, which must be a string literal. Counters are written as
+// counter events that show their running total, and summed up in the summary of the trace.
+void TraceCounter(const char* name, int64_t value);
+
 // A master trace is required to flush events to disk. Events are formatted in systrace
-// json format.
+// json format, to report_aapt2_<pid>.json in the folder. The total time spent in each kind of
+// event and the total of each counter are written to report_aapt2_<pid>_summary.txt.
 class FlushTrace {
 public:
   explicit FlushTrace(const std::string& basepath, const std::string& tag);
@@ -57,6 +67,7 @@ private:
 #define TRACE_CALL() Trace __t(__func__)
 #define TRACE_NAME(tag) Trace __t(tag)
 #define TRACE_NAME_ARGS(tag, args) Trace __t(tag, args)
+#define TRACE_COUNTER(name, value) TraceCounter(name, value)
 
 #define TRACE_FLUSH(basename, tag) FlushTrace __t(basename, tag)
 #define TRACE_FLUSH_ARGS(basename, tag, args) FlushTrace __t(basename, tag, args)
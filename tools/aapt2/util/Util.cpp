@@ -17,8 +17,10 @@
 #include "util/Util.h"
 
 #include <algorithm>
+#include <atomic>
 #include <ostream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "android-base/stringprintf.h"
@@ -202,6 +204,41 @@ Maybe<std::string> GetFullyQualifiedClassName(const StringPiece& package,
   return result;
 }
 
+void ParallelFor(size_t count, size_t thread_count, const std::function<void(size_t)>& f) {
+  thread_count = std::min(thread_count, count);
+  if (thread_count <= 1) {
+    for (size_t i = 0; i < count; i++) {
+      f(i);
+    }
+    return;
+  }
+
+  std::atomic<size_t> next(0u);
+  auto worker = [&]() {
+    size_t i;
+    while ((i = next.fetch_add(1u)) < count) {
+      f(i);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < thread_count; i++) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
+uint64_t Fnv1aHash(const StringPiece& data, uint64_t hash) {
+  for (char c : data) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 0x100000001b3u;
+  }
+  return hash;
+}
+
 const char* GetToolName() {
   static const char* const sToolName = "Android Asset Packaging Tool (aapt)";
   return sToolName;
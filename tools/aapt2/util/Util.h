@@ -98,6 +98,15 @@ bool IsAndroidSplitName(const android::StringPiece& str);
 Maybe<std::string> GetFullyQualifiedClassName(const android::StringPiece& package,
                                               const android::StringPiece& class_name);
 
+// Calls `f` with every index in [0, count), on up to `thread_count` threads including the calling
+// one. Each thread takes the next index as soon as it is done with the last one. Returns once
+// every call has returned.
+void ParallelFor(size_t count, size_t thread_count, const std::function<void(size_t)>& f);
+
+// Returns the 64-bit FNV-1a hash of `data`, continuing from `hash`. It is the same on every host,
+// so it can key files that outlive the process.
+uint64_t Fnv1aHash(const android::StringPiece& data, uint64_t hash = 0xcbf29ce484222325u);
+
 // Retrieves the formatted name of aapt2.
 const char* GetToolName();
 
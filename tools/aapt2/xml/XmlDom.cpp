@@ -18,10 +18,12 @@
 
 #include <expat.h>
 
+#include <algorithm>
 #include <memory>
 #include <stack>
 #include <string>
 #include <tuple>
+#include <vector>
 
 #include "android-base/logging.h"
 
@@ -41,7 +43,7 @@ constexpr char kXmlNamespaceSep = 1;
 
 struct Stack {
   std::unique_ptr<xml::Element> root;
-  std::stack<xml::Element*> node_stack;
+  std::stack<xml::Element*, std::vector<xml::Element*>> node_stack;
   std::unique_ptr<xml::Element> pending_element;
   std::string pending_comment;
   std::unique_ptr<xml::Text> last_text_node;
@@ -121,6 +123,12 @@ static void XMLCALL StartElementHandler(void* user_data, const char* name, const
 
   SplitName(name, &el->namespace_uri, &el->name);
 
+  size_t attr_count = 0u;
+  while (attrs[attr_count * 2] != nullptr) {
+    attr_count++;
+  }
+  el->attributes.reserve(attr_count);
+
   while (*attrs) {
     Attribute attribute;
     SplitName(*attrs++, &attribute.namespace_uri, &attribute.name);
@@ -128,8 +136,10 @@ static void XMLCALL StartElementHandler(void* user_data, const char* name, const
     el->attributes.push_back(std::move(attribute));
   }
 
-  // Sort the attributes.
-  std::sort(el->attributes.begin(), el->attributes.end(), less_attribute);
+  // Sort the attributes. Most files already list them in order.
+  if (!std::is_sorted(el->attributes.begin(), el->attributes.end(), less_attribute)) {
+    std::sort(el->attributes.begin(), el->attributes.end(), less_attribute);
+  }
 
   // Add to the stack.
   Element* this_el = el.get();
@@ -220,32 +230,54 @@ std::unique_ptr<XmlResource> Inflate(InputStream* in, IDiagnostics* diag, const
                                         StringPool{}, std::move(stack.root));
 }
 
-static void CopyAttributes(Element* el, android::ResXMLParser* parser, StringPool* out_pool) {
+namespace {
+
+// Decodes the strings of a binary XML string pool to UTF-8 on first use. Element names,
+// attribute names and namespace URIs repeat throughout a document, and are only decoded once.
+class DecodedStringPool {
+ public:
+  explicit DecodedStringPool(const android::ResStringPool& pool)
+      : pool_(pool), strings_(pool.size()) {
+  }
+
+  // Returns the string at `idx`, or an empty string if there is none.
+  const std::string& Get(int32_t idx) {
+    if (idx < 0 || static_cast<size_t>(idx) >= strings_.size()) {
+      return empty_;
+    }
+    Maybe<std::string>& str = strings_[idx];
+    if (!str) {
+      str = util::GetString(pool_, idx);
+    }
+    return str.value();
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(DecodedStringPool);
+
+  const android::ResStringPool& pool_;
+  std::vector<Maybe<std::string>> strings_;
+  const std::string empty_;
+};
+
+}  // namespace
+
+static void CopyAttributes(Element* el, android::ResXMLParser* parser, DecodedStringPool* strings,
+                           StringPool* out_pool) {
   const size_t attr_count = parser->getAttributeCount();
   if (attr_count > 0) {
     el->attributes.reserve(attr_count);
     for (size_t i = 0; i < attr_count; i++) {
       Attribute attr;
-      size_t len;
-      const char16_t* str16 = parser->getAttributeNamespace(i, &len);
-      if (str16) {
-        attr.namespace_uri = util::Utf16ToUtf8(StringPiece16(str16, len));
-      }
-
-      str16 = parser->getAttributeName(i, &len);
-      if (str16) {
-        attr.name = util::Utf16ToUtf8(StringPiece16(str16, len));
-      }
+      attr.namespace_uri = strings->Get(parser->getAttributeNamespaceID(i));
+      attr.name = strings->Get(parser->getAttributeNameID(i));
 
       uint32_t res_id = parser->getAttributeNameResID(i);
       if (res_id > 0) {
         attr.compiled_attribute = AaptAttribute(::aapt::Attribute(), {res_id});
       }
 
-      str16 = parser->getAttributeStringValue(i, &len);
-      if (str16) {
-        attr.value = util::Utf16ToUtf8(StringPiece16(str16, len));
-      }
+      attr.value = strings->Get(parser->getAttributeValueStringID(i));
 
       android::Res_value res_value;
       if (parser->getAttributeValue(i, &res_value) > 0) {
@@ -272,7 +304,7 @@ std::unique_ptr<XmlResource> Inflate(const void* data, size_t len, std::string*
 
   std::unique_ptr<XmlResource> xml_resource = util::make_unique<XmlResource>();
 
-  std::stack<Element*> node_stack;
+  std::stack<Element*, std::vector<Element*>> node_stack;
   std::unique_ptr<Element> pending_element;
 
   ResXMLTree tree;
@@ -283,6 +315,7 @@ std::unique_ptr<XmlResource> Inflate(const void* data, size_t len, std::string*
     return {};
   }
 
+  DecodedStringPool strings(tree.getStrings());
   ResXMLParser::event_code_t code;
   while ((code = tree.next()) != ResXMLParser::BAD_DOCUMENT && code != ResXMLParser::END_DOCUMENT) {
     std::unique_ptr<Node> new_node;
@@ -290,17 +323,8 @@ std::unique_ptr<XmlResource> Inflate(const void* data, size_t len, std::string*
       case ResXMLParser::START_NAMESPACE: {
         NamespaceDecl decl;
         decl.line_number = tree.getLineNumber();
-
-        size_t len;
-        const char16_t* str16 = tree.getNamespacePrefix(&len);
-        if (str16) {
-          decl.prefix = util::Utf16ToUtf8(StringPiece16(str16, len));
-        }
-
-        str16 = tree.getNamespaceUri(&len);
-        if (str16) {
-          decl.uri = util::Utf16ToUtf8(StringPiece16(str16, len));
-        }
+        decl.prefix = strings.Get(tree.getNamespacePrefixID());
+        decl.uri = strings.Get(tree.getNamespaceUriID());
 
         if (pending_element == nullptr) {
           pending_element = util::make_unique<Element>();
@@ -319,20 +343,11 @@ std::unique_ptr<XmlResource> Inflate(const void* data, size_t len, std::string*
           el = util::make_unique<Element>();
         }
         el->line_number = tree.getLineNumber();
-
-        size_t len;
-        const char16_t* str16 = tree.getElementNamespace(&len);
-        if (str16) {
-          el->namespace_uri = util::Utf16ToUtf8(StringPiece16(str16, len));
-        }
-
-        str16 = tree.getElementName(&len);
-        if (str16) {
-          el->name = util::Utf16ToUtf8(StringPiece16(str16, len));
-        }
+        el->namespace_uri = strings.Get(tree.getElementNamespaceID());
+        el->name = strings.Get(tree.getElementNameID());
 
         Element* this_el = el.get();
-        CopyAttributes(el.get(), &tree, &xml_resource->string_pool);
+        CopyAttributes(el.get(), &tree, &strings, &xml_resource->string_pool);
 
         if (!node_stack.empty()) {
           node_stack.top()->AppendChild(std::move(el));
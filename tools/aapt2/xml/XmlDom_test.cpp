@@ -110,6 +110,43 @@ TEST(XmlDomTest, BinaryInflate) {
   EXPECT_THAT(new_doc->root->namespace_decls[0].line_number, Eq(2u));
 }
 
+TEST(XmlDomTest, BinaryInflateRepeatedNames) {
+  std::unique_ptr<IAaptContext> context = test::ContextBuilder().Build();
+  std::unique_ptr<XmlResource> doc = test::BuildXmlDom(R"(
+      <LinearLayout xmlns:android="http://schemas.android.com/apk/res/android">
+        <TextView android:text="first" android:hint="first" />
+        <TextView android:text="second" android:hint="hint" />
+      </LinearLayout>)");
+
+  BigBuffer buffer(1024);
+  XmlFlattenerOptions options;
+  options.keep_raw_values = true;
+  XmlFlattener flattener(&buffer, options);
+  ASSERT_TRUE(flattener.Consume(context.get(), doc.get()));
+
+  auto block = util::Copy(buffer);
+  std::unique_ptr<XmlResource> new_doc = Inflate(block.get(), buffer.size(), nullptr);
+  ASSERT_THAT(new_doc, NotNull());
+
+  std::vector<Element*> children = new_doc->root->GetChildElements();
+  ASSERT_THAT(children, SizeIs(2u));
+  EXPECT_THAT(children[0]->name, StrEq("TextView"));
+  EXPECT_THAT(children[1]->name, StrEq("TextView"));
+
+  const Attribute* attr = children[0]->FindAttribute(kSchemaAndroid, "hint");
+  ASSERT_THAT(attr, NotNull());
+  EXPECT_THAT(attr->value, StrEq("first"));
+  attr = children[0]->FindAttribute(kSchemaAndroid, "text");
+  ASSERT_THAT(attr, NotNull());
+  EXPECT_THAT(attr->value, StrEq("first"));
+  attr = children[1]->FindAttribute(kSchemaAndroid, "hint");
+  ASSERT_THAT(attr, NotNull());
+  EXPECT_THAT(attr->value, StrEq("hint"));
+  attr = children[1]->FindAttribute(kSchemaAndroid, "text");
+  ASSERT_THAT(attr, NotNull());
+  EXPECT_THAT(attr->value, StrEq("second"));
+}
+
 // Escaping is handled after parsing of the values for resource-specific values.
 TEST(XmlDomTest, ForwardEscapes) {
   std::unique_ptr<XmlResource> doc = test::BuildXmlDom(R"(
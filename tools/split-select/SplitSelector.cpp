@@ -36,8 +36,7 @@ SplitSelector::SplitSelector(const Vector<SplitDescription>& splits)
 
 static void selectBestFromGroup(const SortedVector<SplitDescription>& splits,
         const SplitDescription& target, Vector<SplitDescription>& splitsOut) {
-    SplitDescription bestSplit;
-    bool isSet = false;
+    const SplitDescription* bestSplit = NULL;
     const size_t splitCount = splits.size();
     for (size_t j = 0; j < splitCount; j++) {
         const SplitDescription& thisSplit = splits[j];
@@ -45,14 +44,13 @@ static void selectBestFromGroup(const SortedVector<SplitDescription>& splits,
             continue;
         }
 
-        if (!isSet || thisSplit.isBetterThan(bestSplit, target)) {
-            isSet = true;
-            bestSplit = thisSplit;
+        if (bestSplit == NULL || thisSplit.isBetterThan(*bestSplit, target)) {
+            bestSplit = &thisSplit;
         }
     }
 
-    if (isSet) {
-        splitsOut.add(bestSplit);
+    if (bestSplit != NULL) {
+        splitsOut.add(*bestSplit);
     }
 }
 
@@ -65,6 +63,28 @@ Vector<SplitDescription> SplitSelector::getBestSplits(const SplitDescription& ta
     return bestSplits;
 }
 
+Vector<Vector<SplitDescription> > SplitSelector::getBestSplits(
+        const Vector<SplitDescription>& targets) const {
+    // Many targets usually share a configuration, so index the distinct ones
+    // and only run the selection once for each of them.
+    KeyedVector<SplitDescription, size_t> distinctTargets;
+    Vector<Vector<SplitDescription> > distinctResults;
+    const size_t targetCount = targets.size();
+    for (size_t i = 0; i < targetCount; i++) {
+        if (distinctTargets.indexOfKey(targets[i]) < 0) {
+            distinctTargets.add(targets[i], distinctResults.size());
+            distinctResults.add(getBestSplits(targets[i]));
+        }
+    }
+
+    Vector<Vector<SplitDescription> > results;
+    results.setCapacity(targetCount);
+    for (size_t i = 0; i < targetCount; i++) {
+        results.add(distinctResults[distinctTargets.valueFor(targets[i])]);
+    }
+    return results;
+}
+
 KeyedVector<SplitDescription, sp<Rule> > SplitSelector::getRules() const {
     KeyedVector<SplitDescription, sp<Rule> > rules;
 
@@ -33,6 +33,13 @@ public:
 
     android::Vector<SplitDescription> getBestSplits(const SplitDescription& target) const;
 
+    /**
+     * Selects the best splits for each of the targets, in the order of the targets.
+     * Targets that describe the same configuration are only evaluated once.
+     */
+    android::Vector<android::Vector<SplitDescription> > getBestSplits(
+            const android::Vector<SplitDescription>& targets) const;
+
     android::KeyedVector<SplitDescription, android::sp<Rule> > getRules() const;
 
 private:
@@ -69,4 +69,29 @@ TEST(SplitSelectorTest, rulesShouldMatchSelection) {
     EXPECT_RULES_EQ(rule, expectedRule);
 }
 
+TEST(SplitSelectorTest, batchSelectionShouldMatchSingleSelection) {
+    Vector<SplitDescription> splits;
+    ASSERT_TRUE(addSplit(splits, "hdpi"));
+    ASSERT_TRUE(addSplit(splits, "xhdpi"));
+    ASSERT_TRUE(addSplit(splits, "de"));
+    ASSERT_TRUE(addSplit(splits, "fr"));
+
+    Vector<SplitDescription> targets;
+    ASSERT_TRUE(addSplit(targets, "de-hdpi"));
+    ASSERT_TRUE(addSplit(targets, "fr-xhdpi"));
+    ASSERT_TRUE(addSplit(targets, "de-hdpi"));
+    ASSERT_TRUE(addSplit(targets, "en-ldpi"));
+
+    SplitSelector selector(splits);
+    Vector<Vector<SplitDescription> > results = selector.getBestSplits(targets);
+    ASSERT_EQ(targets.size(), results.size());
+    for (size_t i = 0; i < targets.size(); i++) {
+        Vector<SplitDescription> expected = selector.getBestSplits(targets[i]);
+        ASSERT_EQ(expected.size(), results[i].size());
+        for (size_t j = 0; j < expected.size(); j++) {
+            EXPECT_EQ(expected[j], results[i][j]);
+        }
+    }
+}
+
 } // namespace split